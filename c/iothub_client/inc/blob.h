@@ -35,6 +35,18 @@ extern "C"
 
 DEFINE_ENUM(BLOB_RESULT, BLOB_RESULT_VALUES)
 
+/**
+* @brief	Reads the next bytes of the data uploaded by Blob_UploadFromSasUriWithReader
+*
+* @param	context         The context passed to Blob_UploadFromSasUriWithReader
+* @param	buffer          Receives the bytes read
+* @param	bufferSize      The number of bytes available at @p buffer
+* @param	bytesRead       Receives the number of bytes written at @p buffer, 0 at the end of the data
+*
+* @return	0 when @p bytesRead has been set, any other value fails the upload
+*/
+typedef int(*BLOB_READ_CALLBACK)(void* context, unsigned char* buffer, size_t bufferSize, size_t* bytesRead);
+
 /**
 * @brief	Synchronously uploads a byte array to blob storage
 *
@@ -48,6 +60,105 @@ DEFINE_ENUM(BLOB_RESULT, BLOB_RESULT_VALUES)
 */
 MOCKABLE_FUNCTION(, BLOB_RESULT, Blob_UploadFromSasUri,const char*, SASURI, const unsigned char*, source, size_t, size, unsigned int*, httpStatus, BUFFER_HANDLE, httpResponse)
 
+/**
+* @brief	Synchronously uploads a byte array to blob storage, putting up to @p maxConcurrentBlocks blocks at the same time
+*
+* @param	SASURI	                The URI to use to upload data
+* @param	source		            A pointer to the byte array to be uploaded (can be NULL, but then size needs to be zero)
+* @param	size		            The size of the data to be uploaded (can be 0)
+* @param	maxConcurrentBlocks     The maximum number of 4MB blocks uploaded at the same time, each on its own connection. Only byte arrays
+*                                   of 64MB and more are uploaded in blocks. 1 uploads the blocks one after another, like Blob_UploadFromSasUri.
+* @param    httpStatus              A pointer to an out argument receiving the HTTP status (available only when the return value is BLOB_OK)
+* @param    httpResponse            A BUFFER_HANDLE that receives the HTTP response from the server (available only when the return value is BLOB_OK)
+*
+* @return	A @c BLOB_RESULT. BLOB_OK means the blob has been uploaded successfully. Any other value indicates an error
+*/
+MOCKABLE_FUNCTION(, BLOB_RESULT, Blob_UploadFromSasUriWithConcurrency, const char*, SASURI, const unsigned char*, source, size_t, size, size_t, maxConcurrentBlocks, unsigned int*, httpStatus, BUFFER_HANDLE, httpResponse)
+
+/**
+* @brief	Synchronously uploads to blob storage the data read by @p getData, one 4MB block at a time
+*
+* @param	SASURI	                The URI to use to upload data
+* @param	getData		            Called until it reports the end of the data, never from more than one thread at a time
+* @param	context		            Passed to @p getData
+* @param	maxConcurrentBlocks     The maximum number of 4MB blocks uploaded at the same time, each on its own connection. Every
+*                                   block being uploaded needs 2 buffers of 4MB. 1 uploads the blocks one after another.
+* @param    httpStatus              A pointer to an out argument receiving the HTTP status (available only when the return value is BLOB_OK)
+* @param    httpResponse            A BUFFER_HANDLE that receives the HTTP response from the server (available only when the return value is BLOB_OK)
+*
+* @return	A @c BLOB_RESULT. BLOB_OK means the blob has been uploaded successfully. Any other value indicates an error
+*/
+MOCKABLE_FUNCTION(, BLOB_RESULT, Blob_UploadFromSasUriWithReader, const char*, SASURI, BLOB_READ_CALLBACK, getData, void*, context, size_t, maxConcurrentBlocks, unsigned int*, httpStatus, BUFFER_HANDLE, httpResponse)
+
+/**
+* @brief	Describes the blocks uploaded by a previous attempt of Blob_UploadFromSasUriWithReaderResumable and receives the
+*           blocks uploaded by this attempt. Block IDs are the 0 based indexes of the 4MB blocks of the data.
+*/
+typedef struct BLOB_UPLOAD_RESUME_TAG
+{
+    const unsigned char* isBlockUploaded;                           /*isBlockUploaded[blockID] != 0 when blockID was uploaded by a previous attempt*/
+    size_t blockCount;                                              /*the number of elements at isBlockUploaded, can be 0*/
+    void(*onBlockUploaded)(void* context, unsigned int blockID);    /*called, never concurrently, after blockID has been uploaded. Can be NULL*/
+    void* onBlockUploadedContext;
+}BLOB_UPLOAD_RESUME;
+
+/**
+* @brief	Synchronously uploads to blob storage the data read by @p getData, as Blob_UploadFromSasUriWithReader does, except
+*           that the blocks uploaded by a previous attempt are read but not uploaded again and a block that fails to
+*           reach storage is uploaded again, waiting longer before every retry.
+*
+* @param	SASURI	                The URI used by the previous attempt
+* @param	getData		            Called until it reports the end of the data, never from more than one thread at a time
+* @param	context		            Passed to @p getData
+* @param	maxConcurrentBlocks     The maximum number of 4MB blocks uploaded at the same time, each on its own connection
+* @param	resume                  The blocks uploaded by the previous attempt and the callback receiving the blocks uploaded by this one
+* @param    httpStatus              A pointer to an out argument receiving the HTTP status (available only when the return value is BLOB_OK)
+* @param    httpResponse            A BUFFER_HANDLE that receives the HTTP response from the server (available only when the return value is BLOB_OK)
+*
+* @return	A @c BLOB_RESULT. BLOB_OK means the blob has been uploaded successfully. Any other value indicates an error
+*/
+MOCKABLE_FUNCTION(, BLOB_RESULT, Blob_UploadFromSasUriWithReaderResumable, const char*, SASURI, BLOB_READ_CALLBACK, getData, void*, context, size_t, maxConcurrentBlocks, const BLOB_UPLOAD_RESUME*, resume, unsigned int*, httpStatus, BUFFER_HANDLE, httpResponse)
+
+/**
+* @brief	A connection to a storage host kept from one Blob_UploadFromSasUriOnConnection to the next
+*/
+typedef struct BLOB_CONNECTION_TAG* BLOB_CONNECTION_HANDLE;
+
+/**
+* @brief	Creates a connection that is not connected to any storage host yet
+*
+* @return	A @c BLOB_CONNECTION_HANDLE, or NULL on failure
+*/
+MOCKABLE_FUNCTION(, BLOB_CONNECTION_HANDLE, Blob_CreateConnection)
+
+/**
+* @brief	Closes the connection to the storage host, if any, and frees @p connection
+*
+* @param	connection	            The connection created by Blob_CreateConnection
+*/
+MOCKABLE_FUNCTION(, void, Blob_DestroyConnection, BLOB_CONNECTION_HANDLE, connection)
+
+/**
+* @brief	Synchronously uploads to blob storage as Blob_UploadFromSasUriWithConcurrency does when @p getData is NULL, as
+*           Blob_UploadFromSasUriWithReader does when @p getData is not NULL and as Blob_UploadFromSasUriWithReaderResumable
+*           does when @p resume is not NULL too. The connection to the storage host is taken from @p connection when the
+*           previous upload went to the same host, and is kept in @p connection unless the upload fails.
+*
+* @param	connection	            The connection created by Blob_CreateConnection
+* @param	SASURI	                The URI to use to upload data
+* @param	source		            The byte array to be uploaded when @p getData is NULL (can be NULL, but then size needs to be zero)
+* @param	size		            The size of @p source
+* @param	getData		            Reads the data to be uploaded, can be NULL
+* @param	context		            Passed to @p getData
+* @param	maxConcurrentBlocks     The maximum number of 4MB blocks uploaded at the same time
+* @param	resume                  The blocks uploaded by a previous attempt, NULL when the upload is not resumable
+* @param    httpStatus              A pointer to an out argument receiving the HTTP status (available only when the return value is BLOB_OK)
+* @param    httpResponse            A BUFFER_HANDLE that receives the HTTP response from the server (available only when the return value is BLOB_OK)
+*
+* @return	A @c BLOB_RESULT. BLOB_OK means the blob has been uploaded successfully. Any other value indicates an error
+*/
+MOCKABLE_FUNCTION(, BLOB_RESULT, Blob_UploadFromSasUriOnConnection, BLOB_CONNECTION_HANDLE, connection, const char*, SASURI, const unsigned char*, source, size_t, size, BLOB_READ_CALLBACK, getData, void*, context, size_t, maxConcurrentBlocks, const BLOB_UPLOAD_RESUME*, resume, unsigned int*, httpStatus, BUFFER_HANDLE, httpResponse)
+
 #ifdef __cplusplus
 }
 #endif
@@ -32,6 +32,18 @@ extern "C"
     DEFINE_ENUM(IOTHUB_CLIENT_FILE_UPLOAD_RESULT, IOTHUB_CLIENT_FILE_UPLOAD_RESULT_VALUES)
         typedef void(*IOTHUB_CLIENT_FILE_UPLOAD_CALLBACK)(IOTHUB_CLIENT_FILE_UPLOAD_RESULT result, void* userContextCallback);
 
+	/** @brief	This struct captures the state of the uploads accepted by IoTHubClient_UploadToBlobAsync
+	*			and IoTHubClient_UploadToBlobFromFileAsync that have not finished yet. */
+	typedef struct IOTHUB_CLIENT_UPLOAD_QUEUE_STATS_TAG
+	{
+		/** @brief	How many uploads are waiting for the uploading thread or being uploaded. */
+		size_t uploadCount;
+
+		/** @brief	The bytes copied from the sources of these uploads. Uploads from a file
+		*			count as 0 bytes, the file is not held in memory. */
+		size_t byteCount;
+	} IOTHUB_CLIENT_UPLOAD_QUEUE_STATS;
+
 	/**
 	* @brief	Creates a IoT Hub client for communication with an existing
 	* 			IoT Hub using the specified connection string parameter.
@@ -109,6 +121,30 @@ extern "C"
 	*/
 	extern IOTHUB_CLIENT_RESULT IoTHubClient_SendEventAsync(IOTHUB_CLIENT_HANDLE iotHubClientHandle, IOTHUB_MESSAGE_HANDLE eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void* userContextCallback);
 
+	/**
+	* @brief	Asynchronous call to send the message specified by @p eventMessageHandle
+	* 			without making a copy of it.
+	*
+	* @param	iotHubClientHandle		   	The handle created by a call to the create function.
+	* @param	eventMessageHandle		   	The handle to an IoT Hub message. On success the
+	* 										IoT Hub client owns the message and destroys it
+	* 										once @p eventConfirmationCallback has been called;
+	* 										the caller shall not use or destroy it afterwards.
+	* 										On failure the message still belongs to the caller.
+	* @param	eventConfirmationCallback  	The callback specified by the device for receiving
+	* 										confirmation of the delivery of the IoT Hub message.
+	* 										The user can specify a @c NULL value here to
+	* 										indicate that no callback is required.
+	* @param	userContextCallback			User specified context that will be provided to the
+	* 										callback. This can be @c NULL.
+	*
+	*			@b NOTE: The application behavior is undefined if the user calls
+	*			the ::IoTHubClient_Destroy function from within any callback.
+	*
+	* @return	IOTHUB_CLIENT_OK upon success or an error code upon failure.
+	*/
+	extern IOTHUB_CLIENT_RESULT IoTHubClient_SendEventAsyncTakeOwnership(IOTHUB_CLIENT_HANDLE iotHubClientHandle, IOTHUB_MESSAGE_HANDLE eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void* userContextCallback);
+
 	/**
 	* @brief	This function returns the current sending status for IoTHubClient.
 	*
@@ -123,6 +159,17 @@ extern "C"
 	*/
 	extern IOTHUB_CLIENT_RESULT IoTHubClient_GetSendStatus(IOTHUB_CLIENT_HANDLE iotHubClientHandle, IOTHUB_CLIENT_STATUS *iotHubClientStatus);
 
+	/**
+	* @brief	This function returns the state of the queue of messages waiting to be sent.
+	*
+	* @param	iotHubClientHandle		The handle created by a call to the create function.
+	* @param	stats					The queue state is populated at the address pointed
+	* 									at by this parameter.
+	*
+	* @return	IOTHUB_CLIENT_OK upon success or an error code upon failure.
+	*/
+	extern IOTHUB_CLIENT_RESULT IoTHubClient_GetSendQueueStats(IOTHUB_CLIENT_HANDLE iotHubClientHandle, IOTHUB_CLIENT_SEND_QUEUE_STATS* stats);
+
 	/**
 	* @brief	Sets up the message callback to be invoked when IoT Hub issues a
 	* 			message to the device. This is a blocking call.
@@ -190,6 +237,50 @@ extern "C"
 	*				- @b messageTimeout - the maximum time in milliseconds until a message
 	*                 is timeouted. The time starts at IoTHubClient_SendEventAsync. By default,
 	*                 messages do not expire. @p is a pointer to a uint64_t
+	*				- @b maxIdleSleep - the maximum time in milliseconds the worker thread
+	*				  sleeps between two calls to IoTHubClient_LL_DoWork while there is nothing
+	*				  to send. While idle the sleep doubles from 1 ms up to this value; any call
+	*				  that enqueues work brings it back to 1 ms. Received messages can be delayed
+	*				  by up to this value. By default it is 1, meaning DoWork is called every 1 ms.
+	*				  For clients sharing a transport the value applies to the transport's worker
+	*				  thread. @p value is a pointer to an @c unsigned @c int.
+	*				- @b messagePoolSize - how many message records the client keeps
+	*				  for reuse once their messages have completed, so that sending does
+	*				  not allocate a record for every message. By default it is 0 (no reuse).
+	*				  @p value is a pointer to a @c size_t.
+	*				- @b messageQueueMaxCount, @b messageQueueMaxBytes, @b messageQueueFullPolicy -
+	*				  limit the messages waiting to be sent, see ::IoTHubClient_LL_SetOption.
+	*				  With @c IOTHUB_CLIENT_QUEUE_FULL_BLOCK, IoTHubClient_SendEventAsync waits
+	*				  for room in the queue instead of returning @c IOTHUB_CLIENT_BUSY.
+	*				- @b messageQueueBlockTimeout - the maximum time in milliseconds
+	*				  IoTHubClient_SendEventAsync waits for room in the queue when the policy is
+	*				  @c IOTHUB_CLIENT_QUEUE_FULL_BLOCK, after which it returns @c IOTHUB_CLIENT_BUSY.
+	*				  By default it is 0, meaning it waits for as long as it takes.
+	*				  @p value is a pointer to an @c unsigned @c int.
+	*				- @b compression, @b compressionThreshold - compress the payload of event
+	*				  messages, see ::IoTHubClient_LL_SetOption.
+	*				- @b blobUploadConcurrency - how many blocks IoTHubClient_UploadToBlobAsync
+	*				  uploads at the same time, see ::IoTHubClient_LL_SetOption.
+	*				- @b uploadQueueMaxCount, @b uploadQueueMaxBytes - limit the uploads
+	*				  accepted by IoTHubClient_UploadToBlobAsync and not finished yet, by count
+	*				  and by bytes copied from their sources. When a limit would be exceeded
+	*				  IoTHubClient_UploadToBlobAsync returns @c IOTHUB_CLIENT_BUSY. An upload
+	*				  alone bigger than @b uploadQueueMaxBytes fails with
+	*				  @c IOTHUB_CLIENT_INVALID_SIZE. By default both are 0, meaning no limit.
+	*				  @p value is a pointer to a @c size_t.
+	*				- @b uploadQueueFullPolicy - @c IOTHUB_CLIENT_QUEUE_FULL_REJECT (the default)
+	*				  or @c IOTHUB_CLIENT_QUEUE_FULL_BLOCK, which makes IoTHubClient_UploadToBlobAsync
+	*				  wait for room instead of returning @c IOTHUB_CLIENT_BUSY. An upload stops
+	*				  counting before its callback is called. While an upload callback runs,
+	*				  IoTHubClient_UploadToBlobAsync does not wait and returns
+	*				  @c IOTHUB_CLIENT_BUSY when there is no room, because the callback runs on
+	*				  the thread that makes room. @p value is a pointer to an
+	*				  @c IOTHUB_CLIENT_QUEUE_FULL_POLICY.
+	*				- @b uploadQueueBlockTimeout - the maximum time in milliseconds
+	*				  IoTHubClient_UploadToBlobAsync waits for room under
+	*				  @c IOTHUB_CLIENT_QUEUE_FULL_BLOCK, after which it returns @c IOTHUB_CLIENT_BUSY.
+	*				  By default it is 0, meaning it waits for as long as it takes.
+	*				  @p value is a pointer to an @c unsigned @c int.
 	* @return	IOTHUB_CLIENT_OK upon success or an error code upon failure.
 	*/
 	extern IOTHUB_CLIENT_RESULT IoTHubClient_SetOption(IOTHUB_CLIENT_HANDLE iotHubClientHandle, const char* optionName, const void* value);
@@ -197,6 +288,9 @@ extern "C"
 #ifndef DONT_USE_UPLOADTOBLOB
     /**
     * @brief	IoTHubClient_UploadToBlobAsync uploads data from memory to a file in Azure Blob Storage.
+    *			The data is copied and queued; one uploading thread per client uploads the queued
+    *			data in order and invokes the callbacks. See the @b uploadQueue options of
+    *			IoTHubClient_SetOption to bound the queue.
     *
     * @param	iotHubClientHandle	                The handle created by a call to the IoTHubClient_Create function.
     * @param	destinationFileName	                The name of the file to be created in Azure Blob Storage.
@@ -208,6 +302,32 @@ extern "C"
     * @return	IOTHUB_CLIENT_OK upon success or an error code upon failure.
     */
     extern IOTHUB_CLIENT_RESULT IoTHubClient_UploadToBlobAsync(IOTHUB_CLIENT_HANDLE iotHubClientHandle, const char* destinationFileName, const unsigned char* source, size_t size, IOTHUB_CLIENT_FILE_UPLOAD_CALLBACK iotHubClientFileUploadCallback, void* context);
+
+    /**
+    * @brief	IoTHubClient_UploadToBlobFromFileAsync uploads a local file to a file in Azure Blob Storage.
+    *			The file is not copied in memory, it is read one 4MB block at a time by the uploading
+    *			thread, so it shall not change until the callback is invoked.
+    *
+    * @param	iotHubClientHandle	                The handle created by a call to the IoTHubClient_Create function.
+    * @param	destinationFileName	                The name of the file to be created in Azure Blob Storage.
+    * @param	sourceFileName                      The path of the local file to upload.
+    * @param    iotHubClientFileUploadCallback      A callback to be invoked when the file upload operation has finished.
+    * @param    context                             A user-provided context to be passed to the file upload callback.
+    *
+    * @return	IOTHUB_CLIENT_OK upon success or an error code upon failure.
+    */
+    extern IOTHUB_CLIENT_RESULT IoTHubClient_UploadToBlobFromFileAsync(IOTHUB_CLIENT_HANDLE iotHubClientHandle, const char* destinationFileName, const char* sourceFileName, IOTHUB_CLIENT_FILE_UPLOAD_CALLBACK iotHubClientFileUploadCallback, void* context);
+
+    /**
+    * @brief	This function returns the state of the uploads accepted and not finished yet.
+    *
+    * @param	iotHubClientHandle		The handle created by a call to the create function.
+    * @param	stats					The state is populated at the address pointed
+    * 									at by this parameter.
+    *
+    * @return	IOTHUB_CLIENT_OK upon success or an error code upon failure.
+    */
+    extern IOTHUB_CLIENT_RESULT IoTHubClient_GetUploadQueueStats(IOTHUB_CLIENT_HANDLE iotHubClientHandle, IOTHUB_CLIENT_UPLOAD_QUEUE_STATS* stats);
 #endif
 #ifdef __cplusplus
 }
@@ -0,0 +1,31 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/** @file iothub_client_base64.h
+*	@brief	 Base64 encoding (RFC 4648, with padding) into a caller provided buffer.
+*
+*	@details The encoder does not allocate memory and does not produce a STRING_HANDLE,
+*			 so the callers can write the encoding of their data directly in the
+*			 buffer that is later sent over the wire.
+*/
+
+#ifndef IOTHUB_CLIENT_BASE64_H
+#define IOTHUB_CLIENT_BASE64_H
+
+#include "azure_c_shared_utility/umock_c_prod.h"
+#ifdef __cplusplus
+#include <cstddef>
+extern "C"
+{
+#else
+#include <stddef.h>
+#endif
+
+    MOCKABLE_FUNCTION(, size_t, IoTHubClient_Base64_GetEncodedLength, size_t, size);
+    MOCKABLE_FUNCTION(, char*, IoTHubClient_Base64_Encode, char*, destination, const unsigned char*, source, size_t, size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IOTHUB_CLIENT_BASE64_H */
@@ -30,7 +30,8 @@
     IOTHUB_CLIENT_INVALID_ARG,            \
     IOTHUB_CLIENT_ERROR,                  \
     IOTHUB_CLIENT_INVALID_SIZE,           \
-    IOTHUB_CLIENT_INDEFINITE_TIME         \
+    IOTHUB_CLIENT_INDEFINITE_TIME,        \
+    IOTHUB_CLIENT_BUSY                    \
 
 /** @brief Enumeration specifying the status of calls to various APIs in this module.
 */
@@ -65,7 +66,8 @@ extern "C"
     IOTHUB_CLIENT_CONFIRMATION_OK,                   \
     IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY,      \
     IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT,      \
-    IOTHUB_CLIENT_CONFIRMATION_ERROR                 \
+    IOTHUB_CLIENT_CONFIRMATION_ERROR,                \
+    IOTHUB_CLIENT_CONFIRMATION_BECAUSE_QUEUE_FULL    \
 
 	/** @brief Enumeration passed in by the IoT Hub when the event confirmation
 	*		   callback is invoked to indicate status of the event processing in
@@ -73,6 +75,35 @@ extern "C"
 	*/
 	DEFINE_ENUM(IOTHUB_CLIENT_CONFIRMATION_RESULT, IOTHUB_CLIENT_CONFIRMATION_RESULT_VALUES);
 
+#define IOTHUB_CLIENT_QUEUE_FULL_POLICY_VALUES       \
+    IOTHUB_CLIENT_QUEUE_FULL_REJECT,                 \
+    IOTHUB_CLIENT_QUEUE_FULL_DROP_OLDEST,            \
+    IOTHUB_CLIENT_QUEUE_FULL_BLOCK                   \
+
+	/** @brief Enumeration used with the @c messageQueueFullPolicy option to select
+	*		   what happens to a new message when the send queue is full:
+	*		   @c IOTHUB_CLIENT_QUEUE_FULL_REJECT fails the send with @c IOTHUB_CLIENT_BUSY,
+	*		   @c IOTHUB_CLIENT_QUEUE_FULL_DROP_OLDEST completes the oldest queued messages
+	*		   with @c IOTHUB_CLIENT_CONFIRMATION_BECAUSE_QUEUE_FULL to make room and
+	*		   @c IOTHUB_CLIENT_QUEUE_FULL_BLOCK makes IoTHubClient_SendEventAsync wait for
+	*		   room (IoTHubClient_LL, which cannot wait, behaves as for REJECT).
+	*/
+	DEFINE_ENUM(IOTHUB_CLIENT_QUEUE_FULL_POLICY, IOTHUB_CLIENT_QUEUE_FULL_POLICY_VALUES);
+
+#define IOTHUB_CLIENT_COMPRESSION_VALUES       \
+    IOTHUB_CLIENT_COMPRESSION_NONE,            \
+    IOTHUB_CLIENT_COMPRESSION_LZ4              \
+
+	/** @brief Enumeration used with the @c compression option to select how
+	*		   the payload of event messages is compressed before they are queued:
+	*		   @c IOTHUB_CLIENT_COMPRESSION_NONE sends the payloads as they are and
+	*		   @c IOTHUB_CLIENT_COMPRESSION_LZ4 sends them as one LZ4 block with the
+	*		   application property @c content-encoding set to @c lz4 and the
+	*		   application property @c content-length-uncompressed set to the size of
+	*		   the original payload, which LZ4 needs to decompress the block.
+	*/
+	DEFINE_ENUM(IOTHUB_CLIENT_COMPRESSION, IOTHUB_CLIENT_COMPRESSION_VALUES);
+
 #define TRANSPORT_TYPE_VALUES \
     TRANSPORT_LL, /*LL comes from "LowLevel" */ \
     TRANSPORT_THREADED
@@ -143,6 +174,26 @@ extern "C"
 		const char* deviceSasToken;
 	} IOTHUB_CLIENT_DEVICE_CONFIG;
 
+	/** @brief	This struct captures the state of the queue of messages waiting to be sent. */
+	typedef struct IOTHUB_CLIENT_SEND_QUEUE_STATS_TAG
+	{
+		/** @brief	How many messages are waiting to be sent. */
+		size_t messageCount;
+
+		/** @brief	The payload bytes of the messages waiting to be sent. Only counted
+		*			while the @c messageQueueMaxBytes option is set; setting it measures
+		*			the messages already waiting. */
+		size_t byteCount;
+
+		/** @brief	How many messages have been dropped to make room for newer ones. */
+		size_t droppedCount;
+
+		/** @brief	How many sends have failed with @c IOTHUB_CLIENT_BUSY. A send that
+		*			IoTHubClient_SendEventAsync retries under @c IOTHUB_CLIENT_QUEUE_FULL_BLOCK
+		*			counts once, when it finally fails. */
+		size_t rejectedCount;
+	} IOTHUB_CLIENT_SEND_QUEUE_STATS;
+
 	/** @brief	This struct captures IoTHub transport configuration. */
 	typedef struct IOTHUBTRANSPORT_CONFIG_TAG
 	{
@@ -226,6 +277,30 @@ extern "C"
 	*/
 	extern IOTHUB_CLIENT_RESULT IoTHubClient_LL_SendEventAsync(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, IOTHUB_MESSAGE_HANDLE eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void* userContextCallback);
 
+	/**
+	* @brief	Asynchronous call to send the message specified by @p eventMessageHandle
+	* 			without making a copy of it.
+	*
+	* @param	iotHubClientHandle		   	The handle created by a call to the create function.
+	* @param	eventMessageHandle		   	The handle to an IoT Hub message. On success the
+	* 										IoT Hub client owns the message and destroys it
+	* 										once @p eventConfirmationCallback has been called;
+	* 										the caller shall not use or destroy it afterwards.
+	* 										On failure the message still belongs to the caller.
+	* @param	eventConfirmationCallback  	The callback specified by the device for receiving
+	* 										confirmation of the delivery of the IoT Hub message.
+	* 										The user can specify a @c NULL value here to
+	* 										indicate that no callback is required.
+	* @param	userContextCallback			User specified context that will be provided to the
+	* 										callback. This can be @c NULL.
+	*
+	*			@b NOTE: The application behavior is undefined if the user calls
+	*			the ::IoTHubClient_LL_Destroy function from within any callback.
+	*
+	* @return	IOTHUB_CLIENT_OK upon success or an error code upon failure.
+	*/
+	extern IOTHUB_CLIENT_RESULT IoTHubClient_LL_SendEventAsyncTakeOwnership(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, IOTHUB_MESSAGE_HANDLE eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void* userContextCallback);
+
 	/**
 	* @brief	This function returns the current sending status for IoTHubClient.
 	*
@@ -240,6 +315,17 @@ extern "C"
 	*/
 	extern IOTHUB_CLIENT_RESULT IoTHubClient_LL_GetSendStatus(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, IOTHUB_CLIENT_STATUS *iotHubClientStatus);
 
+	/**
+	* @brief	This function returns the state of the queue of messages waiting to be sent.
+	*
+	* @param	iotHubClientHandle		The handle created by a call to the create function.
+	* @param	stats					The queue state is populated at the address pointed
+	* 									at by this parameter.
+	*
+	* @return	IOTHUB_CLIENT_OK upon success or an error code upon failure.
+	*/
+	extern IOTHUB_CLIENT_RESULT IoTHubClient_LL_GetSendQueueStats(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, IOTHUB_CLIENT_SEND_QUEUE_STATS* stats);
+
 	/**
 	* @brief	Sets up the message callback to be invoked when IoT Hub issues a
 	* 			message to the device. This is a blocking call.
@@ -320,6 +406,37 @@ extern "C"
 	*                interval in seconds when pings are sent to the server.
 	*              - @b logtrace - available for MQTT protocol.  Boolean value that turns on and
 	*                off the diagnostic logging.
+	*				- @b messagePoolSize - how many message records IoTHubClient_LL keeps
+	*				  for reuse once their messages have completed, so that sending does
+	*				  not allocate a record for every message. Only the record is reused:
+	*				  the copy of the message that IoTHubClient_LL_SendEventAsync makes is
+	*				  still allocated by IoTHubMessage_Clone and destroyed with
+	*				  IoTHubMessage_Destroy, since the transports may keep the message
+	*				  handle and the message owns its buffers. Use
+	*				  IoTHubClient_LL_SendEventAsyncTakeOwnership to avoid that copy.
+	*				  By default it is 0 (no reuse). @p value is a pointer to a @c size_t.
+	*				- @b messageQueueMaxCount - the maximum number of messages waiting to be
+	*				  sent. By default it is 0 (no limit). @p value is a pointer to a @c size_t.
+	*				- @b messageQueueMaxBytes - the maximum payload bytes of the messages waiting
+	*				  to be sent. By default it is 0 (no limit). @p value is a pointer to a @c size_t.
+	*				- @b messageQueueFullPolicy - what happens to a new message when one of the
+	*				  limits above would be exceeded. By default it is
+	*				  @c IOTHUB_CLIENT_QUEUE_FULL_REJECT. @p value is a pointer to an
+	*				  @c IOTHUB_CLIENT_QUEUE_FULL_POLICY.
+	*				- @b compression - how the payload of the messages given to
+	*				  IoTHubClient_LL_SendEventAsync is compressed. By default it is
+	*				  @c IOTHUB_CLIENT_COMPRESSION_NONE. Messages that already have a
+	*				  @c content-encoding property and messages that would not get smaller
+	*				  are sent as they are. Compressed messages count against
+	*				  @c messageQueueMaxBytes with their compressed size. @p value is a
+	*				  pointer to an @c IOTHUB_CLIENT_COMPRESSION.
+	*				- @b compressionThreshold - payloads shorter than this many bytes are
+	*				  not compressed. By default it is 256. @p value is a pointer to a
+	*				  @c size_t.
+	*				- @b blobUploadConcurrency - how many 4MB blocks IoTHubClient_LL_UploadToBlob
+	*				  uploads at the same time, each on its own connection to storage. Only
+	*				  uploads of 64MB and more are made of blocks. By default it is 1 (one block
+	*				  after another). @p value is a pointer to a @c size_t.
 	*
 	* @return	IOTHUB_CLIENT_OK upon success or an error code upon failure.
 	*/
@@ -339,6 +456,66 @@ extern "C"
     */
     extern IOTHUB_CLIENT_RESULT IoTHubClient_LL_UploadToBlob(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, const char* destinationFileName, const unsigned char* source, size_t size);
 
+    /**
+    * @brief	Reads the next bytes of the content uploaded by IoTHubClient_LL_UploadToBlobFromReader.
+    *
+    * @param	context		    The context passed to IoTHubClient_LL_UploadToBlobFromReader.
+    * @param	buffer		    Receives the bytes read.
+    * @param	bufferSize	    The number of bytes available at @p buffer.
+    * @param	bytesRead	    Receives the number of bytes written at @p buffer, 0 at the end of the content.
+    *
+    * @return	0 when @p bytesRead has been set, any other value fails the upload.
+    */
+    typedef int(*IOTHUB_CLIENT_FILE_UPLOAD_READ_CALLBACK)(void* context, unsigned char* buffer, size_t bufferSize, size_t* bytesRead);
+
+    /**
+    * @brief	This API uploads to Azure Storage the content read by @p getData under the blob
+    *           name devicename/@pdestinationFileName. The content is read and uploaded one 4MB
+    *           block at a time, so it never needs to be in memory as a whole.
+    *
+    * @param	iotHubClientHandle	    The handle created by a call to the create function.
+    * @param	destinationFileName     name of the file.
+    * @param	getData                 called until it reports the end of the content, never from
+    *                                   more than one thread at a time.
+    * @param    context                 passed to @p getData.
+    *
+    * @return	IOTHUB_CLIENT_OK upon success or an error code upon failure.
+    */
+    extern IOTHUB_CLIENT_RESULT IoTHubClient_LL_UploadToBlobFromReader(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, const char* destinationFileName, IOTHUB_CLIENT_FILE_UPLOAD_READ_CALLBACK getData, void* context);
+
+    /**
+    * @brief	This API uploads to Azure Storage the content of the file @p sourceFileName under
+    *           the blob name devicename/@pdestinationFileName, reading it one 4MB block at a time.
+    *
+    * @param	iotHubClientHandle	    The handle created by a call to the create function.
+    * @param	destinationFileName     name of the file.
+    * @param	sourceFileName          path of the local file to upload.
+    *
+    * @return	IOTHUB_CLIENT_OK upon success or an error code upon failure.
+    */
+    extern IOTHUB_CLIENT_RESULT IoTHubClient_LL_UploadToBlobFromFile(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, const char* destinationFileName, const char* sourceFileName);
+
+    /**
+    * @brief	This API uploads the file @p sourceFileName like IoTHubClient_LL_UploadToBlobFromFile
+    *           does, recording its progress in @p manifestFileName so that an interrupted upload
+    *           can be resumed by calling it again with the same arguments. The blocks already
+    *           uploaded are not uploaded again. Blocks that fail with a network error or a server
+    *           error are retried with an increasing delay. The manifest is deleted once IoTHub
+    *           has been told the outcome of the upload. An upload resumed after the SAS URI of
+    *           the blob has expired (after about an hour) starts over, and so does an upload
+    *           resumed after the content of @p sourceFileName has changed. The file is read
+    *           once more before each attempt to detect that.
+    *
+    * @param	iotHubClientHandle	    The handle created by a call to the create function.
+    * @param	destinationFileName     name of the file.
+    * @param	sourceFileName          path of the local file to upload, it shall not change while
+    *                                   an attempt is uploading it.
+    * @param	manifestFileName        path of the file recording the progress of the upload.
+    *
+    * @return	IOTHUB_CLIENT_OK upon success or an error code upon failure.
+    */
+    extern IOTHUB_CLIENT_RESULT IoTHubClient_LL_UploadToBlobFromFileResumable(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, const char* destinationFileName, const char* sourceFileName, const char* manifestFileName);
+
 #endif /*DONT_USE_UPLOADTOBLOB*/
 
 #ifdef __cplusplus
@@ -0,0 +1,48 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/** @file iothub_client_ll_messagestore.h
+*	@brief	 Disk backed store for the messages given to IoTHubClient_LL_SendEventAsync.
+*
+*	@details The store is an append-only log of checksummed records. Every message
+*			 that enters IoTHubClient_LL is appended to the log and a "done" record
+*			 is appended once its confirmation callback has been called. When the
+*			 store is opened again, a torn or corrupted tail (as left behind by a
+*			 crash in the middle of a write) is discarded, the log is compacted
+*			 down to the messages that are not done and those messages can be
+*			 replayed into the client.
+*/
+
+#ifndef IOTHUB_CLIENT_LL_MESSAGESTORE_H
+#define IOTHUB_CLIENT_LL_MESSAGESTORE_H
+
+#include "iothub_message.h"
+
+#include "azure_c_shared_utility/umock_c_prod.h"
+#ifdef __cplusplus
+#include <cstddef>
+#include <cstdint>
+extern "C"
+{
+#else
+#include <stddef.h>
+#include <stdint.h>
+#endif
+
+typedef struct IOTHUB_CLIENT_LL_MESSAGESTORE_HANDLE_DATA_TAG* IOTHUB_CLIENT_LL_MESSAGESTORE_HANDLE;
+
+/*the callback takes ownership of messageHandle*/
+typedef void(*IOTHUB_CLIENT_LL_MESSAGESTORE_REPLAY_CALLBACK)(IOTHUB_MESSAGE_HANDLE messageHandle, uint64_t recordId, void* context);
+
+    MOCKABLE_FUNCTION(, IOTHUB_CLIENT_LL_MESSAGESTORE_HANDLE, IoTHubClient_LL_MessageStore_Create, const char*, path);
+    MOCKABLE_FUNCTION(, int, IoTHubClient_LL_MessageStore_Replay, IOTHUB_CLIENT_LL_MESSAGESTORE_HANDLE, handle, IOTHUB_CLIENT_LL_MESSAGESTORE_REPLAY_CALLBACK, replayCallback, void*, context);
+    MOCKABLE_FUNCTION(, int, IoTHubClient_LL_MessageStore_Append, IOTHUB_CLIENT_LL_MESSAGESTORE_HANDLE, handle, IOTHUB_MESSAGE_HANDLE, messageHandle, uint64_t*, recordId);
+    MOCKABLE_FUNCTION(, int, IoTHubClient_LL_MessageStore_Remove, IOTHUB_CLIENT_LL_MESSAGESTORE_HANDLE, handle, uint64_t, recordId);
+    MOCKABLE_FUNCTION(, int, IoTHubClient_LL_MessageStore_Flush, IOTHUB_CLIENT_LL_MESSAGESTORE_HANDLE, handle);
+    MOCKABLE_FUNCTION(, void, IoTHubClient_LL_MessageStore_Destroy, IOTHUB_CLIENT_LL_MESSAGESTORE_HANDLE, handle);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IOTHUB_CLIENT_LL_MESSAGESTORE_H */
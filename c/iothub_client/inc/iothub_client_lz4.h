@@ -0,0 +1,31 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/** @file iothub_client_lz4.h
+*	@brief	 LZ4 block format compression into a caller provided buffer.
+*
+*	@details The compressor does not allocate memory. Its output is a single LZ4 block
+*			 (no frame header), which any LZ4 implementation decodes with
+*			 LZ4_decompress_safe. It favors a small footprint over compression ratio.
+*/
+
+#ifndef IOTHUB_CLIENT_LZ4_H
+#define IOTHUB_CLIENT_LZ4_H
+
+#include "azure_c_shared_utility/umock_c_prod.h"
+#ifdef __cplusplus
+#include <cstddef>
+extern "C"
+{
+#else
+#include <stddef.h>
+#endif
+
+    MOCKABLE_FUNCTION(, size_t, IoTHubClient_LZ4_GetMaxCompressedLength, size_t, size);
+    MOCKABLE_FUNCTION(, size_t, IoTHubClient_LZ4_Compress, unsigned char*, destination, size_t, destinationSize, const unsigned char*, source, size_t, size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IOTHUB_CLIENT_LZ4_H */
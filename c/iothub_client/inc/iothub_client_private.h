@@ -44,6 +44,7 @@ typedef struct IOTHUB_MESSAGE_LIST_TAG
     void* context; 
     DLIST_ENTRY entry;
     uint64_t ms_timesOutAfter; /* a value of "0" means "no timeout", if the IOTHUBCLIENT_LL's handle tickcounter > msTimesOutAfer then the message shall timeout*/
+    size_t messageSize; /*payload size of the message as queued (compressed if it was compressed), counted against "messageQueueMaxBytes"*/
 }IOTHUB_MESSAGE_LIST;
 
 
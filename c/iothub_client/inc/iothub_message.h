@@ -45,6 +45,14 @@ IOTHUBMESSAGE_UNKNOWN \
   */
 DEFINE_ENUM(IOTHUBMESSAGE_CONTENT_TYPE, IOTHUBMESSAGE_CONTENT_TYPE_VALUES);
 
+/** @brief Payloads of up to this many bytes are stored in the same allocation
+  * as the message itself instead of in a separate buffer. Define it to 0 to
+  * always use a separate buffer.
+  */
+#ifndef IOTHUB_MESSAGE_INLINE_PAYLOAD_SIZE
+#define IOTHUB_MESSAGE_INLINE_PAYLOAD_SIZE 256
+#endif
+
 typedef void* IOTHUB_MESSAGE_HANDLE;
 
 /**
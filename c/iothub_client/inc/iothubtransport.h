@@ -24,6 +24,10 @@ extern TRANSPORT_LL_HANDLE	IoTHubTransport_GetLLTransport(TRANSPORT_HANDLE trans
 extern IOTHUB_CLIENT_RESULT IoTHubTransport_StartWorkerThread(TRANSPORT_HANDLE transportHandle, IOTHUB_CLIENT_HANDLE clientHandle);
 extern bool					IoTHubTransport_SignalEndWorkerThread(TRANSPORT_HANDLE transportHandle, IOTHUB_CLIENT_HANDLE clientHandle);
 extern void					IoTHubTransport_JoinWorkerThread(TRANSPORT_HANDLE transportHandle, IOTHUB_CLIENT_HANDLE clientHandle);
+extern IOTHUB_CLIENT_RESULT IoTHubTransport_SetMaxIdleSleep(TRANSPORT_HANDLE transportHandle, unsigned int maxIdleSleep);
+
+/*implemented by iothub_client, used by the worker thread to ask the clients sharing the transport whether they are busy*/
+extern IOTHUB_CLIENT_LL_HANDLE	IoTHubClient_GetLLHandle(IOTHUB_CLIENT_HANDLE iotHubClientHandle);
 
 #ifdef __cplusplus
 }
@@ -8,355 +8,1070 @@
 #include "azure_c_shared_utility/gballoc.h"
 
 #include "blob.h"
+#include "iothub_client_base64.h"
 
 #include "azure_c_shared_utility/httpapiex.h"
 #include "azure_c_shared_utility/iot_logging.h"
-#include "azure_c_shared_utility/base64.h"
+#include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/threadapi.h"
 
 /*a block has 4MB*/
 #define BLOCK_SIZE (4*1024*1024)
 
-BLOB_RESULT Blob_UploadFromSasUri(const char* SASURI, const unsigned char* source, size_t size, unsigned int* httpStatus, BUFFER_HANDLE httpResponse)
+/*https://msdn.microsoft.com/en-us/library/azure/dd179467.aspx says "a block blob can include a maximum of 50,000 blocks."*/
+#define MAX_BLOCK_COUNT 50000
+
+/*a resumable upload retries a block 4 more times, waiting 1s, 2s, 4s and 8s before the retries*/
+#define BLOCK_RETRY_COUNT 4
+#define BLOCK_RETRY_INITIAL_DELAY_MS 1000
+
+typedef struct BLOB_UPLOAD_CONTEXT_TAG
+{
+    const char* relativePath;
+    const unsigned char* source; /*NULL when the blocks are read by getData*/
+    size_t size;
+    BLOB_READ_CALLBACK getData;
+    void* getDataContext;
+    const BLOB_UPLOAD_RESUME* resume; /*NULL when every block is uploaded by a single attempt*/
+    int isEndOfSource; /*set when the last block has been taken by a worker*/
+    LOCK_HANDLE lock; /*NULL when the blocks are uploaded by the calling thread only*/
+    unsigned int nextBlockID; /*the next block not yet taken by a worker*/
+    int isError; /*set by the first block that fails, stops the workers from taking new blocks*/
+    BLOB_RESULT result; /*the result of the first block that failed*/
+    unsigned int* httpStatus;
+    BUFFER_HANDLE httpResponse;
+}BLOB_UPLOAD_CONTEXT;
+
+typedef struct BLOB_CONNECTION_TAG
+{
+    char* hostname;                     /*the storage host of httpApiExHandle, NULL when there is no connection*/
+    HTTPAPIEX_HANDLE httpApiExHandle;
+}BLOB_CONNECTION;
+
+typedef struct BLOB_UPLOAD_WORKER_TAG
+{
+    BLOB_UPLOAD_CONTEXT* context;
+    HTTPAPIEX_HANDLE httpApiExHandle; /*each worker has its own connection to storage*/
+    unsigned int httpStatus;
+    BUFFER_HANDLE httpResponse; /*NULL when the caller did not ask for the HTTP response*/
+    unsigned char* blockBuffer; /*the block read by getData, NULL when the blocks are taken from source*/
+    THREAD_HANDLE threadHandle;
+}BLOB_UPLOAD_WORKER;
+
+/*returns 0 when blockIdString contains the BASE64 encoding of the block ID*/
+static int encodeBlockId(unsigned int blockID, char blockIdString[9])
+{
+    int result;
+    /*Codes_SRS_BLOB_02_020: [ Blob_UploadFromSasUri shall construct a BASE64 encoded string from the block ID (000000... 0499999) ]*/
+    char temp[7]; /*this will contain 000000... 049999*/
+    if (sprintf(temp, "%6u", (unsigned int)blockID) != 6) /*produces 000000... 049999*/
+    {
+        LogError("failed to sprintf");
+        result = __LINE__;
+    }
+    else
+    {
+        /*the 6 characters of the blockId produce exactly 8 base64 characters*/
+        char* blockIdStringEnd = IoTHubClient_Base64_Encode(blockIdString, (const unsigned char*)temp, 6);
+        *blockIdStringEnd = '\0';
+        result = 0;
+    }
+    return result;
+}
+
+/*uploads one block by "Put Block", isError is set when the upload cannot continue*/
+static BLOB_RESULT putBlock(HTTPAPIEX_HANDLE httpApiExHandle, const char* relativePath, const char* blockIdString, const unsigned char* blockSource, size_t blockSize, unsigned int* httpStatus, BUFFER_HANDLE httpResponse, int* isError)
 {
     BLOB_RESULT result;
-    /*Codes_SRS_BLOB_02_001: [ If SASURI is NULL then Blob_UploadFromSasUri shall fail and return BLOB_INVALID_ARG. ]*/
-    if (SASURI == NULL)
+    /*Codes_SRS_BLOB_02_022: [ Blob_UploadFromSasUri shall construct a new relativePath from following string: base relativePath + "&comp=block&blockid=BASE64 encoded string of blockId" ]*/
+    STRING_HANDLE newRelativePath = STRING_construct(relativePath);
+    if (newRelativePath == NULL)
     {
-        LogError("parameter SASURI is NULL");
-        result = BLOB_INVALID_ARG;
+        /*Codes_SRS_BLOB_02_033: [ If any previous operation that doesn't have an explicit failure description fails then Blob_UploadFromSasUri shall fail and return BLOB_ERROR ]*/
+        LogError("unable to STRING_construct");
+        result = BLOB_ERROR;
+        *isError = 1;
     }
     else
     {
-        /*Codes_SRS_BLOB_02_002: [ If source is NULL and size is not zero then Blob_UploadFromSasUri shall fail and return BLOB_INVALID_ARG. ]*/
-        if (
-            (size > 0) &&
-            (source == NULL)
-            )
+        if (!(
+            (STRING_concat(newRelativePath, "&comp=block&blockid=") == 0) &&
+            (STRING_concat(newRelativePath, blockIdString) == 0)
+            ))
         {
-            LogError("combination of source = %p and size = %zu is invalid", source, size);
-            result = BLOB_INVALID_ARG;
+            /*Codes_SRS_BLOB_02_033: [ If any previous operation that doesn't have an explicit failure description fails then Blob_UploadFromSasUri shall fail and return BLOB_ERROR ]*/
+            LogError("unable to STRING concatenate");
+            result = BLOB_ERROR;
+            *isError = 1;
         }
-        /*Codes_SRS_BLOB_02_034: [ If size is bigger than 50000*4*1024*1024 then Blob_UploadFromSasUri shall fail and return BLOB_INVALID_ARG. ]*/
-        else if (size > 50000ULL * 4 * 1024 * 1024) /*https://msdn.microsoft.com/en-us/library/azure/dd179467.aspx says "Each block can be a different size, up to a maximum of 4 MB, and a block blob can include a maximum of 50,000 blocks."*/
+        else
         {
-            LogError("size too big (%zu)", size);
-            result = BLOB_INVALID_ARG;
+            /*Codes_SRS_BLOB_02_023: [ Blob_UploadFromSasUri shall create a BUFFER_HANDLE from source and size parameters. ]*/
+            BUFFER_HANDLE requestContent = BUFFER_create(blockSource, blockSize);
+            if (requestContent == NULL)
+            {
+                /*Codes_SRS_BLOB_02_033: [ If any previous operation that doesn't have an explicit failure description fails then Blob_UploadFromSasUri shall fail and return BLOB_ERROR ]*/
+                LogError("unable to BUFFER_create");
+                result = BLOB_ERROR;
+                *isError = 1;
+            }
+            else
+            {
+                /*Codes_SRS_BLOB_02_024: [ Blob_UploadFromSasUri shall call HTTPAPIEX_ExecuteRequest with a PUT operation, passing httpStatus and httpResponse. ]*/
+                if (HTTPAPIEX_ExecuteRequest(
+                    httpApiExHandle,
+                    HTTPAPI_REQUEST_PUT,
+                    STRING_c_str(newRelativePath),
+                    NULL,
+                    requestContent,
+                    httpStatus,
+                    NULL,
+                    httpResponse) != HTTPAPIEX_OK
+                    )
+                {
+                    /*Codes_SRS_BLOB_02_025: [ If HTTPAPIEX_ExecuteRequest fails then Blob_UploadFromSasUri shall fail and return BLOB_HTTP_ERROR. ]*/
+                    LogError("unable to HTTPAPIEX_ExecuteRequest");
+                    result = BLOB_HTTP_ERROR;
+                    *isError = 1;
+                }
+                else if (*httpStatus >= 300)
+                {
+                    /*Codes_SRS_BLOB_02_026: [ Otherwise, if HTTP response code is >=300 then Blob_UploadFromSasUri shall succeed and return BLOB_OK. ]*/
+                    LogError("HTTP status from storage does not indicate success (%d)", (int)*httpStatus);
+                    result = BLOB_OK;
+                    *isError = 1;
+                }
+                else
+                {
+                    /*Codes_SRS_BLOB_02_027: [ Otherwise Blob_UploadFromSasUri shall continue execution. ]*/
+                    result = BLOB_OK;
+                }
+                BUFFER_delete(requestContent);
+            }
+        }
+        STRING_delete(newRelativePath);
+    }
+    return result;
+}
+
+/*commits the blocks listed in xml by "Put Block List"*/
+static BLOB_RESULT putBlockList(HTTPAPIEX_HANDLE httpApiExHandle, const char* relativePath, STRING_HANDLE xml, unsigned int* httpStatus, BUFFER_HANDLE httpResponse)
+{
+    BLOB_RESULT result;
+    /*complete the XML*/
+    if (STRING_concat(xml, "</BlockList>") != 0)
+    {
+        /*Codes_SRS_BLOB_02_033: [ If any previous operation that doesn't have an explicit failure description fails then Blob_UploadFromSasUri shall fail and return BLOB_ERROR ]*/
+        LogError("failed to STRING_concat");
+        result = BLOB_ERROR;
+    }
+    else
+    {
+        /*Codes_SRS_BLOB_02_029: [Blob_UploadFromSasUri shall construct a new relativePath from following string : base relativePath + "&comp=blocklist"]*/
+        STRING_HANDLE newRelativePath = STRING_construct(relativePath);
+        if (newRelativePath == NULL)
+        {
+            /*Codes_SRS_BLOB_02_033: [ If any previous operation that doesn't have an explicit failure description fails then Blob_UploadFromSasUri shall fail and return BLOB_ERROR ]*/
+            LogError("failed to STRING_construct");
+            result = BLOB_ERROR;
         }
         else
         {
-            /*Codes_SRS_BLOB_02_017: [ Blob_UploadFromSasUri shall copy from SASURI the hostname to a new const char* ]*/
-            /*Codes_SRS_BLOB_02_004: [ Blob_UploadFromSasUri shall copy from SASURI the hostname to a new const char*. ]*/
-            /*to find the hostname, the following logic is applied:*/
-            /*the hostname starts at the first character after "://"*/
-            /*the hostname ends at the first character before the next "/" after "://"*/
-            const char* hostnameBegin = strstr(SASURI, "://");
-            if (hostnameBegin == NULL)
+            if (STRING_concat(newRelativePath, "&comp=blocklist") != 0)
             {
-                /*Codes_SRS_BLOB_02_005: [ If the hostname cannot be determined, then Blob_UploadFromSasUri shall fail and return BLOB_INVALID_ARG. ]*/
-                LogError("hostname cannot be determined");
-                result = BLOB_INVALID_ARG;
+                /*Codes_SRS_BLOB_02_033: [ If any previous operation that doesn't have an explicit failure description fails then Blob_UploadFromSasUri shall fail and return BLOB_ERROR ]*/
+                LogError("failed to STRING_concat");
+                result = BLOB_ERROR;
             }
             else
             {
-                hostnameBegin += 3; /*have to skip 3 characters which are "://"*/
-                const char* hostnameEnd = strchr(hostnameBegin, '/');
-                if (hostnameEnd == NULL)
+                /*Codes_SRS_BLOB_02_030: [ Blob_UploadFromSasUri shall call HTTPAPIEX_ExecuteRequest with a PUT operation, passing the new relativePath, httpStatus and httpResponse and the XML string as content. ]*/
+                const unsigned char* s = (const unsigned char*)STRING_c_str(xml);
+                BUFFER_HANDLE xmlAsBuffer = BUFFER_create(s, strlen(s));
+                if (xmlAsBuffer == NULL)
                 {
-                    /*Codes_SRS_BLOB_02_005: [ If the hostname cannot be determined, then Blob_UploadFromSasUri shall fail and return BLOB_INVALID_ARG. ]*/
-                    LogError("hostname cannot be determined");
-                    result = BLOB_INVALID_ARG;
+                    /*Codes_SRS_BLOB_02_033: [ If any previous operation that doesn't have an explicit failure description fails then Blob_UploadFromSasUri shall fail and return BLOB_ERROR ]*/
+                    LogError("failed to BUFFER_create");
+                    result = BLOB_ERROR;
                 }
                 else
                 {
-                    size_t hostnameSize = hostnameEnd - hostnameBegin;
-                    char* hostname = (char*)malloc(hostnameSize + 1); /*+1 because of '\0' at the end*/
-                    if (hostname == NULL)
+                    if (HTTPAPIEX_ExecuteRequest(
+                        httpApiExHandle,
+                        HTTPAPI_REQUEST_PUT,
+                        STRING_c_str(newRelativePath),
+                        NULL,
+                        xmlAsBuffer,
+                        httpStatus,
+                        NULL,
+                        httpResponse
+                    ) != HTTPAPIEX_OK)
                     {
-                        /*Codes_SRS_BLOB_02_016: [ If the hostname copy cannot be made then then Blob_UploadFromSasUri shall fail and return BLOB_ERROR ]*/
-                        LogError("oom - out of memory");
-                        result = BLOB_ERROR;
+                        /*Codes_SRS_BLOB_02_031: [ If HTTPAPIEX_ExecuteRequest fails then Blob_UploadFromSasUri shall fail and return BLOB_HTTP_ERROR. ]*/
+                        LogError("unable to HTTPAPIEX_ExecuteRequest");
+                        result = BLOB_HTTP_ERROR;
                     }
                     else
                     {
-                        HTTPAPIEX_HANDLE httpApiExHandle;
-                        memcpy(hostname, hostnameBegin, hostnameSize);
-                        hostname[hostnameSize] = '\0';
-
-                        /*Codes_SRS_BLOB_02_006: [ Blob_UploadFromSasUri shall create a new HTTPAPI_EX_HANDLE by calling HTTPAPIEX_Create passing the hostname. ]*/
-                        /*Codes_SRS_BLOB_02_018: [ Blob_UploadFromSasUri shall create a new HTTPAPI_EX_HANDLE by calling HTTPAPIEX_Create passing the hostname. ]*/
-                        httpApiExHandle = HTTPAPIEX_Create(hostname);
-                        if (httpApiExHandle == NULL)
+                        /*Codes_SRS_BLOB_02_032: [ Otherwise, Blob_UploadFromSasUri shall succeed and return BLOB_OK. ]*/
+                        result = BLOB_OK;
+                    }
+                    BUFFER_delete(xmlAsBuffer);
+                }
+            }
+            STRING_delete(newRelativePath);
+        }
+    }
+    return result;
+}
+
+/*fills buffer by calling getData until it has BLOCK_SIZE bytes or getData reports the end of the data*/
+static int readBlock(BLOB_UPLOAD_CONTEXT* context, unsigned char* buffer, size_t* blockSize)
+{
+    int result = 0;
+    int isEndOfData = 0;
+    *blockSize = 0;
+    while ((result == 0) && !isEndOfData && (*blockSize < BLOCK_SIZE))
+    {
+        size_t bytesRead = 0;
+        if (context->getData(context->getDataContext, buffer + *blockSize, BLOCK_SIZE - *blockSize, &bytesRead) != 0)
+        {
+            LogError("getData failed");
+            result = __LINE__;
+        }
+        else if (bytesRead > BLOCK_SIZE - *blockSize)
+        {
+            LogError("getData returned %zu bytes, more than the %zu bytes requested", bytesRead, BLOCK_SIZE - *blockSize);
+            result = __LINE__;
+        }
+        else if (bytesRead == 0)
+        {
+            isEndOfData = 1;
+        }
+        else
+        {
+            *blockSize += bytesRead;
+        }
+    }
+    return result;
+}
+
+/*called with the lock held, returns 0 when blockID, blockSource and blockSize describe the block taken by the worker*/
+static int takeNextBlock(BLOB_UPLOAD_WORKER* worker, unsigned int* blockID, const unsigned char** blockSource, size_t* blockSize)
+{
+    int result;
+    BLOB_UPLOAD_CONTEXT* context = worker->context;
+    if (context->isError || context->isEndOfSource)
+    {
+        result = __LINE__;
+    }
+    else if (context->getData == NULL)
+    {
+        size_t offset = (size_t)context->nextBlockID * BLOCK_SIZE;
+        *blockID = context->nextBlockID;
+        *blockSource = context->source + offset;
+        *blockSize = ((context->size - offset) > BLOCK_SIZE) ? BLOCK_SIZE : (context->size - offset);
+        context->nextBlockID++;
+        context->isEndOfSource = (offset + *blockSize == context->size);
+        result = 0;
+    }
+    else
+    {
+        int isTaken = 0;
+        result = 0;
+        while ((result == 0) && !isTaken)
+        {
+            /*Codes_SRS_BLOB_02_045: [ Every block shall be read by the worker that takes it into its own 4MB buffer, by calling getData until the buffer is full or getData sets bytesRead to 0. Only one worker shall call getData at any given time. ]*/
+            if (readBlock(context, worker->blockBuffer, blockSize) != 0)
+            {
+                /*Codes_SRS_BLOB_02_046: [ If getData fails or sets bytesRead to more than bufferSize then Blob_UploadFromSasUriWithReader shall fail and return BLOB_ERROR. ]*/
+                context->isError = 1;
+                context->result = BLOB_ERROR;
+                result = __LINE__;
+            }
+            else if (*blockSize == 0)
+            {
+                context->isEndOfSource = 1;
+                result = __LINE__;
+            }
+            else if (context->nextBlockID == MAX_BLOCK_COUNT)
+            {
+                /*Codes_SRS_BLOB_02_047: [ If the data does not fit in 50000 blocks then Blob_UploadFromSasUriWithReader shall fail and return BLOB_INVALID_ARG. ]*/
+                LogError("the data does not fit in %d blocks", MAX_BLOCK_COUNT);
+                context->isError = 1;
+                context->result = BLOB_INVALID_ARG;
+                result = __LINE__;
+            }
+            else
+            {
+                *blockID = context->nextBlockID;
+                *blockSource = worker->blockBuffer;
+                context->nextBlockID++;
+                /*a block shorter than BLOCK_SIZE is the last one*/
+                context->isEndOfSource = (*blockSize < BLOCK_SIZE);
+
+                /*Codes_SRS_BLOB_02_052: [ Blob_UploadFromSasUriWithReaderResumable shall upload the data as Blob_UploadFromSasUriWithReader does, except that a block whose blockID is less than resume->blockCount and for which resume->isBlockUploaded[blockID] is not 0 shall be read by getData but not uploaded. ]*/
+                if ((context->resume != NULL) && (*blockID < context->resume->blockCount) && (context->resume->isBlockUploaded[*blockID] != 0))
+                {
+                    if (context->isEndOfSource)
+                    {
+                        result = __LINE__;
+                    }
+                }
+                else
+                {
+                    isTaken = 1;
+                }
+            }
+        }
+    }
+    return result;
+}
+
+/*a block that could not reach storage, or that storage failed to store, can be uploaded again*/
+static int isBlockRetriable(BLOB_RESULT result, unsigned int httpStatus)
+{
+    return (result == BLOB_HTTP_ERROR) || ((result == BLOB_OK) && (httpStatus >= 500));
+}
+
+static int UploadBlocks_Worker(void* arg)
+{
+    BLOB_UPLOAD_WORKER* worker = (BLOB_UPLOAD_WORKER*)arg;
+    BLOB_UPLOAD_CONTEXT* context = worker->context;
+    int done = 0;
+    while (!done)
+    {
+        unsigned int blockID = 0;
+        const unsigned char* blockSource = NULL;
+        size_t blockSize = 0;
+
+        /*Codes_SRS_BLOB_02_039: [ Each worker shall take the next block not yet taken by any worker and upload it by "Put Block" on the worker's own HTTPAPIEX_HANDLE, as in the steps above. ]*/
+        if ((context->lock != NULL) && (Lock(context->lock) != LOCK_OK))
+        {
+            LogError("unable to Lock");
+            done = 1;
+        }
+        else
+        {
+            if (takeNextBlock(worker, &blockID, &blockSource, &blockSize) != 0)
+            {
+                done = 1;
+            }
+
+            if (context->lock != NULL)
+            {
+                (void)Unlock(context->lock);
+            }
+        }
+
+        if (!done)
+        {
+            char blockIdString[9];
+            int isError = 0;
+            BLOB_RESULT result;
+
+            if (encodeBlockId(blockID, blockIdString) != 0)
+            {
+                /*Codes_SRS_BLOB_02_033: [ If any previous operation that doesn't have an explicit failure description fails then Blob_UploadFromSasUri shall fail and return BLOB_ERROR ]*/
+                result = BLOB_ERROR;
+                isError = 1;
+            }
+            else
+            {
+                /*Codes_SRS_BLOB_02_053: [ If "Put Block" fails because HTTPAPIEX_ExecuteRequest fails or because the HTTP status code is 500 or more, then Blob_UploadFromSasUriWithReaderResumable shall upload the block again, up to 4 more times, waiting 1, 2, 4 and 8 seconds before the retries. ]*/
+                size_t retries = (context->resume != NULL) ? BLOCK_RETRY_COUNT : 0;
+                unsigned int retryDelay = BLOCK_RETRY_INITIAL_DELAY_MS;
+                result = putBlock(worker->httpApiExHandle, context->relativePath, blockIdString, blockSource, blockSize, &(worker->httpStatus), worker->httpResponse, &isError);
+                while (isError && (retries > 0) && isBlockRetriable(result, worker->httpStatus))
+                {
+                    LogError("block %u failed, uploading it again in %u ms", blockID, retryDelay);
+                    ThreadAPI_Sleep(retryDelay);
+                    retryDelay *= 2;
+                    retries--;
+                    isError = 0;
+                    result = putBlock(worker->httpApiExHandle, context->relativePath, blockIdString, blockSource, blockSize, &(worker->httpStatus), worker->httpResponse, &isError);
+                }
+            }
+
+            if (!isError && (context->resume != NULL) && (context->resume->onBlockUploaded != NULL))
+            {
+                /*Codes_SRS_BLOB_02_054: [ After a block has been uploaded, Blob_UploadFromSasUriWithReaderResumable shall call resume->onBlockUploaded (when not NULL) passing resume->onBlockUploadedContext and the blockID, never from more than one worker at a time. ]*/
+                if ((context->lock != NULL) && (Lock(context->lock) != LOCK_OK))
+                {
+                    LogError("unable to Lock, block %u is not reported as uploaded", blockID);
+                }
+                else
+                {
+                    context->resume->onBlockUploaded(context->resume->onBlockUploadedContext, blockID);
+
+                    if (context->lock != NULL)
+                    {
+                        (void)Unlock(context->lock);
+                    }
+                }
+            }
+
+            if (isError)
+            {
+                /*Codes_SRS_BLOB_02_040: [ When a block fails, the workers shall not take new blocks and Blob_UploadFromSasUriWithConcurrency shall return the result, httpStatus and httpResponse of the first block that failed. ]*/
+                if ((context->lock != NULL) && (Lock(context->lock) != LOCK_OK))
+                {
+                    LogError("unable to Lock, the failure of block %u is not reported", blockID);
+                }
+                else
+                {
+                    if (!context->isError)
+                    {
+                        context->isError = 1;
+                        context->result = result;
+                        *(context->httpStatus) = worker->httpStatus;
+                        if (worker->httpResponse != NULL)
                         {
-                            /*Codes_SRS_BLOB_02_007: [ If HTTPAPIEX_Create fails then Blob_UploadFromSasUri shall fail and return BLOB_ERROR. ]*/
-                            LogError("unable to create a HTTPAPIEX_HANDLE");
+                            const unsigned char* response = BUFFER_u_char(worker->httpResponse);
+                            size_t responseLength = BUFFER_length(worker->httpResponse);
+                            if (BUFFER_build(context->httpResponse, response, responseLength) != 0)
+                            {
+                                LogError("unable to BUFFER_build, the HTTP response of block %u is lost", blockID);
+                            }
+                        }
+                    }
+
+                    if (context->lock != NULL)
+                    {
+                        (void)Unlock(context->lock);
+                    }
+                }
+                done = 1;
+            }
+        }
+    }
+    return 0;
+}
+
+/*uploads all the blocks described by context from up to workerCount workers, isError is set when the upload cannot continue*/
+static BLOB_RESULT putBlocksInParallel(HTTPAPIEX_HANDLE httpApiExHandle, const char* hostname, BLOB_UPLOAD_CONTEXT* context, size_t workerCount, int* isError)
+{
+    BLOB_RESULT result;
+    BLOB_UPLOAD_WORKER* workers;
+
+    context->isEndOfSource = 0;
+    context->nextBlockID = 0;
+    context->isError = 0;
+    context->result = BLOB_OK;
+
+    /*a single worker does not share the blocks with anyone*/
+    context->lock = (workerCount > 1) ? Lock_Init() : NULL;
+    if ((workerCount > 1) && (context->lock == NULL))
+    {
+        /*Codes_SRS_BLOB_02_038: [ If creating the lock, the HTTPAPIEX_HANDLE or the thread of a worker fails, then the blocks shall be uploaded by the workers already started. ]*/
+        LogError("unable to Lock_Init, the blocks are uploaded by the calling thread only");
+        workerCount = 1;
+    }
+
+    workers = (BLOB_UPLOAD_WORKER*)malloc(workerCount * sizeof(BLOB_UPLOAD_WORKER));
+    if (workers == NULL)
+    {
+        /*Codes_SRS_BLOB_02_033: [ If any previous operation that doesn't have an explicit failure description fails then Blob_UploadFromSasUri shall fail and return BLOB_ERROR ]*/
+        LogError("oom - out of memory");
+        result = BLOB_ERROR;
+        *isError = 1;
+    }
+    else
+    {
+        size_t createdWorkers;
+        size_t startedThreads;
+        size_t i;
+
+        for (createdWorkers = 0; createdWorkers < workerCount; createdWorkers++)
+        {
+            BLOB_UPLOAD_WORKER* worker = &(workers[createdWorkers]);
+            worker->context = context;
+            worker->httpStatus = 0;
+            worker->httpResponse = NULL;
+            worker->httpApiExHandle = (createdWorkers == 0) ? httpApiExHandle : HTTPAPIEX_Create(hostname);
+            if (worker->httpApiExHandle == NULL)
+            {
+                /*Codes_SRS_BLOB_02_038: [ If creating the lock, the HTTPAPIEX_HANDLE or the thread of a worker fails, then the blocks shall be uploaded by the workers already started. ]*/
+                LogError("unable to HTTPAPIEX_Create, continuing with %zu workers", createdWorkers);
+                break;
+            }
+            /*every worker receives its HTTP response in its own buffer, so that the caller's buffer is only written by the first block that fails*/
+            else if ((context->httpResponse != NULL) && ((worker->httpResponse = BUFFER_new()) == NULL))
+            {
+                LogError("unable to BUFFER_new, continuing with %zu workers", createdWorkers);
+                if (createdWorkers != 0)
+                {
+                    HTTPAPIEX_Destroy(worker->httpApiExHandle);
+                }
+                break;
+            }
+            else if (context->getData == NULL)
+            {
+                worker->blockBuffer = NULL;
+            }
+            /*Codes_SRS_BLOB_02_044: [ Blob_UploadFromSasUriWithReader shall upload the data by "Put Block" in blocks of 4MB, whatever its size, from up to maxConcurrentBlocks workers as Blob_UploadFromSasUriWithConcurrency does. Every worker shall have its own 4MB buffer. ]*/
+            else if ((worker->blockBuffer = (unsigned char*)malloc(BLOCK_SIZE)) == NULL)
+            {
+                LogError("unable to malloc a block buffer, continuing with %zu workers", createdWorkers);
+                if (worker->httpResponse != NULL)
+                {
+                    BUFFER_delete(worker->httpResponse);
+                }
+                if (createdWorkers != 0)
+                {
+                    HTTPAPIEX_Destroy(worker->httpApiExHandle);
+                }
+                break;
+            }
+        }
+
+        if (createdWorkers == 0)
+        {
+            /*Codes_SRS_BLOB_02_033: [ If any previous operation that doesn't have an explicit failure description fails then Blob_UploadFromSasUri shall fail and return BLOB_ERROR ]*/
+            result = BLOB_ERROR;
+            *isError = 1;
+        }
+        else
+        {
+            /*workers[0] runs on the calling thread*/
+            for (startedThreads = 1; startedThreads < createdWorkers; startedThreads++)
+            {
+                if (ThreadAPI_Create(&(workers[startedThreads].threadHandle), UploadBlocks_Worker, &(workers[startedThreads])) != THREADAPI_OK)
+                {
+                    /*Codes_SRS_BLOB_02_038: [ If creating the lock, the HTTPAPIEX_HANDLE or the thread of a worker fails, then the blocks shall be uploaded by the workers already started. ]*/
+                    LogError("unable to ThreadAPI_Create, continuing with %zu workers", startedThreads);
+                    break;
+                }
+            }
+
+            (void)UploadBlocks_Worker(&(workers[0]));
+
+            /*Codes_SRS_BLOB_02_041: [ Blob_UploadFromSasUriWithConcurrency shall wait for all the workers to finish before executing "Put Block List". ]*/
+            for (i = 1; i < startedThreads; i++)
+            {
+                int notUsed;
+                if (ThreadAPI_Join(workers[i].threadHandle, &notUsed) != THREADAPI_OK)
+                {
+                    LogError("unable to ThreadAPI_Join");
+                }
+            }
+
+            for (i = 0; i < createdWorkers; i++)
+            {
+                if (workers[i].httpResponse != NULL)
+                {
+                    BUFFER_delete(workers[i].httpResponse);
+                }
+                if (workers[i].blockBuffer != NULL)
+                {
+                    free(workers[i].blockBuffer);
+                }
+                if (i != 0)
+                {
+                    HTTPAPIEX_Destroy(workers[i].httpApiExHandle);
+                }
+            }
+
+            result = context->result;
+            *isError = context->isError;
+        }
+        free(workers);
+    }
+
+    if (context->lock != NULL)
+    {
+        (void)Lock_Deinit(context->lock);
+    }
+    return result;
+}
+
+/*uploads the data read by getData by "Put Block" and commits the blocks by "Put Block List"*/
+static BLOB_RESULT putBlocksFromReader(HTTPAPIEX_HANDLE httpApiExHandle, const char* hostname, const char* relativePath, BLOB_READ_CALLBACK getData, void* getDataContext, const BLOB_UPLOAD_RESUME* resume, size_t maxConcurrentBlocks, unsigned int* httpStatus, BUFFER_HANDLE httpResponse)
+{
+    BLOB_RESULT result;
+    BLOB_UPLOAD_CONTEXT context;
+    int isError = 0;
+    context.relativePath = relativePath;
+    context.source = NULL;
+    context.size = 0;
+    context.getData = getData;
+    context.getDataContext = getDataContext;
+    context.resume = resume;
+    context.httpStatus = httpStatus;
+    context.httpResponse = httpResponse;
+
+    /*the number of blocks is only known once getData reaches the end of the data, every worker is started*/
+    result = putBlocksInParallel(httpApiExHandle, hostname, &context, maxConcurrentBlocks, &isError);
+    if (isError)
+    {
+        /*do nothing, it will be reported "as is"*/
+    }
+    else
+    {
+        /*Codes_SRS_BLOB_02_048: [ Once all the workers have finished, Blob_UploadFromSasUriWithReader shall execute "Put Block List" with the XML listing all the blocks in order, as Blob_UploadFromSasUri does. ]*/
+        /*Codes_SRS_BLOB_02_055: [ "Put Block List" shall list all the blocks, the ones uploaded by a previous attempt included. ]*/
+        STRING_HANDLE xml = STRING_construct("<?xml version=\"1.0\" encoding=\"utf-8\"?>\r\n<BlockList>");
+        if (xml == NULL)
+        {
+            /*Codes_SRS_BLOB_02_033: [ If any previous operation that doesn't have an explicit failure description fails then Blob_UploadFromSasUri shall fail and return BLOB_ERROR ]*/
+            LogError("failed to STRING_construct");
+            result = BLOB_ERROR;
+        }
+        else
+        {
+            unsigned int blockID;
+            for (blockID = 0; (blockID < context.nextBlockID) && !isError; blockID++)
+            {
+                char blockIdString[9];
+                if (!(
+                    (encodeBlockId(blockID, blockIdString) == 0) &&
+                    (STRING_concat(xml, "<Latest>") == 0) &&
+                    (STRING_concat(xml, blockIdString) == 0) &&
+                    (STRING_concat(xml, "</Latest>") == 0)
+                    ))
+                {
+                    /*Codes_SRS_BLOB_02_033: [ If any previous operation that doesn't have an explicit failure description fails then Blob_UploadFromSasUri shall fail and return BLOB_ERROR ]*/
+                    LogError("unable to add block %u to the XML", blockID);
+                    result = BLOB_ERROR;
+                    isError = 1;
+                }
+            }
+
+            if (!isError)
+            {
+                result = putBlockList(httpApiExHandle, relativePath, xml, httpStatus, httpResponse);
+            }
+            STRING_delete(xml);
+        }
+    }
+    return result;
+}
+
+/*disconnects connection from its storage host*/
+static void dropConnection(BLOB_CONNECTION* connection)
+{
+    if (connection->httpApiExHandle != NULL)
+    {
+        HTTPAPIEX_Destroy(connection->httpApiExHandle);
+        free(connection->hostname);
+        connection->httpApiExHandle = NULL;
+        connection->hostname = NULL;
+    }
+}
+
+/*uploads source, or the data read by getData when getData is not NULL, to the blob at SASURI. When connection is not NULL
+the connection to the storage host is taken from it and kept in it after the upload*/
+static BLOB_RESULT uploadToSasUri(BLOB_CONNECTION* connection, const char* SASURI, const unsigned char* source, size_t size, BLOB_READ_CALLBACK getData, void* getDataContext, const BLOB_UPLOAD_RESUME* resume, size_t maxConcurrentBlocks, unsigned int* httpStatus, BUFFER_HANDLE httpResponse)
+{
+    BLOB_RESULT result;
+    /*Codes_SRS_BLOB_02_017: [ Blob_UploadFromSasUri shall copy from SASURI the hostname to a new const char* ]*/
+    /*Codes_SRS_BLOB_02_004: [ Blob_UploadFromSasUri shall copy from SASURI the hostname to a new const char*. ]*/
+    /*to find the hostname, the following logic is applied:*/
+    /*the hostname starts at the first character after "://"*/
+    /*the hostname ends at the first character before the next "/" after "://"*/
+    const char* hostnameBegin = strstr(SASURI, "://");
+    if (hostnameBegin == NULL)
+    {
+        /*Codes_SRS_BLOB_02_005: [ If the hostname cannot be determined, then Blob_UploadFromSasUri shall fail and return BLOB_INVALID_ARG. ]*/
+        LogError("hostname cannot be determined");
+        result = BLOB_INVALID_ARG;
+    }
+    else
+    {
+        hostnameBegin += 3; /*have to skip 3 characters which are "://"*/
+        const char* hostnameEnd = strchr(hostnameBegin, '/');
+        if (hostnameEnd == NULL)
+        {
+            /*Codes_SRS_BLOB_02_005: [ If the hostname cannot be determined, then Blob_UploadFromSasUri shall fail and return BLOB_INVALID_ARG. ]*/
+            LogError("hostname cannot be determined");
+            result = BLOB_INVALID_ARG;
+        }
+        else
+        {
+            size_t hostnameSize = hostnameEnd - hostnameBegin;
+            char* hostname = (char*)malloc(hostnameSize + 1); /*+1 because of '\0' at the end*/
+            if (hostname == NULL)
+            {
+                /*Codes_SRS_BLOB_02_016: [ If the hostname copy cannot be made then then Blob_UploadFromSasUri shall fail and return BLOB_ERROR ]*/
+                LogError("oom - out of memory");
+                result = BLOB_ERROR;
+            }
+            else
+            {
+                HTTPAPIEX_HANDLE httpApiExHandle;
+                int isHostnameKept = 0; /*!=0 when hostname belongs to connection*/
+                memcpy(hostname, hostnameBegin, hostnameSize);
+                hostname[hostnameSize] = '\0';
+
+                if ((connection != NULL) && (connection->hostname != NULL) && (strcmp(connection->hostname, hostname) == 0))
+                {
+                    /*Codes_SRS_BLOB_02_058: [ If connection is connected to the hostname of SASURI then Blob_UploadFromSasUriOnConnection shall use its HTTPAPIEX_HANDLE instead of creating one. ]*/
+                    httpApiExHandle = connection->httpApiExHandle;
+                }
+                else
+                {
+                    if (connection != NULL)
+                    {
+                        /*Codes_SRS_BLOB_02_059: [ Otherwise Blob_UploadFromSasUriOnConnection shall destroy the HTTPAPIEX_HANDLE of connection, if any, create the HTTPAPIEX_HANDLE as Blob_UploadFromSasUri does and keep it in connection. ]*/
+                        dropConnection(connection);
+                    }
+
+                    /*Codes_SRS_BLOB_02_006: [ Blob_UploadFromSasUri shall create a new HTTPAPI_EX_HANDLE by calling HTTPAPIEX_Create passing the hostname. ]*/
+                    /*Codes_SRS_BLOB_02_018: [ Blob_UploadFromSasUri shall create a new HTTPAPI_EX_HANDLE by calling HTTPAPIEX_Create passing the hostname. ]*/
+                    httpApiExHandle = HTTPAPIEX_Create(hostname);
+                    if ((httpApiExHandle != NULL) && (connection != NULL))
+                    {
+                        connection->hostname = hostname;
+                        connection->httpApiExHandle = httpApiExHandle;
+                        isHostnameKept = 1;
+                    }
+                }
+
+                if (httpApiExHandle == NULL)
+                {
+                    /*Codes_SRS_BLOB_02_007: [ If HTTPAPIEX_Create fails then Blob_UploadFromSasUri shall fail and return BLOB_ERROR. ]*/
+                    LogError("unable to create a HTTPAPIEX_HANDLE");
+                    result = BLOB_ERROR;
+                }
+                else
+                {
+                    /*Codes_SRS_BLOB_02_008: [ Blob_UploadFromSasUri shall compute the relative path of the request from the SASURI parameter. ]*/
+                    /*Codes_SRS_BLOB_02_019: [ Blob_UploadFromSasUri shall compute the base relative path of the request from the SASURI parameter. ]*/
+                    const char* relativePath = hostnameEnd; /*this is where the relative path begins in the SasUri*/
+
+                    if (getData != NULL)
+                    {
+                        result = putBlocksFromReader(httpApiExHandle, hostname, relativePath, getData, getDataContext, resume, maxConcurrentBlocks, httpStatus, httpResponse);
+                    }
+                    else if (size < 64 * 1024 * 1024) /*code path for sizes <64MB*/
+                    {
+                        /*Codes_SRS_BLOB_02_010: [ Blob_UploadFromSasUri shall create a BUFFER_HANDLE from source and size parameters. ]*/
+                        BUFFER_HANDLE requestBuffer = BUFFER_create(source, size);
+                        if (requestBuffer == NULL)
+                        {
+                            /*Codes_SRS_BLOB_02_011: [ If any of the previous steps related to building the HTTPAPI_EX_ExecuteRequest parameters fails, then Blob_UploadFromSasUri shall fail and return BLOB_ERROR. ]*/
+                            LogError("unable to BUFFER_create");
                             result = BLOB_ERROR;
                         }
                         else
                         {
-                            /*Codes_SRS_BLOB_02_008: [ Blob_UploadFromSasUri shall compute the relative path of the request from the SASURI parameter. ]*/
-                            /*Codes_SRS_BLOB_02_019: [ Blob_UploadFromSasUri shall compute the base relative path of the request from the SASURI parameter. ]*/
-                            const char* relativePath = hostnameEnd; /*this is where the relative path begins in the SasUri*/
-
-                            if (size < 64 * 1024 * 1024) /*code path for sizes <64MB*/
+                            /*Codes_SRS_BLOB_02_009: [ Blob_UploadFromSasUri shall create an HTTP_HEADERS_HANDLE for the request HTTP headers carrying the following headers: ]*/
+                            HTTP_HEADERS_HANDLE requestHttpHeaders = HTTPHeaders_Alloc();
+                            if (requestHttpHeaders == NULL)
+                            {
+                                /*Codes_SRS_BLOB_02_011: [ If any of the previous steps related to building the HTTPAPI_EX_ExecuteRequest parameters fails, then Blob_UploadFromSasUri shall fail and return BLOB_ERROR. ]*/
+                                LogError("unable to HTTPHeaders_Alloc");
+                                result = BLOB_ERROR;
+                            }
+                            else
                             {
-                                /*Codes_SRS_BLOB_02_010: [ Blob_UploadFromSasUri shall create a BUFFER_HANDLE from source and size parameters. ]*/
-                                BUFFER_HANDLE requestBuffer = BUFFER_create(source, size);
-                                if (requestBuffer == NULL)
+                                if (HTTPHeaders_AddHeaderNameValuePair(requestHttpHeaders, "x-ms-blob-type", "BlockBlob") != HTTP_HEADERS_OK)
                                 {
                                     /*Codes_SRS_BLOB_02_011: [ If any of the previous steps related to building the HTTPAPI_EX_ExecuteRequest parameters fails, then Blob_UploadFromSasUri shall fail and return BLOB_ERROR. ]*/
-                                    LogError("unable to BUFFER_create");
+                                    LogError("unable to HTTPHeaders_AddHeaderNameValuePair");
                                     result = BLOB_ERROR;
                                 }
                                 else
                                 {
-                                    /*Codes_SRS_BLOB_02_009: [ Blob_UploadFromSasUri shall create an HTTP_HEADERS_HANDLE for the request HTTP headers carrying the following headers: ]*/
-                                    HTTP_HEADERS_HANDLE requestHttpHeaders = HTTPHeaders_Alloc();
-                                    if (requestHttpHeaders == NULL)
+                                    /*Codes_SRS_BLOB_02_012: [ Blob_UploadFromSasUri shall call HTTPAPIEX_ExecuteRequest passing the parameters previously build, httpStatus and httpResponse ]*/
+                                    if (HTTPAPIEX_ExecuteRequest(httpApiExHandle, HTTPAPI_REQUEST_PUT, relativePath, requestHttpHeaders, requestBuffer, httpStatus, NULL, httpResponse) != HTTPAPIEX_OK)
                                     {
-                                        /*Codes_SRS_BLOB_02_011: [ If any of the previous steps related to building the HTTPAPI_EX_ExecuteRequest parameters fails, then Blob_UploadFromSasUri shall fail and return BLOB_ERROR. ]*/
-                                        LogError("unable to HTTPHeaders_Alloc");
-                                        result = BLOB_ERROR;
+                                        /*Codes_SRS_BLOB_02_013: [ If HTTPAPIEX_ExecuteRequest fails, then Blob_UploadFromSasUri shall fail and return BLOB_HTTP_ERROR. ]*/
+                                        LogError("failed to HTTPAPIEX_ExecuteRequest");
+                                        result = BLOB_HTTP_ERROR;
                                     }
                                     else
                                     {
-                                        if (HTTPHeaders_AddHeaderNameValuePair(requestHttpHeaders, "x-ms-blob-type", "BlockBlob") != HTTP_HEADERS_OK)
-                                        {
-                                            /*Codes_SRS_BLOB_02_011: [ If any of the previous steps related to building the HTTPAPI_EX_ExecuteRequest parameters fails, then Blob_UploadFromSasUri shall fail and return BLOB_ERROR. ]*/
-                                            LogError("unable to HTTPHeaders_AddHeaderNameValuePair");
-                                            result = BLOB_ERROR;
-                                        }
-                                        else
-                                        {
-                                            /*Codes_SRS_BLOB_02_012: [ Blob_UploadFromSasUri shall call HTTPAPIEX_ExecuteRequest passing the parameters previously build, httpStatus and httpResponse ]*/
-                                            if (HTTPAPIEX_ExecuteRequest(httpApiExHandle, HTTPAPI_REQUEST_PUT, relativePath, requestHttpHeaders, requestBuffer, httpStatus, NULL, httpResponse) != HTTPAPIEX_OK)
-                                            {
-                                                /*Codes_SRS_BLOB_02_013: [ If HTTPAPIEX_ExecuteRequest fails, then Blob_UploadFromSasUri shall fail and return BLOB_HTTP_ERROR. ]*/
-                                                LogError("failed to HTTPAPIEX_ExecuteRequest");
-                                                result = BLOB_HTTP_ERROR;
-                                            }
-                                            else
-                                            {
-                                                /*Codes_SRS_BLOB_02_015: [ Otherwise, HTTPAPIEX_ExecuteRequest shall succeed and return BLOB_OK. ]*/
-                                                result = BLOB_OK;
-                                            }
-                                        }
-                                        HTTPHeaders_Free(requestHttpHeaders);
+                                        /*Codes_SRS_BLOB_02_015: [ Otherwise, HTTPAPIEX_ExecuteRequest shall succeed and return BLOB_OK. ]*/
+                                        result = BLOB_OK;
                                     }
-                                    BUFFER_delete(requestBuffer);
                                 }
+                                HTTPHeaders_Free(requestHttpHeaders);
                             }
-                            else /*code path for size >= 64MB*/
+                            BUFFER_delete(requestBuffer);
+                        }
+                    }
+                    else /*code path for size >= 64MB*/
+                    {
+                        /*Codes_SRS_BLOB_02_028: [ Blob_UploadFromSasUri shall construct an XML string with the following content: ]*/
+                        STRING_HANDLE xml = STRING_construct("<?xml version=\"1.0\" encoding=\"utf-8\"?>\r\n<BlockList>"); /*the XML "build as we go"*/
+                        if (xml == NULL)
+                        {
+                            /*Codes_SRS_BLOB_02_033: [ If any previous operation that doesn't have an explicit failure description fails then Blob_UploadFromSasUri shall fail and return BLOB_ERROR ]*/
+                            LogError("failed to STRING_construct");
+                            result = BLOB_HTTP_ERROR;
+                        }
+                        else
+                        {
+                            /*Codes_SRS_BLOB_02_021: [ For every block of 4MB the following operations shall happen: ]*/
+                            size_t toUpload = size;
+                            unsigned int blockID = 0;
+                            int isError = 0; /*used to cleanly exit the loop*/
+                            do
                             {
-                                size_t toUpload = size;
-                                /*Codes_SRS_BLOB_02_028: [ Blob_UploadFromSasUri shall construct an XML string with the following content: ]*/
-                                STRING_HANDLE xml = STRING_construct("<?xml version=\"1.0\" encoding=\"utf-8\"?>\r\n<BlockList>"); /*the XML "build as we go"*/
-                                if (xml == NULL)
+                                /*setting this block size*/
+                                size_t thisBlockSize = (toUpload > BLOCK_SIZE) ? BLOCK_SIZE : toUpload;
+                                char blockIdString[9];
+                                if (encodeBlockId(blockID, blockIdString) != 0)
                                 {
                                     /*Codes_SRS_BLOB_02_033: [ If any previous operation that doesn't have an explicit failure description fails then Blob_UploadFromSasUri shall fail and return BLOB_ERROR ]*/
-                                    LogError("failed to STRING_construct");
-                                    result = BLOB_HTTP_ERROR;
+                                    result = BLOB_ERROR;
+                                    isError = 1;
                                 }
                                 else
                                 {
-                                    /*Codes_SRS_BLOB_02_021: [ For every block of 4MB the following operations shall happen: ]*/
-                                    unsigned int blockID = 0;
-                                    int isError = 0; /*used to cleanly exit the loop*/
-                                    do
+                                    /*add the blockId base64 encoded to the XML*/
+                                    if (!(
+                                        (STRING_concat(xml, "<Latest>")==0) &&
+                                        (STRING_concat(xml, blockIdString)==0) &&
+                                        (STRING_concat(xml, "</Latest>") == 0)
+                                        ))
                                     {
-                                        /*setting this block size*/
-                                        size_t thisBlockSize = (toUpload > BLOCK_SIZE) ? BLOCK_SIZE : toUpload;
-                                        /*Codes_SRS_BLOB_02_020: [ Blob_UploadFromSasUri shall construct a BASE64 encoded string from the block ID (000000... 0499999) ]*/
-                                        char temp[7]; /*this will contain 000000... 049999*/
-                                        if (sprintf(temp, "%6u", (unsigned int)blockID) != 6) /*produces 000000... 049999*/
-                                        {
-                                            /*Codes_SRS_BLOB_02_033: [ If any previous operation that doesn't have an explicit failure description fails then Blob_UploadFromSasUri shall fail and return BLOB_ERROR ]*/
-                                            LogError("failed to sprintf");
-                                            result = BLOB_ERROR;
-                                            isError = 1;
-                                        }
-                                        else
-                                        {
-                                            STRING_HANDLE blockIdString = Base64_Encode_Bytes(temp, 6);
-                                            if (blockIdString == NULL)
-                                            {
-                                                /*Codes_SRS_BLOB_02_033: [ If any previous operation that doesn't have an explicit failure description fails then Blob_UploadFromSasUri shall fail and return BLOB_ERROR ]*/
-                                                LogError("unable to Base64_Encode_Bytes");
-                                                result = BLOB_ERROR;
-                                                isError = 1;
-                                            }
-                                            else
-                                            {
-                                                /*add the blockId base64 encoded to the XML*/
-                                                if (!(
-                                                    (STRING_concat(xml, "<Latest>")==0) &&
-                                                    (STRING_concat_with_STRING(xml, blockIdString)==0) &&
-                                                    (STRING_concat(xml, "</Latest>") == 0)
-                                                    ))
-                                                {
-                                                    /*Codes_SRS_BLOB_02_033: [ If any previous operation that doesn't have an explicit failure description fails then Blob_UploadFromSasUri shall fail and return BLOB_ERROR ]*/
-                                                    LogError("unable to STRING_concat");
-                                                    result = BLOB_ERROR;
-                                                    isError = 1;
-                                                }
-                                                else
-                                                {
-                                                    /*Codes_SRS_BLOB_02_022: [ Blob_UploadFromSasUri shall construct a new relativePath from following string: base relativePath + "&comp=block&blockid=BASE64 encoded string of blockId" ]*/
-                                                    STRING_HANDLE newRelativePath = STRING_construct(relativePath);
-                                                    if (newRelativePath == NULL)
-                                                    {
-                                                        /*Codes_SRS_BLOB_02_033: [ If any previous operation that doesn't have an explicit failure description fails then Blob_UploadFromSasUri shall fail and return BLOB_ERROR ]*/
-                                                        LogError("unable to STRING_construct");
-                                                        result = BLOB_ERROR;
-                                                        isError = 1;
-                                                    }
-                                                    else
-                                                    {
-                                                        if (!(
-                                                            (STRING_concat(newRelativePath, "&comp=block&blockid=") == 0) &&
-                                                            (STRING_concat_with_STRING(newRelativePath, blockIdString) == 0)
-                                                            ))
-                                                        {
-                                                            /*Codes_SRS_BLOB_02_033: [ If any previous operation that doesn't have an explicit failure description fails then Blob_UploadFromSasUri shall fail and return BLOB_ERROR ]*/
-                                                            LogError("unable to STRING concatenate");
-                                                            result = BLOB_ERROR;
-                                                            isError = 1;
-                                                        }
-                                                        else
-                                                        {
-                                                            /*Codes_SRS_BLOB_02_023: [ Blob_UploadFromSasUri shall create a BUFFER_HANDLE from source and size parameters. ]*/
-                                                            BUFFER_HANDLE requestContent = BUFFER_create(source + (size - toUpload), thisBlockSize);
-                                                            if (requestContent == NULL)
-                                                            {
-                                                                /*Codes_SRS_BLOB_02_033: [ If any previous operation that doesn't have an explicit failure description fails then Blob_UploadFromSasUri shall fail and return BLOB_ERROR ]*/
-                                                                LogError("unable to BUFFER_create");
-                                                                result = BLOB_ERROR;
-                                                                isError = 1;
-                                                            }
-                                                            else
-                                                            {
-                                                                /*Codes_SRS_BLOB_02_024: [ Blob_UploadFromSasUri shall call HTTPAPIEX_ExecuteRequest with a PUT operation, passing httpStatus and httpResponse. ]*/
-                                                                if (HTTPAPIEX_ExecuteRequest(
-                                                                    httpApiExHandle,
-                                                                    HTTPAPI_REQUEST_PUT,
-                                                                    STRING_c_str(newRelativePath),
-                                                                    NULL,
-                                                                    requestContent,
-                                                                    httpStatus,
-                                                                    NULL,
-                                                                    httpResponse) != HTTPAPIEX_OK
-                                                                    )
-                                                                {
-                                                                    /*Codes_SRS_BLOB_02_025: [ If HTTPAPIEX_ExecuteRequest fails then Blob_UploadFromSasUri shall fail and return BLOB_HTTP_ERROR. ]*/
-                                                                    LogError("unable to HTTPAPIEX_ExecuteRequest");
-                                                                    result = BLOB_HTTP_ERROR;
-                                                                    isError = 1;
-                                                                }
-                                                                else if (*httpStatus >= 300)
-                                                                {
-                                                                    /*Codes_SRS_BLOB_02_026: [ Otherwise, if HTTP response code is >=300 then Blob_UploadFromSasUri shall succeed and return BLOB_OK. ]*/
-                                                                    LogError("HTTP status from storage does not indicate success (%d)", (int)*httpStatus);
-                                                                    result = BLOB_OK;
-                                                                    isError = 1;
-                                                                }
-                                                                else
-                                                                {
-                                                                    /*Codes_SRS_BLOB_02_027: [ Otherwise Blob_UploadFromSasUri shall continue execution. ]*/
-                                                                }
-                                                                BUFFER_delete(requestContent);
-                                                            }
-                                                        }
-                                                        STRING_delete(newRelativePath);
-                                                    }
-                                                }
-                                                STRING_delete(blockIdString);
-                                            }
-                                        }
-
-                                        blockID++;
-                                        toUpload -= thisBlockSize;
-                                    } while ((toUpload > 0) && !isError);
-
-                                    if (isError)
+                                        /*Codes_SRS_BLOB_02_033: [ If any previous operation that doesn't have an explicit failure description fails then Blob_UploadFromSasUri shall fail and return BLOB_ERROR ]*/
+                                        LogError("unable to STRING_concat");
+                                        result = BLOB_ERROR;
+                                        isError = 1;
+                                    }
+                                    else if (maxConcurrentBlocks > 1)
                                     {
-                                        /*do nothing, it will be reported "as is"*/
+                                        /*the blocks are uploaded by the workers once the XML lists all of them*/
                                     }
                                     else
                                     {
-                                        /*complete the XML*/
-                                        if (STRING_concat(xml, "</BlockList>") != 0)
-                                        {
-                                            /*Codes_SRS_BLOB_02_033: [ If any previous operation that doesn't have an explicit failure description fails then Blob_UploadFromSasUri shall fail and return BLOB_ERROR ]*/
-                                            LogError("failed to STRING_concat");
-                                            result = BLOB_ERROR;
-                                        }
-                                        else
-                                        {
-                                            /*Codes_SRS_BLOB_02_029: [Blob_UploadFromSasUri shall construct a new relativePath from following string : base relativePath + "&comp=blocklist"]*/
-                                            STRING_HANDLE newRelativePath = STRING_construct(relativePath);
-                                            if (newRelativePath == NULL)
-                                            {
-                                                /*Codes_SRS_BLOB_02_033: [ If any previous operation that doesn't have an explicit failure description fails then Blob_UploadFromSasUri shall fail and return BLOB_ERROR ]*/
-                                                LogError("failed to STRING_construct");
-                                                result = BLOB_ERROR;
-                                            }
-                                            else
-                                            {
-                                                if (STRING_concat(newRelativePath, "&comp=blocklist") != 0)
-                                                {
-                                                    /*Codes_SRS_BLOB_02_033: [ If any previous operation that doesn't have an explicit failure description fails then Blob_UploadFromSasUri shall fail and return BLOB_ERROR ]*/
-                                                    LogError("failed to STRING_concat");
-                                                    result = BLOB_ERROR;
-                                                }
-                                                else
-                                                {
-                                                    /*Codes_SRS_BLOB_02_030: [ Blob_UploadFromSasUri shall call HTTPAPIEX_ExecuteRequest with a PUT operation, passing the new relativePath, httpStatus and httpResponse and the XML string as content. ]*/
-                                                    const unsigned char* s = (const unsigned char*)STRING_c_str(xml);
-                                                    BUFFER_HANDLE xmlAsBuffer = BUFFER_create(s, strlen(s));
-                                                    if (xmlAsBuffer == NULL)
-                                                    {
-                                                        /*Codes_SRS_BLOB_02_033: [ If any previous operation that doesn't have an explicit failure description fails then Blob_UploadFromSasUri shall fail and return BLOB_ERROR ]*/
-                                                        LogError("failed to BUFFER_create");
-                                                        result = BLOB_ERROR;
-                                                    }
-                                                    else
-                                                    {
-                                                        if (HTTPAPIEX_ExecuteRequest(
-                                                            httpApiExHandle,
-                                                            HTTPAPI_REQUEST_PUT,
-                                                            STRING_c_str(newRelativePath),
-                                                            NULL,
-                                                            xmlAsBuffer,
-                                                            httpStatus,
-                                                            NULL,
-                                                            httpResponse
-                                                        ) != HTTPAPIEX_OK)
-                                                        {
-                                                            /*Codes_SRS_BLOB_02_031: [ If HTTPAPIEX_ExecuteRequest fails then Blob_UploadFromSasUri shall fail and return BLOB_HTTP_ERROR. ]*/
-                                                            LogError("unable to HTTPAPIEX_ExecuteRequest");
-                                                            result = BLOB_HTTP_ERROR;
-                                                        }
-                                                        else
-                                                        {
-                                                            /*Codes_SRS_BLOB_02_032: [ Otherwise, Blob_UploadFromSasUri shall succeed and return BLOB_OK. ]*/
-                                                            result = BLOB_OK;
-                                                        }
-                                                        BUFFER_delete(xmlAsBuffer);
-                                                    }
-                                                }
-                                                STRING_delete(newRelativePath);
-                                            }
-                                        }
+                                        result = putBlock(httpApiExHandle, relativePath, blockIdString, source + (size - toUpload), thisBlockSize, httpStatus, httpResponse, &isError);
                                     }
-                                    STRING_delete(xml);
                                 }
+
+                                blockID++;
+                                toUpload -= thisBlockSize;
+                            } while ((toUpload > 0) && !isError);
+
+                            if (!isError && (maxConcurrentBlocks > 1))
+                            {
+                                BLOB_UPLOAD_CONTEXT context;
+                                unsigned int blockCount = (unsigned int)((size - 1) / BLOCK_SIZE + 1);
+                                context.relativePath = relativePath;
+                                context.source = source;
+                                context.size = size;
+                                context.getData = NULL;
+                                context.getDataContext = NULL;
+                                context.resume = NULL;
+                                context.httpStatus = httpStatus;
+                                context.httpResponse = httpResponse;
+
+                                /*Codes_SRS_BLOB_02_037: [ If size is at least 64MB and maxConcurrentBlocks is greater than 1 then Blob_UploadFromSasUriWithConcurrency shall upload the blocks from min(maxConcurrentBlocks, number of blocks) workers. The first worker shall run on the calling thread and use the HTTPAPIEX_HANDLE created above, every other worker shall run on its own thread and use its own HTTPAPIEX_HANDLE created by calling HTTPAPIEX_Create passing the hostname. ]*/
+                                result = putBlocksInParallel(httpApiExHandle, hostname, &context, (maxConcurrentBlocks < blockCount) ? maxConcurrentBlocks : blockCount, &isError);
                             }
-                            HTTPAPIEX_Destroy(httpApiExHandle);
+
+                            if (isError)
+                            {
+                                /*do nothing, it will be reported "as is"*/
+                            }
+                            else
+                            {
+                                result = putBlockList(httpApiExHandle, relativePath, xml, httpStatus, httpResponse);
+                            }
+                            STRING_delete(xml);
                         }
-                        free(hostname);
                     }
+
+                    if (connection == NULL)
+                    {
+                        HTTPAPIEX_Destroy(httpApiExHandle);
+                    }
+                    else if (result != BLOB_OK)
+                    {
+                        /*Codes_SRS_BLOB_02_060: [ If the upload fails then Blob_UploadFromSasUriOnConnection shall destroy the HTTPAPIEX_HANDLE of connection, so that the next upload connects again. ]*/
+                        dropConnection(connection); /*frees hostname too when it is kept*/
+                    }
+                    else
+                    {
+                        /*the connection stays open for the next upload*/
+                    }
+                }
+                if (!isHostnameKept)
+                {
+                    free(hostname);
                 }
             }
         }
     }
     return result;
 }
+
+/*validates the arguments of Blob_UploadFromSasUriWithConcurrency and uploads source*/
+static BLOB_RESULT uploadFromSource(BLOB_CONNECTION* connection, const char* SASURI, const unsigned char* source, size_t size, size_t maxConcurrentBlocks, unsigned int* httpStatus, BUFFER_HANDLE httpResponse)
+{
+    BLOB_RESULT result;
+    /*Codes_SRS_BLOB_02_001: [ If SASURI is NULL then Blob_UploadFromSasUri shall fail and return BLOB_INVALID_ARG. ]*/
+    if (SASURI == NULL)
+    {
+        LogError("parameter SASURI is NULL");
+        result = BLOB_INVALID_ARG;
+    }
+    else
+    {
+        /*Codes_SRS_BLOB_02_002: [ If source is NULL and size is not zero then Blob_UploadFromSasUri shall fail and return BLOB_INVALID_ARG. ]*/
+        if (
+            (size > 0) &&
+            (source == NULL)
+            )
+        {
+            LogError("combination of source = %p and size = %zu is invalid", source, size);
+            result = BLOB_INVALID_ARG;
+        }
+        /*Codes_SRS_BLOB_02_034: [ If size is bigger than 50000*4*1024*1024 then Blob_UploadFromSasUri shall fail and return BLOB_INVALID_ARG. ]*/
+        else if (size > 50000ULL * 4 * 1024 * 1024) /*https://msdn.microsoft.com/en-us/library/azure/dd179467.aspx says "Each block can be a different size, up to a maximum of 4 MB, and a block blob can include a maximum of 50,000 blocks."*/
+        {
+            LogError("size too big (%zu)", size);
+            result = BLOB_INVALID_ARG;
+        }
+        /*Codes_SRS_BLOB_02_036: [ If maxConcurrentBlocks is 0 then Blob_UploadFromSasUriWithConcurrency shall fail and return BLOB_INVALID_ARG. ]*/
+        else if (maxConcurrentBlocks == 0)
+        {
+            LogError("maxConcurrentBlocks cannot be 0");
+            result = BLOB_INVALID_ARG;
+        }
+        else
+        {
+            result = uploadToSasUri(connection, SASURI, source, size, NULL, NULL, NULL, maxConcurrentBlocks, httpStatus, httpResponse);
+        }
+    }
+    return result;
+}
+
+/*validates the arguments of Blob_UploadFromSasUriWithReader and uploads the data read by getData*/
+static BLOB_RESULT uploadFromReader(BLOB_CONNECTION* connection, const char* SASURI, BLOB_READ_CALLBACK getData, void* context, size_t maxConcurrentBlocks, unsigned int* httpStatus, BUFFER_HANDLE httpResponse)
+{
+    BLOB_RESULT result;
+    /*Codes_SRS_BLOB_02_042: [ If SASURI or getData is NULL then Blob_UploadFromSasUriWithReader shall fail and return BLOB_INVALID_ARG. ]*/
+    if (
+        (SASURI == NULL) ||
+        (getData == NULL)
+        )
+    {
+        LogError("invalid argument detected SASURI=%p getData=%p", SASURI, getData);
+        result = BLOB_INVALID_ARG;
+    }
+    /*Codes_SRS_BLOB_02_043: [ If maxConcurrentBlocks is 0 then Blob_UploadFromSasUriWithReader shall fail and return BLOB_INVALID_ARG. ]*/
+    else if (maxConcurrentBlocks == 0)
+    {
+        LogError("maxConcurrentBlocks cannot be 0");
+        result = BLOB_INVALID_ARG;
+    }
+    else
+    {
+        /*Codes_SRS_BLOB_02_049: [ Blob_UploadFromSasUriWithReader shall determine the hostname and the relative path and create the HTTPAPIEX_HANDLE as Blob_UploadFromSasUri does, failing the same way. ]*/
+        result = uploadToSasUri(connection, SASURI, NULL, 0, getData, context, NULL, maxConcurrentBlocks, httpStatus, httpResponse);
+    }
+    return result;
+}
+
+/*validates the arguments of Blob_UploadFromSasUriWithReaderResumable and uploads the blocks not uploaded by a previous attempt*/
+static BLOB_RESULT uploadFromReaderResumable(BLOB_CONNECTION* connection, const char* SASURI, BLOB_READ_CALLBACK getData, void* context, size_t maxConcurrentBlocks, const BLOB_UPLOAD_RESUME* resume, unsigned int* httpStatus, BUFFER_HANDLE httpResponse)
+{
+    BLOB_RESULT result;
+    /*Codes_SRS_BLOB_02_050: [ If SASURI, getData or resume is NULL, or if resume->isBlockUploaded is NULL and resume->blockCount is not 0, then Blob_UploadFromSasUriWithReaderResumable shall fail and return BLOB_INVALID_ARG. ]*/
+    if (
+        (SASURI == NULL) ||
+        (getData == NULL) ||
+        (resume == NULL) ||
+        ((resume->isBlockUploaded == NULL) && (resume->blockCount != 0))
+        )
+    {
+        LogError("invalid argument detected SASURI=%p getData=%p resume=%p", SASURI, getData, resume);
+        result = BLOB_INVALID_ARG;
+    }
+    /*Codes_SRS_BLOB_02_051: [ If maxConcurrentBlocks is 0 then Blob_UploadFromSasUriWithReaderResumable shall fail and return BLOB_INVALID_ARG. ]*/
+    else if (maxConcurrentBlocks == 0)
+    {
+        LogError("maxConcurrentBlocks cannot be 0");
+        result = BLOB_INVALID_ARG;
+    }
+    else
+    {
+        result = uploadToSasUri(connection, SASURI, NULL, 0, getData, context, resume, maxConcurrentBlocks, httpStatus, httpResponse);
+    }
+    return result;
+}
+
+BLOB_RESULT Blob_UploadFromSasUri(const char* SASURI, const unsigned char* source, size_t size, unsigned int* httpStatus, BUFFER_HANDLE httpResponse)
+{
+    /*Codes_SRS_BLOB_02_035: [ Blob_UploadFromSasUri shall behave as Blob_UploadFromSasUriWithConcurrency called with maxConcurrentBlocks set to 1. ]*/
+    return Blob_UploadFromSasUriWithConcurrency(SASURI, source, size, 1, httpStatus, httpResponse);
+}
+
+BLOB_RESULT Blob_UploadFromSasUriWithConcurrency(const char* SASURI, const unsigned char* source, size_t size, size_t maxConcurrentBlocks, unsigned int* httpStatus, BUFFER_HANDLE httpResponse)
+{
+    return uploadFromSource(NULL, SASURI, source, size, maxConcurrentBlocks, httpStatus, httpResponse);
+}
+
+BLOB_RESULT Blob_UploadFromSasUriWithReader(const char* SASURI, BLOB_READ_CALLBACK getData, void* context, size_t maxConcurrentBlocks, unsigned int* httpStatus, BUFFER_HANDLE httpResponse)
+{
+    return uploadFromReader(NULL, SASURI, getData, context, maxConcurrentBlocks, httpStatus, httpResponse);
+}
+
+BLOB_RESULT Blob_UploadFromSasUriWithReaderResumable(const char* SASURI, BLOB_READ_CALLBACK getData, void* context, size_t maxConcurrentBlocks, const BLOB_UPLOAD_RESUME* resume, unsigned int* httpStatus, BUFFER_HANDLE httpResponse)
+{
+    return uploadFromReaderResumable(NULL, SASURI, getData, context, maxConcurrentBlocks, resume, httpStatus, httpResponse);
+}
+
+BLOB_CONNECTION_HANDLE Blob_CreateConnection(void)
+{
+    /*Codes_SRS_BLOB_02_061: [ Blob_CreateConnection shall allocate a connection that is not connected to any storage host. ]*/
+    BLOB_CONNECTION* result = (BLOB_CONNECTION*)malloc(sizeof(BLOB_CONNECTION));
+    if (result == NULL)
+    {
+        /*Codes_SRS_BLOB_02_062: [ If allocating the connection fails then Blob_CreateConnection shall return NULL. ]*/
+        LogError("oom - out of memory");
+    }
+    else
+    {
+        result->hostname = NULL;
+        result->httpApiExHandle = NULL;
+    }
+    return result;
+}
+
+void Blob_DestroyConnection(BLOB_CONNECTION_HANDLE connection)
+{
+    if (connection == NULL)
+    {
+        /*Codes_SRS_BLOB_02_063: [ If connection is NULL then Blob_DestroyConnection shall do nothing. ]*/
+        LogError("unexpected NULL argument");
+    }
+    else
+    {
+        /*Codes_SRS_BLOB_02_064: [ Blob_DestroyConnection shall destroy the HTTPAPIEX_HANDLE of connection, if any, and free connection. ]*/
+        dropConnection(connection);
+        free(connection);
+    }
+}
+
+BLOB_RESULT Blob_UploadFromSasUriOnConnection(BLOB_CONNECTION_HANDLE connection, const char* SASURI, const unsigned char* source, size_t size, BLOB_READ_CALLBACK getData, void* context, size_t maxConcurrentBlocks, const BLOB_UPLOAD_RESUME* resume, unsigned int* httpStatus, BUFFER_HANDLE httpResponse)
+{
+    BLOB_RESULT result;
+    /*Codes_SRS_BLOB_02_056: [ If connection is NULL, or if resume is not NULL and getData is NULL, then Blob_UploadFromSasUriOnConnection shall fail and return BLOB_INVALID_ARG. ]*/
+    if (
+        (connection == NULL) ||
+        ((resume != NULL) && (getData == NULL))
+        )
+    {
+        LogError("invalid argument detected connection=%p getData=%p resume=%p", connection, getData, resume);
+        result = BLOB_INVALID_ARG;
+    }
+    /*Codes_SRS_BLOB_02_057: [ Otherwise Blob_UploadFromSasUriOnConnection shall check its arguments and upload as Blob_UploadFromSasUriWithConcurrency does when getData is NULL, as Blob_UploadFromSasUriWithReader does when getData is not NULL and resume is NULL and as Blob_UploadFromSasUriWithReaderResumable does otherwise. ]*/
+    else if (getData == NULL)
+    {
+        result = uploadFromSource(connection, SASURI, source, size, maxConcurrentBlocks, httpStatus, httpResponse);
+    }
+    else if (resume == NULL)
+    {
+        result = uploadFromReader(connection, SASURI, getData, context, maxConcurrentBlocks, httpStatus, httpResponse);
+    }
+    else
+    {
+        result = uploadFromReaderResumable(connection, SASURI, getData, context, maxConcurrentBlocks, resume, httpStatus, httpResponse);
+    }
+    return result;
+}
@@ -10,6 +10,7 @@
 #include <stdlib.h>
 #include <signal.h>
 #include <stddef.h>
+#include <string.h>
 #include "azure_c_shared_utility/crt_abstractions.h"
 #include "iothub_client.h"
 #include "iothub_client_ll.h"
@@ -26,81 +27,88 @@ typedef struct IOTHUB_CLIENT_INSTANCE_TAG
     THREAD_HANDLE ThreadHandle;
     LOCK_HANDLE LockHandle;
     sig_atomic_t StopThread;
+    sig_atomic_t WorkPending; /*set by the APIs that enqueue work so the worker thread does not back off while there is something to do*/
+    unsigned int MaxIdleSleep; /*upper bound (in ms) of the worker thread sleep when there is nothing to send*/
+    IOTHUB_CLIENT_QUEUE_FULL_POLICY QueueFullPolicy; /*copy of the "messageQueueFullPolicy" given to the LL layer*/
+    unsigned int QueueBlockTimeout; /*ms, 0 means wait for room without limit*/
+    size_t QueueBusyRetries; /*IOTHUB_CLIENT_BUSY results of IoTHubClient_LL that have been retried under IOTHUB_CLIENT_QUEUE_FULL_BLOCK, they are not refusals*/
 #ifndef DONT_USE_UPLOADTOBLOB
-    LIST_HANDLE savedDataToBeCleaned; /*list containing UPLOADTOBLOB_SAVED_DATA*/
+    LOCK_HANDLE UploadLock; /*protects the members below, it is never held while uploading nor around IoTHubClient_LL_DoWork*/
+    LIST_HANDLE UploadQueue; /*list containing the UPLOADTOBLOB_SAVED_DATA waiting for the uploading thread*/
+    THREAD_HANDLE UploadingThreadHandle; /*NULL when there is no thread to join*/
+    int UploadingThreadRunning; /*0 once the uploading thread has found the queue empty and is about to exit*/
+    size_t UploadCount; /*uploads accepted and not finished (queued or being uploaded)*/
+    size_t UploadBytes; /*bytes of the sources copied for the uploads accepted and not finished*/
+    size_t UploadQueueMaxCount; /*0 means no limit*/
+    size_t UploadQueueMaxBytes; /*0 means no limit*/
+    IOTHUB_CLIENT_QUEUE_FULL_POLICY UploadQueueFullPolicy;
+    unsigned int UploadQueueBlockTimeout; /*ms, 0 means wait for room without limit*/
 #endif
 } IOTHUB_CLIENT_INSTANCE;
 
+#define MIN_WORKER_SLEEP 1 /*ms*/
+#define QUEUE_FULL_RETRY_SLEEP 10 /*ms*/
+
 #ifndef DONT_USE_UPLOADTOBLOB
+#ifdef _MSC_VER
+#define UPLOAD_THREAD_LOCAL __declspec(thread)
+#else
+#define UPLOAD_THREAD_LOCAL __thread
+#endif
+
+/*1 on an uploading thread while it is in an upload callback, which might call IoTHubClient_UploadToBlobAsync*/
+static UPLOAD_THREAD_LOCAL int inUploadCallback = 0;
+
 typedef struct UPLOADTOBLOB_SAVED_DATA_TAG
 {
     unsigned char* source;
     size_t size;
+    char* sourceFileName; /*NULL when source is uploaded, otherwise the file is read by the uploading thread*/
     char* destinationFileName;
     IOTHUB_CLIENT_FILE_UPLOAD_CALLBACK iotHubClientFileUploadCallback;
     void* context;
-    THREAD_HANDLE uploadingThreadHandle;
-    IOTHUB_CLIENT_HANDLE iotHubClientHandle;
-    LOCK_HANDLE lockGarbage;
-    int canBeGarbageCollected; /*flag indicating that the UPLOADTOBLOB_SAVED_DATA structure can be freed because the thread deadling with it finished*/
 }UPLOADTOBLOB_SAVED_DATA;
 #endif
 
 /*used by unittests only*/
 const size_t IoTHubClient_ThreadTerminationOffset = offsetof(IOTHUB_CLIENT_INSTANCE, StopThread);
 
-#ifndef DONT_USE_UPLOADTOBLOB
-/*this function is called from _Destroy and from ScheduleWork_Thread to join finished blobUpload threads and free that memory*/
-static void garbageCollectorImpl(IOTHUB_CLIENT_INSTANCE* iotHubClientInstance)
+/*this function is called with the lock held, after IoTHubClient_LL_DoWork and returns how long the worker thread shall sleep*/
+static unsigned int computeNextSleep(IOTHUB_CLIENT_INSTANCE* iotHubClientInstance, unsigned int previousSleep)
 {
-    /*see if any savedData structures can be disposed of*/
-    /*Codes_SRS_IOTHUBCLIENT_02_072: [ All threads marked as disposable (upon completion of a file upload) shall be joined and the data structures build for them shall be freed. ]*/
-    LIST_ITEM_HANDLE item = list_get_head_item(iotHubClientInstance->savedDataToBeCleaned);
-    while (item != NULL)
+    unsigned int result;
+    IOTHUB_CLIENT_STATUS sendStatus;
+    if (iotHubClientInstance->MaxIdleSleep <= MIN_WORKER_SLEEP)
     {
-        const UPLOADTOBLOB_SAVED_DATA* savedData = (const UPLOADTOBLOB_SAVED_DATA*)list_item_get_value(item);
-        LIST_ITEM_HANDLE old_item = item;
-        item = list_get_next_item(item);
-
-        if (Lock(savedData->lockGarbage) != LOCK_OK)
-        {
-            LogError("unable to Lock");
-        }
-        else
-        {
-            if (savedData->canBeGarbageCollected == 1)
-            {
-                int notUsed;
-                if (ThreadAPI_Join(savedData->uploadingThreadHandle, &notUsed) != THREADAPI_OK)
-                {
-                    LogError("unable to ThreadAPI_Join");
-                }
-                (void)list_remove(iotHubClientInstance->savedDataToBeCleaned, old_item);
-                free((void*)savedData->source);
-                free((void*)savedData->destinationFileName);
-
-                if (Unlock(savedData->lockGarbage) != LOCK_OK)
-                {
-                    LogError("unable to unlock after locking");
-                }
-                (void)Lock_Deinit(savedData->lockGarbage);
-                free((void*)savedData);
-            }
-            else
-            {
-                if (Unlock(savedData->lockGarbage) != LOCK_OK)
-                {
-                    LogError("unable to unlock after locking");
-                }
-            }
-        }
+        /*Codes_SRS_IOTHUBCLIENT_01_037: [The thread created by IoTHubClient_SendEvent or IoTHubClient_SetMessageCallback shall call IoTHubClient_LL_DoWork every 1 ms.] */
+        result = MIN_WORKER_SLEEP;
+    }
+    else if (iotHubClientInstance->WorkPending)
+    {
+        /*Codes_SRS_IOTHUBCLIENT_02_077: [ If any work was enqueued since the last call to IoTHubClient_LL_DoWork then the thread shall sleep 1 ms. ]*/
+        iotHubClientInstance->WorkPending = 0;
+        result = MIN_WORKER_SLEEP;
+    }
+    else if (
+        (IoTHubClient_LL_GetSendStatus(iotHubClientInstance->IoTHubClientLLHandle, &sendStatus) != IOTHUB_CLIENT_OK) ||
+        (sendStatus != IOTHUB_CLIENT_SEND_STATUS_IDLE)
+        )
+    {
+        /*Codes_SRS_IOTHUBCLIENT_02_078: [ If IoTHubClient_LL_GetSendStatus fails or reports IOTHUB_CLIENT_SEND_STATUS_BUSY then the thread shall sleep 1 ms. ]*/
+        result = MIN_WORKER_SLEEP;
+    }
+    else
+    {
+        /*Codes_SRS_IOTHUBCLIENT_02_079: [ Otherwise the thread shall double the previous sleep time without exceeding the value set by "maxIdleSleep". ]*/
+        result = (previousSleep > iotHubClientInstance->MaxIdleSleep / 2) ? iotHubClientInstance->MaxIdleSleep : previousSleep * 2;
     }
+    return result;
 }
-#endif
 
 static int ScheduleWork_Thread(void* threadArgument)
 {
     IOTHUB_CLIENT_INSTANCE* iotHubClientInstance = (IOTHUB_CLIENT_INSTANCE*)threadArgument;
+    unsigned int sleepTime = MIN_WORKER_SLEEP;
 
     while (1)
     {
@@ -117,10 +125,7 @@ static int ScheduleWork_Thread(void* threadArgument)
                 /* Codes_SRS_IOTHUBCLIENT_01_037: [The thread created by IoTHubClient_SendEvent or IoTHubClient_SetMessageCallback shall call IoTHubClient_LL_DoWork every 1 ms.] */
                 /* Codes_SRS_IOTHUBCLIENT_01_039: [All calls to IoTHubClient_LL_DoWork shall be protected by the lock created in IotHubClient_Create.] */
                 IoTHubClient_LL_DoWork(iotHubClientInstance->IoTHubClientLLHandle);
-
-#ifndef DONT_USE_UPLOADTOBLOB
-                garbageCollectorImpl(iotHubClientInstance);
-#endif
+                sleepTime = computeNextSleep(iotHubClientInstance, sleepTime);
                 (void)Unlock(iotHubClientInstance->LockHandle);
             }
         }
@@ -129,17 +134,57 @@ static int ScheduleWork_Thread(void* threadArgument)
             /*Codes_SRS_IOTHUBCLIENT_01_040: [If acquiring the lock fails, IoTHubClient_LL_DoWork shall not be called.]*/
             /*no code, shall retry*/
         }
-        (void)ThreadAPI_Sleep(1);
+        (void)ThreadAPI_Sleep(sleepTime);
     }
 
     return 0;
 }
 
+#ifndef DONT_USE_UPLOADTOBLOB
+/*creates the queue of uploads and the lock protecting it, returns 0 on success*/
+static int createUploadQueue(IOTHUB_CLIENT_INSTANCE* iotHubClientInstance)
+{
+    int result;
+    if ((iotHubClientInstance->UploadQueue = list_create()) == NULL)
+    {
+        LogError("unable to list_create");
+        result = __LINE__;
+    }
+    else if ((iotHubClientInstance->UploadLock = Lock_Init()) == NULL)
+    {
+        LogError("unable to Lock_Init");
+        list_destroy(iotHubClientInstance->UploadQueue);
+        result = __LINE__;
+    }
+    else
+    {
+        iotHubClientInstance->UploadingThreadHandle = NULL;
+        iotHubClientInstance->UploadingThreadRunning = 0;
+        iotHubClientInstance->UploadCount = 0;
+        iotHubClientInstance->UploadBytes = 0;
+        iotHubClientInstance->UploadQueueMaxCount = 0;
+        iotHubClientInstance->UploadQueueMaxBytes = 0;
+        iotHubClientInstance->UploadQueueFullPolicy = IOTHUB_CLIENT_QUEUE_FULL_REJECT;
+        iotHubClientInstance->UploadQueueBlockTimeout = 0;
+        result = 0;
+    }
+    return result;
+}
+
+static void destroyUploadQueue(IOTHUB_CLIENT_INSTANCE* iotHubClientInstance)
+{
+    (void)Lock_Deinit(iotHubClientInstance->UploadLock);
+    list_destroy(iotHubClientInstance->UploadQueue);
+}
+#endif
+
 static IOTHUB_CLIENT_RESULT StartWorkerThreadIfNeeded(IOTHUB_CLIENT_INSTANCE* iotHubClientInstance)
 {
     IOTHUB_CLIENT_RESULT result;
     if (iotHubClientInstance->TransportHandle == NULL)
     {
+        /*Codes_SRS_IOTHUBCLIENT_02_076: [ Every API that starts the worker thread shall mark that work is pending. ]*/
+        iotHubClientInstance->WorkPending = 1;
         if (iotHubClientInstance->ThreadHandle == NULL)
         {
             iotHubClientInstance->StopThread = 0;
@@ -205,11 +250,10 @@ IOTHUB_CLIENT_HANDLE IoTHubClient_CreateFromConnectionString(const char* connect
             else
             {
 #ifndef DONT_USE_UPLOADTOBLOB
-                /*Codes_SRS_IOTHUBCLIENT_02_059: [ IoTHubClient_CreateFromConnectionString shall create a LIST_HANDLE containing THREAD_HANDLE (created by future calls to IoTHubClient_UploadToBlobAsync). ]*/
-                if ((result->savedDataToBeCleaned = list_create()) == NULL)
+                /*Codes_SRS_IOTHUBCLIENT_02_059: [ IoTHubClient_CreateFromConnectionString shall create a LIST_HANDLE holding the uploads queued by IoTHubClient_UploadToBlobAsync and a lock protecting it. ]*/
+                if (createUploadQueue(result) != 0)
                 {
-                    /*Codes_SRS_IOTHUBCLIENT_02_070: [ If creating the LIST_HANDLE fails then IoTHubClient_CreateFromConnectionString shall fail and return NULL]*/
-                    LogError("unable to list_create");
+                    /*Codes_SRS_IOTHUBCLIENT_02_070: [ If creating the LIST_HANDLE or its lock fails then IoTHubClient_CreateFromConnectionString shall fail and return NULL]*/
                     Lock_Deinit(result->LockHandle);
                     free(result);
                     result = NULL;
@@ -223,7 +267,7 @@ IOTHUB_CLIENT_HANDLE IoTHubClient_CreateFromConnectionString(const char* connect
                     {
                         /* Codes_SRS_IOTHUBCLIENT_12_010: [If IoTHubClient_LL_CreateFromConnectionString fails then IoTHubClient_CreateFromConnectionString shall do clean - up and return NULL] */
 #ifndef DONT_USE_UPLOADTOBLOB
-                        list_destroy(result->savedDataToBeCleaned);
+                        destroyUploadQueue(result);
 #endif
                         Lock_Deinit(result->LockHandle);
                         free(result);
@@ -234,6 +278,11 @@ IOTHUB_CLIENT_HANDLE IoTHubClient_CreateFromConnectionString(const char* connect
                     {
                         result->ThreadHandle = NULL;
                         result->TransportHandle = NULL;
+                        result->WorkPending = 0;
+                        result->MaxIdleSleep = MIN_WORKER_SLEEP;
+                        result->QueueFullPolicy = IOTHUB_CLIENT_QUEUE_FULL_REJECT;
+                        result->QueueBlockTimeout = 0;
+                        result->QueueBusyRetries = 0;
                     }
                 }
             }
@@ -263,11 +312,10 @@ IOTHUB_CLIENT_HANDLE IoTHubClient_Create(const IOTHUB_CLIENT_CONFIG* config)
         else
         {
 #ifndef DONT_USE_UPLOADTOBLOB
-            /*Codes_SRS_IOTHUBCLIENT_02_060: [ IoTHubClient_Create shall create a LIST_HANDLE containing THREAD_HANDLE (created by future calls to IoTHubClient_UploadToBlobAsync). ]*/
-            if ((result->savedDataToBeCleaned = list_create()) == NULL)
+            /*Codes_SRS_IOTHUBCLIENT_02_060: [ IoTHubClient_Create shall create a LIST_HANDLE holding the uploads queued by IoTHubClient_UploadToBlobAsync and a lock protecting it. ]*/
+            if (createUploadQueue(result) != 0)
             {
-                /*Codes_SRS_IOTHUBCLIENT_02_061: [ If creating the LIST_HANDLE fails then IoTHubClient_Create shall fail and return NULL. ]*/
-                LogError("unable to list_create");
+                /*Codes_SRS_IOTHUBCLIENT_02_061: [ If creating the LIST_HANDLE or its lock fails then IoTHubClient_Create shall fail and return NULL. ]*/
                 Lock_Deinit(result->LockHandle);
                 free(result);
                 result = NULL;
@@ -283,7 +331,7 @@ IOTHUB_CLIENT_HANDLE IoTHubClient_Create(const IOTHUB_CLIENT_CONFIG* config)
                     /* Codes_SRS_IOTHUBCLIENT_01_031: [If IoTHubClient_Create fails, all resources allocated by it shall be freed.] */
                     Lock_Deinit(result->LockHandle);
 #ifndef DONT_USE_UPLOADTOBLOB
-                    list_destroy(result->savedDataToBeCleaned);
+                    destroyUploadQueue(result);
 #endif
                     free(result);
                     result = NULL;
@@ -292,6 +340,11 @@ IOTHUB_CLIENT_HANDLE IoTHubClient_Create(const IOTHUB_CLIENT_CONFIG* config)
                 {
                     result->TransportHandle = NULL;
                     result->ThreadHandle = NULL;
+                    result->WorkPending = 0;
+                    result->MaxIdleSleep = MIN_WORKER_SLEEP;
+                    result->QueueFullPolicy = IOTHUB_CLIENT_QUEUE_FULL_REJECT;
+                    result->QueueBlockTimeout = 0;
+                    result->QueueBusyRetries = 0;
                 }
             }
         }
@@ -323,11 +376,10 @@ IOTHUB_CLIENT_HANDLE IoTHubClient_CreateWithTransport(TRANSPORT_HANDLE transport
         else
         {
 #ifndef DONT_USE_UPLOADTOBLOB
-            /*Codes_SRS_IOTHUBCLIENT_02_073: [ IoTHubClient_CreateWithTransport shall create a LIST_HANDLE that shall be used by IoTHubClient_UploadToBlobAsync. ]*/
-            if ((result->savedDataToBeCleaned = list_create()) == NULL)
+            /*Codes_SRS_IOTHUBCLIENT_02_073: [ IoTHubClient_CreateWithTransport shall create a LIST_HANDLE holding the uploads queued by IoTHubClient_UploadToBlobAsync and a lock protecting it. ]*/
+            if (createUploadQueue(result) != 0)
             {
-                /*Codes_SRS_IOTHUBCLIENT_02_074: [ If creating the LIST_HANDLE fails then IoTHubClient_CreateWithTransport shall fail and return NULL. ]*/
-                LogError("unable to list_create");
+                /*Codes_SRS_IOTHUBCLIENT_02_074: [ If creating the LIST_HANDLE or its lock fails then IoTHubClient_CreateWithTransport shall fail and return NULL. ]*/
                 free(result);
                 result = NULL;
             }
@@ -336,6 +388,11 @@ IOTHUB_CLIENT_HANDLE IoTHubClient_CreateWithTransport(TRANSPORT_HANDLE transport
             {
                 result->ThreadHandle = NULL;
                 result->TransportHandle = transportHandle;
+                result->WorkPending = 0;
+                result->MaxIdleSleep = MIN_WORKER_SLEEP;
+                result->QueueFullPolicy = IOTHUB_CLIENT_QUEUE_FULL_REJECT;
+                result->QueueBlockTimeout = 0;
+                result->QueueBusyRetries = 0;
                 /*Codes_SRS_IOTHUBCLIENT_17_005: [ IoTHubClient_CreateWithTransport shall call IoTHubTransport_GetLock to get the transport lock to be used later for serializing IoTHubClient calls. ]*/
                 LOCK_HANDLE transportLock = IoTHubTransport_GetLock(transportHandle);
                 result->LockHandle = transportLock;
@@ -344,7 +401,7 @@ IOTHUB_CLIENT_HANDLE IoTHubClient_CreateWithTransport(TRANSPORT_HANDLE transport
                     LogError("unable to IoTHubTransport_GetLock");
                     /*Codes_SRS_IOTHUBCLIENT_17_006: [ If IoTHubTransport_GetLock fails, then IoTHubClient_CreateWithTransport shall return NULL. ]*/
 #ifndef DONT_USE_UPLOADTOBLOB
-                    list_destroy(result->savedDataToBeCleaned);
+                    destroyUploadQueue(result);
 #endif
                     free(result);
                     result = NULL;
@@ -366,7 +423,7 @@ IOTHUB_CLIENT_HANDLE IoTHubClient_CreateWithTransport(TRANSPORT_HANDLE transport
                         LogError("unable to IoTHubTransport_GetLLTransport");
                         /*Codes_SRS_IOTHUBCLIENT_17_004: [ If IoTHubTransport_GetLLTransport fails, then IoTHubClient_CreateWithTransport shall return NULL. ]*/
 #ifndef DONT_USE_UPLOADTOBLOB
-                        list_destroy(result->savedDataToBeCleaned);
+                        destroyUploadQueue(result);
 #endif
                         free(result);
                         result = NULL;
@@ -377,7 +434,7 @@ IOTHUB_CLIENT_HANDLE IoTHubClient_CreateWithTransport(TRANSPORT_HANDLE transport
                         {
                             LogError("unable to Lock");
 #ifndef DONT_USE_UPLOADTOBLOB
-                            list_destroy(result->savedDataToBeCleaned);
+                            destroyUploadQueue(result);
 #endif
                             free(result);
                             result = NULL;
@@ -392,7 +449,7 @@ IOTHUB_CLIENT_HANDLE IoTHubClient_CreateWithTransport(TRANSPORT_HANDLE transport
                                 /*Codes_SRS_IOTHUBCLIENT_17_008: [ If IoTHubClient_LL_CreateWithTransport fails, then IoTHubClient_Create shall return NULL. ]*/
                                 /*Codes_SRS_IOTHUBCLIENT_17_009: [ If IoTHubClient_LL_CreateWithTransport fails, all resources allocated by it shall be freed. ]*/
 #ifndef DONT_USE_UPLOADTOBLOB
-                                list_destroy(result->savedDataToBeCleaned);
+                                destroyUploadQueue(result);
 #endif
                                 free(result);
                                 result = NULL;
@@ -423,20 +480,39 @@ void IoTHubClient_Destroy(IOTHUB_CLIENT_HANDLE iotHubClientHandle)
 
         IOTHUB_CLIENT_INSTANCE* iotHubClientInstance = (IOTHUB_CLIENT_INSTANCE*)iotHubClientHandle;
 
-        /*Codes_SRS_IOTHUBCLIENT_02_043: [ IoTHubClient_Destroy shall lock the serializing lock and signal the worker thread (if any) to end ]*/
-        if (Lock(iotHubClientInstance->LockHandle) != LOCK_OK)
+#ifndef DONT_USE_UPLOADTOBLOB
+        /*Codes_SRS_IOTHUBCLIENT_02_069: [ IoTHubClient_Destroy shall wait for the uploads accepted by IoTHubClient_UploadToBlobAsync to finish by joining the uploading thread (if any). The serializing lock shall not be held while waiting. ]*/
+        THREAD_HANDLE uploadingThreadHandle;
+        if (Lock(iotHubClientInstance->UploadLock) != LOCK_OK)
         {
-            LogError("unable to Lock - - will still proceed to try to end the thread without locking");
+            LogError("unable to Lock - will still proceed to join the uploading thread without locking");
+            uploadingThreadHandle = iotHubClientInstance->UploadingThreadHandle;
+            iotHubClientInstance->UploadingThreadHandle = NULL;
+        }
+        else
+        {
+            uploadingThreadHandle = iotHubClientInstance->UploadingThreadHandle;
+            iotHubClientInstance->UploadingThreadHandle = NULL;
+            (void)Unlock(iotHubClientInstance->UploadLock);
         }
 
-#ifndef DONT_USE_UPLOADTOBLOB
-        /*Codes_SRS_IOTHUBCLIENT_02_069: [ IoTHubClient_Destroy shall free all data created by IoTHubClient_UploadToBlobAsync ]*/
-        /*wait for all uploading threads to finish*/
-        while (list_get_head_item(iotHubClientInstance->savedDataToBeCleaned) != NULL)
+        if (uploadingThreadHandle != NULL)
         {
-            garbageCollectorImpl(iotHubClientInstance);
+            int notUsed;
+            /*the thread exits once the queue is empty, uploads queued by the callbacks it calls meanwhile are still done*/
+            if (ThreadAPI_Join(uploadingThreadHandle, &notUsed) != THREADAPI_OK)
+            {
+                LogError("unable to ThreadAPI_Join the uploading thread");
+            }
         }
 #endif
+
+        /*Codes_SRS_IOTHUBCLIENT_02_043: [ IoTHubClient_Destroy shall lock the serializing lock and signal the worker thread (if any) to end ]*/
+        if (Lock(iotHubClientInstance->LockHandle) != LOCK_OK)
+        {
+            LogError("unable to Lock - - will still proceed to try to end the thread without locking");
+        }
+
         if (iotHubClientInstance->ThreadHandle != NULL)
         {
             iotHubClientInstance->StopThread = 1;
@@ -457,10 +533,8 @@ void IoTHubClient_Destroy(IOTHUB_CLIENT_HANDLE iotHubClientHandle)
         IoTHubClient_LL_Destroy(iotHubClientInstance->IoTHubClientLLHandle);
 
 #ifndef DONT_USE_UPLOADTOBLOB
-        if (iotHubClientInstance->savedDataToBeCleaned != NULL)
-        {
-            list_destroy(iotHubClientInstance->savedDataToBeCleaned);
-        }
+        /*Codes_SRS_IOTHUBCLIENT_02_109: [ IoTHubClient_Destroy shall then destroy the LIST_HANDLE of uploads and its lock. ]*/
+        destroyUploadQueue(iotHubClientInstance);
 #endif
 
         /*Codes_SRS_IOTHUBCLIENT_02_045: [ IoTHubClient_Destroy shall unlock the serializing lock. ]*/
@@ -497,51 +571,105 @@ void IoTHubClient_Destroy(IOTHUB_CLIENT_HANDLE iotHubClientHandle)
     }
 }
 
-IOTHUB_CLIENT_RESULT IoTHubClient_SendEventAsync(IOTHUB_CLIENT_HANDLE iotHubClientHandle, IOTHUB_MESSAGE_HANDLE eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void* userContextCallback)
+/*one locked attempt at handing the message to the LL layer. *shouldBlock tells whether the caller may wait for room and try again, *blockTimeout how long (ms, 0 = no limit)*/
+static IOTHUB_CLIENT_RESULT trySendEventAsync(IOTHUB_CLIENT_INSTANCE* iotHubClientInstance, IOTHUB_MESSAGE_HANDLE eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void* userContextCallback, bool takeOwnership, bool* shouldBlock, unsigned int* blockTimeout)
 {
     IOTHUB_CLIENT_RESULT result;
 
-    if (iotHubClientHandle == NULL)
+    *shouldBlock = false;
+
+    /* Codes_SRS_IOTHUBCLIENT_01_025: [IoTHubClient_SendEventAsync shall be made thread-safe by using the lock created in IoTHubClient_Create.] */
+    if (Lock(iotHubClientInstance->LockHandle) != LOCK_OK)
     {
-        /* Codes_SRS_IOTHUBCLIENT_01_011: [If iotHubClientHandle is NULL, IoTHubClient_SendEventAsync shall return IOTHUB_CLIENT_INVALID_ARG.] */
-        result = IOTHUB_CLIENT_INVALID_ARG;
-        LogError("NULL iothubClientHandle");
+        /* Codes_SRS_IOTHUBCLIENT_01_026: [If acquiring the lock fails, IoTHubClient_SendEventAsync shall return IOTHUB_CLIENT_ERROR.] */
+        result = IOTHUB_CLIENT_ERROR;
+        LogError("Could not acquire lock");
     }
     else
     {
-        IOTHUB_CLIENT_INSTANCE* iotHubClientInstance = (IOTHUB_CLIENT_INSTANCE*)iotHubClientHandle;
-
-        /* Codes_SRS_IOTHUBCLIENT_01_025: [IoTHubClient_SendEventAsync shall be made thread-safe by using the lock created in IoTHubClient_Create.] */
-        if (Lock(iotHubClientInstance->LockHandle) != LOCK_OK)
+        /* Codes_SRS_IOTHUBCLIENT_01_009: [IoTHubClient_SendEventAsync shall start the worker thread if it was not previously started.] */
+        if ((result = StartWorkerThreadIfNeeded(iotHubClientInstance)) != IOTHUB_CLIENT_OK)
         {
-            /* Codes_SRS_IOTHUBCLIENT_01_026: [If acquiring the lock fails, IoTHubClient_SendEventAsync shall return IOTHUB_CLIENT_ERROR.] */
+            /* Codes_SRS_IOTHUBCLIENT_01_010: [If starting the thread fails, IoTHubClient_SendEventAsync shall return IOTHUB_CLIENT_ERROR.] */
             result = IOTHUB_CLIENT_ERROR;
-            LogError("Could not acquire lock");
+            LogError("Could not start worker thread");
         }
         else
         {
-            /* Codes_SRS_IOTHUBCLIENT_01_009: [IoTHubClient_SendEventAsync shall start the worker thread if it was not previously started.] */
-            if ((result = StartWorkerThreadIfNeeded(iotHubClientInstance)) != IOTHUB_CLIENT_OK)
+            /* Codes_SRS_IOTHUBCLIENT_01_012: [IoTHubClient_SendEventAsync shall call IoTHubClient_LL_SendEventAsync, while passing the IoTHubClient_LL handle created by IoTHubClient_Create and the parameters eventMessageHandle, eventConfirmationCallback and userContextCallback.] */
+            /* Codes_SRS_IOTHUBCLIENT_01_013: [When IoTHubClient_LL_SendEventAsync is called, IoTHubClient_SendEventAsync shall return the result of IoTHubClient_LL_SendEventAsync.] */
+            if (takeOwnership)
             {
-                /* Codes_SRS_IOTHUBCLIENT_01_010: [If starting the thread fails, IoTHubClient_SendEventAsync shall return IOTHUB_CLIENT_ERROR.] */
-                result = IOTHUB_CLIENT_ERROR;
-                LogError("Could not start worker thread");
+                /* Codes_SRS_IOTHUBCLIENT_02_083: [ IoTHubClient_SendEventAsyncTakeOwnership shall call IoTHubClient_LL_SendEventAsyncTakeOwnership and return its result. ]*/
+                result = IoTHubClient_LL_SendEventAsyncTakeOwnership(iotHubClientInstance->IoTHubClientLLHandle, eventMessageHandle, eventConfirmationCallback, userContextCallback);
             }
             else
             {
-                /* Codes_SRS_IOTHUBCLIENT_01_012: [IoTHubClient_SendEventAsync shall call IoTHubClient_LL_SendEventAsync, while passing the IoTHubClient_LL handle created by IoTHubClient_Create and the parameters eventMessageHandle, eventConfirmationCallback and userContextCallback.] */
-                /* Codes_SRS_IOTHUBCLIENT_01_013: [When IoTHubClient_LL_SendEventAsync is called, IoTHubClient_SendEventAsync shall return the result of IoTHubClient_LL_SendEventAsync.] */
                 result = IoTHubClient_LL_SendEventAsync(iotHubClientInstance->IoTHubClientLLHandle, eventMessageHandle, eventConfirmationCallback, userContextCallback);
             }
 
-            /* Codes_SRS_IOTHUBCLIENT_01_025: [IoTHubClient_SendEventAsync shall be made thread-safe by using the lock created in IoTHubClient_Create.] */
-            (void)Unlock(iotHubClientInstance->LockHandle);
+            if ((result == IOTHUB_CLIENT_BUSY) && (iotHubClientInstance->QueueFullPolicy == IOTHUB_CLIENT_QUEUE_FULL_BLOCK))
+            {
+                *shouldBlock = true;
+                *blockTimeout = iotHubClientInstance->QueueBlockTimeout;
+            }
+        }
+
+        /* Codes_SRS_IOTHUBCLIENT_01_025: [IoTHubClient_SendEventAsync shall be made thread-safe by using the lock created in IoTHubClient_Create.] */
+        (void)Unlock(iotHubClientInstance->LockHandle);
+    }
+
+    return result;
+}
+
+static IOTHUB_CLIENT_RESULT SendEventAsync_Impl(IOTHUB_CLIENT_HANDLE iotHubClientHandle, IOTHUB_MESSAGE_HANDLE eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void* userContextCallback, bool takeOwnership)
+{
+    IOTHUB_CLIENT_RESULT result;
+
+    if (iotHubClientHandle == NULL)
+    {
+        /* Codes_SRS_IOTHUBCLIENT_01_011: [If iotHubClientHandle is NULL, IoTHubClient_SendEventAsync shall return IOTHUB_CLIENT_INVALID_ARG.] */
+        result = IOTHUB_CLIENT_INVALID_ARG;
+        LogError("NULL iothubClientHandle");
+    }
+    else
+    {
+        IOTHUB_CLIENT_INSTANCE* iotHubClientInstance = (IOTHUB_CLIENT_INSTANCE*)iotHubClientHandle;
+        unsigned int waited = 0;
+        bool shouldBlock;
+        unsigned int blockTimeout;
+
+        /*Codes_SRS_IOTHUBCLIENT_02_085: [ If IoTHubClient_LL_SendEventAsync returns IOTHUB_CLIENT_BUSY and "messageQueueFullPolicy" is IOTHUB_CLIENT_QUEUE_FULL_BLOCK then IoTHubClient_SendEventAsync shall release the lock, sleep and try again. ]*/
+        /*Codes_SRS_IOTHUBCLIENT_02_086: [ If "messageQueueBlockTimeout" is not 0 and the message could not be queued in that many milliseconds then IoTHubClient_SendEventAsync shall return IOTHUB_CLIENT_BUSY. ]*/
+        while (((result = trySendEventAsync(iotHubClientInstance, eventMessageHandle, eventConfirmationCallback, userContextCallback, takeOwnership, &shouldBlock, &blockTimeout)) == IOTHUB_CLIENT_BUSY) &&
+            shouldBlock &&
+            ((blockTimeout == 0) || (waited < blockTimeout)))
+        {
+            /*Codes_SRS_IOTHUBCLIENT_02_110: [ Only the last IOTHUB_CLIENT_BUSY of a blocked IoTHubClient_SendEventAsync shall count as refused in the statistics returned by IoTHubClient_GetSendQueueStats. ]*/
+            if (Lock(iotHubClientInstance->LockHandle) == LOCK_OK)
+            {
+                iotHubClientInstance->QueueBusyRetries++;
+                (void)Unlock(iotHubClientInstance->LockHandle);
+            }
+            (void)ThreadAPI_Sleep(QUEUE_FULL_RETRY_SLEEP);
+            waited += QUEUE_FULL_RETRY_SLEEP;
         }
     }
 
     return result;
 }
 
+IOTHUB_CLIENT_RESULT IoTHubClient_SendEventAsync(IOTHUB_CLIENT_HANDLE iotHubClientHandle, IOTHUB_MESSAGE_HANDLE eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void* userContextCallback)
+{
+    return SendEventAsync_Impl(iotHubClientHandle, eventMessageHandle, eventConfirmationCallback, userContextCallback, false);
+}
+
+IOTHUB_CLIENT_RESULT IoTHubClient_SendEventAsyncTakeOwnership(IOTHUB_CLIENT_HANDLE iotHubClientHandle, IOTHUB_MESSAGE_HANDLE eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void* userContextCallback)
+{
+    /* Codes_SRS_IOTHUBCLIENT_02_082: [ IoTHubClient_SendEventAsyncTakeOwnership shall behave as IoTHubClient_SendEventAsync, except that it shall not make a copy of eventMessageHandle. ]*/
+    return SendEventAsync_Impl(iotHubClientHandle, eventMessageHandle, eventConfirmationCallback, userContextCallback, true);
+}
+
 IOTHUB_CLIENT_RESULT IoTHubClient_GetSendStatus(IOTHUB_CLIENT_HANDLE iotHubClientHandle, IOTHUB_CLIENT_STATUS *iotHubClientStatus)
 {
     IOTHUB_CLIENT_RESULT result;
@@ -577,6 +705,12 @@ IOTHUB_CLIENT_RESULT IoTHubClient_GetSendStatus(IOTHUB_CLIENT_HANDLE iotHubClien
     return result;
 }
 
+/*used by a shared transport's worker thread, which already holds the transport lock, to query the client's send status*/
+IOTHUB_CLIENT_LL_HANDLE IoTHubClient_GetLLHandle(IOTHUB_CLIENT_HANDLE iotHubClientHandle)
+{
+    return ((IOTHUB_CLIENT_INSTANCE*)iotHubClientHandle)->IoTHubClientLLHandle;
+}
+
 IOTHUB_CLIENT_RESULT IoTHubClient_SetMessageCallback(IOTHUB_CLIENT_HANDLE iotHubClientHandle, IOTHUB_CLIENT_MESSAGE_CALLBACK_ASYNC messageCallback, void* userContextCallback)
 {
     IOTHUB_CLIENT_RESULT result;
@@ -656,6 +790,95 @@ IOTHUB_CLIENT_RESULT IoTHubClient_GetLastMessageReceiveTime(IOTHUB_CLIENT_HANDLE
     return result;
 }
 
+IOTHUB_CLIENT_RESULT IoTHubClient_GetSendQueueStats(IOTHUB_CLIENT_HANDLE iotHubClientHandle, IOTHUB_CLIENT_SEND_QUEUE_STATS* stats)
+{
+    IOTHUB_CLIENT_RESULT result;
+
+    if (iotHubClientHandle == NULL)
+    {
+        /*Codes_SRS_IOTHUBCLIENT_02_088: [ If iotHubClientHandle is NULL then IoTHubClient_GetSendQueueStats shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+        result = IOTHUB_CLIENT_INVALID_ARG;
+        LogError("NULL iothubClientHandle");
+    }
+    else
+    {
+        IOTHUB_CLIENT_INSTANCE* iotHubClientInstance = (IOTHUB_CLIENT_INSTANCE*)iotHubClientHandle;
+
+        /*Codes_SRS_IOTHUBCLIENT_02_089: [ IoTHubClient_GetSendQueueStats shall be made thread-safe by using the lock created in IoTHubClient_Create. If acquiring the lock fails, IoTHubClient_GetSendQueueStats shall return IOTHUB_CLIENT_ERROR. ]*/
+        if (Lock(iotHubClientInstance->LockHandle) != LOCK_OK)
+        {
+            result = IOTHUB_CLIENT_ERROR;
+            LogError("Could not acquire lock");
+        }
+        else
+        {
+            /*Codes_SRS_IOTHUBCLIENT_02_090: [ IoTHubClient_GetSendQueueStats shall call IoTHubClient_LL_GetSendQueueStats and return what IoTHubClient_LL_GetSendQueueStats returns. ]*/
+            result = IoTHubClient_LL_GetSendQueueStats(iotHubClientInstance->IoTHubClientLLHandle, stats);
+            if (result == IOTHUB_CLIENT_OK)
+            {
+                /*Codes_SRS_IOTHUBCLIENT_02_110: [ Only the last IOTHUB_CLIENT_BUSY of a blocked IoTHubClient_SendEventAsync shall count as refused in the statistics returned by IoTHubClient_GetSendQueueStats. ]*/
+                stats->rejectedCount -= iotHubClientInstance->QueueBusyRetries;
+            }
+
+            (void)Unlock(iotHubClientInstance->LockHandle);
+        }
+    }
+
+    return result;
+}
+
+#ifndef DONT_USE_UPLOADTOBLOB
+/*changes one of the "uploadQueue..." options, they are read by IoTHubClient_UploadToBlobAsync under the upload lock*/
+static IOTHUB_CLIENT_RESULT setUploadQueueOption(IOTHUB_CLIENT_INSTANCE* iotHubClientInstance, const char* optionName, const void* value)
+{
+    IOTHUB_CLIENT_RESULT result;
+    /*Codes_SRS_IOTHUBCLIENT_02_105: [ The "uploadQueue..." options shall be changed under the lock of the LIST_HANDLE of uploads. If acquiring it fails then IoTHubClient_SetOption shall return IOTHUB_CLIENT_ERROR. ]*/
+    if (Lock(iotHubClientInstance->UploadLock) != LOCK_OK)
+    {
+        LogError("unable to lock");
+        result = IOTHUB_CLIENT_ERROR;
+    }
+    else
+    {
+        /*Codes_SRS_IOTHUBCLIENT_02_101: [ "uploadQueueMaxCount" - IoTHubClient_UploadToBlobAsync shall not let more than `*value` uploads be queued or uploading. 0 means no limit. Value is a pointer to a size_t. ]*/
+        if (strcmp(optionName, "uploadQueueMaxCount") == 0)
+        {
+            iotHubClientInstance->UploadQueueMaxCount = *(const size_t*)value;
+            result = IOTHUB_CLIENT_OK;
+        }
+        /*Codes_SRS_IOTHUBCLIENT_02_102: [ "uploadQueueMaxBytes" - IoTHubClient_UploadToBlobAsync shall not let the sources it copied for the uploads queued or uploading total more than `*value` bytes. 0 means no limit. Value is a pointer to a size_t. ]*/
+        else if (strcmp(optionName, "uploadQueueMaxBytes") == 0)
+        {
+            iotHubClientInstance->UploadQueueMaxBytes = *(const size_t*)value;
+            result = IOTHUB_CLIENT_OK;
+        }
+        /*Codes_SRS_IOTHUBCLIENT_02_103: [ "uploadQueueFullPolicy" - IOTHUB_CLIENT_QUEUE_FULL_REJECT or IOTHUB_CLIENT_QUEUE_FULL_BLOCK, any other value shall make IoTHubClient_SetOption return IOTHUB_CLIENT_INVALID_ARG. Value is a pointer to an IOTHUB_CLIENT_QUEUE_FULL_POLICY. ]*/
+        else if (strcmp(optionName, "uploadQueueFullPolicy") == 0)
+        {
+            IOTHUB_CLIENT_QUEUE_FULL_POLICY policy = *(const IOTHUB_CLIENT_QUEUE_FULL_POLICY*)value;
+            if ((policy != IOTHUB_CLIENT_QUEUE_FULL_REJECT) && (policy != IOTHUB_CLIENT_QUEUE_FULL_BLOCK))
+            {
+                LogError("uploadQueueFullPolicy can only be IOTHUB_CLIENT_QUEUE_FULL_REJECT or IOTHUB_CLIENT_QUEUE_FULL_BLOCK");
+                result = IOTHUB_CLIENT_INVALID_ARG;
+            }
+            else
+            {
+                iotHubClientInstance->UploadQueueFullPolicy = policy;
+                result = IOTHUB_CLIENT_OK;
+            }
+        }
+        /*Codes_SRS_IOTHUBCLIENT_02_104: [ "uploadQueueBlockTimeout" - how many milliseconds IoTHubClient_UploadToBlobAsync waits for room under IOTHUB_CLIENT_QUEUE_FULL_BLOCK. 0 means no limit. Value is a pointer to an unsigned int. ]*/
+        else
+        {
+            iotHubClientInstance->UploadQueueBlockTimeout = *(const unsigned int*)value;
+            result = IOTHUB_CLIENT_OK;
+        }
+        (void)Unlock(iotHubClientInstance->UploadLock);
+    }
+    return result;
+}
+#endif /*DONT_USE_UPLOADTOBLOB*/
+
 IOTHUB_CLIENT_RESULT IoTHubClient_SetOption(IOTHUB_CLIENT_HANDLE iotHubClientHandle, const char* optionName, const void* value)
 {
     IOTHUB_CLIENT_RESULT result;
@@ -684,11 +907,61 @@ IOTHUB_CLIENT_RESULT IoTHubClient_SetOption(IOTHUB_CLIENT_HANDLE iotHubClientHan
         }
         else
         {
-            /*Codes_SRS_IOTHUBCLIENT_02_038: [If optionName doesn't match one of the options handled by this module then IoTHubClient_SetOption shall call IoTHubClient_LL_SetOption passing the same parameters and return what IoTHubClient_LL_SetOption returns.] */
-            result = IoTHubClient_LL_SetOption(iotHubClientInstance->IoTHubClientLLHandle, optionName, value);
-            if (result != IOTHUB_CLIENT_OK)
+            /*Codes_SRS_IOTHUBCLIENT_02_075: [ "maxIdleSleep" - the maximum time in milliseconds the worker thread sleeps between calls to IoTHubClient_LL_DoWork when there is nothing to send. Value is a pointer to an unsigned int. ]*/
+            if (strcmp(optionName, "maxIdleSleep") == 0)
             {
-                LogError("IoTHubClient_LL_SetOption failed");
+                unsigned int maxIdleSleep = *(const unsigned int*)value;
+                /*Codes_SRS_IOTHUBCLIENT_02_080: [ A value of 0 or 1 for "maxIdleSleep" shall make the worker thread call IoTHubClient_LL_DoWork every 1 ms. ]*/
+                if (maxIdleSleep < MIN_WORKER_SLEEP)
+                {
+                    maxIdleSleep = MIN_WORKER_SLEEP;
+                }
+
+                if (iotHubClientInstance->TransportHandle == NULL)
+                {
+                    iotHubClientInstance->MaxIdleSleep = maxIdleSleep;
+                    result = IOTHUB_CLIENT_OK;
+                }
+                else
+                {
+                    /*Codes_SRS_IOTHUBCLIENT_02_081: [ If the transport connection is shared, "maxIdleSleep" shall be passed to IoTHubTransport_SetMaxIdleSleep and IoTHubClient_SetOption shall return what IoTHubTransport_SetMaxIdleSleep returns. ]*/
+                    result = IoTHubTransport_SetMaxIdleSleep(iotHubClientInstance->TransportHandle, maxIdleSleep);
+                    if (result != IOTHUB_CLIENT_OK)
+                    {
+                        LogError("IoTHubTransport_SetMaxIdleSleep failed");
+                    }
+                }
+            }
+            /*Codes_SRS_IOTHUBCLIENT_02_084: [ "messageQueueBlockTimeout" - how many milliseconds IoTHubClient_SendEventAsync waits for room in the send queue under IOTHUB_CLIENT_QUEUE_FULL_BLOCK. 0 means no limit. Value is a pointer to an unsigned int. ]*/
+            else if (strcmp(optionName, "messageQueueBlockTimeout") == 0)
+            {
+                iotHubClientInstance->QueueBlockTimeout = *(const unsigned int*)value;
+                result = IOTHUB_CLIENT_OK;
+            }
+#ifndef DONT_USE_UPLOADTOBLOB
+            else if (
+                (strcmp(optionName, "uploadQueueMaxCount") == 0) ||
+                (strcmp(optionName, "uploadQueueMaxBytes") == 0) ||
+                (strcmp(optionName, "uploadQueueFullPolicy") == 0) ||
+                (strcmp(optionName, "uploadQueueBlockTimeout") == 0)
+                )
+            {
+                result = setUploadQueueOption(iotHubClientInstance, optionName, value);
+            }
+#endif
+            else
+            {
+                /*Codes_SRS_IOTHUBCLIENT_02_038: [If optionName doesn't match one of the options handled by this module then IoTHubClient_SetOption shall call IoTHubClient_LL_SetOption passing the same parameters and return what IoTHubClient_LL_SetOption returns.] */
+                result = IoTHubClient_LL_SetOption(iotHubClientInstance->IoTHubClientLLHandle, optionName, value);
+                if (result != IOTHUB_CLIENT_OK)
+                {
+                    LogError("IoTHubClient_LL_SetOption failed");
+                }
+                else if (strcmp(optionName, "messageQueueFullPolicy") == 0)
+                {
+                    /*Codes_SRS_IOTHUBCLIENT_02_087: [ "messageQueueFullPolicy" shall be passed to IoTHubClient_LL_SetOption and, if that succeeds, remembered by IoTHubClient_SendEventAsync. ]*/
+                    iotHubClientInstance->QueueFullPolicy = *(const IOTHUB_CLIENT_QUEUE_FULL_POLICY*)value;
+                }
             }
 
             Unlock(iotHubClientInstance->LockHandle);
@@ -698,50 +971,244 @@ IOTHUB_CLIENT_RESULT IoTHubClient_SetOption(IOTHUB_CLIENT_HANDLE iotHubClientHan
 }
 
 #ifndef DONT_USE_UPLOADTOBLOB
-static int uploadingThread(void *data)
+static void freeSavedData(UPLOADTOBLOB_SAVED_DATA* savedData)
+{
+    free(savedData->source);
+    if (savedData->sourceFileName != NULL)
+    {
+        free(savedData->sourceFileName);
+    }
+    free(savedData->destinationFileName);
+    free(savedData);
+}
+
+/*uploads savedData, called by the uploading thread without holding any lock*/
+static IOTHUB_CLIENT_RESULT uploadSavedData(IOTHUB_CLIENT_INSTANCE* iotHubClientInstance, UPLOADTOBLOB_SAVED_DATA* savedData)
 {
-    UPLOADTOBLOB_SAVED_DATA* savedData = (UPLOADTOBLOB_SAVED_DATA*)data;
+    /*IoTHubClient_LL_UploadToBlob does not touch the state IoTHubClient_LL_DoWork uses, so it is not serialized with it*/
+    /*the uploads share the connections kept by the LL layer, which serializes them with a lock of its own*/
+    IOTHUB_CLIENT_RESULT result;
+    if (savedData->sourceFileName != NULL)
+    {
+        /*Codes_SRS_IOTHUBCLIENT_02_094: [ The thread shall call IoTHubClient_LL_UploadToBlobFromFile passing the destinationFileName and sourceFileName packed in the structure. ]*/
+        result = IoTHubClient_LL_UploadToBlobFromFile(iotHubClientInstance->IoTHubClientLLHandle, savedData->destinationFileName, savedData->sourceFileName);
+    }
+    else
+    {
+        /*Codes_SRS_IOTHUBCLIENT_02_054: [ The thread shall call IoTHubClient_LL_UploadToBlob passing the information packed in the structure. ]*/
+        result = IoTHubClient_LL_UploadToBlob(iotHubClientInstance->IoTHubClientLLHandle, savedData->destinationFileName, savedData->source, savedData->size);
+    }
 
-    /*it so happens that IoTHubClient_LL_UploadToBlob is thread-safe because there's no saved state in the handle and there are no globals, so no need to protect it*/
-    /*not having it protected means multiple simultaneous uploads can happen*/
-    /*Codes_SRS_IOTHUBCLIENT_02_054: [ The thread shall call IoTHubClient_LL_UploadToBlob passing the information packed in the structure. ]*/
-    if (IoTHubClient_LL_UploadToBlob(savedData->iotHubClientHandle->IoTHubClientLLHandle, savedData->destinationFileName, savedData->source, savedData->size) != IOTHUB_CLIENT_OK)
+    if (result != IOTHUB_CLIENT_OK)
     {
         LogError("unable to IoTHubClient_LL_UploadToBlob");
-        /*call the callback*/
-        if (savedData->iotHubClientFileUploadCallback != NULL)
+    }
+    return result;
+}
+
+/*called by the uploading thread before the callback of savedData. The lock is retried because the upload must stop counting before its callback is called*/
+static void stopCountingUpload(IOTHUB_CLIENT_INSTANCE* iotHubClientInstance, UPLOADTOBLOB_SAVED_DATA* savedData)
+{
+    while (Lock(iotHubClientInstance->UploadLock) != LOCK_OK)
+    {
+        LogError("unable to Lock - will retry");
+        (void)ThreadAPI_Sleep(QUEUE_FULL_RETRY_SLEEP);
+    }
+
+    /*Codes_SRS_IOTHUBCLIENT_02_100: [ Before calling the callback, the thread shall make the upload no longer count against "uploadQueueMaxCount" and "uploadQueueMaxBytes". ]*/
+    iotHubClientInstance->UploadCount--;
+    iotHubClientInstance->UploadBytes -= savedData->size;
+    (void)Unlock(iotHubClientInstance->UploadLock);
+}
+
+static int uploadingThread(void *data)
+{
+    IOTHUB_CLIENT_INSTANCE* iotHubClientInstance = (IOTHUB_CLIENT_INSTANCE*)data;
+    int exitThread = 0;
+
+    while (exitThread == 0)
+    {
+        if (Lock(iotHubClientInstance->UploadLock) != LOCK_OK)
         {
-            /*Codes_SRS_IOTHUBCLIENT_02_055: [ If IoTHubClient_LL_UploadToBlob fails then the thread shall call iotHubClientFileUploadCallbackInternal passing as result FILE_UPLOAD_ERROR and as context the structure from SRS IOTHUBCLIENT 02 051. ]*/
-            savedData->iotHubClientFileUploadCallback(FILE_UPLOAD_ERROR, savedData->context);
+            LogError("unable to Lock - will retry");
+            (void)ThreadAPI_Sleep(QUEUE_FULL_RETRY_SLEEP);
         }
+        else
+        {
+            UPLOADTOBLOB_SAVED_DATA* next;
+            LIST_ITEM_HANDLE item;
+
+            /*Codes_SRS_IOTHUBCLIENT_02_071: [ The thread shall take the uploads off the LIST_HANDLE one at a time, in the order they were queued, and shall exit when the LIST_HANDLE is empty. ]*/
+            item = list_get_head_item(iotHubClientInstance->UploadQueue);
+            if (item == NULL)
+            {
+                iotHubClientInstance->UploadingThreadRunning = 0;
+                next = NULL;
+                exitThread = 1;
+            }
+            else
+            {
+                next = (UPLOADTOBLOB_SAVED_DATA*)list_item_get_value(item);
+                (void)list_remove(iotHubClientInstance->UploadQueue, item);
+            }
+            (void)Unlock(iotHubClientInstance->UploadLock);
+
+            if (next != NULL)
+            {
+                IOTHUB_CLIENT_RESULT uploadResult = uploadSavedData(iotHubClientInstance, next);
+                stopCountingUpload(iotHubClientInstance, next);
+
+                if (next->iotHubClientFileUploadCallback != NULL)
+                {
+                    /*Codes_SRS_IOTHUBCLIENT_02_055: [ If IoTHubClient_LL_UploadToBlob fails then the thread shall call iotHubClientFileUploadCallbackInternal passing as result FILE_UPLOAD_ERROR and as context the structure from SRS IOTHUBCLIENT 02 051. ]*/
+                    /*Codes_SRS_IOTHUBCLIENT_02_056: [ Otherwise the thread iotHubClientFileUploadCallbackInternal passing as result FILE_UPLOAD_OK and the structure from SRS IOTHUBCLIENT 02 051. ]*/
+                    inUploadCallback = 1;
+                    next->iotHubClientFileUploadCallback((uploadResult == IOTHUB_CLIENT_OK) ? FILE_UPLOAD_OK : FILE_UPLOAD_ERROR, next->context);
+                    inUploadCallback = 0;
+                }
+
+                /*Codes_SRS_IOTHUBCLIENT_02_111: [ Once the callback has returned the thread shall free the structure. ]*/
+                freeSavedData(next);
+            }
+        }
+    }
+    return 0;
+}
+
+/*called with the upload lock held*/
+static IOTHUB_CLIENT_RESULT startUploadingThreadIfNeeded(IOTHUB_CLIENT_INSTANCE* iotHubClientInstance)
+{
+    IOTHUB_CLIENT_RESULT result;
+    if (iotHubClientInstance->UploadingThreadRunning)
+    {
+        result = IOTHUB_CLIENT_OK;
     }
     else
     {
-        if (savedData->iotHubClientFileUploadCallback != NULL)
+        if (iotHubClientInstance->UploadingThreadHandle != NULL)
+        {
+            /*the previous thread found the queue empty, it does not touch the client anymore*/
+            int notUsed;
+            if (ThreadAPI_Join(iotHubClientInstance->UploadingThreadHandle, &notUsed) != THREADAPI_OK)
+            {
+                LogError("unable to ThreadAPI_Join");
+            }
+            iotHubClientInstance->UploadingThreadHandle = NULL;
+        }
+
+        /*Codes_SRS_IOTHUBCLIENT_02_052: [ If the uploading thread is not running then IoTHubClient_UploadToBlobAsync shall start it, after joining the uploading thread that exited (if any). ]*/
+        if (ThreadAPI_Create(&iotHubClientInstance->UploadingThreadHandle, uploadingThread, iotHubClientInstance) != THREADAPI_OK)
         {
-            /*Codes_SRS_IOTHUBCLIENT_02_056: [ Otherwise the thread iotHubClientFileUploadCallbackInternal passing as result FILE_UPLOAD_OK and the structure from SRS IOTHUBCLIENT 02 051. ]*/
-            savedData->iotHubClientFileUploadCallback(FILE_UPLOAD_OK, savedData->context);
+            LogError("unable to ThreadAPI_Create");
+            iotHubClientInstance->UploadingThreadHandle = NULL;
+            result = IOTHUB_CLIENT_ERROR;
+        }
+        else
+        {
+            /*the new thread cannot look at the queue before the upload lock is released*/
+            iotHubClientInstance->UploadingThreadRunning = 1;
+            result = IOTHUB_CLIENT_OK;
         }
     }
+    return result;
+}
+
+/*one locked attempt at queueing savedData. *shouldBlock tells whether the caller may wait for room and try again, *blockTimeout how long (ms, 0 = no limit)*/
+static IOTHUB_CLIENT_RESULT tryQueueUpload(IOTHUB_CLIENT_INSTANCE* iotHubClientInstance, UPLOADTOBLOB_SAVED_DATA* savedData, bool* shouldBlock, unsigned int* blockTimeout)
+{
+    IOTHUB_CLIENT_RESULT result;
+
+    *shouldBlock = false;
 
-    /*Codes_SRS_IOTHUBCLIENT_02_071: [ The thread shall mark itself as disposable. ]*/
-    if (Lock(savedData->lockGarbage) != LOCK_OK)
+    /*Codes_SRS_IOTHUBCLIENT_02_095: [ IoTHubClient_UploadToBlobAsync shall queue the structure under the lock of the LIST_HANDLE of uploads, it shall not take the serializing lock. If acquiring the lock fails then IoTHubClient_UploadToBlobAsync shall fail and return IOTHUB_CLIENT_ERROR. ]*/
+    if (Lock(iotHubClientInstance->UploadLock) != LOCK_OK)
     {
-        LogError("unable to Lock - trying anyway");
-        savedData->canBeGarbageCollected = 1;
+        LogError("unable to lock");
+        result = IOTHUB_CLIENT_ERROR;
     }
     else
     {
-        savedData->canBeGarbageCollected = 1;
-
-        if (Unlock(savedData->lockGarbage) != LOCK_OK)
+        if ((iotHubClientInstance->UploadQueueMaxBytes != 0) && (savedData->size > iotHubClientInstance->UploadQueueMaxBytes))
         {
-            LogError("unable to Unlock after locking");
+            /*Codes_SRS_IOTHUBCLIENT_02_096: [ If "uploadQueueMaxBytes" is not 0 and size is bigger than it then IoTHubClient_UploadToBlobAsync shall fail and return IOTHUB_CLIENT_INVALID_SIZE. ]*/
+            LogError("the upload alone is bigger than uploadQueueMaxBytes");
+            result = IOTHUB_CLIENT_INVALID_SIZE;
         }
+        else if (
+            ((iotHubClientInstance->UploadQueueMaxCount != 0) && (iotHubClientInstance->UploadCount >= iotHubClientInstance->UploadQueueMaxCount)) ||
+            ((iotHubClientInstance->UploadQueueMaxBytes != 0) && (iotHubClientInstance->UploadBytes > iotHubClientInstance->UploadQueueMaxBytes - savedData->size))
+            )
+        {
+            /*Codes_SRS_IOTHUBCLIENT_02_097: [ If accepting the upload would make more than "uploadQueueMaxCount" uploads or more than "uploadQueueMaxBytes" bytes of sources be queued or uploading then IoTHubClient_UploadToBlobAsync shall fail and return IOTHUB_CLIENT_BUSY. ]*/
+            result = IOTHUB_CLIENT_BUSY;
+            if (inUploadCallback)
+            {
+                /*Codes_SRS_IOTHUBCLIENT_02_112: [ When called from within an upload callback IoTHubClient_UploadToBlobAsync shall not wait for room, whatever the "uploadQueueFullPolicy", and shall return IOTHUB_CLIENT_BUSY. ]*/
+                /*blocking the uploading thread would make it wait for room only it can make*/
+                LogError("not waiting for room in the upload queue from within an upload callback");
+            }
+            else if (iotHubClientInstance->UploadQueueFullPolicy == IOTHUB_CLIENT_QUEUE_FULL_BLOCK)
+            {
+                *shouldBlock = true;
+                *blockTimeout = iotHubClientInstance->UploadQueueBlockTimeout;
+            }
+        }
+        else
+        {
+            /*Codes_SRS_IOTHUBCLIENT_02_058: [ IoTHubClient_UploadToBlobAsync shall add the structure to the LIST_HANDLE of uploads. ]*/
+            LIST_ITEM_HANDLE item = list_add(iotHubClientInstance->UploadQueue, savedData);
+            if (item == NULL)
+            {
+                /*Codes_SRS_IOTHUBCLIENT_02_053: [ If copying to the structure, queueing it or starting the uploading thread fails, then IoTHubClient_UploadToBlobAsync shall fail and return IOTHUB_CLIENT_ERROR. ]*/
+                LogError("unable to list_add");
+                result = IOTHUB_CLIENT_ERROR;
+            }
+            else if (startUploadingThreadIfNeeded(iotHubClientInstance) != IOTHUB_CLIENT_OK)
+            {
+                /*Codes_SRS_IOTHUBCLIENT_02_053: [ If copying to the structure, queueing it or starting the uploading thread fails, then IoTHubClient_UploadToBlobAsync shall fail and return IOTHUB_CLIENT_ERROR. ]*/
+                LogError("unable to start the uploading thread");
+                (void)list_remove(iotHubClientInstance->UploadQueue, item);
+                result = IOTHUB_CLIENT_ERROR;
+            }
+            else
+            {
+                iotHubClientInstance->UploadCount++;
+                iotHubClientInstance->UploadBytes += savedData->size;
+                result = IOTHUB_CLIENT_OK;
+            }
+        }
+        (void)Unlock(iotHubClientInstance->UploadLock);
     }
-    return 0;
+
+    return result;
 }
-#endif
+
+/*queues savedData for the uploading thread, savedData is freed on failure*/
+static IOTHUB_CLIENT_RESULT queueUpload(IOTHUB_CLIENT_HANDLE iotHubClientHandle, UPLOADTOBLOB_SAVED_DATA* savedData)
+{
+    IOTHUB_CLIENT_RESULT result;
+    IOTHUB_CLIENT_INSTANCE* iotHubClientInstance = (IOTHUB_CLIENT_INSTANCE*)iotHubClientHandle;
+    unsigned int waited = 0;
+    bool shouldBlock;
+    unsigned int blockTimeout;
+
+    /*Codes_SRS_IOTHUBCLIENT_02_098: [ If the upload is not accepted because of SRS IOTHUBCLIENT 02 097 and "uploadQueueFullPolicy" is IOTHUB_CLIENT_QUEUE_FULL_BLOCK then IoTHubClient_UploadToBlobAsync shall release the lock, sleep and try again. ]*/
+    /*Codes_SRS_IOTHUBCLIENT_02_099: [ If "uploadQueueBlockTimeout" is not 0 and the upload could not be accepted in that many milliseconds then IoTHubClient_UploadToBlobAsync shall return IOTHUB_CLIENT_BUSY. ]*/
+    while (((result = tryQueueUpload(iotHubClientInstance, savedData, &shouldBlock, &blockTimeout)) == IOTHUB_CLIENT_BUSY) &&
+        shouldBlock &&
+        ((blockTimeout == 0) || (waited < blockTimeout)))
+    {
+        (void)ThreadAPI_Sleep(QUEUE_FULL_RETRY_SLEEP);
+        waited += QUEUE_FULL_RETRY_SLEEP;
+    }
+
+    if (result != IOTHUB_CLIENT_OK)
+    {
+        freeSavedData(savedData);
+    }
+    return result;
+}
+#endif /*DONT_USE_UPLOADTOBLOB*/
 
 #ifndef DONT_USE_UPLOADTOBLOB
 IOTHUB_CLIENT_RESULT IoTHubClient_UploadToBlobAsync(IOTHUB_CLIENT_HANDLE iotHubClientHandle, const char* destinationFileName, const unsigned char* source, size_t size, IOTHUB_CLIENT_FILE_UPLOAD_CALLBACK iotHubClientFileUploadCallback, void* context)
@@ -772,7 +1239,7 @@ IOTHUB_CLIENT_RESULT IoTHubClient_UploadToBlobAsync(IOTHUB_CLIENT_HANDLE iotHubC
         UPLOADTOBLOB_SAVED_DATA *savedData = (UPLOADTOBLOB_SAVED_DATA *)malloc(sizeof(UPLOADTOBLOB_SAVED_DATA));
         if (savedData == NULL)
         {
-            /*Codes_SRS_IOTHUBCLIENT_02_053: [ If copying to the structure or spawning the thread fails, then IoTHubClient_UploadToBlobAsync shall fail and return IOTHUB_CLIENT_ERROR. ]*/
+            /*Codes_SRS_IOTHUBCLIENT_02_053: [ If copying to the structure, queueing it or starting the uploading thread fails, then IoTHubClient_UploadToBlobAsync shall fail and return IOTHUB_CLIENT_ERROR. ]*/
             LogError("unable to malloc - oom");
             result = IOTHUB_CLIENT_ERROR;
         }
@@ -780,7 +1247,7 @@ IOTHUB_CLIENT_RESULT IoTHubClient_UploadToBlobAsync(IOTHUB_CLIENT_HANDLE iotHubC
         {
             if (mallocAndStrcpy_s((char**)&savedData->destinationFileName, destinationFileName) != 0)
             {
-                /*Codes_SRS_IOTHUBCLIENT_02_053: [ If copying to the structure or spawning the thread fails, then IoTHubClient_UploadToBlobAsync shall fail and return IOTHUB_CLIENT_ERROR. ]*/
+                /*Codes_SRS_IOTHUBCLIENT_02_053: [ If copying to the structure, queueing it or starting the uploading thread fails, then IoTHubClient_UploadToBlobAsync shall fail and return IOTHUB_CLIENT_ERROR. ]*/
                 LogError("unable to mallocAndStrcpy_s");
                 free(savedData);
                 result = IOTHUB_CLIENT_ERROR;
@@ -788,6 +1255,7 @@ IOTHUB_CLIENT_RESULT IoTHubClient_UploadToBlobAsync(IOTHUB_CLIENT_HANDLE iotHubC
             else
             {
                 savedData->size = size;
+                savedData->sourceFileName = NULL;
                 int sourceCloned;
                 if (size == 0)
                 {
@@ -799,7 +1267,7 @@ IOTHUB_CLIENT_RESULT IoTHubClient_UploadToBlobAsync(IOTHUB_CLIENT_HANDLE iotHubC
                     savedData->source = (unsigned char*)malloc(size);
                     if (savedData->source == NULL)
                     {
-                        /*Codes_SRS_IOTHUBCLIENT_02_053: [ If copying to the structure or spawning the thread fails, then IoTHubClient_UploadToBlobAsync shall fail and return IOTHUB_CLIENT_ERROR. ]*/
+                        /*Codes_SRS_IOTHUBCLIENT_02_053: [ If copying to the structure, queueing it or starting the uploading thread fails, then IoTHubClient_UploadToBlobAsync shall fail and return IOTHUB_CLIENT_ERROR. ]*/
                         LogError("unable to malloc - oom");
                         free(savedData->destinationFileName);
                         free(savedData);
@@ -821,74 +1289,7 @@ IOTHUB_CLIENT_RESULT IoTHubClient_UploadToBlobAsync(IOTHUB_CLIENT_HANDLE iotHubC
                     savedData->iotHubClientFileUploadCallback = iotHubClientFileUploadCallback;
                     savedData->context = context;
                     memcpy(savedData->source, source, size);
-                    IOTHUB_CLIENT_INSTANCE* iotHubClientHandleData = (IOTHUB_CLIENT_INSTANCE*)iotHubClientHandle;
-                    if (Lock(iotHubClientHandleData->LockHandle) != LOCK_OK) /*locking because the next statement is changing blobThreadsToBeJoined*/
-                    {
-                        LogError("unable to lock");
-                        free(savedData->source);
-                        free(savedData->destinationFileName);
-                        free(savedData);
-                        result = IOTHUB_CLIENT_ERROR;
-                    }
-                    else
-                    {
-                        if ((result = StartWorkerThreadIfNeeded(iotHubClientHandleData)) != IOTHUB_CLIENT_OK)
-                        {
-                            free(savedData->source);
-                            free(savedData->destinationFileName);
-                            free(savedData);
-                            result = IOTHUB_CLIENT_ERROR;
-                            LogError("Could not start worker thread");
-                        }
-                        else
-                        {
-                            /*Codes_SRS_IOTHUBCLIENT_02_058: [ IoTHubClient_UploadToBlobAsync shall add the structure to the list of structures that need to be cleaned once file upload finishes. ]*/
-                            LIST_ITEM_HANDLE item = list_add(iotHubClientHandleData->savedDataToBeCleaned, savedData);
-                            if (item == NULL)
-                            {
-                                LogError("unable to list_add");
-                                free(savedData->source);
-                                free(savedData->destinationFileName);
-                                free(savedData);
-                                result = IOTHUB_CLIENT_ERROR;
-                            }
-                            else
-                            {
-                                savedData->iotHubClientHandle = iotHubClientHandle;
-                                savedData->canBeGarbageCollected = 0;
-                                if ((savedData->lockGarbage = Lock_Init()) == NULL)
-                                {
-                                    (void)list_remove(iotHubClientHandleData->savedDataToBeCleaned, item);
-                                    free(savedData->source);
-                                    free(savedData->destinationFileName);
-                                    free(savedData);
-                                    result = IOTHUB_CLIENT_ERROR;
-                                    LogError("unable to Lock_Init");
-                                }
-                                else
-                                {
-                                    /*Codes_SRS_IOTHUBCLIENT_02_052: [ IoTHubClient_UploadToBlobAsync shall spawn a thread passing the structure build in SRS IOTHUBCLIENT 02 051 as thread data.]*/
-                                    if (ThreadAPI_Create(&savedData->uploadingThreadHandle, uploadingThread, savedData) != THREADAPI_OK)
-                                    {
-                                        /*Codes_SRS_IOTHUBCLIENT_02_053: [ If copying to the structure or spawning the thread fails, then IoTHubClient_UploadToBlobAsync shall fail and return IOTHUB_CLIENT_ERROR. ]*/
-                                        LogError("unablet to ThreadAPI_Create");
-                                        (void)Lock_Deinit(savedData->lockGarbage);
-                                        (void)list_remove(iotHubClientHandleData->savedDataToBeCleaned, item);
-                                        free(savedData->source);
-                                        free(savedData->destinationFileName);
-                                        free(savedData);
-                                        result = IOTHUB_CLIENT_ERROR;
-                                    }
-                                    else
-                                    {
-
-                                        result = IOTHUB_CLIENT_OK;
-                                    }
-                                }
-                            }
-                        }
-                        Unlock(iotHubClientHandleData->LockHandle);
-                    }
+                    result = queueUpload(iotHubClientHandle, savedData);
                 }
             }
         }
@@ -896,3 +1297,91 @@ IOTHUB_CLIENT_RESULT IoTHubClient_UploadToBlobAsync(IOTHUB_CLIENT_HANDLE iotHubC
     return result;
 }
 #endif /*DONT_USE_UPLOADTOBLOB*/
+
+#ifndef DONT_USE_UPLOADTOBLOB
+IOTHUB_CLIENT_RESULT IoTHubClient_UploadToBlobFromFileAsync(IOTHUB_CLIENT_HANDLE iotHubClientHandle, const char* destinationFileName, const char* sourceFileName, IOTHUB_CLIENT_FILE_UPLOAD_CALLBACK iotHubClientFileUploadCallback, void* context)
+{
+    IOTHUB_CLIENT_RESULT result;
+    /*Codes_SRS_IOTHUBCLIENT_02_091: [ If iotHubClientHandle, destinationFileName or sourceFileName is NULL then IoTHubClient_UploadToBlobFromFileAsync shall fail and return IOTHUB_CLIENT_INVALID_ARG. ]*/
+    if (
+        (iotHubClientHandle == NULL) ||
+        (destinationFileName == NULL) ||
+        (sourceFileName == NULL)
+        )
+    {
+        LogError("invalid parameters IOTHUB_CLIENT_HANDLE iotHubClientHandle = %p , const char* destinationFileName = %s, const char* sourceFileName = %s", iotHubClientHandle, destinationFileName, sourceFileName);
+        result = IOTHUB_CLIENT_INVALID_ARG;
+    }
+    else
+    {
+        /*Codes_SRS_IOTHUBCLIENT_02_092: [ IoTHubClient_UploadToBlobFromFileAsync shall copy destinationFileName, sourceFileName, iotHubClientFileUploadCallback and context into a structure and then queue it for the uploading thread as IoTHubClient_UploadToBlobAsync does, counting it as 0 bytes. The file shall only be read by the uploading thread. ]*/
+        UPLOADTOBLOB_SAVED_DATA *savedData = (UPLOADTOBLOB_SAVED_DATA *)malloc(sizeof(UPLOADTOBLOB_SAVED_DATA));
+        if (savedData == NULL)
+        {
+            /*Codes_SRS_IOTHUBCLIENT_02_093: [ If copying to the structure fails, then IoTHubClient_UploadToBlobFromFileAsync shall fail and return IOTHUB_CLIENT_ERROR. ]*/
+            LogError("unable to malloc - oom");
+            result = IOTHUB_CLIENT_ERROR;
+        }
+        else if (mallocAndStrcpy_s(&savedData->destinationFileName, destinationFileName) != 0)
+        {
+            /*Codes_SRS_IOTHUBCLIENT_02_093: [ If copying to the structure fails, then IoTHubClient_UploadToBlobFromFileAsync shall fail and return IOTHUB_CLIENT_ERROR. ]*/
+            LogError("unable to mallocAndStrcpy_s");
+            free(savedData);
+            result = IOTHUB_CLIENT_ERROR;
+        }
+        else if (mallocAndStrcpy_s(&savedData->sourceFileName, sourceFileName) != 0)
+        {
+            /*Codes_SRS_IOTHUBCLIENT_02_093: [ If copying to the structure fails, then IoTHubClient_UploadToBlobFromFileAsync shall fail and return IOTHUB_CLIENT_ERROR. ]*/
+            LogError("unable to mallocAndStrcpy_s");
+            free(savedData->destinationFileName);
+            free(savedData);
+            result = IOTHUB_CLIENT_ERROR;
+        }
+        else
+        {
+            savedData->source = NULL;
+            savedData->size = 0;
+            savedData->iotHubClientFileUploadCallback = iotHubClientFileUploadCallback;
+            savedData->context = context;
+            result = queueUpload(iotHubClientHandle, savedData);
+        }
+    }
+    return result;
+}
+#endif /*DONT_USE_UPLOADTOBLOB*/
+
+#ifndef DONT_USE_UPLOADTOBLOB
+IOTHUB_CLIENT_RESULT IoTHubClient_GetUploadQueueStats(IOTHUB_CLIENT_HANDLE iotHubClientHandle, IOTHUB_CLIENT_UPLOAD_QUEUE_STATS* stats)
+{
+    IOTHUB_CLIENT_RESULT result;
+
+    if ((iotHubClientHandle == NULL) || (stats == NULL))
+    {
+        /*Codes_SRS_IOTHUBCLIENT_02_106: [ If iotHubClientHandle or stats is NULL then IoTHubClient_GetUploadQueueStats shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+        result = IOTHUB_CLIENT_INVALID_ARG;
+        LogError("invalid parameters IOTHUB_CLIENT_HANDLE iotHubClientHandle = %p, IOTHUB_CLIENT_UPLOAD_QUEUE_STATS* stats = %p", iotHubClientHandle, stats);
+    }
+    else
+    {
+        IOTHUB_CLIENT_INSTANCE* iotHubClientInstance = (IOTHUB_CLIENT_INSTANCE*)iotHubClientHandle;
+
+        /*Codes_SRS_IOTHUBCLIENT_02_107: [ IoTHubClient_GetUploadQueueStats shall be made thread-safe by using the lock of the LIST_HANDLE of uploads, it shall not take the serializing lock. If acquiring the lock fails, IoTHubClient_GetUploadQueueStats shall return IOTHUB_CLIENT_ERROR. ]*/
+        if (Lock(iotHubClientInstance->UploadLock) != LOCK_OK)
+        {
+            result = IOTHUB_CLIENT_ERROR;
+            LogError("Could not acquire lock");
+        }
+        else
+        {
+            /*Codes_SRS_IOTHUBCLIENT_02_108: [ IoTHubClient_GetUploadQueueStats shall report how many uploads are queued or uploading and the bytes of their sources copied by IoTHubClient_UploadToBlobAsync, and return IOTHUB_CLIENT_OK. ]*/
+            stats->uploadCount = iotHubClientInstance->UploadCount;
+            stats->byteCount = iotHubClientInstance->UploadBytes;
+            result = IOTHUB_CLIENT_OK;
+
+            (void)Unlock(iotHubClientInstance->UploadLock);
+        }
+    }
+
+    return result;
+}
+#endif /*DONT_USE_UPLOADTOBLOB*/
@@ -0,0 +1,84 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#ifdef _CRTDBG_MAP_ALLOC
+#include <crtdbg.h>
+#endif
+#include <stdint.h>
+
+#include "iothub_client_base64.h"
+
+static const char base64char[64] =
+{
+    'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H', 'I', 'J', 'K', 'L', 'M', 'N', 'O', 'P',
+    'Q', 'R', 'S', 'T', 'U', 'V', 'W', 'X', 'Y', 'Z', 'a', 'b', 'c', 'd', 'e', 'f',
+    'g', 'h', 'i', 'j', 'k', 'l', 'm', 'n', 'o', 'p', 'q', 'r', 's', 't', 'u', 'v',
+    'w', 'x', 'y', 'z', '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', '+', '/'
+};
+
+size_t IoTHubClient_Base64_GetEncodedLength(size_t size)
+{
+    /*Codes_SRS_IOTHUB_CLIENT_BASE64_02_001: [ IoTHubClient_Base64_GetEncodedLength shall return the number of characters of the Base64 encoding of size bytes, padding included. ]*/
+    return ((size / 3) + ((size % 3) != 0)) * 4;
+}
+
+char* IoTHubClient_Base64_Encode(char* destination, const unsigned char* source, size_t size)
+{
+    char* result;
+    if (
+        /*Codes_SRS_IOTHUB_CLIENT_BASE64_02_002: [ If destination is NULL then IoTHubClient_Base64_Encode shall fail and return NULL. ]*/
+        (destination == NULL) ||
+        /*Codes_SRS_IOTHUB_CLIENT_BASE64_02_003: [ If source is NULL and size is not zero then IoTHubClient_Base64_Encode shall fail and return NULL. ]*/
+        ((source == NULL) && (size != 0))
+        )
+    {
+        result = NULL;
+    }
+    else
+    {
+        const unsigned char* end = source + (size - (size % 3));
+        result = destination;
+
+        /*Codes_SRS_IOTHUB_CLIENT_BASE64_02_004: [ IoTHubClient_Base64_Encode shall write at destination the Base64 encoding of the size bytes at source, padded with '=' to a multiple of 4 characters. ]*/
+        /*every 3 bytes are loaded as 1 24 bit group that produces 4 characters*/
+        while (source < end)
+        {
+            uint32_t group = ((uint32_t)source[0] << 16) | ((uint32_t)source[1] << 8) | source[2];
+            result[0] = base64char[group >> 18];
+            result[1] = base64char[(group >> 12) & 0x3F];
+            result[2] = base64char[(group >> 6) & 0x3F];
+            result[3] = base64char[group & 0x3F];
+            result += 4;
+            source += 3;
+        }
+
+        switch (size % 3)
+        {
+            case 1:
+            {
+                result[0] = base64char[source[0] >> 2];
+                result[1] = base64char[(source[0] & 0x03) << 4];
+                result[2] = '=';
+                result[3] = '=';
+                result += 4;
+                break;
+            }
+            case 2:
+            {
+                result[0] = base64char[source[0] >> 2];
+                result[1] = base64char[((source[0] & 0x03) << 4) | (source[1] >> 4)];
+                result[2] = base64char[(source[1] & 0x0F) << 2];
+                result[3] = '=';
+                result += 4;
+                break;
+            }
+            default:
+            {
+                break;
+            }
+        }
+        /*Codes_SRS_IOTHUB_CLIENT_BASE64_02_005: [ IoTHubClient_Base64_Encode shall not '\0' terminate the encoding and shall return a pointer to the character that follows the last written one. ]*/
+    }
+    return result;
+}
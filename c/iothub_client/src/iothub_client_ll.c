@@ -6,6 +6,7 @@
 #include <crtdbg.h>
 #endif
 #include <string.h>
+#include <stdio.h>
 #include "azure_c_shared_utility/gballoc.h"
 #include "azure_c_shared_utility/string_tokenizer.h"
 #include "azure_c_shared_utility/doublylinkedlist.h"
@@ -16,6 +17,8 @@
 #include "iothub_client_private.h"
 #include "iothub_client_version.h"
 #include "iothub_transport_ll.h"
+#include "iothub_client_ll_messagestore.h"
+#include "iothub_client_lz4.h"
 
 #ifndef DONT_USE_UPLOADTOBLOB
 #include "iothub_client_ll_uploadtoblob.h"
@@ -38,12 +41,35 @@ typedef struct IOTHUB_CLIENT_LL_HANDLE_DATA_TAG
     time_t lastMessageReceiveTime;
     TICK_COUNTER_HANDLE tickCounter; /*shared tickcounter used to track message timeouts in waitingToSend list*/
     uint64_t currentMessageTimeout;
+    bool waitingToSendInTimeoutOrder; /*true when waitingToSend is known to be sorted by ms_timesOutAfter, so DoTimeouts can stop at the first message that has not expired*/
+    PDLIST_ENTRY knownTail; /*the tail of waitingToSend as IoTHubClient_LL last left it. Transports (a shared one even outside of IoTHubClient_LL_DoWork) append the messages they could not send at the tail, so a different tail means waitingToSend might be out of order*/
+    PDLIST_ENTRY freeMessageEntries; /*released IOTHUB_MESSAGE_LIST kept for reuse, chained through entry.Flink*/
+    size_t freeMessageEntriesCount;
+    size_t messagePoolSize; /*how many released IOTHUB_MESSAGE_LIST are kept at most in freeMessageEntries*/
+    size_t messageQueueMaxCount; /*0 means no limit*/
+    size_t messageQueueMaxBytes; /*0 means no limit*/
+    IOTHUB_CLIENT_QUEUE_FULL_POLICY messageQueueFullPolicy;
+    size_t queuedCount; /*transports take messages out of waitingToSend without telling IoTHubClient_LL (a shared transport even outside of IoTHubClient_LL_DoWork), so this is only an upper bound of the messages in waitingToSend until recounted*/
+    size_t queuedBytes; /*upper bound of the sum of the messageSize of the messages in waitingToSend, same as queuedCount*/
+    size_t droppedCount;
+    size_t rejectedCount;
+    IOTHUB_CLIENT_LL_MESSAGESTORE_HANDLE messageStore; /*NULL unless "messageStorePath" has been set*/
+    IOTHUB_CLIENT_COMPRESSION compression;
+    size_t compressionThreshold; /*payloads shorter than this are sent uncompressed*/
 #ifndef DONT_USE_UPLOADTOBLOB
     IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE uploadToBlobHandle;
 #endif
 
 }IOTHUB_CLIENT_LL_HANDLE_DATA;
 
+/*ms_timesOutAfter == 0 means "never times out", so such messages order after all the others*/
+#define TIMEOUT_ORDER_KEY(ms_timesOutAfter) (((ms_timesOutAfter) == 0) ? UINT64_MAX : (ms_timesOutAfter))
+
+#define DEFAULT_COMPRESSION_THRESHOLD 256
+static const char CONTENT_ENCODING_PROPERTY[] = "content-encoding";
+static const char CONTENT_ENCODING_LZ4[] = "lz4";
+static const char UNCOMPRESSED_LENGTH_PROPERTY[] = "content-length-uncompressed";
+
 static const char HOSTNAME_TOKEN[] = "HostName";
 static const char DEVICEID_TOKEN[] = "DeviceId";
 static const char DEVICEKEY_TOKEN[] = "SharedAccessKey";
@@ -390,6 +416,23 @@ IOTHUB_CLIENT_LL_HANDLE IoTHubClient_LL_Create(const IOTHUB_CLIENT_CONFIG* confi
                             handleData->isSharedTransport = false;
                             /*Codes_SRS_IOTHUBCLIENT_LL_02_042: [ By default, messages shall not timeout. ]*/
                             handleData->currentMessageTimeout = 0;
+                            handleData->waitingToSendInTimeoutOrder = true;
+                            handleData->knownTail = &(handleData->waitingToSend);
+                            handleData->freeMessageEntries = NULL;
+                            handleData->freeMessageEntriesCount = 0;
+                            handleData->messagePoolSize = 0;
+                            /*Codes_SRS_IOTHUBCLIENT_LL_02_110: [ By default, the messages waiting to be sent shall not be limited and the policy shall be IOTHUB_CLIENT_QUEUE_FULL_REJECT. ]*/
+                            handleData->messageQueueMaxCount = 0;
+                            handleData->messageQueueMaxBytes = 0;
+                            handleData->messageQueueFullPolicy = IOTHUB_CLIENT_QUEUE_FULL_REJECT;
+                            handleData->queuedCount = 0;
+                            handleData->queuedBytes = 0;
+                            handleData->droppedCount = 0;
+                            handleData->rejectedCount = 0;
+                            handleData->messageStore = NULL;
+                            /*Codes_SRS_IOTHUBCLIENT_LL_02_130: [ By default, the messages shall not be compressed and "compressionThreshold" shall be 256. ]*/
+                            handleData->compression = IOTHUB_CLIENT_COMPRESSION_NONE;
+                            handleData->compressionThreshold = DEFAULT_COMPRESSION_THRESHOLD;
                             result = handleData;
                         }
                     }
@@ -524,6 +567,23 @@ IOTHUB_CLIENT_LL_HANDLE IoTHubClient_LL_CreateWithTransport(const IOTHUB_CLIENT_
                                 handleData->isSharedTransport = true;
                                 /*Codes_SRS_IOTHUBCLIENT_LL_02_042: [ By default, messages shall not timeout. ]*/
                                 handleData->currentMessageTimeout = 0;
+                                handleData->waitingToSendInTimeoutOrder = true;
+                                handleData->knownTail = &(handleData->waitingToSend);
+                                handleData->freeMessageEntries = NULL;
+                                handleData->freeMessageEntriesCount = 0;
+                                handleData->messagePoolSize = 0;
+                                /*Codes_SRS_IOTHUBCLIENT_LL_02_110: [ By default, the messages waiting to be sent shall not be limited and the policy shall be IOTHUB_CLIENT_QUEUE_FULL_REJECT. ]*/
+                                handleData->messageQueueMaxCount = 0;
+                                handleData->messageQueueMaxBytes = 0;
+                                handleData->messageQueueFullPolicy = IOTHUB_CLIENT_QUEUE_FULL_REJECT;
+                                handleData->queuedCount = 0;
+                                handleData->queuedBytes = 0;
+                                handleData->droppedCount = 0;
+                                handleData->rejectedCount = 0;
+                                handleData->messageStore = NULL;
+                                /*Codes_SRS_IOTHUBCLIENT_LL_02_130: [ By default, the messages shall not be compressed and "compressionThreshold" shall be 256. ]*/
+                                handleData->compression = IOTHUB_CLIENT_COMPRESSION_NONE;
+                                handleData->compressionThreshold = DEFAULT_COMPRESSION_THRESHOLD;
                                 result = handleData;
                             }
                         }
@@ -539,6 +599,52 @@ IOTHUB_CLIENT_LL_HANDLE IoTHubClient_LL_CreateWithTransport(const IOTHUB_CLIENT_
     return result;
 }
 
+/*IoTHubClient_LL is not thread safe (the convenience layer serializes all calls with its lock), so the pool needs no lock of its own*/
+/*only the IOTHUB_MESSAGE_LIST is pooled: the message clone owns its buffers and is created and destroyed by IoTHubMessage, which has no way to reuse them*/
+static IOTHUB_MESSAGE_LIST* allocateMessageEntry(IOTHUB_CLIENT_LL_HANDLE_DATA* handleData)
+{
+    IOTHUB_MESSAGE_LIST* result;
+    if (handleData->freeMessageEntries != NULL)
+    {
+        /*Codes_SRS_IOTHUBCLIENT_LL_02_106: [ IoTHubClient_LL_SendEventAsync shall reuse a released IOTHUB_MESSAGE_LIST when one is available. ]*/
+        PDLIST_ENTRY head = handleData->freeMessageEntries;
+        handleData->freeMessageEntries = head->Flink;
+        handleData->freeMessageEntriesCount--;
+        result = containingRecord(head, IOTHUB_MESSAGE_LIST, entry);
+    }
+    else
+    {
+        result = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST));
+    }
+    return result;
+}
+
+static void releaseMessageEntry(IOTHUB_CLIENT_LL_HANDLE_DATA* handleData, IOTHUB_MESSAGE_LIST* messageEntry)
+{
+    if (handleData->freeMessageEntriesCount < handleData->messagePoolSize)
+    {
+        /*Codes_SRS_IOTHUBCLIENT_LL_02_107: [ A IOTHUB_MESSAGE_LIST that is no longer needed shall be kept for reuse if fewer than "messagePoolSize" are kept, otherwise it shall be freed. ]*/
+        messageEntry->entry.Flink = handleData->freeMessageEntries;
+        handleData->freeMessageEntries = &(messageEntry->entry);
+        handleData->freeMessageEntriesCount++;
+    }
+    else
+    {
+        free(messageEntry);
+    }
+}
+
+static void trimMessageEntries(IOTHUB_CLIENT_LL_HANDLE_DATA* handleData)
+{
+    while (handleData->freeMessageEntriesCount > handleData->messagePoolSize)
+    {
+        PDLIST_ENTRY head = handleData->freeMessageEntries;
+        handleData->freeMessageEntries = head->Flink;
+        handleData->freeMessageEntriesCount--;
+        free(containingRecord(head, IOTHUB_MESSAGE_LIST, entry));
+    }
+}
+
 void IoTHubClient_LL_Destroy(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle)
 {
     /*Codes_SRS_IOTHUBCLIENT_LL_02_009: [IoTHubClient_LL_Destroy shall do nothing if parameter iotHubClientHandle is NULL.]*/
@@ -565,11 +671,19 @@ void IoTHubClient_LL_Destroy(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle)
             IoTHubMessage_Destroy(temp->messageHandle);
             free(temp);
         }
+        /*Codes_SRS_IOTHUBCLIENT_LL_02_108: [ IoTHubClient_LL_Destroy shall free all the IOTHUB_MESSAGE_LIST kept for reuse. ]*/
+        handleData->messagePoolSize = 0;
+        trimMessageEntries(handleData);
         /*Codes_SRS_IOTHUBCLIENT_LL_17_011: [IoTHubClient_LL_Destroy  shall free the resources allocated by IoTHubClient (if any).] */
         tickcounter_destroy(handleData->tickCounter);
 #ifndef DONT_USE_UPLOADTOBLOB
         IoTHubClient_LL_UploadToBlob_Destroy(handleData->uploadToBlobHandle);
 #endif
+        /*Codes_SRS_IOTHUBCLIENT_LL_02_129: [ IoTHubClient_LL_Destroy shall destroy the message store, if any, after all the confirmation callbacks have been called. ]*/
+        if (handleData->messageStore != NULL)
+        {
+            IoTHubClient_LL_MessageStore_Destroy(handleData->messageStore);
+        }
         free(handleData);
     }
 }
@@ -602,7 +716,330 @@ static int attach_ms_timesOutAfter(IOTHUB_CLIENT_LL_HANDLE_DATA* handleData, IOT
     return result;
 }
 
-IOTHUB_CLIENT_RESULT IoTHubClient_LL_SendEventAsync(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, IOTHUB_MESSAGE_HANDLE eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void* userContextCallback)
+/*payload size of a message, as accounted against "messageQueueMaxBytes"*/
+static size_t getMessageSize(IOTHUB_MESSAGE_HANDLE messageHandle)
+{
+    size_t result;
+    IOTHUBMESSAGE_CONTENT_TYPE contentType = IoTHubMessage_GetContentType(messageHandle);
+    if (contentType == IOTHUBMESSAGE_BYTEARRAY)
+    {
+        const unsigned char* buffer;
+        if (IoTHubMessage_GetByteArray(messageHandle, &buffer, &result) != IOTHUB_MESSAGE_OK)
+        {
+            LogError("unable to IoTHubMessage_GetByteArray, the message is accounted as empty");
+            result = 0;
+        }
+    }
+    else if (contentType == IOTHUBMESSAGE_STRING)
+    {
+        const char* text = IoTHubMessage_GetString(messageHandle);
+        result = (text == NULL) ? 0 : strlen(text);
+    }
+    else
+    {
+        result = 0;
+    }
+    return result;
+}
+
+static void recountQueue(IOTHUB_CLIENT_LL_HANDLE_DATA* handleData)
+{
+    PDLIST_ENTRY current = handleData->waitingToSend.Flink;
+    handleData->queuedCount = 0;
+    handleData->queuedBytes = 0;
+    while (current != &(handleData->waitingToSend))
+    {
+        handleData->queuedCount++;
+        handleData->queuedBytes += containingRecord(current, IOTHUB_MESSAGE_LIST, entry)->messageSize;
+        current = current->Flink;
+    }
+}
+
+/*messageSize is known not to be bigger than messageQueueMaxBytes*/
+static bool queueHasRoom(const IOTHUB_CLIENT_LL_HANDLE_DATA* handleData, size_t messageSize)
+{
+    return
+        ((handleData->messageQueueMaxCount == 0) || (handleData->queuedCount < handleData->messageQueueMaxCount)) &&
+        ((handleData->messageQueueMaxBytes == 0) || (handleData->queuedBytes <= handleData->messageQueueMaxBytes - messageSize));
+}
+
+/*Codes_SRS_IOTHUBCLIENT_LL_02_166: [ If the tail of waitingToSend is not the one IoTHubClient_LL last left there then IoTHubClient_LL shall no longer consider waitingToSend sorted by the messages' timeouts. ]*/
+static void checkKnownTail(IOTHUB_CLIENT_LL_HANDLE_DATA* handleData)
+{
+    /*an empty list cannot be out of order*/
+    if ((handleData->waitingToSend.Blink != &(handleData->waitingToSend)) && (handleData->waitingToSend.Blink != handleData->knownTail))
+    {
+        handleData->waitingToSendInTimeoutOrder = false;
+    }
+    handleData->knownTail = handleData->waitingToSend.Blink;
+}
+
+/*returns IOTHUB_CLIENT_OK when a message of messageSize bytes can be added to waitingToSend, possibly after dropOldestMessages. Nothing is dropped yet, so that a later failure does not lose any message*/
+static IOTHUB_CLIENT_RESULT checkRoomInQueue(IOTHUB_CLIENT_LL_HANDLE_DATA* handleData, size_t messageSize)
+{
+    IOTHUB_CLIENT_RESULT result;
+    if ((handleData->messageQueueMaxBytes != 0) && (messageSize > handleData->messageQueueMaxBytes))
+    {
+        /*Codes_SRS_IOTHUBCLIENT_LL_02_117: [ If the message alone is bigger than "messageQueueMaxBytes" then IoTHubClient_LL_SendEventAsync shall fail and return IOTHUB_CLIENT_INVALID_SIZE. ]*/
+        result = IOTHUB_CLIENT_INVALID_SIZE;
+    }
+    else if (queueHasRoom(handleData, messageSize))
+    {
+        /*the counts are never lower than the real ones, no need to recount*/
+        result = IOTHUB_CLIENT_OK;
+    }
+    else
+    {
+        /*Codes_SRS_IOTHUBCLIENT_LL_02_175: [ Before deciding that waitingToSend is full IoTHubClient_LL_SendEventAsync shall count the messages that are in waitingToSend, since the transport might have taken some of them. ]*/
+        recountQueue(handleData);
+        /*Codes_SRS_IOTHUBCLIENT_LL_02_115: [ If adding the message would exceed "messageQueueMaxCount" or "messageQueueMaxBytes" and the policy is IOTHUB_CLIENT_QUEUE_FULL_REJECT or IOTHUB_CLIENT_QUEUE_FULL_BLOCK then IoTHubClient_LL_SendEventAsync shall fail and return IOTHUB_CLIENT_BUSY. ]*/
+        result = (queueHasRoom(handleData, messageSize) || (handleData->messageQueueFullPolicy == IOTHUB_CLIENT_QUEUE_FULL_DROP_OLDEST)) ? IOTHUB_CLIENT_OK : IOTHUB_CLIENT_BUSY;
+    }
+    return result;
+}
+
+/*only has something to do when checkRoomInQueue has let a message in because of IOTHUB_CLIENT_QUEUE_FULL_DROP_OLDEST*/
+static void dropOldestMessages(IOTHUB_CLIENT_LL_HANDLE_DATA* handleData, size_t messageSize)
+{
+    /*Codes_SRS_IOTHUBCLIENT_LL_02_116: [ If the policy is IOTHUB_CLIENT_QUEUE_FULL_DROP_OLDEST then IoTHubClient_LL_SendEventAsync shall remove the oldest messages from waitingToSend, call their callbacks with IOTHUB_CLIENT_CONFIRMATION_BECAUSE_QUEUE_FULL and destroy them until the new message fits. ]*/
+    /*Codes_SRS_IOTHUBCLIENT_LL_02_176: [ IoTHubClient_LL_SendEventAsync shall drop the oldest messages only once the new message is ready to be added to waitingToSend. ]*/
+    while (!queueHasRoom(handleData, messageSize) && !DList_IsListEmpty(&(handleData->waitingToSend)))
+    {
+        IOTHUB_MESSAGE_LIST* oldest = containingRecord(DList_RemoveHeadList(&(handleData->waitingToSend)), IOTHUB_MESSAGE_LIST, entry);
+        handleData->queuedCount--;
+        handleData->queuedBytes -= oldest->messageSize;
+        handleData->droppedCount++;
+        if (oldest->callback != NULL)
+        {
+            oldest->callback(IOTHUB_CLIENT_CONFIRMATION_BECAUSE_QUEUE_FULL, oldest->context);
+        }
+        IoTHubMessage_Destroy(oldest->messageHandle);
+        releaseMessageEntry(handleData, oldest);
+    }
+}
+
+/*the confirmation of a message kept in the message store goes through storedMessageCallback, which trims the store before calling the user's callback*/
+typedef struct STORED_MESSAGE_CONTEXT_TAG
+{
+    IOTHUB_CLIENT_LL_HANDLE_DATA* handleData;
+    uint64_t recordId;
+    IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK callback;
+    void* context;
+}STORED_MESSAGE_CONTEXT;
+
+static void storedMessageCallback(IOTHUB_CLIENT_CONFIRMATION_RESULT result, void* userContextCallback)
+{
+    STORED_MESSAGE_CONTEXT* storedContext = (STORED_MESSAGE_CONTEXT*)userContextCallback;
+    /*Codes_SRS_IOTHUBCLIENT_LL_02_127: [ Messages confirmed with IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY or IOTHUB_CLIENT_CONFIRMATION_ERROR shall be kept in the message store. ]*/
+    /*a transport that is destroyed completes its in-flight messages with IOTHUB_CLIENT_CONFIRMATION_ERROR, these have to be sent again by the next run*/
+    if ((result == IOTHUB_CLIENT_CONFIRMATION_OK) || (result == IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT) || (result == IOTHUB_CLIENT_CONFIRMATION_BECAUSE_QUEUE_FULL))
+    {
+        /*Codes_SRS_IOTHUBCLIENT_LL_02_126: [ When the confirmation of a stored message is IOTHUB_CLIENT_CONFIRMATION_OK, IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT or IOTHUB_CLIENT_CONFIRMATION_BECAUSE_QUEUE_FULL, IoTHubClient_LL shall remove the message from the message store before calling the message's callback. ]*/
+        if (IoTHubClient_LL_MessageStore_Remove(storedContext->handleData->messageStore, storedContext->recordId) != 0)
+        {
+            LogError("unable to remove the message from the message store, it will be sent again");
+        }
+    }
+
+    if (storedContext->callback != NULL)
+    {
+        storedContext->callback(result, storedContext->context);
+    }
+    free(storedContext);
+}
+
+/*returns 0 on success, any other value is error. storeRecordId is 0 for messages that are not in the message store yet*/
+static int storeMessageEntry(IOTHUB_CLIENT_LL_HANDLE_DATA* handleData, IOTHUB_MESSAGE_LIST* newEntry, uint64_t storeRecordId)
+{
+    int result;
+    STORED_MESSAGE_CONTEXT* storedContext = (STORED_MESSAGE_CONTEXT*)malloc(sizeof(STORED_MESSAGE_CONTEXT));
+    if (storedContext == NULL)
+    {
+        LogError("unable to malloc");
+        result = __LINE__;
+    }
+    /*Codes_SRS_IOTHUBCLIENT_LL_02_124: [ If a message store is set then IoTHubClient_LL_SendEventAsync shall append the message to it. ]*/
+    else if ((storeRecordId == 0) && (IoTHubClient_LL_MessageStore_Append(handleData->messageStore, newEntry->messageHandle, &storeRecordId) != 0))
+    {
+        LogError("unable to append the message to the message store");
+        free(storedContext);
+        result = __LINE__;
+    }
+    else
+    {
+        storedContext->handleData = handleData;
+        storedContext->recordId = storeRecordId;
+        storedContext->callback = newEntry->callback;
+        storedContext->context = newEntry->context;
+        newEntry->callback = storedMessageCallback;
+        newEntry->context = storedContext;
+        result = 0;
+    }
+    return result;
+}
+
+/*returns 0 on success, any other value is error*/
+static int copyCompressedMessageFields(IOTHUB_MESSAGE_HANDLE compressedMessage, IOTHUB_MESSAGE_HANDLE messageHandle, MAP_HANDLE properties, size_t payloadSize)
+{
+    int result;
+    char uncompressedLength[21]; /*enough for the decimal digits of a 64 bit value*/
+    const char* messageId = IoTHubMessage_GetMessageId(messageHandle);
+    const char* correlationId = IoTHubMessage_GetCorrelationId(messageHandle);
+    MAP_HANDLE compressedProperties;
+    const char*const* keys;
+    const char*const* values;
+    size_t count;
+
+    if ((messageId != NULL) && (IoTHubMessage_SetMessageId(compressedMessage, messageId) != IOTHUB_MESSAGE_OK))
+    {
+        LogError("unable to IoTHubMessage_SetMessageId");
+        result = __LINE__;
+    }
+    else if ((correlationId != NULL) && (IoTHubMessage_SetCorrelationId(compressedMessage, correlationId) != IOTHUB_MESSAGE_OK))
+    {
+        LogError("unable to IoTHubMessage_SetCorrelationId");
+        result = __LINE__;
+    }
+    else if ((compressedProperties = IoTHubMessage_Properties(compressedMessage)) == NULL)
+    {
+        LogError("unable to IoTHubMessage_Properties");
+        result = __LINE__;
+    }
+    else if (Map_GetInternals(properties, &keys, &values, &count) != MAP_OK)
+    {
+        LogError("unable to Map_GetInternals");
+        result = __LINE__;
+    }
+    else
+    {
+        size_t i;
+        for (i = 0; i < count; i++)
+        {
+            if (Map_AddOrUpdate(compressedProperties, keys[i], values[i]) != MAP_OK)
+            {
+                break;
+            }
+        }
+
+        if (i < count)
+        {
+            LogError("unable to copy the property %s", keys[i]);
+            result = __LINE__;
+        }
+        else if (Map_AddOrUpdate(compressedProperties, CONTENT_ENCODING_PROPERTY, CONTENT_ENCODING_LZ4) != MAP_OK)
+        {
+            LogError("unable to add the %s property", CONTENT_ENCODING_PROPERTY);
+            result = __LINE__;
+        }
+        else if (
+            (sprintf(uncompressedLength, "%lu", (unsigned long)payloadSize) < 0) ||
+            (Map_AddOrUpdate(compressedProperties, UNCOMPRESSED_LENGTH_PROPERTY, uncompressedLength) != MAP_OK)
+            )
+        {
+            LogError("unable to add the %s property", UNCOMPRESSED_LENGTH_PROPERTY);
+            result = __LINE__;
+        }
+        else
+        {
+            result = 0;
+        }
+    }
+    return result;
+}
+
+/*returns a new message with the compressed payload of messageHandle, or NULL when messageHandle is to be sent as it is*/
+static IOTHUB_MESSAGE_HANDLE compressMessage(IOTHUB_CLIENT_LL_HANDLE_DATA* handleData, IOTHUB_MESSAGE_HANDLE messageHandle)
+{
+    IOTHUB_MESSAGE_HANDLE result;
+    const unsigned char* payload;
+    size_t payloadSize;
+    MAP_HANDLE properties;
+    bool isEncoded;
+    IOTHUBMESSAGE_CONTENT_TYPE contentType = IoTHubMessage_GetContentType(messageHandle);
+
+    if (contentType == IOTHUBMESSAGE_BYTEARRAY)
+    {
+        if (IoTHubMessage_GetByteArray(messageHandle, &payload, &payloadSize) != IOTHUB_MESSAGE_OK)
+        {
+            payload = NULL;
+        }
+    }
+    else if (contentType == IOTHUBMESSAGE_STRING)
+    {
+        payload = (const unsigned char*)IoTHubMessage_GetString(messageHandle);
+        payloadSize = (payload == NULL) ? 0 : strlen((const char*)payload);
+    }
+    else
+    {
+        payload = NULL;
+    }
+
+    if (payload == NULL)
+    {
+        LogError("unable to get the payload of the message, it is sent uncompressed");
+        result = NULL;
+    }
+    else if (payloadSize < handleData->compressionThreshold)
+    {
+        /*too short to be worth compressing*/
+        result = NULL;
+    }
+    else if ((properties = IoTHubMessage_Properties(messageHandle)) == NULL)
+    {
+        LogError("unable to IoTHubMessage_Properties, the message is sent uncompressed");
+        result = NULL;
+    }
+    else if (Map_ContainsKey(properties, CONTENT_ENCODING_PROPERTY, &isEncoded) != MAP_OK)
+    {
+        LogError("unable to Map_ContainsKey, the message is sent uncompressed");
+        result = NULL;
+    }
+    else if (isEncoded)
+    {
+        /*the payload is already encoded by the application or it is a stored message that has been compressed before*/
+        result = NULL;
+    }
+    else
+    {
+        size_t maxCompressedSize = IoTHubClient_LZ4_GetMaxCompressedLength(payloadSize);
+        unsigned char* compressed = (unsigned char*)malloc(maxCompressedSize);
+        if (compressed == NULL)
+        {
+            /*Codes_SRS_IOTHUBCLIENT_LL_02_136: [ If compressing the message fails for any reason or the compressed payload is not smaller than the payload then IoTHubClient_LL_SendEventAsync shall queue the message uncompressed. ]*/
+            LogError("unable to malloc, the message is sent uncompressed");
+            result = NULL;
+        }
+        else
+        {
+            size_t compressedSize = IoTHubClient_LZ4_Compress(compressed, maxCompressedSize, payload, payloadSize);
+            if ((compressedSize == 0) || (compressedSize >= payloadSize))
+            {
+                /*Codes_SRS_IOTHUBCLIENT_LL_02_136: [ If compressing the message fails for any reason or the compressed payload is not smaller than the payload then IoTHubClient_LL_SendEventAsync shall queue the message uncompressed. ]*/
+                result = NULL;
+            }
+            else if ((result = IoTHubMessage_CreateFromByteArray(compressed, compressedSize)) == NULL)
+            {
+                LogError("unable to IoTHubMessage_CreateFromByteArray, the message is sent uncompressed");
+            }
+            /*Codes_SRS_IOTHUBCLIENT_LL_02_135: [ The compressed message shall have the message id, the correlation id and the properties of eventMessageHandle and the property "content-encoding" set to "lz4". ]*/
+            /*Codes_SRS_IOTHUBCLIENT_LL_02_169: [ The compressed message shall have the property "content-length-uncompressed" set to the size of the payload of eventMessageHandle in decimal. ]*/
+            else if (copyCompressedMessageFields(result, messageHandle, properties, payloadSize) != 0)
+            {
+                LogError("unable to copy the fields of the message, the message is sent uncompressed");
+                IoTHubMessage_Destroy(result);
+                result = NULL;
+            }
+            else
+            {
+                /*all is fine*/
+            }
+            free(compressed);
+        }
+    }
+    return result;
+}
+
+static IOTHUB_CLIENT_RESULT SendEventAsync_Impl(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, IOTHUB_MESSAGE_HANDLE eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void* userContextCallback, bool takeOwnership, uint64_t storeRecordId)
 {
     IOTHUB_CLIENT_RESULT result;
     /*Codes_SRS_IOTHUBCLIENT_LL_02_011: [IoTHubClient_LL_SendEventAsync shall fail and return IOTHUB_CLIENT_INVALID_ARG if parameter iotHubClientHandle or eventMessageHandle is NULL.]*/
@@ -618,41 +1055,119 @@ IOTHUB_CLIENT_RESULT IoTHubClient_LL_SendEventAsync(IOTHUB_CLIENT_LL_HANDLE iotH
     }
     else
     {
-        IOTHUB_MESSAGE_LIST *newEntry = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST));
-        if (newEntry == NULL)
+        IOTHUB_CLIENT_LL_HANDLE_DATA* handleData = (IOTHUB_CLIENT_LL_HANDLE_DATA*)iotHubClientHandle;
+        /*Codes_SRS_IOTHUBCLIENT_LL_02_134: [ If "compression" is IOTHUB_CLIENT_COMPRESSION_LZ4, the payload is at least "compressionThreshold" bytes and the message does not have a "content-encoding" property then IoTHubClient_LL_SendEventAsync shall queue instead of eventMessageHandle a new byte array message with the LZ4 block of the payload. ]*/
+        IOTHUB_MESSAGE_HANDLE compressedMessage = (handleData->compression == IOTHUB_CLIENT_COMPRESSION_LZ4) ? compressMessage(handleData, eventMessageHandle) : NULL;
+        /*Codes_SRS_IOTHUBCLIENT_LL_02_170: [ The message shall be accounted against "messageQueueMaxBytes" with the size of the payload that is queued, after compression. ]*/
+        /*Codes_SRS_IOTHUBCLIENT_LL_02_168: [ IoTHubClient_LL_SendEventAsync shall measure every message, also when "messageQueueMaxBytes" is 0. ]*/
+        size_t messageSize = getMessageSize((compressedMessage != NULL) ? compressedMessage : eventMessageHandle);
+        if ((result = checkRoomInQueue(handleData, messageSize)) != IOTHUB_CLIENT_OK)
         {
-            result = IOTHUB_CLIENT_ERROR;
+            /*Codes_SRS_IOTHUBCLIENT_LL_02_167: [ Only the calls that return IOTHUB_CLIENT_BUSY shall count as refused because the queue was full. ]*/
+            if (result == IOTHUB_CLIENT_BUSY)
+            {
+                handleData->rejectedCount++;
+            }
+            if (compressedMessage != NULL)
+            {
+                IoTHubMessage_Destroy(compressedMessage);
+            }
             LOG_ERROR;
         }
         else
         {
-            IOTHUB_CLIENT_LL_HANDLE_DATA* handleData = (IOTHUB_CLIENT_LL_HANDLE_DATA*)iotHubClientHandle;
-
-            if (attach_ms_timesOutAfter(handleData, newEntry) != 0)
+            IOTHUB_MESSAGE_LIST *newEntry = allocateMessageEntry(handleData);
+            if (newEntry == NULL)
             {
                 result = IOTHUB_CLIENT_ERROR;
+                if (compressedMessage != NULL)
+                {
+                    IoTHubMessage_Destroy(compressedMessage);
+                }
                 LOG_ERROR;
-                free(newEntry);
             }
             else
             {
-                /*Codes_SRS_IOTHUBCLIENT_LL_02_013: [IoTHubClient_SendEventAsync shall add the DLIST waitingToSend a new record cloning the information from eventMessageHandle, eventConfirmationCallback, userContextCallback.]*/
-                if ((newEntry->messageHandle = IoTHubMessage_Clone(eventMessageHandle)) == NULL)
+
+                if (attach_ms_timesOutAfter(handleData, newEntry) != 0)
                 {
-                    /*Codes_SRS_IOTHUBCLIENT_LL_02_014: [If cloning and/or adding the information fails for any reason, IoTHubClient_LL_SendEventAsync shall fail and return IOTHUB_CLIENT_ERROR.] */
                     result = IOTHUB_CLIENT_ERROR;
-                    free(newEntry);
                     LOG_ERROR;
+                    if (compressedMessage != NULL)
+                    {
+                        IoTHubMessage_Destroy(compressedMessage);
+                    }
+                    releaseMessageEntry(handleData, newEntry);
                 }
                 else
                 {
-                    IOTHUB_CLIENT_LL_HANDLE_DATA* handleData = (IOTHUB_CLIENT_LL_HANDLE_DATA*)iotHubClientHandle;
-                    /*Codes_SRS_IOTHUBCLIENT_LL_02_013: [IoTHubClient_SendEventAsync shall add the DLIST waitingToSend a new record cloning the information from eventMessageHandle, eventConfirmationCallback, userContextCallback.]*/
-                    newEntry->callback = eventConfirmationCallback;
-                    newEntry->context = userContextCallback;
-                    DList_InsertTailList(&(handleData->waitingToSend), &(newEntry->entry));
-                    /*Codes_SRS_IOTHUBCLIENT_LL_02_015: [Otherwise IoTHubClient_LL_SendEventAsync shall succeed and return IOTHUB_CLIENT_OK.] */
-                    result = IOTHUB_CLIENT_OK;
+                    if (compressedMessage != NULL)
+                    {
+                        /*the compressed message replaces the clone*/
+                        newEntry->messageHandle = compressedMessage;
+                    }
+                    else if (takeOwnership)
+                    {
+                        /*Codes_SRS_IOTHUBCLIENT_LL_02_102: [ IoTHubClient_LL_SendEventAsyncTakeOwnership shall add to the DLIST waitingToSend a new record holding eventMessageHandle itself, without cloning it. ]*/
+                        newEntry->messageHandle = eventMessageHandle;
+                    }
+                    else
+                    {
+                        /*Codes_SRS_IOTHUBCLIENT_LL_02_013: [IoTHubClient_SendEventAsync shall add the DLIST waitingToSend a new record cloning the information from eventMessageHandle, eventConfirmationCallback, userContextCallback.]*/
+                        newEntry->messageHandle = IoTHubMessage_Clone(eventMessageHandle);
+                    }
+
+                    if (newEntry->messageHandle == NULL)
+                    {
+                        /*Codes_SRS_IOTHUBCLIENT_LL_02_014: [If cloning and/or adding the information fails for any reason, IoTHubClient_LL_SendEventAsync shall fail and return IOTHUB_CLIENT_ERROR.] */
+                        result = IOTHUB_CLIENT_ERROR;
+                        releaseMessageEntry(handleData, newEntry);
+                        LOG_ERROR;
+                    }
+                    else
+                    {
+                        /*Codes_SRS_IOTHUBCLIENT_LL_02_013: [IoTHubClient_SendEventAsync shall add the DLIST waitingToSend a new record cloning the information from eventMessageHandle, eventConfirmationCallback, userContextCallback.]*/
+                        newEntry->callback = eventConfirmationCallback;
+                        newEntry->context = userContextCallback;
+                        if ((handleData->messageStore != NULL) && (storeMessageEntry(handleData, newEntry, storeRecordId) != 0))
+                        {
+                            /*Codes_SRS_IOTHUBCLIENT_LL_02_125: [ If appending the message to the message store fails then IoTHubClient_LL_SendEventAsync shall fail and return IOTHUB_CLIENT_ERROR. ]*/
+                            result = IOTHUB_CLIENT_ERROR;
+                            if ((!takeOwnership) || (compressedMessage != NULL))
+                            {
+                                IoTHubMessage_Destroy(newEntry->messageHandle);
+                            }
+                            releaseMessageEntry(handleData, newEntry);
+                            LOG_ERROR;
+                        }
+                        else
+                        {
+                            newEntry->messageSize = messageSize;
+                            dropOldestMessages(handleData, messageSize);
+                            checkKnownTail(handleData);
+                            /*Codes_SRS_IOTHUBCLIENT_LL_02_098: [ IoTHubClient_LL_SendEventAsync shall keep track of whether waitingToSend is sorted by the messages' timeouts. ]*/
+                            if (handleData->waitingToSend.Flink == &(handleData->waitingToSend))
+                            {
+                                handleData->waitingToSendInTimeoutOrder = true;
+                            }
+                            else if (TIMEOUT_ORDER_KEY(newEntry->ms_timesOutAfter) < TIMEOUT_ORDER_KEY(containingRecord(handleData->waitingToSend.Blink, IOTHUB_MESSAGE_LIST, entry)->ms_timesOutAfter))
+                            {
+                                /*the message at the tail of waitingToSend times out later than this one*/
+                                handleData->waitingToSendInTimeoutOrder = false;
+                            }
+                            DList_InsertTailList(&(handleData->waitingToSend), &(newEntry->entry));
+                            handleData->knownTail = &(newEntry->entry);
+                            handleData->queuedCount++;
+                            handleData->queuedBytes += messageSize;
+                            if (takeOwnership && (compressedMessage != NULL))
+                            {
+                                /*Codes_SRS_IOTHUBCLIENT_LL_02_137: [ If IoTHubClient_LL_SendEventAsyncTakeOwnership queues a compressed message then it shall destroy eventMessageHandle. ]*/
+                                IoTHubMessage_Destroy(eventMessageHandle);
+                            }
+                            /*Codes_SRS_IOTHUBCLIENT_LL_02_015: [Otherwise IoTHubClient_LL_SendEventAsync shall succeed and return IOTHUB_CLIENT_OK.] */
+                            result = IOTHUB_CLIENT_OK;
+                        }
+                    }
                 }
             }
         }
@@ -660,6 +1175,29 @@ IOTHUB_CLIENT_RESULT IoTHubClient_LL_SendEventAsync(IOTHUB_CLIENT_LL_HANDLE iotH
     return result;
 }
 
+IOTHUB_CLIENT_RESULT IoTHubClient_LL_SendEventAsync(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, IOTHUB_MESSAGE_HANDLE eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void* userContextCallback)
+{
+    return SendEventAsync_Impl(iotHubClientHandle, eventMessageHandle, eventConfirmationCallback, userContextCallback, false, 0);
+}
+
+IOTHUB_CLIENT_RESULT IoTHubClient_LL_SendEventAsyncTakeOwnership(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, IOTHUB_MESSAGE_HANDLE eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void* userContextCallback)
+{
+    /*Codes_SRS_IOTHUBCLIENT_LL_02_101: [ IoTHubClient_LL_SendEventAsyncTakeOwnership shall validate its parameters the same way as IoTHubClient_LL_SendEventAsync does. ]*/
+    /*Codes_SRS_IOTHUBCLIENT_LL_02_103: [ If IoTHubClient_LL_SendEventAsyncTakeOwnership fails then the ownership of eventMessageHandle shall remain with the caller. ]*/
+    /*Codes_SRS_IOTHUBCLIENT_LL_02_104: [ Otherwise IoTHubClient_LL_SendEventAsyncTakeOwnership shall return IOTHUB_CLIENT_OK and IoTHubClient_LL shall destroy eventMessageHandle once its callback has been called. ]*/
+    return SendEventAsync_Impl(iotHubClientHandle, eventMessageHandle, eventConfirmationCallback, userContextCallback, true, 0);
+}
+
+static void replayStoredMessage(IOTHUB_MESSAGE_HANDLE messageHandle, uint64_t recordId, void* context)
+{
+    /*a message that cannot be queued now stays in the message store and is replayed by the next run*/
+    if (SendEventAsync_Impl((IOTHUB_CLIENT_LL_HANDLE)context, messageHandle, NULL, NULL, true, recordId) != IOTHUB_CLIENT_OK)
+    {
+        LogError("unable to queue the stored message %lu", (unsigned long)recordId);
+        IoTHubMessage_Destroy(messageHandle);
+    }
+}
+
 IOTHUB_CLIENT_RESULT IoTHubClient_LL_SetMessageCallback(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, IOTHUB_CLIENT_MESSAGE_CALLBACK_ASYNC messageCallback, void* userContextCallback)
 {
     IOTHUB_CLIENT_RESULT result;
@@ -711,7 +1249,13 @@ static void DoTimeouts(IOTHUB_CLIENT_LL_HANDLE_DATA* handleData)
     }
     else
     {
-        DLIST_ENTRY* currentItemInWaitingToSend = handleData->waitingToSend.Flink;
+        DLIST_ENTRY* currentItemInWaitingToSend;
+        bool stillInTimeoutOrder = true;
+        uint64_t previousTimeout = 0;
+
+        checkKnownTail(handleData);
+        currentItemInWaitingToSend = handleData->waitingToSend.Flink;
+
         while (currentItemInWaitingToSend != &(handleData->waitingToSend)) /*while we are not at the end of the list*/
         {
             IOTHUB_MESSAGE_LIST* fullEntry = containingRecord(currentItemInWaitingToSend, IOTHUB_MESSAGE_LIST, entry);
@@ -720,19 +1264,40 @@ static void DoTimeouts(IOTHUB_CLIENT_LL_HANDLE_DATA* handleData)
             {
                 PDLIST_ENTRY theNext = currentItemInWaitingToSend->Flink; /*need to save the next item, because the below operations are destructive*/
                 DList_RemoveEntryList(currentItemInWaitingToSend);
+                handleData->queuedCount--;
+                handleData->queuedBytes -= fullEntry->messageSize;
                 if (fullEntry->callback != NULL)
                 {
                     fullEntry->callback(IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT, fullEntry->context);
                 }
-                IoTHubMessage_Destroy(fullEntry->messageHandle); /*because it has been cloned*/
-                free(fullEntry);
+                IoTHubMessage_Destroy(fullEntry->messageHandle); /*because it is owned by IoTHubClient_LL (cloned or taken over)*/
+                releaseMessageEntry(handleData, fullEntry);
                 currentItemInWaitingToSend = theNext;
             }
+            else if (handleData->waitingToSendInTimeoutOrder)
+            {
+                /*Codes_SRS_IOTHUBCLIENT_LL_02_099: [ If waitingToSend is sorted by the messages' timeouts then IoTHubClient_LL_DoWork shall stop looking for timed out messages at the first message that has not timed out. ]*/
+                break;
+            }
             else
             {
+                /*Codes_SRS_IOTHUBCLIENT_LL_02_100: [ Otherwise IoTHubClient_LL_DoWork shall inspect all the messages in waitingToSend and shall remember if the remaining ones are sorted by their timeouts. ]*/
+                uint64_t currentTimeout = TIMEOUT_ORDER_KEY(fullEntry->ms_timesOutAfter);
+                if (currentTimeout < previousTimeout)
+                {
+                    stillInTimeoutOrder = false;
+                }
+                previousTimeout = currentTimeout;
                 currentItemInWaitingToSend = currentItemInWaitingToSend->Flink;
             }
         }
+
+        if ((!handleData->waitingToSendInTimeoutOrder) && stillInTimeoutOrder)
+        {
+            handleData->waitingToSendInTimeoutOrder = true;
+        }
+        /*timed out messages might have been removed from the tail*/
+        handleData->knownTail = handleData->waitingToSend.Blink;
     }
 }
 
@@ -744,6 +1309,12 @@ void IoTHubClient_LL_DoWork(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle)
         IOTHUB_CLIENT_LL_HANDLE_DATA* handleData = (IOTHUB_CLIENT_LL_HANDLE_DATA*)iotHubClientHandle;
         DoTimeouts(handleData);
 
+        /*Codes_SRS_IOTHUBCLIENT_LL_02_128: [ If a message store is set then IoTHubClient_LL_DoWork shall flush it before invoking the underlaying layer's _DoWork function. ]*/
+        if ((handleData->messageStore != NULL) && (IoTHubClient_LL_MessageStore_Flush(handleData->messageStore) != 0))
+        {
+            LogError("unable to flush the message store");
+        }
+
         /*Codes_SRS_IOTHUBCLIENT_LL_02_021: [Otherwise, IoTHubClient_LL_DoWork shall invoke the underlaying layer's _DoWork function.]*/
         handleData->IoTHubTransport_DoWork(handleData->transportHandle, iotHubClientHandle);
     }
@@ -771,6 +1342,32 @@ IOTHUB_CLIENT_RESULT IoTHubClient_LL_GetSendStatus(IOTHUB_CLIENT_LL_HANDLE iotHu
     return result;
 }
 
+IOTHUB_CLIENT_RESULT IoTHubClient_LL_GetSendQueueStats(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, IOTHUB_CLIENT_SEND_QUEUE_STATS* stats)
+{
+    IOTHUB_CLIENT_RESULT result;
+
+    /*Codes_SRS_IOTHUBCLIENT_LL_02_118: [ If iotHubClientHandle or stats is NULL then IoTHubClient_LL_GetSendQueueStats shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+    if (iotHubClientHandle == NULL || stats == NULL)
+    {
+        result = IOTHUB_CLIENT_INVALID_ARG;
+        LOG_ERROR;
+    }
+    else
+    {
+        IOTHUB_CLIENT_LL_HANDLE_DATA* handleData = (IOTHUB_CLIENT_LL_HANDLE_DATA*)iotHubClientHandle;
+
+        /*Codes_SRS_IOTHUBCLIENT_LL_02_119: [ Otherwise IoTHubClient_LL_GetSendQueueStats shall fill stats with the number and the bytes of the messages in waitingToSend, how many messages have been dropped and how many sends have been refused because the queue was full, and shall return IOTHUB_CLIENT_OK. ]*/
+        recountQueue(handleData);
+        stats->messageCount = handleData->queuedCount;
+        stats->byteCount = handleData->queuedBytes;
+        stats->droppedCount = handleData->droppedCount;
+        stats->rejectedCount = handleData->rejectedCount;
+        result = IOTHUB_CLIENT_OK;
+    }
+
+    return result;
+}
+
 void IoTHubClient_LL_SendComplete(IOTHUB_CLIENT_LL_HANDLE handle, PDLIST_ENTRY completed, IOTHUB_BATCHSTATE_RESULT result)
 {
     /*Codes_SRS_IOTHUBCLIENT_LL_02_022: [If parameter completed is NULL, or parameter handle is NULL then IoTHubClient_LL_SendBatch shall return.]*/
@@ -786,6 +1383,7 @@ void IoTHubClient_LL_SendComplete(IOTHUB_CLIENT_LL_HANDLE handle, PDLIST_ENTRY c
     {
         /*Codes_SRS_IOTHUBCLIENT_LL_02_027: [If parameter result is IOTHUB_BACTHSTATE_FAILED then IoTHubClient_LL_SendComplete shall call all the non-NULL callbacks with the result parameter set to IOTHUB_CLIENT_CONFIRMATION_ERROR and the context set to the context passed originally in the SendEventAsync call.] */
         /*Codes_SRS_IOTHUBCLIENT_LL_02_025: [If parameter result is IOTHUB_BATCHSTATE_SUCCESS then IoTHubClient_LL_SendComplete shall call all the non-NULL callbacks with the result parameter set to IOTHUB_CLIENT_CONFIRMATION_OK and the context set to the context passed originally in the SendEventAsync call.]*/
+        IOTHUB_CLIENT_LL_HANDLE_DATA* handleData = (IOTHUB_CLIENT_LL_HANDLE_DATA*)handle;
         IOTHUB_CLIENT_CONFIRMATION_RESULT resultToBeCalled = (result == IOTHUB_BATCHSTATE_SUCCESS) ? IOTHUB_CLIENT_CONFIRMATION_OK : IOTHUB_CLIENT_CONFIRMATION_ERROR;
         PDLIST_ENTRY oldest;
         while ((oldest = DList_RemoveHeadList(completed)) != completed)
@@ -797,7 +1395,7 @@ void IoTHubClient_LL_SendComplete(IOTHUB_CLIENT_LL_HANDLE handle, PDLIST_ENTRY c
                 messageList->callback(resultToBeCalled, messageList->context);
             }
             IoTHubMessage_Destroy(messageList->messageHandle);
-            free(messageList);
+            releaseMessageEntry(handleData, messageList);
         }
     }
 }
@@ -893,6 +1491,115 @@ IOTHUB_CLIENT_RESULT IoTHubClient_LL_SetOption(IOTHUB_CLIENT_LL_HANDLE iotHubCli
             handleData->currentMessageTimeout = *(const uint64_t*)value;
             result = IOTHUB_CLIENT_OK;
         }
+        /*Codes_SRS_IOTHUBCLIENT_LL_02_105: [ "messagePoolSize" - IoTHubClient_LL shall keep up to `*value` released IOTHUB_MESSAGE_LIST for reuse by the next messages. value is a pointer to a size_t. ]*/
+        else if (strcmp(optionName, "messagePoolSize") == 0)
+        {
+            /*this is an option handled by IoTHubClient_LL*/
+            handleData->messagePoolSize = *(const size_t*)value;
+            /*Codes_SRS_IOTHUBCLIENT_LL_02_109: [ Lowering "messagePoolSize" shall free the IOTHUB_MESSAGE_LIST that are kept beyond the new value. ]*/
+            trimMessageEntries(handleData);
+            result = IOTHUB_CLIENT_OK;
+        }
+        /*Codes_SRS_IOTHUBCLIENT_LL_02_111: [ "messageQueueMaxCount" - IoTHubClient_LL_SendEventAsync shall not let more than `*value` messages wait to be sent. 0 means no limit. value is a pointer to a size_t. ]*/
+        else if (strcmp(optionName, "messageQueueMaxCount") == 0)
+        {
+            /*this is an option handled by IoTHubClient_LL*/
+            handleData->messageQueueMaxCount = *(const size_t*)value;
+            result = IOTHUB_CLIENT_OK;
+        }
+        /*Codes_SRS_IOTHUBCLIENT_LL_02_112: [ "messageQueueMaxBytes" - IoTHubClient_LL_SendEventAsync shall not let messages having more than `*value` payload bytes in total wait to be sent. 0 means no limit. value is a pointer to a size_t. ]*/
+        else if (strcmp(optionName, "messageQueueMaxBytes") == 0)
+        {
+            /*this is an option handled by IoTHubClient_LL*/
+            handleData->messageQueueMaxBytes = *(const size_t*)value;
+            result = IOTHUB_CLIENT_OK;
+        }
+        /*Codes_SRS_IOTHUBCLIENT_LL_02_113: [ "messageQueueFullPolicy" - sets what IoTHubClient_LL_SendEventAsync does when a limit would be exceeded. value is a pointer to a IOTHUB_CLIENT_QUEUE_FULL_POLICY. ]*/
+        else if (strcmp(optionName, "messageQueueFullPolicy") == 0)
+        {
+            /*this is an option handled by IoTHubClient_LL*/
+            IOTHUB_CLIENT_QUEUE_FULL_POLICY policy = *(const IOTHUB_CLIENT_QUEUE_FULL_POLICY*)value;
+            if (
+                (policy != IOTHUB_CLIENT_QUEUE_FULL_REJECT) &&
+                (policy != IOTHUB_CLIENT_QUEUE_FULL_DROP_OLDEST) &&
+                (policy != IOTHUB_CLIENT_QUEUE_FULL_BLOCK)
+                )
+            {
+                /*Codes_SRS_IOTHUBCLIENT_LL_02_114: [ If the value of "messageQueueFullPolicy" is not a IOTHUB_CLIENT_QUEUE_FULL_POLICY then IoTHubClient_LL_SetOption shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+                result = IOTHUB_CLIENT_INVALID_ARG;
+                LogError("invalid messageQueueFullPolicy");
+            }
+            else
+            {
+                handleData->messageQueueFullPolicy = policy;
+                result = IOTHUB_CLIENT_OK;
+            }
+        }
+        /*Codes_SRS_IOTHUBCLIENT_LL_02_131: [ "compression" - sets how IoTHubClient_LL_SendEventAsync compresses the payload of the messages. value is a pointer to a IOTHUB_CLIENT_COMPRESSION. ]*/
+        else if (strcmp(optionName, "compression") == 0)
+        {
+            /*this is an option handled by IoTHubClient_LL*/
+            IOTHUB_CLIENT_COMPRESSION compression = *(const IOTHUB_CLIENT_COMPRESSION*)value;
+            if (
+                (compression != IOTHUB_CLIENT_COMPRESSION_NONE) &&
+                (compression != IOTHUB_CLIENT_COMPRESSION_LZ4)
+                )
+            {
+                /*Codes_SRS_IOTHUBCLIENT_LL_02_132: [ If the value of "compression" is not a IOTHUB_CLIENT_COMPRESSION then IoTHubClient_LL_SetOption shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+                result = IOTHUB_CLIENT_INVALID_ARG;
+                LogError("invalid compression");
+            }
+            else
+            {
+                handleData->compression = compression;
+                result = IOTHUB_CLIENT_OK;
+            }
+        }
+        /*Codes_SRS_IOTHUBCLIENT_LL_02_133: [ "compressionThreshold" - IoTHubClient_LL_SendEventAsync shall not compress payloads shorter than `*value` bytes. value is a pointer to a size_t. ]*/
+        else if (strcmp(optionName, "compressionThreshold") == 0)
+        {
+            /*this is an option handled by IoTHubClient_LL*/
+            handleData->compressionThreshold = *(const size_t*)value;
+            result = IOTHUB_CLIENT_OK;
+        }
+        /*Codes_SRS_IOTHUBCLIENT_LL_02_120: [ "messageStorePath" - IoTHubClient_LL shall keep the messages given to IoTHubClient_LL_SendEventAsync in a message store at the path `value` until they are confirmed. value is a const char*. ]*/
+        else if (strcmp(optionName, "messageStorePath") == 0)
+        {
+            /*this is an option handled by IoTHubClient_LL*/
+            if (handleData->messageStore != NULL)
+            {
+                /*Codes_SRS_IOTHUBCLIENT_LL_02_121: [ If a message store is already set then IoTHubClient_LL_SetOption shall return IOTHUB_CLIENT_ERROR. ]*/
+                result = IOTHUB_CLIENT_ERROR;
+                LogError("a message store is already set");
+            }
+            else if ((handleData->messageStore = IoTHubClient_LL_MessageStore_Create((const char*)value)) == NULL)
+            {
+                /*Codes_SRS_IOTHUBCLIENT_LL_02_122: [ If creating the message store fails then IoTHubClient_LL_SetOption shall return IOTHUB_CLIENT_ERROR. ]*/
+                result = IOTHUB_CLIENT_ERROR;
+                LogError("unable to create the message store");
+            }
+            else
+            {
+                /*Codes_SRS_IOTHUBCLIENT_LL_02_123: [ IoTHubClient_LL_SetOption shall queue the messages left in the message store by a previous run as if they were given to IoTHubClient_LL_SendEventAsyncTakeOwnership with no callback. ]*/
+                if (IoTHubClient_LL_MessageStore_Replay(handleData->messageStore, replayStoredMessage, handleData) != 0)
+                {
+                    LogError("some stored messages could not be replayed");
+                }
+                result = IOTHUB_CLIENT_OK;
+            }
+        }
+#ifndef DONT_USE_UPLOADTOBLOB
+        /*Codes_SRS_IOTHUBCLIENT_LL_02_138: [ "blobUploadConcurrency" - IoTHubClient_LL_UploadToBlob shall upload up to `*value` blocks of a blob at the same time, each on its own connection. value is a pointer to a size_t. ]*/
+        else if (strcmp(optionName, "blobUploadConcurrency") == 0)
+        {
+            /*this is an option handled by IoTHubClient_LL_UploadToBlob*/
+            result = IoTHubClient_LL_UploadToBlob_SetOption(handleData->uploadToBlobHandle, optionName, value);
+            if (result != IOTHUB_CLIENT_OK)
+            {
+                LogError("unable to IoTHubClient_LL_UploadToBlob_SetOption");
+            }
+        }
+#endif /*DONT_USE_UPLOADTOBLOB*/
         else
         {
             /*Codes_SRS_IOTHUBCLIENT_LL_02_038: [Otherwise, IoTHubClient_LL shall call the function _SetOption of the underlying transport and return what that function is returning.] */
@@ -929,4 +1636,165 @@ IOTHUB_CLIENT_RESULT IoTHubClient_LL_UploadToBlob(IOTHUB_CLIENT_LL_HANDLE iotHub
     }
     return result;
 }
+
+IOTHUB_CLIENT_RESULT IoTHubClient_LL_UploadToBlobFromReader(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, const char* destinationFileName, IOTHUB_CLIENT_FILE_UPLOAD_READ_CALLBACK getData, void* context)
+{
+    IOTHUB_CLIENT_RESULT result;
+    /*Codes_SRS_IOTHUBCLIENT_LL_02_145: [ If iotHubClientHandle, destinationFileName or getData is NULL then IoTHubClient_LL_UploadToBlobFromReader shall fail and return IOTHUB_CLIENT_INVALID_ARG. ]*/
+    if (
+        (iotHubClientHandle == NULL) ||
+        (destinationFileName == NULL) ||
+        (getData == NULL)
+        )
+    {
+        LogError("invalid parameters IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle=%p, const char* destinationFileName=%s, IOTHUB_CLIENT_FILE_UPLOAD_READ_CALLBACK getData=%p", iotHubClientHandle, destinationFileName, getData);
+        result = IOTHUB_CLIENT_INVALID_ARG;
+    }
+    else
+    {
+        /*Codes_SRS_IOTHUBCLIENT_LL_02_146: [ IoTHubClient_LL_UploadToBlobFromReader shall call IoTHubClient_LL_UploadToBlobFromReader_Impl passing getData and context and return what IoTHubClient_LL_UploadToBlobFromReader_Impl returns. ]*/
+        result = IoTHubClient_LL_UploadToBlobFromReader_Impl(iotHubClientHandle->uploadToBlobHandle, destinationFileName, getData, context);
+    }
+    return result;
+}
+
+static int readFromFile(void* context, unsigned char* buffer, size_t bufferSize, size_t* bytesRead)
+{
+    int result;
+    FILE* file = (FILE*)context;
+    *bytesRead = fread(buffer, 1, bufferSize, file);
+    if ((*bytesRead < bufferSize) && ferror(file))
+    {
+        LogError("unable to fread");
+        result = __LINE__;
+    }
+    else
+    {
+        result = 0;
+    }
+    return result;
+}
+
+#define FILE_HASH_LENGTH 16 /*a 64 bit FNV-1a hash in hexadecimal*/
+#define FILE_HASH_READ_SIZE 512
+
+/*writes to hash the FNV-1a hash of the content of file, read from the start, and returns 0. The file is left positioned at its start*/
+static int hashFile(FILE* file, char hash[FILE_HASH_LENGTH + 1])
+{
+    int result;
+    unsigned char buffer[FILE_HASH_READ_SIZE];
+    unsigned long long value = 14695981039346656037ULL; /*the FNV offset basis*/
+    size_t bytesRead;
+    while ((bytesRead = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    {
+        size_t i;
+        for (i = 0; i < bytesRead; i++)
+        {
+            value ^= buffer[i];
+            value *= 1099511628211ULL; /*the FNV prime*/
+        }
+    }
+
+    if (ferror(file) || (fseek(file, 0, SEEK_SET) != 0))
+    {
+        LogError("unable to read the file");
+        result = __LINE__;
+    }
+    else
+    {
+        (void)snprintf(hash, FILE_HASH_LENGTH + 1, "%016llx", value);
+        result = 0;
+    }
+    return result;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubClient_LL_UploadToBlobFromFile(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, const char* destinationFileName, const char* sourceFileName)
+{
+    IOTHUB_CLIENT_RESULT result;
+    /*Codes_SRS_IOTHUBCLIENT_LL_02_147: [ If iotHubClientHandle, destinationFileName or sourceFileName is NULL then IoTHubClient_LL_UploadToBlobFromFile shall fail and return IOTHUB_CLIENT_INVALID_ARG. ]*/
+    if (
+        (iotHubClientHandle == NULL) ||
+        (destinationFileName == NULL) ||
+        (sourceFileName == NULL)
+        )
+    {
+        LogError("invalid parameters IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle=%p, const char* destinationFileName=%s, const char* sourceFileName=%s", iotHubClientHandle, destinationFileName, sourceFileName);
+        result = IOTHUB_CLIENT_INVALID_ARG;
+    }
+    else
+    {
+        FILE* file = fopen(sourceFileName, "rb");
+        if (file == NULL)
+        {
+            /*Codes_SRS_IOTHUBCLIENT_LL_02_148: [ If sourceFileName cannot be opened for reading then IoTHubClient_LL_UploadToBlobFromFile shall fail and return IOTHUB_CLIENT_ERROR. ]*/
+            LogError("unable to open %s", sourceFileName);
+            result = IOTHUB_CLIENT_ERROR;
+        }
+        else
+        {
+            /*Codes_SRS_IOTHUBCLIENT_LL_02_149: [ IoTHubClient_LL_UploadToBlobFromFile shall call IoTHubClient_LL_UploadToBlobFromReader_Impl with a getData that reads the file sequentially and return what IoTHubClient_LL_UploadToBlobFromReader_Impl returns. If reading the file fails then the upload shall fail. ]*/
+            result = IoTHubClient_LL_UploadToBlobFromReader_Impl(iotHubClientHandle->uploadToBlobHandle, destinationFileName, readFromFile, file);
+
+            /*Codes_SRS_IOTHUBCLIENT_LL_02_150: [ IoTHubClient_LL_UploadToBlobFromFile shall close the file before returning. ]*/
+            (void)fclose(file);
+        }
+    }
+    return result;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubClient_LL_UploadToBlobFromFileResumable(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, const char* destinationFileName, const char* sourceFileName, const char* manifestFileName)
+{
+    IOTHUB_CLIENT_RESULT result;
+    /*Codes_SRS_IOTHUBCLIENT_LL_02_157: [ If iotHubClientHandle, destinationFileName, sourceFileName or manifestFileName is NULL then IoTHubClient_LL_UploadToBlobFromFileResumable shall fail and return IOTHUB_CLIENT_INVALID_ARG. ]*/
+    if (
+        (iotHubClientHandle == NULL) ||
+        (destinationFileName == NULL) ||
+        (sourceFileName == NULL) ||
+        (manifestFileName == NULL)
+        )
+    {
+        LogError("invalid parameters IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle=%p, const char* destinationFileName=%s, const char* sourceFileName=%s, const char* manifestFileName=%s", iotHubClientHandle, destinationFileName, sourceFileName, manifestFileName);
+        result = IOTHUB_CLIENT_INVALID_ARG;
+    }
+    else
+    {
+        FILE* file = fopen(sourceFileName, "rb");
+        if (file == NULL)
+        {
+            /*Codes_SRS_IOTHUBCLIENT_LL_02_158: [ If sourceFileName cannot be opened for reading or its size cannot be determined then IoTHubClient_LL_UploadToBlobFromFileResumable shall fail and return IOTHUB_CLIENT_ERROR. ]*/
+            LogError("unable to open %s", sourceFileName);
+            result = IOTHUB_CLIENT_ERROR;
+        }
+        else
+        {
+            long fileSize;
+            if ((fseek(file, 0, SEEK_END) != 0) || ((fileSize = ftell(file)) < 0) || (fseek(file, 0, SEEK_SET) != 0))
+            {
+                /*Codes_SRS_IOTHUBCLIENT_LL_02_158: [ If sourceFileName cannot be opened for reading or its size cannot be determined then IoTHubClient_LL_UploadToBlobFromFileResumable shall fail and return IOTHUB_CLIENT_ERROR. ]*/
+                LogError("unable to get the size of %s", sourceFileName);
+                result = IOTHUB_CLIENT_ERROR;
+            }
+            else
+            {
+                /*the blocks recorded in the manifest are only reused if the content has not changed since*/
+                char sourceVersion[FILE_HASH_LENGTH + 1];
+                /*Codes_SRS_IOTHUBCLIENT_LL_02_174: [ IoTHubClient_LL_UploadToBlobFromFileResumable shall read the file once to compute the 64 bit FNV-1a hash of its content, written as 16 lowercase hexadecimal digits. If reading the file fails then IoTHubClient_LL_UploadToBlobFromFileResumable shall fail and return IOTHUB_CLIENT_ERROR. ]*/
+                if (hashFile(file, sourceVersion) != 0)
+                {
+                    LogError("unable to hash %s", sourceFileName);
+                    result = IOTHUB_CLIENT_ERROR;
+                }
+                else
+                {
+                    /*Codes_SRS_IOTHUBCLIENT_LL_02_159: [ IoTHubClient_LL_UploadToBlobFromFileResumable shall call IoTHubClient_LL_UploadToBlobFromReaderResumable_Impl with a getData that reads the file sequentially from its start, the size of the file, the hash as sourceVersion and manifestFileName and return what IoTHubClient_LL_UploadToBlobFromReaderResumable_Impl returns. ]*/
+                    result = IoTHubClient_LL_UploadToBlobFromReaderResumable_Impl(iotHubClientHandle->uploadToBlobHandle, destinationFileName, readFromFile, file, (size_t)fileSize, sourceVersion, manifestFileName);
+                }
+            }
+
+            /*Codes_SRS_IOTHUBCLIENT_LL_02_160: [ IoTHubClient_LL_UploadToBlobFromFileResumable shall close the file before returning. ]*/
+            (void)fclose(file);
+        }
+    }
+    return result;
+}
 #endif
@@ -0,0 +1,939 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#ifdef _CRTDBG_MAP_ALLOC
+#include <crtdbg.h>
+#endif
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/iot_logging.h"
+#include "azure_c_shared_utility/map.h"
+
+#include "iothub_client_ll_messagestore.h"
+
+/*a record is: magic (4 bytes), type (1 byte), recordId (8 bytes), payload size (4 bytes), payload, crc32 (4 bytes) of everything after the magic. All integers are little endian.*/
+#define RECORD_MAGIC 0x534D4849 /*"IHMS"*/
+#define RECORD_TYPE_MESSAGE 1
+#define RECORD_TYPE_DONE 2
+#define RECORD_HEADER_SIZE (4 + 1 + 8 + 4)
+#define RECORD_TRAILER_SIZE 4
+
+/*in a MESSAGE payload strings are stored with their '\0' so they can be used in place, ABSENT_STRING is the length of a NULL string*/
+#define ABSENT_STRING 0xFFFFFFFF
+
+/*the log is compacted at runtime once it holds at least these many DONE records and they outnumber the pending messages*/
+#define COMPACTION_MIN_DONE_RECORDS 1024
+
+static const char TEMPORARY_SUFFIX[] = ".tmp";
+
+typedef struct IOTHUB_CLIENT_LL_MESSAGESTORE_HANDLE_DATA_TAG
+{
+    char* path;
+    char* temporaryPath; /*compaction writes the new log here, then renames it over path*/
+    FILE* log;
+    uint64_t nextRecordId;
+    size_t pendingCount; /*MESSAGE records that are not DONE*/
+    size_t doneCount; /*DONE records in the log*/
+    bool unflushed;
+}IOTHUB_CLIENT_LL_MESSAGESTORE_HANDLE_DATA;
+
+/*a MESSAGE record as found in the log*/
+typedef struct STORED_RECORD_TAG
+{
+    uint64_t recordId;
+    const unsigned char* record;
+    size_t recordSize;
+    const unsigned char* payload;
+    size_t payloadSize;
+    bool isDone;
+}STORED_RECORD;
+
+typedef struct MESSAGE_PARTS_TAG
+{
+    unsigned char contentType;
+    const unsigned char* body;
+    size_t bodySize;
+    const char* messageId;
+    const char* correlationId;
+    const char* const* keys;
+    const char* const* values;
+    size_t propertyCount;
+}MESSAGE_PARTS;
+
+typedef struct PAYLOAD_READER_TAG
+{
+    const unsigned char* current;
+    size_t remaining;
+    bool failed;
+}PAYLOAD_READER;
+
+static uint32_t computeCrc32(const unsigned char* data, size_t size)
+{
+    uint32_t crc = 0xFFFFFFFF;
+    size_t i;
+    for (i = 0; i < size; i++)
+    {
+        int bit;
+        crc ^= data[i];
+        for (bit = 0; bit < 8; bit++)
+        {
+            crc = (crc & 1) ? ((crc >> 1) ^ 0xEDB88320) : (crc >> 1);
+        }
+    }
+    return ~crc;
+}
+
+static unsigned char* putUint32(unsigned char* destination, uint32_t value)
+{
+    int i;
+    for (i = 0; i < 4; i++)
+    {
+        destination[i] = (unsigned char)(value >> (8 * i));
+    }
+    return destination + 4;
+}
+
+static unsigned char* putUint64(unsigned char* destination, uint64_t value)
+{
+    int i;
+    for (i = 0; i < 8; i++)
+    {
+        destination[i] = (unsigned char)(value >> (8 * i));
+    }
+    return destination + 8;
+}
+
+static uint32_t getUint32(const unsigned char* source)
+{
+    uint32_t result = 0;
+    int i;
+    for (i = 3; i >= 0; i--)
+    {
+        result = (result << 8) | source[i];
+    }
+    return result;
+}
+
+static uint64_t getUint64(const unsigned char* source)
+{
+    uint64_t result = 0;
+    int i;
+    for (i = 7; i >= 0; i--)
+    {
+        result = (result << 8) | source[i];
+    }
+    return result;
+}
+
+static unsigned char* putString(unsigned char* destination, const char* source)
+{
+    unsigned char* result;
+    if (source == NULL)
+    {
+        result = putUint32(destination, ABSENT_STRING);
+    }
+    else
+    {
+        size_t size = strlen(source) + 1;
+        result = putUint32(destination, (uint32_t)size);
+        (void)memcpy(result, source, size);
+        result += size;
+    }
+    return result;
+}
+
+static size_t getStringSize(const char* source)
+{
+    return 4 + ((source == NULL) ? 0 : (strlen(source) + 1));
+}
+
+static const unsigned char* readBytes(PAYLOAD_READER* reader, size_t size)
+{
+    const unsigned char* result;
+    if (reader->failed || (reader->remaining < size))
+    {
+        reader->failed = true;
+        result = NULL;
+    }
+    else
+    {
+        result = reader->current;
+        reader->current += size;
+        reader->remaining -= size;
+    }
+    return result;
+}
+
+static uint32_t readUint32(PAYLOAD_READER* reader)
+{
+    const unsigned char* source = readBytes(reader, 4);
+    return (source == NULL) ? 0 : getUint32(source);
+}
+
+static const char* readString(PAYLOAD_READER* reader)
+{
+    const char* result;
+    uint32_t size = readUint32(reader);
+    if (reader->failed || (size == ABSENT_STRING))
+    {
+        result = NULL;
+    }
+    else if ((size == 0) || ((result = (const char*)readBytes(reader, size)) == NULL) || (result[size - 1] != '\0'))
+    {
+        reader->failed = true;
+        result = NULL;
+    }
+    else
+    {
+        /*result points into the payload*/
+    }
+    return result;
+}
+
+static int getMessageParts(IOTHUB_MESSAGE_HANDLE messageHandle, MESSAGE_PARTS* parts)
+{
+    int result;
+    IOTHUBMESSAGE_CONTENT_TYPE contentType = IoTHubMessage_GetContentType(messageHandle);
+    MAP_HANDLE properties;
+    if (contentType == IOTHUBMESSAGE_BYTEARRAY)
+    {
+        if (IoTHubMessage_GetByteArray(messageHandle, &parts->body, &parts->bodySize) != IOTHUB_MESSAGE_OK)
+        {
+            LogError("unable to IoTHubMessage_GetByteArray");
+            result = __LINE__;
+        }
+        else
+        {
+            result = 0;
+        }
+    }
+    else if (contentType == IOTHUBMESSAGE_STRING)
+    {
+        const char* text = IoTHubMessage_GetString(messageHandle);
+        if (text == NULL)
+        {
+            LogError("unable to IoTHubMessage_GetString");
+            result = __LINE__;
+        }
+        else
+        {
+            parts->body = (const unsigned char*)text;
+            parts->bodySize = strlen(text) + 1;
+            result = 0;
+        }
+    }
+    else
+    {
+        LogError("unknown message content type");
+        result = __LINE__;
+    }
+
+    if (result != 0)
+    {
+        /*already logged*/
+    }
+    else if (parts->bodySize >= ABSENT_STRING)
+    {
+        LogError("message too big to be stored");
+        result = __LINE__;
+    }
+    else if ((properties = IoTHubMessage_Properties(messageHandle)) == NULL)
+    {
+        LogError("unable to IoTHubMessage_Properties");
+        result = __LINE__;
+    }
+    else if (Map_GetInternals(properties, &parts->keys, &parts->values, &parts->propertyCount) != MAP_OK)
+    {
+        LogError("unable to Map_GetInternals");
+        result = __LINE__;
+    }
+    else
+    {
+        parts->contentType = (unsigned char)contentType;
+        parts->messageId = IoTHubMessage_GetMessageId(messageHandle);
+        parts->correlationId = IoTHubMessage_GetCorrelationId(messageHandle);
+        result = 0;
+    }
+    return result;
+}
+
+static size_t getMessagePayloadSize(const MESSAGE_PARTS* parts)
+{
+    size_t result = 1 + 4 + parts->bodySize + getStringSize(parts->messageId) + getStringSize(parts->correlationId) + 4;
+    size_t i;
+    for (i = 0; i < parts->propertyCount; i++)
+    {
+        result += getStringSize(parts->keys[i]) + getStringSize(parts->values[i]);
+    }
+    return result;
+}
+
+static unsigned char* putMessagePayload(unsigned char* destination, const MESSAGE_PARTS* parts)
+{
+    size_t i;
+    *destination++ = parts->contentType;
+    destination = putUint32(destination, (uint32_t)parts->bodySize);
+    (void)memcpy(destination, parts->body, parts->bodySize);
+    destination += parts->bodySize;
+    destination = putString(destination, parts->messageId);
+    destination = putString(destination, parts->correlationId);
+    destination = putUint32(destination, (uint32_t)parts->propertyCount);
+    for (i = 0; i < parts->propertyCount; i++)
+    {
+        destination = putString(destination, parts->keys[i]);
+        destination = putString(destination, parts->values[i]);
+    }
+    return destination;
+}
+
+static IOTHUB_MESSAGE_HANDLE createMessageFromPayload(const unsigned char* payload, size_t payloadSize)
+{
+    IOTHUB_MESSAGE_HANDLE result;
+    PAYLOAD_READER reader;
+    const unsigned char* contentType;
+    uint32_t bodySize;
+    const unsigned char* body;
+    const char* messageId;
+    const char* correlationId;
+    uint32_t propertyCount;
+
+    reader.current = payload;
+    reader.remaining = payloadSize;
+    reader.failed = false;
+
+    contentType = readBytes(&reader, 1);
+    bodySize = readUint32(&reader);
+    body = readBytes(&reader, bodySize);
+    messageId = readString(&reader);
+    correlationId = readString(&reader);
+    propertyCount = readUint32(&reader);
+
+    if (reader.failed)
+    {
+        LogError("malformed message record");
+        result = NULL;
+    }
+    else
+    {
+        if (*contentType == IOTHUBMESSAGE_BYTEARRAY)
+        {
+            result = IoTHubMessage_CreateFromByteArray(body, bodySize);
+        }
+        else if ((*contentType == IOTHUBMESSAGE_STRING) && (bodySize > 0) && (body[bodySize - 1] == '\0'))
+        {
+            result = IoTHubMessage_CreateFromString((const char*)body);
+        }
+        else
+        {
+            LogError("malformed message body");
+            result = NULL;
+        }
+
+        if (result == NULL)
+        {
+            LogError("unable to create the message");
+        }
+        else if (
+            ((messageId != NULL) && (IoTHubMessage_SetMessageId(result, messageId) != IOTHUB_MESSAGE_OK)) ||
+            ((correlationId != NULL) && (IoTHubMessage_SetCorrelationId(result, correlationId) != IOTHUB_MESSAGE_OK))
+            )
+        {
+            LogError("unable to set the message ids");
+            IoTHubMessage_Destroy(result);
+            result = NULL;
+        }
+        else
+        {
+            MAP_HANDLE properties = IoTHubMessage_Properties(result);
+            uint32_t i;
+            for (i = 0; i < propertyCount; i++)
+            {
+                const char* key = readString(&reader);
+                const char* value = readString(&reader);
+                if ((key == NULL) || (value == NULL) || (properties == NULL) || (Map_AddOrUpdate(properties, key, value) != MAP_OK))
+                {
+                    break;
+                }
+            }
+
+            if (i != propertyCount)
+            {
+                LogError("unable to restore the message properties");
+                IoTHubMessage_Destroy(result);
+                result = NULL;
+            }
+        }
+    }
+    return result;
+}
+
+/*appends a record to the log. parts is NULL for DONE records*/
+static int writeRecord(IOTHUB_CLIENT_LL_MESSAGESTORE_HANDLE_DATA* handleData, unsigned char type, uint64_t recordId, const MESSAGE_PARTS* parts)
+{
+    int result;
+    unsigned char doneRecord[RECORD_HEADER_SIZE + RECORD_TRAILER_SIZE];
+    size_t payloadSize = (parts == NULL) ? 0 : getMessagePayloadSize(parts);
+    size_t recordSize = RECORD_HEADER_SIZE + payloadSize + RECORD_TRAILER_SIZE;
+    unsigned char* record = (parts == NULL) ? doneRecord : (unsigned char*)malloc(recordSize);
+    if (handleData->log == NULL)
+    {
+        LogError("the log is not open");
+        result = __LINE__;
+    }
+    else if (record == NULL)
+    {
+        LogError("unable to malloc");
+        result = __LINE__;
+    }
+    else
+    {
+        unsigned char* current = putUint32(record, RECORD_MAGIC);
+        *current++ = type;
+        current = putUint64(current, recordId);
+        current = putUint32(current, (uint32_t)payloadSize);
+        if (parts != NULL)
+        {
+            current = putMessagePayload(current, parts);
+        }
+        (void)putUint32(current, computeCrc32(record + 4, RECORD_HEADER_SIZE - 4 + payloadSize));
+
+        /*a single fwrite per record: a crash can only tear the last record of the log*/
+        if (fwrite(record, 1, recordSize, handleData->log) != recordSize)
+        {
+            LogError("unable to write to the log");
+            result = __LINE__;
+        }
+        else
+        {
+            handleData->unflushed = true;
+            result = 0;
+        }
+    }
+
+    if ((record != NULL) && (record != doneRecord))
+    {
+        free(record);
+    }
+    return result;
+}
+
+static int findRecord(const STORED_RECORD* records, size_t recordCount, uint64_t recordId, size_t* index)
+{
+    /*MESSAGE records are appended with increasing recordIds*/
+    size_t low = 0;
+    size_t high = recordCount;
+    while (low < high)
+    {
+        size_t middle = low + (high - low) / 2;
+        if (records[middle].recordId < recordId)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    if ((low < recordCount) && (records[low].recordId == recordId))
+    {
+        *index = low;
+        return 0;
+    }
+    else
+    {
+        return __LINE__;
+    }
+}
+
+/*reads the whole log at path and returns its MESSAGE records, marked if they are DONE. A missing log has no records.
+Reading stops at the first record that is torn or fails its checksum, so whatever a crash left half written is discarded.*/
+static int readLog(const char* path, unsigned char** content, STORED_RECORD** records, size_t* recordCount, uint64_t* maxRecordId)
+{
+    int result;
+    FILE* file = fopen(path, "rb");
+
+    *content = NULL;
+    *records = NULL;
+    *recordCount = 0;
+    *maxRecordId = 0;
+
+    if (file == NULL)
+    {
+        /*no log yet*/
+        result = 0;
+    }
+    else
+    {
+        long fileSize;
+        if ((fseek(file, 0, SEEK_END) != 0) || ((fileSize = ftell(file)) < 0) || (fseek(file, 0, SEEK_SET) != 0))
+        {
+            LogError("unable to get the size of the log");
+            result = __LINE__;
+        }
+        else if ((*content = (unsigned char*)malloc((fileSize == 0) ? 1 : (size_t)fileSize)) == NULL)
+        {
+            LogError("unable to malloc");
+            result = __LINE__;
+        }
+        else if (fread(*content, 1, (size_t)fileSize, file) != (size_t)fileSize)
+        {
+            LogError("unable to read the log");
+            free(*content);
+            *content = NULL;
+            result = __LINE__;
+        }
+        else
+        {
+            size_t size = (size_t)fileSize;
+            size_t offset = 0;
+            size_t capacity = 0;
+            result = 0;
+            while ((result == 0) && (size - offset >= RECORD_HEADER_SIZE + RECORD_TRAILER_SIZE))
+            {
+                const unsigned char* record = *content + offset;
+                unsigned char type = record[4];
+                uint64_t recordId = getUint64(record + 5);
+                size_t payloadSize = getUint32(record + 13);
+                size_t recordSize;
+                if (
+                    (getUint32(record) != RECORD_MAGIC) ||
+                    ((type != RECORD_TYPE_MESSAGE) && (type != RECORD_TYPE_DONE)) ||
+                    (payloadSize > size - offset - RECORD_HEADER_SIZE - RECORD_TRAILER_SIZE)
+                    )
+                {
+                    break;
+                }
+
+                recordSize = RECORD_HEADER_SIZE + payloadSize + RECORD_TRAILER_SIZE;
+                if (getUint32(record + RECORD_HEADER_SIZE + payloadSize) != computeCrc32(record + 4, RECORD_HEADER_SIZE - 4 + payloadSize))
+                {
+                    break;
+                }
+
+                if (type == RECORD_TYPE_DONE)
+                {
+                    size_t index;
+                    if (findRecord(*records, *recordCount, recordId, &index) == 0)
+                    {
+                        (*records)[index].isDone = true;
+                    }
+                }
+                else
+                {
+                    if (*recordCount == capacity)
+                    {
+                        size_t newCapacity = (capacity == 0) ? 16 : capacity * 2;
+                        STORED_RECORD* newRecords = (STORED_RECORD*)realloc(*records, newCapacity * sizeof(STORED_RECORD));
+                        if (newRecords == NULL)
+                        {
+                            LogError("unable to realloc");
+                            result = __LINE__;
+                        }
+                        else
+                        {
+                            *records = newRecords;
+                            capacity = newCapacity;
+                        }
+                    }
+
+                    if (result == 0)
+                    {
+                        STORED_RECORD* stored = *records + *recordCount;
+                        stored->recordId = recordId;
+                        stored->record = record;
+                        stored->recordSize = recordSize;
+                        stored->payload = record + RECORD_HEADER_SIZE;
+                        stored->payloadSize = payloadSize;
+                        stored->isDone = false;
+                        (*recordCount)++;
+                    }
+                }
+
+                if (recordId > *maxRecordId)
+                {
+                    *maxRecordId = recordId;
+                }
+                offset += recordSize;
+            }
+
+            if (offset != size)
+            {
+                LogError("discarding %lu bytes at the end of the log", (unsigned long)(size - offset));
+            }
+
+            if (result != 0)
+            {
+                free(*records);
+                *records = NULL;
+                *recordCount = 0;
+                free(*content);
+                *content = NULL;
+            }
+        }
+        (void)fclose(file);
+    }
+    return result;
+}
+
+/*a crash during compaction can leave only the compacted log behind*/
+static void recoverInterruptedCompaction(IOTHUB_CLIENT_LL_MESSAGESTORE_HANDLE_DATA* handleData)
+{
+    FILE* file = fopen(handleData->path, "rb");
+    if (file != NULL)
+    {
+        (void)fclose(file);
+    }
+    else if ((file = fopen(handleData->temporaryPath, "rb")) != NULL)
+    {
+        (void)fclose(file);
+        if (rename(handleData->temporaryPath, handleData->path) != 0)
+        {
+            LogError("unable to recover the compacted log");
+        }
+    }
+}
+
+/*rewrites the log with only the MESSAGE records that are not DONE. The log shall not be open.*/
+static int compactLog(IOTHUB_CLIENT_LL_MESSAGESTORE_HANDLE_DATA* handleData)
+{
+    int result;
+    unsigned char* content;
+    STORED_RECORD* records;
+    size_t recordCount;
+    uint64_t maxRecordId;
+    if (readLog(handleData->path, &content, &records, &recordCount, &maxRecordId) != 0)
+    {
+        LogError("unable to read the log");
+        result = __LINE__;
+    }
+    else
+    {
+        FILE* compacted = fopen(handleData->temporaryPath, "wb");
+        if (compacted == NULL)
+        {
+            LogError("unable to create %s", handleData->temporaryPath);
+            result = __LINE__;
+        }
+        else
+        {
+            size_t pendingCount = 0;
+            size_t i;
+            for (i = 0; i < recordCount; i++)
+            {
+                if (!records[i].isDone)
+                {
+                    if (fwrite(records[i].record, 1, records[i].recordSize, compacted) != records[i].recordSize)
+                    {
+                        break;
+                    }
+                    pendingCount++;
+                }
+            }
+
+            if ((fflush(compacted) != 0) || (fclose(compacted) != 0) || (i != recordCount))
+            {
+                LogError("unable to write %s", handleData->temporaryPath);
+                (void)remove(handleData->temporaryPath);
+                result = __LINE__;
+            }
+            /*rename does not replace an existing file everywhere, the compacted log is complete at this point and recoverInterruptedCompaction picks it up if the rename does not happen*/
+            else if ((remove(handleData->path) != 0 && content != NULL) || (rename(handleData->temporaryPath, handleData->path) != 0))
+            {
+                LogError("unable to replace the log with the compacted log");
+                result = __LINE__;
+            }
+            else
+            {
+                handleData->pendingCount = pendingCount;
+                handleData->doneCount = 0;
+                if (maxRecordId >= handleData->nextRecordId)
+                {
+                    handleData->nextRecordId = maxRecordId + 1;
+                }
+                result = 0;
+            }
+        }
+        free(records);
+        free(content);
+    }
+    return result;
+}
+
+static void destroyHandleData(IOTHUB_CLIENT_LL_MESSAGESTORE_HANDLE_DATA* handleData)
+{
+    if (handleData->log != NULL)
+    {
+        (void)fclose(handleData->log);
+    }
+    free(handleData->path);
+    free(handleData->temporaryPath);
+    free(handleData);
+}
+
+IOTHUB_CLIENT_LL_MESSAGESTORE_HANDLE IoTHubClient_LL_MessageStore_Create(const char* path)
+{
+    IOTHUB_CLIENT_LL_MESSAGESTORE_HANDLE_DATA* result;
+    /*Codes_SRS_IOTHUBCLIENT_LL_MESSAGESTORE_02_001: [ If path is NULL then IoTHubClient_LL_MessageStore_Create shall fail and return NULL. ]*/
+    if (path == NULL)
+    {
+        LogError("invalid argument path=NULL");
+        result = NULL;
+    }
+    else if ((result = (IOTHUB_CLIENT_LL_MESSAGESTORE_HANDLE_DATA*)malloc(sizeof(IOTHUB_CLIENT_LL_MESSAGESTORE_HANDLE_DATA))) == NULL)
+    {
+        /*Codes_SRS_IOTHUBCLIENT_LL_MESSAGESTORE_02_005: [ If any of the above steps fails then IoTHubClient_LL_MessageStore_Create shall fail and return NULL. ]*/
+        LogError("unable to malloc");
+    }
+    else
+    {
+        size_t pathLength = strlen(path);
+        result->path = (char*)malloc(pathLength + 1);
+        result->temporaryPath = (char*)malloc(pathLength + sizeof(TEMPORARY_SUFFIX));
+        result->log = NULL;
+        result->nextRecordId = 1;
+        result->pendingCount = 0;
+        result->doneCount = 0;
+        result->unflushed = false;
+        if ((result->path == NULL) || (result->temporaryPath == NULL))
+        {
+            /*Codes_SRS_IOTHUBCLIENT_LL_MESSAGESTORE_02_005: [ If any of the above steps fails then IoTHubClient_LL_MessageStore_Create shall fail and return NULL. ]*/
+            LogError("unable to malloc");
+            destroyHandleData(result);
+            result = NULL;
+        }
+        else
+        {
+            (void)memcpy(result->path, path, pathLength + 1);
+            (void)memcpy(result->temporaryPath, path, pathLength);
+            (void)memcpy(result->temporaryPath + pathLength, TEMPORARY_SUFFIX, sizeof(TEMPORARY_SUFFIX));
+
+            /*Codes_SRS_IOTHUBCLIENT_LL_MESSAGESTORE_02_002: [ IoTHubClient_LL_MessageStore_Create shall discard the records at the end of the log at path that are incomplete or fail their checksum. ]*/
+            /*Codes_SRS_IOTHUBCLIENT_LL_MESSAGESTORE_02_003: [ IoTHubClient_LL_MessageStore_Create shall rewrite the log at path so it only contains the messages that are not done. ]*/
+            recoverInterruptedCompaction(result);
+            if (compactLog(result) != 0)
+            {
+                /*Codes_SRS_IOTHUBCLIENT_LL_MESSAGESTORE_02_005: [ If any of the above steps fails then IoTHubClient_LL_MessageStore_Create shall fail and return NULL. ]*/
+                LogError("unable to compact the log %s", path);
+                destroyHandleData(result);
+                result = NULL;
+            }
+            /*Codes_SRS_IOTHUBCLIENT_LL_MESSAGESTORE_02_004: [ IoTHubClient_LL_MessageStore_Create shall open the log at path for appending. ]*/
+            else if ((result->log = fopen(result->path, "ab")) == NULL)
+            {
+                /*Codes_SRS_IOTHUBCLIENT_LL_MESSAGESTORE_02_005: [ If any of the above steps fails then IoTHubClient_LL_MessageStore_Create shall fail and return NULL. ]*/
+                LogError("unable to open the log %s", path);
+                destroyHandleData(result);
+                result = NULL;
+            }
+            else
+            {
+                /*all is fine*/
+            }
+        }
+    }
+    return result;
+}
+
+int IoTHubClient_LL_MessageStore_Replay(IOTHUB_CLIENT_LL_MESSAGESTORE_HANDLE handle, IOTHUB_CLIENT_LL_MESSAGESTORE_REPLAY_CALLBACK replayCallback, void* context)
+{
+    int result;
+    unsigned char* content;
+    STORED_RECORD* records;
+    size_t recordCount;
+    uint64_t maxRecordId;
+    /*Codes_SRS_IOTHUBCLIENT_LL_MESSAGESTORE_02_006: [ If handle or replayCallback is NULL then IoTHubClient_LL_MessageStore_Replay shall fail and return a non-zero value. ]*/
+    if ((handle == NULL) || (replayCallback == NULL))
+    {
+        LogError("invalid argument handle=%p, replayCallback=%p", handle, replayCallback);
+        result = __LINE__;
+    }
+    else if ((handle->log != NULL) && (fflush(handle->log) != 0))
+    {
+        LogError("unable to flush the log");
+        result = __LINE__;
+    }
+    else if (readLog(handle->path, &content, &records, &recordCount, &maxRecordId) != 0)
+    {
+        LogError("unable to read the log");
+        result = __LINE__;
+    }
+    else
+    {
+        size_t i;
+        handle->unflushed = false;
+        result = 0;
+        for (i = 0; i < recordCount; i++)
+        {
+            if (!records[i].isDone)
+            {
+                IOTHUB_MESSAGE_HANDLE messageHandle = createMessageFromPayload(records[i].payload, records[i].payloadSize);
+                if (messageHandle == NULL)
+                {
+                    /*Codes_SRS_IOTHUBCLIENT_LL_MESSAGESTORE_02_008: [ If a message cannot be recreated then IoTHubClient_LL_MessageStore_Replay shall skip it, continue with the next ones and return a non-zero value. ]*/
+                    LogError("unable to recreate the message of record %lu", (unsigned long)records[i].recordId);
+                    result = __LINE__;
+                }
+                else
+                {
+                    /*Codes_SRS_IOTHUBCLIENT_LL_MESSAGESTORE_02_007: [ IoTHubClient_LL_MessageStore_Replay shall recreate every message that is not done, in the order they were appended, and pass it with its recordId to replayCallback. ]*/
+                    replayCallback(messageHandle, records[i].recordId, context);
+                }
+            }
+        }
+        free(records);
+        free(content);
+    }
+    return result;
+}
+
+int IoTHubClient_LL_MessageStore_Append(IOTHUB_CLIENT_LL_MESSAGESTORE_HANDLE handle, IOTHUB_MESSAGE_HANDLE messageHandle, uint64_t* recordId)
+{
+    int result;
+    MESSAGE_PARTS parts;
+    /*Codes_SRS_IOTHUBCLIENT_LL_MESSAGESTORE_02_009: [ If handle, messageHandle or recordId is NULL then IoTHubClient_LL_MessageStore_Append shall fail and return a non-zero value. ]*/
+    if ((handle == NULL) || (messageHandle == NULL) || (recordId == NULL))
+    {
+        LogError("invalid argument handle=%p, messageHandle=%p, recordId=%p", handle, messageHandle, recordId);
+        result = __LINE__;
+    }
+    else if (getMessageParts(messageHandle, &parts) != 0)
+    {
+        /*Codes_SRS_IOTHUBCLIENT_LL_MESSAGESTORE_02_011: [ If reading the message or writing the record fails then IoTHubClient_LL_MessageStore_Append shall fail and return a non-zero value. ]*/
+        LogError("unable to read the message");
+        result = __LINE__;
+    }
+    /*Codes_SRS_IOTHUBCLIENT_LL_MESSAGESTORE_02_010: [ IoTHubClient_LL_MessageStore_Append shall append to the log a record with the payload, the content type, the messageId, the correlationId and the properties of messageHandle, shall set *recordId to a new record id and return 0. ]*/
+    else if (writeRecord(handle, RECORD_TYPE_MESSAGE, handle->nextRecordId, &parts) != 0)
+    {
+        /*Codes_SRS_IOTHUBCLIENT_LL_MESSAGESTORE_02_011: [ If reading the message or writing the record fails then IoTHubClient_LL_MessageStore_Append shall fail and return a non-zero value. ]*/
+        LogError("unable to append the message");
+        result = __LINE__;
+    }
+    else
+    {
+        *recordId = handle->nextRecordId++;
+        handle->pendingCount++;
+        result = 0;
+    }
+    return result;
+}
+
+int IoTHubClient_LL_MessageStore_Remove(IOTHUB_CLIENT_LL_MESSAGESTORE_HANDLE handle, uint64_t recordId)
+{
+    int result;
+    /*Codes_SRS_IOTHUBCLIENT_LL_MESSAGESTORE_02_012: [ If handle is NULL then IoTHubClient_LL_MessageStore_Remove shall fail and return a non-zero value. ]*/
+    if (handle == NULL)
+    {
+        LogError("invalid argument handle=NULL");
+        result = __LINE__;
+    }
+    /*Codes_SRS_IOTHUBCLIENT_LL_MESSAGESTORE_02_013: [ IoTHubClient_LL_MessageStore_Remove shall append to the log a DONE record for recordId and return 0. ]*/
+    else if (writeRecord(handle, RECORD_TYPE_DONE, recordId, NULL) != 0)
+    {
+        /*Codes_SRS_IOTHUBCLIENT_LL_MESSAGESTORE_02_014: [ If writing the record fails then IoTHubClient_LL_MessageStore_Remove shall fail and return a non-zero value. ]*/
+        LogError("unable to append the DONE record");
+        result = __LINE__;
+    }
+    else
+    {
+        if (handle->pendingCount > 0)
+        {
+            handle->pendingCount--;
+        }
+        handle->doneCount++;
+        result = 0;
+    }
+    return result;
+}
+
+int IoTHubClient_LL_MessageStore_Flush(IOTHUB_CLIENT_LL_MESSAGESTORE_HANDLE handle)
+{
+    int result;
+    /*Codes_SRS_IOTHUBCLIENT_LL_MESSAGESTORE_02_015: [ If handle is NULL then IoTHubClient_LL_MessageStore_Flush shall fail and return a non-zero value. ]*/
+    if (handle == NULL)
+    {
+        LogError("invalid argument handle=NULL");
+        result = __LINE__;
+    }
+    else if ((handle->log == NULL) && ((handle->log = fopen(handle->path, "ab")) == NULL))
+    {
+        /*Codes_SRS_IOTHUBCLIENT_LL_MESSAGESTORE_02_020: [ If flushing, truncating or compacting the log fails then IoTHubClient_LL_MessageStore_Flush shall return a non-zero value. ]*/
+        LogError("unable to open the log");
+        result = __LINE__;
+    }
+    else if (!handle->unflushed)
+    {
+        /*Codes_SRS_IOTHUBCLIENT_LL_MESSAGESTORE_02_016: [ If nothing has been written since the last flush then IoTHubClient_LL_MessageStore_Flush shall return 0. ]*/
+        result = 0;
+    }
+    else if (handle->pendingCount == 0)
+    {
+        /*Codes_SRS_IOTHUBCLIENT_LL_MESSAGESTORE_02_018: [ If all the messages are done then IoTHubClient_LL_MessageStore_Flush shall truncate the log. ]*/
+        (void)fclose(handle->log);
+        if ((handle->log = fopen(handle->path, "wb")) == NULL)
+        {
+            /*Codes_SRS_IOTHUBCLIENT_LL_MESSAGESTORE_02_020: [ If flushing, truncating or compacting the log fails then IoTHubClient_LL_MessageStore_Flush shall return a non-zero value. ]*/
+            LogError("unable to truncate the log");
+            result = __LINE__;
+        }
+        else
+        {
+            handle->doneCount = 0;
+            handle->unflushed = false;
+            result = 0;
+        }
+    }
+    else if ((handle->doneCount >= COMPACTION_MIN_DONE_RECORDS) && (handle->doneCount > handle->pendingCount))
+    {
+        /*Codes_SRS_IOTHUBCLIENT_LL_MESSAGESTORE_02_019: [ If the log has accumulated many DONE records then IoTHubClient_LL_MessageStore_Flush shall compact the log. ]*/
+        (void)fclose(handle->log);
+        handle->log = NULL;
+        if (compactLog(handle) != 0)
+        {
+            LogError("unable to compact the log");
+            result = __LINE__;
+        }
+        else
+        {
+            result = 0;
+        }
+
+        if ((handle->log = fopen(handle->path, "ab")) == NULL)
+        {
+            /*Codes_SRS_IOTHUBCLIENT_LL_MESSAGESTORE_02_020: [ If flushing, truncating or compacting the log fails then IoTHubClient_LL_MessageStore_Flush shall return a non-zero value. ]*/
+            LogError("unable to open the log");
+            result = __LINE__;
+        }
+        else
+        {
+            handle->unflushed = false;
+        }
+    }
+    /*Codes_SRS_IOTHUBCLIENT_LL_MESSAGESTORE_02_017: [ Otherwise IoTHubClient_LL_MessageStore_Flush shall hand all the records written since the last flush to the operating system by calling fflush and return 0. ]*/
+    else if (fflush(handle->log) != 0)
+    {
+        /*Codes_SRS_IOTHUBCLIENT_LL_MESSAGESTORE_02_020: [ If flushing, truncating or compacting the log fails then IoTHubClient_LL_MessageStore_Flush shall return a non-zero value. ]*/
+        LogError("unable to flush the log");
+        result = __LINE__;
+    }
+    else
+    {
+        handle->unflushed = false;
+        result = 0;
+    }
+    return result;
+}
+
+void IoTHubClient_LL_MessageStore_Destroy(IOTHUB_CLIENT_LL_MESSAGESTORE_HANDLE handle)
+{
+    /*Codes_SRS_IOTHUBCLIENT_LL_MESSAGESTORE_02_021: [ If handle is NULL then IoTHubClient_LL_MessageStore_Destroy shall do nothing. ]*/
+    if (handle != NULL)
+    {
+        /*Codes_SRS_IOTHUBCLIENT_LL_MESSAGESTORE_02_022: [ IoTHubClient_LL_MessageStore_Destroy shall flush and close the log and free all the resources used by the store. ]*/
+        destroyHandleData(handle);
+    }
+}
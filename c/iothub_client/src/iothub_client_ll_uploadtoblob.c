@@ -10,12 +10,14 @@
 #include <crtdbg.h>
 #endif
 #include <string.h>
+#include <stdio.h>
 #include "azure_c_shared_utility/gballoc.h"
 #include "azure_c_shared_utility/string_tokenizer.h"
 #include "azure_c_shared_utility/doublylinkedlist.h"
 #include "azure_c_shared_utility/iot_logging.h"
 #include "azure_c_shared_utility/tickcounter.h"
 #include "azure_c_shared_utility/httpapiexsas.h"
+#include "azure_c_shared_utility/lock.h"
 
 #include "iothub_client_ll.h"
 #include "iothub_client_private.h"
@@ -28,6 +30,16 @@
 /*Codes_SRS_IOTHUBCLIENT_LL_02_085: [ IoTHubClient_LL_UploadToBlob shall use the same authorization as step 1. to prepare and perform a HTTP request with the following parameters: ]*/
 #define FILE_UPLOAD_FAILED_BODY "{ \"isSuccess\":false, \"statusCode\":-1,\"statusDescription\" : \"client not able to connect with the server\" }"
 
+/*Codes_SRS_IOTHUBCLIENT_LL_02_140: [ By default, IoTHubClient_LL_UploadToBlob shall upload the blocks of a blob one after another ("blobUploadConcurrency" is 1). ]*/
+#define DEFAULT_BLOB_UPLOAD_CONCURRENCY 1
+
+/*the manifest of a resumable upload is a text file of lines ended by '\n': the version, destinationFileName, the size of the data, the version of the
+source, the correlationId, the SAS URI of the blob and then one line for each block uploaded. A block line is its ID in exactly 5 digits, so a line torn by a crash
+and completed by the next append cannot be taken for another block.*/
+#define UPLOAD_MANIFEST_VERSION "IoTHubClient upload manifest 2"
+#define UPLOAD_MANIFEST_BLOCK_ID_DIGITS 5
+#define UPLOAD_MANIFEST_MAX_BLOCK_COUNT 50000
+
 #define AUTHORIZATION_SCHEME_VALUES \
     DEVICE_KEY, \
     SAS_TOKEN
@@ -43,8 +55,138 @@ typedef struct IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE_DATA_TAG
         STRING_HANDLE deviceKey;    /*used when authorizationScheme is DEVICE_KEY*/
         STRING_HANDLE sas;          /*used when authorizationScheme is SAS_TOKEN*/
     } credentials;                              /*needed for file upload*/
+    size_t blobUploadConcurrency;               /*how many blocks of a blob are uploaded at the same time*/
+    HTTPAPIEX_HANDLE iotHubHttpApiExHandle;     /*the connection to IoTHub, kept open across uploads*/
+    HTTPAPIEX_SAS_HANDLE step1SasHandle;        /*used when authorizationScheme is DEVICE_KEY, NULL otherwise*/
+    HTTPAPIEX_SAS_HANDLE step3SasHandle;        /*used when authorizationScheme is DEVICE_KEY, NULL otherwise*/
+    BLOB_CONNECTION_HANDLE blobConnection;      /*the connection to Azure Storage, kept open across uploads*/
+    LOCK_HANDLE uploadLock;                     /*held for the whole of an upload, the connections above serve one upload at a time*/
 }IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE_DATA;
 
+typedef struct UPLOAD_MANIFEST_TAG
+{
+    FILE* file;                     /*open for appending the blocks uploaded, NULL when they cannot be recorded*/
+    unsigned char* isBlockUploaded; /*the blocks uploaded by the previous attempts*/
+    size_t blockCount;
+}UPLOAD_MANIFEST;
+
+/*returns a HTTPAPIEX_SAS_HANDLE for the resource hostname + "/devices/" + deviceId + uriSuffix (when uriSuffix is not NULL), NULL on failure*/
+static HTTPAPIEX_SAS_HANDLE createSasHandle(IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE_DATA* handleData, const char* uriSuffix)
+{
+    HTTPAPIEX_SAS_HANDLE result;
+    STRING_HANDLE uriResource = STRING_construct(handleData->hostname);
+    if (uriResource == NULL)
+    {
+        LogError("unable to STRING_construct");
+        result = NULL;
+    }
+    else
+    {
+        if (!(
+            (STRING_concat(uriResource, "/devices/") == 0) &&
+            (STRING_concat_with_STRING(uriResource, handleData->deviceId) == 0) &&
+            ((uriSuffix == NULL) || (STRING_concat(uriResource, uriSuffix) == 0))
+            ))
+        {
+            LogError("unable to STRING_concat");
+            result = NULL;
+        }
+        else
+        {
+            STRING_HANDLE empty = STRING_new();
+            if (empty == NULL)
+            {
+                LogError("unable to STRING_new");
+                result = NULL;
+            }
+            else
+            {
+                result = HTTPAPIEX_SAS_Create(handleData->credentials.deviceKey, uriResource, empty);
+                if (result == NULL)
+                {
+                    LogError("unable to HTTPAPIEX_SAS_Create");
+                }
+                STRING_delete(empty);
+            }
+        }
+        STRING_delete(uriResource);
+    }
+    return result;
+}
+
+/*returns 0 when the connections that all the uploads of handleData use have been created*/
+static int createConnections(IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE_DATA* handleData)
+{
+    int result;
+    /*Codes_SRS_IOTHUBCLIENT_LL_02_161: [ IoTHubClient_LL_UploadToBlob_Create shall create an HTTPAPIEX_HANDLE to the IoTHub hostname. ]*/
+    handleData->iotHubHttpApiExHandle = HTTPAPIEX_Create(handleData->hostname);
+    if (handleData->iotHubHttpApiExHandle == NULL)
+    {
+        /*Codes_SRS_IOTHUBCLIENT_LL_02_164: [ If any of the above fails then IoTHubClient_LL_UploadToBlob_Create shall fail and return NULL. ]*/
+        LogError("unable to HTTPAPIEX_Create");
+        result = __LINE__;
+    }
+    else
+    {
+        handleData->step1SasHandle = NULL;
+        handleData->step3SasHandle = NULL;
+        /*Codes_SRS_IOTHUBCLIENT_LL_02_162: [ If the credentials are a "deviceKey" then IoTHubClient_LL_UploadToBlob_Create shall create the HTTPAPIEX_SAS_HANDLE of step 1 for the resource hostname + "/devices/" + deviceId and the HTTPAPIEX_SAS_HANDLE of step 3 for the resource hostname + "/devices/" + deviceId + "/files/notifications", passing the deviceKey and an empty keyName. ]*/
+        if (
+            (handleData->authorizationScheme == DEVICE_KEY) &&
+            (
+                ((handleData->step1SasHandle = createSasHandle(handleData, NULL)) == NULL) ||
+                ((handleData->step3SasHandle = createSasHandle(handleData, "/files/notifications")) == NULL)
+            )
+            )
+        {
+            /*Codes_SRS_IOTHUBCLIENT_LL_02_164: [ If any of the above fails then IoTHubClient_LL_UploadToBlob_Create shall fail and return NULL. ]*/
+            LogError("unable to create the HTTPAPIEX_SAS_HANDLEs");
+            result = __LINE__;
+        }
+        else
+        {
+            /*Codes_SRS_IOTHUBCLIENT_LL_02_163: [ IoTHubClient_LL_UploadToBlob_Create shall call Blob_CreateConnection to create the connection to Azure Storage that the uploads reuse. ]*/
+            handleData->blobConnection = Blob_CreateConnection();
+            if (handleData->blobConnection == NULL)
+            {
+                /*Codes_SRS_IOTHUBCLIENT_LL_02_164: [ If any of the above fails then IoTHubClient_LL_UploadToBlob_Create shall fail and return NULL. ]*/
+                LogError("unable to Blob_CreateConnection");
+                result = __LINE__;
+            }
+            else
+            {
+                /*Codes_SRS_IOTHUBCLIENT_LL_02_171: [ IoTHubClient_LL_UploadToBlob_Create shall create a lock that serializes the uploads done with the handle. ]*/
+                handleData->uploadLock = Lock_Init();
+                if (handleData->uploadLock == NULL)
+                {
+                    /*Codes_SRS_IOTHUBCLIENT_LL_02_164: [ If any of the above fails then IoTHubClient_LL_UploadToBlob_Create shall fail and return NULL. ]*/
+                    LogError("unable to Lock_Init");
+                    Blob_DestroyConnection(handleData->blobConnection);
+                    result = __LINE__;
+                }
+                else
+                {
+                    result = 0;
+                }
+            }
+        }
+
+        if (result != 0)
+        {
+            if (handleData->step3SasHandle != NULL)
+            {
+                HTTPAPIEX_SAS_Destroy(handleData->step3SasHandle);
+            }
+            if (handleData->step1SasHandle != NULL)
+            {
+                HTTPAPIEX_SAS_Destroy(handleData->step1SasHandle);
+            }
+            HTTPAPIEX_Destroy(handleData->iotHubHttpApiExHandle);
+        }
+    }
+    return result;
+}
+
 IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE IoTHubClient_LL_UploadToBlob_Create(const IOTHUB_CLIENT_CONFIG* config)
 {
     IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE_DATA* handleData = malloc(sizeof(IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE_DATA));
@@ -57,6 +199,7 @@ IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE IoTHubClient_LL_UploadToBlob_Create(const I
     {
         size_t iotHubNameLength = strlen(config->iotHubName);
         size_t iotHubSuffixLength = strlen(config->iotHubSuffix);
+        handleData->blobUploadConcurrency = DEFAULT_BLOB_UPLOAD_CONCURRENCY;
         handleData->deviceId = STRING_construct(config->deviceId);
         if (handleData->deviceId == NULL)
         {
@@ -91,6 +234,15 @@ IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE IoTHubClient_LL_UploadToBlob_Create(const I
                         free(handleData);
                         handleData = NULL;
                     }
+                    else if (createConnections(handleData) != 0)
+                    {
+                        LogError("unable to create the connections");
+                        STRING_delete(handleData->credentials.sas);
+                        free((void*)handleData->hostname);
+                        STRING_delete(handleData->deviceId);
+                        free(handleData);
+                        handleData = NULL;
+                    }
                     else
                     {
                         /*return as is*/
@@ -108,6 +260,15 @@ IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE IoTHubClient_LL_UploadToBlob_Create(const I
                         free(handleData);
                         handleData = NULL;
                     }
+                    else if (createConnections(handleData) != 0)
+                    {
+                        LogError("unable to create the connections");
+                        STRING_delete(handleData->credentials.deviceKey);
+                        free((void*)handleData->hostname);
+                        STRING_delete(handleData->deviceId);
+                        free(handleData);
+                        handleData = NULL;
+                    }
                     else
                     {
                         /*return as is*/
@@ -120,6 +281,27 @@ IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE IoTHubClient_LL_UploadToBlob_Create(const I
     
 }
 
+/*the request HTTP headers of step 1, used by step 3 too*/
+static int addRequestHttpHeaders(HTTP_HEADERS_HANDLE requestHttpHeaders)
+{
+    int result;
+    /*Codes_SRS_IOTHUBCLIENT_LL_02_072: [ IoTHubClient_LL_UploadToBlob shall add the following name:value to request HTTP headers: ] "Content-Type": "application/json" "Accept": "application/json" "User-Agent": "iothubclient/" IOTHUB_SDK_VERSION*/
+    if (!(
+        (HTTPHeaders_AddHeaderNameValuePair(requestHttpHeaders, "Content-Type", "application/json") == HTTP_HEADERS_OK) &&
+        (HTTPHeaders_AddHeaderNameValuePair(requestHttpHeaders, "Accept", "application/json") == HTTP_HEADERS_OK) &&
+        (HTTPHeaders_AddHeaderNameValuePair(requestHttpHeaders, "User-Agent", "iothubclient/" IOTHUB_SDK_VERSION) == HTTP_HEADERS_OK) &&
+        (HTTPHeaders_AddHeaderNameValuePair(requestHttpHeaders, "Authorization", "") == HTTP_HEADERS_OK)
+        ))
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        result = 0;
+    }
+    return result;
+}
+
 /*returns 0 when correlationId, sasUri contain data*/
 static int IoTHubClient_LL_UploadToBlob_step1and2(IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE_DATA* handleData, HTTPAPIEX_HANDLE iotHubHttpApiExHandle, HTTP_HEADERS_HANDLE requestHttpHeaders, const char* destinationFileName,
     STRING_HANDLE correlationId, STRING_HANDLE sasUri)
@@ -159,13 +341,7 @@ static int IoTHubClient_LL_UploadToBlob_step1and2(IOTHUB_CLIENT_LL_UPLOADTOBLOB_
             }
             else
             {
-                /*Codes_SRS_IOTHUBCLIENT_LL_02_072: [ IoTHubClient_LL_UploadToBlob shall add the following name:value to request HTTP headers: ] "Content-Type": "application/json" "Accept": "application/json" "User-Agent": "iothubclient/" IOTHUB_SDK_VERSION*/
-                if (!(
-                    (HTTPHeaders_AddHeaderNameValuePair(requestHttpHeaders, "Content-Type", "application/json") == HTTP_HEADERS_OK) &&
-                    (HTTPHeaders_AddHeaderNameValuePair(requestHttpHeaders, "Accept", "application/json") == HTTP_HEADERS_OK) &&
-                    (HTTPHeaders_AddHeaderNameValuePair(requestHttpHeaders, "User-Agent", "iothubclient/" IOTHUB_SDK_VERSION) == HTTP_HEADERS_OK) &&
-                    (HTTPHeaders_AddHeaderNameValuePair(requestHttpHeaders, "Authorization", "") == HTTP_HEADERS_OK)
-                    ))
+                if (addRequestHttpHeaders(requestHttpHeaders) != 0)
                 {
                     /*Codes_SRS_IOTHUBCLIENT_LL_02_071: [ If creating the HTTP headers fails then IoTHubClient_LL_UploadToBlob shall fail and return IOTHUB_CLIENT_ERROR. ]*/
                     LogError("unable to HTTPHeaders_AddHeaderNameValuePair");
@@ -230,82 +406,38 @@ static int IoTHubClient_LL_UploadToBlob_step1and2(IOTHUB_CLIENT_LL_UPLOADTOBLOB_
                     }
                     case(DEVICE_KEY):
                     {
-                        /*Codes_SRS_IOTHUBCLIENT_LL_02_078: [ If the credentials used to create handle have "deviceKey" then IoTHubClient_LL_UploadToBlob shall create an HTTPAPIEX_SAS_HANDLE passing as arguments: ]*/
-                        STRING_HANDLE uriResource = STRING_construct(handleData->hostname);
-                        if (uriResource == NULL)
+                        unsigned int statusCode;
+                        /*Codes_SRS_IOTHUBCLIENT_LL_02_090: [ IoTHubClient_LL_UploadToBlob shall call HTTPAPIEX_SAS_ExecuteRequest passing as arguments: ]*/
+                        if (HTTPAPIEX_SAS_ExecuteRequest(
+                            handleData->step1SasHandle,     /*HTTPAPIEX_SAS_HANDLE sasHandle - the HTTPAPIEX_SAS_HANDLE of step 1*/
+                            iotHubHttpApiExHandle,          /*HTTPAPIEX_HANDLE handle - the created HTTPAPIEX_HANDLE*/
+                            HTTPAPI_REQUEST_GET,            /*HTTPAPI_REQUEST_TYPE requestType - HTTPAPI_REQUEST_GET*/
+                            STRING_c_str(relativePath),     /*const char* relativePath - the HTTP relative path*/
+                            requestHttpHeaders,             /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle - request HTTP headers*/
+                            NULL,                           /*BUFFER_HANDLE requestContent - NULL*/
+                            &statusCode,                    /*unsigned int* statusCode - the address of an unsigned int that will contain the HTTP status code*/
+                            NULL,                           /*HTTP_HEADERS_HANDLE responseHeadersHandle - NULL*/
+                            responseContent
+                        ) != HTTPAPIEX_OK)
                         {
-                            /*Codes_SRS_IOTHUBCLIENT_LL_02_089: [ If creating the HTTPAPIEX_SAS_HANDLE fails then IoTHubClient_LL_UploadToBlob shall fail and return IOTHUB_CLIENT_ERROR. ]*/
+                            /*Codes_SRS_IOTHUBCLIENT_LL_02_079: [ If HTTPAPIEX_SAS_ExecuteRequest fails then IoTHubClient_LL_UploadToBlob shall fail and return IOTHUB_CLIENT_ERROR. ]*/
+                            LogError("unable to HTTPAPIEX_SAS_ExecuteRequest");
                             result = __LINE__;
-                            LogError("unable to STRING_construct");
                         }
                         else
                         {
-                            if (!(
-                                (STRING_concat(uriResource, "/devices/") == 0) &&
-                                (STRING_concat_with_STRING(uriResource, handleData->deviceId) == 0)
-                                ))
+                            if (statusCode >= 300)
                             {
-                                /*Codes_SRS_IOTHUBCLIENT_LL_02_089: [ If creating the HTTPAPIEX_SAS_HANDLE fails then IoTHubClient_LL_UploadToBlob shall fail and return IOTHUB_CLIENT_ERROR. ]*/
-                                LogError("unable to STRING_concat_with_STRING");
+                                /*Codes_SRS_IOTHUBCLIENT_LL_02_080: [ If status code is greater than or equal to 300 then IoTHubClient_LL_UploadToBlob shall fail and return IOTHUB_CLIENT_ERROR. ]*/
                                 result = __LINE__;
+                                LogError("HTTP code was %u", statusCode);
                             }
                             else
                             {
-                                STRING_HANDLE empty = STRING_new();
-                                if (empty == NULL)
-                                {
-                                    LogError("unable to STRING_new");
-                                    result = __LINE__;
-                                }
-                                else
-                                {
-                                    /*Codes_SRS_IOTHUBCLIENT_LL_02_089: [ If creating the HTTPAPIEX_SAS_HANDLE fails then IoTHubClient_LL_UploadToBlob shall fail and return IOTHUB_CLIENT_ERROR. ]*/
-                                    HTTPAPIEX_SAS_HANDLE sasHandle = HTTPAPIEX_SAS_Create(handleData->credentials.deviceKey, uriResource, empty);
-                                    if (sasHandle == NULL)
-                                    {
-                                        LogError("unable to HTTPAPIEX_SAS_Create");
-                                        result = __LINE__;
-                                    }
-                                    else
-                                    {
-                                        unsigned int statusCode;
-                                        /*Codes_SRS_IOTHUBCLIENT_LL_02_090: [ IoTHubClient_LL_UploadToBlob shall call HTTPAPIEX_SAS_ExecuteRequest passing as arguments: ]*/
-                                        if (HTTPAPIEX_SAS_ExecuteRequest(
-                                            sasHandle,                      /*HTTPAPIEX_SAS_HANDLE sasHandle - the created HTTPAPIEX_SAS_HANDLE*/
-                                            iotHubHttpApiExHandle,          /*HTTPAPIEX_HANDLE handle - the created HTTPAPIEX_HANDLE*/
-                                            HTTPAPI_REQUEST_GET,            /*HTTPAPI_REQUEST_TYPE requestType - HTTPAPI_REQUEST_GET*/
-                                            STRING_c_str(relativePath),     /*const char* relativePath - the HTTP relative path*/
-                                            requestHttpHeaders,             /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle - request HTTP headers*/
-                                            NULL,                           /*BUFFER_HANDLE requestContent - NULL*/
-                                            &statusCode,                    /*unsigned int* statusCode - the address of an unsigned int that will contain the HTTP status code*/
-                                            NULL,                           /*HTTP_HEADERS_HANDLE responseHeadersHandle - NULL*/
-                                            responseContent
-                                        ) != HTTPAPIEX_OK)
-                                        {
-                                            /*Codes_SRS_IOTHUBCLIENT_LL_02_079: [ If HTTPAPIEX_SAS_ExecuteRequest fails then IoTHubClient_LL_UploadToBlob shall fail and return IOTHUB_CLIENT_ERROR. ]*/
-                                            LogError("unable to HTTPAPIEX_SAS_ExecuteRequest");
-                                            result = __LINE__;
-                                        }
-                                        else
-                                        {
-                                            if (statusCode >= 300)
-                                            {
-                                                /*Codes_SRS_IOTHUBCLIENT_LL_02_080: [ If status code is greater than or equal to 300 then IoTHubClient_LL_UploadToBlob shall fail and return IOTHUB_CLIENT_ERROR. ]*/
-                                                result = __LINE__;
-                                                LogError("HTTP code was %u", statusCode);
-                                            }
-                                            else
-                                            {
-                                                wasIoTHubRequestSuccess = 1;
-                                            }
-                                        }
-                                        HTTPAPIEX_SAS_Destroy(sasHandle);
-                                    }
-                                    STRING_delete(empty);
-                                }
+                                wasIoTHubRequestSuccess = 1;
                             }
-                            STRING_delete(uriResource);
                         }
+                        break;
                     }
                     } /*switch*/
 
@@ -457,292 +589,635 @@ static int IoTHubClient_LL_UploadToBlob_step3(IOTHUB_CLIENT_LL_UPLOADTOBLOB_HAND
     /*this POST "tries" to happen*/
 
     /*Codes_SRS_IOTHUBCLIENT_LL_02_085: [ IoTHubClient_LL_UploadToBlob shall use the same authorization as step 1. to prepare and perform a HTTP request with the following parameters: ]*/
-    STRING_HANDLE uriResource = STRING_construct(handleData->hostname);
-    if (uriResource == NULL)
+    STRING_HANDLE relativePathNotification = STRING_construct("/devices/");
+    if (relativePathNotification == NULL)
     {
-        LogError("unable to construct URI");
         result = __LINE__;
+        LogError("unable to STRING_construct");
     }
     else
     {
         if (!(
-            (STRING_concat(uriResource, "/devices/") == 0) &&
-            (STRING_concat_with_STRING(uriResource, handleData->deviceId) == 0) &&
-            (STRING_concat(uriResource, "/files/notifications") == 0)
+            (STRING_concat_with_STRING(relativePathNotification, handleData->deviceId) == 0) &&
+            (STRING_concat(relativePathNotification, "/files/notifications/") == 0) &&
+            (STRING_concat(relativePathNotification, STRING_c_str(correlationId)) == 0) &&
+            (STRING_concat(relativePathNotification, API_VERSION) == 0)
             ))
         {
-            LogError("unable to STRING_concat");
+            LogError("unable to STRING_concat_with_STRING");
             result = __LINE__;
         }
         else
         {
-            STRING_HANDLE relativePathNotification = STRING_construct("/devices/");
-            if (relativePathNotification == NULL)
+            /*Codes_SRS_IOTHUBCLIENT_LL_02_086: [ If performing the HTTP request fails then IoTHubClient_LL_UploadToBlob shall fail and return IOTHUB_CLIENT_ERROR. ]*/
+            switch (handleData->authorizationScheme)
             {
+            default:
+            {
+                LogError("internal error: unknown authorization Scheme");
                 result = __LINE__;
-                LogError("unable to STRING_construct");
+                break;
             }
-            else
+            case (DEVICE_KEY):
             {
-                if (!(
-                    (STRING_concat_with_STRING(relativePathNotification, handleData->deviceId) == 0) &&
-                    (STRING_concat(relativePathNotification, "/files/notifications/") == 0) &&
-                    (STRING_concat(relativePathNotification, STRING_c_str(correlationId)) == 0) &&
-                    (STRING_concat(relativePathNotification, API_VERSION) == 0)
-                    ))
+                unsigned int statusCode;
+                if (HTTPAPIEX_SAS_ExecuteRequest(
+                    handleData->step3SasHandle,     /*HTTPAPIEX_SAS_HANDLE sasHandle - the HTTPAPIEX_SAS_HANDLE of step 3*/
+                    iotHubHttpApiExHandle,          /*HTTPAPIEX_HANDLE handle - the created HTTPAPIEX_HANDLE*/
+                    HTTPAPI_REQUEST_POST,            /*HTTPAPI_REQUEST_TYPE requestType - HTTPAPI_REQUEST_GET*/
+                    STRING_c_str(relativePathNotification),     /*const char* relativePath - the HTTP relative path*/
+                    requestHttpHeaders,             /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle - request HTTP headers*/
+                    messageBody,                    /*BUFFER_HANDLE requestContent*/
+                    &statusCode,                    /*unsigned int* statusCode - the address of an unsigned int that will contain the HTTP status code*/
+                    NULL,                           /*HTTP_HEADERS_HANDLE responseHeadersHandle - NULL*/
+                    NULL
+                ) != HTTPAPIEX_OK)
                 {
-                    LogError("unable to STRING_concat_with_STRING");
+                    /*Codes_SRS_IOTHUBCLIENT_LL_02_079: [ If HTTPAPIEX_SAS_ExecuteRequest fails then IoTHubClient_LL_UploadToBlob shall fail and return IOTHUB_CLIENT_ERROR. ]*/
+                    LogError("unable to HTTPAPIEX_SAS_ExecuteRequest");
                     result = __LINE__;
+                    ;
                 }
                 else
                 {
-                    /*Codes_SRS_IOTHUBCLIENT_LL_02_086: [ If performing the HTTP request fails then IoTHubClient_LL_UploadToBlob shall fail and return IOTHUB_CLIENT_ERROR. ]*/
-                    switch (handleData->authorizationScheme)
+                    if (statusCode >= 300)
                     {
-                    default:
+                        /*Codes_SRS_IOTHUBCLIENT_LL_02_087: [If the statusCode of the HTTP request is greater than or equal to 300 then IoTHubClient_LL_UploadToBlob shall fail and return IOTHUB_CLIENT_ERROR]*/
+                        result = __LINE__;
+                        LogError("HTTP code was %u", statusCode);
+                    }
+                    else
+                    {
+                        result = 0;
+                    }
+                }
+                break;
+            }
+            case(SAS_TOKEN):
+            {
+                unsigned int notificationStatusCode;
+                if (HTTPAPIEX_ExecuteRequest(
+                    iotHubHttpApiExHandle,
+                    HTTPAPI_REQUEST_POST,
+                    STRING_c_str(relativePathNotification),
+                    requestHttpHeaders,
+                    messageBody,
+                    &notificationStatusCode,
+                    NULL,
+                    NULL) != HTTPAPIEX_OK)
+                {
+                    LogError("unable to do HTTPAPIEX_ExecuteRequest");
+                    result = __LINE__;
+                }
+                else
+                {
+                    if (notificationStatusCode >= 300)
                     {
-                        LogError("internal error: unknown authorization Scheme");
+                        /*Codes_SRS_IOTHUBCLIENT_LL_02_087: [If the statusCode of the HTTP request is greater than or equal to 300 then IoTHubClient_LL_UploadToBlob shall fail and return IOTHUB_CLIENT_ERROR]*/
+                        LogError("server didn't like the notification request");
                         result = __LINE__;
-                        break;
                     }
-                    case (DEVICE_KEY):
+                    else
                     {
-                        STRING_HANDLE empty = STRING_new();
-                        if (empty == NULL)
-                        {
-                            LogError("unable to STRING_new");
-                            result = __LINE__;
-                        }
-                        else
-                        {
-                            HTTPAPIEX_SAS_HANDLE sasHandle = HTTPAPIEX_SAS_Create(handleData->credentials.deviceKey, uriResource, empty);
-                            if (sasHandle == NULL)
-                            {
-                                LogError("unable to HTTPAPIEX_SAS_Create");
-                                result = __LINE__;
-                            }
-                            else
-                            {
-                                unsigned int statusCode;
-                                if (HTTPAPIEX_SAS_ExecuteRequest(
-                                    sasHandle,                      /*HTTPAPIEX_SAS_HANDLE sasHandle - the created HTTPAPIEX_SAS_HANDLE*/
-                                    iotHubHttpApiExHandle,          /*HTTPAPIEX_HANDLE handle - the created HTTPAPIEX_HANDLE*/
-                                    HTTPAPI_REQUEST_POST,            /*HTTPAPI_REQUEST_TYPE requestType - HTTPAPI_REQUEST_GET*/
-                                    STRING_c_str(relativePathNotification),     /*const char* relativePath - the HTTP relative path*/
-                                    requestHttpHeaders,             /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle - request HTTP headers*/
-                                    messageBody,                    /*BUFFER_HANDLE requestContent*/
-                                    &statusCode,                    /*unsigned int* statusCode - the address of an unsigned int that will contain the HTTP status code*/
-                                    NULL,                           /*HTTP_HEADERS_HANDLE responseHeadersHandle - NULL*/
-                                    NULL
-                                ) != HTTPAPIEX_OK)
-                                {
-                                    /*Codes_SRS_IOTHUBCLIENT_LL_02_079: [ If HTTPAPIEX_SAS_ExecuteRequest fails then IoTHubClient_LL_UploadToBlob shall fail and return IOTHUB_CLIENT_ERROR. ]*/
-                                    LogError("unable to HTTPAPIEX_SAS_ExecuteRequest");
-                                    result = __LINE__;
-                                    ;
-                                }
-                                else
-                                {
-                                    if (statusCode >= 300)
-                                    {
-                                        /*Codes_SRS_IOTHUBCLIENT_LL_02_087: [If the statusCode of the HTTP request is greater than or equal to 300 then IoTHubClient_LL_UploadToBlob shall fail and return IOTHUB_CLIENT_ERROR]*/
-                                        result = __LINE__;
-                                        LogError("HTTP code was %u", statusCode);
-                                    }
-                                    else
-                                    {
-                                        result = 0;
-                                    }
-                                }
-                                HTTPAPIEX_SAS_Destroy(sasHandle);
-                            }
-                            STRING_delete(empty);
-                        }
-                        break;
+                        result = 0;
                     }
-                    case(SAS_TOKEN):
+                }
+                break;
+            }
+            } /*switch authorizationScheme*/
+        }
+        STRING_delete(relativePathNotification);
+    }
+    return result;
+}
+
+/*prepares the request HTTP headers for step 3 when step 1 is skipped*/
+static int IoTHubClient_LL_UploadToBlob_resumeHeaders(IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE_DATA* handleData, HTTP_HEADERS_HANDLE requestHttpHeaders)
+{
+    int result;
+    if (addRequestHttpHeaders(requestHttpHeaders) != 0)
+    {
+        LogError("unable to HTTPHeaders_AddHeaderNameValuePair");
+        result = __LINE__;
+    }
+    else if (
+        (handleData->authorizationScheme == SAS_TOKEN) &&
+        (HTTPHeaders_ReplaceHeaderNameValuePair(requestHttpHeaders, "Authorization", STRING_c_str(handleData->credentials.sas)) != HTTP_HEADERS_OK)
+        )
+    {
+        LogError("unable to HTTPHeaders_ReplaceHeaderNameValuePair");
+        result = __LINE__;
+    }
+    else
+    {
+        result = 0;
+    }
+    return result;
+}
+
+/*returns the next line of the manifest without its '\n' and moves position after it, NULL when there is no complete line left*/
+static char* getManifestLine(char** position, char* end)
+{
+    char* result;
+    char* newLine = (*position < end) ? (char*)memchr(*position, '\n', end - *position) : NULL;
+    if (newLine == NULL)
+    {
+        result = NULL;
+    }
+    else
+    {
+        result = *position;
+        *newLine = '\0';
+        *position = newLine + 1;
+    }
+    return result;
+}
+
+/*returns 0 when line is the ID of a block*/
+static int parseManifestBlockID(const char* line, size_t* blockID)
+{
+    int result;
+    size_t i;
+    *blockID = 0;
+    for (i = 0; (i < UPLOAD_MANIFEST_BLOCK_ID_DIGITS) && (line[i] >= '0') && (line[i] <= '9'); i++)
+    {
+        *blockID = *blockID * 10 + (line[i] - '0');
+    }
+
+    if ((i != UPLOAD_MANIFEST_BLOCK_ID_DIGITS) || (line[i] != '\0') || (*blockID >= UPLOAD_MANIFEST_MAX_BLOCK_COUNT))
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        result = 0;
+    }
+    return result;
+}
+
+/*returns 0 when manifestFileName describes the upload of size bytes of sourceVersion to destinationFileName, correlationId, sasUri and the blocks uploaded are then taken from it*/
+static int loadManifest(UPLOAD_MANIFEST* manifest, const char* manifestFileName, const char* destinationFileName, size_t size, const char* sourceVersion, STRING_HANDLE correlationId, STRING_HANDLE sasUri)
+{
+    int result;
+    FILE* file = fopen(manifestFileName, "rb");
+    if (file == NULL)
+    {
+        /*no upload to resume*/
+        result = __LINE__;
+    }
+    else
+    {
+        long fileSize;
+        char* content;
+        if ((fseek(file, 0, SEEK_END) != 0) || ((fileSize = ftell(file)) < 0) || (fseek(file, 0, SEEK_SET) != 0))
+        {
+            LogError("unable to get the size of %s", manifestFileName);
+            result = __LINE__;
+        }
+        else if ((content = (char*)malloc((size_t)fileSize + 1)) == NULL)
+        {
+            LogError("unable to malloc");
+            result = __LINE__;
+        }
+        else
+        {
+            if (fread(content, 1, (size_t)fileSize, file) != (size_t)fileSize)
+            {
+                LogError("unable to read %s", manifestFileName);
+                result = __LINE__;
+            }
+            else
+            {
+                char* position = content;
+                char* end = content + fileSize;
+                const char* version = getManifestLine(&position, end);
+                const char* manifestDestinationFileName = getManifestLine(&position, end);
+                const char* manifestSize = getManifestLine(&position, end);
+                const char* manifestSourceVersion = getManifestLine(&position, end);
+                const char* manifestCorrelationId = getManifestLine(&position, end);
+                const char* manifestSasUri = getManifestLine(&position, end);
+                char sizeAsString[21];
+                (void)snprintf(sizeAsString, sizeof(sizeAsString), "%llu", (unsigned long long)size);
+
+                /*a manifest cut short before the SAS URI line has no line after it either*/
+                if (
+                    (manifestSasUri == NULL) ||
+                    (strcmp(version, UPLOAD_MANIFEST_VERSION) != 0) ||
+                    (strcmp(manifestDestinationFileName, destinationFileName) != 0) ||
+                    (strcmp(manifestSize, sizeAsString) != 0) ||
+                    (strcmp(manifestSourceVersion, sourceVersion) != 0) /*the source has changed since the blocks were uploaded*/
+                    )
+                {
+                    LogError("%s does not describe the upload of %s, the upload starts over", manifestFileName, destinationFileName);
+                    result = __LINE__;
+                }
+                else if (
+                    (STRING_copy(correlationId, manifestCorrelationId) != 0) ||
+                    (STRING_copy(sasUri, manifestSasUri) != 0)
+                    )
+                {
+                    LogError("unable to STRING_copy");
+                    result = __LINE__;
+                }
+                else
+                {
+                    /*the block lines are read twice, the first time sizes isBlockUploaded*/
+                    char* blocks = position;
+                    const char* line;
+                    size_t blockID;
+                    size_t blockCount = 0;
+                    while ((line = getManifestLine(&position, end)) != NULL)
                     {
-                        unsigned int notificationStatusCode;
-                        if (HTTPAPIEX_ExecuteRequest(
-                            iotHubHttpApiExHandle,
-                            HTTPAPI_REQUEST_POST,
-                            STRING_c_str(relativePathNotification),
-                            requestHttpHeaders,
-                            messageBody,
-                            &notificationStatusCode,
-                            NULL,
-                            NULL) != HTTPAPIEX_OK)
+                        if ((parseManifestBlockID(line, &blockID) == 0) && (blockID >= blockCount))
                         {
-                            LogError("unable to do HTTPAPIEX_ExecuteRequest");
-                            result = __LINE__;
+                            blockCount = blockID + 1;
                         }
-                        else
+                    }
+
+                    if (blockCount == 0)
+                    {
+                        manifest->isBlockUploaded = NULL;
+                        manifest->blockCount = 0;
+                        result = 0;
+                    }
+                    else if ((manifest->isBlockUploaded = (unsigned char*)malloc(blockCount)) == NULL)
+                    {
+                        LogError("unable to malloc");
+                        result = __LINE__;
+                    }
+                    else
+                    {
+                        (void)memset(manifest->isBlockUploaded, 0, blockCount);
+                        manifest->blockCount = blockCount;
+                        /*every line read above is now ended by '\0'*/
+                        while (blocks < position)
                         {
-                            if (notificationStatusCode >= 300)
+                            line = blocks;
+                            blocks += strlen(line) + 1;
+                            if (parseManifestBlockID(line, &blockID) == 0)
                             {
-                                /*Codes_SRS_IOTHUBCLIENT_LL_02_087: [If the statusCode of the HTTP request is greater than or equal to 300 then IoTHubClient_LL_UploadToBlob shall fail and return IOTHUB_CLIENT_ERROR]*/
-                                LogError("server didn't like the notification request");
-                                result = __LINE__;
-                            }
-                            else
-                            {
-                                result = 0;
+                                manifest->isBlockUploaded[blockID] = 1;
                             }
                         }
-                        break;
+                        result = 0;
                     }
-                    } /*switch authorizationScheme*/
                 }
-                STRING_delete(relativePathNotification);
             }
+            free(content);
         }
-        STRING_delete(uriResource);
+        (void)fclose(file);
     }
     return result;
 }
 
-IOTHUB_CLIENT_RESULT IoTHubClient_LL_UploadToBlob_Impl(IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE handle, const char* destinationFileName, const unsigned char* source, size_t size)
+/*manifest->file is NULL when the manifest cannot be written, the upload then goes on without being resumable*/
+static void createManifest(UPLOAD_MANIFEST* manifest, const char* manifestFileName, const char* destinationFileName, size_t size, const char* sourceVersion, STRING_HANDLE correlationId, STRING_HANDLE sasUri)
 {
-    IOTHUB_CLIENT_RESULT result;
-
-    /*Codes_SRS_IOTHUBCLIENT_LL_02_061: [ If handle is NULL then IoTHubClient_LL_UploadToBlob shall fail and return IOTHUB_CLIENT_INVALID_ARG. ]*/
-    /*Codes_SRS_IOTHUBCLIENT_LL_02_062: [ If destinationFileName is NULL then IoTHubClient_LL_UploadToBlob shall fail and return IOTHUB_CLIENT_INVALID_ARG. ]*/
-    /*Codes_SRS_IOTHUBCLIENT_LL_02_063: [ If source is NULL and size is greater than 0 then IoTHubClient_LL_UploadToBlob shall fail and return IOTHUB_CLIENT_INVALID_ARG. ]*/
-    if (
-        (handle == NULL) ||
-        (destinationFileName == NULL) ||
-        ((source == NULL) && (size > 0))
+    manifest->file = fopen(manifestFileName, "wb");
+    if (manifest->file == NULL)
+    {
+        LogError("unable to create %s, the upload cannot be resumed", manifestFileName);
+    }
+    else if (
+        (fprintf(manifest->file, "%s\n%s\n%llu\n%s\n%s\n%s\n", UPLOAD_MANIFEST_VERSION, destinationFileName, (unsigned long long)size, sourceVersion, STRING_c_str(correlationId), STRING_c_str(sasUri)) < 0) ||
+        (fflush(manifest->file) != 0)
         )
     {
-        LogError("invalid argument detected handle=%p destinationFileName=%p source=%p size=%zu", handle, destinationFileName, source, size);
-        result = IOTHUB_CLIENT_INVALID_ARG;
+        LogError("unable to write %s, the upload cannot be resumed", manifestFileName);
+        (void)fclose(manifest->file);
+        manifest->file = NULL;
+        (void)remove(manifestFileName);
     }
     else
     {
-        IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE_DATA* handleData = (IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE_DATA*)handle;
+        /*the manifest stays open for the blocks*/
+    }
+}
+
+static void recordBlockUploaded(void* context, unsigned int blockID)
+{
+    FILE* file = (FILE*)context;
+    /*flushed right away: the block is not uploaded again even if the process dies the next instant*/
+    if ((fprintf(file, "%0*u\n", UPLOAD_MANIFEST_BLOCK_ID_DIGITS, blockID) < 0) || (fflush(file) != 0))
+    {
+        LogError("unable to record block %u in the manifest, a resumed upload shall upload it again", blockID);
+    }
+}
 
-        /*Codes_SRS_IOTHUBCLIENT_LL_02_064: [ IoTHubClient_LL_UploadToBlob shall create an HTTPAPIEX_HANDLE to the IoTHub hostname. ]*/
-        HTTPAPIEX_HANDLE iotHubHttpApiExHandle = HTTPAPIEX_Create(handleData->hostname);
+/*uploads source, or the data read by getData when getData is not NULL. When manifestFileName is not NULL the size bytes of sourceVersion read by getData are uploaded resumably*/
+static IOTHUB_CLIENT_RESULT IoTHubClient_LL_UploadToBlob_steps(IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE_DATA* handleData, const char* destinationFileName, const unsigned char* source, size_t size, IOTHUB_CLIENT_FILE_UPLOAD_READ_CALLBACK getData, void* context, const char* sourceVersion, const char* manifestFileName)
+{
+    IOTHUB_CLIENT_RESULT result;
 
-        /*Codes_SRS_IOTHUBCLIENT_LL_02_065: [ If creating the HTTPAPIEX_HANDLE fails then IoTHubClient_LL_UploadToBlob shall fail and return IOTHUB_CLIENT_ERROR. ]*/
-        if (iotHubHttpApiExHandle == NULL)
+    STRING_HANDLE correlationId = STRING_new();
+    if (correlationId == NULL)
+    {
+        LogError("unable to STRING_new");
+        result = IOTHUB_CLIENT_ERROR;
+    }
+    else
+    {
+        STRING_HANDLE sasUri = STRING_new();
+        if (sasUri == NULL)
         {
-            LogError("unable to HTTPAPIEX_Create");
+            LogError("unable to STRING_new");
             result = IOTHUB_CLIENT_ERROR;
         }
         else
         {
-            STRING_HANDLE correlationId = STRING_new();
-            if (correlationId == NULL)
+            /*Codes_SRS_IOTHUBCLIENT_LL_02_070: [ IoTHubClient_LL_UploadToBlob shall create request HTTP headers. ]*/
+            HTTP_HEADERS_HANDLE requestHttpHeaders = HTTPHeaders_Alloc(); /*these are build by step 1 and used by step 3 too*/
+            if (requestHttpHeaders == NULL)
             {
-                LogError("unable to STRING_new");
+                LogError("unable to HTTPHeaders_Alloc");
                 result = IOTHUB_CLIENT_ERROR;
             }
             else
             {
-                STRING_HANDLE sasUri = STRING_new();
-                if (sasUri == NULL)
+                UPLOAD_MANIFEST manifest;
+                int step1Result;
+                int isUploadOver = 0; /*!=0 when step 3 has been attempted, the manifest is not needed anymore*/
+                manifest.file = NULL;
+                manifest.isBlockUploaded = NULL;
+                manifest.blockCount = 0;
+
+                if ((manifestFileName != NULL) && (loadManifest(&manifest, manifestFileName, destinationFileName, size, sourceVersion, correlationId, sasUri) == 0))
+                {
+                    /*Codes_SRS_IOTHUBCLIENT_LL_02_152: [ If manifestFileName describes an upload of size bytes of sourceVersion to destinationFileName then IoTHubClient_LL_UploadToBlobFromReaderResumable_Impl shall skip step 1, take the correlationId, the SAS URI and the blocks already uploaded from manifestFileName and add the request HTTP headers of step 1. ]*/
+                    step1Result = IoTHubClient_LL_UploadToBlob_resumeHeaders(handleData, requestHttpHeaders);
+                    if (step1Result == 0)
+                    {
+                        manifest.file = fopen(manifestFileName, "ab");
+                        if (manifest.file == NULL)
+                        {
+                            LogError("unable to open %s, the blocks uploaded are not recorded", manifestFileName);
+                        }
+                    }
+                }
+                else
                 {
-                    LogError("unable to STRING_new");
+                    /*do step 1*/
+                    step1Result = IoTHubClient_LL_UploadToBlob_step1and2(handleData, handleData->iotHubHttpApiExHandle, requestHttpHeaders, destinationFileName, correlationId, sasUri);
+                    if ((step1Result == 0) && (manifestFileName != NULL))
+                    {
+                        /*Codes_SRS_IOTHUBCLIENT_LL_02_153: [ Otherwise IoTHubClient_LL_UploadToBlobFromReaderResumable_Impl shall execute step 1 and write to manifestFileName the lines "IoTHubClient upload manifest 2", destinationFileName, size, sourceVersion, the correlationId and the SAS URI. ]*/
+                        createManifest(&manifest, manifestFileName, destinationFileName, size, sourceVersion, correlationId, sasUri);
+                    }
+                }
+
+                if (step1Result != 0)
+                {
+                    LogError("error in IoTHubClient_LL_UploadToBlob_step1");
                     result = IOTHUB_CLIENT_ERROR;
                 }
                 else
                 {
-                    /*Codes_SRS_IOTHUBCLIENT_LL_02_070: [ IoTHubClient_LL_UploadToBlob shall create request HTTP headers. ]*/
-                    HTTP_HEADERS_HANDLE requestHttpHeaders = HTTPHeaders_Alloc(); /*these are build by step 1 and used by step 3 too*/
-                    if (requestHttpHeaders == NULL)
+                    /*do step 2.*/
+
+                    unsigned int httpResponse;
+                    BUFFER_HANDLE responseToIoTHub = BUFFER_new();
+                    if (responseToIoTHub == NULL)
                     {
-                        LogError("unable to HTTPHeaders_Alloc");
                         result = IOTHUB_CLIENT_ERROR;
+                        LogError("unable to BUFFER_new");
                     }
                     else
                     {
-                        /*do step 1*/
-                        if (IoTHubClient_LL_UploadToBlob_step1and2(handleData, iotHubHttpApiExHandle, requestHttpHeaders, destinationFileName, correlationId, sasUri) != 0)
+                        int step2success;
+                        int isResumable = 0;
+                        BLOB_UPLOAD_RESUME resume;
+                        BLOB_RESULT blobResult;
+                        if (manifestFileName != NULL)
+                        {
+                            resume.isBlockUploaded = manifest.isBlockUploaded;
+                            resume.blockCount = manifest.blockCount;
+                            resume.onBlockUploaded = (manifest.file != NULL) ? recordBlockUploaded : NULL;
+                            resume.onBlockUploadedContext = manifest.file;
+                        }
+
+                        /*Codes_SRS_IOTHUBCLIENT_LL_02_083: [ IoTHubClient_LL_UploadToBlob shall call Blob_UploadFromSasUriOnConnection passing the connection created by IoTHubClient_LL_UploadToBlob_Create, source, size and "blobUploadConcurrency" and capture the HTTP return code and HTTP body. ]*/
+                        /*Codes_SRS_IOTHUBCLIENT_LL_02_144: [ IoTHubClient_LL_UploadToBlobFromReader_Impl shall execute the same steps as IoTHubClient_LL_UploadToBlob, except that step 2 shall pass getData and context to Blob_UploadFromSasUriOnConnection instead of source and size. ]*/
+                        /*Codes_SRS_IOTHUBCLIENT_LL_02_154: [ Step 2 shall pass to Blob_UploadFromSasUriOnConnection getData, context and the blocks already uploaded. Every block uploaded shall be appended to manifestFileName as a line of its blockID in 5 digits and flushed. ]*/
+                        blobResult = Blob_UploadFromSasUriOnConnection(handleData->blobConnection, STRING_c_str(sasUri), source, size, getData, context, handleData->blobUploadConcurrency, (manifestFileName != NULL) ? &resume : NULL, &httpResponse, responseToIoTHub);
+                        step2success = (blobResult == BLOB_OK);
+                        if (manifestFileName != NULL)
+                        {
+                            /*a network failure or a server error, which the storage service might not repeat, with the blocks uploaded on record. Anything else (a bad SAS URI, a source that cannot be read) would fail again*/
+                            isResumable = (manifest.file != NULL) && ((blobResult == BLOB_HTTP_ERROR) || ((blobResult == BLOB_OK) && (httpResponse >= 500)));
+                        }
+
+                        if (isResumable)
                         {
-                            LogError("error in IoTHubClient_LL_UploadToBlob_step1");
+                            /*Codes_SRS_IOTHUBCLIENT_LL_02_155: [ If Blob_UploadFromSasUriOnConnection returns BLOB_HTTP_ERROR, or returns BLOB_OK with an HTTP status code of 500 or more, then IoTHubClient_LL_UploadToBlobFromReaderResumable_Impl shall not execute step 3, keep manifestFileName and return IOTHUB_CLIENT_ERROR. ]*/
+                            LogError("the upload of %s was interrupted, it can be resumed from %s", destinationFileName, manifestFileName);
+                            result = IOTHUB_CLIENT_ERROR;
+                        }
+                        else if (!step2success)
+                        {
+                            isUploadOver = 1;
+                            /*Codes_SRS_IOTHUBCLIENT_LL_02_084: [ If Blob_UploadFromSasUri fails then IoTHubClient_LL_UploadToBlob shall fail and return IOTHUB_CLIENT_ERROR. ]*/
+                            LogError("unable to Blob_UploadFromSasUri");
+
+                            /*do step 3*/ /*try*/
+                            /*Codes_SRS_IOTHUBCLIENT_LL_02_091: [ If step 2 fails without establishing an HTTP dialogue, then the HTTP message body shall look like: ]*/
+                            if (BUFFER_build(responseToIoTHub, (const unsigned char*)FILE_UPLOAD_FAILED_BODY, sizeof(FILE_UPLOAD_FAILED_BODY) / sizeof(FILE_UPLOAD_FAILED_BODY[0])) == 0)
+                            {
+                                if (IoTHubClient_LL_UploadToBlob_step3(handleData, correlationId, handleData->iotHubHttpApiExHandle, requestHttpHeaders, responseToIoTHub) != 0)
+                                {
+                                    LogError("IoTHubClient_LL_UploadToBlob_step3 failed");
+                                }
+                            }
                             result = IOTHUB_CLIENT_ERROR;
                         }
                         else
                         {
-                            /*do step 2.*/
+                            isUploadOver = 1;
+                            /*must make a json*/
 
-                            unsigned int httpResponse;
-                            BUFFER_HANDLE responseToIoTHub = BUFFER_new();
-                            if (responseToIoTHub == NULL)
+                            int requiredStringLength = snprintf(NULL, 0, "{\"isSuccess\":%s, \"statusCode\":%d, \"statusDescription\":\"%s\"}", ((httpResponse < 300) ? "true" : "false"), httpResponse, BUFFER_u_char(responseToIoTHub));
+
+                            char* requiredString = malloc(requiredStringLength + 1);
+                            if (requiredString == 0)
                             {
+                                LogError("unable to malloc");
                                 result = IOTHUB_CLIENT_ERROR;
-                                LogError("unable to BUFFER_new");
                             }
                             else
                             {
-                                int step2success;
-                                /*Codes_SRS_IOTHUBCLIENT_LL_02_083: [ IoTHubClient_LL_UploadToBlob shall call Blob_UploadFromSasUri and capture the HTTP return code and HTTP body. ]*/
-                                step2success = (Blob_UploadFromSasUri(STRING_c_str(sasUri), source, size, &httpResponse, responseToIoTHub) == BLOB_OK);
-                                if (!step2success)
+                                /*do again snprintf*/
+                                (void)snprintf(requiredString, requiredStringLength + 1, "{\"isSuccess\":%s, \"statusCode\":%d, \"statusDescription\":\"%s\"}", ((httpResponse < 300) ? "true" : "false"), httpResponse, BUFFER_u_char(responseToIoTHub));
+                                BUFFER_HANDLE toBeTransmitted = BUFFER_create(requiredString, requiredStringLength);
+                                if (toBeTransmitted == NULL)
                                 {
-                                    /*Codes_SRS_IOTHUBCLIENT_LL_02_084: [ If Blob_UploadFromSasUri fails then IoTHubClient_LL_UploadToBlob shall fail and return IOTHUB_CLIENT_ERROR. ]*/
-                                    LogError("unable to Blob_UploadFromSasUri");
-
-                                    /*do step 3*/ /*try*/
-                                    /*Codes_SRS_IOTHUBCLIENT_LL_02_091: [ If step 2 fails without establishing an HTTP dialogue, then the HTTP message body shall look like: ]*/
-                                    if (BUFFER_build(responseToIoTHub, (const unsigned char*)FILE_UPLOAD_FAILED_BODY, sizeof(FILE_UPLOAD_FAILED_BODY) / sizeof(FILE_UPLOAD_FAILED_BODY[0])) == 0)
-                                    {
-                                        if (IoTHubClient_LL_UploadToBlob_step3(handleData, correlationId, iotHubHttpApiExHandle, requestHttpHeaders, responseToIoTHub) != 0)
-                                        {
-                                            LogError("IoTHubClient_LL_UploadToBlob_step3 failed");
-                                        }
-                                    }
+                                    LogError("unable to BUFFER_create");
                                     result = IOTHUB_CLIENT_ERROR;
                                 }
                                 else
                                 {
-                                    /*must make a json*/
-
-                                    int requiredStringLength = snprintf(NULL, 0, "{\"isSuccess\":%s, \"statusCode\":%d, \"statusDescription\":\"%s\"}", ((httpResponse < 300) ? "true" : "false"), httpResponse, BUFFER_u_char(responseToIoTHub));
-
-                                    char* requiredString = malloc(requiredStringLength + 1);
-                                    if (requiredString == 0)
+                                    if (IoTHubClient_LL_UploadToBlob_step3(handleData, correlationId, handleData->iotHubHttpApiExHandle, requestHttpHeaders, toBeTransmitted) != 0)
                                     {
-                                        LogError("unable to malloc");
+                                        LogError("IoTHubClient_LL_UploadToBlob_step3 failed");
                                         result = IOTHUB_CLIENT_ERROR;
                                     }
                                     else
                                     {
-                                        /*do again snprintf*/
-                                        (void)snprintf(requiredString, requiredStringLength + 1, "{\"isSuccess\":%s, \"statusCode\":%d, \"statusDescription\":\"%s\"}", ((httpResponse < 300) ? "true" : "false"), httpResponse, BUFFER_u_char(responseToIoTHub));
-                                        BUFFER_HANDLE toBeTransmitted = BUFFER_create(requiredString, requiredStringLength);
-                                        if (toBeTransmitted == NULL)
-                                        {
-                                            LogError("unable to BUFFER_create");
-                                            result = IOTHUB_CLIENT_ERROR;
-                                        }
-                                        else
-                                        {
-                                            if (IoTHubClient_LL_UploadToBlob_step3(handleData, correlationId, iotHubHttpApiExHandle, requestHttpHeaders, toBeTransmitted) != 0)
-                                            {
-                                                LogError("IoTHubClient_LL_UploadToBlob_step3 failed");
-                                                result = IOTHUB_CLIENT_ERROR;
-                                            }
-                                            else
-                                            {
-                                                result = (httpResponse < 300) ? IOTHUB_CLIENT_OK : IOTHUB_CLIENT_ERROR;
-                                            }
-                                            BUFFER_delete(toBeTransmitted);
-                                        }
-                                        free(requiredString);
+                                        result = (httpResponse < 300) ? IOTHUB_CLIENT_OK : IOTHUB_CLIENT_ERROR;
                                     }
+                                    BUFFER_delete(toBeTransmitted);
                                 }
-                                BUFFER_delete(responseToIoTHub);
+                                free(requiredString);
                             }
                         }
-                        HTTPHeaders_Free(requestHttpHeaders);
+                        BUFFER_delete(responseToIoTHub);
+                    }
+                }
+
+                if (manifestFileName != NULL)
+                {
+                    if (manifest.file != NULL)
+                    {
+                        (void)fclose(manifest.file);
+                    }
+                    free(manifest.isBlockUploaded);
+
+                    /*Codes_SRS_IOTHUBCLIENT_LL_02_156: [ Otherwise IoTHubClient_LL_UploadToBlobFromReaderResumable_Impl shall execute step 3 as IoTHubClient_LL_UploadToBlob does and delete manifestFileName. ]*/
+                    if (isUploadOver)
+                    {
+                        (void)remove(manifestFileName);
                     }
-                    STRING_delete(sasUri);
                 }
-                STRING_delete(correlationId);
+                HTTPHeaders_Free(requestHttpHeaders);
+            }
+            STRING_delete(sasUri);
+        }
+        STRING_delete(correlationId);
+    }
+    return result;
+}
+
+/*the HTTPAPIEX_HANDLE, the HTTPAPIEX_SAS_HANDLEs and the blob connection of handleData cannot serve two uploads at once*/
+static IOTHUB_CLIENT_RESULT IoTHubClient_LL_UploadToBlob_serialized(IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE_DATA* handleData, const char* destinationFileName, const unsigned char* source, size_t size, IOTHUB_CLIENT_FILE_UPLOAD_READ_CALLBACK getData, void* context, const char* sourceVersion, const char* manifestFileName)
+{
+    IOTHUB_CLIENT_RESULT result;
+    /*Codes_SRS_IOTHUBCLIENT_LL_02_172: [ Every upload shall hold the lock created by IoTHubClient_LL_UploadToBlob_Create from before step 1 until after step 3. If acquiring the lock fails then the upload shall fail and return IOTHUB_CLIENT_ERROR. ]*/
+    if (Lock(handleData->uploadLock) != LOCK_OK)
+    {
+        LogError("unable to Lock");
+        result = IOTHUB_CLIENT_ERROR;
+    }
+    else
+    {
+        result = IoTHubClient_LL_UploadToBlob_steps(handleData, destinationFileName, source, size, getData, context, sourceVersion, manifestFileName);
+        (void)Unlock(handleData->uploadLock);
+    }
+    return result;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubClient_LL_UploadToBlob_Impl(IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE handle, const char* destinationFileName, const unsigned char* source, size_t size)
+{
+    IOTHUB_CLIENT_RESULT result;
+
+    /*Codes_SRS_IOTHUBCLIENT_LL_02_061: [ If handle is NULL then IoTHubClient_LL_UploadToBlob shall fail and return IOTHUB_CLIENT_INVALID_ARG. ]*/
+    /*Codes_SRS_IOTHUBCLIENT_LL_02_062: [ If destinationFileName is NULL then IoTHubClient_LL_UploadToBlob shall fail and return IOTHUB_CLIENT_INVALID_ARG. ]*/
+    /*Codes_SRS_IOTHUBCLIENT_LL_02_063: [ If source is NULL and size is greater than 0 then IoTHubClient_LL_UploadToBlob shall fail and return IOTHUB_CLIENT_INVALID_ARG. ]*/
+    if (
+        (handle == NULL) ||
+        (destinationFileName == NULL) ||
+        ((source == NULL) && (size > 0))
+        )
+    {
+        LogError("invalid argument detected handle=%p destinationFileName=%p source=%p size=%zu", handle, destinationFileName, source, size);
+        result = IOTHUB_CLIENT_INVALID_ARG;
+    }
+    else
+    {
+        IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE_DATA* handleData = (IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE_DATA*)handle;
+        result = IoTHubClient_LL_UploadToBlob_serialized(handleData, destinationFileName, source, size, NULL, NULL, NULL, NULL);
+    }
+    return result;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubClient_LL_UploadToBlobFromReader_Impl(IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE handle, const char* destinationFileName, IOTHUB_CLIENT_FILE_UPLOAD_READ_CALLBACK getData, void* context)
+{
+    IOTHUB_CLIENT_RESULT result;
+
+    /*Codes_SRS_IOTHUBCLIENT_LL_02_143: [ If handle, destinationFileName or getData is NULL then IoTHubClient_LL_UploadToBlobFromReader_Impl shall fail and return IOTHUB_CLIENT_INVALID_ARG. ]*/
+    if (
+        (handle == NULL) ||
+        (destinationFileName == NULL) ||
+        (getData == NULL)
+        )
+    {
+        LogError("invalid argument detected handle=%p destinationFileName=%p getData=%p", handle, destinationFileName, getData);
+        result = IOTHUB_CLIENT_INVALID_ARG;
+    }
+    else
+    {
+        result = IoTHubClient_LL_UploadToBlob_serialized((IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE_DATA*)handle, destinationFileName, NULL, 0, getData, context, NULL, NULL);
+    }
+    return result;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubClient_LL_UploadToBlobFromReaderResumable_Impl(IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE handle, const char* destinationFileName, IOTHUB_CLIENT_FILE_UPLOAD_READ_CALLBACK getData, void* context, size_t size, const char* sourceVersion, const char* manifestFileName)
+{
+    IOTHUB_CLIENT_RESULT result;
+
+    /*Codes_SRS_IOTHUBCLIENT_LL_02_151: [ If handle, destinationFileName, getData, sourceVersion or manifestFileName is NULL then IoTHubClient_LL_UploadToBlobFromReaderResumable_Impl shall fail and return IOTHUB_CLIENT_INVALID_ARG. ]*/
+    if (
+        (handle == NULL) ||
+        (destinationFileName == NULL) ||
+        (getData == NULL) ||
+        (sourceVersion == NULL) ||
+        (manifestFileName == NULL)
+        )
+    {
+        LogError("invalid argument detected handle=%p destinationFileName=%p getData=%p sourceVersion=%p manifestFileName=%p", handle, destinationFileName, getData, sourceVersion, manifestFileName);
+        result = IOTHUB_CLIENT_INVALID_ARG;
+    }
+    else
+    {
+        result = IoTHubClient_LL_UploadToBlob_serialized((IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE_DATA*)handle, destinationFileName, NULL, size, getData, context, sourceVersion, manifestFileName);
+    }
+    return result;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubClient_LL_UploadToBlob_SetOption(IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE handle, const char* optionName, const void* value)
+{
+    IOTHUB_CLIENT_RESULT result;
+    /*Codes_SRS_IOTHUBCLIENT_LL_02_141: [ If handle, optionName or value is NULL then IoTHubClient_LL_UploadToBlob_SetOption shall fail and return IOTHUB_CLIENT_INVALID_ARG. ]*/
+    if (
+        (handle == NULL) ||
+        (optionName == NULL) ||
+        (value == NULL)
+        )
+    {
+        LogError("invalid argument detected handle=%p optionName=%p value=%p", handle, optionName, value);
+        result = IOTHUB_CLIENT_INVALID_ARG;
+    }
+    else
+    {
+        IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE_DATA* handleData = (IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE_DATA*)handle;
+
+        /*Codes_SRS_IOTHUBCLIENT_LL_02_138: [ "blobUploadConcurrency" - IoTHubClient_LL_UploadToBlob shall upload up to `*value` blocks of a blob at the same time, each on its own connection. value is a pointer to a size_t. ]*/
+        if (strcmp(optionName, "blobUploadConcurrency") == 0)
+        {
+            if (*(const size_t*)value == 0)
+            {
+                /*Codes_SRS_IOTHUBCLIENT_LL_02_139: [ If the value of "blobUploadConcurrency" is 0 then IoTHubClient_LL_SetOption shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+                LogError("blobUploadConcurrency cannot be 0");
+                result = IOTHUB_CLIENT_INVALID_ARG;
+            }
+            else
+            {
+                handleData->blobUploadConcurrency = *(const size_t*)value;
+                result = IOTHUB_CLIENT_OK;
             }
-            HTTPAPIEX_Destroy(iotHubHttpApiExHandle);
+        }
+        else
+        {
+            /*Codes_SRS_IOTHUBCLIENT_LL_02_142: [ If optionName is not an option of IoTHubClient_LL_UploadToBlob then IoTHubClient_LL_UploadToBlob_SetOption shall fail and return IOTHUB_CLIENT_INVALID_ARG. ]*/
+            LogError("unknown option %s", optionName);
+            result = IOTHUB_CLIENT_INVALID_ARG;
         }
     }
     return result;
@@ -757,6 +1232,19 @@ void IoTHubClient_LL_UploadToBlob_Destroy(IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE h
     else
     {
         IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE_DATA* handleData = (IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE_DATA*)handle;
+        /*Codes_SRS_IOTHUBCLIENT_LL_02_165: [ IoTHubClient_LL_UploadToBlob_Destroy shall call Blob_DestroyConnection, destroy the HTTPAPIEX_SAS_HANDLEs and destroy the HTTPAPIEX_HANDLE. ]*/
+        /*Codes_SRS_IOTHUBCLIENT_LL_02_173: [ IoTHubClient_LL_UploadToBlob_Destroy shall call Lock_Deinit on the lock created by IoTHubClient_LL_UploadToBlob_Create. ]*/
+        (void)Lock_Deinit(handleData->uploadLock);
+        Blob_DestroyConnection(handleData->blobConnection);
+        if (handleData->step3SasHandle != NULL)
+        {
+            HTTPAPIEX_SAS_Destroy(handleData->step3SasHandle);
+        }
+        if (handleData->step1SasHandle != NULL)
+        {
+            HTTPAPIEX_SAS_Destroy(handleData->step1SasHandle);
+        }
+        HTTPAPIEX_Destroy(handleData->iotHubHttpApiExHandle);
         switch (handleData->authorizationScheme)
         {
             case(SAS_TOKEN):
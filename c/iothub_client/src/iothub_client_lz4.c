@@ -0,0 +1,150 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#ifdef _CRTDBG_MAP_ALLOC
+#include <crtdbg.h>
+#endif
+#include <stdint.h>
+#include <string.h>
+
+#include "iothub_client_lz4.h"
+
+/*the constraints of the LZ4 block format: a match is at least MINMATCH bytes long, the last LASTLITERALS bytes are always literals and the last match starts at least MFLIMIT bytes before the end*/
+#define MINMATCH 4
+#define LASTLITERALS 5
+#define MFLIMIT 12
+#define MAX_DISTANCE 65535
+#define RUN_MASK 15
+
+/*2^HASH_LOG positions of previously seen sequences, kept on the stack (2KB)*/
+#define HASH_LOG 9
+#define HASH_SIZE (1 << HASH_LOG)
+
+static uint32_t read32(const unsigned char* source)
+{
+    uint32_t result;
+    (void)memcpy(&result, source, sizeof(result));
+    return result;
+}
+
+static size_t hashSequence(uint32_t sequence)
+{
+    return (size_t)((sequence * 2654435761U) >> (32 - HASH_LOG));
+}
+
+/*lengths that do not fit in the 4 bits of the token continue in bytes of 255, ended by a byte lower than 255*/
+static unsigned char* writeLength(unsigned char* destination, size_t length)
+{
+    while (length >= 255)
+    {
+        *destination++ = 255;
+        length -= 255;
+    }
+    *destination++ = (unsigned char)length;
+    return destination;
+}
+
+static unsigned char* writeSequence(unsigned char* destination, const unsigned char* literals, size_t literalLength, size_t offset, size_t matchLength)
+{
+    unsigned char* token = destination++;
+    *token = (unsigned char)(((literalLength < RUN_MASK) ? literalLength : RUN_MASK) << 4);
+    if (literalLength >= RUN_MASK)
+    {
+        destination = writeLength(destination, literalLength - RUN_MASK);
+    }
+    (void)memcpy(destination, literals, literalLength);
+    destination += literalLength;
+
+    /*the last sequence of a block has only literals*/
+    if (offset != 0)
+    {
+        *destination++ = (unsigned char)(offset & 0xFF);
+        *destination++ = (unsigned char)(offset >> 8);
+        matchLength -= MINMATCH;
+        *token |= (unsigned char)((matchLength < RUN_MASK) ? matchLength : RUN_MASK);
+        if (matchLength >= RUN_MASK)
+        {
+            destination = writeLength(destination, matchLength - RUN_MASK);
+        }
+    }
+    return destination;
+}
+
+size_t IoTHubClient_LZ4_GetMaxCompressedLength(size_t size)
+{
+    /*Codes_SRS_IOTHUB_CLIENT_LZ4_02_001: [ IoTHubClient_LZ4_GetMaxCompressedLength shall return size + size / 255 + 16, the length of the LZ4 block of size bytes that do not compress at all. ]*/
+    return size + (size / 255) + 16;
+}
+
+size_t IoTHubClient_LZ4_Compress(unsigned char* destination, size_t destinationSize, const unsigned char* source, size_t size)
+{
+    size_t result;
+    if (
+        /*Codes_SRS_IOTHUB_CLIENT_LZ4_02_002: [ If destination is NULL then IoTHubClient_LZ4_Compress shall fail and return 0. ]*/
+        (destination == NULL) ||
+        /*Codes_SRS_IOTHUB_CLIENT_LZ4_02_003: [ If source is NULL and size is not zero then IoTHubClient_LZ4_Compress shall fail and return 0. ]*/
+        ((source == NULL) && (size != 0))
+        )
+    {
+        result = 0;
+    }
+    /*Codes_SRS_IOTHUB_CLIENT_LZ4_02_004: [ If destinationSize is smaller than IoTHubClient_LZ4_GetMaxCompressedLength(size) then IoTHubClient_LZ4_Compress shall fail and return 0. ]*/
+    else if (destinationSize < IoTHubClient_LZ4_GetMaxCompressedLength(size))
+    {
+        result = 0;
+    }
+    else
+    {
+        /*Codes_SRS_IOTHUB_CLIENT_LZ4_02_005: [ IoTHubClient_LZ4_Compress shall write at destination the size bytes at source as one LZ4 block. ]*/
+        unsigned char* output = destination;
+        const unsigned char* anchor = source;
+
+        /*inputs shorter than MFLIMIT + 1 cannot have a match, they are a single run of literals*/
+        if (size > MFLIMIT)
+        {
+            uint32_t positions[HASH_SIZE];
+            const unsigned char* current = source;
+            const unsigned char* lastMatchStart = source + size - MFLIMIT;
+            const unsigned char* matchEndLimit = source + size - LASTLITERALS;
+
+            /*every position is checked against read32 before it is used, so the table only needs to be initialized to any position inside source*/
+            (void)memset(positions, 0, sizeof(positions));
+
+            while (current <= lastMatchStart)
+            {
+                uint32_t sequence = read32(current);
+                size_t hash = hashSequence(sequence);
+                const unsigned char* candidate = source + positions[hash];
+                positions[hash] = (uint32_t)(current - source);
+
+                if ((candidate < current) &&
+                    ((size_t)(current - candidate) <= MAX_DISTANCE) &&
+                    (read32(candidate) == sequence))
+                {
+                    const unsigned char* matchEnd = current + MINMATCH;
+                    candidate += MINMATCH;
+                    while ((matchEnd < matchEndLimit) && (*matchEnd == *candidate))
+                    {
+                        matchEnd++;
+                        candidate++;
+                    }
+
+                    output = writeSequence(output, anchor, (size_t)(current - anchor), (size_t)(matchEnd - candidate), (size_t)(matchEnd - current));
+                    current = matchEnd;
+                    anchor = current;
+                }
+                else
+                {
+                    current++;
+                }
+            }
+        }
+
+        output = writeSequence(output, anchor, (size_t)(source + size - anchor), 0, 0);
+
+        /*Codes_SRS_IOTHUB_CLIENT_LZ4_02_006: [ IoTHubClient_LZ4_Compress shall return the number of bytes written at destination. ]*/
+        result = (size_t)(output - destination);
+    }
+    return result;
+}
@@ -2,6 +2,7 @@
 // Licensed under the MIT license. See LICENSE file in the project root for full license information.
 
 #include <stdlib.h>
+#include <string.h>
 #ifdef _CRTDBG_MAP_ALLOC
 #include <crtdbg.h>
 #endif
@@ -25,6 +26,8 @@ typedef struct IOTHUB_MESSAGE_HANDLE_DATA_TAG
         BUFFER_HANDLE byteArray;
         STRING_HANDLE string;
     } value;
+    unsigned char* inlinePayload; /*when not NULL the payload is stored right after this structure and value is not used*/
+    size_t inlinePayloadSize; /*for STRING messages this does not count the '\0' that follows the payload*/
     MAP_HANDLE properties;
     char* messageId;
     char* correlationId;
@@ -62,10 +65,19 @@ static int ValidateAsciiCharactersFilter(const char* mapKey, const char* mapValu
     return result;
 }
 
+static void setInlinePayload(IOTHUB_MESSAGE_HANDLE_DATA* handleData, const unsigned char* source, size_t size, size_t bytesToCopy)
+{
+    handleData->inlinePayload = (unsigned char*)(handleData + 1);
+    handleData->inlinePayloadSize = size;
+    (void)memcpy(handleData->inlinePayload, source, bytesToCopy);
+}
+
 IOTHUB_MESSAGE_HANDLE IoTHubMessage_CreateFromByteArray(const unsigned char* byteArray, size_t size)
 {
     IOTHUB_MESSAGE_HANDLE_DATA* result;
-    result = malloc(sizeof(IOTHUB_MESSAGE_HANDLE_DATA));
+    /*Codes_SRS_IOTHUBMESSAGE_02_034: [ If size is not bigger than IOTHUB_MESSAGE_INLINE_PAYLOAD_SIZE then IoTHubMessage_CreateFromByteArray shall store a copy of byteArray in the same allocation as the message and shall not call BUFFER_create. ]*/
+    bool storeInline = (size <= IOTHUB_MESSAGE_INLINE_PAYLOAD_SIZE);
+    result = malloc(sizeof(IOTHUB_MESSAGE_HANDLE_DATA) + (storeInline ? size : 0));
     if (result == NULL)
     {
         LogError("unable to malloc");
@@ -98,8 +110,19 @@ IOTHUB_MESSAGE_HANDLE IoTHubMessage_CreateFromByteArray(const unsigned char* byt
         }
         if (result != NULL)
         {
-            /*Codes_SRS_IOTHUBMESSAGE_02_022: [IoTHubMessage_CreateFromByteArray shall call BUFFER_create passing byteArray and size as parameters.] */
-            if ((result->value.byteArray = BUFFER_create(source, size)) == NULL)
+            if (storeInline)
+            {
+                result->value.byteArray = NULL;
+                setInlinePayload(result, source, size, size);
+            }
+            else
+            {
+                result->inlinePayload = NULL;
+                /*Codes_SRS_IOTHUBMESSAGE_02_022: [IoTHubMessage_CreateFromByteArray shall call BUFFER_create passing byteArray and size as parameters.] */
+                result->value.byteArray = BUFFER_create(source, size);
+            }
+
+            if ((result->inlinePayload == NULL) && (result->value.byteArray == NULL))
             {
                 LogError("BUFFER_create failed");
                 /*Codes_SRS_IOTHUBMESSAGE_02_024: [If there are any errors then IoTHubMessage_CreateFromByteArray shall return NULL.] */
@@ -111,7 +134,10 @@ IOTHUB_MESSAGE_HANDLE IoTHubMessage_CreateFromByteArray(const unsigned char* byt
             {
                 LogError("Map_Create failed");
                 /*Codes_SRS_IOTHUBMESSAGE_02_024: [If there are any errors then IoTHubMessage_CreateFromByteArray shall return NULL.] */
-                BUFFER_delete(result->value.byteArray);
+                if (result->inlinePayload == NULL)
+                {
+                    BUFFER_delete(result->value.byteArray);
+                }
                 free(result);
                 result = NULL;
             }
@@ -131,7 +157,10 @@ IOTHUB_MESSAGE_HANDLE IoTHubMessage_CreateFromByteArray(const unsigned char* byt
 IOTHUB_MESSAGE_HANDLE IoTHubMessage_CreateFromString(const char* source)
 {
     IOTHUB_MESSAGE_HANDLE_DATA* result;
-    result = malloc(sizeof(IOTHUB_MESSAGE_HANDLE_DATA));
+    /*Codes_SRS_IOTHUBMESSAGE_02_035: [ If the length of source is not bigger than IOTHUB_MESSAGE_INLINE_PAYLOAD_SIZE then IoTHubMessage_CreateFromString shall store a copy of source (including its '\0') in the same allocation as the message and shall not call STRING_construct. ]*/
+    size_t length = (source == NULL) ? 0 : strlen(source);
+    bool storeInline = (source != NULL) && (length <= IOTHUB_MESSAGE_INLINE_PAYLOAD_SIZE);
+    result = malloc(sizeof(IOTHUB_MESSAGE_HANDLE_DATA) + (storeInline ? length + 1 : 0));
     if (result == NULL)
     {
         LogError("malloc failed");
@@ -140,8 +169,19 @@ IOTHUB_MESSAGE_HANDLE IoTHubMessage_CreateFromString(const char* source)
     }
     else
     {
-        /*Codes_SRS_IOTHUBMESSAGE_02_027: [IoTHubMessage_CreateFromString shall call STRING_construct passing source as parameter.] */
-        if ((result->value.string = STRING_construct(source)) == NULL)
+        if (storeInline)
+        {
+            result->value.string = NULL;
+            setInlinePayload(result, (const unsigned char*)source, length, length + 1);
+        }
+        else
+        {
+            result->inlinePayload = NULL;
+            /*Codes_SRS_IOTHUBMESSAGE_02_027: [IoTHubMessage_CreateFromString shall call STRING_construct passing source as parameter.] */
+            result->value.string = STRING_construct(source);
+        }
+
+        if ((result->inlinePayload == NULL) && (result->value.string == NULL))
         {
             LogError("STRING_construct failed");
             /*Codes_SRS_IOTHUBMESSAGE_02_029: [If there are any encountered in the execution of IoTHubMessage_CreateFromString then IoTHubMessage_CreateFromString shall return NULL.] */
@@ -153,7 +193,10 @@ IOTHUB_MESSAGE_HANDLE IoTHubMessage_CreateFromString(const char* source)
         {
             LogError("Map_Create failed");
             /*Codes_SRS_IOTHUBMESSAGE_02_029: [If there are any encountered in the execution of IoTHubMessage_CreateFromString then IoTHubMessage_CreateFromString shall return NULL.] */
-            STRING_delete(result->value.string);
+            if (result->inlinePayload == NULL)
+            {
+                STRING_delete(result->value.string);
+            }
             free(result);
             result = NULL;
         }
@@ -182,7 +225,9 @@ IOTHUB_MESSAGE_HANDLE IoTHubMessage_Clone(IOTHUB_MESSAGE_HANDLE iotHubMessageHan
     }
     else
     {
-        result = (IOTHUB_MESSAGE_HANDLE_DATA*)malloc(sizeof(IOTHUB_MESSAGE_HANDLE_DATA));
+        /*inline payloads are copied together with the message, STRING payloads are followed by their '\0'*/
+        size_t inlineBytes = (source->inlinePayload == NULL) ? 0 : (source->inlinePayloadSize + ((source->contentType == IOTHUBMESSAGE_STRING) ? 1 : 0));
+        result = (IOTHUB_MESSAGE_HANDLE_DATA*)malloc(sizeof(IOTHUB_MESSAGE_HANDLE_DATA) + inlineBytes);
         /*Codes_SRS_IOTHUBMESSAGE_03_004: [IoTHubMessage_Clone shall return NULL if it fails for any reason.]*/
         if (result == NULL)
         {
@@ -194,6 +239,7 @@ IOTHUB_MESSAGE_HANDLE IoTHubMessage_Clone(IOTHUB_MESSAGE_HANDLE iotHubMessageHan
         {
             result->messageId = NULL;
             result->correlationId = NULL;
+            result->inlinePayload = NULL;
             if (source->messageId != NULL && mallocAndStrcpy_s(&result->messageId, source->messageId) != 0)
             {
                 LogError("unable to Copy messageId");
@@ -211,6 +257,34 @@ IOTHUB_MESSAGE_HANDLE IoTHubMessage_Clone(IOTHUB_MESSAGE_HANDLE iotHubMessageHan
                 free(result);
                 result = NULL;
             }
+            else if (source->inlinePayload != NULL)
+            {
+                /*Codes_SRS_IOTHUBMESSAGE_02_005: [IoTHubMessage_Clone shall clone the properties map by using Map_Clone.] */
+                if ((result->properties = Map_Clone(source->properties)) == NULL)
+                {
+                    /*Codes_SRS_IOTHUBMESSAGE_03_004: [IoTHubMessage_Clone shall return NULL if it fails for any reason.]*/
+                    LogError("unable to Map_Clone");
+                    if (result->messageId != NULL)
+                    {
+                        free(result->messageId);
+                        result->messageId = NULL;
+                    }
+                    if (result->correlationId != NULL)
+                    {
+                        free(result->correlationId);
+                        result->correlationId = NULL;
+                    }
+                    free(result);
+                    result = NULL;
+                }
+                else
+                {
+                    /*Codes_SRS_IOTHUBMESSAGE_02_036: [ If the payload of iotHubMessageHandle is stored inline then IoTHubMessage_Clone shall copy it inline in the new message. ]*/
+                    result->value.byteArray = NULL;
+                    setInlinePayload(result, source->inlinePayload, source->inlinePayloadSize, inlineBytes);
+                    result->contentType = source->contentType;
+                }
+            }
             else if (source->contentType == IOTHUBMESSAGE_BYTEARRAY)
             {
                 /*Codes_SRS_IOTHUBMESSAGE_02_006: [IoTHubMessage_Clone shall clone to content by a call to BUFFER_clone] */
@@ -331,10 +405,19 @@ IOTHUB_MESSAGE_RESULT IoTHubMessage_GetByteArray(IOTHUB_MESSAGE_HANDLE iotHubMes
         }
         else
         {
-            /*Codes_SRS_IOTHUBMESSAGE_01_011: [The pointer shall be obtained by using BUFFER_u_char and it shall be copied in the buffer argument.]*/
-            *buffer = BUFFER_u_char(handleData->value.byteArray);
-            /*Codes_SRS_IOTHUBMESSAGE_01_012: [The size of the associated data shall be obtained by using BUFFER_length and it shall be copied to the size argument.]*/
-            *size = BUFFER_length(handleData->value.byteArray);
+            if (handleData->inlinePayload != NULL)
+            {
+                /*Codes_SRS_IOTHUBMESSAGE_02_037: [ If the payload is stored inline then IoTHubMessage_GetByteArray shall return in buffer and size the inline payload. ]*/
+                *buffer = handleData->inlinePayload;
+                *size = handleData->inlinePayloadSize;
+            }
+            else
+            {
+                /*Codes_SRS_IOTHUBMESSAGE_01_011: [The pointer shall be obtained by using BUFFER_u_char and it shall be copied in the buffer argument.]*/
+                *buffer = BUFFER_u_char(handleData->value.byteArray);
+                /*Codes_SRS_IOTHUBMESSAGE_01_012: [The size of the associated data shall be obtained by using BUFFER_length and it shall be copied to the size argument.]*/
+                *size = BUFFER_length(handleData->value.byteArray);
+            }
             result = IOTHUB_MESSAGE_OK;
         }
     }
@@ -357,6 +440,11 @@ const char* IoTHubMessage_GetString(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle)
             /*Codes_SRS_IOTHUBMESSAGE_02_017: [IoTHubMessage_GetString shall return NULL if the iotHubMessageHandle does not refer to a IOTHUBMESSAGE of type STRING.] */
             result = NULL;
         }
+        else if (handleData->inlinePayload != NULL)
+        {
+            /*Codes_SRS_IOTHUBMESSAGE_02_038: [ If the payload is stored inline then IoTHubMessage_GetString shall return the inline null terminated string. ]*/
+            result = (const char*)handleData->inlinePayload;
+        }
         else
         {
             /*Codes_SRS_IOTHUBMESSAGE_02_018: [IoTHubMessage_GetStringData shall return the currently stored null terminated string.] */
@@ -507,7 +595,11 @@ void IoTHubMessage_Destroy(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle)
     {
         /*Codes_SRS_IOTHUBMESSAGE_01_003: [IoTHubMessage_Destroy shall free all resources associated with iotHubMessageHandle.]  */
         IOTHUB_MESSAGE_HANDLE_DATA* handleData = iotHubMessageHandle;
-        if (handleData->contentType == IOTHUBMESSAGE_BYTEARRAY)
+        if (handleData->inlinePayload != NULL)
+        {
+            /*the payload goes away with handleData*/
+        }
+        else if (handleData->contentType == IOTHUBMESSAGE_BYTEARRAY)
         {
             BUFFER_delete(handleData->value.byteArray);
         }
@@ -26,10 +26,14 @@ typedef struct TRANSPORT_HANDLE_DATA_TAG
     THREAD_HANDLE workerThreadHandle;
     LOCK_HANDLE lockHandle;
     sig_atomic_t stopThread;
+    sig_atomic_t workPending; /*set every time a client (re)starts the worker thread, that is, every time a client enqueues work*/
+    unsigned int maxIdleSleep; /*upper bound (in ms) of the worker thread sleep when no client has enqueued work*/
 	TRANSPORT_PROVIDER_FIELDS;
 	VECTOR_HANDLE clients;
 } TRANSPORT_HANDLE_DATA;
 
+#define MIN_WORKER_SLEEP 1 /*ms*/
+
 /* Used for Unit test */
 const size_t IoTHubTransport_ThreadTerminationOffset = offsetof(TRANSPORT_HANDLE_DATA, stopThread);
 
@@ -108,6 +112,8 @@ TRANSPORT_HANDLE  IoTHubTransport_Create(IOTHUB_CLIENT_TRANSPORT_PROVIDER protoc
 					{
 						/*Codes_SRS_IOTHUBTRANSPORT_17_001: [ IoTHubTransport_Create shall return a non-NULL handle on success.]*/
 						result->stopThread = 1;
+						result->workPending = 0;
+						result->maxIdleSleep = MIN_WORKER_SLEEP;
 						result->workerThreadHandle = NULL; /* create thread when work needs to be done */
                         result->IoTHubTransport_GetHostname = transportProtocol->IoTHubTransport_GetHostname;
 						result->IoTHubTransport_SetOption = transportProtocol->IoTHubTransport_SetOption;
@@ -128,9 +134,54 @@ TRANSPORT_HANDLE  IoTHubTransport_Create(IOTHUB_CLIENT_TRANSPORT_PROVIDER protoc
 	return result;
 }
 
+/*called with the lock held, returns true when any client still has messages waiting or in flight*/
+static bool any_client_busy(TRANSPORT_HANDLE_DATA* transportData)
+{
+	bool result = false;
+	size_t clientCount = VECTOR_size(transportData->clients);
+	size_t i;
+	for (i = 0; (i < clientCount) && !result; i++)
+	{
+		IOTHUB_CLIENT_HANDLE* clientHandle = (IOTHUB_CLIENT_HANDLE*)VECTOR_element(transportData->clients, i);
+		IOTHUB_CLIENT_STATUS sendStatus;
+		result = (IoTHubClient_LL_GetSendStatus(IoTHubClient_GetLLHandle(*clientHandle), &sendStatus) != IOTHUB_CLIENT_OK) ||
+			(sendStatus != IOTHUB_CLIENT_SEND_STATUS_IDLE);
+	}
+	return result;
+}
+
+/*called with the lock held, after the lower layer DoWork, returns how long the worker thread shall sleep*/
+static unsigned int compute_next_sleep(TRANSPORT_HANDLE_DATA* transportData, unsigned int previousSleep)
+{
+	unsigned int result;
+	if (transportData->maxIdleSleep <= MIN_WORKER_SLEEP)
+	{
+		/*Codes_SRS_IOTHUBTRANSPORT_17_029: [ The thread shall call lower layer transport DoWork every 1 ms. ]*/
+		result = MIN_WORKER_SLEEP;
+	}
+	else if (transportData->workPending)
+	{
+		/*Codes_SRS_IOTHUBTRANSPORT_02_002: [ If any client has called IoTHubTransport_StartWorkerThread since the last lower layer DoWork then the thread shall sleep 1 ms. ]*/
+		transportData->workPending = 0;
+		result = MIN_WORKER_SLEEP;
+	}
+	else if (any_client_busy(transportData))
+	{
+		/*Codes_SRS_IOTHUBTRANSPORT_02_006: [ If IoTHubClient_LL_GetSendStatus fails or reports IOTHUB_CLIENT_SEND_STATUS_BUSY for any client then the thread shall sleep 1 ms. ]*/
+		result = MIN_WORKER_SLEEP;
+	}
+	else
+	{
+		/*Codes_SRS_IOTHUBTRANSPORT_02_003: [ Otherwise the thread shall double the previous sleep time without exceeding the value set by IoTHubTransport_SetMaxIdleSleep. ]*/
+		result = (previousSleep > transportData->maxIdleSleep / 2) ? transportData->maxIdleSleep : previousSleep * 2;
+	}
+	return result;
+}
+
 static int transport_worker_thread(void* threadArgument)
 {
 	TRANSPORT_HANDLE_DATA* transportData = (TRANSPORT_HANDLE_DATA*)threadArgument;
+	unsigned int sleepTime = MIN_WORKER_SLEEP;
 
 	while (1)
 	{
@@ -147,11 +198,11 @@ static int transport_worker_thread(void* threadArgument)
 			else
 			{
 				(transportData->IoTHubTransport_DoWork)(transportData->transportLLHandle, NULL);
+				sleepTime = compute_next_sleep(transportData, sleepTime);
 				(void)Unlock(transportData->lockHandle);
 			}
 		}
-		/*Codes_SRS_IOTHUBTRANSPORT_17_029: [ The thread shall call lower layer transport DoWork every 1 ms. ]*/
-		ThreadAPI_Sleep(1);
+		ThreadAPI_Sleep(sleepTime);
 	}
 
 	return 0;
@@ -168,6 +219,8 @@ static bool find_by_handle(const void* element, const void* value)
 static IOTHUB_CLIENT_RESULT start_worker_if_needed(TRANSPORT_HANDLE_DATA * transportData, IOTHUB_CLIENT_HANDLE clientHandle)
 {
 	IOTHUB_CLIENT_RESULT result;
+	/*Codes_SRS_IOTHUBTRANSPORT_02_001: [ IoTHubTransport_StartWorkerThread shall mark that work is pending. ]*/
+	transportData->workPending = 1;
 	if (transportData->workerThreadHandle == NULL)
 	{
 		/*Codes_SRS_IOTHUBTRANSPORT_17_018: [ If the worker thread does not exist, IoTHubTransport_StartWorkerThread shall start the thread using ThreadAPI_Create. ]*/
@@ -373,3 +426,22 @@ void IoTHubTransport_JoinWorkerThread(TRANSPORT_HANDLE transportHandle, IOTHUB_C
 		wait_worker_thread(transportData);
 	}
 }
+
+IOTHUB_CLIENT_RESULT IoTHubTransport_SetMaxIdleSleep(TRANSPORT_HANDLE transportHandle, unsigned int maxIdleSleep)
+{
+	IOTHUB_CLIENT_RESULT result;
+	if (transportHandle == NULL)
+	{
+		/*Codes_SRS_IOTHUBTRANSPORT_02_004: [ If transportHandle is NULL, IoTHubTransport_SetMaxIdleSleep shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+		LogError("invalid arg TRANSPORT_HANDLE transportHandle=%p", transportHandle);
+		result = IOTHUB_CLIENT_INVALID_ARG;
+	}
+	else
+	{
+		/*Codes_SRS_IOTHUBTRANSPORT_02_005: [ IoTHubTransport_SetMaxIdleSleep shall set the maximum time the worker thread sleeps when no work is pending and return IOTHUB_CLIENT_OK. Values less than 1 shall be treated as 1. ]*/
+		TRANSPORT_HANDLE_DATA * transportData = (TRANSPORT_HANDLE_DATA*)transportHandle;
+		transportData->maxIdleSleep = (maxIdleSleep < MIN_WORKER_SLEEP) ? MIN_WORKER_SLEEP : maxIdleSleep;
+		result = IOTHUB_CLIENT_OK;
+	}
+	return result;
+}
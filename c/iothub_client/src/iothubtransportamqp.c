@@ -8,6 +8,7 @@
 #include <stdint.h>
 #include <time.h>
 #include <limits.h>
+#include <string.h>
 #include "azure_c_shared_utility/gballoc.h"
 #include "azure_c_shared_utility/crt_abstractions.h"
 #include "azure_c_shared_utility/doublylinkedlist.h"
@@ -22,6 +23,7 @@
 #include "azure_uamqp_c/link.h"
 #include "azure_uamqp_c/message.h"
 #include "azure_uamqp_c/amqpvalue.h"
+#include "azure_uamqp_c/amqp_definitions.h"
 #include "azure_uamqp_c/message_receiver.h"
 #include "azure_uamqp_c/message_sender.h"
 #include "azure_uamqp_c/messaging.h"
@@ -51,6 +53,12 @@
 #define MESSAGE_SENDER_LINK_NAME "sender-link"
 #define MESSAGE_SENDER_SOURCE_ADDRESS "ingress"
 #define MESSAGE_SENDER_MAX_LINK_SIZE UINT64_MAX
+#define IOTHUB_BATCHING_MESSAGE_FORMAT 0x80013700
+#define MAXIMUM_BATCH_MESSAGE_SIZE (256 * 1024)
+// Descriptor (3 bytes) and vbin32 header (5 bytes) of each data section in a batch message.
+#define BATCH_DATA_SECTION_OVERHEAD 8
+// An event with no properties and an empty body still takes a data section descriptor (3 bytes) and a vbin8 header (2 bytes), so no more events than this fit in a batch message.
+#define MAXIMUM_EVENTS_PER_BATCH (MAXIMUM_BATCH_MESSAGE_SIZE / (BATCH_DATA_SECTION_OVERHEAD + 5))
 
 typedef XIO_HANDLE(*TLS_IO_TRANSPORT_PROVIDER)(const char* fqdn, int port);
 
@@ -67,18 +75,8 @@ typedef struct AMQP_TRANSPORT_STATE_TAG
     STRING_HANDLE iotHubHostFqdn;
     // AMQP port of the IoT Hub.
     int iotHubPort;
-    // Key associated to the device to be used.
-    STRING_HANDLE deviceKey;
-    // SAS associated to the device to be used.
-    STRING_HANDLE deviceSasToken;
-    // Address to which the transport will connect to and send events.
-    STRING_HANDLE targetAddress;
-    // Address to which the transport will connect to and receive messages from.
-    STRING_HANDLE messageReceiveAddress;
     // A component of the SAS token. Currently this must be an empty string.
     STRING_HANDLE sasTokenKeyName;
-    // Internal parameter that identifies the current logical device within the service.
-    STRING_HANDLE devicesPath;
     // How long a SAS token created by the transport is valid, in milliseconds.
     size_t sas_token_lifetime;
     // Maximum period of time for the transport to wait before refreshing the SAS token it created previously, in milliseconds.
@@ -87,8 +85,6 @@ typedef struct AMQP_TRANSPORT_STATE_TAG
     size_t cbs_request_timeout;
     // Maximum time for the connection establishment/retry logic should wait for a connection to succeed, in milliseconds.
     size_t connection_timeout;
-    // Saved reference to the IoTHub LL Client.
-    IOTHUB_CLIENT_LL_HANDLE iothub_client_handle;
 
     // TSL I/O transport.
     XIO_HANDLE tls_io;
@@ -106,6 +102,41 @@ typedef struct AMQP_TRANSPORT_STATE_TAG
     size_t connection_establish_time;
     // AMQP session.
     SESSION_HANDLE session;
+    // Connection instance with the Azure IoT CBS.
+    CBS_HANDLE cbs;
+    // Devices registered in the transport (AMQP_TRANSPORT_PERDEVICE_DATA). They all share the connection, the session and the CBS instance.
+    DLIST_ENTRY registered_devices;
+    // Devices unregistered while a cbs_put_token() they are the context of was pending. They are freed when the last one completes or when the CBS instance is destroyed.
+    DLIST_ENTRY unregistered_devices;
+    // Turns logging on and off
+    bool is_trace_on;
+    // Pack the pending events of a device into batch messages instead of sending them one by one.
+    bool is_batching_on;
+} AMQP_TRANSPORT_INSTANCE;
+
+typedef struct AMQP_TRANSPORT_PERDEVICE_DATA_TAG
+{
+    // Transport the device is registered in.
+    AMQP_TRANSPORT_INSTANCE* transport_state;
+    // Entry in transport_state->registered_devices (or in transport_state->unregistered_devices once is_unregistered is true).
+    DLIST_ENTRY entry;
+    // Set by IoTHubTransportAMQP_Unregister when the device state has to outlive its pending cbs_put_token() calls.
+    bool is_unregistered;
+    // Key associated to the device to be used.
+    STRING_HANDLE deviceKey;
+    // SAS associated to the device to be used.
+    STRING_HANDLE deviceSasToken;
+    // Internal parameter that identifies the current logical device within the service.
+    STRING_HANDLE devicesPath;
+    // Address to which the transport will connect to and send events.
+    STRING_HANDLE targetAddress;
+    // Address to which the transport will connect to and receive messages from.
+    STRING_HANDLE messageReceiveAddress;
+    // Names of the AMQP links of the device. They have to be unique within the session.
+    STRING_HANDLE senderLinkName;
+    STRING_HANDLE receiverLinkName;
+    // Saved reference to the IoTHub LL Client.
+    IOTHUB_CLIENT_LL_HANDLE iothub_client_handle;
     // AMQP link used by the event sender.
     LINK_HANDLE sender_link;
     // uAMQP event sender.
@@ -120,17 +151,21 @@ typedef struct AMQP_TRANSPORT_STATE_TAG
     PDLIST_ENTRY waitingToSend;
     // Internal list with the items currently being processed/sent through uAMQP.
     DLIST_ENTRY inProgress;
-    // Connection instance with the Azure IoT CBS.
-    CBS_HANDLE cbs;
-    // Current state of the CBS connection.
+    // Current state of the CBS authentication of the device.
     CBS_STATE cbs_state;
+    // Number of cbs_put_token() calls that have the device state as context and have not completed yet.
+    size_t pending_put_token_count;
     // Time when the current SAS token was created, in seconds since epoch.
     size_t current_sas_token_create_time;
-    // Mark if device is registered in transport (only one device per transport).
-    bool isRegistered;
-    // Turns logging on and off
-    bool is_trace_on;
-} AMQP_TRANSPORT_INSTANCE;
+} AMQP_TRANSPORT_PERDEVICE_DATA;
+
+typedef struct AMQP_EVENT_BATCH_TAG
+{
+    // Number of events packed in the batch message.
+    size_t count;
+    // Events packed in the batch message, in the order they were queued. Allocated together with the batch.
+    IOTHUB_MESSAGE_LIST** events;
+} AMQP_EVENT_BATCH;
 
 
 
@@ -163,19 +198,19 @@ static size_t getSecondsSinceEpoch(void)
     return (size_t)(difftime(get_time(NULL), (time_t)0));
 }
 
-static void trackEventInProgress(IOTHUB_MESSAGE_LIST* message, AMQP_TRANSPORT_INSTANCE* transport_state)
+static void trackEventInProgress(IOTHUB_MESSAGE_LIST* message, AMQP_TRANSPORT_PERDEVICE_DATA* device_state)
 {
     DList_RemoveEntryList(&message->entry);
-    DList_InsertTailList(&transport_state->inProgress, &message->entry);
+    DList_InsertTailList(&device_state->inProgress, &message->entry);
 }
 
-static IOTHUB_MESSAGE_LIST* getNextEventToSend(AMQP_TRANSPORT_INSTANCE* transport_state)
+static IOTHUB_MESSAGE_LIST* getNextEventToSend(AMQP_TRANSPORT_PERDEVICE_DATA* device_state)
 {
     IOTHUB_MESSAGE_LIST* message;
 
-    if (!DList_IsListEmpty(transport_state->waitingToSend))
+    if (!DList_IsListEmpty(device_state->waitingToSend))
     {
-        PDLIST_ENTRY list_entry = transport_state->waitingToSend->Flink;
+        PDLIST_ENTRY list_entry = device_state->waitingToSend->Flink;
         message = containingRecord(list_entry, IOTHUB_MESSAGE_LIST, entry);
     }
     else
@@ -197,26 +232,31 @@ static void removeEventFromInProgressList(IOTHUB_MESSAGE_LIST* message)
     DList_InitializeListHead(&message->entry);
 }
 
-static void rollEventBackToWaitList(IOTHUB_MESSAGE_LIST* message, AMQP_TRANSPORT_INSTANCE* transport_state)
+static void rollEventBackToWaitList(IOTHUB_MESSAGE_LIST* message, AMQP_TRANSPORT_PERDEVICE_DATA* device_state)
 {
     removeEventFromInProgressList(message);
-    DList_InsertTailList(transport_state->waitingToSend, &message->entry);
+    DList_InsertTailList(device_state->waitingToSend, &message->entry);
 }
 
-static void rollEventsBackToWaitList(AMQP_TRANSPORT_INSTANCE* transport_state)
+static void rollEventsBackToWaitList(AMQP_TRANSPORT_PERDEVICE_DATA* device_state)
 {
-    PDLIST_ENTRY entry = transport_state->inProgress.Blink;
+    PDLIST_ENTRY entry = device_state->inProgress.Blink;
 
-    while (entry != &transport_state->inProgress)
+    while (entry != &device_state->inProgress)
     {
         IOTHUB_MESSAGE_LIST* message = containingRecord(entry, IOTHUB_MESSAGE_LIST, entry);
         entry = entry->Blink;
-        rollEventBackToWaitList(message, transport_state);
+        rollEventBackToWaitList(message, device_state);
     }
 }
 
+static bool hasRegisteredDevices(AMQP_TRANSPORT_INSTANCE* transport_state)
+{
+    return (transport_state->registered_devices.Flink != &transport_state->registered_devices);
+}
 
-static int addPropertiesTouAMQPMessage(IOTHUB_MESSAGE_HANDLE iothub_message_handle, MESSAGE_HANDLE uamqp_message)
+
+static int createPropertiesMap(IOTHUB_MESSAGE_HANDLE iothub_message_handle, AMQP_VALUE* uamqp_properties_map)
 {
     int result;
     MAP_HANDLE properties_map;
@@ -224,6 +264,8 @@ static int addPropertiesTouAMQPMessage(IOTHUB_MESSAGE_HANDLE iothub_message_hand
     const char* const* propertyValues;
     size_t propertyCount;
 
+    *uamqp_properties_map = NULL;
+
     /* Codes_SRS_IOTHUBTRANSPORTUAMQP_01_007: [The IoTHub message properties shall be obtained by calling IoTHubMessage_Properties.] */
     properties_map = IoTHubMessage_Properties(iothub_message_handle);
     if (properties_map == NULL)
@@ -293,24 +335,14 @@ static int addPropertiesTouAMQPMessage(IOTHUB_MESSAGE_HANDLE iothub_message_hand
 
                 if (i < propertyCount)
                 {
+                    amqpvalue_destroy(uamqp_map);
                     result = __LINE__;
                 }
                 else
                 {
-                    /* Codes_SRS_IOTHUBTRANSPORTUAMQP_01_013: [After all properties have been filled in the uAMQP map, the uAMQP properties map shall be set on the uAMQP message by calling message_set_application_properties.] */
-                    if (message_set_application_properties(uamqp_message, uamqp_map) != 0)
-                    {
-                        /* Codes_SRS_IOTHUBTRANSPORTUAMQP_01_014: [If any of the APIs fails while building the property map and setting it on the uAMQP message, IoTHubTransportAMQP_DoWork shall notify the failure by invoking the upper layer message send callback with IOTHUB_CLIENT_CONFIRMATION_ERROR.] */
-                        LogError("Failed to transfer the message properties to the uAMQP message.");
-                        result = __LINE__;
-                    }
-                    else
-                    {
-                        result = 0;
-                    }
+                    *uamqp_properties_map = uamqp_map;
+                    result = 0;
                 }
-
-                amqpvalue_destroy(uamqp_map);
             }
         }
         else
@@ -322,6 +354,170 @@ static int addPropertiesTouAMQPMessage(IOTHUB_MESSAGE_HANDLE iothub_message_hand
     return result;
 }
 
+static int addPropertiesTouAMQPMessage(IOTHUB_MESSAGE_HANDLE iothub_message_handle, MESSAGE_HANDLE uamqp_message)
+{
+    int result;
+    AMQP_VALUE uamqp_map;
+
+    if (createPropertiesMap(iothub_message_handle, &uamqp_map) != 0)
+    {
+        result = __LINE__;
+    }
+    else if (uamqp_map == NULL)
+    {
+        result = 0;
+    }
+    else
+    {
+        /* Codes_SRS_IOTHUBTRANSPORTUAMQP_01_013: [After all properties have been filled in the uAMQP map, the uAMQP properties map shall be set on the uAMQP message by calling message_set_application_properties.] */
+        if (message_set_application_properties(uamqp_message, uamqp_map) != 0)
+        {
+            /* Codes_SRS_IOTHUBTRANSPORTUAMQP_01_014: [If any of the APIs fails while building the property map and setting it on the uAMQP message, IoTHubTransportAMQP_DoWork shall notify the failure by invoking the upper layer message send callback with IOTHUB_CLIENT_CONFIRMATION_ERROR.] */
+            LogError("Failed to transfer the message properties to the uAMQP message.");
+            result = __LINE__;
+        }
+        else
+        {
+            result = 0;
+        }
+
+        amqpvalue_destroy(uamqp_map);
+    }
+
+    return result;
+}
+
+static int getEventBody(IOTHUB_MESSAGE_HANDLE message_handle, BINARY_DATA* body)
+{
+    int result;
+    IOTHUBMESSAGE_CONTENT_TYPE contentType = IoTHubMessage_GetContentType(message_handle);
+    const unsigned char* messageContent;
+    size_t messageContentSize;
+
+    // Codes_SRS_IOTHUBTRANSPORTAMQP_09_087: [If the event contains a message of type IOTHUBMESSAGE_BYTEARRAY, IoTHubTransportAMQP_DoWork shall obtain its char* representation and size using IoTHubMessage_GetByteArray()] 
+    if (contentType == IOTHUBMESSAGE_BYTEARRAY &&
+        IoTHubMessage_GetByteArray(message_handle, &messageContent, &messageContentSize) != IOTHUB_MESSAGE_OK)
+    {
+        LogError("Failed getting the BYTE array representation of the event content to be sent.");
+        result = __LINE__;
+    }
+    // Codes_SRS_IOTHUBTRANSPORTAMQP_09_089: [If the event contains a message of type IOTHUBMESSAGE_STRING, IoTHubTransportAMQP_DoWork shall obtain its char* representation using IoTHubMessage_GetString()] 
+    else if (contentType == IOTHUBMESSAGE_STRING &&
+        ((messageContent = (const unsigned char*)IoTHubMessage_GetString(message_handle)) == NULL))
+    {
+        LogError("Failed getting the STRING representation of the event content to be sent.");
+        result = __LINE__;
+    }
+    // Codes_SRS_IOTHUBTRANSPORTAMQP_09_092: [If the event contains a message of type IOTHUBMESSAGE_UNKNOWN, IoTHubTransportAMQP_DoWork shall remove the event from the in-progress list and invoke the upper layer callback reporting the error] 
+    else if (contentType == IOTHUBMESSAGE_UNKNOWN)
+    {
+        LogError("Cannot send events with content type IOTHUBMESSAGE_UNKNOWN.");
+        result = __LINE__;
+    }
+    else
+    {
+        // Codes_SRS_IOTHUBTRANSPORTAMQP_09_090: [If the event contains a message of type IOTHUBMESSAGE_STRING, IoTHubTransportAMQP_DoWork shall obtain the size of its char* representation using strlen()] 
+        if (contentType == IOTHUBMESSAGE_STRING)
+        {
+            messageContentSize = strlen((const char*)messageContent);
+        }
+
+        body->bytes = messageContent;
+        body->length = messageContentSize;
+        result = 0;
+    }
+
+    return result;
+}
+
+static int appendEncodedBytes(void* context, const unsigned char* bytes, size_t length)
+{
+    BINARY_DATA* encoded_event = (BINARY_DATA*)context;
+
+    (void)memcpy((unsigned char*)encoded_event->bytes + encoded_event->length, bytes, length);
+    encoded_event->length += length;
+
+    return 0;
+}
+
+// Encodes the application-properties and data sections of an event, which is the content of one data section of a batch message.
+static int encodeEventForBatch(IOTHUB_MESSAGE_HANDLE message_handle, BINARY_DATA* encoded_event, bool* is_message_error)
+{
+    int result;
+    BINARY_DATA event_body;
+    AMQP_VALUE properties_map = NULL;
+    AMQP_VALUE application_properties = NULL;
+    AMQP_VALUE body = NULL;
+    size_t application_properties_size = 0;
+    size_t body_size;
+
+    encoded_event->bytes = NULL;
+    encoded_event->length = 0;
+    *is_message_error = false;
+
+    if (getEventBody(message_handle, &event_body) != 0 ||
+        createPropertiesMap(message_handle, &properties_map) != 0)
+    {
+        *is_message_error = true;
+        result = __LINE__;
+    }
+    else if ((properties_map != NULL) &&
+        (((application_properties = amqpvalue_create_application_properties(properties_map)) == NULL) ||
+        (amqpvalue_get_encoded_size(application_properties, &application_properties_size) != 0)))
+    {
+        LogError("Failed encoding the application properties of the event.");
+        result = __LINE__;
+    }
+    else
+    {
+        data body_data;
+        body_data.bytes = event_body.bytes;
+        body_data.length = (uint32_t)event_body.length;
+
+        if (((body = amqpvalue_create_data(body_data)) == NULL) ||
+            (amqpvalue_get_encoded_size(body, &body_size) != 0))
+        {
+            LogError("Failed encoding the body of the event.");
+            result = __LINE__;
+        }
+        else if ((encoded_event->bytes = (const unsigned char*)malloc(application_properties_size + body_size)) == NULL)
+        {
+            LogError("Failed allocating the encoded event.");
+            result = __LINE__;
+        }
+        else if (((application_properties != NULL) && (amqpvalue_encode(application_properties, appendEncodedBytes, encoded_event) != 0)) ||
+            (amqpvalue_encode(body, appendEncodedBytes, encoded_event) != 0))
+        {
+            LogError("Failed encoding the event.");
+            free((void*)encoded_event->bytes);
+            encoded_event->bytes = NULL;
+            encoded_event->length = 0;
+            result = __LINE__;
+        }
+        else
+        {
+            result = 0;
+        }
+    }
+
+    if (body != NULL)
+    {
+        amqpvalue_destroy(body);
+    }
+
+    if (application_properties != NULL)
+    {
+        amqpvalue_destroy(application_properties);
+    }
+
+    if (properties_map != NULL)
+    {
+        amqpvalue_destroy(properties_map);
+    }
+
+    return result;
+}
+
 static int readPropertiesFromuAMQPMessage(IOTHUB_MESSAGE_HANDLE iothub_message_handle, MESSAGE_HANDLE uamqp_message)
 {
     int return_value;
@@ -521,13 +717,44 @@ static void on_message_send_complete(void* context, MESSAGE_SEND_RESULT send_res
     free(message);
 }
 
+static void on_event_batch_send_complete(void* context, MESSAGE_SEND_RESULT send_result)
+{
+    AMQP_EVENT_BATCH* batch = (AMQP_EVENT_BATCH*)context;
+    size_t i;
+
+    // Codes_SRS_IOTHUBTRANSPORTAMQP_02_019: [When the batch message is settled, IoTHubTransportAMQP_DoWork shall complete every event packed in it, in order, as 'on_message_send_complete' does for a single event.]
+    for (i = 0; i < batch->count; i++)
+    {
+        on_message_send_complete(batch->events[i], send_result);
+    }
+
+    free(batch);
+}
+
+static void destroyDeviceState(AMQP_TRANSPORT_PERDEVICE_DATA* device_state);
+
 static void on_put_token_complete(void* context, CBS_OPERATION_RESULT operation_result, unsigned int status_code, const char* status_description)
 {
-    AMQP_TRANSPORT_INSTANCE* transportState = (AMQP_TRANSPORT_INSTANCE*)context;
+    AMQP_TRANSPORT_PERDEVICE_DATA* device_state = (AMQP_TRANSPORT_PERDEVICE_DATA*)context;
 
-    if (operation_result == CBS_OPERATION_RESULT_OK)
+    // The count is reset when the connection is retried, so a late completion must not underflow it.
+    if (device_state->pending_put_token_count > 0)
     {
-        transportState->cbs_state = CBS_STATE_AUTHENTICATED;
+        device_state->pending_put_token_count--;
+    }
+
+    if (device_state->is_unregistered)
+    {
+        // Codes_SRS_IOTHUBTRANSPORTAMQP_02_024: [When the last pending cbs_put_token() of an unregistered device completes, the transport shall free the state of that device.]
+        if (device_state->pending_put_token_count == 0)
+        {
+            DList_RemoveEntryList(&device_state->entry);
+            destroyDeviceState(device_state);
+        }
+    }
+    else if (operation_result == CBS_OPERATION_RESULT_OK)
+    {
+        device_state->cbs_state = CBS_STATE_AUTHENTICATED;
     }
 }
 
@@ -622,8 +849,20 @@ static void destroyConnection(AMQP_TRANSPORT_INSTANCE* transport_state)
 {
     if (transport_state->cbs != NULL)
     {
+        PDLIST_ENTRY entry;
+
         cbs_destroy(transport_state->cbs);
         transport_state->cbs = NULL;
+
+        // Codes_SRS_IOTHUBTRANSPORTAMQP_02_025: [Destroying the CBS instance shall free the state of the unregistered devices still waiting for a cbs_put_token(), since those operations will not complete anymore.]
+        entry = transport_state->unregistered_devices.Flink;
+        while (entry != &transport_state->unregistered_devices)
+        {
+            AMQP_TRANSPORT_PERDEVICE_DATA* device_state = containingRecord(entry, AMQP_TRANSPORT_PERDEVICE_DATA, entry);
+            entry = entry->Flink;
+            DList_RemoveEntryList(&device_state->entry);
+            destroyDeviceState(device_state);
+        }
     }
 
     if (transport_state->session != NULL)
@@ -753,7 +992,6 @@ static int establishConnection(AMQP_TRANSPORT_INSTANCE* transport_state)
             else
             {
                 transport_state->connection_establish_time = getSecondsSinceEpoch();
-                transport_state->cbs_state = CBS_STATE_IDLE;
                 connection_set_trace(transport_state->connection, transport_state->is_trace_on);
                 result = RESULT_OK;
             }
@@ -768,24 +1006,24 @@ static int establishConnection(AMQP_TRANSPORT_INSTANCE* transport_state)
     return result;
 }
 
-static int startAuthentication(AMQP_TRANSPORT_INSTANCE* transport_state)
+static int startAuthentication(AMQP_TRANSPORT_PERDEVICE_DATA* device_state)
 {
     int result;
 
     size_t sas_token_create_time = getSecondsSinceEpoch(); // I.e.: NOW, in seconds since epoch.
 
                                                            // Codes_SRS_IOTHUBTRANSPORTAMQP_09_083: [Each new SAS token created by the transport shall be valid for up to 'sas_token_lifetime' milliseconds from the time of creation]
-    size_t new_expiry_time = sas_token_create_time + (transport_state->sas_token_lifetime / 1000);
+    size_t new_expiry_time = sas_token_create_time + (device_state->transport_state->sas_token_lifetime / 1000);
 
     STRING_HANDLE newSASToken;
 
-    if (transport_state->deviceSasToken == NULL)
+    if (device_state->deviceSasToken == NULL)
     {
-        newSASToken = SASToken_Create(transport_state->deviceKey, transport_state->devicesPath, transport_state->sasTokenKeyName, new_expiry_time);
+        newSASToken = SASToken_Create(device_state->deviceKey, device_state->devicesPath, device_state->transport_state->sasTokenKeyName, new_expiry_time);
     }
     else
     {
-        newSASToken = STRING_clone(transport_state->deviceSasToken);
+        newSASToken = STRING_clone(device_state->deviceSasToken);
     }
 
     if (newSASToken == NULL)
@@ -793,15 +1031,16 @@ static int startAuthentication(AMQP_TRANSPORT_INSTANCE* transport_state)
         LogError("Could not generate a new SAS token for the CBS.");
         result = RESULT_FAILURE;
     }
-    else if (cbs_put_token(transport_state->cbs, CBS_AUDIENCE, STRING_c_str(transport_state->devicesPath), STRING_c_str(newSASToken), on_put_token_complete, transport_state) != RESULT_OK)
+    else if (cbs_put_token(device_state->transport_state->cbs, CBS_AUDIENCE, STRING_c_str(device_state->devicesPath), STRING_c_str(newSASToken), on_put_token_complete, device_state) != RESULT_OK)
     {
         LogError("Failed applying new SAS token to CBS.");
         result = RESULT_FAILURE;
     }
     else
     {
-        transport_state->cbs_state = CBS_STATE_AUTH_IN_PROGRESS;
-        transport_state->current_sas_token_create_time = sas_token_create_time;
+        device_state->cbs_state = CBS_STATE_AUTH_IN_PROGRESS;
+        device_state->pending_put_token_count++;
+        device_state->current_sas_token_create_time = sas_token_create_time;
         result = RESULT_OK;
     }
 
@@ -814,9 +1053,9 @@ static int startAuthentication(AMQP_TRANSPORT_INSTANCE* transport_state)
     return result;
 }
 
-static int verifyAuthenticationTimeout(AMQP_TRANSPORT_INSTANCE* transport_state)
+static int verifyAuthenticationTimeout(AMQP_TRANSPORT_PERDEVICE_DATA* device_state)
 {
-    return ((getSecondsSinceEpoch() - transport_state->current_sas_token_create_time) * 1000 >= transport_state->cbs_request_timeout) ? RESULT_TIMEOUT : RESULT_OK;
+    return ((getSecondsSinceEpoch() - device_state->current_sas_token_create_time) * 1000 >= device_state->transport_state->cbs_request_timeout) ? RESULT_TIMEOUT : RESULT_OK;
 }
 
 static void attachDeviceClientTypeToLink(LINK_HANDLE link)
@@ -873,15 +1112,15 @@ static void attachDeviceClientTypeToLink(LINK_HANDLE link)
     }
 }
 
-static void destroyEventSender(AMQP_TRANSPORT_INSTANCE* transport_state)
+static void destroyEventSender(AMQP_TRANSPORT_PERDEVICE_DATA* device_state)
 {
-    if (transport_state->message_sender != NULL)
+    if (device_state->message_sender != NULL)
     {
-        messagesender_destroy(transport_state->message_sender);
-        transport_state->message_sender = NULL;
+        messagesender_destroy(device_state->message_sender);
+        device_state->message_sender = NULL;
 
-        link_destroy(transport_state->sender_link);
-        transport_state->sender_link = NULL;
+        link_destroy(device_state->sender_link);
+        device_state->sender_link = NULL;
     }
 }
 
@@ -890,25 +1129,26 @@ void on_event_sender_state_changed(void* context, MESSAGE_SENDER_STATE new_state
     LogInfo("Event sender state changed [%d->%d]", previous_state, new_state);
 }
 
-static int createEventSender(AMQP_TRANSPORT_INSTANCE* transport_state)
+static int createEventSender(AMQP_TRANSPORT_PERDEVICE_DATA* device_state)
 {
     int result = RESULT_FAILURE;
 
-    if (transport_state->message_sender == NULL)
+    if (device_state->message_sender == NULL)
     {
         AMQP_VALUE source = NULL;
         AMQP_VALUE target = NULL;
 
         // Codes_SRS_IOTHUBTRANSPORTAMQP_09_068: [IoTHubTransportAMQP_DoWork shall create the AMQP link for sending messages using 'source' as "ingress", target as the IoT hub FQDN, link name as "sender-link" and role as 'role_sender'] 
+        // Codes_SRS_IOTHUBTRANSPORTAMQP_02_009: [The name of the AMQP links created by IoTHubTransportAMQP_DoWork shall be suffixed with "-" + deviceId, so the links of every registered device are unique within the shared session.]
         if ((source = messaging_create_source(MESSAGE_SENDER_SOURCE_ADDRESS)) == NULL)
         {
             LogError("Failed creating AMQP messaging source attribute.");
         }
-        else if ((target = messaging_create_target(STRING_c_str(transport_state->targetAddress))) == NULL)
+        else if ((target = messaging_create_target(STRING_c_str(device_state->targetAddress))) == NULL)
         {
             LogError("Failed creating AMQP messaging target attribute.");
         }
-        else if ((transport_state->sender_link = link_create(transport_state->session, MESSAGE_SENDER_LINK_NAME, role_sender, source, target)) == NULL)
+        else if ((device_state->sender_link = link_create(device_state->transport_state->session, STRING_c_str(device_state->senderLinkName), role_sender, source, target)) == NULL)
         {
             // Codes_SRS_IOTHUBTRANSPORTAMQP_09_069: [If IoTHubTransportAMQP_DoWork fails to create the AMQP link for sending messages, the function shall fail and return immediately, flagging the connection to be re-stablished] 
             LogError("Failed creating AMQP link for message sender.");
@@ -916,15 +1156,15 @@ static int createEventSender(AMQP_TRANSPORT_INSTANCE* transport_state)
         else
         {
             // Codes_SRS_IOTHUBTRANSPORTAMQP_09_119: [IoTHubTransportAMQP_DoWork shall apply a default value of 65536 for the parameter 'Link MAX message size']
-            if (link_set_max_message_size(transport_state->sender_link, MESSAGE_SENDER_MAX_LINK_SIZE) != RESULT_OK)
+            if (link_set_max_message_size(device_state->sender_link, MESSAGE_SENDER_MAX_LINK_SIZE) != RESULT_OK)
             {
                 LogError("Failed setting AMQP link max message size.");
             }
 
-            attachDeviceClientTypeToLink(transport_state->sender_link);
+            attachDeviceClientTypeToLink(device_state->sender_link);
 
             // Codes_SRS_IOTHUBTRANSPORTAMQP_09_070: [IoTHubTransportAMQP_DoWork shall create the AMQP message sender using messagesender_create() AMQP API] 
-            if ((transport_state->message_sender = messagesender_create(transport_state->sender_link, on_event_sender_state_changed, (void*)transport_state, NULL)) == NULL)
+            if ((device_state->message_sender = messagesender_create(device_state->sender_link, on_event_sender_state_changed, (void*)device_state, NULL)) == NULL)
             {
                 // Codes_SRS_IOTHUBTRANSPORTAMQP_09_071: [IoTHubTransportAMQP_DoWork shall fail and return immediately if the AMQP message sender instance fails to be created, flagging the connection to be re-established] 
                 LogError("Could not allocate AMQP message sender");
@@ -932,7 +1172,7 @@ static int createEventSender(AMQP_TRANSPORT_INSTANCE* transport_state)
             else
             {
                 // Codes_SRS_IOTHUBTRANSPORTAMQP_09_072: [IoTHubTransportAMQP_DoWork shall open the AMQP message sender using messagesender_open() AMQP API] 
-                if (messagesender_open(transport_state->message_sender) != RESULT_OK)
+                if (messagesender_open(device_state->message_sender) != RESULT_OK)
                 {
                     // Codes_SRS_IOTHUBTRANSPORTAMQP_09_073: [IoTHubTransportAMQP_DoWork shall fail and return immediately if the AMQP message sender instance fails to be opened, flagging the connection to be re-established] 
                     LogError("Failed opening the AMQP message sender.");
@@ -953,24 +1193,24 @@ static int createEventSender(AMQP_TRANSPORT_INSTANCE* transport_state)
     return result;
 }
 
-static int destroyMessageReceiver(AMQP_TRANSPORT_INSTANCE* transport_state)
+static int destroyMessageReceiver(AMQP_TRANSPORT_PERDEVICE_DATA* device_state)
 {
     int result = RESULT_FAILURE;
 
-    if (transport_state->message_receiver != NULL)
+    if (device_state->message_receiver != NULL)
     {
-        if (messagereceiver_close(transport_state->message_receiver) != RESULT_OK)
+        if (messagereceiver_close(device_state->message_receiver) != RESULT_OK)
         {
             LogError("Failed closing the AMQP message receiver.");
         }
 
-        messagereceiver_destroy(transport_state->message_receiver);
+        messagereceiver_destroy(device_state->message_receiver);
 
-        transport_state->message_receiver = NULL;
+        device_state->message_receiver = NULL;
 
-        link_destroy(transport_state->receiver_link);
+        link_destroy(device_state->receiver_link);
 
-        transport_state->receiver_link = NULL;
+        device_state->receiver_link = NULL;
 
         result = RESULT_OK;
     }
@@ -978,17 +1218,18 @@ static int destroyMessageReceiver(AMQP_TRANSPORT_INSTANCE* transport_state)
     return result;
 }
 
-static int createMessageReceiver(AMQP_TRANSPORT_INSTANCE* transport_state, IOTHUB_CLIENT_LL_HANDLE iothub_client_handle)
+static int createMessageReceiver(AMQP_TRANSPORT_PERDEVICE_DATA* device_state)
 {
     int result = RESULT_FAILURE;
 
-    if (transport_state->message_receiver == NULL)
+    if (device_state->message_receiver == NULL)
     {
         AMQP_VALUE source = NULL;
         AMQP_VALUE target = NULL;
 
         // Codes_SRS_IOTHUBTRANSPORTAMQP_09_074: [IoTHubTransportAMQP_DoWork shall create the AMQP link for receiving messages using 'source' as messageReceiveAddress, target as the "ingress-rx", link name as "receiver-link" and role as 'role_receiver'] 
-        if ((source = messaging_create_source(STRING_c_str(transport_state->messageReceiveAddress))) == NULL)
+        // Codes_SRS_IOTHUBTRANSPORTAMQP_02_009: [The name of the AMQP links created by IoTHubTransportAMQP_DoWork shall be suffixed with "-" + deviceId, so the links of every registered device are unique within the shared session.]
+        if ((source = messaging_create_source(STRING_c_str(device_state->messageReceiveAddress))) == NULL)
         {
             LogError("Failed creating AMQP message receiver source attribute.");
         }
@@ -996,13 +1237,13 @@ static int createMessageReceiver(AMQP_TRANSPORT_INSTANCE* transport_state, IOTHU
         {
             LogError("Failed creating AMQP message receiver target attribute.");
         }
-        else if ((transport_state->receiver_link = link_create(transport_state->session, MESSAGE_RECEIVER_LINK_NAME, role_receiver, source, target)) == NULL)
+        else if ((device_state->receiver_link = link_create(device_state->transport_state->session, STRING_c_str(device_state->receiverLinkName), role_receiver, source, target)) == NULL)
         {
             // Codes_SRS_IOTHUBTRANSPORTAMQP_09_075: [If IoTHubTransportAMQP_DoWork fails to create the AMQP link for receiving messages, the function shall fail and return immediately, flagging the connection to be re-stablished] 
             LogError("Failed creating AMQP link for message receiver.");
         }
         // Codes_SRS_IOTHUBTRANSPORTAMQP_09_076: [IoTHubTransportAMQP_DoWork shall set the receiver link settle mode as receiver_settle_mode_first] 
-        else if (link_set_rcv_settle_mode(transport_state->receiver_link, receiver_settle_mode_first) != RESULT_OK)
+        else if (link_set_rcv_settle_mode(device_state->receiver_link, receiver_settle_mode_first) != RESULT_OK)
         {
             // Codes_SRS_IOTHUBTRANSPORTAMQP_09_141: [If IoTHubTransportAMQP_DoWork fails to set the settle mode on the AMQP link for receiving messages, the function shall fail and return immediately, flagging the connection to be re-stablished]
             LogError("Failed setting AMQP link settle mode for message receiver.");
@@ -1010,15 +1251,15 @@ static int createMessageReceiver(AMQP_TRANSPORT_INSTANCE* transport_state, IOTHU
         else
         {
             // Codes_SRS_IOTHUBTRANSPORTAMQP_09_119: [IoTHubTransportAMQP_DoWork shall apply a default value of 65536 for the parameter 'Link MAX message size']
-            if (link_set_max_message_size(transport_state->receiver_link, MESSAGE_RECEIVER_MAX_LINK_SIZE) != RESULT_OK)
+            if (link_set_max_message_size(device_state->receiver_link, MESSAGE_RECEIVER_MAX_LINK_SIZE) != RESULT_OK)
             {
                 LogError("Failed setting AMQP link max message size for message receiver.");
             }
 
-            attachDeviceClientTypeToLink(transport_state->receiver_link);
+            attachDeviceClientTypeToLink(device_state->receiver_link);
 
             // Codes_SRS_IOTHUBTRANSPORTAMQP_09_077: [IoTHubTransportAMQP_DoWork shall create the AMQP message receiver using messagereceiver_create() AMQP API] 
-            if ((transport_state->message_receiver = messagereceiver_create(transport_state->receiver_link, NULL, NULL)) == NULL)
+            if ((device_state->message_receiver = messagereceiver_create(device_state->receiver_link, NULL, NULL)) == NULL)
             {
                 // Codes_SRS_IOTHUBTRANSPORTAMQP_09_078: [IoTHubTransportAMQP_DoWork shall fail and return immediately if the AMQP message receiver instance fails to be created, flagging the connection to be re-established] 
                 LogError("Could not allocate AMQP message receiver.");
@@ -1027,7 +1268,7 @@ static int createMessageReceiver(AMQP_TRANSPORT_INSTANCE* transport_state, IOTHU
             {
                 // Codes_SRS_IOTHUBTRANSPORTAMQP_09_079: [IoTHubTransportAMQP_DoWork shall open the AMQP message receiver using messagereceiver_open() AMQP API, passing a callback function for handling C2D incoming messages] 
                 // Codes_SRS_IOTHUBTRANSPORTAMQP_09_123: [IoTHubTransportAMQP_DoWork shall create each AMQP message_receiver passing the 'on_message_received' as the callback function] 
-                if (messagereceiver_open(transport_state->message_receiver, on_message_received, (const void*)iothub_client_handle) != RESULT_OK)
+                if (messagereceiver_open(device_state->message_receiver, on_message_received, (const void*)device_state->iothub_client_handle) != RESULT_OK)
                 {
                     // Codes_SRS_IOTHUBTRANSPORTAMQP_09_080: [IoTHubTransportAMQP_DoWork shall fail and return immediately if the AMQP message receiver instance fails to be opened, flagging the connection to be re-established] 
                     LogError("Failed opening the AMQP message receiver.");
@@ -1048,43 +1289,24 @@ static int createMessageReceiver(AMQP_TRANSPORT_INSTANCE* transport_state, IOTHU
     return result;
 }
 
-static int sendPendingEvents(AMQP_TRANSPORT_INSTANCE* transport_state)
+static int sendPendingEvents(AMQP_TRANSPORT_PERDEVICE_DATA* device_state)
 {
     int result = RESULT_OK;
     IOTHUB_MESSAGE_LIST* message;
 
-    while ((message = getNextEventToSend(transport_state)) != NULL)
+    while ((message = getNextEventToSend(device_state)) != NULL)
     {
         result = RESULT_FAILURE;
 
-        IOTHUBMESSAGE_CONTENT_TYPE contentType = IoTHubMessage_GetContentType(message->messageHandle);
-        const unsigned char* messageContent;
-        size_t messageContentSize;
+        BINARY_DATA binary_data;
         MESSAGE_HANDLE amqp_message = NULL;
         bool is_message_error = false;
 
         // Codes_SRS_IOTHUBTRANSPORTAMQP_09_086: [IoTHubTransportAMQP_DoWork shall move queued events to an "in-progress" list right before processing them for sending]
-        trackEventInProgress(message, transport_state);
+        trackEventInProgress(message, device_state);
 
-        // Codes_SRS_IOTHUBTRANSPORTAMQP_09_087: [If the event contains a message of type IOTHUBMESSAGE_BYTEARRAY, IoTHubTransportAMQP_DoWork shall obtain its char* representation and size using IoTHubMessage_GetByteArray()] 
-        if (contentType == IOTHUBMESSAGE_BYTEARRAY &&
-            IoTHubMessage_GetByteArray(message->messageHandle, &messageContent, &messageContentSize) != IOTHUB_MESSAGE_OK)
-        {
-            LogError("Failed getting the BYTE array representation of the event content to be sent.");
-            is_message_error = true;
-        }
-        // Codes_SRS_IOTHUBTRANSPORTAMQP_09_089: [If the event contains a message of type IOTHUBMESSAGE_STRING, IoTHubTransportAMQP_DoWork shall obtain its char* representation using IoTHubMessage_GetString()] 
-        // Codes_SRS_IOTHUBTRANSPORTAMQP_09_090: [If the event contains a message of type IOTHUBMESSAGE_STRING, IoTHubTransportAMQP_DoWork shall obtain the size of its char* representation using strlen()] 
-        else if (contentType == IOTHUBMESSAGE_STRING &&
-            ((messageContent = IoTHubMessage_GetString(message->messageHandle)) == NULL))
-        {
-            LogError("Failed getting the STRING representation of the event content to be sent.");
-            is_message_error = true;
-        }
-        // Codes_SRS_IOTHUBTRANSPORTAMQP_09_092: [If the event contains a message of type IOTHUBMESSAGE_UNKNOWN, IoTHubTransportAMQP_DoWork shall remove the event from the in-progress list and invoke the upper layer callback reporting the error] 
-        else if (contentType == IOTHUBMESSAGE_UNKNOWN)
+        if (getEventBody(message->messageHandle, &binary_data) != 0)
         {
-            LogError("Cannot send events with content type IOTHUBMESSAGE_UNKNOWN.");
             is_message_error = true;
         }
         // Codes_SRS_IOTHUBTRANSPORTAMQP_09_093: [IoTHubTransportAMQP_DoWork shall create an amqp message using message_create() uAMQP API] 
@@ -1094,16 +1316,6 @@ static int sendPendingEvents(AMQP_TRANSPORT_INSTANCE* transport_state)
         }
         else
         {
-            BINARY_DATA binary_data;
-
-            if (contentType == IOTHUBMESSAGE_STRING)
-            {
-                messageContentSize = strlen(messageContent);
-            }
-
-            binary_data.bytes = messageContent;
-            binary_data.length = messageContentSize;
-
             // Codes_SRS_IOTHUBTRANSPORTAMQP_09_095: [IoTHubTransportAMQP_DoWork shall set the AMQP message body using message_add_body_amqp_data() uAMQP API] 
             if (message_add_body_amqp_data(amqp_message, binary_data) != RESULT_OK)
             {
@@ -1119,7 +1331,7 @@ static int sendPendingEvents(AMQP_TRANSPORT_INSTANCE* transport_state)
                 else
                 {
                     // Codes_SRS_IOTHUBTRANSPORTAMQP_09_097: [IoTHubTransportAMQP_DoWork shall pass the encoded AMQP message to AMQP for sending (along with on_message_send_complete callback) using messagesender_send()] 
-                    if (messagesender_send(transport_state->message_sender, amqp_message, on_message_send_complete, message) != RESULT_OK)
+                    if (messagesender_send(device_state->message_sender, amqp_message, on_message_send_complete, message) != RESULT_OK)
                     {
                         LogError("Failed sending the AMQP message.");
                     }
@@ -1150,7 +1362,7 @@ static int sendPendingEvents(AMQP_TRANSPORT_INSTANCE* transport_state)
                 // Codes_SRS_IOTHUBTRANSPORTAMQP_09_111: [If message_create() fails, IoTHubTransportAMQP_DoWork notify the failure, roll back the event to waitToSent list and return]
                 // Codes_SRS_IOTHUBTRANSPORTAMQP_09_112: [If message_add_body_amqp_data() fails, IoTHubTransportAMQP_DoWork notify the failure, roll back the event to waitToSent list and return]
                 // Codes_SRS_IOTHUBTRANSPORTAMQP_09_113: [If messagesender_send() fails, IoTHubTransportAMQP_DoWork notify the failure, roll back the event to waitToSent list and return]
-                rollEventBackToWaitList(message, transport_state);
+                rollEventBackToWaitList(message, device_state);
                 break;
             }
         }
@@ -1159,27 +1371,322 @@ static int sendPendingEvents(AMQP_TRANSPORT_INSTANCE* transport_state)
     return result;
 }
 
-static bool isSasTokenRefreshRequired(AMQP_TRANSPORT_INSTANCE* transport_state)
+// Number of events the next batch message can hold: the pending events, up to as many as can fit in MAXIMUM_BATCH_MESSAGE_SIZE.
+static size_t getNumberOfEventsToSend(AMQP_TRANSPORT_PERDEVICE_DATA* device_state)
+{
+    size_t result = 0;
+    PDLIST_ENTRY entry;
+
+    for (entry = device_state->waitingToSend->Flink; entry != device_state->waitingToSend && result < MAXIMUM_EVENTS_PER_BATCH; entry = entry->Flink)
+    {
+        result++;
+    }
+
+    return result;
+}
+
+static int sendNextEventBatch(AMQP_TRANSPORT_PERDEVICE_DATA* device_state)
 {
-    if (transport_state->deviceSasToken != NULL)
+    int result;
+    size_t number_of_events = getNumberOfEventsToSend(device_state);
+    AMQP_EVENT_BATCH* batch;
+    MESSAGE_HANDLE batch_message;
+
+    if ((batch = (AMQP_EVENT_BATCH*)malloc(sizeof(AMQP_EVENT_BATCH) + number_of_events * sizeof(IOTHUB_MESSAGE_LIST*))) == NULL)
+    {
+        LogError("Failed allocating the batch of events.");
+        result = RESULT_FAILURE;
+    }
+    // Codes_SRS_IOTHUBTRANSPORTAMQP_02_017: [If batching is on, IoTHubTransportAMQP_DoWork shall pack the pending events into an AMQP message created with message_create() and whose message format is set to 0x80013700 with message_set_message_format().]
+    else if ((batch_message = message_create()) == NULL)
+    {
+        LogError("Failed allocating the AMQP batch message.");
+        free(batch);
+        result = RESULT_FAILURE;
+    }
+    else if (message_set_message_format(batch_message, IOTHUB_BATCHING_MESSAGE_FORMAT) != 0)
+    {
+        LogError("Failed setting the message format of the AMQP batch message.");
+        message_destroy(batch_message);
+        free(batch);
+        result = RESULT_FAILURE;
+    }
+    else
+    {
+        IOTHUB_MESSAGE_LIST* message;
+        size_t batch_size = 0;
+        bool is_batch_full = false;
+        bool is_batch_failed = false;
+
+        batch->count = 0;
+        batch->events = (IOTHUB_MESSAGE_LIST**)(batch + 1);
+
+        // Codes_SRS_IOTHUBTRANSPORTAMQP_02_027: [IoTHubTransportAMQP_DoWork shall put in a batch message at most as many events as can fit in 256KB, sizing the batch to the pending events up to that number, and shall send the remaining events in the next batch messages.]
+        while (!is_batch_full && !is_batch_failed && (message = getNextEventToSend(device_state)) != NULL && batch->count < number_of_events)
+        {
+            BINARY_DATA encoded_event;
+            bool is_message_error;
+
+            if (encodeEventForBatch(message->messageHandle, &encoded_event, &is_message_error) != 0)
+            {
+                if (is_message_error)
+                {
+                    // Codes_SRS_IOTHUBTRANSPORTAMQP_02_020: [If the content or the properties of an event cannot be obtained, IoTHubTransportAMQP_DoWork shall complete that event with IOTHUB_CLIENT_CONFIRMATION_ERROR and continue with the next one.]
+                    trackEventInProgress(message, device_state);
+                    on_message_send_complete(message, MESSAGE_SEND_ERROR);
+                }
+                else
+                {
+                    is_batch_failed = true;
+                }
+            }
+            else
+            {
+                // Codes_SRS_IOTHUBTRANSPORTAMQP_02_018: [Each pending event shall be encoded as its application-properties and data sections and added as one data section of the batch message with message_add_body_amqp_data(), as long as the batch message stays within 256KB.]
+                if (batch_size + encoded_event.length + BATCH_DATA_SECTION_OVERHEAD > MAXIMUM_BATCH_MESSAGE_SIZE)
+                {
+                    if (batch->count == 0)
+                    {
+                        // Codes_SRS_IOTHUBTRANSPORTAMQP_02_021: [If an event alone exceeds 256KB, IoTHubTransportAMQP_DoWork shall complete it with IOTHUB_CLIENT_CONFIRMATION_ERROR.]
+                        LogError("The event is too large to be sent in a batch.");
+                        trackEventInProgress(message, device_state);
+                        on_message_send_complete(message, MESSAGE_SEND_ERROR);
+                    }
+                    else
+                    {
+                        is_batch_full = true;
+                    }
+                }
+                else if (message_add_body_amqp_data(batch_message, encoded_event) != RESULT_OK)
+                {
+                    LogError("Failed adding the event to the AMQP batch message.");
+                    is_batch_failed = true;
+                }
+                else
+                {
+                    trackEventInProgress(message, device_state);
+                    batch->events[batch->count++] = message;
+                    batch_size += encoded_event.length + BATCH_DATA_SECTION_OVERHEAD;
+                }
+
+                free((void*)encoded_event.bytes);
+            }
+        }
+
+        if (!is_batch_failed && batch->count == 0)
+        {
+            free(batch);
+            result = RESULT_OK;
+        }
+        // Codes_SRS_IOTHUBTRANSPORTAMQP_02_022: [IoTHubTransportAMQP_DoWork shall send the batch message with messagesender_send(), passing a callback that settles all the events of the batch with a single disposition.]
+        else if (is_batch_failed ||
+            messagesender_send(device_state->message_sender, batch_message, on_event_batch_send_complete, batch) != RESULT_OK)
+        {
+            size_t i;
+
+            // Codes_SRS_IOTHUBTRANSPORTAMQP_02_023: [If building or sending the batch message fails, IoTHubTransportAMQP_DoWork shall roll the events of the batch back to the waitingToSend list and return.]
+            LogError("Failed sending the AMQP batch message.");
+            for (i = 0; i < batch->count; i++)
+            {
+                rollEventBackToWaitList(batch->events[i], device_state);
+            }
+            free(batch);
+            result = RESULT_FAILURE;
+        }
+        else
+        {
+            result = RESULT_OK;
+        }
+
+        // It can be destroyed because AMQP keeps a clone of the message.
+        message_destroy(batch_message);
+    }
+
+    return result;
+}
+
+static int sendPendingEventBatches(AMQP_TRANSPORT_PERDEVICE_DATA* device_state)
+{
+    int result = RESULT_OK;
+
+    while (result == RESULT_OK && getNextEventToSend(device_state) != NULL)
+    {
+        result = sendNextEventBatch(device_state);
+    }
+
+    return result;
+}
+
+static bool isSasTokenRefreshRequired(AMQP_TRANSPORT_PERDEVICE_DATA* device_state)
+{
+    if (device_state->deviceSasToken != NULL)
     {
         return false;
     }
     else
     {
-    return ((getSecondsSinceEpoch() - transport_state->current_sas_token_create_time) >= (transport_state->sas_token_refresh_time / 1000)) ? true : false;
+        return ((getSecondsSinceEpoch() - device_state->current_sas_token_create_time) >= (device_state->transport_state->sas_token_refresh_time / 1000)) ? true : false;
+    }
 }
+
+static void prepareForDeviceRetry(AMQP_TRANSPORT_PERDEVICE_DATA* device_state)
+{
+    destroyMessageReceiver(device_state);
+    destroyEventSender(device_state);
+    device_state->cbs_state = CBS_STATE_IDLE;
+    rollEventsBackToWaitList(device_state);
 }
 
 static void prepareForConnectionRetry(AMQP_TRANSPORT_INSTANCE* transport_state)
 {
-    destroyMessageReceiver(transport_state);
-    destroyEventSender(transport_state);
+    PDLIST_ENTRY entry = transport_state->registered_devices.Flink;
+
+    while (entry != &transport_state->registered_devices)
+    {
+        AMQP_TRANSPORT_PERDEVICE_DATA* device_state = containingRecord(entry, AMQP_TRANSPORT_PERDEVICE_DATA, entry);
+        entry = entry->Flink;
+        prepareForDeviceRetry(device_state);
+        // The CBS instance is destroyed below, so its pending cbs_put_token() calls will not complete.
+        device_state->pending_put_token_count = 0;
+    }
+
     destroyConnection(transport_state);
     transport_state->connection_state = AMQP_MANAGEMENT_STATE_IDLE;
-    rollEventsBackToWaitList(transport_state);
 }
 
+static int doDeviceWork(AMQP_TRANSPORT_PERDEVICE_DATA* device_state)
+{
+    int result = RESULT_OK;
+
+    // Codes_SRS_IOTHUBTRANSPORTAMQP_09_081: [IoTHubTransportAMQP_DoWork shall put a new SAS token if the one has not been out already, or if the previous one failed to be put due to timeout of cbs_put_token().]
+    // Codes_SRS_IOTHUBTRANSPORTAMQP_09_082: [IoTHubTransportAMQP_DoWork shall refresh the SAS token if the current token has been used for more than 'sas_token_refresh_time' milliseconds]
+    if ((device_state->cbs_state == CBS_STATE_IDLE || isSasTokenRefreshRequired(device_state)) &&
+        startAuthentication(device_state) != RESULT_OK)
+    {
+        // Codes_SRS_IOTHUBTRANSPORTAMQP_09_146: [If the SAS token fails to be sent to CBS (cbs_put_token), IoTHubTransportAMQP_DoWork shall fail and exit immediately]
+        LogError("Failed authenticating AMQP connection within CBS.");
+        result = RESULT_FAILURE;
+    }
+    // Codes_SRS_IOTHUBTRANSPORTAMQP_09_084: [IoTHubTransportAMQP_DoWork shall wait for 'cbs_request_timeout' milliseconds for the cbs_put_token() to complete before failing due to timeout]
+    else if (device_state->cbs_state == CBS_STATE_AUTH_IN_PROGRESS &&
+        verifyAuthenticationTimeout(device_state) == RESULT_TIMEOUT)
+    {
+        // Codes_SRS_IOTHUBTRANSPORTAMQP_02_013: [If the authentication of a device times out, IoTHubTransportAMQP_DoWork shall destroy the links of that device only, roll its in-progress events back to its waitingToSend list and authenticate it again on the next call, keeping the connection for the other registered devices.]
+        LogError("AMQP transport authentication timed out.");
+        prepareForDeviceRetry(device_state);
+    }
+    else if (device_state->cbs_state == CBS_STATE_AUTHENTICATED)
+    {
+        // Codes_SRS_IOTHUBTRANSPORTAMQP_09_121: [IoTHubTransportAMQP_DoWork shall create an AMQP message_receiver if transport_state->message_receive is NULL and transport_state->receive_messages is true] 
+        if (device_state->receive_messages == true &&
+            device_state->message_receiver == NULL &&
+            createMessageReceiver(device_state) != RESULT_OK)
+        {
+            LogError("Failed creating AMQP transport message receiver.");
+            result = RESULT_FAILURE;
+        }
+        // Codes_SRS_IOTHUBTRANSPORTAMQP_09_122: [IoTHubTransportAMQP_DoWork shall destroy the transport_state->message_receiver (and set it to NULL) if it exists and transport_state->receive_messages is false] 
+        else if (device_state->receive_messages == false &&
+            device_state->message_receiver != NULL &&
+            destroyMessageReceiver(device_state) != RESULT_OK)
+        {
+            LogError("Failed destroying AMQP transport message receiver.");
+        }
+
+        if (device_state->message_sender == NULL &&
+            createEventSender(device_state) != RESULT_OK)
+        {
+            LogError("Failed creating AMQP transport event sender.");
+            result = RESULT_FAILURE;
+        }
+        else if (device_state->transport_state->is_batching_on)
+        {
+            if (sendPendingEventBatches(device_state) != RESULT_OK)
+            {
+                LogError("AMQP transport failed sending batched events.");
+            }
+        }
+        else if (sendPendingEvents(device_state) != RESULT_OK)
+        {
+            LogError("AMQP transport failed sending events.");
+        }
+    }
+
+    return result;
+}
+
+static void destroyDeviceState(AMQP_TRANSPORT_PERDEVICE_DATA* device_state)
+{
+    // Codes_SRS_IOTHUBTRANSPORTAMQP_09_024: [IoTHubTransportAMQP_Destroy shall destroy the AMQP message_sender.]
+    // Codes_SRS_IOTHUBTRANSPORTAMQP_09_029 : [IoTHubTransportAMQP_Destroy shall destroy the AMQP link.]
+    destroyEventSender(device_state);
+
+    // Codes_SRS_IOTHUBTRANSPORTAMQP_09_025: [IoTHubTransportAMQP_Destroy shall destroy the AMQP message_receiver.] 
+    // Codes_SRS_IOTHUBTRANSPORTAMQP_09_029 : [IoTHubTransportAMQP_Destroy shall destroy the AMQP link.]
+    destroyMessageReceiver(device_state);
+
+    // Codes_SRS_IOTHUBTRANSPORTAMQP_09_036 : [IoTHubTransportAMQP_Destroy shall return the remaining items in inProgress to waitingToSend list.]
+    rollEventsBackToWaitList(device_state);
+
+    // Codes_SRS_IOTHUBTRANSPORTAMQP_09_035 : [IoTHubTransportAMQP_Destroy shall delete its internally - set parameters(deviceKey, targetAddress, devicesPath, sasTokenKeyName).]
+    if (device_state->deviceKey != NULL)
+        STRING_delete(device_state->deviceKey);
+    if (device_state->deviceSasToken != NULL)
+        STRING_delete(device_state->deviceSasToken);
+    if (device_state->targetAddress != NULL)
+        STRING_delete(device_state->targetAddress);
+    if (device_state->messageReceiveAddress != NULL)
+        STRING_delete(device_state->messageReceiveAddress);
+    if (device_state->senderLinkName != NULL)
+        STRING_delete(device_state->senderLinkName);
+    if (device_state->receiverLinkName != NULL)
+        STRING_delete(device_state->receiverLinkName);
+    if (device_state->devicesPath != NULL)
+        STRING_delete(device_state->devicesPath);
+
+    free(device_state);
+}
+
+// Removes the device from the registered devices and frees its state, unless a pending cbs_put_token() still has it as context.
+static void releaseDeviceState(AMQP_TRANSPORT_PERDEVICE_DATA* device_state)
+{
+    DList_RemoveEntryList(&device_state->entry);
+
+    if (device_state->pending_put_token_count == 0)
+    {
+        destroyDeviceState(device_state);
+    }
+    else
+    {
+        // Codes_SRS_IOTHUBTRANSPORTAMQP_02_026: [If a cbs_put_token() of the device is still pending, IoTHubTransportAMQP_Unregister shall destroy the links of the device and return its in-progress events to its waitingToSend list right away, but shall keep the rest of its state until that cbs_put_token() completes.]
+        destroyEventSender(device_state);
+        destroyMessageReceiver(device_state);
+        rollEventsBackToWaitList(device_state);
+        device_state->is_unregistered = true;
+        DList_InsertTailList(&device_state->transport_state->unregistered_devices, &device_state->entry);
+    }
+}
+
+static AMQP_TRANSPORT_PERDEVICE_DATA* findDeviceByDevicesPath(AMQP_TRANSPORT_INSTANCE* transport_state, STRING_HANDLE devicesPath)
+{
+    AMQP_TRANSPORT_PERDEVICE_DATA* result = NULL;
+    PDLIST_ENTRY entry = transport_state->registered_devices.Flink;
+
+    while (entry != &transport_state->registered_devices)
+    {
+        AMQP_TRANSPORT_PERDEVICE_DATA* device_state = containingRecord(entry, AMQP_TRANSPORT_PERDEVICE_DATA, entry);
+
+        if (strcmp(STRING_c_str(device_state->devicesPath), STRING_c_str(devicesPath)) == 0)
+        {
+            result = device_state;
+            break;
+        }
+
+        entry = entry->Flink;
+    }
+
+    return result;
+}
 
 // API functions
 
@@ -1187,31 +1694,18 @@ static TRANSPORT_LL_HANDLE IoTHubTransportAMQP_Create(const IOTHUBTRANSPORT_CONF
 {
     AMQP_TRANSPORT_INSTANCE* transport_state = NULL;
     bool cleanup_required = false;
-    size_t deviceIdLength;
 
     // Codes_SRS_IOTHUBTRANSPORTAMQP_09_005: [If parameter config (or its fields) is NULL then IoTHubTransportAMQP_Create shall fail and return NULL.] 
-    if (config == NULL || config->upperConfig == NULL || config->waitingToSend == NULL)
+    // Codes_SRS_IOTHUBTRANSPORTAMQP_02_003: [IoTHubTransportAMQP_Create shall not use config->upperConfig->deviceId, deviceKey, deviceSasToken nor config->waitingToSend; devices are added to the transport by IoTHubTransportAMQP_Register.]
+    if (config == NULL || config->upperConfig == NULL)
     {
         LogError("IoTHub AMQP client transport null configuration parameter.");
     }
     // Codes_SRS_IOTHUBTRANSPORTAMQP_09_006: [IoTHubTransportAMQP_Create shall fail and return NULL if any fields of the config structure are NULL.]
-    // Codes_SRS_IOTHUBTRANSPORTAMQP_03_001: [IoTHubTransportAMQP_Create shall fail and return NULL if both deviceKey & deviceSasToken fields are NOT NULL.]
     else if (config->upperConfig->protocol == NULL)
     {
         LogError("Invalid configuration (NULL protocol detected)");
     }
-    else if (config->upperConfig->deviceId == NULL)
-    {
-        LogError("Invalid configuration (NULL deviceId detected)");
-    }
-    else if (config->upperConfig->deviceKey == NULL && config->upperConfig->deviceSasToken == NULL)
-    {
-        LogError("Invalid configuration (NULL deviceKey/deviceSasToken detected)");
-    }
-    else if (config->upperConfig->deviceKey != NULL && config->upperConfig->deviceSasToken != NULL)
-    {
-        LogError("Invalid configuration (Both deviceKey and deviceSasToken are defined)");
-    }
     else if (config->upperConfig->iotHubName == NULL)
     {
         LogError("Invalid configuration (NULL iotHubName detected)");
@@ -1220,29 +1714,11 @@ static TRANSPORT_LL_HANDLE IoTHubTransportAMQP_Create(const IOTHUBTRANSPORT_CONF
     {
         LogError("Invalid configuration (NULL iotHubSuffix detected)");
     }
-    else if (!config->waitingToSend)
-    {
-        LogError("Invalid configuration (NULL waitingToSend list detected)");
-    }
     // Codes_SRS_IOTHUBTRANSPORTAMQP_09_008: [IoTHubTransportAMQP_Create shall fail and return NULL if any config field of type string is zero length.] 
-    else if ((deviceIdLength = strlen(config->upperConfig->deviceId)) == 0 ||
-        (strlen(config->upperConfig->iotHubName) == 0) ||
+    else if ((strlen(config->upperConfig->iotHubName) == 0) ||
         (strlen(config->upperConfig->iotHubSuffix) == 0))
     {
-        LogError("Zero-length config parameter (deviceId, iotHubName or iotHubSuffix)");
-    }
-    else if ((config->upperConfig->deviceKey != NULL) && (strlen(config->upperConfig->deviceKey) == 0))
-    {
-        LogError("Zero-length config parameter (deviceKey)");
-    }
-    else if ((config->upperConfig->deviceSasToken != NULL) && (strlen(config->upperConfig->deviceSasToken) == 0))
-    {
-        LogError("Zero-length config parameter (deviceSasToken)");
-    }
-    // Codes_SRS_IOTHUBTRANSPORTAMQP_09_007: [IoTHubTransportAMQP_Create shall fail and return NULL if the deviceId length is greater than 128.]
-    else if (deviceIdLength > 128U)
-    {
-        LogError("deviceId is too long");
+        LogError("Zero-length config parameter (iotHubName or iotHubSuffix)");
     }
     // Codes_SRS_IOTHUBTRANSPORTAMQP_09_134: [IoTHubTransportAMQP_Create shall fail and return NULL if the combined length of config->iotHubName and config->iotHubSuffix exceeds 254 bytes (RFC1035)]
     else if ((strlen(config->upperConfig->iotHubName) + strlen(config->upperConfig->iotHubSuffix)) > (RFC1035_MAX_FQDN_LENGTH - 1))
@@ -1262,36 +1738,22 @@ static TRANSPORT_LL_HANDLE IoTHubTransportAMQP_Create(const IOTHUBTRANSPORT_CONF
         {
             transport_state->iotHubHostFqdn = NULL;
             transport_state->iotHubPort = DEFAULT_IOTHUB_AMQP_PORT;
-            transport_state->deviceKey = NULL;
-            transport_state->deviceSasToken = NULL;
-            transport_state->devicesPath = NULL;
-            transport_state->messageReceiveAddress = NULL;
             transport_state->sasTokenKeyName = NULL;
-            transport_state->targetAddress = NULL;
-            transport_state->waitingToSend = config->waitingToSend;
 
             transport_state->cbs = NULL;
-            transport_state->cbs_state = CBS_STATE_IDLE;
-            transport_state->current_sas_token_create_time = 0;
             transport_state->connection = NULL;
             transport_state->connection_state = AMQP_MANAGEMENT_STATE_IDLE;
             transport_state->connection_establish_time = 0;
-            transport_state->iothub_client_handle = NULL;
-            transport_state->receive_messages = false;
-            transport_state->message_receiver = NULL;
-            transport_state->message_sender = NULL;
-            transport_state->receiver_link = NULL;
             transport_state->sasl_io = NULL;
             transport_state->sasl_mechanism = NULL;
-            transport_state->sender_link = NULL;
             transport_state->session = NULL;
             transport_state->tls_io = NULL;
             transport_state->tls_io_transport_provider = getTLSIOTransport;
-            transport_state->isRegistered = false;
             transport_state->is_trace_on = false;
+            transport_state->is_batching_on = false;
 
-            transport_state->waitingToSend = config->waitingToSend;
-            DList_InitializeListHead(&transport_state->inProgress);
+            DList_InitializeListHead(&transport_state->registered_devices);
+            DList_InitializeListHead(&transport_state->unregistered_devices);
 
             // Codes_SRS_IOTHUBTRANSPORTAMQP_09_010: [IoTHubTransportAMQP_Create shall create an immutable string, referred to as iotHubHostFqdn, from the following pieces: config->iotHubName + "." + config->iotHubSuffix.] 
             if ((transport_state->iotHubHostFqdn = concat3Params(config->upperConfig->iotHubName, ".", config->upperConfig->iotHubSuffix)) == NULL)
@@ -1299,27 +1761,6 @@ static TRANSPORT_LL_HANDLE IoTHubTransportAMQP_Create(const IOTHUBTRANSPORT_CONF
                 LogError("Failed to set transport_state->iotHubHostFqdn.");
                 cleanup_required = true;
             }
-            // Codes_SRS_IOTHUBTRANSPORTAMQP_09_012: [IoTHubTransportAMQP_Create shall create an immutable string, referred to as devicesPath, from the following parts: host_fqdn + "/devices/" + deviceId.] 
-            else if ((transport_state->devicesPath = concat3Params(STRING_c_str(transport_state->iotHubHostFqdn), "/devices/", config->upperConfig->deviceId)) == NULL)
-            {
-                // Codes_SRS_IOTHUBTRANSPORTAMQP_09_013: [If creating devicesPath fails for any reason then IoTHubTransportAMQP_Create shall fail and return NULL.] 
-                LogError("Failed to allocate transport_state->devicesPath.");
-                cleanup_required = true;
-            }
-            // Codes_SRS_IOTHUBTRANSPORTAMQP_09_014: [IoTHubTransportAMQP_Create shall create an immutable string, referred to as targetAddress, from the following parts: "amqps://" + devicesPath + "/messages/events".]
-            else if ((transport_state->targetAddress = concat3Params("amqps://", STRING_c_str(transport_state->devicesPath), "/messages/events")) == NULL)
-            {
-                // Codes_SRS_IOTHUBTRANSPORTAMQP_09_015: [If creating the targetAddress fails for any reason then IoTHubTransportAMQP_Create shall fail and return NULL.] 
-                LogError("Failed to allocate transport_state->targetAddress.");
-                cleanup_required = true;
-            }
-            // Codes_SRS_IOTHUBTRANSPORTAMQP_09_053: [IoTHubTransportAMQP_Create shall define the source address for receiving messages as "amqps://" + devicesPath + "/messages/devicebound", stored in the transport handle as messageReceiveAddress]
-            else if ((transport_state->messageReceiveAddress = concat3Params("amqps://", STRING_c_str(transport_state->devicesPath), "/messages/devicebound")) == NULL)
-            {
-                // Codes_SRS_IOTHUBTRANSPORTAMQP_09_054: [If creating the messageReceiveAddress fails for any reason then IoTHubTransportAMQP_Create shall fail and return NULL.]
-                LogError("Failed to allocate transport_state->messageReceiveAddress.");
-                cleanup_required = true;
-            }
             // Codes_SRS_IOTHUBTRANSPORTAMQP_09_016: [IoTHubTransportAMQP_Create shall initialize handle->sasTokenKeyName with a zero-length STRING_HANDLE instance.] 
             else if ((transport_state->sasTokenKeyName = STRING_new()) == NULL)
             {
@@ -1327,23 +1768,6 @@ static TRANSPORT_LL_HANDLE IoTHubTransportAMQP_Create(const IOTHUBTRANSPORT_CONF
                 LogError("Failed to allocate transport_state->sasTokenKeyName.");
                 cleanup_required = true;
             }
-            else if (config->upperConfig->deviceSasToken != NULL)
-            {
-                if ((transport_state->deviceSasToken = STRING_construct(config->upperConfig->deviceSasToken)) == NULL)
-                {
-                    // Codes_SRS_IOTHUBTRANSPORTAMQP_09_019: [If IoTHubTransportAMQP_Create fails to copy config->deviceKey, the function shall fail and return NULL.]
-                    LogError("Failed to allocate transport_state->deviceSasToken.");
-                    cleanup_required = true;
-            }
-            }
-            // Codes_SRS_IOTHUBTRANSPORTAMQP_09_018: [IoTHubTransportAMQP_Create shall store a copy of config->deviceKey (passed by upper layer) into the transports own deviceKey field.] 
-            else if ((config->upperConfig->deviceKey != NULL) && ((transport_state->deviceKey = STRING_new()) == NULL ||
-                STRING_copy(transport_state->deviceKey, config->upperConfig->deviceKey) != 0))
-            {
-                // Codes_SRS_IOTHUBTRANSPORTAMQP_09_019: [If IoTHubTransportAMQP_Create fails to copy config->deviceKey, the function shall fail and return NULL.]
-                LogError("Failed to allocate transport_state->deviceKey.");
-                cleanup_required = true;
-            }
             else
             {
                 // Codes_SRS_IOTHUBTRANSPORTAMQP_09_020: [IoTHubTransportAMQP_Create shall set parameter transport_state->sas_token_lifetime with the default value of 3600000 (milliseconds).]
@@ -1360,18 +1784,8 @@ static TRANSPORT_LL_HANDLE IoTHubTransportAMQP_Create(const IOTHUBTRANSPORT_CONF
 
     if (cleanup_required)
     {
-        if (transport_state->deviceSasToken != NULL)
-            STRING_delete(transport_state->deviceSasToken);
-        if (transport_state->deviceKey != NULL)
-            STRING_delete(transport_state->deviceKey);
         if (transport_state->sasTokenKeyName != NULL)
             STRING_delete(transport_state->sasTokenKeyName);
-        if (transport_state->targetAddress != NULL)
-            STRING_delete(transport_state->targetAddress);
-        if (transport_state->messageReceiveAddress != NULL)
-            STRING_delete(transport_state->messageReceiveAddress);
-        if (transport_state->devicesPath != NULL)
-            STRING_delete(transport_state->devicesPath);
         if (transport_state->iotHubHostFqdn != NULL)
             STRING_delete(transport_state->iotHubHostFqdn);
 
@@ -1388,14 +1802,24 @@ static void IoTHubTransportAMQP_Destroy(TRANSPORT_LL_HANDLE handle)
     if (handle != NULL)
     {
         AMQP_TRANSPORT_INSTANCE* transport_state = (AMQP_TRANSPORT_INSTANCE*)handle;
+        PDLIST_ENTRY entry = transport_state->registered_devices.Flink;
 
-        // Codes_SRS_IOTHUBTRANSPORTAMQP_09_024: [IoTHubTransportAMQP_Destroy shall destroy the AMQP message_sender.]
-        // Codes_SRS_IOTHUBTRANSPORTAMQP_09_029 : [IoTHubTransportAMQP_Destroy shall destroy the AMQP link.]
-        destroyEventSender(transport_state);
+        // Codes_SRS_IOTHUBTRANSPORTAMQP_02_015: [IoTHubTransportAMQP_Destroy shall destroy the links and the internal state of every device still registered in the transport.]
+        while (entry != &transport_state->registered_devices)
+        {
+            AMQP_TRANSPORT_PERDEVICE_DATA* device_state = containingRecord(entry, AMQP_TRANSPORT_PERDEVICE_DATA, entry);
+            entry = entry->Flink;
 
-        // Codes_SRS_IOTHUBTRANSPORTAMQP_09_025: [IoTHubTransportAMQP_Destroy shall destroy the AMQP message_receiver.] 
-        // Codes_SRS_IOTHUBTRANSPORTAMQP_09_029 : [IoTHubTransportAMQP_Destroy shall destroy the AMQP link.]
-        destroyMessageReceiver(transport_state);
+            if (device_state->pending_put_token_count == 0)
+            {
+                destroyDeviceState(device_state);
+            }
+            else
+            {
+                // Freed by destroyConnection, once the CBS instance that holds it as context is gone.
+                releaseDeviceState(device_state);
+            }
+        }
 
         // Codes_SRS_IOTHUBTRANSPORTAMQP_09_027 : [IoTHubTransportAMQP_Destroy shall destroy the AMQP cbs instance]
         // Codes_SRS_IOTHUBTRANSPORTAMQP_09_030 : [IoTHubTransportAMQP_Destroy shall destroy the AMQP session.]
@@ -1404,17 +1828,9 @@ static void IoTHubTransportAMQP_Destroy(TRANSPORT_LL_HANDLE handle)
         // Codes_SRS_IOTHUBTRANSPORTAMQP_09_033 : [IoTHubTransportAMQP_Destroy shall destroy the AMQP SASL mechanism.]
         destroyConnection(transport_state);
 
-        // Codes_SRS_IOTHUBTRANSPORTAMQP_09_035 : [IoTHubTransportAMQP_Destroy shall delete its internally - set parameters(deviceKey, targetAddress, devicesPath, sasTokenKeyName).]
-        STRING_delete(transport_state->targetAddress);
-        STRING_delete(transport_state->messageReceiveAddress);
         STRING_delete(transport_state->sasTokenKeyName);
-        STRING_delete(transport_state->deviceKey);
-        STRING_delete(transport_state->devicesPath);
         STRING_delete(transport_state->iotHubHostFqdn);
 
-        // Codes_SRS_IOTHUBTRANSPORTAMQP_09_036 : [IoTHubTransportAMQP_Destroy shall return the remaining items in inProgress to waitingToSend list.]
-        rollEventsBackToWaitList(transport_state);
-
         // Codes_SRS_IOTHUBTRANSPORTAMQP_09_150: [IoTHubTransportAMQP_Destroy shall destroy the transport instance]
         free(transport_state);
     }
@@ -1422,128 +1838,95 @@ static void IoTHubTransportAMQP_Destroy(TRANSPORT_LL_HANDLE handle)
 
 static void IoTHubTransportAMQP_DoWork(TRANSPORT_LL_HANDLE handle, IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle)
 {
+    // Codes_SRS_IOTHUBTRANSPORTAMQP_02_014: [IoTHubTransportAMQP_DoWork shall ignore iotHubClientHandle (which is NULL when the transport is shared) and use the client handle each device passed to IoTHubTransportAMQP_Register.]
+    (void)iotHubClientHandle;
+
     // Codes_SRS_IOTHUBTRANSPORTAMQP_09_051: [IoTHubTransportAMQP_DoWork shall fail and return immediately if the transport handle parameter is NULL] 
     if (handle == NULL)
     {
         LogError("IoTHubClient DoWork failed: transport handle parameter is NULL.");
     }
-    // Codes_[IoTHubTransportAMQP_DoWork shall fail and return immediately if the client handle parameter is NULL] 
-    else if (iotHubClientHandle == NULL)
-    {
-        LogError("IoTHubClient DoWork failed: client handle parameter is NULL.");
-    }
     else
     {
-        bool trigger_connection_retry = false;
         AMQP_TRANSPORT_INSTANCE* transport_state = (AMQP_TRANSPORT_INSTANCE*)handle;
 
-        // Codes_SRS_IOTHUBTRANSPORTAMQP_09_147: [IoTHubTransportAMQP_DoWork shall save a reference to the client handle in transport_state->iothub_client_handle]
-        transport_state->iothub_client_handle = iotHubClientHandle;
-
-        if (transport_state->connection != NULL &&
-            transport_state->connection_state == AMQP_MANAGEMENT_STATE_ERROR)
-        {
-            LogError("An error occured on AMQP connection. The connection will be restablished.");
-            trigger_connection_retry = true;
-        }
-        // Codes_SRS_IOTHUBTRANSPORTAMQP_09_055: [If the transport handle has a NULL connection, IoTHubTransportAMQP_DoWork shall instantiate and initialize the AMQP components and establish the connection] 
-        else if (transport_state->connection == NULL &&
-            establishConnection(transport_state) != RESULT_OK)
-        {
-            LogError("AMQP transport failed to establish connection with service.");
-            trigger_connection_retry = true;
-        }
-        // Codes_SRS_IOTHUBTRANSPORTAMQP_09_081: [IoTHubTransportAMQP_DoWork shall put a new SAS token if the one has not been out already, or if the previous one failed to be put due to timeout of cbs_put_token().]
-        // Codes_SRS_IOTHUBTRANSPORTAMQP_09_082: [IoTHubTransportAMQP_DoWork shall refresh the SAS token if the current token has been used for more than 'sas_token_refresh_time' milliseconds]
-        else if ((transport_state->cbs_state == CBS_STATE_IDLE || isSasTokenRefreshRequired(transport_state)) &&
-            startAuthentication(transport_state) != RESULT_OK)
-        {
-            // Codes_SRS_IOTHUBTRANSPORTAMQP_09_146: [If the SAS token fails to be sent to CBS (cbs_put_token), IoTHubTransportAMQP_DoWork shall fail and exit immediately]
-            LogError("Failed authenticating AMQP connection within CBS.");
-            trigger_connection_retry = true;
-        }
-        // Codes_SRS_IOTHUBTRANSPORTAMQP_09_084: [IoTHubTransportAMQP_DoWork shall wait for 'cbs_request_timeout' milliseconds for the cbs_put_token() to complete before failing due to timeout]
-        else if (transport_state->cbs_state == CBS_STATE_AUTH_IN_PROGRESS &&
-            verifyAuthenticationTimeout(transport_state) == RESULT_TIMEOUT)
+        // Codes_SRS_IOTHUBTRANSPORTAMQP_02_011: [If no device is registered in the transport, IoTHubTransportAMQP_DoWork shall return without establishing the connection.]
+        if (hasRegisteredDevices(transport_state))
         {
-            LogError("AMQP transport authentication timed out.");
-            trigger_connection_retry = true;
-        }
-        else if (transport_state->cbs_state == CBS_STATE_AUTHENTICATED)
-        {
-            // Codes_SRS_IOTHUBTRANSPORTAMQP_09_121: [IoTHubTransportAMQP_DoWork shall create an AMQP message_receiver if transport_state->message_receive is NULL and transport_state->receive_messages is true] 
-            if (transport_state->receive_messages == true &&
-                transport_state->message_receiver == NULL &&
-                createMessageReceiver(transport_state, iotHubClientHandle) != RESULT_OK)
+            bool trigger_connection_retry = false;
+
+            if (transport_state->connection != NULL &&
+                transport_state->connection_state == AMQP_MANAGEMENT_STATE_ERROR)
             {
-                LogError("Failed creating AMQP transport message receiver.");
+                LogError("An error occured on AMQP connection. The connection will be restablished.");
                 trigger_connection_retry = true;
             }
-            // Codes_SRS_IOTHUBTRANSPORTAMQP_09_122: [IoTHubTransportAMQP_DoWork shall destroy the transport_state->message_receiver (and set it to NULL) if it exists and transport_state->receive_messages is false] 
-            else if (transport_state->receive_messages == false &&
-                transport_state->message_receiver != NULL &&
-                destroyMessageReceiver(transport_state) != RESULT_OK)
+            // Codes_SRS_IOTHUBTRANSPORTAMQP_09_055: [If the transport handle has a NULL connection, IoTHubTransportAMQP_DoWork shall instantiate and initialize the AMQP components and establish the connection] 
+            else if (transport_state->connection == NULL &&
+                establishConnection(transport_state) != RESULT_OK)
+            {
+                LogError("AMQP transport failed to establish connection with service.");
+                trigger_connection_retry = true;
+            }
+            else
             {
-                LogError("Failed destroying AMQP transport message receiver.");
+                // Codes_SRS_IOTHUBTRANSPORTAMQP_02_012: [IoTHubTransportAMQP_DoWork shall authenticate each registered device within the shared CBS instance, attach its links to the shared session and send its pending events.]
+                PDLIST_ENTRY entry = transport_state->registered_devices.Flink;
+
+                while (entry != &transport_state->registered_devices && !trigger_connection_retry)
+                {
+                    AMQP_TRANSPORT_PERDEVICE_DATA* device_state = containingRecord(entry, AMQP_TRANSPORT_PERDEVICE_DATA, entry);
+                    entry = entry->Flink;
+                    trigger_connection_retry = (doDeviceWork(device_state) != RESULT_OK);
+                }
             }
 
-            if (transport_state->message_sender == NULL &&
-                createEventSender(transport_state) != RESULT_OK)
+            if (trigger_connection_retry)
             {
-                LogError("Failed creating AMQP transport event sender.");
-                trigger_connection_retry = true;
+                prepareForConnectionRetry(transport_state);
             }
-            else if (sendPendingEvents(transport_state) != RESULT_OK)
+            else
             {
-                LogError("AMQP transport failed sending events.");
+                // Codes_SRS_IOTHUBTRANSPORTAMQP_09_103: [IoTHubTransportAMQP_DoWork shall invoke connection_dowork() on AMQP for triggering sending and receiving messages] 
+                connection_dowork(transport_state->connection);
             }
         }
-
-        if (trigger_connection_retry)
-        {
-            prepareForConnectionRetry(transport_state);
-        }
-        else
-        {
-            // Codes_SRS_IOTHUBTRANSPORTAMQP_09_103: [IoTHubTransportAMQP_DoWork shall invoke connection_dowork() on AMQP for triggering sending and receiving messages] 
-            connection_dowork(transport_state->connection);
-        }
     }
 }
 
-static int IoTHubTransportAMQP_Subscribe(TRANSPORT_LL_HANDLE handle)
+static int IoTHubTransportAMQP_Subscribe(IOTHUB_DEVICE_HANDLE handle)
 {
     int result;
 
     // Codes_SRS_IOTHUBTRANSPORTAMQP_09_037: [IoTHubTransportAMQP_Subscribe shall fail if the transport handle parameter received is NULL.] 
     if (handle == NULL)
     {
-        LogError("Invalid handle to IoTHubClient AMQP transport.");
+        LogError("Invalid handle to IoTHubClient AMQP transport device.");
         result = __LINE__;
     }
     else
     {
         // Codes_SRS_IOTHUBTRANSPORTAMQP_09_038: [IoTHubTransportAMQP_Subscribe shall set transport_handle->receive_messages to true and return success code.]
-        AMQP_TRANSPORT_INSTANCE* transport_state = (AMQP_TRANSPORT_INSTANCE*)handle;
-        transport_state->receive_messages = true;
+        AMQP_TRANSPORT_PERDEVICE_DATA* device_state = (AMQP_TRANSPORT_PERDEVICE_DATA*)handle;
+        device_state->receive_messages = true;
         result = 0;
     }
 
     return result;
 }
 
-static void IoTHubTransportAMQP_Unsubscribe(TRANSPORT_LL_HANDLE handle)
+static void IoTHubTransportAMQP_Unsubscribe(IOTHUB_DEVICE_HANDLE handle)
 {
     // Codes_SRS_IOTHUBTRANSPORTAMQP_09_039: [IoTHubTransportAMQP_Unsubscribe shall fail if the transport handle parameter received is NULL.] 
     if (handle == NULL)
     {
-        LogError("Invalid handle to IoTHubClient AMQP transport.");
+        LogError("Invalid handle to IoTHubClient AMQP transport device.");
     }
     else
     {
         // Codes_SRS_IOTHUBTRANSPORTAMQP_09_040: [IoTHubTransportAMQP_Unsubscribe shall set transport_handle->receive_messages to false and return success code.]
-        AMQP_TRANSPORT_INSTANCE* transport_state = (AMQP_TRANSPORT_INSTANCE*)handle;
-        transport_state->receive_messages = false;
+        AMQP_TRANSPORT_PERDEVICE_DATA* device_state = (AMQP_TRANSPORT_PERDEVICE_DATA*)handle;
+        device_state->receive_messages = false;
     }
 }
 
@@ -1555,7 +1938,7 @@ static IOTHUB_CLIENT_RESULT IoTHubTransportAMQP_GetSendStatus(IOTHUB_DEVICE_HAND
     if (handle == NULL)
     {
         result = IOTHUB_CLIENT_INVALID_ARG;
-        LogError("Invalid handle to IoTHubClient AMQP transport instance.");
+        LogError("Invalid handle to IoTHubClient AMQP transport device.");
     }
     else if (iotHubClientStatus == NULL)
     {
@@ -1564,10 +1947,10 @@ static IOTHUB_CLIENT_RESULT IoTHubTransportAMQP_GetSendStatus(IOTHUB_DEVICE_HAND
     }
     else
     {
-        AMQP_TRANSPORT_INSTANCE* transport_state = (AMQP_TRANSPORT_INSTANCE*)handle;
+        AMQP_TRANSPORT_PERDEVICE_DATA* device_state = (AMQP_TRANSPORT_PERDEVICE_DATA*)handle;
 
         // Codes_SRS_IOTHUBTRANSPORTAMQP_09_043: [IoTHubTransportAMQP_GetSendStatus shall return IOTHUB_CLIENT_OK and status IOTHUB_CLIENT_SEND_STATUS_BUSY if there are currently event items to be sent or being sent.]
-        if (!DList_IsListEmpty(transport_state->waitingToSend) || !DList_IsListEmpty(&(transport_state->inProgress)))
+        if (!DList_IsListEmpty(device_state->waitingToSend) || !DList_IsListEmpty(&(device_state->inProgress)))
         {
             *iotHubClientStatus = IOTHUB_CLIENT_SEND_STATUS_BUSY;
         }
@@ -1621,6 +2004,12 @@ static IOTHUB_CLIENT_RESULT IoTHubTransportAMQP_SetOption(TRANSPORT_LL_HANDLE ha
             transport_state->cbs_request_timeout = *((size_t*)value);
             result = IOTHUB_CLIENT_OK;
         }
+        // Codes_SRS_IOTHUBTRANSPORTAMQP_02_016: [IoTHubTransportAMQP_SetOption shall save the value if the option name is "Batching", returning IOTHUB_CLIENT_OK; when it is true the events of each device are sent as batch messages.]
+        else if (strcmp("Batching", option) == 0)
+        {
+            transport_state->is_batching_on = *((bool*)value);
+            result = IOTHUB_CLIENT_OK;
+        }
         else if (strcmp("logtrace", option) == 0)
         {
             transport_state->is_trace_on = (bool*)value;
@@ -1661,77 +2050,158 @@ static IOTHUB_CLIENT_RESULT IoTHubTransportAMQP_SetOption(TRANSPORT_LL_HANDLE ha
 static IOTHUB_DEVICE_HANDLE IoTHubTransportAMQP_Register(TRANSPORT_LL_HANDLE handle, const IOTHUB_DEVICE_CONFIG* device, IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, PDLIST_ENTRY waitingToSend)
 {
     IOTHUB_DEVICE_HANDLE result;
+    size_t deviceIdLength;
+
     // Codes_SRS_IOTHUBTRANSPORTUAMQP_17_001: [IoTHubTransportAMQP_Register shall return NULL if device, or waitingToSend are NULL.] 
     // Codes_SRS_IOTHUBTRANSPORTUAMQP_17_005: [IoTHubTransportAMQP_Register shall return NULL if the TRANSPORT_LL_HANDLE is NULL.]
     if ((handle == NULL) || (device == NULL) || (waitingToSend == NULL))
     {
+        LogError("Invalid parameter (NULL) passed to AMQP transport Register()");
+        result = NULL;
+    }
+    // Codes_SRS_IOTHUBTRANSPORTUAMQP_03_002: [IoTHubTransportAMQP_Register shall return NULL if deviceId, or both deviceKey and deviceSasToken are NULL.**]
+    else if ((device->deviceId == NULL) || (device->deviceSasToken == NULL && device->deviceKey == NULL))
+    {
+        LogError("Invalid device configuration (NULL deviceId or deviceKey/deviceSasToken detected)");
+        result = NULL;
+    }
+    // Codes_SRS_IOTHUBTRANSPORTUAMQP_03_003: [IoTHubTransportAMQP_Register shall return NULL if both deviceKey and deviceSasToken are not NULL.]
+    else if ((device->deviceSasToken != NULL) && (device->deviceKey != NULL))
+    {
+        LogError("Invalid device configuration (Both deviceKey and deviceSasToken are defined)");
+        result = NULL;
+    }
+    // Codes_SRS_IOTHUBTRANSPORTAMQP_02_004: [IoTHubTransportAMQP_Register shall return NULL if the deviceId is zero length or longer than 128 characters.]
+    else if ((deviceIdLength = strlen(device->deviceId)) == 0 || deviceIdLength > 128U)
+    {
+        LogError("Invalid deviceId length (%u)", (unsigned int)deviceIdLength);
+        result = NULL;
+    }
+    // Codes_SRS_IOTHUBTRANSPORTAMQP_02_005: [IoTHubTransportAMQP_Register shall return NULL if the deviceKey or the deviceSasToken provided is zero length.]
+    else if (((device->deviceKey != NULL) && (strlen(device->deviceKey) == 0)) ||
+        ((device->deviceSasToken != NULL) && (strlen(device->deviceSasToken) == 0)))
+    {
+        LogError("Zero-length device parameter (deviceKey or deviceSasToken)");
         result = NULL;
     }
     else
     {
         AMQP_TRANSPORT_INSTANCE* transport_state = (AMQP_TRANSPORT_INSTANCE*)handle;
+        AMQP_TRANSPORT_PERDEVICE_DATA* device_state;
 
-        // Codes_SRS_IOTHUBTRANSPORTUAMQP_03_002: [IoTHubTransportAMQP_Register shall return NULL if deviceId, or both deviceKey and deviceSasToken are NULL.**]
-        if ((device->deviceId == NULL) || (device->deviceSasToken == NULL && device->deviceKey == NULL))
-        {
-            result = NULL;
-        }
-        // Codes_SRS_IOTHUBTRANSPORTUAMQP_03_003: [IoTHubTransportAMQP_Register shall return NULL if both deviceKey and deviceSasToken are not NULL.]
-        else if ( (device->deviceSasToken != NULL) && (device->deviceKey != NULL) )
+        // Codes_SRS_IOTHUBTRANSPORTAMQP_02_007: [IoTHubTransportAMQP_Register shall allocate the state of the device, and shall fail and return NULL if any of its allocations fails.]
+        if ((device_state = (AMQP_TRANSPORT_PERDEVICE_DATA*)malloc(sizeof(AMQP_TRANSPORT_PERDEVICE_DATA))) == NULL)
         {
+            LogError("Could not allocate AMQP transport device state");
             result = NULL;
         }
         else
         {
-            STRING_HANDLE devicesPath = concat3Params(STRING_c_str(transport_state->iotHubHostFqdn), "/devices/", device->deviceId);
-        if (devicesPath == NULL)
-        {
-                LogError("Could not create devicesPath");
-            result = NULL;
-        }
-        else
-        {
-            // Codes_SRS_IOTHUBTRANSPORTUAMQP_17_002: [IoTHubTransportAMQP_Register shall return NULL if deviceId or deviceKey do not match the deviceId and deviceKey passed in during IoTHubTransportAMQP_Create.] 
-            if (strcmp(STRING_c_str(transport_state->devicesPath), STRING_c_str(devicesPath)) != 0)
+            bool cleanup_required = false;
+
+            device_state->transport_state = transport_state;
+            device_state->deviceKey = NULL;
+            device_state->deviceSasToken = NULL;
+            device_state->devicesPath = NULL;
+            device_state->targetAddress = NULL;
+            device_state->messageReceiveAddress = NULL;
+            device_state->senderLinkName = NULL;
+            device_state->receiverLinkName = NULL;
+            device_state->iothub_client_handle = iotHubClientHandle;
+            device_state->sender_link = NULL;
+            device_state->message_sender = NULL;
+            device_state->receive_messages = false;
+            device_state->receiver_link = NULL;
+            device_state->message_receiver = NULL;
+            device_state->waitingToSend = waitingToSend;
+            device_state->cbs_state = CBS_STATE_IDLE;
+            device_state->pending_put_token_count = 0;
+            device_state->is_unregistered = false;
+            device_state->current_sas_token_create_time = 0;
+            DList_InitializeListHead(&device_state->inProgress);
+
+            // Codes_SRS_IOTHUBTRANSPORTAMQP_09_012: [IoTHubTransportAMQP_Register shall create an immutable string, referred to as devicesPath, from the following parts: host_fqdn + "/devices/" + deviceId.] 
+            if ((device_state->devicesPath = concat3Params(STRING_c_str(transport_state->iotHubHostFqdn), "/devices/", device->deviceId)) == NULL)
             {
-                LogError("Attemping to add new device to AMQP transport, not allowed.");
-                result = NULL;
+                // Codes_SRS_IOTHUBTRANSPORTAMQP_09_013: [If creating devicesPath fails for any reason then IoTHubTransportAMQP_Register shall fail and return NULL.] 
+                LogError("Failed to allocate device_state->devicesPath.");
+                cleanup_required = true;
             }
-                else if ((transport_state->deviceSasToken == NULL) && strcmp(STRING_c_str(transport_state->deviceKey), device->deviceKey) != 0)
+            // Codes_SRS_IOTHUBTRANSPORTAMQP_02_006: [IoTHubTransportAMQP_Register shall fail and return NULL if a device with the same deviceId is already registered in the transport.]
+            else if (findDeviceByDevicesPath(transport_state, device_state->devicesPath) != NULL)
             {
-                LogError("Attemping to add new device to AMQP transport, not allowed.");
-                result = NULL;
+                LogError("Transport already has device registered by id: [%s]", device->deviceId);
+                cleanup_required = true;
+            }
+            // Codes_SRS_IOTHUBTRANSPORTAMQP_09_014: [IoTHubTransportAMQP_Register shall create an immutable string, referred to as targetAddress, from the following parts: "amqps://" + devicesPath + "/messages/events".]
+            else if ((device_state->targetAddress = concat3Params("amqps://", STRING_c_str(device_state->devicesPath), "/messages/events")) == NULL)
+            {
+                // Codes_SRS_IOTHUBTRANSPORTAMQP_09_015: [If creating the targetAddress fails for any reason then IoTHubTransportAMQP_Register shall fail and return NULL.] 
+                LogError("Failed to allocate device_state->targetAddress.");
+                cleanup_required = true;
+            }
+            // Codes_SRS_IOTHUBTRANSPORTAMQP_09_053: [IoTHubTransportAMQP_Register shall define the source address for receiving messages as "amqps://" + devicesPath + "/messages/devicebound", stored in the device state as messageReceiveAddress]
+            else if ((device_state->messageReceiveAddress = concat3Params("amqps://", STRING_c_str(device_state->devicesPath), "/messages/devicebound")) == NULL)
+            {
+                // Codes_SRS_IOTHUBTRANSPORTAMQP_09_054: [If creating the messageReceiveAddress fails for any reason then IoTHubTransportAMQP_Register shall fail and return NULL.]
+                LogError("Failed to allocate device_state->messageReceiveAddress.");
+                cleanup_required = true;
+            }
+            else if ((device_state->senderLinkName = concat3Params(MESSAGE_SENDER_LINK_NAME, "-", device->deviceId)) == NULL)
+            {
+                LogError("Failed to allocate device_state->senderLinkName.");
+                cleanup_required = true;
+            }
+            else if ((device_state->receiverLinkName = concat3Params(MESSAGE_RECEIVER_LINK_NAME, "-", device->deviceId)) == NULL)
+            {
+                LogError("Failed to allocate device_state->receiverLinkName.");
+                cleanup_required = true;
+            }
+            else if ((device->deviceSasToken != NULL) &&
+                ((device_state->deviceSasToken = STRING_construct(device->deviceSasToken)) == NULL))
+            {
+                // Codes_SRS_IOTHUBTRANSPORTAMQP_09_019: [If IoTHubTransportAMQP_Register fails to copy device->deviceKey, the function shall fail and return NULL.]
+                LogError("Failed to allocate device_state->deviceSasToken.");
+                cleanup_required = true;
+            }
+            // Codes_SRS_IOTHUBTRANSPORTAMQP_09_018: [IoTHubTransportAMQP_Register shall store a copy of device->deviceKey (passed by upper layer) into the device state.] 
+            else if ((device->deviceKey != NULL) &&
+                ((device_state->deviceKey = STRING_construct(device->deviceKey)) == NULL))
+            {
+                // Codes_SRS_IOTHUBTRANSPORTAMQP_09_019: [If IoTHubTransportAMQP_Register fails to copy device->deviceKey, the function shall fail and return NULL.]
+                LogError("Failed to allocate device_state->deviceKey.");
+                cleanup_required = true;
             }
             else
             {
-                if (transport_state->isRegistered == true)
-                {
-                        LogError("Transport already has device registered by id: [%s]", device->deviceId);
-                    result = NULL;
-                }
-                else
-                {
-                    transport_state->isRegistered = true;
-                    // Codes_SRS_IOTHUBTRANSPORTUAMQP_17_003: [IoTHubTransportAMQP_Register shall return the TRANSPORT_LL_HANDLE as the IOTHUB_DEVICE_HANDLE.] 
-                    result = (IOTHUB_DEVICE_HANDLE)handle;
-                }
+                // Codes_SRS_IOTHUBTRANSPORTAMQP_02_008: [On success IoTHubTransportAMQP_Register shall add the device to the devices of the transport and return its state as the IOTHUB_DEVICE_HANDLE.]
+                DList_InsertTailList(&transport_state->registered_devices, &device_state->entry);
+                result = (IOTHUB_DEVICE_HANDLE)device_state;
+            }
+
+            if (cleanup_required)
+            {
+                destroyDeviceState(device_state);
+                result = NULL;
             }
-            STRING_delete(devicesPath);
         }
     }
-    }
 
     return result;
 }
 
-// Codes_SRS_IOTHUBTRANSPORTUAMQP_17_004: [IoTHubTransportAMQP_Unregister shall return.] 
 static void IoTHubTransportAMQP_Unregister(IOTHUB_DEVICE_HANDLE deviceHandle)
 {
-    if (deviceHandle != NULL)
+    if (deviceHandle == NULL)
+    {
+        LogError("Invalid handle to IoTHubClient AMQP transport device.");
+    }
+    else
     {
-        AMQP_TRANSPORT_INSTANCE* transport_state = (AMQP_TRANSPORT_INSTANCE*)deviceHandle;
+        AMQP_TRANSPORT_PERDEVICE_DATA* device_state = (AMQP_TRANSPORT_PERDEVICE_DATA*)deviceHandle;
 
-        transport_state->isRegistered = false;
+        // Codes_SRS_IOTHUBTRANSPORTAMQP_02_010: [IoTHubTransportAMQP_Unregister shall remove the device from the transport, destroy its links, return its in-progress events to its waitingToSend list and free its state; the connection is kept for the other registered devices.]
+        releaseDeviceState(device_state);
     }
 }
 
@@ -12,18 +12,22 @@
 #include "iothub_client_private.h"
 #include "iothub_transport_ll.h"
 #include "iothubtransporthttp.h"
+#include "iothub_client_base64.h"
 
 #include "azure_c_shared_utility/httpapiexsas.h"
+#include "azure_c_shared_utility/sastoken.h"
 #include "azure_c_shared_utility/urlencode.h"
 #include "azure_c_shared_utility/iot_logging.h"
 #include "azure_c_shared_utility/httpapiex.h"
 #include "azure_c_shared_utility/httpapiexsas.h"
 #include "azure_c_shared_utility/strings.h"
-#include "azure_c_shared_utility/base64.h"
 #include "azure_c_shared_utility/doublylinkedlist.h"
 #include "azure_c_shared_utility/vector.h"
 #include "azure_c_shared_utility/httpheaders.h"
 #include "azure_c_shared_utility/agenttime.h"
+#include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/threadapi.h"
+#include "azure_c_shared_utility/tickcounter.h"
 
 #define IOTHUB_APP_PREFIX "iothub-app-"
 const char* IOTHUB_MESSAGE_ID = "iothub-messageid";
@@ -37,12 +41,37 @@ const char* IOTHUB_CORRELATION_ID = "iothub-correlationid";
 /*the default is 25 minutes*/
 #define DEFAULT_GETMINIMUMPOLLINGTIME ((unsigned int)25*60) 
 
+/*DEFAULT_MAXIMUMMESSAGESPERDOWORK is how many messages a device can receive in one DoWork. 1 means "one GET per polling interval"*/
+#define DEFAULT_MAXIMUMMESSAGESPERDOWORK ((unsigned int)1)
+
+/*the smoothed round trip time gives the new sample a weight of 1/ROUNDTRIP_SMOOTHING_FACTOR (same as TCP's SRTT)*/
+#define ROUNDTRIP_SMOOTHING_FACTOR 8
+
+/*a pool thread that finds no DoWork to join doubles its sleep (starting at 1 ms) up to POOL_THREAD_MAX_IDLE_SLEEP ms. The thread calling DoWork waits for the pool threads the same way*/
+#define POOL_THREAD_MIN_SLEEP 1
+#define POOL_THREAD_MAX_IDLE_SLEEP 64
+
 #define MAXIMUM_MESSAGE_SIZE (255*1024-1)
 #define MAXIMUM_PAYLOAD_OVERHEAD 384
 #define MAXIMUM_PROPERTY_OVERHEAD 16
 
-/*forward declaration*/
-static int appendMapToJSON(STRING_HANDLE existing, const char* const* keys, const char* const* values, size_t count);
+/*the connection on which a device is serviced during DoWork*/
+typedef struct HTTPTRANSPORT_CONNECTION_TAG
+{
+	HTTPAPIEX_HANDLE httpApiExHandle;
+	LOCK_HANDLE upperLayerLock; /*NULL when DoWork runs on the calling thread only. Otherwise it is held for everything but the HTTP requests*/
+}HTTPTRANSPORT_CONNECTION;
+
+struct HTTPTRANSPORT_HANDLE_DATA_TAG;
+
+typedef struct HTTPTRANSPORT_WORKER_TAG
+{
+	struct HTTPTRANSPORT_HANDLE_DATA_TAG* handleData;
+	HTTPTRANSPORT_CONNECTION connection;
+	THREAD_HANDLE threadHandle; /*NULL for workers[0] (the thread calling DoWork) and for workers whose thread could not be started*/
+}HTTPTRANSPORT_WORKER;
+
+struct HTTPTRANSPORT_DOWORK_CONTEXT_TAG;
 
 typedef struct HTTPTRANSPORT_HANDLE_DATA_TAG
 {
@@ -50,9 +79,28 @@ typedef struct HTTPTRANSPORT_HANDLE_DATA_TAG
 	HTTPAPIEX_HANDLE httpApiExHandle;
 	bool doBatchedTransfers;
 	unsigned int getMinimumPollingTime;
+	unsigned int maximumMessagesPerDoWork;
+	size_t sasTokenLifetime; /*in milliseconds. 0 means "HTTPAPIEX_SAS computes a new token for every request"*/
+	unsigned int batchLingerMs; /*how long a batch may wait for more events. 0 means "send what is there"*/
+	size_t batchMinBytes; /*a batch this big is sent without waiting for batchLingerMs*/
+	bool isBatchLingerAdaptive; /*when true, the linger follows the smoothed round trip time of the batched POSTs*/
+	uint64_t smoothedRoundTripMs; /*0 until the first batched POST completes*/
+	TICK_COUNTER_HANDLE tickCounter; /*only created when one of the batch linger options is set*/
 	VECTOR_HANDLE perDeviceList;
+	size_t connectionPoolSize;
+	HTTPTRANSPORT_WORKER* workers; /*connectionPoolSize items when connectionPoolSize > 1, NULL otherwise. workers[0] uses httpApiExHandle*/
+	LOCK_HANDLE upperLayerLock;
+	struct HTTPTRANSPORT_DOWORK_CONTEXT_TAG* doWorkContext; /*the DoWork the pool threads can join, NULL when there is none. Guarded by upperLayerLock*/
+	bool stopWorkers; /*guarded by upperLayerLock*/
 }HTTPTRANSPORT_HANDLE_DATA;
 
+typedef struct HTTPTRANSPORT_DOWORK_CONTEXT_TAG
+{
+	size_t nextDevice;
+	size_t unclaimedWorkers; /*how many more pool threads may join this DoWork*/
+	size_t runningWorkers; /*pool threads that joined this DoWork and have not finished yet*/
+}HTTPTRANSPORT_DOWORK_CONTEXT; /*all fields are guarded by upperLayerLock*/
+
 typedef struct HTTPTRANSPORT_PERDEVICE_DATA_TAG
 {
 	HTTPTRANSPORT_HANDLE_DATA* transportHandle;
@@ -65,7 +113,14 @@ typedef struct HTTPTRANSPORT_PERDEVICE_DATA_TAG
 	HTTP_HEADERS_HANDLE eventHTTPrequestHeaders;
 	HTTP_HEADERS_HANDLE messageHTTPrequestHeaders;
 	STRING_HANDLE abandonHTTPrelativePathBegin;
+	HTTP_HEADERS_HANDLE abandonHTTPrequestHeaders; /*reused by every abandon/accept/reject, only If-Match changes*/
 	HTTPAPIEX_SAS_HANDLE sasObject;
+	STRING_HANDLE cachedSasToken; /*only used by devices that have a deviceKey when "sas_token_lifetime" is not 0*/
+	time_t cachedSasTokenCreateTime;
+	bool isBatchLingering; /*true when the events in waitingToSend are held back waiting for more events*/
+	uint64_t batchLingerStartMs;
+	size_t batchLingerBytes; /*the size of the lingering events counted so far*/
+	PDLIST_ENTRY batchLingerLastCounted; /*the last event counted in batchLingerBytes, waitingToSend itself when none is*/
 	bool DoWork_PullMessage;
 	time_t lastPollTime;
 	bool isFirstPoll;
@@ -296,12 +351,59 @@ static bool create_abandonHTTPrelativePathBegin(HTTPTRANSPORT_PERDEVICE_DATA* ha
 	return result;
 }
 
+static void destroy_abandonHTTPrequestHeaders(HTTPTRANSPORT_PERDEVICE_DATA* handleData)
+{
+	HTTPHeaders_Free(handleData->abandonHTTPrequestHeaders);
+	handleData->abandonHTTPrequestHeaders = NULL;
+}
+
+static bool create_abandonHTTPrequestHeaders(HTTPTRANSPORT_PERDEVICE_DATA* handleData)
+{
+	/*Codes_SRS_TRANSPORTMULTITHTTP_02_011: [ IoTHubTransportHttp_Register shall create a set of HTTP headers (further called "abandon HTTP request headers") consisting of the following fixed field names and values:
+	"User-Agent": CLIENT_DEVICE_TYPE_PREFIX CLIENT_DEVICE_BACKSLASH IOTHUB_SDK_VERSION
+	"Authorization": " " ]*/
+	bool result;
+	handleData->abandonHTTPrequestHeaders = HTTPHeaders_Alloc();
+	if (handleData->abandonHTTPrequestHeaders == NULL)
+	{
+		LogError("HTTPHeaders_Alloc failed.");
+		result = false;
+	}
+	else
+	{
+		if (!(
+			(HTTPHeaders_AddHeaderNameValuePair(handleData->abandonHTTPrequestHeaders, "User-Agent", CLIENT_DEVICE_TYPE_PREFIX CLIENT_DEVICE_BACKSLASH IOTHUB_SDK_VERSION) == HTTP_HEADERS_OK) &&
+			(HTTPHeaders_AddHeaderNameValuePair(handleData->abandonHTTPrequestHeaders, "Authorization", " ") == HTTP_HEADERS_OK)
+			))
+		{
+			/*Codes_SRS_TRANSPORTMULTITHTTP_02_012: [ If creating the abandon HTTP request headers fails then IoTHubTransportHttp_Register shall fail and return NULL. ]*/
+			destroy_abandonHTTPrequestHeaders(handleData);
+			LogError("adding header properties failed.");
+			result = false;
+		}
+		else
+		{
+			result = true;
+		}
+	}
+	return result;
+}
+
 static void destroy_SASObject(HTTPTRANSPORT_PERDEVICE_DATA* handleData)
 {
 	HTTPAPIEX_SAS_Destroy(handleData->sasObject);
 	handleData->sasObject = NULL;
 }
 
+static void destroy_cachedSasToken(HTTPTRANSPORT_PERDEVICE_DATA* handleData)
+{
+	if (handleData->cachedSasToken != NULL)
+	{
+		STRING_delete(handleData->cachedSasToken);
+		handleData->cachedSasToken = NULL;
+	}
+}
+
 static bool create_deviceSASObject(HTTPTRANSPORT_PERDEVICE_DATA* handleData, STRING_HANDLE hostName, const char * deviceId, const char * deviceKey)
 {
 	STRING_HANDLE keyName;
@@ -538,14 +640,15 @@ static IOTHUB_DEVICE_HANDLE IoTHubTransportHttp_Register(TRANSPORT_LL_HANDLE han
 			bool was_eventHTTPrequestHeaders_ok = was_messageHTTPrelativePath_ok && create_eventHTTPrequestHeaders(result, device->deviceId);
 			bool was_messageHTTPrequestHeaders_ok = was_eventHTTPrequestHeaders_ok && create_messageHTTPrequestHeaders(result);
 			bool was_abandonHTTPrelativePathBegin_ok = was_messageHTTPrequestHeaders_ok && create_abandonHTTPrelativePathBegin(result, device->deviceId);
+			bool was_abandonHTTPrequestHeaders_ok = was_abandonHTTPrelativePathBegin_ok && create_abandonHTTPrequestHeaders(result);
 
 			if (!was_create_deviceSasToken_ok)
 			{
-				was_sasObject_ok = was_abandonHTTPrelativePathBegin_ok && create_deviceSASObject(result, handleData->hostName, device->deviceId, device->deviceKey);
+				was_sasObject_ok = was_abandonHTTPrequestHeaders_ok && create_deviceSASObject(result, handleData->hostName, device->deviceId, device->deviceKey);
 			}
 
 			/*Codes_SRS_TRANSPORTMULTITHTTP_17_041: [ IoTHubTransportHttp_Register shall call VECTOR_push_back to store the new device information. ]*/
-			bool was_list_add_ok = (was_sasObject_ok || was_create_deviceSasToken_ok) && (VECTOR_push_back(handleData->perDeviceList, &result, 1) == 0);
+			bool was_list_add_ok = (was_sasObject_ok || (was_create_deviceSasToken_ok && was_abandonHTTPrequestHeaders_ok)) && (VECTOR_push_back(handleData->perDeviceList, &result, 1) == 0);
 
 			if (was_list_add_ok)
 			{
@@ -554,6 +657,10 @@ static IOTHUB_DEVICE_HANDLE IoTHubTransportHttp_Register(TRANSPORT_LL_HANDLE han
 				/*Codes_SRS_TRANSPORTMULTITHTTP_17_128: [ IoTHubTransportHttp_Register shall mark this device as unsubscribed. ]*/
 				result->DoWork_PullMessage = false;
 				result->isFirstPoll = true;
+				result->cachedSasToken = NULL;
+				result->isBatchLingering = false;
+				result->batchLingerBytes = 0;
+				result->batchLingerLastCounted = NULL;
 				result->iotHubClientHandle = iotHubClientHandle;
 				result->waitingToSend = waitingToSend;
 				DList_InitializeListHead(&(result->eventConfirmations));
@@ -563,6 +670,7 @@ static IOTHUB_DEVICE_HANDLE IoTHubTransportHttp_Register(TRANSPORT_LL_HANDLE han
 			{
 				/*Codes_SRS_TRANSPORTMULTITHTTP_17_042: [ If the list_add fails then IoTHubTransportHttp_Register shall fail and return NULL. ]*/
 				if (was_sasObject_ok) destroy_SASObject(result);
+				if (was_abandonHTTPrequestHeaders_ok) destroy_abandonHTTPrequestHeaders(result);
 				if (was_abandonHTTPrelativePathBegin_ok) destroy_abandonHTTPrelativePathBegin(result);
 				if (was_messageHTTPrelativePath_ok) destroy_messageHTTPrelativePath(result);
 				if (was_eventHTTPrequestHeaders_ok) destroy_eventHTTPrequestHeaders(result);
@@ -592,7 +700,9 @@ static void destroy_perDeviceData(HTTPTRANSPORT_PERDEVICE_DATA * perDeviceItem)
 	destroy_eventHTTPrequestHeaders(perDeviceItem);
 	destroy_messageHTTPrequestHeaders(perDeviceItem);
 	destroy_abandonHTTPrelativePathBegin(perDeviceItem);
+	destroy_abandonHTTPrequestHeaders(perDeviceItem);
 	destroy_SASObject(perDeviceItem);
+	destroy_cachedSasToken(perDeviceItem);
 }
 
 static IOTHUB_DEVICE_HANDLE* get_perDeviceDataItem(IOTHUB_DEVICE_HANDLE deviceHandle)
@@ -708,6 +818,197 @@ static bool create_httpApiExHandle(HTTPTRANSPORT_HANDLE_DATA* handleData, const
 	return result;
 }
 
+static int DoWork_PoolThread(void* arg);
+
+/*Codes_SRS_TRANSPORTMULTITHTTP_02_038: [ Setting "ConnectionPoolSize" to a value greater than 1 shall start one pool thread for every pooled connection but the first one. The pool threads shall stay alive until "ConnectionPoolSize" changes again or the transport is destroyed. ]*/
+static void start_workerThreads(HTTPTRANSPORT_HANDLE_DATA* handleData)
+{
+	/*workers[0] is the thread calling DoWork*/
+	handleData->workers[0].handleData = handleData;
+	handleData->workers[0].threadHandle = NULL;
+	for (size_t i = 1; i < handleData->connectionPoolSize; i++)
+	{
+		handleData->workers[i].handleData = handleData;
+		if (ThreadAPI_Create(&(handleData->workers[i].threadHandle), DoWork_PoolThread, &(handleData->workers[i])) != THREADAPI_OK)
+		{
+			/*Codes_SRS_TRANSPORTMULTITHTTP_02_009: [ If starting a worker fails, then the devices shall be serviced by the workers already started. ]*/
+			LogError("unable to ThreadAPI_Create, the pool continues without worker %zu", i);
+			handleData->workers[i].threadHandle = NULL;
+		}
+	}
+}
+
+static void stop_workerThreads(HTTPTRANSPORT_HANDLE_DATA* handleData)
+{
+	if (Lock(handleData->upperLayerLock) != LOCK_OK)
+	{
+		LogError("unable to Lock, stopping the pool threads anyway");
+		handleData->stopWorkers = true;
+	}
+	else
+	{
+		handleData->stopWorkers = true;
+		(void)Unlock(handleData->upperLayerLock);
+	}
+
+	for (size_t i = 1; i < handleData->connectionPoolSize; i++)
+	{
+		if (handleData->workers[i].threadHandle != NULL)
+		{
+			int notUsed;
+			if (ThreadAPI_Join(handleData->workers[i].threadHandle, &notUsed) != THREADAPI_OK)
+			{
+				LogError("unable to ThreadAPI_Join");
+			}
+			handleData->workers[i].threadHandle = NULL;
+		}
+	}
+	handleData->stopWorkers = false;
+}
+
+static void destroy_connectionPool(HTTPTRANSPORT_HANDLE_DATA* handleData)
+{
+	if (handleData->workers != NULL)
+	{
+		stop_workerThreads(handleData);
+		/*workers[0] uses httpApiExHandle, which is not owned by the pool*/
+		for (size_t i = 1; i < handleData->connectionPoolSize; i++)
+		{
+			HTTPAPIEX_Destroy(handleData->workers[i].connection.httpApiExHandle);
+		}
+		free(handleData->workers);
+		handleData->workers = NULL;
+	}
+	if (handleData->upperLayerLock != NULL)
+	{
+		(void)Lock_Deinit(handleData->upperLayerLock);
+		handleData->upperLayerLock = NULL;
+	}
+	handleData->connectionPoolSize = 1;
+}
+
+/*grows or shrinks the pool so that the transport has exactly newSize connections to the same host*/
+static int set_connectionPoolSize(HTTPTRANSPORT_HANDLE_DATA* handleData, size_t newSize)
+{
+	int result;
+	if (newSize == handleData->connectionPoolSize)
+	{
+		result = 0;
+	}
+	else if (newSize == 1)
+	{
+		destroy_connectionPool(handleData);
+		result = 0;
+	}
+	else
+	{
+		HTTPTRANSPORT_WORKER* newWorkers = (HTTPTRANSPORT_WORKER*)malloc(newSize * sizeof(HTTPTRANSPORT_WORKER));
+		if (newWorkers == NULL)
+		{
+			LogError("unable to malloc");
+			result = __LINE__;
+		}
+		else
+		{
+			LOCK_HANDLE upperLayerLock = (handleData->upperLayerLock != NULL) ? handleData->upperLayerLock : Lock_Init();
+			if (upperLayerLock == NULL)
+			{
+				LogError("unable to Lock_Init");
+				free(newWorkers);
+				result = __LINE__;
+			}
+			else
+			{
+				size_t kept = (handleData->connectionPoolSize < newSize) ? handleData->connectionPoolSize : newSize;
+				size_t i;
+
+				newWorkers[0].connection.httpApiExHandle = handleData->httpApiExHandle;
+				for (i = 1; i < kept; i++)
+				{
+					newWorkers[i].connection.httpApiExHandle = handleData->workers[i].connection.httpApiExHandle;
+				}
+				for (; i < newSize; i++)
+				{
+					if ((newWorkers[i].connection.httpApiExHandle = HTTPAPIEX_Create(STRING_c_str(handleData->hostName))) == NULL)
+					{
+						break;
+					}
+				}
+
+				if (i < newSize)
+				{
+					/*Codes_SRS_TRANSPORTMULTITHTTP_02_005: [ If any resource needed by "ConnectionPoolSize" cannot be created then IoTHubTransportHttp_SetOption shall fail, return IOTHUB_CLIENT_ERROR and leave the existing connections untouched. ]*/
+					LogError("unable to HTTPAPIEX_Create");
+					while (i > kept)
+					{
+						i--;
+						HTTPAPIEX_Destroy(newWorkers[i].connection.httpApiExHandle);
+					}
+					if (upperLayerLock != handleData->upperLayerLock)
+					{
+						(void)Lock_Deinit(upperLayerLock);
+					}
+					free(newWorkers);
+					result = __LINE__;
+				}
+				else
+				{
+					/*the pool threads point into the old workers, so they are restarted on the new ones*/
+					if (handleData->workers != NULL)
+					{
+						stop_workerThreads(handleData);
+					}
+
+					/*connections above newSize are not needed anymore*/
+					for (i = newSize; i < handleData->connectionPoolSize; i++)
+					{
+						HTTPAPIEX_Destroy(handleData->workers[i].connection.httpApiExHandle);
+					}
+					for (i = 0; i < newSize; i++)
+					{
+						newWorkers[i].connection.upperLayerLock = upperLayerLock;
+					}
+					free(handleData->workers);
+					handleData->workers = newWorkers;
+					handleData->upperLayerLock = upperLayerLock;
+					handleData->connectionPoolSize = newSize;
+					start_workerThreads(handleData);
+					result = 0;
+				}
+			}
+		}
+	}
+	return result;
+}
+
+static void destroy_tickCounter(HTTPTRANSPORT_HANDLE_DATA* handleData)
+{
+	if (handleData->tickCounter != NULL)
+	{
+		tickcounter_destroy(handleData->tickCounter);
+		handleData->tickCounter = NULL;
+	}
+}
+
+static int create_tickCounter(HTTPTRANSPORT_HANDLE_DATA* handleData)
+{
+	int result;
+	if (handleData->tickCounter != NULL)
+	{
+		result = 0;
+	}
+	else if ((handleData->tickCounter = tickcounter_create()) == NULL)
+	{
+		LogError("unable to tickcounter_create");
+		result = __LINE__;
+	}
+	else
+	{
+		result = 0;
+	}
+	return result;
+}
+
 static void destroy_perDeviceList(HTTPTRANSPORT_HANDLE_DATA* handleData)
 {
 	VECTOR_destroy(handleData->perDeviceList);
@@ -786,6 +1087,21 @@ static TRANSPORT_LL_HANDLE IoTHubTransportHttp_Create(const IOTHUBTRANSPORT_CONF
 				/*Codes_SRS_TRANSPORTMULTITHTTP_17_011: [ Otherwise, IoTHubTransportHttp_Create shall succeed and return a non-NULL value. ]*/
 				result->doBatchedTransfers = false;
 				result->getMinimumPollingTime = DEFAULT_GETMINIMUMPOLLINGTIME;
+				/*Codes_SRS_TRANSPORTMULTITHTTP_02_016: [ By default "MaximumMessagesPerDoWork" shall be 1. ]*/
+				result->maximumMessagesPerDoWork = DEFAULT_MAXIMUMMESSAGESPERDOWORK;
+				/*Codes_SRS_TRANSPORTMULTITHTTP_02_021: [ By default "sas_token_lifetime" shall be 0. ]*/
+				result->sasTokenLifetime = 0;
+				/*Codes_SRS_TRANSPORTMULTITHTTP_02_031: [ By default "BatchLingerMs" and "BatchMinBytes" shall be 0 and "BatchLingerAdaptive" shall be false. ]*/
+				result->batchLingerMs = 0;
+				result->batchMinBytes = 0;
+				result->isBatchLingerAdaptive = false;
+				result->smoothedRoundTripMs = 0;
+				result->tickCounter = NULL;
+				result->connectionPoolSize = 1;
+				result->workers = NULL;
+				result->upperLayerLock = NULL;
+				result->doWorkContext = NULL;
+				result->stopWorkers = false;
 			}
 			else
 			{
@@ -819,6 +1135,8 @@ static void IoTHubTransportHttp_Destroy(TRANSPORT_LL_HANDLE handle)
 			free(perDeviceItem);
 		}
 
+		destroy_connectionPool(handleData);
+		destroy_tickCounter(handleData);
 		destroy_hostName(handle);
 		destroy_httpApiExHandle(handle);
 		destroy_perDeviceList(handle);
@@ -884,9 +1202,90 @@ static void IoTHubTransportHttp_Unsubscribe(IOTHUB_DEVICE_HANDLE handle)
 	}
 }
 
-/*produces a representation of the properties, if they exist*/
-/*if they do not exist, produces ""*/
-static int concat_Properties(STRING_HANDLE existing, MAP_HANDLE map, size_t* propertiesMessageSizeContribution)
+#define PROPERTIES_BEGIN ",\"properties\":{"
+#define PROPERTY_NAME_BEGIN "\"" IOTHUB_APP_PREFIX
+#define PROPERTY_NAME_END "\":\""
+#define PROPERTY_VALUE_END "\""
+#define PROPERTIES_END "}"
+#define BYTEARRAY_BODY_BEGIN "{\"body\":\""
+#define BYTEARRAY_BODY_END "\""
+#define STRING_BODY_BEGIN "{\"body\":"
+#define STRING_BODY_END ",\"base64Encoded\":false"
+#define EVENT_END "}," /*the last comma shall be replaced by a ']' by DaCr's suggestion (which is awesome enough to receive credits in the source code)*/
+
+#define CONST_STRLEN(s) (sizeof(s) - 1)
+
+static const char hexToASCII[] = "0123456789ABCDEF";
+
+static unsigned char* writeText(unsigned char* destination, const char* text, size_t length)
+{
+	(void)memcpy(destination, text, length);
+	return destination + length;
+}
+
+/*computes the length of the JSON representation of source (quotes included) with the same rules as STRING_new_JSON*/
+/*returns non-zero if source cannot be represented (it has non-ASCII characters)*/
+static int measureJSONString(const char* source, size_t* jsonLength)
+{
+	int result = 0;
+	size_t length = 2; /*the quotes*/
+	const unsigned char* c;
+	for (c = (const unsigned char*)source; *c != '\0'; c++)
+	{
+		if (*c >= 128)
+		{
+			LogError("invalid character in input string");
+			result = __LINE__;
+			break;
+		}
+		else if (*c <= 0x1F)
+		{
+			length += 6; /*\u00XX*/
+		}
+		else if ((*c == '"') || (*c == '\\') || (*c == '/'))
+		{
+			length += 2;
+		}
+		else
+		{
+			length++;
+		}
+	}
+	*jsonLength = length;
+	return result;
+}
+
+static unsigned char* writeJSONString(unsigned char* destination, const char* source)
+{
+	const unsigned char* c;
+	*destination++ = '"';
+	for (c = (const unsigned char*)source; *c != '\0'; c++)
+	{
+		if (*c <= 0x1F)
+		{
+			*destination++ = '\\';
+			*destination++ = 'u';
+			*destination++ = '0';
+			*destination++ = '0';
+			*destination++ = hexToASCII[(*c & 0xF0) >> 4];
+			*destination++ = hexToASCII[*c & 0x0F];
+		}
+		else if ((*c == '"') || (*c == '\\') || (*c == '/'))
+		{
+			*destination++ = '\\';
+			*destination++ = *c;
+		}
+		else
+		{
+			*destination++ = *c;
+		}
+	}
+	*destination++ = '"';
+	return destination;
+}
+
+/*computes the length of ,"properties":{"iothub-app-name1":"value1",...} (0 when there are no properties)*/
+static int measureProperties(MAP_HANDLE map, size_t* jsonLength, size_t* propertiesMessageSizeContribution)
 {
 	int result;
 	const char*const* keys;
@@ -899,214 +1298,179 @@ static int concat_Properties(STRING_HANDLE existing, MAP_HANDLE map, size_t* pro
 	}
 	else
 	{
-
-		if (count == 0)
-		{
-			/*Codes_SRS_TRANSPORTMULTITHTTP_17_064: [If IoTHubMessage does not have properties, then "properties":{...} shall be missing from the payload*/
-			/*no properties - do nothing with existing*/
-			result = 0;
-			*propertiesMessageSizeContribution = 0;
-		}
-		else
+		size_t i;
+		*propertiesMessageSizeContribution = 0;
+		/*Codes_SRS_TRANSPORTMULTITHTTP_17_064: [If IoTHubMessage does not have properties, then "properties":{...} shall be missing from the payload*/
+		*jsonLength = (count == 0) ? 0 : (CONST_STRLEN(PROPERTIES_BEGIN) + (count - 1) /*commas*/ + CONST_STRLEN(PROPERTIES_END));
+		for (i = 0; i < count; i++)
 		{
-			/*Codes_SRS_TRANSPORTMULTITHTTP_17_058: [If IoTHubMessage has properties, then they shall be serialized at the same level as "body" using the following pattern: "properties":{"iothub-app-name1":"value1","iothub-app-name2":"value2*/
-			if (STRING_concat(existing, ",\"properties\":") != 0)
-			{
-				/*go ahead and return it*/
-				result = __LINE__;
-				LogError("failed STRING_concat");
-			}
-			else if (appendMapToJSON(existing, keys, values, count) != 0)
-			{
-				result = __LINE__;
-				LogError("unable to append the properties");
-			}
-			else
-			{
-				/*all is fine*/
-				size_t i;
-				*propertiesMessageSizeContribution = 0;
-				for (i = 0;i < count;i++)
-				{
-					/*Codes_SRS_TRANSPORTMULTITHTTP_17_063: [Every property name shall add to the message size the length of the property name + the length of the property value + 16 bytes.] */
-					*propertiesMessageSizeContribution += (strlen(keys[i]) + strlen(values[i]) + MAXIMUM_PROPERTY_OVERHEAD);
-				}
-				result = 0;
-			}
+			size_t keyLength = strlen(keys[i]);
+			size_t valueLength = strlen(values[i]);
+			*jsonLength += CONST_STRLEN(PROPERTY_NAME_BEGIN) + keyLength + CONST_STRLEN(PROPERTY_NAME_END) + valueLength + CONST_STRLEN(PROPERTY_VALUE_END);
+			/*Codes_SRS_TRANSPORTMULTITHTTP_17_063: [Every property name shall add to the message size the length of the property name + the length of the property value + 16 bytes.] */
+			*propertiesMessageSizeContribution += (keyLength + valueLength + MAXIMUM_PROPERTY_OVERHEAD);
 		}
+		result = 0;
 	}
 	return result;
 }
 
-/*produces a JSON representation of the map : {"a": "value_of_a","b":"value_of_b"}*/
-static int appendMapToJSON(STRING_HANDLE existing, const char* const* keys, const char* const* values, size_t count) /*under consideration: move to MAP module when it has more than 1 user*/
+static unsigned char* writeProperties(unsigned char* destination, MAP_HANDLE map)
 {
-	int result;
-	if (STRING_concat(existing, "{") != 0)
+	unsigned char* result;
+	const char*const* keys;
+	const char*const* values;
+	size_t count;
+	if (Map_GetInternals(map, &keys, &values, &count) != MAP_OK)
 	{
-		/*go on and return it*/
-		result = __LINE__;
-		LogError("STRING_construct failed");
+		result = NULL;
+		LogError("error while Map_GetInternals");
+	}
+	else if (count == 0)
+	{
+		result = destination;
 	}
 	else
 	{
+		/*Codes_SRS_TRANSPORTMULTITHTTP_17_058: [If IoTHubMessage has properties, then they shall be serialized at the same level as "body" using the following pattern: "properties":{"iothub-app-name1":"value1","iothub-app-name2":"value2*/
 		size_t i;
+		result = writeText(destination, PROPERTIES_BEGIN, CONST_STRLEN(PROPERTIES_BEGIN));
 		for (i = 0; i < count; i++)
 		{
-			if (!(
-				(STRING_concat(existing, (i == 0) ? "\"" IOTHUB_APP_PREFIX : ",\"" IOTHUB_APP_PREFIX) == 0) &&
-				(STRING_concat(existing, keys[i]) == 0) &&
-				(STRING_concat(existing, "\":\"") == 0) &&
-				(STRING_concat(existing, values[i]) == 0) &&
-				(STRING_concat(existing, "\"") == 0)
-				))
+			if (i > 0)
 			{
-				LogError("unable to STRING_concat");
-				break;
+				*result++ = ',';
 			}
+			result = writeText(result, PROPERTY_NAME_BEGIN, CONST_STRLEN(PROPERTY_NAME_BEGIN));
+			result = writeText(result, keys[i], strlen(keys[i]));
+			result = writeText(result, PROPERTY_NAME_END, CONST_STRLEN(PROPERTY_NAME_END));
+			result = writeText(result, values[i], strlen(values[i]));
+			result = writeText(result, PROPERTY_VALUE_END, CONST_STRLEN(PROPERTY_VALUE_END));
 		}
-
-		if (i < count)
-		{
-			result = __LINE__;
-			/*error, let it go through*/
-		}
-		else if (STRING_concat(existing, "}") != 0)
-		{
-			result = __LINE__;
-			LogError("unable to STRING_concat");
-		}
-		else
-		{
-			/*all is fine*/
-			result = 0;
-		}
+		result = writeText(result, PROPERTIES_END, CONST_STRLEN(PROPERTIES_END));
 	}
 	return result;
 }
 
-/*makes the following string:{"body":"base64 encoding of the message content"[,"properties":{"a":"valueOfA"}]}*/
-/*return NULL if there was a failure, or a non-NULL STRING_HANDLE that contains the intended data*/
-static STRING_HANDLE make1EventJSONitem(PDLIST_ENTRY item, size_t *messageSizeContribution)
+/*computes the length of {"body":"base64 encoding of the message content"[,"properties":{"a":"valueOfA"}]}, (trailing comma included) and the size the item adds to the batch*/
+static int measure1EventJSONitem(PDLIST_ENTRY item, size_t* jsonLength, size_t* messageSizeContribution)
 {
-	STRING_HANDLE result; /*temp wants to contain :{"body":"base64 encoding of the message content"[,"properties":{"a":"valueOfA"}]}*/
+	int result;
 	IOTHUB_MESSAGE_LIST* message = containingRecord(item, IOTHUB_MESSAGE_LIST, entry);
 	IOTHUBMESSAGE_CONTENT_TYPE contentType = IoTHubMessage_GetContentType(message->messageHandle);
+	size_t bodyLength = 0;
+	size_t bodySize = 0;
 
 	switch (contentType)
 	{
 	case IOTHUBMESSAGE_BYTEARRAY:
 	{
-		result = STRING_construct("{\"body\":\"");
-		if (result == NULL)
+		const unsigned char* source;
+		if (IoTHubMessage_GetByteArray(message->messageHandle, &source, &bodySize) != IOTHUB_MESSAGE_OK)
 		{
-			LogError("unable to STRING_construct");
+			LogError("unable to get the data for the message.");
+			result = __LINE__;
 		}
 		else
 		{
-			const unsigned char* source;
-			size_t size;
-
-			if (IoTHubMessage_GetByteArray(message->messageHandle, &source, &size) != IOTHUB_MESSAGE_OK)
-			{
-				LogError("unable to get the data for the message.");
-				STRING_delete(result);
-				result = NULL;
-			}
-			else
-			{
-				STRING_HANDLE encoded = Base64_Encode_Bytes(source, size);
-				if (encoded == NULL)
-				{
-					LogError("unable to Base64_Encode_Bytes.");
-					STRING_delete(result);
-					result = NULL;
-				}
-				else
-				{
-					size_t propertiesSize;
-					if (!(
-						(STRING_concat_with_STRING(result, encoded) == 0) &&
-						(STRING_concat(result, "\"") == 0) && /*\" because closing value*/
-						(concat_Properties(result, IoTHubMessage_Properties(message->messageHandle), &propertiesSize) == 0) &&
-						(STRING_concat(result, "},") == 0) /*the last comma shall be replaced by a ']' by DaCr's suggestion (which is awesome enough to receive credits in the source code)*/
-						))
-					{
-						STRING_delete(result);
-						result = NULL;
-						LogError("unable to STRING_concat_with_STRING.");
-					}
-					else
-					{
-						/*all is fine... */
-						/*Codes_SRS_TRANSPORTMULTITHTTP_17_062: [The message size is computed from the length of the payload + 384.] */
-						*messageSizeContribution = size + MAXIMUM_PAYLOAD_OVERHEAD + propertiesSize;
-					}
-					STRING_delete(encoded);
-				}
-			}
+			bodyLength = CONST_STRLEN(BYTEARRAY_BODY_BEGIN) + IoTHubClient_Base64_GetEncodedLength(bodySize) + CONST_STRLEN(BYTEARRAY_BODY_END);
+			result = 0;
 		}
 		break;
 	}
 	/*Codes_SRS_TRANSPORTMULTITHTTP_17_057: [If a messages to be send has type IOTHUBMESSAGE_STRING, then its serialization shall be {"body":"JSON encoding of the string", "base64Encoded":false}] */
 	case IOTHUBMESSAGE_STRING:
 	{
-		result = STRING_construct("{\"body\":");
-		if (result == NULL)
+		const char* source = IoTHubMessage_GetString(message->messageHandle);
+		if (source == NULL)
+		{
+			LogError("unable to IoTHubMessage_GetString");
+			result = __LINE__;
+		}
+		else if (measureJSONString(source, &bodyLength) != 0)
 		{
-			LogError("unable to STRING_construct");
+			LogError("unable to represent the string as JSON");
+			result = __LINE__;
 		}
 		else
 		{
-			const char* source = IoTHubMessage_GetString(message->messageHandle);
-			if (source == NULL)
-			{
-				LogError("unable to IoTHubMessage_GetString");
-				STRING_delete(result);
-				result = NULL;
-			}
-			else
-			{
-				STRING_HANDLE asJson = STRING_new_JSON(source);
-				if (asJson == NULL)
-				{
-					LogError("unable to STRING_new_JSON");
-					STRING_delete(result);
-					result = NULL;
-				}
-				else
-				{
-					size_t propertiesSize;
-					if (!(
-						(STRING_concat_with_STRING(result, asJson) == 0) &&
-						(STRING_concat(result, ",\"base64Encoded\":false") == 0) &&
-						(concat_Properties(result, IoTHubMessage_Properties(message->messageHandle), &propertiesSize) == 0) &&
-						(STRING_concat(result, "},") == 0) /*the last comma shall be replaced by a ']' by DaCr's suggestion (which is awesome enough to receive credits in the source code)*/
-						))
-					{
-						LogError("unable to STRING_concat_with_STRING");
-						STRING_delete(result);
-						result = NULL;
-					}
-					else
-					{
-						/*result has the intended content*/
-						/*Codes_SRS_TRANSPORTMULTITHTTP_17_062: [The message size is computed from the length of the payload + 384.] */
-						*messageSizeContribution = strlen(source) + MAXIMUM_PAYLOAD_OVERHEAD + propertiesSize;
-					}
-					STRING_delete(asJson);
-				}
-			}
+			bodySize = strlen(source);
+			bodyLength += CONST_STRLEN(STRING_BODY_BEGIN) + CONST_STRLEN(STRING_BODY_END);
+			result = 0;
 		}
 		break;
 	}
 	default:
 	{
 		LogError("an unknown message type was encountered (%d)", contentType);
-		result = NULL; /*unknown message type*/
+		result = __LINE__; /*unknown message type*/
 		break;
 	}
 	}
+
+	if (result == 0)
+	{
+		size_t propertiesLength;
+		size_t propertiesSize;
+		if (measureProperties(IoTHubMessage_Properties(message->messageHandle), &propertiesLength, &propertiesSize) != 0)
+		{
+			LogError("unable to measure the properties");
+			result = __LINE__;
+		}
+		else
+		{
+			*jsonLength = bodyLength + propertiesLength + CONST_STRLEN(EVENT_END);
+			/*Codes_SRS_TRANSPORTMULTITHTTP_17_062: [The message size is computed from the length of the payload + 384.] */
+			*messageSizeContribution = bodySize + MAXIMUM_PAYLOAD_OVERHEAD + propertiesSize;
+		}
+	}
+	return result;
+}
+
+/*writes the item measured by measure1EventJSONitem at destination, returns the position after it or NULL if the item cannot be written*/
+static unsigned char* write1EventJSONitem(unsigned char* destination, PDLIST_ENTRY item)
+{
+	unsigned char* result;
+	IOTHUB_MESSAGE_LIST* message = containingRecord(item, IOTHUB_MESSAGE_LIST, entry);
+	IOTHUBMESSAGE_CONTENT_TYPE contentType = IoTHubMessage_GetContentType(message->messageHandle);
+
+	if (contentType == IOTHUBMESSAGE_BYTEARRAY)
+	{
+		const unsigned char* source;
+		size_t size;
+		if (IoTHubMessage_GetByteArray(message->messageHandle, &source, &size) != IOTHUB_MESSAGE_OK)
+		{
+			LogError("unable to get the data for the message.");
+			result = NULL;
+		}
+		else
+		{
+			result = writeText(destination, BYTEARRAY_BODY_BEGIN, CONST_STRLEN(BYTEARRAY_BODY_BEGIN));
+			result = (unsigned char*)IoTHubClient_Base64_Encode((char*)result, source, size);
+			result = writeText(result, BYTEARRAY_BODY_END, CONST_STRLEN(BYTEARRAY_BODY_END));
+		}
+	}
+	else
+	{
+		const char* source = IoTHubMessage_GetString(message->messageHandle);
+		if (source == NULL)
+		{
+			LogError("unable to IoTHubMessage_GetString");
+			result = NULL;
+		}
+		else
+		{
+			result = writeText(destination, STRING_BODY_BEGIN, CONST_STRLEN(STRING_BODY_BEGIN));
+			result = writeJSONString(result, source);
+			result = writeText(result, STRING_BODY_END, CONST_STRLEN(STRING_BODY_END));
+		}
+	}
+
+	if ((result != NULL) &&
+		((result = writeProperties(result, IoTHubMessage_Properties(message->messageHandle))) != NULL))
+	{
+		result = writeText(result, EVENT_END, CONST_STRLEN(EVENT_END));
+	}
 	return result;
 }
 
@@ -1119,133 +1483,356 @@ static STRING_HANDLE make1EventJSONitem(PDLIST_ENTRY item, size_t *messageSizeCo
 DEFINE_ENUM(MAKE_PAYLOAD_RESULT, MAKE_PAYLOAD_RESULT_VALUES);
 
 /*this function assembles several {"body":"base64 encoding of the message content"," base64Encoded": true} into 1 payload*/
+/*the items that fit are measured first, so the payload is allocated once and every item is written directly in it*/
 /*Codes_SRS_TRANSPORTMULTITHTTP_17_056: [IoTHubTransportHttp_DoWork shall build the following string:[{"body":"base64 encoding of the message1 content"},{"body":"base64 encoding of the message2 content"}...]]*/
-static MAKE_PAYLOAD_RESULT makePayload(HTTPTRANSPORT_PERDEVICE_DATA* deviceData, STRING_HANDLE* payload)
+static MAKE_PAYLOAD_RESULT makePayload(HTTPTRANSPORT_PERDEVICE_DATA* deviceData, BUFFER_HANDLE* payload)
 {
-	MAKE_PAYLOAD_RESULT result;
+	MAKE_PAYLOAD_RESULT result = MAKE_PAYLOAD_OK; /*optimistically initializing it*/
 	size_t allMessagesSize = 0;
-	*payload = STRING_construct("[");
-	if (*payload == NULL)
+	size_t payloadLength = 1; /*the opening '['*/
+	size_t itemCount = 0;
+	bool keepGoing = true; /*keepGoing gets sometimes to false from within the loop*/
+	PDLIST_ENTRY actual;
+
+	*payload = NULL;
+	for (actual = deviceData->waitingToSend->Flink; keepGoing && (actual != deviceData->waitingToSend); actual = actual->Flink)
+	{
+		size_t jsonLength;
+		size_t messageSize;
+		if (measure1EventJSONitem(actual, &jsonLength, &messageSize) != 0)
+		{
+			if (itemCount == 0)
+			{
+				/*Codes_SRS_TRANSPORTMULTITHTTP_17_067: [If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity.]*/
+				result = MAKE_PAYLOAD_ERROR;
+			}
+			else
+			{
+				/*there are multiple payloads encoded, the last one had an internal error, just go with those*/
+				/*Codes_SRS_TRANSPORTMULTITHTTP_17_066: [If at any point during construction of the string there are errors, IoTHubTransportHttp_DoWork shall use the so far constructed string as payload.]*/
+			}
+			keepGoing = false;
+		}
+		/*Codes_SRS_TRANSPORTMULTITHTTP_17_065: [If the oldest message in waitingToSend causes the message size to exceed the message size limit then it shall be removed from waitingToSend, and IoTHubClient_LL_SendComplete shall be called. Parameter PDLIST_ENTRY completed shall point to a list containing only the oldest item, and parameter IOTHUB_BATCHSTATE result shall be set to IOTHUB_BATCHSTATE_FAILED.]*/
+		/*Codes_SRS_TRANSPORTMULTITHTTP_17_061: [The message size shall be limited to 255KB - 1 byte.]*/
+		else if ((itemCount == 0) && (messageSize > MAXIMUM_MESSAGE_SIZE))
+		{
+			PDLIST_ENTRY head = DList_RemoveHeadList(deviceData->waitingToSend); /*actually this is the same as "actual", but now it is removed*/
+			DList_InsertTailList(&(deviceData->eventConfirmations), head);
+			result = MAKE_PAYLOAD_FIRST_ITEM_DOES_NOT_FIT;
+			keepGoing = false;
+		}
+		else if (allMessagesSize + messageSize > MAXIMUM_MESSAGE_SIZE)
+		{
+			/*this item doesn't make it to the payload, but the payload is valid so far*/
+			keepGoing = false;
+		}
+		else
+		{
+			allMessagesSize += messageSize;
+			payloadLength += jsonLength;
+			itemCount++;
+		}
+	}
+
+	if (result != MAKE_PAYLOAD_OK)
+	{
+		/*nothing to send*/
+	}
+	else if (itemCount == 0)
+	{
+		result = MAKE_PAYLOAD_NO_ITEMS;
+	}
+	else if ((*payload = BUFFER_new()) == NULL)
+	{
+		LogError("unable to BUFFER_new");
+		result = MAKE_PAYLOAD_ERROR;
+	}
+	else if (BUFFER_pre_build(*payload, payloadLength) != 0)
 	{
-		LogError("unable to STRING_construct");
+		LogError("unable to BUFFER_pre_build");
+		BUFFER_delete(*payload);
+		*payload = NULL;
 		result = MAKE_PAYLOAD_ERROR;
 	}
 	else
 	{
-		bool isFirst = true;
-		PDLIST_ENTRY actual;
-		bool keepGoing = true; /*keepGoing gets sometimes to false from within the loop*/
-							   /*either all the items enter the list or only some*/
-		result = MAKE_PAYLOAD_OK; /*optimistically initializing it*/
-		while (keepGoing && ((actual = deviceData->waitingToSend->Flink) != deviceData->waitingToSend))
+		unsigned char* start = BUFFER_u_char(*payload);
+		unsigned char* destination = start;
+		size_t i;
+
+		*destination++ = '[';
+		actual = deviceData->waitingToSend->Flink;
+		for (i = 0; (i < itemCount) && (destination != NULL); i++)
 		{
-			size_t messageSize;
-			STRING_HANDLE temp = make1EventJSONitem(actual, &messageSize);
-			if (isFirst)
+			destination = write1EventJSONitem(destination, actual);
+			actual = actual->Flink;
+		}
+
+		if ((destination == NULL) || ((size_t)(destination - start) != payloadLength))
+		{
+			LogError("unable to write the batched payload");
+			BUFFER_delete(*payload);
+			*payload = NULL;
+			result = MAKE_PAYLOAD_ERROR;
+		}
+		else
+		{
+			/*closing the payload*/
+			destination[-1] = ']';
+			/*the items are now in the payload, they wait for the HTTP result in eventConfirmations*/
+			for (i = 0; i < itemCount; i++)
 			{
-				isFirst = false;
-				/*Codes_SRS_TRANSPORTMULTITHTTP_17_067: [If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity.]*/
-				if (temp == NULL) /*first item failed to create, nothing to send*/
-				{
-					result = MAKE_PAYLOAD_ERROR;
-					STRING_delete(*payload);
-					*payload = NULL;
-					keepGoing = false;
-				}
-				else
-				{
-					/*Codes_SRS_TRANSPORTMULTITHTTP_17_065: [If the oldest message in waitingToSend causes the message size to exceed the message size limit then it shall be removed from waitingToSend, and IoTHubClient_LL_SendComplete shall be called. Parameter PDLIST_ENTRY completed shall point to a list containing only the oldest item, and parameter IOTHUB_BATCHSTATE result shall be set to IOTHUB_BATCHSTATE_FAILED.]*/
-					/*Codes_SRS_TRANSPORTMULTITHTTP_17_061: [The message size shall be limited to 255KB - 1 byte.]*/
-					if (messageSize > MAXIMUM_MESSAGE_SIZE)
-					{
-						PDLIST_ENTRY head = DList_RemoveHeadList(deviceData->waitingToSend); /*actually this is the same as "actual", but now it is removed*/
-						DList_InsertTailList(&(deviceData->eventConfirmations), head);
-						result = MAKE_PAYLOAD_FIRST_ITEM_DOES_NOT_FIT;
-						STRING_delete(*payload);
-						*payload = NULL;
-						keepGoing = false;
-					}
-					else
-					{
-						if (STRING_concat_with_STRING(*payload, temp) != 0)
-						{
-							/*Codes_SRS_TRANSPORTMULTITHTTP_17_067: [If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity.]*/
-							result = MAKE_PAYLOAD_ERROR;
-							STRING_delete(*payload);
-							*payload = NULL;
-							keepGoing = false;
-						}
-						else
-						{
-							/*first item was put nicely in the payload*/
-							PDLIST_ENTRY head = DList_RemoveHeadList(deviceData->waitingToSend); /*actually this is the same as "actual", but now it is removed*/
-							DList_InsertTailList(&(deviceData->eventConfirmations), head);
-							allMessagesSize += messageSize;
-						}
-					}
-					STRING_delete(temp);
-				}
+				PDLIST_ENTRY head = DList_RemoveHeadList(deviceData->waitingToSend);
+				DList_InsertTailList(&(deviceData->eventConfirmations), head);
+			}
+		}
+	}
+	return result;
+}
+
+static void reversePutListBackIn(PDLIST_ENTRY source, PDLIST_ENTRY destination)
+{
+	/*this function takes a list, and inserts it in another list. When done in the context of this file, it reverses the effects of a not-able-to-send situation*/
+	DList_AppendTailList(destination->Flink, source);
+	DList_RemoveEntryList(source);
+	DList_InitializeListHead(source);
+}
+
+/*the upper layer lock (if any) is released for the duration of the HTTP request so other workers can make progress*/
+static void releaseUpperLayer(const HTTPTRANSPORT_CONNECTION* connection)
+{
+	if ((connection->upperLayerLock != NULL) && (Unlock(connection->upperLayerLock) != LOCK_OK))
+	{
+		LogError("unable to Unlock");
+	}
+}
+
+static void acquireUpperLayer(const HTTPTRANSPORT_CONNECTION* connection)
+{
+	if ((connection->upperLayerLock != NULL) && (Lock(connection->upperLayerLock) != LOCK_OK))
+	{
+		LogError("unable to Lock");
+	}
+}
+
+static HTTPAPIEX_RESULT executeRequest(const HTTPTRANSPORT_CONNECTION* connection, HTTPAPI_REQUEST_TYPE requestType, const char* relativePath, HTTP_HEADERS_HANDLE requestHttpHeadersHandle, BUFFER_HANDLE requestContent, unsigned int* statusCode, HTTP_HEADERS_HANDLE responseHttpHeadersHandle, BUFFER_HANDLE responseContent)
+{
+	HTTPAPIEX_RESULT result;
+	releaseUpperLayer(connection);
+	result = HTTPAPIEX_ExecuteRequest(connection->httpApiExHandle, requestType, relativePath, requestHttpHeadersHandle, requestContent, statusCode, responseHttpHeadersHandle, responseContent);
+	acquireUpperLayer(connection);
+	return result;
+}
+
+/*makes sure deviceData->cachedSasToken holds a token that is at most half way through its lifetime*/
+static int refreshCachedSasToken(HTTPTRANSPORT_PERDEVICE_DATA* deviceData, time_t timeNow)
+{
+	int result;
+	size_t sasTokenLifetimeInSeconds = deviceData->transportHandle->sasTokenLifetime / 1000;
+	if (
+		(deviceData->cachedSasToken != NULL) &&
+		(get_difftime(timeNow, deviceData->cachedSasTokenCreateTime) < (double)(sasTokenLifetimeInSeconds / 2))
+		)
+	{
+		/*Codes_SRS_TRANSPORTMULTITHTTP_02_023: [ The cached SAS token shall be reused until half of "sas_token_lifetime" has elapsed since it was created. ]*/
+		result = 0;
+	}
+	else
+	{
+		/*Codes_SRS_TRANSPORTMULTITHTTP_02_022: [ If "sas_token_lifetime" is not 0, then before every request of a device that has a deviceKey _DoWork shall create a SAS token by calling SASToken_Create with the device key, hostname + "/devices/" + URL_ENCODED(deviceId), an empty key name and an expiry of now + "sas_token_lifetime", unless a cached one can be reused. ]*/
+		STRING_HANDLE uriResource = STRING_clone(deviceData->transportHandle->hostName);
+		if (uriResource == NULL)
+		{
+			LogError("unable to STRING_clone");
+			result = __LINE__;
+		}
+		else
+		{
+			STRING_HANDLE urlEncodedDeviceId = URL_EncodeString(STRING_c_str(deviceData->deviceId));
+			if (urlEncodedDeviceId == NULL)
+			{
+				LogError("unable to URL_EncodeString");
+				result = __LINE__;
 			}
 			else
 			{
-				/*there is at least 1 item already in the payload*/
-				if (temp == NULL)
+				STRING_HANDLE emptyKeyName;
+				if (!(
+					(STRING_concat(uriResource, "/devices/") == 0) &&
+					(STRING_concat_with_STRING(uriResource, urlEncodedDeviceId) == 0)
+					))
 				{
-					/*there are multiple payloads encoded, the last one had an internal error, just go with those - closing the payload happens "after the loop"*/
-					/*Codes_SRS_TRANSPORTMULTITHTTP_17_066: [If at any point during construction of the string there are errors, IoTHubTransportHttp_DoWork shall use the so far constructed string as payload.]*/
-					result = MAKE_PAYLOAD_OK;
-					keepGoing = false;
+					LogError("unable to STRING_concat");
+					result = __LINE__;
+				}
+				else if ((emptyKeyName = STRING_new()) == NULL)
+				{
+					LogError("unable to STRING_new");
+					result = __LINE__;
 				}
 				else
 				{
-					if (allMessagesSize + messageSize > MAXIMUM_MESSAGE_SIZE)
-					{
-						/*this item doesn't make it to the payload, but the payload is valid so far*/
-						/*Codes_SRS_TRANSPORTMULTITHTTP_17_066: [If at any point during construction of the string there are errors, IoTHubTransportHttp_DoWork shall use the so far constructed string as payload.]*/
-						result = MAKE_PAYLOAD_OK;
-						keepGoing = false;
-					}
-					else if (STRING_concat_with_STRING(*payload, temp) != 0)
+					size_t expiry = (size_t)get_difftime(timeNow, (time_t)0) + sasTokenLifetimeInSeconds;
+					STRING_HANDLE newSasToken = SASToken_Create(deviceData->deviceKey, uriResource, emptyKeyName, expiry);
+					if (newSasToken == NULL)
 					{
-						/*should still send what there is so far...*/
-						/*Codes_SRS_TRANSPORTMULTITHTTP_17_066: [If at any point during construction of the string there are errors, IoTHubTransportHttp_DoWork shall use the so far constructed string as payload.]*/
-						result = MAKE_PAYLOAD_OK;
-						keepGoing = false;
+						/*Codes_SRS_TRANSPORTMULTITHTTP_02_024: [ If creating the SAS token fails, then the request shall fail the same way a failed HTTPAPIEX_SAS_ExecuteRequest does. ]*/
+						LogError("unable to SASToken_Create");
+						result = __LINE__;
 					}
 					else
 					{
-						/*cool, the payload made it there, let's continue... */
-						PDLIST_ENTRY head = DList_RemoveHeadList(deviceData->waitingToSend); /*actually this is the same as "actual", but now it is removed*/
-						DList_InsertTailList(&(deviceData->eventConfirmations), head);
-						allMessagesSize += messageSize;
+						destroy_cachedSasToken(deviceData);
+						deviceData->cachedSasToken = newSasToken;
+						deviceData->cachedSasTokenCreateTime = timeNow;
+						result = 0;
 					}
-					STRING_delete(temp);
+					STRING_delete(emptyKeyName);
 				}
+				STRING_delete(urlEncodedDeviceId);
 			}
+			STRING_delete(uriResource);
 		}
+	}
+	return result;
+}
+
+static HTTPAPIEX_RESULT executeSasRequest(const HTTPTRANSPORT_CONNECTION* connection, HTTPTRANSPORT_PERDEVICE_DATA* deviceData, HTTPAPI_REQUEST_TYPE requestType, const char* relativePath, HTTP_HEADERS_HANDLE requestHttpHeadersHandle, BUFFER_HANDLE requestContent, unsigned int* statusCode, HTTP_HEADERS_HANDLE responseHttpHeadersHandle, BUFFER_HANDLE responseContent)
+{
+	HTTPAPIEX_RESULT result;
+	time_t timeNow;
+	if (
+		(deviceData->transportHandle->sasTokenLifetime == 0) ||
+		((timeNow = get_time(NULL)) == (time_t)(-1))
+		)
+	{
+		/*Codes_SRS_TRANSPORTMULTITHTTP_02_025: [ If "sas_token_lifetime" is 0 or time is not available, then the request shall be executed by HTTPAPIEX_SAS_ExecuteRequest. ]*/
+		releaseUpperLayer(connection);
+		result = HTTPAPIEX_SAS_ExecuteRequest(deviceData->sasObject, connection->httpApiExHandle, requestType, relativePath, requestHttpHeadersHandle, requestContent, statusCode, responseHttpHeadersHandle, responseContent);
+		acquireUpperLayer(connection);
+	}
+	else if (refreshCachedSasToken(deviceData, timeNow) != 0)
+	{
+		result = HTTPAPIEX_ERROR;
+	}
+	/*Codes_SRS_TRANSPORTMULTITHTTP_02_026: [ Otherwise, the "Authorization" header of the request shall be set to the cached SAS token and the request shall be executed by HTTPAPIEX_ExecuteRequest. ]*/
+	else if (HTTPHeaders_ReplaceHeaderNameValuePair(requestHttpHeadersHandle, "Authorization", STRING_c_str(deviceData->cachedSasToken)) != HTTP_HEADERS_OK)
+	{
+		LogError("unable to HTTPHeaders_ReplaceHeaderNameValuePair");
+		result = HTTPAPIEX_ERROR;
+	}
+	else
+	{
+		result = executeRequest(connection, requestType, relativePath, requestHttpHeadersHandle, requestContent, statusCode, responseHttpHeadersHandle, responseContent);
+	}
+	return result;
+}
+
+static uint64_t getBatchLingerMs(const HTTPTRANSPORT_HANDLE_DATA* handleData)
+{
+	uint64_t result = handleData->batchLingerMs;
+	/*Codes_SRS_TRANSPORTMULTITHTTP_02_034: [ If "BatchLingerAdaptive" is true and a batched POST has completed, then the linger shall be the smoothed round trip time of the batched POSTs, capped by "BatchLingerMs" when "BatchLingerMs" is not 0. ]*/
+	if (
+		handleData->isBatchLingerAdaptive &&
+		(handleData->smoothedRoundTripMs != 0) &&
+		((result == 0) || (handleData->smoothedRoundTripMs < result))
+		)
+	{
+		result = handleData->smoothedRoundTripMs;
+	}
+	return result;
+}
 
-		/*closing the payload*/
-		if (result == MAKE_PAYLOAD_OK)
+/*returns true when the batch of this device should wait for more events (Nagle-style), false when it should be sent now*/
+static bool shallBatchLinger(const HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVICE_DATA* deviceData)
+{
+	bool result;
+	uint64_t lingerMs;
+	uint64_t nowMs;
+	if (
+		(handleData->tickCounter == NULL) ||
+		((lingerMs = getBatchLingerMs(handleData)) == 0)
+		)
+	{
+		/*Codes_SRS_TRANSPORTMULTITHTTP_02_028: [ If the linger is 0 then _DoWork shall send the batch right away. ]*/
+		result = false;
+	}
+	else if (tickcounter_get_current_ms(handleData->tickCounter, &nowMs) != 0)
+	{
+		LogError("unable to tickcounter_get_current_ms, the batch is sent without lingering");
+		result = false;
+	}
+	else
+	{
+		bool shallFlush = false;
+		PDLIST_ENTRY actual;
+		if (!deviceData->isBatchLingering)
 		{
-			((char*)STRING_c_str(*payload))[STRING_length(*payload) - 1] = ']'; /*TODO - do this in STRING_HANDLE*/
+			deviceData->isBatchLingering = true;
+			deviceData->batchLingerStartMs = nowMs;
+			deviceData->batchLingerBytes = 0;
+			deviceData->batchLingerLastCounted = deviceData->waitingToSend;
 		}
-		else
+
+		/*Codes_SRS_TRANSPORTMULTITHTTP_02_041: [ While a batch lingers, _DoWork shall keep a running total of the size of its events and shall only measure the events added to waitingToSend since the previous _DoWork. ]*/
+		for (actual = deviceData->batchLingerLastCounted->Flink; !shallFlush && (actual != deviceData->waitingToSend); actual = actual->Flink)
 		{
-			/*no need to close anything*/
+			size_t jsonLength;
+			size_t messageSize;
+			/*Codes_SRS_TRANSPORTMULTITHTTP_02_030: [ The batch shall be sent without lingering if any of its events has a message timeout. ]*/
+			if (
+				(containingRecord(actual, IOTHUB_MESSAGE_LIST, entry)->ms_timesOutAfter != 0) ||
+				(measure1EventJSONitem(actual, &jsonLength, &messageSize) != 0)
+				)
+			{
+				shallFlush = true;
+			}
+			else
+			{
+				deviceData->batchLingerBytes += messageSize;
+				deviceData->batchLingerLastCounted = actual;
+				/*Codes_SRS_TRANSPORTMULTITHTTP_02_029: [ The batch shall be sent without lingering once the events in waitingToSend amount to "BatchMinBytes" or to the maximum batch size. ]*/
+				shallFlush = (deviceData->batchLingerBytes > MAXIMUM_MESSAGE_SIZE) || ((handleData->batchMinBytes != 0) && (deviceData->batchLingerBytes >= handleData->batchMinBytes));
+			}
 		}
+
+		/*Codes_SRS_TRANSPORTMULTITHTTP_02_027: [ If "Batching" is true and the linger is not 0, then _DoWork shall hold back the events of a device until the oldest one has waited for the linger. ]*/
+		result = !shallFlush && (nowMs - deviceData->batchLingerStartMs < lingerMs);
+	}
+
+	if (!result)
+	{
+		/*the batch goes out now, the next events start a new linger*/
+		deviceData->isBatchLingering = false;
 	}
 	return result;
 }
 
-static void reversePutListBackIn(PDLIST_ENTRY source, PDLIST_ENTRY destination)
+/*feeds the duration of a batched POST into the smoothed round trip time that drives the adaptive linger*/
+static void updateSmoothedRoundTrip(HTTPTRANSPORT_HANDLE_DATA* handleData, uint64_t startMs)
 {
-	/*this function takes a list, and inserts it in another list. When done in the context of this file, it reverses the effects of a not-able-to-send situation*/
-	DList_AppendTailList(destination->Flink, source);
-	DList_RemoveEntryList(source);
-	DList_InitializeListHead(source);
+	uint64_t endMs;
+	if (tickcounter_get_current_ms(handleData->tickCounter, &endMs) != 0)
+	{
+		LogError("unable to tickcounter_get_current_ms");
+	}
+	else
+	{
+		uint64_t sampleMs = (endMs > startMs) ? (endMs - startMs) : 1;
+		/*Codes_SRS_TRANSPORTMULTITHTTP_02_035: [ The first batched POST that completes shall set the smoothed round trip time to its duration, every following one shall set it to (7 * smoothed + duration) / 8. ]*/
+		if (handleData->smoothedRoundTripMs == 0)
+		{
+			handleData->smoothedRoundTripMs = sampleMs;
+		}
+		else
+		{
+			handleData->smoothedRoundTripMs = (handleData->smoothedRoundTripMs * (ROUNDTRIP_SMOOTHING_FACTOR - 1) + sampleMs) / ROUNDTRIP_SMOOTHING_FACTOR;
+		}
+	}
 }
 
-static void DoEvent(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVICE_DATA* deviceData, IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle)
+static void DoEvent(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVICE_DATA* deviceData, IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, const HTTPTRANSPORT_CONNECTION* connection)
 {
 
 	if (DList_IsListEmpty(deviceData->waitingToSend))
@@ -1257,8 +1844,12 @@ static void DoEvent(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVI
 		/*Codes_SRS_TRANSPORTMULTITHTTP_17_053: [If option SetBatching is true then _Dowork shall send batched event message as specced below.] */
 		if (handleData->doBatchedTransfers)
 		{
+			if (shallBatchLinger(handleData, deviceData))
+			{
+				/*the events stay in waitingToSend, a later _DoWork sends them*/
+			}
 			/*Codes_SRS_TRANSPORTMULTITHTTP_17_054: [Request HTTP headers shall have the value of "Content-Type" created or updated to "application/vnd.microsoft.iothub.json" by a call to HTTPHeaders_ReplaceHeaderNameValuePair.] */
-			if (HTTPHeaders_ReplaceHeaderNameValuePair(deviceData->eventHTTPrequestHeaders, CONTENT_TYPE, APPLICATION_VND_MICROSOFT_IOTHUB_JSON) != HTTP_HEADERS_OK)
+			else if (HTTPHeaders_ReplaceHeaderNameValuePair(deviceData->eventHTTPrequestHeaders, CONTENT_TYPE, APPLICATION_VND_MICROSOFT_IOTHUB_JSON) != HTTP_HEADERS_OK)
 			{
 				/*Codes_SRS_TRANSPORTMULTITHTTP_17_055: [If updating Content-Type fails for any reason, then _DoWork shall advance to the next action.] */
 				LogError("unable to HTTPHeaders_ReplaceHeaderNameValuePair");
@@ -1266,68 +1857,54 @@ static void DoEvent(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVI
 			else
 			{
 				/*Codes_SRS_TRANSPORTMULTITHTTP_17_059: [It shall inspect the "waitingToSend" DLIST passed in config structure.] */
-				STRING_HANDLE payload;
+				BUFFER_HANDLE payload;
 				switch (makePayload(deviceData, &payload))
 				{
 				case MAKE_PAYLOAD_OK:
 				{
 					/*Codes_SRS_TRANSPORTMULTITHTTP_17_068: [Once a final payload has been obtained, IoTHubTransportHttp_DoWork shall call HTTPAPIEX_SAS_ExecuteRequest passing the following parameters:] */
-					BUFFER_HANDLE temp = BUFFER_new();
-					if (temp == NULL)
+					unsigned int statusCode;
+					HTTPAPIEX_RESULT r;
+					uint64_t startMs = 0;
+					bool isRoundTripMeasured = handleData->isBatchLingerAdaptive && (handleData->tickCounter != NULL) && (tickcounter_get_current_ms(handleData->tickCounter, &startMs) == 0);
+					if ((r = executeSasRequest(
+						connection,
+						deviceData,
+						HTTPAPI_REQUEST_POST,
+						STRING_c_str(deviceData->eventHTTPrelativePath),
+						deviceData->eventHTTPrequestHeaders,
+						payload,
+						&statusCode,
+						NULL,
+						NULL
+						)) != HTTPAPIEX_OK)
 					{
-						LogError("unable to BUFFER_new");
-						/*Codes_SRS_TRANSPORTMULTITHTTP_17_067: [If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity.]*/
+						LogError("unable to HTTPAPIEX_ExecuteRequest");
+						//items go back to waitingToSend
+						/*Codes_SRS_TRANSPORTMULTITHTTP_17_069: [if HTTPAPIEX_SAS_ExecuteRequest fails or the http status code >=300 then IoTHubTransportHttp_DoWork shall not do any other action (it is assumed at the next _DoWork it shall be retried).] */
 						reversePutListBackIn(&(deviceData->eventConfirmations), deviceData->waitingToSend);
 					}
 					else
 					{
-						if (BUFFER_build(temp, (const unsigned char*)STRING_c_str(payload), STRING_length(payload)) != 0)
+						if (isRoundTripMeasured)
 						{
-							LogError("unable to BUFFER_build");
-							//items go back to waitingToSend
-							/*Codes_SRS_TRANSPORTMULTITHTTP_17_067: [If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity.]*/
-							reversePutListBackIn(&(deviceData->eventConfirmations), deviceData->waitingToSend);
+							updateSmoothedRoundTrip(handleData, startMs);
+						}
+
+						if (statusCode < 300)
+						{
+							/*Codes_SRS_TRANSPORTMULTITHTTP_17_070: [If HTTPAPIEX_SAS_ExecuteRequest does not fail and http status code <300 then IoTHubTransportHttp_DoWork shall call IoTHubClient_LL_SendComplete. Parameter PDLIST_ENTRY completed shall point to a list containing all the items batched, and parameter IOTHUB_BATCHSTATE result shall be set to IOTHUB_BATCHSTATE_SUCESS. The batched items shall be removed from waitingToSend.] */
+							IoTHubClient_LL_SendComplete(iotHubClientHandle, &(deviceData->eventConfirmations), IOTHUB_BATCHSTATE_SUCCESS);
 						}
 						else
 						{
-							unsigned int statusCode;
-							HTTPAPIEX_RESULT r;
-							if ((r = HTTPAPIEX_SAS_ExecuteRequest(
-								deviceData->sasObject,
-								handleData->httpApiExHandle,
-								HTTPAPI_REQUEST_POST,
-								STRING_c_str(deviceData->eventHTTPrelativePath),
-								deviceData->eventHTTPrequestHeaders,
-								temp,
-								&statusCode,
-								NULL,
-								NULL
-								)) != HTTPAPIEX_OK)
-							{
-								LogError("unable to HTTPAPIEX_ExecuteRequest");
-								//items go back to waitingToSend
-								/*Codes_SRS_TRANSPORTMULTITHTTP_17_069: [if HTTPAPIEX_SAS_ExecuteRequest fails or the http status code >=300 then IoTHubTransportHttp_DoWork shall not do any other action (it is assumed at the next _DoWork it shall be retried).] */
-								reversePutListBackIn(&(deviceData->eventConfirmations), deviceData->waitingToSend);
-							}
-							else
-							{
-								if (statusCode < 300)
-								{
-									/*Codes_SRS_TRANSPORTMULTITHTTP_17_070: [If HTTPAPIEX_SAS_ExecuteRequest does not fail and http status code <300 then IoTHubTransportHttp_DoWork shall call IoTHubClient_LL_SendComplete. Parameter PDLIST_ENTRY completed shall point to a list containing all the items batched, and parameter IOTHUB_BATCHSTATE result shall be set to IOTHUB_BATCHSTATE_SUCESS. The batched items shall be removed from waitingToSend.] */
-									IoTHubClient_LL_SendComplete(iotHubClientHandle, &(deviceData->eventConfirmations), IOTHUB_BATCHSTATE_SUCCESS);
-								}
-								else
-								{
-									//items go back to waitingToSend
-									/*Codes_SRS_TRANSPORTMULTITHTTP_17_069: [if HTTPAPIEX_SAS_ExecuteRequest fails or the http status code >=300 then IoTHubTransportHttp_DoWork shall not do any other action (it is assumed at the next _DoWork it shall be retried).] */
-									LogError("unexpected HTTP status code (%u)", statusCode);
-									reversePutListBackIn(&(deviceData->eventConfirmations), deviceData->waitingToSend);
-								}
-							}
+							//items go back to waitingToSend
+							/*Codes_SRS_TRANSPORTMULTITHTTP_17_069: [if HTTPAPIEX_SAS_ExecuteRequest fails or the http status code >=300 then IoTHubTransportHttp_DoWork shall not do any other action (it is assumed at the next _DoWork it shall be retried).] */
+							LogError("unexpected HTTP status code (%u)", statusCode);
+							reversePutListBackIn(&(deviceData->eventConfirmations), deviceData->waitingToSend);
 						}
-						BUFFER_delete(temp);
 					}
-					STRING_delete(payload);
+					BUFFER_delete(payload);
 					break;
 				}
 				case MAKE_PAYLOAD_FIRST_ITEM_DOES_NOT_FIT:
@@ -1521,8 +2098,8 @@ static void DoEvent(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVI
 												}
 
 												/*Codes_SRS_TRANSPORTMULTITHTTP_03_003: [If a deviceSasToken exists, IoTHubTransportHttp_DoWork shall call HTTPAPIEX_ExecuteRequest passing the following parameters] */
-												else if ((r = HTTPAPIEX_ExecuteRequest(
-													handleData->httpApiExHandle,
+												else if ((r = executeRequest(
+													connection,
 													HTTPAPI_REQUEST_POST,
 													STRING_c_str(deviceData->eventHTTPrelativePath),
 													clonedEventHTTPrequestHeaders,
@@ -1538,9 +2115,9 @@ static void DoEvent(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVI
 											else
 											{
 												/*Codes_SRS_TRANSPORTMULTITHTTP_17_080: [If a deviceSasToken does not exist, IoTHubTransportHttp_DoWork shall call HTTPAPIEX_SAS_ExecuteRequest passing the following parameters] */
-												if ((r = HTTPAPIEX_SAS_ExecuteRequest(
-													deviceData->sasObject,
-													handleData->httpApiExHandle,
+												if ((r = executeSasRequest(
+													connection,
+													deviceData,
 													HTTPAPI_REQUEST_POST,
 													STRING_c_str(deviceData->eventHTTPrelativePath),
 													clonedEventHTTPrequestHeaders,
@@ -1588,7 +2165,7 @@ static void DoEvent(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVI
     ACCEPT
 DEFINE_ENUM(ACTION, ACTION_VALUES);
 
-static void abandonOrAcceptMessage(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVICE_DATA* deviceData, const char* ETag, ACTION action)
+static void abandonOrAcceptMessage(const HTTPTRANSPORT_CONNECTION* connection, HTTPTRANSPORT_PERDEVICE_DATA* deviceData, const char* ETag, ACTION action)
 {
 	/*Codes_SRS_TRANSPORTMULTITHTTP_17_097: [_DoWork shall call HTTPAPIEX_SAS_ExecuteRequest with the following parameters:
 	-requestType: POST
@@ -1653,63 +2230,32 @@ static void abandonOrAcceptMessage(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTR
 			}
 			else
 			{
-				HTTP_HEADERS_HANDLE abandonRequestHttpHeaders = HTTPHeaders_Alloc();
-				if (abandonRequestHttpHeaders == NULL)
+				/*Codes_SRS_TRANSPORTMULTITHTTP_02_013: [ _DoWork shall set the "If-Match" header of the abandon HTTP request headers created by _Register to the value of ETag by calling HTTPHeaders_ReplaceHeaderNameValuePair. ]*/
+				if (HTTPHeaders_ReplaceHeaderNameValuePair(deviceData->abandonHTTPrequestHeaders, "If-Match", ETag) != HTTP_HEADERS_OK)
 				{
 					/*Codes_SRS_TRANSPORTMULTITHTTP_17_098: [Abandoning the message is considered successful if the HTTPAPIEX_SAS_ExecuteRequest doesn't fail and the statusCode is 204.]*/
 					/*Codes_SRS_TRANSPORTMULTITHTTP_17_100: [Accepting a message is successful when HTTPAPIEX_SAS_ExecuteRequest completes successfully and the status code is 204.] */
 					/*Codes_SRS_TRANSPORTMULTITHTTP_17_102: [Rejecting a message is successful when HTTPAPIEX_SAS_ExecuteRequest completes successfully and the status code is 204.] */
-					LogError("unable to HTTPHeaders_Alloc");
+					LogError("unable to HTTPHeaders_ReplaceHeaderNameValuePair");
 				}
 				else
 				{
-					if (!(
-						(HTTPHeaders_AddHeaderNameValuePair(abandonRequestHttpHeaders, "User-Agent", CLIENT_DEVICE_TYPE_PREFIX CLIENT_DEVICE_BACKSLASH IOTHUB_SDK_VERSION) == HTTP_HEADERS_OK) &&
-						(HTTPHeaders_AddHeaderNameValuePair(abandonRequestHttpHeaders, "Authorization", " ") == HTTP_HEADERS_OK) &&
-						(HTTPHeaders_AddHeaderNameValuePair(abandonRequestHttpHeaders, "If-Match", ETag) == HTTP_HEADERS_OK)
-						))
-					{
-						/*Codes_SRS_TRANSPORTMULTITHTTP_17_098: [Abandoning the message is considered successful if the HTTPAPIEX_SAS_ExecuteRequest doesn't fail and the statusCode is 204.]*/
-						/*Codes_SRS_TRANSPORTMULTITHTTP_17_100: [Accepting a message is successful when HTTPAPIEX_SAS_ExecuteRequest completes successfully and the status code is 204.] */
-						/*Codes_SRS_TRANSPORTMULTITHTTP_17_102: [Rejecting a message is successful when HTTPAPIEX_SAS_ExecuteRequest completes successfully and the status code is 204.] */
-						LogError("unable to HTTPHeaders_AddHeaderNameValuePair");
-					}
-					else
+					unsigned int statusCode;
+					HTTPAPIEX_RESULT r;
+					if (deviceData->deviceSasToken != NULL)
 					{
-						unsigned int statusCode;
-						HTTPAPIEX_RESULT r;
-						if (deviceData->deviceSasToken != NULL)
+						/*Codes_SRS_TRANSPORTMULTITHTTP_03_001: [if a deviceSasToken exists, HTTPHeaders_ReplaceHeaderNameValuePair shall be invoked with "Authorization" as its second argument and STRING_c_str (deviceSasToken) as its third argument.]*/
+						if (HTTPHeaders_ReplaceHeaderNameValuePair(deviceData->abandonHTTPrequestHeaders, "Authorization", STRING_c_str(deviceData->deviceSasToken)) != HTTP_HEADERS_OK)
 						{
-							/*Codes_SRS_TRANSPORTMULTITHTTP_03_001: [if a deviceSasToken exists, HTTPHeaders_ReplaceHeaderNameValuePair shall be invoked with "Authorization" as its second argument and STRING_c_str (deviceSasToken) as its third argument.]*/
-							if (HTTPHeaders_ReplaceHeaderNameValuePair(abandonRequestHttpHeaders, "Authorization", STRING_c_str(deviceData->deviceSasToken)) != HTTP_HEADERS_OK)
-							{
-								r = HTTPAPIEX_ERROR;
-								/*Codes_SRS_TRANSPORTMULTITHTTP_03_002: [If the result of the invocation of HTTPHeaders_ReplaceHeaderNameValuePair is NOT HTTP_HEADERS_OK then fallthrough.]*/
-								LogError("Unable to replace the old SAS Token.");
-							}
-							else if ((r = HTTPAPIEX_ExecuteRequest(
-								handleData->httpApiExHandle,
-								(action == ABANDON) ? HTTPAPI_REQUEST_POST : HTTPAPI_REQUEST_DELETE,                               /*-requestType: POST                                                                                                       */
-								STRING_c_str(fullAbandonRelativePath),              /*-relativePath: abandon relative path begin (as created by _Create) + value of ETag + "/abandon?api-version=2016-02-03"   */
-								abandonRequestHttpHeaders,                          /*- requestHttpHeadersHandle: an HTTP headers instance containing the following                                            */
-								NULL,                                               /*- requestContent: NULL                                                                                                   */
-								&statusCode,                                         /*- statusCode: a pointer to unsigned int which might be examined for logging                                              */
-								NULL,                                               /*- responseHeadearsHandle: NULL                                                                                           */
-								NULL                                                /*- responseContent: NULL]                                                                                                 */
-								)) != HTTPAPIEX_OK)
-							{
-								/*Codes_SRS_TRANSPORTMULTITHTTP_17_098: [Abandoning the message is considered successful if the HTTPAPIEX_SAS_ExecuteRequest doesn't fail and the statusCode is 204.]*/
-								/*Codes_SRS_TRANSPORTMULTITHTTP_17_100: [Accepting a message is successful when HTTPAPIEX_SAS_ExecuteRequest completes successfully and the status code is 204.] */
-								/*Codes_SRS_TRANSPORTMULTITHTTP_17_102: [Rejecting a message is successful when HTTPAPIEX_SAS_ExecuteRequest completes successfully and the status code is 204.] */
-								LogError("Unable to HTTPAPIEX_ExecuteRequest.");
-							}
+							r = HTTPAPIEX_ERROR;
+							/*Codes_SRS_TRANSPORTMULTITHTTP_03_002: [If the result of the invocation of HTTPHeaders_ReplaceHeaderNameValuePair is NOT HTTP_HEADERS_OK then fallthrough.]*/
+							LogError("Unable to replace the old SAS Token.");
 						}
-						else if ((r = HTTPAPIEX_SAS_ExecuteRequest(
-							deviceData->sasObject,
-							handleData->httpApiExHandle,
+						else if ((r = executeRequest(
+							connection,
 							(action == ABANDON) ? HTTPAPI_REQUEST_POST : HTTPAPI_REQUEST_DELETE,                               /*-requestType: POST                                                                                                       */
 							STRING_c_str(fullAbandonRelativePath),              /*-relativePath: abandon relative path begin (as created by _Create) + value of ETag + "/abandon?api-version=2016-02-03"   */
-							abandonRequestHttpHeaders,                          /*- requestHttpHeadersHandle: an HTTP headers instance containing the following                                            */
+							deviceData->abandonHTTPrequestHeaders,              /*- requestHttpHeadersHandle: an HTTP headers instance containing the following                                            */
 							NULL,                                               /*- requestContent: NULL                                                                                                   */
 							&statusCode,                                         /*- statusCode: a pointer to unsigned int which might be examined for logging                                              */
 							NULL,                                               /*- responseHeadearsHandle: NULL                                                                                           */
@@ -1719,27 +2265,43 @@ static void abandonOrAcceptMessage(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTR
 							/*Codes_SRS_TRANSPORTMULTITHTTP_17_098: [Abandoning the message is considered successful if the HTTPAPIEX_SAS_ExecuteRequest doesn't fail and the statusCode is 204.]*/
 							/*Codes_SRS_TRANSPORTMULTITHTTP_17_100: [Accepting a message is successful when HTTPAPIEX_SAS_ExecuteRequest completes successfully and the status code is 204.] */
 							/*Codes_SRS_TRANSPORTMULTITHTTP_17_102: [Rejecting a message is successful when HTTPAPIEX_SAS_ExecuteRequest completes successfully and the status code is 204.] */
-							LogError("unable to HTTPAPIEX_SAS_ExecuteRequest");
+							LogError("Unable to HTTPAPIEX_ExecuteRequest.");
 						}
-						if (r == HTTPAPIEX_OK)
-						{
-							if (statusCode != 204)
-							{
-								/*Codes_SRS_TRANSPORTMULTITHTTP_17_098: [Abandoning the message is considered successful if the HTTPAPIEX_SAS_ExecuteRequest doesn't fail and the statusCode is 204.]*/
-								/*Codes_SRS_TRANSPORTMULTITHTTP_17_100: [Accepting a message is successful when HTTPAPIEX_SAS_ExecuteRequest completes successfully and the status code is 204.] */
-								/*Codes_SRS_TRANSPORTMULTITHTTP_17_102: [Rejecting a message is successful when HTTPAPIEX_SAS_ExecuteRequest completes successfully and the status code is 204.] */
-								LogError("unexpected status code returned %u (was expecting 204)", statusCode);
-							}
-							else
-							{
-								/*Codes_SRS_TRANSPORTMULTITHTTP_17_098: [Abandoning the message is considered successful if the HTTPAPIEX_SAS_ExecuteRequest doesn't fail and the statusCode is 204.]*/
-								/*Codes_SRS_TRANSPORTMULTITHTTP_17_100: [Accepting a message is successful when HTTPAPIEX_SAS_ExecuteRequest completes successfully and the status code is 204.] */
-								/*Codes_SRS_TRANSPORTMULTITHTTP_17_102: [Rejecting a message is successful when HTTPAPIEX_SAS_ExecuteRequest completes successfully and the status code is 204.] */
-								/*all is fine*/
-							}
+					}
+					else if ((r = executeSasRequest(
+						connection,
+						deviceData,
+						(action == ABANDON) ? HTTPAPI_REQUEST_POST : HTTPAPI_REQUEST_DELETE,                               /*-requestType: POST                                                                                                       */
+						STRING_c_str(fullAbandonRelativePath),              /*-relativePath: abandon relative path begin (as created by _Create) + value of ETag + "/abandon?api-version=2016-02-03"   */
+						deviceData->abandonHTTPrequestHeaders,              /*- requestHttpHeadersHandle: an HTTP headers instance containing the following                                            */
+						NULL,                                               /*- requestContent: NULL                                                                                                   */
+						&statusCode,                                         /*- statusCode: a pointer to unsigned int which might be examined for logging                                              */
+						NULL,                                               /*- responseHeadearsHandle: NULL                                                                                           */
+						NULL                                                /*- responseContent: NULL]                                                                                                 */
+						)) != HTTPAPIEX_OK)
+					{
+						/*Codes_SRS_TRANSPORTMULTITHTTP_17_098: [Abandoning the message is considered successful if the HTTPAPIEX_SAS_ExecuteRequest doesn't fail and the statusCode is 204.]*/
+						/*Codes_SRS_TRANSPORTMULTITHTTP_17_100: [Accepting a message is successful when HTTPAPIEX_SAS_ExecuteRequest completes successfully and the status code is 204.] */
+						/*Codes_SRS_TRANSPORTMULTITHTTP_17_102: [Rejecting a message is successful when HTTPAPIEX_SAS_ExecuteRequest completes successfully and the status code is 204.] */
+						LogError("unable to HTTPAPIEX_SAS_ExecuteRequest");
+					}
+					if (r == HTTPAPIEX_OK)
+					{
+						if (statusCode != 204)
+						{
+							/*Codes_SRS_TRANSPORTMULTITHTTP_17_098: [Abandoning the message is considered successful if the HTTPAPIEX_SAS_ExecuteRequest doesn't fail and the statusCode is 204.]*/
+							/*Codes_SRS_TRANSPORTMULTITHTTP_17_100: [Accepting a message is successful when HTTPAPIEX_SAS_ExecuteRequest completes successfully and the status code is 204.] */
+							/*Codes_SRS_TRANSPORTMULTITHTTP_17_102: [Rejecting a message is successful when HTTPAPIEX_SAS_ExecuteRequest completes successfully and the status code is 204.] */
+							LogError("unexpected status code returned %u (was expecting 204)", statusCode);
+						}
+						else
+						{
+							/*Codes_SRS_TRANSPORTMULTITHTTP_17_098: [Abandoning the message is considered successful if the HTTPAPIEX_SAS_ExecuteRequest doesn't fail and the statusCode is 204.]*/
+							/*Codes_SRS_TRANSPORTMULTITHTTP_17_100: [Accepting a message is successful when HTTPAPIEX_SAS_ExecuteRequest completes successfully and the status code is 204.] */
+							/*Codes_SRS_TRANSPORTMULTITHTTP_17_102: [Rejecting a message is successful when HTTPAPIEX_SAS_ExecuteRequest completes successfully and the status code is 204.] */
+							/*all is fine*/
 						}
 					}
-					HTTPHeaders_Free(abandonRequestHttpHeaders);
 				}
 			}
 			STRING_delete(ETagUnquoted);
@@ -1748,242 +2310,259 @@ static void abandonOrAcceptMessage(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTR
 	}
 }
 
-static void DoMessages(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVICE_DATA* deviceData, IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle)
+/*issues one GET for a cloud-to-device message and settles it. Returns true when the message was accepted or rejected*/
+static bool DoOneMessage(HTTPTRANSPORT_PERDEVICE_DATA* deviceData, IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, const HTTPTRANSPORT_CONNECTION* connection, time_t timeNow)
 {
-	/*Codes_SRS_TRANSPORTMULTITHTTP_17_083: [ If device is not subscribed then _DoWork shall advance to the next action. ] */
-	if (deviceData->DoWork_PullMessage)
+	bool result = false;
+	HTTP_HEADERS_HANDLE responseHTTPHeaders = HTTPHeaders_Alloc();
+	if (responseHTTPHeaders == NULL)
 	{
-		/*Codes_SRS_TRANSPORTMULTITHTTP_17_123: [After client creation, the first GET shall be allowed no matter what the value of GetMinimumPollingTime.] */
-		/*Codes_SRS_TRANSPORTMULTITHTTP_17_124: [If time is not available then all calls shall be treated as if they are the first one.] */
-		/*Codes_SRS_TRANSPORTMULTITHTTP_17_122: [A GET request that happens earlier than GetMinimumPollingTime shall be ignored.] */
-		time_t timeNow = get_time(NULL);
-		bool isPollingAllowed = deviceData->isFirstPoll || (timeNow == (time_t)(-1)) || (get_difftime(timeNow, deviceData->lastPollTime) > handleData->getMinimumPollingTime);
-		if (isPollingAllowed)
+		/*Codes_SRS_TRANSPORTMULTITHTTP_17_085: [If the call to HTTPAPIEX_SAS_ExecuteRequest did not executed successfully or building any part of the prerequisites of the call fails, then _DoWork shall advance to the next action in this description.] */
+		LogError("unable to HTTPHeaders_Alloc");
+	}
+	else
+	{
+		BUFFER_HANDLE responseContent = BUFFER_new();
+		if (responseContent == NULL)
 		{
-			HTTP_HEADERS_HANDLE responseHTTPHeaders = HTTPHeaders_Alloc();
-			if (responseHTTPHeaders == NULL)
+			/*Codes_SRS_TRANSPORTMULTITHTTP_17_085: [If the call to HTTPAPIEX_SAS_ExecuteRequest did not executed successfully or building any part of the prerequisites of the call fails, then _DoWork shall advance to the next action in this description.] */
+			LogError("unable to BUFFER_new");
+		}
+		else
+		{
+			unsigned int statusCode;
+			HTTPAPIEX_RESULT r;
+			if (deviceData->deviceSasToken != NULL)
+			{
+				/*Codes_SRS_TRANSPORTMULTITHTTP_03_001: [if a deviceSasToken exists, HTTPHeaders_ReplaceHeaderNameValuePair shall be invoked with "Authorization" as its second argument and STRING_c_str (deviceSasToken) as its third argument.]*/
+				if (HTTPHeaders_ReplaceHeaderNameValuePair(deviceData->messageHTTPrequestHeaders, "Authorization", STRING_c_str(deviceData->deviceSasToken)) != HTTP_HEADERS_OK)
+				{
+					r = HTTPAPIEX_ERROR;
+					/*Codes_SRS_TRANSPORTMULTITHTTP_03_002: [If the result of the invocation of HTTPHeaders_ReplaceHeaderNameValuePair is NOT HTTP_HEADERS_OK then fallthrough.]*/
+					LogError("Unable to replace the old SAS Token.");
+				}
+				else if ((r = executeRequest(
+					connection,
+					HTTPAPI_REQUEST_GET,                                            /*requestType: GET*/
+					STRING_c_str(deviceData->messageHTTPrelativePath),         /*relativePath: the message HTTP relative path*/
+					deviceData->messageHTTPrequestHeaders,                     /*requestHttpHeadersHandle: message HTTP request headers created by _Create*/
+					NULL,                                                           /*requestContent: NULL*/
+					&statusCode,                                                    /*statusCode: a pointer to unsigned int which shall be later examined*/
+					responseHTTPHeaders,                                            /*responseHeadearsHandle: a new instance of HTTP headers*/
+					responseContent                                                 /*responseContent: a new instance of buffer*/
+					)) != HTTPAPIEX_OK)
+				{
+					/*Codes_SRS_TRANSPORTMULTITHTTP_17_085: [If the call to HTTPAPIEX_SAS_ExecuteRequest did not executed successfully or building any part of the prerequisites of the call fails, then _DoWork shall advance to the next action in this description.] */
+					LogError("Unable to HTTPAPIEX_ExecuteRequest.");
+				}
+			}
+
+			/*Codes_SRS_TRANSPORTMULTITHTTP_17_084: [Otherwise, IoTHubTransportHttp_DoWork shall call HTTPAPIEX_SAS_ExecuteRequest passing the following parameters
+			requestType: GET
+			relativePath: the message HTTP relative path
+			requestHttpHeadersHandle: message HTTP request headers created by _Create
+			requestContent: NULL
+			statusCode: a pointer to unsigned int which shall be later examined
+			responseHeadearsHandle: a new instance of HTTP headers
+			responseContent: a new instance of buffer]
+			*/
+			else if ((r = executeSasRequest(
+				connection,
+				deviceData,
+				HTTPAPI_REQUEST_GET,                                            /*requestType: GET*/
+				STRING_c_str(deviceData->messageHTTPrelativePath),         /*relativePath: the message HTTP relative path*/
+				deviceData->messageHTTPrequestHeaders,                     /*requestHttpHeadersHandle: message HTTP request headers created by _Create*/
+				NULL,                                                           /*requestContent: NULL*/
+				&statusCode,                                                    /*statusCode: a pointer to unsigned int which shall be later examined*/
+				responseHTTPHeaders,                                            /*responseHeadearsHandle: a new instance of HTTP headers*/
+				responseContent                                                 /*responseContent: a new instance of buffer*/
+				)) != HTTPAPIEX_OK)
 			{
 				/*Codes_SRS_TRANSPORTMULTITHTTP_17_085: [If the call to HTTPAPIEX_SAS_ExecuteRequest did not executed successfully or building any part of the prerequisites of the call fails, then _DoWork shall advance to the next action in this description.] */
-				LogError("unable to HTTPHeaders_Alloc");
+				LogError("unable to HTTPAPIEX_SAS_ExecuteRequest");
 			}
-			else
+			if (r == HTTPAPIEX_OK)
 			{
-				BUFFER_HANDLE responseContent = BUFFER_new();
-				if (responseContent == NULL)
+				/*HTTP dialogue was succesfull*/
+				if (timeNow == (time_t)(-1))
 				{
-					/*Codes_SRS_TRANSPORTMULTITHTTP_17_085: [If the call to HTTPAPIEX_SAS_ExecuteRequest did not executed successfully or building any part of the prerequisites of the call fails, then _DoWork shall advance to the next action in this description.] */
-					LogError("unable to BUFFER_new");
+					deviceData->isFirstPoll = true;
 				}
 				else
 				{
-					unsigned int statusCode;
-					HTTPAPIEX_RESULT r;
-					if (deviceData->deviceSasToken != NULL)
-					{
-						/*Codes_SRS_TRANSPORTMULTITHTTP_03_001: [if a deviceSasToken exists, HTTPHeaders_ReplaceHeaderNameValuePair shall be invoked with "Authorization" as its second argument and STRING_c_str (deviceSasToken) as its third argument.]*/
-						if (HTTPHeaders_ReplaceHeaderNameValuePair(deviceData->messageHTTPrequestHeaders, "Authorization", STRING_c_str(deviceData->deviceSasToken)) != HTTP_HEADERS_OK)
-						{
-							r = HTTPAPIEX_ERROR;
-							/*Codes_SRS_TRANSPORTMULTITHTTP_03_002: [If the result of the invocation of HTTPHeaders_ReplaceHeaderNameValuePair is NOT HTTP_HEADERS_OK then fallthrough.]*/
-							LogError("Unable to replace the old SAS Token.");
-						}
-						else if ((r = HTTPAPIEX_ExecuteRequest(
-							handleData->httpApiExHandle,
-							HTTPAPI_REQUEST_GET,                                            /*requestType: GET*/
-							STRING_c_str(deviceData->messageHTTPrelativePath),         /*relativePath: the message HTTP relative path*/
-							deviceData->messageHTTPrequestHeaders,                     /*requestHttpHeadersHandle: message HTTP request headers created by _Create*/
-							NULL,                                                           /*requestContent: NULL*/
-							&statusCode,                                                    /*statusCode: a pointer to unsigned int which shall be later examined*/
-							responseHTTPHeaders,                                            /*responseHeadearsHandle: a new instance of HTTP headers*/
-							responseContent                                                 /*responseContent: a new instance of buffer*/
-							)) != HTTPAPIEX_OK)
-						{
-							/*Codes_SRS_TRANSPORTMULTITHTTP_17_085: [If the call to HTTPAPIEX_SAS_ExecuteRequest did not executed successfully or building any part of the prerequisites of the call fails, then _DoWork shall advance to the next action in this description.] */
-							LogError("Unable to HTTPAPIEX_ExecuteRequest.");
-						}
-					}
+					deviceData->isFirstPoll = false;
+					deviceData->lastPollTime = timeNow;
+				}
+				if (statusCode == 204)
+				{
+					/*Codes_SRS_TRANSPORTMULTITHTTP_17_086: [If the HTTPAPIEX_SAS_ExecuteRequest executed successfully then status code shall be examined. Any status code different than 200 causes _DoWork to advance to the next action.] */
+					/*this is an expected status code, means "no commands", but logging that creates panic*/
 
-					/*Codes_SRS_TRANSPORTMULTITHTTP_17_084: [Otherwise, IoTHubTransportHttp_DoWork shall call HTTPAPIEX_SAS_ExecuteRequest passing the following parameters
-					requestType: GET
-					relativePath: the message HTTP relative path
-					requestHttpHeadersHandle: message HTTP request headers created by _Create
-					requestContent: NULL
-					statusCode: a pointer to unsigned int which shall be later examined
-					responseHeadearsHandle: a new instance of HTTP headers
-					responseContent: a new instance of buffer]
-					*/
-					else if ((r = HTTPAPIEX_SAS_ExecuteRequest(
-						deviceData->sasObject,
-						handleData->httpApiExHandle,
-						HTTPAPI_REQUEST_GET,                                            /*requestType: GET*/
-						STRING_c_str(deviceData->messageHTTPrelativePath),         /*relativePath: the message HTTP relative path*/
-						deviceData->messageHTTPrequestHeaders,                     /*requestHttpHeadersHandle: message HTTP request headers created by _Create*/
-						NULL,                                                           /*requestContent: NULL*/
-						&statusCode,                                                    /*statusCode: a pointer to unsigned int which shall be later examined*/
-						responseHTTPHeaders,                                            /*responseHeadearsHandle: a new instance of HTTP headers*/
-						responseContent                                                 /*responseContent: a new instance of buffer*/
-						)) != HTTPAPIEX_OK)
+					/*do nothing, advance to next action*/
+				}
+				else if (statusCode != 200)
+				{
+					/*Codes_SRS_TRANSPORTMULTITHTTP_17_086: [If the HTTPAPIEX_SAS_ExecuteRequest executed successfully then status code shall be examined. Any status code different than 200 causes _DoWork to advance to the next action.] */
+					LogError("expected status code was 200, but actually was received %u... moving on", statusCode);
+				}
+				else
+				{
+					/*Codes_SRS_TRANSPORTMULTITHTTP_17_087: [If status code is 200, then _DoWork shall make a copy of the value of the "ETag" http header.]*/
+					const char* etagValue = HTTPHeaders_FindHeaderValue(responseHTTPHeaders, "ETag");
+					if (etagValue == NULL)
 					{
-						/*Codes_SRS_TRANSPORTMULTITHTTP_17_085: [If the call to HTTPAPIEX_SAS_ExecuteRequest did not executed successfully or building any part of the prerequisites of the call fails, then _DoWork shall advance to the next action in this description.] */
-						LogError("unable to HTTPAPIEX_SAS_ExecuteRequest");
+						LogError("unable to find a received header called \"E-Tag\"");
 					}
-					if (r == HTTPAPIEX_OK)
+					else
 					{
-						/*HTTP dialogue was succesfull*/
-						if (timeNow == (time_t)(-1))
-						{
-							deviceData->isFirstPoll = true;
-						}
-						else
-						{
-							deviceData->isFirstPoll = false;
-							deviceData->lastPollTime = timeNow;
-						}
-						if (statusCode == 204)
-						{
-							/*Codes_SRS_TRANSPORTMULTITHTTP_17_086: [If the HTTPAPIEX_SAS_ExecuteRequest executed successfully then status code shall be examined. Any status code different than 200 causes _DoWork to advance to the next action.] */
-							/*this is an expected status code, means "no commands", but logging that creates panic*/
-
-							/*do nothing, advance to next action*/
-						}
-						else if (statusCode != 200)
+						/*Codes_SRS_TRANSPORTMULTITHTTP_17_088: [If no such header is found or is invalid, then _DoWork shall advance to the next action.]*/
+						size_t etagsize = strlen(etagValue);
+						if (
+							(etagsize < 2) ||
+							(etagValue[0] != '"') ||
+							(etagValue[etagsize - 1] != '"')
+							)
 						{
-							/*Codes_SRS_TRANSPORTMULTITHTTP_17_086: [If the HTTPAPIEX_SAS_ExecuteRequest executed successfully then status code shall be examined. Any status code different than 200 causes _DoWork to advance to the next action.] */
-							LogError("expected status code was 200, but actually was received %u... moving on", statusCode);
+							LogError("ETag is not a valid quoted string");
 						}
 						else
 						{
-							/*Codes_SRS_TRANSPORTMULTITHTTP_17_087: [If status code is 200, then _DoWork shall make a copy of the value of the "ETag" http header.]*/
-							const char* etagValue = HTTPHeaders_FindHeaderValue(responseHTTPHeaders, "ETag");
-							if (etagValue == NULL)
+							/*Codes_SRS_TRANSPORTMULTITHTTP_17_089: [_DoWork shall assemble an IOTHUBMESSAGE_HANDLE from the received HTTP content (using the responseContent buffer).] */
+							IOTHUB_MESSAGE_HANDLE receivedMessage = IoTHubMessage_CreateFromByteArray(BUFFER_u_char(responseContent), BUFFER_length(responseContent));
+							if (receivedMessage == NULL)
 							{
-								LogError("unable to find a received header called \"E-Tag\"");
+								/*Codes_SRS_TRANSPORTMULTITHTTP_17_092: [If assembling the message fails in any way, then _DoWork shall "abandon" the message.]*/
+								LogError("unable to IoTHubMessage_CreateFromByteArray, trying to abandon the message... ");
+								abandonOrAcceptMessage(connection, deviceData, etagValue, ABANDON);
 							}
 							else
 							{
-								/*Codes_SRS_TRANSPORTMULTITHTTP_17_088: [If no such header is found or is invalid, then _DoWork shall advance to the next action.]*/
-								size_t etagsize = strlen(etagValue);
-								if (
-									(etagsize < 2) ||
-									(etagValue[0] != '"') ||
-									(etagValue[etagsize - 1] != '"')
-									)
+								/*Codes_SRS_TRANSPORTMULTITHTTP_17_090: [All the HTTP headers of the form iothub-app-name:somecontent shall be transformed in message properties {name, somecontent}.]*/
+								/*Codes_SRS_TRANSPORTMULTITHTTP_17_091: [The HTTP header of iothub-messageid shall be set in the MessageId.]*/
+								size_t nHeaders;
+								if (HTTPHeaders_GetHeaderCount(responseHTTPHeaders, &nHeaders) != HTTP_HEADERS_OK)
 								{
-									LogError("ETag is not a valid quoted string");
+									LogError("unable to get the count of HTTP headers");
+									abandonOrAcceptMessage(connection, deviceData, etagValue, ABANDON);
 								}
 								else
 								{
-									/*Codes_SRS_TRANSPORTMULTITHTTP_17_089: [_DoWork shall assemble an IOTHUBMESSAGE_HANDLE from the received HTTP content (using the responseContent buffer).] */
-									IOTHUB_MESSAGE_HANDLE receivedMessage = IoTHubMessage_CreateFromByteArray(BUFFER_u_char(responseContent), BUFFER_length(responseContent));
-									if (receivedMessage == NULL)
+									size_t i;
+									MAP_HANDLE properties = (nHeaders > 0) ? IoTHubMessage_Properties(receivedMessage) : NULL;
+									for (i = 0; i < nHeaders; i++)
 									{
-										/*Codes_SRS_TRANSPORTMULTITHTTP_17_092: [If assembling the message fails in any way, then _DoWork shall "abandon" the message.]*/
-										LogError("unable to IoTHubMessage_CreateFromByteArray, trying to abandon the message... ");
-										abandonOrAcceptMessage(handleData, deviceData, etagValue, ABANDON);
-									}
-									else
-									{
-										/*Codes_SRS_TRANSPORTMULTITHTTP_17_090: [All the HTTP headers of the form iothub-app-name:somecontent shall be transformed in message properties {name, somecontent}.]*/
-										/*Codes_SRS_TRANSPORTMULTITHTTP_17_091: [The HTTP header of iothub-messageid shall be set in the MessageId.]*/
-										size_t nHeaders;
-										if (HTTPHeaders_GetHeaderCount(responseHTTPHeaders, &nHeaders) != HTTP_HEADERS_OK)
+										char* completeHeader;
+										if (HTTPHeaders_GetHeader(responseHTTPHeaders, i, &completeHeader) != HTTP_HEADERS_OK)
 										{
-											LogError("unable to get the count of HTTP headers");
-											abandonOrAcceptMessage(handleData, deviceData, etagValue, ABANDON);
+											break;
 										}
 										else
 										{
-											size_t i;
-											MAP_HANDLE properties = (nHeaders > 0) ? IoTHubMessage_Properties(receivedMessage) : NULL;
-											for (i = 0; i < nHeaders; i++)
+											if (strncmp(IOTHUB_APP_PREFIX, completeHeader, strlen(IOTHUB_APP_PREFIX)) == 0)
 											{
-												char* completeHeader;
-												if (HTTPHeaders_GetHeader(responseHTTPHeaders, i, &completeHeader) != HTTP_HEADERS_OK)
-												{
-													break;
-												}
-												else
+												/*looks like a property headers*/
+												/*there's a guaranteed ':' in the completeHeader, by HTTP_HEADERS module*/
+												char* whereIsColon = strchr(completeHeader, ':');
+												if (whereIsColon != NULL)
 												{
-													if (strncmp(IOTHUB_APP_PREFIX, completeHeader, strlen(IOTHUB_APP_PREFIX)) == 0)
-													{
-														/*looks like a property headers*/
-														/*there's a guaranteed ':' in the completeHeader, by HTTP_HEADERS module*/
-														char* whereIsColon = strchr(completeHeader, ':');
-														if (whereIsColon != NULL)
-														{
-															*whereIsColon = '\0'; /*cut it down*/
-															if (Map_AddOrUpdate(properties, completeHeader + strlen(IOTHUB_APP_PREFIX), whereIsColon + 2) != MAP_OK) /*whereIsColon+1 is a space because HTTPEHADERS outputs a ": " between name and value*/
-															{
-																free(completeHeader);
-																break;
-															}
-														}
-													}
-													else if (strncmp(IOTHUB_MESSAGE_ID, completeHeader, strlen(IOTHUB_MESSAGE_ID)) == 0)
+													*whereIsColon = '\0'; /*cut it down*/
+													if (Map_AddOrUpdate(properties, completeHeader + strlen(IOTHUB_APP_PREFIX), whereIsColon + 2) != MAP_OK) /*whereIsColon+1 is a space because HTTPEHADERS outputs a ": " between name and value*/
 													{
-														char* whereIsColon = strchr(completeHeader, ':');
-														if (whereIsColon != NULL)
-														{
-															*whereIsColon = '\0'; /*cut it down*/
-															if (IoTHubMessage_SetMessageId(receivedMessage, whereIsColon + 2) != IOTHUB_MESSAGE_OK)
-															{
-																free(completeHeader);
-																break;
-															}
-														}
+														free(completeHeader);
+														break;
 													}
-													else if (strncmp(IOTHUB_CORRELATION_ID, completeHeader, strlen(IOTHUB_CORRELATION_ID)) == 0)
-													{
-														char* whereIsColon = strchr(completeHeader, ':');
-														if (whereIsColon != NULL)
-														{
-															*whereIsColon = '\0'; /*cut it down*/
-															if (IoTHubMessage_SetCorrelationId(receivedMessage, whereIsColon + 2) != IOTHUB_MESSAGE_OK)
-															{
-																free(completeHeader);
-																break;
-															}
-														}
-													}
-													free(completeHeader);
 												}
 											}
-
-											if (i < nHeaders)
-											{
-												abandonOrAcceptMessage(handleData, deviceData, etagValue, ABANDON);
-											}
-											else
+											else if (strncmp(IOTHUB_MESSAGE_ID, completeHeader, strlen(IOTHUB_MESSAGE_ID)) == 0)
 											{
-												/*Codes_SRS_TRANSPORTMULTITHTTP_17_093: [Otherwise, _DoWork shall call IoTHubClient_LL_MessageCallback with parameters handle = iotHubClientHandle and message = newly created message.]*/
-												IOTHUBMESSAGE_DISPOSITION_RESULT messageResult = IoTHubClient_LL_MessageCallback(iotHubClientHandle, receivedMessage);
-												if (messageResult == IOTHUBMESSAGE_ACCEPTED)
-												{
-													/*Codes_SRS_TRANSPORTMULTITHTTP_17_094: [If IoTHubClient_LL_MessageCallback returns IOTHUBMESSAGE_ACCEPTED then _DoWork shall "accept" the message.]*/
-													abandonOrAcceptMessage(handleData, deviceData, etagValue, ACCEPT);
-												}
-												else if (messageResult == IOTHUBMESSAGE_REJECTED)
+												char* whereIsColon = strchr(completeHeader, ':');
+												if (whereIsColon != NULL)
 												{
-													/*Codes_SRS_TRANSPORTMULTITHTTP_17_095: [If IoTHubClient_LL_MessageCallback returns IOTHUBMESSAGE_REJECTED then _DoWork shall "reject" the message.]*/
-													abandonOrAcceptMessage(handleData, deviceData, etagValue, REJECT);
+													*whereIsColon = '\0'; /*cut it down*/
+													if (IoTHubMessage_SetMessageId(receivedMessage, whereIsColon + 2) != IOTHUB_MESSAGE_OK)
+													{
+														free(completeHeader);
+														break;
+													}
 												}
-												else
+											}
+											else if (strncmp(IOTHUB_CORRELATION_ID, completeHeader, strlen(IOTHUB_CORRELATION_ID)) == 0)
+											{
+												char* whereIsColon = strchr(completeHeader, ':');
+												if (whereIsColon != NULL)
 												{
-													/*Codes_SRS_TRANSPORTMULTITHTTP_17_096: [If IoTHubClient_LL_MessageCallback returns IOTHUBMESSAGE_ABANDONED then _DoWork shall "abandon" the message.] */
-													abandonOrAcceptMessage(handleData, deviceData, etagValue, ABANDON);
+													*whereIsColon = '\0'; /*cut it down*/
+													if (IoTHubMessage_SetCorrelationId(receivedMessage, whereIsColon + 2) != IOTHUB_MESSAGE_OK)
+													{
+														free(completeHeader);
+														break;
+													}
 												}
 											}
+											free(completeHeader);
 										}
-										IoTHubMessage_Destroy(receivedMessage);
 									}
-								}
 
+									if (i < nHeaders)
+									{
+										abandonOrAcceptMessage(connection, deviceData, etagValue, ABANDON);
+									}
+									else
+									{
+										/*Codes_SRS_TRANSPORTMULTITHTTP_17_093: [Otherwise, _DoWork shall call IoTHubClient_LL_MessageCallback with parameters handle = iotHubClientHandle and message = newly created message.]*/
+										IOTHUBMESSAGE_DISPOSITION_RESULT messageResult = IoTHubClient_LL_MessageCallback(iotHubClientHandle, receivedMessage);
+										if (messageResult == IOTHUBMESSAGE_ACCEPTED)
+										{
+											/*Codes_SRS_TRANSPORTMULTITHTTP_17_094: [If IoTHubClient_LL_MessageCallback returns IOTHUBMESSAGE_ACCEPTED then _DoWork shall "accept" the message.]*/
+											abandonOrAcceptMessage(connection, deviceData, etagValue, ACCEPT);
+											result = true;
+										}
+										else if (messageResult == IOTHUBMESSAGE_REJECTED)
+										{
+											/*Codes_SRS_TRANSPORTMULTITHTTP_17_095: [If IoTHubClient_LL_MessageCallback returns IOTHUBMESSAGE_REJECTED then _DoWork shall "reject" the message.]*/
+											abandonOrAcceptMessage(connection, deviceData, etagValue, REJECT);
+											result = true;
+										}
+										else
+										{
+											/*Codes_SRS_TRANSPORTMULTITHTTP_17_096: [If IoTHubClient_LL_MessageCallback returns IOTHUBMESSAGE_ABANDONED then _DoWork shall "abandon" the message.] */
+											/*Codes_SRS_TRANSPORTMULTITHTTP_02_040: [ An abandoned message goes back to the device's queue, so after abandoning a message _DoWork shall not issue another GET for the device in this call. ]*/
+											abandonOrAcceptMessage(connection, deviceData, etagValue, ABANDON);
+										}
+									}
+								}
+								IoTHubMessage_Destroy(receivedMessage);
 							}
 						}
+
 					}
-					BUFFER_delete(responseContent);
 				}
-				HTTPHeaders_Free(responseHTTPHeaders);
+			}
+			BUFFER_delete(responseContent);
+		}
+		HTTPHeaders_Free(responseHTTPHeaders);
+	}
+	return result;
+}
+
+static void DoMessages(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVICE_DATA* deviceData, IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, const HTTPTRANSPORT_CONNECTION* connection)
+{
+	/*Codes_SRS_TRANSPORTMULTITHTTP_17_083: [ If device is not subscribed then _DoWork shall advance to the next action. ] */
+	if (deviceData->DoWork_PullMessage)
+	{
+		/*Codes_SRS_TRANSPORTMULTITHTTP_17_123: [After client creation, the first GET shall be allowed no matter what the value of GetMinimumPollingTime.] */
+		/*Codes_SRS_TRANSPORTMULTITHTTP_17_124: [If time is not available then all calls shall be treated as if they are the first one.] */
+		/*Codes_SRS_TRANSPORTMULTITHTTP_17_122: [A GET request that happens earlier than GetMinimumPollingTime shall be ignored.] */
+		time_t timeNow = get_time(NULL);
+		bool isPollingAllowed = deviceData->isFirstPoll || (timeNow == (time_t)(-1)) || (get_difftime(timeNow, deviceData->lastPollTime) > handleData->getMinimumPollingTime);
+		if (isPollingAllowed)
+		{
+			/*Codes_SRS_TRANSPORTMULTITHTTP_02_017: [ After a message has been received and accepted or rejected, _DoWork shall immediately issue another GET for the same device (regardless of GetMinimumPollingTime) until "MaximumMessagesPerDoWork" messages have been received in this call. ]*/
+			/*Codes_SRS_TRANSPORTMULTITHTTP_02_018: [ _DoWork shall stop issuing GETs for the device as soon as a GET does not produce a message (status code 204, any other status code, or any failure). ]*/
+			unsigned int nMessages = 0;
+			while ((nMessages < handleData->maximumMessagesPerDoWork) && DoOneMessage(deviceData, iotHubClientHandle, connection, timeNow))
+			{
+				nMessages++;
 			}
 		}
 		else
@@ -1994,6 +2573,149 @@ static void DoMessages(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERD
 	}
 }
 
+/*a device is busy when it has events to send or when it is allowed to poll for messages*/
+static size_t countBusyDevices(HTTPTRANSPORT_HANDLE_DATA* handleData, size_t deviceListSize)
+{
+	size_t result = 0;
+	time_t timeNow = get_time(NULL);
+	uint64_t nowMs;
+	bool isNowMsAvailable = (handleData->tickCounter != NULL) && (tickcounter_get_current_ms(handleData->tickCounter, &nowMs) == 0);
+	uint64_t lingerMs = getBatchLingerMs(handleData);
+	for (size_t i = 0; i < deviceListSize; i++)
+	{
+		HTTPTRANSPORT_PERDEVICE_DATA* perDeviceItem = *(HTTPTRANSPORT_PERDEVICE_DATA**)VECTOR_element(handleData->perDeviceList, i);
+		/*Codes_SRS_TRANSPORTMULTITHTTP_02_042: [ A device whose batch lingers and whose linger has not run out yet shall not count as having events to send. ]*/
+		bool isBatchLingerPending = isNowMsAvailable && perDeviceItem->isBatchLingering && (nowMs - perDeviceItem->batchLingerStartMs < lingerMs);
+		if (
+			((!DList_IsListEmpty(perDeviceItem->waitingToSend)) && !isBatchLingerPending) ||
+			(perDeviceItem->DoWork_PullMessage && (perDeviceItem->isFirstPoll || (timeNow == (time_t)(-1)) || (get_difftime(timeNow, perDeviceItem->lastPollTime) > handleData->getMinimumPollingTime)))
+			)
+		{
+			result++;
+		}
+	}
+	return result;
+}
+
+/*services devices until every device of the DoWork has been taken. The caller holds upperLayerLock*/
+static void DoWork_Worker(HTTPTRANSPORT_WORKER* worker, HTTPTRANSPORT_DOWORK_CONTEXT* doWorkContext)
+{
+	HTTPTRANSPORT_HANDLE_DATA* handleData = worker->handleData;
+	size_t deviceListSize = VECTOR_size(handleData->perDeviceList);
+	/*Codes_SRS_TRANSPORTMULTITHTTP_02_008: [ Each worker shall take the next device not yet serviced in this DoWork and perform both the "SendEvent" and "ExecuteMessage" actions for it, so that the order of the actions for a device is preserved. ]*/
+	while (doWorkContext->nextDevice < deviceListSize)
+	{
+		HTTPTRANSPORT_PERDEVICE_DATA* perDeviceItem = *(HTTPTRANSPORT_PERDEVICE_DATA**)VECTOR_element(handleData->perDeviceList, doWorkContext->nextDevice);
+		doWorkContext->nextDevice++;
+		DoEvent(handleData, perDeviceItem, perDeviceItem->iotHubClientHandle, &(worker->connection));
+		DoMessages(handleData, perDeviceItem, perDeviceItem->iotHubClientHandle, &(worker->connection));
+	}
+}
+
+/*releases upperLayerLock for *sleepTime ms and doubles *sleepTime, up to POOL_THREAD_MAX_IDLE_SLEEP. Returns false when upperLayerLock cannot be taken back*/
+static bool yieldUpperLayerLock(HTTPTRANSPORT_HANDLE_DATA* handleData, unsigned int* sleepTime)
+{
+	bool result;
+	(void)Unlock(handleData->upperLayerLock);
+	ThreadAPI_Sleep(*sleepTime);
+	*sleepTime = (*sleepTime > POOL_THREAD_MAX_IDLE_SLEEP / 2) ? POOL_THREAD_MAX_IDLE_SLEEP : *sleepTime * 2;
+	if (Lock(handleData->upperLayerLock) != LOCK_OK)
+	{
+		LogError("unable to Lock");
+		result = false;
+	}
+	else
+	{
+		result = true;
+	}
+	return result;
+}
+
+/*Codes_SRS_TRANSPORTMULTITHTTP_02_039: [ An idle pool thread shall sleep between its checks for a DoWork waiting for workers, doubling the sleep (starting at 1 ms) every time it finds none, up to 64 ms. A pool thread that finds such a DoWork shall join it as one of its min(busy devices, "ConnectionPoolSize") workers and shall restart its sleep at 1 ms afterwards. ]*/
+static int DoWork_PoolThread(void* arg)
+{
+	HTTPTRANSPORT_WORKER* worker = (HTTPTRANSPORT_WORKER*)arg;
+	HTTPTRANSPORT_HANDLE_DATA* handleData = worker->handleData;
+	/*Codes_SRS_TRANSPORTMULTITHTTP_02_007: [ Every worker shall hold the transport's upper layer lock at all times except while executing an HTTP request, so that calls into the upper layer (including the completion and message callbacks) are serialized. ]*/
+	if (Lock(handleData->upperLayerLock) != LOCK_OK)
+	{
+		LogError("unable to Lock, pool thread exiting");
+	}
+	else
+	{
+		bool isLocked = true;
+		unsigned int sleepTime = POOL_THREAD_MIN_SLEEP;
+		while (isLocked && !handleData->stopWorkers)
+		{
+			HTTPTRANSPORT_DOWORK_CONTEXT* doWorkContext = handleData->doWorkContext;
+			if ((doWorkContext != NULL) && (doWorkContext->unclaimedWorkers > 0))
+			{
+				doWorkContext->unclaimedWorkers--;
+				doWorkContext->runningWorkers++;
+				DoWork_Worker(worker, doWorkContext);
+				doWorkContext->runningWorkers--;
+				/*a busy transport is likely to call DoWork again soon*/
+				sleepTime = POOL_THREAD_MIN_SLEEP;
+			}
+			else
+			{
+				isLocked = yieldUpperLayerLock(handleData, &sleepTime);
+			}
+		}
+		if (isLocked)
+		{
+			(void)Unlock(handleData->upperLayerLock);
+		}
+	}
+	return 0;
+}
+
+static void DoWorkInParallel(HTTPTRANSPORT_HANDLE_DATA* handleData, size_t workerCount)
+{
+	/*Codes_SRS_TRANSPORTMULTITHTTP_02_007: [ Every worker shall hold the transport's upper layer lock at all times except while executing an HTTP request, so that calls into the upper layer (including the completion and message callbacks) are serialized. ]*/
+	if (Lock(handleData->upperLayerLock) != LOCK_OK)
+	{
+		LogError("unable to Lock");
+	}
+	else
+	{
+		HTTPTRANSPORT_DOWORK_CONTEXT doWorkContext;
+		bool isLocked = true;
+		unsigned int sleepTime = POOL_THREAD_MIN_SLEEP;
+		doWorkContext.nextDevice = 0;
+		doWorkContext.unclaimedWorkers = workerCount - 1;
+		doWorkContext.runningWorkers = 0;
+		handleData->doWorkContext = &doWorkContext;
+
+		/*workers[0] runs on the calling thread*/
+		DoWork_Worker(&(handleData->workers[0]), &doWorkContext);
+
+		/*every device has been taken, pool threads that have not joined yet have nothing left to do*/
+		doWorkContext.unclaimedWorkers = 0;
+		/*the pool threads still running are in the middle of HTTP requests, so the wait backs off like an idle pool thread*/
+		while (isLocked && (doWorkContext.runningWorkers > 0))
+		{
+			isLocked = yieldUpperLayerLock(handleData, &sleepTime);
+		}
+
+		if (isLocked)
+		{
+			handleData->doWorkContext = NULL;
+			(void)Unlock(handleData->upperLayerLock);
+		}
+		else
+		{
+			/*doWorkContext lives on this stack and the pool threads might still be using it*/
+			while (Lock(handleData->upperLayerLock) != LOCK_OK)
+			{
+				ThreadAPI_Sleep(1);
+			}
+			handleData->doWorkContext = NULL;
+			(void)Unlock(handleData->upperLayerLock);
+		}
+	}
+}
+
 static void IoTHubTransportHttp_DoWork(TRANSPORT_LL_HANDLE handle, IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle)
 {
 	/*Codes_SRS_TRANSPORTMULTITHTTP_17_049: [ If handle is NULL, then IoTHubTransportHttp_DoWork shall do nothing. ]*/
@@ -2005,16 +2727,29 @@ static void IoTHubTransportHttp_DoWork(TRANSPORT_LL_HANDLE handle, IOTHUB_CLIENT
 		HTTPTRANSPORT_HANDLE_DATA* handleData = (HTTPTRANSPORT_HANDLE_DATA*)handle;
 		IOTHUB_DEVICE_HANDLE* listItem;
 		size_t deviceListSize = VECTOR_size(handleData->perDeviceList);
-		/*Codes_SRS_TRANSPORTMULTITHTTP_17_052: [ IoTHubTransportHttp_DoWork shall perform a round-robin loop through every deviceHandle in the transport device list, using the iotHubClientHandle field saved in the IOTHUB_DEVICE_HANDLE. ]*/
-		/*Codes_SRS_TRANSPORTMULTITHTTP_17_050: [ IoTHubTransportHttp_DoWork shall call loop through the device list. ] */
-		/*Codes_SRS_TRANSPORTMULTITHTTP_17_051: [ IF the list is empty, then IoTHubTransportHttp_DoWork shall do nothing. ]*/
-		for (size_t i = 0; i < deviceListSize; i++)
+		size_t busyDevices;
+		/*Codes_SRS_TRANSPORTMULTITHTTP_02_006: [ If "ConnectionPoolSize" is greater than 1 and more than 1 device has an event to send or is allowed to poll for messages, then IoTHubTransportHttp_DoWork shall service the devices from min(busy devices, "ConnectionPoolSize") workers, each one using its own pooled connection, and shall wait for all the workers to finish before returning. The thread calling IoTHubTransportHttp_DoWork is one of the workers, the others are pool threads. ]*/
+		if ((handleData->connectionPoolSize > 1) && ((busyDevices = countBusyDevices(handleData, deviceListSize)) > 1))
 		{
-			listItem = VECTOR_element(handleData->perDeviceList, i);
-			HTTPTRANSPORT_PERDEVICE_DATA* perDeviceItem = *(HTTPTRANSPORT_PERDEVICE_DATA**)(listItem);
-			DoEvent(handleData, perDeviceItem, perDeviceItem->iotHubClientHandle);
-			DoMessages(handleData, perDeviceItem, perDeviceItem->iotHubClientHandle);
+			DoWorkInParallel(handleData, (busyDevices < handleData->connectionPoolSize) ? busyDevices : handleData->connectionPoolSize);
+		}
+		else
+		{
+			HTTPTRANSPORT_CONNECTION connection;
+			connection.httpApiExHandle = handleData->httpApiExHandle;
+			connection.upperLayerLock = NULL;
+
+			/*Codes_SRS_TRANSPORTMULTITHTTP_17_052: [ IoTHubTransportHttp_DoWork shall perform a round-robin loop through every deviceHandle in the transport device list, using the iotHubClientHandle field saved in the IOTHUB_DEVICE_HANDLE. ]*/
+			/*Codes_SRS_TRANSPORTMULTITHTTP_17_050: [ IoTHubTransportHttp_DoWork shall call loop through the device list. ] */
+			/*Codes_SRS_TRANSPORTMULTITHTTP_17_051: [ IF the list is empty, then IoTHubTransportHttp_DoWork shall do nothing. ]*/
+			for (size_t i = 0; i < deviceListSize; i++)
+			{
+				listItem = VECTOR_element(handleData->perDeviceList, i);
+				HTTPTRANSPORT_PERDEVICE_DATA* perDeviceItem = *(HTTPTRANSPORT_PERDEVICE_DATA**)(listItem);
+				DoEvent(handleData, perDeviceItem, perDeviceItem->iotHubClientHandle, &connection);
+				DoMessages(handleData, perDeviceItem, perDeviceItem->iotHubClientHandle, &connection);
 
+			}
 		}
 	}
 	else
@@ -2099,6 +2834,98 @@ static IOTHUB_CLIENT_RESULT IoTHubTransportHttp_SetOption(TRANSPORT_LL_HANDLE ha
 			handleData->getMinimumPollingTime = *(unsigned int*)value;
 			result = IOTHUB_CLIENT_OK;
 		}
+		/*Codes_SRS_TRANSPORTMULTITHTTP_02_014: [ "MaximumMessagesPerDoWork" ]*/
+		else if (strcmp("MaximumMessagesPerDoWork", option) == 0)
+		{
+			unsigned int maximumMessagesPerDoWork = *(unsigned int*)value;
+			if (maximumMessagesPerDoWork == 0)
+			{
+				/*Codes_SRS_TRANSPORTMULTITHTTP_02_015: [ If "MaximumMessagesPerDoWork" is 0 then IoTHubTransportHttp_SetOption shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+				result = IOTHUB_CLIENT_INVALID_ARG;
+				LogError("MaximumMessagesPerDoWork cannot be 0");
+			}
+			else
+			{
+				handleData->maximumMessagesPerDoWork = maximumMessagesPerDoWork;
+				result = IOTHUB_CLIENT_OK;
+			}
+		}
+		/*Codes_SRS_TRANSPORTMULTITHTTP_02_019: [ "sas_token_lifetime" ]*/
+		else if (strcmp("sas_token_lifetime", option) == 0)
+		{
+			size_t sasTokenLifetime = *(size_t*)value;
+			if ((sasTokenLifetime != 0) && (sasTokenLifetime < 1000))
+			{
+				/*Codes_SRS_TRANSPORTMULTITHTTP_02_043: [ If "sas_token_lifetime" is not 0 and less than 1000 then IoTHubTransportHttp_SetOption shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+				result = IOTHUB_CLIENT_INVALID_ARG;
+				LogError("sas_token_lifetime cannot be less than 1000 ms, SAS tokens expire in whole seconds");
+			}
+			else
+			{
+				/*Codes_SRS_TRANSPORTMULTITHTTP_02_020: [ Changing "sas_token_lifetime" shall discard all the cached SAS tokens. ]*/
+				size_t i;
+				size_t deviceListSize = VECTOR_size(handleData->perDeviceList);
+				for (i = 0; i < deviceListSize; i++)
+				{
+					destroy_cachedSasToken(*(HTTPTRANSPORT_PERDEVICE_DATA**)VECTOR_element(handleData->perDeviceList, i));
+				}
+				handleData->sasTokenLifetime = sasTokenLifetime;
+				result = IOTHUB_CLIENT_OK;
+			}
+		}
+		/*Codes_SRS_TRANSPORTMULTITHTTP_02_032: [ "BatchLingerMs" ]*/
+		else if (strcmp("BatchLingerMs", option) == 0)
+		{
+			if (create_tickCounter(handleData) != 0)
+			{
+				/*Codes_SRS_TRANSPORTMULTITHTTP_02_036: [ If the tick counter needed by "BatchLingerMs" or "BatchLingerAdaptive" cannot be created then IoTHubTransportHttp_SetOption shall return IOTHUB_CLIENT_ERROR. ]*/
+				result = IOTHUB_CLIENT_ERROR;
+			}
+			else
+			{
+				handleData->batchLingerMs = *(unsigned int*)value;
+				result = IOTHUB_CLIENT_OK;
+			}
+		}
+		/*Codes_SRS_TRANSPORTMULTITHTTP_02_033: [ "BatchMinBytes" ]*/
+		else if (strcmp("BatchMinBytes", option) == 0)
+		{
+			handleData->batchMinBytes = *(size_t*)value;
+			result = IOTHUB_CLIENT_OK;
+		}
+		/*Codes_SRS_TRANSPORTMULTITHTTP_02_037: [ "BatchLingerAdaptive" ]*/
+		else if (strcmp("BatchLingerAdaptive", option) == 0)
+		{
+			if (create_tickCounter(handleData) != 0)
+			{
+				result = IOTHUB_CLIENT_ERROR;
+			}
+			else
+			{
+				handleData->isBatchLingerAdaptive = *(bool*)value;
+				result = IOTHUB_CLIENT_OK;
+			}
+		}
+		/*Codes_SRS_TRANSPORTMULTITHTTP_02_003: [ "ConnectionPoolSize" ]*/
+		else if (strcmp("ConnectionPoolSize", option) == 0)
+		{
+			unsigned int connectionPoolSize = *(unsigned int*)value;
+			if (connectionPoolSize == 0)
+			{
+				/*Codes_SRS_TRANSPORTMULTITHTTP_02_004: [ If "ConnectionPoolSize" is 0 then IoTHubTransportHttp_SetOption shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+				result = IOTHUB_CLIENT_INVALID_ARG;
+				LogError("ConnectionPoolSize cannot be 0");
+			}
+			else if (set_connectionPoolSize(handleData, connectionPoolSize) != 0)
+			{
+				result = IOTHUB_CLIENT_ERROR;
+				LogError("unable to set ConnectionPoolSize to %u", connectionPoolSize);
+			}
+			else
+			{
+				result = IOTHUB_CLIENT_OK;
+			}
+		}
 		else
 		{
 			/*Codes_SRS_TRANSPORTMULTITHTTP_17_126: [ "TrustedCerts"] */
@@ -2106,6 +2933,11 @@ static IOTHUB_CLIENT_RESULT IoTHubTransportHttp_SetOption(TRANSPORT_LL_HANDLE ha
 			/*Codes_SRS_TRANSPORTMULTITHTTP_17_129: [ This option shall passed down to the lower layer by calling HTTPAPIEX_SetOption. ]*/
 			/*Codes_SRS_TRANSPORTMULTITHTTP_17_118: [Otherwise, IoTHubTransport_Http shall call HTTPAPIEX_SetOption with the same parameters and return the translated code.] */
 			HTTPAPIEX_RESULT HTTPAPIEX_result = HTTPAPIEX_SetOption(handleData->httpApiExHandle, option, value);
+			/*Codes_SRS_TRANSPORTMULTITHTTP_02_010: [ Options passed down to HTTPAPIEX_SetOption shall also be passed to every pooled connection, stopping at the first failure. ]*/
+			for (size_t i = 1; (i < handleData->connectionPoolSize) && (HTTPAPIEX_result == HTTPAPIEX_OK); i++)
+			{
+				HTTPAPIEX_result = HTTPAPIEX_SetOption(handleData->workers[i].connection.httpApiExHandle, option, value);
+			}
 			/*Codes_SRS_TRANSPORTMULTITHTTP_17_119: [The following table translates HTTPAPIEX return codes to IOTHUB_CLIENT_RESULT return codes:] */
 			if (HTTPAPIEX_result == HTTPAPIEX_OK)
 			{
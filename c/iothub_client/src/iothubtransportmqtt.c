@@ -41,6 +41,8 @@
 #define MAX_SEND_RECOUNT_LIMIT      2
 #define DEFAULT_CONNECTION_INTERVAL 30
 #define FAILED_CONN_BACKOFF_VALUE   5
+#define INFLIGHT_TABLE_INITIAL_SIZE 16
+#define MAX_INFLIGHT_MESSAGES       (UINT16_MAX - 1) /*packet id 0 is invalid and one packet id is always left for SUBSCRIBE and UNSUBSCRIBE*/
 
 static const char* DEVICE_MSG_TOPIC = "devices/%s/messages/devicebound/#";
 static const char* DEVICE_DEVICE_TOPIC = "devices/%s/messages/events/";
@@ -90,6 +92,13 @@ typedef struct MQTTTRANSPORT_HANDLE_DATA_TAG
     bool receiveMessages;
     bool destroyCalled;
     DLIST_ENTRY waitingForAck;
+    /*the messages in waitingForAck indexed by their msgPacketId (open addressing, linear probing) so PUBACKs are matched in constant time*/
+    struct MQTT_MESSAGE_DETAILS_LIST_TAG** inflightTable;
+    size_t inflightTableSize; /*a power of 2, 0 until the first message is published*/
+    size_t inflightCount;
+    size_t maxInflight; /*the in flight window, set by the "mqttMaxInflight" option*/
+    bool inflightWindowFull; /*set when messages were left in waitingToSend because the window was full*/
+    QOS_VALUE eventQos; /*set by the "mqttEventQos" option*/
     PDLIST_ENTRY waitingToSend;
     IOTHUB_CLIENT_LL_HANDLE llClientHandle;
     CONTROL_PACKET_TYPE currPacketState;
@@ -107,6 +116,7 @@ typedef struct MQTT_MESSAGE_DETAILS_LIST_TAG
     IOTHUB_MESSAGE_LIST* iotHubMessageEntry;
     void* context;
     uint16_t msgPacketId;
+    char* topic; /*the publish topic with the message properties, built on the first publish and reused by the resends*/
     DLIST_ENTRY entry;
 } MQTT_MESSAGE_DETAILS_LIST, *PMQTT_MESSAGE_DETAILS_LIST;
 
@@ -123,6 +133,124 @@ static void defaultPrintLogFunction(unsigned int options, char* format, ...)
     }
 }
 
+/*returns the slot of inflightTable that holds packetId or the empty slot where packetId would be inserted*/
+static size_t findInflightSlot(PMQTTTRANSPORT_HANDLE_DATA transportState, uint16_t packetId)
+{
+    size_t mask = transportState->inflightTableSize - 1;
+    size_t slot = packetId & mask;
+    while ((transportState->inflightTable[slot] != NULL) && (transportState->inflightTable[slot]->msgPacketId != packetId))
+    {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+static bool isPacketIdInflight(PMQTTTRANSPORT_HANDLE_DATA transportState, uint16_t packetId)
+{
+    return (transportState->inflightCount > 0) && (transportState->inflightTable[findInflightSlot(transportState, packetId)] != NULL);
+}
+
+static int addInflightMessage(PMQTTTRANSPORT_HANDLE_DATA transportState, MQTT_MESSAGE_DETAILS_LIST* mqttMsgEntry)
+{
+    int result;
+    /*the table is kept at most half full so the probe sequences stay short*/
+    if (2 * (transportState->inflightCount + 1) > transportState->inflightTableSize)
+    {
+        size_t newSize = (transportState->inflightTableSize == 0) ? INFLIGHT_TABLE_INITIAL_SIZE : (2 * transportState->inflightTableSize);
+        MQTT_MESSAGE_DETAILS_LIST** newTable = (MQTT_MESSAGE_DETAILS_LIST**)malloc(newSize * sizeof(MQTT_MESSAGE_DETAILS_LIST*));
+        if (newTable == NULL)
+        {
+            LogError("Allocation Error: Failure growing the in flight messages table.");
+            result = __LINE__;
+        }
+        else
+        {
+            MQTT_MESSAGE_DETAILS_LIST** oldTable = transportState->inflightTable;
+            size_t oldSize = transportState->inflightTableSize;
+            size_t index;
+            for (index = 0; index < newSize; index++)
+            {
+                newTable[index] = NULL;
+            }
+            transportState->inflightTable = newTable;
+            transportState->inflightTableSize = newSize;
+            for (index = 0; index < oldSize; index++)
+            {
+                if (oldTable[index] != NULL)
+                {
+                    newTable[findInflightSlot(transportState, oldTable[index]->msgPacketId)] = oldTable[index];
+                }
+            }
+            if (oldTable != NULL)
+            {
+                free(oldTable);
+            }
+            result = 0;
+        }
+    }
+    else
+    {
+        result = 0;
+    }
+
+    if (result == 0)
+    {
+        transportState->inflightTable[findInflightSlot(transportState, mqttMsgEntry->msgPacketId)] = mqttMsgEntry;
+        transportState->inflightCount++;
+    }
+    return result;
+}
+
+/*returns the message that was removed or NULL if no message has packetId*/
+static MQTT_MESSAGE_DETAILS_LIST* removeInflightMessage(PMQTTTRANSPORT_HANDLE_DATA transportState, uint16_t packetId)
+{
+    MQTT_MESSAGE_DETAILS_LIST* result;
+    if (transportState->inflightCount == 0)
+    {
+        result = NULL;
+    }
+    else
+    {
+        MQTT_MESSAGE_DETAILS_LIST** table = transportState->inflightTable;
+        size_t mask = transportState->inflightTableSize - 1;
+        size_t hole = findInflightSlot(transportState, packetId);
+        result = table[hole];
+        if (result != NULL)
+        {
+            /*backward shift deletion: the entries after the hole that could not be found anymore are moved into it*/
+            size_t next = (hole + 1) & mask;
+            while (table[next] != NULL)
+            {
+                size_t home = table[next]->msgPacketId & mask;
+                if (
+                    ((next > hole) && ((home <= hole) || (home > next))) ||
+                    ((next < hole) && (home <= hole) && (home > next))
+                    )
+                {
+                    table[hole] = table[next];
+                    hole = next;
+                }
+                next = (next + 1) & mask;
+            }
+            table[hole] = NULL;
+            transportState->inflightCount--;
+        }
+    }
+    return result;
+}
+
+static uint16_t getNextPacketId(PMQTTTRANSPORT_HANDLE_DATA transportState)
+{
+    uint16_t result;
+    /*Codes_SRS_IOTHUB_MQTT_TRANSPORT_02_004: [IoTHubTransportMqtt_DoWork shall not give a new message the packet id of a message that is waiting for its acknowledgement.]*/
+    /*0 is not a valid packet id*/
+    do
+    {
+        result = transportState->packetId++;
+    } while ((result == 0) || isPacketIdInflight(transportState, result));
+    return result;
+}
+
 static void sendMsgComplete(IOTHUB_MESSAGE_LIST* iothubMsgList, PMQTTTRANSPORT_HANDLE_DATA transportState, IOTHUB_BATCHSTATE_RESULT batchResult)
 {
     DLIST_ENTRY messageCompleted;
@@ -131,83 +259,144 @@ static void sendMsgComplete(IOTHUB_MESSAGE_LIST* iothubMsgList, PMQTTTRANSPORT_H
     IoTHubClient_LL_SendComplete(transportState->llClientHandle, &messageCompleted, batchResult);
 }
 
-static STRING_HANDLE addPropertiesTouMqttMessage(IOTHUB_MESSAGE_HANDLE iothub_message_handle, const char* eventTopic)
+static bool isUnreservedTopicChar(unsigned char c)
 {
-    STRING_HANDLE result = STRING_construct(eventTopic);
-    const char* const* propertyKeys;
-    const char* const* propertyValues;
-    size_t propertyCount;
+    return ((c >= 'a') && (c <= 'z')) || ((c >= 'A') && (c <= 'Z')) || ((c >= '0') && (c <= '9')) ||
+        (c == '-') || (c == '.') || (c == '_') || (c == '~');
+}
+
+static size_t getPercentEncodedLength(const char* text)
+{
+    size_t result = 0;
+    for (; *text != '\0'; text++)
+    {
+        result += isUnreservedTopicChar((unsigned char)*text) ? 1 : 3;
+    }
+    return result;
+}
+
+static char* writePercentEncoded(char* destination, const char* text)
+{
+    static const char hexDigits[] = "0123456789ABCDEF";
+    for (; *text != '\0'; text++)
+    {
+        unsigned char c = (unsigned char)*text;
+        if (isUnreservedTopicChar(c))
+        {
+            *destination++ = (char)c;
+        }
+        else
+        {
+            *destination++ = '%';
+            *destination++ = hexDigits[c >> 4];
+            *destination++ = hexDigits[c & 0x0F];
+        }
+    }
+    return destination;
+}
+
+/*builds "<eventTopic>key1=value1&key2=value2" in a single allocation: the first pass measures it, the second pass writes it*/
+static char* buildEventTopic(IOTHUB_MESSAGE_HANDLE iothub_message_handle, const char* eventTopic)
+{
+    char* result;
+    const char* const* propertyKeys = NULL;
+    const char* const* propertyValues = NULL;
+    size_t propertyCount = 0;
 
-    // Construct Properties
     MAP_HANDLE properties_map = IoTHubMessage_Properties(iothub_message_handle);
-    if (properties_map != NULL)
+    if ((properties_map != NULL) && (Map_GetInternals(properties_map, &propertyKeys, &propertyValues, &propertyCount) != MAP_OK))
+    {
+        LogError("Failed to get the internals of the property map.");
+        result = NULL;
+    }
+    else
     {
-        if (Map_GetInternals(properties_map, &propertyKeys, &propertyValues, &propertyCount) != MAP_OK)
+        size_t eventTopicLength = strlen(eventTopic);
+        size_t topicLength = eventTopicLength;
+        size_t index;
+        for (index = 0; index < propertyCount; index++)
         {
-            LogError("Failed to get the internals of the property map.");
-            STRING_delete(result);
-            result = NULL;
+            /*'=' and, but for the last property, '&'*/
+            topicLength += getPercentEncodedLength(propertyKeys[index]) + 1 + getPercentEncodedLength(propertyValues[index]) + ((index + 1 < propertyCount) ? 1 : 0);
+        }
+
+        result = (char*)malloc(topicLength + 1);
+        if (result == NULL)
+        {
+            LogError("Allocation Error: Failure allocating the topic of the message.");
         }
         else
         {
-            if (propertyCount != 0)
+            char* position = result;
+            (void)memcpy(position, eventTopic, eventTopicLength);
+            position += eventTopicLength;
+            for (index = 0; index < propertyCount; index++)
             {
-                for (size_t index = 0; index < propertyCount && result != NULL; index++)
+                position = writePercentEncoded(position, propertyKeys[index]);
+                *position++ = '=';
+                position = writePercentEncoded(position, propertyValues[index]);
+                if (index + 1 < propertyCount)
                 {
-                    size_t len = strlen(propertyKeys[index]) + strlen(propertyValues[index]) + 2;
-                    char* propValues = malloc(len+1);
-                    if (propValues == NULL)
-                    {
-                        STRING_delete(result);
-                        result = NULL;
-                    }
-                    else
-                    {
-                        sprintf(propValues, "%s=%s%s", propertyKeys[index], propertyValues[index], propertyCount - 1 == index ? "" : "&");
-                        if (STRING_concat(result, propValues) != 0)
-                        {
-                            STRING_delete(result);
-                            result = NULL;
-                        }
-                        free(propValues);
-                    }
+                    *position++ = '&';
                 }
             }
+            *position = '\0';
         }
     }
     return result;
 }
 
-static int publishMqttMessage(PMQTTTRANSPORT_HANDLE_DATA transportState, MQTT_MESSAGE_DETAILS_LIST* mqttMsgEntry, const unsigned char* payload, size_t len)
+static void destroyMqttMessageEntry(MQTT_MESSAGE_DETAILS_LIST* mqttMsgEntry)
+{
+    if (mqttMsgEntry->topic != NULL)
+    {
+        free(mqttMsgEntry->topic);
+    }
+    free(mqttMsgEntry);
+}
+
+static int sendMqttMessage(PMQTTTRANSPORT_HANDLE_DATA transportState, const char* topic, uint16_t packetId, QOS_VALUE qosValue, const unsigned char* payload, size_t len)
 {
     int result;
-    STRING_HANDLE msgTopic = addPropertiesTouMqttMessage(mqttMsgEntry->iotHubMessageEntry->messageHandle, STRING_c_str(transportState->mqttEventTopic));
-    if (msgTopic == NULL)
+    MQTT_MESSAGE_HANDLE mqttMsg = mqttmessage_create(packetId, topic, qosValue, payload, len);
+    if (mqttMsg == NULL)
     {
         result = __LINE__;
     }
     else
     {
-        MQTT_MESSAGE_HANDLE mqttMsg = mqttmessage_create(transportState->packetId++, STRING_c_str(msgTopic), DELIVER_AT_LEAST_ONCE, payload, len);
-        if (mqttMsg == NULL)
+        if (mqtt_client_publish(transportState->mqttClient, mqttMsg) != 0)
         {
             result = __LINE__;
         }
         else
         {
-            if (mqtt_client_publish(transportState->mqttClient, mqttMsg) != 0)
-            {
-                result = __LINE__;
-            }
-            else
-            {
-                mqttMsgEntry->retryCount++;
-                (void)tickcounter_get_current_ms(g_msgTickCounter, &mqttMsgEntry->msgPublishTime);
-                result = 0;
-            }
-            mqttmessage_destroy(mqttMsg);
+            result = 0;
         }
-        STRING_delete(msgTopic);
+        mqttmessage_destroy(mqttMsg);
+    }
+    return result;
+}
+
+static int publishMqttMessage(PMQTTTRANSPORT_HANDLE_DATA transportState, MQTT_MESSAGE_DETAILS_LIST* mqttMsgEntry, const unsigned char* payload, size_t len)
+{
+    int result;
+    /*Codes_SRS_IOTHUB_MQTT_TRANSPORT_02_017: [IoTHubTransportMqtt_DoWork shall build the topic of a message, with its properties percent-encoded, only when the message is first published and shall reuse it when the message is resent.]*/
+    if ((mqttMsgEntry->topic == NULL) &&
+        ((mqttMsgEntry->topic = buildEventTopic(mqttMsgEntry->iotHubMessageEntry->messageHandle, STRING_c_str(transportState->mqttEventTopic))) == NULL))
+    {
+        result = __LINE__;
+    }
+    /*Codes_SRS_IOTHUB_MQTT_TRANSPORT_02_003: [IoTHubTransportMqtt_DoWork shall resend a message with the packet id that the message was first published with.]*/
+    else if (sendMqttMessage(transportState, mqttMsgEntry->topic, mqttMsgEntry->msgPacketId, DELIVER_AT_LEAST_ONCE, payload, len) != 0)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        mqttMsgEntry->retryCount++;
+        (void)tickcounter_get_current_ms(g_msgTickCounter, &mqttMsgEntry->msgPublishTime);
+        result = 0;
     }
     return result;
 }
@@ -357,20 +546,14 @@ static void MqttOpCompleteCallback(MQTT_CLIENT_HANDLE handle, MQTT_CLIENT_EVENT_
                 const PUBLISH_ACK* puback = (const PUBLISH_ACK*)msgInfo;
                 if (puback != NULL)
                 {
-                    PDLIST_ENTRY currentListEntry = transportData->waitingForAck.Flink;
-                    while (currentListEntry != &transportData->waitingForAck)
+                    /*Codes_SRS_IOTHUB_MQTT_TRANSPORT_02_005: [When a PUBACK is received the message waiting for acknowledgement that has the packet id of the PUBACK shall be found without walking the list of messages waiting for acknowledgement and shall be completed with IOTHUB_BATCHSTATE_SUCCESS.]*/
+                    MQTT_MESSAGE_DETAILS_LIST* mqttMsgEntry = removeInflightMessage(transportData, puback->packetId);
+                    /*Codes_SRS_IOTHUB_MQTT_TRANSPORT_02_006: [If no message waiting for acknowledgement has the packet id of the PUBACK then the PUBACK shall be ignored.]*/
+                    if (mqttMsgEntry != NULL)
                     {
-                        MQTT_MESSAGE_DETAILS_LIST* mqttMsgEntry = containingRecord(currentListEntry, MQTT_MESSAGE_DETAILS_LIST, entry);
-                        DLIST_ENTRY saveListEntry;
-                        saveListEntry.Flink = currentListEntry->Flink;
-
-                        if (puback->packetId == mqttMsgEntry->msgPacketId)
-                        {
-                            (void)DList_RemoveEntryList(currentListEntry); //First remove the item from Waiting for Ack List.
-                            sendMsgComplete(mqttMsgEntry->iotHubMessageEntry, transportData, IOTHUB_BATCHSTATE_SUCCESS);
-                            free(mqttMsgEntry);
-                        }
-                        currentListEntry = saveListEntry.Flink;
+                        (void)DList_RemoveEntryList(&(mqttMsgEntry->entry)); //First remove the item from Waiting for Ack List.
+                        sendMsgComplete(mqttMsgEntry->iotHubMessageEntry, transportData, IOTHUB_BATCHSTATE_SUCCESS);
+                        destroyMqttMessageEntry(mqttMsgEntry);
                     }
                 }
                 break;
@@ -459,7 +642,7 @@ static int SubscribeToMqttProtocol(PMQTTTRANSPORT_HANDLE_DATA transportState)
             { STRING_c_str(transportState->mqttMessageTopic), DELIVER_AT_LEAST_ONCE }
         };
         /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_016: [IoTHubTransportMqtt_Subscribe shall call mqtt_client_subscribe to subscribe to the Message Topic.] */
-        if (mqtt_client_subscribe(transportState->mqttClient, transportState->packetId++, subscribe, 1) != 0)
+        if (mqtt_client_subscribe(transportState->mqttClient, getNextPacketId(transportState), subscribe, 1) != 0)
         {
             /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_017: [Upon failure IoTHubTransportMqtt_Subscribe shall return a non-zero value.] */
             result = __LINE__;
@@ -858,6 +1041,12 @@ static PMQTTTRANSPORT_HANDLE_DATA InitializeTransportHandleData(const IOTHUB_CLI
                 {
                     /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_010: [IoTHubTransportMqtt_Create shall allocate memory to save its internal state where all topics, hostname, device_id, device_key, sasTokenSr and client handle shall be saved.] */
                     DList_InitializeListHead(&(state->waitingForAck));
+                    state->inflightTable = NULL;
+                    state->inflightTableSize = 0;
+                    state->inflightCount = 0;
+                    state->maxInflight = MAX_INFLIGHT_MESSAGES;
+                    state->inflightWindowFull = false;
+                    state->eventQos = DELIVER_AT_LEAST_ONCE;
                     state->sasTokenFromUser = (upperConfig->deviceSasToken == NULL) ? false : true;
                     state->destroyCalled = false;
                     state->isRegistered = false;
@@ -983,7 +1172,11 @@ static void IoTHubTransportMqtt_Destroy(TRANSPORT_LL_HANDLE handle)
             PDLIST_ENTRY currentEntry = DList_RemoveHeadList(&transportState->waitingForAck);
             MQTT_MESSAGE_DETAILS_LIST* mqttMsgEntry = containingRecord(currentEntry, MQTT_MESSAGE_DETAILS_LIST, entry);
             sendMsgComplete(mqttMsgEntry->iotHubMessageEntry, transportState, IOTHUB_BATCHSTATE_FAILED);
-            free(mqttMsgEntry);
+            destroyMqttMessageEntry(mqttMsgEntry);
+        }
+        if (transportState->inflightTable != NULL)
+        {
+            free(transportState->inflightTable);
         }
 
         /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_014: [IoTHubTransportMqtt_Destroy shall free all the resources currently in use.] */
@@ -1035,7 +1228,7 @@ static void IoTHubTransportMqtt_Unsubscribe(IOTHUB_DEVICE_HANDLE handle)
     {
         /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_020: [IoTHubTransportMqtt_Unsubscribe shall call mqtt_client_unsubscribe to unsubscribe the mqtt message topic.] */
         const char* unsubscribe[] = { STRING_c_str(transportState->mqttMessageTopic) };
-        (void)mqtt_client_unsubscribe(transportState->mqttClient, transportState->packetId++, unsubscribe, 1);
+        (void)mqtt_client_unsubscribe(transportState->mqttClient, getNextPacketId(transportState), unsubscribe, 1);
         transportState->subscribed = false;
         transportState->receiveMessages = false;
     }
@@ -1045,6 +1238,82 @@ static void IoTHubTransportMqtt_Unsubscribe(IOTHUB_DEVICE_HANDLE handle)
     }
 }
 
+static void publishWaitingMessages(PMQTTTRANSPORT_HANDLE_DATA transportState)
+{
+    PDLIST_ENTRY currentListEntry = transportState->waitingToSend->Flink;
+    /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_027: [IoTHubTransportMqtt_DoWork shall inspect the waitingToSend DLIST passed in config structure.] */
+    while ((currentListEntry != transportState->waitingToSend) && (transportState->inflightCount < transportState->maxInflight))
+    {
+        IOTHUB_MESSAGE_LIST* iothubMsgList = containingRecord(currentListEntry, IOTHUB_MESSAGE_LIST, entry);
+        DLIST_ENTRY savedFromCurrentListEntry;
+        savedFromCurrentListEntry.Flink = currentListEntry->Flink;
+
+        /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_027: [IoTHubTransportMqtt_DoWork shall inspect the waitingToSend DLIST passed in config structure.] */
+        size_t messageLength;
+        const unsigned char* messagePayload = RetrieveMessagePayload(iothubMsgList->messageHandle, &messageLength);
+        if (messageLength == 0 || messagePayload == NULL)
+        {
+            LogError("Failure result from IoTHubMessage_GetData");
+        }
+        else if (transportState->eventQos == DELIVER_AT_MOST_ONCE)
+        {
+            /*Codes_SRS_IOTHUB_MQTT_TRANSPORT_02_014: [If "mqttEventQos" is 0 then IoTHubTransportMqtt_DoWork shall publish the message with DELIVER_AT_MOST_ONCE and packet id 0 and shall not add it to the messages waiting for acknowledgement.]*/
+            IOTHUB_BATCHSTATE_RESULT batchResult;
+            char* topic = buildEventTopic(iothubMsgList->messageHandle, STRING_c_str(transportState->mqttEventTopic));
+            if (topic == NULL)
+            {
+                batchResult = IOTHUB_BATCHSTATE_FAILED;
+            }
+            else
+            {
+                batchResult = (sendMqttMessage(transportState, topic, 0, DELIVER_AT_MOST_ONCE, messagePayload, messageLength) == 0) ? IOTHUB_BATCHSTATE_SUCCESS : IOTHUB_BATCHSTATE_FAILED;
+                free(topic);
+            }
+            /*Codes_SRS_IOTHUB_MQTT_TRANSPORT_02_015: [The message shall be completed as soon as mqtt_client_publish returns, with IOTHUB_BATCHSTATE_SUCCESS if it succeeded and IOTHUB_BATCHSTATE_FAILED otherwise.]*/
+            (void)(DList_RemoveEntryList(currentListEntry));
+            sendMsgComplete(iothubMsgList, transportState, batchResult);
+        }
+        else
+        {
+            /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_029: [IoTHubTransportMqtt_DoWork shall create a MQTT_MESSAGE_HANDLE and pass this to a call to mqtt_client_publish.] */
+            MQTT_MESSAGE_DETAILS_LIST* mqttMsgEntry = (MQTT_MESSAGE_DETAILS_LIST*)malloc(sizeof(MQTT_MESSAGE_DETAILS_LIST));
+            if (mqttMsgEntry == NULL)
+            {
+                LogError("Allocation Error: Failure allocating MQTT Message Detail List.");
+            }
+            else
+            {
+                mqttMsgEntry->retryCount = 0;
+                mqttMsgEntry->msgPacketId = getNextPacketId(transportState);
+                mqttMsgEntry->topic = NULL;
+                mqttMsgEntry->iotHubMessageEntry = iothubMsgList;
+
+                /*the message is indexed before it is published so nothing goes on the wire for a message that could not be tracked*/
+                if (addInflightMessage(transportState, mqttMsgEntry) != 0)
+                {
+                    /*the message stays in waitingToSend and is tried again by the next DoWork*/
+                    destroyMqttMessageEntry(mqttMsgEntry);
+                }
+                else if (publishMqttMessage(transportState, mqttMsgEntry, messagePayload, messageLength) != 0)
+                {
+                    (void)removeInflightMessage(transportState, mqttMsgEntry->msgPacketId);
+                    (void)(DList_RemoveEntryList(currentListEntry));
+                    sendMsgComplete(iothubMsgList, transportState, IOTHUB_BATCHSTATE_FAILED);
+                    destroyMqttMessageEntry(mqttMsgEntry);
+                }
+                else
+                {
+                    (void)(DList_RemoveEntryList(currentListEntry));
+                    DList_InsertTailList(&(transportState->waitingForAck), &(mqttMsgEntry->entry));
+                }
+            }
+        }
+        currentListEntry = savedFromCurrentListEntry.Flink;
+    }
+    /*Codes_SRS_IOTHUB_MQTT_TRANSPORT_02_008: [IoTHubTransportMqtt_DoWork shall not publish a new message while the number of messages waiting for acknowledgement is "mqttMaxInflight" or more.]*/
+    transportState->inflightWindowFull = (currentListEntry != transportState->waitingToSend);
+}
+
 static void IoTHubTransportMqtt_DoWork(TRANSPORT_LL_HANDLE handle, IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle)
 {
     /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_026: [IoTHubTransportMqtt_DoWork shall do nothing if parameter handle and/or iotHubClientHandle is NULL.] */
@@ -1085,9 +1354,10 @@ static void IoTHubTransportMqtt_DoWork(TRANSPORT_LL_HANDLE handle, IOTHUB_CLIENT
                         /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_034: [If IoTHubTransportMqtt_DoWork has resent the message two times then it shall fail the message] */
                         if (mqttMsgEntry->retryCount >= MAX_SEND_RECOUNT_LIMIT)
                         {
+                            (void)removeInflightMessage(transportState, mqttMsgEntry->msgPacketId);
                             (void)DList_RemoveEntryList(currentListEntry);
                             sendMsgComplete(mqttMsgEntry->iotHubMessageEntry, transportState, IOTHUB_BATCHSTATE_FAILED);
-                            free(mqttMsgEntry);
+                            destroyMqttMessageEntry(mqttMsgEntry);
                         }
                         else
                         {
@@ -1101,9 +1371,10 @@ static void IoTHubTransportMqtt_DoWork(TRANSPORT_LL_HANDLE handle, IOTHUB_CLIENT
                             {
                                 if (publishMqttMessage(transportState, mqttMsgEntry, messagePayload, messageLength) != 0)
                                 {
+                                    (void)removeInflightMessage(transportState, mqttMsgEntry->msgPacketId);
                                     (void)DList_RemoveEntryList(currentListEntry);
                                     sendMsgComplete(mqttMsgEntry->iotHubMessageEntry, transportState, IOTHUB_BATCHSTATE_FAILED);
-                                    free(mqttMsgEntry);
+                                    destroyMqttMessageEntry(mqttMsgEntry);
                                 }
                             }
                         }
@@ -1111,53 +1382,17 @@ static void IoTHubTransportMqtt_DoWork(TRANSPORT_LL_HANDLE handle, IOTHUB_CLIENT
                     currentListEntry = nextListEntry.Flink;
                 }
 
-                currentListEntry = transportState->waitingToSend->Flink;
-                /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_027: [IoTHubTransportMqtt_DoWork shall inspect the waitingToSend DLIST passed in config structure.] */
-                while (currentListEntry != transportState->waitingToSend)
-                {
-                    IOTHUB_MESSAGE_LIST* iothubMsgList = containingRecord(currentListEntry, IOTHUB_MESSAGE_LIST, entry);
-                    DLIST_ENTRY savedFromCurrentListEntry;
-                    savedFromCurrentListEntry.Flink = currentListEntry->Flink;
-
-                    /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_027: [IoTHubTransportMqtt_DoWork shall inspect the waitingToSend DLIST passed in config structure.] */
-                    size_t messageLength;
-                    const unsigned char* messagePayload = RetrieveMessagePayload(iothubMsgList->messageHandle, &messageLength);
-                    if (messageLength == 0 || messagePayload == NULL)
-                    {
-                        LogError("Failure result from IoTHubMessage_GetData");
-                    }
-                    else
-                    {
-                        /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_029: [IoTHubTransportMqtt_DoWork shall create a MQTT_MESSAGE_HANDLE and pass this to a call to mqtt_client_publish.] */
-                        MQTT_MESSAGE_DETAILS_LIST* mqttMsgEntry = (MQTT_MESSAGE_DETAILS_LIST*)malloc(sizeof(MQTT_MESSAGE_DETAILS_LIST));
-                        if (mqttMsgEntry == NULL)
-                        {
-                            LogError("Allocation Error: Failure allocating MQTT Message Detail List.");
-                        }
-                        else
-                        {
-                            mqttMsgEntry->retryCount = 0;
-                            mqttMsgEntry->msgPacketId = transportState->packetId;
-                            mqttMsgEntry->iotHubMessageEntry = iothubMsgList;
-
-                            if (publishMqttMessage(transportState, mqttMsgEntry, messagePayload, messageLength) != 0)
-                            {
-                                (void)(DList_RemoveEntryList(currentListEntry));
-                                sendMsgComplete(iothubMsgList, transportState, IOTHUB_BATCHSTATE_FAILED);
-                                free(mqttMsgEntry);
-                            }
-                            else
-                            {
-                                (void)(DList_RemoveEntryList(currentListEntry));
-                                DList_InsertTailList(&(transportState->waitingForAck), &(mqttMsgEntry->entry));
-                            }
-                        }
-                    }
-                    currentListEntry = savedFromCurrentListEntry.Flink;
-                }
+                publishWaitingMessages(transportState);
             }
             /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_030: [IoTHubTransportMqtt_DoWork shall call mqtt_client_dowork everytime it is called if it is connected.] */
             mqtt_client_dowork(transportState->mqttClient);
+
+            /*Codes_SRS_IOTHUB_MQTT_TRANSPORT_02_009: [If the in flight window was full and PUBACKs received by mqtt_client_dowork have freed slots in it then IoTHubTransportMqtt_DoWork shall publish waiting messages into the freed slots before returning.]*/
+            if ((transportState->currPacketState == PUBLISH_TYPE) && transportState->connected &&
+                transportState->inflightWindowFull && (transportState->inflightCount < transportState->maxInflight))
+            {
+                publishWaitingMessages(transportState);
+            }
         }
     }
 }
@@ -1229,6 +1464,44 @@ static IOTHUB_CLIENT_RESULT IoTHubTransportMqtt_SetOption(TRANSPORT_LL_HANDLE ha
             }
             result = IOTHUB_CLIENT_OK;
         }
+        /*Codes_SRS_IOTHUB_MQTT_TRANSPORT_02_007: [If the option parameter is set to "mqttMaxInflight" then the value shall be an unsigned int_ptr and the value will determine the maximum number of messages waiting for acknowledgement.]*/
+        else if (strcmp("mqttMaxInflight", option) == 0)
+        {
+            unsigned int maxInflight = *(unsigned int*)value;
+            if ((maxInflight == 0) || (maxInflight > MAX_INFLIGHT_MESSAGES))
+            {
+                /*Codes_SRS_IOTHUB_MQTT_TRANSPORT_02_010: [If "mqttMaxInflight" is 0 or greater than 65534 then IoTHubTransportMqtt_SetOption shall return IOTHUB_CLIENT_INVALID_ARG.]*/
+                LogError("mqttMaxInflight must be between 1 and %u", (unsigned int)MAX_INFLIGHT_MESSAGES);
+                result = IOTHUB_CLIENT_INVALID_ARG;
+            }
+            else
+            {
+                /*messages already in flight above a lowered window are not affected, new messages wait until enough of them are acknowledged*/
+                transportState->maxInflight = maxInflight;
+                result = IOTHUB_CLIENT_OK;
+            }
+        }
+        /*Codes_SRS_IOTHUB_MQTT_TRANSPORT_02_013: [If the option parameter is set to "mqttEventQos" then the value shall be an unsigned int_ptr, 0 for DELIVER_AT_MOST_ONCE or 1 for DELIVER_AT_LEAST_ONCE, and the value will determine the QoS of the events published after it is set.]*/
+        else if (strcmp("mqttEventQos", option) == 0)
+        {
+            unsigned int eventQos = *(unsigned int*)value;
+            if (eventQos == 0)
+            {
+                transportState->eventQos = DELIVER_AT_MOST_ONCE;
+                result = IOTHUB_CLIENT_OK;
+            }
+            else if (eventQos == 1)
+            {
+                transportState->eventQos = DELIVER_AT_LEAST_ONCE;
+                result = IOTHUB_CLIENT_OK;
+            }
+            else
+            {
+                /*Codes_SRS_IOTHUB_MQTT_TRANSPORT_02_016: [If "mqttEventQos" is neither 0 nor 1 then IoTHubTransportMqtt_SetOption shall return IOTHUB_CLIENT_INVALID_ARG.]*/
+                LogError("mqttEventQos must be 0 or 1");
+                result = IOTHUB_CLIENT_INVALID_ARG;
+            }
+        }
         else
         {
             /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_032: [IoTHubTransportMqtt_SetOption shall pass down the option to xio_setoption if the option parameter is not a known option string for the MQTT transport.] */
@@ -25,11 +25,13 @@ static void my_gballoc_free(void* s)
 #include "azure_c_shared_utility/httpapiex.h"
 #include "azure_c_shared_utility/buffer_.h"
 #include "azure_c_shared_utility/strings.h"
-#include "azure_c_shared_utility/base64.h"
 #include "azure_c_shared_utility/httpheaders.h"
 #include "azure_c_shared_utility/gballoc.h"
 #undef ENABLE_MOCKS
 
+#include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/threadapi.h"
+
 #include "blob.h"
 #include "testrunnerswitcher.h"
 #include "umock_c.h"
@@ -65,6 +67,11 @@ static BUFFER_HANDLE my_BUFFER_create(const unsigned char* source, size_t size)
     return (BUFFER_HANDLE)my_gballoc_malloc(1);
 }
 
+static BUFFER_HANDLE my_BUFFER_new(void)
+{
+    return (BUFFER_HANDLE)my_gballoc_malloc(1);
+}
+
 static void my_BUFFER_delete(BUFFER_HANDLE h)
 {
     my_gballoc_free(h);
@@ -93,9 +100,72 @@ static void my_STRING_delete(STRING_HANDLE h)
     my_gballoc_free((void*)h);
 }
 
-static STRING_HANDLE my_Base64_Encode_Bytes(const unsigned char* source, size_t size)
+/*Lock and ThreadAPI are not mocked, the workers of Blob_UploadFromSasUriWithConcurrency run to completion inside ThreadAPI_Create*/
+static int failLock_Init;
+static int failThreadAPI_Create;
+static size_t threadsCreated;
+static size_t threadsJoined;
+
+LOCK_HANDLE Lock_Init(void)
+{
+    return failLock_Init ? NULL : (LOCK_HANDLE)0x42;
+}
+
+LOCK_RESULT Lock(LOCK_HANDLE handle)
+{
+    (void)handle;
+    return LOCK_OK;
+}
+
+LOCK_RESULT Unlock(LOCK_HANDLE handle)
+{
+    (void)handle;
+    return LOCK_OK;
+}
+
+LOCK_RESULT Lock_Deinit(LOCK_HANDLE handle)
+{
+    (void)handle;
+    return LOCK_OK;
+}
+
+THREADAPI_RESULT ThreadAPI_Create(THREAD_HANDLE* threadHandle, THREAD_START_FUNC func, void* arg)
+{
+    THREADAPI_RESULT result;
+    if (failThreadAPI_Create)
+    {
+        result = THREADAPI_ERROR;
+    }
+    else
+    {
+        threadsCreated++;
+        *threadHandle = (THREAD_HANDLE)0x43;
+        (void)func(arg);
+        result = THREADAPI_OK;
+    }
+    return result;
+}
+
+THREADAPI_RESULT ThreadAPI_Join(THREAD_HANDLE threadHandle, int* res)
+{
+    (void)threadHandle;
+    threadsJoined++;
+    *res = 0;
+    return THREADAPI_OK;
+}
+
+/*the retries of Blob_UploadFromSasUriWithReaderResumable do not wait, the delays are recorded instead*/
+#define MAX_RECORDED_SLEEPS 8
+static size_t sleepCount;
+static unsigned int sleepDelays[MAX_RECORDED_SLEEPS];
+
+void ThreadAPI_Sleep(unsigned int milliseconds)
 {
-    return (STRING_HANDLE)my_gballoc_malloc(1);
+    if (sleepCount < MAX_RECORDED_SLEEPS)
+    {
+        sleepDelays[sleepCount] = milliseconds;
+    }
+    sleepCount++;
 }
 
 TEST_DEFINE_ENUM_TYPE(BLOB_RESULT, BLOB_RESULT_VALUES);
@@ -106,6 +176,8 @@ static TEST_MUTEX_HANDLE g_dllByDll;
 #define TEST_HOSTNAME_1 "host.name"
 #define TEST_RELATIVE_PATH_1 "/here/follows/something?param1=value1&param2=value2"
 #define TEST_VALID_SASURI_1 TEST_HTTPCOLONBACKSLASHBACKSLACH TEST_HOSTNAME_1 TEST_RELATIVE_PATH_1
+#define TEST_HOSTNAME_2 "other.host"
+#define TEST_VALID_SASURI_2 TEST_HTTPCOLONBACKSLASHBACKSLACH TEST_HOSTNAME_2 TEST_RELATIVE_PATH_1
 
 #define X_MS_BLOB_TYPE "x-ms-blob-type"
 #define BLOCK_BLOB "BlockBlob"
@@ -119,6 +191,7 @@ static BUFFER_HANDLE testValidBufferHandle; /*assigned in TEST_SUITE_INITIALIZE*
 static unsigned int httpResponse; /*used as out parameter in every call to Blob_....*/
 static const unsigned int TwoHundred = 200;
 static const unsigned int FourHundredFour = 404;
+static const unsigned int FiveHundredThree = 503;
 
 
 BEGIN_TEST_SUITE(blob_unittests)
@@ -142,17 +215,15 @@ TEST_SUITE_INITIALIZE(TestSuiteInitialize)
     REGISTER_GLOBAL_MOCK_HOOK(BUFFER_create, my_BUFFER_create);
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(BUFFER_create, NULL);
     REGISTER_GLOBAL_MOCK_HOOK(BUFFER_delete, my_BUFFER_delete);
+    REGISTER_GLOBAL_MOCK_HOOK(BUFFER_new, my_BUFFER_new);
 
     REGISTER_GLOBAL_MOCK_HOOK(HTTPHeaders_Alloc, my_HTTPHeaders_Alloc);
     REGISTER_GLOBAL_MOCK_HOOK(HTTPHeaders_Free, my_HTTPHeaders_Free);
 
     REGISTER_GLOBAL_MOCK_HOOK(STRING_construct, my_STRING_construct);
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(STRING_construct, NULL);
-    REGISTER_GLOBAL_MOCK_HOOK(Base64_Encode_Bytes, my_Base64_Encode_Bytes);
-    REGISTER_GLOBAL_MOCK_FAIL_RETURN(Base64_Encode_Bytes, NULL);
 
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(STRING_concat, __LINE__);
-    REGISTER_GLOBAL_MOCK_FAIL_RETURN(STRING_concat_with_STRING, __LINE__);
 
     REGISTER_GLOBAL_MOCK_RETURN(STRING_c_str, "a");
     REGISTER_GLOBAL_MOCK_HOOK(STRING_delete, my_STRING_delete);
@@ -189,6 +260,109 @@ TEST_SUITE_CLEANUP(TestClassCleanup)
 TEST_FUNCTION_INITIALIZE(Setup)
 {
     umock_c_reset_all_calls();
+    failLock_Init = 0;
+    failThreadAPI_Create = 0;
+    threadsCreated = 0;
+    threadsJoined = 0;
+    sleepCount = 0;
+}
+
+/*the size of block blockNumber when size bytes are uploaded in blocks of 4MB*/
+static size_t getBlockSize(size_t size, size_t blockNumber)
+{
+    return (blockNumber != (size - 1) / (4 * 1024 * 1024)) ? 4 * 1024 * 1024 : (size - 1) % (4 * 1024 * 1024) + 1;
+}
+
+/*the XML of Put Block List is built before any block is uploaded by the workers*/
+static void setExpectedXmlBlockIds(size_t size)
+{
+    for (size_t blockNumber = 0; blockNumber < (size - 1) / (4 * 1024 * 1024) + 1; blockNumber++)
+    {
+        STRICT_EXPECTED_CALL(STRING_concat(IGNORED_PTR_ARG, "<Latest>"))
+            .IgnoreArgument_handle();
+        STRICT_EXPECTED_CALL(STRING_concat(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreArgument_handle()
+            .IgnoreArgument_s2();
+        STRICT_EXPECTED_CALL(STRING_concat(IGNORED_PTR_ARG, "</Latest>"))
+            .IgnoreArgument_handle();
+    }
+}
+
+/*a worker uploads a block by Put Block, receiving the HTTP status and response in its own variables*/
+static void setExpectedPutBlock(const unsigned char* content, size_t size, size_t blockNumber, const unsigned int* httpStatus)
+{
+    STRICT_EXPECTED_CALL(STRING_construct("/something?a=b"));
+    STRICT_EXPECTED_CALL(STRING_concat(IGNORED_PTR_ARG, "&comp=block&blockid="))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(STRING_concat(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument_handle()
+        .IgnoreArgument_s2();
+    STRICT_EXPECTED_CALL(BUFFER_create(content + blockNumber * 4 * 1024 * 1024, getBlockSize(size, blockNumber)));
+    STRICT_EXPECTED_CALL(STRING_c_str(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(HTTPAPIEX_ExecuteRequest(IGNORED_PTR_ARG, HTTPAPI_REQUEST_PUT, IGNORED_PTR_ARG, NULL, IGNORED_PTR_ARG, IGNORED_PTR_ARG, NULL, IGNORED_PTR_ARG))
+        .IgnoreArgument_handle()
+        .IgnoreArgument_relativePath()
+        .IgnoreArgument_requestContent()
+        .IgnoreArgument_statusCode()
+        .IgnoreArgument_responseContent()
+        .CopyOutArgumentBuffer_statusCode(httpStatus, sizeof(*httpStatus));
+    STRICT_EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+}
+
+/*the workers other than the first one have their own HTTPAPIEX_HANDLE, all of them have their own response buffer*/
+static void setExpectedWorkers(size_t workerCount)
+{
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument_size();
+    STRICT_EXPECTED_CALL(BUFFER_new());
+    for (size_t i = 1; i < workerCount; i++)
+    {
+        STRICT_EXPECTED_CALL(HTTPAPIEX_Create("h.h"));
+        STRICT_EXPECTED_CALL(BUFFER_new());
+    }
+}
+
+static void setExpectedWorkersCleanup(size_t workerCount)
+{
+    STRICT_EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+    for (size_t i = 1; i < workerCount; i++)
+    {
+        STRICT_EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG))
+            .IgnoreArgument_handle();
+        STRICT_EXPECTED_CALL(HTTPAPIEX_Destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument_handle();
+    }
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument_ptr();
+}
+
+static void setExpectedPutBlockList(void)
+{
+    STRICT_EXPECTED_CALL(STRING_concat(IGNORED_PTR_ARG, "</BlockList>"))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(STRING_construct("/something?a=b"));
+    STRICT_EXPECTED_CALL(STRING_concat(IGNORED_PTR_ARG, "&comp=blocklist"))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(STRING_c_str(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(BUFFER_create(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(STRING_c_str(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(HTTPAPIEX_ExecuteRequest(IGNORED_PTR_ARG, HTTPAPI_REQUEST_PUT, IGNORED_PTR_ARG, NULL, IGNORED_PTR_ARG, &httpResponse, NULL, testValidBufferHandle))
+        .IgnoreArgument_handle()
+        .IgnoreArgument_relativePath()
+        .IgnoreArgument_requestContent()
+        .CopyOutArgumentBuffer_statusCode(&TwoHundred, sizeof(TwoHundred));
+    STRICT_EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
 }
 
 /*Tests_SRS_BLOB_02_001: [ If SASURI is NULL then Blob_UploadFromSasUri shall fail and return BLOB_INVALID_ARG. ]*/
@@ -612,14 +786,12 @@ TEST_FUNCTION(Blob_UploadFromSasUri_various_sizes_happy_path)
         /*uploading blocks (Put Block)*/
         for (size_t blockNumber = 0;blockNumber < (sizes[iSize] - 1) / (4 * 1024 * 1024) + 1;blockNumber++)
         {
-            /*here some sprintf happens and that produces a string in the form: 000000...049999*/
-            STRICT_EXPECTED_CALL(Base64_Encode_Bytes(IGNORED_PTR_ARG, 6)) /*this is converting the produced blockID string to a base64 representation*/
-                .IgnoreArgument_source();
+            /*here some sprintf happens and that produces a string in the form: 000000...049999, that string is base64 encoded by IoTHubClient_Base64_Encode (not a mock)*/
 
             STRICT_EXPECTED_CALL(STRING_concat(IGNORED_PTR_ARG, "<Latest>")) /*this is building the XML*/
                 .IgnoreArgument_handle();
-            STRICT_EXPECTED_CALL(STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is building the XML*/
-                .IgnoreArgument_s1()
+            STRICT_EXPECTED_CALL(STRING_concat(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is building the XML*/
+                .IgnoreArgument_handle()
                 .IgnoreArgument_s2();
             STRICT_EXPECTED_CALL(STRING_concat(IGNORED_PTR_ARG, "</Latest>")) /*this is building the XML*/
                 .IgnoreArgument_handle();
@@ -627,8 +799,8 @@ TEST_FUNCTION(Blob_UploadFromSasUri_various_sizes_happy_path)
 
             STRICT_EXPECTED_CALL(STRING_concat(IGNORED_PTR_ARG, "&comp=block&blockid=")) /*this is building the relativePath*/
                 .IgnoreArgument_handle();
-            STRICT_EXPECTED_CALL(STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is building the relativePath by adding the blockId (base64 encoded_*/
-                .IgnoreArgument_s1()
+            STRICT_EXPECTED_CALL(STRING_concat(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is building the relativePath by adding the blockId (base64 encoded_*/
+                .IgnoreArgument_handle()
                 .IgnoreArgument_s2();
 
             STRICT_EXPECTED_CALL(BUFFER_create(content + blockNumber * 4 * 1024 * 1024,
@@ -647,8 +819,6 @@ TEST_FUNCTION(Blob_UploadFromSasUri_various_sizes_happy_path)
                 .IgnoreArgument_handle();
             STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG)) /*this is unbuilding the relativePath*/
                 .IgnoreArgument_handle();
-            STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG)) /*this is unbuilding the blockID string to a base64 representation*/
-                .IgnoreArgument_handle();
         }
 
         /*this part is Put Block list*/
@@ -714,79 +884,63 @@ TEST_FUNCTION(Blob_UploadFromSasUri_64MB_unhappy_path)
 
     size_t calls_that_cannot_fail[] =
     {
-        13   ,/*BUFFER_delete*/
-        26   ,/*BUFFER_delete*/
-        39   ,/*BUFFER_delete*/
-        52   ,/*BUFFER_delete*/
-        65   ,/*BUFFER_delete*/
+        12   ,/*BUFFER_delete*/
+        23   ,/*BUFFER_delete*/
+        34   ,/*BUFFER_delete*/
+        45   ,/*BUFFER_delete*/
+        56   ,/*BUFFER_delete*/
+        67   ,/*BUFFER_delete*/
         78   ,/*BUFFER_delete*/
-        91   ,/*BUFFER_delete*/
-        104  ,/*BUFFER_delete*/
-        117  ,/*BUFFER_delete*/
-        130  ,/*BUFFER_delete*/
-        143  ,/*BUFFER_delete*/
-        156  ,/*BUFFER_delete*/
-        169  ,/*BUFFER_delete*/
-        182  ,/*BUFFER_delete*/
-        195  ,/*BUFFER_delete*/
-        208  ,/*BUFFER_delete*/
-        11   ,/*STRING_c_str*/
-        24   ,/*STRING_c_str*/
-        37   ,/*STRING_c_str*/
-        50   ,/*STRING_c_str*/
-        63   ,/*STRING_c_str*/
+        89   ,/*BUFFER_delete*/
+        100  ,/*BUFFER_delete*/
+        111  ,/*BUFFER_delete*/
+        122  ,/*BUFFER_delete*/
+        133  ,/*BUFFER_delete*/
+        144  ,/*BUFFER_delete*/
+        155  ,/*BUFFER_delete*/
+        166  ,/*BUFFER_delete*/
+        177  ,/*BUFFER_delete*/
+        10   ,/*STRING_c_str*/
+        21   ,/*STRING_c_str*/
+        32   ,/*STRING_c_str*/
+        43   ,/*STRING_c_str*/
+        54   ,/*STRING_c_str*/
+        65   ,/*STRING_c_str*/
         76   ,/*STRING_c_str*/
-        89   ,/*STRING_c_str*/
-        102  ,/*STRING_c_str*/
-        115  ,/*STRING_c_str*/
-        128  ,/*STRING_c_str*/
-        141  ,/*STRING_c_str*/
-        154  ,/*STRING_c_str*/
-        167  ,/*STRING_c_str*/
-        180  ,/*STRING_c_str*/
-        193  ,/*STRING_c_str*/
-        206  ,/*STRING_c_str*/
-        14   ,/*STRING_delete*/
-        27   ,/*STRING_delete*/
-        40   ,/*STRING_delete*/
-        53   ,/*STRING_delete*/
-        66   ,/*STRING_delete*/
+        87   ,/*STRING_c_str*/
+        98   ,/*STRING_c_str*/
+        109  ,/*STRING_c_str*/
+        120  ,/*STRING_c_str*/
+        131  ,/*STRING_c_str*/
+        142  ,/*STRING_c_str*/
+        153  ,/*STRING_c_str*/
+        164  ,/*STRING_c_str*/
+        175  ,/*STRING_c_str*/
+        13   ,/*STRING_delete*/
+        24   ,/*STRING_delete*/
+        35   ,/*STRING_delete*/
+        46   ,/*STRING_delete*/
+        57   ,/*STRING_delete*/
+        68   ,/*STRING_delete*/
         79   ,/*STRING_delete*/
-        92   ,/*STRING_delete*/
-        105  ,/*STRING_delete*/
-        118  ,/*STRING_delete*/
-        131  ,/*STRING_delete*/
-        144  ,/*STRING_delete*/
-        157  ,/*STRING_delete*/
-        170  ,/*STRING_delete*/
-        183  ,/*STRING_delete*/
-        196  ,/*STRING_delete*/
-        209  ,/*STRING_delete*/
-        15   ,/*STRING_delete*/
-        28   ,/*STRING_delete*/
-        41   ,/*STRING_delete*/
-        54   ,/*STRING_delete*/
-        67   ,/*STRING_delete*/
-        80   ,/*STRING_delete*/
-        93   ,/*STRING_delete*/
-        106  ,/*STRING_delete*/
-        119  ,/*STRING_delete*/
-        132  ,/*STRING_delete*/
+        90   ,/*STRING_delete*/
+        101  ,/*STRING_delete*/
+        112  ,/*STRING_delete*/
+        123  ,/*STRING_delete*/
+        134  ,/*STRING_delete*/
         145  ,/*STRING_delete*/
-        158  ,/*STRING_delete*/
-        171  ,/*STRING_delete*/
-        184  ,/*STRING_delete*/
-        197  ,/*STRING_delete*/
-        210  ,/*STRING_delete*/
-
-
-        214, /*STRING_c_str*/
-        216, /*STRING_c_str*/
-        218, /*BUFFER_delete*/
-        219, /*STRING_delete*/
-        220, /*STRING_delete*/
-        221, /*HTTPAPIEX_Destroy*/
-        222, /*gballoc_free*/
+        156  ,/*STRING_delete*/
+        167  ,/*STRING_delete*/
+        178  ,/*STRING_delete*/
+
+
+        182, /*STRING_c_str*/
+        184, /*STRING_c_str*/
+        186, /*BUFFER_delete*/
+        187, /*STRING_delete*/
+        188, /*STRING_delete*/
+        189, /*HTTPAPIEX_Destroy*/
+        190, /*gballoc_free*/
     };
 
     (void)umock_c_negative_tests_init();
@@ -812,14 +966,12 @@ TEST_FUNCTION(Blob_UploadFromSasUri_64MB_unhappy_path)
     /*uploading blocks (Put Block)*/
     for (size_t blockNumber = 0;blockNumber < (size - 1) / (4 * 1024 * 1024) + 1;blockNumber++)
     {
-        /*here some sprintf happens and that produces a string in the form: 000000...049999*/
-        STRICT_EXPECTED_CALL(Base64_Encode_Bytes(IGNORED_PTR_ARG, 6)) /*this is converting the produced blockID string to a base64 representation*/ /*3, 16, 29... (16 numbers)*/
-            .IgnoreArgument_source();
+        /*here some sprintf happens and that produces a string in the form: 000000...049999, that string is base64 encoded by IoTHubClient_Base64_Encode (not a mock)*/
 
         STRICT_EXPECTED_CALL(STRING_concat(IGNORED_PTR_ARG, "<Latest>")) /*this is building the XML*/
             .IgnoreArgument_handle();
-        STRICT_EXPECTED_CALL(STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is building the XML*/
-            .IgnoreArgument_s1()
+        STRICT_EXPECTED_CALL(STRING_concat(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is building the XML*/
+            .IgnoreArgument_handle()
             .IgnoreArgument_s2();
         STRICT_EXPECTED_CALL(STRING_concat(IGNORED_PTR_ARG, "</Latest>")) /*this is building the XML*/
             .IgnoreArgument_handle();
@@ -827,15 +979,15 @@ TEST_FUNCTION(Blob_UploadFromSasUri_64MB_unhappy_path)
 
         STRICT_EXPECTED_CALL(STRING_concat(IGNORED_PTR_ARG, "&comp=block&blockid=")) /*this is building the relativePath*/
             .IgnoreArgument_handle();
-        STRICT_EXPECTED_CALL(STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is building the relativePath by adding the blockId (base64 encoded_*/
-            .IgnoreArgument_s1()
+        STRICT_EXPECTED_CALL(STRING_concat(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is building the relativePath by adding the blockId (base64 encoded_*/
+            .IgnoreArgument_handle()
             .IgnoreArgument_s2();
 
         STRICT_EXPECTED_CALL(BUFFER_create(content + blockNumber * 4 * 1024 * 1024,
             (blockNumber != (size - 1) / (4 * 1024 * 1024)) ? 4 * 1024 * 1024 : (size - 1) % (4 * 1024 * 1024) + 1 /*condition to take care of "the size of the last block*/
         )); /*this is the content to be uploaded by this call*/
 
-        STRICT_EXPECTED_CALL(STRING_c_str(IGNORED_PTR_ARG)) /*this is getting the relative path as const char* */ /*11, 24, 27...*/
+        STRICT_EXPECTED_CALL(STRING_c_str(IGNORED_PTR_ARG)) /*this is getting the relative path as const char* */ /*10, 21, 32...*/
             .IgnoreArgument_handle();
 
         STRICT_EXPECTED_CALL(HTTPAPIEX_ExecuteRequest(IGNORED_PTR_ARG, HTTPAPI_REQUEST_PUT, IGNORED_PTR_ARG, NULL, IGNORED_PTR_ARG, &httpResponse, NULL, testValidBufferHandle))
@@ -845,16 +997,14 @@ TEST_FUNCTION(Blob_UploadFromSasUri_64MB_unhappy_path)
             .CopyOutArgumentBuffer_statusCode(&TwoHundred, sizeof(TwoHundred))
             ;
 
-        STRICT_EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG)) /*this was the content to be uploaded*/ /*13, 26, 39... (16 numbers)*/
-            .IgnoreArgument_handle();
-        STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG)) /*this is unbuilding the relativePath*/ /*14, 27, 40...*/
+        STRICT_EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG)) /*this was the content to be uploaded*/ /*12, 23, 34... (16 numbers)*/
             .IgnoreArgument_handle();
-        STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG)) /*this is unbuilding the blockID string to a base64 representation*/ /*15, 28, 41... 210*/
+        STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG)) /*this is unbuilding the relativePath*/ /*13, 24, 35... 178*/
             .IgnoreArgument_handle();
     }
 
     /*this part is Put Block list*/
-    STRICT_EXPECTED_CALL(STRING_concat(IGNORED_PTR_ARG, "</BlockList>")) /*This is closing the XML*/ /*211*/
+    STRICT_EXPECTED_CALL(STRING_concat(IGNORED_PTR_ARG, "</BlockList>")) /*This is closing the XML*/ /*179*/
         .IgnoreArgument_handle();
     STRICT_EXPECTED_CALL(STRING_construct("/something?a=b")); /*this is building the relative path for the Put BLock list*/
 
@@ -983,24 +1133,20 @@ TEST_FUNCTION(Blob_UploadFromSasUri_when_http_code_is_404_it_immediately_succeed
     /*uploading blocks (Put Block)*/ /*this simply fails first block*/
     size_t blockNumber = 0;
     {
-        /*here some sprintf happens and that produces a string in the form: 000000...049999*/
-        STRICT_EXPECTED_CALL(Base64_Encode_Bytes(IGNORED_PTR_ARG, 6)) /*this is converting the produced blockID string to a base64 representation*/
-            .IgnoreArgument_source();
+        /*here some sprintf happens and that produces a string in the form: 000000...049999, that string is base64 encoded by IoTHubClient_Base64_Encode (not a mock)*/
 
         STRICT_EXPECTED_CALL(STRING_concat(IGNORED_PTR_ARG, "<Latest>")) /*this is building the XML*/
             .IgnoreArgument_handle();
-        STRICT_EXPECTED_CALL(STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is building the XML*/
-            .IgnoreArgument_s1()
-            .IgnoreArgument_s2();
+        STRICT_EXPECTED_CALL(STRING_concat(IGNORED_PTR_ARG, "ICAgICAw")) /*this is building the XML, "ICAgICAw" is the base64 encoding of "     0"*/
+            .IgnoreArgument_handle();
         STRICT_EXPECTED_CALL(STRING_concat(IGNORED_PTR_ARG, "</Latest>")) /*this is building the XML*/
             .IgnoreArgument_handle();
         STRICT_EXPECTED_CALL(STRING_construct("/something?a=b")); /*this is building the relativePath*/
 
         STRICT_EXPECTED_CALL(STRING_concat(IGNORED_PTR_ARG, "&comp=block&blockid=")) /*this is building the relativePath*/
             .IgnoreArgument_handle();
-        STRICT_EXPECTED_CALL(STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is building the relativePath by adding the blockId (base64 encoded_*/
-            .IgnoreArgument_s1()
-            .IgnoreArgument_s2();
+        STRICT_EXPECTED_CALL(STRING_concat(IGNORED_PTR_ARG, "ICAgICAw")) /*this is building the relativePath by adding the blockId (base64 encoded_*/
+            .IgnoreArgument_handle();
 
         STRICT_EXPECTED_CALL(BUFFER_create(content + blockNumber * 4 * 1024 * 1024,
             (blockNumber != (size - 1) / (4 * 1024 * 1024)) ? 4 * 1024 * 1024 : (size - 1) % (4 * 1024 * 1024) + 1 /*condition to take care of "the size of the last block*/
@@ -1020,8 +1166,6 @@ TEST_FUNCTION(Blob_UploadFromSasUri_when_http_code_is_404_it_immediately_succeed
             .IgnoreArgument_handle();
         STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG)) /*this is unbuilding the relativePath*/
             .IgnoreArgument_handle();
-        STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG)) /*this is unbuilding the blockID string to a base64 representation*/
-            .IgnoreArgument_handle();
     }
 
     /*this part is Put Block list*/ /*notice: no op because it failed before with 404*/
@@ -1046,4 +1190,1211 @@ TEST_FUNCTION(Blob_UploadFromSasUri_when_http_code_is_404_it_immediately_succeed
 }
 
 
+/*Tests_SRS_BLOB_02_036: [ If maxConcurrentBlocks is 0 then Blob_UploadFromSasUriWithConcurrency shall fail and return BLOB_INVALID_ARG. ]*/
+TEST_FUNCTION(Blob_UploadFromSasUriWithConcurrency_with_0_maxConcurrentBlocks_fails)
+{
+    ///arrange
+    unsigned char c = '3';
+
+    ///act
+    BLOB_RESULT result = Blob_UploadFromSasUriWithConcurrency(TEST_VALID_SASURI_1, &c, sizeof(c), 0, &httpResponse, testValidBufferHandle);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BLOB_RESULT, BLOB_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+}
+
+/*Tests_SRS_BLOB_02_037: [ If size is at least 64MB and maxConcurrentBlocks is greater than 1 then Blob_UploadFromSasUriWithConcurrency shall upload the blocks from min(maxConcurrentBlocks, number of blocks) workers. The first worker shall run on the calling thread and use the HTTPAPIEX_HANDLE created above, every other worker shall run on its own thread and use its own HTTPAPIEX_HANDLE created by calling HTTPAPIEX_Create passing the hostname. ]*/
+/*Tests_SRS_BLOB_02_039: [ Each worker shall take the next block not yet taken by any worker and upload it by "Put Block" on the worker's own HTTPAPIEX_HANDLE, as in the steps above. ]*/
+/*Tests_SRS_BLOB_02_041: [ Blob_UploadFromSasUriWithConcurrency shall wait for all the workers to finish before executing "Put Block List". ]*/
+TEST_FUNCTION(Blob_UploadFromSasUriWithConcurrency_uploads_the_blocks_from_several_workers)
+{
+    /*68MB+1 has 18 blocks, that is more than 4 workers and fewer than 32*/
+    size_t size = 68 * 1024 * 1024 + 1;
+    size_t maxConcurrentBlocks[] = { 4, 32 };
+    size_t expectedWorkers[] = { 4, 18 };
+
+    for (size_t i = 0; i < sizeof(maxConcurrentBlocks) / sizeof(maxConcurrentBlocks[0]); i++)
+    {
+        ///arrange
+        unsigned char * content = (unsigned char*)gballoc_malloc(size);
+        ASSERT_IS_NOT_NULL(content);
+        umock_c_reset_all_calls();
+        threadsCreated = 0;
+        threadsJoined = 0;
+
+        STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG)) /*this is creating a copy of the hostname */
+            .IgnoreArgument_size();
+        STRICT_EXPECTED_CALL(HTTPAPIEX_Create("h.h")); /*this is the HTTPAPIEX_HANDLE of the first worker*/
+        STRICT_EXPECTED_CALL(STRING_construct("<?xml version=\"1.0\" encoding=\"utf-8\"?>\r\n<BlockList>"));
+        setExpectedXmlBlockIds(size);
+        setExpectedWorkers(expectedWorkers[i]);
+        for (size_t blockNumber = 0; blockNumber < 18; blockNumber++) /*the second worker runs first in this test, it uploads all the blocks*/
+        {
+            setExpectedPutBlock(content, size, blockNumber, &TwoHundred);
+        }
+        setExpectedWorkersCleanup(expectedWorkers[i]);
+        setExpectedPutBlockList();
+        STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG)) /*this is the XML string used for Put Block List operation*/
+            .IgnoreArgument_handle();
+        STRICT_EXPECTED_CALL(HTTPAPIEX_Destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument_handle();
+        STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG)) /*this is freeing the copy of the hostname*/
+            .IgnoreArgument_ptr();
+
+        ///act
+        BLOB_RESULT result = Blob_UploadFromSasUriWithConcurrency("https://h.h/something?a=b", content, size, maxConcurrentBlocks[i], &httpResponse, testValidBufferHandle);
+
+        ///assert
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+        ASSERT_ARE_EQUAL(BLOB_RESULT, BLOB_OK, result);
+        ASSERT_ARE_EQUAL(size_t, expectedWorkers[i] - 1, threadsCreated);
+        ASSERT_ARE_EQUAL(size_t, expectedWorkers[i] - 1, threadsJoined);
+        ASSERT_ARE_EQUAL(int, 200, (int)httpResponse);
+
+        ///cleanup
+        gballoc_free(content);
+    }
+}
+
+/*Tests_SRS_BLOB_02_038: [ If creating the lock, the HTTPAPIEX_HANDLE or the thread of a worker fails, then the blocks shall be uploaded by the workers already started. ]*/
+TEST_FUNCTION(Blob_UploadFromSasUriWithConcurrency_continues_with_fewer_workers_when_HTTPAPIEX_Create_fails)
+{
+    ///arrange
+    size_t size = 64 * 1024 * 1024;
+    unsigned char * content = (unsigned char*)gballoc_malloc(size);
+    ASSERT_IS_NOT_NULL(content);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument_size();
+    STRICT_EXPECTED_CALL(HTTPAPIEX_Create("h.h"));
+    STRICT_EXPECTED_CALL(STRING_construct("<?xml version=\"1.0\" encoding=\"utf-8\"?>\r\n<BlockList>"));
+    setExpectedXmlBlockIds(size);
+    setExpectedWorkers(2);
+    STRICT_EXPECTED_CALL(HTTPAPIEX_Create("h.h")) /*the third worker cannot connect*/
+        .SetReturn(NULL);
+    for (size_t blockNumber = 0; blockNumber < 16; blockNumber++)
+    {
+        setExpectedPutBlock(content, size, blockNumber, &TwoHundred);
+    }
+    setExpectedWorkersCleanup(2);
+    setExpectedPutBlockList();
+    STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(HTTPAPIEX_Destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument_ptr();
+
+    ///act
+    BLOB_RESULT result = Blob_UploadFromSasUriWithConcurrency("https://h.h/something?a=b", content, size, 8, &httpResponse, testValidBufferHandle);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(BLOB_RESULT, BLOB_OK, result);
+    ASSERT_ARE_EQUAL(size_t, 1, threadsCreated);
+
+    ///cleanup
+    gballoc_free(content);
+}
+
+/*Tests_SRS_BLOB_02_038: [ If creating the lock, the HTTPAPIEX_HANDLE or the thread of a worker fails, then the blocks shall be uploaded by the workers already started. ]*/
+TEST_FUNCTION(Blob_UploadFromSasUriWithConcurrency_uploads_from_the_calling_thread_when_ThreadAPI_Create_fails)
+{
+    ///arrange
+    size_t size = 64 * 1024 * 1024;
+    unsigned char * content = (unsigned char*)gballoc_malloc(size);
+    ASSERT_IS_NOT_NULL(content);
+    umock_c_reset_all_calls();
+    failThreadAPI_Create = 1;
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument_size();
+    STRICT_EXPECTED_CALL(HTTPAPIEX_Create("h.h"));
+    STRICT_EXPECTED_CALL(STRING_construct("<?xml version=\"1.0\" encoding=\"utf-8\"?>\r\n<BlockList>"));
+    setExpectedXmlBlockIds(size);
+    setExpectedWorkers(4);
+    for (size_t blockNumber = 0; blockNumber < 16; blockNumber++)
+    {
+        setExpectedPutBlock(content, size, blockNumber, &TwoHundred);
+    }
+    setExpectedWorkersCleanup(4);
+    setExpectedPutBlockList();
+    STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(HTTPAPIEX_Destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument_ptr();
+
+    ///act
+    BLOB_RESULT result = Blob_UploadFromSasUriWithConcurrency("https://h.h/something?a=b", content, size, 4, &httpResponse, testValidBufferHandle);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(BLOB_RESULT, BLOB_OK, result);
+    ASSERT_ARE_EQUAL(size_t, 0, threadsJoined);
+
+    ///cleanup
+    gballoc_free(content);
+}
+
+/*Tests_SRS_BLOB_02_038: [ If creating the lock, the HTTPAPIEX_HANDLE or the thread of a worker fails, then the blocks shall be uploaded by the workers already started. ]*/
+TEST_FUNCTION(Blob_UploadFromSasUriWithConcurrency_uploads_from_the_calling_thread_when_Lock_Init_fails)
+{
+    ///arrange
+    size_t size = 64 * 1024 * 1024;
+    unsigned char * content = (unsigned char*)gballoc_malloc(size);
+    ASSERT_IS_NOT_NULL(content);
+    umock_c_reset_all_calls();
+    failLock_Init = 1;
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument_size();
+    STRICT_EXPECTED_CALL(HTTPAPIEX_Create("h.h"));
+    STRICT_EXPECTED_CALL(STRING_construct("<?xml version=\"1.0\" encoding=\"utf-8\"?>\r\n<BlockList>"));
+    setExpectedXmlBlockIds(size);
+    setExpectedWorkers(1);
+    for (size_t blockNumber = 0; blockNumber < 16; blockNumber++)
+    {
+        setExpectedPutBlock(content, size, blockNumber, &TwoHundred);
+    }
+    setExpectedWorkersCleanup(1);
+    setExpectedPutBlockList();
+    STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(HTTPAPIEX_Destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument_ptr();
+
+    ///act
+    BLOB_RESULT result = Blob_UploadFromSasUriWithConcurrency("https://h.h/something?a=b", content, size, 4, &httpResponse, testValidBufferHandle);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(BLOB_RESULT, BLOB_OK, result);
+    ASSERT_ARE_EQUAL(size_t, 0, threadsCreated);
+
+    ///cleanup
+    gballoc_free(content);
+}
+
+/*Tests_SRS_BLOB_02_040: [ When a block fails, the workers shall not take new blocks and Blob_UploadFromSasUriWithConcurrency shall return the result, httpStatus and httpResponse of the first block that failed. ]*/
+TEST_FUNCTION(Blob_UploadFromSasUriWithConcurrency_when_http_code_is_404_it_stops_the_workers_and_succeeds)
+{
+    ///arrange
+    size_t size = 64 * 1024 * 1024;
+    unsigned char * content = (unsigned char*)gballoc_malloc(size);
+    ASSERT_IS_NOT_NULL(content);
+    umock_c_reset_all_calls();
+    httpResponse = 0;
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument_size();
+    STRICT_EXPECTED_CALL(HTTPAPIEX_Create("h.h"));
+    STRICT_EXPECTED_CALL(STRING_construct("<?xml version=\"1.0\" encoding=\"utf-8\"?>\r\n<BlockList>"));
+    setExpectedXmlBlockIds(size);
+    setExpectedWorkers(2);
+    setExpectedPutBlock(content, size, 0, &FourHundredFour);
+    STRICT_EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG)) /*the response of the worker becomes the response of Blob_UploadFromSasUriWithConcurrency*/
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(BUFFER_build(testValidBufferHandle, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+        .IgnoreArgument_source()
+        .IgnoreArgument_size();
+    setExpectedWorkersCleanup(2);
+    /*notice: no Put Block List because a block failed*/
+    STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(HTTPAPIEX_Destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument_ptr();
+
+    ///act
+    BLOB_RESULT result = Blob_UploadFromSasUriWithConcurrency("https://h.h/something?a=b", content, size, 2, &httpResponse, testValidBufferHandle);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(BLOB_RESULT, BLOB_OK, result);
+    ASSERT_ARE_EQUAL(int, 404, (int)httpResponse);
+
+    ///cleanup
+    gballoc_free(content);
+}
+
+/*Tests_SRS_BLOB_02_040: [ When a block fails, the workers shall not take new blocks and Blob_UploadFromSasUriWithConcurrency shall return the result, httpStatus and httpResponse of the first block that failed. ]*/
+TEST_FUNCTION(Blob_UploadFromSasUriWithConcurrency_fails_when_a_block_fails)
+{
+    ///arrange
+    size_t size = 64 * 1024 * 1024;
+    unsigned char * content = (unsigned char*)gballoc_malloc(size);
+    ASSERT_IS_NOT_NULL(content);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument_size();
+    STRICT_EXPECTED_CALL(HTTPAPIEX_Create("h.h"));
+    STRICT_EXPECTED_CALL(STRING_construct("<?xml version=\"1.0\" encoding=\"utf-8\"?>\r\n<BlockList>"));
+    setExpectedXmlBlockIds(size);
+    setExpectedWorkers(2);
+    setExpectedPutBlock(content, size, 0, &TwoHundred);
+    STRICT_EXPECTED_CALL(STRING_construct("/something?a=b"));
+    STRICT_EXPECTED_CALL(STRING_concat(IGNORED_PTR_ARG, "&comp=block&blockid="))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(STRING_concat(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument_handle()
+        .IgnoreArgument_s2();
+    STRICT_EXPECTED_CALL(BUFFER_create(content + 4 * 1024 * 1024, 4 * 1024 * 1024))
+        .SetReturn(NULL);
+    STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(BUFFER_build(testValidBufferHandle, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+        .IgnoreArgument_source()
+        .IgnoreArgument_size();
+    setExpectedWorkersCleanup(2);
+    STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(HTTPAPIEX_Destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument_ptr();
+
+    ///act
+    BLOB_RESULT result = Blob_UploadFromSasUriWithConcurrency("https://h.h/something?a=b", content, size, 2, &httpResponse, testValidBufferHandle);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(BLOB_RESULT, BLOB_ERROR, result);
+
+    ///cleanup
+    gballoc_free(content);
+}
+
+typedef struct TEST_READER_TAG
+{
+    size_t size; /*how many bytes testGetData produces in total*/
+    size_t position;
+    size_t chunkSize; /*the most bytes produced by one call*/
+    size_t failAt; /*testGetData fails once position reaches failAt*/
+    int produceTooMuch;
+}TEST_READER;
+
+static int testGetData(void* context, unsigned char* buffer, size_t bufferSize, size_t* bytesRead)
+{
+    int result;
+    TEST_READER* reader = (TEST_READER*)context;
+    if (reader->position >= reader->failAt)
+    {
+        result = __LINE__;
+    }
+    else if (reader->produceTooMuch)
+    {
+        *bytesRead = bufferSize + 1;
+        result = 0;
+    }
+    else
+    {
+        size_t n = reader->size - reader->position;
+        n = (n > bufferSize) ? bufferSize : n;
+        n = (n > reader->chunkSize) ? reader->chunkSize : n;
+        for (size_t i = 0; i < n; i++)
+        {
+            buffer[i] = (unsigned char)(reader->position + i);
+        }
+        reader->position += n;
+        *bytesRead = n;
+        result = 0;
+    }
+    return result;
+}
+
+static void initTestReader(TEST_READER* reader, size_t size)
+{
+    reader->size = size;
+    reader->position = 0;
+    reader->chunkSize = 1024 * 1024;
+    reader->failAt = (size_t)-1;
+    reader->produceTooMuch = 0;
+}
+
+/*the worker of Blob_UploadFromSasUriWithReader has its own response buffer and its own block buffer*/
+static void setExpectedReaderWorker(void)
+{
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument_size();
+    STRICT_EXPECTED_CALL(BUFFER_new());
+    STRICT_EXPECTED_CALL(gballoc_malloc(4 * 1024 * 1024));
+}
+
+static void setExpectedReaderWorkerCleanup(void)
+{
+    STRICT_EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG)) /*the block buffer*/
+        .IgnoreArgument_ptr();
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG)) /*the workers*/
+        .IgnoreArgument_ptr();
+}
+
+/*a block read from getData is uploaded from the block buffer of the worker*/
+static void setExpectedReaderPutBlock(size_t blockSize, const unsigned int* httpStatus)
+{
+    STRICT_EXPECTED_CALL(STRING_construct("/something?a=b"));
+    STRICT_EXPECTED_CALL(STRING_concat(IGNORED_PTR_ARG, "&comp=block&blockid="))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(STRING_concat(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument_handle()
+        .IgnoreArgument_s2();
+    STRICT_EXPECTED_CALL(BUFFER_create(IGNORED_PTR_ARG, blockSize))
+        .IgnoreArgument_source();
+    STRICT_EXPECTED_CALL(STRING_c_str(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(HTTPAPIEX_ExecuteRequest(IGNORED_PTR_ARG, HTTPAPI_REQUEST_PUT, IGNORED_PTR_ARG, NULL, IGNORED_PTR_ARG, IGNORED_PTR_ARG, NULL, IGNORED_PTR_ARG))
+        .IgnoreArgument_handle()
+        .IgnoreArgument_relativePath()
+        .IgnoreArgument_requestContent()
+        .IgnoreArgument_statusCode()
+        .IgnoreArgument_responseContent()
+        .CopyOutArgumentBuffer_statusCode(httpStatus, sizeof(*httpStatus));
+    STRICT_EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+}
+
+/*Tests_SRS_BLOB_02_042: [ If SASURI or getData is NULL then Blob_UploadFromSasUriWithReader shall fail and return BLOB_INVALID_ARG. ]*/
+TEST_FUNCTION(Blob_UploadFromSasUriWithReader_with_NULL_SasUri_fails)
+{
+    ///arrange
+    TEST_READER reader;
+    initTestReader(&reader, 1);
+
+    ///act
+    BLOB_RESULT result = Blob_UploadFromSasUriWithReader(NULL, testGetData, &reader, 1, &httpResponse, testValidBufferHandle);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(BLOB_RESULT, BLOB_INVALID_ARG, result);
+}
+
+/*Tests_SRS_BLOB_02_042: [ If SASURI or getData is NULL then Blob_UploadFromSasUriWithReader shall fail and return BLOB_INVALID_ARG. ]*/
+TEST_FUNCTION(Blob_UploadFromSasUriWithReader_with_NULL_getData_fails)
+{
+    ///arrange
+
+    ///act
+    BLOB_RESULT result = Blob_UploadFromSasUriWithReader("https://h.h/something?a=b", NULL, NULL, 1, &httpResponse, testValidBufferHandle);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(BLOB_RESULT, BLOB_INVALID_ARG, result);
+}
+
+/*Tests_SRS_BLOB_02_043: [ If maxConcurrentBlocks is 0 then Blob_UploadFromSasUriWithReader shall fail and return BLOB_INVALID_ARG. ]*/
+TEST_FUNCTION(Blob_UploadFromSasUriWithReader_with_0_maxConcurrentBlocks_fails)
+{
+    ///arrange
+    TEST_READER reader;
+    initTestReader(&reader, 1);
+
+    ///act
+    BLOB_RESULT result = Blob_UploadFromSasUriWithReader("https://h.h/something?a=b", testGetData, &reader, 0, &httpResponse, testValidBufferHandle);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(BLOB_RESULT, BLOB_INVALID_ARG, result);
+}
+
+/*Tests_SRS_BLOB_02_049: [ Blob_UploadFromSasUriWithReader shall determine the hostname and the relative path and create the HTTPAPIEX_HANDLE as Blob_UploadFromSasUri does, failing the same way. ]*/
+TEST_FUNCTION(Blob_UploadFromSasUriWithReader_when_SasUri_is_wrong_fails)
+{
+    ///arrange
+    TEST_READER reader;
+    initTestReader(&reader, 1);
+
+    ///act
+    BLOB_RESULT result = Blob_UploadFromSasUriWithReader("https:/h.h/doms", testGetData, &reader, 1, &httpResponse, testValidBufferHandle);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(BLOB_RESULT, BLOB_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(size_t, 0, reader.position);
+}
+
+/*Tests_SRS_BLOB_02_044: [ Blob_UploadFromSasUriWithReader shall upload the data by "Put Block" in blocks of 4MB, whatever its size, from up to maxConcurrentBlocks workers as Blob_UploadFromSasUriWithConcurrency does. Every worker shall have its own 4MB buffer. ]*/
+/*Tests_SRS_BLOB_02_045: [ Every block shall be read by the worker that takes it into its own 4MB buffer, by calling getData until the buffer is full or getData sets bytesRead to 0. Only one worker shall call getData at any given time. ]*/
+/*Tests_SRS_BLOB_02_048: [ Once all the workers have finished, Blob_UploadFromSasUriWithReader shall execute "Put Block List" with the XML listing all the blocks in order, as Blob_UploadFromSasUri does. ]*/
+TEST_FUNCTION(Blob_UploadFromSasUriWithReader_uploads_the_data_one_block_at_a_time)
+{
+    ///arrange
+    /*5MB+1 is read in chunks of 1MB: a full block of 4MB and a last block of 1MB+1*/
+    TEST_READER reader;
+    initTestReader(&reader, 5 * 1024 * 1024 + 1);
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG)) /*this is creating a copy of the hostname */
+        .IgnoreArgument_size();
+    STRICT_EXPECTED_CALL(HTTPAPIEX_Create("h.h"));
+    setExpectedReaderWorker();
+    setExpectedReaderPutBlock(4 * 1024 * 1024, &TwoHundred);
+    setExpectedReaderPutBlock(1024 * 1024 + 1, &TwoHundred);
+    setExpectedReaderWorkerCleanup();
+    STRICT_EXPECTED_CALL(STRING_construct("<?xml version=\"1.0\" encoding=\"utf-8\"?>\r\n<BlockList>"));
+    setExpectedXmlBlockIds(reader.size);
+    setExpectedPutBlockList();
+    STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG)) /*this is the XML string used for Put Block List operation*/
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(HTTPAPIEX_Destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG)) /*this is freeing the copy of the hostname*/
+        .IgnoreArgument_ptr();
+
+    ///act
+    BLOB_RESULT result = Blob_UploadFromSasUriWithReader("https://h.h/something?a=b", testGetData, &reader, 1, &httpResponse, testValidBufferHandle);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(BLOB_RESULT, BLOB_OK, result);
+    ASSERT_ARE_EQUAL(size_t, reader.size, reader.position);
+    ASSERT_ARE_EQUAL(size_t, 0, threadsCreated);
+    ASSERT_ARE_EQUAL(int, 200, (int)httpResponse);
+}
+
+/*Tests_SRS_BLOB_02_048: [ Once all the workers have finished, Blob_UploadFromSasUriWithReader shall execute "Put Block List" with the XML listing all the blocks in order, as Blob_UploadFromSasUri does. ]*/
+TEST_FUNCTION(Blob_UploadFromSasUriWithReader_with_no_data_puts_an_empty_block_list)
+{
+    ///arrange
+    TEST_READER reader;
+    initTestReader(&reader, 0);
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument_size();
+    STRICT_EXPECTED_CALL(HTTPAPIEX_Create("h.h"));
+    setExpectedReaderWorker();
+    setExpectedReaderWorkerCleanup();
+    STRICT_EXPECTED_CALL(STRING_construct("<?xml version=\"1.0\" encoding=\"utf-8\"?>\r\n<BlockList>"));
+    setExpectedPutBlockList();
+    STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(HTTPAPIEX_Destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument_ptr();
+
+    ///act
+    BLOB_RESULT result = Blob_UploadFromSasUriWithReader("https://h.h/something?a=b", testGetData, &reader, 1, &httpResponse, testValidBufferHandle);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(BLOB_RESULT, BLOB_OK, result);
+}
+
+/*Tests_SRS_BLOB_02_044: [ Blob_UploadFromSasUriWithReader shall upload the data by "Put Block" in blocks of 4MB, whatever its size, from up to maxConcurrentBlocks workers as Blob_UploadFromSasUriWithConcurrency does. Every worker shall have its own 4MB buffer. ]*/
+TEST_FUNCTION(Blob_UploadFromSasUriWithReader_uploads_from_several_workers)
+{
+    ///arrange
+    TEST_READER reader;
+    initTestReader(&reader, 12 * 1024 * 1024);
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument_size();
+    STRICT_EXPECTED_CALL(HTTPAPIEX_Create("h.h"));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG)) /*the workers*/
+        .IgnoreArgument_size();
+    STRICT_EXPECTED_CALL(BUFFER_new());
+    STRICT_EXPECTED_CALL(gballoc_malloc(4 * 1024 * 1024));
+    STRICT_EXPECTED_CALL(HTTPAPIEX_Create("h.h"));
+    STRICT_EXPECTED_CALL(BUFFER_new());
+    STRICT_EXPECTED_CALL(gballoc_malloc(4 * 1024 * 1024));
+    for (size_t blockNumber = 0; blockNumber < 3; blockNumber++) /*the second worker runs first in this test, it uploads all the blocks*/
+    {
+        setExpectedReaderPutBlock(4 * 1024 * 1024, &TwoHundred);
+    }
+    STRICT_EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument_ptr();
+    STRICT_EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument_ptr();
+    STRICT_EXPECTED_CALL(HTTPAPIEX_Destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument_ptr();
+    STRICT_EXPECTED_CALL(STRING_construct("<?xml version=\"1.0\" encoding=\"utf-8\"?>\r\n<BlockList>"));
+    setExpectedXmlBlockIds(reader.size);
+    setExpectedPutBlockList();
+    STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(HTTPAPIEX_Destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument_ptr();
+
+    ///act
+    BLOB_RESULT result = Blob_UploadFromSasUriWithReader("https://h.h/something?a=b", testGetData, &reader, 2, &httpResponse, testValidBufferHandle);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(BLOB_RESULT, BLOB_OK, result);
+    ASSERT_ARE_EQUAL(size_t, 1, threadsCreated);
+    ASSERT_ARE_EQUAL(size_t, 1, threadsJoined);
+}
+
+/*Tests_SRS_BLOB_02_046: [ If getData fails or sets bytesRead to more than bufferSize then Blob_UploadFromSasUriWithReader shall fail and return BLOB_ERROR. ]*/
+TEST_FUNCTION(Blob_UploadFromSasUriWithReader_fails_when_getData_fails)
+{
+    ///arrange
+    TEST_READER reader;
+    initTestReader(&reader, 12 * 1024 * 1024);
+    reader.failAt = 6 * 1024 * 1024; /*the second block cannot be read*/
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument_size();
+    STRICT_EXPECTED_CALL(HTTPAPIEX_Create("h.h"));
+    setExpectedReaderWorker();
+    setExpectedReaderPutBlock(4 * 1024 * 1024, &TwoHundred);
+    setExpectedReaderWorkerCleanup();
+    /*notice: no Put Block List because a block failed*/
+    STRICT_EXPECTED_CALL(HTTPAPIEX_Destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument_ptr();
+
+    ///act
+    BLOB_RESULT result = Blob_UploadFromSasUriWithReader("https://h.h/something?a=b", testGetData, &reader, 1, &httpResponse, testValidBufferHandle);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(BLOB_RESULT, BLOB_ERROR, result);
+}
+
+/*Tests_SRS_BLOB_02_046: [ If getData fails or sets bytesRead to more than bufferSize then Blob_UploadFromSasUriWithReader shall fail and return BLOB_ERROR. ]*/
+TEST_FUNCTION(Blob_UploadFromSasUriWithReader_fails_when_getData_produces_more_than_requested)
+{
+    ///arrange
+    TEST_READER reader;
+    initTestReader(&reader, 1);
+    reader.produceTooMuch = 1;
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument_size();
+    STRICT_EXPECTED_CALL(HTTPAPIEX_Create("h.h"));
+    setExpectedReaderWorker();
+    setExpectedReaderWorkerCleanup();
+    STRICT_EXPECTED_CALL(HTTPAPIEX_Destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument_ptr();
+
+    ///act
+    BLOB_RESULT result = Blob_UploadFromSasUriWithReader("https://h.h/something?a=b", testGetData, &reader, 1, &httpResponse, testValidBufferHandle);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(BLOB_RESULT, BLOB_ERROR, result);
+}
+
+/*Tests_SRS_BLOB_02_040: [ When a block fails, the workers shall not take new blocks and Blob_UploadFromSasUriWithConcurrency shall return the result, httpStatus and httpResponse of the first block that failed. ]*/
+TEST_FUNCTION(Blob_UploadFromSasUriWithReader_when_http_code_is_404_it_stops_reading_and_succeeds)
+{
+    ///arrange
+    TEST_READER reader;
+    initTestReader(&reader, 12 * 1024 * 1024);
+    httpResponse = 0;
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument_size();
+    STRICT_EXPECTED_CALL(HTTPAPIEX_Create("h.h"));
+    setExpectedReaderWorker();
+    setExpectedReaderPutBlock(4 * 1024 * 1024, &FourHundredFour);
+    STRICT_EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG)) /*the response of the worker becomes the response of Blob_UploadFromSasUriWithReader*/
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(BUFFER_build(testValidBufferHandle, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+        .IgnoreArgument_source()
+        .IgnoreArgument_size();
+    setExpectedReaderWorkerCleanup();
+    STRICT_EXPECTED_CALL(HTTPAPIEX_Destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument_ptr();
+
+    ///act
+    BLOB_RESULT result = Blob_UploadFromSasUriWithReader("https://h.h/something?a=b", testGetData, &reader, 1, &httpResponse, testValidBufferHandle);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(BLOB_RESULT, BLOB_OK, result);
+    ASSERT_ARE_EQUAL(int, 404, (int)httpResponse);
+    ASSERT_ARE_EQUAL(size_t, 4 * 1024 * 1024, reader.position);
+}
+
+typedef struct TEST_UPLOADED_BLOCKS_TAG
+{
+    size_t count;
+    unsigned int blockIDs[8];
+}TEST_UPLOADED_BLOCKS;
+
+static void testOnBlockUploaded(void* context, unsigned int blockID)
+{
+    TEST_UPLOADED_BLOCKS* uploaded = (TEST_UPLOADED_BLOCKS*)context;
+    if (uploaded->count < sizeof(uploaded->blockIDs) / sizeof(uploaded->blockIDs[0]))
+    {
+        uploaded->blockIDs[uploaded->count] = blockID;
+    }
+    uploaded->count++;
+}
+
+static void initTestResume(BLOB_UPLOAD_RESUME* resume, const unsigned char* isBlockUploaded, size_t blockCount, TEST_UPLOADED_BLOCKS* uploaded)
+{
+    uploaded->count = 0;
+    resume->isBlockUploaded = isBlockUploaded;
+    resume->blockCount = blockCount;
+    resume->onBlockUploaded = testOnBlockUploaded;
+    resume->onBlockUploadedContext = uploaded;
+}
+
+/*Tests_SRS_BLOB_02_050: [ If SASURI, getData or resume is NULL, or if resume->isBlockUploaded is NULL and resume->blockCount is not 0, then Blob_UploadFromSasUriWithReaderResumable shall fail and return BLOB_INVALID_ARG. ]*/
+TEST_FUNCTION(Blob_UploadFromSasUriWithReaderResumable_with_NULL_resume_fails)
+{
+    ///arrange
+    TEST_READER reader;
+    initTestReader(&reader, 1);
+
+    ///act
+    BLOB_RESULT result = Blob_UploadFromSasUriWithReaderResumable("https://h.h/something?a=b", testGetData, &reader, 1, NULL, &httpResponse, testValidBufferHandle);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(BLOB_RESULT, BLOB_INVALID_ARG, result);
+}
+
+/*Tests_SRS_BLOB_02_050: [ If SASURI, getData or resume is NULL, or if resume->isBlockUploaded is NULL and resume->blockCount is not 0, then Blob_UploadFromSasUriWithReaderResumable shall fail and return BLOB_INVALID_ARG. ]*/
+TEST_FUNCTION(Blob_UploadFromSasUriWithReaderResumable_with_NULL_isBlockUploaded_and_non_zero_blockCount_fails)
+{
+    ///arrange
+    TEST_READER reader;
+    TEST_UPLOADED_BLOCKS uploaded;
+    BLOB_UPLOAD_RESUME resume;
+    initTestReader(&reader, 1);
+    initTestResume(&resume, NULL, 1, &uploaded);
+
+    ///act
+    BLOB_RESULT result = Blob_UploadFromSasUriWithReaderResumable("https://h.h/something?a=b", testGetData, &reader, 1, &resume, &httpResponse, testValidBufferHandle);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(BLOB_RESULT, BLOB_INVALID_ARG, result);
+}
+
+/*Tests_SRS_BLOB_02_050: [ If SASURI, getData or resume is NULL, or if resume->isBlockUploaded is NULL and resume->blockCount is not 0, then Blob_UploadFromSasUriWithReaderResumable shall fail and return BLOB_INVALID_ARG. ]*/
+TEST_FUNCTION(Blob_UploadFromSasUriWithReaderResumable_with_NULL_getData_fails)
+{
+    ///arrange
+    TEST_UPLOADED_BLOCKS uploaded;
+    BLOB_UPLOAD_RESUME resume;
+    initTestResume(&resume, NULL, 0, &uploaded);
+
+    ///act
+    BLOB_RESULT result = Blob_UploadFromSasUriWithReaderResumable("https://h.h/something?a=b", NULL, NULL, 1, &resume, &httpResponse, testValidBufferHandle);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(BLOB_RESULT, BLOB_INVALID_ARG, result);
+}
+
+/*Tests_SRS_BLOB_02_051: [ If maxConcurrentBlocks is 0 then Blob_UploadFromSasUriWithReaderResumable shall fail and return BLOB_INVALID_ARG. ]*/
+TEST_FUNCTION(Blob_UploadFromSasUriWithReaderResumable_with_0_maxConcurrentBlocks_fails)
+{
+    ///arrange
+    TEST_READER reader;
+    TEST_UPLOADED_BLOCKS uploaded;
+    BLOB_UPLOAD_RESUME resume;
+    initTestReader(&reader, 1);
+    initTestResume(&resume, NULL, 0, &uploaded);
+
+    ///act
+    BLOB_RESULT result = Blob_UploadFromSasUriWithReaderResumable("https://h.h/something?a=b", testGetData, &reader, 0, &resume, &httpResponse, testValidBufferHandle);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(BLOB_RESULT, BLOB_INVALID_ARG, result);
+}
+
+/*Tests_SRS_BLOB_02_052: [ Blob_UploadFromSasUriWithReaderResumable shall upload the data as Blob_UploadFromSasUriWithReader does, except that a block whose blockID is less than resume->blockCount and for which resume->isBlockUploaded[blockID] is not 0 shall be read by getData but not uploaded. ]*/
+/*Tests_SRS_BLOB_02_054: [ After a block has been uploaded, Blob_UploadFromSasUriWithReaderResumable shall call resume->onBlockUploaded (when not NULL) passing resume->onBlockUploadedContext and the blockID, never from more than one worker at a time. ]*/
+/*Tests_SRS_BLOB_02_055: [ "Put Block List" shall list all the blocks, the ones uploaded by a previous attempt included. ]*/
+TEST_FUNCTION(Blob_UploadFromSasUriWithReaderResumable_uploads_only_the_blocks_not_uploaded_before)
+{
+    ///arrange
+    /*the first and the last of 3 blocks were uploaded by a previous attempt*/
+    const unsigned char isBlockUploaded[] = { 1, 0, 1 };
+    TEST_READER reader;
+    TEST_UPLOADED_BLOCKS uploaded;
+    BLOB_UPLOAD_RESUME resume;
+    initTestReader(&reader, 12 * 1024 * 1024);
+    initTestResume(&resume, isBlockUploaded, sizeof(isBlockUploaded), &uploaded);
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument_size();
+    STRICT_EXPECTED_CALL(HTTPAPIEX_Create("h.h"));
+    setExpectedReaderWorker();
+    setExpectedReaderPutBlock(4 * 1024 * 1024, &TwoHundred);
+    setExpectedReaderWorkerCleanup();
+    STRICT_EXPECTED_CALL(STRING_construct("<?xml version=\"1.0\" encoding=\"utf-8\"?>\r\n<BlockList>"));
+    setExpectedXmlBlockIds(reader.size);
+    setExpectedPutBlockList();
+    STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(HTTPAPIEX_Destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument_ptr();
+
+    ///act
+    BLOB_RESULT result = Blob_UploadFromSasUriWithReaderResumable("https://h.h/something?a=b", testGetData, &reader, 1, &resume, &httpResponse, testValidBufferHandle);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(BLOB_RESULT, BLOB_OK, result);
+    ASSERT_ARE_EQUAL(size_t, reader.size, reader.position);
+    ASSERT_ARE_EQUAL(size_t, 1, uploaded.count);
+    ASSERT_ARE_EQUAL(int, 1, (int)uploaded.blockIDs[0]);
+    ASSERT_ARE_EQUAL(size_t, 0, sleepCount);
+}
+
+/*Tests_SRS_BLOB_02_055: [ "Put Block List" shall list all the blocks, the ones uploaded by a previous attempt included. ]*/
+TEST_FUNCTION(Blob_UploadFromSasUriWithReaderResumable_when_all_blocks_were_uploaded_before_only_puts_the_block_list)
+{
+    ///arrange
+    const unsigned char isBlockUploaded[] = { 1, 1 };
+    TEST_READER reader;
+    TEST_UPLOADED_BLOCKS uploaded;
+    BLOB_UPLOAD_RESUME resume;
+    initTestReader(&reader, 5 * 1024 * 1024 + 1);
+    initTestResume(&resume, isBlockUploaded, sizeof(isBlockUploaded), &uploaded);
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument_size();
+    STRICT_EXPECTED_CALL(HTTPAPIEX_Create("h.h"));
+    setExpectedReaderWorker();
+    setExpectedReaderWorkerCleanup();
+    STRICT_EXPECTED_CALL(STRING_construct("<?xml version=\"1.0\" encoding=\"utf-8\"?>\r\n<BlockList>"));
+    setExpectedXmlBlockIds(reader.size);
+    setExpectedPutBlockList();
+    STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(HTTPAPIEX_Destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument_ptr();
+
+    ///act
+    BLOB_RESULT result = Blob_UploadFromSasUriWithReaderResumable("https://h.h/something?a=b", testGetData, &reader, 1, &resume, &httpResponse, testValidBufferHandle);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(BLOB_RESULT, BLOB_OK, result);
+    ASSERT_ARE_EQUAL(size_t, reader.size, reader.position);
+    ASSERT_ARE_EQUAL(size_t, 0, uploaded.count);
+}
+
+/*Tests_SRS_BLOB_02_053: [ If "Put Block" fails because HTTPAPIEX_ExecuteRequest fails or because the HTTP status code is 500 or more, then Blob_UploadFromSasUriWithReaderResumable shall upload the block again, up to 4 more times, waiting 1, 2, 4 and 8 seconds before the retries. ]*/
+TEST_FUNCTION(Blob_UploadFromSasUriWithReaderResumable_uploads_again_a_block_that_got_http_code_503)
+{
+    ///arrange
+    TEST_READER reader;
+    TEST_UPLOADED_BLOCKS uploaded;
+    BLOB_UPLOAD_RESUME resume;
+    initTestReader(&reader, 1);
+    initTestResume(&resume, NULL, 0, &uploaded);
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument_size();
+    STRICT_EXPECTED_CALL(HTTPAPIEX_Create("h.h"));
+    setExpectedReaderWorker();
+    setExpectedReaderPutBlock(1, &FiveHundredThree);
+    setExpectedReaderPutBlock(1, &FiveHundredThree);
+    setExpectedReaderPutBlock(1, &TwoHundred);
+    setExpectedReaderWorkerCleanup();
+    STRICT_EXPECTED_CALL(STRING_construct("<?xml version=\"1.0\" encoding=\"utf-8\"?>\r\n<BlockList>"));
+    setExpectedXmlBlockIds(reader.size);
+    setExpectedPutBlockList();
+    STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(HTTPAPIEX_Destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument_ptr();
+
+    ///act
+    BLOB_RESULT result = Blob_UploadFromSasUriWithReaderResumable("https://h.h/something?a=b", testGetData, &reader, 1, &resume, &httpResponse, testValidBufferHandle);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(BLOB_RESULT, BLOB_OK, result);
+    ASSERT_ARE_EQUAL(int, 200, (int)httpResponse);
+    ASSERT_ARE_EQUAL(size_t, 2, sleepCount);
+    ASSERT_ARE_EQUAL(int, 1000, (int)sleepDelays[0]);
+    ASSERT_ARE_EQUAL(int, 2000, (int)sleepDelays[1]);
+    ASSERT_ARE_EQUAL(size_t, 1, uploaded.count);
+    ASSERT_ARE_EQUAL(int, 0, (int)uploaded.blockIDs[0]);
+}
+
+/*Tests_SRS_BLOB_02_053: [ If "Put Block" fails because HTTPAPIEX_ExecuteRequest fails or because the HTTP status code is 500 or more, then Blob_UploadFromSasUriWithReaderResumable shall upload the block again, up to 4 more times, waiting 1, 2, 4 and 8 seconds before the retries. ]*/
+TEST_FUNCTION(Blob_UploadFromSasUriWithReaderResumable_uploads_again_a_block_when_HTTPAPIEX_ExecuteRequest_fails)
+{
+    ///arrange
+    TEST_READER reader;
+    TEST_UPLOADED_BLOCKS uploaded;
+    BLOB_UPLOAD_RESUME resume;
+    initTestReader(&reader, 1);
+    initTestResume(&resume, NULL, 0, &uploaded);
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument_size();
+    STRICT_EXPECTED_CALL(HTTPAPIEX_Create("h.h"));
+    setExpectedReaderWorker();
+    STRICT_EXPECTED_CALL(STRING_construct("/something?a=b"));
+    STRICT_EXPECTED_CALL(STRING_concat(IGNORED_PTR_ARG, "&comp=block&blockid="))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(STRING_concat(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument_handle()
+        .IgnoreArgument_s2();
+    STRICT_EXPECTED_CALL(BUFFER_create(IGNORED_PTR_ARG, 1))
+        .IgnoreArgument_source();
+    STRICT_EXPECTED_CALL(STRING_c_str(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(HTTPAPIEX_ExecuteRequest(IGNORED_PTR_ARG, HTTPAPI_REQUEST_PUT, IGNORED_PTR_ARG, NULL, IGNORED_PTR_ARG, IGNORED_PTR_ARG, NULL, IGNORED_PTR_ARG))
+        .IgnoreArgument_handle()
+        .IgnoreArgument_relativePath()
+        .IgnoreArgument_requestContent()
+        .IgnoreArgument_statusCode()
+        .IgnoreArgument_responseContent()
+        .SetReturn(HTTPAPIEX_ERROR);
+    STRICT_EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+    setExpectedReaderPutBlock(1, &TwoHundred);
+    setExpectedReaderWorkerCleanup();
+    STRICT_EXPECTED_CALL(STRING_construct("<?xml version=\"1.0\" encoding=\"utf-8\"?>\r\n<BlockList>"));
+    setExpectedXmlBlockIds(reader.size);
+    setExpectedPutBlockList();
+    STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(HTTPAPIEX_Destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument_ptr();
+
+    ///act
+    BLOB_RESULT result = Blob_UploadFromSasUriWithReaderResumable("https://h.h/something?a=b", testGetData, &reader, 1, &resume, &httpResponse, testValidBufferHandle);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(BLOB_RESULT, BLOB_OK, result);
+    ASSERT_ARE_EQUAL(size_t, 1, sleepCount);
+    ASSERT_ARE_EQUAL(int, 1000, (int)sleepDelays[0]);
+    ASSERT_ARE_EQUAL(size_t, 1, uploaded.count);
+}
+
+/*Tests_SRS_BLOB_02_053: [ If "Put Block" fails because HTTPAPIEX_ExecuteRequest fails or because the HTTP status code is 500 or more, then Blob_UploadFromSasUriWithReaderResumable shall upload the block again, up to 4 more times, waiting 1, 2, 4 and 8 seconds before the retries. ]*/
+TEST_FUNCTION(Blob_UploadFromSasUriWithReaderResumable_after_4_retries_returns_the_http_code_of_the_block)
+{
+    ///arrange
+    TEST_READER reader;
+    TEST_UPLOADED_BLOCKS uploaded;
+    BLOB_UPLOAD_RESUME resume;
+    initTestReader(&reader, 1);
+    initTestResume(&resume, NULL, 0, &uploaded);
+    httpResponse = 0;
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument_size();
+    STRICT_EXPECTED_CALL(HTTPAPIEX_Create("h.h"));
+    setExpectedReaderWorker();
+    for (size_t attempt = 0; attempt < 5; attempt++)
+    {
+        setExpectedReaderPutBlock(1, &FiveHundredThree);
+    }
+    STRICT_EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(BUFFER_build(testValidBufferHandle, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+        .IgnoreArgument_source()
+        .IgnoreArgument_size();
+    setExpectedReaderWorkerCleanup();
+    /*notice: no Put Block List because a block failed*/
+    STRICT_EXPECTED_CALL(HTTPAPIEX_Destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument_ptr();
+
+    ///act
+    BLOB_RESULT result = Blob_UploadFromSasUriWithReaderResumable("https://h.h/something?a=b", testGetData, &reader, 1, &resume, &httpResponse, testValidBufferHandle);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(BLOB_RESULT, BLOB_OK, result);
+    ASSERT_ARE_EQUAL(int, 503, (int)httpResponse);
+    ASSERT_ARE_EQUAL(size_t, 4, sleepCount);
+    ASSERT_ARE_EQUAL(int, 1000, (int)sleepDelays[0]);
+    ASSERT_ARE_EQUAL(int, 2000, (int)sleepDelays[1]);
+    ASSERT_ARE_EQUAL(int, 4000, (int)sleepDelays[2]);
+    ASSERT_ARE_EQUAL(int, 8000, (int)sleepDelays[3]);
+    ASSERT_ARE_EQUAL(size_t, 0, uploaded.count);
+}
+
+/*Tests_SRS_BLOB_02_053: [ If "Put Block" fails because HTTPAPIEX_ExecuteRequest fails or because the HTTP status code is 500 or more, then Blob_UploadFromSasUriWithReaderResumable shall upload the block again, up to 4 more times, waiting 1, 2, 4 and 8 seconds before the retries. ]*/
+TEST_FUNCTION(Blob_UploadFromSasUriWithReaderResumable_does_not_upload_again_a_block_that_got_http_code_404)
+{
+    ///arrange
+    TEST_READER reader;
+    TEST_UPLOADED_BLOCKS uploaded;
+    BLOB_UPLOAD_RESUME resume;
+    initTestReader(&reader, 1);
+    initTestResume(&resume, NULL, 0, &uploaded);
+    httpResponse = 0;
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument_size();
+    STRICT_EXPECTED_CALL(HTTPAPIEX_Create("h.h"));
+    setExpectedReaderWorker();
+    setExpectedReaderPutBlock(1, &FourHundredFour);
+    STRICT_EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(BUFFER_build(testValidBufferHandle, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+        .IgnoreArgument_source()
+        .IgnoreArgument_size();
+    setExpectedReaderWorkerCleanup();
+    STRICT_EXPECTED_CALL(HTTPAPIEX_Destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument_ptr();
+
+    ///act
+    BLOB_RESULT result = Blob_UploadFromSasUriWithReaderResumable("https://h.h/something?a=b", testGetData, &reader, 1, &resume, &httpResponse, testValidBufferHandle);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(BLOB_RESULT, BLOB_OK, result);
+    ASSERT_ARE_EQUAL(int, 404, (int)httpResponse);
+    ASSERT_ARE_EQUAL(size_t, 0, sleepCount);
+    ASSERT_ARE_EQUAL(size_t, 0, uploaded.count);
+}
+
+/*a byte array of less than 64MB is uploaded by a single "Put Blob" on the HTTPAPIEX_HANDLE already known*/
+static void setExpectedPutBlob(const unsigned char* c, const unsigned int* httpStatus, HTTPAPIEX_RESULT executeRequestResult)
+{
+    STRICT_EXPECTED_CALL(BUFFER_create(c, 1));
+    STRICT_EXPECTED_CALL(HTTPHeaders_Alloc());
+    STRICT_EXPECTED_CALL(HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, X_MS_BLOB_TYPE, BLOCK_BLOB))
+        .IgnoreArgument_httpHeadersHandle();
+    STRICT_EXPECTED_CALL(HTTPAPIEX_ExecuteRequest(IGNORED_PTR_ARG, HTTPAPI_REQUEST_PUT, TEST_RELATIVE_PATH_1, IGNORED_PTR_ARG, IGNORED_PTR_ARG, &httpResponse, NULL, testValidBufferHandle))
+        .IgnoreArgument_handle()
+        .IgnoreArgument_requestHttpHeadersHandle()
+        .IgnoreArgument_requestContent()
+        .CopyOutArgumentBuffer_statusCode(httpStatus, sizeof(*httpStatus))
+        .SetReturn(executeRequestResult);
+    STRICT_EXPECTED_CALL(HTTPHeaders_Free(IGNORED_PTR_ARG))
+        .IgnoreArgument_httpHeadersHandle();
+    STRICT_EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+}
+
+/*Tests_SRS_BLOB_02_061: [ Blob_CreateConnection shall allocate a connection that is not connected to any storage host. ]*/
+/*Tests_SRS_BLOB_02_063: [ If connection is NULL then Blob_DestroyConnection shall do nothing. ]*/
+/*Tests_SRS_BLOB_02_064: [ Blob_DestroyConnection shall destroy the HTTPAPIEX_HANDLE of connection, if any, and free connection. ]*/
+TEST_FUNCTION(Blob_CreateConnection_and_Blob_DestroyConnection_succeed)
+{
+    ///arrange
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument_size();
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument_ptr();
+
+    ///act
+    BLOB_CONNECTION_HANDLE connection = Blob_CreateConnection();
+    Blob_DestroyConnection(connection);
+    Blob_DestroyConnection(NULL);
+
+    ///assert
+    ASSERT_IS_NOT_NULL(connection);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_BLOB_02_062: [ If allocating the connection fails then Blob_CreateConnection shall return NULL. ]*/
+TEST_FUNCTION(Blob_CreateConnection_fails_when_malloc_fails)
+{
+    ///arrange
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument_size()
+        .SetReturn(NULL);
+
+    ///act
+    BLOB_CONNECTION_HANDLE connection = Blob_CreateConnection();
+
+    ///assert
+    ASSERT_IS_NULL(connection);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_BLOB_02_056: [ If connection is NULL, or if resume is not NULL and getData is NULL, then Blob_UploadFromSasUriOnConnection shall fail and return BLOB_INVALID_ARG. ]*/
+TEST_FUNCTION(Blob_UploadFromSasUriOnConnection_with_NULL_connection_fails)
+{
+    ///arrange
+    unsigned char c = '3';
+
+    ///act
+    BLOB_RESULT result = Blob_UploadFromSasUriOnConnection(NULL, TEST_VALID_SASURI_1, &c, sizeof(c), NULL, NULL, 1, NULL, &httpResponse, testValidBufferHandle);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BLOB_RESULT, BLOB_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_BLOB_02_056: [ If connection is NULL, or if resume is not NULL and getData is NULL, then Blob_UploadFromSasUriOnConnection shall fail and return BLOB_INVALID_ARG. ]*/
+TEST_FUNCTION(Blob_UploadFromSasUriOnConnection_with_resume_and_NULL_getData_fails)
+{
+    ///arrange
+    unsigned char c = '3';
+    TEST_UPLOADED_BLOCKS uploaded;
+    BLOB_UPLOAD_RESUME resume;
+    initTestResume(&resume, NULL, 0, &uploaded);
+    BLOB_CONNECTION_HANDLE connection = Blob_CreateConnection();
+    umock_c_reset_all_calls();
+
+    ///act
+    BLOB_RESULT result = Blob_UploadFromSasUriOnConnection(connection, TEST_VALID_SASURI_1, &c, sizeof(c), NULL, NULL, 1, &resume, &httpResponse, testValidBufferHandle);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BLOB_RESULT, BLOB_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    Blob_DestroyConnection(connection);
+}
+
+/*Tests_SRS_BLOB_02_057: [ Otherwise Blob_UploadFromSasUriOnConnection shall check its arguments and upload as Blob_UploadFromSasUriWithConcurrency does when getData is NULL, as Blob_UploadFromSasUriWithReader does when getData is not NULL and resume is NULL and as Blob_UploadFromSasUriWithReaderResumable does otherwise. ]*/
+/*Tests_SRS_BLOB_02_058: [ If connection is connected to the hostname of SASURI then Blob_UploadFromSasUriOnConnection shall use its HTTPAPIEX_HANDLE instead of creating one. ]*/
+/*Tests_SRS_BLOB_02_059: [ Otherwise Blob_UploadFromSasUriOnConnection shall destroy the HTTPAPIEX_HANDLE of connection, if any, create the HTTPAPIEX_HANDLE as Blob_UploadFromSasUri does and keep it in connection. ]*/
+/*Tests_SRS_BLOB_02_064: [ Blob_DestroyConnection shall destroy the HTTPAPIEX_HANDLE of connection, if any, and free connection. ]*/
+TEST_FUNCTION(Blob_UploadFromSasUriOnConnection_reuses_the_connection_to_the_same_host)
+{
+    ///arrange
+    unsigned char c = '3';
+    BLOB_CONNECTION_HANDLE connection = Blob_CreateConnection();
+    umock_c_reset_all_calls();
+
+    /*the first upload connects*/
+    STRICT_EXPECTED_CALL(gballoc_malloc(strlen(TEST_HOSTNAME_1) + 1));
+    STRICT_EXPECTED_CALL(HTTPAPIEX_Create(TEST_HOSTNAME_1));
+    setExpectedPutBlob(&c, &TwoHundred, HTTPAPIEX_OK);
+
+    /*the second upload does not*/
+    STRICT_EXPECTED_CALL(gballoc_malloc(strlen(TEST_HOSTNAME_1) + 1));
+    setExpectedPutBlob(&c, &TwoHundred, HTTPAPIEX_OK);
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument_ptr();
+
+    /*destroying the connection disconnects*/
+    STRICT_EXPECTED_CALL(HTTPAPIEX_Destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument_ptr();
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument_ptr();
+
+    ///act
+    BLOB_RESULT result1 = Blob_UploadFromSasUriOnConnection(connection, TEST_VALID_SASURI_1, &c, sizeof(c), NULL, NULL, 1, NULL, &httpResponse, testValidBufferHandle);
+    BLOB_RESULT result2 = Blob_UploadFromSasUriOnConnection(connection, TEST_VALID_SASURI_1, &c, sizeof(c), NULL, NULL, 1, NULL, &httpResponse, testValidBufferHandle);
+    Blob_DestroyConnection(connection);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BLOB_RESULT, BLOB_OK, result1);
+    ASSERT_ARE_EQUAL(BLOB_RESULT, BLOB_OK, result2);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_BLOB_02_059: [ Otherwise Blob_UploadFromSasUriOnConnection shall destroy the HTTPAPIEX_HANDLE of connection, if any, create the HTTPAPIEX_HANDLE as Blob_UploadFromSasUri does and keep it in connection. ]*/
+TEST_FUNCTION(Blob_UploadFromSasUriOnConnection_connects_again_when_the_host_changes)
+{
+    ///arrange
+    unsigned char c = '3';
+    BLOB_CONNECTION_HANDLE connection = Blob_CreateConnection();
+    (void)Blob_UploadFromSasUriOnConnection(connection, TEST_VALID_SASURI_1, &c, sizeof(c), NULL, NULL, 1, NULL, &httpResponse, testValidBufferHandle);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(strlen(TEST_HOSTNAME_2) + 1));
+    STRICT_EXPECTED_CALL(HTTPAPIEX_Destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument_ptr();
+    STRICT_EXPECTED_CALL(HTTPAPIEX_Create(TEST_HOSTNAME_2));
+    setExpectedPutBlob(&c, &TwoHundred, HTTPAPIEX_OK);
+
+    ///act
+    BLOB_RESULT result = Blob_UploadFromSasUriOnConnection(connection, TEST_VALID_SASURI_2, &c, sizeof(c), NULL, NULL, 1, NULL, &httpResponse, testValidBufferHandle);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BLOB_RESULT, BLOB_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    Blob_DestroyConnection(connection);
+}
+
+/*Tests_SRS_BLOB_02_060: [ If the upload fails then Blob_UploadFromSasUriOnConnection shall destroy the HTTPAPIEX_HANDLE of connection, so that the next upload connects again. ]*/
+TEST_FUNCTION(Blob_UploadFromSasUriOnConnection_disconnects_when_the_upload_fails)
+{
+    ///arrange
+    unsigned char c = '3';
+    BLOB_CONNECTION_HANDLE connection = Blob_CreateConnection();
+    (void)Blob_UploadFromSasUriOnConnection(connection, TEST_VALID_SASURI_1, &c, sizeof(c), NULL, NULL, 1, NULL, &httpResponse, testValidBufferHandle);
+    umock_c_reset_all_calls();
+
+    /*the failed upload disconnects*/
+    STRICT_EXPECTED_CALL(gballoc_malloc(strlen(TEST_HOSTNAME_1) + 1));
+    setExpectedPutBlob(&c, &TwoHundred, HTTPAPIEX_ERROR);
+    STRICT_EXPECTED_CALL(HTTPAPIEX_Destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument_ptr();
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument_ptr();
+
+    /*the next upload connects again*/
+    STRICT_EXPECTED_CALL(gballoc_malloc(strlen(TEST_HOSTNAME_1) + 1));
+    STRICT_EXPECTED_CALL(HTTPAPIEX_Create(TEST_HOSTNAME_1));
+    setExpectedPutBlob(&c, &TwoHundred, HTTPAPIEX_OK);
+
+    ///act
+    BLOB_RESULT result1 = Blob_UploadFromSasUriOnConnection(connection, TEST_VALID_SASURI_1, &c, sizeof(c), NULL, NULL, 1, NULL, &httpResponse, testValidBufferHandle);
+    BLOB_RESULT result2 = Blob_UploadFromSasUriOnConnection(connection, TEST_VALID_SASURI_1, &c, sizeof(c), NULL, NULL, 1, NULL, &httpResponse, testValidBufferHandle);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BLOB_RESULT, BLOB_HTTP_ERROR, result1);
+    ASSERT_ARE_EQUAL(BLOB_RESULT, BLOB_OK, result2);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    Blob_DestroyConnection(connection);
+}
+
 END_TEST_SUITE(blob_unittests);
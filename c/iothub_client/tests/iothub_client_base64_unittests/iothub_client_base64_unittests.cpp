@@ -0,0 +1,141 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <cstdlib>
+#include <cstring>
+#ifdef _CRTDBG_MAP_ALLOC
+#include <crtdbg.h>
+#endif
+
+#include "testrunnerswitcher.h"
+#include "iothub_client_base64.h"
+
+/*the test vectors of RFC 4648, section 10*/
+static const struct
+{
+    const char* source;
+    const char* encoding;
+} rfc4648Vectors[] =
+{
+    { "", "" },
+    { "f", "Zg==" },
+    { "fo", "Zm8=" },
+    { "foo", "Zm9v" },
+    { "foob", "Zm9vYg==" },
+    { "fooba", "Zm9vYmE=" },
+    { "foobar", "Zm9vYmFy" }
+};
+
+BEGIN_TEST_SUITE(iothub_client_base64_unittests)
+
+    /*Tests_SRS_IOTHUB_CLIENT_BASE64_02_001: [ IoTHubClient_Base64_GetEncodedLength shall return the number of characters of the Base64 encoding of size bytes, padding included. ]*/
+    TEST_FUNCTION(IoTHubClient_Base64_GetEncodedLength_returns_the_padded_length)
+    {
+        ASSERT_ARE_EQUAL(size_t, 0, IoTHubClient_Base64_GetEncodedLength(0));
+        ASSERT_ARE_EQUAL(size_t, 4, IoTHubClient_Base64_GetEncodedLength(1));
+        ASSERT_ARE_EQUAL(size_t, 4, IoTHubClient_Base64_GetEncodedLength(2));
+        ASSERT_ARE_EQUAL(size_t, 4, IoTHubClient_Base64_GetEncodedLength(3));
+        ASSERT_ARE_EQUAL(size_t, 8, IoTHubClient_Base64_GetEncodedLength(4));
+        ASSERT_ARE_EQUAL(size_t, 340, IoTHubClient_Base64_GetEncodedLength(255));
+        ASSERT_ARE_EQUAL(size_t, 344, IoTHubClient_Base64_GetEncodedLength(256));
+    }
+
+    /*Tests_SRS_IOTHUB_CLIENT_BASE64_02_002: [ If destination is NULL then IoTHubClient_Base64_Encode shall fail and return NULL. ]*/
+    TEST_FUNCTION(IoTHubClient_Base64_Encode_with_NULL_destination_fails)
+    {
+        ///arrange
+        unsigned char source[] = { 'a' };
+
+        ///act
+        char* result = IoTHubClient_Base64_Encode(NULL, source, sizeof(source));
+
+        ///assert
+        ASSERT_IS_NULL(result);
+    }
+
+    /*Tests_SRS_IOTHUB_CLIENT_BASE64_02_003: [ If source is NULL and size is not zero then IoTHubClient_Base64_Encode shall fail and return NULL. ]*/
+    TEST_FUNCTION(IoTHubClient_Base64_Encode_with_NULL_source_fails)
+    {
+        ///arrange
+        char destination[8];
+
+        ///act
+        char* result = IoTHubClient_Base64_Encode(destination, NULL, 1);
+
+        ///assert
+        ASSERT_IS_NULL(result);
+    }
+
+    /*Tests_SRS_IOTHUB_CLIENT_BASE64_02_003: [ If source is NULL and size is not zero then IoTHubClient_Base64_Encode shall fail and return NULL. ]*/
+    TEST_FUNCTION(IoTHubClient_Base64_Encode_with_NULL_source_and_zero_size_writes_nothing)
+    {
+        ///arrange
+        char destination[8];
+
+        ///act
+        char* result = IoTHubClient_Base64_Encode(destination, NULL, 0);
+
+        ///assert
+        ASSERT_ARE_EQUAL(void_ptr, destination, result);
+    }
+
+    /*Tests_SRS_IOTHUB_CLIENT_BASE64_02_004: [ IoTHubClient_Base64_Encode shall write at destination the Base64 encoding of the size bytes at source, padded with '=' to a multiple of 4 characters. ]*/
+    /*Tests_SRS_IOTHUB_CLIENT_BASE64_02_005: [ IoTHubClient_Base64_Encode shall not '\0' terminate the encoding and shall return a pointer to the character that follows the last written one. ]*/
+    TEST_FUNCTION(IoTHubClient_Base64_Encode_produces_the_RFC4648_test_vectors)
+    {
+        for (size_t i = 0; i < sizeof(rfc4648Vectors) / sizeof(rfc4648Vectors[0]); i++)
+        {
+            ///arrange
+            char destination[16];
+            size_t sourceLength = strlen(rfc4648Vectors[i].source);
+            (void)memset(destination, 'X', sizeof(destination));
+
+            ///act
+            char* result = IoTHubClient_Base64_Encode(destination, (const unsigned char*)rfc4648Vectors[i].source, sourceLength);
+
+            ///assert
+            ASSERT_ARE_EQUAL(size_t, strlen(rfc4648Vectors[i].encoding), (size_t)(result - destination));
+            ASSERT_ARE_EQUAL(int, 0, memcmp(rfc4648Vectors[i].encoding, destination, strlen(rfc4648Vectors[i].encoding)));
+            ASSERT_ARE_EQUAL(int, (int)'X', (int)*result); /*nothing is written after the encoding*/
+        }
+    }
+
+    /*Tests_SRS_IOTHUB_CLIENT_BASE64_02_004: [ IoTHubClient_Base64_Encode shall write at destination the Base64 encoding of the size bytes at source, padded with '=' to a multiple of 4 characters. ]*/
+    TEST_FUNCTION(IoTHubClient_Base64_Encode_uses_every_character_of_the_alphabet)
+    {
+        ///arrange
+        /*these 48 bytes are the 64 6 bit values 0, 1, 2 ... 63*/
+        unsigned char source[48];
+        char destination[64];
+        for (size_t i = 0; i < 16; i++)
+        {
+            unsigned int group = ((4 * i) << 18) | ((4 * i + 1) << 12) | ((4 * i + 2) << 6) | (4 * i + 3);
+            source[3 * i] = (unsigned char)(group >> 16);
+            source[3 * i + 1] = (unsigned char)(group >> 8);
+            source[3 * i + 2] = (unsigned char)group;
+        }
+
+        ///act
+        char* result = IoTHubClient_Base64_Encode(destination, source, sizeof(source));
+
+        ///assert
+        ASSERT_ARE_EQUAL(size_t, sizeof(destination), (size_t)(result - destination));
+        ASSERT_ARE_EQUAL(int, 0, memcmp("ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/", destination, sizeof(destination)));
+    }
+
+    /*Tests_SRS_IOTHUB_CLIENT_BASE64_02_004: [ IoTHubClient_Base64_Encode shall write at destination the Base64 encoding of the size bytes at source, padded with '=' to a multiple of 4 characters. ]*/
+    TEST_FUNCTION(IoTHubClient_Base64_Encode_encodes_the_high_bits_of_the_last_bytes)
+    {
+        ///arrange
+        unsigned char source[] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+        char destination[8];
+
+        ///act
+        char* result = IoTHubClient_Base64_Encode(destination, source, sizeof(source));
+
+        ///assert
+        ASSERT_ARE_EQUAL(size_t, 8, (size_t)(result - destination));
+        ASSERT_ARE_EQUAL(int, 0, memcmp("//////8=", destination, 8));
+    }
+
+END_TEST_SUITE(iothub_client_base64_unittests)
@@ -0,0 +1,228 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <cstdlib>
+#include <cstring>
+#ifdef _CRTDBG_MAP_ALLOC
+#include <crtdbg.h>
+#endif
+
+#include "testrunnerswitcher.h"
+#include "iothub_client_lz4.h"
+
+#define TEST_JSON_RECORD "{\"deviceId\":\"myFirstDevice\",\"windSpeed\":10.5,\"temperature\":23.25}"
+
+static size_t readLength(const unsigned char** source, size_t length)
+{
+    if (length == 15)
+    {
+        unsigned char more;
+        do
+        {
+            more = *(*source)++;
+            length += more;
+        } while (more == 255);
+    }
+    return length;
+}
+
+/*decodes one LZ4 block, returns the number of decoded bytes or (size_t)-1 if the block is malformed*/
+static size_t decodeBlock(unsigned char* destination, size_t destinationSize, const unsigned char* source, size_t size)
+{
+    const unsigned char* end = source + size;
+    unsigned char* output = destination;
+    while (source < end)
+    {
+        unsigned char token = *source++;
+        size_t literalLength = readLength(&source, token >> 4);
+        if ((literalLength > (size_t)(end - source)) || (literalLength > destinationSize - (size_t)(output - destination)))
+        {
+            return (size_t)-1;
+        }
+        (void)memcpy(output, source, literalLength);
+        output += literalLength;
+        source += literalLength;
+        if (source < end)
+        {
+            size_t offset = source[0] | (source[1] << 8);
+            source += 2;
+            size_t matchLength = readLength(&source, token & 0x0F) + 4;
+            if ((offset == 0) || (offset > (size_t)(output - destination)) || (matchLength > destinationSize - (size_t)(output - destination)))
+            {
+                return (size_t)-1;
+            }
+            /*matches can overlap their own output, they are copied byte by byte*/
+            for (size_t i = 0; i < matchLength; i++, output++)
+            {
+                *output = *(output - offset);
+            }
+        }
+    }
+    return (size_t)(output - destination);
+}
+
+static void assertRoundTrip(const unsigned char* source, size_t size)
+{
+    size_t destinationSize = IoTHubClient_LZ4_GetMaxCompressedLength(size);
+    unsigned char* compressed = (unsigned char*)malloc(destinationSize);
+    unsigned char* decoded = (unsigned char*)malloc(size + 1);
+
+    size_t compressedSize = IoTHubClient_LZ4_Compress(compressed, destinationSize, source, size);
+
+    ASSERT_ARE_NOT_EQUAL(size_t, 0, compressedSize);
+    ASSERT_IS_TRUE(compressedSize <= destinationSize);
+    ASSERT_ARE_EQUAL(size_t, size, decodeBlock(decoded, size, compressed, compressedSize));
+    ASSERT_ARE_EQUAL(int, 0, memcmp(source, decoded, size));
+
+    free(decoded);
+    free(compressed);
+}
+
+BEGIN_TEST_SUITE(iothub_client_lz4_unittests)
+
+    /*Tests_SRS_IOTHUB_CLIENT_LZ4_02_001: [ IoTHubClient_LZ4_GetMaxCompressedLength shall return size + size / 255 + 16, the length of the LZ4 block of size bytes that do not compress at all. ]*/
+    TEST_FUNCTION(IoTHubClient_LZ4_GetMaxCompressedLength_returns_the_worst_case_length)
+    {
+        ASSERT_ARE_EQUAL(size_t, 16, IoTHubClient_LZ4_GetMaxCompressedLength(0));
+        ASSERT_ARE_EQUAL(size_t, 17, IoTHubClient_LZ4_GetMaxCompressedLength(1));
+        ASSERT_ARE_EQUAL(size_t, 270, IoTHubClient_LZ4_GetMaxCompressedLength(254));
+        ASSERT_ARE_EQUAL(size_t, 272, IoTHubClient_LZ4_GetMaxCompressedLength(255));
+        ASSERT_ARE_EQUAL(size_t, 4128, IoTHubClient_LZ4_GetMaxCompressedLength(4096));
+    }
+
+    /*Tests_SRS_IOTHUB_CLIENT_LZ4_02_002: [ If destination is NULL then IoTHubClient_LZ4_Compress shall fail and return 0. ]*/
+    TEST_FUNCTION(IoTHubClient_LZ4_Compress_with_NULL_destination_fails)
+    {
+        ///arrange
+        unsigned char source[] = { 'a' };
+
+        ///act
+        size_t result = IoTHubClient_LZ4_Compress(NULL, 64, source, sizeof(source));
+
+        ///assert
+        ASSERT_ARE_EQUAL(size_t, 0, result);
+    }
+
+    /*Tests_SRS_IOTHUB_CLIENT_LZ4_02_003: [ If source is NULL and size is not zero then IoTHubClient_LZ4_Compress shall fail and return 0. ]*/
+    TEST_FUNCTION(IoTHubClient_LZ4_Compress_with_NULL_source_fails)
+    {
+        ///arrange
+        unsigned char destination[64];
+
+        ///act
+        size_t result = IoTHubClient_LZ4_Compress(destination, sizeof(destination), NULL, 1);
+
+        ///assert
+        ASSERT_ARE_EQUAL(size_t, 0, result);
+    }
+
+    /*Tests_SRS_IOTHUB_CLIENT_LZ4_02_004: [ If destinationSize is smaller than IoTHubClient_LZ4_GetMaxCompressedLength(size) then IoTHubClient_LZ4_Compress shall fail and return 0. ]*/
+    TEST_FUNCTION(IoTHubClient_LZ4_Compress_with_a_too_small_destination_fails)
+    {
+        ///arrange
+        unsigned char source[32];
+        unsigned char destination[64];
+        (void)memset(source, 'a', sizeof(source));
+
+        ///act
+        size_t result = IoTHubClient_LZ4_Compress(destination, IoTHubClient_LZ4_GetMaxCompressedLength(sizeof(source)) - 1, source, sizeof(source));
+
+        ///assert
+        ASSERT_ARE_EQUAL(size_t, 0, result);
+    }
+
+    /*Tests_SRS_IOTHUB_CLIENT_LZ4_02_005: [ IoTHubClient_LZ4_Compress shall write at destination the size bytes at source as one LZ4 block. ]*/
+    /*Tests_SRS_IOTHUB_CLIENT_LZ4_02_006: [ IoTHubClient_LZ4_Compress shall return the number of bytes written at destination. ]*/
+    TEST_FUNCTION(IoTHubClient_LZ4_Compress_with_an_empty_source_writes_an_empty_block)
+    {
+        ///arrange
+        unsigned char destination[16];
+
+        ///act
+        size_t result = IoTHubClient_LZ4_Compress(destination, sizeof(destination), NULL, 0);
+
+        ///assert
+        ASSERT_ARE_EQUAL(size_t, 1, result);
+        ASSERT_ARE_EQUAL(int, 0, (int)destination[0]);
+    }
+
+    /*Tests_SRS_IOTHUB_CLIENT_LZ4_02_005: [ IoTHubClient_LZ4_Compress shall write at destination the size bytes at source as one LZ4 block. ]*/
+    TEST_FUNCTION(IoTHubClient_LZ4_Compress_writes_a_short_source_as_literals)
+    {
+        ///arrange
+        const unsigned char source[] = { 'a', 'a', 'a', 'a', 'a', 'a', 'a', 'a', 'a', 'a', 'a', 'a' };
+        unsigned char destination[32];
+
+        ///act
+        size_t result = IoTHubClient_LZ4_Compress(destination, sizeof(destination), source, sizeof(source));
+
+        ///assert
+        /*12 bytes are too short for a match*/
+        ASSERT_ARE_EQUAL(size_t, 1 + sizeof(source), result);
+        ASSERT_ARE_EQUAL(int, 12 << 4, (int)destination[0]);
+        ASSERT_ARE_EQUAL(int, 0, memcmp(source, destination + 1, sizeof(source)));
+    }
+
+    /*Tests_SRS_IOTHUB_CLIENT_LZ4_02_005: [ IoTHubClient_LZ4_Compress shall write at destination the size bytes at source as one LZ4 block. ]*/
+    TEST_FUNCTION(IoTHubClient_LZ4_Compress_makes_repeated_telemetry_smaller)
+    {
+        ///arrange
+        size_t recordLength = sizeof(TEST_JSON_RECORD) - 1;
+        size_t size = 32 * recordLength;
+        unsigned char* source = (unsigned char*)malloc(size);
+        unsigned char* destination = (unsigned char*)malloc(IoTHubClient_LZ4_GetMaxCompressedLength(size));
+        for (size_t i = 0; i < 32; i++)
+        {
+            (void)memcpy(source + i * recordLength, TEST_JSON_RECORD, recordLength);
+        }
+
+        ///act
+        size_t result = IoTHubClient_LZ4_Compress(destination, IoTHubClient_LZ4_GetMaxCompressedLength(size), source, size);
+
+        ///assert
+        ASSERT_ARE_NOT_EQUAL(size_t, 0, result);
+        ASSERT_IS_TRUE(result < size / 4);
+        assertRoundTrip(source, size);
+
+        ///cleanup
+        free(destination);
+        free(source);
+    }
+
+    /*Tests_SRS_IOTHUB_CLIENT_LZ4_02_005: [ IoTHubClient_LZ4_Compress shall write at destination the size bytes at source as one LZ4 block. ]*/
+    TEST_FUNCTION(IoTHubClient_LZ4_Compress_round_trips_sources_of_all_sizes)
+    {
+        ///arrange
+        unsigned char source[1024];
+        unsigned int state = 42;
+        for (size_t i = 0; i < sizeof(source); i++)
+        {
+            /*runs of a few symbols mixed with noise, so that there are matches, long literals and long matches*/
+            state = state * 1103515245 + 12345;
+            source[i] = (i % 300 < 100) ? 'x' : (i % 300 < 200) ? (unsigned char)(state >> 16) : (unsigned char)("abcd"[(state >> 16) % 4]);
+        }
+
+        ///act + assert
+        for (size_t size = 0; size <= sizeof(source); size++)
+        {
+            assertRoundTrip(source, size);
+        }
+    }
+
+    /*Tests_SRS_IOTHUB_CLIENT_LZ4_02_005: [ IoTHubClient_LZ4_Compress shall write at destination the size bytes at source as one LZ4 block. ]*/
+    TEST_FUNCTION(IoTHubClient_LZ4_Compress_round_trips_a_source_that_does_not_compress)
+    {
+        ///arrange
+        unsigned char source[600];
+        unsigned int state = 7;
+        for (size_t i = 0; i < sizeof(source); i++)
+        {
+            state = state * 1103515245 + 12345;
+            source[i] = (unsigned char)(state >> 16);
+        }
+
+        ///act + assert
+        assertRoundTrip(source, sizeof(source));
+    }
+
+END_TEST_SUITE(iothub_client_lz4_unittests)
@@ -0,0 +1,627 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#ifdef _CRTDBG_MAP_ALLOC
+#include <crtdbg.h>
+#endif
+
+#include "testrunnerswitcher.h"
+#include "micromock.h"
+#include "micromockcharstararenullterminatedstrings.h"
+#include "iothub_client_ll_messagestore.h"
+#include "iothub_message.h"
+#include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/map.h"
+
+static MICROMOCK_MUTEX_HANDLE g_testByTest;
+
+#define GBALLOC_H
+
+extern "C" int gballoc_init(void);
+extern "C" void gballoc_deinit(void);
+extern "C" void* gballoc_malloc(size_t size);
+extern "C" void* gballoc_calloc(size_t nmemb, size_t size);
+extern "C" void* gballoc_realloc(void* ptr, size_t size);
+extern "C" void gballoc_free(void* ptr);
+
+namespace BASEIMPLEMENTATION
+{
+    /*if malloc is defined as gballoc_malloc at this moment, there'd be serious trouble*/
+#define Lock(x) (LOCK_OK + gballocState - gballocState) /*compiler warning about constant in if condition*/
+#define Unlock(x) (LOCK_OK + gballocState - gballocState)
+#define Lock_Init() (LOCK_HANDLE)0x42
+#define Lock_Deinit(x) (LOCK_OK + gballocState - gballocState)
+#include "gballoc.c"
+#undef Lock
+#undef Unlock
+#undef Lock_Init
+#undef Lock_Deinit
+};
+
+#define TEST_MAX_PROPERTIES 4
+#define TEST_MAX_STRING 64
+
+/*the messages handled by the store are TEST_MESSAGEs, the message ids and properties are kept inside them*/
+typedef struct MAP_TAG
+{
+    size_t count;
+    char keyStorage[TEST_MAX_PROPERTIES][TEST_MAX_STRING];
+    char valueStorage[TEST_MAX_PROPERTIES][TEST_MAX_STRING];
+    const char* keys[TEST_MAX_PROPERTIES];
+    const char* values[TEST_MAX_PROPERTIES];
+}TEST_MAP;
+
+typedef struct TEST_MESSAGE_TAG
+{
+    IOTHUBMESSAGE_CONTENT_TYPE contentType;
+    unsigned char body[TEST_MAX_STRING];
+    size_t bodySize;
+    char messageId[TEST_MAX_STRING];
+    char correlationId[TEST_MAX_STRING];
+    TEST_MAP properties;
+}TEST_MESSAGE;
+
+static const char* TEST_STORE_PATH = "iothubclient_ll_messagestore_unittests.log";
+static const char* TEST_STORE_TEMPORARY_PATH = "iothubclient_ll_messagestore_unittests.log.tmp";
+static const unsigned char TEST_BODY[] = { 0x00, 0x01, 0xFE, 0xFF, 'a' };
+static const char* TEST_STRING_BODY = "{\"temperature\":42}";
+static const char* TEST_MESSAGE_ID = "3820ADAE-E3CA-4065-843A-A6BDE950D8DC";
+static const char* TEST_CORRELATION_ID = "052BA01A-ECBF-48CF-BC7B-64B315D898B7";
+
+#define TEST_MAX_REPLAYED 8
+static size_t replayedCount;
+static TEST_MESSAGE* replayedMessages[TEST_MAX_REPLAYED];
+static uint64_t replayedRecordIds[TEST_MAX_REPLAYED];
+
+static TEST_MESSAGE* createTestMessage(IOTHUBMESSAGE_CONTENT_TYPE contentType, const unsigned char* body, size_t bodySize)
+{
+    TEST_MESSAGE* result = (TEST_MESSAGE*)BASEIMPLEMENTATION::gballoc_malloc(sizeof(TEST_MESSAGE));
+    (void)memset(result, 0, sizeof(TEST_MESSAGE));
+    result->contentType = contentType;
+    (void)memcpy(result->body, body, bodySize);
+    result->bodySize = bodySize;
+    return result;
+}
+
+static void addTestProperty(TEST_MAP* map, const char* key, const char* value)
+{
+    (void)strcpy(map->keyStorage[map->count], key);
+    (void)strcpy(map->valueStorage[map->count], value);
+    map->keys[map->count] = map->keyStorage[map->count];
+    map->values[map->count] = map->valueStorage[map->count];
+    map->count++;
+}
+
+static long getFileSize(const char* path)
+{
+    long result;
+    FILE* file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        result = -1;
+    }
+    else
+    {
+        (void)fseek(file, 0, SEEK_END);
+        result = ftell(file);
+        (void)fclose(file);
+    }
+    return result;
+}
+
+static void appendToFile(const char* path, const void* content, size_t size)
+{
+    FILE* file = fopen(path, "ab");
+    ASSERT_IS_NOT_NULL(file);
+    ASSERT_ARE_EQUAL(size_t, size, fwrite(content, 1, size, file));
+    (void)fclose(file);
+}
+
+static void onReplay(IOTHUB_MESSAGE_HANDLE messageHandle, uint64_t recordId, void* context)
+{
+    (void)context;
+    replayedMessages[replayedCount] = (TEST_MESSAGE*)messageHandle;
+    replayedRecordIds[replayedCount] = recordId;
+    replayedCount++;
+}
+
+static void destroyReplayedMessages(void)
+{
+    size_t i;
+    for (i = 0; i < replayedCount; i++)
+    {
+        BASEIMPLEMENTATION::gballoc_free(replayedMessages[i]);
+    }
+    replayedCount = 0;
+}
+
+/*opens the store, replays it and closes it*/
+static void reopenAndReplay(void)
+{
+    IOTHUB_CLIENT_LL_MESSAGESTORE_HANDLE handle = IoTHubClient_LL_MessageStore_Create(TEST_STORE_PATH);
+    ASSERT_IS_NOT_NULL(handle);
+    ASSERT_ARE_EQUAL(int, 0, IoTHubClient_LL_MessageStore_Replay(handle, onReplay, NULL));
+    IoTHubClient_LL_MessageStore_Destroy(handle);
+}
+
+TYPED_MOCK_CLASS(CIoTHubClientLLMessageStoreMocks, CGlobalMock)
+{
+public:
+
+    MOCK_STATIC_METHOD_1(, void*, gballoc_malloc, size_t, size)
+    MOCK_METHOD_END(void*, BASEIMPLEMENTATION::gballoc_malloc(size));
+
+    MOCK_STATIC_METHOD_2(, void*, gballoc_realloc, void*, ptr, size_t, size)
+    MOCK_METHOD_END(void*, BASEIMPLEMENTATION::gballoc_realloc(ptr, size));
+
+    MOCK_STATIC_METHOD_1(, void, gballoc_free, void*, ptr)
+        BASEIMPLEMENTATION::gballoc_free(ptr);
+    MOCK_VOID_METHOD_END()
+
+    MOCK_STATIC_METHOD_2(, IOTHUB_MESSAGE_HANDLE, IoTHubMessage_CreateFromByteArray, const unsigned char*, byteArray, size_t, size)
+    MOCK_METHOD_END(IOTHUB_MESSAGE_HANDLE, (IOTHUB_MESSAGE_HANDLE)createTestMessage(IOTHUBMESSAGE_BYTEARRAY, byteArray, size));
+
+    MOCK_STATIC_METHOD_1(, IOTHUB_MESSAGE_HANDLE, IoTHubMessage_CreateFromString, const char*, source)
+    MOCK_METHOD_END(IOTHUB_MESSAGE_HANDLE, (IOTHUB_MESSAGE_HANDLE)createTestMessage(IOTHUBMESSAGE_STRING, (const unsigned char*)source, strlen(source) + 1));
+
+    MOCK_STATIC_METHOD_3(, IOTHUB_MESSAGE_RESULT, IoTHubMessage_GetByteArray, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle, const unsigned char**, buffer, size_t*, size)
+        *buffer = ((TEST_MESSAGE*)iotHubMessageHandle)->body;
+        *size = ((TEST_MESSAGE*)iotHubMessageHandle)->bodySize;
+    MOCK_METHOD_END(IOTHUB_MESSAGE_RESULT, IOTHUB_MESSAGE_OK);
+
+    MOCK_STATIC_METHOD_1(, const char*, IoTHubMessage_GetString, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle)
+    MOCK_METHOD_END(const char*, (const char*)((TEST_MESSAGE*)iotHubMessageHandle)->body);
+
+    MOCK_STATIC_METHOD_1(, IOTHUBMESSAGE_CONTENT_TYPE, IoTHubMessage_GetContentType, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle)
+    MOCK_METHOD_END(IOTHUBMESSAGE_CONTENT_TYPE, ((TEST_MESSAGE*)iotHubMessageHandle)->contentType);
+
+    MOCK_STATIC_METHOD_1(, MAP_HANDLE, IoTHubMessage_Properties, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle)
+    MOCK_METHOD_END(MAP_HANDLE, &(((TEST_MESSAGE*)iotHubMessageHandle)->properties));
+
+    MOCK_STATIC_METHOD_2(, IOTHUB_MESSAGE_RESULT, IoTHubMessage_SetMessageId, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle, const char*, messageId)
+        (void)strcpy(((TEST_MESSAGE*)iotHubMessageHandle)->messageId, messageId);
+    MOCK_METHOD_END(IOTHUB_MESSAGE_RESULT, IOTHUB_MESSAGE_OK);
+
+    MOCK_STATIC_METHOD_1(, const char*, IoTHubMessage_GetMessageId, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle)
+        const char* messageId = ((TEST_MESSAGE*)iotHubMessageHandle)->messageId;
+    MOCK_METHOD_END(const char*, (messageId[0] == '\0') ? NULL : messageId);
+
+    MOCK_STATIC_METHOD_2(, IOTHUB_MESSAGE_RESULT, IoTHubMessage_SetCorrelationId, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle, const char*, correlationId)
+        (void)strcpy(((TEST_MESSAGE*)iotHubMessageHandle)->correlationId, correlationId);
+    MOCK_METHOD_END(IOTHUB_MESSAGE_RESULT, IOTHUB_MESSAGE_OK);
+
+    MOCK_STATIC_METHOD_1(, const char*, IoTHubMessage_GetCorrelationId, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle)
+        const char* correlationId = ((TEST_MESSAGE*)iotHubMessageHandle)->correlationId;
+    MOCK_METHOD_END(const char*, (correlationId[0] == '\0') ? NULL : correlationId);
+
+    MOCK_STATIC_METHOD_1(, void, IoTHubMessage_Destroy, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle)
+        BASEIMPLEMENTATION::gballoc_free(iotHubMessageHandle);
+    MOCK_VOID_METHOD_END()
+
+    MOCK_STATIC_METHOD_4(, MAP_RESULT, Map_GetInternals, MAP_HANDLE, handle, const char*const**, keys, const char*const**, values, size_t*, count)
+        *keys = handle->keys;
+        *values = handle->values;
+        *count = handle->count;
+    MOCK_METHOD_END(MAP_RESULT, MAP_OK);
+
+    MOCK_STATIC_METHOD_3(, MAP_RESULT, Map_AddOrUpdate, MAP_HANDLE, handle, const char*, key, const char*, value)
+        addTestProperty(handle, key, value);
+    MOCK_METHOD_END(MAP_RESULT, MAP_OK);
+};
+
+DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubClientLLMessageStoreMocks, , void*, gballoc_malloc, size_t, size);
+DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubClientLLMessageStoreMocks, , void*, gballoc_realloc, void*, ptr, size_t, size);
+DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubClientLLMessageStoreMocks, , void, gballoc_free, void*, ptr);
+
+DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubClientLLMessageStoreMocks, , IOTHUB_MESSAGE_HANDLE, IoTHubMessage_CreateFromByteArray, const unsigned char*, byteArray, size_t, size);
+DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubClientLLMessageStoreMocks, , IOTHUB_MESSAGE_HANDLE, IoTHubMessage_CreateFromString, const char*, source);
+DECLARE_GLOBAL_MOCK_METHOD_3(CIoTHubClientLLMessageStoreMocks, , IOTHUB_MESSAGE_RESULT, IoTHubMessage_GetByteArray, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle, const unsigned char**, buffer, size_t*, size);
+DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubClientLLMessageStoreMocks, , const char*, IoTHubMessage_GetString, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle);
+DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubClientLLMessageStoreMocks, , IOTHUBMESSAGE_CONTENT_TYPE, IoTHubMessage_GetContentType, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle);
+DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubClientLLMessageStoreMocks, , MAP_HANDLE, IoTHubMessage_Properties, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle);
+DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubClientLLMessageStoreMocks, , IOTHUB_MESSAGE_RESULT, IoTHubMessage_SetMessageId, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle, const char*, messageId);
+DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubClientLLMessageStoreMocks, , const char*, IoTHubMessage_GetMessageId, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle);
+DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubClientLLMessageStoreMocks, , IOTHUB_MESSAGE_RESULT, IoTHubMessage_SetCorrelationId, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle, const char*, correlationId);
+DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubClientLLMessageStoreMocks, , const char*, IoTHubMessage_GetCorrelationId, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle);
+DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubClientLLMessageStoreMocks, , void, IoTHubMessage_Destroy, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle);
+
+DECLARE_GLOBAL_MOCK_METHOD_4(CIoTHubClientLLMessageStoreMocks, , MAP_RESULT, Map_GetInternals, MAP_HANDLE, handle, const char*const**, keys, const char*const**, values, size_t*, count);
+DECLARE_GLOBAL_MOCK_METHOD_3(CIoTHubClientLLMessageStoreMocks, , MAP_RESULT, Map_AddOrUpdate, MAP_HANDLE, handle, const char*, key, const char*, value);
+
+static MICROMOCK_GLOBAL_SEMAPHORE_HANDLE g_dllByDll;
+
+BEGIN_TEST_SUITE(iothubclient_ll_messagestore_unittests)
+
+    TEST_SUITE_INITIALIZE(TestClassInitialize)
+    {
+        TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
+        g_testByTest = MicroMockCreateMutex();
+        ASSERT_IS_NOT_NULL(g_testByTest);
+    }
+
+    TEST_SUITE_CLEANUP(TestClassCleanup)
+    {
+        MicroMockDestroyMutex(g_testByTest);
+        TEST_DEINITIALIZE_MEMORY_DEBUG(g_dllByDll);
+    }
+
+    TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
+    {
+        if (!MicroMockAcquireMutex(g_testByTest))
+        {
+            ASSERT_FAIL("our mutex is ABANDONED. Failure in test framework");
+        }
+
+        (void)remove(TEST_STORE_PATH);
+        (void)remove(TEST_STORE_TEMPORARY_PATH);
+        replayedCount = 0;
+    }
+
+    TEST_FUNCTION_CLEANUP(TestMethodCleanup)
+    {
+        destroyReplayedMessages();
+        (void)remove(TEST_STORE_PATH);
+        (void)remove(TEST_STORE_TEMPORARY_PATH);
+
+        if (!MicroMockReleaseMutex(g_testByTest))
+        {
+            ASSERT_FAIL("failure in test framework at ReleaseMutex");
+        }
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_LL_MESSAGESTORE_02_001: [ If path is NULL then IoTHubClient_LL_MessageStore_Create shall fail and return NULL. ]*/
+    TEST_FUNCTION(IoTHubClient_LL_MessageStore_Create_with_NULL_path_fails)
+    {
+        ///arrange
+        CIoTHubClientLLMessageStoreMocks mocks;
+
+        ///act
+        IOTHUB_CLIENT_LL_MESSAGESTORE_HANDLE handle = IoTHubClient_LL_MessageStore_Create(NULL);
+
+        ///assert
+        ASSERT_IS_NULL(handle);
+        mocks.AssertActualAndExpectedCalls();
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_LL_MESSAGESTORE_02_004: [ IoTHubClient_LL_MessageStore_Create shall open the log at path for appending. ]*/
+    TEST_FUNCTION(IoTHubClient_LL_MessageStore_Create_without_a_log_creates_an_empty_log)
+    {
+        ///arrange
+        CNiceCallComparer<CIoTHubClientLLMessageStoreMocks> mocks;
+
+        ///act
+        IOTHUB_CLIENT_LL_MESSAGESTORE_HANDLE handle = IoTHubClient_LL_MessageStore_Create(TEST_STORE_PATH);
+
+        ///assert
+        ASSERT_IS_NOT_NULL(handle);
+        ASSERT_ARE_EQUAL(int, (int)0, (int)getFileSize(TEST_STORE_PATH));
+        ASSERT_ARE_EQUAL(int, (int)-1, (int)getFileSize(TEST_STORE_TEMPORARY_PATH));
+
+        ///cleanup
+        IoTHubClient_LL_MessageStore_Destroy(handle);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_LL_MESSAGESTORE_02_009: [ If handle, messageHandle or recordId is NULL then IoTHubClient_LL_MessageStore_Append shall fail and return a non-zero value. ]*/
+    TEST_FUNCTION(IoTHubClient_LL_MessageStore_Append_with_NULL_messageHandle_fails)
+    {
+        ///arrange
+        CIoTHubClientLLMessageStoreMocks mocks;
+        uint64_t recordId;
+        IOTHUB_CLIENT_LL_MESSAGESTORE_HANDLE handle = IoTHubClient_LL_MessageStore_Create(TEST_STORE_PATH);
+        mocks.ResetAllCalls();
+
+        ///act
+        int result = IoTHubClient_LL_MessageStore_Append(handle, NULL, &recordId);
+
+        ///assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_LL_MessageStore_Destroy(handle);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_LL_MESSAGESTORE_02_010: [ IoTHubClient_LL_MessageStore_Append shall append to the log a record with the payload, the content type, the messageId, the correlationId and the properties of messageHandle, shall set *recordId to a new record id and return 0. ]*/
+    TEST_FUNCTION(IoTHubClient_LL_MessageStore_Append_happy_path)
+    {
+        ///arrange
+        CIoTHubClientLLMessageStoreMocks mocks;
+        uint64_t recordId = 0;
+        TEST_MESSAGE* message = createTestMessage(IOTHUBMESSAGE_BYTEARRAY, TEST_BODY, sizeof(TEST_BODY));
+        IOTHUB_CLIENT_LL_MESSAGESTORE_HANDLE handle = IoTHubClient_LL_MessageStore_Create(TEST_STORE_PATH);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType((IOTHUB_MESSAGE_HANDLE)message));
+        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray((IOTHUB_MESSAGE_HANDLE)message, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreArgument(2)
+            .IgnoreArgument(3);
+        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties((IOTHUB_MESSAGE_HANDLE)message));
+        STRICT_EXPECTED_CALL(mocks, Map_GetInternals(&(message->properties), IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreArgument(2)
+            .IgnoreArgument(3)
+            .IgnoreArgument(4);
+        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetMessageId((IOTHUB_MESSAGE_HANDLE)message));
+        STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetCorrelationId((IOTHUB_MESSAGE_HANDLE)message));
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*the record*/
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        ///act
+        int result = IoTHubClient_LL_MessageStore_Append(handle, (IOTHUB_MESSAGE_HANDLE)message, &recordId);
+
+        ///assert
+        ASSERT_ARE_EQUAL(int, 0, result);
+        ASSERT_IS_TRUE(recordId != 0);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_LL_MessageStore_Destroy(handle);
+        BASEIMPLEMENTATION::gballoc_free(message);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_LL_MESSAGESTORE_02_007: [ IoTHubClient_LL_MessageStore_Replay shall recreate every message that is not done, in the order they were appended, and pass it with its recordId to replayCallback. ]*/
+    TEST_FUNCTION(IoTHubClient_LL_MessageStore_Replay_after_reopening_recreates_the_messages)
+    {
+        ///arrange
+        CNiceCallComparer<CIoTHubClientLLMessageStoreMocks> mocks;
+        uint64_t recordId1;
+        uint64_t recordId2;
+        TEST_MESSAGE* message1 = createTestMessage(IOTHUBMESSAGE_BYTEARRAY, TEST_BODY, sizeof(TEST_BODY));
+        TEST_MESSAGE* message2 = createTestMessage(IOTHUBMESSAGE_STRING, (const unsigned char*)TEST_STRING_BODY, strlen(TEST_STRING_BODY) + 1);
+        (void)strcpy(message1->messageId, TEST_MESSAGE_ID);
+        (void)strcpy(message2->correlationId, TEST_CORRELATION_ID);
+        addTestProperty(&(message2->properties), "alert", "yes");
+        addTestProperty(&(message2->properties), "unit", "C");
+
+        IOTHUB_CLIENT_LL_MESSAGESTORE_HANDLE handle = IoTHubClient_LL_MessageStore_Create(TEST_STORE_PATH);
+        ASSERT_ARE_EQUAL(int, 0, IoTHubClient_LL_MessageStore_Append(handle, (IOTHUB_MESSAGE_HANDLE)message1, &recordId1));
+        ASSERT_ARE_EQUAL(int, 0, IoTHubClient_LL_MessageStore_Append(handle, (IOTHUB_MESSAGE_HANDLE)message2, &recordId2));
+        ASSERT_ARE_EQUAL(int, 0, IoTHubClient_LL_MessageStore_Flush(handle));
+        IoTHubClient_LL_MessageStore_Destroy(handle);
+
+        ///act
+        reopenAndReplay();
+
+        ///assert
+        ASSERT_ARE_EQUAL(size_t, 2, replayedCount);
+        ASSERT_IS_TRUE(replayedRecordIds[0] == recordId1);
+        ASSERT_IS_TRUE(replayedRecordIds[1] == recordId2);
+
+        ASSERT_ARE_EQUAL(int, (int)IOTHUBMESSAGE_BYTEARRAY, (int)replayedMessages[0]->contentType);
+        ASSERT_ARE_EQUAL(size_t, sizeof(TEST_BODY), replayedMessages[0]->bodySize);
+        ASSERT_ARE_EQUAL(int, 0, memcmp(TEST_BODY, replayedMessages[0]->body, sizeof(TEST_BODY)));
+        ASSERT_ARE_EQUAL(char_ptr, TEST_MESSAGE_ID, replayedMessages[0]->messageId);
+        ASSERT_ARE_EQUAL(char_ptr, "", replayedMessages[0]->correlationId);
+        ASSERT_ARE_EQUAL(size_t, 0, replayedMessages[0]->properties.count);
+
+        ASSERT_ARE_EQUAL(int, (int)IOTHUBMESSAGE_STRING, (int)replayedMessages[1]->contentType);
+        ASSERT_ARE_EQUAL(char_ptr, TEST_STRING_BODY, (const char*)replayedMessages[1]->body);
+        ASSERT_ARE_EQUAL(char_ptr, "", replayedMessages[1]->messageId);
+        ASSERT_ARE_EQUAL(char_ptr, TEST_CORRELATION_ID, replayedMessages[1]->correlationId);
+        ASSERT_ARE_EQUAL(size_t, 2, replayedMessages[1]->properties.count);
+        ASSERT_ARE_EQUAL(char_ptr, "alert", replayedMessages[1]->properties.keys[0]);
+        ASSERT_ARE_EQUAL(char_ptr, "yes", replayedMessages[1]->properties.values[0]);
+        ASSERT_ARE_EQUAL(char_ptr, "unit", replayedMessages[1]->properties.keys[1]);
+        ASSERT_ARE_EQUAL(char_ptr, "C", replayedMessages[1]->properties.values[1]);
+
+        ///cleanup
+        BASEIMPLEMENTATION::gballoc_free(message1);
+        BASEIMPLEMENTATION::gballoc_free(message2);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_LL_MESSAGESTORE_02_013: [ IoTHubClient_LL_MessageStore_Remove shall append to the log a DONE record for recordId and return 0. ]*/
+    /*Tests_SRS_IOTHUBCLIENT_LL_MESSAGESTORE_02_003: [ IoTHubClient_LL_MessageStore_Create shall rewrite the log at path so it only contains the messages that are not done. ]*/
+    TEST_FUNCTION(IoTHubClient_LL_MessageStore_removed_messages_are_not_replayed)
+    {
+        ///arrange
+        CNiceCallComparer<CIoTHubClientLLMessageStoreMocks> mocks;
+        uint64_t recordId1;
+        uint64_t recordId2;
+        uint64_t recordId3;
+        TEST_MESSAGE* message = createTestMessage(IOTHUBMESSAGE_BYTEARRAY, TEST_BODY, sizeof(TEST_BODY));
+
+        IOTHUB_CLIENT_LL_MESSAGESTORE_HANDLE handle = IoTHubClient_LL_MessageStore_Create(TEST_STORE_PATH);
+        ASSERT_ARE_EQUAL(int, 0, IoTHubClient_LL_MessageStore_Append(handle, (IOTHUB_MESSAGE_HANDLE)message, &recordId1));
+        ASSERT_ARE_EQUAL(int, 0, IoTHubClient_LL_MessageStore_Append(handle, (IOTHUB_MESSAGE_HANDLE)message, &recordId2));
+        ASSERT_ARE_EQUAL(int, 0, IoTHubClient_LL_MessageStore_Append(handle, (IOTHUB_MESSAGE_HANDLE)message, &recordId3));
+
+        ///act
+        int result = IoTHubClient_LL_MessageStore_Remove(handle, recordId2);
+
+        ///assert
+        ASSERT_ARE_EQUAL(int, 0, result);
+        ASSERT_ARE_EQUAL(int, 0, IoTHubClient_LL_MessageStore_Flush(handle));
+        long sizeBeforeCompaction = getFileSize(TEST_STORE_PATH);
+        IoTHubClient_LL_MessageStore_Destroy(handle);
+        reopenAndReplay();
+        ASSERT_ARE_EQUAL(size_t, 2, replayedCount);
+        ASSERT_IS_TRUE(replayedRecordIds[0] == recordId1);
+        ASSERT_IS_TRUE(replayedRecordIds[1] == recordId3);
+        ASSERT_IS_TRUE(getFileSize(TEST_STORE_PATH) < sizeBeforeCompaction);
+
+        ///cleanup
+        BASEIMPLEMENTATION::gballoc_free(message);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_LL_MESSAGESTORE_02_018: [ If all the messages are done then IoTHubClient_LL_MessageStore_Flush shall truncate the log. ]*/
+    TEST_FUNCTION(IoTHubClient_LL_MessageStore_Flush_truncates_the_log_when_all_messages_are_done)
+    {
+        ///arrange
+        CNiceCallComparer<CIoTHubClientLLMessageStoreMocks> mocks;
+        uint64_t recordId;
+        TEST_MESSAGE* message = createTestMessage(IOTHUBMESSAGE_BYTEARRAY, TEST_BODY, sizeof(TEST_BODY));
+
+        IOTHUB_CLIENT_LL_MESSAGESTORE_HANDLE handle = IoTHubClient_LL_MessageStore_Create(TEST_STORE_PATH);
+        ASSERT_ARE_EQUAL(int, 0, IoTHubClient_LL_MessageStore_Append(handle, (IOTHUB_MESSAGE_HANDLE)message, &recordId));
+        ASSERT_ARE_EQUAL(int, 0, IoTHubClient_LL_MessageStore_Flush(handle));
+        ASSERT_IS_TRUE(getFileSize(TEST_STORE_PATH) > 0);
+        ASSERT_ARE_EQUAL(int, 0, IoTHubClient_LL_MessageStore_Remove(handle, recordId));
+
+        ///act
+        int result = IoTHubClient_LL_MessageStore_Flush(handle);
+
+        ///assert
+        ASSERT_ARE_EQUAL(int, 0, result);
+        ASSERT_ARE_EQUAL(int, (int)0, (int)getFileSize(TEST_STORE_PATH));
+
+        ///cleanup
+        IoTHubClient_LL_MessageStore_Destroy(handle);
+        BASEIMPLEMENTATION::gballoc_free(message);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_LL_MESSAGESTORE_02_002: [ IoTHubClient_LL_MessageStore_Create shall discard the records at the end of the log at path that are incomplete or fail their checksum. ]*/
+    TEST_FUNCTION(IoTHubClient_LL_MessageStore_Create_discards_a_torn_record_at_the_end_of_the_log)
+    {
+        ///arrange
+        CNiceCallComparer<CIoTHubClientLLMessageStoreMocks> mocks;
+        uint64_t recordId;
+        TEST_MESSAGE* message = createTestMessage(IOTHUBMESSAGE_BYTEARRAY, TEST_BODY, sizeof(TEST_BODY));
+        IOTHUB_CLIENT_LL_MESSAGESTORE_HANDLE handle = IoTHubClient_LL_MessageStore_Create(TEST_STORE_PATH);
+        ASSERT_ARE_EQUAL(int, 0, IoTHubClient_LL_MessageStore_Append(handle, (IOTHUB_MESSAGE_HANDLE)message, &recordId));
+        IoTHubClient_LL_MessageStore_Destroy(handle);
+        long completeSize = getFileSize(TEST_STORE_PATH);
+
+        /*this is what a crash in the middle of writing the second record leaves behind: the start of a record*/
+        FILE* file = fopen(TEST_STORE_PATH, "rb");
+        ASSERT_IS_NOT_NULL(file);
+        unsigned char tornRecord[20];
+        ASSERT_ARE_EQUAL(size_t, sizeof(tornRecord), fread(tornRecord, 1, sizeof(tornRecord), file));
+        (void)fclose(file);
+        appendToFile(TEST_STORE_PATH, tornRecord, sizeof(tornRecord));
+
+        ///act
+        reopenAndReplay();
+
+        ///assert
+        ASSERT_ARE_EQUAL(size_t, 1, replayedCount);
+        ASSERT_IS_TRUE(replayedRecordIds[0] == recordId);
+        ASSERT_ARE_EQUAL(int, (int)completeSize, (int)getFileSize(TEST_STORE_PATH));
+
+        ///cleanup
+        BASEIMPLEMENTATION::gballoc_free(message);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_LL_MESSAGESTORE_02_002: [ IoTHubClient_LL_MessageStore_Create shall discard the records at the end of the log at path that are incomplete or fail their checksum. ]*/
+    TEST_FUNCTION(IoTHubClient_LL_MessageStore_Create_discards_a_record_that_fails_its_checksum)
+    {
+        ///arrange
+        CNiceCallComparer<CIoTHubClientLLMessageStoreMocks> mocks;
+        uint64_t recordId1;
+        uint64_t recordId2;
+        TEST_MESSAGE* message = createTestMessage(IOTHUBMESSAGE_BYTEARRAY, TEST_BODY, sizeof(TEST_BODY));
+        IOTHUB_CLIENT_LL_MESSAGESTORE_HANDLE handle = IoTHubClient_LL_MessageStore_Create(TEST_STORE_PATH);
+        ASSERT_ARE_EQUAL(int, 0, IoTHubClient_LL_MessageStore_Append(handle, (IOTHUB_MESSAGE_HANDLE)message, &recordId1));
+        ASSERT_ARE_EQUAL(int, 0, IoTHubClient_LL_MessageStore_Append(handle, (IOTHUB_MESSAGE_HANDLE)message, &recordId2));
+        IoTHubClient_LL_MessageStore_Destroy(handle);
+
+        /*flip the last byte of the body of the second record*/
+        FILE* file = fopen(TEST_STORE_PATH, "r+b");
+        ASSERT_IS_NOT_NULL(file);
+        ASSERT_ARE_EQUAL(int, 0, fseek(file, -(4 /*crc*/ + 4 /*property count*/ + 4 /*correlationId*/ + 4 /*messageId*/ + 1), SEEK_END));
+        int lastBodyByte = fgetc(file);
+        ASSERT_ARE_EQUAL(int, 0, fseek(file, -1, SEEK_CUR));
+        (void)fputc(lastBodyByte ^ 0xFF, file);
+        (void)fclose(file);
+
+        ///act
+        reopenAndReplay();
+
+        ///assert
+        ASSERT_ARE_EQUAL(size_t, 1, replayedCount);
+        ASSERT_IS_TRUE(replayedRecordIds[0] == recordId1);
+
+        ///cleanup
+        BASEIMPLEMENTATION::gballoc_free(message);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_LL_MESSAGESTORE_02_003: [ IoTHubClient_LL_MessageStore_Create shall rewrite the log at path so it only contains the messages that are not done. ]*/
+    TEST_FUNCTION(IoTHubClient_LL_MessageStore_Create_picks_up_an_interrupted_compaction)
+    {
+        ///arrange
+        CNiceCallComparer<CIoTHubClientLLMessageStoreMocks> mocks;
+        uint64_t recordId;
+        TEST_MESSAGE* message = createTestMessage(IOTHUBMESSAGE_BYTEARRAY, TEST_BODY, sizeof(TEST_BODY));
+        IOTHUB_CLIENT_LL_MESSAGESTORE_HANDLE handle = IoTHubClient_LL_MessageStore_Create(TEST_STORE_PATH);
+        ASSERT_ARE_EQUAL(int, 0, IoTHubClient_LL_MessageStore_Append(handle, (IOTHUB_MESSAGE_HANDLE)message, &recordId));
+        IoTHubClient_LL_MessageStore_Destroy(handle);
+
+        /*a crash between removing the log and renaming the compacted log leaves only the compacted log*/
+        ASSERT_ARE_EQUAL(int, 0, rename(TEST_STORE_PATH, TEST_STORE_TEMPORARY_PATH));
+
+        ///act
+        reopenAndReplay();
+
+        ///assert
+        ASSERT_ARE_EQUAL(size_t, 1, replayedCount);
+        ASSERT_IS_TRUE(replayedRecordIds[0] == recordId);
+        ASSERT_ARE_EQUAL(int, (int)-1, (int)getFileSize(TEST_STORE_TEMPORARY_PATH));
+
+        ///cleanup
+        BASEIMPLEMENTATION::gballoc_free(message);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_LL_MESSAGESTORE_02_006: [ If handle or replayCallback is NULL then IoTHubClient_LL_MessageStore_Replay shall fail and return a non-zero value. ]*/
+    TEST_FUNCTION(IoTHubClient_LL_MessageStore_Replay_with_NULL_replayCallback_fails)
+    {
+        ///arrange
+        CIoTHubClientLLMessageStoreMocks mocks;
+        IOTHUB_CLIENT_LL_MESSAGESTORE_HANDLE handle = IoTHubClient_LL_MessageStore_Create(TEST_STORE_PATH);
+        mocks.ResetAllCalls();
+
+        ///act
+        int result = IoTHubClient_LL_MessageStore_Replay(handle, NULL, NULL);
+
+        ///assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_LL_MessageStore_Destroy(handle);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_LL_MESSAGESTORE_02_012: [ If handle is NULL then IoTHubClient_LL_MessageStore_Remove shall fail and return a non-zero value. ]*/
+    TEST_FUNCTION(IoTHubClient_LL_MessageStore_Remove_with_NULL_handle_fails)
+    {
+        ///arrange
+        CIoTHubClientLLMessageStoreMocks mocks;
+
+        ///act
+        int result = IoTHubClient_LL_MessageStore_Remove(NULL, 1);
+
+        ///assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+        mocks.AssertActualAndExpectedCalls();
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_LL_MESSAGESTORE_02_015: [ If handle is NULL then IoTHubClient_LL_MessageStore_Flush shall fail and return a non-zero value. ]*/
+    TEST_FUNCTION(IoTHubClient_LL_MessageStore_Flush_with_NULL_handle_fails)
+    {
+        ///arrange
+        CIoTHubClientLLMessageStoreMocks mocks;
+
+        ///act
+        int result = IoTHubClient_LL_MessageStore_Flush(NULL);
+
+        ///assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+        mocks.AssertActualAndExpectedCalls();
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_LL_MESSAGESTORE_02_021: [ If handle is NULL then IoTHubClient_LL_MessageStore_Destroy shall do nothing. ]*/
+    TEST_FUNCTION(IoTHubClient_LL_MessageStore_Destroy_with_NULL_handle_does_nothing)
+    {
+        ///arrange
+        CIoTHubClientLLMessageStoreMocks mocks;
+
+        ///act
+        IoTHubClient_LL_MessageStore_Destroy(NULL);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+    }
+
+END_TEST_SUITE(iothubclient_ll_messagestore_unittests)
@@ -29,6 +29,7 @@ void my_gballoc_free(void* ptr)
 #include "umock_c_negative_tests.h"
 #include "umocktypes.h"
 #include "umocktypes_c.h"
+#include "azure_c_shared_utility/lock.h"
 
 #define ENABLE_MOCKS
 
@@ -113,6 +114,16 @@ static void my_HTTPAPIEX_SAS_Destroy(HTTPAPIEX_SAS_HANDLE handle)
     free(handle);
 }
 
+static BLOB_CONNECTION_HANDLE my_Blob_CreateConnection(void)
+{
+    return (BLOB_CONNECTION_HANDLE)malloc(1);
+}
+
+static void my_Blob_DestroyConnection(BLOB_CONNECTION_HANDLE connection)
+{
+    free(connection);
+}
+
 static JSON_Value * my_json_parse_string(const char *string)
 {
     return (JSON_Value *)malloc(1);
@@ -123,10 +134,58 @@ static void my_json_value_free(JSON_Value *value)
     free(value);
 }
 
+/*Lock is not mocked, so the expected calls of the uploads do not change. The stubs count the requests made without the lock held*/
+static int failLock_Init;
+static int failLock;
+static int isLocked;
+static size_t lockCount;
+static size_t requestCount;
+static size_t requestsWithoutLock;
+
+LOCK_HANDLE Lock_Init(void)
+{
+    return failLock_Init ? NULL : (LOCK_HANDLE)malloc(1);
+}
+
+LOCK_RESULT Lock(LOCK_HANDLE handle)
+{
+    LOCK_RESULT result;
+    (void)handle;
+    if (failLock)
+    {
+        result = LOCK_ERROR;
+    }
+    else
+    {
+        isLocked = 1;
+        lockCount++;
+        result = LOCK_OK;
+    }
+    return result;
+}
+
+LOCK_RESULT Unlock(LOCK_HANDLE handle)
+{
+    (void)handle;
+    isLocked = 0;
+    return LOCK_OK;
+}
+
+LOCK_RESULT Lock_Deinit(LOCK_HANDLE handle)
+{
+    free(handle);
+    return LOCK_OK;
+}
+
 static HTTPAPIEX_RESULT my_HTTPAPIEX_ExecuteRequest(HTTPAPIEX_HANDLE handle, HTTPAPI_REQUEST_TYPE requestType, const char* relativePath,
     HTTP_HEADERS_HANDLE requestHttpHeadersHandle, BUFFER_HANDLE requestContent, unsigned int* statusCode,
     HTTP_HEADERS_HANDLE responseHttpHeadersHandle, BUFFER_HANDLE responseContent)
 {
+    requestCount++;
+    if (!isLocked)
+    {
+        requestsWithoutLock++;
+    }
     if (statusCode != NULL)
     {
         *statusCode = 200; /*success*/
@@ -136,6 +195,11 @@ static HTTPAPIEX_RESULT my_HTTPAPIEX_ExecuteRequest(HTTPAPIEX_HANDLE handle, HTT
 
 static HTTPAPIEX_RESULT my_HTTPAPIEX_SAS_ExecuteRequest(HTTPAPIEX_SAS_HANDLE sasHandle, HTTPAPIEX_HANDLE handle, HTTPAPI_REQUEST_TYPE requestType, const char* relativePath, HTTP_HEADERS_HANDLE requestHttpHeadersHandle, BUFFER_HANDLE requestContent, unsigned int* statusCode, HTTP_HEADERS_HANDLE responseHeadersHandle, BUFFER_HANDLE responseContent)
 {
+    requestCount++;
+    if (!isLocked)
+    {
+        requestsWithoutLock++;
+    }
     if (statusCode != NULL)
     {
         *statusCode = 200;/*success*/
@@ -247,6 +311,9 @@ TEST_SUITE_INITIALIZE(TestClassInitialize)
     REGISTER_UMOCK_ALIAS_TYPE(HTTPAPIEX_HANDLE, void*);
     REGISTER_UMOCK_ALIAS_TYPE(HTTPAPIEX_SAS_HANDLE, void*);
     REGISTER_UMOCK_ALIAS_TYPE(const unsigned char*, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(BLOB_READ_CALLBACK, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(const BLOB_UPLOAD_RESUME*, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(BLOB_CONNECTION_HANDLE, void*);
 
     REGISTER_GLOBAL_MOCK_HOOK(gballoc_malloc, my_gballoc_malloc);
     REGISTER_GLOBAL_MOCK_HOOK(gballoc_free, my_gballoc_free);
@@ -272,6 +339,7 @@ TEST_SUITE_INITIALIZE(TestClassInitialize)
     REGISTER_GLOBAL_MOCK_HOOK(HTTPAPIEX_Destroy, my_HTTPAPIEX_Destroy);
 
     REGISTER_GLOBAL_MOCK_HOOK(HTTPAPIEX_SAS_Create, my_HTTPAPIEX_SAS_Create);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(HTTPAPIEX_SAS_Create, NULL);
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(HTTPAPIEX_SAS_ExecuteRequest, HTTPAPIEX_ERROR);
     REGISTER_GLOBAL_MOCK_HOOK(HTTPAPIEX_SAS_ExecuteRequest, my_HTTPAPIEX_SAS_ExecuteRequest)
     REGISTER_GLOBAL_MOCK_HOOK(HTTPAPIEX_SAS_Destroy, my_HTTPAPIEX_SAS_Destroy);
@@ -297,7 +365,13 @@ TEST_SUITE_INITIALIZE(TestClassInitialize)
     REGISTER_GLOBAL_MOCK_RETURN(HTTPAPIEX_ExecuteRequest, HTTPAPIEX_OK);
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(HTTPAPIEX_ExecuteRequest, HTTPAPIEX_ERROR);
 
-    REGISTER_GLOBAL_MOCK_FAIL_RETURN(Blob_UploadFromSasUri, BLOB_ERROR);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(Blob_UploadFromSasUriWithConcurrency, BLOB_ERROR);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(Blob_UploadFromSasUriWithReader, BLOB_ERROR);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(Blob_UploadFromSasUriWithReaderResumable, BLOB_ERROR);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(Blob_UploadFromSasUriOnConnection, BLOB_ERROR);
+    REGISTER_GLOBAL_MOCK_HOOK(Blob_CreateConnection, my_Blob_CreateConnection);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(Blob_CreateConnection, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(Blob_DestroyConnection, my_Blob_DestroyConnection);
 
 }
 
@@ -317,7 +391,12 @@ TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
     }
 
     umock_c_reset_all_calls();
-    
+    failLock_Init = 0;
+    failLock = 0;
+    isLocked = 0;
+    lockCount = 0;
+    requestCount = 0;
+    requestsWithoutLock = 0;
 }
 
 TEST_FUNCTION_CLEANUP(TestMethodCleanup)
@@ -326,6 +405,8 @@ TEST_FUNCTION_CLEANUP(TestMethodCleanup)
     TEST_MUTEX_RELEASE(g_testByTest);
 }
 
+/*Tests_SRS_IOTHUBCLIENT_LL_02_161: [ IoTHubClient_LL_UploadToBlob_Create shall create an HTTPAPIEX_HANDLE to the IoTHub hostname. ]*/
+/*Tests_SRS_IOTHUBCLIENT_LL_02_163: [ IoTHubClient_LL_UploadToBlob_Create shall call Blob_CreateConnection to create the connection to Azure Storage that the uploads reuse. ]*/
 TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_Create_happypath)
 {
     ///arrange
@@ -340,6 +421,10 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_Create_happypath)
     
     STRICT_EXPECTED_CALL(STRING_construct(TEST_DEVICE_SAS));
 
+    STRICT_EXPECTED_CALL(HTTPAPIEX_Create(TEST_IOTHUBNAME "." TEST_IOTHUBSUFFIX));
+
+    STRICT_EXPECTED_CALL(Blob_CreateConnection());
+
     ///act
     IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE h = IoTHubClient_LL_UploadToBlob_Create(&TEST_CONFIG_SAS);
 
@@ -351,6 +436,7 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_Create_happypath)
     IoTHubClient_LL_UploadToBlob_Destroy(h);
 }
 
+/*Tests_SRS_IOTHUBCLIENT_LL_02_164: [ If any of the above fails then IoTHubClient_LL_UploadToBlob_Create shall fail and return NULL. ]*/
 TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_Create_unhappypaths)
 {
     ///arrange
@@ -373,6 +459,12 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_Create_unhappypaths)
     STRICT_EXPECTED_CALL(STRING_construct(TEST_DEVICE_SAS))
         .SetFailReturn(NULL);
 
+    STRICT_EXPECTED_CALL(HTTPAPIEX_Create(TEST_IOTHUBNAME "." TEST_IOTHUBSUFFIX))
+        .SetFailReturn(NULL);
+
+    STRICT_EXPECTED_CALL(Blob_CreateConnection())
+        .SetFailReturn(NULL);
+
     umock_c_negative_tests_snapshot();
 
     ///act
@@ -397,6 +489,22 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_Create_unhappypaths)
     
 }
 
+/*Tests_SRS_IOTHUBCLIENT_LL_02_171: [ IoTHubClient_LL_UploadToBlob_Create shall create a lock that serializes the uploads done with the handle. ]*/
+/*Tests_SRS_IOTHUBCLIENT_LL_02_164: [ If any of the above fails then IoTHubClient_LL_UploadToBlob_Create shall fail and return NULL. ]*/
+TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_Create_fails_when_Lock_Init_fails)
+{
+    ///arrange
+    failLock_Init = 1;
+
+    ///act
+    IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE h = IoTHubClient_LL_UploadToBlob_Create(&TEST_CONFIG_SAS);
+
+    ///assert
+    ASSERT_IS_NULL(h);
+
+    ///cleanup
+}
+
 TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_Destroy_with_NULL_handle_does_nothing)
 {
     ///arrange
@@ -411,6 +519,7 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_Destroy_with_NULL_handle_does_nothing
 
 }
 
+/*Tests_SRS_IOTHUBCLIENT_LL_02_165: [ IoTHubClient_LL_UploadToBlob_Destroy shall call Blob_DestroyConnection, destroy the HTTPAPIEX_SAS_HANDLEs and destroy the HTTPAPIEX_HANDLE. ]*/
 TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_Destroy_happypath)
 {
     ///arrange
@@ -432,8 +541,18 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_Destroy_happypath)
     STRICT_EXPECTED_CALL(STRING_construct(TEST_DEVICE_SAS))
         .CaptureReturn(&s2);
 
+    HTTPAPIEX_HANDLE iotHubHttpApiExHandle;
+    STRICT_EXPECTED_CALL(HTTPAPIEX_Create(TEST_IOTHUBNAME "." TEST_IOTHUBSUFFIX))
+        .CaptureReturn(&iotHubHttpApiExHandle);
+
+    BLOB_CONNECTION_HANDLE blobConnection;
+    STRICT_EXPECTED_CALL(Blob_CreateConnection())
+        .CaptureReturn(&blobConnection);
+
     IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE h = IoTHubClient_LL_UploadToBlob_Create(&TEST_CONFIG_SAS);
 
+    STRICT_EXPECTED_CALL(Blob_DestroyConnection(blobConnection));
+    STRICT_EXPECTED_CALL(HTTPAPIEX_Destroy(iotHubHttpApiExHandle));
     STRICT_EXPECTED_CALL(STRING_delete(s2));
     STRICT_EXPECTED_CALL(gballoc_free(malloc2));
     STRICT_EXPECTED_CALL(STRING_delete(s1));
@@ -497,7 +616,46 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_with_NULL_source_and_non_zero_size_fa
     IoTHubClient_LL_UploadToBlob_Destroy(h);
 }
 
-/*Tests_SRS_IOTHUBCLIENT_LL_02_064: [ IoTHubClient_LL_UploadToBlob shall create an HTTPAPIEX_HANDLE to the IoTHub hostname. ]*/
+/*Tests_SRS_IOTHUBCLIENT_LL_02_172: [ Every upload shall hold the lock created by IoTHubClient_LL_UploadToBlob_Create from before step 1 until after step 3. If acquiring the lock fails then the upload shall fail and return IOTHUB_CLIENT_ERROR. ]*/
+TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_holds_the_lock_for_the_whole_upload)
+{
+    ///arrange
+    IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE h = IoTHubClient_LL_UploadToBlob_Create(&TEST_CONFIG_SAS);
+    umock_c_reset_all_calls();
+
+    ///act
+    (void)IoTHubClient_LL_UploadToBlob_Impl(h, "text.txt", (const unsigned char*)"a", 1);
+
+    ///assert
+    ASSERT_ARE_EQUAL(size_t, 1, lockCount);
+    ASSERT_ARE_NOT_EQUAL(size_t, 0, requestCount);
+    ASSERT_ARE_EQUAL(size_t, 0, requestsWithoutLock);
+    ASSERT_ARE_EQUAL(int, 0, isLocked); /*released once the upload is over*/
+
+    ///cleanup
+    IoTHubClient_LL_UploadToBlob_Destroy(h);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_172: [ Every upload shall hold the lock created by IoTHubClient_LL_UploadToBlob_Create from before step 1 until after step 3. If acquiring the lock fails then the upload shall fail and return IOTHUB_CLIENT_ERROR. ]*/
+TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_fails_when_Lock_fails)
+{
+    ///arrange
+    IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE h = IoTHubClient_LL_UploadToBlob_Create(&TEST_CONFIG_SAS);
+    umock_c_reset_all_calls();
+    failLock = 1;
+
+    ///act
+    IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_UploadToBlob_Impl(h, "text.txt", (const unsigned char*)"a", 1);
+
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls()); /*nothing is attempted*/
+
+    ///cleanup
+    IoTHubClient_LL_UploadToBlob_Destroy(h);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_064: [ IoTHubClient_LL_UploadToBlob shall use the HTTPAPIEX_HANDLE to the IoTHub hostname created by IoTHubClient_LL_UploadToBlob_Create. ]*/
 /*Tests_SRS_IOTHUBCLIENT_LL_02_066: [ IoTHubClient_LL_UploadToBlob shall create an HTTP relative path formed from "/devices/" + deviceId + "/files/" + destinationFileName + "?api-version=API_VERSION". ]*/
 /*Tests_SRS_IOTHUBCLIENT_LL_02_068: [ IoTHubClient_LL_UploadToBlob shall create an HTTP responseContent BUFFER_HANDLE. ]*/
 /*Tests_SRS_IOTHUBCLIENT_LL_02_070: [ IoTHubClient_LL_UploadToBlob shall create request HTTP headers. ]*/
@@ -507,7 +665,7 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_with_NULL_source_and_non_zero_size_fa
 /*Tests_SRS_IOTHUBCLIENT_LL_02_081: [ Otherwise, IoTHubClient_LL_UploadToBlob shall use parson to extract and save the following information from the response buffer: correlationID and SasUri. ]*/
 /*Tests_SRS_IOTHUBCLIENT_LL_02_085: [ IoTHubClient_LL_UploadToBlob shall use the same authorization as step 1. to prepare and perform a HTTP request with the following parameters: ]*/
 /*Tests_SRS_IOTHUBCLIENT_LL_02_088: [ Otherwise, IoTHubClient_LL_UploadToBlob shall succeed and return IOTHUB_CLIENT_OK. ]*/
-/*Tests_SRS_IOTHUBCLIENT_LL_02_083: [ IoTHubClient_LL_UploadToBlob shall call Blob_UploadFromSasUri and capture the HTTP return code and HTTP body. ]*/
+/*Tests_SRS_IOTHUBCLIENT_LL_02_083: [ IoTHubClient_LL_UploadToBlob shall call Blob_UploadFromSasUriOnConnection passing the connection created by IoTHubClient_LL_UploadToBlob_Create, source, size and "blobUploadConcurrency" and capture the HTTP return code and HTTP body. ]*/
 TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_SAS_token_happypath)
 {
     ///arrange
@@ -515,11 +673,6 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_SAS_token_happypath)
     unsigned char c = '3';
     umock_c_reset_all_calls();
 
-    HTTPAPIEX_HANDLE iotHubHttpApiExHandle;
-    STRICT_EXPECTED_CALL(HTTPAPIEX_Create(TEST_IOTHUBNAME "." TEST_IOTHUBSUFFIX))
-        .CaptureReturn(&iotHubHttpApiExHandle)
-        .IgnoreArgument(1);
-    
     STRING_HANDLE correlationId;
     STRICT_EXPECTED_CALL(STRING_new())
         .CaptureReturn(&correlationId);
@@ -576,7 +729,7 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_SAS_token_happypath)
 
 
         STRICT_EXPECTED_CALL(HTTPAPIEX_ExecuteRequest(
-            iotHubHttpApiExHandle,
+            IGNORED_PTR_ARG,
             HTTPAPI_REQUEST_GET,
             iotHubHttpRelativePath1_as_const_char,
             iotHubHttpRequestHeaders1,
@@ -688,10 +841,11 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_SAS_token_happypath)
             .CaptureReturn(&sasUri_as_const_char)
             .IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(Blob_UploadFromSasUri(sasUri_as_const_char, &c, 1, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        STRICT_EXPECTED_CALL(Blob_UploadFromSasUriOnConnection(IGNORED_PTR_ARG, sasUri_as_const_char, &c, 1, NULL, NULL, 1, NULL, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
             .IgnoreArgument(1)
-            .IgnoreArgument(4)
-            .IgnoreArgument(5)
+            .IgnoreArgument(2)
+            .IgnoreArgument(9)
+            .IgnoreArgument(10)
             .CopyOutArgumentBuffer_httpStatus(&TwoHundred, sizeof(TwoHundred))
             ;
         /*some snprintfs happen here... */
@@ -711,18 +865,338 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_SAS_token_happypath)
     }
 
     {/*step3*/
-        STRING_HANDLE uriResource;
-        STRICT_EXPECTED_CALL(STRING_construct(TEST_IOTHUBNAME "." TEST_IOTHUBSUFFIX))
-            .CaptureReturn(&uriResource);
+        STRING_HANDLE relativePathNotification;
+        STRICT_EXPECTED_CALL(STRING_construct("/devices/"))
+            .CaptureReturn(&relativePathNotification);
+
+        STRICT_EXPECTED_CALL(STRING_concat_with_STRING(relativePathNotification, IGNORED_PTR_ARG))
+            .IgnoreArgument(1)
+            .IgnoreArgument(2);
+        STRICT_EXPECTED_CALL(STRING_concat(relativePathNotification, "/files/notifications/"))
+            .IgnoreArgument(1);
+
+        const char* correlationId_as_char = TEST_DEFAULT_STRING_VALUE;
+        STRICT_EXPECTED_CALL(STRING_c_str(correlationId))
+            .CaptureReturn(&correlationId_as_char)
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(STRING_concat(relativePathNotification, correlationId_as_char))
+            .IgnoreArgument(1)
+            .IgnoreArgument(2);
+        STRICT_EXPECTED_CALL(STRING_concat(relativePathNotification, TEST_API_VERSION))
+            .IgnoreArgument(1);
+
+        const char* relativePathNotification_as_char = TEST_DEFAULT_STRING_VALUE;
+        STRICT_EXPECTED_CALL(STRING_c_str(relativePathNotification))
+            .CaptureReturn(&relativePathNotification_as_char)
+            .IgnoreArgument(1);
+
+        STRICT_EXPECTED_CALL(HTTPAPIEX_ExecuteRequest(
+            IGNORED_PTR_ARG,
+            HTTPAPI_REQUEST_POST,
+            relativePathNotification_as_char,
+            iotHubHttpRequestHeaders1,
+            IGNORED_PTR_ARG,
+            IGNORED_PTR_ARG,
+            NULL,
+            NULL
+        ))
+            .IgnoreArgument(1)
+            .IgnoreArgument(3)
+            .IgnoreArgument(4)
+            .IgnoreArgument(5)
+            .CopyOutArgumentBuffer_statusCode(&TwoHundred, sizeof(TwoHundred));
+
+        STRICT_EXPECTED_CALL(STRING_delete(relativePathNotification)) /*60*/
+            .IgnoreArgument(1);
+    }
+
+    STRICT_EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument_ptr();
+
+    STRICT_EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+
+    STRICT_EXPECTED_CALL(HTTPHeaders_Free(iotHubHttpRequestHeaders1))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(STRING_delete(sasUri))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(STRING_delete(correlationId))
+        .IgnoreArgument(1);
+
+    ///act
+    IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_UploadToBlob_Impl(h, "text.txt", &c, 1);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    
+
+    ///cleanup
+    IoTHubClient_LL_UploadToBlob_Destroy(h);
+}
+
+static int testGetData(void* context, unsigned char* buffer, size_t bufferSize, size_t* bytesRead)
+{
+    (void)context;
+    (void)buffer;
+    (void)bufferSize;
+    *bytesRead = 0;
+    return 0;
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_143: [ If handle, destinationFileName or getData is NULL then IoTHubClient_LL_UploadToBlobFromReader_Impl shall fail and return IOTHUB_CLIENT_INVALID_ARG. ]*/
+TEST_FUNCTION(IoTHubClient_LL_UploadToBlobFromReader_with_NULL_handle_fails)
+{
+    ///arrange
+
+    ///act
+    IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_UploadToBlobFromReader_Impl(NULL, "text.txt", testGetData, NULL);
+
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_143: [ If handle, destinationFileName or getData is NULL then IoTHubClient_LL_UploadToBlobFromReader_Impl shall fail and return IOTHUB_CLIENT_INVALID_ARG. ]*/
+TEST_FUNCTION(IoTHubClient_LL_UploadToBlobFromReader_with_NULL_destinationFileName_fails)
+{
+    ///arrange
+    IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE h = IoTHubClient_LL_UploadToBlob_Create(&TEST_CONFIG_SAS);
+    umock_c_reset_all_calls();
+
+    ///act
+    IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_UploadToBlobFromReader_Impl(h, NULL, testGetData, NULL);
+
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubClient_LL_UploadToBlob_Destroy(h);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_143: [ If handle, destinationFileName or getData is NULL then IoTHubClient_LL_UploadToBlobFromReader_Impl shall fail and return IOTHUB_CLIENT_INVALID_ARG. ]*/
+TEST_FUNCTION(IoTHubClient_LL_UploadToBlobFromReader_with_NULL_getData_fails)
+{
+    ///arrange
+    IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE h = IoTHubClient_LL_UploadToBlob_Create(&TEST_CONFIG_SAS);
+    umock_c_reset_all_calls();
+
+    ///act
+    IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_UploadToBlobFromReader_Impl(h, "text.txt", NULL, NULL);
+
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubClient_LL_UploadToBlob_Destroy(h);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_144: [ IoTHubClient_LL_UploadToBlobFromReader_Impl shall execute the same steps as IoTHubClient_LL_UploadToBlob, except that step 2 shall pass getData and context to Blob_UploadFromSasUriOnConnection instead of source and size. ]*/
+TEST_FUNCTION(IoTHubClient_LL_UploadToBlobFromReader_SAS_token_happypath)
+{
+    ///arrange
+    IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE h = IoTHubClient_LL_UploadToBlob_Create(&TEST_CONFIG_SAS);
+    umock_c_reset_all_calls();
+
+    STRING_HANDLE correlationId;
+    STRICT_EXPECTED_CALL(STRING_new())
+        .CaptureReturn(&correlationId);
+
+    STRING_HANDLE sasUri;
+    STRICT_EXPECTED_CALL(STRING_new())
+        .CaptureReturn(&sasUri);
+
+    HTTP_HEADERS_HANDLE iotHubHttpRequestHeaders1;
+    STRICT_EXPECTED_CALL(HTTPHeaders_Alloc())
+        .CaptureReturn(&iotHubHttpRequestHeaders1);
+
+    {
+        STRING_HANDLE iotHubHttpRelativePath1;
+        STRICT_EXPECTED_CALL(STRING_construct("/devices/"))
+            .CaptureReturn(&iotHubHttpRelativePath1);
+
+        STRICT_EXPECTED_CALL(STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*IGNORED_PTR_ARG is the deviceId, which stays nicely tucked in h (handle)*/
+            .IgnoreArgument(1)
+            .IgnoreArgument(2);
+
+        STRICT_EXPECTED_CALL(STRING_concat(iotHubHttpRelativePath1, "/files/"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(STRING_concat(iotHubHttpRelativePath1, "text.txt"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(STRING_concat(iotHubHttpRelativePath1, TEST_API_VERSION))
+            .IgnoreArgument(1);
+
+        BUFFER_HANDLE iotHubHttpMessageBodyResponse1;
+        STRICT_EXPECTED_CALL(BUFFER_new())
+            .CaptureReturn(&iotHubHttpMessageBodyResponse1);
+
+        STRICT_EXPECTED_CALL(HTTPHeaders_AddHeaderNameValuePair(iotHubHttpRequestHeaders1, "Content-Type", "application/json")) /*10*/
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(HTTPHeaders_AddHeaderNameValuePair(iotHubHttpRequestHeaders1, "Accept", "application/json"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(HTTPHeaders_AddHeaderNameValuePair(iotHubHttpRequestHeaders1, "User-Agent", "iothubclient/" TEST_IOTHUB_SDK_VERSION))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(HTTPHeaders_AddHeaderNameValuePair(iotHubHttpRequestHeaders1, "Authorization", ""))
+            .IgnoreArgument(1);
+
+        STRICT_EXPECTED_CALL(STRING_c_str(IGNORED_PTR_ARG)) /*this fetches the SAS from under h (handle)*/
+            .IgnoreArgument(1)
+            .SetReturn(TEST_DEVICE_SAS);
+
+        STRICT_EXPECTED_CALL(HTTPHeaders_ReplaceHeaderNameValuePair(iotHubHttpRequestHeaders1, "Authorization", TEST_DEVICE_SAS))
+            .IgnoreArgument(1);
+
+        const char* iotHubHttpRelativePath1_as_const_char = TEST_DEFAULT_STRING_VALUE;
+        STRICT_EXPECTED_CALL(STRING_c_str(iotHubHttpRelativePath1))
+            .CaptureReturn(&iotHubHttpRelativePath1_as_const_char)
+            .IgnoreArgument(1);
+
+
+
+        STRICT_EXPECTED_CALL(HTTPAPIEX_ExecuteRequest(
+            IGNORED_PTR_ARG,
+            HTTPAPI_REQUEST_GET,
+            iotHubHttpRelativePath1_as_const_char,
+            iotHubHttpRequestHeaders1,
+            NULL,
+            IGNORED_PTR_ARG,
+            NULL,
+            iotHubHttpMessageBodyResponse1
+        ))
+            .IgnoreArgument(1)
+            .IgnoreArgument(3)
+            .IgnoreArgument(4)
+            .IgnoreArgument(6)
+            .CopyOutArgumentBuffer_statusCode(&TwoHundred, sizeof(TwoHundred))
+            .IgnoreArgument(8);
+
+        unsigned char* iotHubHttpMessageBodyResponse1_unsigned_char = (unsigned char*)TEST_DEFAULT_STRING_VALUE;
+        size_t iotHubHttpMessageBodyResponse1_size;
+        STRICT_EXPECTED_CALL(BUFFER_u_char(iotHubHttpMessageBodyResponse1))
+            .CaptureReturn(&iotHubHttpMessageBodyResponse1_unsigned_char)
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(BUFFER_length(iotHubHttpMessageBodyResponse1))
+            .CaptureReturn(&iotHubHttpMessageBodyResponse1_size)
+            .IgnoreArgument(1);
+
+        STRING_HANDLE iotHubHttpMessageBodyResponse1_as_STRING_HANDLE;
+        STRICT_EXPECTED_CALL(STRING_from_byte_array(iotHubHttpMessageBodyResponse1_unsigned_char, iotHubHttpMessageBodyResponse1_size)) /*20*/
+            .CaptureReturn(&iotHubHttpMessageBodyResponse1_as_STRING_HANDLE)
+            .IgnoreArgument(1)
+            .IgnoreArgument(2);
+
+        const char* iotHubHttpMessageBodyResponse1_as_const_char = TEST_DEFAULT_STRING_VALUE;
+        STRICT_EXPECTED_CALL(STRING_c_str(iotHubHttpMessageBodyResponse1_as_STRING_HANDLE))
+            .CaptureReturn(&iotHubHttpMessageBodyResponse1_as_const_char)
+            .IgnoreArgument(1);
+
+        JSON_Value* allJson;
+        STRICT_EXPECTED_CALL(json_parse_string(iotHubHttpMessageBodyResponse1_as_const_char))
+            .CaptureReturn(&allJson)
+            .IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(STRING_concat(uriResource, "/devices/"))
+        JSON_Object* jsonObject;
+        STRICT_EXPECTED_CALL(json_value_get_object(allJson))
+            .CaptureReturn(&jsonObject)
+            .IgnoreArgument(1);
+
+        const char* json_correlationId = TEST_DEFAULT_STRING_VALUE;
+        STRICT_EXPECTED_CALL(json_object_get_string(jsonObject, "correlationId"))
+            .CaptureReturn(&json_correlationId)
             .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(STRING_concat_with_STRING(uriResource, IGNORED_PTR_ARG)) /*50*/
+
+        STRICT_EXPECTED_CALL(STRING_copy(correlationId, json_correlationId))
             .IgnoreArgument(1)
             .IgnoreArgument(2);
-        STRICT_EXPECTED_CALL(STRING_concat(uriResource, "/files/notifications"))
+
+        const char* json_hostName = TEST_DEFAULT_STRING_VALUE;
+        STRICT_EXPECTED_CALL(json_object_get_string(jsonObject, "hostName"))
+            .CaptureReturn(&json_hostName)
+            .IgnoreArgument(1);
+
+        const char* json_containerName = TEST_DEFAULT_STRING_VALUE;
+        STRICT_EXPECTED_CALL(json_object_get_string(jsonObject, "containerName"))
+            .CaptureReturn(&json_containerName)
+            .IgnoreArgument(1);
+
+        const char* json_blobName = TEST_DEFAULT_STRING_VALUE;
+        STRICT_EXPECTED_CALL(json_object_get_string(jsonObject, "blobName"))
+            .CaptureReturn(&json_blobName)
+            .IgnoreArgument(1);
+
+        const char* json_sasToken = TEST_DEFAULT_STRING_VALUE;
+        STRICT_EXPECTED_CALL(json_object_get_string(jsonObject, "sasToken"))
+            .CaptureReturn(&json_sasToken)
+            .IgnoreArgument(1);
+
+        STRICT_EXPECTED_CALL(STRING_copy(sasUri, "https://")) /*30*/
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(STRING_concat(sasUri, json_hostName))
+            .IgnoreArgument(1)
+            .IgnoreArgument(2);
+        STRICT_EXPECTED_CALL(STRING_concat(sasUri, "/"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(STRING_concat(sasUri, json_containerName))
+            .IgnoreArgument(1)
+            .IgnoreArgument(2);
+        STRICT_EXPECTED_CALL(STRING_concat(sasUri, "/"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(STRING_concat(sasUri, json_blobName))
+            .IgnoreArgument(1)
+            .IgnoreArgument(2);
+        STRICT_EXPECTED_CALL(STRING_concat(sasUri, json_sasToken))
+            .IgnoreArgument(1)
+            .IgnoreArgument(2);
+
+        STRICT_EXPECTED_CALL(json_value_free(allJson))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(STRING_delete(iotHubHttpMessageBodyResponse1_as_STRING_HANDLE))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(BUFFER_delete(iotHubHttpMessageBodyResponse1))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(STRING_delete(iotHubHttpRelativePath1)) /*40*/
+            .IgnoreArgument(1);
+    }
+    
+    {/*step2*/
+        STRICT_EXPECTED_CALL(BUFFER_new()); /*this is building the buffer that will contain the response from Blob_UploadFromSasUri*/
+
+        const char* sasUri_as_const_char = TEST_DEFAULT_STRING_VALUE;
+        STRICT_EXPECTED_CALL(STRING_c_str(sasUri))
+            .CaptureReturn(&sasUri_as_const_char)
             .IgnoreArgument(1);
 
+        STRICT_EXPECTED_CALL(Blob_UploadFromSasUriOnConnection(IGNORED_PTR_ARG, sasUri_as_const_char, NULL, 0, testGetData, (void*)0x42, 1, NULL, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreArgument(1)
+            .IgnoreArgument(2)
+            .IgnoreArgument(9)
+            .IgnoreArgument(10)
+            .CopyOutArgumentBuffer_httpStatus(&TwoHundred, sizeof(TwoHundred))
+            ;
+        /*some snprintfs happen here... */
+        STRICT_EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG))
+            .IgnoreArgument_handle();
+
+        STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument_size();
+
+        STRICT_EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG))
+            .IgnoreArgument_handle();
+
+        STRICT_EXPECTED_CALL(BUFFER_create(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+            .IgnoreArgument_source()
+            .IgnoreArgument_size()
+            ;
+    }
+
+    {/*step3*/
         STRING_HANDLE relativePathNotification;
         STRICT_EXPECTED_CALL(STRING_construct("/devices/"))
             .CaptureReturn(&relativePathNotification);
@@ -749,7 +1223,7 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_SAS_token_happypath)
             .IgnoreArgument(1);
 
         STRICT_EXPECTED_CALL(HTTPAPIEX_ExecuteRequest(
-            iotHubHttpApiExHandle,
+            IGNORED_PTR_ARG,
             HTTPAPI_REQUEST_POST,
             relativePathNotification_as_char,
             iotHubHttpRequestHeaders1,
@@ -766,8 +1240,6 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_SAS_token_happypath)
 
         STRICT_EXPECTED_CALL(STRING_delete(relativePathNotification)) /*60*/
             .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(STRING_delete(uriResource))
-            .IgnoreArgument(1);
     }
 
     STRICT_EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG))
@@ -785,11 +1257,9 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_SAS_token_happypath)
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(STRING_delete(correlationId))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(HTTPAPIEX_Destroy(iotHubHttpApiExHandle))
-        .IgnoreArgument(1);
 
     ///act
-    IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_UploadToBlob_Impl(h, "text.txt", &c, 1);
+    IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_UploadToBlobFromReader_Impl(h, "text.txt", testGetData, (void*)0x42);
 
     ///assert
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
@@ -800,6 +1270,93 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_SAS_token_happypath)
     IoTHubClient_LL_UploadToBlob_Destroy(h);
 }
 
+/*Tests_SRS_IOTHUBCLIENT_LL_02_151: [ If handle, destinationFileName, getData, sourceVersion or manifestFileName is NULL then IoTHubClient_LL_UploadToBlobFromReaderResumable_Impl shall fail and return IOTHUB_CLIENT_INVALID_ARG. ]*/
+TEST_FUNCTION(IoTHubClient_LL_UploadToBlobFromReaderResumable_with_NULL_handle_fails)
+{
+    ///arrange
+
+    ///act
+    IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_UploadToBlobFromReaderResumable_Impl(NULL, "text.txt", testGetData, NULL, 1, "1", "text.txt.manifest");
+
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_151: [ If handle, destinationFileName, getData, sourceVersion or manifestFileName is NULL then IoTHubClient_LL_UploadToBlobFromReaderResumable_Impl shall fail and return IOTHUB_CLIENT_INVALID_ARG. ]*/
+TEST_FUNCTION(IoTHubClient_LL_UploadToBlobFromReaderResumable_with_NULL_destinationFileName_fails)
+{
+    ///arrange
+    IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE h = IoTHubClient_LL_UploadToBlob_Create(&TEST_CONFIG_SAS);
+    umock_c_reset_all_calls();
+
+    ///act
+    IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_UploadToBlobFromReaderResumable_Impl(h, NULL, testGetData, NULL, 1, "1", "text.txt.manifest");
+
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubClient_LL_UploadToBlob_Destroy(h);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_151: [ If handle, destinationFileName, getData, sourceVersion or manifestFileName is NULL then IoTHubClient_LL_UploadToBlobFromReaderResumable_Impl shall fail and return IOTHUB_CLIENT_INVALID_ARG. ]*/
+TEST_FUNCTION(IoTHubClient_LL_UploadToBlobFromReaderResumable_with_NULL_getData_fails)
+{
+    ///arrange
+    IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE h = IoTHubClient_LL_UploadToBlob_Create(&TEST_CONFIG_SAS);
+    umock_c_reset_all_calls();
+
+    ///act
+    IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_UploadToBlobFromReaderResumable_Impl(h, "text.txt", NULL, NULL, 1, "1", "text.txt.manifest");
+
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubClient_LL_UploadToBlob_Destroy(h);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_151: [ If handle, destinationFileName, getData, sourceVersion or manifestFileName is NULL then IoTHubClient_LL_UploadToBlobFromReaderResumable_Impl shall fail and return IOTHUB_CLIENT_INVALID_ARG. ]*/
+TEST_FUNCTION(IoTHubClient_LL_UploadToBlobFromReaderResumable_with_NULL_manifestFileName_fails)
+{
+    ///arrange
+    IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE h = IoTHubClient_LL_UploadToBlob_Create(&TEST_CONFIG_SAS);
+    umock_c_reset_all_calls();
+
+    ///act
+    IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_UploadToBlobFromReaderResumable_Impl(h, "text.txt", testGetData, NULL, 1, "1", NULL);
+
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubClient_LL_UploadToBlob_Destroy(h);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_151: [ If handle, destinationFileName, getData, sourceVersion or manifestFileName is NULL then IoTHubClient_LL_UploadToBlobFromReaderResumable_Impl shall fail and return IOTHUB_CLIENT_INVALID_ARG. ]*/
+TEST_FUNCTION(IoTHubClient_LL_UploadToBlobFromReaderResumable_with_NULL_sourceVersion_fails)
+{
+    ///arrange
+    IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE h = IoTHubClient_LL_UploadToBlob_Create(&TEST_CONFIG_SAS);
+    umock_c_reset_all_calls();
+
+    ///act
+    IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_UploadToBlobFromReaderResumable_Impl(h, "text.txt", testGetData, NULL, 1, NULL, "text.txt.manifest");
+
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubClient_LL_UploadToBlob_Destroy(h);
+}
+
 TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_SAS_token_when_step1_http_code_is400_fails)
 {
     ///arrange
@@ -807,11 +1364,6 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_SAS_token_when_step1_http_code_is400_
     unsigned char c = '3';
     umock_c_reset_all_calls();
 
-    HTTPAPIEX_HANDLE iotHubHttpApiExHandle;
-    STRICT_EXPECTED_CALL(HTTPAPIEX_Create(TEST_IOTHUBNAME "." TEST_IOTHUBSUFFIX))
-        .CaptureReturn(&iotHubHttpApiExHandle)
-        .IgnoreArgument(1);
-
     STRING_HANDLE correlationId;
     STRICT_EXPECTED_CALL(STRING_new())
         .CaptureReturn(&correlationId);
@@ -868,7 +1420,7 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_SAS_token_when_step1_http_code_is400_
 
 
         STRICT_EXPECTED_CALL(HTTPAPIEX_ExecuteRequest(
-            iotHubHttpApiExHandle,
+            IGNORED_PTR_ARG,
             HTTPAPI_REQUEST_GET,
             iotHubHttpRelativePath1_as_const_char,
             iotHubHttpRequestHeaders1,
@@ -896,8 +1448,6 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_SAS_token_when_step1_http_code_is400_
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(STRING_delete(correlationId))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(HTTPAPIEX_Destroy(iotHubHttpApiExHandle))
-        .IgnoreArgument(1);
 
     ///act
     IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_UploadToBlob_Impl(h, "text.txt", &c, 1);
@@ -919,11 +1469,6 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_SAS_token_when_step2_httpStatusCode_i
     unsigned char c = '3';
     umock_c_reset_all_calls();
 
-    HTTPAPIEX_HANDLE iotHubHttpApiExHandle;
-    STRICT_EXPECTED_CALL(HTTPAPIEX_Create(TEST_IOTHUBNAME "." TEST_IOTHUBSUFFIX))
-        .CaptureReturn(&iotHubHttpApiExHandle)
-        .IgnoreArgument(1);
-
     STRING_HANDLE correlationId;
     STRICT_EXPECTED_CALL(STRING_new())
         .CaptureReturn(&correlationId);
@@ -978,7 +1523,7 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_SAS_token_when_step2_httpStatusCode_i
             .IgnoreArgument(1);
 
         STRICT_EXPECTED_CALL(HTTPAPIEX_ExecuteRequest(
-            iotHubHttpApiExHandle,
+            IGNORED_PTR_ARG,
             HTTPAPI_REQUEST_GET,
             iotHubHttpRelativePath1_as_const_char,
             iotHubHttpRequestHeaders1,
@@ -1090,10 +1635,11 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_SAS_token_when_step2_httpStatusCode_i
             .CaptureReturn(&sasUri_as_const_char)
             .IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(Blob_UploadFromSasUri(sasUri_as_const_char, &c, 1, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        STRICT_EXPECTED_CALL(Blob_UploadFromSasUriOnConnection(IGNORED_PTR_ARG, sasUri_as_const_char, &c, 1, NULL, NULL, 1, NULL, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
             .IgnoreArgument(1)
-            .IgnoreArgument(4)
-            .IgnoreArgument(5)
+            .IgnoreArgument(2)
+            .IgnoreArgument(9)
+            .IgnoreArgument(10)
             .CopyOutArgumentBuffer_httpStatus(&FourHundred, sizeof(FourHundred))
             ;
         /*some snprintfs happen here... */
@@ -1113,18 +1659,6 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_SAS_token_when_step2_httpStatusCode_i
     }
 
     {/*step3*/
-        STRING_HANDLE uriResource;
-        STRICT_EXPECTED_CALL(STRING_construct(TEST_IOTHUBNAME "." TEST_IOTHUBSUFFIX))
-            .CaptureReturn(&uriResource);
-
-        STRICT_EXPECTED_CALL(STRING_concat(uriResource, "/devices/"))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(STRING_concat_with_STRING(uriResource, IGNORED_PTR_ARG)) /*50*/
-            .IgnoreArgument(1)
-            .IgnoreArgument(2);
-        STRICT_EXPECTED_CALL(STRING_concat(uriResource, "/files/notifications"))
-            .IgnoreArgument(1);
-
         STRING_HANDLE relativePathNotification;
         STRICT_EXPECTED_CALL(STRING_construct("/devices/"))
             .CaptureReturn(&relativePathNotification);
@@ -1151,7 +1685,7 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_SAS_token_when_step2_httpStatusCode_i
             .IgnoreArgument(1);
 
         STRICT_EXPECTED_CALL(HTTPAPIEX_ExecuteRequest(
-            iotHubHttpApiExHandle,
+            IGNORED_PTR_ARG,
             HTTPAPI_REQUEST_POST,
             relativePathNotification_as_char,
             iotHubHttpRequestHeaders1,
@@ -1168,8 +1702,6 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_SAS_token_when_step2_httpStatusCode_i
 
         STRICT_EXPECTED_CALL(STRING_delete(relativePathNotification)) /*60*/
             .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(STRING_delete(uriResource))
-            .IgnoreArgument(1);
     }
 
     STRICT_EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG))
@@ -1187,8 +1719,6 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_SAS_token_when_step2_httpStatusCode_i
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(STRING_delete(correlationId))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(HTTPAPIEX_Destroy(iotHubHttpApiExHandle))
-        .IgnoreArgument(1);
 
     ///act
     IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_UploadToBlob_Impl(h, "text.txt", &c, 1);
@@ -1210,11 +1740,6 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_SAS_token_when_step3_httpStatusCode_i
     unsigned char c = '3';
     umock_c_reset_all_calls();
 
-    HTTPAPIEX_HANDLE iotHubHttpApiExHandle;
-    STRICT_EXPECTED_CALL(HTTPAPIEX_Create(TEST_IOTHUBNAME "." TEST_IOTHUBSUFFIX))
-        .CaptureReturn(&iotHubHttpApiExHandle)
-        .IgnoreArgument(1);
-
     STRING_HANDLE correlationId;
     STRICT_EXPECTED_CALL(STRING_new())
         .CaptureReturn(&correlationId);
@@ -1271,7 +1796,7 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_SAS_token_when_step3_httpStatusCode_i
 
 
         STRICT_EXPECTED_CALL(HTTPAPIEX_ExecuteRequest(
-            iotHubHttpApiExHandle,
+            IGNORED_PTR_ARG,
             HTTPAPI_REQUEST_GET,
             iotHubHttpRelativePath1_as_const_char,
             iotHubHttpRequestHeaders1,
@@ -1383,10 +1908,11 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_SAS_token_when_step3_httpStatusCode_i
             .CaptureReturn(&sasUri_as_const_char)
             .IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(Blob_UploadFromSasUri(sasUri_as_const_char, &c, 1, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        STRICT_EXPECTED_CALL(Blob_UploadFromSasUriOnConnection(IGNORED_PTR_ARG, sasUri_as_const_char, &c, 1, NULL, NULL, 1, NULL, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
             .IgnoreArgument(1)
-            .IgnoreArgument(4)
-            .IgnoreArgument(5)
+            .IgnoreArgument(2)
+            .IgnoreArgument(9)
+            .IgnoreArgument(10)
             .CopyOutArgumentBuffer_httpStatus(&TwoHundred, sizeof(TwoHundred))
             ;
         /*some snprintfs happen here... */
@@ -1406,18 +1932,6 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_SAS_token_when_step3_httpStatusCode_i
     }
 
     {/*step3*/
-        STRING_HANDLE uriResource;
-        STRICT_EXPECTED_CALL(STRING_construct(TEST_IOTHUBNAME "." TEST_IOTHUBSUFFIX))
-            .CaptureReturn(&uriResource);
-
-        STRICT_EXPECTED_CALL(STRING_concat(uriResource, "/devices/"))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(STRING_concat_with_STRING(uriResource, IGNORED_PTR_ARG)) /*50*/
-            .IgnoreArgument(1)
-            .IgnoreArgument(2);
-        STRICT_EXPECTED_CALL(STRING_concat(uriResource, "/files/notifications"))
-            .IgnoreArgument(1);
-
         STRING_HANDLE relativePathNotification;
         STRICT_EXPECTED_CALL(STRING_construct("/devices/"))
             .CaptureReturn(&relativePathNotification);
@@ -1444,7 +1958,7 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_SAS_token_when_step3_httpStatusCode_i
             .IgnoreArgument(1);
 
         STRICT_EXPECTED_CALL(HTTPAPIEX_ExecuteRequest(
-            iotHubHttpApiExHandle,
+            IGNORED_PTR_ARG,
             HTTPAPI_REQUEST_POST,
             relativePathNotification_as_char,
             iotHubHttpRequestHeaders1,
@@ -1461,8 +1975,6 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_SAS_token_when_step3_httpStatusCode_i
 
         STRICT_EXPECTED_CALL(STRING_delete(relativePathNotification)) /*60*/
             .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(STRING_delete(uriResource))
-            .IgnoreArgument(1);
     }
 
     STRICT_EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG))
@@ -1480,8 +1992,6 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_SAS_token_when_step3_httpStatusCode_i
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(STRING_delete(correlationId))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(HTTPAPIEX_Destroy(iotHubHttpApiExHandle))
-        .IgnoreArgument(1);
 
     ///act
     IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_UploadToBlob_Impl(h, "text.txt", &c, 1);
@@ -1495,7 +2005,6 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_SAS_token_when_step3_httpStatusCode_i
     IoTHubClient_LL_UploadToBlob_Destroy(h);
 }
 
-/*Tests_SRS_IOTHUBCLIENT_LL_02_065: [ If creating the HTTPAPIEX_HANDLE fails then IoTHubClient_LL_UploadToBlob shall fail and return IOTHUB_CLIENT_ERROR. ]*/
 /*Tests_SRS_IOTHUBCLIENT_LL_02_067: [ If creating the relativePath fails then IoTHubClient_LL_UploadToBlob shall fail and return IOTHUB_CLIENT_ERROR. ]*/
 /*Tests_SRS_IOTHUBCLIENT_LL_02_069: [ If creating the HTTP response buffer handle fails then IoTHubClient_LL_UploadToBlob shall fail and return IOTHUB_CLIENT_ERROR. ]*/
 /*Tests_SRS_IOTHUBCLIENT_LL_02_071: [ If creating the HTTP headers fails then IoTHubClient_LL_UploadToBlob shall fail and return IOTHUB_CLIENT_ERROR. ]*/
@@ -1515,11 +2024,6 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_SAS_token_unhappypaths)
     unsigned char c = '3';
     umock_c_reset_all_calls();
 
-    HTTPAPIEX_HANDLE iotHubHttpApiExHandle;
-    STRICT_EXPECTED_CALL(HTTPAPIEX_Create(TEST_IOTHUBNAME "." TEST_IOTHUBSUFFIX))
-        .CaptureReturn(&iotHubHttpApiExHandle)
-        .IgnoreArgument(1);
-
     STRING_HANDLE correlationId;
     STRICT_EXPECTED_CALL(STRING_new())
         .CaptureReturn(&correlationId);
@@ -1574,7 +2078,7 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_SAS_token_unhappypaths)
             .IgnoreArgument(1);
 
         STRICT_EXPECTED_CALL(HTTPAPIEX_ExecuteRequest(
-            iotHubHttpApiExHandle,
+            IGNORED_PTR_ARG,
             HTTPAPI_REQUEST_GET,
             iotHubHttpRelativePath1_as_const_char,
             iotHubHttpRequestHeaders1,
@@ -1686,10 +2190,11 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_SAS_token_unhappypaths)
             .CaptureReturn(&sasUri_as_const_char)
             .IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(Blob_UploadFromSasUri(sasUri_as_const_char, &c, 1, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        STRICT_EXPECTED_CALL(Blob_UploadFromSasUriOnConnection(IGNORED_PTR_ARG, sasUri_as_const_char, &c, 1, NULL, NULL, 1, NULL, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
             .IgnoreArgument(1)
-            .IgnoreArgument(4)
-            .IgnoreArgument(5)
+            .IgnoreArgument(2)
+            .IgnoreArgument(9)
+            .IgnoreArgument(10)
             .CopyOutArgumentBuffer_httpStatus(&TwoHundred, sizeof(TwoHundred))
             ;
         /*some snprintfs happen here... */
@@ -1709,18 +2214,6 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_SAS_token_unhappypaths)
     }
 
     {/*step3*/
-        STRING_HANDLE uriResource;
-        STRICT_EXPECTED_CALL(STRING_construct(TEST_IOTHUBNAME "." TEST_IOTHUBSUFFIX))
-            .CaptureReturn(&uriResource);
-
-        STRICT_EXPECTED_CALL(STRING_concat(uriResource, "/devices/"))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(STRING_concat_with_STRING(uriResource, IGNORED_PTR_ARG)) /*50*/
-            .IgnoreArgument(1)
-            .IgnoreArgument(2);
-        STRICT_EXPECTED_CALL(STRING_concat(uriResource, "/files/notifications"))
-            .IgnoreArgument(1);
-
         STRING_HANDLE relativePathNotification;
         STRICT_EXPECTED_CALL(STRING_construct("/devices/"))
             .CaptureReturn(&relativePathNotification);
@@ -1747,7 +2240,7 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_SAS_token_unhappypaths)
             .IgnoreArgument(1);
 
         STRICT_EXPECTED_CALL(HTTPAPIEX_ExecuteRequest(
-            iotHubHttpApiExHandle,
+            IGNORED_PTR_ARG,
             HTTPAPI_REQUEST_POST,
             relativePathNotification_as_char,
             iotHubHttpRequestHeaders1,
@@ -1764,8 +2257,6 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_SAS_token_unhappypaths)
 
         STRICT_EXPECTED_CALL(STRING_delete(relativePathNotification)) /*60*/
             .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(STRING_delete(uriResource))
-            .IgnoreArgument(1);
     }
 
     STRICT_EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG))
@@ -1783,38 +2274,33 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_SAS_token_unhappypaths)
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(STRING_delete(correlationId))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(HTTPAPIEX_Destroy(iotHubHttpApiExHandle))
-        .IgnoreArgument(1);
 
     umock_c_negative_tests_snapshot();
 
     ///act
 
     size_t calls_that_cannot_fail[] = { 
-        14, /*STRING_c_str*/
-        16, /*STRING_c_str*/
-        18, /*BUFFER_u_char*/
-        19, /*BUFFER_length*/
-        21, /*STRING_c_str*/
-        37, /*json_value_free*/
-        38, /*STRING_delete*/
-        39, /*BUFFER_delete*/
-        40, /*STRING_delete*/
-        42, /*STRING_c_str*/
-        44, /*BUFFER_u_char*/
-        46, /*BUFFER_u_char*/
-        55, /*STRING_c_str*/
-        58, /*STRING_c_str*/
-        60, /*BUFFER_delete*/
+        13, /*STRING_c_str*/
+        15, /*STRING_c_str*/
+        17, /*BUFFER_u_char*/
+        18, /*BUFFER_length*/
+        20, /*STRING_c_str*/
+        36, /*json_value_free*/
+        37, /*STRING_delete*/
+        38, /*BUFFER_delete*/
+        39, /*STRING_delete*/
+        41, /*STRING_c_str*/
+        43, /*BUFFER_u_char*/
+        45, /*BUFFER_u_char*/
+        50, /*STRING_c_str*/
+        53, /*STRING_c_str*/
+        55, /*STRING_delete*/
+        56, /*BUFFER_delete*/
+        57, /*gballoc_free*/
+        58, /*BUFFER_delete*/
+        59, /*HTTPHeaders_Free*/
         60, /*STRING_delete*/
         61, /*STRING_delete*/
-        62, /*BUFFER_delete*/
-        63, /*gballoc_free*/
-        64, /*BUFFER_delete*/
-        65, /*HTTPHeaders_Free*/
-        66, /*STRING_delete*/
-        67, /*STRING_delete*/
-        68, /*HTTPAPIEX_Destroy*/
     };
 
     for (size_t i = 0; i < umock_c_negative_tests_call_count(); i++)
@@ -1856,6 +2342,7 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_SAS_token_unhappypaths)
 }
 
 
+/*Tests_SRS_IOTHUBCLIENT_LL_02_162: [ If the credentials are a "deviceKey" then IoTHubClient_LL_UploadToBlob_Create shall create the HTTPAPIEX_SAS_HANDLE of step 1 for the resource hostname + "/devices/" + deviceId and the HTTPAPIEX_SAS_HANDLE of step 3 for the resource hostname + "/devices/" + deviceId + "/files/notifications", passing the deviceKey and an empty keyName. ]*/
 TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_Create_DeviceKey_happypath)
 {
     ///arrange
@@ -1870,6 +2357,40 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_Create_DeviceKey_happypath)
 
     STRICT_EXPECTED_CALL(STRING_construct(TEST_DEVICE_KEY));
 
+    STRICT_EXPECTED_CALL(HTTPAPIEX_Create(TEST_IOTHUBNAME "." TEST_IOTHUBSUFFIX));
+
+    STRICT_EXPECTED_CALL(STRING_construct(TEST_IOTHUBNAME "." TEST_IOTHUBSUFFIX)); /*the resource that the SAS tokens of step 1 authenticate*/
+    STRICT_EXPECTED_CALL(STRING_concat(IGNORED_PTR_ARG, "/devices/"))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument_s1()
+        .IgnoreArgument_s2();
+    STRICT_EXPECTED_CALL(STRING_new()); /*HTTPAPIEX_SAS_Create needs an empty keyName*/
+    STRICT_EXPECTED_CALL(HTTPAPIEX_SAS_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+
+    STRICT_EXPECTED_CALL(STRING_construct(TEST_IOTHUBNAME "." TEST_IOTHUBSUFFIX)); /*the resource that the SAS tokens of step 3 authenticate*/
+    STRICT_EXPECTED_CALL(STRING_concat(IGNORED_PTR_ARG, "/devices/"))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument_s1()
+        .IgnoreArgument_s2();
+    STRICT_EXPECTED_CALL(STRING_concat(IGNORED_PTR_ARG, "/files/notifications"))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(STRING_new()); /*HTTPAPIEX_SAS_Create needs an empty keyName*/
+    STRICT_EXPECTED_CALL(HTTPAPIEX_SAS_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+
+    STRICT_EXPECTED_CALL(Blob_CreateConnection());
+
     ///act
     IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE h = IoTHubClient_LL_UploadToBlob_Create(&TEST_CONFIG_DEVICE_KEY);
 
@@ -1881,6 +2402,7 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_Create_DeviceKey_happypath)
     IoTHubClient_LL_UploadToBlob_Destroy(h);
 }
 
+/*Tests_SRS_IOTHUBCLIENT_LL_02_164: [ If any of the above fails then IoTHubClient_LL_UploadToBlob_Create shall fail and return NULL. ]*/
 TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_Create_DeviceKey_unhappypaths)
 {
     ///arrange
@@ -1903,34 +2425,107 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_Create_DeviceKey_unhappypaths)
     STRICT_EXPECTED_CALL(STRING_construct(TEST_DEVICE_KEY))
         .SetFailReturn(NULL);
 
+    STRICT_EXPECTED_CALL(HTTPAPIEX_Create(TEST_IOTHUBNAME "." TEST_IOTHUBSUFFIX))
+        .SetFailReturn(NULL);
+
+    STRICT_EXPECTED_CALL(STRING_construct(TEST_IOTHUBNAME "." TEST_IOTHUBSUFFIX)) /*the resource that the SAS tokens of step 1 authenticate*/
+        .SetFailReturn(NULL);
+    STRICT_EXPECTED_CALL(STRING_concat(IGNORED_PTR_ARG, "/devices/"))
+        .IgnoreArgument_handle()
+        .SetFailReturn(__LINE__);
+    STRICT_EXPECTED_CALL(STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument_s1()
+        .IgnoreArgument_s2()
+        .SetFailReturn(__LINE__);
+    STRICT_EXPECTED_CALL(STRING_new())
+        .SetFailReturn(NULL);
+    STRICT_EXPECTED_CALL(HTTPAPIEX_SAS_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments()
+        .SetFailReturn(NULL);
+    STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+
+    STRICT_EXPECTED_CALL(STRING_construct(TEST_IOTHUBNAME "." TEST_IOTHUBSUFFIX)) /*the resource that the SAS tokens of step 3 authenticate*/
+        .SetFailReturn(NULL);
+    STRICT_EXPECTED_CALL(STRING_concat(IGNORED_PTR_ARG, "/devices/"))
+        .IgnoreArgument_handle()
+        .SetFailReturn(__LINE__);
+    STRICT_EXPECTED_CALL(STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument_s1()
+        .IgnoreArgument_s2()
+        .SetFailReturn(__LINE__);
+    STRICT_EXPECTED_CALL(STRING_concat(IGNORED_PTR_ARG, "/files/notifications"))
+        .IgnoreArgument_handle()
+        .SetFailReturn(__LINE__);
+    STRICT_EXPECTED_CALL(STRING_new())
+        .SetFailReturn(NULL);
+    STRICT_EXPECTED_CALL(HTTPAPIEX_SAS_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments()
+        .SetFailReturn(NULL);
+    STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+
+    STRICT_EXPECTED_CALL(Blob_CreateConnection())
+        .SetFailReturn(NULL);
+
     umock_c_negative_tests_snapshot();
 
+    size_t calls_that_cannot_fail[] = {
+        10, /*STRING_delete*/
+        11, /*STRING_delete*/
+        18, /*STRING_delete*/
+        19, /*STRING_delete*/
+    };
+
     ///act
     for (size_t i = 0; i < umock_c_negative_tests_call_count(); i++)
     {
         /// arrange
         char temp_str[128];
+        size_t j;
         umock_c_negative_tests_reset();
         umock_c_negative_tests_fail_call(i);
 
-        /// act
-        IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE h = IoTHubClient_LL_UploadToBlob_Create(&TEST_CONFIG_DEVICE_KEY);
+        for (j = 0;j<sizeof(calls_that_cannot_fail) / sizeof(calls_that_cannot_fail[0]);j++)
+        {
+            if (calls_that_cannot_fail[j] == i)
+                break;
+        }
 
-        /// assert
-        sprintf(temp_str, "On failed call %zu", i + 1);
-        ASSERT_IS_NULL_WITH_MSG(h, temp_str);
+        if (j == sizeof(calls_that_cannot_fail) / sizeof(calls_that_cannot_fail[0]))
+        {
+            /// act
+            IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE h = IoTHubClient_LL_UploadToBlob_Create(&TEST_CONFIG_DEVICE_KEY);
+
+            /// assert
+            sprintf(temp_str, "On failed call %zu", i + 1);
+            ASSERT_IS_NULL_WITH_MSG(h, temp_str);
+        }
     }
 
     umock_c_negative_tests_deinit();
 
 }
 
+/*Tests_SRS_IOTHUBCLIENT_LL_02_165: [ IoTHubClient_LL_UploadToBlob_Destroy shall call Blob_DestroyConnection, destroy the HTTPAPIEX_SAS_HANDLEs and destroy the HTTPAPIEX_HANDLE. ]*/
 TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_Destroy_with_DeviceKey_happypath)
 {
     ///arrange
     IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE h = IoTHubClient_LL_UploadToBlob_Create(&TEST_CONFIG_DEVICE_KEY);
     umock_c_reset_all_calls();
 
+    STRICT_EXPECTED_CALL(Blob_DestroyConnection(IGNORED_PTR_ARG))
+        .IgnoreArgument_connection();
+    STRICT_EXPECTED_CALL(HTTPAPIEX_SAS_Destroy(IGNORED_PTR_ARG)) /*step 3*/
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(HTTPAPIEX_SAS_Destroy(IGNORED_PTR_ARG)) /*step 1*/
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(HTTPAPIEX_Destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
     STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG))
         .IgnoreArgument_handle();
     STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
@@ -1949,7 +2544,7 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_Destroy_with_DeviceKey_happypath)
     ///cleanup
 }
 
-/*Tests_SRS_IOTHUBCLIENT_LL_02_078: [ If the credentials used to create iotHubClientHandle have "deviceKey" then IoTHubClient_LL_UploadToBlob shall create an HTTPAPIEX_SAS_HANDLE passing as arguments: ]*/
+/*Tests_SRS_IOTHUBCLIENT_LL_02_078: [ If the credentials used to create iotHubClientHandle have "deviceKey" then IoTHubClient_LL_UploadToBlob shall use the HTTPAPIEX_SAS_HANDLE of step 1 created by IoTHubClient_LL_UploadToBlob_Create. ]*/
 /*Tests_SRS_IOTHUBCLIENT_LL_02_090: [ IoTHubClient_LL_UploadToBlob shall call HTTPAPIEX_SAS_ExecuteRequest passing as arguments: ]*/
 TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_deviceKey_happypath)
 {
@@ -1958,11 +2553,6 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_deviceKey_happypath)
     unsigned char c = '3';
     umock_c_reset_all_calls();
 
-    HTTPAPIEX_HANDLE iotHubHttpApiExHandle;
-    STRICT_EXPECTED_CALL(HTTPAPIEX_Create(TEST_IOTHUBNAME "." TEST_IOTHUBSUFFIX))
-        .CaptureReturn(&iotHubHttpApiExHandle)
-        .IgnoreArgument(1);
-
     STRING_HANDLE correlationId;
     STRICT_EXPECTED_CALL(STRING_new())
         .CaptureReturn(&correlationId);
@@ -2004,17 +2594,6 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_deviceKey_happypath)
         STRICT_EXPECTED_CALL(HTTPHeaders_AddHeaderNameValuePair(iotHubHttpRequestHeaders1, "Authorization", "")) /*14*/
             .IgnoreArgument(1);
 
-       
-        STRICT_EXPECTED_CALL(STRING_construct(TEST_IOTHUBNAME "." TEST_IOTHUBSUFFIX)); /*this is starting to build the path that the SAS token authenticates*/
-        STRICT_EXPECTED_CALL(STRING_concat(IGNORED_PTR_ARG, "/devices/")) /*this is building the path that the SAS token authenticates*/
-            .IgnoreArgument_handle();
-        STRICT_EXPECTED_CALL(STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is building the path that the SAS token authenticates*/
-            .IgnoreArgument_s1()
-            .IgnoreArgument_s2();
-        STRICT_EXPECTED_CALL(STRING_new());/*this is needed for HTTPAPIEX_SAS_Create -it needs an empty STRING_HANDLE*/
-
-        STRICT_EXPECTED_CALL(HTTPAPIEX_SAS_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreAllArguments();
         STRICT_EXPECTED_CALL(STRING_c_str(IGNORED_PTR_ARG))
             .IgnoreArgument_handle();
         STRICT_EXPECTED_CALL(HTTPAPIEX_SAS_ExecuteRequest( /*20*/
@@ -2038,12 +2617,6 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_deviceKey_happypath)
             .IgnoreArgument_responseContent()
             .CopyOutArgumentBuffer_statusCode(&TwoHundred, sizeof(TwoHundred))
             ;
-        STRICT_EXPECTED_CALL(HTTPAPIEX_SAS_Destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument_handle();
-        STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG)) /*the empty STRING_new*/
-            .IgnoreArgument_handle();
-        STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG)) /*the build the path that the SAS token authenticates*/
-            .IgnoreArgument_handle();
 
         unsigned char* iotHubHttpMessageBodyResponse1_unsigned_char = (unsigned char*)TEST_DEFAULT_STRING_VALUE;
         size_t iotHubHttpMessageBodyResponse1_size;
@@ -2141,10 +2714,11 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_deviceKey_happypath)
             .CaptureReturn(&sasUri_as_const_char)
             .IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(Blob_UploadFromSasUri(sasUri_as_const_char, &c, 1, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        STRICT_EXPECTED_CALL(Blob_UploadFromSasUriOnConnection(IGNORED_PTR_ARG, sasUri_as_const_char, &c, 1, NULL, NULL, 1, NULL, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
             .IgnoreArgument(1)
-            .IgnoreArgument(4)
-            .IgnoreArgument(5)
+            .IgnoreArgument(2)
+            .IgnoreArgument(9)
+            .IgnoreArgument(10)
             .CopyOutArgumentBuffer_httpStatus(&TwoHundred, sizeof(TwoHundred))
             ;
         /*some snprintfs happen here... */
@@ -2165,18 +2739,6 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_deviceKey_happypath)
 
     {/*step3*/
 
-        STRING_HANDLE uriResource;
-        STRICT_EXPECTED_CALL(STRING_construct(TEST_IOTHUBNAME "." TEST_IOTHUBSUFFIX))
-            .CaptureReturn(&uriResource);
-
-        STRICT_EXPECTED_CALL(STRING_concat(uriResource, "/devices/"))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(STRING_concat_with_STRING(uriResource, IGNORED_PTR_ARG))
-            .IgnoreArgument(1)
-            .IgnoreArgument(2);
-        STRICT_EXPECTED_CALL(STRING_concat(uriResource, "/files/notifications"))
-            .IgnoreArgument(1);
-
         STRING_HANDLE relativePathNotification;
         STRICT_EXPECTED_CALL(STRING_construct("/devices/"))
             .CaptureReturn(&relativePathNotification);
@@ -2197,9 +2759,6 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_deviceKey_happypath)
         STRICT_EXPECTED_CALL(STRING_concat(relativePathNotification, TEST_API_VERSION))
             .IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(STRING_new());
-        STRICT_EXPECTED_CALL(HTTPAPIEX_SAS_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreAllArguments();
         STRICT_EXPECTED_CALL(STRING_c_str(IGNORED_PTR_ARG))
             .IgnoreArgument_handle();
         STRICT_EXPECTED_CALL(HTTPAPIEX_SAS_ExecuteRequest(
@@ -2223,15 +2782,9 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_deviceKey_happypath)
             .IgnoreArgument_responseContent()
             .CopyOutArgumentBuffer_statusCode(&TwoHundred, sizeof(TwoHundred))
             ;
-        STRICT_EXPECTED_CALL(HTTPAPIEX_SAS_Destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument_handle();
-        STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument_handle();
             
         STRICT_EXPECTED_CALL(STRING_delete(relativePathNotification)) /*70*/
             .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(STRING_delete(uriResource))
-            .IgnoreArgument(1);
     }
 
     STRICT_EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG))
@@ -2249,8 +2802,6 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_deviceKey_happypath)
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(STRING_delete(correlationId))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(HTTPAPIEX_Destroy(iotHubHttpApiExHandle))
-        .IgnoreArgument(1);
 
     ///act
     IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_UploadToBlob_Impl(h, "text.txt", &c, 1);
@@ -2271,11 +2822,6 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_deviceKey_when_step1_httpStatusCode_i
     unsigned char c = '3';
     umock_c_reset_all_calls();
 
-    HTTPAPIEX_HANDLE iotHubHttpApiExHandle;
-    STRICT_EXPECTED_CALL(HTTPAPIEX_Create(TEST_IOTHUBNAME "." TEST_IOTHUBSUFFIX))
-        .CaptureReturn(&iotHubHttpApiExHandle)
-        .IgnoreArgument(1);
-
     STRING_HANDLE correlationId;
     STRICT_EXPECTED_CALL(STRING_new())
         .CaptureReturn(&correlationId);
@@ -2317,17 +2863,6 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_deviceKey_when_step1_httpStatusCode_i
         STRICT_EXPECTED_CALL(HTTPHeaders_AddHeaderNameValuePair(iotHubHttpRequestHeaders1, "Authorization", "")) /*14*/
             .IgnoreArgument(1);
 
-
-        STRICT_EXPECTED_CALL(STRING_construct(TEST_IOTHUBNAME "." TEST_IOTHUBSUFFIX)); /*this is starting to build the path that the SAS token authenticates*/
-        STRICT_EXPECTED_CALL(STRING_concat(IGNORED_PTR_ARG, "/devices/")) /*this is building the path that the SAS token authenticates*/
-            .IgnoreArgument_handle();
-        STRICT_EXPECTED_CALL(STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is building the path that the SAS token authenticates*/
-            .IgnoreArgument_s1()
-            .IgnoreArgument_s2();
-        STRICT_EXPECTED_CALL(STRING_new());/*this is needed for HTTPAPIEX_SAS_Create -it needs an empty STRING_HANDLE*/
-
-        STRICT_EXPECTED_CALL(HTTPAPIEX_SAS_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreAllArguments();
         STRICT_EXPECTED_CALL(STRING_c_str(IGNORED_PTR_ARG))
             .IgnoreArgument_handle();
         STRICT_EXPECTED_CALL(HTTPAPIEX_SAS_ExecuteRequest(
@@ -2351,12 +2886,6 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_deviceKey_when_step1_httpStatusCode_i
             .IgnoreArgument_responseContent()
             .CopyOutArgumentBuffer_statusCode(&FourHundred, sizeof(FourHundred))
             ;
-        STRICT_EXPECTED_CALL(HTTPAPIEX_SAS_Destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument_handle();
-        STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG)) /*the empty STRING_new*/
-            .IgnoreArgument_handle();
-        STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG)) /*the build the path that the SAS token authenticates*/
-            .IgnoreArgument_handle();
 
         STRICT_EXPECTED_CALL(BUFFER_delete(iotHubHttpMessageBodyResponse1))
             .IgnoreArgument(1);
@@ -2370,8 +2899,6 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_deviceKey_when_step1_httpStatusCode_i
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(STRING_delete(correlationId))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(HTTPAPIEX_Destroy(iotHubHttpApiExHandle))
-        .IgnoreArgument(1);
 
     ///act
     IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_UploadToBlob_Impl(h, "text.txt", &c, 1);
@@ -2393,11 +2920,6 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_deviceKey_when_step3_httpStatusCode_i
     unsigned char c = '3';
     umock_c_reset_all_calls();
 
-    HTTPAPIEX_HANDLE iotHubHttpApiExHandle;
-    STRICT_EXPECTED_CALL(HTTPAPIEX_Create(TEST_IOTHUBNAME "." TEST_IOTHUBSUFFIX))
-        .CaptureReturn(&iotHubHttpApiExHandle)
-        .IgnoreArgument(1);
-
     STRING_HANDLE correlationId;
     STRICT_EXPECTED_CALL(STRING_new())
         .CaptureReturn(&correlationId);
@@ -2439,17 +2961,6 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_deviceKey_when_step3_httpStatusCode_i
         STRICT_EXPECTED_CALL(HTTPHeaders_AddHeaderNameValuePair(iotHubHttpRequestHeaders1, "Authorization", "")) /*14*/
             .IgnoreArgument(1);
 
-
-        STRICT_EXPECTED_CALL(STRING_construct(TEST_IOTHUBNAME "." TEST_IOTHUBSUFFIX)); /*this is starting to build the path that the SAS token authenticates*/
-        STRICT_EXPECTED_CALL(STRING_concat(IGNORED_PTR_ARG, "/devices/")) /*this is building the path that the SAS token authenticates*/
-            .IgnoreArgument_handle();
-        STRICT_EXPECTED_CALL(STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is building the path that the SAS token authenticates*/
-            .IgnoreArgument_s1()
-            .IgnoreArgument_s2();
-        STRICT_EXPECTED_CALL(STRING_new());/*this is needed for HTTPAPIEX_SAS_Create -it needs an empty STRING_HANDLE*/
-
-        STRICT_EXPECTED_CALL(HTTPAPIEX_SAS_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreAllArguments();
         STRICT_EXPECTED_CALL(STRING_c_str(IGNORED_PTR_ARG))
             .IgnoreArgument_handle();
         STRICT_EXPECTED_CALL(HTTPAPIEX_SAS_ExecuteRequest( /*20*/
@@ -2473,12 +2984,6 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_deviceKey_when_step3_httpStatusCode_i
             .IgnoreArgument_responseContent()
             .CopyOutArgumentBuffer_statusCode(&TwoHundred, sizeof(TwoHundred))
             ;
-        STRICT_EXPECTED_CALL(HTTPAPIEX_SAS_Destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument_handle();
-        STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG)) /*the empty STRING_new*/
-            .IgnoreArgument_handle();
-        STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG)) /*the build the path that the SAS token authenticates*/
-            .IgnoreArgument_handle();
 
         unsigned char* iotHubHttpMessageBodyResponse1_unsigned_char = (unsigned char*)TEST_DEFAULT_STRING_VALUE;
         size_t iotHubHttpMessageBodyResponse1_size;
@@ -2576,10 +3081,11 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_deviceKey_when_step3_httpStatusCode_i
             .CaptureReturn(&sasUri_as_const_char)
             .IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(Blob_UploadFromSasUri(sasUri_as_const_char, &c, 1, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        STRICT_EXPECTED_CALL(Blob_UploadFromSasUriOnConnection(IGNORED_PTR_ARG, sasUri_as_const_char, &c, 1, NULL, NULL, 1, NULL, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
             .IgnoreArgument(1)
-            .IgnoreArgument(4)
-            .IgnoreArgument(5)
+            .IgnoreArgument(2)
+            .IgnoreArgument(9)
+            .IgnoreArgument(10)
             .CopyOutArgumentBuffer_httpStatus(&TwoHundred, sizeof(TwoHundred))
             ;
         /*some snprintfs happen here... */
@@ -2600,18 +3106,6 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_deviceKey_when_step3_httpStatusCode_i
 
     {/*step3*/
 
-        STRING_HANDLE uriResource;
-        STRICT_EXPECTED_CALL(STRING_construct(TEST_IOTHUBNAME "." TEST_IOTHUBSUFFIX))
-            .CaptureReturn(&uriResource);
-
-        STRICT_EXPECTED_CALL(STRING_concat(uriResource, "/devices/"))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(STRING_concat_with_STRING(uriResource, IGNORED_PTR_ARG))
-            .IgnoreArgument(1)
-            .IgnoreArgument(2);
-        STRICT_EXPECTED_CALL(STRING_concat(uriResource, "/files/notifications"))
-            .IgnoreArgument(1);
-
         STRING_HANDLE relativePathNotification;
         STRICT_EXPECTED_CALL(STRING_construct("/devices/"))
             .CaptureReturn(&relativePathNotification);
@@ -2632,9 +3126,6 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_deviceKey_when_step3_httpStatusCode_i
         STRICT_EXPECTED_CALL(STRING_concat(relativePathNotification, TEST_API_VERSION))
             .IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(STRING_new());
-        STRICT_EXPECTED_CALL(HTTPAPIEX_SAS_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreAllArguments();
         STRICT_EXPECTED_CALL(STRING_c_str(IGNORED_PTR_ARG))
             .IgnoreArgument_handle();
         STRICT_EXPECTED_CALL(HTTPAPIEX_SAS_ExecuteRequest(
@@ -2658,15 +3149,9 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_deviceKey_when_step3_httpStatusCode_i
             .IgnoreArgument_responseContent()
             .CopyOutArgumentBuffer_statusCode(&FourHundred, sizeof(FourHundred))
             ;
-        STRICT_EXPECTED_CALL(HTTPAPIEX_SAS_Destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument_handle();
-        STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument_handle();
 
         STRICT_EXPECTED_CALL(STRING_delete(relativePathNotification)) /*70*/
             .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(STRING_delete(uriResource))
-            .IgnoreArgument(1);
     }
 
     STRICT_EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG))
@@ -2684,8 +3169,6 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_deviceKey_when_step3_httpStatusCode_i
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(STRING_delete(correlationId))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(HTTPAPIEX_Destroy(iotHubHttpApiExHandle))
-        .IgnoreArgument(1);
 
     ///act
     IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_UploadToBlob_Impl(h, "text.txt", &c, 1);
@@ -2698,7 +3181,6 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_deviceKey_when_step3_httpStatusCode_i
     IoTHubClient_LL_UploadToBlob_Destroy(h);
 }
 
-/*Tests_SRS_IOTHUBCLIENT_LL_02_089: [ If creating the HTTPAPIEX_SAS_HANDLE fails then IoTHubClient_LL_UploadToBlob shall fail and return IOTHUB_CLIENT_ERROR. ]*/
 /*Tests_SRS_IOTHUBCLIENT_LL_02_079: [ If HTTPAPIEX_SAS_ExecuteRequest fails then IoTHubClient_LL_UploadToBlob shall fail and return IOTHUB_CLIENT_ERROR. ]*/
 TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_deviceKey_unhappypaths)
 {
@@ -2712,11 +3194,6 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_deviceKey_unhappypaths)
     unsigned char c = '3';
     umock_c_reset_all_calls();
 
-    HTTPAPIEX_HANDLE iotHubHttpApiExHandle;
-    STRICT_EXPECTED_CALL(HTTPAPIEX_Create(TEST_IOTHUBNAME "." TEST_IOTHUBSUFFIX))
-        .CaptureReturn(&iotHubHttpApiExHandle)
-        .IgnoreArgument(1);
-
     STRING_HANDLE correlationId;
     STRICT_EXPECTED_CALL(STRING_new())
         .CaptureReturn(&correlationId);
@@ -2758,17 +3235,6 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_deviceKey_unhappypaths)
         STRICT_EXPECTED_CALL(HTTPHeaders_AddHeaderNameValuePair(iotHubHttpRequestHeaders1, "Authorization", "")) /*14*/
             .IgnoreArgument(1);
 
-
-        STRICT_EXPECTED_CALL(STRING_construct(TEST_IOTHUBNAME "." TEST_IOTHUBSUFFIX)); /*this is starting to build the path that the SAS token authenticates*/
-        STRICT_EXPECTED_CALL(STRING_concat(IGNORED_PTR_ARG, "/devices/")) /*this is building the path that the SAS token authenticates*/
-            .IgnoreArgument_handle();
-        STRICT_EXPECTED_CALL(STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is building the path that the SAS token authenticates*/
-            .IgnoreArgument_s1()
-            .IgnoreArgument_s2();
-        STRICT_EXPECTED_CALL(STRING_new());/*this is needed for HTTPAPIEX_SAS_Create -it needs an empty STRING_HANDLE*/
-
-        STRICT_EXPECTED_CALL(HTTPAPIEX_SAS_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreAllArguments();
         STRICT_EXPECTED_CALL(STRING_c_str(IGNORED_PTR_ARG))
             .IgnoreArgument_handle();
         STRICT_EXPECTED_CALL(HTTPAPIEX_SAS_ExecuteRequest( /*20*/
@@ -2792,12 +3258,6 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_deviceKey_unhappypaths)
             .IgnoreArgument_responseContent()
             .CopyOutArgumentBuffer_statusCode(&TwoHundred, sizeof(TwoHundred))
             ;
-        STRICT_EXPECTED_CALL(HTTPAPIEX_SAS_Destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument_handle();
-        STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG)) /*the empty STRING_new*/
-            .IgnoreArgument_handle();
-        STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG)) /*the build the path that the SAS token authenticates*/
-            .IgnoreArgument_handle();
 
         unsigned char* iotHubHttpMessageBodyResponse1_unsigned_char = (unsigned char*)TEST_DEFAULT_STRING_VALUE;
         size_t iotHubHttpMessageBodyResponse1_size;
@@ -2895,10 +3355,11 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_deviceKey_unhappypaths)
             .CaptureReturn(&sasUri_as_const_char)
             .IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(Blob_UploadFromSasUri(sasUri_as_const_char, &c, 1, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        STRICT_EXPECTED_CALL(Blob_UploadFromSasUriOnConnection(IGNORED_PTR_ARG, sasUri_as_const_char, &c, 1, NULL, NULL, 1, NULL, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
             .IgnoreArgument(1)
-            .IgnoreArgument(4)
-            .IgnoreArgument(5)
+            .IgnoreArgument(2)
+            .IgnoreArgument(9)
+            .IgnoreArgument(10)
             .CopyOutArgumentBuffer_httpStatus(&TwoHundred, sizeof(TwoHundred))
             ;
         /*some snprintfs happen here... */
@@ -2919,18 +3380,6 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_deviceKey_unhappypaths)
 
     {/*step3*/
 
-        STRING_HANDLE uriResource;
-        STRICT_EXPECTED_CALL(STRING_construct(TEST_IOTHUBNAME "." TEST_IOTHUBSUFFIX))
-            .CaptureReturn(&uriResource);
-
-        STRICT_EXPECTED_CALL(STRING_concat(uriResource, "/devices/"))
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(STRING_concat_with_STRING(uriResource, IGNORED_PTR_ARG))
-            .IgnoreArgument(1)
-            .IgnoreArgument(2);
-        STRICT_EXPECTED_CALL(STRING_concat(uriResource, "/files/notifications"))
-            .IgnoreArgument(1);
-
         STRING_HANDLE relativePathNotification;
         STRICT_EXPECTED_CALL(STRING_construct("/devices/"))
             .CaptureReturn(&relativePathNotification);
@@ -2951,9 +3400,6 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_deviceKey_unhappypaths)
         STRICT_EXPECTED_CALL(STRING_concat(relativePathNotification, TEST_API_VERSION))
             .IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(STRING_new());
-        STRICT_EXPECTED_CALL(HTTPAPIEX_SAS_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreAllArguments();
         STRICT_EXPECTED_CALL(STRING_c_str(IGNORED_PTR_ARG))
             .IgnoreArgument_handle();
         EXPECTED_CALL(HTTPAPIEX_SAS_ExecuteRequest(
@@ -2974,15 +3420,9 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_deviceKey_unhappypaths)
             .IgnoreArgument_requestContent()
             .CopyOutArgumentBuffer_statusCode(&TwoHundred, sizeof(TwoHundred))
             ;
-        STRICT_EXPECTED_CALL(HTTPAPIEX_SAS_Destroy(IGNORED_PTR_ARG))
-            .IgnoreArgument_handle();
-        STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG))
-            .IgnoreArgument_handle();
 
         STRICT_EXPECTED_CALL(STRING_delete(relativePathNotification)) /*70*/
             .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(STRING_delete(uriResource))
-            .IgnoreArgument(1);
     }
 
     STRICT_EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG))
@@ -3000,40 +3440,30 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_deviceKey_unhappypaths)
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(STRING_delete(correlationId))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(HTTPAPIEX_Destroy(iotHubHttpApiExHandle))
-        .IgnoreArgument(1);
 
     umock_c_negative_tests_snapshot();
 
     size_t calls_that_cannot_fail[] = {
-        19, /*STRING_c_str*/
-        21, /*HTTPAPIEX_SAS_Destroy*/
-        22, /*STRING_delete*/
-        23, /*STRING_delete*/
-        24, /*BUFFER_u_char*/
-        25, /*BUFFER_length*/
-        27, /*STRING_c_str*/
-        43, /*json_value_free*/
-        44, /*STRING_delete*/
-        45, /*BUFFER_delete*/
-        46, /*STRING_delete*/
+        13, /*STRING_c_str*/
+        15, /*BUFFER_u_char*/
+        16, /*BUFFER_length*/
+        18, /*STRING_c_str*/
+        34, /*json_value_free*/
+        35, /*STRING_delete*/
+        36, /*BUFFER_delete*/
+        37, /*STRING_delete*/
+        39, /*STRING_c_str*/
+        41, /*BUFFER_u_char*/
+        43, /*BUFFER_u_char*/
         48, /*STRING_c_str*/
-        50, /*BUFFER_u_char*/
-        52, /*BUFFER_u_char*/
-        61, /*STRING_c_str*/
-        66, /*STRING_c_str*/
-        68, /*HTTPAPIEX_SAS_Destroy*/
-        69, /*STRING_delete*/
-        70, /*STRING_delete*/
-        71, /*STRING_delete*/
-        72, /*BUFFER_delete*/
-        73, /*gballoc_free*/
-        74, /*BUFFER_delete*/
-        75, /*HTTPHeaders_Free*/
-        76, /*STRING_delete*/
-        77, /*STRING_delete*/
-        78, /*HTTPAPIEX_Destroy*/
-
+        51, /*STRING_c_str*/
+        52, /*STRING_delete*/
+        53, /*BUFFER_delete*/
+        54, /*gballoc_free*/
+        55, /*BUFFER_delete*/
+        56, /*HTTPHeaders_Free*/
+        57, /*STRING_delete*/
+        58, /*STRING_delete*/
     };
 
     for (size_t i = 0; i < umock_c_negative_tests_call_count(); i++)
@@ -3066,5 +3496,115 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_deviceKey_unhappypaths)
     IoTHubClient_LL_UploadToBlob_Destroy(h);
 }
 
+/*Tests_SRS_IOTHUBCLIENT_LL_02_141: [ If handle, optionName or value is NULL then IoTHubClient_LL_UploadToBlob_SetOption shall fail and return IOTHUB_CLIENT_INVALID_ARG. ]*/
+TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_SetOption_with_NULL_handle_fails)
+{
+    ///arrange
+    size_t concurrency = 8;
+
+    ///act
+    IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_UploadToBlob_SetOption(NULL, "blobUploadConcurrency", &concurrency);
+
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_141: [ If handle, optionName or value is NULL then IoTHubClient_LL_UploadToBlob_SetOption shall fail and return IOTHUB_CLIENT_INVALID_ARG. ]*/
+TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_SetOption_with_NULL_optionName_fails)
+{
+    ///arrange
+    IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE h = IoTHubClient_LL_UploadToBlob_Create(&TEST_CONFIG_SAS);
+    size_t concurrency = 8;
+    umock_c_reset_all_calls();
+
+    ///act
+    IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_UploadToBlob_SetOption(h, NULL, &concurrency);
+
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubClient_LL_UploadToBlob_Destroy(h);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_141: [ If handle, optionName or value is NULL then IoTHubClient_LL_UploadToBlob_SetOption shall fail and return IOTHUB_CLIENT_INVALID_ARG. ]*/
+TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_SetOption_with_NULL_value_fails)
+{
+    ///arrange
+    IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE h = IoTHubClient_LL_UploadToBlob_Create(&TEST_CONFIG_SAS);
+    umock_c_reset_all_calls();
+
+    ///act
+    IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_UploadToBlob_SetOption(h, "blobUploadConcurrency", NULL);
+
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubClient_LL_UploadToBlob_Destroy(h);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_142: [ If optionName is not an option of IoTHubClient_LL_UploadToBlob then IoTHubClient_LL_UploadToBlob_SetOption shall fail and return IOTHUB_CLIENT_INVALID_ARG. ]*/
+TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_SetOption_with_unknown_option_fails)
+{
+    ///arrange
+    IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE h = IoTHubClient_LL_UploadToBlob_Create(&TEST_CONFIG_SAS);
+    size_t concurrency = 8;
+    umock_c_reset_all_calls();
+
+    ///act
+    IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_UploadToBlob_SetOption(h, "someOption", &concurrency);
+
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubClient_LL_UploadToBlob_Destroy(h);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_138: [ "blobUploadConcurrency" - IoTHubClient_LL_UploadToBlob shall upload up to `*value` blocks of a blob at the same time, each on its own connection. value is a pointer to a size_t. ]*/
+TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_SetOption_blobUploadConcurrency_succeeds)
+{
+    ///arrange
+    IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE h = IoTHubClient_LL_UploadToBlob_Create(&TEST_CONFIG_SAS);
+    size_t concurrency = 8;
+    umock_c_reset_all_calls();
+
+    ///act
+    IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_UploadToBlob_SetOption(h, "blobUploadConcurrency", &concurrency);
+
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubClient_LL_UploadToBlob_Destroy(h);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_139: [ If the value of "blobUploadConcurrency" is 0 then IoTHubClient_LL_SetOption shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_SetOption_blobUploadConcurrency_0_fails)
+{
+    ///arrange
+    IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE h = IoTHubClient_LL_UploadToBlob_Create(&TEST_CONFIG_SAS);
+    size_t concurrency = 0;
+    umock_c_reset_all_calls();
+
+    ///act
+    IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_UploadToBlob_SetOption(h, "blobUploadConcurrency", &concurrency);
+
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubClient_LL_UploadToBlob_Destroy(h);
+}
+
 END_TEST_SUITE(iothubclient_ll_uploadtoblob_unittests)
 #endif /*DONT_USE_UPLOADTOBLOB*/
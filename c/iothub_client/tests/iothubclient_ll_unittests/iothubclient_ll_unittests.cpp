@@ -2,6 +2,7 @@
 // Licensed under the MIT license. See LICENSE file in the project root for full license information.
 
 #include <cstdlib>
+#include <cstdio>
 #ifdef _CRTDBG_MAP_ALLOC
 #include <crtdbg.h>
 #endif
@@ -19,6 +20,8 @@
 #include "azure_c_shared_utility/doublylinkedlist.h"
 #include "iothub_client_private.h"
 #include "iothub_transport_ll.h"
+#include "iothub_client_ll_messagestore.h"
+#include "iothub_client_lz4.h"
 
 #ifndef DONT_USE_UPLOADTOBLOB
 #include "iothub_client_ll_uploadtoblob.h"
@@ -64,6 +67,15 @@ static MICROMOCK_GLOBAL_SEMAPHORE_HANDLE g_dllByDll;
 //Check ProtocolGateway Configuration.
 static bool checkProtocolGatewayHostName;
 static bool checkProtocolGatewayIsNull;
+static PDLIST_ENTRY lastRegisteredWaitingToSend; /*the waitingToSend list given to the transport*/
+static IOTHUB_MESSAGE_HANDLE storedMessageToReplay; /*IoTHubClient_LL_MessageStore_Replay replays this message when it is not NULL*/
+static bool rollFirstMessageBackOnDoWork; /*FAKE_IoTHubTransport_DoWork moves the first message of waitingToSend to its tail, like a transport giving back a message it could not send*/
+static IOTHUB_CLIENT_LL_HANDLE lastRegisteredClient; /*the IoTHubClient_LL handle given to the transport*/
+static PDLIST_ENTRY inFlightOnTransportDestroy; /*FAKE_IoTHubTransport_Destroy completes these messages with IOTHUB_BATCHSTATE_FAILED, like a transport destroyed while messages are in flight*/
+
+#define TEST_MESSAGESTORE_PATH "messages.log"
+#define TEST_MESSAGESTORE_RECORD_ID 5
+#define TEST_MESSAGESTORE_REPLAYED_RECORD_ID 3
 
 #define TEST_DEVICE_ID "theidofTheDevice"
 #define TEST_DEVICE_KEY "theKeyoftheDevice"
@@ -82,6 +94,15 @@ static bool checkProtocolGatewayIsNull;
 
 #define TEST_DEVICEMESSAGE_HANDLE (IOTHUB_MESSAGE_HANDLE)0x52
 #define TEST_DEVICEMESSAGE_HANDLE_2 (IOTHUB_MESSAGE_HANDLE)0x53
+#define TEST_DEVICEMESSAGE_SIZE 10
+#define TEST_COMPRESSED_MESSAGE_HANDLE (IOTHUB_MESSAGE_HANDLE)0x54
+#define TEST_COMPRESSED_SIZE 4
+#define TEST_MESSAGE_ID "theMessageId"
+/*the properties of a message are mocked as the handle of the message + 0x100*/
+#define TEST_MESSAGE_PROPERTIES(messageHandle) ((MAP_HANDLE)((uintptr_t)(messageHandle) + 0x100))
+static const unsigned char TEST_DEVICEMESSAGE_BUFFER[TEST_DEVICEMESSAGE_SIZE] = { 'a', 'a', 'a', 'a', 'a', 'a', 'a', 'a', 'a', 'a' };
+static const char* TEST_PROPERTY_KEYS[] = { "theKey" };
+static const char* TEST_PROPERTY_VALUES[] = { "theValue" };
 #define TEST_IOTHUB_CLIENT_LL_HANDLE    (IOTHUB_CLIENT_LL_HANDLE)0x4242
 
 #define TEST_STRING_HANDLE (STRING_HANDLE)0x46
@@ -232,9 +253,15 @@ public:
 		MOCK_METHOD_END(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK)
 
 		MOCK_STATIC_METHOD_1(, void, FAKE_IoTHubTransport_Destroy, TRANSPORT_LL_HANDLE, handle)
+		if (inFlightOnTransportDestroy != NULL)
+		{
+			IoTHubClient_LL_SendComplete(lastRegisteredClient, inFlightOnTransportDestroy, IOTHUB_BATCHSTATE_FAILED);
+		}
 		MOCK_VOID_METHOD_END()
 
 		MOCK_STATIC_METHOD_4(, IOTHUB_DEVICE_HANDLE, FAKE_IoTHubTransport_Register, TRANSPORT_LL_HANDLE, handle, const IOTHUB_DEVICE_CONFIG*, device, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle, PDLIST_ENTRY, waitingToSend)
+		lastRegisteredWaitingToSend = waitingToSend;
+		lastRegisteredClient = iotHubClientHandle;
 		MOCK_METHOD_END(IOTHUB_DEVICE_HANDLE, (IOTHUB_DEVICE_HANDLE)handle)
 
 		MOCK_STATIC_METHOD_1(, void, FAKE_IoTHubTransport_Unregister, IOTHUB_DEVICE_HANDLE, handle)
@@ -247,6 +274,12 @@ public:
 		MOCK_VOID_METHOD_END()
 
 		MOCK_STATIC_METHOD_2(, void, FAKE_IoTHubTransport_DoWork, TRANSPORT_LL_HANDLE, handle, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle)
+		if (rollFirstMessageBackOnDoWork && !BASEIMPLEMENTATION::DList_IsListEmpty(lastRegisteredWaitingToSend))
+		{
+			PDLIST_ENTRY first = lastRegisteredWaitingToSend->Flink;
+			(void)BASEIMPLEMENTATION::DList_RemoveEntryList(first);
+			BASEIMPLEMENTATION::DList_InsertTailList(lastRegisteredWaitingToSend, first);
+		}
 		MOCK_VOID_METHOD_END()
 
 		MOCK_STATIC_METHOD_2(, IOTHUB_CLIENT_RESULT, FAKE_IoTHubTransport_GetSendStatus, TRANSPORT_LL_HANDLE, handle, IOTHUB_CLIENT_STATUS*, iotHubClientStatus)
@@ -265,6 +298,54 @@ public:
 		MOCK_STATIC_METHOD_1(, void, IoTHubMessage_Destroy, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle)
 		MOCK_VOID_METHOD_END()
 
+	MOCK_STATIC_METHOD_1(, IOTHUBMESSAGE_CONTENT_TYPE, IoTHubMessage_GetContentType, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle)
+		MOCK_METHOD_END(IOTHUBMESSAGE_CONTENT_TYPE, IOTHUBMESSAGE_BYTEARRAY)
+
+	MOCK_STATIC_METHOD_3(, IOTHUB_MESSAGE_RESULT, IoTHubMessage_GetByteArray, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle, const unsigned char**, buffer, size_t*, size)
+		*buffer = TEST_DEVICEMESSAGE_BUFFER;
+		*size = (iotHubMessageHandle == TEST_COMPRESSED_MESSAGE_HANDLE) ? TEST_COMPRESSED_SIZE : TEST_DEVICEMESSAGE_SIZE;
+	MOCK_METHOD_END(IOTHUB_MESSAGE_RESULT, IOTHUB_MESSAGE_OK)
+
+	MOCK_STATIC_METHOD_1(, const char*, IoTHubMessage_GetString, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle)
+		MOCK_METHOD_END(const char*, NULL)
+
+	MOCK_STATIC_METHOD_2(, IOTHUB_MESSAGE_HANDLE, IoTHubMessage_CreateFromByteArray, const unsigned char*, byteArray, size_t, size)
+	MOCK_METHOD_END(IOTHUB_MESSAGE_HANDLE, TEST_COMPRESSED_MESSAGE_HANDLE)
+
+	MOCK_STATIC_METHOD_1(, MAP_HANDLE, IoTHubMessage_Properties, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle)
+	MOCK_METHOD_END(MAP_HANDLE, TEST_MESSAGE_PROPERTIES(iotHubMessageHandle))
+
+	MOCK_STATIC_METHOD_1(, const char*, IoTHubMessage_GetMessageId, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle)
+	MOCK_METHOD_END(const char*, TEST_MESSAGE_ID)
+
+	MOCK_STATIC_METHOD_2(, IOTHUB_MESSAGE_RESULT, IoTHubMessage_SetMessageId, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle, const char*, messageId)
+	MOCK_METHOD_END(IOTHUB_MESSAGE_RESULT, IOTHUB_MESSAGE_OK)
+
+	MOCK_STATIC_METHOD_1(, const char*, IoTHubMessage_GetCorrelationId, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle)
+	MOCK_METHOD_END(const char*, NULL)
+
+	MOCK_STATIC_METHOD_2(, IOTHUB_MESSAGE_RESULT, IoTHubMessage_SetCorrelationId, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle, const char*, correlationId)
+	MOCK_METHOD_END(IOTHUB_MESSAGE_RESULT, IOTHUB_MESSAGE_OK)
+
+	MOCK_STATIC_METHOD_3(, MAP_RESULT, Map_ContainsKey, MAP_HANDLE, handle, const char*, key, bool*, keyExists)
+		*keyExists = false;
+	MOCK_METHOD_END(MAP_RESULT, MAP_OK)
+
+	MOCK_STATIC_METHOD_4(, MAP_RESULT, Map_GetInternals, MAP_HANDLE, handle, const char*const**, keys, const char*const**, values, size_t*, count)
+		*keys = TEST_PROPERTY_KEYS;
+		*values = TEST_PROPERTY_VALUES;
+		*count = 1;
+	MOCK_METHOD_END(MAP_RESULT, MAP_OK)
+
+	MOCK_STATIC_METHOD_3(, MAP_RESULT, Map_AddOrUpdate, MAP_HANDLE, handle, const char*, key, const char*, value)
+	MOCK_METHOD_END(MAP_RESULT, MAP_OK)
+
+	MOCK_STATIC_METHOD_1(, size_t, IoTHubClient_LZ4_GetMaxCompressedLength, size_t, size)
+	MOCK_METHOD_END(size_t, size + 16)
+
+	MOCK_STATIC_METHOD_4(, size_t, IoTHubClient_LZ4_Compress, unsigned char*, destination, size_t, destinationSize, const unsigned char*, source, size_t, size)
+	MOCK_METHOD_END(size_t, TEST_COMPRESSED_SIZE)
+
 		MOCK_STATIC_METHOD_1(, time_t, get_time, time_t*, t)
 		MOCK_METHOD_END(time_t, time(t));
 
@@ -313,6 +394,31 @@ public:
 		MOCK_STATIC_METHOD_2(, int, tickcounter_get_current_ms, TICK_COUNTER_HANDLE, tick_counter, uint64_t*, current_ms);
     MOCK_METHOD_END(int, 0)
 
+	MOCK_STATIC_METHOD_1(, IOTHUB_CLIENT_LL_MESSAGESTORE_HANDLE, IoTHubClient_LL_MessageStore_Create, const char*, path)
+		IOTHUB_CLIENT_LL_MESSAGESTORE_HANDLE result2 = (IOTHUB_CLIENT_LL_MESSAGESTORE_HANDLE)BASEIMPLEMENTATION::gballoc_malloc(1);
+	MOCK_METHOD_END(IOTHUB_CLIENT_LL_MESSAGESTORE_HANDLE, result2)
+
+	MOCK_STATIC_METHOD_3(, int, IoTHubClient_LL_MessageStore_Replay, IOTHUB_CLIENT_LL_MESSAGESTORE_HANDLE, handle, IOTHUB_CLIENT_LL_MESSAGESTORE_REPLAY_CALLBACK, replayCallback, void*, context)
+		if (storedMessageToReplay != NULL)
+		{
+			replayCallback(storedMessageToReplay, TEST_MESSAGESTORE_REPLAYED_RECORD_ID, context);
+		}
+	MOCK_METHOD_END(int, 0)
+
+	MOCK_STATIC_METHOD_3(, int, IoTHubClient_LL_MessageStore_Append, IOTHUB_CLIENT_LL_MESSAGESTORE_HANDLE, handle, IOTHUB_MESSAGE_HANDLE, messageHandle, uint64_t*, recordId)
+		*recordId = TEST_MESSAGESTORE_RECORD_ID;
+	MOCK_METHOD_END(int, 0)
+
+	MOCK_STATIC_METHOD_2(, int, IoTHubClient_LL_MessageStore_Remove, IOTHUB_CLIENT_LL_MESSAGESTORE_HANDLE, handle, uint64_t, recordId)
+	MOCK_METHOD_END(int, 0)
+
+	MOCK_STATIC_METHOD_1(, int, IoTHubClient_LL_MessageStore_Flush, IOTHUB_CLIENT_LL_MESSAGESTORE_HANDLE, handle)
+	MOCK_METHOD_END(int, 0)
+
+	MOCK_STATIC_METHOD_1(, void, IoTHubClient_LL_MessageStore_Destroy, IOTHUB_CLIENT_LL_MESSAGESTORE_HANDLE, handle)
+		BASEIMPLEMENTATION::gballoc_free(handle);
+	MOCK_VOID_METHOD_END()
+
 #ifndef DONT_USE_UPLOADTOBLOB
     MOCK_STATIC_METHOD_1(, IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE, IoTHubClient_LL_UploadToBlob_Create, const IOTHUB_CLIENT_CONFIG*, config)
         IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE result2 = (IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE)BASEIMPLEMENTATION::gballoc_malloc(1);
@@ -321,6 +427,15 @@ public:
     MOCK_STATIC_METHOD_4(, IOTHUB_CLIENT_RESULT, IoTHubClient_LL_UploadToBlob_Impl, IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE, handle, const char*, destinationFileName, const unsigned char*, source, size_t, size)
     MOCK_METHOD_END(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK)
 
+    MOCK_STATIC_METHOD_4(, IOTHUB_CLIENT_RESULT, IoTHubClient_LL_UploadToBlobFromReader_Impl, IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE, handle, const char*, destinationFileName, IOTHUB_CLIENT_FILE_UPLOAD_READ_CALLBACK, getData, void*, context)
+    MOCK_METHOD_END(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK)
+
+    MOCK_STATIC_METHOD_7(, IOTHUB_CLIENT_RESULT, IoTHubClient_LL_UploadToBlobFromReaderResumable_Impl, IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE, handle, const char*, destinationFileName, IOTHUB_CLIENT_FILE_UPLOAD_READ_CALLBACK, getData, void*, context, size_t, size, const char*, sourceVersion, const char*, manifestFileName)
+    MOCK_METHOD_END(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK)
+
+    MOCK_STATIC_METHOD_3(, IOTHUB_CLIENT_RESULT, IoTHubClient_LL_UploadToBlob_SetOption, IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE, handle, const char*, optionName, const void*, value)
+    MOCK_METHOD_END(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK)
+
     MOCK_STATIC_METHOD_1(, void, IoTHubClient_LL_UploadToBlob_Destroy, IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE, handle)
         BASEIMPLEMENTATION::gballoc_free(handle);
     MOCK_VOID_METHOD_END()
@@ -356,6 +471,22 @@ DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubClientLLMocks, , IOTHUBMESSAGE_DISPOSITION_R
 
 DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubClientLLMocks, , IOTHUB_MESSAGE_HANDLE, IoTHubMessage_Clone, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle);
 DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubClientLLMocks, , void, IoTHubMessage_Destroy, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle);
+DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubClientLLMocks, , IOTHUBMESSAGE_CONTENT_TYPE, IoTHubMessage_GetContentType, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle);
+DECLARE_GLOBAL_MOCK_METHOD_3(CIoTHubClientLLMocks, , IOTHUB_MESSAGE_RESULT, IoTHubMessage_GetByteArray, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle, const unsigned char**, buffer, size_t*, size);
+DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubClientLLMocks, , const char*, IoTHubMessage_GetString, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle);
+DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubClientLLMocks, , IOTHUB_MESSAGE_HANDLE, IoTHubMessage_CreateFromByteArray, const unsigned char*, byteArray, size_t, size);
+DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubClientLLMocks, , MAP_HANDLE, IoTHubMessage_Properties, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle);
+DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubClientLLMocks, , const char*, IoTHubMessage_GetMessageId, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle);
+DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubClientLLMocks, , IOTHUB_MESSAGE_RESULT, IoTHubMessage_SetMessageId, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle, const char*, messageId);
+DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubClientLLMocks, , const char*, IoTHubMessage_GetCorrelationId, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle);
+DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubClientLLMocks, , IOTHUB_MESSAGE_RESULT, IoTHubMessage_SetCorrelationId, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle, const char*, correlationId);
+
+DECLARE_GLOBAL_MOCK_METHOD_3(CIoTHubClientLLMocks, , MAP_RESULT, Map_ContainsKey, MAP_HANDLE, handle, const char*, key, bool*, keyExists);
+DECLARE_GLOBAL_MOCK_METHOD_4(CIoTHubClientLLMocks, , MAP_RESULT, Map_GetInternals, MAP_HANDLE, handle, const char*const**, keys, const char*const**, values, size_t*, count);
+DECLARE_GLOBAL_MOCK_METHOD_3(CIoTHubClientLLMocks, , MAP_RESULT, Map_AddOrUpdate, MAP_HANDLE, handle, const char*, key, const char*, value);
+
+DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubClientLLMocks, , size_t, IoTHubClient_LZ4_GetMaxCompressedLength, size_t, size);
+DECLARE_GLOBAL_MOCK_METHOD_4(CIoTHubClientLLMocks, , size_t, IoTHubClient_LZ4_Compress, unsigned char*, destination, size_t, destinationSize, const unsigned char*, source, size_t, size);
 
 DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubClientLLMocks, , time_t, get_time, time_t*, t);
 
@@ -376,9 +507,19 @@ DECLARE_GLOBAL_MOCK_METHOD_0(CIoTHubClientLLMocks, , TICK_COUNTER_HANDLE, tickco
 DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubClientLLMocks, , void, tickcounter_destroy, TICK_COUNTER_HANDLE, tick_counter);
 DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubClientLLMocks, , int, tickcounter_get_current_ms, TICK_COUNTER_HANDLE, tick_counter, uint64_t*, current_ms);
 
+DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubClientLLMocks, , IOTHUB_CLIENT_LL_MESSAGESTORE_HANDLE, IoTHubClient_LL_MessageStore_Create, const char*, path);
+DECLARE_GLOBAL_MOCK_METHOD_3(CIoTHubClientLLMocks, , int, IoTHubClient_LL_MessageStore_Replay, IOTHUB_CLIENT_LL_MESSAGESTORE_HANDLE, handle, IOTHUB_CLIENT_LL_MESSAGESTORE_REPLAY_CALLBACK, replayCallback, void*, context);
+DECLARE_GLOBAL_MOCK_METHOD_3(CIoTHubClientLLMocks, , int, IoTHubClient_LL_MessageStore_Append, IOTHUB_CLIENT_LL_MESSAGESTORE_HANDLE, handle, IOTHUB_MESSAGE_HANDLE, messageHandle, uint64_t*, recordId);
+DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubClientLLMocks, , int, IoTHubClient_LL_MessageStore_Remove, IOTHUB_CLIENT_LL_MESSAGESTORE_HANDLE, handle, uint64_t, recordId);
+DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubClientLLMocks, , int, IoTHubClient_LL_MessageStore_Flush, IOTHUB_CLIENT_LL_MESSAGESTORE_HANDLE, handle);
+DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubClientLLMocks, , void, IoTHubClient_LL_MessageStore_Destroy, IOTHUB_CLIENT_LL_MESSAGESTORE_HANDLE, handle);
+
 #ifndef DONT_USE_UPLOADTOBLOB
 DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubClientLLMocks, , IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE, IoTHubClient_LL_UploadToBlob_Create, const IOTHUB_CLIENT_CONFIG*, config);
 DECLARE_GLOBAL_MOCK_METHOD_4(CIoTHubClientLLMocks, , IOTHUB_CLIENT_RESULT, IoTHubClient_LL_UploadToBlob_Impl, IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE, handle, const char*, destinationFileName, const unsigned char*, source, size_t, size);
+DECLARE_GLOBAL_MOCK_METHOD_4(CIoTHubClientLLMocks, , IOTHUB_CLIENT_RESULT, IoTHubClient_LL_UploadToBlobFromReader_Impl, IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE, handle, const char*, destinationFileName, IOTHUB_CLIENT_FILE_UPLOAD_READ_CALLBACK, getData, void*, context);
+DECLARE_GLOBAL_MOCK_METHOD_7(CIoTHubClientLLMocks, , IOTHUB_CLIENT_RESULT, IoTHubClient_LL_UploadToBlobFromReaderResumable_Impl, IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE, handle, const char*, destinationFileName, IOTHUB_CLIENT_FILE_UPLOAD_READ_CALLBACK, getData, void*, context, size_t, size, const char*, sourceVersion, const char*, manifestFileName);
+DECLARE_GLOBAL_MOCK_METHOD_3(CIoTHubClientLLMocks, , IOTHUB_CLIENT_RESULT, IoTHubClient_LL_UploadToBlob_SetOption, IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE, handle, const char*, optionName, const void*, value);
 DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubClientLLMocks, , void, IoTHubClient_LL_UploadToBlob_Destroy, IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE, handle);
 #endif
 
@@ -427,6 +568,9 @@ TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
 	whenShallmalloc_fail = 0;
 	checkProtocolGatewayHostName = false;
 	checkProtocolGatewayIsNull = false;
+	storedMessageToReplay = NULL;
+	rollFirstMessageBackOnDoWork = false;
+	inFlightOnTransportDestroy = NULL;
 }
 
 TEST_FUNCTION_CLEANUP(TestMethodCleanup)
@@ -2709,6 +2853,11 @@ TEST_FUNCTION(IoTHubClient_LL_SendEventAsync_succeeds)
 	auto messageHandle = (IOTHUB_MESSAGE_HANDLE)1;
 	mocks.ResetAllCalls();
 
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(messageHandle));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3);
+
 	STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
 		.IgnoreArgument(1);
 
@@ -2784,6 +2933,11 @@ TEST_FUNCTION(IoTHubClient_LL_SendEventAsync_fails_when_IoTHubMessage_Clone_fail
 	auto messageHandle = (IOTHUB_MESSAGE_HANDLE)1;
 	mocks.ResetAllCalls();
 
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(messageHandle));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3);
+
 	STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
 		.IgnoreArgument(1);
 	STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)) /*because _Clone fails below*/
@@ -2815,6 +2969,11 @@ TEST_FUNCTION(IoTHubClient_LL_SendEventAsync_fails_when_current_ms_cannot_be_obt
 	auto messageHandle = (IOTHUB_MESSAGE_HANDLE)1;
 	mocks.ResetAllCalls();
 
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(messageHandle));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3);
+
 	STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
 		.IgnoreArgument(1);
 	STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)) /*because _Clone fails below*/
@@ -2844,6 +3003,11 @@ TEST_FUNCTION(IoTHubClient_LL_SendEventAsync_fails_when_malloc_fails)
 	auto messageHandle = (IOTHUB_MESSAGE_HANDLE)1;
 	mocks.ResetAllCalls();
 
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(messageHandle));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3);
+
 	whenShallmalloc_fail = currentmalloc_call+1;
 	STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
 		.IgnoreArgument(1);
@@ -2859,6 +3023,182 @@ TEST_FUNCTION(IoTHubClient_LL_SendEventAsync_fails_when_malloc_fails)
 	IoTHubClient_LL_Destroy(handle);
 }
 
+/*Tests_SRS_IOTHUBCLIENT_LL_02_101: [ IoTHubClient_LL_SendEventAsyncTakeOwnership shall validate its parameters the same way as IoTHubClient_LL_SendEventAsync does. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendEventAsyncTakeOwnership_with_NULL_iotHubClientHandle_fails)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+
+	///act
+	auto result = IoTHubClient_LL_SendEventAsyncTakeOwnership(NULL, (IOTHUB_MESSAGE_HANDLE)1, eventConfirmationCallback, (void*)1);
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+	mocks.AssertActualAndExpectedCalls();
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_101: [ IoTHubClient_LL_SendEventAsyncTakeOwnership shall validate its parameters the same way as IoTHubClient_LL_SendEventAsync does. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendEventAsyncTakeOwnership_with_NULL_eventConfirmationCallback_and_non_NULL_context_fails)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	auto handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	mocks.ResetAllCalls();
+
+	///act
+	auto result = IoTHubClient_LL_SendEventAsyncTakeOwnership(handle, (IOTHUB_MESSAGE_HANDLE)1, NULL, (void*)1);
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_102: [ IoTHubClient_LL_SendEventAsyncTakeOwnership shall add to the DLIST waitingToSend a new record holding eventMessageHandle itself, without cloning it. ]*/
+/*Tests_SRS_IOTHUBCLIENT_LL_02_104: [ Otherwise IoTHubClient_LL_SendEventAsyncTakeOwnership shall return IOTHUB_CLIENT_OK and IoTHubClient_LL shall destroy eventMessageHandle once its callback has been called. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendEventAsyncTakeOwnership_succeeds)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	auto handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_DEVICEMESSAGE_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_DEVICEMESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3);
+
+	STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+		.IgnoreArgument(1);
+
+	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2);
+
+	/*no IoTHubMessage_Clone*/
+
+	///act
+	auto result = IoTHubClient_LL_SendEventAsyncTakeOwnership(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)1);
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_103: [ If IoTHubClient_LL_SendEventAsyncTakeOwnership fails then the ownership of eventMessageHandle shall remain with the caller. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendEventAsyncTakeOwnership_fails_when_malloc_fails)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	auto handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_DEVICEMESSAGE_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_DEVICEMESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3);
+
+	whenShallmalloc_fail = currentmalloc_call + 1;
+	STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+		.IgnoreArgument(1);
+
+	/*no IoTHubMessage_Destroy, the message still belongs to the caller*/
+
+	///act
+	auto result = IoTHubClient_LL_SendEventAsyncTakeOwnership(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)1);
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_103: [ If IoTHubClient_LL_SendEventAsyncTakeOwnership fails then the ownership of eventMessageHandle shall remain with the caller. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendEventAsyncTakeOwnership_fails_when_current_ms_cannot_be_obtained)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	auto handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	uint64_t thisIsNotZero = 312984751;
+	(void)IoTHubClient_LL_SetOption(handle, "messageTimeout", &thisIsNotZero);
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_DEVICEMESSAGE_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_DEVICEMESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3);
+
+	STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments()
+		.SetFailReturn(__LINE__);
+
+	/*no IoTHubMessage_Destroy, the message still belongs to the caller*/
+
+	///act
+	auto result = IoTHubClient_LL_SendEventAsyncTakeOwnership(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)1);
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_104: [ Otherwise IoTHubClient_LL_SendEventAsyncTakeOwnership shall return IOTHUB_CLIENT_OK and IoTHubClient_LL shall destroy eventMessageHandle once its callback has been called. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendEventAsyncTakeOwnership_destroys_the_message_when_it_times_out)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	uint64_t one = 1;
+	(void)IoTHubClient_LL_SetOption(handle, "messageTimeout", &one);
+
+	uint64_t ten = 10;
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.CopyOutArgumentBuffer(2, &ten, sizeof(ten));
+	(void)IoTHubClient_LL_SendEventAsyncTakeOwnership(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)TEST_DEVICEMESSAGE_HANDLE);
+	mocks.ResetAllCalls();
+
+	/*we don't care what happens in the Transport, so let's ignore all those calls*/
+	EXPECTED_CALL(mocks, FAKE_IoTHubTransport_DoWork(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllCalls();
+
+	uint64_t twelve = 12; /*12 > 10 (receive time) + 1 (timeout) => timeout*/
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.CopyOutArgumentBuffer(2, &twelve, sizeof(twelve));
+
+	STRICT_EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT, (void*)TEST_DEVICEMESSAGE_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(TEST_DEVICEMESSAGE_HANDLE)); /*the very handle that was given, not a clone*/
+	STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+
+	///act
+	IoTHubClient_LL_DoWork(handle);
+
+	///assert
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
 /*Tests_SRS_IOTHUBCLIENT_LL_02_016: [IoTHubClient_LL_SetMessageCallback shall fail and return IOTHUB_CLIENT_INVALID_ARG if parameter iotHubClientHandle is NULL.]*/
 TEST_FUNCTION(IoTHubClient_LL_SetMessageCallback_with_NULL_iotHubClientHandle_fails)
 {
@@ -3894,6 +4234,7 @@ TEST_FUNCTION(IoTHubClient_LL_SetOption_messageTimeout_when_exactly_on_the_edge_
 
 /*Tests_SRS_IOTHUBCLIENT_LL_02_039: [ "messageTimeout" - once IoTHubClient_LL_SendEventAsync is called the message shall timeout after value miliseconds. Value is a pointer to a uint64. ]*/
 /*Tests_SRS_IOTHUBCLIENT_LL_02_041: [ If more than value miliseconds have passed since the call to IoTHubClient_LL_SendEventAsync then the message callback shall be called with a status code of IOTHUB_CLIENT_CONFIRMATION_TIMEOUT. ]*/
+/*Tests_SRS_IOTHUBCLIENT_LL_02_099: [ If waitingToSend is sorted by the messages' timeouts then IoTHubClient_LL_DoWork shall stop looking for timed out messages at the first message that has not timed out. ]*/
 TEST_FUNCTION(IoTHubClient_LL_SetOption_2_messages_with_timeouts_at_11_and_12_calls_1_timeout) /*test wants to see that message that did not timeout yet do not have their callbacks called*/
 {
 	///arrange
@@ -4025,106 +4366,1609 @@ TEST_FUNCTION(IoTHubClient_LL_SetOption_2_messages_with_timeouts_at_11_and_12_ca
 	IoTHubClient_LL_Destroy(handle);
 }
 
-/*Tests_SRS_IOTHUBCLIENT_LL_02_039: [ "messageTimeout" - once IoTHubClient_LL_SendEventAsync is called the message shall timeout after value miliseconds. Value is a pointer to a uint64. ]*/
-/*Tests_SRS_IOTHUBCLIENT_LL_02_041: [ If more than value miliseconds have passed since the call to IoTHubClient_LL_SendEventAsync then the message callback shall be called with a status code of IOTHUB_CLIENT_CONFIRMATION_TIMEOUT. ]*/
-/*Tests_SRS_IOTHUBCLIENT_LL_02_043: [ Calling IoTHubClient_LL_SetOption with value set to "0" shall disable the timeout mechanism for all new messages. ]*/
-/*Tests_SRS_IOTHUBCLIENT_LL_02_044: [ Messages already delivered to IoTHubClient_LL shall not have their timeouts modified by a new call to IoTHubClient_LL_SetOption. ]*/
-TEST_FUNCTION(IoTHubClient_LL_SetOption_2_messages_one_with_timeout_one_without_call_1_callback) /*test wants to see that message that did not timeout yet do not have their callbacks called*/
+/*Tests_SRS_IOTHUBCLIENT_LL_02_105: [ "messagePoolSize" - IoTHubClient_LL shall keep up to `*value` released IOTHUB_MESSAGE_LIST for reuse by the next messages. value is a pointer to a size_t. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SetOption_messagePoolSize_succeeds)
 {
 	///arrange
 	CIoTHubClientLLMocks mocks;
 	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
-	uint64_t one = 1;
-	(void)IoTHubClient_LL_SetOption(handle, "messageTimeout", &one);
-
-	/*send 2 messages that will expire at 12 and 13, both of these messages are send at time=10*/
-	/*because sending messages stamps the message's timeout, the call to tickcounter_get_current_ms needs to be here, so the test can says
-	"the message has been received at time=10*/
-	uint64_t ten = 10;
-	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreArgument(1)
-		.CopyOutArgumentBuffer(2, &ten, sizeof(ten));
-	(void)IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)TEST_DEVICEMESSAGE_HANDLE);
-
-	uint64_t zero = 0;
-	(void)IoTHubClient_LL_SetOption(handle, "messageTimeout", &zero); /*essentially no timeout*/
-	(void)IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)(TEST_DEVICEMESSAGE_HANDLE_2));
-
 	mocks.ResetAllCalls();
 
-	/*we don't care what happens in the Transport, so let's ignore all those calls*/
-	EXPECTED_CALL(mocks, FAKE_IoTHubTransport_DoWork(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreAllCalls();
-
-	{/*this scope happen in the first _DoWork call*/
-		uint64_t timeIsNow = 12; /*12 > 10 (receive time) + 1 (timeout) => timeout!!!*/
-		STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.CopyOutArgumentBuffer(2, &timeIsNow, sizeof(timeIsNow));
-
-		STRICT_EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG)) /*this is removing the item from waitingToSend*/
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT, (void*)TEST_DEVICEMESSAGE_HANDLE)); /*calling the callback*/
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG)) /*destroying the message clone*/
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)) /*destroying the IOTHUB_MESSAGE_LIST*/
-			.IgnoreArgument(1);
-	}
-
-	{/*this scope happen in the second _DoWork call*/
-		uint64_t timeIsNow = 999999999999999ULL; /*some very big number*/
-		STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.CopyOutArgumentBuffer(2, &timeIsNow, sizeof(timeIsNow));
-	}
-
 	///act
-	IoTHubClient_LL_DoWork(handle);
-	IoTHubClient_LL_DoWork(handle);
+	size_t poolSize = 10;
+	auto result = IoTHubClient_LL_SetOption(handle, "messagePoolSize", &poolSize); /*not passed to the transport*/
 
 	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
 	IoTHubClient_LL_Destroy(handle);
 }
 
-/*Tests_SRS_IOTHUBCLIENT_LL_02_041: [ If more than value miliseconds have passed since the call to IoTHubClient_LL_SendEventAsync then the message callback shall be called with a status code of IOTHUB_CLIENT_CONFIRMATION_TIMEOUT. ]*/
-TEST_FUNCTION(IoTHubClient_LL_SetOption_messageTimeout_when_tickcounter_fails_in_do_work_no_timeout_callbacks_are_called) /*test wants to see that message that did not timeout yet do not have their callbacks called*/
+/*Tests_SRS_IOTHUBCLIENT_LL_02_106: [ IoTHubClient_LL_SendEventAsync shall reuse a released IOTHUB_MESSAGE_LIST when one is available. ]*/
+/*Tests_SRS_IOTHUBCLIENT_LL_02_107: [ A IOTHUB_MESSAGE_LIST that is no longer needed shall be kept for reuse if fewer than "messagePoolSize" are kept, otherwise it shall be freed. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendEventAsync_reuses_the_IOTHUB_MESSAGE_LIST_of_a_timed_out_message)
 {
 	///arrange
 	CIoTHubClientLLMocks mocks;
 	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	size_t poolSize = 1;
+	(void)IoTHubClient_LL_SetOption(handle, "messagePoolSize", &poolSize);
 	uint64_t one = 1;
 	(void)IoTHubClient_LL_SetOption(handle, "messageTimeout", &one);
 
-	/*send 2 messages that will expire at 12 and 13, both of these messages are send at time=10*/
-	/*because sending messages stamps the message's timeout, the call to tickcounter_get_current_ms needs to be here, so the test can says
-	"the message has been received at time=10*/
 	uint64_t ten = 10;
 	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
 		.IgnoreArgument(1)
 		.CopyOutArgumentBuffer(2, &ten, sizeof(ten));
 	(void)IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)TEST_DEVICEMESSAGE_HANDLE);
-
 	mocks.ResetAllCalls();
 
-	/*we don't care what happens in the Transport, so let's ignore all those calls*/
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_DEVICEMESSAGE_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_DEVICEMESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3);
+
 	EXPECTED_CALL(mocks, FAKE_IoTHubTransport_DoWork(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
 		.IgnoreAllCalls();
 
-	{/*this scope happen in the _DoWork call*/
-		uint64_t timeIsNow = 12; /*12 > 10 (receive time) + 1 (timeout) => timeout!!! (well - normally - but here the code doesn't call any callbacks because time cannot be obtained*/
-		STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.CopyOutArgumentBuffer(2, &timeIsNow, sizeof(timeIsNow))
-			.SetFailReturn(__LINE__);
-	}
+	uint64_t twelve = 12; /*12 > 10 (receive time) + 1 (timeout) => timeout*/
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.CopyOutArgumentBuffer(2, &twelve, sizeof(twelve));
+	STRICT_EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT, (void*)TEST_DEVICEMESSAGE_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	/*no gballoc_free, the IOTHUB_MESSAGE_LIST is kept*/
+
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.CopyOutArgumentBuffer(2, &twelve, sizeof(twelve));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Clone(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2);
+	/*no gballoc_malloc, the IOTHUB_MESSAGE_LIST is reused*/
+
+	///act
+	IoTHubClient_LL_DoWork(handle);
+	auto result = IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)TEST_DEVICEMESSAGE_HANDLE);
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_109: [ Lowering "messagePoolSize" shall free the IOTHUB_MESSAGE_LIST that are kept beyond the new value. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SetOption_messagePoolSize_to_0_frees_the_kept_IOTHUB_MESSAGE_LIST)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	size_t poolSize = 1;
+	(void)IoTHubClient_LL_SetOption(handle, "messagePoolSize", &poolSize);
+	(void)IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, NULL, NULL);
+	DLIST_ENTRY completed;
+	DList_InitializeListHead(&completed);
+	DList_InsertTailList(&completed, DList_RemoveHeadList(lastRegisteredWaitingToSend)); /*this is what the transport does*/
+	IoTHubClient_LL_SendComplete(handle, &completed, IOTHUB_BATCHSTATE_SUCCESS); /*the IOTHUB_MESSAGE_LIST is now kept for reuse*/
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+
+	///act
+	size_t zero = 0;
+	auto result = IoTHubClient_LL_SetOption(handle, "messagePoolSize", &zero);
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_111: [ "messageQueueMaxCount" - IoTHubClient_LL_SendEventAsync shall not let more than `*value` messages wait to be sent. 0 means no limit. value is a pointer to a size_t. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SetOption_messageQueueMaxCount_succeeds)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	mocks.ResetAllCalls();
+
+	///act
+	size_t maxCount = 10;
+	auto result = IoTHubClient_LL_SetOption(handle, "messageQueueMaxCount", &maxCount); /*not passed to the transport*/
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_114: [ If the value of "messageQueueFullPolicy" is not a IOTHUB_CLIENT_QUEUE_FULL_POLICY then IoTHubClient_LL_SetOption shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SetOption_messageQueueFullPolicy_with_invalid_value_fails)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	mocks.ResetAllCalls();
+
+	///act
+	IOTHUB_CLIENT_QUEUE_FULL_POLICY policy = (IOTHUB_CLIENT_QUEUE_FULL_POLICY)42;
+	auto result = IoTHubClient_LL_SetOption(handle, "messageQueueFullPolicy", &policy);
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_110: [ By default, the messages waiting to be sent shall not be limited and the policy shall be IOTHUB_CLIENT_QUEUE_FULL_REJECT. ]*/
+/*Tests_SRS_IOTHUBCLIENT_LL_02_115: [ If adding the message would exceed "messageQueueMaxCount" or "messageQueueMaxBytes" and the policy is IOTHUB_CLIENT_QUEUE_FULL_REJECT or IOTHUB_CLIENT_QUEUE_FULL_BLOCK then IoTHubClient_LL_SendEventAsync shall fail and return IOTHUB_CLIENT_BUSY. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendEventAsync_when_messageQueueMaxCount_is_reached_fails)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	size_t maxCount = 1;
+	(void)IoTHubClient_LL_SetOption(handle, "messageQueueMaxCount", &maxCount);
+	(void)IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)1);
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_DEVICEMESSAGE_HANDLE_2));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_DEVICEMESSAGE_HANDLE_2, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3);
+
+	/*no gballoc_malloc, no IoTHubMessage_Clone*/
+
+	///act
+	auto result = IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE_2, eventConfirmationCallback, (void*)2);
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_BUSY, result);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_116: [ If the policy is IOTHUB_CLIENT_QUEUE_FULL_DROP_OLDEST then IoTHubClient_LL_SendEventAsync shall remove the oldest messages from waitingToSend, call their callbacks with IOTHUB_CLIENT_CONFIRMATION_BECAUSE_QUEUE_FULL and destroy them until the new message fits. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendEventAsync_when_messageQueueMaxCount_is_reached_and_policy_is_DROP_OLDEST_drops_the_oldest_message)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	size_t maxCount = 1;
+	(void)IoTHubClient_LL_SetOption(handle, "messageQueueMaxCount", &maxCount);
+	IOTHUB_CLIENT_QUEUE_FULL_POLICY policy = IOTHUB_CLIENT_QUEUE_FULL_DROP_OLDEST;
+	(void)IoTHubClient_LL_SetOption(handle, "messageQueueFullPolicy", &policy);
+	(void)IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)1);
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_DEVICEMESSAGE_HANDLE_2));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_DEVICEMESSAGE_HANDLE_2, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3);
+
+	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_BECAUSE_QUEUE_FULL, (void*)1));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+
+	STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Clone(TEST_DEVICEMESSAGE_HANDLE_2));
+	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2);
+
+	///act
+	auto result = IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE_2, eventConfirmationCallback, (void*)2);
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_176: [ IoTHubClient_LL_SendEventAsync shall drop the oldest messages only once the new message is ready to be added to waitingToSend. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendEventAsync_with_DROP_OLDEST_does_not_drop_the_oldest_message_when_IoTHubMessage_Clone_fails)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	size_t maxCount = 1;
+	(void)IoTHubClient_LL_SetOption(handle, "messageQueueMaxCount", &maxCount);
+	IOTHUB_CLIENT_QUEUE_FULL_POLICY policy = IOTHUB_CLIENT_QUEUE_FULL_DROP_OLDEST;
+	(void)IoTHubClient_LL_SetOption(handle, "messageQueueFullPolicy", &policy);
+	(void)IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)1);
+	IOTHUB_CLIENT_SEND_QUEUE_STATS stats;
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_DEVICEMESSAGE_HANDLE_2));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_DEVICEMESSAGE_HANDLE_2, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3);
+	STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Clone(TEST_DEVICEMESSAGE_HANDLE_2))
+		.SetReturn((IOTHUB_MESSAGE_HANDLE)NULL);
+	STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)) /*because _Clone fails*/
+		.IgnoreArgument(1);
+	/*no DList_RemoveHeadList, no IOTHUB_CLIENT_CONFIRMATION_BECAUSE_QUEUE_FULL callback*/
+
+	///act
+	auto result = IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE_2, eventConfirmationCallback, (void*)2);
+	(void)IoTHubClient_LL_GetSendQueueStats(handle, &stats);
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+	mocks.AssertActualAndExpectedCalls();
+	ASSERT_ARE_EQUAL(size_t, 1, stats.messageCount);
+	ASSERT_ARE_EQUAL(size_t, 0, stats.droppedCount);
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_111: [ "messageQueueMaxCount" - IoTHubClient_LL_SendEventAsync shall not let more than `*value` messages wait to be sent. 0 means no limit. value is a pointer to a size_t. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendEventAsync_does_not_count_the_messages_taken_by_the_transport)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	size_t maxCount = 1;
+	(void)IoTHubClient_LL_SetOption(handle, "messageQueueMaxCount", &maxCount);
+	(void)IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, NULL, NULL);
+	DLIST_ENTRY inProgress;
+	DList_InitializeListHead(&inProgress);
+	DList_InsertTailList(&inProgress, DList_RemoveHeadList(lastRegisteredWaitingToSend)); /*this is what the transport does in _DoWork*/
+	IoTHubClient_LL_DoWork(handle);
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_DEVICEMESSAGE_HANDLE_2));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_DEVICEMESSAGE_HANDLE_2, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3);
+
+	STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Clone(TEST_DEVICEMESSAGE_HANDLE_2));
+	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2);
+
+	///act
+	auto result = IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE_2, NULL, NULL);
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_SendComplete(handle, &inProgress, IOTHUB_BATCHSTATE_SUCCESS);
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_175: [ Before deciding that waitingToSend is full IoTHubClient_LL_SendEventAsync shall count the messages that are in waitingToSend, since the transport might have taken some of them. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendEventAsync_with_shared_transport_does_not_count_the_messages_taken_by_the_transport)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.SetReturn(TEST_HOSTNAME_VALUE);
+	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_CreateWithTransport(&TEST_DEVICE_CONFIG);
+	size_t maxCount = 1;
+	(void)IoTHubClient_LL_SetOption(handle, "messageQueueMaxCount", &maxCount);
+	(void)IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)1);
+	DLIST_ENTRY inProgress;
+	DList_InitializeListHead(&inProgress);
+	DList_InsertTailList(&inProgress, DList_RemoveHeadList(lastRegisteredWaitingToSend)); /*this is what the shared transport does, without IoTHubClient_LL_DoWork being called*/
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_DEVICEMESSAGE_HANDLE_2));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_DEVICEMESSAGE_HANDLE_2, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3);
+
+	STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Clone(TEST_DEVICEMESSAGE_HANDLE_2));
+	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2);
+
+	///act
+	auto result = IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE_2, eventConfirmationCallback, (void*)2);
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_SendComplete(handle, &inProgress, IOTHUB_BATCHSTATE_SUCCESS);
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_116: [ If the policy is IOTHUB_CLIENT_QUEUE_FULL_DROP_OLDEST then IoTHubClient_LL_SendEventAsync shall remove the oldest messages from waitingToSend, call their callbacks with IOTHUB_CLIENT_CONFIRMATION_BECAUSE_QUEUE_FULL and destroy them until the new message fits. ]*/
+/*Tests_SRS_IOTHUBCLIENT_LL_02_175: [ Before deciding that waitingToSend is full IoTHubClient_LL_SendEventAsync shall count the messages that are in waitingToSend, since the transport might have taken some of them. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendEventAsync_with_shared_transport_and_DROP_OLDEST_does_not_drop_the_messages_taken_by_the_transport)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.SetReturn(TEST_HOSTNAME_VALUE);
+	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_CreateWithTransport(&TEST_DEVICE_CONFIG);
+	size_t maxCount = 1;
+	(void)IoTHubClient_LL_SetOption(handle, "messageQueueMaxCount", &maxCount);
+	IOTHUB_CLIENT_QUEUE_FULL_POLICY policy = IOTHUB_CLIENT_QUEUE_FULL_DROP_OLDEST;
+	(void)IoTHubClient_LL_SetOption(handle, "messageQueueFullPolicy", &policy);
+	(void)IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)1);
+	(void)IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)2); /*drops the first message*/
+	DLIST_ENTRY inProgress;
+	DList_InitializeListHead(&inProgress);
+	DList_InsertTailList(&inProgress, DList_RemoveHeadList(lastRegisteredWaitingToSend)); /*this is what the shared transport does, without IoTHubClient_LL_DoWork being called*/
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_DEVICEMESSAGE_HANDLE_2));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_DEVICEMESSAGE_HANDLE_2, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3);
+
+	/*waitingToSend is empty: nothing is dropped (the message taken by the transport is not touched)*/
+	STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Clone(TEST_DEVICEMESSAGE_HANDLE_2));
+	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2);
+
+	///act
+	auto result = IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE_2, eventConfirmationCallback, (void*)3);
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_SendComplete(handle, &inProgress, IOTHUB_BATCHSTATE_SUCCESS);
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_112: [ "messageQueueMaxBytes" - IoTHubClient_LL_SendEventAsync shall not let messages having more than `*value` payload bytes in total wait to be sent. 0 means no limit. value is a pointer to a size_t. ]*/
+/*Tests_SRS_IOTHUBCLIENT_LL_02_115: [ If adding the message would exceed "messageQueueMaxCount" or "messageQueueMaxBytes" and the policy is IOTHUB_CLIENT_QUEUE_FULL_REJECT or IOTHUB_CLIENT_QUEUE_FULL_BLOCK then IoTHubClient_LL_SendEventAsync shall fail and return IOTHUB_CLIENT_BUSY. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendEventAsync_when_messageQueueMaxBytes_is_reached_fails)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	size_t maxBytes = TEST_DEVICEMESSAGE_SIZE + TEST_DEVICEMESSAGE_SIZE / 2;
+	(void)IoTHubClient_LL_SetOption(handle, "messageQueueMaxBytes", &maxBytes);
+	(void)IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)1);
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_DEVICEMESSAGE_HANDLE_2));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_DEVICEMESSAGE_HANDLE_2, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3);
+
+	///act
+	auto result = IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE_2, eventConfirmationCallback, (void*)2);
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_BUSY, result);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_117: [ If the message alone is bigger than "messageQueueMaxBytes" then IoTHubClient_LL_SendEventAsync shall fail and return IOTHUB_CLIENT_INVALID_SIZE. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendEventAsync_with_a_message_bigger_than_messageQueueMaxBytes_fails)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	size_t maxBytes = TEST_DEVICEMESSAGE_SIZE - 1;
+	(void)IoTHubClient_LL_SetOption(handle, "messageQueueMaxBytes", &maxBytes);
+	IOTHUB_CLIENT_QUEUE_FULL_POLICY policy = IOTHUB_CLIENT_QUEUE_FULL_DROP_OLDEST;
+	(void)IoTHubClient_LL_SetOption(handle, "messageQueueFullPolicy", &policy);
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_DEVICEMESSAGE_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_DEVICEMESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3);
+
+	///act
+	auto result = IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)1);
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_SIZE, result);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_118: [ If iotHubClientHandle or stats is NULL then IoTHubClient_LL_GetSendQueueStats shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+TEST_FUNCTION(IoTHubClient_LL_GetSendQueueStats_with_NULL_handle_fails)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	IOTHUB_CLIENT_SEND_QUEUE_STATS stats;
+
+	///act
+	auto result = IoTHubClient_LL_GetSendQueueStats(NULL, &stats);
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+	mocks.AssertActualAndExpectedCalls();
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_118: [ If iotHubClientHandle or stats is NULL then IoTHubClient_LL_GetSendQueueStats shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+TEST_FUNCTION(IoTHubClient_LL_GetSendQueueStats_with_NULL_stats_fails)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	mocks.ResetAllCalls();
+
+	///act
+	auto result = IoTHubClient_LL_GetSendQueueStats(handle, NULL);
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_119: [ Otherwise IoTHubClient_LL_GetSendQueueStats shall fill stats with the number and the bytes of the messages in waitingToSend, how many messages have been dropped and how many sends have been refused because the queue was full, and shall return IOTHUB_CLIENT_OK. ]*/
+TEST_FUNCTION(IoTHubClient_LL_GetSendQueueStats_succeeds)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	size_t maxBytes = TEST_DEVICEMESSAGE_SIZE;
+	(void)IoTHubClient_LL_SetOption(handle, "messageQueueMaxBytes", &maxBytes);
+	(void)IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, NULL, NULL);
+	(void)IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE_2, NULL, NULL); /*rejected*/
+	IOTHUB_CLIENT_SEND_QUEUE_STATS stats;
+	mocks.ResetAllCalls();
+
+	///act
+	auto result = IoTHubClient_LL_GetSendQueueStats(handle, &stats);
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+	ASSERT_ARE_EQUAL(size_t, 1, stats.messageCount);
+	ASSERT_ARE_EQUAL(size_t, TEST_DEVICEMESSAGE_SIZE, stats.byteCount);
+	ASSERT_ARE_EQUAL(size_t, 0, stats.droppedCount);
+	ASSERT_ARE_EQUAL(size_t, 1, stats.rejectedCount);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_167: [ Only the calls that return IOTHUB_CLIENT_BUSY shall count as refused because the queue was full. ]*/
+TEST_FUNCTION(IoTHubClient_LL_GetSendQueueStats_does_not_count_a_message_too_big_as_rejected)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	size_t maxBytes = TEST_DEVICEMESSAGE_SIZE - 1;
+	(void)IoTHubClient_LL_SetOption(handle, "messageQueueMaxBytes", &maxBytes);
+	IOTHUB_CLIENT_RESULT sendResult = IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, NULL, NULL);
+	IOTHUB_CLIENT_SEND_QUEUE_STATS stats;
+	mocks.ResetAllCalls();
+
+	///act
+	auto result = IoTHubClient_LL_GetSendQueueStats(handle, &stats);
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_SIZE, sendResult);
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+	ASSERT_ARE_EQUAL(size_t, 0, stats.messageCount);
+	ASSERT_ARE_EQUAL(size_t, 0, stats.rejectedCount);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_168: [ IoTHubClient_LL_SendEventAsync shall measure every message, also when "messageQueueMaxBytes" is 0. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendEventAsync_without_messageQueueMaxBytes_measures_the_message)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	IOTHUB_CLIENT_SEND_QUEUE_STATS stats;
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_DEVICEMESSAGE_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_DEVICEMESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3);
+	STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Clone(TEST_DEVICEMESSAGE_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments();
+
+	///act
+	IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, NULL, NULL);
+	(void)IoTHubClient_LL_GetSendQueueStats(handle, &stats);
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+	ASSERT_ARE_EQUAL(size_t, 1, stats.messageCount);
+	ASSERT_ARE_EQUAL(size_t, TEST_DEVICEMESSAGE_SIZE, stats.byteCount);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_168: [ IoTHubClient_LL_SendEventAsync shall measure every message, also when "messageQueueMaxBytes" is 0. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SetOption_messageQueueMaxBytes_counts_the_messages_already_queued)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	(void)IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, NULL, NULL);
+	size_t maxBytes = TEST_DEVICEMESSAGE_SIZE;
+	IOTHUB_CLIENT_SEND_QUEUE_STATS stats;
+	mocks.ResetAllCalls();
+
+	///act
+	auto result = IoTHubClient_LL_SetOption(handle, "messageQueueMaxBytes", &maxBytes);
+	IOTHUB_CLIENT_RESULT secondSendResult = IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE_2, NULL, NULL);
+	(void)IoTHubClient_LL_GetSendQueueStats(handle, &stats);
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_BUSY, secondSendResult); /*the first message already takes all the budget*/
+	ASSERT_ARE_EQUAL(size_t, 1, stats.messageCount);
+	ASSERT_ARE_EQUAL(size_t, TEST_DEVICEMESSAGE_SIZE, stats.byteCount);
+	ASSERT_ARE_EQUAL(size_t, 1, stats.rejectedCount);
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_098: [ IoTHubClient_LL_SendEventAsync shall keep track of whether waitingToSend is sorted by the messages' timeouts. ]*/
+/*Tests_SRS_IOTHUBCLIENT_LL_02_100: [ Otherwise IoTHubClient_LL_DoWork shall inspect all the messages in waitingToSend and shall remember if the remaining ones are sorted by their timeouts. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SetOption_2_messages_with_timeouts_at_20_and_11_calls_1_timeout) /*test wants to see that lowering the timeout does not hide the message that expires first*/
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	uint64_t ten = 10;
+	(void)IoTHubClient_LL_SetOption(handle, "messageTimeout", &ten);
+
+	/*send 2 messages that will expire at 20 and 11, both of these messages are send at time=10*/
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.CopyOutArgumentBuffer(2, &ten, sizeof(ten));
+	(void)IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)TEST_DEVICEMESSAGE_HANDLE);
+
+	uint64_t one = 1;
+	(void)IoTHubClient_LL_SetOption(handle, "messageTimeout", &one);
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.CopyOutArgumentBuffer(2, &ten, sizeof(ten));
+	(void)IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)(TEST_DEVICEMESSAGE_HANDLE_2));
+
+	mocks.ResetAllCalls();
+
+	/*we don't care what happens in the Transport, so let's ignore all those calls*/
+	EXPECTED_CALL(mocks, FAKE_IoTHubTransport_DoWork(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllCalls();
+
+	uint64_t twelve = 12; /*12 > 10 (receive time) + 1 (timeout) => the second message times out even if the first one did not*/
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.CopyOutArgumentBuffer(2, &twelve, sizeof(twelve));
+
+	STRICT_EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG)) /*this is removing the item from waitingToSend*/
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT, (void*)TEST_DEVICEMESSAGE_HANDLE_2)); /*calling the callback*/
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG)) /*destroying the message clone*/
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)) /*destroying the IOTHUB_MESSAGE_LIST*/
+		.IgnoreArgument(1);
+
+	///act
+	IoTHubClient_LL_DoWork(handle);
+
+	///assert
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_166: [ If the tail of waitingToSend is not the one IoTHubClient_LL last left there then IoTHubClient_LL shall no longer consider waitingToSend sorted by the messages' timeouts. ]*/
+TEST_FUNCTION(IoTHubClient_LL_DoWork_message_rolled_back_to_the_tail_still_times_out) /*test wants to see that a message the transport appends at the tail is not hidden behind messages that expire later*/
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	uint64_t one = 1;
+	(void)IoTHubClient_LL_SetOption(handle, "messageTimeout", &one);
+
+	/*send 2 messages that will expire at 11 and 20, both of these messages are send at time=10*/
+	uint64_t ten = 10;
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.CopyOutArgumentBuffer(2, &ten, sizeof(ten));
+	(void)IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)TEST_DEVICEMESSAGE_HANDLE);
+
+	(void)IoTHubClient_LL_SetOption(handle, "messageTimeout", &ten);
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.CopyOutArgumentBuffer(2, &ten, sizeof(ten));
+	(void)IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)(TEST_DEVICEMESSAGE_HANDLE_2));
+
+	/*at time=10 nothing times out and the transport gives back the message that expires at 11 at the tail of waitingToSend*/
+	rollFirstMessageBackOnDoWork = true;
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.CopyOutArgumentBuffer(2, &ten, sizeof(ten));
+	IoTHubClient_LL_DoWork(handle);
+	rollFirstMessageBackOnDoWork = false;
+
+	mocks.ResetAllCalls();
+
+	/*we don't care what happens in the Transport, so let's ignore all those calls*/
+	EXPECTED_CALL(mocks, FAKE_IoTHubTransport_DoWork(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllCalls();
+
+	uint64_t twelve = 12; /*12 > 10 (receive time) + 1 (timeout) => the message at the tail times out even if the one at the head did not*/
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.CopyOutArgumentBuffer(2, &twelve, sizeof(twelve));
+
+	STRICT_EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG)) /*this is removing the item from waitingToSend*/
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT, (void*)TEST_DEVICEMESSAGE_HANDLE)); /*calling the callback*/
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG)) /*destroying the message clone*/
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)) /*destroying the IOTHUB_MESSAGE_LIST*/
+		.IgnoreArgument(1);
+
+	///act
+	IoTHubClient_LL_DoWork(handle);
+
+	///assert
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_166: [ If the tail of waitingToSend is not the one IoTHubClient_LL last left there then IoTHubClient_LL shall no longer consider waitingToSend sorted by the messages' timeouts. ]*/
+TEST_FUNCTION(IoTHubClient_LL_DoWork_with_shared_transport_message_rolled_back_outside_of_DoWork_still_times_out) /*a shared transport services every device from any client's DoWork, so it can put messages back without this client's IoTHubClient_LL_DoWork running*/
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.SetReturn(TEST_HOSTNAME_VALUE);
+	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_CreateWithTransport(&TEST_DEVICE_CONFIG);
+	uint64_t one = 1;
+	(void)IoTHubClient_LL_SetOption(handle, "messageTimeout", &one);
+
+	/*send 2 messages that will expire at 11 and 20, both of these messages are send at time=10*/
+	uint64_t ten = 10;
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.CopyOutArgumentBuffer(2, &ten, sizeof(ten));
+	(void)IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)TEST_DEVICEMESSAGE_HANDLE);
+
+	(void)IoTHubClient_LL_SetOption(handle, "messageTimeout", &ten);
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.CopyOutArgumentBuffer(2, &ten, sizeof(ten));
+	(void)IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)(TEST_DEVICEMESSAGE_HANDLE_2));
+
+	/*the shared transport takes the message that expires at 11 and gives it back at the tail of waitingToSend*/
+	PDLIST_ENTRY first = DList_RemoveHeadList(lastRegisteredWaitingToSend);
+	DList_InsertTailList(lastRegisteredWaitingToSend, first);
+
+	mocks.ResetAllCalls();
+
+	/*we don't care what happens in the Transport, so let's ignore all those calls*/
+	EXPECTED_CALL(mocks, FAKE_IoTHubTransport_DoWork(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllCalls();
+
+	uint64_t twelve = 12; /*12 > 10 (receive time) + 1 (timeout) => the message at the tail times out even if the one at the head did not*/
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.CopyOutArgumentBuffer(2, &twelve, sizeof(twelve));
+
+	STRICT_EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG)) /*this is removing the item from waitingToSend*/
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT, (void*)TEST_DEVICEMESSAGE_HANDLE)); /*calling the callback*/
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG)) /*destroying the message clone*/
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)) /*destroying the IOTHUB_MESSAGE_LIST*/
+		.IgnoreArgument(1);
+
+	///act
+	IoTHubClient_LL_DoWork(handle);
+
+	///assert
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_039: [ "messageTimeout" - once IoTHubClient_LL_SendEventAsync is called the message shall timeout after value miliseconds. Value is a pointer to a uint64. ]*/
+/*Tests_SRS_IOTHUBCLIENT_LL_02_041: [ If more than value miliseconds have passed since the call to IoTHubClient_LL_SendEventAsync then the message callback shall be called with a status code of IOTHUB_CLIENT_CONFIRMATION_TIMEOUT. ]*/
+/*Tests_SRS_IOTHUBCLIENT_LL_02_043: [ Calling IoTHubClient_LL_SetOption with value set to "0" shall disable the timeout mechanism for all new messages. ]*/
+/*Tests_SRS_IOTHUBCLIENT_LL_02_044: [ Messages already delivered to IoTHubClient_LL shall not have their timeouts modified by a new call to IoTHubClient_LL_SetOption. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SetOption_2_messages_one_with_timeout_one_without_call_1_callback) /*test wants to see that message that did not timeout yet do not have their callbacks called*/
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	uint64_t one = 1;
+	(void)IoTHubClient_LL_SetOption(handle, "messageTimeout", &one);
+
+	/*send 2 messages that will expire at 12 and 13, both of these messages are send at time=10*/
+	/*because sending messages stamps the message's timeout, the call to tickcounter_get_current_ms needs to be here, so the test can says
+	"the message has been received at time=10*/
+	uint64_t ten = 10;
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.CopyOutArgumentBuffer(2, &ten, sizeof(ten));
+	(void)IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)TEST_DEVICEMESSAGE_HANDLE);
+
+	uint64_t zero = 0;
+	(void)IoTHubClient_LL_SetOption(handle, "messageTimeout", &zero); /*essentially no timeout*/
+	(void)IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)(TEST_DEVICEMESSAGE_HANDLE_2));
+
+	mocks.ResetAllCalls();
+
+	/*we don't care what happens in the Transport, so let's ignore all those calls*/
+	EXPECTED_CALL(mocks, FAKE_IoTHubTransport_DoWork(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllCalls();
+
+	{/*this scope happen in the first _DoWork call*/
+		uint64_t timeIsNow = 12; /*12 > 10 (receive time) + 1 (timeout) => timeout!!!*/
+		STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+			.IgnoreArgument(1)
+			.CopyOutArgumentBuffer(2, &timeIsNow, sizeof(timeIsNow));
+
+		STRICT_EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG)) /*this is removing the item from waitingToSend*/
+			.IgnoreArgument(1);
+		STRICT_EXPECTED_CALL(mocks, eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT, (void*)TEST_DEVICEMESSAGE_HANDLE)); /*calling the callback*/
+		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG)) /*destroying the message clone*/
+			.IgnoreArgument(1);
+		STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)) /*destroying the IOTHUB_MESSAGE_LIST*/
+			.IgnoreArgument(1);
+	}
+
+	{/*this scope happen in the second _DoWork call*/
+		uint64_t timeIsNow = 999999999999999ULL; /*some very big number*/
+		STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+			.IgnoreArgument(1)
+			.CopyOutArgumentBuffer(2, &timeIsNow, sizeof(timeIsNow));
+	}
+
+	///act
+	IoTHubClient_LL_DoWork(handle);
+	IoTHubClient_LL_DoWork(handle);
+
+	///assert
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_041: [ If more than value miliseconds have passed since the call to IoTHubClient_LL_SendEventAsync then the message callback shall be called with a status code of IOTHUB_CLIENT_CONFIRMATION_TIMEOUT. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SetOption_messageTimeout_when_tickcounter_fails_in_do_work_no_timeout_callbacks_are_called) /*test wants to see that message that did not timeout yet do not have their callbacks called*/
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	IOTHUB_CLIENT_LL_HANDLE handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	uint64_t one = 1;
+	(void)IoTHubClient_LL_SetOption(handle, "messageTimeout", &one);
+
+	/*send 2 messages that will expire at 12 and 13, both of these messages are send at time=10*/
+	/*because sending messages stamps the message's timeout, the call to tickcounter_get_current_ms needs to be here, so the test can says
+	"the message has been received at time=10*/
+	uint64_t ten = 10;
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.CopyOutArgumentBuffer(2, &ten, sizeof(ten));
+	(void)IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)TEST_DEVICEMESSAGE_HANDLE);
+
+	mocks.ResetAllCalls();
+
+	/*we don't care what happens in the Transport, so let's ignore all those calls*/
+	EXPECTED_CALL(mocks, FAKE_IoTHubTransport_DoWork(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllCalls();
+
+	{/*this scope happen in the _DoWork call*/
+		uint64_t timeIsNow = 12; /*12 > 10 (receive time) + 1 (timeout) => timeout!!! (well - normally - but here the code doesn't call any callbacks because time cannot be obtained*/
+		STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+			.IgnoreArgument(1)
+			.CopyOutArgumentBuffer(2, &timeIsNow, sizeof(timeIsNow))
+			.SetFailReturn(__LINE__);
+	}
+
+	///act
+	IoTHubClient_LL_DoWork(handle);
+
+	///assert
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_120: [ "messageStorePath" - IoTHubClient_LL shall keep the messages given to IoTHubClient_LL_SendEventAsync in a message store at the path `value` until they are confirmed. value is a const char*. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SetOption_messageStorePath_creates_the_message_store_and_replays_it)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	auto handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_MessageStore_Create(TEST_MESSAGESTORE_PATH));
+	STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is the store*/
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_MessageStore_Replay(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments();
+
+	///act
+	auto result = IoTHubClient_LL_SetOption(handle, "messageStorePath", TEST_MESSAGESTORE_PATH);
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_121: [ If a message store is already set then IoTHubClient_LL_SetOption shall return IOTHUB_CLIENT_ERROR. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SetOption_messageStorePath_twice_fails)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	auto handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	(void)IoTHubClient_LL_SetOption(handle, "messageStorePath", TEST_MESSAGESTORE_PATH);
+	mocks.ResetAllCalls();
+
+	///act
+	auto result = IoTHubClient_LL_SetOption(handle, "messageStorePath", TEST_MESSAGESTORE_PATH);
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_122: [ If creating the message store fails then IoTHubClient_LL_SetOption shall return IOTHUB_CLIENT_ERROR. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SetOption_messageStorePath_fails_when_the_message_store_cannot_be_created)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	auto handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_MessageStore_Create(TEST_MESSAGESTORE_PATH))
+		.SetReturn((IOTHUB_CLIENT_LL_MESSAGESTORE_HANDLE)NULL);
+
+	///act
+	auto result = IoTHubClient_LL_SetOption(handle, "messageStorePath", TEST_MESSAGESTORE_PATH);
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_123: [ IoTHubClient_LL_SetOption shall queue the messages left in the message store by a previous run as if they were given to IoTHubClient_LL_SendEventAsyncTakeOwnership with no callback. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SetOption_messageStorePath_queues_the_replayed_messages)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	auto handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	storedMessageToReplay = TEST_DEVICEMESSAGE_HANDLE;
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_MessageStore_Create(TEST_MESSAGESTORE_PATH));
+	STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is the store*/
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_MessageStore_Replay(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments();
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_DEVICEMESSAGE_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_DEVICEMESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3);
+	STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is the IOTHUB_MESSAGE_LIST*/
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is the STORED_MESSAGE_CONTEXT*/
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments();
+	/*no IoTHubMessage_Clone, no IoTHubClient_LL_MessageStore_Append: the message is already in the store*/
+
+	///act
+	auto result = IoTHubClient_LL_SetOption(handle, "messageStorePath", TEST_MESSAGESTORE_PATH);
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+	mocks.AssertActualAndExpectedCalls();
+	ASSERT_IS_TRUE(lastRegisteredWaitingToSend->Flink != lastRegisteredWaitingToSend);
+	ASSERT_ARE_EQUAL(void_ptr, TEST_DEVICEMESSAGE_HANDLE, containingRecord(lastRegisteredWaitingToSend->Flink, IOTHUB_MESSAGE_LIST, entry)->messageHandle);
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_124: [ If a message store is set then IoTHubClient_LL_SendEventAsync shall append the message to it. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendEventAsync_with_messageStorePath_appends_the_message_to_the_store)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	auto handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	(void)IoTHubClient_LL_SetOption(handle, "messageStorePath", TEST_MESSAGESTORE_PATH);
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_DEVICEMESSAGE_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_DEVICEMESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3);
+
+	STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is the IOTHUB_MESSAGE_LIST*/
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Clone(TEST_DEVICEMESSAGE_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is the STORED_MESSAGE_CONTEXT*/
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_MessageStore_Append(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments();
+	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments();
+
+	///act
+	auto result = IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)1);
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_125: [ If appending the message to the message store fails then IoTHubClient_LL_SendEventAsync shall fail and return IOTHUB_CLIENT_ERROR. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendEventAsync_with_messageStorePath_fails_when_Append_fails)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	auto handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	(void)IoTHubClient_LL_SetOption(handle, "messageStorePath", TEST_MESSAGESTORE_PATH);
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_DEVICEMESSAGE_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_DEVICEMESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3);
+
+	STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is the IOTHUB_MESSAGE_LIST*/
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Clone(TEST_DEVICEMESSAGE_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is the STORED_MESSAGE_CONTEXT*/
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_MessageStore_Append(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments()
+		.SetReturn(__LINE__);
+	STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)) /*this is the STORED_MESSAGE_CONTEXT*/
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG)) /*this is the clone*/
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)) /*this is the IOTHUB_MESSAGE_LIST*/
+		.IgnoreArgument(1);
+
+	///act
+	auto result = IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)1);
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_126: [ When the confirmation of a stored message is IOTHUB_CLIENT_CONFIRMATION_OK, IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT or IOTHUB_CLIENT_CONFIRMATION_BECAUSE_QUEUE_FULL, IoTHubClient_LL shall remove the message from the message store before calling the message's callback. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendComplete_with_messageStorePath_removes_the_message_from_the_store)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	auto handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	(void)IoTHubClient_LL_SetOption(handle, "messageStorePath", TEST_MESSAGESTORE_PATH);
+	(void)IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)1);
+	DLIST_ENTRY temp;
+	DList_InitializeListHead(&temp);
+	DList_InsertTailList(&temp, DList_RemoveHeadList(lastRegisteredWaitingToSend)); /*this is what the transport does*/
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(&temp));
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_MessageStore_Remove(IGNORED_PTR_ARG, TEST_MESSAGESTORE_RECORD_ID))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_OK, (void*)1));
+	STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)) /*this is the STORED_MESSAGE_CONTEXT*/
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)) /*this is the IOTHUB_MESSAGE_LIST*/
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(&temp));
+
+	///act
+	IoTHubClient_LL_SendComplete(handle, &temp, IOTHUB_BATCHSTATE_SUCCESS);
+
+	///assert
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_127: [ Messages confirmed with IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY or IOTHUB_CLIENT_CONFIRMATION_ERROR shall be kept in the message store. ]*/
+/*Tests_SRS_IOTHUBCLIENT_LL_02_129: [ IoTHubClient_LL_Destroy shall destroy the message store, if any, after all the confirmation callbacks have been called. ]*/
+TEST_FUNCTION(IoTHubClient_LL_Destroy_with_messageStorePath_keeps_the_waiting_messages_in_the_store)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	auto handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	(void)IoTHubClient_LL_SetOption(handle, "messageStorePath", TEST_MESSAGESTORE_PATH);
+	(void)IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)1);
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, FAKE_IoTHubTransport_Unregister(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, FAKE_IoTHubTransport_Destroy(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG)) /*because there is one item in the list*/
+		.IgnoreArgument(1);
+	/*no IoTHubClient_LL_MessageStore_Remove*/
+	STRICT_EXPECTED_CALL(mocks, eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY, (void*)1));
+	STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)) /*STORED_MESSAGE_CONTEXT*/
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)) /*IOTHUB_MESSAGE_LIST*/
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG)) /*because this says "no more items in the list*/
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, tickcounter_destroy(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+#ifndef DONT_USE_UPLOADTOBLOB
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_UploadToBlob_Destroy(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+#endif
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_MessageStore_Destroy(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)) /*IOTHUBCLIENT*/
+		.IgnoreArgument(1);
+
+	///act
+	IoTHubClient_LL_Destroy(handle);
+
+	///assert
+	mocks.AssertActualAndExpectedCalls();
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_127: [ Messages confirmed with IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY or IOTHUB_CLIENT_CONFIRMATION_ERROR shall be kept in the message store. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendComplete_with_messageStorePath_and_FAILED_keeps_the_message_in_the_store)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	auto handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	(void)IoTHubClient_LL_SetOption(handle, "messageStorePath", TEST_MESSAGESTORE_PATH);
+	(void)IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)1);
+	DLIST_ENTRY temp;
+	DList_InitializeListHead(&temp);
+	DList_InsertTailList(&temp, DList_RemoveHeadList(lastRegisteredWaitingToSend)); /*this is what the transport does*/
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(&temp));
+	/*no IoTHubClient_LL_MessageStore_Remove*/
+	STRICT_EXPECTED_CALL(mocks, eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_ERROR, (void*)1));
+	STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)) /*this is the STORED_MESSAGE_CONTEXT*/
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)) /*this is the IOTHUB_MESSAGE_LIST*/
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(&temp));
+
+	///act
+	IoTHubClient_LL_SendComplete(handle, &temp, IOTHUB_BATCHSTATE_FAILED);
+
+	///assert
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_127: [ Messages confirmed with IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY or IOTHUB_CLIENT_CONFIRMATION_ERROR shall be kept in the message store. ]*/
+TEST_FUNCTION(IoTHubClient_LL_Destroy_with_messageStorePath_keeps_the_messages_in_flight_in_the_store)
+{
+	///arrange
+	CNiceCallComparer<CIoTHubClientLLMocks> mocks;
+	auto handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	(void)IoTHubClient_LL_SetOption(handle, "messageStorePath", TEST_MESSAGESTORE_PATH);
+	(void)IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)1);
+	DLIST_ENTRY inFlight;
+	DList_InitializeListHead(&inFlight);
+	DList_InsertTailList(&inFlight, DList_RemoveHeadList(lastRegisteredWaitingToSend)); /*this is what the transport does*/
+	inFlightOnTransportDestroy = &inFlight;
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_ERROR, (void*)1)); /*from the transport's _Destroy*/
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_MessageStore_Remove(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+		.IgnoreAllArguments()
+		.NeverInvoked();
+
+	///act
+	IoTHubClient_LL_Destroy(handle);
+
+	///assert
+	mocks.AssertActualAndExpectedCalls();
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_128: [ If a message store is set then IoTHubClient_LL_DoWork shall flush it before invoking the underlaying layer's _DoWork function. ]*/
+TEST_FUNCTION(IoTHubClient_LL_DoWork_with_messageStorePath_flushes_the_store)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	auto handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	(void)IoTHubClient_LL_SetOption(handle, "messageStorePath", TEST_MESSAGESTORE_PATH);
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*_DoWork will ask "what's the time"*/
+		.IgnoreAllArguments();
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_MessageStore_Flush(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, FAKE_IoTHubTransport_DoWork(IGNORED_PTR_ARG, handle))
+		.IgnoreArgument(1);
+
+	///act
+	IoTHubClient_LL_DoWork(handle);
+
+	///assert
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_131: [ "compression" - sets how IoTHubClient_LL_SendEventAsync compresses the payload of the messages. value is a pointer to a IOTHUB_CLIENT_COMPRESSION. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SetOption_compression_succeeds)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	auto handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	mocks.ResetAllCalls();
+
+	///act
+	IOTHUB_CLIENT_COMPRESSION compression = IOTHUB_CLIENT_COMPRESSION_LZ4;
+	auto result = IoTHubClient_LL_SetOption(handle, "compression", &compression); /*not passed to the transport*/
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_132: [ If the value of "compression" is not a IOTHUB_CLIENT_COMPRESSION then IoTHubClient_LL_SetOption shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SetOption_compression_with_invalid_value_fails)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	auto handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	mocks.ResetAllCalls();
+
+	///act
+	IOTHUB_CLIENT_COMPRESSION compression = (IOTHUB_CLIENT_COMPRESSION)42;
+	auto result = IoTHubClient_LL_SetOption(handle, "compression", &compression);
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_133: [ "compressionThreshold" - IoTHubClient_LL_SendEventAsync shall not compress payloads shorter than `*value` bytes. value is a pointer to a size_t. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SetOption_compressionThreshold_succeeds)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	auto handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	mocks.ResetAllCalls();
+
+	///act
+	size_t threshold = 0;
+	auto result = IoTHubClient_LL_SetOption(handle, "compressionThreshold", &threshold); /*not passed to the transport*/
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_130: [ By default, the messages shall not be compressed and "compressionThreshold" shall be 256. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendEventAsync_with_LZ4_does_not_compress_payloads_shorter_than_the_default_threshold)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	auto handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	IOTHUB_CLIENT_COMPRESSION compression = IOTHUB_CLIENT_COMPRESSION_LZ4;
+	(void)IoTHubClient_LL_SetOption(handle, "compression", &compression);
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_DEVICEMESSAGE_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_DEVICEMESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3);
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_DEVICEMESSAGE_HANDLE)); /*this is measuring the queued message*/
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_DEVICEMESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3);
+	STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is the IOTHUB_MESSAGE_LIST*/
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Clone(TEST_DEVICEMESSAGE_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments();
+
+	///act
+	auto result = IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)1);
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_134: [ If "compression" is IOTHUB_CLIENT_COMPRESSION_LZ4, the payload is at least "compressionThreshold" bytes and the message does not have a "content-encoding" property then IoTHubClient_LL_SendEventAsync shall queue instead of eventMessageHandle a new byte array message with the LZ4 block of the payload. ]*/
+/*Tests_SRS_IOTHUBCLIENT_LL_02_135: [ The compressed message shall have the message id, the correlation id and the properties of eventMessageHandle and the property "content-encoding" set to "lz4". ]*/
+/*Tests_SRS_IOTHUBCLIENT_LL_02_169: [ The compressed message shall have the property "content-length-uncompressed" set to the size of the payload of eventMessageHandle in decimal. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendEventAsync_with_LZ4_queues_the_compressed_message)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	auto handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	IOTHUB_CLIENT_COMPRESSION compression = IOTHUB_CLIENT_COMPRESSION_LZ4;
+	size_t threshold = 0;
+	(void)IoTHubClient_LL_SetOption(handle, "compression", &compression);
+	(void)IoTHubClient_LL_SetOption(handle, "compressionThreshold", &threshold);
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_DEVICEMESSAGE_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_DEVICEMESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3);
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_DEVICEMESSAGE_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, Map_ContainsKey(TEST_MESSAGE_PROPERTIES(TEST_DEVICEMESSAGE_HANDLE), "content-encoding", IGNORED_PTR_ARG))
+		.IgnoreArgument(3);
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LZ4_GetMaxCompressedLength(TEST_DEVICEMESSAGE_SIZE));
+	STRICT_EXPECTED_CALL(mocks, gballoc_malloc(TEST_DEVICEMESSAGE_SIZE + 16)); /*this is the compressed payload*/
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LZ4_Compress(IGNORED_PTR_ARG, TEST_DEVICEMESSAGE_SIZE + 16, TEST_DEVICEMESSAGE_BUFFER, TEST_DEVICEMESSAGE_SIZE))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, TEST_COMPRESSED_SIZE))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetMessageId(TEST_DEVICEMESSAGE_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetCorrelationId(TEST_DEVICEMESSAGE_HANDLE)); /*there is none*/
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_SetMessageId(TEST_COMPRESSED_MESSAGE_HANDLE, TEST_MESSAGE_ID));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_COMPRESSED_MESSAGE_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MESSAGE_PROPERTIES(TEST_DEVICEMESSAGE_HANDLE), IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3)
+		.IgnoreArgument(4);
+	STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(TEST_MESSAGE_PROPERTIES(TEST_COMPRESSED_MESSAGE_HANDLE), "theKey", "theValue"));
+	STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(TEST_MESSAGE_PROPERTIES(TEST_COMPRESSED_MESSAGE_HANDLE), "content-encoding", "lz4"));
+	STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(TEST_MESSAGE_PROPERTIES(TEST_COMPRESSED_MESSAGE_HANDLE), "content-length-uncompressed", "10")); /*TEST_DEVICEMESSAGE_SIZE*/
+	STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)) /*this is the compressed payload*/
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_COMPRESSED_MESSAGE_HANDLE)); /*this is measuring the queued message*/
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_COMPRESSED_MESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3);
+	STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is the IOTHUB_MESSAGE_LIST*/
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments();
+
+	///act
+	auto result = IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)1);
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+	mocks.AssertActualAndExpectedCalls();
+	ASSERT_ARE_EQUAL(void_ptr, TEST_COMPRESSED_MESSAGE_HANDLE, containingRecord(lastRegisteredWaitingToSend->Flink, IOTHUB_MESSAGE_LIST, entry)->messageHandle);
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_134: [ If "compression" is IOTHUB_CLIENT_COMPRESSION_LZ4, the payload is at least "compressionThreshold" bytes and the message does not have a "content-encoding" property then IoTHubClient_LL_SendEventAsync shall queue instead of eventMessageHandle a new byte array message with the LZ4 block of the payload. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendEventAsync_with_LZ4_does_not_compress_a_message_that_has_a_content_encoding)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	auto handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	IOTHUB_CLIENT_COMPRESSION compression = IOTHUB_CLIENT_COMPRESSION_LZ4;
+	size_t threshold = 0;
+	bool isEncoded = true;
+	(void)IoTHubClient_LL_SetOption(handle, "compression", &compression);
+	(void)IoTHubClient_LL_SetOption(handle, "compressionThreshold", &threshold);
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_DEVICEMESSAGE_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_DEVICEMESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3);
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_DEVICEMESSAGE_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, Map_ContainsKey(TEST_MESSAGE_PROPERTIES(TEST_DEVICEMESSAGE_HANDLE), "content-encoding", IGNORED_PTR_ARG))
+		.IgnoreArgument(3)
+		.CopyOutArgumentBuffer(3, &isEncoded, sizeof(isEncoded));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_DEVICEMESSAGE_HANDLE)); /*this is measuring the queued message*/
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_DEVICEMESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3);
+	STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is the IOTHUB_MESSAGE_LIST*/
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Clone(TEST_DEVICEMESSAGE_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments();
+
+	///act
+	auto result = IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)1);
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_170: [ The message shall be accounted against "messageQueueMaxBytes" with the size of the payload that is queued, after compression. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendEventAsync_with_LZ4_accounts_the_compressed_size_against_messageQueueMaxBytes)
+{
+	///arrange
+	CNiceCallComparer<CIoTHubClientLLMocks> mocks;
+	auto handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	IOTHUB_CLIENT_COMPRESSION compression = IOTHUB_CLIENT_COMPRESSION_LZ4;
+	size_t threshold = 0;
+	size_t maxBytes = TEST_COMPRESSED_SIZE; /*the uncompressed message alone would not fit*/
+	IOTHUB_CLIENT_SEND_QUEUE_STATS stats;
+	(void)IoTHubClient_LL_SetOption(handle, "compression", &compression);
+	(void)IoTHubClient_LL_SetOption(handle, "compressionThreshold", &threshold);
+	(void)IoTHubClient_LL_SetOption(handle, "messageQueueMaxBytes", &maxBytes);
+	mocks.ResetAllCalls();
+
+	///act
+	auto result = IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)1);
+	(void)IoTHubClient_LL_GetSendQueueStats(handle, &stats);
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+	ASSERT_ARE_EQUAL(size_t, 1, stats.messageCount);
+	ASSERT_ARE_EQUAL(size_t, TEST_COMPRESSED_SIZE, stats.byteCount);
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_136: [ If compressing the message fails for any reason or the compressed payload is not smaller than the payload then IoTHubClient_LL_SendEventAsync shall queue the message uncompressed. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendEventAsync_with_LZ4_queues_the_message_uncompressed_when_it_does_not_get_smaller)
+{
+	///arrange
+	CIoTHubClientLLMocks mocks;
+	auto handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	IOTHUB_CLIENT_COMPRESSION compression = IOTHUB_CLIENT_COMPRESSION_LZ4;
+	size_t threshold = 0;
+	(void)IoTHubClient_LL_SetOption(handle, "compression", &compression);
+	(void)IoTHubClient_LL_SetOption(handle, "compressionThreshold", &threshold);
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_DEVICEMESSAGE_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_DEVICEMESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3);
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_DEVICEMESSAGE_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, Map_ContainsKey(TEST_MESSAGE_PROPERTIES(TEST_DEVICEMESSAGE_HANDLE), "content-encoding", IGNORED_PTR_ARG))
+		.IgnoreArgument(3);
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LZ4_GetMaxCompressedLength(TEST_DEVICEMESSAGE_SIZE));
+	STRICT_EXPECTED_CALL(mocks, gballoc_malloc(TEST_DEVICEMESSAGE_SIZE + 16));
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LZ4_Compress(IGNORED_PTR_ARG, TEST_DEVICEMESSAGE_SIZE + 16, TEST_DEVICEMESSAGE_BUFFER, TEST_DEVICEMESSAGE_SIZE))
+		.IgnoreArgument(1)
+		.SetReturn(TEST_DEVICEMESSAGE_SIZE + 1);
+	STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_DEVICEMESSAGE_HANDLE)); /*this is measuring the queued message*/
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_DEVICEMESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3);
+	STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is the IOTHUB_MESSAGE_LIST*/
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Clone(TEST_DEVICEMESSAGE_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments();
+
+	///act
+	auto result = IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)1);
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_136: [ If compressing the message fails for any reason or the compressed payload is not smaller than the payload then IoTHubClient_LL_SendEventAsync shall queue the message uncompressed. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendEventAsync_with_LZ4_queues_the_message_uncompressed_when_IoTHubMessage_CreateFromByteArray_fails)
+{
+	///arrange
+	CNiceCallComparer<CIoTHubClientLLMocks> mocks;
+	auto handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	IOTHUB_CLIENT_COMPRESSION compression = IOTHUB_CLIENT_COMPRESSION_LZ4;
+	size_t threshold = 0;
+	(void)IoTHubClient_LL_SetOption(handle, "compression", &compression);
+	(void)IoTHubClient_LL_SetOption(handle, "compressionThreshold", &threshold);
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, TEST_COMPRESSED_SIZE))
+		.IgnoreArgument(1)
+		.SetReturn((IOTHUB_MESSAGE_HANDLE)NULL);
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Clone(TEST_DEVICEMESSAGE_HANDLE));
 
 	///act
-	IoTHubClient_LL_DoWork(handle);
+	auto result = IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)1);
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+	mocks.AssertActualAndExpectedCalls();
+	ASSERT_ARE_EQUAL(void_ptr, (IOTHUB_MESSAGE_HANDLE)((uintptr_t)TEST_DEVICEMESSAGE_HANDLE + 1000), containingRecord(lastRegisteredWaitingToSend->Flink, IOTHUB_MESSAGE_LIST, entry)->messageHandle);
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_136: [ If compressing the message fails for any reason or the compressed payload is not smaller than the payload then IoTHubClient_LL_SendEventAsync shall queue the message uncompressed. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendEventAsync_with_LZ4_queues_the_message_uncompressed_when_copying_the_properties_fails)
+{
+	///arrange
+	CNiceCallComparer<CIoTHubClientLLMocks> mocks;
+	auto handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	IOTHUB_CLIENT_COMPRESSION compression = IOTHUB_CLIENT_COMPRESSION_LZ4;
+	size_t threshold = 0;
+	(void)IoTHubClient_LL_SetOption(handle, "compression", &compression);
+	(void)IoTHubClient_LL_SetOption(handle, "compressionThreshold", &threshold);
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(TEST_MESSAGE_PROPERTIES(TEST_COMPRESSED_MESSAGE_HANDLE), "theKey", "theValue"))
+		.SetReturn(MAP_ERROR);
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(TEST_COMPRESSED_MESSAGE_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Clone(TEST_DEVICEMESSAGE_HANDLE));
+
+	///act
+	auto result = IoTHubClient_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)1);
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_137: [ If IoTHubClient_LL_SendEventAsyncTakeOwnership queues a compressed message then it shall destroy eventMessageHandle. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendEventAsyncTakeOwnership_with_LZ4_destroys_the_given_message)
+{
+	///arrange
+	CNiceCallComparer<CIoTHubClientLLMocks> mocks;
+	auto handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	IOTHUB_CLIENT_COMPRESSION compression = IOTHUB_CLIENT_COMPRESSION_LZ4;
+	size_t threshold = 0;
+	(void)IoTHubClient_LL_SetOption(handle, "compression", &compression);
+	(void)IoTHubClient_LL_SetOption(handle, "compressionThreshold", &threshold);
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(TEST_DEVICEMESSAGE_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Clone(IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.NeverInvoked();
+
+	///act
+	auto result = IoTHubClient_LL_SendEventAsyncTakeOwnership(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)1);
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+	mocks.AssertActualAndExpectedCalls();
+	ASSERT_ARE_EQUAL(void_ptr, TEST_COMPRESSED_MESSAGE_HANDLE, containingRecord(lastRegisteredWaitingToSend->Flink, IOTHUB_MESSAGE_LIST, entry)->messageHandle);
+
+	///cleanup
+	IoTHubClient_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_103: [ If IoTHubClient_LL_SendEventAsyncTakeOwnership fails then the ownership of eventMessageHandle shall remain with the caller. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SendEventAsyncTakeOwnership_with_LZ4_destroys_only_the_compressed_message_when_Append_fails)
+{
+	///arrange
+	CNiceCallComparer<CIoTHubClientLLMocks> mocks;
+	auto handle = IoTHubClient_LL_Create(&TEST_CONFIG);
+	IOTHUB_CLIENT_COMPRESSION compression = IOTHUB_CLIENT_COMPRESSION_LZ4;
+	size_t threshold = 0;
+	(void)IoTHubClient_LL_SetOption(handle, "compression", &compression);
+	(void)IoTHubClient_LL_SetOption(handle, "compressionThreshold", &threshold);
+	(void)IoTHubClient_LL_SetOption(handle, "messageStorePath", TEST_MESSAGESTORE_PATH);
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_MessageStore_Append(IGNORED_PTR_ARG, TEST_COMPRESSED_MESSAGE_HANDLE, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.IgnoreArgument(3)
+		.SetReturn(__LINE__);
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(TEST_COMPRESSED_MESSAGE_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(TEST_DEVICEMESSAGE_HANDLE))
+		.NeverInvoked();
+
+	///act
+	auto result = IoTHubClient_LL_SendEventAsyncTakeOwnership(handle, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)1);
 
 	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
@@ -4189,5 +6033,277 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_with_NULL_source_and_size_greater_tha
 }
 #endif 
 
+#ifndef DONT_USE_UPLOADTOBLOB
+/*Tests_SRS_IOTHUBCLIENT_LL_02_138: [ "blobUploadConcurrency" - IoTHubClient_LL_UploadToBlob shall upload up to `*value` blocks of a blob at the same time, each on its own connection. value is a pointer to a size_t. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SetOption_blobUploadConcurrency_is_passed_to_UploadToBlob)
+{
+    ///arrange
+    CIoTHubClientLLMocks mocks;
+    IOTHUB_CLIENT_LL_HANDLE h = IoTHubClient_LL_Create(&TEST_CONFIG);
+    size_t concurrency = 8;
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_UploadToBlob_SetOption(IGNORED_PTR_ARG, "blobUploadConcurrency", &concurrency))
+        .IgnoreArgument(1);
+
+    ///act
+    IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_SetOption(h, "blobUploadConcurrency", &concurrency); /*not passed to the transport*/
+
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    IoTHubClient_LL_Destroy(h);
+}
+#endif
+
+#ifndef DONT_USE_UPLOADTOBLOB
+/*Tests_SRS_IOTHUBCLIENT_LL_02_139: [ If the value of "blobUploadConcurrency" is 0 then IoTHubClient_LL_SetOption shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+TEST_FUNCTION(IoTHubClient_LL_SetOption_blobUploadConcurrency_fails_when_UploadToBlob_fails)
+{
+    ///arrange
+    CIoTHubClientLLMocks mocks;
+    IOTHUB_CLIENT_LL_HANDLE h = IoTHubClient_LL_Create(&TEST_CONFIG);
+    size_t concurrency = 0;
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_UploadToBlob_SetOption(IGNORED_PTR_ARG, "blobUploadConcurrency", &concurrency))
+        .IgnoreArgument(1)
+        .SetReturn(IOTHUB_CLIENT_INVALID_ARG);
+
+    ///act
+    IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_SetOption(h, "blobUploadConcurrency", &concurrency);
+
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    IoTHubClient_LL_Destroy(h);
+}
+#endif
+
+#ifndef DONT_USE_UPLOADTOBLOB
+static int testGetData(void* context, unsigned char* buffer, size_t bufferSize, size_t* bytesRead)
+{
+    (void)context;
+    (void)buffer;
+    (void)bufferSize;
+    *bytesRead = 0;
+    return 0;
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_02_145: [ If iotHubClientHandle, destinationFileName or getData is NULL then IoTHubClient_LL_UploadToBlobFromReader shall fail and return IOTHUB_CLIENT_INVALID_ARG. ]*/
+TEST_FUNCTION(IoTHubClient_LL_UploadToBlobFromReader_with_NULL_arguments_fails)
+{
+    ///arrange
+    CIoTHubClientLLMocks mocks;
+    IOTHUB_CLIENT_LL_HANDLE h = IoTHubClient_LL_Create(&TEST_CONFIG);
+    mocks.ResetAllCalls();
+
+    ///act
+    IOTHUB_CLIENT_RESULT result1 = IoTHubClient_LL_UploadToBlobFromReader(NULL, "someFileName.txt", testGetData, NULL);
+    IOTHUB_CLIENT_RESULT result2 = IoTHubClient_LL_UploadToBlobFromReader(h, NULL, testGetData, NULL);
+    IOTHUB_CLIENT_RESULT result3 = IoTHubClient_LL_UploadToBlobFromReader(h, "someFileName.txt", NULL, NULL);
+
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result1);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result2);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result3);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    IoTHubClient_LL_Destroy(h);
+}
+#endif
+
+#ifndef DONT_USE_UPLOADTOBLOB
+/*Tests_SRS_IOTHUBCLIENT_LL_02_146: [ IoTHubClient_LL_UploadToBlobFromReader shall call IoTHubClient_LL_UploadToBlobFromReader_Impl passing getData and context and return what IoTHubClient_LL_UploadToBlobFromReader_Impl returns. ]*/
+TEST_FUNCTION(IoTHubClient_LL_UploadToBlobFromReader_calls_UploadToBlobFromReader_Impl)
+{
+    ///arrange
+    CIoTHubClientLLMocks mocks;
+    IOTHUB_CLIENT_LL_HANDLE h = IoTHubClient_LL_Create(&TEST_CONFIG);
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_UploadToBlobFromReader_Impl(IGNORED_PTR_ARG, "someFileName.txt", testGetData, (void*)0x42))
+        .IgnoreArgument(1)
+        .SetReturn(IOTHUB_CLIENT_ERROR);
+
+    ///act
+    IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_UploadToBlobFromReader(h, "someFileName.txt", testGetData, (void*)0x42);
+
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    IoTHubClient_LL_Destroy(h);
+}
+#endif
+
+#ifndef DONT_USE_UPLOADTOBLOB
+/*Tests_SRS_IOTHUBCLIENT_LL_02_147: [ If iotHubClientHandle, destinationFileName or sourceFileName is NULL then IoTHubClient_LL_UploadToBlobFromFile shall fail and return IOTHUB_CLIENT_INVALID_ARG. ]*/
+TEST_FUNCTION(IoTHubClient_LL_UploadToBlobFromFile_with_NULL_arguments_fails)
+{
+    ///arrange
+    CIoTHubClientLLMocks mocks;
+    IOTHUB_CLIENT_LL_HANDLE h = IoTHubClient_LL_Create(&TEST_CONFIG);
+    mocks.ResetAllCalls();
+
+    ///act
+    IOTHUB_CLIENT_RESULT result1 = IoTHubClient_LL_UploadToBlobFromFile(NULL, "someFileName.txt", "source.bin");
+    IOTHUB_CLIENT_RESULT result2 = IoTHubClient_LL_UploadToBlobFromFile(h, NULL, "source.bin");
+    IOTHUB_CLIENT_RESULT result3 = IoTHubClient_LL_UploadToBlobFromFile(h, "someFileName.txt", NULL);
+
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result1);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result2);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result3);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    IoTHubClient_LL_Destroy(h);
+}
+#endif
+
+#ifndef DONT_USE_UPLOADTOBLOB
+/*Tests_SRS_IOTHUBCLIENT_LL_02_148: [ If sourceFileName cannot be opened for reading then IoTHubClient_LL_UploadToBlobFromFile shall fail and return IOTHUB_CLIENT_ERROR. ]*/
+TEST_FUNCTION(IoTHubClient_LL_UploadToBlobFromFile_fails_when_the_file_cannot_be_opened)
+{
+    ///arrange
+    CIoTHubClientLLMocks mocks;
+    IOTHUB_CLIENT_LL_HANDLE h = IoTHubClient_LL_Create(&TEST_CONFIG);
+    mocks.ResetAllCalls();
+
+    ///act
+    IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_UploadToBlobFromFile(h, "someFileName.txt", "this/file/does/not/exist.bin");
+
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    IoTHubClient_LL_Destroy(h);
+}
+#endif
+
+#ifndef DONT_USE_UPLOADTOBLOB
+/*Tests_SRS_IOTHUBCLIENT_LL_02_149: [ IoTHubClient_LL_UploadToBlobFromFile shall call IoTHubClient_LL_UploadToBlobFromReader_Impl with a getData that reads the file sequentially and return what IoTHubClient_LL_UploadToBlobFromReader_Impl returns. If reading the file fails then the upload shall fail. ]*/
+/*Tests_SRS_IOTHUBCLIENT_LL_02_150: [ IoTHubClient_LL_UploadToBlobFromFile shall close the file before returning. ]*/
+TEST_FUNCTION(IoTHubClient_LL_UploadToBlobFromFile_calls_UploadToBlobFromReader_Impl)
+{
+    ///arrange
+    CIoTHubClientLLMocks mocks;
+    const char* sourceFileName = "iothubclient_ll_unittests_source.bin";
+    FILE* source = fopen(sourceFileName, "wb");
+    ASSERT_IS_NOT_NULL(source);
+    ASSERT_ARE_EQUAL(size_t, 3, fwrite("abc", 1, 3, source));
+    (void)fclose(source);
+    IOTHUB_CLIENT_LL_HANDLE h = IoTHubClient_LL_Create(&TEST_CONFIG);
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_UploadToBlobFromReader_Impl(IGNORED_PTR_ARG, "someFileName.txt", IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(3)
+        .IgnoreArgument(4);
+
+    ///act
+    IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_UploadToBlobFromFile(h, "someFileName.txt", sourceFileName);
+
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    mocks.AssertActualAndExpectedCalls();
+    ASSERT_ARE_EQUAL(int, 0, remove(sourceFileName)); /*the file is closed*/
+
+    ///cleanup
+    IoTHubClient_LL_Destroy(h);
+}
+#endif
+
+#ifndef DONT_USE_UPLOADTOBLOB
+/*Tests_SRS_IOTHUBCLIENT_LL_02_157: [ If iotHubClientHandle, destinationFileName, sourceFileName or manifestFileName is NULL then IoTHubClient_LL_UploadToBlobFromFileResumable shall fail and return IOTHUB_CLIENT_INVALID_ARG. ]*/
+TEST_FUNCTION(IoTHubClient_LL_UploadToBlobFromFileResumable_with_NULL_arguments_fails)
+{
+    ///arrange
+    CIoTHubClientLLMocks mocks;
+    IOTHUB_CLIENT_LL_HANDLE h = IoTHubClient_LL_Create(&TEST_CONFIG);
+    mocks.ResetAllCalls();
+
+    ///act
+    IOTHUB_CLIENT_RESULT result1 = IoTHubClient_LL_UploadToBlobFromFileResumable(NULL, "someFileName.txt", "source.bin", "source.bin.manifest");
+    IOTHUB_CLIENT_RESULT result2 = IoTHubClient_LL_UploadToBlobFromFileResumable(h, NULL, "source.bin", "source.bin.manifest");
+    IOTHUB_CLIENT_RESULT result3 = IoTHubClient_LL_UploadToBlobFromFileResumable(h, "someFileName.txt", NULL, "source.bin.manifest");
+    IOTHUB_CLIENT_RESULT result4 = IoTHubClient_LL_UploadToBlobFromFileResumable(h, "someFileName.txt", "source.bin", NULL);
+
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result1);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result2);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result3);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result4);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    IoTHubClient_LL_Destroy(h);
+}
+#endif
+
+#ifndef DONT_USE_UPLOADTOBLOB
+/*Tests_SRS_IOTHUBCLIENT_LL_02_158: [ If sourceFileName cannot be opened for reading or its size cannot be determined then IoTHubClient_LL_UploadToBlobFromFileResumable shall fail and return IOTHUB_CLIENT_ERROR. ]*/
+TEST_FUNCTION(IoTHubClient_LL_UploadToBlobFromFileResumable_fails_when_the_file_cannot_be_opened)
+{
+    ///arrange
+    CIoTHubClientLLMocks mocks;
+    IOTHUB_CLIENT_LL_HANDLE h = IoTHubClient_LL_Create(&TEST_CONFIG);
+    mocks.ResetAllCalls();
+
+    ///act
+    IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_UploadToBlobFromFileResumable(h, "someFileName.txt", "this/file/does/not/exist.bin", "exist.bin.manifest");
+
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    IoTHubClient_LL_Destroy(h);
+}
+#endif
+
+#ifndef DONT_USE_UPLOADTOBLOB
+/*Tests_SRS_IOTHUBCLIENT_LL_02_174: [ IoTHubClient_LL_UploadToBlobFromFileResumable shall read the file once to compute the 64 bit FNV-1a hash of its content, written as 16 lowercase hexadecimal digits. If reading the file fails then IoTHubClient_LL_UploadToBlobFromFileResumable shall fail and return IOTHUB_CLIENT_ERROR. ]*/
+/*Tests_SRS_IOTHUBCLIENT_LL_02_159: [ IoTHubClient_LL_UploadToBlobFromFileResumable shall call IoTHubClient_LL_UploadToBlobFromReaderResumable_Impl with a getData that reads the file sequentially from its start, the size of the file, the hash as sourceVersion and manifestFileName and return what IoTHubClient_LL_UploadToBlobFromReaderResumable_Impl returns. ]*/
+/*Tests_SRS_IOTHUBCLIENT_LL_02_160: [ IoTHubClient_LL_UploadToBlobFromFileResumable shall close the file before returning. ]*/
+TEST_FUNCTION(IoTHubClient_LL_UploadToBlobFromFileResumable_calls_UploadToBlobFromReaderResumable_Impl)
+{
+    ///arrange
+    CIoTHubClientLLMocks mocks;
+    const char* sourceFileName = "iothubclient_ll_unittests_source.bin";
+    FILE* source = fopen(sourceFileName, "wb");
+    ASSERT_IS_NOT_NULL(source);
+    ASSERT_ARE_EQUAL(size_t, 3, fwrite("abc", 1, 3, source));
+    (void)fclose(source);
+    IOTHUB_CLIENT_LL_HANDLE h = IoTHubClient_LL_Create(&TEST_CONFIG);
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_UploadToBlobFromReaderResumable_Impl(IGNORED_PTR_ARG, "someFileName.txt", IGNORED_PTR_ARG, IGNORED_PTR_ARG, (size_t)3, "e71fa2190541574b", "source.bin.manifest")) /*the FNV-1a hash of "abc"*/
+        .IgnoreArgument(1)
+        .IgnoreArgument(3)
+        .IgnoreArgument(4)
+        .SetReturn(IOTHUB_CLIENT_ERROR);
+
+    ///act
+    IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_UploadToBlobFromFileResumable(h, "someFileName.txt", sourceFileName, "source.bin.manifest");
+
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+    mocks.AssertActualAndExpectedCalls();
+    ASSERT_ARE_EQUAL(int, 0, remove(sourceFileName)); /*the file is closed*/
+
+    ///cleanup
+    IoTHubClient_LL_Destroy(h);
+}
+#endif
+
 END_TEST_SUITE(iothubclient_ll_unittests)
 
@@ -9,6 +9,7 @@
 #include <cstdbool>
 #include <cstddef>
 #include <csignal>
+#include <thread>
 #include "testrunnerswitcher.h"
 #include "micromock.h"
 #include "micromockcharstararenullterminatedstrings.h"
@@ -74,6 +75,7 @@ static const IOTHUB_CLIENT_CONFIG TEST_CONFIG =
 
 static size_t currentmalloc_call;
 static size_t whenShallmalloc_fail;
+static IOTHUB_CLIENT_STATUS currentSendStatus;
 static IOTHUB_CLIENT_HANDLE current_iothub_client;
 
 #define TEST_IOTHUB_CLIENT_LL_HANDLE    (IOTHUB_CLIENT_LL_HANDLE)0x4242
@@ -103,12 +105,20 @@ public:
     MOCK_VOID_METHOD_END();
     MOCK_STATIC_METHOD_4(, IOTHUB_CLIENT_RESULT, IoTHubClient_LL_SendEventAsync, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle, IOTHUB_MESSAGE_HANDLE, eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK, eventConfirmationCallback, void*, userContextCallback)
     MOCK_METHOD_END(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK);
+    MOCK_STATIC_METHOD_4(, IOTHUB_CLIENT_RESULT, IoTHubClient_LL_SendEventAsyncTakeOwnership, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle, IOTHUB_MESSAGE_HANDLE, eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK, eventConfirmationCallback, void*, userContextCallback)
+    MOCK_METHOD_END(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK);
     MOCK_STATIC_METHOD_3(, IOTHUB_CLIENT_RESULT, IoTHubClient_LL_SetMessageCallback, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle, IOTHUB_CLIENT_MESSAGE_CALLBACK_ASYNC, messageCallback, void*, userContextCallback)
     MOCK_METHOD_END(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK);
     MOCK_STATIC_METHOD_1(, void, IoTHubClient_LL_DoWork, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle)
         doWorkCallCount++;
     MOCK_VOID_METHOD_END();
     MOCK_STATIC_METHOD_2(, IOTHUB_CLIENT_RESULT, IoTHubClient_LL_GetSendStatus, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle, IOTHUB_CLIENT_STATUS*, iotHubClientStatus)
+        if (iotHubClientStatus != NULL)
+        {
+            *iotHubClientStatus = currentSendStatus;
+        }
+    MOCK_METHOD_END(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK);
+    MOCK_STATIC_METHOD_2(, IOTHUB_CLIENT_RESULT, IoTHubClient_LL_GetSendQueueStats, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle, IOTHUB_CLIENT_SEND_QUEUE_STATS*, stats)
     MOCK_METHOD_END(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK);
     MOCK_STATIC_METHOD_2(, IOTHUB_CLIENT_RESULT, IoTHubClient_LL_GetLastMessageReceiveTime, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle, time_t*, lastMessageReceiveTime)
     MOCK_METHOD_END(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK);
@@ -194,6 +204,9 @@ public:
     MOCK_STATIC_METHOD_2(, void, IoTHubTransport_JoinWorkerThread, TRANSPORT_HANDLE, transportHlHandle, IOTHUB_CLIENT_HANDLE, clientHandle)
     MOCK_VOID_METHOD_END()
 
+    MOCK_STATIC_METHOD_2(, IOTHUB_CLIENT_RESULT, IoTHubTransport_SetMaxIdleSleep, TRANSPORT_HANDLE, transportHlHandle, unsigned int, maxIdleSleep)
+    MOCK_METHOD_END(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK)
+
     MOCK_STATIC_METHOD_2(, int, mallocAndStrcpy_s, char**, destination, const char*, source)
         int result2;
         if ((destination == NULL) || (source == NULL))
@@ -219,6 +232,8 @@ public:
 #ifndef DONT_USE_UPLOADTOBLOB
     MOCK_STATIC_METHOD_4(, IOTHUB_CLIENT_RESULT, IoTHubClient_LL_UploadToBlob, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle, const char*, destinationFileName, const unsigned char*, source, size_t, size);
     MOCK_METHOD_END(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK);
+    MOCK_STATIC_METHOD_3(, IOTHUB_CLIENT_RESULT, IoTHubClient_LL_UploadToBlobFromFile, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle, const char*, destinationFileName, const char*, sourceFileName);
+    MOCK_METHOD_END(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK);
 #endif
     
     /* list mocks */
@@ -308,9 +323,11 @@ DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubClientMocks, , IOTHUB_CLIENT_LL_HANDLE, IoTH
 
 DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubClientMocks, , void, IoTHubClient_LL_Destroy, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle);
 DECLARE_GLOBAL_MOCK_METHOD_4(CIoTHubClientMocks, , IOTHUB_CLIENT_RESULT, IoTHubClient_LL_SendEventAsync, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle, IOTHUB_MESSAGE_HANDLE, eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK, eventConfirmationCallback, void*, userContextCallback)
+DECLARE_GLOBAL_MOCK_METHOD_4(CIoTHubClientMocks, , IOTHUB_CLIENT_RESULT, IoTHubClient_LL_SendEventAsyncTakeOwnership, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle, IOTHUB_MESSAGE_HANDLE, eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK, eventConfirmationCallback, void*, userContextCallback)
 DECLARE_GLOBAL_MOCK_METHOD_3(CIoTHubClientMocks, , IOTHUB_CLIENT_RESULT, IoTHubClient_LL_SetMessageCallback, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle, IOTHUB_CLIENT_MESSAGE_CALLBACK_ASYNC, messageCallback, void*, userContextCallback)
 DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubClientMocks, , void, IoTHubClient_LL_DoWork, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle)
 DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubClientMocks, , IOTHUB_CLIENT_RESULT, IoTHubClient_LL_GetSendStatus, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle, IOTHUB_CLIENT_STATUS*, iotHubClientStatus)
+DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubClientMocks, , IOTHUB_CLIENT_RESULT, IoTHubClient_LL_GetSendQueueStats, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle, IOTHUB_CLIENT_SEND_QUEUE_STATS*, stats)
 DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubClientMocks, , IOTHUB_CLIENT_RESULT, IoTHubClient_LL_GetLastMessageReceiveTime, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle, time_t*, lastMessageReceiveTime)
 DECLARE_GLOBAL_MOCK_METHOD_3(CIoTHubClientMocks, , IOTHUB_CLIENT_RESULT, IoTHubClient_LL_SetOption, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle, const char*, optionName, const void*, value)
 
@@ -336,11 +353,13 @@ DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubClientMocks, , TRANSPORT_LL_HANDLE, IoTHubTr
 DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubClientMocks, , IOTHUB_CLIENT_RESULT, IoTHubTransport_StartWorkerThread, TRANSPORT_HANDLE, transportHlHandle, IOTHUB_CLIENT_HANDLE, clientHandle);
 DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubClientMocks, , bool, IoTHubTransport_SignalEndWorkerThread, TRANSPORT_HANDLE, transportHlHandle, IOTHUB_CLIENT_HANDLE, clientHandle);
 DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubClientMocks, , void, IoTHubTransport_JoinWorkerThread, TRANSPORT_HANDLE, transportHlHandle, IOTHUB_CLIENT_HANDLE, clientHandle);
+DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubClientMocks, , IOTHUB_CLIENT_RESULT, IoTHubTransport_SetMaxIdleSleep, TRANSPORT_HANDLE, transportHlHandle, unsigned int, maxIdleSleep);
 
 DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubClientMocks, , int, mallocAndStrcpy_s, char**, destination, const char*, source);
 
 #ifndef DONT_USE_UPLOADTOBLOB
 DECLARE_GLOBAL_MOCK_METHOD_4(CIoTHubClientMocks, , IOTHUB_CLIENT_RESULT, IoTHubClient_LL_UploadToBlob, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle, const char*, destinationFileName, const unsigned char*, source, size_t, size);
+DECLARE_GLOBAL_MOCK_METHOD_3(CIoTHubClientMocks, , IOTHUB_CLIENT_RESULT, IoTHubClient_LL_UploadToBlobFromFile, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle, const char*, destinationFileName, const char*, sourceFileName);
 DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubClientMocks, , void, uploadToBlobAsyncCallback, IOTHUB_CLIENT_FILE_UPLOAD_RESULT, result, void*, userContextCallback);
 #endif
 
@@ -358,6 +377,32 @@ static const TRANSPORT_PROVIDER* provideFAKE(void)
     return NULL;
 }
 
+#ifdef USE_UPOLOADTOBLOB
+static IOTHUB_CLIENT_RESULT chainedUploadResult;
+static IOTHUB_CLIENT_UPLOAD_QUEUE_STATS statsInUploadCallback;
+
+/*this callback queues another upload, like an application chaining its uploads would*/
+static void chainingUploadCallback(IOTHUB_CLIENT_FILE_UPLOAD_RESULT result, void* userContextCallback)
+{
+    (void)result;
+    (void)userContextCallback;
+    (void)IoTHubClient_GetUploadQueueStats(current_iothub_client, &statsInUploadCallback);
+    chainedUploadResult = IoTHubClient_UploadToBlobAsync(current_iothub_client, "chained.txt", (const unsigned char*)"c", 1, NULL, NULL);
+}
+
+/*this callback waits for another application thread that queues an upload while the callback runs*/
+static void waitingForOtherThreadUploadCallback(IOTHUB_CLIENT_FILE_UPLOAD_RESULT result, void* userContextCallback)
+{
+    (void)result;
+    (void)userContextCallback;
+    std::thread otherThread([]()
+    {
+        chainedUploadResult = IoTHubClient_UploadToBlobAsync(current_iothub_client, "other.txt", (const unsigned char*)"c", 1, NULL, NULL);
+    });
+    otherThread.join();
+}
+#endif
+
 BEGIN_TEST_SUITE(iothubclient_unittests)
 
     TEST_SUITE_INITIALIZE(TestClassInitialize)
@@ -383,6 +428,7 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
         whenShallmalloc_fail = 0;
         howManyDoWorkCalls = 0;
         doWorkCallCount = 0;
+        currentSendStatus = IOTHUB_CLIENT_SEND_STATUS_IDLE;
 		threadFunc = NULL;
 		threadFuncArg = NULL;
     }
@@ -398,7 +444,7 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
     /* Tests_SRS_IOTHUBCLIENT_12_004: [IoTHubClient_CreateFromConnectionString shall allocate a new IoTHubClient instance.] */
     /* Tests_SRS_IOTHUBCLIENT_12_005: [IoTHubClient_CreateFromConnectionString shall create a lock object to be used later for serializing IoTHubClient calls] */
     /* Tests_SRS_IOTHUBCLIENT_12_006: [IoTHubClient_CreateFromConnectionString shall instantiate a new IoTHubClient_LL instance by calling IoTHubClient_LL_CreateFromConnectionString and passing the connectionString and protocol] */
-    /*Tests_SRS_IOTHUBCLIENT_02_059: [ IoTHubClient_CreateFromConnectionString shall create a LIST_HANDLE containing informations saved by IoTHubClient_UploadToBlobAsync. ]*/
+    /*Tests_SRS_IOTHUBCLIENT_02_059: [ IoTHubClient_CreateFromConnectionString shall create a LIST_HANDLE holding the uploads queued by IoTHubClient_UploadToBlobAsync and a lock protecting it. ]*/
     TEST_FUNCTION(IoTHubClient_CreateFromConnectionString_succeeds)
     {
         // arrange
@@ -407,6 +453,7 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
         STRICT_EXPECTED_CALL(mocks, Lock_Init());
 #ifndef DONT_USE_UPLOADTOBLOB
         STRICT_EXPECTED_CALL(mocks, list_create());
+        STRICT_EXPECTED_CALL(mocks, Lock_Init());
 #endif
         STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_CreateFromConnectionString(TEST_CHAR, provideFAKE));
 
@@ -486,7 +533,7 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
     }
 
 #ifndef DONT_USE_UPLOADTOBLOB
-    /*Tests_SRS_IOTHUBCLIENT_02_070: [ If creating the LIST_HANDLE fails then IoTHubClient_CreateFromConnectionString shall fail and return NULL]*/
+    /*Tests_SRS_IOTHUBCLIENT_02_070: [ If creating the LIST_HANDLE or its lock fails then IoTHubClient_CreateFromConnectionString shall fail and return NULL]*/
     TEST_FUNCTION(IoTHubClient_CreateFromConnectionString_if_list_create_fails_then_it_fails)
     {
         // arrange
@@ -509,6 +556,32 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
     }
 #endif
 
+#ifndef DONT_USE_UPLOADTOBLOB
+    /*Tests_SRS_IOTHUBCLIENT_02_070: [ If creating the LIST_HANDLE or its lock fails then IoTHubClient_CreateFromConnectionString shall fail and return NULL]*/
+    TEST_FUNCTION(IoTHubClient_CreateFromConnectionString_if_creating_the_upload_lock_fails_then_it_fails)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
+        EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
+
+        STRICT_EXPECTED_CALL(mocks, Lock_Init());
+        STRICT_EXPECTED_CALL(mocks, Lock_Deinit(TEST_LOCK_HANDLE));
+
+        STRICT_EXPECTED_CALL(mocks, list_create());
+        STRICT_EXPECTED_CALL(mocks, list_destroy(TEST_LIST_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Lock_Init())
+            .SetReturn((LOCK_HANDLE)NULL);
+
+        // act
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_CreateFromConnectionString(TEST_CHAR, provideFAKE);
+
+        // assert
+        ASSERT_IS_NULL(iotHubClient);
+        mocks.AssertActualAndExpectedCalls();
+    }
+#endif
+
     /* Tests_SRS_IOTHUBCLIENT_12_010: [If IoTHubClient_LL_CreateFromConnectionString fails then IoTHubClient_CreateFromConnectionString shall do clean - up and return NULL] */
     TEST_FUNCTION(IoTHubClient_CreateFromConnectionString_if_IoTHubClient_LL_CreateFromConnectionString_fails_then_IoTHubClient_CreateFromConnectionString_do_clean_up_and_fails)
     {
@@ -519,6 +592,8 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
         STRICT_EXPECTED_CALL(mocks, Lock_Init());
 #ifndef DONT_USE_UPLOADTOBLOB
         STRICT_EXPECTED_CALL(mocks, list_create());
+        STRICT_EXPECTED_CALL(mocks, Lock_Init());
+        STRICT_EXPECTED_CALL(mocks, Lock_Deinit(TEST_LOCK_HANDLE));
         STRICT_EXPECTED_CALL(mocks, list_destroy(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
 #endif
@@ -540,7 +615,7 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
     /* Tests_SRS_IOTHUBCLIENT_01_001: [IoTHubClient_Create shall allocate a new IoTHubClient instance and return a non-NULL handle to it.] */
     /* Tests_SRS_IOTHUBCLIENT_01_002: [IoTHubClient_Create shall instantiate a new IoTHubClient_LL instance by calling IoTHubClient_LL_Create and passing the config argument.] */
     /* Tests_SRS_IOTHUBCLIENT_01_029: [IoTHubClient_Create shall create a lock object to be used later for serializing IoTHubClient calls.] */
-    /*Tests_SRS_IOTHUBCLIENT_02_060: [ IoTHubClient_Create shall create a LIST_HANDLE that shall be used beIoTHubClient_UploadToBlobAsync. ]*/
+    /*Tests_SRS_IOTHUBCLIENT_02_060: [ IoTHubClient_Create shall create a LIST_HANDLE holding the uploads queued by IoTHubClient_UploadToBlobAsync and a lock protecting it. ]*/
     TEST_FUNCTION(IoTHubClient_Create_with_valid_arguments_when_all_underlying_calls_are_OK_succeeds)
     {
         // arrange
@@ -549,6 +624,7 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
         STRICT_EXPECTED_CALL(mocks, Lock_Init());
 #ifndef DONT_USE_UPLOADTOBLOB
         STRICT_EXPECTED_CALL(mocks, list_create());
+        STRICT_EXPECTED_CALL(mocks, Lock_Init());
 #endif
         STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_Create(&TEST_CONFIG));
 
@@ -573,12 +649,14 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
         STRICT_EXPECTED_CALL(mocks, Lock_Init());
 #ifndef DONT_USE_UPLOADTOBLOB
         STRICT_EXPECTED_CALL(mocks, list_create());
+        STRICT_EXPECTED_CALL(mocks, Lock_Init());
 #endif
 
         STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_Create(&TEST_CONFIG))
             .SetReturn((IOTHUB_CLIENT_LL_HANDLE)NULL);
         STRICT_EXPECTED_CALL(mocks, Lock_Deinit(TEST_LOCK_HANDLE));
 #ifndef DONT_USE_UPLOADTOBLOB
+        STRICT_EXPECTED_CALL(mocks, Lock_Deinit(TEST_LOCK_HANDLE));
         STRICT_EXPECTED_CALL(mocks, list_destroy(TEST_LIST_HANDLE));
 #endif
         EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
@@ -592,7 +670,7 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
     }
 
 #ifndef DONT_USE_UPLOADTOBLOB
-    /*Tests_SRS_IOTHUBCLIENT_02_061: [ If creating the LIST_HANDLE fails then IoTHubClient_Create shall fail and return NULL. ]*/
+    /*Tests_SRS_IOTHUBCLIENT_02_061: [ If creating the LIST_HANDLE or its lock fails then IoTHubClient_Create shall fail and return NULL. ]*/
     TEST_FUNCTION(IoTHubClient_LL_Create_fails_when_list_create_fails)
     {
         // arrange
@@ -615,6 +693,32 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
     }
 #endif
 
+#ifndef DONT_USE_UPLOADTOBLOB
+    /*Tests_SRS_IOTHUBCLIENT_02_061: [ If creating the LIST_HANDLE or its lock fails then IoTHubClient_Create shall fail and return NULL. ]*/
+    TEST_FUNCTION(IoTHubClient_Create_fails_when_creating_the_upload_lock_fails)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
+        EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
+
+        STRICT_EXPECTED_CALL(mocks, Lock_Init());
+        STRICT_EXPECTED_CALL(mocks, Lock_Deinit(TEST_LOCK_HANDLE));
+
+        STRICT_EXPECTED_CALL(mocks, list_create());
+        STRICT_EXPECTED_CALL(mocks, list_destroy(TEST_LIST_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Lock_Init())
+            .SetFailReturn((LOCK_HANDLE)NULL);
+
+        // act
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+
+        // assert
+        ASSERT_IS_NULL(iotHubClient);
+        mocks.AssertActualAndExpectedCalls();
+    }
+#endif
+
     /* Tests_SRS_IOTHUBCLIENT_01_030: [If creating the lock fails, then IoTHubClient_Create shall return NULL.] */
     /* Tests_SRS_IOTHUBCLIENT_01_031: [If IoTHubClient_Create fails, all resources allocated by it shall be freed.] */
     TEST_FUNCTION(When_Creating_The_Lock_Fails_then_IoTHubClient_Create_fails)
@@ -666,7 +770,7 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
 	//Tests_SRS_IOTHUBCLIENT_17_003: [ IoTHubClient_CreateWithTransport shall call IoTHubTransport_HL_GetLLTransport on transportHandle to get lower layer transport. ]
 	//Tests_SRS_IOTHUBCLIENT_17_005: [ IoTHubClient_CreateWithTransport shall call IoTHubTransport_GetLock to get the transport lock to be used later for serializing IoTHubClient calls. ]
 	//Tests_SRS_IOTHUBCLIENT_17_007: [ IoTHubClient_CreateWithTransport shall instantiate a new IoTHubClient_LL instance by calling IoTHubClient_LL_CreateWithTransport and passing the lower layer transport and config argument. ]
-    /*Tests_SRS_IOTHUBCLIENT_02_073: [ IoTHubClient_CreateWithTransport shall create a LIST_HANDLE that shall be used by IoTHubClient_UploadToBlobAsync. ]*/
+    /*Tests_SRS_IOTHUBCLIENT_02_073: [ IoTHubClient_CreateWithTransport shall create a LIST_HANDLE holding the uploads queued by IoTHubClient_UploadToBlobAsync and a lock protecting it. ]*/
 	TEST_FUNCTION(When_creating_with_transport_success_returns_non_null)
 	{
 		// arrange
@@ -678,7 +782,8 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
 		EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
 
 #ifndef DONT_USE_UPLOADTOBLOB
-        STRICT_EXPECTED_CALL(mocks, list_create()); /*this is the list of SAVED_DATA*/
+        STRICT_EXPECTED_CALL(mocks, list_create()); /*this is the list of queued uploads*/
+        STRICT_EXPECTED_CALL(mocks, Lock_Init()); /*this is the lock of the list of queued uploads*/
 #endif
 
 		STRICT_EXPECTED_CALL(mocks, IoTHubTransport_GetLock(TEST_IOTHUBTRANSPORT_HANDLE));
@@ -709,7 +814,8 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
 		EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
 
 #ifndef DONT_USE_UPLOADTOBLOB
-        STRICT_EXPECTED_CALL(mocks, list_create()); /*this is the list of SAVED_DATA*/
+        STRICT_EXPECTED_CALL(mocks, list_create()); /*this is the list of queued uploads*/
+        STRICT_EXPECTED_CALL(mocks, Lock_Init()); /*this is the lock of the list of queued uploads*/
 #endif
 
 		STRICT_EXPECTED_CALL(mocks, IoTHubTransport_GetLock(TEST_IOTHUBTRANSPORT_HANDLE));
@@ -742,7 +848,9 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
 		EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
 
 #ifndef DONT_USE_UPLOADTOBLOB
-        STRICT_EXPECTED_CALL(mocks, list_create()); /*this is the list of SAVED_DATA*/
+        STRICT_EXPECTED_CALL(mocks, list_create()); /*this is the list of queued uploads*/
+        STRICT_EXPECTED_CALL(mocks, Lock_Init()); /*this is the lock of the list of queued uploads*/
+        STRICT_EXPECTED_CALL(mocks, Lock_Deinit(TEST_LOCK_HANDLE));
         STRICT_EXPECTED_CALL(mocks, list_destroy(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
 #endif
@@ -775,7 +883,9 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
 		EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
 
 #ifndef DONT_USE_UPLOADTOBLOB
-        STRICT_EXPECTED_CALL(mocks, list_create()); /*this is the list of SAVED_DATA*/
+        STRICT_EXPECTED_CALL(mocks, list_create()); /*this is the list of queued uploads*/
+        STRICT_EXPECTED_CALL(mocks, Lock_Init()); /*this is the lock of the list of queued uploads*/
+        STRICT_EXPECTED_CALL(mocks, Lock_Deinit(TEST_LOCK_HANDLE));
         STRICT_EXPECTED_CALL(mocks, list_destroy(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
 #endif
@@ -800,7 +910,9 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
 
 		EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
 #ifndef DONT_USE_UPLOADTOBLOB
-        STRICT_EXPECTED_CALL(mocks, list_create()); /*this is the list of SAVED_DATA*/
+        STRICT_EXPECTED_CALL(mocks, list_create()); /*this is the list of queued uploads*/
+        STRICT_EXPECTED_CALL(mocks, Lock_Init()); /*this is the lock of the list of queued uploads*/
+        STRICT_EXPECTED_CALL(mocks, Lock_Deinit(TEST_LOCK_HANDLE));
         STRICT_EXPECTED_CALL(mocks, list_destroy(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
 #endif
@@ -830,7 +942,9 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
 		EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
 
 #ifndef DONT_USE_UPLOADTOBLOB
-        STRICT_EXPECTED_CALL(mocks, list_create()); /*this is the list of SAVED_DATA*/
+        STRICT_EXPECTED_CALL(mocks, list_create()); /*this is the list of queued uploads*/
+        STRICT_EXPECTED_CALL(mocks, Lock_Init()); /*this is the lock of the list of queued uploads*/
+        STRICT_EXPECTED_CALL(mocks, Lock_Deinit(TEST_LOCK_HANDLE));
         STRICT_EXPECTED_CALL(mocks, list_destroy(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
 #endif
@@ -849,7 +963,7 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
 	}
 
 #ifndef DONT_USE_UPLOADTOBLOB
-    /*Tests_SRS_IOTHUBCLIENT_02_074: [ If creating the LIST_HANDLE fails then IoTHubClient_CreateWithTransport shall fail and return NULL. ]*/
+    /*Tests_SRS_IOTHUBCLIENT_02_074: [ If creating the LIST_HANDLE or its lock fails then IoTHubClient_CreateWithTransport shall fail and return NULL. ]*/
     TEST_FUNCTION(When_creating_with_transport_list_create_fails_returns_null)
     {
         // arrange
@@ -858,7 +972,7 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
         EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
         EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
 
-        STRICT_EXPECTED_CALL(mocks, list_create()) /*this is the list of SAVED_DATA*/
+        STRICT_EXPECTED_CALL(mocks, list_create()) /*this is the list of queued uploads*/
             .SetFailReturn((LIST_HANDLE)NULL);
 
         // act
@@ -872,6 +986,33 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
     }
 #endif
 
+#ifndef DONT_USE_UPLOADTOBLOB
+    /*Tests_SRS_IOTHUBCLIENT_02_074: [ If creating the LIST_HANDLE or its lock fails then IoTHubClient_CreateWithTransport shall fail and return NULL. ]*/
+    TEST_FUNCTION(When_creating_with_transport_the_upload_lock_fails_returns_null)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+
+        EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
+        EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
+
+        STRICT_EXPECTED_CALL(mocks, list_create()); /*this is the list of queued uploads*/
+        STRICT_EXPECTED_CALL(mocks, Lock_Init()) /*this is the lock of the list of queued uploads*/
+            .SetFailReturn((LOCK_HANDLE)NULL);
+        STRICT_EXPECTED_CALL(mocks, list_destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        // act
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_CreateWithTransport(TEST_IOTHUBTRANSPORT_HANDLE, &TEST_CONFIG);
+
+        // assert
+        ASSERT_IS_NULL(iotHubClient);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+    }
+#endif
+
 	//Tests_SRS_IOTHUBCLIENT_17_002: [ If allocating memory for the new IoTHubClient instance fails, then IoTHubClient_CreateWithTransport shall return NULL. ]
 	TEST_FUNCTION(When_creating_with_transport_IoTHubClient_alloc_fails_returns_null)
 	{
@@ -969,8 +1110,8 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
     /* Tests_SRS_IOTHUBCLIENT_01_005: [IoTHubClient_Destroy shall free all resources associated with the iotHubClientHandle instance.] */
     /* Tests_SRS_IOTHUBCLIENT_01_006: [That includes destroying the IoTHubClient_LL instance by calling IoTHubClient_LL_Destroy.] */
     /* Tests_SRS_IOTHUBCLIENT_01_032: [The lock allocated in IoTHubClient_Create shall be also freed.] */
-    /*Tests_SRS_IOTHUBCLIENT_02_069: [ IoTHubClient_Destroy shall free all data created by IoTHubClient_UploadToBlobAsync ]*/
-    /*Tests_SRS_IOTHUBCLIENT_02_072: [ All threads marked as disposable (upon completion of a file upload) shall be joined and the data structures build for them shall be freed. ]*/
+    /*Tests_SRS_IOTHUBCLIENT_02_069: [ IoTHubClient_Destroy shall wait for the uploads accepted by IoTHubClient_UploadToBlobAsync to finish by joining the uploading thread (if any). The serializing lock shall not be held while waiting. ]*/
+    /*Tests_SRS_IOTHUBCLIENT_02_109: [ IoTHubClient_Destroy shall then destroy the LIST_HANDLE of uploads and its lock. ]*/
     TEST_FUNCTION(IoTHubClient_Destroy_frees_underlying_LL_client)
     {
         // arrange
@@ -978,15 +1119,17 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
         IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
         mocks.ResetAllCalls();
 
-		STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
 #ifndef DONT_USE_UPLOADTOBLOB
-        STRICT_EXPECTED_CALL(mocks, list_get_head_item(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE)); /*this is the lock of the list of queued uploads*/
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
 #endif
+
+		STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
 		STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
 
         STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_Destroy(TEST_IOTHUB_CLIENT_LL_HANDLE));
 #ifndef DONT_USE_UPLOADTOBLOB
+        STRICT_EXPECTED_CALL(mocks, Lock_Deinit(TEST_LOCK_HANDLE)); /*this is the lock of the list of queued uploads*/
         STRICT_EXPECTED_CALL(mocks, list_destroy(TEST_LIST_HANDLE));
 #endif
         STRICT_EXPECTED_CALL(mocks, Lock_Deinit(TEST_LOCK_HANDLE));
@@ -1006,17 +1149,19 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
 		IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
 		mocks.ResetAllCalls();
 
-		STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE))
-			.SetFailReturn((LOCK_RESULT)LOCK_ERROR);
 #ifndef DONT_USE_UPLOADTOBLOB
-        STRICT_EXPECTED_CALL(mocks, list_get_head_item(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE)); /*this is the lock of the list of queued uploads*/
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
 #endif
+
+		STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE))
+			.SetFailReturn((LOCK_RESULT)LOCK_ERROR);
 		STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE))
 			.SetFailReturn((LOCK_RESULT)LOCK_ERROR);
 
 		STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_Destroy(TEST_IOTHUB_CLIENT_LL_HANDLE));
 #ifndef DONT_USE_UPLOADTOBLOB
+        STRICT_EXPECTED_CALL(mocks, Lock_Deinit(TEST_LOCK_HANDLE)); /*this is the lock of the list of queued uploads*/
         STRICT_EXPECTED_CALL(mocks, list_destroy(TEST_LIST_HANDLE));
 #endif
 		STRICT_EXPECTED_CALL(mocks, Lock_Deinit(TEST_LOCK_HANDLE));
@@ -1036,10 +1181,14 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
 		IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_CreateWithTransport(TEST_IOTHUBTRANSPORT_HANDLE, &TEST_CONFIG);
 		mocks.ResetAllCalls();
 
+#ifndef DONT_USE_UPLOADTOBLOB
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE)); /*this is the lock of the list of queued uploads*/
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+#endif
+
 		STRICT_EXPECTED_CALL(mocks, Lock(TEST_IOTHUBTRANSPORT_LOCK));
 #ifndef DONT_USE_UPLOADTOBLOB
-        STRICT_EXPECTED_CALL(mocks, list_get_head_item(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Lock_Deinit(TEST_LOCK_HANDLE));
         STRICT_EXPECTED_CALL(mocks, list_destroy(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
 #endif
@@ -1079,13 +1228,14 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
         (void)IoTHubClient_SendEventAsync(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42);
         mocks.ResetAllCalls();
 
+#ifndef DONT_USE_UPLOADTOBLOB
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE)); /*this is the lock of the list of queued uploads*/
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+#endif
+
         STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
         /*here StopThread=1 is set*/
-#ifndef DONT_USE_UPLOADTOBLOB
-        STRICT_EXPECTED_CALL(mocks, list_get_head_item(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-#endif
         STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
 
@@ -1093,6 +1243,7 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
             .IgnoreArgument(2);
         STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_Destroy(TEST_IOTHUB_CLIENT_LL_HANDLE));
 #ifndef DONT_USE_UPLOADTOBLOB
+        STRICT_EXPECTED_CALL(mocks, Lock_Deinit(TEST_LOCK_HANDLE)); /*this is the lock of the list of queued uploads*/
         STRICT_EXPECTED_CALL(mocks, list_destroy(TEST_LIST_HANDLE));
 #endif
         STRICT_EXPECTED_CALL(mocks, Lock_Deinit(TEST_LOCK_HANDLE));
@@ -1114,13 +1265,14 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
         (void)IoTHubClient_SetMessageCallback(iotHubClient, messageCallback, (void*)0x42);
         mocks.ResetAllCalls();
 
+#ifndef DONT_USE_UPLOADTOBLOB
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE)); /*this is the lock of the list of queued uploads*/
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+#endif
+
         STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
         /*here StopThread=1 is set*/
-#ifndef DONT_USE_UPLOADTOBLOB
-        STRICT_EXPECTED_CALL(mocks, list_get_head_item(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-#endif
         STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
 
@@ -1129,6 +1281,7 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
         STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_Destroy(TEST_IOTHUB_CLIENT_LL_HANDLE));
         STRICT_EXPECTED_CALL(mocks, Lock_Deinit(TEST_LOCK_HANDLE));
 #ifndef DONT_USE_UPLOADTOBLOB
+        STRICT_EXPECTED_CALL(mocks, Lock_Deinit(TEST_LOCK_HANDLE)); /*this is the lock of the list of queued uploads*/
         STRICT_EXPECTED_CALL(mocks, list_destroy(TEST_LIST_HANDLE));
 #endif
 
@@ -1152,13 +1305,14 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
         (void)IoTHubClient_SetMessageCallback(iotHubClient, messageCallback, (void*)0x42);
         mocks.ResetAllCalls();
 
+#ifndef DONT_USE_UPLOADTOBLOB
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE)); /*this is the lock of the list of queued uploads*/
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+#endif
+
         STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
         /*here StopThread=1 is set*/
-#ifndef DONT_USE_UPLOADTOBLOB
-        STRICT_EXPECTED_CALL(mocks, list_get_head_item(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-#endif
         STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
 
@@ -1169,6 +1323,7 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
         STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_Destroy(TEST_IOTHUB_CLIENT_LL_HANDLE));
         STRICT_EXPECTED_CALL(mocks, Lock_Deinit(TEST_LOCK_HANDLE));
 #ifndef DONT_USE_UPLOADTOBLOB
+        STRICT_EXPECTED_CALL(mocks, Lock_Deinit(TEST_LOCK_HANDLE)); /*this is the lock of the list of queued uploads*/
         STRICT_EXPECTED_CALL(mocks, list_destroy(TEST_LIST_HANDLE));
 #endif
         EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
@@ -1191,12 +1346,13 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
         (void)IoTHubClient_SetMessageCallback(iotHubClient, messageCallback, (void*)0x42);
         mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
 #ifndef DONT_USE_UPLOADTOBLOB
-        STRICT_EXPECTED_CALL(mocks, list_get_head_item(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE)); /*this is the lock of the list of queued uploads*/
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
 #endif
+
+        STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, ThreadAPI_Join(TEST_THREAD_HANDLE, IGNORED_PTR_ARG))
@@ -1205,6 +1361,7 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
         STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_Destroy(TEST_IOTHUB_CLIENT_LL_HANDLE));
         STRICT_EXPECTED_CALL(mocks, Lock_Deinit(TEST_LOCK_HANDLE));
 #ifndef DONT_USE_UPLOADTOBLOB
+        STRICT_EXPECTED_CALL(mocks, Lock_Deinit(TEST_LOCK_HANDLE)); /*this is the lock of the list of queued uploads*/
         STRICT_EXPECTED_CALL(mocks, list_destroy(TEST_LIST_HANDLE));
 #endif
         EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
@@ -1306,15 +1463,25 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
         IoTHubClient_Destroy(iotHubClient);
     }
 
-    /* SRS_IOTHUBCLIENT_01_009: [IoTHubClient_SendEventAsync shall start the worker thread if it was not previously started.] */
-    TEST_FUNCTION(When_The_Worker_Thread_Was_Started_Already_Due_To_SendEventAsync_Thread_Is_Not_Started_Again_On_A_New_SendEventAsync)
+    /*Tests_SRS_IOTHUBCLIENT_02_085: [ If IoTHubClient_LL_SendEventAsync returns IOTHUB_CLIENT_BUSY and "messageQueueFullPolicy" is IOTHUB_CLIENT_QUEUE_FULL_BLOCK then IoTHubClient_SendEventAsync shall release the lock, sleep and try again. ]*/
+    /*Tests_SRS_IOTHUBCLIENT_02_087: [ "messageQueueFullPolicy" shall be passed to IoTHubClient_LL_SetOption and, if that succeeds, remembered by IoTHubClient_SendEventAsync. ]*/
+    TEST_FUNCTION(IoTHubClient_SendEventAsync_when_queue_is_full_and_policy_is_BLOCK_retries)
     {
         // arrange
         CIoTHubClientMocks mocks;
         IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
-        (void)IoTHubClient_SendEventAsync(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42);
+        IOTHUB_CLIENT_QUEUE_FULL_POLICY policy = IOTHUB_CLIENT_QUEUE_FULL_BLOCK;
+        (void)IoTHubClient_SetOption(iotHubClient, "messageQueueFullPolicy", &policy);
         mocks.ResetAllCalls();
 
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendEventAsync(TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42))
+            .SetReturn(IOTHUB_CLIENT_BUSY);
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE)); /*counting the retry*/
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(10));
         STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
         STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendEventAsync(TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42));
         STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
@@ -1330,68 +1497,83 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
         IoTHubClient_Destroy(iotHubClient);
     }
 
-    /* SRS_IOTHUBCLIENT_01_009: [IoTHubClient_SendEventAsync shall start the worker thread if it was not previously started.] */
-    TEST_FUNCTION(When_The_Worker_Thread_Was_Started_Already_Due_To_SetMessageCallback_Thread_Is_Not_Started_Again_On_A_New_SendEventAsync)
+    /*Tests_SRS_IOTHUBCLIENT_02_086: [ If "messageQueueBlockTimeout" is not 0 and the message could not be queued in that many milliseconds then IoTHubClient_SendEventAsync shall return IOTHUB_CLIENT_BUSY. ]*/
+    TEST_FUNCTION(IoTHubClient_SendEventAsync_when_queue_stays_full_past_messageQueueBlockTimeout_fails)
     {
         // arrange
         CIoTHubClientMocks mocks;
         IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
-        (void)IoTHubClient_SetMessageCallback(iotHubClient, messageCallback, (void*)0x42);
+        IOTHUB_CLIENT_QUEUE_FULL_POLICY policy = IOTHUB_CLIENT_QUEUE_FULL_BLOCK;
+        (void)IoTHubClient_SetOption(iotHubClient, "messageQueueFullPolicy", &policy);
+        unsigned int blockTimeout = 10;
+        (void)IoTHubClient_SetOption(iotHubClient, "messageQueueBlockTimeout", &blockTimeout);
         mocks.ResetAllCalls();
 
         STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
-        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendEventAsync(TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42));
+        EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendEventAsync(TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42))
+            .SetReturn(IOTHUB_CLIENT_BUSY);
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE)); /*counting the retry*/
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(10));
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendEventAsync(TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42))
+            .SetReturn(IOTHUB_CLIENT_BUSY);
         STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
 
         // act
         IOTHUB_CLIENT_RESULT result = IoTHubClient_SendEventAsync(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42);
 
         // assert
-        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_BUSY, result);
         mocks.AssertActualAndExpectedCalls();
 
         // cleanup
         IoTHubClient_Destroy(iotHubClient);
     }
 
-    /* Tests_SRS_IOTHUBCLIENT_01_026: [If acquiring the lock fails, IoTHubClient_SendEventAsync shall return IOTHUB_CLIENT_ERROR.] */
-    TEST_FUNCTION(When_Acquiring_The_lock_fails_then_IoTHubClient_SendEventAsync_fails)
+    /*Tests_SRS_IOTHUBCLIENT_02_085: [ If IoTHubClient_LL_SendEventAsync returns IOTHUB_CLIENT_BUSY and "messageQueueFullPolicy" is IOTHUB_CLIENT_QUEUE_FULL_BLOCK then IoTHubClient_SendEventAsync shall release the lock, sleep and try again. ]*/
+    TEST_FUNCTION(IoTHubClient_SendEventAsync_when_queue_is_full_and_policy_is_not_BLOCK_does_not_retry)
     {
         // arrange
         CIoTHubClientMocks mocks;
         IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
-        (void)IoTHubClient_SetMessageCallback(iotHubClient, messageCallback, (void*)0x42);
         mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE))
-            .SetReturn(LOCK_ERROR);
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendEventAsync(TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42))
+            .SetReturn(IOTHUB_CLIENT_BUSY);
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
 
         // act
         IOTHUB_CLIENT_RESULT result = IoTHubClient_SendEventAsync(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42);
 
         // assert
-        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_ERROR);
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_BUSY, result);
         mocks.AssertActualAndExpectedCalls();
 
         // cleanup
         IoTHubClient_Destroy(iotHubClient);
     }
 
-    TEST_FUNCTION(When_Unlock_fails_SendEventAsync_still_succeeds)
+    /* Tests_SRS_IOTHUBCLIENT_02_082: [ IoTHubClient_SendEventAsyncTakeOwnership shall behave as IoTHubClient_SendEventAsync, except that it shall not make a copy of eventMessageHandle. ]*/
+    /* Tests_SRS_IOTHUBCLIENT_02_083: [ IoTHubClient_SendEventAsyncTakeOwnership shall call IoTHubClient_LL_SendEventAsyncTakeOwnership and return its result. ]*/
+    TEST_FUNCTION(IoTHubClient_SendEventAsyncTakeOwnership_calls_the_underlayer_TakeOwnership)
     {
         // arrange
         CIoTHubClientMocks mocks;
         IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
-        (void)IoTHubClient_SetMessageCallback(iotHubClient, messageCallback, (void*)0x42);
         mocks.ResetAllCalls();
 
         STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
-        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendEventAsync(TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42));
-        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE))
-            .SetReturn(LOCK_ERROR);
+        EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendEventAsyncTakeOwnership(TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
 
         // act
-        IOTHUB_CLIENT_RESULT result = IoTHubClient_SendEventAsync(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42);
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_SendEventAsyncTakeOwnership(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42);
 
         // assert
         ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
@@ -1401,12 +1583,21 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
         IoTHubClient_Destroy(iotHubClient);
     }
 
-    /* IoTHubClient_SetMessageCallback */
+    /* Tests_SRS_IOTHUBCLIENT_02_082: [ IoTHubClient_SendEventAsyncTakeOwnership shall behave as IoTHubClient_SendEventAsync, except that it shall not make a copy of eventMessageHandle. ]*/
+    TEST_FUNCTION(IoTHubClient_SendEventAsyncTakeOwnership_With_NULL_Handle_Fails)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
 
-    /* Tests_SRS_IOTHUBCLIENT_01_014: [IoTHubClient_SetMessageCallback shall start the worker thread if it was not previously started.] */
-    /* Tests_SRS_IOTHUBCLIENT_01_017: [IoTHubClient_SetMessageCallback shall call IoTHubClient_LL_SetMessageCallback, while passing the IoTHubClient_LL handle created by IoTHubClient_Create and the parameters messageCallback and userContextCallback.] */
-    /* Tests_SRS_IOTHUBCLIENT_01_027: [IoTHubClient_SetMessageCallback shall be made thread-safe by using the lock created in IoTHubClient_Create.] */
-    TEST_FUNCTION(IoTHubClient_SetMessageCallback_starts_the_worker_thread_and_calls_the_underlayer)
+        // act
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_SendEventAsyncTakeOwnership(NULL, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42);
+
+        // assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    }
+
+    /* Tests_SRS_IOTHUBCLIENT_02_083: [ IoTHubClient_SendEventAsyncTakeOwnership shall call IoTHubClient_LL_SendEventAsyncTakeOwnership and return its result. ]*/
+    TEST_FUNCTION(IoTHubClient_SendEventAsyncTakeOwnership_Returns_The_Error_Code_From_The_Underlayer)
     {
         // arrange
         CIoTHubClientMocks mocks;
@@ -1415,108 +1606,232 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
 
         STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
         EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SetMessageCallback(TEST_IOTHUB_CLIENT_LL_HANDLE, messageCallback, (void*)0x42));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendEventAsyncTakeOwnership(TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42))
+            .SetReturn(IOTHUB_CLIENT_ERROR);
         STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
 
         // act
-        IOTHUB_CLIENT_RESULT result = IoTHubClient_SetMessageCallback(iotHubClient, messageCallback, (void*)0x42);
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_SendEventAsyncTakeOwnership(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42);
 
         // assert
-        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
         mocks.AssertActualAndExpectedCalls();
 
         // cleanup
         IoTHubClient_Destroy(iotHubClient);
     }
 
-    /* Tests_SRS_IOTHUBCLIENT_01_015: [If starting the thread fails, IoTHubClient_SetMessageCallback shall return IOTHUB_CLIENT_ERROR.] */
-    TEST_FUNCTION(When_Thread_API_Create_fails_then_IoTHubClient_SetMessageCallback_fails)
+    /* SRS_IOTHUBCLIENT_01_009: [IoTHubClient_SendEventAsync shall start the worker thread if it was not previously started.] */
+    TEST_FUNCTION(When_The_Worker_Thread_Was_Started_Already_Due_To_SendEventAsync_Thread_Is_Not_Started_Again_On_A_New_SendEventAsync)
     {
         // arrange
         CIoTHubClientMocks mocks;
         IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        (void)IoTHubClient_SendEventAsync(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42);
         mocks.ResetAllCalls();
 
         STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
-        EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .SetReturn(THREADAPI_ERROR);
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendEventAsync(TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42));
         STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
 
         // act
-        IOTHUB_CLIENT_RESULT result = IoTHubClient_SetMessageCallback(iotHubClient, messageCallback, (void*)0x42);
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_SendEventAsync(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42);
 
         // assert
-        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_ERROR);
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
         mocks.AssertActualAndExpectedCalls();
 
         // cleanup
         IoTHubClient_Destroy(iotHubClient);
     }
 
-    /* Tests_SRS_IOTHUBCLIENT_01_016: [If iotHubClientHandle is NULL, IoTHubClient_SetMessageCallback shall return IOTHUB_CLIENT_INVALID_ARG.] */
-    TEST_FUNCTION(IoTHubClient_SetMessageCallback_with_NULL_handle_fails)
-    {
-        // arrange
-        CIoTHubClientMocks mocks;
-
-        // act
-        IOTHUB_CLIENT_RESULT result = IoTHubClient_SetMessageCallback(NULL, messageCallback, (void*)0x42);
-
-        // assert
-        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_INVALID_ARG);
-    }
-
-    /* Tests_SRS_IOTHUBCLIENT_01_018: [When IoTHubClient_LL_SetMessageCallback is called, IoTHubClient_SetMessageCallback shall return the result of IoTHubClient_LL_SetMessageCallback.] */
-    TEST_FUNCTION(IoTHubClient_SetMessageCallback_returns_the_result_of_calling_IoTHubClient_LL_SetMessageCallback)
+    /* SRS_IOTHUBCLIENT_01_009: [IoTHubClient_SendEventAsync shall start the worker thread if it was not previously started.] */
+    TEST_FUNCTION(When_The_Worker_Thread_Was_Started_Already_Due_To_SetMessageCallback_Thread_Is_Not_Started_Again_On_A_New_SendEventAsync)
     {
         // arrange
         CIoTHubClientMocks mocks;
         IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        (void)IoTHubClient_SetMessageCallback(iotHubClient, messageCallback, (void*)0x42);
         mocks.ResetAllCalls();
 
         STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
-        EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SetMessageCallback(TEST_IOTHUB_CLIENT_LL_HANDLE, messageCallback, (void*)0x42))
-            .SetReturn(IOTHUB_CLIENT_INVALID_SIZE);
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendEventAsync(TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42));
         STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
 
         // act
-        IOTHUB_CLIENT_RESULT result = IoTHubClient_SetMessageCallback(iotHubClient, messageCallback, (void*)0x42);
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_SendEventAsync(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42);
 
         // assert
-        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_INVALID_SIZE);
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
         mocks.AssertActualAndExpectedCalls();
 
         // cleanup
         IoTHubClient_Destroy(iotHubClient);
     }
 
-    /* Tests_SRS_IOTHUBCLIENT_01_014: [IoTHubClient_SetMessageCallback shall start the worker thread if it was not previously started.] */
-    TEST_FUNCTION(When_the_worker_thread_was_started_by_a_SendEventAsync_A_Call_To_SetMessageCallback_Does_NOt_Start_A_New_Thread)
+    /* Tests_SRS_IOTHUBCLIENT_01_026: [If acquiring the lock fails, IoTHubClient_SendEventAsync shall return IOTHUB_CLIENT_ERROR.] */
+    TEST_FUNCTION(When_Acquiring_The_lock_fails_then_IoTHubClient_SendEventAsync_fails)
     {
         // arrange
         CIoTHubClientMocks mocks;
         IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
-        (void)IoTHubClient_SendEventAsync(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42);
+        (void)IoTHubClient_SetMessageCallback(iotHubClient, messageCallback, (void*)0x42);
         mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
-        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SetMessageCallback(TEST_IOTHUB_CLIENT_LL_HANDLE, messageCallback, (void*)0x42));
-        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE))
+            .SetReturn(LOCK_ERROR);
 
         // act
-        IOTHUB_CLIENT_RESULT result = IoTHubClient_SetMessageCallback(iotHubClient, messageCallback, (void*)0x42);
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_SendEventAsync(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42);
 
         // assert
-        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_ERROR);
         mocks.AssertActualAndExpectedCalls();
 
         // cleanup
         IoTHubClient_Destroy(iotHubClient);
     }
 
-    /* Tests_SRS_IOTHUBCLIENT_01_014: [IoTHubClient_SetMessageCallback shall start the worker thread if it was not previously started.] */
-    TEST_FUNCTION(When_the_worker_thread_was_started_by_a_previous_SetMessageCallback_A_Call_To_SetMessageCallback_Does_Not_Start_A_New_Thread)
+    TEST_FUNCTION(When_Unlock_fails_SendEventAsync_still_succeeds)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        (void)IoTHubClient_SetMessageCallback(iotHubClient, messageCallback, (void*)0x42);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendEventAsync(TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE))
+            .SetReturn(LOCK_ERROR);
+
+        // act
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_SendEventAsync(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42);
+
+        // assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        // cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /* IoTHubClient_SetMessageCallback */
+
+    /* Tests_SRS_IOTHUBCLIENT_01_014: [IoTHubClient_SetMessageCallback shall start the worker thread if it was not previously started.] */
+    /* Tests_SRS_IOTHUBCLIENT_01_017: [IoTHubClient_SetMessageCallback shall call IoTHubClient_LL_SetMessageCallback, while passing the IoTHubClient_LL handle created by IoTHubClient_Create and the parameters messageCallback and userContextCallback.] */
+    /* Tests_SRS_IOTHUBCLIENT_01_027: [IoTHubClient_SetMessageCallback shall be made thread-safe by using the lock created in IoTHubClient_Create.] */
+    TEST_FUNCTION(IoTHubClient_SetMessageCallback_starts_the_worker_thread_and_calls_the_underlayer)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SetMessageCallback(TEST_IOTHUB_CLIENT_LL_HANDLE, messageCallback, (void*)0x42));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        // act
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_SetMessageCallback(iotHubClient, messageCallback, (void*)0x42);
+
+        // assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        // cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /* Tests_SRS_IOTHUBCLIENT_01_015: [If starting the thread fails, IoTHubClient_SetMessageCallback shall return IOTHUB_CLIENT_ERROR.] */
+    TEST_FUNCTION(When_Thread_API_Create_fails_then_IoTHubClient_SetMessageCallback_fails)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .SetReturn(THREADAPI_ERROR);
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        // act
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_SetMessageCallback(iotHubClient, messageCallback, (void*)0x42);
+
+        // assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_ERROR);
+        mocks.AssertActualAndExpectedCalls();
+
+        // cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /* Tests_SRS_IOTHUBCLIENT_01_016: [If iotHubClientHandle is NULL, IoTHubClient_SetMessageCallback shall return IOTHUB_CLIENT_INVALID_ARG.] */
+    TEST_FUNCTION(IoTHubClient_SetMessageCallback_with_NULL_handle_fails)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+
+        // act
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_SetMessageCallback(NULL, messageCallback, (void*)0x42);
+
+        // assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_INVALID_ARG);
+    }
+
+    /* Tests_SRS_IOTHUBCLIENT_01_018: [When IoTHubClient_LL_SetMessageCallback is called, IoTHubClient_SetMessageCallback shall return the result of IoTHubClient_LL_SetMessageCallback.] */
+    TEST_FUNCTION(IoTHubClient_SetMessageCallback_returns_the_result_of_calling_IoTHubClient_LL_SetMessageCallback)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SetMessageCallback(TEST_IOTHUB_CLIENT_LL_HANDLE, messageCallback, (void*)0x42))
+            .SetReturn(IOTHUB_CLIENT_INVALID_SIZE);
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        // act
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_SetMessageCallback(iotHubClient, messageCallback, (void*)0x42);
+
+        // assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_INVALID_SIZE);
+        mocks.AssertActualAndExpectedCalls();
+
+        // cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /* Tests_SRS_IOTHUBCLIENT_01_014: [IoTHubClient_SetMessageCallback shall start the worker thread if it was not previously started.] */
+    TEST_FUNCTION(When_the_worker_thread_was_started_by_a_SendEventAsync_A_Call_To_SetMessageCallback_Does_NOt_Start_A_New_Thread)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        (void)IoTHubClient_SendEventAsync(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SetMessageCallback(TEST_IOTHUB_CLIENT_LL_HANDLE, messageCallback, (void*)0x42));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        // act
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_SetMessageCallback(iotHubClient, messageCallback, (void*)0x42);
+
+        // assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        // cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /* Tests_SRS_IOTHUBCLIENT_01_014: [IoTHubClient_SetMessageCallback shall start the worker thread if it was not previously started.] */
+    TEST_FUNCTION(When_the_worker_thread_was_started_by_a_previous_SetMessageCallback_A_Call_To_SetMessageCallback_Does_Not_Start_A_New_Thread)
     {
         // arrange
         CIoTHubClientMocks mocks;
@@ -1756,6 +2071,112 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
         IoTHubClient_Destroy(iotHubClient);
     }
 
+    /*Tests_SRS_IOTHUBCLIENT_02_090: [ IoTHubClient_GetSendQueueStats shall call IoTHubClient_LL_GetSendQueueStats and return what IoTHubClient_LL_GetSendQueueStats returns. ]*/
+    /*Tests_SRS_IOTHUBCLIENT_02_089: [ IoTHubClient_GetSendQueueStats shall be made thread-safe by using the lock created in IoTHubClient_Create. If acquiring the lock fails, IoTHubClient_GetSendQueueStats shall return IOTHUB_CLIENT_ERROR. ]*/
+    TEST_FUNCTION(IoTHubClient_GetSendQueueStats_Calls_The_Underlayer_With_Lock_On)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        mocks.ResetAllCalls();
+
+        IOTHUB_CLIENT_SEND_QUEUE_STATS injectedStats = { 1, 2, 3, 4 };
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_GetSendQueueStats(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG))
+            .CopyOutArgumentBuffer(2, &injectedStats, sizeof(injectedStats));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        // act
+        IOTHUB_CLIENT_SEND_QUEUE_STATS stats;
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_GetSendQueueStats(iotHubClient, &stats);
+
+        // assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+        ASSERT_ARE_EQUAL(size_t, 1, stats.messageCount);
+        ASSERT_ARE_EQUAL(size_t, 2, stats.byteCount);
+        ASSERT_ARE_EQUAL(size_t, 3, stats.droppedCount);
+        ASSERT_ARE_EQUAL(size_t, 4, stats.rejectedCount);
+        mocks.AssertActualAndExpectedCalls();
+
+        // cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_02_110: [ Only the last IOTHUB_CLIENT_BUSY of a blocked IoTHubClient_SendEventAsync shall count as refused in the statistics returned by IoTHubClient_GetSendQueueStats. ]*/
+    TEST_FUNCTION(IoTHubClient_GetSendQueueStats_does_not_count_the_retries_of_a_blocked_send_as_rejected)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        IOTHUB_CLIENT_QUEUE_FULL_POLICY policy = IOTHUB_CLIENT_QUEUE_FULL_BLOCK;
+        (void)IoTHubClient_SetOption(iotHubClient, "messageQueueFullPolicy", &policy);
+        unsigned int blockTimeout = 20;
+        (void)IoTHubClient_SetOption(iotHubClient, "messageQueueBlockTimeout", &blockTimeout);
+        mocks.ResetAllCalls();
+
+        EXPECTED_CALL(mocks, IoTHubClient_LL_SendEventAsync(TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42))
+            .SetReturn(IOTHUB_CLIENT_BUSY)
+            .ExpectedTimesExactly(3);
+        (void)IoTHubClient_SendEventAsync(iotHubClient, TEST_DEVICEMESSAGE_HANDLE, eventConfirmationCallback, (void*)0x42); /*3 tries, 2 of them retried*/
+        mocks.ResetAllCalls();
+
+        IOTHUB_CLIENT_SEND_QUEUE_STATS injectedStats = { 0, 0, 0, 3 }; /*IoTHubClient_LL has seen 3 IOTHUB_CLIENT_BUSY*/
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_GetSendQueueStats(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG))
+            .CopyOutArgumentBuffer(2, &injectedStats, sizeof(injectedStats));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        // act
+        IOTHUB_CLIENT_SEND_QUEUE_STATS stats;
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_GetSendQueueStats(iotHubClient, &stats);
+
+        // assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+        ASSERT_ARE_EQUAL(size_t, 1, stats.rejectedCount);
+        mocks.AssertActualAndExpectedCalls();
+
+        // cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_02_088: [ If iotHubClientHandle is NULL then IoTHubClient_GetSendQueueStats shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+    TEST_FUNCTION(IoTHubClient_GetSendQueueStats_With_NULL_handle_fails)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+
+        // act
+        IOTHUB_CLIENT_SEND_QUEUE_STATS stats;
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_GetSendQueueStats(NULL, &stats);
+
+        // assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+        mocks.AssertActualAndExpectedCalls();
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_02_089: [ IoTHubClient_GetSendQueueStats shall be made thread-safe by using the lock created in IoTHubClient_Create. If acquiring the lock fails, IoTHubClient_GetSendQueueStats shall return IOTHUB_CLIENT_ERROR. ]*/
+    TEST_FUNCTION(when_Lock_fails_IoTHubClient_GetSendQueueStats_fails)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE))
+            .SetReturn(LOCK_ERROR);
+
+        // act
+        IOTHUB_CLIENT_SEND_QUEUE_STATS stats;
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_GetSendQueueStats(iotHubClient, &stats);
+
+        // assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        // cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
     /* Tests_SRS_IOTHUBCLIENT_01_034: [If acquiring the lock fails, IoTHubClient_GetSendStatus shall return IOTHUB_CLIENT_ERROR.] */
     TEST_FUNCTION(When_acquiring_the_lock_fails_then_IoTHubClient_GetSendStatus_fails)
     {
@@ -1810,7 +2231,6 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
     /* Tests_SRS_IOTHUBCLIENT_01_037: [The thread created by IoTHubClient_Create shall call IoTHubClient_LL_DoWork every 1 ms.] */
     /* Tests_SRS_IOTHUBCLIENT_01_038: [The thread shall exit when IoTHubClient_Destroy is called.] */
     /* Tests_SRS_IOTHUBCLIENT_01_039: [All calls to IoTHubClient_LL_DoWork shall be protected by the lock created in IotHubClient_Create.] */
-    /*Tests_SRS_IOTHUBCLIENT_02_072: [ All threads marked as disposable (upon completion of a file upload) shall be joined and the data structures build for them shall be freed. ]*/
     TEST_FUNCTION(Worker_Thread_calls_DoWork_Every_1_ms)
     {
         // arrange
@@ -1823,10 +2243,6 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
         current_iothub_client = iotHubClient;
         STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
         STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_DoWork(TEST_IOTHUB_CLIENT_LL_HANDLE));
-#ifndef DONT_USE_UPLOADTOBLOB
-        STRICT_EXPECTED_CALL(mocks, list_get_head_item(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-#endif
         STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
         
         STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(1));
@@ -1858,19 +2274,11 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
         current_iothub_client = iotHubClient;
         STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
         STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_DoWork(TEST_IOTHUB_CLIENT_LL_HANDLE));
-#ifndef DONT_USE_UPLOADTOBLOB
-        STRICT_EXPECTED_CALL(mocks, list_get_head_item(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-#endif
         STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
 
         STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(1));
         STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
         STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_DoWork(TEST_IOTHUB_CLIENT_LL_HANDLE));
-#ifndef DONT_USE_UPLOADTOBLOB
-        STRICT_EXPECTED_CALL(mocks, list_get_head_item(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-#endif
         STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
 
         STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(1));
@@ -1907,10 +2315,6 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
         /* second round, when lock does not fail and DoWork gets called */
         STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
         STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_DoWork(TEST_IOTHUB_CLIENT_LL_HANDLE));
-#ifndef DONT_USE_UPLOADTOBLOB
-        STRICT_EXPECTED_CALL(mocks, list_get_head_item(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-#endif
         STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
 
         STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(1));
@@ -1927,35 +2331,278 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
         IoTHubClient_Destroy(iotHubClient);
     }
 
-    /* IoTHubClient_SetOption */
-
-    /*Tests_SRS_IOTHUBCLIENT_02_034: [If parameter iotHubClientHandle is NULL then IoTHubClient_SetOption shall return IOTHUB_CLIENT_INVALID_ARG.] */
-    TEST_FUNCTION(IoTHubClient_SetOption_with_NULL_handle_fails)
+    /*Tests_SRS_IOTHUBCLIENT_02_076: [ Every API that starts the worker thread shall mark that work is pending. ]*/
+    /*Tests_SRS_IOTHUBCLIENT_02_077: [ If any work was enqueued since the last call to IoTHubClient_LL_DoWork then the thread shall sleep 1 ms. ]*/
+    /*Tests_SRS_IOTHUBCLIENT_02_079: [ Otherwise the thread shall double the previous sleep time without exceeding the value set by "maxIdleSleep". ]*/
+    TEST_FUNCTION(Worker_Thread_backs_off_when_idle_and_maxIdleSleep_is_set)
     {
-        /// arrange
+        // arrange
         CIoTHubClientMocks mocks;
+        unsigned int maxIdleSleep = 3;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        (void)IoTHubClient_SetOption(iotHubClient, "maxIdleSleep", &maxIdleSleep);
+        (void)IoTHubClient_SetMessageCallback(iotHubClient, messageCallback, (void*)0x42);
+        mocks.ResetAllCalls();
 
-        ///act
-        auto result = IoTHubClient_SetOption(NULL, "a", "b");
-
-        ///assert
-        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
-
-        ///cleanup
-        
-    }
+        howManyDoWorkCalls = 3;
+        current_iothub_client = iotHubClient;
 
-    /*Tests_SRS_IOTHUBCLIENT_02_035: [If parameter optionName is NULL then IoTHubClient_SetOption shall return IOTHUB_CLIENT_INVALID_ARG.] */
-    TEST_FUNCTION(IoTHubClient_SetOption_with_NULL_optionName_fails)
-    {
-        /// arrange
-        CIoTHubClientMocks mocks;
+        /*first round: work is pending because of IoTHubClient_SetMessageCallback*/
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_DoWork(TEST_IOTHUB_CLIENT_LL_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(1));
 
-        IOTHUB_CLIENT_HANDLE handle = IoTHubClient_Create(&TEST_CONFIG);
-        mocks.ResetAllCalls();
+        /*second round: idle, sleep doubles*/
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_DoWork(TEST_IOTHUB_CLIENT_LL_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_GetSendStatus(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG))
+            .IgnoreArgument(2);
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(2));
+
+        /*third round: idle, sleep is capped at maxIdleSleep*/
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_DoWork(TEST_IOTHUB_CLIENT_LL_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_GetSendStatus(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG))
+            .IgnoreArgument(2);
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(3));
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        // act
+        threadFunc(threadFuncArg);
+
+        // assert
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_02_078: [ If IoTHubClient_LL_GetSendStatus fails or reports IOTHUB_CLIENT_SEND_STATUS_BUSY then the thread shall sleep 1 ms. ]*/
+    TEST_FUNCTION(Worker_Thread_does_not_back_off_while_sending)
+    {
+        // arrange
+        CIoTHubClientMocks mocks;
+        unsigned int maxIdleSleep = 100;
+        IOTHUB_CLIENT_HANDLE iotHubClient = IoTHubClient_Create(&TEST_CONFIG);
+        (void)IoTHubClient_SetOption(iotHubClient, "maxIdleSleep", &maxIdleSleep);
+        (void)IoTHubClient_SetMessageCallback(iotHubClient, messageCallback, (void*)0x42);
+        mocks.ResetAllCalls();
+
+        howManyDoWorkCalls = 2;
+        current_iothub_client = iotHubClient;
+        currentSendStatus = IOTHUB_CLIENT_SEND_STATUS_BUSY;
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_DoWork(TEST_IOTHUB_CLIENT_LL_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(1));
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_DoWork(TEST_IOTHUB_CLIENT_LL_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_GetSendStatus(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG))
+            .IgnoreArgument(2);
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(1));
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        // act
+        threadFunc(threadFuncArg);
+
+        // assert
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(iotHubClient);
+    }
+
+    /* IoTHubClient_SetOption */
+
+    /*Tests_SRS_IOTHUBCLIENT_02_075: [ "maxIdleSleep" - the maximum time in milliseconds the worker thread sleeps between calls to IoTHubClient_LL_DoWork when there is nothing to send. Value is a pointer to an unsigned int. ]*/
+    TEST_FUNCTION(IoTHubClient_SetOption_maxIdleSleep_is_handled_by_IoTHubClient)
+    {
+        /// arrange
+        CIoTHubClientMocks mocks;
+        unsigned int maxIdleSleep = 100;
+
+        IOTHUB_CLIENT_HANDLE handle = IoTHubClient_Create(&TEST_CONFIG);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
 
         ///act
-        auto result = IoTHubClient_SetOption(handle, NULL, "b");
+        auto result = IoTHubClient_SetOption(handle, "maxIdleSleep", &maxIdleSleep);
+
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(handle);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_02_081: [ If the transport connection is shared, "maxIdleSleep" shall be passed to IoTHubTransport_SetMaxIdleSleep and IoTHubClient_SetOption shall return what IoTHubTransport_SetMaxIdleSleep returns. ]*/
+    TEST_FUNCTION(IoTHubClient_SetOption_maxIdleSleep_shared_transport_calls_IoTHubTransport_SetMaxIdleSleep)
+    {
+        /// arrange
+        CIoTHubClientMocks mocks;
+        unsigned int maxIdleSleep = 100;
+
+        IOTHUB_CLIENT_HANDLE handle = IoTHubClient_CreateWithTransport(TEST_IOTHUBTRANSPORT_HANDLE, &TEST_CONFIG);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, IoTHubTransport_SetMaxIdleSleep(TEST_IOTHUBTRANSPORT_HANDLE, 100))
+            .SetReturn(IOTHUB_CLIENT_ERROR);
+        STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        ///act
+        auto result = IoTHubClient_SetOption(handle, "maxIdleSleep", &maxIdleSleep);
+
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(handle);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_02_084: [ "messageQueueBlockTimeout" - how many milliseconds IoTHubClient_SendEventAsync waits for room in the send queue under IOTHUB_CLIENT_QUEUE_FULL_BLOCK. 0 means no limit. Value is a pointer to an unsigned int. ]*/
+    TEST_FUNCTION(IoTHubClient_SetOption_messageQueueBlockTimeout_is_handled_by_IoTHubClient)
+    {
+        /// arrange
+        CIoTHubClientMocks mocks;
+
+        IOTHUB_CLIENT_HANDLE handle = IoTHubClient_Create(&TEST_CONFIG);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        ///act
+        unsigned int blockTimeout = 100;
+        auto result = IoTHubClient_SetOption(handle, "messageQueueBlockTimeout", &blockTimeout);
+
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(handle);
+    }
+
+#ifndef DONT_USE_UPLOADTOBLOB
+    /*Tests_SRS_IOTHUBCLIENT_02_101: [ "uploadQueueMaxCount" - IoTHubClient_UploadToBlobAsync shall not let more than `*value` uploads be queued or uploading. 0 means no limit. Value is a pointer to a size_t. ]*/
+    /*Tests_SRS_IOTHUBCLIENT_02_105: [ The "uploadQueue..." options shall be changed under the lock of the LIST_HANDLE of uploads. If acquiring it fails then IoTHubClient_SetOption shall return IOTHUB_CLIENT_ERROR. ]*/
+    TEST_FUNCTION(IoTHubClient_SetOption_uploadQueueMaxCount_is_handled_by_IoTHubClient)
+    {
+        /// arrange
+        CIoTHubClientMocks mocks;
+
+        IOTHUB_CLIENT_HANDLE handle = IoTHubClient_Create(&TEST_CONFIG);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE)) /*the serializing lock and the lock of the list of queued uploads*/
+            .ExpectedTimesExactly(2);
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE))
+            .ExpectedTimesExactly(2);
+
+        ///act
+        size_t maxCount = 4;
+        auto result = IoTHubClient_SetOption(handle, "uploadQueueMaxCount", &maxCount);
+
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(handle);
+    }
+#endif
+
+#ifndef DONT_USE_UPLOADTOBLOB
+    /*Tests_SRS_IOTHUBCLIENT_02_102: [ "uploadQueueMaxBytes" - IoTHubClient_UploadToBlobAsync shall not let the sources it copied for the uploads queued or uploading total more than `*value` bytes. 0 means no limit. Value is a pointer to a size_t. ]*/
+    TEST_FUNCTION(IoTHubClient_SetOption_uploadQueueMaxBytes_is_handled_by_IoTHubClient)
+    {
+        /// arrange
+        CIoTHubClientMocks mocks;
+
+        IOTHUB_CLIENT_HANDLE handle = IoTHubClient_Create(&TEST_CONFIG);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE))
+            .ExpectedTimesExactly(2);
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE))
+            .ExpectedTimesExactly(2);
+
+        ///act
+        size_t maxBytes = 1024 * 1024;
+        auto result = IoTHubClient_SetOption(handle, "uploadQueueMaxBytes", &maxBytes);
+
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(handle);
+    }
+#endif
+
+#ifndef DONT_USE_UPLOADTOBLOB
+    /*Tests_SRS_IOTHUBCLIENT_02_103: [ "uploadQueueFullPolicy" - IOTHUB_CLIENT_QUEUE_FULL_REJECT or IOTHUB_CLIENT_QUEUE_FULL_BLOCK, any other value shall make IoTHubClient_SetOption return IOTHUB_CLIENT_INVALID_ARG. Value is a pointer to an IOTHUB_CLIENT_QUEUE_FULL_POLICY. ]*/
+    TEST_FUNCTION(IoTHubClient_SetOption_uploadQueueFullPolicy_BLOCK_succeeds)
+    {
+        /// arrange
+        CIoTHubClientMocks mocks;
+
+        IOTHUB_CLIENT_HANDLE handle = IoTHubClient_Create(&TEST_CONFIG);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE))
+            .ExpectedTimesExactly(2);
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE))
+            .ExpectedTimesExactly(2);
+
+        ///act
+        IOTHUB_CLIENT_QUEUE_FULL_POLICY policy = IOTHUB_CLIENT_QUEUE_FULL_BLOCK;
+        auto result = IoTHubClient_SetOption(handle, "uploadQueueFullPolicy", &policy);
+
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(handle);
+    }
+#endif
+
+#ifndef DONT_USE_UPLOADTOBLOB
+    /*Tests_SRS_IOTHUBCLIENT_02_103: [ "uploadQueueFullPolicy" - IOTHUB_CLIENT_QUEUE_FULL_REJECT or IOTHUB_CLIENT_QUEUE_FULL_BLOCK, any other value shall make IoTHubClient_SetOption return IOTHUB_CLIENT_INVALID_ARG. Value is a pointer to an IOTHUB_CLIENT_QUEUE_FULL_POLICY. ]*/
+    TEST_FUNCTION(IoTHubClient_SetOption_uploadQueueFullPolicy_DROP_OLDEST_fails)
+    {
+        /// arrange
+        CIoTHubClientMocks mocks;
+
+        IOTHUB_CLIENT_HANDLE handle = IoTHubClient_Create(&TEST_CONFIG);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE))
+            .ExpectedTimesExactly(2);
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE))
+            .ExpectedTimesExactly(2);
+
+        ///act
+        IOTHUB_CLIENT_QUEUE_FULL_POLICY policy = IOTHUB_CLIENT_QUEUE_FULL_DROP_OLDEST;
+        auto result = IoTHubClient_SetOption(handle, "uploadQueueFullPolicy", &policy);
 
         ///assert
         ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
@@ -1964,141 +2611,683 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
         ///cleanup
         IoTHubClient_Destroy(handle);
     }
+#endif
 
-    /*Tests_SRS_IOTHUBCLIENT_02_036: [If parameter value is NULL then IoTHubClient_SetOption shall return IOTHUB_CLIENT_INVALID_ARG.] */
-    TEST_FUNCTION(IoTHubClient_SetOption_with_NULL_value_fails)
+#ifndef DONT_USE_UPLOADTOBLOB
+    /*Tests_SRS_IOTHUBCLIENT_02_104: [ "uploadQueueBlockTimeout" - how many milliseconds IoTHubClient_UploadToBlobAsync waits for room under IOTHUB_CLIENT_QUEUE_FULL_BLOCK. 0 means no limit. Value is a pointer to an unsigned int. ]*/
+    TEST_FUNCTION(IoTHubClient_SetOption_uploadQueueBlockTimeout_is_handled_by_IoTHubClient)
+    {
+        /// arrange
+        CIoTHubClientMocks mocks;
+
+        IOTHUB_CLIENT_HANDLE handle = IoTHubClient_Create(&TEST_CONFIG);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE))
+            .ExpectedTimesExactly(2);
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE))
+            .ExpectedTimesExactly(2);
+
+        ///act
+        unsigned int blockTimeout = 100;
+        auto result = IoTHubClient_SetOption(handle, "uploadQueueBlockTimeout", &blockTimeout);
+
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(handle);
+    }
+#endif
+
+#ifndef DONT_USE_UPLOADTOBLOB
+    /*Tests_SRS_IOTHUBCLIENT_02_105: [ The "uploadQueue..." options shall be changed under the lock of the LIST_HANDLE of uploads. If acquiring it fails then IoTHubClient_SetOption shall return IOTHUB_CLIENT_ERROR. ]*/
+    TEST_FUNCTION(when_the_upload_Lock_fails_IoTHubClient_SetOption_uploadQueueMaxCount_fails)
+    {
+        /// arrange
+        CIoTHubClientMocks mocks;
+
+        IOTHUB_CLIENT_HANDLE handle = IoTHubClient_Create(&TEST_CONFIG);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE)); /*this is the serializing lock*/
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE)) /*this is the lock of the list of queued uploads*/
+            .SetReturn(LOCK_ERROR);
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        ///act
+        size_t maxCount = 4;
+        auto result = IoTHubClient_SetOption(handle, "uploadQueueMaxCount", &maxCount);
+
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(handle);
+    }
+#endif
+
+    /*Tests_SRS_IOTHUBCLIENT_02_034: [If parameter iotHubClientHandle is NULL then IoTHubClient_SetOption shall return IOTHUB_CLIENT_INVALID_ARG.] */
+    TEST_FUNCTION(IoTHubClient_SetOption_with_NULL_handle_fails)
     {
         /// arrange
         CIoTHubClientMocks mocks;
 
-        IOTHUB_CLIENT_HANDLE handle = IoTHubClient_Create(&TEST_CONFIG);
-        mocks.ResetAllCalls();
+        ///act
+        auto result = IoTHubClient_SetOption(NULL, "a", "b");
+
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+
+        ///cleanup
+        
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_02_035: [If parameter optionName is NULL then IoTHubClient_SetOption shall return IOTHUB_CLIENT_INVALID_ARG.] */
+    TEST_FUNCTION(IoTHubClient_SetOption_with_NULL_optionName_fails)
+    {
+        /// arrange
+        CIoTHubClientMocks mocks;
+
+        IOTHUB_CLIENT_HANDLE handle = IoTHubClient_Create(&TEST_CONFIG);
+        mocks.ResetAllCalls();
+
+        ///act
+        auto result = IoTHubClient_SetOption(handle, NULL, "b");
+
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(handle);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_02_036: [If parameter value is NULL then IoTHubClient_SetOption shall return IOTHUB_CLIENT_INVALID_ARG.] */
+    TEST_FUNCTION(IoTHubClient_SetOption_with_NULL_value_fails)
+    {
+        /// arrange
+        CIoTHubClientMocks mocks;
+
+        IOTHUB_CLIENT_HANDLE handle = IoTHubClient_Create(&TEST_CONFIG);
+        mocks.ResetAllCalls();
+
+        ///act
+        auto result = IoTHubClient_SetOption(handle, "a", NULL);
+
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(handle);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_02_038: [If optionName doesn't match one of the options handled by this module then IoTHubClient_SetOption shall call IoTHubClient_LL_SetOption passing the same parameters and return what IoTHubClient_LL_SetOption returns.]*/
+    /* Tests_SRS_IOTHUBCLIENT_01_041: [ IoTHubClient_SetOption shall be made thread-safe by using the lock created in IoTHubClient_Create. ]*/
+    TEST_FUNCTION(IoTHubClient_SetOption_happy_path)
+    {
+        /// arrange
+        CIoTHubClientMocks mocks;
+
+        IOTHUB_CLIENT_HANDLE handle = IoTHubClient_Create(&TEST_CONFIG);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        EXPECTED_CALL(mocks, IoTHubClient_LL_SetOption(IGNORED_PTR_ARG, "a", "b"));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        ///act
+        auto result = IoTHubClient_SetOption(handle, "a", "b");
+
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(handle);
+    }
+
+    /*Tests_SRS_IOTHUBCLIENT_02_038: [If optionName doesn't match one of the options handled by this module then IoTHubClient_SetOption shall call IoTHubClient_LL_SetOption passing the same parameters and return what IoTHubClient_LL_SetOption returns.]*/
+    TEST_FUNCTION(IoTHubClient_SetOption_fails_when_LL_fails)
+    {
+        /// arrange
+        CIoTHubClientMocks mocks;
+
+        IOTHUB_CLIENT_HANDLE handle = IoTHubClient_Create(&TEST_CONFIG);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        EXPECTED_CALL(mocks, IoTHubClient_LL_SetOption(IGNORED_PTR_ARG, "a", "b"))
+            .SetReturn(IOTHUB_CLIENT_ERROR);
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        ///act
+        auto result = IoTHubClient_SetOption(handle, "a", "b");
+
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(handle);
+    }
+
+    /* Tests_SRS_IOTHUBCLIENT_01_042: [ If acquiring the lock fails, IoTHubClient_GetLastMessageReceiveTime shall return IOTHUB_CLIENT_ERROR. ]*/
+    TEST_FUNCTION(when_Lock_fails_IoTHubClient_SetOption_fails)
+    {
+        /// arrange
+        CIoTHubClientMocks mocks;
+
+        IOTHUB_CLIENT_HANDLE handle = IoTHubClient_Create(&TEST_CONFIG);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE))
+            .SetReturn(LOCK_ERROR);
+
+        ///act
+        auto result = IoTHubClient_SetOption(handle, "a", "b");
+
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(handle);
+    }
+
+#ifndef DONT_USE_UPLOADTOBLOB
+    /*Tests_SRS_IOTHUBCLIENT_02_047: [ If iotHubClientHandle is NULL then IoTHubClient_UploadToBlobAsync shall fail and return IOTHUB_CLIENT_INVALID_ARG. ]*/
+    TEST_FUNCTION(IoTHubClient_UploadToBlobAsync_with_NULL_iotHubClientHandle_fails)
+    {
+        ///arrange
+        IOTHUB_CLIENT_RESULT result;
+
+        ///act
+        result = IoTHubClient_UploadToBlobAsync(NULL, "a", (const unsigned char*)"b", 1, NULL, NULL);
+
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    }
+#endif
+
+#ifdef USE_UPOLOADTOBLOB
+    /*Tests_SRS_IOTHUBCLIENT_02_048: [ If destinationFileName is NULL then IoTHubClient_UploadToBlobAsync shall fail and return IOTHUB_CLIENT_INVALID_ARG. ]*/
+    TEST_FUNCTION(IoTHubClient_UploadToBlobAsync_with_NULL_destinationFileName_fails)
+    {
+        ///arrange
+        CIoTHubClientMocks mocks;
+
+        IOTHUB_CLIENT_HANDLE h = IoTHubClient_Create(&TEST_CONFIG);
+        IOTHUB_CLIENT_RESULT result;
+        mocks.ResetAllCalls();
+
+        ///act
+        result = IoTHubClient_UploadToBlobAsync(h, NULL, (const unsigned char*)"b", 1, NULL, NULL);
+
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(h);
+    }
+#endif
+
+#ifdef USE_UPOLOADTOBLOB
+    /*Tests_SRS_IOTHUBCLIENT_02_049: [ If source is NULL and size is greated than 0 then IoTHubClient_UploadToBlobAsync shall fail and return IOTHUB_CLIENT_INVALID_ARG. ]*/
+    TEST_FUNCTION(IoTHubClient_UploadToBlobAsync_with_NULL_source_and_size_1_fails)
+    {
+        ///arrange
+        CIoTHubClientMocks mocks;
+
+        IOTHUB_CLIENT_HANDLE h = IoTHubClient_Create(&TEST_CONFIG);
+        IOTHUB_CLIENT_RESULT result;
+        mocks.ResetAllCalls();
+
+        ///act
+        result = IoTHubClient_UploadToBlobAsync(h, "someFileName.txt", NULL, 1, NULL, NULL);
+
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(h);
+    }
+#endif
+
+#ifdef USE_UPOLOADTOBLOB
+    /*Tests_SRS_IOTHUBCLIENT_02_051: [IoTHubClient_UploadToBlobAsync shall copy the souce, size, iotHubClientFileUploadCallback, context into a structure.]*/
+    /*Tests_SRS_IOTHUBCLIENT_02_095: [ IoTHubClient_UploadToBlobAsync shall queue the structure under the lock of the LIST_HANDLE of uploads, it shall not take the serializing lock. If acquiring the lock fails then IoTHubClient_UploadToBlobAsync shall fail and return IOTHUB_CLIENT_ERROR. ]*/
+    /*Tests_SRS_IOTHUBCLIENT_02_058: [ IoTHubClient_UploadToBlobAsync shall add the structure to the LIST_HANDLE of uploads. ]*/
+    /*Tests_SRS_IOTHUBCLIENT_02_052: [ If the uploading thread is not running then IoTHubClient_UploadToBlobAsync shall start it, after joining the uploading thread that exited (if any). ]*/
+    /*Tests_SRS_IOTHUBCLIENT_02_071: [ The thread shall take the uploads off the LIST_HANDLE one at a time, in the order they were queued, and shall exit when the LIST_HANDLE is empty. ]*/
+    /*Tests_SRS_IOTHUBCLIENT_02_054: [ The thread shall call IoTHubClient_LL_UploadToBlob passing the information packed in the structure. ]*/
+    /*Tests_SRS_IOTHUBCLIENT_02_056: [ Otherwise the thread iotHubClientFileUploadCallbackInternal passing as result FILE_UPLOAD_OK and the structure from SRS IOTHUBCLIENT 02 051. ]*/
+    /*Tests_SRS_IOTHUBCLIENT_02_100: [ Before calling the callback, the thread shall make the upload no longer count against "uploadQueueMaxCount" and "uploadQueueMaxBytes". ]*/
+    /*Tests_SRS_IOTHUBCLIENT_02_111: [ Once the callback has returned the thread shall free the structure. ]*/
+    TEST_FUNCTION(IoTHubClient_UploadToBlobAsync_succeeds)
+    {
+        ///arrange
+        CIoTHubClientMocks mocks;
+
+        IOTHUB_CLIENT_HANDLE h = IoTHubClient_Create(&TEST_CONFIG);
+        IOTHUB_CLIENT_RESULT result;
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is creating a UPLOADTOBLOB_SAVED_DATA*/
+            .IgnoreArgument(1);
+
+        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, "someFileName.txt")) /*this is making a copy of the filename*/
+            .IgnoreArgument(1);
+
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(1)); /*this is making a copy of the content*/
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE)); /*this is locking the list of queued uploads, the serializing lock is not taken*/
+        STRICT_EXPECTED_CALL(mocks, list_add(TEST_LIST_HANDLE, IGNORED_PTR_ARG)) /*this is queueing the UPLOADTOBLOB_SAVED_DATA*/
+            .IgnoreArgument(2);
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is starting the uploading thread*/
+            .IgnoreAllArguments();
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE)); /*what has been locked shall be unlocked*/
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE)); /*this is the thread taking the upload off the list*/
+        STRICT_EXPECTED_CALL(mocks, list_get_head_item(TEST_LIST_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, list_item_get_value(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, list_remove(TEST_LIST_HANDLE, IGNORED_PTR_ARG))
+            .IgnoreArgument(2);
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_UploadToBlob(TEST_IOTHUB_CLIENT_LL_HANDLE, "someFileName.txt", IGNORED_PTR_ARG, 1)) /*this is the thread calling into _LL layer*/
+            .IgnoreArgument(3);
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE)); /*this is the thread releasing the upload before its callback*/
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, uploadToBlobAsyncCallback(FILE_UPLOAD_OK, (void*)1)); /*the thread completes successfully*/
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE)); /*this is the thread noting the callback has returned*/
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)) /*this is freeing the copy of the content*/
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)) /*this is freeing the copy of the filename*/
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)) /*this is freeing the UPLOADTOBLOB_SAVED_DATA*/
+            .IgnoreArgument(1);
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE)); /*this is the thread finding the list empty*/
+        STRICT_EXPECTED_CALL(mocks, list_get_head_item(TEST_LIST_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        ///act
+        result = IoTHubClient_UploadToBlobAsync(h, "someFileName.txt", (const unsigned char*)"a", 1, uploadToBlobAsyncCallback, (void*)1);
+
+        threadFunc(threadFuncArg); /*this is the thread uploading function*/
+
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(h);
+    }
+#endif
+
+#ifdef USE_UPOLOADTOBLOB
+    /*Tests_SRS_IOTHUBCLIENT_02_051: [IoTHubClient_UploadToBlobAsync shall copy the souce, size, iotHubClientFileUploadCallback, context into a structure.]*/
+    /*Tests_SRS_IOTHUBCLIENT_02_054: [ The thread shall call IoTHubClient_LL_UploadToBlob passing the information packed in the structure. ]*/
+    /*Tests_SRS_IOTHUBCLIENT_02_056: [ Otherwise the thread iotHubClientFileUploadCallbackInternal passing as result FILE_UPLOAD_OK and the structure from SRS IOTHUBCLIENT 02 051. ]*/
+    TEST_FUNCTION(IoTHubClient_UploadToBlobAsync_with_0_size_succeeds)
+    {
+        ///arrange
+        CIoTHubClientMocks mocks;
+
+        IOTHUB_CLIENT_HANDLE h = IoTHubClient_Create(&TEST_CONFIG);
+        IOTHUB_CLIENT_RESULT result;
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is creating a UPLOADTOBLOB_SAVED_DATA*/
+            .IgnoreArgument(1);
+
+        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, "someFileName.txt")) /*this is making a copy of the filename*/
+            .IgnoreArgument(1);
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE)); /*this is locking the list of queued uploads*/
+        STRICT_EXPECTED_CALL(mocks, list_add(TEST_LIST_HANDLE, IGNORED_PTR_ARG)) /*this is queueing the UPLOADTOBLOB_SAVED_DATA*/
+            .IgnoreArgument(2);
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is starting the uploading thread*/
+            .IgnoreAllArguments();
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE)); /*what has been locked shall be unlocked*/
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE)); /*this is the thread taking the upload off the list*/
+        STRICT_EXPECTED_CALL(mocks, list_get_head_item(TEST_LIST_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, list_item_get_value(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, list_remove(TEST_LIST_HANDLE, IGNORED_PTR_ARG))
+            .IgnoreArgument(2);
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_UploadToBlob(TEST_IOTHUB_CLIENT_LL_HANDLE, "someFileName.txt", IGNORED_PTR_ARG, 0)) /*this is the thread calling into _LL layer*/
+            .IgnoreArgument(3);
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE)); /*this is the thread releasing the upload before its callback*/
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, uploadToBlobAsyncCallback(FILE_UPLOAD_OK, (void*)1)); /*the thread completes successfully*/
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE)); /*this is the thread noting the callback has returned*/
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        STRICT_EXPECTED_CALL(mocks, gballoc_free((void*)NULL)); /*there was no content to copy*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)) /*this is freeing the copy of the filename*/
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)) /*this is freeing the UPLOADTOBLOB_SAVED_DATA*/
+            .IgnoreArgument(1);
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE)); /*this is the thread finding the list empty*/
+        STRICT_EXPECTED_CALL(mocks, list_get_head_item(TEST_LIST_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        ///act
+        result = IoTHubClient_UploadToBlobAsync(h, "someFileName.txt", NULL, 0, uploadToBlobAsyncCallback, (void*)1);
+
+        threadFunc(threadFuncArg); /*this is the thread uploading function*/
+
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(h);
+    }
+#endif
+
+#ifdef USE_UPOLOADTOBLOB
+    /*Tests_SRS_IOTHUBCLIENT_02_054: [ The thread shall call IoTHubClient_LL_UploadToBlob passing the information packed in the structure. ]*/
+    /*Tests_SRS_IOTHUBCLIENT_02_055: [ If IoTHubClient_LL_UploadToBlob fails then the thread shall call iotHubClientFileUploadCallbackInternal passing as result FILE_UPLOAD_ERROR and as context the structure from SRS IOTHUBCLIENT 02 051. ]*/
+    /*Tests_SRS_IOTHUBCLIENT_02_100: [ Before calling the callback, the thread shall make the upload no longer count against "uploadQueueMaxCount" and "uploadQueueMaxBytes". ]*/
+    /*Tests_SRS_IOTHUBCLIENT_02_111: [ Once the callback has returned the thread shall free the structure. ]*/
+    TEST_FUNCTION(IoTHubClient_UploadToBlobAsync_indicates_error)
+    {
+        ///arrange
+        CIoTHubClientMocks mocks;
+
+        IOTHUB_CLIENT_HANDLE h = IoTHubClient_Create(&TEST_CONFIG);
+        IOTHUB_CLIENT_RESULT result;
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is creating a UPLOADTOBLOB_SAVED_DATA*/
+            .IgnoreArgument(1);
+
+        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, "someFileName.txt")) /*this is making a copy of the filename*/
+            .IgnoreArgument(1);
+
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(1)); /*this is making a copy of the content*/
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE)); /*this is locking the list of queued uploads*/
+        STRICT_EXPECTED_CALL(mocks, list_add(TEST_LIST_HANDLE, IGNORED_PTR_ARG)) /*this is queueing the UPLOADTOBLOB_SAVED_DATA*/
+            .IgnoreArgument(2);
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is starting the uploading thread*/
+            .IgnoreAllArguments();
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE)); /*what has been locked shall be unlocked*/
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE)); /*this is the thread taking the upload off the list*/
+        STRICT_EXPECTED_CALL(mocks, list_get_head_item(TEST_LIST_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, list_item_get_value(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, list_remove(TEST_LIST_HANDLE, IGNORED_PTR_ARG))
+            .IgnoreArgument(2);
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_UploadToBlob(TEST_IOTHUB_CLIENT_LL_HANDLE, "someFileName.txt", IGNORED_PTR_ARG, 1)) /*this is the thread calling into _LL layer*/
+            .IgnoreArgument(3)
+            .SetReturn(IOTHUB_CLIENT_ERROR);
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE)); /*this is the thread releasing the upload before its callback*/
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, uploadToBlobAsyncCallback(FILE_UPLOAD_ERROR, (void*)1)); /*the thread completes the upload, but fails*/
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE)); /*this is the thread noting the callback has returned*/
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)) /*this is freeing the copy of the content*/
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)) /*this is freeing the copy of the filename*/
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)) /*this is freeing the UPLOADTOBLOB_SAVED_DATA*/
+            .IgnoreArgument(1);
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE)); /*this is the thread finding the list empty*/
+        STRICT_EXPECTED_CALL(mocks, list_get_head_item(TEST_LIST_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
 
         ///act
-        auto result = IoTHubClient_SetOption(handle, "a", NULL);
+        result = IoTHubClient_UploadToBlobAsync(h, "someFileName.txt", (const unsigned char*)"a", 1, uploadToBlobAsyncCallback, (void*)1);
+
+        threadFunc(threadFuncArg); /*this is the thread uploading function*/
 
         ///assert
-        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
         mocks.AssertActualAndExpectedCalls();
 
         ///cleanup
-        IoTHubClient_Destroy(handle);
+        IoTHubClient_Destroy(h);
     }
+#endif
 
-    /*Tests_SRS_IOTHUBCLIENT_02_038: [If optionName doesn't match one of the options handled by this module then IoTHubClient_SetOption shall call IoTHubClient_LL_SetOption passing the same parameters and return what IoTHubClient_LL_SetOption returns.]*/
-    /* Tests_SRS_IOTHUBCLIENT_01_041: [ IoTHubClient_SetOption shall be made thread-safe by using the lock created in IoTHubClient_Create. ]*/
-    TEST_FUNCTION(IoTHubClient_SetOption_happy_path)
+#ifdef USE_UPOLOADTOBLOB
+    /*Tests_SRS_IOTHUBCLIENT_02_052: [ If the uploading thread is not running then IoTHubClient_UploadToBlobAsync shall start it, after joining the uploading thread that exited (if any). ]*/
+    /*Tests_SRS_IOTHUBCLIENT_02_071: [ The thread shall take the uploads off the LIST_HANDLE one at a time, in the order they were queued, and shall exit when the LIST_HANDLE is empty. ]*/
+    TEST_FUNCTION(IoTHubClient_UploadToBlobAsync_while_the_uploading_thread_runs_does_not_start_another_one)
     {
-        /// arrange
+        ///arrange
         CIoTHubClientMocks mocks;
 
-        IOTHUB_CLIENT_HANDLE handle = IoTHubClient_Create(&TEST_CONFIG);
+        IOTHUB_CLIENT_HANDLE h = IoTHubClient_Create(&TEST_CONFIG);
+        IOTHUB_CLIENT_RESULT result;
+        (void)IoTHubClient_UploadToBlobAsync(h, "first.txt", (const unsigned char*)"a", 1, uploadToBlobAsyncCallback, (void*)1);
         mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
-        EXPECTED_CALL(mocks, IoTHubClient_LL_SetOption(IGNORED_PTR_ARG, "a", "b"));
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is creating a UPLOADTOBLOB_SAVED_DATA*/
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, "second.txt")) /*this is making a copy of the filename*/
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(2)); /*this is making a copy of the content*/
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE)); /*this is locking the list of queued uploads*/
+        STRICT_EXPECTED_CALL(mocks, list_add(TEST_LIST_HANDLE, IGNORED_PTR_ARG)) /*the upload waits behind the first one, no new thread is started*/
+            .IgnoreArgument(2);
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE)); /*this is the thread taking the first upload off the list*/
+        STRICT_EXPECTED_CALL(mocks, list_get_head_item(TEST_LIST_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, list_item_get_value(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, list_remove(TEST_LIST_HANDLE, IGNORED_PTR_ARG))
+            .IgnoreArgument(2);
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_UploadToBlob(TEST_IOTHUB_CLIENT_LL_HANDLE, "first.txt", IGNORED_PTR_ARG, 1))
+            .IgnoreArgument(3);
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE)); /*this is the thread releasing the upload before its callback*/
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, uploadToBlobAsyncCallback(FILE_UPLOAD_OK, (void*)1));
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE)); /*this is the thread noting the callback has returned*/
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)) /*the first upload is freed once its callback has returned*/
+            .IgnoreArgument(1)
+            .ExpectedTimesExactly(3);
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE)); /*this is the thread taking the second upload off the list*/
+        STRICT_EXPECTED_CALL(mocks, list_get_head_item(TEST_LIST_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, list_item_get_value(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, list_remove(TEST_LIST_HANDLE, IGNORED_PTR_ARG))
+            .IgnoreArgument(2);
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_UploadToBlob(TEST_IOTHUB_CLIENT_LL_HANDLE, "second.txt", IGNORED_PTR_ARG, 2))
+            .IgnoreArgument(3);
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE)); /*this is the thread releasing the upload before its callback*/
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, uploadToBlobAsyncCallback(FILE_UPLOAD_OK, (void*)2));
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE)); /*this is the thread noting the callback has returned*/
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)) /*the second upload is freed once its callback has returned*/
+            .IgnoreArgument(1)
+            .ExpectedTimesExactly(3);
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE)); /*this is the thread finding the list empty*/
+        STRICT_EXPECTED_CALL(mocks, list_get_head_item(TEST_LIST_HANDLE));
         STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
 
         ///act
-        auto result = IoTHubClient_SetOption(handle, "a", "b");
+        result = IoTHubClient_UploadToBlobAsync(h, "second.txt", (const unsigned char*)"bc", 2, uploadToBlobAsyncCallback, (void*)2);
+
+        threadFunc(threadFuncArg); /*this is the only uploading thread*/
 
         ///assert
         ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
         mocks.AssertActualAndExpectedCalls();
 
         ///cleanup
-        IoTHubClient_Destroy(handle);
+        IoTHubClient_Destroy(h);
     }
+#endif
 
-    /*Tests_SRS_IOTHUBCLIENT_02_038: [If optionName doesn't match one of the options handled by this module then IoTHubClient_SetOption shall call IoTHubClient_LL_SetOption passing the same parameters and return what IoTHubClient_LL_SetOption returns.]*/
-    TEST_FUNCTION(IoTHubClient_SetOption_fails_when_LL_fails)
+#ifdef USE_UPOLOADTOBLOB
+    /*Tests_SRS_IOTHUBCLIENT_02_100: [ Before calling the callback, the thread shall make the upload no longer count against "uploadQueueMaxCount" and "uploadQueueMaxBytes". ]*/
+    TEST_FUNCTION(IoTHubClient_UploadToBlobAsync_the_finished_upload_does_not_count_during_its_callback)
     {
-        /// arrange
+        ///arrange
         CIoTHubClientMocks mocks;
 
-        IOTHUB_CLIENT_HANDLE handle = IoTHubClient_Create(&TEST_CONFIG);
+        IOTHUB_CLIENT_HANDLE h = IoTHubClient_Create(&TEST_CONFIG);
+        size_t maxCount = 1;
+        IOTHUB_CLIENT_QUEUE_FULL_POLICY policy = IOTHUB_CLIENT_QUEUE_FULL_BLOCK;
+        (void)IoTHubClient_SetOption(h, "uploadQueueMaxCount", &maxCount);
+        (void)IoTHubClient_SetOption(h, "uploadQueueFullPolicy", &policy);
+        (void)IoTHubClient_UploadToBlobAsync(h, "first.txt", (const unsigned char*)"ab", 2, chainingUploadCallback, NULL);
+        current_iothub_client = h;
+        chainedUploadResult = IOTHUB_CLIENT_ERROR;
         mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
-        EXPECTED_CALL(mocks, IoTHubClient_LL_SetOption(IGNORED_PTR_ARG, "a", "b"))
-            .SetReturn(IOTHUB_CLIENT_ERROR);
-        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
-
         ///act
-        auto result = IoTHubClient_SetOption(handle, "a", "b");
+        threadFunc(threadFuncArg); /*the callback of the first upload queues the chained one, which the same thread then uploads*/
 
         ///assert
-        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
-        mocks.AssertActualAndExpectedCalls();
+        ASSERT_ARE_EQUAL(size_t, 0, statsInUploadCallback.uploadCount);
+        ASSERT_ARE_EQUAL(size_t, 0, statsInUploadCallback.byteCount);
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, chainedUploadResult);
 
         ///cleanup
-        IoTHubClient_Destroy(handle);
+        IoTHubClient_Destroy(h);
     }
+#endif
 
-    /* Tests_SRS_IOTHUBCLIENT_01_042: [ If acquiring the lock fails, IoTHubClient_GetLastMessageReceiveTime shall return IOTHUB_CLIENT_ERROR. ]*/
-    TEST_FUNCTION(when_Lock_fails_IoTHubClient_SetOption_fails)
+#ifdef USE_UPOLOADTOBLOB
+    /*Tests_SRS_IOTHUBCLIENT_02_112: [ When called from within an upload callback IoTHubClient_UploadToBlobAsync shall not wait for room, whatever the "uploadQueueFullPolicy", and shall return IOTHUB_CLIENT_BUSY. ]*/
+    TEST_FUNCTION(IoTHubClient_UploadToBlobAsync_from_an_upload_callback_returns_BUSY_instead_of_blocking)
     {
-        /// arrange
+        ///arrange
         CIoTHubClientMocks mocks;
 
-        IOTHUB_CLIENT_HANDLE handle = IoTHubClient_Create(&TEST_CONFIG);
+        IOTHUB_CLIENT_HANDLE h = IoTHubClient_Create(&TEST_CONFIG);
+        size_t maxCount = 1;
+        IOTHUB_CLIENT_QUEUE_FULL_POLICY policy = IOTHUB_CLIENT_QUEUE_FULL_BLOCK;
+        (void)IoTHubClient_UploadToBlobAsync(h, "first.txt", (const unsigned char*)"a", 1, chainingUploadCallback, NULL);
+        (void)IoTHubClient_UploadToBlobAsync(h, "second.txt", (const unsigned char*)"b", 1, NULL, NULL);
+        (void)IoTHubClient_SetOption(h, "uploadQueueMaxCount", &maxCount); /*the second upload fills the queue once the first one is released*/
+        (void)IoTHubClient_SetOption(h, "uploadQueueFullPolicy", &policy); /*"uploadQueueBlockTimeout" is 0, a blocked caller would wait forever*/
+        current_iothub_client = h;
+        chainedUploadResult = IOTHUB_CLIENT_ERROR;
         mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE))
-            .SetReturn(LOCK_ERROR);
-
         ///act
-        auto result = IoTHubClient_SetOption(handle, "a", "b");
+        threadFunc(threadFuncArg);
 
         ///assert
-        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
-        mocks.AssertActualAndExpectedCalls();
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_BUSY, chainedUploadResult);
 
         ///cleanup
-        IoTHubClient_Destroy(handle);
+        IoTHubClient_Destroy(h);
     }
 
-#ifndef DONT_USE_UPLOADTOBLOB
-    /*Tests_SRS_IOTHUBCLIENT_02_047: [ If iotHubClientHandle is NULL then IoTHubClient_UploadToBlobAsync shall fail and return IOTHUB_CLIENT_INVALID_ARG. ]*/
-    TEST_FUNCTION(IoTHubClient_UploadToBlobAsync_with_NULL_iotHubClientHandle_fails)
+    /*Tests_SRS_IOTHUBCLIENT_02_098: [ If the upload is not accepted because of SRS IOTHUBCLIENT 02 097 and "uploadQueueFullPolicy" is IOTHUB_CLIENT_QUEUE_FULL_BLOCK then IoTHubClient_UploadToBlobAsync shall release the lock, sleep and try again. ]*/
+    TEST_FUNCTION(IoTHubClient_UploadToBlobAsync_from_another_thread_waits_while_an_upload_callback_runs)
     {
         ///arrange
-        IOTHUB_CLIENT_RESULT result;
+        CNiceCallComparer<CIoTHubClientMocks> mocks;
+
+        IOTHUB_CLIENT_HANDLE h = IoTHubClient_Create(&TEST_CONFIG);
+        size_t maxCount = 1;
+        IOTHUB_CLIENT_QUEUE_FULL_POLICY policy = IOTHUB_CLIENT_QUEUE_FULL_BLOCK;
+        unsigned int blockTimeout = 20;
+        (void)IoTHubClient_UploadToBlobAsync(h, "first.txt", (const unsigned char*)"a", 1, waitingForOtherThreadUploadCallback, NULL);
+        (void)IoTHubClient_UploadToBlobAsync(h, "second.txt", (const unsigned char*)"b", 1, NULL, NULL);
+        (void)IoTHubClient_SetOption(h, "uploadQueueMaxCount", &maxCount); /*the second upload fills the queue once the first one is released*/
+        (void)IoTHubClient_SetOption(h, "uploadQueueFullPolicy", &policy);
+        (void)IoTHubClient_SetOption(h, "uploadQueueBlockTimeout", &blockTimeout);
+        current_iothub_client = h;
+        chainedUploadResult = IOTHUB_CLIENT_ERROR;
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(10)) /*the other thread is not the callback, it waits for room until "uploadQueueBlockTimeout"*/
+            .ExpectedTimesExactly(2);
 
         ///act
-        result = IoTHubClient_UploadToBlobAsync(NULL, "a", (const unsigned char*)"b", 1, NULL, NULL);
+        threadFunc(threadFuncArg);
 
         ///assert
-        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_BUSY, chainedUploadResult);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubClient_Destroy(h);
     }
 #endif
 
 #ifdef USE_UPOLOADTOBLOB
-    /*Tests_SRS_IOTHUBCLIENT_02_048: [ If destinationFileName is NULL then IoTHubClient_UploadToBlobAsync shall fail and return IOTHUB_CLIENT_INVALID_ARG. ]*/
-    TEST_FUNCTION(IoTHubClient_UploadToBlobAsync_with_NULL_destinationFileName_fails)
+    /*Tests_SRS_IOTHUBCLIENT_02_052: [ If the uploading thread is not running then IoTHubClient_UploadToBlobAsync shall start it, after joining the uploading thread that exited (if any). ]*/
+    TEST_FUNCTION(IoTHubClient_UploadToBlobAsync_joins_the_exited_uploading_thread_before_starting_a_new_one)
     {
         ///arrange
         CIoTHubClientMocks mocks;
 
         IOTHUB_CLIENT_HANDLE h = IoTHubClient_Create(&TEST_CONFIG);
         IOTHUB_CLIENT_RESULT result;
+        (void)IoTHubClient_UploadToBlobAsync(h, "first.txt", (const unsigned char*)"a", 1, uploadToBlobAsyncCallback, (void*)1);
+        threadFunc(threadFuncArg); /*the first uploading thread empties the list and exits*/
         mocks.ResetAllCalls();
 
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is creating a UPLOADTOBLOB_SAVED_DATA*/
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, "second.txt")) /*this is making a copy of the filename*/
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(1)); /*this is making a copy of the content*/
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE)); /*this is locking the list of queued uploads*/
+        STRICT_EXPECTED_CALL(mocks, list_add(TEST_LIST_HANDLE, IGNORED_PTR_ARG))
+            .IgnoreArgument(2);
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Join(TEST_THREAD_HANDLE, IGNORED_PTR_ARG)) /*this is joining the thread that exited*/
+            .IgnoreArgument(2);
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is starting a new uploading thread*/
+            .IgnoreAllArguments();
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
         ///act
-        result = IoTHubClient_UploadToBlobAsync(h, NULL, (const unsigned char*)"b", 1, NULL, NULL);
+        result = IoTHubClient_UploadToBlobAsync(h, "second.txt", (const unsigned char*)"b", 1, uploadToBlobAsyncCallback, (void*)2);
 
         ///assert
-        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
         mocks.AssertActualAndExpectedCalls();
 
         ///cleanup
+        threadFunc(threadFuncArg);
         IoTHubClient_Destroy(h);
     }
 #endif
 
 #ifdef USE_UPOLOADTOBLOB
-    /*Tests_SRS_IOTHUBCLIENT_02_049: [ If source is NULL and size is greated than 0 then IoTHubClient_UploadToBlobAsync shall fail and return IOTHUB_CLIENT_INVALID_ARG. ]*/
-    TEST_FUNCTION(IoTHubClient_UploadToBlobAsync_with_NULL_source_and_size_1_fails)
+    /*Tests_SRS_IOTHUBCLIENT_02_053: [ If copying to the structure, queueing it or starting the uploading thread fails, then IoTHubClient_UploadToBlobAsync shall fail and return IOTHUB_CLIENT_ERROR. ]*/
+    TEST_FUNCTION(IoTHubClient_UploadToBlobAsync_fails_when_ThreadAPI_Create_fails)
     {
         ///arrange
         CIoTHubClientMocks mocks;
@@ -2107,11 +3296,38 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
         IOTHUB_CLIENT_RESULT result;
         mocks.ResetAllCalls();
 
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is creating a UPLOADTOBLOB_SAVED_DATA*/
+            .IgnoreArgument(1);
+
+        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, "someFileName.txt")) /*this is making a copy of the filename*/
+            .IgnoreArgument(1);
+
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(1)); /*this is making a copy of the content*/
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE)); /*this is locking the list of queued uploads*/
+        STRICT_EXPECTED_CALL(mocks, list_add(TEST_LIST_HANDLE, IGNORED_PTR_ARG))
+            .IgnoreArgument(2);
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is starting the uploading thread*/
+            .IgnoreAllArguments()
+            .SetFailReturn(THREADAPI_ERROR);
+        STRICT_EXPECTED_CALL(mocks, list_remove(TEST_LIST_HANDLE, IGNORED_PTR_ARG)) /*the upload is taken back off the list*/
+            .IgnoreArgument(2);
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
         ///act
-        result = IoTHubClient_UploadToBlobAsync(h, "someFileName.txt", NULL, 1, NULL, NULL);
+        result = IoTHubClient_UploadToBlobAsync(h, "someFileName.txt", (const unsigned char*)"a", 1, uploadToBlobAsyncCallback, (void*)1);
 
         ///assert
-        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
         mocks.AssertActualAndExpectedCalls();
 
         ///cleanup
@@ -2120,13 +3336,8 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
 #endif
 
 #ifdef USE_UPOLOADTOBLOB
-    /*Tests_SRS_IOTHUBCLIENT_02_051: [ IoTHubClient_UploadToBlobAsync shall copy the souce, size, iotHubClientFileUploadCallback, context and a non-initialized(1) THREAD_HANDLE parameters into a structure. ]*/
-    /*Tests_SRS_IOTHUBCLIENT_02_058: [ IoTHubClient_UploadToBlobAsync shall add the structure to the list of structures that need to be cleaned once file upload finishes. ]*/
-    /*Tests_SRS_IOTHUBCLIENT_02_052: [ IoTHubClient_UploadToBlobAsync shall spawn a thread passing the structure build in SRS IOTHUBCLIENT 02 051 as thread data.]*/
-    /*Tests_SRS_IOTHUBCLIENT_02_054: [ The thread shall call IoTHubClient_LL_UploadToBlob passing the information packed in the structure. ]*/
-    /*Tests_SRS_IOTHUBCLIENT_02_056: [ Otherwise the thread iotHubClientFileUploadCallbackInternal passing as result FILE_UPLOAD_OK and the structure from SRS IOTHUBCLIENT 02 051. ]*/
-    /*Tests_SRS_IOTHUBCLIENT_02_071: [ The thread shall mark itself as disposable. ]*/
-    TEST_FUNCTION(IoTHubClient_UploadToBlobAsync_succeeds)
+    /*Tests_SRS_IOTHUBCLIENT_02_053: [ If copying to the structure, queueing it or starting the uploading thread fails, then IoTHubClient_UploadToBlobAsync shall fail and return IOTHUB_CLIENT_ERROR. ]*/
+    TEST_FUNCTION(IoTHubClient_UploadToBlobAsync_fails_when_list_add_fails)
     {
         ///arrange
         CIoTHubClientMocks mocks;
@@ -2143,40 +3354,26 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
 
         STRICT_EXPECTED_CALL(mocks, gballoc_malloc(1)); /*this is making a copy of the content*/
 
-        STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG)) /*this is locking the IOTHUB_CLIENT_HANDLE because it's savedDataToBeCleaned member is about to be modified*/
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is starting the worker thread*/
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG)) /*what has been locked shall be unlocked*/
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, list_add(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is adding UPLOADTOBLOB_SAVED_DATA to the list of UPLOADTOBLOB_SAVED_DATAs to be cleaned*/
-            .IgnoreArgument(1)
-            .IgnoreArgument(2);
-
-        STRICT_EXPECTED_CALL(mocks, Lock_Init()); /*this is creating a lock for the canBeGarbageCollected */
-
-        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is spawning the thread*/
-            .IgnoreAllArguments();
-
-        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_UploadToBlob(IGNORED_PTR_ARG, "someFileName.txt", IGNORED_PTR_ARG, 1)) /*this is the thread calling into _LL layer*/
-            .IgnoreArgument(1)
-            .IgnoreArgument(3);
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE)); /*this is locking the list of queued uploads*/
+        STRICT_EXPECTED_CALL(mocks, list_add(TEST_LIST_HANDLE, IGNORED_PTR_ARG))
+            .IgnoreArgument(2)
+            .SetFailReturn((LIST_ITEM_HANDLE)NULL);
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
 
-        STRICT_EXPECTED_CALL(mocks, uploadToBlobAsyncCallback(FILE_UPLOAD_OK, (void*)1)); /*the thread completes successfully*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG)) /*this is the thread marking UPLOADTOBLOB_SAVED_DATA as disposeable*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG)) /*what has been locked, shall be unlocked*/
+
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
 
         ///act
         result = IoTHubClient_UploadToBlobAsync(h, "someFileName.txt", (const unsigned char*)"a", 1, uploadToBlobAsyncCallback, (void*)1);
 
-        threadFunc(threadFuncArg); /*this is the thread uploading function*/
-
         ///assert
-        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
         mocks.AssertActualAndExpectedCalls();
 
         ///cleanup
@@ -2185,13 +3382,8 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
 #endif
 
 #ifdef USE_UPOLOADTOBLOB
-    /*Tests_SRS_IOTHUBCLIENT_02_051: [ IoTHubClient_UploadToBlobAsync shall copy the souce, size, iotHubClientFileUploadCallback, context and a non-initialized(1) THREAD_HANDLE parameters into a structure. ]*/
-    /*Tests_SRS_IOTHUBCLIENT_02_058: [ IoTHubClient_UploadToBlobAsync shall add the structure to the list of structures that need to be cleaned once file upload finishes. ]*/
-    /*Tests_SRS_IOTHUBCLIENT_02_052: [ IoTHubClient_UploadToBlobAsync shall spawn a thread passing the structure build in SRS IOTHUBCLIENT 02 051 as thread data.]*/
-    /*Tests_SRS_IOTHUBCLIENT_02_054: [ The thread shall call IoTHubClient_LL_UploadToBlob passing the information packed in the structure. ]*/
-    /*Tests_SRS_IOTHUBCLIENT_02_056: [ Otherwise the thread iotHubClientFileUploadCallbackInternal passing as result FILE_UPLOAD_OK and the structure from SRS IOTHUBCLIENT 02 051. ]*/
-    /*Tests_SRS_IOTHUBCLIENT_02_071: [ The thread shall mark itself as disposable. ]*/
-    TEST_FUNCTION(IoTHubClient_UploadToBlobAsync_with_0_size_succeeds)
+    /*Tests_SRS_IOTHUBCLIENT_02_095: [ IoTHubClient_UploadToBlobAsync shall queue the structure under the lock of the LIST_HANDLE of uploads, it shall not take the serializing lock. If acquiring the lock fails then IoTHubClient_UploadToBlobAsync shall fail and return IOTHUB_CLIENT_ERROR. ]*/
+    TEST_FUNCTION(IoTHubClient_UploadToBlobAsync_fails_when_Lock_fails)
     {
         ///arrange
         CIoTHubClientMocks mocks;
@@ -2206,106 +3398,145 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
         STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, "someFileName.txt")) /*this is making a copy of the filename*/
             .IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG)) /*this is locking the IOTHUB_CLIENT_HANDLE because it's savedDataToBeCleaned member is about to be modified*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(1)); /*this is making a copy of the content*/
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE)) /*this is locking the list of queued uploads*/
+            .SetReturn(LOCK_ERROR);
+
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is starting the worker thread*/
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG)) /*what has been locked shall be unlocked*/
+
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, list_add(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is adding UPLOADTOBLOB_SAVED_DATA to the list of UPLOADTOBLOB_SAVED_DATAs to be cleaned*/
-            .IgnoreArgument(1)
-            .IgnoreArgument(2);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, Lock_Init()); /*this is creating a lock for the canBeGarbageCollected */
+        ///act
+        result = IoTHubClient_UploadToBlobAsync(h, "someFileName.txt", (const unsigned char*)"a", 1, uploadToBlobAsyncCallback, (void*)1);
 
-        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is spawning the thread*/
-            .IgnoreAllArguments();
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+        mocks.AssertActualAndExpectedCalls();
 
-        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_UploadToBlob(IGNORED_PTR_ARG, "someFileName.txt", IGNORED_PTR_ARG, 0)) /*this is the thread calling into _LL layer*/
-            .IgnoreArgument(1)
-            .IgnoreArgument(3);
+        ///cleanup
+        IoTHubClient_Destroy(h);
+    }
+#endif
 
-        STRICT_EXPECTED_CALL(mocks, uploadToBlobAsyncCallback(FILE_UPLOAD_OK, (void*)1)); /*the thread completes successfully*/
+#ifdef USE_UPOLOADTOBLOB
+    /*Tests_SRS_IOTHUBCLIENT_02_097: [ If accepting the upload would make more than "uploadQueueMaxCount" uploads or more than "uploadQueueMaxBytes" bytes of sources be queued or uploading then IoTHubClient_UploadToBlobAsync shall fail and return IOTHUB_CLIENT_BUSY. ]*/
+    TEST_FUNCTION(IoTHubClient_UploadToBlobAsync_when_uploadQueueMaxCount_is_reached_returns_BUSY)
+    {
+        ///arrange
+        CIoTHubClientMocks mocks;
+
+        IOTHUB_CLIENT_HANDLE h = IoTHubClient_Create(&TEST_CONFIG);
+        IOTHUB_CLIENT_RESULT result;
+        size_t maxCount = 1;
+        (void)IoTHubClient_SetOption(h, "uploadQueueMaxCount", &maxCount);
+        (void)IoTHubClient_UploadToBlobAsync(h, "first.txt", (const unsigned char*)"a", 1, uploadToBlobAsyncCallback, (void*)1);
+        mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG)) /*this is the thread marking UPLOADTOBLOB_SAVED_DATA as disposeable*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is creating a UPLOADTOBLOB_SAVED_DATA*/
             .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG)) /*what has been locked, shall be unlocked*/
+        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, "second.txt")) /*this is making a copy of the filename*/
             .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(1)); /*this is making a copy of the content*/
 
-        ///act
-        result = IoTHubClient_UploadToBlobAsync(h, "someFileName.txt", NULL, 0, uploadToBlobAsyncCallback, (void*)1);
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE)); /*the policy is IOTHUB_CLIENT_QUEUE_FULL_REJECT, so there is a single attempt*/
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
 
-        threadFunc(threadFuncArg); /*this is the thread uploading function*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1)
+            .ExpectedTimesExactly(3);
+
+        ///act
+        result = IoTHubClient_UploadToBlobAsync(h, "second.txt", (const unsigned char*)"b", 1, uploadToBlobAsyncCallback, (void*)2);
 
         ///assert
-        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_BUSY, result);
         mocks.AssertActualAndExpectedCalls();
 
         ///cleanup
+        threadFunc(threadFuncArg);
         IoTHubClient_Destroy(h);
     }
 #endif
 
 #ifdef USE_UPOLOADTOBLOB
-    /*Tests_SRS_IOTHUBCLIENT_02_051: [ IoTHubClient_UploadToBlobAsync shall copy the souce, size, iotHubClientFileUploadCallback, context and a non-initialized(1) THREAD_HANDLE parameters into a structure. ]*/
-    /*Tests_SRS_IOTHUBCLIENT_02_058: [ IoTHubClient_UploadToBlobAsync shall add the structure to the list of structures that need to be cleaned once file upload finishes. ]*/
-    /*Tests_SRS_IOTHUBCLIENT_02_052: [ IoTHubClient_UploadToBlobAsync shall spawn a thread passing the structure build in SRS IOTHUBCLIENT 02 051 as thread data.]*/
-    /*Tests_SRS_IOTHUBCLIENT_02_054: [ The thread shall call IoTHubClient_LL_UploadToBlob passing the information packed in the structure. ]*/
-    /*Tests_SRS_IOTHUBCLIENT_02_055: [ If IoTHubClient_LL_UploadToBlob fails then the thread shall call the callback passing as result FILE_UPLOAD_ERROR and as context the structure from SRS IOTHUBCLIENT 02 051. ]*/
-    /*Tests_SRS_IOTHUBCLIENT_02_071: [ The thread shall mark itself as disposable. ]*/
-    TEST_FUNCTION(IoTHubClient_UploadToBlobAsync_indicates_error)
+    /*Tests_SRS_IOTHUBCLIENT_02_097: [ If accepting the upload would make more than "uploadQueueMaxCount" uploads or more than "uploadQueueMaxBytes" bytes of sources be queued or uploading then IoTHubClient_UploadToBlobAsync shall fail and return IOTHUB_CLIENT_BUSY. ]*/
+    TEST_FUNCTION(IoTHubClient_UploadToBlobAsync_when_uploadQueueMaxBytes_would_be_exceeded_returns_BUSY)
     {
         ///arrange
         CIoTHubClientMocks mocks;
 
         IOTHUB_CLIENT_HANDLE h = IoTHubClient_Create(&TEST_CONFIG);
         IOTHUB_CLIENT_RESULT result;
+        size_t maxBytes = 3;
+        (void)IoTHubClient_SetOption(h, "uploadQueueMaxBytes", &maxBytes);
+        (void)IoTHubClient_UploadToBlobAsync(h, "first.txt", (const unsigned char*)"ab", 2, uploadToBlobAsyncCallback, (void*)1);
         mocks.ResetAllCalls();
 
         STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is creating a UPLOADTOBLOB_SAVED_DATA*/
             .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, "someFileName.txt")) /*this is making a copy of the filename*/
+        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, "second.txt")) /*this is making a copy of the filename*/
             .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(2)); /*this is making a copy of the content*/
 
-        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(1)); /*this is making a copy of the content*/
-
-        STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG)) /*this is locking the IOTHUB_CLIENT_HANDLE because it's savedDataToBeCleaned member is about to be modified*/
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is starting the worker thread*/
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG)) /*what has been locked shall be unlocked*/
-            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE)); /*2 bytes are queued already, 2 more would make 4*/
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
 
-        STRICT_EXPECTED_CALL(mocks, list_add(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is adding UPLOADTOBLOB_SAVED_DATA to the list of UPLOADTOBLOB_SAVED_DATAs to be cleaned*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
             .IgnoreArgument(1)
-            .IgnoreArgument(2);
+            .ExpectedTimesExactly(3);
 
-        STRICT_EXPECTED_CALL(mocks, Lock_Init()); /*this is creating a lock for the canBeGarbageCollected */
+        ///act
+        result = IoTHubClient_UploadToBlobAsync(h, "second.txt", (const unsigned char*)"cd", 2, uploadToBlobAsyncCallback, (void*)2);
 
-        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is spawning the thread*/
-            .IgnoreAllArguments();
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_BUSY, result);
+        mocks.AssertActualAndExpectedCalls();
 
-        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_UploadToBlob(IGNORED_PTR_ARG, "someFileName.txt", IGNORED_PTR_ARG, 1)) /*this is the thread calling into _LL layer*/
-            .IgnoreArgument(1)
-            .IgnoreArgument(3)
-            .SetReturn(IOTHUB_CLIENT_ERROR);
+        ///cleanup
+        threadFunc(threadFuncArg);
+        IoTHubClient_Destroy(h);
+    }
+#endif
 
-        STRICT_EXPECTED_CALL(mocks, uploadToBlobAsyncCallback(FILE_UPLOAD_ERROR, (void*)1)); /*the thread completes the upload, but fails*/
+#ifdef USE_UPOLOADTOBLOB
+    /*Tests_SRS_IOTHUBCLIENT_02_096: [ If "uploadQueueMaxBytes" is not 0 and size is bigger than it then IoTHubClient_UploadToBlobAsync shall fail and return IOTHUB_CLIENT_INVALID_SIZE. ]*/
+    TEST_FUNCTION(IoTHubClient_UploadToBlobAsync_bigger_than_uploadQueueMaxBytes_returns_INVALID_SIZE)
+    {
+        ///arrange
+        CIoTHubClientMocks mocks;
+
+        IOTHUB_CLIENT_HANDLE h = IoTHubClient_Create(&TEST_CONFIG);
+        IOTHUB_CLIENT_RESULT result;
+        size_t maxBytes = 1;
+        IOTHUB_CLIENT_QUEUE_FULL_POLICY policy = IOTHUB_CLIENT_QUEUE_FULL_BLOCK;
+        (void)IoTHubClient_SetOption(h, "uploadQueueMaxBytes", &maxBytes);
+        (void)IoTHubClient_SetOption(h, "uploadQueueFullPolicy", &policy);
+        mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG)) /*this is the thread marking UPLOADTOBLOB_SAVED_DATA as disposeable*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is creating a UPLOADTOBLOB_SAVED_DATA*/
             .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG)) /*what has been locked, shall be unlocked*/
+        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, "someFileName.txt")) /*this is making a copy of the filename*/
             .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(2)); /*this is making a copy of the content*/
 
-        ///act
-        result = IoTHubClient_UploadToBlobAsync(h, "someFileName.txt", (const unsigned char*)"a", 1, uploadToBlobAsyncCallback, (void*)1);
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE)); /*there would never be room, so even IOTHUB_CLIENT_QUEUE_FULL_BLOCK does not wait*/
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
 
-        threadFunc(threadFuncArg); /*this is the thread uploading function*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1)
+            .ExpectedTimesExactly(3);
+
+        ///act
+        result = IoTHubClient_UploadToBlobAsync(h, "someFileName.txt", (const unsigned char*)"ab", 2, uploadToBlobAsyncCallback, (void*)1);
 
         ///assert
-        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_SIZE, result);
         mocks.AssertActualAndExpectedCalls();
 
         ///cleanup
@@ -2314,71 +3545,90 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
 #endif
 
 #ifdef USE_UPOLOADTOBLOB
-    /*Tests_SRS_IOTHUBCLIENT_02_053: [ If copying to the structure or spawning the thread fails, then IoTHubClient_UploadToBlobAsync shall fail and return IOTHUB_CLIENT_ERROR. ]*/
-    TEST_FUNCTION(IoTHubClient_UploadToBlobAsync_fails_when_ThreadAPI_Create_fails)
+    /*Tests_SRS_IOTHUBCLIENT_02_098: [ If the upload is not accepted because of SRS IOTHUBCLIENT 02 097 and "uploadQueueFullPolicy" is IOTHUB_CLIENT_QUEUE_FULL_BLOCK then IoTHubClient_UploadToBlobAsync shall release the lock, sleep and try again. ]*/
+    /*Tests_SRS_IOTHUBCLIENT_02_099: [ If "uploadQueueBlockTimeout" is not 0 and the upload could not be accepted in that many milliseconds then IoTHubClient_UploadToBlobAsync shall return IOTHUB_CLIENT_BUSY. ]*/
+    TEST_FUNCTION(IoTHubClient_UploadToBlobAsync_under_BLOCK_retries_until_uploadQueueBlockTimeout)
     {
         ///arrange
         CIoTHubClientMocks mocks;
 
         IOTHUB_CLIENT_HANDLE h = IoTHubClient_Create(&TEST_CONFIG);
         IOTHUB_CLIENT_RESULT result;
+        size_t maxCount = 1;
+        IOTHUB_CLIENT_QUEUE_FULL_POLICY policy = IOTHUB_CLIENT_QUEUE_FULL_BLOCK;
+        unsigned int blockTimeout = 20;
+        (void)IoTHubClient_SetOption(h, "uploadQueueMaxCount", &maxCount);
+        (void)IoTHubClient_SetOption(h, "uploadQueueFullPolicy", &policy);
+        (void)IoTHubClient_SetOption(h, "uploadQueueBlockTimeout", &blockTimeout);
+        (void)IoTHubClient_UploadToBlobAsync(h, "first.txt", (const unsigned char*)"a", 1, uploadToBlobAsyncCallback, (void*)1);
         mocks.ResetAllCalls();
 
         STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is creating a UPLOADTOBLOB_SAVED_DATA*/
             .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, "someFileName.txt")) /*this is making a copy of the filename*/
+        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, "second.txt")) /*this is making a copy of the filename*/
             .IgnoreArgument(1);
-
         STRICT_EXPECTED_CALL(mocks, gballoc_malloc(1)); /*this is making a copy of the content*/
 
-        STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG)) /*this is locking the IOTHUB_CLIENT_HANDLE because it's savedDataToBeCleaned member is about to be modified*/
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is starting the worker thread*/
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG)) /*what has been locked shall be unlocked*/
-            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE)) /*the first upload never finishes, so each attempt finds the queue full*/
+            .ExpectedTimesExactly(3);
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE))
+            .ExpectedTimesExactly(3);
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(10)) /*10 ms between attempts, 20 ms in total*/
+            .ExpectedTimesExactly(2);
 
-        STRICT_EXPECTED_CALL(mocks, list_add(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is adding UPLOADTOBLOB_SAVED_DATA to the list of UPLOADTOBLOB_SAVED_DATAs to be cleaned*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
             .IgnoreArgument(1)
-            .IgnoreArgument(2);
+            .ExpectedTimesExactly(3);
 
-        STRICT_EXPECTED_CALL(mocks, Lock_Init()); /*this is creating a lock for the canBeGarbageCollected */
+        ///act
+        result = IoTHubClient_UploadToBlobAsync(h, "second.txt", (const unsigned char*)"b", 1, uploadToBlobAsyncCallback, (void*)2);
 
-        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is spawning the thread*/
-            .IgnoreAllArguments()
-            .SetFailReturn(THREADAPI_ERROR);
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_BUSY, result);
+        mocks.AssertActualAndExpectedCalls();
 
-        STRICT_EXPECTED_CALL(mocks, Lock_Deinit(IGNORED_PTR_ARG)) /*this is uncreating a lock for the canBeGarbageCollected */
-            .IgnoreArgument(1);
+        ///cleanup
+        threadFunc(threadFuncArg);
+        IoTHubClient_Destroy(h);
+    }
+#endif
 
-        STRICT_EXPECTED_CALL(mocks, list_remove(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreAllArguments();
+#ifdef USE_UPOLOADTOBLOB
+    /*Tests_SRS_IOTHUBCLIENT_02_069: [ IoTHubClient_Destroy shall wait for the uploads accepted by IoTHubClient_UploadToBlobAsync to finish by joining the uploading thread (if any). The serializing lock shall not be held while waiting. ]*/
+    TEST_FUNCTION(IoTHubClient_Destroy_joins_the_uploading_thread_before_taking_the_serializing_lock)
+    {
+        ///arrange
+        CIoTHubClientMocks mocks;
 
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+        IOTHUB_CLIENT_HANDLE h = IoTHubClient_Create(&TEST_CONFIG);
+        (void)IoTHubClient_UploadToBlobAsync(h, "someFileName.txt", (const unsigned char*)"a", 1, uploadToBlobAsyncCallback, (void*)1);
+        threadFunc(threadFuncArg);
+        mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE)); /*this is the lock of the list of queued uploads*/
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Join(TEST_THREAD_HANDLE, IGNORED_PTR_ARG)) /*this is waiting for the uploading thread*/
+            .IgnoreArgument(2);
 
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE)); /*this is the serializing lock*/
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_Destroy(TEST_IOTHUB_CLIENT_LL_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Lock_Deinit(TEST_LOCK_HANDLE)); /*this is the lock of the list of queued uploads*/
+        STRICT_EXPECTED_CALL(mocks, list_destroy(TEST_LIST_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Lock_Deinit(TEST_LOCK_HANDLE));
+        EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
 
         ///act
-        result = IoTHubClient_UploadToBlobAsync(h, "someFileName.txt", (const unsigned char*)"a", 1, uploadToBlobAsyncCallback, (void*)1);
+        IoTHubClient_Destroy(h);
 
         ///assert
-        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
         mocks.AssertActualAndExpectedCalls();
-
-        ///cleanup
-        IoTHubClient_Destroy(h);
     }
 #endif
 
 #ifdef USE_UPOLOADTOBLOB
-    /*Tests_SRS_IOTHUBCLIENT_02_053: [ If copying to the structure or spawning the thread fails, then IoTHubClient_UploadToBlobAsync shall fail and return IOTHUB_CLIENT_ERROR. ]*/
-    TEST_FUNCTION(IoTHubClient_UploadToBlobAsync_fails_when_Lock_Init_fails)
+    /*Tests_SRS_IOTHUBCLIENT_02_053: [ If copying to the structure, queueing it or starting the uploading thread fails, then IoTHubClient_UploadToBlobAsync shall fail and return IOTHUB_CLIENT_ERROR. ]*/
+    TEST_FUNCTION(IoTHubClient_UploadToBlobAsync_fails_when_malloc_fails_1)
     {
         ///arrange
         CIoTHubClientMocks mocks;
@@ -2393,27 +3643,8 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
         STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, "someFileName.txt")) /*this is making a copy of the filename*/
             .IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(1)); /*this is making a copy of the content*/
-
-        STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG)) /*this is locking the IOTHUB_CLIENT_HANDLE because it's savedDataToBeCleaned member is about to be modified*/
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is starting the worker thread*/
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG)) /*what has been locked shall be unlocked*/
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, list_add(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is adding UPLOADTOBLOB_SAVED_DATA to the list of UPLOADTOBLOB_SAVED_DATAs to be cleaned*/
-            .IgnoreArgument(1)
-            .IgnoreArgument(2);
-
-        STRICT_EXPECTED_CALL(mocks, Lock_Init()) /*this is creating a lock for the canBeGarbageCollected */
-            .SetFailReturn((LOCK_HANDLE)NULL);
-
-        STRICT_EXPECTED_CALL(mocks, list_remove(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .IgnoreAllArguments();
-
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(1)) /*this is making a copy of the content*/
+            .SetFailReturn((void*)NULL);
 
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
@@ -2434,8 +3665,8 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
 #endif
 
 #ifdef USE_UPOLOADTOBLOB
-    /*Tests_SRS_IOTHUBCLIENT_02_053: [ If copying to the structure or spawning the thread fails, then IoTHubClient_UploadToBlobAsync shall fail and return IOTHUB_CLIENT_ERROR. ]*/
-    TEST_FUNCTION(IoTHubClient_UploadToBlobAsync_fails_when_list_add_fails)
+    /*Tests_SRS_IOTHUBCLIENT_02_053: [ If copying to the structure, queueing it or starting the uploading thread fails, then IoTHubClient_UploadToBlobAsync shall fail and return IOTHUB_CLIENT_ERROR. ]*/
+    TEST_FUNCTION(IoTHubClient_UploadToBlobAsync_fails_when_malloc_fails_2)
     {
         ///arrange
         CIoTHubClientMocks mocks;
@@ -2448,27 +3679,8 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
             .IgnoreArgument(1);
 
         STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, "someFileName.txt")) /*this is making a copy of the filename*/
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(1)); /*this is making a copy of the content*/
-
-        STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG)) /*this is locking the IOTHUB_CLIENT_HANDLE because it's savedDataToBeCleaned member is about to be modified*/
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is starting the worker thread*/
-            .IgnoreAllArguments();
-        STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG)) /*what has been locked shall be unlocked*/
-            .IgnoreArgument(1);
-    
-        STRICT_EXPECTED_CALL(mocks, list_add(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is adding UPLOADTOBLOB_SAVED_DATA to the list of UPLOADTOBLOB_SAVED_DATAs to be cleaned*/
             .IgnoreArgument(1)
-            .IgnoreArgument(2)
-            .SetFailReturn((LIST_ITEM_HANDLE)NULL);
-
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+            .SetFailReturn(__LINE__);
 
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
@@ -2486,8 +3698,8 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
 #endif
 
 #ifdef USE_UPOLOADTOBLOB
-    /*Tests_SRS_IOTHUBCLIENT_02_053: [ If copying to the structure or spawning the thread fails, then IoTHubClient_UploadToBlobAsync shall fail and return IOTHUB_CLIENT_ERROR. ]*/
-    TEST_FUNCTION(IoTHubClient_UploadToBlobAsync_fails_when_StartWorkerThreadIfNeeded_fails)
+    /*Tests_SRS_IOTHUBCLIENT_02_053: [ If copying to the structure, queueing it or starting the uploading thread fails, then IoTHubClient_UploadToBlobAsync shall fail and return IOTHUB_CLIENT_ERROR. ]*/
+    TEST_FUNCTION(IoTHubClient_UploadToBlobAsync_fails_when_malloc_fails_3)
     {
         ///arrange
         CIoTHubClientMocks mocks;
@@ -2497,36 +3709,52 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
         mocks.ResetAllCalls();
 
         STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is creating a UPLOADTOBLOB_SAVED_DATA*/
-            .IgnoreArgument(1);
+            .IgnoreArgument(1)
+            .SetFailReturn((void*)NULL);
 
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, "someFileName.txt")) /*this is making a copy of the filename*/
-            .IgnoreArgument(1);
+        ///act
+        result = IoTHubClient_UploadToBlobAsync(h, "someFileName.txt", (const unsigned char*)"a", 1, uploadToBlobAsyncCallback, (void*)1);
 
-        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(1)); /*this is making a copy of the content*/
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+        mocks.AssertActualAndExpectedCalls();
 
-        STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG)) /*this is locking the IOTHUB_CLIENT_HANDLE because it's savedDataToBeCleaned member is about to be modified*/
-            .IgnoreArgument(1);
-        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is starting the worker thread*/
-            .IgnoreAllArguments()
-            .SetReturn(THREADAPI_ERROR);
+        ///cleanup
+        IoTHubClient_Destroy(h);
+    }
+#endif
 
-        STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG)) /*what has been locked shall be unlocked*/
-            .IgnoreArgument(1);
+#ifndef DONT_USE_UPLOADTOBLOB
+    /*Tests_SRS_IOTHUBCLIENT_02_091: [ If iotHubClientHandle, destinationFileName or sourceFileName is NULL then IoTHubClient_UploadToBlobFromFileAsync shall fail and return IOTHUB_CLIENT_INVALID_ARG. ]*/
+    TEST_FUNCTION(IoTHubClient_UploadToBlobFromFileAsync_with_NULL_iotHubClientHandle_fails)
+    {
+        ///arrange
+        IOTHUB_CLIENT_RESULT result;
 
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+        ///act
+        result = IoTHubClient_UploadToBlobFromFileAsync(NULL, "a", "b.bin", NULL, NULL);
 
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    }
+#endif
 
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+#ifdef USE_UPOLOADTOBLOB
+    /*Tests_SRS_IOTHUBCLIENT_02_091: [ If iotHubClientHandle, destinationFileName or sourceFileName is NULL then IoTHubClient_UploadToBlobFromFileAsync shall fail and return IOTHUB_CLIENT_INVALID_ARG. ]*/
+    TEST_FUNCTION(IoTHubClient_UploadToBlobFromFileAsync_with_NULL_sourceFileName_fails)
+    {
+        ///arrange
+        CIoTHubClientMocks mocks;
+
+        IOTHUB_CLIENT_HANDLE h = IoTHubClient_Create(&TEST_CONFIG);
+        IOTHUB_CLIENT_RESULT result;
+        mocks.ResetAllCalls();
 
         ///act
-        result = IoTHubClient_UploadToBlobAsync(h, "someFileName.txt", (const unsigned char*)"a", 1, uploadToBlobAsyncCallback, (void*)1);
+        result = IoTHubClient_UploadToBlobFromFileAsync(h, "someFileName.txt", NULL, NULL, NULL);
 
         ///assert
-        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
         mocks.AssertActualAndExpectedCalls();
 
         ///cleanup
@@ -2535,8 +3763,11 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
 #endif
 
 #ifdef USE_UPOLOADTOBLOB
-    /*Tests_SRS_IOTHUBCLIENT_02_053: [ If copying to the structure or spawning the thread fails, then IoTHubClient_UploadToBlobAsync shall fail and return IOTHUB_CLIENT_ERROR. ]*/
-    TEST_FUNCTION(IoTHubClient_UploadToBlobAsync_fails_when_Lock_fails)
+    /*Tests_SRS_IOTHUBCLIENT_02_092: [ IoTHubClient_UploadToBlobFromFileAsync shall copy destinationFileName, sourceFileName, iotHubClientFileUploadCallback and context into a structure and then queue it for the uploading thread as IoTHubClient_UploadToBlobAsync does, counting it as 0 bytes. The file shall only be read by the uploading thread. ]*/
+    /*Tests_SRS_IOTHUBCLIENT_02_094: [ The thread shall call IoTHubClient_LL_UploadToBlobFromFile passing the destinationFileName and sourceFileName packed in the structure. ]*/
+    /*Tests_SRS_IOTHUBCLIENT_02_100: [ Before calling the callback, the thread shall make the upload no longer count against "uploadQueueMaxCount" and "uploadQueueMaxBytes". ]*/
+    /*Tests_SRS_IOTHUBCLIENT_02_111: [ Once the callback has returned the thread shall free the structure. ]*/
+    TEST_FUNCTION(IoTHubClient_UploadToBlobFromFileAsync_succeeds)
     {
         ///arrange
         CIoTHubClientMocks mocks;
@@ -2548,29 +3779,51 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
         STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is creating a UPLOADTOBLOB_SAVED_DATA*/
             .IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, "someFileName.txt")) /*this is making a copy of the filename*/
+        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, "someFileName.txt")) /*this is making a copy of the destination filename*/
             .IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(1)); /*this is making a copy of the content*/
+        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, "source.bin")) /*this is making a copy of the source filename, the file itself is not read here*/
+            .IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG)) /*this is locking the IOTHUB_CLIENT_HANDLE because it's savedDataToBeCleaned member is about to be modified*/
-            .IgnoreArgument(1)
-            .SetReturn(LOCK_ERROR);
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE)); /*this is locking the list of queued uploads*/
+        STRICT_EXPECTED_CALL(mocks, list_add(TEST_LIST_HANDLE, IGNORED_PTR_ARG)) /*this is queueing the UPLOADTOBLOB_SAVED_DATA*/
+            .IgnoreArgument(2);
+        STRICT_EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is starting the uploading thread*/
+            .IgnoreAllArguments();
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
 
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE)); /*this is the thread taking the upload off the list*/
+        STRICT_EXPECTED_CALL(mocks, list_get_head_item(TEST_LIST_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, list_item_get_value(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, list_remove(TEST_LIST_HANDLE, IGNORED_PTR_ARG))
+            .IgnoreArgument(2);
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
 
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_UploadToBlobFromFile(TEST_IOTHUB_CLIENT_LL_HANDLE, "someFileName.txt", "source.bin")); /*this is the thread calling into _LL layer*/
 
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE)); /*this is the thread releasing the upload before its callback*/
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, uploadToBlobAsyncCallback(FILE_UPLOAD_OK, (void*)1)); /*the thread completes successfully*/
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE)); /*this is the thread noting the callback has returned*/
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+        STRICT_EXPECTED_CALL(mocks, gballoc_free((void*)NULL)); /*there is no copy of the content*/
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)) /*this is freeing the copies of the filenames and the UPLOADTOBLOB_SAVED_DATA*/
+            .IgnoreArgument(1)
+            .ExpectedTimesExactly(3);
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE)); /*this is the thread finding the list empty*/
+        STRICT_EXPECTED_CALL(mocks, list_get_head_item(TEST_LIST_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
 
         ///act
-        result = IoTHubClient_UploadToBlobAsync(h, "someFileName.txt", (const unsigned char*)"a", 1, uploadToBlobAsyncCallback, (void*)1);
+        result = IoTHubClient_UploadToBlobFromFileAsync(h, "someFileName.txt", "source.bin", uploadToBlobAsyncCallback, (void*)1);
+
+        threadFunc(threadFuncArg); /*this is the thread uploading function*/
 
         ///assert
-        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
         mocks.AssertActualAndExpectedCalls();
 
         ///cleanup
@@ -2579,8 +3832,8 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
 #endif
 
 #ifdef USE_UPOLOADTOBLOB
-    /*Tests_SRS_IOTHUBCLIENT_02_053: [ If copying to the structure or spawning the thread fails, then IoTHubClient_UploadToBlobAsync shall fail and return IOTHUB_CLIENT_ERROR. ]*/
-    TEST_FUNCTION(IoTHubClient_UploadToBlobAsync_fails_when_malloc_fails_1)
+    /*Tests_SRS_IOTHUBCLIENT_02_093: [ If copying to the structure fails, then IoTHubClient_UploadToBlobFromFileAsync shall fail and return IOTHUB_CLIENT_ERROR. ]*/
+    TEST_FUNCTION(IoTHubClient_UploadToBlobFromFileAsync_fails_when_copying_the_sourceFileName_fails)
     {
         ///arrange
         CIoTHubClientMocks mocks;
@@ -2591,21 +3844,18 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
 
         STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is creating a UPLOADTOBLOB_SAVED_DATA*/
             .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, "someFileName.txt")) /*this is making a copy of the filename*/
+        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, "someFileName.txt"))
             .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(1)) /*this is making a copy of the content*/
-            .SetFailReturn((void*)NULL);
-
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, "source.bin"))
+            .IgnoreArgument(1)
+            .SetFailReturn(__LINE__);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)) /*this is freeing the copy of the destination filename*/
             .IgnoreArgument(1);
-
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)) /*this is freeing the UPLOADTOBLOB_SAVED_DATA*/
             .IgnoreArgument(1);
 
         ///act
-        result = IoTHubClient_UploadToBlobAsync(h, "someFileName.txt", (const unsigned char*)"a", 1, uploadToBlobAsyncCallback, (void*)1);
+        result = IoTHubClient_UploadToBlobFromFileAsync(h, "someFileName.txt", "source.bin", uploadToBlobAsyncCallback, (void*)1);
 
         ///assert
         ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
@@ -2616,32 +3866,65 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
     }
 #endif
 
-#ifdef USE_UPOLOADTOBLOB
-    /*Tests_SRS_IOTHUBCLIENT_02_053: [ If copying to the structure or spawning the thread fails, then IoTHubClient_UploadToBlobAsync shall fail and return IOTHUB_CLIENT_ERROR. ]*/
-    TEST_FUNCTION(IoTHubClient_UploadToBlobAsync_fails_when_malloc_fails_2)
+#ifndef DONT_USE_UPLOADTOBLOB
+    /*Tests_SRS_IOTHUBCLIENT_02_106: [ If iotHubClientHandle or stats is NULL then IoTHubClient_GetUploadQueueStats shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+    TEST_FUNCTION(IoTHubClient_GetUploadQueueStats_with_NULL_handle_fails)
     {
         ///arrange
         CIoTHubClientMocks mocks;
+        IOTHUB_CLIENT_UPLOAD_QUEUE_STATS stats;
+
+        ///act
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_GetUploadQueueStats(NULL, &stats);
+
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+        mocks.AssertActualAndExpectedCalls();
+    }
+#endif
 
+#ifndef DONT_USE_UPLOADTOBLOB
+    /*Tests_SRS_IOTHUBCLIENT_02_106: [ If iotHubClientHandle or stats is NULL then IoTHubClient_GetUploadQueueStats shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+    TEST_FUNCTION(IoTHubClient_GetUploadQueueStats_with_NULL_stats_fails)
+    {
+        ///arrange
+        CIoTHubClientMocks mocks;
         IOTHUB_CLIENT_HANDLE h = IoTHubClient_Create(&TEST_CONFIG);
-        IOTHUB_CLIENT_RESULT result;
         mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is creating a UPLOADTOBLOB_SAVED_DATA*/
-            .IgnoreArgument(1);
+        ///act
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_GetUploadQueueStats(h, NULL);
 
-        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, "someFileName.txt")) /*this is making a copy of the filename*/
-            .IgnoreArgument(1)
-            .SetFailReturn(__LINE__);
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+        mocks.AssertActualAndExpectedCalls();
 
-        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
-            .IgnoreArgument(1);
+        ///cleanup
+        IoTHubClient_Destroy(h);
+    }
+#endif
+
+#ifndef DONT_USE_UPLOADTOBLOB
+    /*Tests_SRS_IOTHUBCLIENT_02_107: [ IoTHubClient_GetUploadQueueStats shall be made thread-safe by using the lock of the LIST_HANDLE of uploads, it shall not take the serializing lock. If acquiring the lock fails, IoTHubClient_GetUploadQueueStats shall return IOTHUB_CLIENT_ERROR. ]*/
+    /*Tests_SRS_IOTHUBCLIENT_02_108: [ IoTHubClient_GetUploadQueueStats shall report how many uploads are queued or uploading and the bytes of their sources copied by IoTHubClient_UploadToBlobAsync, and return IOTHUB_CLIENT_OK. ]*/
+    TEST_FUNCTION(IoTHubClient_GetUploadQueueStats_with_nothing_queued_reports_0)
+    {
+        ///arrange
+        CIoTHubClientMocks mocks;
+        IOTHUB_CLIENT_HANDLE h = IoTHubClient_Create(&TEST_CONFIG);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+        STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
 
         ///act
-        result = IoTHubClient_UploadToBlobAsync(h, "someFileName.txt", (const unsigned char*)"a", 1, uploadToBlobAsyncCallback, (void*)1);
+        IOTHUB_CLIENT_UPLOAD_QUEUE_STATS stats = { 1, 1 };
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_GetUploadQueueStats(h, &stats);
 
         ///assert
-        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+        ASSERT_ARE_EQUAL(size_t, 0, stats.uploadCount);
+        ASSERT_ARE_EQUAL(size_t, 0, stats.byteCount);
         mocks.AssertActualAndExpectedCalls();
 
         ///cleanup
@@ -2649,23 +3932,21 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
     }
 #endif
 
-#ifdef USE_UPOLOADTOBLOB
-    /*Tests_SRS_IOTHUBCLIENT_02_053: [ If copying to the structure or spawning the thread fails, then IoTHubClient_UploadToBlobAsync shall fail and return IOTHUB_CLIENT_ERROR. ]*/
-    TEST_FUNCTION(IoTHubClient_UploadToBlobAsync_fails_when_malloc_fails_3)
+#ifndef DONT_USE_UPLOADTOBLOB
+    /*Tests_SRS_IOTHUBCLIENT_02_107: [ IoTHubClient_GetUploadQueueStats shall be made thread-safe by using the lock of the LIST_HANDLE of uploads, it shall not take the serializing lock. If acquiring the lock fails, IoTHubClient_GetUploadQueueStats shall return IOTHUB_CLIENT_ERROR. ]*/
+    TEST_FUNCTION(when_Lock_fails_IoTHubClient_GetUploadQueueStats_fails)
     {
         ///arrange
         CIoTHubClientMocks mocks;
-
         IOTHUB_CLIENT_HANDLE h = IoTHubClient_Create(&TEST_CONFIG);
-        IOTHUB_CLIENT_RESULT result;
         mocks.ResetAllCalls();
 
-        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is creating a UPLOADTOBLOB_SAVED_DATA*/
-            .IgnoreArgument(1)
-            .SetFailReturn((void*)NULL);
+        STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE))
+            .SetReturn(LOCK_ERROR);
 
         ///act
-        result = IoTHubClient_UploadToBlobAsync(h, "someFileName.txt", (const unsigned char*)"a", 1, uploadToBlobAsyncCallback, (void*)1);
+        IOTHUB_CLIENT_UPLOAD_QUEUE_STATS stats;
+        IOTHUB_CLIENT_RESULT result = IoTHubClient_GetUploadQueueStats(h, &stats);
 
         ///assert
         ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
@@ -2676,4 +3957,35 @@ BEGIN_TEST_SUITE(iothubclient_unittests)
     }
 #endif
 
+#ifdef USE_UPOLOADTOBLOB
+    /*Tests_SRS_IOTHUBCLIENT_02_108: [ IoTHubClient_GetUploadQueueStats shall report how many uploads are queued or uploading and the bytes of their sources copied by IoTHubClient_UploadToBlobAsync, and return IOTHUB_CLIENT_OK. ]*/
+    /*Tests_SRS_IOTHUBCLIENT_02_100: [ Before calling the callback, the thread shall make the upload no longer count against "uploadQueueMaxCount" and "uploadQueueMaxBytes". ]*/
+    TEST_FUNCTION(IoTHubClient_GetUploadQueueStats_counts_the_uploads_until_they_finish)
+    {
+        ///arrange
+        CIoTHubClientMocks mocks;
+        IOTHUB_CLIENT_HANDLE h = IoTHubClient_Create(&TEST_CONFIG);
+        IOTHUB_CLIENT_UPLOAD_QUEUE_STATS queued;
+        IOTHUB_CLIENT_UPLOAD_QUEUE_STATS finished;
+        (void)IoTHubClient_UploadToBlobAsync(h, "first.txt", (const unsigned char*)"abc", 3, uploadToBlobAsyncCallback, (void*)1);
+        (void)IoTHubClient_UploadToBlobFromFileAsync(h, "second.txt", "source.bin", uploadToBlobAsyncCallback, (void*)2);
+
+        ///act
+        IOTHUB_CLIENT_RESULT result1 = IoTHubClient_GetUploadQueueStats(h, &queued);
+        threadFunc(threadFuncArg);
+        IOTHUB_CLIENT_RESULT result2 = IoTHubClient_GetUploadQueueStats(h, &finished);
+
+        ///assert
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result1);
+        ASSERT_ARE_EQUAL(size_t, 2, queued.uploadCount);
+        ASSERT_ARE_EQUAL(size_t, 3, queued.byteCount); /*the file is not read before it is uploaded*/
+        ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result2);
+        ASSERT_ARE_EQUAL(size_t, 0, finished.uploadCount);
+        ASSERT_ARE_EQUAL(size_t, 0, finished.byteCount);
+
+        ///cleanup
+        IoTHubClient_Destroy(h);
+    }
+#endif
+
 END_TEST_SUITE(iothubclient_unittests)
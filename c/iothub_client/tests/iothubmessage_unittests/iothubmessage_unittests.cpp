@@ -2,6 +2,7 @@
 // Licensed under the MIT license. See LICENSE file in the project root for full license information.
 
 #include <cstdlib>
+#include <cstring>
 #ifdef _CRTDBG_MAP_ALLOC
 #include <crtdbg.h>
 #endif
@@ -99,6 +100,9 @@ static size_t whenShallSTRING_concat_with_STRING_fail;
 static MAP_FILTER_CALLBACK g_mapFilterFunc;
 
 static const unsigned char c[1] = { '3' };
+/*payloads that do not fit in IOTHUB_MESSAGE_INLINE_PAYLOAD_SIZE are kept in BUFFER_HANDLE/STRING_HANDLE*/
+static unsigned char bigC[IOTHUB_MESSAGE_INLINE_PAYLOAD_SIZE + 1];
+static char bigString[IOTHUB_MESSAGE_INLINE_PAYLOAD_SIZE + 2];
 static const char* TEST_MESSAGE_ID = "3820ADAE-E3CA-4065-843A-A6BDE950D8DC";
 static const char* TEST_MESSAGE_ID2 = "052BA01A-ECBF-48CF-BC7B-64B315D898B7";
 
@@ -396,6 +400,10 @@ BEGIN_TEST_SUITE(iothubmessage_unittests)
         TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
         g_testByTest = MicroMockCreateMutex();
         ASSERT_IS_NOT_NULL(g_testByTest);
+
+        (void)memset(bigC, '3', sizeof(bigC));
+        (void)memset(bigString, 'a', sizeof(bigString) - 1);
+        bigString[sizeof(bigString) - 1] = '\0';
     }
 
     TEST_SUITE_CLEANUP(TestClassCleanup)
@@ -475,12 +483,12 @@ BEGIN_TEST_SUITE(iothubmessage_unittests)
         STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
             .IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, BUFFER_create(c, 1));
+        STRICT_EXPECTED_CALL(mocks, BUFFER_create(bigC, sizeof(bigC)));
         STRICT_EXPECTED_CALL(mocks, Map_Create(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
 
         ///act
-        auto h = IoTHubMessage_CreateFromByteArray(c, 1);
+        auto h = IoTHubMessage_CreateFromByteArray(bigC, sizeof(bigC));
 
         ///assert
         ASSERT_IS_NOT_NULL(h);
@@ -522,7 +530,6 @@ BEGIN_TEST_SUITE(iothubmessage_unittests)
         STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
             .IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, BUFFER_create(IGNORED_PTR_ARG, 0)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, Map_Create(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
 
@@ -546,7 +553,6 @@ BEGIN_TEST_SUITE(iothubmessage_unittests)
         STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
             .IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, BUFFER_create(IGNORED_PTR_ARG, 0)).IgnoreArgument(1);
         STRICT_EXPECTED_CALL(mocks, Map_Create(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
 
@@ -572,7 +578,7 @@ BEGIN_TEST_SUITE(iothubmessage_unittests)
         STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, BUFFER_create(c, 1));
+        STRICT_EXPECTED_CALL(mocks, BUFFER_create(bigC, sizeof(bigC)));
         STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
 
@@ -581,7 +587,7 @@ BEGIN_TEST_SUITE(iothubmessage_unittests)
             .IgnoreArgument(1);
 
         ///act
-        auto h = IoTHubMessage_CreateFromByteArray(c, 1);
+        auto h = IoTHubMessage_CreateFromByteArray(bigC, sizeof(bigC));
 
         ///assert
         ASSERT_IS_NULL(h);
@@ -602,10 +608,10 @@ BEGIN_TEST_SUITE(iothubmessage_unittests)
             .IgnoreArgument(1);
 
         whenShallBUFFER_create_fail = currentBUFFER_create_call + 1;
-        STRICT_EXPECTED_CALL(mocks, BUFFER_create(c, 1));
+        STRICT_EXPECTED_CALL(mocks, BUFFER_create(bigC, sizeof(bigC)));
 
         ///act
-        auto h = IoTHubMessage_CreateFromByteArray(c, 1);
+        auto h = IoTHubMessage_CreateFromByteArray(bigC, sizeof(bigC));
 
         ///assert
         ASSERT_IS_NULL(h);
@@ -647,12 +653,12 @@ BEGIN_TEST_SUITE(iothubmessage_unittests)
         STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
             .IgnoreArgument(1);
 
-        STRICT_EXPECTED_CALL(mocks, STRING_construct("a"));
+        STRICT_EXPECTED_CALL(mocks, STRING_construct(bigString));
         STRICT_EXPECTED_CALL(mocks, Map_Create(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
 
         ///act
-        auto h = IoTHubMessage_CreateFromString("a");
+        auto h = IoTHubMessage_CreateFromString(bigString);
 
         ///assert
         ASSERT_IS_NOT_NULL(h);
@@ -676,7 +682,7 @@ BEGIN_TEST_SUITE(iothubmessage_unittests)
             .IgnoreArgument(1);
 
 
-        STRICT_EXPECTED_CALL(mocks, STRING_construct("a"));
+        STRICT_EXPECTED_CALL(mocks, STRING_construct(bigString));
         STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
             .IgnoreArgument(1);
 
@@ -685,7 +691,7 @@ BEGIN_TEST_SUITE(iothubmessage_unittests)
             .IgnoreArgument(1);
 
         ///act
-        auto h = IoTHubMessage_CreateFromString("a");
+        auto h = IoTHubMessage_CreateFromString(bigString);
 
         ///assert
         ASSERT_IS_NULL(h);
@@ -706,10 +712,10 @@ BEGIN_TEST_SUITE(iothubmessage_unittests)
             .IgnoreArgument(1);
 
         whenShallSTRING_construct_fail = currentSTRING_construct_call + 1;
-        STRICT_EXPECTED_CALL(mocks, STRING_construct("a"));
+        STRICT_EXPECTED_CALL(mocks, STRING_construct(bigString));
 
         ///act
-        auto h = IoTHubMessage_CreateFromString("a");
+        auto h = IoTHubMessage_CreateFromString(bigString);
 
         ///assert
         ASSERT_IS_NULL(h);
@@ -758,7 +764,7 @@ BEGIN_TEST_SUITE(iothubmessage_unittests)
     {
         ///arrange
         CIoTHubMessageMocks mocks;
-        auto h = IoTHubMessage_CreateFromByteArray(c, 1);
+        auto h = IoTHubMessage_CreateFromByteArray(bigC, sizeof(bigC));
         mocks.ResetAllCalls();
 
         STRICT_EXPECTED_CALL(mocks, Map_Destroy(IGNORED_PTR_ARG))
@@ -783,7 +789,7 @@ BEGIN_TEST_SUITE(iothubmessage_unittests)
     {
         ///arrange
         CIoTHubMessageMocks mocks;
-        auto h = IoTHubMessage_CreateFromString("aaaa");
+        auto h = IoTHubMessage_CreateFromString(bigString);
         mocks.ResetAllCalls();
 
         STRICT_EXPECTED_CALL(mocks, Map_Destroy(IGNORED_PTR_ARG))
@@ -810,7 +816,7 @@ BEGIN_TEST_SUITE(iothubmessage_unittests)
     {
         ///arrange
         CIoTHubMessageMocks mocks;
-        auto h = IoTHubMessage_CreateFromByteArray(c, 1);
+        auto h = IoTHubMessage_CreateFromByteArray(bigC, sizeof(bigC));
         const unsigned char* byteArray;
         size_t size;
         mocks.ResetAllCalls();
@@ -826,8 +832,8 @@ BEGIN_TEST_SUITE(iothubmessage_unittests)
 
         ///assert
         ASSERT_ARE_EQUAL(IOTHUB_MESSAGE_RESULT, IOTHUB_MESSAGE_OK, r);
-        ASSERT_ARE_EQUAL(uint8_t, c[0], byteArray[0]);
-        ASSERT_ARE_EQUAL(size_t, 1, size);
+        ASSERT_ARE_EQUAL(uint8_t, bigC[0], byteArray[0]);
+        ASSERT_ARE_EQUAL(size_t, sizeof(bigC), size);
         mocks.AssertActualAndExpectedCalls();
 
         ///cleanup
@@ -924,7 +930,7 @@ BEGIN_TEST_SUITE(iothubmessage_unittests)
     {
         ///arrange
         CIoTHubMessageMocks mocks;
-        auto h = IoTHubMessage_CreateFromByteArray(c, 1);
+        auto h = IoTHubMessage_CreateFromByteArray(bigC, sizeof(bigC));
         mocks.ResetAllCalls();
 
         STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
@@ -951,7 +957,7 @@ BEGIN_TEST_SUITE(iothubmessage_unittests)
     {
         ///arrange
         CIoTHubMessageMocks mocks;
-        auto h = IoTHubMessage_CreateFromByteArray(c, 1);
+        auto h = IoTHubMessage_CreateFromByteArray(bigC, sizeof(bigC));
         mocks.ResetAllCalls();
 
         STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
@@ -984,7 +990,7 @@ BEGIN_TEST_SUITE(iothubmessage_unittests)
     {
         ///arrange
         CIoTHubMessageMocks mocks;
-        auto h = IoTHubMessage_CreateFromByteArray(c, 1);
+        auto h = IoTHubMessage_CreateFromByteArray(bigC, sizeof(bigC));
         mocks.ResetAllCalls();
 
         STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
@@ -1039,7 +1045,7 @@ BEGIN_TEST_SUITE(iothubmessage_unittests)
     {
         ///arrange
         CIoTHubMessageMocks mocks;
-        auto h = IoTHubMessage_CreateFromString("c, 1");
+        auto h = IoTHubMessage_CreateFromString(bigString);
         mocks.ResetAllCalls();
 
         STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
@@ -1066,7 +1072,7 @@ BEGIN_TEST_SUITE(iothubmessage_unittests)
     {
         ///arrange
         CIoTHubMessageMocks mocks;
-        auto h = IoTHubMessage_CreateFromString("c, 1");
+        auto h = IoTHubMessage_CreateFromString(bigString);
         mocks.ResetAllCalls();
 
         STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
@@ -1099,7 +1105,7 @@ BEGIN_TEST_SUITE(iothubmessage_unittests)
     {
         ///arrange
         CIoTHubMessageMocks mocks;
-        auto h = IoTHubMessage_CreateFromString("c, 1");
+        auto h = IoTHubMessage_CreateFromString(bigString);
         mocks.ResetAllCalls();
 
         STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
@@ -1219,7 +1225,7 @@ BEGIN_TEST_SUITE(iothubmessage_unittests)
     {
         ///arrange
         CIoTHubMessageMocks mocks;
-        auto h = IoTHubMessage_CreateFromString("c, 1");
+        auto h = IoTHubMessage_CreateFromString(bigString);
         mocks.ResetAllCalls();
 
         STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
@@ -1229,7 +1235,7 @@ BEGIN_TEST_SUITE(iothubmessage_unittests)
         auto r = IoTHubMessage_GetString(h);
 
         ///assert
-        ASSERT_ARE_EQUAL(char_ptr, "c, 1", r);
+        ASSERT_ARE_EQUAL(char_ptr, bigString, r);
         mocks.AssertActualAndExpectedCalls();
 
         ///cleanup
@@ -1527,4 +1533,192 @@ BEGIN_TEST_SUITE(iothubmessage_unittests)
         IoTHubMessage_Destroy(h);
     }
 
+    /*Tests_SRS_IOTHUBMESSAGE_02_034: [ If size is not bigger than IOTHUB_MESSAGE_INLINE_PAYLOAD_SIZE then IoTHubMessage_CreateFromByteArray shall store a copy of byteArray in the same allocation as the message and shall not call BUFFER_create. ]*/
+    /*Tests_SRS_IOTHUBMESSAGE_02_037: [ If the payload is stored inline then IoTHubMessage_GetByteArray shall return in buffer and size the inline payload. ]*/
+    TEST_FUNCTION(IoTHubMessage_CreateFromByteArray_with_small_payload_does_not_call_BUFFER_create)
+    {
+        ///arrange
+        CIoTHubMessageMocks mocks;
+        const unsigned char* byteArray;
+        size_t size;
+
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Map_Create(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        ///act
+        auto h = IoTHubMessage_CreateFromByteArray(c, 1);
+        auto r = IoTHubMessage_GetByteArray(h, &byteArray, &size);
+
+        ///assert
+        ASSERT_IS_NOT_NULL(h);
+        ASSERT_ARE_EQUAL(IOTHUB_MESSAGE_RESULT, IOTHUB_MESSAGE_OK, r);
+        ASSERT_ARE_EQUAL(uint8_t, c[0], byteArray[0]);
+        ASSERT_ARE_EQUAL(size_t, 1, size);
+        ASSERT_ARE_EQUAL(IOTHUBMESSAGE_CONTENT_TYPE, IOTHUBMESSAGE_BYTEARRAY, IoTHubMessage_GetContentType(h));
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubMessage_Destroy(h);
+    }
+
+    /*Tests_SRS_IOTHUBMESSAGE_02_024: [If there are any errors then IoTHubMessage_CreateFromByteArray shall return NULL*/
+    TEST_FUNCTION(IoTHubMessage_CreateFromByteArray_with_small_payload_fails_when_Map_Create_fails)
+    {
+        ///arrange
+        CIoTHubMessageMocks mocks;
+
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        whenShallMap_Create_fail = currentMap_Create_call + 1;
+        STRICT_EXPECTED_CALL(mocks, Map_Create(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        ///act
+        auto h = IoTHubMessage_CreateFromByteArray(c, 1);
+
+        ///assert
+        ASSERT_IS_NULL(h);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+    }
+
+    /*Tests_SRS_IOTHUBMESSAGE_02_035: [ If the length of source is not bigger than IOTHUB_MESSAGE_INLINE_PAYLOAD_SIZE then IoTHubMessage_CreateFromString shall store a copy of source (including its '\0') in the same allocation as the message and shall not call STRING_construct. ]*/
+    /*Tests_SRS_IOTHUBMESSAGE_02_038: [ If the payload is stored inline then IoTHubMessage_GetString shall return the inline null terminated string. ]*/
+    TEST_FUNCTION(IoTHubMessage_CreateFromString_with_small_payload_does_not_call_STRING_construct)
+    {
+        ///arrange
+        CIoTHubMessageMocks mocks;
+
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Map_Create(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        ///act
+        auto h = IoTHubMessage_CreateFromString("c, 1");
+        auto r = IoTHubMessage_GetString(h);
+
+        ///assert
+        ASSERT_IS_NOT_NULL(h);
+        ASSERT_ARE_EQUAL(char_ptr, "c, 1", r);
+        ASSERT_ARE_EQUAL(IOTHUBMESSAGE_CONTENT_TYPE, IOTHUBMESSAGE_STRING, IoTHubMessage_GetContentType(h));
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubMessage_Destroy(h);
+    }
+
+    /*Tests_SRS_IOTHUBMESSAGE_02_036: [ If the payload of iotHubMessageHandle is stored inline then IoTHubMessage_Clone shall copy it inline in the new message. ]*/
+    TEST_FUNCTION(IoTHubMessage_Clone_with_small_BYTE_ARRAY_copies_the_payload)
+    {
+        ///arrange
+        CIoTHubMessageMocks mocks;
+        auto h = IoTHubMessage_CreateFromByteArray(c, 1);
+        const unsigned char* byteArray;
+        size_t size;
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Map_Clone(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        ///act
+        auto r = IoTHubMessage_Clone(h);
+
+        ///assert
+        ASSERT_IS_NOT_NULL(r);
+        mocks.AssertActualAndExpectedCalls();
+        ASSERT_ARE_EQUAL(IOTHUB_MESSAGE_RESULT, IOTHUB_MESSAGE_OK, IoTHubMessage_GetByteArray(r, &byteArray, &size));
+        ASSERT_ARE_EQUAL(uint8_t, c[0], byteArray[0]);
+        ASSERT_ARE_EQUAL(size_t, 1, size);
+
+        ///cleanup
+        IoTHubMessage_Destroy(r);
+        IoTHubMessage_Destroy(h);
+    }
+
+    /*Tests_SRS_IOTHUBMESSAGE_02_036: [ If the payload of iotHubMessageHandle is stored inline then IoTHubMessage_Clone shall copy it inline in the new message. ]*/
+    TEST_FUNCTION(IoTHubMessage_Clone_with_small_STRING_copies_the_payload)
+    {
+        ///arrange
+        CIoTHubMessageMocks mocks;
+        auto h = IoTHubMessage_CreateFromString("c, 1");
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Map_Clone(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        ///act
+        auto r = IoTHubMessage_Clone(h);
+
+        ///assert
+        ASSERT_IS_NOT_NULL(r);
+        mocks.AssertActualAndExpectedCalls();
+        ASSERT_ARE_EQUAL(char_ptr, "c, 1", IoTHubMessage_GetString(r));
+        ASSERT_ARE_EQUAL(IOTHUBMESSAGE_CONTENT_TYPE, IOTHUBMESSAGE_STRING, IoTHubMessage_GetContentType(r));
+
+        ///cleanup
+        IoTHubMessage_Destroy(r);
+        IoTHubMessage_Destroy(h);
+    }
+
+    /*Tests_SRS_IOTHUBMESSAGE_03_004: [IoTHubMessage_Clone shall return NULL if it fails for any reason.]*/
+    TEST_FUNCTION(IoTHubMessage_Clone_with_small_payload_fails_when_Map_Clone_fails)
+    {
+        ///arrange
+        CIoTHubMessageMocks mocks;
+        auto h = IoTHubMessage_CreateFromByteArray(c, 1);
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+        whenShallMap_Clone_fail = currentMap_Clone_call + 1;
+        STRICT_EXPECTED_CALL(mocks, Map_Clone(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+
+        ///act
+        auto r = IoTHubMessage_Clone(h);
+
+        ///assert
+        ASSERT_IS_NULL(r);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+        IoTHubMessage_Destroy(h);
+    }
+
+    /*Tests_SRS_IOTHUBMESSAGE_01_003: [IoTHubMessage_Destroy shall free all resources associated with iotHubMessageHandle.]  */
+    TEST_FUNCTION(IoTHubMessage_Destroy_destroys_a_small_IoTHubMEssage)
+    {
+        ///arrange
+        CIoTHubMessageMocks mocks;
+        auto h = IoTHubMessage_CreateFromString("aaaa");
+        mocks.ResetAllCalls();
+
+        STRICT_EXPECTED_CALL(mocks, Map_Destroy(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(h));
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
+
+        ///act
+        IoTHubMessage_Destroy(h);
+
+        ///assert
+        mocks.AssertActualAndExpectedCalls();
+
+        ///cleanup
+    }
+
 END_TEST_SUITE(iothubmessage_unittests)
@@ -70,6 +70,7 @@ static void* threadFuncArg;
 #define TEST_AUTHORIZATIONKEY "theAuthorizationKey"
 #define TEST_IOTHUB_CLIENT_HANDLE1 (IOTHUB_CLIENT_HANDLE)0xDEAD
 #define TEST_IOTHUB_CLIENT_HANDLE2 (IOTHUB_CLIENT_HANDLE)0xDEAF
+#define TEST_IOTHUB_CLIENT_LL_HANDLE (IOTHUB_CLIENT_LL_HANDLE)0xDEB0
 #define TEST_LOCK_HANDLE (LOCK_HANDLE)0x4443
 #define TEST_THREAD_HANDLE (THREAD_HANDLE)0x4442
 
@@ -124,6 +125,7 @@ static const IOTHUB_CLIENT_DEVICE_CONFIG TEST_DEVICE_CONFIG =
 static size_t currentmalloc_call;
 static size_t whenShallmalloc_fail;
 static IOTHUB_CLIENT_STATUS currentIotHubClientStatus;
+static IOTHUB_CLIENT_STATUS currentLLSendStatus;
 
 
 
@@ -274,6 +276,13 @@ public:
 	MOCK_STATIC_METHOD_0(, const char*, IoTHubClient_GetVersionString)
 		MOCK_METHOD_END(const char*, (const char*) NULL)
 
+	MOCK_STATIC_METHOD_1(, IOTHUB_CLIENT_LL_HANDLE, IoTHubClient_GetLLHandle, IOTHUB_CLIENT_HANDLE, iotHubClientHandle)
+		MOCK_METHOD_END(IOTHUB_CLIENT_LL_HANDLE, TEST_IOTHUB_CLIENT_LL_HANDLE)
+
+	MOCK_STATIC_METHOD_2(, IOTHUB_CLIENT_RESULT, IoTHubClient_LL_GetSendStatus, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle, IOTHUB_CLIENT_STATUS*, iotHubClientStatus)
+		*iotHubClientStatus = currentLLSendStatus;
+	MOCK_METHOD_END(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK)
+
 		MOCK_STATIC_METHOD_0(, TICK_COUNTER_HANDLE, tickcounter_create);
 	TICK_COUNTER_HANDLE result2 = (TICK_COUNTER_HANDLE )BASEIMPLEMENTATION::gballoc_malloc(1);
 	MOCK_METHOD_END(TICK_COUNTER_HANDLE, result2)
@@ -390,6 +399,8 @@ DECLARE_GLOBAL_MOCK_METHOD_1(CIotHubTransportMocks, , const char*, STRING_c_str,
 DECLARE_GLOBAL_MOCK_METHOD_0(CIotHubTransportMocks, , STRING_HANDLE, STRING_new);
 
 DECLARE_GLOBAL_MOCK_METHOD_0(CIotHubTransportMocks, , const char*, IoTHubClient_GetVersionString);
+DECLARE_GLOBAL_MOCK_METHOD_1(CIotHubTransportMocks, , IOTHUB_CLIENT_LL_HANDLE, IoTHubClient_GetLLHandle, IOTHUB_CLIENT_HANDLE, iotHubClientHandle);
+DECLARE_GLOBAL_MOCK_METHOD_2(CIotHubTransportMocks, , IOTHUB_CLIENT_RESULT, IoTHubClient_LL_GetSendStatus, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle, IOTHUB_CLIENT_STATUS*, iotHubClientStatus);
 
 DECLARE_GLOBAL_MOCK_METHOD_0(CIotHubTransportMocks, ,TICK_COUNTER_HANDLE, tickcounter_create);
 DECLARE_GLOBAL_MOCK_METHOD_1(CIotHubTransportMocks, , void, tickcounter_destroy, TICK_COUNTER_HANDLE, tick_counter);
@@ -464,7 +475,7 @@ TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
 	checkProtocolGatewayIsNull = false;
 	howManyDoWorkCalls = 0;
 	doWorkCallCount = 0;
-
+	currentLLSendStatus = IOTHUB_CLIENT_SEND_STATUS_IDLE;
 }
 
 TEST_FUNCTION_CLEANUP(TestMethodCleanup)
@@ -1349,5 +1360,146 @@ TEST_FUNCTION(IoTHubTransport_worker_thread_runs_lock_fails)
 	IoTHubTransport_Destroy(transportHandle);
 }
 
+//Tests_SRS_IOTHUBTRANSPORT_02_004: [ If transportHlHandle is NULL, IoTHubTransport_SetMaxIdleSleep shall return IOTHUB_CLIENT_INVALID_ARG. ]
+TEST_FUNCTION(IoTHubTransport_SetMaxIdleSleep_with_NULL_handle_fails)
+{
+	CIotHubTransportMocks mocks;
+	///arrange
+
+	///act
+	IOTHUB_CLIENT_RESULT result = IoTHubTransport_SetMaxIdleSleep(NULL, 100);
+
+	///assert
+	ASSERT_ARE_EQUAL(int, (int)IOTHUB_CLIENT_INVALID_ARG, (int)result);
+	mocks.AssertActualAndExpectedCalls();
+}
+
+//Tests_SRS_IOTHUBTRANSPORT_02_005: [ IoTHubTransport_SetMaxIdleSleep shall set the maximum time the worker thread sleeps when no work is pending and return IOTHUB_CLIENT_OK. Values less than 1 shall be treated as 1. ]
+//Tests_SRS_IOTHUBTRANSPORT_02_001: [ IoTHubTransport_StartWorkerThread shall mark that work is pending. ]
+//Tests_SRS_IOTHUBTRANSPORT_02_002: [ If any client has called IoTHubTransport_StartWorkerThread since the last lower layer DoWork then the thread shall sleep 1 ms. ]
+//Tests_SRS_IOTHUBTRANSPORT_02_003: [ Otherwise the thread shall double the previous sleep time without exceeding the value set by IoTHubTransport_SetMaxIdleSleep. ]
+TEST_FUNCTION(IoTHubTransport_worker_thread_backs_off_when_idle)
+{
+	CIotHubTransportMocks mocks;
+	///arrange
+
+	auto transportHandle = IoTHubTransport_Create(TEST_CONFIG.protocol, TEST_CONFIG.iotHubName, TEST_CONFIG.iotHubSuffix);
+	IOTHUB_CLIENT_RESULT setResult = IoTHubTransport_SetMaxIdleSleep(transportHandle, 3);
+	IOTHUB_CLIENT_RESULT result = IoTHubTransport_StartWorkerThread(transportHandle, TEST_IOTHUB_CLIENT_HANDLE1);
+	mocks.ResetAllCalls();
+
+	howManyDoWorkCalls = 4;
+	STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, FAKE_IoTHubTransport_DoWork((TRANSPORT_LL_HANDLE)(0x42), NULL));
+	STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(1)); /*work was pending*/
+
+	STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, FAKE_IoTHubTransport_DoWork((TRANSPORT_LL_HANDLE)(0x42), NULL));
+	STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_GetLLHandle(TEST_IOTHUB_CLIENT_HANDLE1));
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_GetSendStatus(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG))
+		.IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(2));
+
+	STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, FAKE_IoTHubTransport_DoWork((TRANSPORT_LL_HANDLE)(0x42), NULL));
+	STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_GetLLHandle(TEST_IOTHUB_CLIENT_HANDLE1));
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_GetSendStatus(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG))
+		.IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(3)); /*capped*/
+
+	STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, FAKE_IoTHubTransport_DoWork((TRANSPORT_LL_HANDLE)(0x42), NULL));
+	STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_GetLLHandle(TEST_IOTHUB_CLIENT_HANDLE1));
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_GetSendStatus(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG))
+		.IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(3));
+
+	STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+	///act
+	threadFunc(threadFuncArg);
+
+	///assert
+	ASSERT_ARE_EQUAL(int, (int)IOTHUB_CLIENT_OK, (int)setResult);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubTransport_SignalEndWorkerThread(transportHandle, TEST_IOTHUB_CLIENT_HANDLE1);
+	IoTHubTransport_Destroy(transportHandle);
+}
+
+//Tests_SRS_IOTHUBTRANSPORT_02_006: [ If IoTHubClient_LL_GetSendStatus fails or reports IOTHUB_CLIENT_SEND_STATUS_BUSY for any client then the thread shall sleep 1 ms. ]
+TEST_FUNCTION(IoTHubTransport_worker_thread_does_not_back_off_while_a_client_is_busy)
+{
+	CIotHubTransportMocks mocks;
+	///arrange
+
+	auto transportHandle = IoTHubTransport_Create(TEST_CONFIG.protocol, TEST_CONFIG.iotHubName, TEST_CONFIG.iotHubSuffix);
+	(void)IoTHubTransport_SetMaxIdleSleep(transportHandle, 3);
+	(void)IoTHubTransport_StartWorkerThread(transportHandle, TEST_IOTHUB_CLIENT_HANDLE1);
+	mocks.ResetAllCalls();
+	currentLLSendStatus = IOTHUB_CLIENT_SEND_STATUS_BUSY;
+
+	howManyDoWorkCalls = 3;
+	STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, FAKE_IoTHubTransport_DoWork((TRANSPORT_LL_HANDLE)(0x42), NULL));
+	STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(1)); /*work was pending*/
+
+	STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, FAKE_IoTHubTransport_DoWork((TRANSPORT_LL_HANDLE)(0x42), NULL));
+	STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_GetLLHandle(TEST_IOTHUB_CLIENT_HANDLE1));
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_GetSendStatus(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG))
+		.IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(1)); /*the client has messages in flight*/
+
+	STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, FAKE_IoTHubTransport_DoWork((TRANSPORT_LL_HANDLE)(0x42), NULL));
+	STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_GetLLHandle(TEST_IOTHUB_CLIENT_HANDLE1));
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_GetSendStatus(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG))
+		.IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(1));
+
+	STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+
+	///act
+	threadFunc(threadFuncArg);
+
+	///assert
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubTransport_SignalEndWorkerThread(transportHandle, TEST_IOTHUB_CLIENT_HANDLE1);
+	IoTHubTransport_Destroy(transportHandle);
+}
+
 END_TEST_SUITE(iothubtransport_unittests)
 
@@ -129,9 +129,20 @@ std::ostream& operator<<(std::ostream& left, const BINARY_DATA bindata)
     return left << "struct BINARY_DATA = ([length=" << bindata.length << " bytes] " << bindata.bytes << ")";
 }
 
+static bool operator==(amqp_binary left, amqp_binary right)
+{
+    return (left.length == right.length) && (memcmp(left.bytes, right.bytes, left.length) == 0);
+}
+
+std::ostream& operator<<(std::ostream& left, const amqp_binary bindata)
+{
+    return left << "struct amqp_binary = ([length=" << bindata.length << " bytes] " << bindata.bytes << ")";
+}
+
 
 // Control parameters
 #define TEST_DEVICE_ID "deviceid"
+#define TEST_DEVICE_ID_2 "deviceid2"
 #define TEST_DEVICE_KEY "devicekey"
 #define TEST_DEVICE_SAS "deviceSas"
 #define TEST_IOT_HUB_NAME "servername"
@@ -155,6 +166,7 @@ std::ostream& operator<<(std::ostream& left, const BINARY_DATA bindata)
 #define TEST_STRING_COPY_FAILURE_RESULT 1
 
 #define TEST_IOTHUB_CLIENT_LL_HANDLE (IOTHUB_CLIENT_LL_HANDLE)0x49
+#define TEST_IOTHUB_CLIENT_LL_HANDLE_2 (IOTHUB_CLIENT_LL_HANDLE)0x4A
 #define TEST_TLS_IO_INTERFACE_DESC (IO_INTERFACE_DESCRIPTION*)0x77
 #define TEST_TLS_IO_INTERFACE (XIO_HANDLE)0x81
 #define TEST_SASL_MECHANISM (SASL_MECHANISM_HANDLE)0x90
@@ -177,6 +189,10 @@ std::ostream& operator<<(std::ostream& left, const BINARY_DATA bindata)
 #define TEST_BINARY_BUFFER (const unsigned char*)0x210
 #define TEST_BINARY_BUFFER_SIZE 56
 #define TEST_EVENT_MESSAGE_HANDLE (MESSAGE_HANDLE)0x220
+#define TEST_EVENT_BODY_AMQP_VALUE (AMQP_VALUE)0x222
+#define TEST_ENCODED_AMQP_VALUE_SIZE 40
+#define TEST_IOTHUB_BATCHING_MESSAGE_FORMAT 0x80013700
+#define TEST_MAXIMUM_BATCH_MESSAGE_SIZE (256 * 1024)
 #define TEST_OPTION_SASTOKEN_LIFETIME "sas_token_lifetime"
 #define TEST_OPTION_SASTOKEN_REFRESH_TIME "sas_token_refresh_time"
 #define TEST_OPTION_CBS_REQUEST_TIMEOUT "cbs_request_timeout"
@@ -213,6 +229,10 @@ static void* test_latest_cbs_put_token_context;
 static int test_number_of_event_confirmation_callbacks_invoked;
 static int test_sum_of_event_confirmation_callback_contexts;
 static BINARY_DATA test_binary_data;
+static unsigned char test_encoded_amqp_value[TEST_MAXIMUM_BATCH_MESSAGE_SIZE];
+static size_t test_encoded_amqp_value_size = TEST_ENCODED_AMQP_VALUE_SIZE;
+static ON_MESSAGE_SEND_COMPLETE saved_messagesender_send_callback;
+static void* saved_messagesender_send_context;
 static MESSAGE_BODY_TYPE test_message_get_body_type = MESSAGE_BODY_TYPE_DATA;
 
 static bool fail_malloc = false;
@@ -281,6 +301,20 @@ public:
     MOCK_STATIC_METHOD_3(, int, amqpvalue_set_map_value, AMQP_VALUE, map, AMQP_VALUE, key, AMQP_VALUE, value)
     MOCK_METHOD_END(int, 0)
 
+    MOCK_STATIC_METHOD_1(, AMQP_VALUE, amqpvalue_create_application_properties, AMQP_VALUE, value)
+    MOCK_METHOD_END(AMQP_VALUE, NULL)
+
+    MOCK_STATIC_METHOD_1(, AMQP_VALUE, amqpvalue_create_data, amqp_binary, value)
+    MOCK_METHOD_END(AMQP_VALUE, NULL)
+
+    MOCK_STATIC_METHOD_2(, int, amqpvalue_get_encoded_size, AMQP_VALUE, value, size_t*, encoded_size)
+        *encoded_size = test_encoded_amqp_value_size;
+    MOCK_METHOD_END(int, 0)
+
+    MOCK_STATIC_METHOD_3(, int, amqpvalue_encode, AMQP_VALUE, value, AMQPVALUE_ENCODER_OUTPUT, encoder_output, void*, context)
+        (void)encoder_output(context, test_encoded_amqp_value, test_encoded_amqp_value_size);
+    MOCK_METHOD_END(int, 0)
+
     /* Map mocks */
     MOCK_STATIC_METHOD_4(, MAP_RESULT, Map_GetInternals, MAP_HANDLE, handle, const char*const**, keys, const char*const**, values, size_t*, count);
     MOCK_METHOD_END(MAP_RESULT, MAP_OK)
@@ -640,6 +674,9 @@ public:
     MOCK_STATIC_METHOD_2(, int, message_add_body_amqp_data, MESSAGE_HANDLE, message, BINARY_DATA, binary_data)
     MOCK_METHOD_END(int, 0)
 
+    MOCK_STATIC_METHOD_2(, int, message_set_message_format, MESSAGE_HANDLE, message, uint32_t, message_format)
+    MOCK_METHOD_END(int, 0)
+
     MOCK_STATIC_METHOD_1(, void, message_destroy, MESSAGE_HANDLE, message)
     MOCK_VOID_METHOD_END()
 
@@ -681,6 +718,8 @@ public:
     MOCK_METHOD_END(int, 0)
 
     MOCK_STATIC_METHOD_4(, int, messagesender_send, MESSAGE_SENDER_HANDLE, message_sender, MESSAGE_HANDLE, message, ON_MESSAGE_SEND_COMPLETE, on_message_send_complete, void*, callback_context)
+        saved_messagesender_send_callback = on_message_send_complete;
+        saved_messagesender_send_context = callback_context;
     MOCK_METHOD_END(int, 0)
 
     // messaging.h
@@ -895,6 +934,10 @@ DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubTransportAMQPMocks, , void, properties_destr
 // amqpvalue.h
 DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubTransportAMQPMocks, , void, amqpvalue_destroy, AMQP_VALUE, value);
 DECLARE_GLOBAL_MOCK_METHOD_0(CIoTHubTransportAMQPMocks, , AMQP_VALUE, amqpvalue_create_map);
+DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubTransportAMQPMocks, , AMQP_VALUE, amqpvalue_create_application_properties, AMQP_VALUE, value);
+DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubTransportAMQPMocks, , AMQP_VALUE, amqpvalue_create_data, amqp_binary, value);
+DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubTransportAMQPMocks, , int, amqpvalue_get_encoded_size, AMQP_VALUE, value, size_t*, encoded_size);
+DECLARE_GLOBAL_MOCK_METHOD_3(CIoTHubTransportAMQPMocks, , int, amqpvalue_encode, AMQP_VALUE, value, AMQPVALUE_ENCODER_OUTPUT, encoder_output, void*, context);
 DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubTransportAMQPMocks, , AMQP_VALUE, amqpvalue_create_symbol, const char*, value);
 DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubTransportAMQPMocks, , AMQP_VALUE, amqpvalue_create_string, const char*, value);
 DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubTransportAMQPMocks, , int, amqpvalue_get_string, AMQP_VALUE, value, const char**, string_value);
@@ -926,6 +969,7 @@ DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubTransportAMQPMocks, , int, link_set_attach_p
 
 // message.h
 DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubTransportAMQPMocks, , int, message_add_body_amqp_data, MESSAGE_HANDLE, message, BINARY_DATA, binary_data);
+DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubTransportAMQPMocks, , int, message_set_message_format, MESSAGE_HANDLE, message, uint32_t, message_format);
 DECLARE_GLOBAL_MOCK_METHOD_0(CIoTHubTransportAMQPMocks, , MESSAGE_HANDLE, message_create);
 DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubTransportAMQPMocks, , void, message_destroy, MESSAGE_HANDLE, message);
 DECLARE_GLOBAL_MOCK_METHOD_3(CIoTHubTransportAMQPMocks, , int, message_get_body_amqp_data, MESSAGE_HANDLE, message, size_t, index, BINARY_DATA*, binary_data);
@@ -994,11 +1038,16 @@ DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubTransportAMQPMocks, , void, test_iothubclien
 
 #define STEP_CREATE_LIST_INIT 0
 #define STEP_CREATE_IOTHUB_FQDN 1
-#define STEP_CREATE_DEVICES_PATH 2
-#define STEP_CREATE_TARGET_ADDRESS 3
-#define STEP_CREATE_RECEIVE_ADDRESS 4
-#define STEP_CREATE_SASTOKEN_KEYNAME 5
-#define STEP_CREATE_DEVICEKEY 6
+#define STEP_CREATE_SASTOKEN_KEYNAME 2
+
+#define STEP_REGISTER_DEVICE_STATE 0
+#define STEP_REGISTER_DEVICES_PATH 1
+#define STEP_REGISTER_TARGET_ADDRESS 2
+#define STEP_REGISTER_RECEIVE_ADDRESS 3
+#define STEP_REGISTER_SENDER_LINK_NAME 4
+#define STEP_REGISTER_RECEIVER_LINK_NAME 5
+#define STEP_REGISTER_DEVICEKEY 6
+#define STEP_REGISTER_ADD_DEVICE 7
 
 #define STEP_DOWORK_GET_TLS_IO 0
 #define STEP_DOWORK_CREATE_SASLMECHANISM 1
@@ -1065,6 +1114,7 @@ static void setExpectedCallsForTransportCreateUpTo(CIoTHubTransportAMQPMocks& mo
         {
             STRICT_EXPECTED_CALL(mocks, gballoc_malloc(0)).IgnoreArgument(1);
             STRICT_EXPECTED_CALL(mocks, DList_InitializeListHead(0)).IgnoreAllArguments();
+            STRICT_EXPECTED_CALL(mocks, DList_InitializeListHead(0)).IgnoreAllArguments();
         }
         else if (step == STEP_CREATE_IOTHUB_FQDN)
         {
@@ -1072,36 +1122,10 @@ static void setExpectedCallsForTransportCreateUpTo(CIoTHubTransportAMQPMocks& mo
             EXPECTED_CALL(mocks, STRING_construct(0));
             EXPECTED_CALL(mocks, gballoc_free(0));
         }
-        else if (step == STEP_CREATE_DEVICES_PATH)
-        {
-            EXPECTED_CALL(mocks, STRING_c_str(0));
-            EXPECTED_CALL(mocks, gballoc_malloc(0));
-            EXPECTED_CALL(mocks, STRING_construct(0));
-            EXPECTED_CALL(mocks, gballoc_free(0));
-        }
-        else if (step == STEP_CREATE_TARGET_ADDRESS)
-        {
-            EXPECTED_CALL(mocks, STRING_c_str(0));
-            EXPECTED_CALL(mocks, gballoc_malloc(0));
-            EXPECTED_CALL(mocks, STRING_construct(0));
-            EXPECTED_CALL(mocks, gballoc_free(0));
-        }
-        else if (step == STEP_CREATE_RECEIVE_ADDRESS)
-        {
-            EXPECTED_CALL(mocks, STRING_c_str(0));
-            EXPECTED_CALL(mocks, gballoc_malloc(0));
-            EXPECTED_CALL(mocks, STRING_construct(0));
-            EXPECTED_CALL(mocks, gballoc_free(0));
-        }
         else if (step == STEP_CREATE_SASTOKEN_KEYNAME)
         {
             STRICT_EXPECTED_CALL(mocks, STRING_new());
         }
-        else if (step == STEP_CREATE_DEVICEKEY)
-        {
-            STRICT_EXPECTED_CALL(mocks, STRING_new());
-            STRICT_EXPECTED_CALL(mocks, STRING_copy(0, config->upperConfig->deviceKey)).IgnoreArgument(1);
-        }
     }
 }
 
@@ -1118,29 +1142,79 @@ static void setExpectedCleanupCallsForTransportCreateUpTo(CIoTHubTransportAMQPMo
         {
             EXPECTED_CALL(mocks, STRING_delete(0));
         }
-        else if (step == STEP_CREATE_DEVICES_PATH)
+        else if (step == STEP_CREATE_SASTOKEN_KEYNAME)
         {
             EXPECTED_CALL(mocks, STRING_delete(0));
         }
-        else if (step == STEP_CREATE_TARGET_ADDRESS)
+    }
+}
+
+static void setExpectedCallsForRegisterUpTo(CIoTHubTransportAMQPMocks& mocks, IOTHUB_DEVICE_CONFIG* device, int maximumStepToSet)
+{
+    int step;
+    for (step = 0; step <= maximumStepToSet; step++)
+    {
+        if (step == STEP_REGISTER_DEVICE_STATE)
         {
-            EXPECTED_CALL(mocks, STRING_delete(0));
+            STRICT_EXPECTED_CALL(mocks, gballoc_malloc(0)).IgnoreArgument(1);
+            STRICT_EXPECTED_CALL(mocks, DList_InitializeListHead(0)).IgnoreAllArguments();
         }
-        else if (step == STEP_CREATE_RECEIVE_ADDRESS)
+        else if (step == STEP_REGISTER_DEVICES_PATH ||
+            step == STEP_REGISTER_TARGET_ADDRESS ||
+            step == STEP_REGISTER_RECEIVE_ADDRESS)
         {
-            EXPECTED_CALL(mocks, STRING_delete(0));
+            EXPECTED_CALL(mocks, STRING_c_str(0));
+            EXPECTED_CALL(mocks, gballoc_malloc(0));
+            EXPECTED_CALL(mocks, STRING_construct(0));
+            EXPECTED_CALL(mocks, gballoc_free(0));
         }
-        else if (step == STEP_CREATE_SASTOKEN_KEYNAME)
+        else if (step == STEP_REGISTER_SENDER_LINK_NAME ||
+            step == STEP_REGISTER_RECEIVER_LINK_NAME)
         {
-            EXPECTED_CALL(mocks, STRING_delete(0));
+            EXPECTED_CALL(mocks, gballoc_malloc(0));
+            EXPECTED_CALL(mocks, STRING_construct(0));
+            EXPECTED_CALL(mocks, gballoc_free(0));
+        }
+        else if (step == STEP_REGISTER_DEVICEKEY)
+        {
+            STRICT_EXPECTED_CALL(mocks, STRING_construct(device->deviceKey != NULL ? device->deviceKey : device->deviceSasToken));
+        }
+        else if (step == STEP_REGISTER_ADD_DEVICE)
+        {
+            EXPECTED_CALL(mocks, DList_InsertTailList(0, 0));
         }
-        else if (step == STEP_CREATE_DEVICEKEY)
+    }
+}
+
+static void setExpectedCleanupCallsForRegisterUpTo(CIoTHubTransportAMQPMocks& mocks, int maximumStepToCleanup)
+{
+    int step;
+    for (step = maximumStepToCleanup; step >= 0; step--)
+    {
+        if (step == STEP_REGISTER_DEVICE_STATE)
+        {
+            EXPECTED_CALL(mocks, gballoc_free(0));
+        }
+        else if (step >= STEP_REGISTER_DEVICES_PATH && step <= STEP_REGISTER_DEVICEKEY)
         {
             EXPECTED_CALL(mocks, STRING_delete(0));
         }
     }
 }
 
+static IOTHUB_DEVICE_HANDLE registerTestDevice(TRANSPORT_LL_HANDLE transport, IOTHUBTRANSPORT_CONFIG* config)
+{
+    IOTHUB_DEVICE_CONFIG device;
+    device.deviceId = config->upperConfig->deviceId;
+    device.deviceKey = config->upperConfig->deviceKey;
+    device.deviceSasToken = config->upperConfig->deviceSasToken;
+
+    IOTHUB_DEVICE_HANDLE result = ((TRANSPORT_PROVIDER*)AMQP_Protocol())->IoTHubTransport_Register(transport, &device, TEST_IOTHUB_CLIENT_LL_HANDLE, config->waitingToSend);
+    ASSERT_IS_NOT_NULL(result);
+
+    return result;
+}
+
 static void setExpectedCallsForSASTokenExpiryCheck(CIoTHubTransportAMQPMocks& mocks, IOTHUBTRANSPORT_CONFIG* config, time_t current_time)
 {
     STRICT_EXPECTED_CALL(mocks, get_time(NULL)).SetReturn(current_time);
@@ -1258,6 +1332,48 @@ static void setExpectedCallsForSendPendingEvents(CIoTHubTransportAMQPMocks& mock
     EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(1);
 }
 
+static void setExpectedCallsForEncodeEventForBatch(CIoTHubTransportAMQPMocks& mocks)
+{
+    EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE)).SetReturn(IOTHUBMESSAGE_STRING);
+    EXPECTED_CALL(mocks, IoTHubMessage_GetString(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE))
+        .SetReturn(TEST_IOTHUB_MESSAGE_PROPERTIES_MAP);
+    STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_IOTHUB_MESSAGE_PROPERTIES_MAP, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .CopyOutArgumentBuffer(2, &no_property_keys_ptr, sizeof(no_property_keys_ptr))
+        .CopyOutArgumentBuffer(3, &no_property_values_ptr, sizeof(no_property_values_ptr))
+        .CopyOutArgumentBuffer(4, &no_property_size, sizeof(no_property_size));
+    amqp_binary event_body = { TEST_RANDOM_CHAR_SEQ, TEST_RANDOM_CHAR_SEQ_SIZE };
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_data(event_body)).SetReturn(TEST_EVENT_BODY_AMQP_VALUE);
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_get_encoded_size(TEST_EVENT_BODY_AMQP_VALUE, IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, gballoc_malloc(0));
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_encode(TEST_EVENT_BODY_AMQP_VALUE, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_EVENT_BODY_AMQP_VALUE));
+}
+
+static void setExpectedCallsForSendPendingEventsBatch(CIoTHubTransportAMQPMocks& mocks, int numberOfEvents)
+{
+    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(0);
+    EXPECTED_CALL(mocks, gballoc_malloc(0));
+    EXPECTED_CALL(mocks, message_create()).SetReturn(TEST_EVENT_MESSAGE_HANDLE);
+    STRICT_EXPECTED_CALL(mocks, message_set_message_format(TEST_EVENT_MESSAGE_HANDLE, TEST_IOTHUB_BATCHING_MESSAGE_FORMAT));
+
+    while (numberOfEvents-- > 0)
+    {
+        EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(0);
+        setExpectedCallsForEncodeEventForBatch(mocks);
+        EXPECTED_CALL(mocks, message_add_body_amqp_data(TEST_EVENT_MESSAGE_HANDLE, test_binary_data)).IgnoreArgument(2);
+        EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
+        EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
+    }
+
+    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(1);
+    STRICT_EXPECTED_CALL(mocks, messagesender_send(TEST_MESSAGE_SENDER, TEST_EVENT_MESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(3).IgnoreArgument(4);
+    STRICT_EXPECTED_CALL(mocks, message_destroy(TEST_EVENT_MESSAGE_HANDLE));
+    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(1);
+}
+
 static void setExpectedCallsForConnectionDoWork(CIoTHubTransportAMQPMocks& mocks, IOTHUBTRANSPORT_CONFIG* config)
 {
     EXPECTED_CALL(mocks, connection_dowork(NULL));
@@ -1285,10 +1401,6 @@ static void setExpectedCallsForTransportDestroy(CIoTHubTransportAMQPMocks& mocks
         EXPECTED_CALL(mocks, xio_destroy(0));
     }
 
-    EXPECTED_CALL(mocks, STRING_delete(0));
-    EXPECTED_CALL(mocks, STRING_delete(0));
-    EXPECTED_CALL(mocks, STRING_delete(0));
-    EXPECTED_CALL(mocks, STRING_delete(0));
     EXPECTED_CALL(mocks, STRING_delete(0));
     EXPECTED_CALL(mocks, STRING_delete(0));
 
@@ -1465,6 +1577,9 @@ static void resetTestSuiteState()
     saved_on_message_received_context = NULL;
     saved_message_get_body_amqp_data_binary_data = NULL;
     test_amqpvalue_get_string_index = 0;
+    test_encoded_amqp_value_size = TEST_ENCODED_AMQP_VALUE_SIZE;
+    saved_messagesender_send_callback = NULL;
+    saved_messagesender_send_context = NULL;
 }
 
 static time_t addSecondsToTime(time_t reference_time, size_t seconds_to_add)
@@ -1561,104 +1676,32 @@ TEST_FUNCTION(AMQP_Create_with_config_null_field1_fails)
     ASSERT_IS_NULL(transportHandle);
 }
 
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_006: [IoTHubTransportAMQP_Create shall fail and return NULL if any fields of the config structure are NULL.]
-TEST_FUNCTION(AMQP_Create_with_config_null_field2_fails)
-{
-    // arrange
-    IOTHUBTRANSPORT_CONFIG config;
-    TRANSPORT_PROVIDER* transport_interface;
-    IOTHUB_CLIENT_CONFIG client_config;
-
-    config.waitingToSend = NULL;
-    config.upperConfig = &client_config;
-    transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
-
-    // act
-    TRANSPORT_LL_HANDLE transportHandle = transport_interface->IoTHubTransport_Create(&config);
-
-    // assert
-    ASSERT_IS_NULL(transportHandle);
-}
-
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_007: [IoTHubTransportAMQP_Create shall fail and return NULL if the deviceId length is greater than 128.]
-TEST_FUNCTION(AMQP_Create_with_config_deviceId_too_long_fails)
-{
-    // arrange
-    DLIST_ENTRY wts;
-    TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
-
-    IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
-        "012345678901234567890123456789012345678901234567890123456789012345678901234567890123456789012345678901234567890123456789012345678",
-        TEST_DEVICE_KEY, TEST_DEVICE_SAS, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
-
-    IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
-    
-    // act
-    TRANSPORT_LL_HANDLE transportHandle = transport_interface->IoTHubTransport_Create(&config);
-
-    // assert
-    ASSERT_IS_NULL(transportHandle);
-}
-
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_008: [IoTHubTransportAMQP_Create shall fail and return NULL if any config field of type string is zero length.] 
-TEST_FUNCTION(AMQP_Create_with_config_deviceId_NULL_fails)
+// Tests_SRS_IOTHUBTRANSPORTAMQP_02_003: [IoTHubTransportAMQP_Create shall not use config->upperConfig->deviceId, deviceKey, deviceSasToken nor config->waitingToSend; devices are added to the transport by IoTHubTransportAMQP_Register.]
+TEST_FUNCTION(AMQP_Create_without_device_configuration_succeeds)
 {
     // arrange
-    DLIST_ENTRY wts;
-    TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
-
-    IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
-        NULL, TEST_DEVICE_KEY, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
-
-    IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
-
-    // act
-    TRANSPORT_LL_HANDLE transportHandle = transport_interface->IoTHubTransport_Create(&config);
-
-    // assert
-    ASSERT_IS_NULL(transportHandle);
-}
+    CIoTHubTransportAMQPMocks mocks;
 
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_008: [IoTHubTransportAMQP_Create shall fail and return NULL if any config field of type string is zero length.] 
-TEST_FUNCTION(AMQP_Create_with_config_deviceKey_and_deviceSasToken_NULL_fails)
-{
-    // arrange
-    DLIST_ENTRY wts;
     TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
 
     IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
-        TEST_DEVICE_ID, NULL, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
+        NULL, NULL, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
+    IOTHUBTRANSPORT_CONFIG config = { &client_config, NULL };
 
-    IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+    mocks.ResetAllCalls();
+    setExpectedCallsForTransportCreateUpTo(mocks, &config, STEP_CREATE_SASTOKEN_KEYNAME);
 
     // act
-    TRANSPORT_LL_HANDLE transportHandle = transport_interface->IoTHubTransport_Create(&config);
+    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
 
     // assert
-    ASSERT_IS_NULL(transportHandle);
-}
-
-// Tests_SRS_IOTHUBTRANSPORTAMQP_03_001: [IoTHubTransportAMQP_Create shall fail and return NULL if both deviceKey & deviceSasToken fields are NOT NULL.]
-TEST_FUNCTION(AMQP_Create_with_config_deviceKey_and_deviceSasToken_defined_fails)
-{
-    // arrange
-    DLIST_ENTRY wts;
-    TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
-
-    IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
-        TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_DEVICE_SAS, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
-
-    IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
-
-    // act
-    TRANSPORT_LL_HANDLE transportHandle = transport_interface->IoTHubTransport_Create(&config);
+    ASSERT_IS_NOT_NULL(transport);
+    mocks.AssertActualAndExpectedCalls();
 
-    // assert
-    ASSERT_IS_NULL(transportHandle);
+    // cleanup
+    transport_interface->IoTHubTransport_Destroy(transport);
 }
 
-
-
 // Tests_SRS_IOTHUBTRANSPORTAMQP_09_008: [IoTHubTransportAMQP_Create shall fail and return NULL if any config field of type string is zero length.] 
 TEST_FUNCTION(AMQP_Create_with_config_hubName_NULL_fails)
 {
@@ -1746,11 +1789,7 @@ TEST_FUNCTION(AMQP_Create_transport_state_allocation_fails)
 }
 
 // Tests_SRS_IOTHUBTRANSPORTAMQP_09_010: [IoTHubTransportAMQP_Create shall create an immutable string, referred to as iotHubHostFqdn, from the following pieces : config->iotHubName + "." + config->iotHubSuffix.]
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_012: [IoTHubTransportAMQP_Create shall create an immutable string, referred to as devicesPath, from the following parts : host_fqdn + " / devices / " + deviceId.]
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_014: [IoTHubTransportAMQP_Create shall create an immutable string, referred to as targetAddress, from the following parts: "amqps://" + devicesPath + "/messages/events".]
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_053: [IoTHubTransportAMQP_Create shall define the source address for receiving messages as "amqps://" + devicesPath + "/messages/devicebound", stored in the transport handle as messageReceiveAddress]
 // Tests_SRS_IOTHUBTRANSPORTAMQP_09_016: [IoTHubTransportAMQP_Create shall initialize handle->sasTokenKeyName with a zero-length STRING_HANDLE instance.] 
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_018: [IoTHubTransportAMQP_Create shall store a copy of config->deviceKey (passed by upper layer) into the transports own deviceKey field.] 
 // Tests_SRS_IOTHUBTRANSPORTAMQP_09_023: [If IoTHubTransportAMQP_Create succeeds it shall return a non-NULL pointer to the structure that represents the transport.] 
 TEST_FUNCTION(AMQP_Create_succeeds)
 {
@@ -1766,7 +1805,7 @@ TEST_FUNCTION(AMQP_Create_succeeds)
     IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
 
     mocks.ResetAllCalls();
-    setExpectedCallsForTransportCreateUpTo(mocks, &config, STEP_CREATE_DEVICEKEY);
+    setExpectedCallsForTransportCreateUpTo(mocks, &config, STEP_CREATE_SASTOKEN_KEYNAME);
 
     // act
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
@@ -1779,8 +1818,8 @@ TEST_FUNCTION(AMQP_Create_succeeds)
     transport_interface->IoTHubTransport_Destroy(transport);
 }
 
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_013: [If creating devicesPath fails for any reason then IoTHubTransportAMQP_Create shall fail and return NULL.] 
-TEST_FUNCTION(AMQP_Create_devicesPath_malloc_fails)
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_017: [If IoTHubTransportAMQP_Create fails to initialize handle->sasTokenKeyName with a zero-length STRING the function shall fail and return NULL.] 
+TEST_FUNCTION(AMQP_Create_sasTokenKeyName_allocation_fails)
 {
     // arrange
     CIoTHubTransportAMQPMocks mocks;
@@ -1793,12 +1832,9 @@ TEST_FUNCTION(AMQP_Create_devicesPath_malloc_fails)
         TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
     IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
 
-    const char* devicesPath = TEST_IOT_HUB_NAME "." TEST_IOT_HUB_SUFFIX "/devices/" TEST_DEVICE_ID;
-
     mocks.ResetAllCalls();
     setExpectedCallsForTransportCreateUpTo(mocks, &config, STEP_CREATE_IOTHUB_FQDN);
-    EXPECTED_CALL(mocks, STRING_c_str(0));
-    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(strlen(devicesPath) + 1)).SetFailReturn((char*)NULL);
+    STRICT_EXPECTED_CALL(mocks, STRING_new()).SetFailReturn(TEST_NULL_STRING_HANDLE);
     setExpectedCleanupCallsForTransportCreateUpTo(mocks, &config, STEP_CREATE_IOTHUB_FQDN);
 
     // act
@@ -1809,8 +1845,18 @@ TEST_FUNCTION(AMQP_Create_devicesPath_malloc_fails)
     mocks.AssertActualAndExpectedCalls();
 }
 
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_013: [If creating devicesPath fails for any reason then IoTHubTransportAMQP_Create shall fail and return NULL.] 
-TEST_FUNCTION(AMQP_Create_devicesPath_STRING_construct_fails)
+// Tests_SRS_IOTHUBTRANSPORTUAMQP_09_024: [IoTHubTransportAMQP_Destroy shall destroy the AMQP message_sender.]
+// Tests_SRS_IOTHUBTRANSPORTUAMQP_09_025: [IoTHubTransportAMQP_Destroy shall destroy the AMQP message_receiver.]
+// Tests_SRS_IOTHUBTRANSPORTUAMQP_09_027: [IoTHubTransportAMQP_Destroy shall destroy the AMQP cbs instance]
+// Tests_SRS_IOTHUBTRANSPORTUAMQP_09_029: [IoTHubTransportAMQP_Destroy shall destroy the AMQP link.]
+// Tests_SRS_IOTHUBTRANSPORTUAMQP_09_030: [IoTHubTransportAMQP_Destroy shall destroy the AMQP session.]
+// Tests_SRS_IOTHUBTRANSPORTUAMQP_09_031: [IoTHubTransportAMQP_Destroy shall destroy the AMQP connection.]
+// Tests_SRS_IOTHUBTRANSPORTUAMQP_09_032: [IoTHubTransportAMQP_Destroy shall destroy the AMQP SASL I / O transport.]
+// Tests_SRS_IOTHUBTRANSPORTUAMQP_09_033: [IoTHubTransportAMQP_Destroy shall destroy the AMQP SASL mechanism.]
+// Tests_SRS_IOTHUBTRANSPORTUAMQP_09_034: [IoTHubTransportAMQP_Destroy shall destroy the AMQP TLS I/O transport.] 
+// Tests_SRS_IOTHUBTRANSPORTUAMQP_09_035: [IoTHubTransportAMQP_Destroy shall delete its internally - set parameters(deviceKey, targetAddress, devicesPath, sasTokenKeyName).]
+// Tests_SRS_IOTHUBTRANSPORTUAMQP_09_036: [IoTHubTransportAMQP_Destroy shall return the remaining items in inProgress to waitingToSend list.] 
+TEST_FUNCTION(AMQP_Destroy_succeeds_no_DoWork)
 {
     // arrange
     CIoTHubTransportAMQPMocks mocks;
@@ -1823,26 +1869,22 @@ TEST_FUNCTION(AMQP_Create_devicesPath_STRING_construct_fails)
         TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
     IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
 
-    const char* devicesPath = TEST_IOT_HUB_NAME "." TEST_IOT_HUB_SUFFIX "/devices/" TEST_DEVICE_ID;
+    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+
+    ASSERT_IS_NOT_NULL(transport);
 
     mocks.ResetAllCalls();
-    setExpectedCallsForTransportCreateUpTo(mocks, &config, STEP_CREATE_IOTHUB_FQDN);
-    EXPECTED_CALL(mocks, STRING_c_str(0));
-    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(strlen(devicesPath) + 1));
-    STRICT_EXPECTED_CALL(mocks, STRING_construct(devicesPath)).SetFailReturn(TEST_NULL_STRING_HANDLE);
-    EXPECTED_CALL(mocks, gballoc_free(0));
-    setExpectedCleanupCallsForTransportCreateUpTo(mocks, &config, STEP_CREATE_IOTHUB_FQDN);
-    
+    setExpectedCallsForTransportDestroy(mocks, &config, false, false, 0);
+
     // act
-    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    transport_interface->IoTHubTransport_Destroy(transport);
 
     // assert
-    ASSERT_IS_NULL(transport);
     mocks.AssertActualAndExpectedCalls();
 }
 
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_015: [If creating the targetAddress fails for any reason then IoTHubTransportAMQP_Create shall fail and return NULL.]
-TEST_FUNCTION(AMQP_Create_targetAddress_malloc_fails)
+// Tests_SRS_IOTHUBTRANSPORTAMQP_02_015: [IoTHubTransportAMQP_Destroy shall destroy the links and the internal state of every device still registered in the transport.]
+TEST_FUNCTION(AMQP_Destroy_destroys_registered_devices)
 {
     // arrange
     CIoTHubTransportAMQPMocks mocks;
@@ -1850,29 +1892,26 @@ TEST_FUNCTION(AMQP_Create_targetAddress_malloc_fails)
     DLIST_ENTRY wts;
     BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
     TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
-
     IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
         TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
     IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
 
-    const char* targetAddress = "amqps://" TEST_IOT_HUB_NAME "." TEST_IOT_HUB_SUFFIX "/devices/" TEST_DEVICE_ID "/messages/events";
+    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    registerTestDevice(transport, &config);
 
     mocks.ResetAllCalls();
-    setExpectedCallsForTransportCreateUpTo(mocks, &config, STEP_CREATE_DEVICES_PATH);
-    EXPECTED_CALL(mocks, STRING_c_str(0));
-    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(strlen(targetAddress) + 1)).SetFailReturn((char*)NULL);
-    setExpectedCleanupCallsForTransportCreateUpTo(mocks, &config, STEP_CREATE_DEVICES_PATH);
+    setExpectedCleanupCallsForRegisterUpTo(mocks, STEP_REGISTER_DEVICEKEY);
+    setExpectedCallsForTransportDestroy(mocks, &config, false, false, 0);
 
     // act
-    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    transport_interface->IoTHubTransport_Destroy(transport);
 
     // assert
-    ASSERT_IS_NULL(transport);
     mocks.AssertActualAndExpectedCalls();
 }
 
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_015: [If creating the targetAddress fails for any reason then IoTHubTransportAMQP_Create shall fail and return NULL.] 
-TEST_FUNCTION(AMQP_Create_targetAddress_STRING_construct_fails)
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_051: [IoTHubTransportAMQP_DoWork shall fail and return immediately if the transport handle parameter is NULL] 
+TEST_FUNCTION(AMQP_DoWork_transport_handle_NULL_fails)
 {
     // arrange
     CIoTHubTransportAMQPMocks mocks;
@@ -1885,26 +1924,17 @@ TEST_FUNCTION(AMQP_Create_targetAddress_STRING_construct_fails)
         TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
     IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
 
-    const char* targetAddress = "amqps://" TEST_IOT_HUB_NAME "." TEST_IOT_HUB_SUFFIX "/devices/" TEST_DEVICE_ID "/messages/events";
-
     mocks.ResetAllCalls();
-    setExpectedCallsForTransportCreateUpTo(mocks, &config, STEP_CREATE_DEVICES_PATH);
-    EXPECTED_CALL(mocks, STRING_c_str(0));
-    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(strlen(targetAddress) + 1));
-    STRICT_EXPECTED_CALL(mocks, STRING_construct(targetAddress)).SetFailReturn(TEST_NULL_STRING_HANDLE);
-    EXPECTED_CALL(mocks, gballoc_free(0));
-    setExpectedCleanupCallsForTransportCreateUpTo(mocks, &config, STEP_CREATE_DEVICES_PATH);
 
     // act
-    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    transport_interface->IoTHubTransport_DoWork(NULL, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
     // assert
-    ASSERT_IS_NULL(transport);
-    mocks.AssertActualAndExpectedCalls();
+    mocks.AssertActualAndExpectedCalls(); // Nothing is expected.
 }
 
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_054: [If creating the messageReceiveAddress fails for any reason then IoTHubTransportAMQP_Create shall fail and return NULL.]
-TEST_FUNCTION(AMQP_Create_receiveAddress_malloc_fails)
+// Tests_SRS_IOTHUBTRANSPORTAMQP_02_011: [If no device is registered in the transport, IoTHubTransportAMQP_DoWork shall return without establishing the connection.]
+TEST_FUNCTION(AMQP_DoWork_no_registered_device_does_nothing)
 {
     // arrange
     CIoTHubTransportAMQPMocks mocks;
@@ -1917,24 +1947,22 @@ TEST_FUNCTION(AMQP_Create_receiveAddress_malloc_fails)
         TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
     IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
 
-    const char* receiveAddress = "amqps://"  TEST_IOT_HUB_NAME "." TEST_IOT_HUB_SUFFIX "/devices/" TEST_DEVICE_ID "/messages/devicebound";
+    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
 
     mocks.ResetAllCalls();
-    setExpectedCallsForTransportCreateUpTo(mocks, &config, STEP_CREATE_TARGET_ADDRESS);
-    EXPECTED_CALL(mocks, STRING_c_str(0));
-    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(strlen(receiveAddress) + 1)).SetFailReturn((char*)NULL);
-    setExpectedCleanupCallsForTransportCreateUpTo(mocks, &config, STEP_CREATE_TARGET_ADDRESS);
 
     // act
-    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
     // assert
-    ASSERT_IS_NULL(transport);
-    mocks.AssertActualAndExpectedCalls();
+    mocks.AssertActualAndExpectedCalls(); // Nothing is expected.
+
+    // cleanup
+    transport_interface->IoTHubTransport_Destroy(transport);
 }
 
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_054: [If creating the messageReceiveAddress fails for any reason then IoTHubTransportAMQP_Create shall fail and return NULL.]
-TEST_FUNCTION(AMQP_Create_receiveAddress_STRING_construct_fails)
+// Tests_SRS_IOTHUBTRANSPORTAMQP_02_014: [IoTHubTransportAMQP_DoWork shall ignore iotHubClientHandle (which is NULL when the transport is shared) and use the client handle each device passed to IoTHubTransportAMQP_Register.]
+TEST_FUNCTION(AMQP_DoWork_client_handle_NULL_authenticates_registered_device)
 {
     // arrange
     CIoTHubTransportAMQPMocks mocks;
@@ -1946,195 +1974,28 @@ TEST_FUNCTION(AMQP_Create_receiveAddress_STRING_construct_fails)
     IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
         TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
     IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+    time_t current_time = time(NULL);
 
-    const char* receiveAddress = "amqps://"  TEST_IOT_HUB_NAME "." TEST_IOT_HUB_SUFFIX "/devices/" TEST_DEVICE_ID "/messages/devicebound";
-
-    mocks.ResetAllCalls();
-    setExpectedCallsForTransportCreateUpTo(mocks, &config, STEP_CREATE_TARGET_ADDRESS);
-    EXPECTED_CALL(mocks, STRING_c_str(0));
-    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(strlen(receiveAddress) + 1));
-    STRICT_EXPECTED_CALL(mocks, STRING_construct(receiveAddress)).SetFailReturn(TEST_NULL_STRING_HANDLE);
-    EXPECTED_CALL(mocks, gballoc_free(0));
-    setExpectedCleanupCallsForTransportCreateUpTo(mocks, &config, STEP_CREATE_TARGET_ADDRESS);
-
-    // act
-    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
-
-    // assert
-    ASSERT_IS_NULL(transport);
-    mocks.AssertActualAndExpectedCalls();
-}
-
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_017: [If IoTHubTransportAMQP_Create fails to initialize handle->sasTokenKeyName with a zero-length STRING the function shall fail and return NULL.] 
-TEST_FUNCTION(AMQP_Create_sasTokenKeyName_allocation_fails)
-{
-    // arrange
-    CIoTHubTransportAMQPMocks mocks;
-
-    DLIST_ENTRY wts;
-    BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
-    TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
-
-    IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
-        TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
-    IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
-
-    mocks.ResetAllCalls();
-    setExpectedCallsForTransportCreateUpTo(mocks, &config, STEP_CREATE_RECEIVE_ADDRESS);
-    STRICT_EXPECTED_CALL(mocks, STRING_new()).SetFailReturn(TEST_NULL_STRING_HANDLE);
-    setExpectedCleanupCallsForTransportCreateUpTo(mocks, &config, STEP_CREATE_RECEIVE_ADDRESS);
-
-    // act
-    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
-
-    // assert
-    ASSERT_IS_NULL(transport);
-    mocks.AssertActualAndExpectedCalls();
-}
-
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_135: [If creating the config->deviceKey fails for any reason then IoTHubTransportAMQP_Create shall fail and return NULL.]
-TEST_FUNCTION(AMQP_Create_deviceKey_allocation_fails)
-{
-    // arrange
-    CIoTHubTransportAMQPMocks mocks;
-
-    DLIST_ENTRY wts;
-    BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
-    TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
-
-    IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
-        TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
-    IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
-
-    mocks.ResetAllCalls();
-    setExpectedCallsForTransportCreateUpTo(mocks, &config, STEP_CREATE_SASTOKEN_KEYNAME);
-    STRICT_EXPECTED_CALL(mocks, STRING_new()).SetFailReturn(TEST_NULL_STRING_HANDLE);
-    setExpectedCleanupCallsForTransportCreateUpTo(mocks, &config, STEP_CREATE_SASTOKEN_KEYNAME);
-
-    // act
-    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
-
-    // assert
-    ASSERT_IS_NULL(transport);
-    mocks.AssertActualAndExpectedCalls();
-}
-
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_019: [If IoTHubTransportAMQP_Create fails to copy config->deviceKey, the function shall fail and return NULL.] 
-TEST_FUNCTION(AMQP_Create_deviceKey_copy_fails)
-{
-    // arrange
-    CIoTHubTransportAMQPMocks mocks;
-
-    DLIST_ENTRY wts;
-    BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
-    TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
-
-    IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
-        TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
-    IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
-
-    mocks.ResetAllCalls();
-    setExpectedCallsForTransportCreateUpTo(mocks, &config, STEP_CREATE_SASTOKEN_KEYNAME);
-    STRICT_EXPECTED_CALL(mocks, STRING_new());
-    STRICT_EXPECTED_CALL(mocks, STRING_copy(0, config.upperConfig->deviceKey)).IgnoreArgument(1).SetReturn(TEST_STRING_COPY_FAILURE_RESULT);
-    setExpectedCleanupCallsForTransportCreateUpTo(mocks, &config, STEP_CREATE_DEVICEKEY);
-
-    // act
-    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
-
-    // assert
-    ASSERT_IS_NULL(transport);
-    mocks.AssertActualAndExpectedCalls();
-}
-
-// Tests_SRS_IOTHUBTRANSPORTUAMQP_09_024: [IoTHubTransportAMQP_Destroy shall destroy the AMQP message_sender.]
-// Tests_SRS_IOTHUBTRANSPORTUAMQP_09_025: [IoTHubTransportAMQP_Destroy shall destroy the AMQP message_receiver.]
-// Tests_SRS_IOTHUBTRANSPORTUAMQP_09_027: [IoTHubTransportAMQP_Destroy shall destroy the AMQP cbs instance]
-// Tests_SRS_IOTHUBTRANSPORTUAMQP_09_029: [IoTHubTransportAMQP_Destroy shall destroy the AMQP link.]
-// Tests_SRS_IOTHUBTRANSPORTUAMQP_09_030: [IoTHubTransportAMQP_Destroy shall destroy the AMQP session.]
-// Tests_SRS_IOTHUBTRANSPORTUAMQP_09_031: [IoTHubTransportAMQP_Destroy shall destroy the AMQP connection.]
-// Tests_SRS_IOTHUBTRANSPORTUAMQP_09_032: [IoTHubTransportAMQP_Destroy shall destroy the AMQP SASL I / O transport.]
-// Tests_SRS_IOTHUBTRANSPORTUAMQP_09_033: [IoTHubTransportAMQP_Destroy shall destroy the AMQP SASL mechanism.]
-// Tests_SRS_IOTHUBTRANSPORTUAMQP_09_034: [IoTHubTransportAMQP_Destroy shall destroy the AMQP TLS I/O transport.] 
-// Tests_SRS_IOTHUBTRANSPORTUAMQP_09_035: [IoTHubTransportAMQP_Destroy shall delete its internally - set parameters(deviceKey, targetAddress, devicesPath, sasTokenKeyName).]
-// Tests_SRS_IOTHUBTRANSPORTUAMQP_09_036: [IoTHubTransportAMQP_Destroy shall return the remaining items in inProgress to waitingToSend list.] 
-TEST_FUNCTION(AMQP_Destroy_succeeds_no_DoWork)
-{
-    // arrange
-    CIoTHubTransportAMQPMocks mocks;
-
-    DLIST_ENTRY wts;
-    BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
-    TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
-
-    IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
-        TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
-    IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
-
-    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
-
-    ASSERT_IS_NOT_NULL(transport);
-
-    mocks.ResetAllCalls();
-    setExpectedCallsForTransportDestroy(mocks, &config, false, false, 0);
-
-    // act
-    transport_interface->IoTHubTransport_Destroy(transport);
-
-    // assert
-    mocks.AssertActualAndExpectedCalls();
-}
-
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_051: [IoTHubTransportAMQP_DoWork shall fail and return immediately if the transport handle parameter is NULL] 
-TEST_FUNCTION(AMQP_DoWork_transport_handle_NULL_fails)
-{
-    // arrange
-    CIoTHubTransportAMQPMocks mocks;
-
-    DLIST_ENTRY wts;
-    BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
-    TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
-
-    IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
-        TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
-    IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
-
-    mocks.ResetAllCalls();
-
-    // act
-    transport_interface->IoTHubTransport_DoWork(NULL, TEST_IOTHUB_CLIENT_LL_HANDLE);
-
-    // assert
-    mocks.AssertActualAndExpectedCalls(); // Nothing is expected.
-}
-
-// Tests_SRS_IOTHUBTRANSPORTAMQP_09_052: [IoTHubTransportAMQP_DoWork shall fail and return immediately if the client handle parameter is NULL] 
-TEST_FUNCTION(AMQP_DoWork_client_handle_NULL_fails)
-{
-    // arrange
-    CIoTHubTransportAMQPMocks mocks;
-
-    DLIST_ENTRY wts;
-    BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
-    TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
-
-    IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
-        TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
-    IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
-
-    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    registerTestDevice(transport, &config);
 
     mocks.ResetAllCalls();
+    setExpectedCallsForTransportDoWorkUpTo(mocks, &config, STEP_DOWORK_OPEN_CBS, DOWORK_MESSAGERECEIVER_NONE, current_time);
+    setExpectedCallsForCbsAuthentication(mocks, &config, current_time);
+    setExpectedCallsForCbsAuthTimeoutCheck(mocks, &config, current_time);
+    EXPECTED_CALL(mocks, connection_set_trace(IGNORED_PTR_ARG, false));
+    setExpectedCallsForConnectionDoWork(mocks, &config);
 
     // act
     transport_interface->IoTHubTransport_DoWork(transport, NULL);
 
     // assert
-    mocks.AssertActualAndExpectedCalls(); // Nothing is expected.
+    mocks.AssertActualAndExpectedCalls();
 
     // cleanup
     transport_interface->IoTHubTransport_Destroy(transport);
 }
+
 // Tests_SRS_IOTHUBTRANSPORTAMQP_09_056: [IoTHubTransportAMQP_DoWork shall create the SASL mechanism using AMQP's saslmechanism_create() API] 
 // Tests_SRS_IOTHUBTRANSPORTAMQP_09_057: [If saslmechanism_create() fails, IoTHubTransportAMQP_DoWork shall fail and return immediately]
 TEST_FUNCTION(AMQP_DoWork_saslmechanism_create_fails)
@@ -2151,6 +2012,7 @@ TEST_FUNCTION(AMQP_DoWork_saslmechanism_create_fails)
     IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
 
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    registerTestDevice(transport, &config);
 
     mocks.ResetAllCalls();
     setExpectedCallsForTransportDoWorkUpTo(mocks, &config, STEP_DOWORK_GET_TLS_IO, DOWORK_MESSAGERECEIVER_NONE, time(NULL));
@@ -2185,6 +2047,7 @@ TEST_FUNCTION(AMQP_DoWork_saslio_create_fails)
     IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
 
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    registerTestDevice(transport, &config);
 
     mocks.ResetAllCalls();
     setExpectedCallsForTransportDoWorkUpTo(mocks, &config, STEP_DOWORK_SASLIO_GET_INTERFACE, DOWORK_MESSAGERECEIVER_NONE, time(NULL));
@@ -2218,6 +2081,7 @@ TEST_FUNCTION(AMQP_DoWork_connection_create2_fails)
     IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
 
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    registerTestDevice(transport, &config);
 
     mocks.ResetAllCalls();
     setExpectedCallsForTransportDoWorkUpTo(mocks, &config, STEP_DOWORK_CREATE_SASLIO, DOWORK_MESSAGERECEIVER_NONE, time(NULL));
@@ -2252,6 +2116,7 @@ TEST_FUNCTION(AMQP_DoWork_session_create_fails)
     IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
 
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    registerTestDevice(transport, &config);
 
     mocks.ResetAllCalls();
     setExpectedCallsForTransportDoWorkUpTo(mocks, &config, STEP_DOWORK_CREATE_CONNECTION, DOWORK_MESSAGERECEIVER_NONE, time(NULL));
@@ -2288,6 +2153,7 @@ TEST_FUNCTION(AMQP_DoWork_cbs_create_fails)
     IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
 
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    registerTestDevice(transport, &config);
 
     mocks.ResetAllCalls();
     setExpectedCallsForTransportDoWorkUpTo(mocks, &config, STEP_DOWORK_OUTGOING_WINDOW, DOWORK_MESSAGERECEIVER_NONE, time(NULL));
@@ -2322,6 +2188,7 @@ TEST_FUNCTION(AMQP_DoWork_cbs_open_fails)
     IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
 
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    registerTestDevice(transport, &config);
 
     mocks.ResetAllCalls();
     setExpectedCallsForTransportDoWorkUpTo(mocks, &config, STEP_DOWORK_CREATE_CBS, DOWORK_MESSAGERECEIVER_NONE, time(NULL));
@@ -2354,6 +2221,7 @@ TEST_FUNCTION(AMQP_DoWork_SASToken_create_fails)
         TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
     IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    registerTestDevice(transport, &config);
     time_t current_time = time(NULL);
     size_t expected_expiry_time = (size_t)(difftime(current_time, 0) + TEST_SAS_TOKEN_LIFETIME_MS / 1000);
 
@@ -2390,6 +2258,7 @@ TEST_FUNCTION(AMQP_DoWork_cbs_put_token_fails)
         TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
     IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    registerTestDevice(transport, &config);
     time_t current_time = time(NULL);
 
     mocks.ResetAllCalls();
@@ -2416,7 +2285,8 @@ TEST_FUNCTION(AMQP_DoWork_cbs_put_token_fails)
 }
 
 // Tests_SRS_IOTHUBTRANSPORTAMQP_09_084: [IoTHubTransportAMQP_DoWork shall wait for 'cbs_request_timeout' milliseconds for the cbs_put_token() to complete before failing due to timeout] 
-TEST_FUNCTION(AMQP_DoWork_CBS_auth_timeout_fails)
+// Tests_SRS_IOTHUBTRANSPORTAMQP_02_013: [If the authentication of a device times out, IoTHubTransportAMQP_DoWork shall destroy the links of that device only, roll its in-progress events back to its waitingToSend list and authenticate it again on the next call, keeping the connection for the other registered devices.]
+TEST_FUNCTION(AMQP_DoWork_CBS_auth_timeout_keeps_the_connection)
 {
     // arrange
     CIoTHubTransportAMQPMocks mocks;
@@ -2428,6 +2298,7 @@ TEST_FUNCTION(AMQP_DoWork_CBS_auth_timeout_fails)
         TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
     IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    registerTestDevice(transport, &config);
     time_t current_time = time(NULL);
     time_t expiration_time = addSecondsToTime(current_time, TEST_CBS_REQUEST_TIMEOUT_MS + 1);
 
@@ -2435,9 +2306,9 @@ TEST_FUNCTION(AMQP_DoWork_CBS_auth_timeout_fails)
     setExpectedCallsForTransportDoWorkUpTo(mocks, &config, STEP_DOWORK_OPEN_CBS, DOWORK_MESSAGERECEIVER_NONE, current_time);
     setExpectedCallsForCbsAuthentication(mocks, &config, current_time);
     EXPECTED_CALL(mocks, get_time(NULL)).SetReturn(expiration_time);
-    setExpectedCallsForConnectionDestroyUpTo(mocks, &config, STEP_DOWORK_CREATE_CBS);
     setExpectedCallsForRollEventsBackToWaitList(mocks, &config);
     EXPECTED_CALL(mocks, connection_set_trace(IGNORED_PTR_ARG, false));
+    setExpectedCallsForConnectionDoWork(mocks, &config);
 
     // act
     transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
@@ -2463,6 +2334,7 @@ TEST_FUNCTION(AMQP_DoWork_messagesender_create_source_fails)
         TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
     IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    registerTestDevice(transport, &config);
     time_t current_time = time(NULL);
     time_t expiration_time = addSecondsToTime(current_time, TEST_CBS_REQUEST_TIMEOUT_MS + 1);
 
@@ -2503,6 +2375,7 @@ TEST_FUNCTION(AMQP_DoWork_messagesender_create_target_fails)
         TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
     IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    registerTestDevice(transport, &config);
     time_t current_time = time(NULL);
     time_t expiration_time = addSecondsToTime(current_time, TEST_CBS_REQUEST_TIMEOUT_MS + 1);
 
@@ -2546,6 +2419,7 @@ TEST_FUNCTION(AMQP_DoWork_messagesender_create_link_fails)
         TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
     IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    registerTestDevice(transport, &config);
     time_t current_time = time(NULL);
     time_t expiration_time = addSecondsToTime(current_time, TEST_CBS_REQUEST_TIMEOUT_MS + 1);
 
@@ -2592,6 +2466,7 @@ TEST_FUNCTION(AMQP_DoWork_messagesender_create_fails)
         TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
     IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    registerTestDevice(transport, &config);
     time_t current_time = time(NULL);
     time_t expiration_time = addSecondsToTime(current_time, TEST_CBS_REQUEST_TIMEOUT_MS + 1);
 
@@ -2647,6 +2522,7 @@ TEST_FUNCTION(AMQP_DoWork_messagesender_open_fails)
         TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
     IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    registerTestDevice(transport, &config);
     time_t current_time = time(NULL);
     time_t expiration_time = addSecondsToTime(current_time, TEST_CBS_REQUEST_TIMEOUT_MS + 1);
 
@@ -2707,7 +2583,8 @@ TEST_FUNCTION(AMQP_DoWork_messagereceiver_source_create_fails)
     time_t current_time = time(NULL);
 
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
-    int subscribe_result = transport_interface->IoTHubTransport_Subscribe(transport);
+    IOTHUB_DEVICE_HANDLE device_handle = registerTestDevice(transport, &config);
+    int subscribe_result = transport_interface->IoTHubTransport_Subscribe(device_handle);
     ASSERT_ARE_EQUAL(int, subscribe_result, 0);
 
     mocks.ResetAllCalls();
@@ -2751,7 +2628,8 @@ TEST_FUNCTION(AMQP_DoWork_messagereceiver_target_create_fails)
     time_t current_time = time(NULL);
 
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
-    int subscribe_result = transport_interface->IoTHubTransport_Subscribe(transport);
+    IOTHUB_DEVICE_HANDLE device_handle = registerTestDevice(transport, &config);
+    int subscribe_result = transport_interface->IoTHubTransport_Subscribe(device_handle);
     ASSERT_ARE_EQUAL(int, subscribe_result, 0);
 
     mocks.ResetAllCalls();
@@ -2797,7 +2675,8 @@ TEST_FUNCTION(AMQP_DoWork_messagereceiver_link_create_fails)
     time_t current_time = time(NULL);
 
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
-    int subscribe_result = transport_interface->IoTHubTransport_Subscribe(transport);
+    IOTHUB_DEVICE_HANDLE device_handle = registerTestDevice(transport, &config);
+    int subscribe_result = transport_interface->IoTHubTransport_Subscribe(device_handle);
     ASSERT_ARE_EQUAL(int, subscribe_result, 0);
 
     mocks.ResetAllCalls();
@@ -2845,7 +2724,8 @@ TEST_FUNCTION(AMQP_DoWork_messagereceiver_settle_mode_fails)
     time_t current_time = time(NULL);
 
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
-    int subscribe_result = transport_interface->IoTHubTransport_Subscribe(transport);
+    IOTHUB_DEVICE_HANDLE device_handle = registerTestDevice(transport, &config);
+    int subscribe_result = transport_interface->IoTHubTransport_Subscribe(device_handle);
     ASSERT_ARE_EQUAL(int, subscribe_result, 0);
 
     mocks.ResetAllCalls();
@@ -2895,7 +2775,8 @@ TEST_FUNCTION(AMQP_DoWork_messagereceiver_create_fails)
     time_t current_time = time(NULL);
 
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
-    int subscribe_result = transport_interface->IoTHubTransport_Subscribe(transport);
+    IOTHUB_DEVICE_HANDLE device_handle = registerTestDevice(transport, &config);
+    int subscribe_result = transport_interface->IoTHubTransport_Subscribe(device_handle);
     ASSERT_ARE_EQUAL(int, subscribe_result, 0);
 
     mocks.ResetAllCalls();
@@ -2954,7 +2835,8 @@ TEST_FUNCTION(AMQP_DoWork_messagereceiver_open_fails)
     time_t current_time = time(NULL);
 
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
-    int subscribe_result = transport_interface->IoTHubTransport_Subscribe(transport);
+    IOTHUB_DEVICE_HANDLE device_handle = registerTestDevice(transport, &config);
+    int subscribe_result = transport_interface->IoTHubTransport_Subscribe(device_handle);
     ASSERT_ARE_EQUAL(int, subscribe_result, 0);
 
     mocks.ResetAllCalls();
@@ -3017,7 +2899,8 @@ TEST_FUNCTION(AMQP_DoWork_expired_SASToken_fails)
     time_t expiration_time = addSecondsToTime(current_time, (TEST_SAS_TOKEN_LIFETIME_MS / 2) / 1000 + 1);
 
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
-    int subscribe_result = transport_interface->IoTHubTransport_Subscribe(transport);
+    IOTHUB_DEVICE_HANDLE device_handle = registerTestDevice(transport, &config);
+    int subscribe_result = transport_interface->IoTHubTransport_Subscribe(device_handle);
     ASSERT_ARE_EQUAL(int, subscribe_result, 0);
 
     mocks.ResetAllCalls();
@@ -3061,6 +2944,7 @@ TEST_FUNCTION(AMQP_DoWork_succeeds_when_2_waiting_to_send_messages_are_in_the_li
     time_t current_time = time(NULL);
     
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    registerTestDevice(transport, &config);
 
     addTestEvents(config.waitingToSend, 2, true);
 
@@ -3106,6 +2990,7 @@ TEST_FUNCTION(AMQP_DoWork_send_one_message_succeeds)
     time_t current_time = time(NULL);
 
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    registerTestDevice(transport, &config);
 
     setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
 
@@ -3182,12 +3067,13 @@ TEST_FUNCTION(AMQP_DoWork_receive_message_read_properties_succeeds)
     resetTestSuiteState();
 
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    IOTHUB_DEVICE_HANDLE device_handle = registerTestDevice(transport, &config);
 
     mocks.ResetAllCalls();
     setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
     setupSuccessfulDoWork(transport, mocks, config, current_time, MESSAGERECEIVER_CREATE);
 
-    subscribe_result = transport_interface->IoTHubTransport_Subscribe(transport);
+    subscribe_result = transport_interface->IoTHubTransport_Subscribe(device_handle);
     transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
     mocks.ResetAllCalls();
@@ -3268,12 +3154,13 @@ TEST_FUNCTION(AMQP_DoWork_receive_message_app_properties_IoTHubMessage_Propertie
     resetTestSuiteState();
 
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    IOTHUB_DEVICE_HANDLE device_handle = registerTestDevice(transport, &config);
 
     mocks.ResetAllCalls();
     setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
     setupSuccessfulDoWork(transport, mocks, config, current_time, MESSAGERECEIVER_CREATE);
 
-    subscribe_result = transport_interface->IoTHubTransport_Subscribe(transport);
+    subscribe_result = transport_interface->IoTHubTransport_Subscribe(device_handle);
     transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
     mocks.ResetAllCalls();
@@ -3326,12 +3213,13 @@ TEST_FUNCTION(AMQP_DoWork_receive_message_app_properties_message_get_application
     resetTestSuiteState();
 
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    IOTHUB_DEVICE_HANDLE device_handle = registerTestDevice(transport, &config);
 
     mocks.ResetAllCalls();
     setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
     setupSuccessfulDoWork(transport, mocks, config, current_time, MESSAGERECEIVER_CREATE);
 
-    subscribe_result = transport_interface->IoTHubTransport_Subscribe(transport);
+    subscribe_result = transport_interface->IoTHubTransport_Subscribe(device_handle);
     transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
     mocks.ResetAllCalls();
@@ -3385,12 +3273,13 @@ TEST_FUNCTION(AMQP_DoWork_receive_message_app_properties_amqpvalue_get_inplace_d
     resetTestSuiteState();
 
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    IOTHUB_DEVICE_HANDLE device_handle = registerTestDevice(transport, &config);
 
     mocks.ResetAllCalls();
     setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
     setupSuccessfulDoWork(transport, mocks, config, current_time, MESSAGERECEIVER_CREATE);
 
-    subscribe_result = transport_interface->IoTHubTransport_Subscribe(transport);
+    subscribe_result = transport_interface->IoTHubTransport_Subscribe(device_handle);
     transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
     mocks.ResetAllCalls();
@@ -3445,12 +3334,13 @@ TEST_FUNCTION(AMQP_DoWork_receive_message_app_properties_amqpvalue_get_map_pair_
     resetTestSuiteState();
 
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    IOTHUB_DEVICE_HANDLE device_handle = registerTestDevice(transport, &config);
 
     mocks.ResetAllCalls();
     setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
     setupSuccessfulDoWork(transport, mocks, config, current_time, MESSAGERECEIVER_CREATE);
 
-    subscribe_result = transport_interface->IoTHubTransport_Subscribe(transport);
+    subscribe_result = transport_interface->IoTHubTransport_Subscribe(device_handle);
     transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
     mocks.ResetAllCalls();
@@ -3505,12 +3395,13 @@ TEST_FUNCTION(AMQP_DoWork_receive_message_NO_app_properties_succeeds)
     resetTestSuiteState();
 
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    IOTHUB_DEVICE_HANDLE device_handle = registerTestDevice(transport, &config);
 
     mocks.ResetAllCalls();
     setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
     setupSuccessfulDoWork(transport, mocks, config, current_time, MESSAGERECEIVER_CREATE);
 
-    subscribe_result = transport_interface->IoTHubTransport_Subscribe(transport);
+    subscribe_result = transport_interface->IoTHubTransport_Subscribe(device_handle);
     transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
     mocks.ResetAllCalls();
@@ -3567,12 +3458,13 @@ TEST_FUNCTION(AMQP_DoWork_receive_message_EMPTY_app_properties_succeeds)
     resetTestSuiteState();
 
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    IOTHUB_DEVICE_HANDLE device_handle = registerTestDevice(transport, &config);
 
     mocks.ResetAllCalls();
     setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
     setupSuccessfulDoWork(transport, mocks, config, current_time, MESSAGERECEIVER_CREATE);
 
-    subscribe_result = transport_interface->IoTHubTransport_Subscribe(transport);
+    subscribe_result = transport_interface->IoTHubTransport_Subscribe(device_handle);
     transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
     mocks.ResetAllCalls();
@@ -3629,12 +3521,13 @@ TEST_FUNCTION(AMQP_DoWork_receive_message_app_properties_amqpvalue_get_map_key_v
     resetTestSuiteState();
 
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    IOTHUB_DEVICE_HANDLE device_handle = registerTestDevice(transport, &config);
 
     mocks.ResetAllCalls();
     setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
     setupSuccessfulDoWork(transport, mocks, config, current_time, MESSAGERECEIVER_CREATE);
 
-    subscribe_result = transport_interface->IoTHubTransport_Subscribe(transport);
+    subscribe_result = transport_interface->IoTHubTransport_Subscribe(device_handle);
     transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
     mocks.ResetAllCalls();
@@ -3693,12 +3586,13 @@ TEST_FUNCTION(AMQP_DoWork_receive_message_app_properties_amqpvalue_get_string_na
     resetTestSuiteState();
 
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    IOTHUB_DEVICE_HANDLE device_handle = registerTestDevice(transport, &config);
 
     mocks.ResetAllCalls();
     setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
     setupSuccessfulDoWork(transport, mocks, config, current_time, MESSAGERECEIVER_CREATE);
 
-    subscribe_result = transport_interface->IoTHubTransport_Subscribe(transport);
+    subscribe_result = transport_interface->IoTHubTransport_Subscribe(device_handle);
     transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
     mocks.ResetAllCalls();
@@ -3758,12 +3652,13 @@ TEST_FUNCTION(AMQP_DoWork_receive_message_app_properties_amqpvalue_get_string_va
     resetTestSuiteState();
 
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    IOTHUB_DEVICE_HANDLE device_handle = registerTestDevice(transport, &config);
 
     mocks.ResetAllCalls();
     setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
     setupSuccessfulDoWork(transport, mocks, config, current_time, MESSAGERECEIVER_CREATE);
 
-    subscribe_result = transport_interface->IoTHubTransport_Subscribe(transport);
+    subscribe_result = transport_interface->IoTHubTransport_Subscribe(device_handle);
     transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
     mocks.ResetAllCalls();
@@ -3824,12 +3719,13 @@ TEST_FUNCTION(AMQP_DoWork_receive_message_app_properties_Map_AddOrUpdate_fails)
     resetTestSuiteState();
 
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    IOTHUB_DEVICE_HANDLE device_handle = registerTestDevice(transport, &config);
 
     mocks.ResetAllCalls();
     setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
     setupSuccessfulDoWork(transport, mocks, config, current_time, MESSAGERECEIVER_CREATE);
 
-    subscribe_result = transport_interface->IoTHubTransport_Subscribe(transport);
+    subscribe_result = transport_interface->IoTHubTransport_Subscribe(device_handle);
     transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
     mocks.ResetAllCalls();
@@ -3887,6 +3783,7 @@ TEST_FUNCTION(AMQP_GetSendStatus_idle_succeeds)
     time_t current_time = time(NULL);
 
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    IOTHUB_DEVICE_HANDLE device_handle = registerTestDevice(transport, &config);
 
     IOTHUB_CLIENT_STATUS iotHubClientStatus;
 
@@ -3895,7 +3792,7 @@ TEST_FUNCTION(AMQP_GetSendStatus_idle_succeeds)
     EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(1);
 
     // act
-    IOTHUB_CLIENT_RESULT result = transport_interface->IoTHubTransport_GetSendStatus(transport, &iotHubClientStatus);
+    IOTHUB_CLIENT_RESULT result = transport_interface->IoTHubTransport_GetSendStatus(device_handle, &iotHubClientStatus);
 
     // assert
     mocks.AssertActualAndExpectedCalls();
@@ -3922,6 +3819,7 @@ TEST_FUNCTION(AMQP_GetSendStatus_inProgress_not_empty_succeeds)
     time_t current_time = time(NULL);
 
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    IOTHUB_DEVICE_HANDLE device_handle = registerTestDevice(transport, &config);
 
     IOTHUB_CLIENT_STATUS iotHubClientStatus;
 
@@ -3930,7 +3828,7 @@ TEST_FUNCTION(AMQP_GetSendStatus_inProgress_not_empty_succeeds)
     EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(0);
 
     // act
-    IOTHUB_CLIENT_RESULT result = transport_interface->IoTHubTransport_GetSendStatus(transport, &iotHubClientStatus);
+    IOTHUB_CLIENT_RESULT result = transport_interface->IoTHubTransport_GetSendStatus(device_handle, &iotHubClientStatus);
 
     // assert
     mocks.AssertActualAndExpectedCalls();
@@ -3957,6 +3855,7 @@ TEST_FUNCTION(AMQP_GetSendStatus_waitingToSend_not_empty_succeeds)
     time_t current_time = time(NULL);
 
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    IOTHUB_DEVICE_HANDLE device_handle = registerTestDevice(transport, &config);
 
     IOTHUB_CLIENT_STATUS iotHubClientStatus;
 
@@ -3964,7 +3863,7 @@ TEST_FUNCTION(AMQP_GetSendStatus_waitingToSend_not_empty_succeeds)
     EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(0);
 
     // act
-    IOTHUB_CLIENT_RESULT result = transport_interface->IoTHubTransport_GetSendStatus(transport, &iotHubClientStatus);
+    IOTHUB_CLIENT_RESULT result = transport_interface->IoTHubTransport_GetSendStatus(device_handle, &iotHubClientStatus);
 
     // assert
     mocks.AssertActualAndExpectedCalls();
@@ -4020,13 +3919,14 @@ TEST_FUNCTION(AMQP_Subscribe_and_messagereceiver_create_succeeds)
     resetTestSuiteState();
 
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    IOTHUB_DEVICE_HANDLE device_handle = registerTestDevice(transport, &config);
 
     mocks.ResetAllCalls();
     setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
     setupSuccessfulDoWork(transport, mocks, config, current_time, MESSAGERECEIVER_CREATE);
 
     // act
-    subscribe_result = transport_interface->IoTHubTransport_Subscribe(transport);
+    subscribe_result = transport_interface->IoTHubTransport_Subscribe(device_handle);
     transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
     // assert
@@ -4219,8 +4119,8 @@ TEST_FUNCTION(AMQP_SetOption_fails_when_xio_setoption_fails)
     transport_interface->IoTHubTransport_Destroy(transport);
 }
 
-/* Tests_SRS_IOTHUBTRANSPORTUAMQP_01_014: [If any of the APIs fails while building the property map and setting it on the uAMQP message, IoTHubTransportAMQP_DoWork shall notify the failure by invoking the upper layer message send callback with IOTHUB_CLIENT_CONFIRMATION_ERROR.] */
-TEST_FUNCTION(when_getting_the_properties_map_for_a_message_to_be_sent_fails_AMQP_DoWork_reports_the_error)
+// Tests_SRS_IOTHUBTRANSPORTAMQP_02_016: [IoTHubTransportAMQP_SetOption shall save the value if the option name is "Batching", returning IOTHUB_CLIENT_OK; when it is true the events of each device are sent as batch messages.]
+TEST_FUNCTION(AMQP_SetOption_Batching_succeeds)
 {
     // arrange
     CIoTHubTransportAMQPMocks mocks;
@@ -4231,54 +4131,26 @@ TEST_FUNCTION(when_getting_the_properties_map_for_a_message_to_be_sent_fails_AMQ
     IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
         TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
     IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
-    time_t current_time = time(NULL);
-
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    bool batching = true;
 
-    setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
-
-    addTestEvents(config.waitingToSend, 1, true);
     mocks.ResetAllCalls();
 
-    setExpectedCallsForSASTokenExpiryCheck(mocks, &config, current_time);
-    setExpectedCallsForConnectionDoWork(mocks, &config);
-
-    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(0);
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE)).SetReturn(IOTHUBMESSAGE_BYTEARRAY);
-
-    EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-    const unsigned char* binarydata_ptr = test_binary_data.bytes;
-    EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .CopyOutArgumentBuffer(2, &binarydata_ptr, sizeof(binarydata_ptr))
-        .CopyOutArgumentBuffer(3, &test_binary_data.length, sizeof(test_binary_data.length));
-    EXPECTED_CALL(mocks, message_create()).SetReturn(TEST_EVENT_MESSAGE_HANDLE);
-    STRICT_EXPECTED_CALL(mocks, message_add_body_amqp_data(TEST_EVENT_MESSAGE_HANDLE, test_binary_data));
-
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE))
-        .SetReturn((MAP_HANDLE)NULL);
-    STRICT_EXPECTED_CALL(mocks, message_destroy(TEST_EVENT_MESSAGE_HANDLE));
-    STRICT_EXPECTED_CALL(mocks, test_iothubclient_send_confirmation_callback(IOTHUB_CLIENT_CONFIRMATION_ERROR, (void*)0x00));
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(TEST_IOTHUB_MESSAGE_HANDLE));
-    EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(1);
-
     // act
-    transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
+    IOTHUB_CLIENT_RESULT result = transport_interface->IoTHubTransport_SetOption(transport, "Batching", &batching);
 
     // assert
     mocks.AssertActualAndExpectedCalls();
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_OK);
 
     // cleanup
     transport_interface->IoTHubTransport_Destroy(transport);
-    cleanupList(config.waitingToSend);
 }
 
-/* Tests_SRS_IOTHUBTRANSPORTUAMQP_01_014: [If any of the APIs fails while building the property map and setting it on the uAMQP message, IoTHubTransportAMQP_DoWork shall notify the failure by invoking the upper layer message send callback with IOTHUB_CLIENT_CONFIRMATION_ERROR.] */
-TEST_FUNCTION(when_getting_the_internals_for_the_properties_map_for_a_message_to_be_sent_fails_AMQP_DoWork_reports_the_error)
+// Tests_SRS_IOTHUBTRANSPORTAMQP_02_017: [If batching is on, IoTHubTransportAMQP_DoWork shall pack the pending events into an AMQP message created with message_create() and whose message format is set to 0x80013700 with message_set_message_format().]
+// Tests_SRS_IOTHUBTRANSPORTAMQP_02_018: [Each pending event shall be encoded as its application-properties and data sections and added as one data section of the batch message with message_add_body_amqp_data(), as long as the batch message stays within 256KB.]
+// Tests_SRS_IOTHUBTRANSPORTAMQP_02_022: [IoTHubTransportAMQP_DoWork shall send the batch message with messagesender_send(), passing a callback that settles all the events of the batch with a single disposition.]
+TEST_FUNCTION(AMQP_DoWork_with_batching_sends_2_events_in_one_batch_message)
 {
     // arrange
     CIoTHubTransportAMQPMocks mocks;
@@ -4290,63 +4162,35 @@ TEST_FUNCTION(when_getting_the_internals_for_the_properties_map_for_a_message_to
         TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
     IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
     time_t current_time = time(NULL);
+    bool batching = true;
 
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    registerTestDevice(transport, &config);
+    (void)transport_interface->IoTHubTransport_SetOption(transport, "Batching", &batching);
 
     setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
 
-    addTestEvents(config.waitingToSend, 1, true);
+    addTestEvents(config.waitingToSend, 2, true);
     mocks.ResetAllCalls();
 
     setExpectedCallsForSASTokenExpiryCheck(mocks, &config, current_time);
+    setExpectedCallsForSendPendingEventsBatch(mocks, 2);
     setExpectedCallsForConnectionDoWork(mocks, &config);
 
-    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(0);
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE)).SetReturn(IOTHUBMESSAGE_BYTEARRAY);
-
-    EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-    const unsigned char* binarydata_ptr = test_binary_data.bytes;
-    EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .CopyOutArgumentBuffer(2, &binarydata_ptr, sizeof(binarydata_ptr))
-        .CopyOutArgumentBuffer(3, &test_binary_data.length, sizeof(test_binary_data.length));
-    EXPECTED_CALL(mocks, message_create()).SetReturn(TEST_EVENT_MESSAGE_HANDLE);
-    STRICT_EXPECTED_CALL(mocks, message_add_body_amqp_data(TEST_EVENT_MESSAGE_HANDLE, test_binary_data));
-
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE))
-        .SetReturn(TEST_IOTHUB_MESSAGE_PROPERTIES_MAP);
-    STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_IOTHUB_MESSAGE_PROPERTIES_MAP, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .CopyOutArgumentBuffer(2, &no_property_keys_ptr, sizeof(no_property_keys_ptr))
-        .CopyOutArgumentBuffer(3, &no_property_values_ptr, sizeof(no_property_values_ptr))
-        .CopyOutArgumentBuffer(4, &no_property_size, sizeof(no_property_size))
-        .SetReturn(MAP_ERROR);
-    STRICT_EXPECTED_CALL(mocks, message_destroy(TEST_EVENT_MESSAGE_HANDLE));
-    STRICT_EXPECTED_CALL(mocks, test_iothubclient_send_confirmation_callback(IOTHUB_CLIENT_CONFIRMATION_ERROR, (void*)0x00));
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(TEST_IOTHUB_MESSAGE_HANDLE));
-    EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(1);
-
     // act
     transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
     // assert
     mocks.AssertActualAndExpectedCalls();
+    ASSERT_IS_NOT_NULL(saved_messagesender_send_callback);
 
     // cleanup
     transport_interface->IoTHubTransport_Destroy(transport);
     cleanupList(config.waitingToSend);
 }
 
-/* Tests_SRS_IOTHUBTRANSPORTUAMQP_01_008: [All properties shall be transferred to a uAMQP map.] */
-/* Tests_SRS_IOTHUBTRANSPORTUAMQP_01_009: [The uAMQP map shall be created by calling amqpvalue_create_map.] */
-/* Tests_SRS_IOTHUBTRANSPORTUAMQP_01_010: [A key uAMQP value shall be created by using amqpvalue_create_string.] */
-/* Tests_SRS_IOTHUBTRANSPORTUAMQP_01_011: [A value uAMQP value shall be created by using amqpvalue_create_string.] */
-/* Tests_SRS_IOTHUBTRANSPORTUAMQP_01_012: [The key/value pair for the property shall be set into the uAMQP property map by calling amqpvalue_map_set_value.] */
-/* Tests_SRS_IOTHUBTRANSPORTUAMQP_01_013: [After all properties have been filled in the uAMQP map, the uAMQP properties map shall be set on the uAMQP message by calling message_set_application_properties.] */
-TEST_FUNCTION(AMQP_DoWork_encodes_two_properties_on_an_IoTHub_Message_before_giving_it_to_uAMQP)
+// Tests_SRS_IOTHUBTRANSPORTAMQP_02_027: [IoTHubTransportAMQP_DoWork shall put in a batch message at most as many events as can fit in 256KB, sizing the batch to the pending events up to that number, and shall send the remaining events in the next batch messages.]
+TEST_FUNCTION(AMQP_DoWork_with_batching_sizes_the_batch_to_the_pending_events)
 {
     // arrange
     CIoTHubTransportAMQPMocks mocks;
@@ -4358,70 +4202,164 @@ TEST_FUNCTION(AMQP_DoWork_encodes_two_properties_on_an_IoTHub_Message_before_giv
         TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
     IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
     time_t current_time = time(NULL);
+    bool batching = true;
 
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    registerTestDevice(transport, &config);
+    (void)transport_interface->IoTHubTransport_SetOption(transport, "Batching", &batching);
 
     setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
 
-    addTestEvents(config.waitingToSend, 1, true);
+    addTestEvents(config.waitingToSend, 3, true);
     mocks.ResetAllCalls();
 
     setExpectedCallsForSASTokenExpiryCheck(mocks, &config, current_time);
+    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(0);
+    // The batch (its count and events pointer) followed by one pointer per pending event.
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(sizeof(size_t) + sizeof(void*) + 3 * sizeof(void*)));
+    EXPECTED_CALL(mocks, message_create()).SetReturn(TEST_EVENT_MESSAGE_HANDLE);
+    STRICT_EXPECTED_CALL(mocks, message_set_message_format(TEST_EVENT_MESSAGE_HANDLE, TEST_IOTHUB_BATCHING_MESSAGE_FORMAT));
+    for (int i = 0; i < 3; i++)
+    {
+        EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(0);
+        setExpectedCallsForEncodeEventForBatch(mocks);
+        EXPECTED_CALL(mocks, message_add_body_amqp_data(TEST_EVENT_MESSAGE_HANDLE, test_binary_data)).IgnoreArgument(2);
+        EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
+        EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
+    }
+    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(1);
+    STRICT_EXPECTED_CALL(mocks, messagesender_send(TEST_MESSAGE_SENDER, TEST_EVENT_MESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(3).IgnoreArgument(4);
+    STRICT_EXPECTED_CALL(mocks, message_destroy(TEST_EVENT_MESSAGE_HANDLE));
+    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(1);
     setExpectedCallsForConnectionDoWork(mocks, &config);
 
-    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(0);
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE)).SetReturn(IOTHUBMESSAGE_BYTEARRAY);
+    // act
+    transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
-    EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-    const unsigned char* binarydata_ptr = test_binary_data.bytes;
-    EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .CopyOutArgumentBuffer(2, &binarydata_ptr, sizeof(binarydata_ptr))
-        .CopyOutArgumentBuffer(3, &test_binary_data.length, sizeof(test_binary_data.length));
-    EXPECTED_CALL(mocks, message_create()).SetReturn(TEST_EVENT_MESSAGE_HANDLE);
-    STRICT_EXPECTED_CALL(mocks, message_add_body_amqp_data(TEST_EVENT_MESSAGE_HANDLE, test_binary_data));
+    // assert
+    mocks.AssertActualAndExpectedCalls();
 
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE))
-        .SetReturn(TEST_IOTHUB_MESSAGE_PROPERTIES_MAP);
-    STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_IOTHUB_MESSAGE_PROPERTIES_MAP, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .CopyOutArgumentBuffer(2, &two_property_keys_ptr, sizeof(two_property_keys_ptr))
-        .CopyOutArgumentBuffer(3, &two_property_values_ptr, sizeof(two_property_values_ptr))
-        .CopyOutArgumentBuffer(4, &two_properties_size, sizeof(two_properties_size));
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_map())
-        .SetReturn(TEST_UAMQP_MAP);
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_keys[0]))
-        .SetReturn(TEST_PROPERTY_1_KEY_UAMQP_VALUE);
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_values[0]))
-        .SetReturn(TEST_PROPERTY_1_VALUE_UAMQP_VALUE);
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_set_map_value(TEST_UAMQP_MAP, TEST_PROPERTY_1_KEY_UAMQP_VALUE, TEST_PROPERTY_1_VALUE_UAMQP_VALUE));
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_keys[1]))
-        .SetReturn(TEST_PROPERTY_2_KEY_UAMQP_VALUE);
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_values[1]))
-        .SetReturn(TEST_PROPERTY_2_VALUE_UAMQP_VALUE);
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_set_map_value(TEST_UAMQP_MAP, TEST_PROPERTY_2_KEY_UAMQP_VALUE, TEST_PROPERTY_2_VALUE_UAMQP_VALUE));
-    STRICT_EXPECTED_CALL(mocks, message_set_application_properties(TEST_EVENT_MESSAGE_HANDLE, TEST_UAMQP_MAP));
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_UAMQP_MAP));
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_PROPERTY_1_KEY_UAMQP_VALUE));
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_PROPERTY_1_VALUE_UAMQP_VALUE));
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_PROPERTY_2_KEY_UAMQP_VALUE));
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_PROPERTY_2_VALUE_UAMQP_VALUE));
-    EXPECTED_CALL(mocks, messagesender_send(NULL, TEST_EVENT_MESSAGE_HANDLE, NULL, NULL));
-    STRICT_EXPECTED_CALL(mocks, message_destroy(TEST_EVENT_MESSAGE_HANDLE));
+    // cleanup
+    transport_interface->IoTHubTransport_Destroy(transport);
+    cleanupList(config.waitingToSend);
+}
+
+// Tests_SRS_IOTHUBTRANSPORTAMQP_02_019: [When the batch message is settled, IoTHubTransportAMQP_DoWork shall complete every event packed in it, in order, as 'on_message_send_complete' does for a single event.]
+TEST_FUNCTION(AMQP_batch_send_complete_completes_all_events_of_the_batch)
+{
+    // arrange
+    CIoTHubTransportAMQPMocks mocks;
+
+    DLIST_ENTRY wts;
+    BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+    TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+    IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+        TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
+    IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+    time_t current_time = time(NULL);
+    bool batching = true;
+
+    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    registerTestDevice(transport, &config);
+    (void)transport_interface->IoTHubTransport_SetOption(transport, "Batching", &batching);
+
+    setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
+
+    addTestEvents(config.waitingToSend, 2, true);
+    transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, test_iothubclient_send_confirmation_callback(IOTHUB_CLIENT_CONFIRMATION_OK, (void*)0x01));
+    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(TEST_IOTHUB_MESSAGE_HANDLE));
+    EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(mocks, test_iothubclient_send_confirmation_callback(IOTHUB_CLIENT_CONFIRMATION_OK, (void*)0x00));
+    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(TEST_IOTHUB_MESSAGE_HANDLE));
+    EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
+
+    // act
+    saved_messagesender_send_callback(saved_messagesender_send_context, MESSAGE_SEND_OK);
+
+    // assert
+    mocks.AssertActualAndExpectedCalls();
+
+    // cleanup
+    transport_interface->IoTHubTransport_Destroy(transport);
+    cleanupList(config.waitingToSend);
+}
+
+// Tests_SRS_IOTHUBTRANSPORTAMQP_02_023: [If building or sending the batch message fails, IoTHubTransportAMQP_DoWork shall roll the events of the batch back to the waitingToSend list and return.]
+TEST_FUNCTION(AMQP_DoWork_with_batching_messagesender_send_fails_rolls_the_events_back)
+{
+    // arrange
+    CIoTHubTransportAMQPMocks mocks;
+
+    DLIST_ENTRY wts;
+    BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+    TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+    IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+        TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
+    IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+    time_t current_time = time(NULL);
+    bool batching = true;
+
+    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    registerTestDevice(transport, &config);
+    (void)transport_interface->IoTHubTransport_SetOption(transport, "Batching", &batching);
+
+    setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
+
+    addTestEvents(config.waitingToSend, 2, true);
+    mocks.ResetAllCalls();
+
+    setExpectedCallsForSASTokenExpiryCheck(mocks, &config, current_time);
+    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(0);
+    EXPECTED_CALL(mocks, gballoc_malloc(0));
+    EXPECTED_CALL(mocks, message_create()).SetReturn(TEST_EVENT_MESSAGE_HANDLE);
+    STRICT_EXPECTED_CALL(mocks, message_set_message_format(TEST_EVENT_MESSAGE_HANDLE, TEST_IOTHUB_BATCHING_MESSAGE_FORMAT));
+    for (int i = 0; i < 2; i++)
+    {
+        EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(0);
+        setExpectedCallsForEncodeEventForBatch(mocks);
+        EXPECTED_CALL(mocks, message_add_body_amqp_data(TEST_EVENT_MESSAGE_HANDLE, test_binary_data)).IgnoreArgument(2);
+        EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
+        EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
+    }
     EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(1);
+    EXPECTED_CALL(mocks, messagesender_send(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG)).SetReturn(1);
+    for (int i = 0; i < 2; i++)
+    {
+        EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
+        EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG));
+        EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    }
+    EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(mocks, message_destroy(TEST_EVENT_MESSAGE_HANDLE));
+    setExpectedCallsForConnectionDoWork(mocks, &config);
 
     // act
     transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
     // assert
     mocks.AssertActualAndExpectedCalls();
+    ASSERT_IS_FALSE(BASEIMPLEMENTATION::DList_IsListEmpty(config.waitingToSend));
 
     // cleanup
     transport_interface->IoTHubTransport_Destroy(transport);
     cleanupList(config.waitingToSend);
 }
 
-/* Tests_SRS_IOTHUBTRANSPORTUAMQP_01_014: [If any of the APIs fails while building the property map and setting it on the uAMQP message, IoTHubTransportAMQP_DoWork shall notify the failure by invoking the upper layer message send callback with IOTHUB_CLIENT_CONFIRMATION_ERROR.] */
-TEST_FUNCTION(when_creating_the_property_map_fails_AMQP_DoWork_completes_the_message_send_with_an_error)
+// Tests_SRS_IOTHUBTRANSPORTAMQP_02_021: [If an event alone exceeds 256KB, IoTHubTransportAMQP_DoWork shall complete it with IOTHUB_CLIENT_CONFIRMATION_ERROR.]
+TEST_FUNCTION(AMQP_DoWork_with_batching_event_larger_than_the_batch_limit_is_completed_with_error)
 {
     // arrange
     CIoTHubTransportAMQPMocks mocks;
@@ -4433,46 +4371,39 @@ TEST_FUNCTION(when_creating_the_property_map_fails_AMQP_DoWork_completes_the_mes
         TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
     IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
     time_t current_time = time(NULL);
+    bool batching = true;
 
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    registerTestDevice(transport, &config);
+    (void)transport_interface->IoTHubTransport_SetOption(transport, "Batching", &batching);
 
     setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
 
     addTestEvents(config.waitingToSend, 1, true);
+    test_encoded_amqp_value_size = TEST_MAXIMUM_BATCH_MESSAGE_SIZE;
     mocks.ResetAllCalls();
 
     setExpectedCallsForSASTokenExpiryCheck(mocks, &config, current_time);
-    setExpectedCallsForConnectionDoWork(mocks, &config);
-
     EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(0);
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE)).SetReturn(IOTHUBMESSAGE_BYTEARRAY);
-
+    EXPECTED_CALL(mocks, gballoc_malloc(0));
+    EXPECTED_CALL(mocks, message_create()).SetReturn(TEST_EVENT_MESSAGE_HANDLE);
+    STRICT_EXPECTED_CALL(mocks, message_set_message_format(TEST_EVENT_MESSAGE_HANDLE, TEST_IOTHUB_BATCHING_MESSAGE_FORMAT));
+    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(0);
+    setExpectedCallsForEncodeEventForBatch(mocks);
     EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
     EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-    const unsigned char* binarydata_ptr = test_binary_data.bytes;
-    EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .CopyOutArgumentBuffer(2, &binarydata_ptr, sizeof(binarydata_ptr))
-        .CopyOutArgumentBuffer(3, &test_binary_data.length, sizeof(test_binary_data.length));
-    EXPECTED_CALL(mocks, message_create()).SetReturn(TEST_EVENT_MESSAGE_HANDLE);
-    STRICT_EXPECTED_CALL(mocks, message_add_body_amqp_data(TEST_EVENT_MESSAGE_HANDLE, test_binary_data));
-
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE))
-        .SetReturn(TEST_IOTHUB_MESSAGE_PROPERTIES_MAP);
-    STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_IOTHUB_MESSAGE_PROPERTIES_MAP, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .CopyOutArgumentBuffer(2, &two_property_keys_ptr, sizeof(two_property_keys_ptr))
-        .CopyOutArgumentBuffer(3, &two_property_values_ptr, sizeof(two_property_values_ptr))
-        .CopyOutArgumentBuffer(4, &two_properties_size, sizeof(two_properties_size));
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_map())
-        .SetReturn((AMQP_VALUE)NULL);
-
-    STRICT_EXPECTED_CALL(mocks, message_destroy(TEST_EVENT_MESSAGE_HANDLE));
     STRICT_EXPECTED_CALL(mocks, test_iothubclient_send_confirmation_callback(IOTHUB_CLIENT_CONFIRMATION_ERROR, (void*)0x00));
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(TEST_IOTHUB_MESSAGE_HANDLE));
-    EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
     EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG));
     EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
     EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(TEST_IOTHUB_MESSAGE_HANDLE));
+    EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(1);
+    EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(mocks, message_destroy(TEST_EVENT_MESSAGE_HANDLE));
     EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(1);
+    setExpectedCallsForConnectionDoWork(mocks, &config);
 
     // act
     transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
@@ -4486,7 +4417,7 @@ TEST_FUNCTION(when_creating_the_property_map_fails_AMQP_DoWork_completes_the_mes
 }
 
 /* Tests_SRS_IOTHUBTRANSPORTUAMQP_01_014: [If any of the APIs fails while building the property map and setting it on the uAMQP message, IoTHubTransportAMQP_DoWork shall notify the failure by invoking the upper layer message send callback with IOTHUB_CLIENT_CONFIRMATION_ERROR.] */
-TEST_FUNCTION(when_creating_the_uAMQP_value_for_the_1st_property_key_fails_AMQP_DoWork_completes_the_message_send_with_an_error)
+TEST_FUNCTION(when_getting_the_properties_map_for_a_message_to_be_sent_fails_AMQP_DoWork_reports_the_error)
 {
     // arrange
     CIoTHubTransportAMQPMocks mocks;
@@ -4500,6 +4431,7 @@ TEST_FUNCTION(when_creating_the_uAMQP_value_for_the_1st_property_key_fails_AMQP_
     time_t current_time = time(NULL);
 
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    registerTestDevice(transport, &config);
 
     setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
 
@@ -4522,17 +4454,7 @@ TEST_FUNCTION(when_creating_the_uAMQP_value_for_the_1st_property_key_fails_AMQP_
     STRICT_EXPECTED_CALL(mocks, message_add_body_amqp_data(TEST_EVENT_MESSAGE_HANDLE, test_binary_data));
 
     STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE))
-        .SetReturn(TEST_IOTHUB_MESSAGE_PROPERTIES_MAP);
-    STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_IOTHUB_MESSAGE_PROPERTIES_MAP, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .CopyOutArgumentBuffer(2, &two_property_keys_ptr, sizeof(two_property_keys_ptr))
-        .CopyOutArgumentBuffer(3, &two_property_values_ptr, sizeof(two_property_values_ptr))
-        .CopyOutArgumentBuffer(4, &two_properties_size, sizeof(two_properties_size));
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_map())
-        .SetReturn(TEST_UAMQP_MAP);
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_keys[0]))
-        .SetReturn((AMQP_VALUE)NULL);
-
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_UAMQP_MAP));
+        .SetReturn((MAP_HANDLE)NULL);
     STRICT_EXPECTED_CALL(mocks, message_destroy(TEST_EVENT_MESSAGE_HANDLE));
     STRICT_EXPECTED_CALL(mocks, test_iothubclient_send_confirmation_callback(IOTHUB_CLIENT_CONFIRMATION_ERROR, (void*)0x00));
     STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(TEST_IOTHUB_MESSAGE_HANDLE));
@@ -4554,7 +4476,7 @@ TEST_FUNCTION(when_creating_the_uAMQP_value_for_the_1st_property_key_fails_AMQP_
 }
 
 /* Tests_SRS_IOTHUBTRANSPORTUAMQP_01_014: [If any of the APIs fails while building the property map and setting it on the uAMQP message, IoTHubTransportAMQP_DoWork shall notify the failure by invoking the upper layer message send callback with IOTHUB_CLIENT_CONFIRMATION_ERROR.] */
-TEST_FUNCTION(when_creating_the_uAMQP_value_for_the_1st_property_value_fails_AMQP_DoWork_completes_the_message_send_with_an_error)
+TEST_FUNCTION(when_getting_the_internals_for_the_properties_map_for_a_message_to_be_sent_fails_AMQP_DoWork_reports_the_error)
 {
     // arrange
     CIoTHubTransportAMQPMocks mocks;
@@ -4568,6 +4490,7 @@ TEST_FUNCTION(when_creating_the_uAMQP_value_for_the_1st_property_value_fails_AMQ
     time_t current_time = time(NULL);
 
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    registerTestDevice(transport, &config);
 
     setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
 
@@ -4592,18 +4515,10 @@ TEST_FUNCTION(when_creating_the_uAMQP_value_for_the_1st_property_value_fails_AMQ
     STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE))
         .SetReturn(TEST_IOTHUB_MESSAGE_PROPERTIES_MAP);
     STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_IOTHUB_MESSAGE_PROPERTIES_MAP, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .CopyOutArgumentBuffer(2, &two_property_keys_ptr, sizeof(two_property_keys_ptr))
-        .CopyOutArgumentBuffer(3, &two_property_values_ptr, sizeof(two_property_values_ptr))
-        .CopyOutArgumentBuffer(4, &two_properties_size, sizeof(two_properties_size));
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_map())
-        .SetReturn(TEST_UAMQP_MAP);
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_keys[0]))
-        .SetReturn(TEST_PROPERTY_1_KEY_UAMQP_VALUE);
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_values[0]))
-        .SetReturn((AMQP_VALUE)NULL);
-
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_PROPERTY_1_KEY_UAMQP_VALUE));
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_UAMQP_MAP));
+        .CopyOutArgumentBuffer(2, &no_property_keys_ptr, sizeof(no_property_keys_ptr))
+        .CopyOutArgumentBuffer(3, &no_property_values_ptr, sizeof(no_property_values_ptr))
+        .CopyOutArgumentBuffer(4, &no_property_size, sizeof(no_property_size))
+        .SetReturn(MAP_ERROR);
     STRICT_EXPECTED_CALL(mocks, message_destroy(TEST_EVENT_MESSAGE_HANDLE));
     STRICT_EXPECTED_CALL(mocks, test_iothubclient_send_confirmation_callback(IOTHUB_CLIENT_CONFIRMATION_ERROR, (void*)0x00));
     STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(TEST_IOTHUB_MESSAGE_HANDLE));
@@ -4624,8 +4539,13 @@ TEST_FUNCTION(when_creating_the_uAMQP_value_for_the_1st_property_value_fails_AMQ
     cleanupList(config.waitingToSend);
 }
 
-/* Tests_SRS_IOTHUBTRANSPORTUAMQP_01_014: [If any of the APIs fails while building the property map and setting it on the uAMQP message, IoTHubTransportAMQP_DoWork shall notify the failure by invoking the upper layer message send callback with IOTHUB_CLIENT_CONFIRMATION_ERROR.] */
-TEST_FUNCTION(when_setting_the_value_for_the_1st_property_fails_AMQP_DoWork_completes_the_message_send_with_an_error)
+/* Tests_SRS_IOTHUBTRANSPORTUAMQP_01_008: [All properties shall be transferred to a uAMQP map.] */
+/* Tests_SRS_IOTHUBTRANSPORTUAMQP_01_009: [The uAMQP map shall be created by calling amqpvalue_create_map.] */
+/* Tests_SRS_IOTHUBTRANSPORTUAMQP_01_010: [A key uAMQP value shall be created by using amqpvalue_create_string.] */
+/* Tests_SRS_IOTHUBTRANSPORTUAMQP_01_011: [A value uAMQP value shall be created by using amqpvalue_create_string.] */
+/* Tests_SRS_IOTHUBTRANSPORTUAMQP_01_012: [The key/value pair for the property shall be set into the uAMQP property map by calling amqpvalue_map_set_value.] */
+/* Tests_SRS_IOTHUBTRANSPORTUAMQP_01_013: [After all properties have been filled in the uAMQP map, the uAMQP properties map shall be set on the uAMQP message by calling message_set_application_properties.] */
+TEST_FUNCTION(AMQP_DoWork_encodes_two_properties_on_an_IoTHub_Message_before_giving_it_to_uAMQP)
 {
     // arrange
     CIoTHubTransportAMQPMocks mocks;
@@ -4639,6 +4559,7 @@ TEST_FUNCTION(when_setting_the_value_for_the_1st_property_fails_AMQP_DoWork_comp
     time_t current_time = time(NULL);
 
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    registerTestDevice(transport, &config);
 
     setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
 
@@ -4672,19 +4593,20 @@ TEST_FUNCTION(when_setting_the_value_for_the_1st_property_fails_AMQP_DoWork_comp
         .SetReturn(TEST_PROPERTY_1_KEY_UAMQP_VALUE);
     STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_values[0]))
         .SetReturn(TEST_PROPERTY_1_VALUE_UAMQP_VALUE);
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_set_map_value(TEST_UAMQP_MAP, TEST_PROPERTY_1_KEY_UAMQP_VALUE, TEST_PROPERTY_1_VALUE_UAMQP_VALUE))
-        .SetReturn(1);
-
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_set_map_value(TEST_UAMQP_MAP, TEST_PROPERTY_1_KEY_UAMQP_VALUE, TEST_PROPERTY_1_VALUE_UAMQP_VALUE));
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_keys[1]))
+        .SetReturn(TEST_PROPERTY_2_KEY_UAMQP_VALUE);
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_values[1]))
+        .SetReturn(TEST_PROPERTY_2_VALUE_UAMQP_VALUE);
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_set_map_value(TEST_UAMQP_MAP, TEST_PROPERTY_2_KEY_UAMQP_VALUE, TEST_PROPERTY_2_VALUE_UAMQP_VALUE));
+    STRICT_EXPECTED_CALL(mocks, message_set_application_properties(TEST_EVENT_MESSAGE_HANDLE, TEST_UAMQP_MAP));
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_UAMQP_MAP));
     STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_PROPERTY_1_KEY_UAMQP_VALUE));
     STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_PROPERTY_1_VALUE_UAMQP_VALUE));
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_UAMQP_MAP));
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_PROPERTY_2_KEY_UAMQP_VALUE));
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_PROPERTY_2_VALUE_UAMQP_VALUE));
+    EXPECTED_CALL(mocks, messagesender_send(NULL, TEST_EVENT_MESSAGE_HANDLE, NULL, NULL));
     STRICT_EXPECTED_CALL(mocks, message_destroy(TEST_EVENT_MESSAGE_HANDLE));
-    STRICT_EXPECTED_CALL(mocks, test_iothubclient_send_confirmation_callback(IOTHUB_CLIENT_CONFIRMATION_ERROR, (void*)0x00));
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(TEST_IOTHUB_MESSAGE_HANDLE));
-    EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG));
     EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(1);
 
     // act
@@ -4699,7 +4621,7 @@ TEST_FUNCTION(when_setting_the_value_for_the_1st_property_fails_AMQP_DoWork_comp
 }
 
 /* Tests_SRS_IOTHUBTRANSPORTUAMQP_01_014: [If any of the APIs fails while building the property map and setting it on the uAMQP message, IoTHubTransportAMQP_DoWork shall notify the failure by invoking the upper layer message send callback with IOTHUB_CLIENT_CONFIRMATION_ERROR.] */
-TEST_FUNCTION(when_creating_the_uAMQP_value_for_the_for_key_of_the_2nd_property_fails_AMQP_DoWork_completes_the_message_send_with_an_error)
+TEST_FUNCTION(when_creating_the_property_map_fails_AMQP_DoWork_completes_the_message_send_with_an_error)
 {
     // arrange
     CIoTHubTransportAMQPMocks mocks;
@@ -4713,6 +4635,7 @@ TEST_FUNCTION(when_creating_the_uAMQP_value_for_the_for_key_of_the_2nd_property_
     time_t current_time = time(NULL);
 
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    registerTestDevice(transport, &config);
 
     setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
 
@@ -4741,18 +4664,8 @@ TEST_FUNCTION(when_creating_the_uAMQP_value_for_the_for_key_of_the_2nd_property_
         .CopyOutArgumentBuffer(3, &two_property_values_ptr, sizeof(two_property_values_ptr))
         .CopyOutArgumentBuffer(4, &two_properties_size, sizeof(two_properties_size));
     STRICT_EXPECTED_CALL(mocks, amqpvalue_create_map())
-        .SetReturn(TEST_UAMQP_MAP);
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_keys[0]))
-        .SetReturn(TEST_PROPERTY_1_KEY_UAMQP_VALUE);
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_values[0]))
-        .SetReturn(TEST_PROPERTY_1_VALUE_UAMQP_VALUE);
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_set_map_value(TEST_UAMQP_MAP, TEST_PROPERTY_1_KEY_UAMQP_VALUE, TEST_PROPERTY_1_VALUE_UAMQP_VALUE));
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_keys[1]))
         .SetReturn((AMQP_VALUE)NULL);
 
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_PROPERTY_1_KEY_UAMQP_VALUE));
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_PROPERTY_1_VALUE_UAMQP_VALUE));
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_UAMQP_MAP));
     STRICT_EXPECTED_CALL(mocks, message_destroy(TEST_EVENT_MESSAGE_HANDLE));
     STRICT_EXPECTED_CALL(mocks, test_iothubclient_send_confirmation_callback(IOTHUB_CLIENT_CONFIRMATION_ERROR, (void*)0x00));
     STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(TEST_IOTHUB_MESSAGE_HANDLE));
@@ -4774,7 +4687,7 @@ TEST_FUNCTION(when_creating_the_uAMQP_value_for_the_for_key_of_the_2nd_property_
 }
 
 /* Tests_SRS_IOTHUBTRANSPORTUAMQP_01_014: [If any of the APIs fails while building the property map and setting it on the uAMQP message, IoTHubTransportAMQP_DoWork shall notify the failure by invoking the upper layer message send callback with IOTHUB_CLIENT_CONFIRMATION_ERROR.] */
-TEST_FUNCTION(when_creating_the_uAMQP_value_for_the_for_value_of_the_2nd_property_fails_AMQP_DoWork_completes_the_message_send_with_an_error)
+TEST_FUNCTION(when_creating_the_uAMQP_value_for_the_1st_property_key_fails_AMQP_DoWork_completes_the_message_send_with_an_error)
 {
     // arrange
     CIoTHubTransportAMQPMocks mocks;
@@ -4788,6 +4701,7 @@ TEST_FUNCTION(when_creating_the_uAMQP_value_for_the_for_value_of_the_2nd_propert
     time_t current_time = time(NULL);
 
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    registerTestDevice(transport, &config);
 
     setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
 
@@ -4818,18 +4732,8 @@ TEST_FUNCTION(when_creating_the_uAMQP_value_for_the_for_value_of_the_2nd_propert
     STRICT_EXPECTED_CALL(mocks, amqpvalue_create_map())
         .SetReturn(TEST_UAMQP_MAP);
     STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_keys[0]))
-        .SetReturn(TEST_PROPERTY_1_KEY_UAMQP_VALUE);
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_values[0]))
-        .SetReturn(TEST_PROPERTY_1_VALUE_UAMQP_VALUE);
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_set_map_value(TEST_UAMQP_MAP, TEST_PROPERTY_1_KEY_UAMQP_VALUE, TEST_PROPERTY_1_VALUE_UAMQP_VALUE));
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_keys[1]))
-        .SetReturn(TEST_PROPERTY_2_KEY_UAMQP_VALUE);
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_values[1]))
         .SetReturn((AMQP_VALUE)NULL);
 
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_PROPERTY_1_KEY_UAMQP_VALUE));
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_PROPERTY_1_VALUE_UAMQP_VALUE));
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_PROPERTY_2_KEY_UAMQP_VALUE));
     STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_UAMQP_MAP));
     STRICT_EXPECTED_CALL(mocks, message_destroy(TEST_EVENT_MESSAGE_HANDLE));
     STRICT_EXPECTED_CALL(mocks, test_iothubclient_send_confirmation_callback(IOTHUB_CLIENT_CONFIRMATION_ERROR, (void*)0x00));
@@ -4848,10 +4752,11 @@ TEST_FUNCTION(when_creating_the_uAMQP_value_for_the_for_value_of_the_2nd_propert
 
     // cleanup
     transport_interface->IoTHubTransport_Destroy(transport);
+    cleanupList(config.waitingToSend);
 }
 
 /* Tests_SRS_IOTHUBTRANSPORTUAMQP_01_014: [If any of the APIs fails while building the property map and setting it on the uAMQP message, IoTHubTransportAMQP_DoWork shall notify the failure by invoking the upper layer message send callback with IOTHUB_CLIENT_CONFIRMATION_ERROR.] */
-TEST_FUNCTION(when_setting_the_2nd_property_on_the_uAMQP_map_fails_AMQP_DoWork_completes_the_message_send_with_an_error)
+TEST_FUNCTION(when_creating_the_uAMQP_value_for_the_1st_property_value_fails_AMQP_DoWork_completes_the_message_send_with_an_error)
 {
     // arrange
     CIoTHubTransportAMQPMocks mocks;
@@ -4865,6 +4770,7 @@ TEST_FUNCTION(when_setting_the_2nd_property_on_the_uAMQP_map_fails_AMQP_DoWork_c
     time_t current_time = time(NULL);
 
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    registerTestDevice(transport, &config);
 
     setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
 
@@ -4897,19 +4803,9 @@ TEST_FUNCTION(when_setting_the_2nd_property_on_the_uAMQP_map_fails_AMQP_DoWork_c
     STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_keys[0]))
         .SetReturn(TEST_PROPERTY_1_KEY_UAMQP_VALUE);
     STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_values[0]))
-        .SetReturn(TEST_PROPERTY_1_VALUE_UAMQP_VALUE);
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_set_map_value(TEST_UAMQP_MAP, TEST_PROPERTY_1_KEY_UAMQP_VALUE, TEST_PROPERTY_1_VALUE_UAMQP_VALUE));
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_keys[1]))
-        .SetReturn(TEST_PROPERTY_2_KEY_UAMQP_VALUE);
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_values[1]))
-        .SetReturn(TEST_PROPERTY_2_VALUE_UAMQP_VALUE);
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_set_map_value(TEST_UAMQP_MAP, TEST_PROPERTY_2_KEY_UAMQP_VALUE, TEST_PROPERTY_2_VALUE_UAMQP_VALUE))
-        .SetReturn(1);
+        .SetReturn((AMQP_VALUE)NULL);
 
     STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_PROPERTY_1_KEY_UAMQP_VALUE));
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_PROPERTY_1_VALUE_UAMQP_VALUE));
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_PROPERTY_2_KEY_UAMQP_VALUE));
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_PROPERTY_2_VALUE_UAMQP_VALUE));
     STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_UAMQP_MAP));
     STRICT_EXPECTED_CALL(mocks, message_destroy(TEST_EVENT_MESSAGE_HANDLE));
     STRICT_EXPECTED_CALL(mocks, test_iothubclient_send_confirmation_callback(IOTHUB_CLIENT_CONFIRMATION_ERROR, (void*)0x00));
@@ -4932,7 +4828,7 @@ TEST_FUNCTION(when_setting_the_2nd_property_on_the_uAMQP_map_fails_AMQP_DoWork_c
 }
 
 /* Tests_SRS_IOTHUBTRANSPORTUAMQP_01_014: [If any of the APIs fails while building the property map and setting it on the uAMQP message, IoTHubTransportAMQP_DoWork shall notify the failure by invoking the upper layer message send callback with IOTHUB_CLIENT_CONFIRMATION_ERROR.] */
-TEST_FUNCTION(when_setting_the_message_properties_fails_AMQP_DoWork_completes_the_message_send_with_an_error)
+TEST_FUNCTION(when_setting_the_value_for_the_1st_property_fails_AMQP_DoWork_completes_the_message_send_with_an_error)
 {
     // arrange
     CIoTHubTransportAMQPMocks mocks;
@@ -4946,6 +4842,7 @@ TEST_FUNCTION(when_setting_the_message_properties_fails_AMQP_DoWork_completes_th
     time_t current_time = time(NULL);
 
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    registerTestDevice(transport, &config);
 
     setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
 
@@ -4979,13 +4876,241 @@ TEST_FUNCTION(when_setting_the_message_properties_fails_AMQP_DoWork_completes_th
         .SetReturn(TEST_PROPERTY_1_KEY_UAMQP_VALUE);
     STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_values[0]))
         .SetReturn(TEST_PROPERTY_1_VALUE_UAMQP_VALUE);
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_set_map_value(TEST_UAMQP_MAP, TEST_PROPERTY_1_KEY_UAMQP_VALUE, TEST_PROPERTY_1_VALUE_UAMQP_VALUE));
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_keys[1]))
-        .SetReturn(TEST_PROPERTY_2_KEY_UAMQP_VALUE);
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_values[1]))
-        .SetReturn(TEST_PROPERTY_2_VALUE_UAMQP_VALUE);
-    STRICT_EXPECTED_CALL(mocks, amqpvalue_set_map_value(TEST_UAMQP_MAP, TEST_PROPERTY_2_KEY_UAMQP_VALUE, TEST_PROPERTY_2_VALUE_UAMQP_VALUE));
-    STRICT_EXPECTED_CALL(mocks, message_set_application_properties(TEST_EVENT_MESSAGE_HANDLE, TEST_UAMQP_MAP))
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_set_map_value(TEST_UAMQP_MAP, TEST_PROPERTY_1_KEY_UAMQP_VALUE, TEST_PROPERTY_1_VALUE_UAMQP_VALUE))
+        .SetReturn(1);
+
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_PROPERTY_1_KEY_UAMQP_VALUE));
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_PROPERTY_1_VALUE_UAMQP_VALUE));
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_UAMQP_MAP));
+    STRICT_EXPECTED_CALL(mocks, message_destroy(TEST_EVENT_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(mocks, test_iothubclient_send_confirmation_callback(IOTHUB_CLIENT_CONFIRMATION_ERROR, (void*)0x00));
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(TEST_IOTHUB_MESSAGE_HANDLE));
+    EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(1);
+
+    // act
+    transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
+
+    // assert
+    mocks.AssertActualAndExpectedCalls();
+
+    // cleanup
+    transport_interface->IoTHubTransport_Destroy(transport);
+    cleanupList(config.waitingToSend);
+}
+
+/* Tests_SRS_IOTHUBTRANSPORTUAMQP_01_014: [If any of the APIs fails while building the property map and setting it on the uAMQP message, IoTHubTransportAMQP_DoWork shall notify the failure by invoking the upper layer message send callback with IOTHUB_CLIENT_CONFIRMATION_ERROR.] */
+TEST_FUNCTION(when_creating_the_uAMQP_value_for_the_for_key_of_the_2nd_property_fails_AMQP_DoWork_completes_the_message_send_with_an_error)
+{
+    // arrange
+    CIoTHubTransportAMQPMocks mocks;
+
+    DLIST_ENTRY wts;
+    BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+    TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+    IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+        TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
+    IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+    time_t current_time = time(NULL);
+
+    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    registerTestDevice(transport, &config);
+
+    setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
+
+    addTestEvents(config.waitingToSend, 1, true);
+    mocks.ResetAllCalls();
+
+    setExpectedCallsForSASTokenExpiryCheck(mocks, &config, current_time);
+    setExpectedCallsForConnectionDoWork(mocks, &config);
+
+    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(0);
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE)).SetReturn(IOTHUBMESSAGE_BYTEARRAY);
+
+    EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    const unsigned char* binarydata_ptr = test_binary_data.bytes;
+    EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .CopyOutArgumentBuffer(2, &binarydata_ptr, sizeof(binarydata_ptr))
+        .CopyOutArgumentBuffer(3, &test_binary_data.length, sizeof(test_binary_data.length));
+    EXPECTED_CALL(mocks, message_create()).SetReturn(TEST_EVENT_MESSAGE_HANDLE);
+    STRICT_EXPECTED_CALL(mocks, message_add_body_amqp_data(TEST_EVENT_MESSAGE_HANDLE, test_binary_data));
+
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE))
+        .SetReturn(TEST_IOTHUB_MESSAGE_PROPERTIES_MAP);
+    STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_IOTHUB_MESSAGE_PROPERTIES_MAP, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .CopyOutArgumentBuffer(2, &two_property_keys_ptr, sizeof(two_property_keys_ptr))
+        .CopyOutArgumentBuffer(3, &two_property_values_ptr, sizeof(two_property_values_ptr))
+        .CopyOutArgumentBuffer(4, &two_properties_size, sizeof(two_properties_size));
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_map())
+        .SetReturn(TEST_UAMQP_MAP);
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_keys[0]))
+        .SetReturn(TEST_PROPERTY_1_KEY_UAMQP_VALUE);
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_values[0]))
+        .SetReturn(TEST_PROPERTY_1_VALUE_UAMQP_VALUE);
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_set_map_value(TEST_UAMQP_MAP, TEST_PROPERTY_1_KEY_UAMQP_VALUE, TEST_PROPERTY_1_VALUE_UAMQP_VALUE));
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_keys[1]))
+        .SetReturn((AMQP_VALUE)NULL);
+
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_PROPERTY_1_KEY_UAMQP_VALUE));
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_PROPERTY_1_VALUE_UAMQP_VALUE));
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_UAMQP_MAP));
+    STRICT_EXPECTED_CALL(mocks, message_destroy(TEST_EVENT_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(mocks, test_iothubclient_send_confirmation_callback(IOTHUB_CLIENT_CONFIRMATION_ERROR, (void*)0x00));
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(TEST_IOTHUB_MESSAGE_HANDLE));
+    EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(1);
+
+    // act
+    transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
+
+    // assert
+    mocks.AssertActualAndExpectedCalls();
+
+    // cleanup
+    transport_interface->IoTHubTransport_Destroy(transport);
+    cleanupList(config.waitingToSend);
+}
+
+/* Tests_SRS_IOTHUBTRANSPORTUAMQP_01_014: [If any of the APIs fails while building the property map and setting it on the uAMQP message, IoTHubTransportAMQP_DoWork shall notify the failure by invoking the upper layer message send callback with IOTHUB_CLIENT_CONFIRMATION_ERROR.] */
+TEST_FUNCTION(when_creating_the_uAMQP_value_for_the_for_value_of_the_2nd_property_fails_AMQP_DoWork_completes_the_message_send_with_an_error)
+{
+    // arrange
+    CIoTHubTransportAMQPMocks mocks;
+
+    DLIST_ENTRY wts;
+    BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+    TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+    IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+        TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
+    IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+    time_t current_time = time(NULL);
+
+    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    registerTestDevice(transport, &config);
+
+    setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
+
+    addTestEvents(config.waitingToSend, 1, true);
+    mocks.ResetAllCalls();
+
+    setExpectedCallsForSASTokenExpiryCheck(mocks, &config, current_time);
+    setExpectedCallsForConnectionDoWork(mocks, &config);
+
+    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(0);
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE)).SetReturn(IOTHUBMESSAGE_BYTEARRAY);
+
+    EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    const unsigned char* binarydata_ptr = test_binary_data.bytes;
+    EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .CopyOutArgumentBuffer(2, &binarydata_ptr, sizeof(binarydata_ptr))
+        .CopyOutArgumentBuffer(3, &test_binary_data.length, sizeof(test_binary_data.length));
+    EXPECTED_CALL(mocks, message_create()).SetReturn(TEST_EVENT_MESSAGE_HANDLE);
+    STRICT_EXPECTED_CALL(mocks, message_add_body_amqp_data(TEST_EVENT_MESSAGE_HANDLE, test_binary_data));
+
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE))
+        .SetReturn(TEST_IOTHUB_MESSAGE_PROPERTIES_MAP);
+    STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_IOTHUB_MESSAGE_PROPERTIES_MAP, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .CopyOutArgumentBuffer(2, &two_property_keys_ptr, sizeof(two_property_keys_ptr))
+        .CopyOutArgumentBuffer(3, &two_property_values_ptr, sizeof(two_property_values_ptr))
+        .CopyOutArgumentBuffer(4, &two_properties_size, sizeof(two_properties_size));
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_map())
+        .SetReturn(TEST_UAMQP_MAP);
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_keys[0]))
+        .SetReturn(TEST_PROPERTY_1_KEY_UAMQP_VALUE);
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_values[0]))
+        .SetReturn(TEST_PROPERTY_1_VALUE_UAMQP_VALUE);
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_set_map_value(TEST_UAMQP_MAP, TEST_PROPERTY_1_KEY_UAMQP_VALUE, TEST_PROPERTY_1_VALUE_UAMQP_VALUE));
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_keys[1]))
+        .SetReturn(TEST_PROPERTY_2_KEY_UAMQP_VALUE);
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_values[1]))
+        .SetReturn((AMQP_VALUE)NULL);
+
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_PROPERTY_1_KEY_UAMQP_VALUE));
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_PROPERTY_1_VALUE_UAMQP_VALUE));
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_PROPERTY_2_KEY_UAMQP_VALUE));
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_UAMQP_MAP));
+    STRICT_EXPECTED_CALL(mocks, message_destroy(TEST_EVENT_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(mocks, test_iothubclient_send_confirmation_callback(IOTHUB_CLIENT_CONFIRMATION_ERROR, (void*)0x00));
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(TEST_IOTHUB_MESSAGE_HANDLE));
+    EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(1);
+
+    // act
+    transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
+
+    // assert
+    mocks.AssertActualAndExpectedCalls();
+
+    // cleanup
+    transport_interface->IoTHubTransport_Destroy(transport);
+}
+
+/* Tests_SRS_IOTHUBTRANSPORTUAMQP_01_014: [If any of the APIs fails while building the property map and setting it on the uAMQP message, IoTHubTransportAMQP_DoWork shall notify the failure by invoking the upper layer message send callback with IOTHUB_CLIENT_CONFIRMATION_ERROR.] */
+TEST_FUNCTION(when_setting_the_2nd_property_on_the_uAMQP_map_fails_AMQP_DoWork_completes_the_message_send_with_an_error)
+{
+    // arrange
+    CIoTHubTransportAMQPMocks mocks;
+
+    DLIST_ENTRY wts;
+    BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+    TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+    IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+        TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
+    IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+    time_t current_time = time(NULL);
+
+    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    registerTestDevice(transport, &config);
+
+    setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
+
+    addTestEvents(config.waitingToSend, 1, true);
+    mocks.ResetAllCalls();
+
+    setExpectedCallsForSASTokenExpiryCheck(mocks, &config, current_time);
+    setExpectedCallsForConnectionDoWork(mocks, &config);
+
+    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(0);
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE)).SetReturn(IOTHUBMESSAGE_BYTEARRAY);
+
+    EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    const unsigned char* binarydata_ptr = test_binary_data.bytes;
+    EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .CopyOutArgumentBuffer(2, &binarydata_ptr, sizeof(binarydata_ptr))
+        .CopyOutArgumentBuffer(3, &test_binary_data.length, sizeof(test_binary_data.length));
+    EXPECTED_CALL(mocks, message_create()).SetReturn(TEST_EVENT_MESSAGE_HANDLE);
+    STRICT_EXPECTED_CALL(mocks, message_add_body_amqp_data(TEST_EVENT_MESSAGE_HANDLE, test_binary_data));
+
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE))
+        .SetReturn(TEST_IOTHUB_MESSAGE_PROPERTIES_MAP);
+    STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_IOTHUB_MESSAGE_PROPERTIES_MAP, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .CopyOutArgumentBuffer(2, &two_property_keys_ptr, sizeof(two_property_keys_ptr))
+        .CopyOutArgumentBuffer(3, &two_property_values_ptr, sizeof(two_property_values_ptr))
+        .CopyOutArgumentBuffer(4, &two_properties_size, sizeof(two_properties_size));
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_map())
+        .SetReturn(TEST_UAMQP_MAP);
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_keys[0]))
+        .SetReturn(TEST_PROPERTY_1_KEY_UAMQP_VALUE);
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_values[0]))
+        .SetReturn(TEST_PROPERTY_1_VALUE_UAMQP_VALUE);
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_set_map_value(TEST_UAMQP_MAP, TEST_PROPERTY_1_KEY_UAMQP_VALUE, TEST_PROPERTY_1_VALUE_UAMQP_VALUE));
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_keys[1]))
+        .SetReturn(TEST_PROPERTY_2_KEY_UAMQP_VALUE);
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_values[1]))
+        .SetReturn(TEST_PROPERTY_2_VALUE_UAMQP_VALUE);
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_set_map_value(TEST_UAMQP_MAP, TEST_PROPERTY_2_KEY_UAMQP_VALUE, TEST_PROPERTY_2_VALUE_UAMQP_VALUE))
         .SetReturn(1);
 
     STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_PROPERTY_1_KEY_UAMQP_VALUE));
@@ -5000,22 +5125,589 @@ TEST_FUNCTION(when_setting_the_message_properties_fails_AMQP_DoWork_completes_th
     EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG));
     EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
     EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(1);
+
+    // act
+    transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
+
+    // assert
+    mocks.AssertActualAndExpectedCalls();
+
+    // cleanup
+    transport_interface->IoTHubTransport_Destroy(transport);
+    cleanupList(config.waitingToSend);
+}
+
+/* Tests_SRS_IOTHUBTRANSPORTUAMQP_01_014: [If any of the APIs fails while building the property map and setting it on the uAMQP message, IoTHubTransportAMQP_DoWork shall notify the failure by invoking the upper layer message send callback with IOTHUB_CLIENT_CONFIRMATION_ERROR.] */
+TEST_FUNCTION(when_setting_the_message_properties_fails_AMQP_DoWork_completes_the_message_send_with_an_error)
+{
+    // arrange
+    CIoTHubTransportAMQPMocks mocks;
+
+    DLIST_ENTRY wts;
+    BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+    TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+    IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+        TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
+    IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+    time_t current_time = time(NULL);
+
+    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    registerTestDevice(transport, &config);
+
+    setupSuccessfulDoWorkAndAuthenticate(transport, mocks, config, current_time);
+
+    addTestEvents(config.waitingToSend, 1, true);
+    mocks.ResetAllCalls();
+
+    setExpectedCallsForSASTokenExpiryCheck(mocks, &config, current_time);
+    setExpectedCallsForConnectionDoWork(mocks, &config);
+
+    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(0);
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE)).SetReturn(IOTHUBMESSAGE_BYTEARRAY);
+
+    EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    const unsigned char* binarydata_ptr = test_binary_data.bytes;
+    EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .CopyOutArgumentBuffer(2, &binarydata_ptr, sizeof(binarydata_ptr))
+        .CopyOutArgumentBuffer(3, &test_binary_data.length, sizeof(test_binary_data.length));
+    EXPECTED_CALL(mocks, message_create()).SetReturn(TEST_EVENT_MESSAGE_HANDLE);
+    STRICT_EXPECTED_CALL(mocks, message_add_body_amqp_data(TEST_EVENT_MESSAGE_HANDLE, test_binary_data));
+
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE))
+        .SetReturn(TEST_IOTHUB_MESSAGE_PROPERTIES_MAP);
+    STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_IOTHUB_MESSAGE_PROPERTIES_MAP, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .CopyOutArgumentBuffer(2, &two_property_keys_ptr, sizeof(two_property_keys_ptr))
+        .CopyOutArgumentBuffer(3, &two_property_values_ptr, sizeof(two_property_values_ptr))
+        .CopyOutArgumentBuffer(4, &two_properties_size, sizeof(two_properties_size));
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_map())
+        .SetReturn(TEST_UAMQP_MAP);
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_keys[0]))
+        .SetReturn(TEST_PROPERTY_1_KEY_UAMQP_VALUE);
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_values[0]))
+        .SetReturn(TEST_PROPERTY_1_VALUE_UAMQP_VALUE);
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_set_map_value(TEST_UAMQP_MAP, TEST_PROPERTY_1_KEY_UAMQP_VALUE, TEST_PROPERTY_1_VALUE_UAMQP_VALUE));
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_keys[1]))
+        .SetReturn(TEST_PROPERTY_2_KEY_UAMQP_VALUE);
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_create_string(two_property_values[1]))
+        .SetReturn(TEST_PROPERTY_2_VALUE_UAMQP_VALUE);
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_set_map_value(TEST_UAMQP_MAP, TEST_PROPERTY_2_KEY_UAMQP_VALUE, TEST_PROPERTY_2_VALUE_UAMQP_VALUE));
+    STRICT_EXPECTED_CALL(mocks, message_set_application_properties(TEST_EVENT_MESSAGE_HANDLE, TEST_UAMQP_MAP))
+        .SetReturn(1);
+
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_PROPERTY_1_KEY_UAMQP_VALUE));
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_PROPERTY_1_VALUE_UAMQP_VALUE));
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_PROPERTY_2_KEY_UAMQP_VALUE));
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_PROPERTY_2_VALUE_UAMQP_VALUE));
+    STRICT_EXPECTED_CALL(mocks, amqpvalue_destroy(TEST_UAMQP_MAP));
+    STRICT_EXPECTED_CALL(mocks, message_destroy(TEST_EVENT_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(mocks, test_iothubclient_send_confirmation_callback(IOTHUB_CLIENT_CONFIRMATION_ERROR, (void*)0x00));
+    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(TEST_IOTHUB_MESSAGE_HANDLE));
+    EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG));
+
+    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(1);
+
+    // act
+    transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
+
+    // assert
+    mocks.AssertActualAndExpectedCalls();
+
+    // cleanup
+    transport_interface->IoTHubTransport_Destroy(transport);
+    cleanupList(config.waitingToSend);
+}
+
+// Tests_SRS_IOTHUBTRANSPORTAMQP_02_007: [IoTHubTransportAMQP_Register shall allocate the state of the device, and shall fail and return NULL if any of its allocations fails.]
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_012: [IoTHubTransportAMQP_Register shall create an immutable string, referred to as devicesPath, from the following parts: host_fqdn + "/devices/" + deviceId.]
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_014: [IoTHubTransportAMQP_Register shall create an immutable string, referred to as targetAddress, from the following parts: "amqps://" + devicesPath + "/messages/events".]
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_053: [IoTHubTransportAMQP_Register shall define the source address for receiving messages as "amqps://" + devicesPath + "/messages/devicebound", stored in the device state as messageReceiveAddress]
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_018: [IoTHubTransportAMQP_Register shall store a copy of device->deviceKey (passed by upper layer) into the device state.]
+// Tests_SRS_IOTHUBTRANSPORTAMQP_02_008: [On success IoTHubTransportAMQP_Register shall add the device to the devices of the transport and return its state as the IOTHUB_DEVICE_HANDLE.]
+TEST_FUNCTION(AMQP_Register_succeeds_and_returns_device_handle)
+{
+    // arrange
+    CIoTHubTransportAMQPMocks mocks;
+    IOTHUB_DEVICE_CONFIG device;
+    device.deviceId = TEST_DEVICE_ID;
+    device.deviceKey = TEST_DEVICE_KEY;
+    device.deviceSasToken = NULL;
+
+    DLIST_ENTRY wts;
+    BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+    TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+    IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+        TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
+    IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+
+    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    mocks.ResetAllCalls();
+
+    setExpectedCallsForRegisterUpTo(mocks, &device, STEP_REGISTER_ADD_DEVICE);
+
+    // act
+    IOTHUB_DEVICE_HANDLE devHandle = transport_interface->IoTHubTransport_Register(transport, &device, TEST_IOTHUB_CLIENT_LL_HANDLE, &wts);
+
+    // assert
+    ASSERT_IS_NOT_NULL(devHandle);
+    ASSERT_ARE_NOT_EQUAL(void_ptr, transport, devHandle);
+    mocks.AssertActualAndExpectedCalls();
+
+    // cleanup
+    transport_interface->IoTHubTransport_Destroy(transport);
+    cleanupList(config.waitingToSend);
+}
+
+
+// Tests_SRS_IOTHUBTRANSPORTAMQP_02_008: [On success IoTHubTransportAMQP_Register shall add the device to the devices of the transport and return its state as the IOTHUB_DEVICE_HANDLE.]
+TEST_FUNCTION(AMQP_Register_with_deviceSasToken_succeeds)
+{
+    // arrange
+    CIoTHubTransportAMQPMocks mocks;
+    IOTHUB_DEVICE_CONFIG device;
+    device.deviceId = TEST_DEVICE_ID;
+    device.deviceKey = NULL;
+    device.deviceSasToken = TEST_DEVICE_SAS;
+
+    DLIST_ENTRY wts;
+    BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+    TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+    IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+        TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
+    IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+
+    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    mocks.ResetAllCalls();
+
+    setExpectedCallsForRegisterUpTo(mocks, &device, STEP_REGISTER_ADD_DEVICE);
+
+    // act
+    IOTHUB_DEVICE_HANDLE devHandle = transport_interface->IoTHubTransport_Register(transport, &device, TEST_IOTHUB_CLIENT_LL_HANDLE, &wts);
+
+    // assert
+    ASSERT_IS_NOT_NULL(devHandle);
+    mocks.AssertActualAndExpectedCalls();
+
+    // cleanup
+    transport_interface->IoTHubTransport_Destroy(transport);
+    cleanupList(config.waitingToSend);
+}
+
+
+// Tests_SRS_IOTHUBTRANSPORTAMQP_02_006: [IoTHubTransportAMQP_Register shall fail and return NULL if a device with the same deviceId is already registered in the transport.]
+TEST_FUNCTION(AMQP_Register_twice_returns_null_second_time)
+{
+    // arrange
+    CIoTHubTransportAMQPMocks mocks;
+    IOTHUB_DEVICE_CONFIG device;
+    device.deviceId = TEST_DEVICE_ID;
+    device.deviceKey = TEST_DEVICE_KEY;
+    device.deviceSasToken = NULL;
+
+    DLIST_ENTRY wts;
+    BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+    TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+    IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+        TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
+    IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+
+    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    IOTHUB_DEVICE_HANDLE devHandle = transport_interface->IoTHubTransport_Register(transport, &device, TEST_IOTHUB_CLIENT_LL_HANDLE, &wts);
+    mocks.ResetAllCalls();
+
+    setExpectedCallsForRegisterUpTo(mocks, &device, STEP_REGISTER_DEVICES_PATH);
+    EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG));
+    setExpectedCleanupCallsForRegisterUpTo(mocks, STEP_REGISTER_DEVICES_PATH);
+
+    // act
+    IOTHUB_DEVICE_HANDLE devHandle2 = transport_interface->IoTHubTransport_Register(transport, &device, TEST_IOTHUB_CLIENT_LL_HANDLE, &wts);
+
+    // assert
+    ASSERT_IS_NOT_NULL(devHandle);
+    ASSERT_IS_NULL(devHandle2);
+    mocks.AssertActualAndExpectedCalls();
+
+    // cleanup
+    transport_interface->IoTHubTransport_Destroy(transport);
+    cleanupList(config.waitingToSend);
+}
+
+
+// Tests_SRS_IOTHUBTRANSPORTAMQP_02_008: [On success IoTHubTransportAMQP_Register shall add the device to the devices of the transport and return its state as the IOTHUB_DEVICE_HANDLE.]
+TEST_FUNCTION(AMQP_Register_two_devices_succeeds)
+{
+    // arrange
+    CIoTHubTransportAMQPMocks mocks;
+    IOTHUB_DEVICE_CONFIG device;
+    device.deviceId = TEST_DEVICE_ID;
+    device.deviceKey = TEST_DEVICE_KEY;
+    device.deviceSasToken = NULL;
+    IOTHUB_DEVICE_CONFIG device2;
+    device2.deviceId = TEST_DEVICE_ID_2;
+    device2.deviceKey = TEST_DEVICE_KEY;
+    device2.deviceSasToken = NULL;
+
+    DLIST_ENTRY wts2;
+    BASEIMPLEMENTATION::DList_InitializeListHead(&wts2);
+    DLIST_ENTRY wts;
+    BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+    TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+    IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+        TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
+    IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+
+    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    IOTHUB_DEVICE_HANDLE devHandle = transport_interface->IoTHubTransport_Register(transport, &device, TEST_IOTHUB_CLIENT_LL_HANDLE, &wts);
+    mocks.ResetAllCalls();
+
+    setExpectedCallsForRegisterUpTo(mocks, &device2, STEP_REGISTER_ADD_DEVICE);
+    EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG));
+
+    // act
+    IOTHUB_DEVICE_HANDLE devHandle2 = transport_interface->IoTHubTransport_Register(transport, &device2, TEST_IOTHUB_CLIENT_LL_HANDLE_2, &wts2);
+
+    // assert
+    ASSERT_IS_NOT_NULL(devHandle);
+    ASSERT_IS_NOT_NULL(devHandle2);
+    ASSERT_ARE_NOT_EQUAL(void_ptr, devHandle, devHandle2);
+    mocks.AssertActualAndExpectedCalls();
+
+    // cleanup
+    transport_interface->IoTHubTransport_Destroy(transport);
+    cleanupList(config.waitingToSend);
+    cleanupList(&wts2);
+}
+
+// Tests_SRS_IOTHUBTRANSPORTUAMQP_17_001: [IoTHubTransportAMQP_Register shall return NULL if device, or waitingToSend are NULL.] 
+// Tests_SRS_IOTHUBTRANSPORTUAMQP_03_002: [IoTHubTransportAMQP_Register shall return NULL if deviceId, or both deviceKey and deviceSasToken are NULL.]
+TEST_FUNCTION(AMQP_Register_transport_deviceId_null_returns_null)
+{
+    // arrange
+    CIoTHubTransportAMQPMocks mocks;
+    IOTHUB_DEVICE_CONFIG device;
+    device.deviceId = NULL;
+    device.deviceKey = TEST_DEVICE_KEY;
+    device.deviceSasToken = NULL;
+
+    DLIST_ENTRY wts;
+    BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+    TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+    IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+        TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
+    IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+
+    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    mocks.ResetAllCalls();
+
+    // act
+    IOTHUB_DEVICE_HANDLE devHandle = transport_interface->IoTHubTransport_Register(transport, &device, TEST_IOTHUB_CLIENT_LL_HANDLE, &wts);
+
+    // assert
+    ASSERT_IS_NULL(devHandle);
+    mocks.AssertActualAndExpectedCalls();
+
+    // cleanup
+    transport_interface->IoTHubTransport_Destroy(transport);
+    cleanupList(config.waitingToSend);
+}
+
+
+// Tests_SRS_IOTHUBTRANSPORTUAMQP_17_001: [IoTHubTransportAMQP_Register shall return NULL if device or waitingToSend are NULL.] 
+TEST_FUNCTION(AMQP_Register_transport_device_null_returns_null)
+{
+    // arrange
+    CIoTHubTransportAMQPMocks mocks;
+
+    DLIST_ENTRY wts;
+    BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+    TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+    IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+        TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
+    IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+
+    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    mocks.ResetAllCalls();
+
+    // act
+    IOTHUB_DEVICE_HANDLE devHandle = transport_interface->IoTHubTransport_Register(transport, NULL, TEST_IOTHUB_CLIENT_LL_HANDLE, &wts);
+
+    // assert
+    ASSERT_IS_NULL(devHandle);
+    mocks.AssertActualAndExpectedCalls();
+
+    // cleanup
+    transport_interface->IoTHubTransport_Destroy(transport);
+    cleanupList(config.waitingToSend);
+}
+
+
+// Tests_SRS_IOTHUBTRANSPORTUAMQP_03_002: [IoTHubTransportAMQP_Register shall return NULL if deviceId, or both deviceKey and deviceSasToken are NULL.]
+TEST_FUNCTION(AMQP_Register_transport_deviceKey_null_and_deviceSasToken_null_returns_null)
+{
+    // arrange
+    CIoTHubTransportAMQPMocks mocks;
+    IOTHUB_DEVICE_CONFIG device;
+    device.deviceId = TEST_DEVICE_ID;
+    device.deviceKey = NULL;
+    device.deviceSasToken = NULL;
+
+    DLIST_ENTRY wts;
+    BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+    TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+    IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+        TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
+    IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+
+    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    mocks.ResetAllCalls();
+
+    // act
+    IOTHUB_DEVICE_HANDLE devHandle = transport_interface->IoTHubTransport_Register(transport, &device, TEST_IOTHUB_CLIENT_LL_HANDLE, &wts);
+
+    // assert
+    ASSERT_IS_NULL(devHandle);
+    mocks.AssertActualAndExpectedCalls();
+
+    // cleanup
+    transport_interface->IoTHubTransport_Destroy(transport);
+    cleanupList(config.waitingToSend);
+}
+
+
+// Tests_SRS_IOTHUBTRANSPORTUAMQP_03_003: [IoTHubTransportAMQP_Register shall return NULL if both deviceKey and deviceSasToken are not NULL.] 
+TEST_FUNCTION(AMQP_Register_transport_deviceKey_and_deviceSasToken_provided_returns_null)
+{
+    // arrange
+    CIoTHubTransportAMQPMocks mocks;
+    IOTHUB_DEVICE_CONFIG device;
+    device.deviceId = TEST_DEVICE_ID;
+    device.deviceKey = TEST_DEVICE_KEY;
+    device.deviceSasToken = TEST_DEVICE_SAS;
+
+    DLIST_ENTRY wts;
+    BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+    TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+    IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+        TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
+    IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+
+    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    mocks.ResetAllCalls();
+
+    // act
+    IOTHUB_DEVICE_HANDLE devHandle = transport_interface->IoTHubTransport_Register(transport, &device, TEST_IOTHUB_CLIENT_LL_HANDLE, &wts);
+
+    // assert
+    ASSERT_IS_NULL(devHandle);
+    mocks.AssertActualAndExpectedCalls();
+
+    // cleanup
+    transport_interface->IoTHubTransport_Destroy(transport);
+    cleanupList(config.waitingToSend);
+}
+
+
+// Tests_SRS_IOTHUBTRANSPORTUAMQP_17_001: [IoTHubTransportAMQP_Register shall return NULL if device or waitingToSend are NULL.] 
+TEST_FUNCTION(AMQP_Register_transport_wts_null_returns_null)
+{
+    // arrange
+    CIoTHubTransportAMQPMocks mocks;
+    IOTHUB_DEVICE_CONFIG device;
+    device.deviceId = TEST_DEVICE_ID;
+    device.deviceKey = TEST_DEVICE_KEY;
+    device.deviceSasToken = NULL;
+
+    DLIST_ENTRY wts;
+    BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+    TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+    IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+        TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
+    IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+
+    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    mocks.ResetAllCalls();
+
+    // act
+    IOTHUB_DEVICE_HANDLE devHandle = transport_interface->IoTHubTransport_Register(transport, &device, TEST_IOTHUB_CLIENT_LL_HANDLE, NULL);
+
+    // assert
+    ASSERT_IS_NULL(devHandle);
+    mocks.AssertActualAndExpectedCalls();
+
+    // cleanup
+    transport_interface->IoTHubTransport_Destroy(transport);
+    cleanupList(config.waitingToSend);
+}
+
+
+// Tests_SRS_IOTHUBTRANSPORTAMQP_02_004: [IoTHubTransportAMQP_Register shall return NULL if the deviceId is zero length or longer than 128 characters.]
+TEST_FUNCTION(AMQP_Register_deviceId_too_long_returns_null)
+{
+    // arrange
+    CIoTHubTransportAMQPMocks mocks;
+    IOTHUB_DEVICE_CONFIG device;
+    device.deviceId = "012345678901234567890123456789012345678901234567890123456789012345678901234567890123456789012345678901234567890123456789012345678";
+    device.deviceKey = TEST_DEVICE_KEY;
+    device.deviceSasToken = NULL;
+
+    DLIST_ENTRY wts;
+    BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+    TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+    IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+        TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
+    IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+
+    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    mocks.ResetAllCalls();
+
+    // act
+    IOTHUB_DEVICE_HANDLE devHandle = transport_interface->IoTHubTransport_Register(transport, &device, TEST_IOTHUB_CLIENT_LL_HANDLE, &wts);
+
+    // assert
+    ASSERT_IS_NULL(devHandle);
+    mocks.AssertActualAndExpectedCalls();
+
+    // cleanup
+    transport_interface->IoTHubTransport_Destroy(transport);
+    cleanupList(config.waitingToSend);
+}
+
+
+// Tests_SRS_IOTHUBTRANSPORTAMQP_02_004: [IoTHubTransportAMQP_Register shall return NULL if the deviceId is zero length or longer than 128 characters.]
+TEST_FUNCTION(AMQP_Register_deviceId_zero_length_returns_null)
+{
+    // arrange
+    CIoTHubTransportAMQPMocks mocks;
+    IOTHUB_DEVICE_CONFIG device;
+    device.deviceId = "";
+    device.deviceKey = TEST_DEVICE_KEY;
+    device.deviceSasToken = NULL;
+
+    DLIST_ENTRY wts;
+    BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+    TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+    IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+        TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
+    IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+
+    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    mocks.ResetAllCalls();
+
+    // act
+    IOTHUB_DEVICE_HANDLE devHandle = transport_interface->IoTHubTransport_Register(transport, &device, TEST_IOTHUB_CLIENT_LL_HANDLE, &wts);
+
+    // assert
+    ASSERT_IS_NULL(devHandle);
+    mocks.AssertActualAndExpectedCalls();
+
+    // cleanup
+    transport_interface->IoTHubTransport_Destroy(transport);
+    cleanupList(config.waitingToSend);
+}
+
+
+// Tests_SRS_IOTHUBTRANSPORTAMQP_02_005: [IoTHubTransportAMQP_Register shall return NULL if the deviceKey or the deviceSasToken provided is zero length.]
+TEST_FUNCTION(AMQP_Register_deviceKey_zero_length_returns_null)
+{
+    // arrange
+    CIoTHubTransportAMQPMocks mocks;
+    IOTHUB_DEVICE_CONFIG device;
+    device.deviceId = TEST_DEVICE_ID;
+    device.deviceKey = "";
+    device.deviceSasToken = NULL;
+
+    DLIST_ENTRY wts;
+    BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+    TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+    IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+        TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
+    IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+
+    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    mocks.ResetAllCalls();
+
+    // act
+    IOTHUB_DEVICE_HANDLE devHandle = transport_interface->IoTHubTransport_Register(transport, &device, TEST_IOTHUB_CLIENT_LL_HANDLE, &wts);
+
+    // assert
+    ASSERT_IS_NULL(devHandle);
+    mocks.AssertActualAndExpectedCalls();
+
+    // cleanup
+    transport_interface->IoTHubTransport_Destroy(transport);
+    cleanupList(config.waitingToSend);
+}
+
+
+// Tests_SRS_IOTHUBTRANSPORTAMQP_02_005: [IoTHubTransportAMQP_Register shall return NULL if the deviceKey or the deviceSasToken provided is zero length.]
+TEST_FUNCTION(AMQP_Register_deviceSasToken_zero_length_returns_null)
+{
+    // arrange
+    CIoTHubTransportAMQPMocks mocks;
+    IOTHUB_DEVICE_CONFIG device;
+    device.deviceId = TEST_DEVICE_ID;
+    device.deviceKey = NULL;
+    device.deviceSasToken = "";
+
+    DLIST_ENTRY wts;
+    BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+    TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+    IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+        TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
+    IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+
+    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    mocks.ResetAllCalls();
+
+    // act
+    IOTHUB_DEVICE_HANDLE devHandle = transport_interface->IoTHubTransport_Register(transport, &device, TEST_IOTHUB_CLIENT_LL_HANDLE, &wts);
+
+    // assert
+    ASSERT_IS_NULL(devHandle);
+    mocks.AssertActualAndExpectedCalls();
+
+    // cleanup
+    transport_interface->IoTHubTransport_Destroy(transport);
+    cleanupList(config.waitingToSend);
+}
 
-    EXPECTED_CALL(mocks, DList_IsListEmpty(IGNORED_PTR_ARG)).SetReturn(1);
+
+// Tests_SRS_IOTHUBTRANSPORTUAMQP_17_005: [IoTHubTransportAMQP_Register shall return NULL if the TRANSPORT_LL_HANDLE is NULL.] 
+TEST_FUNCTION(AMQP_Register_transport_null_returns_null)
+{
+    // arrange
+    CIoTHubTransportAMQPMocks mocks;
+    IOTHUB_DEVICE_CONFIG device;
+    device.deviceId = TEST_DEVICE_ID;
+    device.deviceKey = TEST_DEVICE_KEY;
+    device.deviceSasToken = NULL;
+
+    DLIST_ENTRY wts;
+    BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+    TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+
+    TRANSPORT_LL_HANDLE transport = NULL;
+    mocks.ResetAllCalls();
 
     // act
-    transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
+    IOTHUB_DEVICE_HANDLE devHandle = transport_interface->IoTHubTransport_Register(transport, &device, TEST_IOTHUB_CLIENT_LL_HANDLE, &wts);
 
     // assert
+    ASSERT_IS_NULL(devHandle);
     mocks.AssertActualAndExpectedCalls();
 
     // cleanup
-    transport_interface->IoTHubTransport_Destroy(transport);
-    cleanupList(config.waitingToSend);
+    cleanupList(&wts);
 }
 
-// Tests_SRS_IOTHUBTRANSPORTUAMQP_17_003: [IoTHubTransportAMQP_Register shall return the TRANSPORT_LL_HANDLE as the IOTHUB_DEVICE_HANDLE.] 
-TEST_FUNCTION(AMQP_Register_transport_success_returns_transport)
+// Tests_SRS_IOTHUBTRANSPORTAMQP_02_007: [IoTHubTransportAMQP_Register shall allocate the state of the device, and shall fail and return NULL if any of its allocations fails.]
+TEST_FUNCTION(AMQP_Register_device_state_allocation_fails)
 {
     // arrange
     CIoTHubTransportAMQPMocks mocks;
@@ -5030,34 +5722,28 @@ TEST_FUNCTION(AMQP_Register_transport_success_returns_transport)
     IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
         TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
     IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
-    time_t current_time = time(NULL);
 
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
     mocks.ResetAllCalls();
 
-    EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
-    EXPECTED_CALL(mocks, STRING_construct(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG));
+    fail_malloc = true;
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(0)).IgnoreArgument(1);
 
     // act
     IOTHUB_DEVICE_HANDLE devHandle = transport_interface->IoTHubTransport_Register(transport, &device, TEST_IOTHUB_CLIENT_LL_HANDLE, &wts);
 
     // assert
-    ASSERT_IS_NOT_NULL(devHandle);
-    ASSERT_ARE_EQUAL(void_ptr, transport, devHandle);
+    ASSERT_IS_NULL(devHandle);
     mocks.AssertActualAndExpectedCalls();
 
     // cleanup
+    fail_malloc = false;
     transport_interface->IoTHubTransport_Destroy(transport);
     cleanupList(config.waitingToSend);
 }
 
-TEST_FUNCTION(AMQP_Register_twice_returns_null_second_time)
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_013: [If creating devicesPath fails for any reason then IoTHubTransportAMQP_Register shall fail and return NULL.] 
+TEST_FUNCTION(AMQP_Register_devicesPath_malloc_fails)
 {
     // arrange
     CIoTHubTransportAMQPMocks mocks;
@@ -5072,26 +5758,22 @@ TEST_FUNCTION(AMQP_Register_twice_returns_null_second_time)
     IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
         TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
     IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
-    time_t current_time = time(NULL);
 
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
-    IOTHUB_DEVICE_HANDLE devHandle = transport_interface->IoTHubTransport_Register(transport, &device, TEST_IOTHUB_CLIENT_LL_HANDLE, &wts);
     mocks.ResetAllCalls();
 
-    EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
-    EXPECTED_CALL(mocks, STRING_construct(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG));
+    const char* devicesPath = TEST_IOT_HUB_NAME "." TEST_IOT_HUB_SUFFIX "/devices/" TEST_DEVICE_ID;
+
+    setExpectedCallsForRegisterUpTo(mocks, &device, STEP_REGISTER_DEVICE_STATE);
+    EXPECTED_CALL(mocks, STRING_c_str(0));
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(strlen(devicesPath) + 1)).SetFailReturn((char*)NULL);
+    setExpectedCleanupCallsForRegisterUpTo(mocks, STEP_REGISTER_DEVICE_STATE);
 
     // act
-    IOTHUB_DEVICE_HANDLE devHandle2 = transport_interface->IoTHubTransport_Register(transport, &device, TEST_IOTHUB_CLIENT_LL_HANDLE, &wts);
+    IOTHUB_DEVICE_HANDLE devHandle = transport_interface->IoTHubTransport_Register(transport, &device, TEST_IOTHUB_CLIENT_LL_HANDLE, &wts);
 
     // assert
-    ASSERT_IS_NULL(devHandle2);
+    ASSERT_IS_NULL(devHandle);
     mocks.AssertActualAndExpectedCalls();
 
     // cleanup
@@ -5099,14 +5781,15 @@ TEST_FUNCTION(AMQP_Register_twice_returns_null_second_time)
     cleanupList(config.waitingToSend);
 }
 
-// Tests_SRS_IOTHUBTRANSPORTUAMQP_17_002: [IoTHubTransportAMQP_Register shall return NULL if deviceId or deviceKey do not match the deviceId and deviceKey passed in during IoTHubTransportAMQP_Create.] 
-TEST_FUNCTION(AMQP_Register_transport_deviceKey_mismatch_returns_null)
+
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_013: [If creating devicesPath fails for any reason then IoTHubTransportAMQP_Register shall fail and return NULL.] 
+TEST_FUNCTION(AMQP_Register_devicesPath_STRING_construct_fails)
 {
     // arrange
     CIoTHubTransportAMQPMocks mocks;
     IOTHUB_DEVICE_CONFIG device;
     device.deviceId = TEST_DEVICE_ID;
-    device.deviceKey = "this is a different device key";
+    device.deviceKey = TEST_DEVICE_KEY;
     device.deviceSasToken = NULL;
 
     DLIST_ENTRY wts;
@@ -5115,19 +5798,18 @@ TEST_FUNCTION(AMQP_Register_transport_deviceKey_mismatch_returns_null)
     IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
         TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
     IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
-    time_t current_time = time(NULL);
 
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
     mocks.ResetAllCalls();
 
-    EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
-    EXPECTED_CALL(mocks, STRING_construct(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG));
+    const char* devicesPath = TEST_IOT_HUB_NAME "." TEST_IOT_HUB_SUFFIX "/devices/" TEST_DEVICE_ID;
+
+    setExpectedCallsForRegisterUpTo(mocks, &device, STEP_REGISTER_DEVICE_STATE);
+    EXPECTED_CALL(mocks, STRING_c_str(0));
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(strlen(devicesPath) + 1));
+    STRICT_EXPECTED_CALL(mocks, STRING_construct(devicesPath)).SetFailReturn(TEST_NULL_STRING_HANDLE);
+    EXPECTED_CALL(mocks, gballoc_free(0));
+    setExpectedCleanupCallsForRegisterUpTo(mocks, STEP_REGISTER_DEVICE_STATE);
 
     // act
     IOTHUB_DEVICE_HANDLE devHandle = transport_interface->IoTHubTransport_Register(transport, &device, TEST_IOTHUB_CLIENT_LL_HANDLE, &wts);
@@ -5141,13 +5823,14 @@ TEST_FUNCTION(AMQP_Register_transport_deviceKey_mismatch_returns_null)
     cleanupList(config.waitingToSend);
 }
 
-// Tests_SRS_IOTHUBTRANSPORTUAMQP_17_002: [IoTHubTransportAMQP_Register shall return NULL if deviceId or deviceKey do not match the deviceId and deviceKey passed in during IoTHubTransportAMQP_Create.] 
-TEST_FUNCTION(AMQP_Register_transport_deviceId_mismatch_returns_null)
+
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_015: [If creating the targetAddress fails for any reason then IoTHubTransportAMQP_Register shall fail and return NULL.]
+TEST_FUNCTION(AMQP_Register_targetAddress_STRING_construct_fails)
 {
     // arrange
     CIoTHubTransportAMQPMocks mocks;
     IOTHUB_DEVICE_CONFIG device;
-    device.deviceId = "not the right devId";
+    device.deviceId = TEST_DEVICE_ID;
     device.deviceKey = TEST_DEVICE_KEY;
     device.deviceSasToken = NULL;
 
@@ -5157,18 +5840,18 @@ TEST_FUNCTION(AMQP_Register_transport_deviceId_mismatch_returns_null)
     IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
         TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
     IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
-    time_t current_time = time(NULL);
 
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
     mocks.ResetAllCalls();
 
-    EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
-    EXPECTED_CALL(mocks, STRING_construct(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG));
+    const char* targetAddress = "amqps://" TEST_IOT_HUB_NAME "." TEST_IOT_HUB_SUFFIX "/devices/" TEST_DEVICE_ID "/messages/events";
+
+    setExpectedCallsForRegisterUpTo(mocks, &device, STEP_REGISTER_DEVICES_PATH);
+    EXPECTED_CALL(mocks, STRING_c_str(0));
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(strlen(targetAddress) + 1));
+    STRICT_EXPECTED_CALL(mocks, STRING_construct(targetAddress)).SetFailReturn(TEST_NULL_STRING_HANDLE);
+    EXPECTED_CALL(mocks, gballoc_free(0));
+    setExpectedCleanupCallsForRegisterUpTo(mocks, STEP_REGISTER_DEVICES_PATH);
 
     // act
     IOTHUB_DEVICE_HANDLE devHandle = transport_interface->IoTHubTransport_Register(transport, &device, TEST_IOTHUB_CLIENT_LL_HANDLE, &wts);
@@ -5182,13 +5865,14 @@ TEST_FUNCTION(AMQP_Register_transport_deviceId_mismatch_returns_null)
     cleanupList(config.waitingToSend);
 }
 
-// Tests_SRS_IOTHUBTRANSPORTUAMQP_17_001: [IoTHubTransportAMQP_Register shall return NULL if deviceId, deviceKey or waitingToSend are NULL.] 
-TEST_FUNCTION(AMQP_Register_transport_deviceId_null_returns_null)
+
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_054: [If creating the messageReceiveAddress fails for any reason then IoTHubTransportAMQP_Register shall fail and return NULL.]
+TEST_FUNCTION(AMQP_Register_receiveAddress_STRING_construct_fails)
 {
     // arrange
     CIoTHubTransportAMQPMocks mocks;
     IOTHUB_DEVICE_CONFIG device;
-    device.deviceId = NULL;
+    device.deviceId = TEST_DEVICE_ID;
     device.deviceKey = TEST_DEVICE_KEY;
     device.deviceSasToken = NULL;
 
@@ -5198,11 +5882,19 @@ TEST_FUNCTION(AMQP_Register_transport_deviceId_null_returns_null)
     IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
         TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
     IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
-    time_t current_time = time(NULL);
 
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
     mocks.ResetAllCalls();
 
+    const char* receiveAddress = "amqps://" TEST_IOT_HUB_NAME "." TEST_IOT_HUB_SUFFIX "/devices/" TEST_DEVICE_ID "/messages/devicebound";
+
+    setExpectedCallsForRegisterUpTo(mocks, &device, STEP_REGISTER_TARGET_ADDRESS);
+    EXPECTED_CALL(mocks, STRING_c_str(0));
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(strlen(receiveAddress) + 1));
+    STRICT_EXPECTED_CALL(mocks, STRING_construct(receiveAddress)).SetFailReturn(TEST_NULL_STRING_HANDLE);
+    EXPECTED_CALL(mocks, gballoc_free(0));
+    setExpectedCleanupCallsForRegisterUpTo(mocks, STEP_REGISTER_TARGET_ADDRESS);
+
     // act
     IOTHUB_DEVICE_HANDLE devHandle = transport_interface->IoTHubTransport_Register(transport, &device, TEST_IOTHUB_CLIENT_LL_HANDLE, &wts);
 
@@ -5215,11 +5907,16 @@ TEST_FUNCTION(AMQP_Register_transport_deviceId_null_returns_null)
     cleanupList(config.waitingToSend);
 }
 
-// Tests_SRS_IOTHUBTRANSPORTUAMQP_17_001: [IoTHubTransportAMQP_Register shall return NULL if device or waitingToSend are NULL.] 
-TEST_FUNCTION(AMQP_Register_transport_device_null_returns_null)
+
+// Tests_SRS_IOTHUBTRANSPORTAMQP_02_009: [The name of the AMQP links created by IoTHubTransportAMQP_DoWork shall be suffixed with "-" + deviceId, so the links of every registered device are unique within the shared session.]
+TEST_FUNCTION(AMQP_Register_sender_link_name_STRING_construct_fails)
 {
     // arrange
     CIoTHubTransportAMQPMocks mocks;
+    IOTHUB_DEVICE_CONFIG device;
+    device.deviceId = TEST_DEVICE_ID;
+    device.deviceKey = TEST_DEVICE_KEY;
+    device.deviceSasToken = NULL;
 
     DLIST_ENTRY wts;
     BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
@@ -5227,13 +5924,18 @@ TEST_FUNCTION(AMQP_Register_transport_device_null_returns_null)
     IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
         TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
     IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
-    time_t current_time = time(NULL);
 
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
     mocks.ResetAllCalls();
 
+    setExpectedCallsForRegisterUpTo(mocks, &device, STEP_REGISTER_RECEIVE_ADDRESS);
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(strlen("sender-link-" TEST_DEVICE_ID) + 1));
+    STRICT_EXPECTED_CALL(mocks, STRING_construct("sender-link-" TEST_DEVICE_ID)).SetFailReturn(TEST_NULL_STRING_HANDLE);
+    EXPECTED_CALL(mocks, gballoc_free(0));
+    setExpectedCleanupCallsForRegisterUpTo(mocks, STEP_REGISTER_RECEIVE_ADDRESS);
+
     // act
-    IOTHUB_DEVICE_HANDLE devHandle = transport_interface->IoTHubTransport_Register(transport, NULL, TEST_IOTHUB_CLIENT_LL_HANDLE, &wts);
+    IOTHUB_DEVICE_HANDLE devHandle = transport_interface->IoTHubTransport_Register(transport, &device, TEST_IOTHUB_CLIENT_LL_HANDLE, &wts);
 
     // assert
     ASSERT_IS_NULL(devHandle);
@@ -5244,14 +5946,15 @@ TEST_FUNCTION(AMQP_Register_transport_device_null_returns_null)
     cleanupList(config.waitingToSend);
 }
 
-// Tests_SRS_IOTHUBTRANSPORTUAMQP_03_002: [IoTHubTransportAMQP_Register shall return NULL if deviceId, or both deviceKey and deviceSasToken are NULL.]
-TEST_FUNCTION(AMQP_Register_transport_deviceKey_null_and_deviceSasToken_null_returns_null)
+
+// Tests_SRS_IOTHUBTRANSPORTAMQP_02_009: [The name of the AMQP links created by IoTHubTransportAMQP_DoWork shall be suffixed with "-" + deviceId, so the links of every registered device are unique within the shared session.]
+TEST_FUNCTION(AMQP_Register_receiver_link_name_STRING_construct_fails)
 {
     // arrange
     CIoTHubTransportAMQPMocks mocks;
     IOTHUB_DEVICE_CONFIG device;
     device.deviceId = TEST_DEVICE_ID;
-    device.deviceKey = NULL;
+    device.deviceKey = TEST_DEVICE_KEY;
     device.deviceSasToken = NULL;
 
     DLIST_ENTRY wts;
@@ -5260,11 +5963,16 @@ TEST_FUNCTION(AMQP_Register_transport_deviceKey_null_and_deviceSasToken_null_ret
     IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
         TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
     IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
-    time_t current_time = time(NULL);
 
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
     mocks.ResetAllCalls();
 
+    setExpectedCallsForRegisterUpTo(mocks, &device, STEP_REGISTER_SENDER_LINK_NAME);
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(strlen("receiver-link-" TEST_DEVICE_ID) + 1));
+    STRICT_EXPECTED_CALL(mocks, STRING_construct("receiver-link-" TEST_DEVICE_ID)).SetFailReturn(TEST_NULL_STRING_HANDLE);
+    EXPECTED_CALL(mocks, gballoc_free(0));
+    setExpectedCleanupCallsForRegisterUpTo(mocks, STEP_REGISTER_SENDER_LINK_NAME);
+
     // act
     IOTHUB_DEVICE_HANDLE devHandle = transport_interface->IoTHubTransport_Register(transport, &device, TEST_IOTHUB_CLIENT_LL_HANDLE, &wts);
 
@@ -5277,15 +5985,16 @@ TEST_FUNCTION(AMQP_Register_transport_deviceKey_null_and_deviceSasToken_null_ret
     cleanupList(config.waitingToSend);
 }
 
-// Tests_SRS_IOTHUBTRANSPORTUAMQP_03_003: [IoTHubTransportAMQP_Register shall return NULL if both deviceKey and deviceSasToken are not NULL.] 
-TEST_FUNCTION(AMQP_Register_transport_deviceKey_and_deviceSasToken_provided_returns_null)
+
+// Tests_SRS_IOTHUBTRANSPORTAMQP_09_019: [If IoTHubTransportAMQP_Register fails to copy device->deviceKey, the function shall fail and return NULL.] 
+TEST_FUNCTION(AMQP_Register_deviceKey_copy_fails)
 {
     // arrange
     CIoTHubTransportAMQPMocks mocks;
     IOTHUB_DEVICE_CONFIG device;
     device.deviceId = TEST_DEVICE_ID;
     device.deviceKey = TEST_DEVICE_KEY;
-    device.deviceSasToken = TEST_DEVICE_SAS;
+    device.deviceSasToken = NULL;
 
     DLIST_ENTRY wts;
     BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
@@ -5293,11 +6002,14 @@ TEST_FUNCTION(AMQP_Register_transport_deviceKey_and_deviceSasToken_provided_retu
     IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
         TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
     IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
-    time_t current_time = time(NULL);
 
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
     mocks.ResetAllCalls();
 
+    setExpectedCallsForRegisterUpTo(mocks, &device, STEP_REGISTER_RECEIVER_LINK_NAME);
+    STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_DEVICE_KEY)).SetFailReturn(TEST_NULL_STRING_HANDLE);
+    setExpectedCleanupCallsForRegisterUpTo(mocks, STEP_REGISTER_RECEIVER_LINK_NAME);
+
     // act
     IOTHUB_DEVICE_HANDLE devHandle = transport_interface->IoTHubTransport_Register(transport, &device, TEST_IOTHUB_CLIENT_LL_HANDLE, &wts);
 
@@ -5310,13 +6022,14 @@ TEST_FUNCTION(AMQP_Register_transport_deviceKey_and_deviceSasToken_provided_retu
     cleanupList(config.waitingToSend);
 }
 
-// Tests_SRS_IOTHUBTRANSPORTUAMQP_17_001: [IoTHubTransportAMQP_Register shall return NULL if deviceId, deviceKey or waitingToSend are NULL.] 
-TEST_FUNCTION(AMQP_Register_transport_wts_null_returns_null)
+
+// Tests_SRS_IOTHUBTRANSPORTAMQP_02_010: [IoTHubTransportAMQP_Unregister shall remove the device from the transport, destroy its links, return its in-progress events to its waitingToSend list and free its state; the connection is kept for the other registered devices.]
+TEST_FUNCTION(AMQP_Unregister_transport_success)
 {
     // arrange
     CIoTHubTransportAMQPMocks mocks;
     IOTHUB_DEVICE_CONFIG device;
-    device.deviceId = "not the right devId";
+    device.deviceId = TEST_DEVICE_ID;
     device.deviceKey = TEST_DEVICE_KEY;
     device.deviceSasToken = NULL;
 
@@ -5326,16 +6039,19 @@ TEST_FUNCTION(AMQP_Register_transport_wts_null_returns_null)
     IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
         TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
     IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
-    time_t current_time = time(NULL);
 
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+
+    IOTHUB_DEVICE_HANDLE devHandle = transport_interface->IoTHubTransport_Register(transport, &device, TEST_IOTHUB_CLIENT_LL_HANDLE, &wts);
+
     mocks.ResetAllCalls();
+    EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
+    setExpectedCleanupCallsForRegisterUpTo(mocks, STEP_REGISTER_DEVICEKEY);
 
     // act
-    IOTHUB_DEVICE_HANDLE devHandle = transport_interface->IoTHubTransport_Register(transport, &device, TEST_IOTHUB_CLIENT_LL_HANDLE, NULL);
+    transport_interface->IoTHubTransport_Unregister(devHandle);
 
     // assert
-    ASSERT_IS_NULL(devHandle);
     mocks.AssertActualAndExpectedCalls();
 
     // cleanup
@@ -5343,8 +6059,24 @@ TEST_FUNCTION(AMQP_Register_transport_wts_null_returns_null)
     cleanupList(config.waitingToSend);
 }
 
-// Tests_SRS_IOTHUBTRANSPORTUAMQP_17_005: [IoTHubTransportAMQP_Register shall return NULL if the TRANSPORT_LL_HANDLE is NULL.] 
-TEST_FUNCTION(AMQP_Register_transport_null_returns_null)
+
+TEST_FUNCTION(AMQP_Unregister_NULL_device_handle_does_nothing)
+{
+    // arrange
+    CIoTHubTransportAMQPMocks mocks;
+    TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+
+    mocks.ResetAllCalls();
+
+    // act
+    transport_interface->IoTHubTransport_Unregister(NULL);
+
+    // assert
+    mocks.AssertActualAndExpectedCalls();
+}
+
+// Tests_SRS_IOTHUBTRANSPORTAMQP_02_010: [IoTHubTransportAMQP_Unregister shall remove the device from the transport, destroy its links, return its in-progress events to its waitingToSend list and free its state; the connection is kept for the other registered devices.]
+TEST_FUNCTION(AMQP_Register_transport_Register_Unregister_Register_success_returns_device_handle)
 {
     // arrange
     CIoTHubTransportAMQPMocks mocks;
@@ -5356,30 +6088,35 @@ TEST_FUNCTION(AMQP_Register_transport_null_returns_null)
     DLIST_ENTRY wts;
     BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
     TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+    IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+        TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
+    IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
 
-    TRANSPORT_LL_HANDLE transport = NULL;
+    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    IOTHUB_DEVICE_HANDLE devHandle = transport_interface->IoTHubTransport_Register(transport, &device, TEST_IOTHUB_CLIENT_LL_HANDLE, &wts);
+    transport_interface->IoTHubTransport_Unregister(devHandle);
     mocks.ResetAllCalls();
 
+    setExpectedCallsForRegisterUpTo(mocks, &device, STEP_REGISTER_ADD_DEVICE);
+
     // act
-    IOTHUB_DEVICE_HANDLE devHandle = transport_interface->IoTHubTransport_Register(transport, &device, TEST_IOTHUB_CLIENT_LL_HANDLE, &wts);
+    IOTHUB_DEVICE_HANDLE devHandle2 = transport_interface->IoTHubTransport_Register(transport, &device, TEST_IOTHUB_CLIENT_LL_HANDLE, &wts);
 
     // assert
-    ASSERT_IS_NULL(devHandle);
+    ASSERT_IS_NOT_NULL(devHandle2);
     mocks.AssertActualAndExpectedCalls();
 
     // cleanup
-    cleanupList(&wts);
+    transport_interface->IoTHubTransport_Destroy(transport);
+    cleanupList(config.waitingToSend);
 }
 
-// Tests_SRS_IOTHUBTRANSPORTUAMQP_17_004: [IoTHubTransportAMQP_Unregister shall return.] 
-TEST_FUNCTION(AMQP_Unregister_transport_success)
+
+// Tests_SRS_IOTHUBTRANSPORTAMQP_02_026: [If a cbs_put_token() of the device is still pending, IoTHubTransportAMQP_Unregister shall destroy the links of the device and return its in-progress events to its waitingToSend list right away, but shall keep the rest of its state until that cbs_put_token() completes.]
+TEST_FUNCTION(AMQP_Unregister_with_a_pending_put_token_keeps_the_device_state)
 {
     // arrange
     CIoTHubTransportAMQPMocks mocks;
-    IOTHUB_DEVICE_CONFIG device;
-    device.deviceId = TEST_DEVICE_ID;
-    device.deviceKey = TEST_DEVICE_KEY;
-    device.deviceSasToken = NULL;
 
     DLIST_ENTRY wts;
     BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
@@ -5387,13 +6124,15 @@ TEST_FUNCTION(AMQP_Unregister_transport_success)
     IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
         TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
     IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
-    time_t current_time = time(NULL);
 
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
-
-    IOTHUB_DEVICE_HANDLE devHandle = transport_interface->IoTHubTransport_Register(transport, &device, TEST_IOTHUB_CLIENT_LL_HANDLE, &wts);
+    IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
+    transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
     mocks.ResetAllCalls();
+    EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
+    setExpectedCallsForRollEventsBackToWaitList(mocks, &config);
+    EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
 
     // act
     transport_interface->IoTHubTransport_Unregister(devHandle);
@@ -5406,14 +6145,11 @@ TEST_FUNCTION(AMQP_Unregister_transport_success)
     cleanupList(config.waitingToSend);
 }
 
-TEST_FUNCTION(AMQP_Register_transport_Register_Unregister_Register_success_returns_transport)
+// Tests_SRS_IOTHUBTRANSPORTAMQP_02_024: [When the last pending cbs_put_token() of an unregistered device completes, the transport shall free the state of that device.]
+TEST_FUNCTION(AMQP_Unregister_with_a_pending_put_token_frees_the_device_state_when_the_put_token_completes)
 {
     // arrange
     CIoTHubTransportAMQPMocks mocks;
-    IOTHUB_DEVICE_CONFIG device;
-    device.deviceId = TEST_DEVICE_ID;
-    device.deviceKey = TEST_DEVICE_KEY;
-    device.deviceSasToken = NULL;
 
     DLIST_ENTRY wts;
     BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
@@ -5421,33 +6157,106 @@ TEST_FUNCTION(AMQP_Register_transport_Register_Unregister_Register_success_retur
     IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
         TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
     IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
-    time_t current_time = time(NULL);
 
     TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
-    IOTHUB_DEVICE_HANDLE devHandle = transport_interface->IoTHubTransport_Register(transport, &device, TEST_IOTHUB_CLIENT_LL_HANDLE, &wts);
+    IOTHUB_DEVICE_HANDLE devHandle = registerTestDevice(transport, &config);
+    transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
     transport_interface->IoTHubTransport_Unregister(devHandle);
+
     mocks.ResetAllCalls();
+    EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
+    setExpectedCleanupCallsForRegisterUpTo(mocks, STEP_REGISTER_DEVICEKEY);
 
-    EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
-    EXPECTED_CALL(mocks, STRING_construct(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG));
+    // act
+    test_latest_cbs_put_token_callback(test_latest_cbs_put_token_context, CBS_OPERATION_RESULT_OK, 0, NULL);
+
+    // assert
+    mocks.AssertActualAndExpectedCalls();
+
+    // cleanup
+    transport_interface->IoTHubTransport_Destroy(transport);
+    cleanupList(config.waitingToSend);
+}
+
+// Tests_SRS_IOTHUBTRANSPORTAMQP_02_025: [Destroying the CBS instance shall free the state of the unregistered devices still waiting for a cbs_put_token(), since those operations will not complete anymore.]
+TEST_FUNCTION(AMQP_Destroy_with_a_pending_put_token_frees_the_device_state_after_destroying_the_cbs_instance)
+{
+    // arrange
+    CIoTHubTransportAMQPMocks mocks;
+
+    DLIST_ENTRY wts;
+    BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+    TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+    IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+        TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
+    IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+
+    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    registerTestDevice(transport, &config);
+    transport_interface->IoTHubTransport_DoWork(transport, TEST_IOTHUB_CLIENT_LL_HANDLE);
+
+    mocks.ResetAllCalls();
+    EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    setExpectedCallsForConnectionDestroyUpTo(mocks, &config, STEP_DOWORK_CREATE_CBS);
+    EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
+    setExpectedCleanupCallsForRegisterUpTo(mocks, STEP_REGISTER_DEVICEKEY);
+    setExpectedCallsForTransportDestroy(mocks, &config, false, false, 0);
 
     // act
-    IOTHUB_DEVICE_HANDLE devHandle2 = transport_interface->IoTHubTransport_Register(transport, &device, TEST_IOTHUB_CLIENT_LL_HANDLE, &wts);
+    transport_interface->IoTHubTransport_Destroy(transport);
 
     // assert
+    mocks.AssertActualAndExpectedCalls();
+
+    // cleanup
+    cleanupList(config.waitingToSend);
+}
+
+// Tests_SRS_IOTHUBTRANSPORTAMQP_02_012: [IoTHubTransportAMQP_DoWork shall authenticate each registered device within the shared CBS instance, attach its links to the shared session and send its pending events.]
+TEST_FUNCTION(AMQP_DoWork_two_devices_share_one_connection)
+{
+    // arrange
+    CIoTHubTransportAMQPMocks mocks;
+    IOTHUB_DEVICE_CONFIG device2;
+    device2.deviceId = TEST_DEVICE_ID_2;
+    device2.deviceKey = TEST_DEVICE_KEY;
+    device2.deviceSasToken = NULL;
+
+    DLIST_ENTRY wts2;
+    BASEIMPLEMENTATION::DList_InitializeListHead(&wts2);
+    DLIST_ENTRY wts;
+    BASEIMPLEMENTATION::DList_InitializeListHead(&wts);
+    TRANSPORT_PROVIDER* transport_interface = (TRANSPORT_PROVIDER*)AMQP_Protocol();
+    IOTHUB_CLIENT_CONFIG client_config = { (IOTHUB_CLIENT_TRANSPORT_PROVIDER)transport_interface,
+        TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL, TEST_IOT_HUB_NAME, TEST_IOT_HUB_SUFFIX, TEST_PROT_GW_HOSTNAME };
+    IOTHUBTRANSPORT_CONFIG config = { &client_config, &wts };
+    time_t current_time = time(NULL);
+
+    TRANSPORT_LL_HANDLE transport = transport_interface->IoTHubTransport_Create(&config);
+    registerTestDevice(transport, &config);
+    IOTHUB_DEVICE_HANDLE devHandle2 = transport_interface->IoTHubTransport_Register(transport, &device2, TEST_IOTHUB_CLIENT_LL_HANDLE_2, &wts2);
     ASSERT_IS_NOT_NULL(devHandle2);
-    ASSERT_ARE_EQUAL(void_ptr, transport, devHandle2);
+
+    mocks.ResetAllCalls();
+    setExpectedCallsForTransportDoWorkUpTo(mocks, &config, STEP_DOWORK_OPEN_CBS, DOWORK_MESSAGERECEIVER_NONE, current_time);
+    setExpectedCallsForCbsAuthentication(mocks, &config, current_time);
+    setExpectedCallsForCbsAuthTimeoutCheck(mocks, &config, current_time);
+    setExpectedCallsForCbsAuthentication(mocks, &config, current_time);
+    setExpectedCallsForCbsAuthTimeoutCheck(mocks, &config, current_time);
+    EXPECTED_CALL(mocks, connection_set_trace(IGNORED_PTR_ARG, false));
+    setExpectedCallsForConnectionDoWork(mocks, &config);
+
+    // act
+    transport_interface->IoTHubTransport_DoWork(transport, NULL);
+
+    // assert
     mocks.AssertActualAndExpectedCalls();
 
     // cleanup
     transport_interface->IoTHubTransport_Destroy(transport);
     cleanupList(config.waitingToSend);
+    cleanupList(&wts2);
 }
 
 /*Tests_SRS_IOTHUBTRANSPORTAMQP_02_001: [ If parameter handle is NULL then IoTHubTransportAMQP_GetHostname shall return NULL. ]*/
@@ -28,9 +28,11 @@
 #include "azure_c_shared_utility/buffer_.h"
 #include "azure_c_shared_utility/httpapiex.h"
 #include "azure_c_shared_utility/httpapiexsas.h"
-#include "azure_c_shared_utility/base64.h"
+#include "azure_c_shared_utility/sastoken.h"
 #include "azure_c_shared_utility/vector.h"
 #include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/threadapi.h"
+#include "azure_c_shared_utility/tickcounter.h"
 
 #define IOTHUB_ACK "iothub-ack"
 #define IOTHUB_ACK_NONE "none"
@@ -63,7 +65,6 @@ namespace BASEIMPLEMENTATION
 #undef Lock_Deinit
 
 #include "doublylinkedlist.c"
-#include "base64.c"
 #include "strings.c"
 #include "buffer.c"
 #include "vector.c"
@@ -112,6 +113,10 @@ static MICROMOCK_GLOBAL_SEMAPHORE_HANDLE g_dllByDll;
 #define TEST_PROPERTY_A_VALUE "value_of_a"
 
 #define TEST_HTTPAPIEX_HANDLE (HTTPAPIEX_HANDLE)0x343
+#define TEST_HTTPAPIEX_HANDLE2 (HTTPAPIEX_HANDLE)0x344
+#define TEST_HTTPAPIEX_HANDLE3 (HTTPAPIEX_HANDLE)0x345
+#define TEST_LOCK_HANDLE (LOCK_HANDLE)0x346
+#define TEST_THREAD_HANDLE (THREAD_HANDLE)0x347
 
 static const bool thisIsTrue = true;
 static const bool thisIsFalse = false;
@@ -410,8 +415,6 @@ static size_t whenShallBUFFER_new_fail;
 static size_t currentBUFFER_build_call;
 static size_t whenShallBUFFER_build_fail;
 
-static size_t currentBase64_Encode_Bytes_call;
-static size_t whenShallBase64_Encode_Bytes_fail;
 
 static size_t currentURL_Encode_String_call;
 static size_t whenShallURL_Encode_String_fail;
@@ -475,6 +478,13 @@ const unsigned int httpStatus204 = 204;
 const unsigned int httpStatus404 = 404;
 
 static BUFFER_HANDLE last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest = NULL;
+static uint64_t currentTickCounterMs = 0; /*what tickcounter_get_current_ms produces*/
+
+static size_t currentLock_call;
+static size_t whenShallLock_fail;
+
+static THREAD_START_FUNC lastPoolThreadFunc; /*what the last ThreadAPI_Create would have run*/
+static void* lastPoolThreadArg;
 
 static bool HTTPHeaders_GetHeaderCount_writes_to_its_outputs = true;
 
@@ -486,6 +496,7 @@ static bool HTTPHeaders_GetHeaderCount_writes_to_its_outputs = true;
 /*for the purpose of this implementation, time_t represents the number of seconds since 1970, 1st jan, 0:0:0*/
 #define TEST_GET_TIME_VALUE 384739233
 #define TEST_DEFAULT_GETMINIMUMPOLLINGTIME 1500
+#define TEST_SAS_TOKEN "SharedAccessSignature sr=thisIsAHostName.net%2fdevices%2fthisIsDeviceID&sig=thisIsASignature&se=384742833&skn="
 
 
 TYPED_MOCK_CLASS(CIoTHubTransportHttpMocks, CGlobalMock)
@@ -732,6 +743,35 @@ public:
 		MOCK_STATIC_METHOD_1(, void, HTTPAPIEX_Destroy, HTTPAPIEX_HANDLE, handle)
 		MOCK_VOID_METHOD_END()
 
+		/* Lock mocks */
+		MOCK_STATIC_METHOD_0(, LOCK_HANDLE, Lock_Init)
+		MOCK_METHOD_END(LOCK_HANDLE, TEST_LOCK_HANDLE)
+
+		MOCK_STATIC_METHOD_1(, LOCK_RESULT, Lock, LOCK_HANDLE, handle)
+		LOCK_RESULT result2;
+		currentLock_call++;
+		result2 = ((whenShallLock_fail > 0) && (currentLock_call == whenShallLock_fail)) ? LOCK_ERROR : LOCK_OK;
+		MOCK_METHOD_END(LOCK_RESULT, result2)
+
+		MOCK_STATIC_METHOD_1(, LOCK_RESULT, Unlock, LOCK_HANDLE, handle)
+		MOCK_METHOD_END(LOCK_RESULT, LOCK_OK)
+
+		MOCK_STATIC_METHOD_1(, LOCK_RESULT, Lock_Deinit, LOCK_HANDLE, handle)
+		MOCK_METHOD_END(LOCK_RESULT, LOCK_OK)
+
+		/* ThreadAPI mocks, the pool threads are never run (unless a test calls lastPoolThreadFunc) */
+		MOCK_STATIC_METHOD_3(, THREADAPI_RESULT, ThreadAPI_Create, THREAD_HANDLE*, threadHandle, THREAD_START_FUNC, func, void*, arg)
+		*threadHandle = TEST_THREAD_HANDLE;
+		lastPoolThreadFunc = func;
+		lastPoolThreadArg = arg;
+	MOCK_METHOD_END(THREADAPI_RESULT, THREADAPI_OK)
+
+		MOCK_STATIC_METHOD_2(, THREADAPI_RESULT, ThreadAPI_Join, THREAD_HANDLE, threadHandle, int*, res)
+		MOCK_METHOD_END(THREADAPI_RESULT, THREADAPI_OK)
+
+		MOCK_STATIC_METHOD_1(, void, ThreadAPI_Sleep, unsigned int, milliseconds)
+		MOCK_VOID_METHOD_END()
+
 		/* IoTHubMessage mocks */
 		MOCK_STATIC_METHOD_2(, IOTHUB_MESSAGE_HANDLE, IoTHubMessage_CreateFromByteArray, const unsigned char*, buffer, size_t, size)
 		MOCK_METHOD_END(IOTHUB_MESSAGE_HANDLE, (IOTHUB_MESSAGE_HANDLE)0x42)
@@ -1012,10 +1052,6 @@ public:
 		MOCK_STATIC_METHOD_2(, int, BUFFER_size, BUFFER_HANDLE, handle, size_t*, size);
 	MOCK_METHOD_END(int, BASEIMPLEMENTATION::BUFFER_size(handle, size))
 
-		MOCK_STATIC_METHOD_2(, STRING_HANDLE, Base64_Encode_Bytes, const unsigned char*, source, size_t, size);
-	currentBase64_Encode_Bytes_call++;
-	MOCK_METHOD_END(STRING_HANDLE, (((currentBase64_Encode_Bytes_call > 0) && (currentBase64_Encode_Bytes_call == whenShallBase64_Encode_Bytes_fail)) ? ((STRING_HANDLE)NULL) : BASEIMPLEMENTATION::Base64_Encode_Bytes(source, size)));
-
 
 
 	MOCK_STATIC_METHOD_4(, MAP_RESULT, Map_GetInternals, MAP_HANDLE, handle, const char*const**, keys, const char*const**, values, size_t*, count)
@@ -1140,6 +1176,19 @@ public:
 	last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest = BASEIMPLEMENTATION::BUFFER_clone(requestContent);
 	MOCK_METHOD_END(HTTPAPIEX_RESULT, HTTPAPIEX_OK)
 
+		MOCK_STATIC_METHOD_4(, STRING_HANDLE, SASToken_Create, STRING_HANDLE, key, STRING_HANDLE, scope, STRING_HANDLE, keyName, size_t, expiry)
+		MOCK_METHOD_END(STRING_HANDLE, BASEIMPLEMENTATION::STRING_construct(TEST_SAS_TOKEN))
+
+		MOCK_STATIC_METHOD_0(, TICK_COUNTER_HANDLE, tickcounter_create)
+		MOCK_METHOD_END(TICK_COUNTER_HANDLE, (TICK_COUNTER_HANDLE)0x4242)
+
+		MOCK_STATIC_METHOD_1(, void, tickcounter_destroy, TICK_COUNTER_HANDLE, tick_counter)
+		MOCK_VOID_METHOD_END()
+
+		MOCK_STATIC_METHOD_2(, int, tickcounter_get_current_ms, TICK_COUNTER_HANDLE, tick_counter, uint64_t*, current_ms)
+		*current_ms = currentTickCounterMs;
+	MOCK_METHOD_END(int, 0)
+
 		MOCK_STATIC_METHOD_1(, time_t, get_time, time_t*, currentTime)
 		MOCK_METHOD_END(time_t, TEST_GET_TIME_VALUE)
 
@@ -1257,6 +1306,14 @@ DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubTransportHttpMocks, , HTTPAPIEX_HANDLE, HTTP
 DECLARE_GLOBAL_MOCK_METHOD_3(CIoTHubTransportHttpMocks, , HTTPAPIEX_RESULT, HTTPAPIEX_SetOption, HTTPAPIEX_HANDLE, handle, const char*, optionName, const void*, value);
 DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubTransportHttpMocks, , void, HTTPAPIEX_Destroy, HTTPAPIEX_HANDLE, handle);
 
+DECLARE_GLOBAL_MOCK_METHOD_0(CIoTHubTransportHttpMocks, , LOCK_HANDLE, Lock_Init);
+DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubTransportHttpMocks, , LOCK_RESULT, Lock, LOCK_HANDLE, handle);
+DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubTransportHttpMocks, , LOCK_RESULT, Unlock, LOCK_HANDLE, handle);
+DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubTransportHttpMocks, , LOCK_RESULT, Lock_Deinit, LOCK_HANDLE, handle);
+DECLARE_GLOBAL_MOCK_METHOD_3(CIoTHubTransportHttpMocks, , THREADAPI_RESULT, ThreadAPI_Create, THREAD_HANDLE*, threadHandle, THREAD_START_FUNC, func, void*, arg);
+DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubTransportHttpMocks, , THREADAPI_RESULT, ThreadAPI_Join, THREAD_HANDLE, threadHandle, int*, res);
+DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubTransportHttpMocks, , void, ThreadAPI_Sleep, unsigned int, milliseconds);
+
 DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubTransportHttpMocks, , IOTHUB_MESSAGE_HANDLE, IoTHubMessage_CreateFromByteArray, const unsigned char*, buffer, size_t, size);
 DECLARE_GLOBAL_MOCK_METHOD_3(CIoTHubTransportHttpMocks, , IOTHUB_MESSAGE_RESULT, IoTHubMessage_GetByteArray, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle, const unsigned char**, buffer, size_t*, size);
 DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubTransportHttpMocks, , const char*, IoTHubMessage_GetString, IOTHUB_MESSAGE_HANDLE, handle);
@@ -1285,7 +1342,6 @@ DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubTransportHttpMocks, , int, BUFFER_content, B
 DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubTransportHttpMocks, , int, BUFFER_size, BUFFER_HANDLE, handle, size_t*, size);
 
 
-DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubTransportHttpMocks, , STRING_HANDLE, Base64_Encode_Bytes, const unsigned char*, source, size_t, size);
 
 DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubTransportHttpMocks, , STRING_HANDLE, URL_EncodeString, const char*, textEncode);
 
@@ -1295,6 +1351,10 @@ DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubTransportHttpMocks, , void, HTTPAPIEX_SAS_De
 DECLARE_GLOBAL_MOCK_METHOD_9(CIoTHubTransportHttpMocks, , HTTPAPIEX_RESULT, HTTPAPIEX_SAS_ExecuteRequest2, HTTPAPIEX_SAS_HANDLE, sasHandle, HTTPAPIEX_HANDLE, handle, HTTPAPI_REQUEST_TYPE, requestType, const char*, relativePath, HTTP_HEADERS_HANDLE, requestHttpHeadersHandle, BUFFER_HANDLE, requestContent, unsigned int*, statusCode, HTTP_HEADERS_HANDLE, responseHttpHeadersHandle, BUFFER_HANDLE, responseContent);
 DECLARE_GLOBAL_MOCK_METHOD_8(CIoTHubTransportHttpMocks, , HTTPAPIEX_RESULT, HTTPAPIEX_ExecuteRequest2, HTTPAPIEX_HANDLE, handle, HTTPAPI_REQUEST_TYPE, requestType, const char*, relativePath, HTTP_HEADERS_HANDLE, requestHttpHeadersHandle, BUFFER_HANDLE, requestContent, unsigned int*, statusCode, HTTP_HEADERS_HANDLE, responseHttpHeadersHandle, BUFFER_HANDLE, responseContent);
 
+DECLARE_GLOBAL_MOCK_METHOD_4(CIoTHubTransportHttpMocks, , STRING_HANDLE, SASToken_Create, STRING_HANDLE, key, STRING_HANDLE, scope, STRING_HANDLE, keyName, size_t, expiry);
+DECLARE_GLOBAL_MOCK_METHOD_0(CIoTHubTransportHttpMocks, , TICK_COUNTER_HANDLE, tickcounter_create);
+DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubTransportHttpMocks, , void, tickcounter_destroy, TICK_COUNTER_HANDLE, tick_counter);
+DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubTransportHttpMocks, , int, tickcounter_get_current_ms, TICK_COUNTER_HANDLE, tick_counter, uint64_t*, current_ms);
 DECLARE_GLOBAL_MOCK_METHOD_1(CIoTHubTransportHttpMocks, , time_t, get_time, time_t*, currentTime);
 DECLARE_GLOBAL_MOCK_METHOD_2(CIoTHubTransportHttpMocks, , double, get_difftime, time_t, stopTime, time_t, startTime);
 
@@ -1549,6 +1609,21 @@ static void setupRegisterHappyPathabandonHTTPrelativePathBegin(CIoTHubTransportH
 		.IgnoreArgument(1);
 }
 
+static void setupRegisterHappyPathabandonHTTPrequestHeaders(CIoTHubTransportHttpMocks &mocks, bool deallocateCreated)
+{
+	(void)mocks;
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc());
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "User-Agent", CLIENT_DEVICE_TYPE_PREFIX CLIENT_DEVICE_BACKSLASH IOTHUB_SDK_VERSION))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "Authorization", TEST_BLANK_SAS_TOKEN))
+		.IgnoreArgument(1);
+	if (deallocateCreated == true)
+	{
+		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
+			.IgnoreArgument(1);
+	}
+}
+
 static void setupRegisterHappyPathsasObject(CIoTHubTransportHttpMocks &mocks, bool deallocateCreated)
 {
 	(void)mocks;
@@ -1605,6 +1680,7 @@ static void setupRegisterHappyPath(CIoTHubTransportHttpMocks &mocks, bool deallo
 	setupRegisterHappyPatheventHTTPrequestHeaders(mocks, deallocateCreated);
 	setupRegisterHappyPathmessageHTTPrequestHeaders(mocks, deallocateCreated);
 	setupRegisterHappyPathabandonHTTPrelativePathBegin(mocks, deallocateCreated);
+	setupRegisterHappyPathabandonHTTPrequestHeaders(mocks, deallocateCreated);
 	setupRegisterHappyPathsasObject(mocks, deallocateCreated);
 	setupRegisterHappyPathDeviceListAdd(mocks, deallocateCreated);
 	setupRegisterHappyPatheventConfirmations(mocks, deallocateCreated);
@@ -1621,6 +1697,7 @@ static void setupRegisterHappyPathWithSasToken(CIoTHubTransportHttpMocks &mocks,
 	setupRegisterHappyPatheventHTTPrequestHeaders(mocks, deallocateCreated);
 	setupRegisterHappyPathmessageHTTPrequestHeaders(mocks, deallocateCreated);
 	setupRegisterHappyPathabandonHTTPrelativePathBegin(mocks, deallocateCreated);
+	setupRegisterHappyPathabandonHTTPrequestHeaders(mocks, deallocateCreated);
 	//setupRegisterHappyPathsasObject(mocks, deallocateCreated);
 	setupRegisterHappyPathDeviceListAdd(mocks, deallocateCreated);
 	setupRegisterHappyPatheventConfirmations(mocks, deallocateCreated);
@@ -1650,6 +1727,9 @@ static void setupUnregisterOneDevice(CIoTHubTransportHttpMocks &mocks)
 	//destroy_abandonHTTPrelativePathBegin(perDeviceItem);
 	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
+	//destroy_abandonHTTPrequestHeaders(perDeviceItem);
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
 	//destroy_SASObject(perDeviceItem);
 	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_Destroy(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
@@ -1674,6 +1754,48 @@ static void setupDoWorkLoopForNextDevice(CIoTHubTransportHttpMocks &mocks, size_
 		.IgnoreArgument(1);
 }
 
+/*the calls that visit 1 batched item. An item is visited once when it is measured and once more when it is written in the payload*/
+static void setupBatchedItem(CIoTHubTransportHttpMocks &mocks, IOTHUB_MESSAGE_HANDLE messageHandle, MAP_HANDLE properties)
+{
+	(void)mocks;
+
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(messageHandle));
+	switch ((uintptr_t)messageHandle)
+	{
+	case ((uintptr_t)TEST_IOTHUB_MESSAGE_HANDLE_10) :
+	{
+		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetString(messageHandle));
+		break;
+	}
+	default:
+	{
+		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+			.IgnoreArgument(2)
+			.IgnoreArgument(3);
+		break;
+	}
+	}
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(messageHandle));
+	STRICT_EXPECTED_CALL(mocks, Map_GetInternals(properties, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3)
+		.IgnoreArgument(4);
+}
+
+/*the batched payload is allocated once, at its final size*/
+static void setupBatchedPayload(CIoTHubTransportHttpMocks &mocks)
+{
+	(void)mocks;
+
+	STRICT_EXPECTED_CALL(mocks, BUFFER_new());
+	STRICT_EXPECTED_CALL(mocks, BUFFER_pre_build(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+		.IgnoreAllArguments();
+	STRICT_EXPECTED_CALL(mocks, BUFFER_u_char(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+}
+
 //
 //static void setupInitHappyPathUpThroughHostName(CIoTHubTransportHttpMocks &mocks, bool deallocateCreated)
 //{
@@ -1840,8 +1962,6 @@ TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
 	currentBUFFER_build_call = 0;
 	whenShallBUFFER_build_fail = 0;
 
-	currentBase64_Encode_Bytes_call = 0;
-	whenShallBase64_Encode_Bytes_fail = 0;
 
 	HTTPHeaders_GetHeaderCount_writes_to_its_outputs = true;
 
@@ -1861,6 +1981,14 @@ TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
 	whenShallVECTOR_find_if_fail = 0;
 
 	last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest = NULL;
+
+	currentTickCounterMs = 0;
+
+	currentLock_call = 0;
+	whenShallLock_fail = 0;
+
+	lastPoolThreadFunc = NULL;
+	lastPoolThreadArg = NULL;
 }
 
 
@@ -2380,6 +2508,7 @@ TEST_FUNCTION(IoTHubTransportHttp_Register_vector_pushback_fails)
 	setupRegisterHappyPatheventHTTPrequestHeaders(mocks, deallocateCreated);
 	setupRegisterHappyPathmessageHTTPrequestHeaders(mocks, deallocateCreated);
 	setupRegisterHappyPathabandonHTTPrelativePathBegin(mocks, deallocateCreated);
+	setupRegisterHappyPathabandonHTTPrequestHeaders(mocks, deallocateCreated);
 	setupRegisterHappyPathsasObject(mocks, deallocateCreated);
 	whenShallVECTOR_push_back_fail = 1;
 	setupRegisterHappyPathDeviceListAdd(mocks, deallocateCreated);
@@ -2413,6 +2542,7 @@ TEST_FUNCTION(IoTHubTransportHttp_Register_createSASObject_fails_1)
 	setupRegisterHappyPatheventHTTPrequestHeaders(mocks, deallocateCreated);
 	setupRegisterHappyPathmessageHTTPrequestHeaders(mocks, deallocateCreated);
 	setupRegisterHappyPathabandonHTTPrelativePathBegin(mocks, deallocateCreated);
+	setupRegisterHappyPathabandonHTTPrequestHeaders(mocks, deallocateCreated);
 	STRICT_EXPECTED_CALL(mocks, URL_EncodeString(TEST_DEVICE_ID)).SetReturn((STRING_HANDLE)NULL);
 
 	///act
@@ -2445,6 +2575,7 @@ TEST_FUNCTION(IoTHubTransportHttp_Register_createSASObject_fails_2)
 	setupRegisterHappyPatheventHTTPrequestHeaders(mocks, deallocateCreated);
 	setupRegisterHappyPathmessageHTTPrequestHeaders(mocks, deallocateCreated);
 	setupRegisterHappyPathabandonHTTPrelativePathBegin(mocks, deallocateCreated);
+	setupRegisterHappyPathabandonHTTPrequestHeaders(mocks, deallocateCreated);
 	STRICT_EXPECTED_CALL(mocks, URL_EncodeString(TEST_DEVICE_ID));
 	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG)) /*encoded device id*/
 		.IgnoreArgument(1);
@@ -2483,6 +2614,7 @@ TEST_FUNCTION(IoTHubTransportHttp_Register_createSASObject_fails_3)
 	setupRegisterHappyPatheventHTTPrequestHeaders(mocks, deallocateCreated);
 	setupRegisterHappyPathmessageHTTPrequestHeaders(mocks, deallocateCreated);
 	setupRegisterHappyPathabandonHTTPrelativePathBegin(mocks, deallocateCreated);
+	setupRegisterHappyPathabandonHTTPrequestHeaders(mocks, deallocateCreated);
 	STRICT_EXPECTED_CALL(mocks, URL_EncodeString(TEST_DEVICE_ID));
 	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG)) /*encoded device id*/
 		.IgnoreArgument(1);
@@ -2525,6 +2657,7 @@ TEST_FUNCTION(IoTHubTransportHttp_Register_createSASObject_fails_4)
 	setupRegisterHappyPatheventHTTPrequestHeaders(mocks, deallocateCreated);
 	setupRegisterHappyPathmessageHTTPrequestHeaders(mocks, deallocateCreated);
 	setupRegisterHappyPathabandonHTTPrelativePathBegin(mocks, deallocateCreated);
+	setupRegisterHappyPathabandonHTTPrequestHeaders(mocks, deallocateCreated);
 	STRICT_EXPECTED_CALL(mocks, URL_EncodeString(TEST_DEVICE_ID));
 	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG)) /*encoded device id*/
 		.IgnoreArgument(1);
@@ -2569,6 +2702,7 @@ TEST_FUNCTION(IoTHubTransportHttp_Register_createSASObject_fails_5)
 	setupRegisterHappyPatheventHTTPrequestHeaders(mocks, deallocateCreated);
 	setupRegisterHappyPathmessageHTTPrequestHeaders(mocks, deallocateCreated);
 	setupRegisterHappyPathabandonHTTPrelativePathBegin(mocks, deallocateCreated);
+	setupRegisterHappyPathabandonHTTPrequestHeaders(mocks, deallocateCreated);
 	STRICT_EXPECTED_CALL(mocks, URL_EncodeString(TEST_DEVICE_ID));
 	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG)) /*encoded device id*/
 		.IgnoreArgument(1);
@@ -2614,6 +2748,7 @@ TEST_FUNCTION(IoTHubTransportHttp_Register_createSASObject_fails_6)
 	setupRegisterHappyPatheventHTTPrequestHeaders(mocks, deallocateCreated);
 	setupRegisterHappyPathmessageHTTPrequestHeaders(mocks, deallocateCreated);
 	setupRegisterHappyPathabandonHTTPrelativePathBegin(mocks, deallocateCreated);
+	setupRegisterHappyPathabandonHTTPrequestHeaders(mocks, deallocateCreated);
 	STRICT_EXPECTED_CALL(mocks, URL_EncodeString(TEST_DEVICE_ID));
 	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG)) /*encoded device id*/
 		.IgnoreArgument(1);
@@ -2662,6 +2797,7 @@ TEST_FUNCTION(IoTHubTransportHttp_Register_createSASObject_fails_7)
 	setupRegisterHappyPatheventHTTPrequestHeaders(mocks, deallocateCreated);
 	setupRegisterHappyPathmessageHTTPrequestHeaders(mocks, deallocateCreated);
 	setupRegisterHappyPathabandonHTTPrelativePathBegin(mocks, deallocateCreated);
+	setupRegisterHappyPathabandonHTTPrequestHeaders(mocks, deallocateCreated);
 	STRICT_EXPECTED_CALL(mocks, URL_EncodeString(TEST_DEVICE_ID));
 	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG)) /*encoded device id*/
 		.IgnoreArgument(1);
@@ -2696,6 +2832,76 @@ TEST_FUNCTION(IoTHubTransportHttp_Register_createSASObject_fails_7)
 	IoTHubTransportHttp_Destroy(handle);
 }
 
+//Tests_SRS_TRANSPORTMULTITHTTP_02_012: [ If creating the abandon HTTP request headers fails then IoTHubTransportHttp_Register shall fail and return NULL. ]
+TEST_FUNCTION(IoTHubTransportHttp_Register_abandonHTTPrequestHeaders_fails_1)
+{
+	///arrange
+	CIoTHubTransportHttpMocks mocks;
+	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	mocks.ResetAllCalls();
+
+	bool deallocateCreated = true;
+	setupRegisterHappyPathNotFoundInList(mocks, deallocateCreated);
+	setupRegisterHappyPathAllocHandle(mocks, deallocateCreated);
+	setupRegisterHappyPathcreate_deviceId(mocks, deallocateCreated);
+	setupRegisterHappyPathcreate_deviceKey(mocks, deallocateCreated);
+	setupRegisterHappyPatheventHTTPrelativePath(mocks, deallocateCreated);
+	setupRegisterHappyPathmessageHTTPrelativePath(mocks, deallocateCreated);
+	setupRegisterHappyPatheventHTTPrequestHeaders(mocks, deallocateCreated);
+	setupRegisterHappyPathmessageHTTPrequestHeaders(mocks, deallocateCreated);
+	setupRegisterHappyPathabandonHTTPrelativePathBegin(mocks, deallocateCreated);
+	/*creating abandon HTTP request headers*/
+	whenShallHTTPHeaders_Alloc_fail = 3;
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc());
+
+	///act
+	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+
+	///assert
+	ASSERT_IS_NULL(devHandle);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubTransportHttp_Destroy(handle);
+}
+
+//Tests_SRS_TRANSPORTMULTITHTTP_02_012: [ If creating the abandon HTTP request headers fails then IoTHubTransportHttp_Register shall fail and return NULL. ]
+TEST_FUNCTION(IoTHubTransportHttp_Register_abandonHTTPrequestHeaders_fails_2)
+{
+	///arrange
+	CIoTHubTransportHttpMocks mocks;
+	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	mocks.ResetAllCalls();
+
+	bool deallocateCreated = true;
+	setupRegisterHappyPathNotFoundInList(mocks, deallocateCreated);
+	setupRegisterHappyPathAllocHandle(mocks, deallocateCreated);
+	setupRegisterHappyPathcreate_deviceId(mocks, deallocateCreated);
+	setupRegisterHappyPathcreate_deviceKey(mocks, deallocateCreated);
+	setupRegisterHappyPatheventHTTPrelativePath(mocks, deallocateCreated);
+	setupRegisterHappyPathmessageHTTPrelativePath(mocks, deallocateCreated);
+	setupRegisterHappyPatheventHTTPrequestHeaders(mocks, deallocateCreated);
+	setupRegisterHappyPathmessageHTTPrequestHeaders(mocks, deallocateCreated);
+	setupRegisterHappyPathabandonHTTPrelativePathBegin(mocks, deallocateCreated);
+	/*creating abandon HTTP request headers*/
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc());
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "User-Agent", CLIENT_DEVICE_TYPE_PREFIX CLIENT_DEVICE_BACKSLASH IOTHUB_SDK_VERSION))
+		.IgnoreArgument(1)
+		.SetReturn(HTTP_HEADERS_ERROR);
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+
+	///act
+	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+
+	///assert
+	ASSERT_IS_NULL(devHandle);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubTransportHttp_Destroy(handle);
+}
+
 //Tests_SRS_TRANSPORTMULTITHTTP_17_025: [ If creating the abandonHTTPrelativePathBegin fails then IoTHubTransportHttp_Register shall fail and return NULL. ]
 //Tests_SRS_TRANSPORTMULTITHTTP_17_030: [ IoTHubTransportHttp_Register shall invoke STRING_concat with arguments uriResource and the string "/devices/". ]
 TEST_FUNCTION(IoTHubTransportHttp_Register_abandonHTTPrelativePathBegin_fails_1)
@@ -4498,14 +4704,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, API_VERSION))
 		.IgnoreArgument(1);
 
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc());
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "User-Agent", CLIENT_DEVICE_TYPE_PREFIX CLIENT_DEVICE_BACKSLASH IOTHUB_SDK_VERSION))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "Authorization", TEST_BLANK_SAS_TOKEN))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "If-Match", TEST_ETAG_VALUE))
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "If-Match", TEST_ETAG_VALUE))
 		.IgnoreArgument(1);
 
 
@@ -4654,14 +4853,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_2device_with_2nd_empty_waiti
 	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, API_VERSION))
 		.IgnoreArgument(1);
 
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc());
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "User-Agent", CLIENT_DEVICE_TYPE_PREFIX CLIENT_DEVICE_BACKSLASH IOTHUB_SDK_VERSION))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "Authorization", TEST_BLANK_SAS_TOKEN))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "If-Match", TEST_ETAG_VALUE))
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "If-Match", TEST_ETAG_VALUE))
 		.IgnoreArgument(1);
 
 
@@ -4715,51 +4907,12 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_2devices_2nd_has_1_event_item_as_string
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
 		.IgnoreArgument(1);
 
-	/*starting to prepare the "big" payload*/
-	STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-
-	/*this is first batched payload*/
-	{
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message10.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":"));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetString(message10.messageHandle));
-
-		STRICT_EXPECTED_CALL(mocks, STRING_new_JSON(string10));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
-
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, ",\"base64Encoded\":false")) /*closing the value of the body*/
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message10.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3)
-			.IgnoreArgument(4);
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "},")) /* this extra "," is going to be harshly overwritten by a "]"*/
-			.IgnoreArgument(1);
-		/*end of the first batched payload*/
-	}
-
-	{
-		/*adding the first payload to the "big" payload*/
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
+	/*measuring the items, the ones that fit make the batch*/
+	setupBatchedItem(mocks, message10.messageHandle, TEST_MAP_EMPTY);
 
-		/*closing the "big" payload*/
-		STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, STRING_length(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-	}
+	/*the payload is allocated once and the batched items are written directly in it*/
+	setupBatchedPayload(mocks);
+	setupBatchedItem(mocks, message10.messageHandle, TEST_MAP_EMPTY);
 
 	/*building the list of messages to be notified if HTTP is fine*/
 	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
@@ -4767,22 +4920,6 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_2devices_2nd_has_1_event_item_as_string
 	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message10.entry)))
 		.IgnoreArgument(1);
 
-	{
-		/*this is building the HTTP payload... from a STRING_HANDLE (as it comes as "big payload"), into an array of bytes*/
-		STRICT_EXPECTED_CALL(mocks, BUFFER_new());
-		STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-
-		STRICT_EXPECTED_CALL(mocks, STRING_length(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, BUFFER_build(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2)
-			.IgnoreArgument(3);
-	}
-
 	/*executing HTTP goodies*/
 	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
 		.IgnoreArgument(1);
@@ -4912,14 +5049,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_2devices_2subscriptions_happy_path_succ
 		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, API_VERSION))
 			.IgnoreArgument(1);
 
-		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc());
-		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "User-Agent", CLIENT_DEVICE_TYPE_PREFIX CLIENT_DEVICE_BACKSLASH IOTHUB_SDK_VERSION))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "Authorization", TEST_BLANK_SAS_TOKEN))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "If-Match", TEST_ETAG_VALUE))
+		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "If-Match", TEST_ETAG_VALUE))
 			.IgnoreArgument(1);
 
 
@@ -5015,14 +5145,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_2devices_2subscriptions_happy_path_succ
 		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, API_VERSION))
 			.IgnoreArgument(1);
 
-		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc());
-		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "User-Agent", CLIENT_DEVICE_TYPE_PREFIX CLIENT_DEVICE_BACKSLASH IOTHUB_SDK_VERSION))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "Authorization", TEST_BLANK_SAS_TOKEN))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "If-Match", TEST_ETAG_VALUE))
+		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "If-Match", TEST_ETAG_VALUE))
 			.IgnoreArgument(1);
 
 
@@ -5144,14 +5267,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, API_VERSION))
 		.IgnoreArgument(1);
 
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc());
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "User-Agent", CLIENT_DEVICE_TYPE_PREFIX CLIENT_DEVICE_BACKSLASH IOTHUB_SDK_VERSION))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "Authorization", TEST_BLANK_SAS_TOKEN))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "If-Match", TEST_ETAG_VALUE))
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "If-Match", TEST_ETAG_VALUE))
 		.IgnoreArgument(1);
 
 
@@ -5273,14 +5389,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, API_VERSION))
 			.IgnoreArgument(1);
 
-		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc());
-		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "User-Agent", CLIENT_DEVICE_TYPE_PREFIX CLIENT_DEVICE_BACKSLASH IOTHUB_SDK_VERSION))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "Authorization", TEST_BLANK_SAS_TOKEN))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "If-Match", TEST_ETAG_VALUE))
+		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "If-Match", TEST_ETAG_VALUE))
 			.IgnoreArgument(1);
 
 
@@ -5408,14 +5517,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, API_VERSION))
 		.IgnoreArgument(1);
 
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc());
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "User-Agent", CLIENT_DEVICE_TYPE_PREFIX CLIENT_DEVICE_BACKSLASH IOTHUB_SDK_VERSION))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "Authorization", TEST_BLANK_SAS_TOKEN))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "If-Match", TEST_ETAG_VALUE))
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "If-Match", TEST_ETAG_VALUE))
 		.IgnoreArgument(1);
 
 
@@ -5571,14 +5673,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, API_VERSION))
 		.IgnoreArgument(1);
 
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc());
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "User-Agent", CLIENT_DEVICE_TYPE_PREFIX CLIENT_DEVICE_BACKSLASH IOTHUB_SDK_VERSION))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "Authorization", TEST_BLANK_SAS_TOKEN))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "If-Match", TEST_ETAG_VALUE))
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "If-Match", TEST_ETAG_VALUE))
 		.IgnoreArgument(1);
 
 
@@ -5694,14 +5789,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, API_VERSION))
 		.IgnoreArgument(1);
 
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc());
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "User-Agent", CLIENT_DEVICE_TYPE_PREFIX CLIENT_DEVICE_BACKSLASH IOTHUB_SDK_VERSION))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "Authorization", TEST_BLANK_SAS_TOKEN))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "If-Match", TEST_ETAG_VALUE))
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "If-Match", TEST_ETAG_VALUE))
 		.IgnoreArgument(1);
 
 
@@ -5817,14 +5905,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, API_VERSION))
 		.IgnoreArgument(1);
 
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc());
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "User-Agent", CLIENT_DEVICE_TYPE_PREFIX CLIENT_DEVICE_BACKSLASH IOTHUB_SDK_VERSION))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "Authorization", TEST_BLANK_SAS_TOKEN))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "If-Match", TEST_ETAG_VALUE))
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "If-Match", TEST_ETAG_VALUE))
 		.IgnoreArgument(1);
 
 
@@ -5858,7 +5939,8 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 }
 
 /*undefined behavior*/
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_acceptmessage_fails_at_HTTPHeaders_AddHeaderNameValuePair_succeeds_1)
+//Tests_SRS_TRANSPORTMULTITHTTP_02_013: [ Before abandoning, accepting or rejecting a message _DoWork shall set the "If-Match" header of the abandon HTTP request headers created by _Register to the value of ETag by calling HTTPHeaders_ReplaceHeaderNameValuePair. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_acceptmessage_fails_at_HTTPHeaders_ReplaceHeaderNameValuePair_succeeds)
 {
 	///arrange
 	CIoTHubTransportHttpMocks mocks;
@@ -5940,14 +6022,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, API_VERSION))
 		.IgnoreArgument(1);
 
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc());
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "User-Agent", CLIENT_DEVICE_TYPE_PREFIX CLIENT_DEVICE_BACKSLASH IOTHUB_SDK_VERSION))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "Authorization", TEST_BLANK_SAS_TOKEN))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "If-Match", TEST_ETAG_VALUE))
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "If-Match", TEST_ETAG_VALUE))
 		.IgnoreArgument(1)
 		.SetReturn(HTTP_HEADERS_ERROR);
 
@@ -5962,7 +6037,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 }
 
 /*undefined behavior*/
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_acceptmessage_fails_at_HTTPHeaders_AddHeaderNameValuePair_succeeds_2)
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_acceptmessage_fails_at_STRING_concat_succeeds_1)
 {
 	///arrange
 	CIoTHubTransportHttpMocks mocks;
@@ -6040,18 +6115,10 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 	STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
 		.IgnoreArgument(1)
 		.IgnoreArgument(2);
+	whenShallSTRING_concat_fail = currentSTRING_concat_call + 1;
 	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, API_VERSION))
 		.IgnoreArgument(1);
 
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc());
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "User-Agent", CLIENT_DEVICE_TYPE_PREFIX CLIENT_DEVICE_BACKSLASH IOTHUB_SDK_VERSION))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "Authorization", TEST_BLANK_SAS_TOKEN))
-		.IgnoreArgument(1)
-		.SetReturn(HTTP_HEADERS_ERROR);
-
 	///act
 	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
@@ -6062,8 +6129,8 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-/*undefined behavior*/
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_acceptmessage_fails_at_HTTPHeaders_Alloc_succeeds)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_088: [ If no such header is found or is invalid, then _DoWork shall advance to the next action. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_acceptmessage_fails_at_STRING_concat_with_STRING_succeeds_1)
 {
 	///arrange
 	CIoTHubTransportHttpMocks mocks;
@@ -6138,196 +6205,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 		.ValidateArgumentBuffer(1, TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1);
 	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, API_VERSION))
-		.IgnoreArgument(1);
-
-	whenShallHTTPHeaders_Alloc_fail = currentHTTPHeaders_Alloc_call + 2;
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc());
-
-
-	///act
-	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
-
-	///assert
-	mocks.AssertActualAndExpectedCalls();
-
-	///cleanup
-	IoTHubTransportHttp_Destroy(handle);
-}
-
-/*undefined behavior*/
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_acceptmessage_fails_at_STRING_concat_succeeds_1)
-{
-	///arrange
-	CIoTHubTransportHttpMocks mocks;
-	unsigned int statusCode200 = 200;
-	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
-	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
-
-	(void)IoTHubTransportHttp_Subscribe(devHandle);
-	mocks.ResetAllCalls();
-	setupDoWorkLoopOnceForOneDevice(mocks);
-
-	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
-
-	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-
-	STRICT_EXPECTED_CALL(mocks, BUFFER_new());
-	STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-
-	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-		.IgnoreArgument(1); /*because relativePath is a STRING_HANDLE*/
-	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
-		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
-		IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
-		HTTPAPI_REQUEST_GET,                                /*HTTPAPI_REQUEST_TYPE requestType,                            */
-		"/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP API_VERSION,    /*const char* relativePath,                                    */
-		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
-		NULL,                                               /*BUFFER_HANDLE requestContent,                                */
-		IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
-		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
-		IGNORED_PTR_ARG                                     /*BUFFER_HANDLE responseContent))                              */
-		))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2)
-		.IgnoreArgument(5)
-		.IgnoreArgument(7)
-		.IgnoreArgument(8)
-		.IgnoreArgument(9)
-		.CopyOutArgumentBuffer(7, &statusCode200, sizeof(statusCode200));
-
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_FindHeaderValue(IGNORED_PTR_ARG, "ETag"))
-		.IgnoreArgument(1)
-		.SetReturn(TEST_ETAG_VALUE);
-
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2);
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, BUFFER_u_char(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, BUFFER_length(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeaderCount(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2);
-
-	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_MessageCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2);
-
-	/*this returns "0" so the message needs to be "accepted"*/
-	/*this is "accepting"*/
-	STRICT_EXPECTED_CALL(mocks, STRING_clone(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_construct_n(TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1))
-		.ValidateArgumentBuffer(1, TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1);
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2);
-	whenShallSTRING_concat_fail = currentSTRING_concat_call + 1;
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, API_VERSION))
-		.IgnoreArgument(1);
-
-	///act
-	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
-
-	///assert
-	mocks.AssertActualAndExpectedCalls();
-
-	///cleanup
-	IoTHubTransportHttp_Destroy(handle);
-}
-
-//Tests_SRS_TRANSPORTMULTITHTTP_17_088: [ If no such header is found or is invalid, then _DoWork shall advance to the next action. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_acceptmessage_fails_at_STRING_concat_with_STRING_succeeds_1)
-{
-	///arrange
-	CIoTHubTransportHttpMocks mocks;
-	unsigned int statusCode200 = 200;
-	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
-	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
-
-	(void)IoTHubTransportHttp_Subscribe(devHandle);
-	mocks.ResetAllCalls();
-	setupDoWorkLoopOnceForOneDevice(mocks);
-
-	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
-
-	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-
-	STRICT_EXPECTED_CALL(mocks, BUFFER_new());
-	STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-
-	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-		.IgnoreArgument(1); /*because relativePath is a STRING_HANDLE*/
-	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
-		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
-		IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
-		HTTPAPI_REQUEST_GET,                                /*HTTPAPI_REQUEST_TYPE requestType,                            */
-		"/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP API_VERSION,    /*const char* relativePath,                                    */
-		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
-		NULL,                                               /*BUFFER_HANDLE requestContent,                                */
-		IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
-		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
-		IGNORED_PTR_ARG                                     /*BUFFER_HANDLE responseContent))                              */
-		))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2)
-		.IgnoreArgument(5)
-		.IgnoreArgument(7)
-		.IgnoreArgument(8)
-		.IgnoreArgument(9)
-		.CopyOutArgumentBuffer(7, &statusCode200, sizeof(statusCode200));
-
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_FindHeaderValue(IGNORED_PTR_ARG, "ETag"))
-		.IgnoreArgument(1)
-		.SetReturn(TEST_ETAG_VALUE);
-
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2);
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, BUFFER_u_char(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, BUFFER_length(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeaderCount(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2);
-
-	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_MessageCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2);
-
-	/*this returns "0" so the message needs to be "accepted"*/
-	/*this is "accepting"*/
-	STRICT_EXPECTED_CALL(mocks, STRING_clone(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_construct_n(TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1))
-		.ValidateArgumentBuffer(1, TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1);
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	whenShallSTRING_concat_with_STRING_fail = currentSTRING_concat_with_STRING_call + 1;
+	whenShallSTRING_concat_with_STRING_fail = currentSTRING_concat_with_STRING_call + 1;
 	STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
 		.IgnoreArgument(1)
 		.IgnoreArgument(2);
@@ -6618,14 +6496,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, API_VERSION REJECT_QUERY_PARAMETER))
 		.IgnoreArgument(1);
 
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc());
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "User-Agent", CLIENT_DEVICE_TYPE_PREFIX CLIENT_DEVICE_BACKSLASH IOTHUB_SDK_VERSION))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "Authorization", TEST_BLANK_SAS_TOKEN))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "If-Match", TEST_ETAG_VALUE))
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "If-Match", TEST_ETAG_VALUE))
 		.IgnoreArgument(1);
 
 
@@ -6741,14 +6612,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, API_VERSION REJECT_QUERY_PARAMETER))
 		.IgnoreArgument(1);
 
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc());
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "User-Agent", CLIENT_DEVICE_TYPE_PREFIX CLIENT_DEVICE_BACKSLASH IOTHUB_SDK_VERSION))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "Authorization", TEST_BLANK_SAS_TOKEN))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "If-Match", TEST_ETAG_VALUE))
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "If-Match", TEST_ETAG_VALUE))
 		.IgnoreArgument(1);
 
 
@@ -6864,14 +6728,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, API_VERSION REJECT_QUERY_PARAMETER))
 		.IgnoreArgument(1);
 
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc());
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "User-Agent", CLIENT_DEVICE_TYPE_PREFIX CLIENT_DEVICE_BACKSLASH IOTHUB_SDK_VERSION))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "Authorization", TEST_BLANK_SAS_TOKEN))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "If-Match", TEST_ETAG_VALUE))
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "If-Match", TEST_ETAG_VALUE))
 		.IgnoreArgument(1);
 
 
@@ -6906,7 +6763,8 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 }
 
 //Tests_SRS_TRANSPORTMULTITHTTP_17_095: [ If IoTHubClient_LL_MessageCallback returns IOTHUBMESSAGE_REJECTED then _DoWork shall "reject" the message. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_with_HTTPHeaders_AddHeaderNameValuePair_fails_succeeds_1)
+//Tests_SRS_TRANSPORTMULTITHTTP_02_013: [ Before abandoning, accepting or rejecting a message _DoWork shall set the "If-Match" header of the abandon HTTP request headers created by _Register to the value of ETag by calling HTTPHeaders_ReplaceHeaderNameValuePair. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_with_HTTPHeaders_ReplaceHeaderNameValuePair_fails_succeeds)
 {
 	///arrange
 	CIoTHubTransportHttpMocks mocks;
@@ -6987,14 +6845,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, API_VERSION REJECT_QUERY_PARAMETER))
 		.IgnoreArgument(1);
 
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc());
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "User-Agent", CLIENT_DEVICE_TYPE_PREFIX CLIENT_DEVICE_BACKSLASH IOTHUB_SDK_VERSION))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "Authorization", TEST_BLANK_SAS_TOKEN))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "If-Match", TEST_ETAG_VALUE))
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "If-Match", TEST_ETAG_VALUE))
 		.IgnoreArgument(1)
 		.SetReturn(HTTP_HEADERS_ERROR);
 
@@ -7010,7 +6861,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 }
 
 //Tests_SRS_TRANSPORTMULTITHTTP_17_095: [ If IoTHubClient_LL_MessageCallback returns IOTHUBMESSAGE_REJECTED then _DoWork shall "reject" the message. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_with_HTTPHeaders_AddHeaderNameValuePair_fails_succeeds_2)
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_with_STRING_concat_fails_succeeds_1)
 {
 	///arrange
 	CIoTHubTransportHttpMocks mocks;
@@ -7074,9 +6925,9 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_MessageCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
 		.IgnoreArgument(1)
 		.IgnoreArgument(2)
-		.SetReturn(IOTHUBMESSAGE_REJECTED); /*1 means "do not acept it"*/
+		.SetReturn(IOTHUBMESSAGE_REJECTED);
 
-											/*this is "reject"*/
+	/*this is "reject"*/
 	STRICT_EXPECTED_CALL(mocks, STRING_clone(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
 	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
@@ -7088,19 +6939,10 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 	STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
 		.IgnoreArgument(1)
 		.IgnoreArgument(2);
+	whenShallSTRING_concat_fail = currentSTRING_concat_call + 1;
 	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, API_VERSION REJECT_QUERY_PARAMETER))
 		.IgnoreArgument(1);
 
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc());
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "User-Agent", CLIENT_DEVICE_TYPE_PREFIX CLIENT_DEVICE_BACKSLASH IOTHUB_SDK_VERSION))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "Authorization", TEST_BLANK_SAS_TOKEN))
-		.IgnoreArgument(1)
-		.SetReturn(HTTP_HEADERS_ERROR);
-
-
 	///act
 	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
@@ -7112,7 +6954,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 }
 
 //Tests_SRS_TRANSPORTMULTITHTTP_17_095: [ If IoTHubClient_LL_MessageCallback returns IOTHUBMESSAGE_REJECTED then _DoWork shall "reject" the message. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_with_HTTPHeaders_Alloc_fails_succeeds)
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_with_STRING_concat_with_STRING_fails_succeeds_2)
 {
 	///arrange
 	CIoTHubTransportHttpMocks mocks;
@@ -7187,14 +7029,10 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 		.ValidateArgumentBuffer(1, TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1);
 	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
+	whenShallSTRING_concat_with_STRING_fail = currentSTRING_concat_with_STRING_call + 1;
 	STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
 		.IgnoreArgument(1)
 		.IgnoreArgument(2);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, API_VERSION REJECT_QUERY_PARAMETER))
-		.IgnoreArgument(1);
-
-	whenShallHTTPHeaders_Alloc_fail = currentHTTPHeaders_Alloc_call + 2;
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc());
 
 	///act
 	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
@@ -7207,7 +7045,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 }
 
 //Tests_SRS_TRANSPORTMULTITHTTP_17_095: [ If IoTHubClient_LL_MessageCallback returns IOTHUBMESSAGE_REJECTED then _DoWork shall "reject" the message. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_with_STRING_concat_fails_succeeds_1)
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_with_STRING_construct_n_fails_succeeds_2)
 {
 	///arrange
 	CIoTHubTransportHttpMocks mocks;
@@ -7278,16 +7116,9 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 		.IgnoreArgument(1);
 	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
+	whenShallSTRING_construct_n_fail = currentSTRING_construct_n_call + 1;
 	STRICT_EXPECTED_CALL(mocks, STRING_construct_n(TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1))
 		.ValidateArgumentBuffer(1, TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1);
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2);
-	whenShallSTRING_concat_fail = currentSTRING_concat_call + 1;
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, API_VERSION REJECT_QUERY_PARAMETER))
-		.IgnoreArgument(1);
 
 	///act
 	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
@@ -7300,7 +7131,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 }
 
 //Tests_SRS_TRANSPORTMULTITHTTP_17_095: [ If IoTHubClient_LL_MessageCallback returns IOTHUBMESSAGE_REJECTED then _DoWork shall "reject" the message. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_with_STRING_concat_with_STRING_fails_succeeds_2)
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_with_STRING_clone_fails_succeeds)
 {
 	///arrange
 	CIoTHubTransportHttpMocks mocks;
@@ -7367,184 +7198,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 		.SetReturn(IOTHUBMESSAGE_REJECTED);
 
 	/*this is "reject"*/
-	STRICT_EXPECTED_CALL(mocks, STRING_clone(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_construct_n(TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1))
-		.ValidateArgumentBuffer(1, TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1);
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	whenShallSTRING_concat_with_STRING_fail = currentSTRING_concat_with_STRING_call + 1;
-	STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2);
-
-	///act
-	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
-
-	///assert
-	mocks.AssertActualAndExpectedCalls();
-
-	///cleanup
-	IoTHubTransportHttp_Destroy(handle);
-}
-
-//Tests_SRS_TRANSPORTMULTITHTTP_17_095: [ If IoTHubClient_LL_MessageCallback returns IOTHUBMESSAGE_REJECTED then _DoWork shall "reject" the message. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_with_STRING_construct_n_fails_succeeds_2)
-{
-	///arrange
-	CIoTHubTransportHttpMocks mocks;
-	unsigned int statusCode200 = 200;
-	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
-	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
-
-	(void)IoTHubTransportHttp_Subscribe(devHandle);
-	mocks.ResetAllCalls();
-	setupDoWorkLoopOnceForOneDevice(mocks);
-
-	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
-
-	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-
-	STRICT_EXPECTED_CALL(mocks, BUFFER_new());
-	STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-
-	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-		.IgnoreArgument(1); /*because relativePath is a STRING_HANDLE*/
-	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
-		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
-		IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
-		HTTPAPI_REQUEST_GET,                                /*HTTPAPI_REQUEST_TYPE requestType,                            */
-		"/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP API_VERSION,    /*const char* relativePath,                                    */
-		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
-		NULL,                                               /*BUFFER_HANDLE requestContent,                                */
-		IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
-		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
-		IGNORED_PTR_ARG                                     /*BUFFER_HANDLE responseContent))                              */
-		))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2)
-		.IgnoreArgument(5)
-		.IgnoreArgument(7)
-		.IgnoreArgument(8)
-		.IgnoreArgument(9)
-		.CopyOutArgumentBuffer(7, &statusCode200, sizeof(statusCode200));
-
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_FindHeaderValue(IGNORED_PTR_ARG, "ETag"))
-		.IgnoreArgument(1)
-		.SetReturn(TEST_ETAG_VALUE);
-
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2);
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, BUFFER_u_char(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, BUFFER_length(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeaderCount(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2);
-
-	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_MessageCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2)
-		.SetReturn(IOTHUBMESSAGE_REJECTED);
-
-	/*this is "reject"*/
-	STRICT_EXPECTED_CALL(mocks, STRING_clone(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	whenShallSTRING_construct_n_fail = currentSTRING_construct_n_call + 1;
-	STRICT_EXPECTED_CALL(mocks, STRING_construct_n(TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1))
-		.ValidateArgumentBuffer(1, TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1);
-
-	///act
-	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
-
-	///assert
-	mocks.AssertActualAndExpectedCalls();
-
-	///cleanup
-	IoTHubTransportHttp_Destroy(handle);
-}
-
-//Tests_SRS_TRANSPORTMULTITHTTP_17_095: [ If IoTHubClient_LL_MessageCallback returns IOTHUBMESSAGE_REJECTED then _DoWork shall "reject" the message. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_with_STRING_clone_fails_succeeds)
-{
-	///arrange
-	CIoTHubTransportHttpMocks mocks;
-	unsigned int statusCode200 = 200;
-	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
-	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
-
-	(void)IoTHubTransportHttp_Subscribe(devHandle);
-	mocks.ResetAllCalls();
-	setupDoWorkLoopOnceForOneDevice(mocks);
-
-	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
-
-	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-
-	STRICT_EXPECTED_CALL(mocks, BUFFER_new());
-	STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-
-	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-		.IgnoreArgument(1); /*because relativePath is a STRING_HANDLE*/
-	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
-		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
-		IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
-		HTTPAPI_REQUEST_GET,                                /*HTTPAPI_REQUEST_TYPE requestType,                            */
-		"/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP API_VERSION,    /*const char* relativePath,                                    */
-		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
-		NULL,                                               /*BUFFER_HANDLE requestContent,                                */
-		IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
-		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
-		IGNORED_PTR_ARG                                     /*BUFFER_HANDLE responseContent))                              */
-		))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2)
-		.IgnoreArgument(5)
-		.IgnoreArgument(7)
-		.IgnoreArgument(8)
-		.IgnoreArgument(9)
-		.CopyOutArgumentBuffer(7, &statusCode200, sizeof(statusCode200));
-
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_FindHeaderValue(IGNORED_PTR_ARG, "ETag"))
-		.IgnoreArgument(1)
-		.SetReturn(TEST_ETAG_VALUE);
-
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2);
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, BUFFER_u_char(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, BUFFER_length(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeaderCount(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2);
-
-	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_MessageCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2)
-		.SetReturn(IOTHUBMESSAGE_REJECTED);
-
-	/*this is "reject"*/
-	whenShallSTRING_clone_fail = currentSTRING_clone_call + 1;
+	whenShallSTRING_clone_fail = currentSTRING_clone_call + 1;
 	STRICT_EXPECTED_CALL(mocks, STRING_clone(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
 
@@ -7633,14 +7287,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "/abandon" API_VERSION))
 		.IgnoreArgument(1);
 
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc());
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "User-Agent", CLIENT_DEVICE_TYPE_PREFIX CLIENT_DEVICE_BACKSLASH IOTHUB_SDK_VERSION))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "Authorization", TEST_BLANK_SAS_TOKEN))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "If-Match", TEST_ETAG_VALUE))
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "If-Match", TEST_ETAG_VALUE))
 		.IgnoreArgument(1);
 
 
@@ -8246,55 +7893,12 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_happy_path_succeeds)
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
 		.IgnoreArgument(1);
 
-	EXPECTED_CALL(mocks, STRING_new_with_memory(IGNORED_PTR_ARG));
-
-	/*starting to prepare the "big" payload*/
-	STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-
-	/*this is first batched payload*/
-	{
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message1.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":\""));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(message1.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3);
-
-		STRICT_EXPECTED_CALL(mocks, Base64_Encode_Bytes(buffer1, buffer1_size));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
-
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\"")) /*closing the value of the body*/
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message1.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3)
-			.IgnoreArgument(4);
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "},")) /* this extra "," is going to be harshly overwritten by a "]"*/
-			.IgnoreArgument(1);
-		/*end of the first batched payload*/
-	}
-
-	{
-		/*adding the first payload to the "big" payload*/
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
+	/*measuring the items, the ones that fit make the batch*/
+	setupBatchedItem(mocks, message1.messageHandle, TEST_MAP_EMPTY);
 
-		/*closing the "big" payload*/
-		STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, STRING_length(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-	}
+	/*the payload is allocated once and the batched items are written directly in it*/
+	setupBatchedPayload(mocks);
+	setupBatchedItem(mocks, message1.messageHandle, TEST_MAP_EMPTY);
 
 	/*building the list of messages to be notified if HTTP is fine*/
 	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
@@ -8302,22 +7906,6 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_happy_path_succeeds)
 	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message1.entry)))
 		.IgnoreArgument(1);
 
-	{
-		/*this is building the HTTP payload... from a STRING_HANDLE (as it comes as "big payload"), into an array of bytes*/
-		STRICT_EXPECTED_CALL(mocks, BUFFER_new());
-		STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-
-		STRICT_EXPECTED_CALL(mocks, STRING_length(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, BUFFER_build(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2)
-			.IgnoreArgument(3);
-	}
-
 	/*executing HTTP goodies*/
 	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
 		.IgnoreArgument(1);
@@ -8373,55 +7961,12 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_puts_it_back_when_ht
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
 		.IgnoreArgument(1);
 
-	/*starting to prepare the "big" payload*/
-	STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-
-	EXPECTED_CALL(mocks, STRING_new_with_memory(IGNORED_PTR_ARG));
+	/*measuring the items, the ones that fit make the batch*/
+	setupBatchedItem(mocks, message1.messageHandle, TEST_MAP_EMPTY);
 
-	/*this is first batched payload*/
-	{
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message1.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":\""));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(message1.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3);
-
-		STRICT_EXPECTED_CALL(mocks, Base64_Encode_Bytes(buffer1, buffer1_size));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
-
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\"")) /*closing the value of the body*/
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message1.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3)
-			.IgnoreArgument(4);
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "},")) /* this extra "," is going to be harshly overwritten by a "]"*/
-			.IgnoreArgument(1);
-		/*end of the first batched payload*/
-	}
-
-	{
-		/*adding the first payload to the "big" payload*/
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
-
-		/*closing the "big" payload*/
-		STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, STRING_length(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-	}
+	/*the payload is allocated once and the batched items are written directly in it*/
+	setupBatchedPayload(mocks);
+	setupBatchedItem(mocks, message1.messageHandle, TEST_MAP_EMPTY);
 
 	/*building the list of messages to be notified if HTTP is fine*/
 	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
@@ -8429,22 +7974,6 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_puts_it_back_when_ht
 	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message1.entry)))
 		.IgnoreArgument(1);
 
-	{
-		/*this is building the HTTP payload... from a STRING_HANDLE (as it comes as "big payload"), into an array of bytes*/
-		STRICT_EXPECTED_CALL(mocks, BUFFER_new());
-		STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-
-		STRICT_EXPECTED_CALL(mocks, STRING_length(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, BUFFER_build(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2)
-			.IgnoreArgument(3);
-	}
-
 	/*executing HTTP goodies*/
 	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
 		.IgnoreArgument(1);
@@ -8499,55 +8028,12 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_puts_it_back_when_HT
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
 		.IgnoreArgument(1);
 
-	EXPECTED_CALL(mocks, STRING_new_with_memory(IGNORED_PTR_ARG));
-
-	/*starting to prepare the "big" payload*/
-	STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-
-	/*this is first batched payload*/
-	{
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message1.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":\""));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(message1.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3);
-
-		STRICT_EXPECTED_CALL(mocks, Base64_Encode_Bytes(buffer1, buffer1_size));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
-
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\"")) /*closing the value of the body*/
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message1.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3)
-			.IgnoreArgument(4);
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "},")) /* this extra "," is going to be harshly overwritten by a "]"*/
-			.IgnoreArgument(1);
-		/*end of the first batched payload*/
-	}
-
-	{
-		/*adding the first payload to the "big" payload*/
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
+	/*measuring the items, the ones that fit make the batch*/
+	setupBatchedItem(mocks, message1.messageHandle, TEST_MAP_EMPTY);
 
-		/*closing the "big" payload*/
-		STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, STRING_length(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-	}
+	/*the payload is allocated once and the batched items are written directly in it*/
+	setupBatchedPayload(mocks);
+	setupBatchedItem(mocks, message1.messageHandle, TEST_MAP_EMPTY);
 
 	/*building the list of messages to be notified if HTTP is fine*/
 	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
@@ -8555,22 +8041,6 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_puts_it_back_when_HT
 	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message1.entry)))
 		.IgnoreArgument(1);
 
-	{
-		/*this is building the HTTP payload... from a STRING_HANDLE (as it comes as "big payload"), into an array of bytes*/
-		STRICT_EXPECTED_CALL(mocks, BUFFER_new());
-		STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-
-		STRICT_EXPECTED_CALL(mocks, STRING_length(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, BUFFER_build(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2)
-			.IgnoreArgument(3);
-	}
-
 	/*executing HTTP goodies*/
 	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
 		.IgnoreArgument(1);
@@ -8609,7 +8079,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_puts_it_back_when_HT
 }
 
 //Tests_SRS_TRANSPORTMULTITHTTP_17_067: [ If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_puts_it_back_when_BUFFER_build_fails)
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_leaves_it_in_waitingToSend_when_BUFFER_pre_build_fails)
 {
 	///arrange
 	CIoTHubTransportHttpMocks mocks;
@@ -8626,84 +8096,17 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_puts_it_back_when_BU
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
 		.IgnoreArgument(1);
 
-	EXPECTED_CALL(mocks, STRING_new_with_memory(IGNORED_PTR_ARG));
-
-	/*starting to prepare the "big" payload*/
-	STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-
-	/*this is first batched payload*/
-	{
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message1.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":\""));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(message1.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3);
-
-		STRICT_EXPECTED_CALL(mocks, Base64_Encode_Bytes(buffer1, buffer1_size));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
-
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\"")) /*closing the value of the body*/
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message1.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3)
-			.IgnoreArgument(4);
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "},")) /* this extra "," is going to be harshly overwritten by a "]"*/
-			.IgnoreArgument(1);
-		/*end of the first batched payload*/
-	}
-
-	{
-		/*adding the first payload to the "big" payload*/
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
-
-		/*closing the "big" payload*/
-		STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, STRING_length(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-	}
+	/*measuring the items, the ones that fit make the batch*/
+	setupBatchedItem(mocks, message1.messageHandle, TEST_MAP_EMPTY);
 
-	/*building the list of messages to be notified if HTTP is fine*/
-	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message1.entry)))
+	/*the payload cannot be allocated, the item is not taken out of waitingToSend*/
+	STRICT_EXPECTED_CALL(mocks, BUFFER_new());
+	STRICT_EXPECTED_CALL(mocks, BUFFER_pre_build(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+		.IgnoreAllArguments()
+		.SetReturn(__LINE__);
+	STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
 
-	{
-		/*this is building the HTTP payload... from a STRING_HANDLE (as it comes as "big payload"), into an array of bytes*/
-		STRICT_EXPECTED_CALL(mocks, BUFFER_new());
-		STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-
-		STRICT_EXPECTED_CALL(mocks, STRING_length(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		whenShallBUFFER_build_fail = 1;
-		STRICT_EXPECTED_CALL(mocks, BUFFER_build(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2)
-			.IgnoreArgument(3)
-			.SetReturn(__LINE__);
-	}
-
-	STRICT_EXPECTED_CALL(mocks, DList_AppendTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG)).IgnoreAllArguments();
-	STRICT_EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG)).IgnoreAllArguments();
-	STRICT_EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG)).IgnoreAllArguments();
-
 	ENABLE_BATCHING();
 
 	///act
@@ -8711,13 +8114,14 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_puts_it_back_when_BU
 
 	///assert
 	mocks.AssertActualAndExpectedCalls();
+	ASSERT_ARE_EQUAL(void_ptr, &(message1.entry), waitingToSend.Flink);
 
 	///cleanup
 	IoTHubTransportHttp_Destroy(handle);
 }
 
 //Tests_SRS_TRANSPORTMULTITHTTP_17_067: [ If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_puts_it_back_when_BUFFER_new_fails)
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_leaves_it_in_waitingToSend_when_BUFFER_new_fails)
 {
 	///arrange
 	CIoTHubTransportHttpMocks mocks;
@@ -8734,71 +8138,12 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_puts_it_back_when_BU
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
 		.IgnoreArgument(1);
 
-	EXPECTED_CALL(mocks, STRING_new_with_memory(IGNORED_PTR_ARG));
-
-	/*starting to prepare the "big" payload*/
-	STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-
-	/*this is first batched payload*/
-	{
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message1.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":\""));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(message1.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3);
-
-		STRICT_EXPECTED_CALL(mocks, Base64_Encode_Bytes(buffer1, buffer1_size));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
-
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\"")) /*closing the value of the body*/
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message1.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3)
-			.IgnoreArgument(4);
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "},")) /* this extra "," is going to be harshly overwritten by a "]"*/
-			.IgnoreArgument(1);
-		/*end of the first batched payload*/
-	}
-
-	{
-		/*adding the first payload to the "big" payload*/
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
-
-		/*closing the "big" payload*/
-		STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, STRING_length(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-	}
-
-	/*building the list of messages to be notified if HTTP is fine*/
-	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message1.entry)))
-		.IgnoreArgument(1);
-
-	{
-		/*this is building the HTTP payload... from a STRING_HANDLE (as it comes as "big payload"), into an array of bytes*/
-		whenShallBUFFER_new_fail = 1;
-		STRICT_EXPECTED_CALL(mocks, BUFFER_new());
-	}
+	/*measuring the items, the ones that fit make the batch*/
+	setupBatchedItem(mocks, message1.messageHandle, TEST_MAP_EMPTY);
 
-	STRICT_EXPECTED_CALL(mocks, DList_AppendTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG)).IgnoreAllArguments();
-	STRICT_EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG)).IgnoreAllArguments();
-	STRICT_EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG)).IgnoreAllArguments();
+	/*the payload cannot be allocated, the item is not taken out of waitingToSend*/
+	whenShallBUFFER_new_fail = 1;
+	STRICT_EXPECTED_CALL(mocks, BUFFER_new());
 
 	ENABLE_BATCHING();
 
@@ -8807,13 +8152,14 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_puts_it_back_when_BU
 
 	///assert
 	mocks.AssertActualAndExpectedCalls();
+	ASSERT_ARE_EQUAL(void_ptr, &(message1.entry), waitingToSend.Flink);
 
 	///cleanup
 	IoTHubTransportHttp_Destroy(handle);
 }
 
 //Tests_SRS_TRANSPORTMULTITHTTP_17_067: [ If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_STRING_concat_with_STRING_fails_it_fails)
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_IoTHubMessage_GetByteArray_it_fails)
 {
 	///arrange
 	CIoTHubTransportHttpMocks mocks;
@@ -8830,50 +8176,12 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_STRING_concat_wi
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
 		.IgnoreArgument(1);
 
-	EXPECTED_CALL(mocks, STRING_new_with_memory(IGNORED_PTR_ARG));
-
-	/*starting to prepare the "big" payload*/
-	STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-
-	/*this is first batched payload*/
-	{
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message1.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":\""));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(message1.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3);
-
-		STRICT_EXPECTED_CALL(mocks, Base64_Encode_Bytes(buffer1, buffer1_size));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
-
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\"")) /*closing the value of the body*/
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message1.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3)
-			.IgnoreArgument(4);
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "},")) /* this extra "," is going to be harshly overwritten by a "]"*/
-			.IgnoreArgument(1);
-		/*end of the first batched payload*/
-	}
-
-	{
-		/*adding the first payload to the "big" payload*/
-		whenShallSTRING_concat_with_STRING_fail = 7;
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
-	}
+	/*measuring the first item fails*/
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message1.messageHandle));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(message1.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3)
+		.SetReturn(IOTHUB_MESSAGE_ERROR);
 
 	ENABLE_BATCHING();
 
@@ -8887,8 +8195,8 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_STRING_concat_wi
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_067: [ If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_STRING_concat_it_fails)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_055: [ If updating Content-Type fails for any reason, then _DoWork shall advance to the next action. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_HTTP_headers_fails_it_fails)
 {
 	///arrange
 	CIoTHubTransportHttpMocks mocks;
@@ -8903,46 +8211,8 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_STRING_concat_it
 	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
 
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
-		.IgnoreArgument(1);
-
-	EXPECTED_CALL(mocks, STRING_new_with_memory(IGNORED_PTR_ARG));
-
-	/*starting to prepare the "big" payload*/
-	STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-
-	/*this is first batched payload*/
-	{
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message1.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":\""));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(message1.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3);
-
-		STRICT_EXPECTED_CALL(mocks, Base64_Encode_Bytes(buffer1, buffer1_size));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
-
-
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\"")) /*closing the value of the body*/
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message1.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3)
-			.IgnoreArgument(4);
-		whenShallSTRING_concat_fail = currentSTRING_concat_call + 2;
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "},")) /* this extra "," is going to be harshly overwritten by a "]"*/
-			.IgnoreArgument(1);
-		/*end of the first batched payload*/
-	}
+		.IgnoreArgument(1)
+		.SetReturn(HTTP_HEADERS_ERROR);
 
 	ENABLE_BATCHING();
 
@@ -8956,12 +8226,14 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_STRING_concat_it
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_067: [ If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_STRING_concat_it_fails_2)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_065: [ If the oldest message in waitingToSend causes the message size to exceed the message size limit then it shall be removed from waitingToSend, and IoTHubClient_LL_SendComplete shall be called. Parameter PDLIST_ENTRY completed shall point to a list containing only the oldest item, and parameter IOTHUB_BATCHSTATE result shall be set to IOTHUB_BATCHSTATE_FAILED. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_061: [ The message size shall be limited to 255KB - 1 byte. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_062: [ The message size is computed from the length of the payload + 384. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_bigger_than_256K_path_succeeds)
 {
 	///arrange
 	CIoTHubTransportHttpMocks mocks;
-	DList_InsertTailList(&(waitingToSend), &(message1.entry));
+	DList_InsertTailList(&(waitingToSend), &(message4.entry));
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
 	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
@@ -8974,37 +8246,17 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_STRING_concat_it
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
 		.IgnoreArgument(1);
 
-	EXPECTED_CALL(mocks, STRING_new_with_memory(IGNORED_PTR_ARG));
+	/*measuring the first item, it is too big to ever be sent*/
+	setupBatchedItem(mocks, message4.messageHandle, TEST_MAP_EMPTY);
 
-	/*starting to prepare the "big" payload*/
-	STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+	/*building the list of messages to be notified because this is 100% fail (>256K)*/
+	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message4.entry)))
 		.IgnoreArgument(1);
 
-	/*this is first batched payload*/
-	{
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message1.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":\""));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(message1.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3);
-
-		STRICT_EXPECTED_CALL(mocks, Base64_Encode_Bytes(buffer1, buffer1_size));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
-
-
-		whenShallSTRING_concat_fail = currentSTRING_concat_call + 1;
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\"")) /*closing the value of the body*/
-			.IgnoreArgument(1);
-		/*end of the first batched payload*/
-	}
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_FAILED))
+		.IgnoreArgument(2);
 
 	ENABLE_BATCHING();
 
@@ -9018,12 +8270,13 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_STRING_concat_it
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_067: [ If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_STRING_concat_with_STRING_it_fails_2)
+/*this is a test that wants to see that "almost" 255KB message still fits*/
+//Tests_SRS_TRANSPORTMULTITHTTP_17_062: [ The message size is computed from the length of the payload + 384. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_almost255_happy_path_succeeds)
 {
 	///arrange
 	CIoTHubTransportHttpMocks mocks;
-	DList_InsertTailList(&(waitingToSend), &(message1.entry));
+	DList_InsertTailList(&(waitingToSend), &(message5.entry));
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
 	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
@@ -9036,33 +8289,43 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_STRING_concat_wi
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
 		.IgnoreArgument(1);
 
-	EXPECTED_CALL(mocks, STRING_new_with_memory(IGNORED_PTR_ARG));
+	/*measuring the items, the ones that fit make the batch*/
+	setupBatchedItem(mocks, message5.messageHandle, TEST_MAP_EMPTY);
 
-	/*starting to prepare the "big" payload*/
-	STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
+	/*the payload is allocated once and the batched items are written directly in it*/
+	setupBatchedPayload(mocks);
+	setupBatchedItem(mocks, message5.messageHandle, TEST_MAP_EMPTY);
 
-	/*this is first batched payload*/
-	{
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message1.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":\""));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(message1.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3);
+	/*building the list of messages to be notified if HTTP is fine*/
+	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message5.entry)))
+		.IgnoreArgument(1);
 
-		STRICT_EXPECTED_CALL(mocks, Base64_Encode_Bytes(buffer1, buffer1_size));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
+	/*executing HTTP goodies*/
+	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
+		IGNORED_PTR_ARG,
+		HTTPAPI_REQUEST_POST,                                                           /*HTTPAPI_REQUEST_TYPE requestType,                  */
+		"/devices/" TEST_DEVICE_ID EVENT_ENDPOINT API_VERSION,                 /*const char* relativePath,                          */
+		IGNORED_PTR_ARG,                                                                /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,      */
+		IGNORED_PTR_ARG,                                                                /*BUFFER_HANDLE requestContent,                      */
+		IGNORED_PTR_ARG,                                                                /*unsigned int* statusCode,                          */
+		NULL,                                                                           /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,     */
+		NULL                                                                            /*BUFFER_HANDLE responseContent)                     */
+		))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2)
+		.IgnoreArgument(5)
+		.IgnoreArgument(6)
+		.CopyOutArgumentBuffer(7, &httpStatus200, sizeof(httpStatus200));
 
-		whenShallSTRING_concat_with_STRING_fail = 6;
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
-		/*end of the first batched payload*/
-	}
+	/*once the event has been succesfull...*/
+
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_SUCCESS))
+		.IgnoreArgument(2);
 
 	ENABLE_BATCHING();
 
@@ -9076,12 +8339,13 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_STRING_concat_wi
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_067: [ If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_Base64_Encode_Bytes_it_fails)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_056: [ IoTHubTransportHttp_DoWork shall build the following string:[{"body":"base64 encoding of the message1 content"},{"body":"base64 encoding of the message2 content"}...] ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_2_event_items_makes_1_batch_succeeds)
 {
 	///arrange
 	CIoTHubTransportHttpMocks mocks;
 	DList_InsertTailList(&(waitingToSend), &(message1.entry));
+	DList_InsertTailList(&(waitingToSend), &(message2.entry));
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
 	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
@@ -9094,25 +8358,49 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_Base64_Encode_By
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
 		.IgnoreArgument(1);
 
-	/*starting to prepare the "big" payload*/
-	STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+	/*measuring the items, the ones that fit make the batch*/
+	setupBatchedItem(mocks, message1.messageHandle, TEST_MAP_EMPTY);
+	setupBatchedItem(mocks, message2.messageHandle, TEST_MAP_EMPTY);
+
+	/*the payload is allocated once and the batched items are written directly in it*/
+	setupBatchedPayload(mocks);
+	setupBatchedItem(mocks, message1.messageHandle, TEST_MAP_EMPTY);
+	setupBatchedItem(mocks, message2.messageHandle, TEST_MAP_EMPTY);
+
+	/*building the list of messages to be notified if HTTP is fine*/
+	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message1.entry)))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message2.entry)))
 		.IgnoreArgument(1);
 
-	/*this is first batched payload*/
-	{
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message1.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":\""));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(message1.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3);
+	/*executing HTTP goodies*/
+	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
+		IGNORED_PTR_ARG,
+		HTTPAPI_REQUEST_POST,                                                           /*HTTPAPI_REQUEST_TYPE requestType,                  */
+		"/devices/" TEST_DEVICE_ID EVENT_ENDPOINT API_VERSION,                 /*const char* relativePath,                          */
+		IGNORED_PTR_ARG,                                                                /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,      */
+		IGNORED_PTR_ARG,                                                                /*BUFFER_HANDLE requestContent,                      */
+		IGNORED_PTR_ARG,                                                                /*unsigned int* statusCode,                          */
+		NULL,                                                                           /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,     */
+		NULL                                                                            /*BUFFER_HANDLE responseContent)                     */
+		))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2)
+		.IgnoreArgument(5)
+		.IgnoreArgument(6)
+		.CopyOutArgumentBuffer(7, &httpStatus200, sizeof(httpStatus200));
 
-		whenShallBase64_Encode_Bytes_fail = 1;
-		STRICT_EXPECTED_CALL(mocks, Base64_Encode_Bytes(buffer1, buffer1_size));
-		/*end of the first batched payload*/
-	}
+	/*once the event has been succesfull...*/
+
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_SUCCESS))
+		.IgnoreArgument(2);
 
 	ENABLE_BATCHING();
 
@@ -9126,17 +8414,17 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_Base64_Encode_By
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_067: [ If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_IoTHubMessage_GetByteArray_it_fails)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_066: [ If at any point during construction of the string there are errors, IoTHubTransportHttp_DoWork shall use the so far constructed string as payload. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_2_event_items_when_the_second_items_fails_the_first_one_still_makes_1_batch_succeeds_1)
 {
 	///arrange
 	CIoTHubTransportHttpMocks mocks;
 	DList_InsertTailList(&(waitingToSend), &(message1.entry));
+	DList_InsertTailList(&(waitingToSend), &(message2.entry));
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
 	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
 	mocks.ResetAllCalls();
-
 	setupDoWorkLoopOnceForOneDevice(mocks);
 
 	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
@@ -9144,24 +8432,49 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_IoTHubMessage_Ge
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
 		.IgnoreArgument(1);
 
-	/*starting to prepare the "big" payload*/
-	STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+	/*measuring the items, the first one fits*/
+	setupBatchedItem(mocks, message1.messageHandle, TEST_MAP_EMPTY);
+
+	/*the second one cannot be measured, the batch stops at the first one*/
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message2.messageHandle));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(message2.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3)
+		.SetReturn(IOTHUB_MESSAGE_ERROR);
+
+	/*the payload is allocated once and the batched items are written directly in it*/
+	setupBatchedPayload(mocks);
+	setupBatchedItem(mocks, message1.messageHandle, TEST_MAP_EMPTY);
+
+	/*building the list of messages to be notified if HTTP is fine*/
+	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message1.entry)))
+		.IgnoreArgument(1);
+	/*executing HTTP goodies*/
+	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
+		IGNORED_PTR_ARG,
+		HTTPAPI_REQUEST_POST,                                                           /*HTTPAPI_REQUEST_TYPE requestType,                  */
+		"/devices/" TEST_DEVICE_ID EVENT_ENDPOINT API_VERSION,                 /*const char* relativePath,                          */
+		IGNORED_PTR_ARG,                                                                /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,      */
+		IGNORED_PTR_ARG,                                                                /*BUFFER_HANDLE requestContent,                      */
+		IGNORED_PTR_ARG,                                                                /*unsigned int* statusCode,                          */
+		NULL,                                                                           /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,     */
+		NULL                                                                            /*BUFFER_HANDLE responseContent)                     */
+		))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2)
+		.IgnoreArgument(5)
+		.IgnoreArgument(6)
+		.CopyOutArgumentBuffer(7, &httpStatus200, sizeof(httpStatus200));
 
-	/*this is first batched payload*/
-	{
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message1.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":\""));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(message1.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3)
-			.SetReturn(IOTHUB_MESSAGE_ERROR);
+	/*once the event has been succesfull...*/
 
-		/*end of the first batched payload*/
-	}
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_SUCCESS))
+		.IgnoreArgument(2);
 
 	ENABLE_BATCHING();
 
@@ -9175,17 +8488,17 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_IoTHubMessage_Ge
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_067: [ If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_STRING_construct_fails_it_fails)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_066: [ If at any point during construction of the string there are errors, IoTHubTransportHttp_DoWork shall use the so far constructed string as payload. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_2_event_items_when_the_second_items_fails_the_first_one_still_makes_1_batch_succeeds_2)
 {
 	///arrange
 	CIoTHubTransportHttpMocks mocks;
 	DList_InsertTailList(&(waitingToSend), &(message1.entry));
+	DList_InsertTailList(&(waitingToSend), &(message2.entry));
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
 	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
 	mocks.ResetAllCalls();
-
 	setupDoWorkLoopOnceForOneDevice(mocks);
 
 	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
@@ -9193,18 +8506,55 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_STRING_construct
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
 		.IgnoreArgument(1);
 
-	/*starting to prepare the "big" payload*/
-	STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+	/*measuring the items, the first one fits*/
+	setupBatchedItem(mocks, message1.messageHandle, TEST_MAP_EMPTY);
+
+	/*the properties of the second one cannot be measured, the batch stops at the first one*/
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message2.messageHandle));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(message2.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3);
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message2.messageHandle))
+		.SetReturn(TEST_MAP_1_PROPERTY);
+	STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_1_PROPERTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3)
+		.IgnoreArgument(4)
+		.SetReturn(MAP_ERROR);
+
+	/*the payload is allocated once and the batched items are written directly in it*/
+	setupBatchedPayload(mocks);
+	setupBatchedItem(mocks, message1.messageHandle, TEST_MAP_EMPTY);
+
+	/*building the list of messages to be notified if HTTP is fine*/
+	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message1.entry)))
+		.IgnoreArgument(1);
+	/*executing HTTP goodies*/
+	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
+		IGNORED_PTR_ARG,
+		HTTPAPI_REQUEST_POST,                                                           /*HTTPAPI_REQUEST_TYPE requestType,                  */
+		"/devices/" TEST_DEVICE_ID EVENT_ENDPOINT API_VERSION,                 /*const char* relativePath,                          */
+		IGNORED_PTR_ARG,                                                                /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,      */
+		IGNORED_PTR_ARG,                                                                /*BUFFER_HANDLE requestContent,                      */
+		IGNORED_PTR_ARG,                                                                /*unsigned int* statusCode,                          */
+		NULL,                                                                           /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,     */
+		NULL                                                                            /*BUFFER_HANDLE responseContent)                     */
+		))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2)
+		.IgnoreArgument(5)
+		.IgnoreArgument(6)
+		.CopyOutArgumentBuffer(7, &httpStatus200, sizeof(httpStatus200));
 
-	/*this is first batched payload*/
-	{
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message1.messageHandle));
-		whenShallSTRING_construct_fail = currentSTRING_construct_call + 2;
-		STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":\""));
-		/*end of the first batched payload*/
-	}
+	/*once the event has been succesfull...*/
+
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_SUCCESS))
+		.IgnoreArgument(2);
 
 	ENABLE_BATCHING();
 
@@ -9218,17 +8568,17 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_STRING_construct
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_067: [ If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_STRING_construct_it_fails)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_066: [ If at any point during construction of the string there are errors, IoTHubTransportHttp_DoWork shall use the so far constructed string as payload. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_2_event_items_the_second_one_does_not_fit_256K_makes_1_batch_of_the_first_item_succeeds)
 {
 	///arrange
 	CIoTHubTransportHttpMocks mocks;
 	DList_InsertTailList(&(waitingToSend), &(message1.entry));
+	DList_InsertTailList(&(waitingToSend), &(message5.entry));
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
 	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
 	mocks.ResetAllCalls();
-
 	setupDoWorkLoopOnceForOneDevice(mocks);
 
 	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
@@ -9236,9 +8586,44 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_STRING_construct
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
 		.IgnoreArgument(1);
 
-	/*starting to prepare the "big" payload*/
-	whenShallSTRING_construct_fail = currentSTRING_construct_call + 1;
-	STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
+	/*measuring the items, the ones that fit make the batch*/
+	setupBatchedItem(mocks, message1.messageHandle, TEST_MAP_EMPTY);
+	setupBatchedItem(mocks, message5.messageHandle, TEST_MAP_EMPTY);
+
+	/*the payload is allocated once and the batched items are written directly in it*/
+	setupBatchedPayload(mocks);
+	setupBatchedItem(mocks, message1.messageHandle, TEST_MAP_EMPTY);
+
+	/*building the list of messages to be notified if HTTP is fine*/
+	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message1.entry)))
+		.IgnoreArgument(1);
+
+	/*executing HTTP goodies*/
+	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
+		IGNORED_PTR_ARG,
+		HTTPAPI_REQUEST_POST,                                                           /*HTTPAPI_REQUEST_TYPE requestType,                  */
+		"/devices/" TEST_DEVICE_ID EVENT_ENDPOINT API_VERSION,                 /*const char* relativePath,                          */
+		IGNORED_PTR_ARG,                                                                /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,      */
+		IGNORED_PTR_ARG,                                                                /*BUFFER_HANDLE requestContent,                      */
+		IGNORED_PTR_ARG,                                                                /*unsigned int* statusCode,                          */
+		NULL,                                                                           /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,     */
+		NULL                                                                            /*BUFFER_HANDLE responseContent)                     */
+		))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2)
+		.IgnoreArgument(5)
+		.IgnoreArgument(6)
+		.CopyOutArgumentBuffer(7, &httpStatus200, sizeof(httpStatus200));
+
+	/*once the event has been succesfull...*/
+
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_SUCCESS))
+		.IgnoreArgument(2);
 
 	ENABLE_BATCHING();
 
@@ -9252,214 +8637,201 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_STRING_construct
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_055: [ If updating Content-Type fails for any reason, then _DoWork shall advance to the next action. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_when_HTTP_headers_fails_it_fails)
+
+/*** IoTHubTransportHttp_GetSendStatus ***/
+
+//Tests_SRS_TRANSPORTMULTITHTTP_17_111: [ IoTHubTransportHttp_GetSendStatus shall return IOTHUB_CLIENT_INVALID_ARG if called with NULL parameter. ]
+TEST_FUNCTION(IoTHubTransportHttp_GetSendStatus_InvalidHandleArgument_fail)
 {
-	///arrange
+	// arrange
 	CIoTHubTransportHttpMocks mocks;
-	DList_InsertTailList(&(waitingToSend), &(message1.entry));
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
-	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
 	mocks.ResetAllCalls();
 
-	setupDoWorkLoopOnceForOneDevice(mocks);
-
-	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
-
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
-		.IgnoreArgument(1)
-		.SetReturn(HTTP_HEADERS_ERROR);
+	IOTHUB_CLIENT_STATUS status;
 
-	ENABLE_BATCHING();
+	// act
+	IOTHUB_CLIENT_RESULT result = IoTHubTransportHttp_GetSendStatus(NULL, &status);
 
-	///act
-	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+	// assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_INVALID_ARG);
 
-	///assert
 	mocks.AssertActualAndExpectedCalls();
 
-	///cleanup
+	// cleanup
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_065: [ If the oldest message in waitingToSend causes the message size to exceed the message size limit then it shall be removed from waitingToSend, and IoTHubClient_LL_SendComplete shall be called. Parameter PDLIST_ENTRY completed shall point to a list containing only the oldest item, and parameter IOTHUB_BATCHSTATE result shall be set to IOTHUB_BATCHSTATE_FAILED. ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_061: [ The message size shall be limited to 255KB - 1 byte. ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_062: [ The message size is computed from the length of the payload + 384. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_bigger_than_256K_path_succeeds)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_111: [ IoTHubTransportHttp_GetSendStatus shall return IOTHUB_CLIENT_INVALID_ARG if called with NULL parameter. ]
+TEST_FUNCTION(IoTHubTransportHttp_GetSendStatus_InvalidStatusArgument_fail)
 {
-	///arrange
+	// arrange
 	CIoTHubTransportHttpMocks mocks;
-	DList_InsertTailList(&(waitingToSend), &(message4.entry));
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
 	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
 	mocks.ResetAllCalls();
 
-	setupDoWorkLoopOnceForOneDevice(mocks);
-
-	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
+	// act
+	IOTHUB_CLIENT_RESULT result = IoTHubTransportHttp_GetSendStatus(devHandle, NULL);
 
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
-		.IgnoreArgument(1);
+	// assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_INVALID_ARG);
 
-	/*starting to prepare the "big" payload*/
-	STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
+	mocks.AssertActualAndExpectedCalls();
 
-	EXPECTED_CALL(mocks, STRING_new_with_memory(IGNORED_PTR_ARG));
+	// cleanup
+	IoTHubTransportHttp_Destroy(handle);
+}
 
-	/*this is first batched payload*/
-	{
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message4.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":\""));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(message4.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3);
+//Tests_SRS_TRANSPORTMULTITHTTP_17_112: [ IoTHubTransportHttp_GetSendStatus shall return IOTHUB_CLIENT_OK and status IOTHUB_CLIENT_SEND_STATUS_IDLE if there are currently no event items to be sent or being sent. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_138: [ IoTHubTransportHttp_GetSendStatus shall locate deviceHandle in the transport device list by calling VECTOR_find_if. ]
+TEST_FUNCTION(IoTHubTransportHttp_GetSendStatus_empty_waitingToSend_and_empty_eventConfirmations_success)
+{
+	// arrange
+	CIoTHubTransportHttpMocks mocks;
+	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
-		STRICT_EXPECTED_CALL(mocks, Base64_Encode_Bytes(bigBufferOverflow, TEST_BIG_BUFFER_1_OVERFLOW_SIZE));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
+	mocks.ResetAllCalls();
 
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, devHandle))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2);
 
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\"")) /*closing the value of the body*/
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message4.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3)
-			.IgnoreArgument(4);
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "},")) /* this extra "," is going to be harshly overwritten by a "]"*/
-			.IgnoreArgument(1);
-		/*end of the first batched payload*/
-	}
+	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
 
-	{
-		/*adding the first payload to the "big" payload*/
-		/*building the list of messages to be notified because this is 100% fail (>256K)*/
-		STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message4.entry)))
-			.IgnoreArgument(1);
-	}
+	IOTHUB_CLIENT_STATUS status;
 
-	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_FAILED))
+	// act
+	IOTHUB_CLIENT_RESULT result = IoTHubTransportHttp_GetSendStatus(devHandle, &status);
+
+	// assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_OK);
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_STATUS, status, IOTHUB_CLIENT_SEND_STATUS_IDLE);
+
+	mocks.AssertActualAndExpectedCalls();
+
+	// cleanup
+	IoTHubTransportHttp_Destroy(handle);
+}
+
+//Tests_SRS_TRANSPORTMULTITHTTP_17_113: [ IoTHubTransportHttp_GetSendStatus shall return IOTHUB_CLIENT_OK and status IOTHUB_CLIENT_SEND_STATUS_BUSY if there are currently event items to be sent or being sent. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_138: [ IoTHubTransportHttp_GetSendStatus shall locate deviceHandle in the transport device list by calling VECTOR_find_if. ]
+TEST_FUNCTION(IoTHubTransportHttp_GetSendStatus_waitingToSend_not_empty_success)
+{
+	// arrange
+	CIoTHubTransportHttpMocks mocks;
+	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+
+	IOTHUB_MESSAGE_HANDLE eventMessageHandle = IoTHubMessage_CreateFromByteArray(contains3, 1);
+	IOTHUB_MESSAGE_LIST newEntry;
+	newEntry.messageHandle = &newEntry;
+	DList_InsertTailList(&(waitingToSend), &(newEntry.entry));
+
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, devHandle))
+		.IgnoreArgument(1)
 		.IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
 
-	ENABLE_BATCHING();
+	IOTHUB_CLIENT_STATUS status;
 
-	///act
-	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+	// act
+	IOTHUB_CLIENT_RESULT result = IoTHubTransportHttp_GetSendStatus(devHandle, &status);
+
+	// assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_OK);
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_STATUS, status, IOTHUB_CLIENT_SEND_STATUS_BUSY);
 
-	///assert
 	mocks.AssertActualAndExpectedCalls();
 
-	///cleanup
+	// cleanup
 	IoTHubTransportHttp_Destroy(handle);
+	IoTHubMessage_Destroy(eventMessageHandle);
 }
 
-/*this is a test that wants to see that "almost" 255KB message still fits*/
-//Tests_SRS_TRANSPORTMULTITHTTP_17_062: [ The message size is computed from the length of the payload + 384. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_almost255_happy_path_succeeds)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_139: [ If the device structure is not found, then this function shall fail and return with IOTHUB_CLIENT_INVALID_ARG. ]
+TEST_FUNCTION(IoTHubTransportHttp_GetSendStatus_deviceData_is_not_found_fails)
 {
-	///arrange
+	// arrange
 	CIoTHubTransportHttpMocks mocks;
-	DList_InsertTailList(&(waitingToSend), &(message5.entry));
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
 	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
-	mocks.ResetAllCalls();
+	IOTHUB_MESSAGE_HANDLE eventMessageHandle = IoTHubMessage_CreateFromByteArray(contains3, 1);
+	IOTHUB_MESSAGE_LIST newEntry;
+	newEntry.messageHandle = &newEntry;
+	DList_InsertTailList(&(waitingToSend), &(newEntry.entry));
 
-	setupDoWorkLoopOnceForOneDevice(mocks);
+	mocks.ResetAllCalls();
 
-	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
+	STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, devHandle))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2)
+		.SetFailReturn((void_ptr)NULL);
 
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
-		.IgnoreArgument(1);
+	IOTHUB_CLIENT_STATUS status;
 
-	/*starting to prepare the "big" payload*/
-	STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
+	// act
+	IOTHUB_CLIENT_RESULT result = IoTHubTransportHttp_GetSendStatus(devHandle, &status);
 
-	/*this is first batched payload*/
-	{
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message5.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":\""));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(message5.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3);
+	// assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_INVALID_ARG);
 
-		STRICT_EXPECTED_CALL(mocks, Base64_Encode_Bytes(bigBufferFit, TEST_BIG_BUFFER_1_FIT_SIZE));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
+	mocks.AssertActualAndExpectedCalls();
 
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
+	// cleanup
+	IoTHubTransportHttp_Destroy(handle);
+	IoTHubMessage_Destroy(eventMessageHandle);
+}
 
-		EXPECTED_CALL(mocks, STRING_new_with_memory(IGNORED_PTR_ARG));
+#define TEST_2_ITEM_STRING "[{\"body\":\"MTIzNDU2\",\"properties\":{" TEST_RED_KEY_STRING_WITH_IOTHUBAPP ":" TEST_RED_VALUE_STRING "}},{\"body\":\"MTIzNDU2Nw==\",\"properties\":{" TEST_BLUE_KEY_STRING_WITH_IOTHUBAPP ":" TEST_BLUE_VALUE_STRING "," TEST_YELLOW_KEY_STRING_WITH_IOTHUBAPP ":" TEST_YELLOW_VALUE_STRING "}}]"
+#define TEST_1_ITEM_STRING "[{\"body\":\"MTIzNDU2\",\"properties\":{" TEST_RED_KEY_STRING_WITH_IOTHUBAPP ":" TEST_RED_VALUE_STRING "}}]"
 
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\"")) /*closing the value of the body*/
-			.IgnoreArgument(1);
+void setupIrrelevantMocksForProperties(CIoTHubTransportHttpMocks *mocks, IOTHUB_MESSAGE_HANDLE messageHandle, MAP_HANDLE properties) /*these are copy pasted from TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items))*/
+{
+	(void)(*mocks);
+	STRICT_EXPECTED_CALL((*mocks), DList_IsListEmpty(&waitingToSend));
 
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message5.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3)
-			.IgnoreArgument(4);
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "},")) /* this extra "," is going to be harshly overwritten by a "]"*/
-			.IgnoreArgument(1);
-		/*end of the first batched payload*/
-	}
+	STRICT_EXPECTED_CALL((*mocks), HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
+		.IgnoreArgument(1);
 
-	{
-		/*adding the first payload to the "big" payload*/
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
+	/*measuring the item*/
+	setupBatchedItem(*mocks, messageHandle, properties);
 
-		/*closing the "big" payload*/
-		STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, STRING_length(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-	}
+	/*the payload is allocated once and the batched item is written directly in it*/
+	setupBatchedPayload(*mocks);
+	setupBatchedItem(*mocks, messageHandle, properties);
 
 	/*building the list of messages to be notified if HTTP is fine*/
-	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message5.entry)))
+	STRICT_EXPECTED_CALL((*mocks), DList_RemoveHeadList(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
 
+	switch ((uintptr_t)messageHandle)
 	{
-		/*this is building the HTTP payload... from a STRING_HANDLE (as it comes as "big payload"), into an array of bytes*/
-		STRICT_EXPECTED_CALL(mocks, BUFFER_new());
-		STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
+	case((uintptr_t)TEST_IOTHUB_MESSAGE_HANDLE_11) :
+	{
+		STRICT_EXPECTED_CALL((*mocks), DList_InsertTailList(IGNORED_PTR_ARG, &(message11.entry)))
 			.IgnoreArgument(1);
+		break;
+	}
 
-		STRICT_EXPECTED_CALL(mocks, STRING_length(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+	default:
+	{
+		STRICT_EXPECTED_CALL((*mocks), DList_InsertTailList(IGNORED_PTR_ARG, &(message6.entry)))
 			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, BUFFER_build(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2)
-			.IgnoreArgument(3);
+		break;
+	}
 	}
 
 	/*executing HTTP goodies*/
-	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
+	STRICT_EXPECTED_CALL((*mocks), STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+	STRICT_EXPECTED_CALL((*mocks), HTTPAPIEX_SAS_ExecuteRequest2(
 		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
 		IGNORED_PTR_ARG,
 		HTTPAPI_REQUEST_POST,                                                           /*HTTPAPI_REQUEST_TYPE requestType,                  */
@@ -9478,8 +8850,25 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_almost255_happy_path_
 
 	/*once the event has been succesfull...*/
 
-	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_SUCCESS))
+	STRICT_EXPECTED_CALL((*mocks), IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_SUCCESS))
 		.IgnoreArgument(2);
+}
+
+//Tests_SRS_TRANSPORTMULTITHTTP_17_064: [ If IoTHubMessage does not have properties, then "properties":{...} shall be missing from the payload. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_059: [ It shall inspect the "waitingToSend" DLIST passed in config structure. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_with_properties_succeeds)
+{
+	///arrange
+	CIoTHubTransportHttpMocks mocks;
+	DList_InsertTailList(&(waitingToSend), &(message6.entry));
+	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+
+	mocks.ResetAllCalls();
+
+	setupDoWorkLoopOnceForOneDevice(mocks);
+
+	setupIrrelevantMocksForProperties(&mocks, message6.messageHandle, TEST_MAP_1_PROPERTY);
 
 	ENABLE_BATCHING();
 
@@ -9487,19 +8876,22 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_almost255_happy_path_
 	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
 	///assert
+	ASSERT_ARE_EQUAL(int, 0, memcmp(BASEIMPLEMENTATION::BUFFER_u_char(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest), TEST_1_ITEM_STRING, sizeof(TEST_1_ITEM_STRING) - 1));
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_056: [ IoTHubTransportHttp_DoWork shall build the following string:[{"body":"base64 encoding of the message1 content"},{"body":"base64 encoding of the message2 content"}...] ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_2_event_items_makes_1_batch_succeeds)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_063: [ Every property name shall add to the message size the length of the property name + the length of the property value + 16 bytes. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_with_1_properties_at_maximum_message_size_succeeds)
 {
+	/*this test shall use a message that has a payload of MAXIMUM_MESSAGE_SIZE - PAYLOAD_OVERHEAD - PROPERTY_OVERHEAD - 2*/
+	/*it will also have a property of "a":"b", therefore reaching the MAXIMUM_MESSAGE_SIZE*/
+	/*the next test will increase either the propertyname or value by 1 character as the message is expected to fail*/
 	///arrange
 	CIoTHubTransportHttpMocks mocks;
-	DList_InsertTailList(&(waitingToSend), &(message1.entry));
-	DList_InsertTailList(&(waitingToSend), &(message2.entry));
+	DList_InsertTailList(&(waitingToSend), &(message11.entry));
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
 	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
@@ -9507,131 +8899,116 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_2_event_items_makes_1_batch_succee
 
 	setupDoWorkLoopOnceForOneDevice(mocks);
 
-	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
+	setupIrrelevantMocksForProperties(&mocks, message11.messageHandle, TEST_MAP_1_PROPERTY_A_B);
 
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
-		.IgnoreArgument(1);
+	ENABLE_BATCHING();
 
-	EXPECTED_CALL(mocks, STRING_new_with_memory(IGNORED_PTR_ARG))
-		.ExpectedAtLeastTimes(2);
+	///act
+	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
-	/*starting to prepare the "big" payload*/
-	STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
+	///assert
+	mocks.AssertActualAndExpectedCalls();
 
-	/*this is first batched payload*/
-	{
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message1.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":\""));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(message1.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3);
+	///cleanup
+	IoTHubTransportHttp_Destroy(handle);
+}
 
-		STRICT_EXPECTED_CALL(mocks, Base64_Encode_Bytes(buffer1, buffer1_size));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
+//Tests_SRS_TRANSPORTMULTITHTTP_17_063: [ Every property name shall add to the message size the length of the property name + the length of the property value + 16 bytes. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_with_1_properties_past_maximum_message_size_fails)
+{
+	/*this test shall use a message that has a payload of MAXIMUM_MESSAGE_SIZE - PAYLOAD_OVERHEAD - PROPERTY_OVERHEAD - 2*/
+	/*it will also have a property of "aa":"b", therefore reaching 1 byte past the MAXIMUM_MESSAGE_SIZE*/
+	/*this is done in a very e2e manner*/
+	///arrange
+	CNiceCallComparer<CIoTHubTransportHttpMocks>mocks;
+	DList_InsertTailList(&(waitingToSend), &(message12.entry));
+	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
+	ENABLE_BATCHING();
 
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\"")) /*closing the value of the body*/
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message1.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3)
-			.IgnoreArgument(4);
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "},")) /* this extra "," is going to be harshly overwritten by a "]"*/
-			.IgnoreArgument(1);
-		/*end of the first batched payload*/
-	}
 
-	{
-		/*adding the first payload to the "big" payload*/
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
-	}
+	mocks.ResetAllCalls();
 
-	/*this is second batched payload*/
-	{
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message2.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":\""));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(message2.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3);
+	setupDoWorkLoopOnceForOneDevice(mocks);
 
-		STRICT_EXPECTED_CALL(mocks, Base64_Encode_Bytes(buffer2, buffer2_size));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_FAILED))
+		.IgnoreArgument(2);
 
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
+	///act
+	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\"")) /*closing the value of the body*/
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message2.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3)
-			.IgnoreArgument(4);
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "},")) /* this extra "," is going to be harshly overwritten by a "]"*/
-			.IgnoreArgument(1);
-		/*end of the first batched payload*/
-	}
+	///assert
+	mocks.AssertActualAndExpectedCalls();
 
-	{
-		/*adding the second payload to the "big" payload*/
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
-	}
+	///cleanup
+	IoTHubTransportHttp_Destroy(handle);
+}
 
-	{
-		/*closing the "big" payload*/
-		STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, STRING_length(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-	}
+//Tests_SRS_TRANSPORTMULTITHTTP_17_064: [ If IoTHubMessage does not have properties, then "properties":{...} shall be missing from the payload. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_fails_when_Map_GetInternals_fails)
+{
+	///arrange
+	CNiceCallComparer<CIoTHubTransportHttpMocks> mocks;
+	DList_InsertTailList(&(waitingToSend), &(message6.entry));
+	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+
+	mocks.ResetAllCalls();
+
+	setupDoWorkLoopOnceForOneDevice(mocks);
+
+	STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_1_PROPERTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3)
+		.IgnoreArgument(4)
+		.SetReturn(MAP_ERROR);
+
+	ENABLE_BATCHING();
+
+	///act
+	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+
+	///assert
+	ASSERT_IS_NULL(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest);
+	mocks.AssertActualAndExpectedCalls();
+
+
+	///cleanup
+	IoTHubTransportHttp_Destroy(handle);
+}
+
+void setupIrrelevantMocksForProperties2(CIoTHubTransportHttpMocks *mocks, IOTHUB_MESSAGE_HANDLE h1, MAP_HANDLE p1, IOTHUB_MESSAGE_HANDLE h2, MAP_HANDLE p2) /*these are copy pasted from TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items))*/
+{
+	(void)(*mocks);
+	STRICT_EXPECTED_CALL((*mocks), DList_IsListEmpty(&waitingToSend));
+
+	STRICT_EXPECTED_CALL((*mocks), HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
+		.IgnoreArgument(1);
+
+	/*measuring the items, both fit*/
+	setupBatchedItem(*mocks, h1, p1);
+	setupBatchedItem(*mocks, h2, p2);
+
+	/*the payload is allocated once and the batched items are written directly in it*/
+	setupBatchedPayload(*mocks);
+	setupBatchedItem(*mocks, h1, p1);
+	setupBatchedItem(*mocks, h2, p2);
 
 	/*building the list of messages to be notified if HTTP is fine*/
-	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
+	STRICT_EXPECTED_CALL((*mocks), DList_RemoveHeadList(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message1.entry)))
+	STRICT_EXPECTED_CALL((*mocks), DList_InsertTailList(IGNORED_PTR_ARG, &(message6.entry)))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
+	STRICT_EXPECTED_CALL((*mocks), DList_RemoveHeadList(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message2.entry)))
+	STRICT_EXPECTED_CALL((*mocks), DList_InsertTailList(IGNORED_PTR_ARG, &(message7.entry)))
 		.IgnoreArgument(1);
 
-	{
-		/*this is building the HTTP payload... from a STRING_HANDLE (as it comes as "big payload"), into an array of bytes*/
-		STRICT_EXPECTED_CALL(mocks, BUFFER_new());
-		STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-
-		STRICT_EXPECTED_CALL(mocks, STRING_length(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, BUFFER_build(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2)
-			.IgnoreArgument(3);
-	}
-
 	/*executing HTTP goodies*/
-	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
+	STRICT_EXPECTED_CALL((*mocks), STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+	STRICT_EXPECTED_CALL((*mocks), HTTPAPIEX_SAS_ExecuteRequest2(
 		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
 		IGNORED_PTR_ARG,
 		HTTPAPI_REQUEST_POST,                                                           /*HTTPAPI_REQUEST_TYPE requestType,                  */
@@ -9650,8 +9027,25 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_2_event_items_makes_1_batch_succee
 
 	/*once the event has been succesfull...*/
 
-	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_SUCCESS))
+	STRICT_EXPECTED_CALL((*mocks), IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_SUCCESS))
 		.IgnoreArgument(2);
+}
+
+//Tests_SRS_TRANSPORTMULTITHTTP_17_064: [ If IoTHubMessage does not have properties, then "properties":{...} shall be missing from the payload. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_2_event_items_with_properties_succeeds)
+{
+	///arrange
+	CIoTHubTransportHttpMocks mocks;
+	DList_InsertTailList(&(waitingToSend), &(message6.entry));
+	DList_InsertTailList(&(waitingToSend), &(message7.entry));
+	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+
+	mocks.ResetAllCalls();
+
+	setupDoWorkLoopOnceForOneDevice(mocks);
+
+	setupIrrelevantMocksForProperties2(&mocks, message6.messageHandle, TEST_MAP_1_PROPERTY, message7.messageHandle, TEST_MAP_2_PROPERTY);
 
 	ENABLE_BATCHING();
 
@@ -9659,159 +9053,60 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_2_event_items_makes_1_batch_succee
 	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
 	///assert
+	ASSERT_ARE_EQUAL(int, 0, memcmp(BASEIMPLEMENTATION::BUFFER_u_char(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest), TEST_2_ITEM_STRING, sizeof(TEST_2_ITEM_STRING) - 1));
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_066: [ If at any point during construction of the string there are errors, IoTHubTransportHttp_DoWork shall use the so far constructed string as payload. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_2_event_items_when_the_second_items_fails_the_first_one_still_makes_1_batch_succeeds_1)
+
+//Tests_SRS_TRANSPORTMULTITHTTP_17_058: [ If IoTHubMessage has properties, then they shall be serialized at the same level as "body" using the following pattern: "properties":{"iothub-app-name1":"value1","iothub-app-name2":"value2"} ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_2_event_items)
 {
 	///arrange
-	CIoTHubTransportHttpMocks mocks;
-	DList_InsertTailList(&(waitingToSend), &(message1.entry));
-	DList_InsertTailList(&(waitingToSend), &(message2.entry));
+	CNiceCallComparer<CIoTHubTransportHttpMocks> mocks; /*a very e2e test... */
+	DList_InsertTailList(&(waitingToSend), &(message6.entry));
+	DList_InsertTailList(&(waitingToSend), &(message7.entry));
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
 	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
 	mocks.ResetAllCalls();
-	setupDoWorkLoopOnceForOneDevice(mocks);
-
-	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
-
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
-		.IgnoreArgument(1);
-
-	/*starting to prepare the "big" payload*/
-	STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-
-	EXPECTED_CALL(mocks, STRING_new_with_memory(IGNORED_PTR_ARG))
-		.ExpectedAtLeastTimes(2);
-	/*this is first batched payload*/
-	{
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message1.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":\""));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(message1.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3);
 
-		STRICT_EXPECTED_CALL(mocks, Base64_Encode_Bytes(buffer1, buffer1_size));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
-
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\"")) /*closing the value of the body*/
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message1.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3)
-			.IgnoreArgument(4);
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "},")) /* this extra "," is going to be harshly overwritten by a "]"*/
-			.IgnoreArgument(1);
-		/*end of the first batched payload*/
-	}
-
-	{
-		/*adding the first payload to the "big" payload*/
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
-	}
-
-	/*this is second batched payload*/
-	{
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message2.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":\""));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(message2.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3);
+	setupDoWorkLoopOnceForOneDevice(mocks);
 
-		STRICT_EXPECTED_CALL(mocks, Base64_Encode_Bytes(buffer2, buffer2_size));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
+	ENABLE_BATCHING();
 
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
+	///act
+	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\"")) /*closing the value of the body*/
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message2.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3)
-			.IgnoreArgument(4);
-		whenShallSTRING_concat_fail = currentSTRING_concat_call + 4;
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "},")) /* this extra "," is going to be harshly overwritten by a "]"*/
-			.IgnoreArgument(1);
-		/*end of the second batched payload*/
-	}
+	///assert
+	ASSERT_ARE_EQUAL(int, 0, memcmp(BASEIMPLEMENTATION::BUFFER_u_char(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest), TEST_2_ITEM_STRING, sizeof(TEST_2_ITEM_STRING) - 1));
+	mocks.AssertActualAndExpectedCalls();
 
-	{
-		/*closing the "big" payload*/
-		STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, STRING_length(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-	}
+	///cleanup
+	IoTHubTransportHttp_Destroy(handle);
+}
 
-	/*building the list of messages to be notified if HTTP is fine*/
-	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message1.entry)))
-		.IgnoreArgument(1);
+//Tests_SRS_TRANSPORTMULTITHTTP_17_066: [ If at any point during construction of the string there are errors, IoTHubTransportHttp_DoWork shall use the so far constructed string as payload. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_2_event_items_send_only_1_when_properties_for_second_fail)
+{
+	///arrange
+	CNiceCallComparer<CIoTHubTransportHttpMocks> mocks; /*a very e2e test... */
+	DList_InsertTailList(&(waitingToSend), &(message6.entry));
+	DList_InsertTailList(&(waitingToSend), &(message7.entry));
+	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
-	{
-		/*this is building the HTTP payload... from a STRING_HANDLE (as it comes as "big payload"), into an array of bytes*/
-		STRICT_EXPECTED_CALL(mocks, BUFFER_new());
-		STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
+	mocks.ResetAllCalls();
 
-		STRICT_EXPECTED_CALL(mocks, STRING_length(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, BUFFER_build(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2)
-			.IgnoreArgument(3);
-	}
+	setupDoWorkLoopOnceForOneDevice(mocks);
 
-	/*executing HTTP goodies*/
-	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
-		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
-		IGNORED_PTR_ARG,
-		HTTPAPI_REQUEST_POST,                                                           /*HTTPAPI_REQUEST_TYPE requestType,                  */
-		"/devices/" TEST_DEVICE_ID EVENT_ENDPOINT API_VERSION,                 /*const char* relativePath,                          */
-		IGNORED_PTR_ARG,                                                                /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,      */
-		IGNORED_PTR_ARG,                                                                /*BUFFER_HANDLE requestContent,                      */
-		IGNORED_PTR_ARG,                                                                /*unsigned int* statusCode,                          */
-		NULL,                                                                           /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,     */
-		NULL                                                                            /*BUFFER_HANDLE responseContent)                     */
-		))
-		.IgnoreArgument(1)
+	STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_2_PROPERTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
 		.IgnoreArgument(2)
-		.IgnoreArgument(5)
-		.IgnoreArgument(6)
-		.CopyOutArgumentBuffer(7, &httpStatus200, sizeof(httpStatus200));
-
-	/*once the event has been succesfull...*/
-
-	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_SUCCESS))
-		.IgnoreArgument(2);
+		.IgnoreArgument(3)
+		.IgnoreArgument(4)
+		.SetReturn(MAP_ERROR);
 
 	ENABLE_BATCHING();
 
@@ -9819,331 +9114,296 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_2_event_items_when_the_second_item
 	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
 	///assert
+	ASSERT_ARE_EQUAL(size_t, sizeof(TEST_1_ITEM_STRING) - 1, BASEIMPLEMENTATION::BUFFER_length(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest));
+	ASSERT_ARE_EQUAL(int, 0, memcmp(BASEIMPLEMENTATION::BUFFER_u_char(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest), TEST_1_ITEM_STRING, sizeof(TEST_1_ITEM_STRING) - 1));
+	ASSERT_ARE_EQUAL(void_ptr, &(message7.entry), waitingToSend.Flink);
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_066: [ If at any point during construction of the string there are errors, IoTHubTransportHttp_DoWork shall use the so far constructed string as payload. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_2_event_items_when_the_second_items_fails_the_first_one_still_makes_1_batch_succeeds_2)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_067: [ If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_2_event_items_send_nothing)
 {
 	///arrange
-	CIoTHubTransportHttpMocks mocks;
-	DList_InsertTailList(&(waitingToSend), &(message1.entry));
-	DList_InsertTailList(&(waitingToSend), &(message2.entry));
+	CNiceCallComparer<CIoTHubTransportHttpMocks> mocks; /*a very e2e test... */
+	DList_InsertTailList(&(waitingToSend), &(message6.entry));
+	DList_InsertTailList(&(waitingToSend), &(message7.entry));
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
 	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
 	mocks.ResetAllCalls();
+
 	setupDoWorkLoopOnceForOneDevice(mocks);
 
-	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
+	STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_1_PROPERTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3)
+		.IgnoreArgument(4)
+		.SetReturn(MAP_ERROR);
 
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
-		.IgnoreArgument(1);
+	ENABLE_BATCHING();
 
-	/*starting to prepare the "big" payload*/
-	STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
+	///act
+	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
-	EXPECTED_CALL(mocks, STRING_new_with_memory(IGNORED_PTR_ARG))
-		.ExpectedAtLeastTimes(2);
+	///assert
+	ASSERT_IS_NULL(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest);
+	ASSERT_ARE_EQUAL(void_ptr, &(message6.entry), waitingToSend.Flink);
+	mocks.AssertActualAndExpectedCalls();
 
-	/*this is first batched payload*/
-	{
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message1.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":\""));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(message1.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3);
+	///cleanup
+	IoTHubTransportHttp_Destroy(handle);
+}
 
-		STRICT_EXPECTED_CALL(mocks, Base64_Encode_Bytes(buffer1, buffer1_size));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
+//Tests_SRS_TRANSPORTMULTITHTTP_17_114: [ If handle parameter is NULL then IoTHubTransportHttp_SetOption shall return IOTHUB_CLIENT_INVALID_ARG. ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_with_NULL_handle_fails)
+{
+	///arrange
 
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
+	///act
+	auto result = IoTHubTransportHttp_SetOption(NULL, "someOption", "someValue");
 
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\"")) /*closing the value of the body*/
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message1.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3)
-			.IgnoreArgument(4);
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "},")) /* this extra "," is going to be harshly overwritten by a "]"*/
-			.IgnoreArgument(1);;
-		/*end of the first batched payload*/
-	}
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
 
-	{
-		/*adding the first payload to the "big" payload*/
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
-	}
+	///cleanup
+}
 
-	/*this is second batched payload*/
-	{
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message2.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":\""));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(message2.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3);
+//Tests_SRS_TRANSPORTMULTITHTTP_17_115: [ If option parameter is NULL then IoTHubTransportHttp_SetOption shall return IOTHUB_CLIENT_INVALID_ARG. ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_with_NULL_optionName_fails)
+{
+	///arrange
+	CIoTHubTransportHttpMocks mocks;
+	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	mocks.ResetAllCalls();
 
-		STRICT_EXPECTED_CALL(mocks, Base64_Encode_Bytes(buffer2, buffer2_size));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
+	///act
+	auto result = IoTHubTransportHttp_SetOption(handle, NULL, "someValue");
 
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\"")) /*closing the value of the body*/
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message2.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3)
-			.IgnoreArgument(4);
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "},")) /* this extra "," is going to be harshly overwritten by a "]"*/
-			.IgnoreArgument(1);
-		/*end of the second batched payload*/
-	}
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+	mocks.AssertActualAndExpectedCalls();
 
-	{
-		/*adding the second payload to the "big" payload*/
-		whenShallSTRING_concat_with_STRING_fail = currentSTRING_concat_with_STRING_call + 4;
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
-	}
+	///cleanup
+	IoTHubTransportHttp_Destroy(handle);
+}
 
-	{
-		/*closing the "big" payload*/
-		STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, STRING_length(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-	}
+//Tests_SRS_TRANSPORTMULTITHTTP_17_116: [ If value parameter is NULL then IoTHubTransportHttp_SetOption shall return IOTHUB_CLIENT_INVALID_ARG. ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_with_NULL_value_fails)
+{
+	///arrange
+	CIoTHubTransportHttpMocks mocks;
+	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	mocks.ResetAllCalls();
 
-	/*building the list of messages to be notified if HTTP is fine*/
-	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message1.entry)))
-		.IgnoreArgument(1);
+	///act
+	auto result = IoTHubTransportHttp_SetOption(handle, "someOption", NULL);
 
-	{
-		/*this is building the HTTP payload... from a STRING_HANDLE (as it comes as "big payload"), into an array of bytes*/
-		STRICT_EXPECTED_CALL(mocks, BUFFER_new());
-		STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+	mocks.AssertActualAndExpectedCalls();
 
-		STRICT_EXPECTED_CALL(mocks, STRING_length(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, BUFFER_build(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2)
-			.IgnoreArgument(3);
-	}
+	///cleanup
+	IoTHubTransportHttp_Destroy(handle);
+}
 
-	/*executing HTTP goodies*/
-	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
-		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
-		IGNORED_PTR_ARG,
-		HTTPAPI_REQUEST_POST,                                                           /*HTTPAPI_REQUEST_TYPE requestType,                  */
-		"/devices/" TEST_DEVICE_ID EVENT_ENDPOINT API_VERSION,                 /*const char* relativePath,                          */
-		IGNORED_PTR_ARG,                                                                /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,      */
-		IGNORED_PTR_ARG,                                                                /*BUFFER_HANDLE requestContent,                      */
-		IGNORED_PTR_ARG,                                                                /*unsigned int* statusCode,                          */
-		NULL,                                                                           /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,     */
-		NULL                                                                            /*BUFFER_HANDLE responseContent)                     */
-		))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2)
-		.IgnoreArgument(5)
-		.IgnoreArgument(6)
-		.CopyOutArgumentBuffer(7, &httpStatus200, sizeof(httpStatus200));
+//Tests_SRS_TRANSPORTMULTITHTTP_17_119: [ The following table translates HTTPAPIEX return codes to IOTHUB_CLIENT_RESULT return codes: ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_118: [ Otherwise, IoTHubTransport_Http shall call HTTPAPIEX_SetOption with the same parameters and return the translated code. ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_succeeds_when_HTTPAPIEX_succeeds)
+{
+	///arrange
+	CIoTHubTransportHttpMocks mocks;
+	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	mocks.ResetAllCalls();
 
-	/*once the event has been succesfull...*/
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SetOption(TEST_HTTPAPIEX_HANDLE, "someOption", (void*)42));
 
-	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_SUCCESS))
-		.IgnoreArgument(2);
+	///act
+	auto result = IoTHubTransportHttp_SetOption(handle, "someOption", (void*)42);
 
-	ENABLE_BATCHING();
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubTransportHttp_Destroy(handle);
+}
+
+//Tests_SRS_TRANSPORTMULTITHTTP_17_119: [ The following table translates HTTPAPIEX return codes to IOTHUB_CLIENT_RESULT return codes: ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_118: [ Otherwise, IoTHubTransport_Http shall call HTTPAPIEX_SetOption with the same parameters and return the translated code. ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_fails_when_HTTPAPIEX_returns_HTTPAPIEX_INVALID_ARG)
+{
+	///arrange
+	CIoTHubTransportHttpMocks mocks;
+	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SetOption(TEST_HTTPAPIEX_HANDLE, "someOption", (void*)42))
+		.SetReturn(HTTPAPIEX_INVALID_ARG);
 
 	///act
-	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+	auto result = IoTHubTransportHttp_SetOption(handle, "someOption", (void*)42);
 
 	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_066: [ If at any point during construction of the string there are errors, IoTHubTransportHttp_DoWork shall use the so far constructed string as payload. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_2_event_items_the_second_one_does_not_fit_256K_makes_1_batch_of_the_first_item_succeeds)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_119: [ The following table translates HTTPAPIEX return codes to IOTHUB_CLIENT_RESULT return codes: ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_118: [ Otherwise, IoTHubTransport_Http shall call HTTPAPIEX_SetOption with the same parameters and return the translated code. ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_fails_when_HTTPAPIEX_returns_HTTPAPIEX_ERROR)
 {
 	///arrange
 	CIoTHubTransportHttpMocks mocks;
-	DList_InsertTailList(&(waitingToSend), &(message1.entry));
-	DList_InsertTailList(&(waitingToSend), &(message5.entry));
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
-	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
-
 	mocks.ResetAllCalls();
-	setupDoWorkLoopOnceForOneDevice(mocks);
 
-	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SetOption(TEST_HTTPAPIEX_HANDLE, "someOption", (void*)42))
+		.SetReturn(HTTPAPIEX_ERROR);
 
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
-		.IgnoreArgument(1);
+	///act
+	auto result = IoTHubTransportHttp_SetOption(handle, "someOption", (void*)42);
 
-	/*starting to prepare the "big" payload*/
-	STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+	mocks.AssertActualAndExpectedCalls();
 
-	EXPECTED_CALL(mocks, STRING_new_with_memory(IGNORED_PTR_ARG))
-		.ExpectedAtLeastTimes(2);
+	///cleanup
+	IoTHubTransportHttp_Destroy(handle);
+}
 
-	/*this is first batched payload*/
-	{
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message1.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":\""));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(message1.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3);
+//Tests_SRS_TRANSPORTMULTITHTTP_17_119: [ The following table translates HTTPAPIEX return codes to IOTHUB_CLIENT_RESULT return codes: ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_118: [ Otherwise, IoTHubTransport_Http shall call HTTPAPIEX_SetOption with the same parameters and return the translated code. ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_fails_when_HTTPAPIEX_returns_any_other_error)
+{
+	///arrange
+	CIoTHubTransportHttpMocks mocks;
+	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	mocks.ResetAllCalls();
 
-		STRICT_EXPECTED_CALL(mocks, Base64_Encode_Bytes(buffer1, buffer1_size));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SetOption(TEST_HTTPAPIEX_HANDLE, "someOption", (void*)42))
+		.SetReturn(HTTPAPIEX_RECOVERYFAILED);
 
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
+	///act
+	auto result = IoTHubTransportHttp_SetOption(handle, "someOption", (void*)42);
 
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\"")) /*closing the value of the body*/
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message1.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3)
-			.IgnoreArgument(4);
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "},")) /* this extra "," is going to be harshly overwritten by a "]"*/
-			.IgnoreArgument(1);
-		/*end of the first batched payload*/
-	}
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+	mocks.AssertActualAndExpectedCalls();
 
-	{
-		/*adding the first payload to the "big" payload*/
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
-	}
+	///cleanup
+	IoTHubTransportHttp_Destroy(handle);
+}
 
-	/*this is second batched payload*/
-	{
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message5.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":\""));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(message5.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3);
+//Tests_SRS_TRANSPORTMULTITHTTP_17_096: [ If IoTHubClient_LL_MessageCallback returns IOTHUBMESSAGE_ABANDONED then _DoWork shall "abandon" the message. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_with_abandon_succeeds)
+{
+	///arrange
+	CIoTHubTransportHttpMocks mocks;
+	unsigned int statusCode200 = 200;
+	unsigned int statusCode204 = 204;
+	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
-		STRICT_EXPECTED_CALL(mocks, Base64_Encode_Bytes(bigBufferFit, TEST_BIG_BUFFER_1_FIT_SIZE));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
+	(void)IoTHubTransportHttp_Subscribe(devHandle);
+	mocks.ResetAllCalls();
+	setupDoWorkLoopOnceForOneDevice(mocks);
 
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
 
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\"")) /*closing the value of the body*/
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message5.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3)
-			.IgnoreArgument(4);
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "},")) /* this extra "," is going to be harshly overwritten by a "]"*/
-			.IgnoreArgument(1);
-		/*end of the first batched payload*/
-	}
+	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
 
-	{
-		/*adding the second payload to the "big" payload*/
-	}
+	STRICT_EXPECTED_CALL(mocks, BUFFER_new());
+	STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
 
-	{
-		/*closing the "big" payload*/
-		STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, STRING_length(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-	}
+	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+		.IgnoreArgument(1); /*because relativePath is a STRING_HANDLE*/
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
+		IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
+		HTTPAPI_REQUEST_GET,                                /*HTTPAPI_REQUEST_TYPE requestType,                            */
+		"/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP API_VERSION,    /*const char* relativePath,                                    */
+		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
+		NULL,                                               /*BUFFER_HANDLE requestContent,                                */
+		IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
+		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
+		IGNORED_PTR_ARG                                     /*BUFFER_HANDLE responseContent))                              */
+		))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2)
+		.IgnoreArgument(5)
+		.IgnoreArgument(7)
+		.IgnoreArgument(8)
+		.IgnoreArgument(9)
+		.CopyOutArgumentBuffer(7, &statusCode200, sizeof(statusCode200));
 
-	/*building the list of messages to be notified if HTTP is fine*/
-	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_FindHeaderValue(IGNORED_PTR_ARG, "ETag"))
+		.IgnoreArgument(1)
+		.SetReturn(TEST_ETAG_VALUE);
+
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message1.entry)))
+	STRICT_EXPECTED_CALL(mocks, BUFFER_u_char(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
-	{
-		/*this is building the HTTP payload... from a STRING_HANDLE (as it comes as "big payload"), into an array of bytes*/
-		STRICT_EXPECTED_CALL(mocks, BUFFER_new());
-		STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, BUFFER_length(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeaderCount(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2);
 
-		STRICT_EXPECTED_CALL(mocks, STRING_length(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, BUFFER_build(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2)
-			.IgnoreArgument(3);
-	}
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_MessageCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2)
+		.SetReturn(IOTHUBMESSAGE_ABANDONED);
 
-	/*executing HTTP goodies*/
-	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
+	/*this is "abandon"*/
+	STRICT_EXPECTED_CALL(mocks, STRING_clone(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, STRING_construct_n(TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1))
+		.ValidateArgumentBuffer(1, TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1);
+	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "/abandon" API_VERSION))
+		.IgnoreArgument(1);
+
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "If-Match", TEST_ETAG_VALUE))
 		.IgnoreArgument(1);
+
+	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+		.IgnoreArgument(1); /*because abandon relativePath is a STRING_HANDLE*/
 	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
-		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
 		IGNORED_PTR_ARG,
-		HTTPAPI_REQUEST_POST,                                                           /*HTTPAPI_REQUEST_TYPE requestType,                  */
-		"/devices/" TEST_DEVICE_ID EVENT_ENDPOINT API_VERSION,                 /*const char* relativePath,                          */
-		IGNORED_PTR_ARG,                                                                /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,      */
-		IGNORED_PTR_ARG,                                                                /*BUFFER_HANDLE requestContent,                      */
-		IGNORED_PTR_ARG,                                                                /*unsigned int* statusCode,                          */
-		NULL,                                                                           /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,     */
-		NULL                                                                            /*BUFFER_HANDLE responseContent)                     */
+		IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
+		HTTPAPI_REQUEST_POST,                               /*HTTPAPI_REQUEST_TYPE requestType,                            */
+		"/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP_ETAG TEST_ETAG_VALUE_UNQUOTED "/abandon" API_VERSION,    /*const char* relativePath,                                    */
+		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
+		NULL,                                               /*BUFFER_HANDLE requestContent,                                */
+		IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
+		NULL,                                               /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
+		NULL                                                /*BUFFER_HANDLE responseContent))                              */
 		))
 		.IgnoreArgument(1)
 		.IgnoreArgument(2)
 		.IgnoreArgument(5)
-		.IgnoreArgument(6)
-		.CopyOutArgumentBuffer(7, &httpStatus200, sizeof(httpStatus200));
-
-	/*once the event has been succesfull...*/
-
-	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_SUCCESS))
-		.IgnoreArgument(2);
-
-	ENABLE_BATCHING();
+		.IgnoreArgument(7)
+		.CopyOutArgumentBuffer(7, &statusCode204, sizeof(statusCode204));
 
 	///act
 	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
@@ -10155,330 +9415,419 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_2_event_items_the_second_one_does_
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-
-/*** IoTHubTransportHttp_GetSendStatus ***/
-
-//Tests_SRS_TRANSPORTMULTITHTTP_17_111: [ IoTHubTransportHttp_GetSendStatus shall return IOTHUB_CLIENT_INVALID_ARG if called with NULL parameter. ]
-TEST_FUNCTION(IoTHubTransportHttp_GetSendStatus_InvalidHandleArgument_fail)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_090: [ All the HTTP headers of the form iothub-app-name:somecontent shall be transformed in message properties {name, somecontent}. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_with_1_property_succeeds)
 {
-	// arrange
+	///arrange
 	CIoTHubTransportHttpMocks mocks;
+	unsigned int statusCode200 = 200;
+	unsigned int statusCode204 = 204;
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
+	(void)IoTHubTransportHttp_Subscribe(devHandle);
+	size_t nHeaders = 1;
 	mocks.ResetAllCalls();
 
-	IOTHUB_CLIENT_STATUS status;
-
-	// act
-	IOTHUB_CLIENT_RESULT result = IoTHubTransportHttp_GetSendStatus(NULL, &status);
+	setupDoWorkLoopOnceForOneDevice(mocks);
 
-	// assert
-	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_INVALID_ARG);
+	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
 
-	mocks.AssertActualAndExpectedCalls();
+	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
 
-	// cleanup
-	IoTHubTransportHttp_Destroy(handle);
-}
+	STRICT_EXPECTED_CALL(mocks, BUFFER_new());
+	STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_111: [ IoTHubTransportHttp_GetSendStatus shall return IOTHUB_CLIENT_INVALID_ARG if called with NULL parameter. ]
-TEST_FUNCTION(IoTHubTransportHttp_GetSendStatus_InvalidStatusArgument_fail)
-{
-	// arrange
-	CIoTHubTransportHttpMocks mocks;
-	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
-	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+		.IgnoreArgument(1); /*because relativePath is a STRING_HANDLE*/
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+		IGNORED_PTR_ARG,
+		IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
+		HTTPAPI_REQUEST_GET,                                /*HTTPAPI_REQUEST_TYPE requestType,                            */
+		"/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP API_VERSION,    /*const char* relativePath,                                    */
+		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
+		NULL,                                               /*BUFFER_HANDLE requestContent,                                */
+		IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
+		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
+		IGNORED_PTR_ARG                                     /*BUFFER_HANDLE responseContent))                              */
+		))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2)
+		.IgnoreArgument(5)
+		.IgnoreArgument(7)
+		.IgnoreArgument(8)
+		.IgnoreArgument(9)
+		.CopyOutArgumentBuffer(7, &statusCode200, sizeof(statusCode200));
 
-	mocks.ResetAllCalls();
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_FindHeaderValue(IGNORED_PTR_ARG, "ETag"))
+		.IgnoreArgument(1)
+		.SetReturn(TEST_ETAG_VALUE);
 
-	// act
-	IOTHUB_CLIENT_RESULT result = IoTHubTransportHttp_GetSendStatus(devHandle, NULL);
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2)
+		.SetReturn(TEST_IOTHUB_MESSAGE_HANDLE_8);
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, BUFFER_u_char(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, BUFFER_length(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	{
+		/*this scope is for is properties code*/
 
-	// assert
-	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_INVALID_ARG);
+		HTTPHeaders_GetHeaderCount_writes_to_its_outputs = false;
+		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeaderCount(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+			.IgnoreArgument(1)
+			.CopyOutArgumentBuffer(2, &nHeaders, sizeof(nHeaders));
 
-	mocks.AssertActualAndExpectedCalls();
+		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE_8));
 
-	// cleanup
-	IoTHubTransportHttp_Destroy(handle);
-}
+		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeader(IGNORED_PTR_ARG, 0, IGNORED_PTR_ARG))
+			.IgnoreArgument(1)
+			.IgnoreArgument(3);
+		STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+			.IgnoreArgument(1);
+		STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(TEST_MAP_3_PROPERTY, "NAME1", "VALUE1"));
+	}
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_112: [ IoTHubTransportHttp_GetSendStatus shall return IOTHUB_CLIENT_OK and status IOTHUB_CLIENT_SEND_STATUS_IDLE if there are currently no event items to be sent or being sent. ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_138: [ IoTHubTransportHttp_GetSendStatus shall locate deviceHandle in the transport device list by calling VECTOR_find_if. ]
-TEST_FUNCTION(IoTHubTransportHttp_GetSendStatus_empty_waitingToSend_and_empty_eventConfirmations_success)
-{
-	// arrange
-	CIoTHubTransportHttpMocks mocks;
-	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
-	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_MessageCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2);
 
-	mocks.ResetAllCalls();
 
-	STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, devHandle))
+	/*this returns "0" so the message needs to be "accepted"*/
+	/*this is "accepting"*/
+	STRICT_EXPECTED_CALL(mocks, STRING_clone(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, STRING_construct_n(TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1))
+		.ValidateArgumentBuffer(1, TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1);
+	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
 		.IgnoreArgument(1)
 		.IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, API_VERSION))
+		.IgnoreArgument(1);
 
-	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "If-Match", TEST_ETAG_VALUE))
+		.IgnoreArgument(1);
 
-	IOTHUB_CLIENT_STATUS status;
 
-	// act
-	IOTHUB_CLIENT_RESULT result = IoTHubTransportHttp_GetSendStatus(devHandle, &status);
+	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+		.IgnoreArgument(1); /*because abandon relativePath is a STRING_HANDLE*/
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+		IGNORED_PTR_ARG,
+		IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
+		HTTPAPI_REQUEST_DELETE,                                /*HTTPAPI_REQUEST_TYPE requestType,                            */
+		"/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP_ETAG TEST_ETAG_VALUE_UNQUOTED API_VERSION,    /*const char* relativePath,                                    */
+		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
+		NULL,                                               /*BUFFER_HANDLE requestContent,                                */
+		IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
+		NULL,                                               /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
+		NULL                                                /*BUFFER_HANDLE responseContent))                              */
+		))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2)
+		.IgnoreArgument(5)
+		.IgnoreArgument(7)
+		.CopyOutArgumentBuffer(7, &statusCode204, sizeof(statusCode204));
 
-	// assert
-	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_OK);
-	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_STATUS, status, IOTHUB_CLIENT_SEND_STATUS_IDLE);
+	///act
+	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
+	///assert
 	mocks.AssertActualAndExpectedCalls();
 
-	// cleanup
+	///cleanup
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_113: [ IoTHubTransportHttp_GetSendStatus shall return IOTHUB_CLIENT_OK and status IOTHUB_CLIENT_SEND_STATUS_BUSY if there are currently event items to be sent or being sent. ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_138: [ IoTHubTransportHttp_GetSendStatus shall locate deviceHandle in the transport device list by calling VECTOR_find_if. ]
-TEST_FUNCTION(IoTHubTransportHttp_GetSendStatus_waitingToSend_not_empty_success)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_090: [ All the HTTP headers of the form iothub-app-name:somecontent shall be transformed in message properties {name, somecontent}. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_with_2_property_succeeds)
 {
-	// arrange
+	///arrange
 	CIoTHubTransportHttpMocks mocks;
+	unsigned int statusCode200 = 200;
+	unsigned int statusCode204 = 204;
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
 	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
-	IOTHUB_MESSAGE_HANDLE eventMessageHandle = IoTHubMessage_CreateFromByteArray(contains3, 1);
-	IOTHUB_MESSAGE_LIST newEntry;
-	newEntry.messageHandle = &newEntry;
-	DList_InsertTailList(&(waitingToSend), &(newEntry.entry));
-
+	(void)IoTHubTransportHttp_Subscribe(devHandle);
+	size_t nHeaders = 3;
 	mocks.ResetAllCalls();
 
-	STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, devHandle))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2);
-	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
-
-	IOTHUB_CLIENT_STATUS status;
-
-	// act
-	IOTHUB_CLIENT_RESULT result = IoTHubTransportHttp_GetSendStatus(devHandle, &status);
-
-	// assert
-	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_OK);
-	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_STATUS, status, IOTHUB_CLIENT_SEND_STATUS_BUSY);
-
-	mocks.AssertActualAndExpectedCalls();
-
-	// cleanup
-	IoTHubTransportHttp_Destroy(handle);
-	IoTHubMessage_Destroy(eventMessageHandle);
-}
+	setupDoWorkLoopOnceForOneDevice(mocks);
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_139: [ If the device structure is not found, then this function shall fail and return with IOTHUB_CLIENT_INVALID_ARG. ]
-TEST_FUNCTION(IoTHubTransportHttp_GetSendStatus_deviceData_is_not_found_fails)
-{
-	// arrange
-	CIoTHubTransportHttpMocks mocks;
-	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
-	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
 
-	IOTHUB_MESSAGE_HANDLE eventMessageHandle = IoTHubMessage_CreateFromByteArray(contains3, 1);
-	IOTHUB_MESSAGE_LIST newEntry;
-	newEntry.messageHandle = &newEntry;
-	DList_InsertTailList(&(waitingToSend), &(newEntry.entry));
+	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
 
-	mocks.ResetAllCalls();
+	STRICT_EXPECTED_CALL(mocks, BUFFER_new());
+	STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
 
-	STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, devHandle))
+	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+		.IgnoreArgument(1); /*because relativePath is a STRING_HANDLE*/
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+		IGNORED_PTR_ARG,
+		IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
+		HTTPAPI_REQUEST_GET,                                /*HTTPAPI_REQUEST_TYPE requestType,                            */
+		"/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP API_VERSION,    /*const char* relativePath,                                    */
+		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
+		NULL,                                               /*BUFFER_HANDLE requestContent,                                */
+		IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
+		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
+		IGNORED_PTR_ARG                                     /*BUFFER_HANDLE responseContent))                              */
+		))
 		.IgnoreArgument(1)
 		.IgnoreArgument(2)
-		.SetFailReturn((void_ptr)NULL);
-
-	IOTHUB_CLIENT_STATUS status;
-
-	// act
-	IOTHUB_CLIENT_RESULT result = IoTHubTransportHttp_GetSendStatus(devHandle, &status);
-
-	// assert
-	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, result, IOTHUB_CLIENT_INVALID_ARG);
-
-	mocks.AssertActualAndExpectedCalls();
-
-	// cleanup
-	IoTHubTransportHttp_Destroy(handle);
-	IoTHubMessage_Destroy(eventMessageHandle);
-}
+		.IgnoreArgument(5)
+		.IgnoreArgument(7)
+		.IgnoreArgument(8)
+		.IgnoreArgument(9)
+		.CopyOutArgumentBuffer(7, &statusCode200, sizeof(statusCode200));
 
-void setupIrrelevantMocksForProperties(CIoTHubTransportHttpMocks *mocks, IOTHUB_MESSAGE_HANDLE messageHandle) /*these are copy pasted from TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items))*/
-{
-	(void)(*mocks);
-	STRICT_EXPECTED_CALL((*mocks), DList_IsListEmpty(&waitingToSend));
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_FindHeaderValue(IGNORED_PTR_ARG, "ETag"))
+		.IgnoreArgument(1)
+		.SetReturn(TEST_ETAG_VALUE);
 
-	STRICT_EXPECTED_CALL((*mocks), HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2)
+		.SetReturn(TEST_IOTHUB_MESSAGE_HANDLE_8);
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
-
-	/*starting to prepare the "big" payload*/
-	STRICT_EXPECTED_CALL((*mocks), STRING_construct("["));
-	STRICT_EXPECTED_CALL((*mocks), STRING_delete(IGNORED_PTR_ARG))
+	STRICT_EXPECTED_CALL(mocks, BUFFER_u_char(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, BUFFER_length(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
-
-	/*this is first batched payload*/
 	{
-		STRICT_EXPECTED_CALL((*mocks), IoTHubMessage_GetContentType(messageHandle));
-		STRICT_EXPECTED_CALL((*mocks), STRING_construct("{\"body\":\""));
-		STRICT_EXPECTED_CALL((*mocks), STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL((*mocks), IoTHubMessage_GetByteArray(messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3);
-
+		/*this scope is for is properties code*/
 
-		switch ((uintptr_t)messageHandle)
-		{
-		case((uintptr_t)TEST_IOTHUB_MESSAGE_HANDLE_11) :
-		{
-			STRICT_EXPECTED_CALL((*mocks), Base64_Encode_Bytes(buffer11, buffer11_size));
-			break;
-		}
-		default:
-		{
-			STRICT_EXPECTED_CALL((*mocks), Base64_Encode_Bytes(buffer6, buffer6_size));
-			break;
-		}
-		}
+		HTTPHeaders_GetHeaderCount_writes_to_its_outputs = false;
+		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeaderCount(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+			.IgnoreArgument(1)
+			.CopyOutArgumentBuffer(2, &nHeaders, sizeof(nHeaders));
 
-		STRICT_EXPECTED_CALL((*mocks), STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
+		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE_8));
 
-		STRICT_EXPECTED_CALL((*mocks), STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeader(IGNORED_PTR_ARG, 0, IGNORED_PTR_ARG))
 			.IgnoreArgument(1)
-			.IgnoreArgument(2);
-
-		STRICT_EXPECTED_CALL((*mocks), STRING_concat(IGNORED_PTR_ARG, "\"")) /*closing the value of the body*/
+			.IgnoreArgument(3);
+		STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
 			.IgnoreArgument(1);
+		STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(TEST_MAP_3_PROPERTY, "NAME1", "VALUE1"));
 
-		STRICT_EXPECTED_CALL((*mocks), STRING_concat(IGNORED_PTR_ARG, "},")) /* this extra "," is going to be harshly overwritten by a "]"*/
+		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeader(IGNORED_PTR_ARG, 1, IGNORED_PTR_ARG))
+			.IgnoreArgument(1)
+			.IgnoreArgument(3);
+		STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
 			.IgnoreArgument(1);
-		/*end of the first batched payload*/
-	}
 
-	{
-		/*adding the first payload to the "big" payload*/
-		STRICT_EXPECTED_CALL((*mocks), STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeader(IGNORED_PTR_ARG, 2, IGNORED_PTR_ARG))
 			.IgnoreArgument(1)
-			.IgnoreArgument(2);
-
-		/*closing the "big" payload*/
-		STRICT_EXPECTED_CALL((*mocks), STRING_c_str(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL((*mocks), STRING_length(IGNORED_PTR_ARG))
+			.IgnoreArgument(3);
+		STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
 			.IgnoreArgument(1);
+		STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(TEST_MAP_3_PROPERTY, "NAME2", "VALUE2"));
 	}
 
-	/*building the list of messages to be notified if HTTP is fine*/
-	STRICT_EXPECTED_CALL((*mocks), DList_RemoveHeadList(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-
-	switch ((uintptr_t)messageHandle)
-	{
-	case((uintptr_t)TEST_IOTHUB_MESSAGE_HANDLE_11) :
-	{
-		STRICT_EXPECTED_CALL((*mocks), DList_InsertTailList(IGNORED_PTR_ARG, &(message11.entry)))
-			.IgnoreArgument(1);
-		break;
-	}
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_MessageCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2);
 
-	default:
-	{
-		STRICT_EXPECTED_CALL((*mocks), DList_InsertTailList(IGNORED_PTR_ARG, &(message6.entry)))
-			.IgnoreArgument(1);
-		break;
-	}
-	}
 
+	/*this returns "0" so the message needs to be "accepted"*/
+	/*this is "accepting"*/
+	STRICT_EXPECTED_CALL(mocks, STRING_clone(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, STRING_construct_n(TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1))
+		.ValidateArgumentBuffer(1, TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1);
+	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, API_VERSION))
+		.IgnoreArgument(1);
 
-	{
-		/*this is building the HTTP payload... from a STRING_HANDLE (as it comes as "big payload"), into an array of bytes*/
-		STRICT_EXPECTED_CALL((*mocks), BUFFER_new());
-		STRICT_EXPECTED_CALL((*mocks), BUFFER_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "If-Match", TEST_ETAG_VALUE))
+		.IgnoreArgument(1);
 
-		STRICT_EXPECTED_CALL((*mocks), STRING_length(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL((*mocks), STRING_c_str(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL((*mocks), BUFFER_build(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2)
-			.IgnoreArgument(3);
-	}
 
-	/*executing HTTP goodies*/
-	STRICT_EXPECTED_CALL((*mocks), STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL((*mocks), HTTPAPIEX_SAS_ExecuteRequest2(
-		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
+	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+		.IgnoreArgument(1); /*because abandon relativePath is a STRING_HANDLE*/
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
 		IGNORED_PTR_ARG,
-		HTTPAPI_REQUEST_POST,                                                           /*HTTPAPI_REQUEST_TYPE requestType,                  */
-		"/devices/" TEST_DEVICE_ID EVENT_ENDPOINT API_VERSION,                 /*const char* relativePath,                          */
-		IGNORED_PTR_ARG,                                                                /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,      */
-		IGNORED_PTR_ARG,                                                                /*BUFFER_HANDLE requestContent,                      */
-		IGNORED_PTR_ARG,                                                                /*unsigned int* statusCode,                          */
-		NULL,                                                                           /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,     */
-		NULL                                                                            /*BUFFER_HANDLE responseContent)                     */
+		IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
+		HTTPAPI_REQUEST_DELETE,                                /*HTTPAPI_REQUEST_TYPE requestType,                            */
+		"/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP_ETAG TEST_ETAG_VALUE_UNQUOTED API_VERSION,    /*const char* relativePath,                                    */
+		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
+		NULL,                                               /*BUFFER_HANDLE requestContent,                                */
+		IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
+		NULL,                                               /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
+		NULL                                                /*BUFFER_HANDLE responseContent))                              */
 		))
 		.IgnoreArgument(1)
 		.IgnoreArgument(2)
 		.IgnoreArgument(5)
-		.IgnoreArgument(6)
-		.CopyOutArgumentBuffer(7, &httpStatus200, sizeof(httpStatus200));
+		.IgnoreArgument(7)
+		.CopyOutArgumentBuffer(7, &statusCode204, sizeof(statusCode204));
 
-	/*once the event has been succesfull...*/
+	///act
+	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
-	STRICT_EXPECTED_CALL((*mocks), IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_SUCCESS))
-		.IgnoreArgument(2);
+	///assert
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_064: [ If IoTHubMessage does not have properties, then "properties":{...} shall be missing from the payload. ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_059: [ It shall inspect the "waitingToSend" DLIST passed in config structure. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_with_properties_succeeds)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_090: [ All the HTTP headers of the form iothub-app-name:somecontent shall be transformed in message properties {name, somecontent}. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_092: [ If assembling the message fails in any way, then _DoWork shall "abandon" the message. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_with_2_property_when_properties_fails_it_abandons_1)
 {
 	///arrange
 	CIoTHubTransportHttpMocks mocks;
-	DList_InsertTailList(&(waitingToSend), &(message6.entry));
+	unsigned int statusCode200 = 200;
+	unsigned int statusCode204 = 204;
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
 	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
+	(void)IoTHubTransportHttp_Subscribe(devHandle);
+	size_t nHeaders = 3;
 	mocks.ResetAllCalls();
 
 	setupDoWorkLoopOnceForOneDevice(mocks);
 
-	setupIrrelevantMocksForProperties(&mocks, message6.messageHandle);
-
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message6.messageHandle));
-	STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_1_PROPERTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreArgument(2)
-		.IgnoreArgument(3)
-		.IgnoreArgument(4);
-
-	EXPECTED_CALL(mocks, STRING_new_with_memory(IGNORED_PTR_ARG));
+	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
 
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, ",\"properties\":"))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "{"))
+	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\"iothub-app-"))
+
+	STRICT_EXPECTED_CALL(mocks, BUFFER_new());
+	STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, TEST_VALUES1[0]))
+
+	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+		.IgnoreArgument(1); /*because relativePath is a STRING_HANDLE*/
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+		IGNORED_PTR_ARG,
+		IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
+		HTTPAPI_REQUEST_GET,                                /*HTTPAPI_REQUEST_TYPE requestType,                            */
+		"/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP API_VERSION,    /*const char* relativePath,                                    */
+		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
+		NULL,                                               /*BUFFER_HANDLE requestContent,                                */
+		IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
+		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
+		IGNORED_PTR_ARG                                     /*BUFFER_HANDLE responseContent))                              */
+		))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2)
+		.IgnoreArgument(5)
+		.IgnoreArgument(7)
+		.IgnoreArgument(8)
+		.IgnoreArgument(9)
+		.CopyOutArgumentBuffer(7, &statusCode200, sizeof(statusCode200));
+
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_FindHeaderValue(IGNORED_PTR_ARG, "ETag"))
+		.IgnoreArgument(1)
+		.SetReturn(TEST_ETAG_VALUE);
+
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2)
+		.SetReturn(TEST_IOTHUB_MESSAGE_HANDLE_8);
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, BUFFER_u_char(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, BUFFER_length(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	{
+		/*this scope is for is properties code*/
+
+		HTTPHeaders_GetHeaderCount_writes_to_its_outputs = false;
+		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeaderCount(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+			.IgnoreArgument(1)
+			.CopyOutArgumentBuffer(2, &nHeaders, sizeof(nHeaders));
+
+		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE_8));
+
+		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeader(IGNORED_PTR_ARG, 0, IGNORED_PTR_ARG))
+			.IgnoreArgument(1)
+			.IgnoreArgument(3);
+		STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+			.IgnoreArgument(1);
+		STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(TEST_MAP_3_PROPERTY, "NAME1", "VALUE1"));
+
+		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeader(IGNORED_PTR_ARG, 1, IGNORED_PTR_ARG))
+			.IgnoreArgument(1)
+			.IgnoreArgument(3);
+		STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+			.IgnoreArgument(1);
+
+		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeader(IGNORED_PTR_ARG, 2, IGNORED_PTR_ARG))
+			.IgnoreArgument(1)
+			.IgnoreArgument(3);
+		STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+			.IgnoreArgument(1);
+		STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(TEST_MAP_3_PROPERTY, "NAME2", "VALUE2"))
+			.SetReturn(MAP_ERROR);
+	}
+
+	/*this is "abandon"*/
+	STRICT_EXPECTED_CALL(mocks, STRING_clone(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\":\""))
+	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, TEST_KEYS1[0]))
+	STRICT_EXPECTED_CALL(mocks, STRING_construct_n(TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1))
+		.ValidateArgumentBuffer(1, TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1);
+	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\""))
+	STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "/abandon" API_VERSION))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "}"))
+
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "If-Match", TEST_ETAG_VALUE))
 		.IgnoreArgument(1);
 
-	ENABLE_BATCHING();
+
+	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+		.IgnoreArgument(1); /*because abandon relativePath is a STRING_HANDLE*/
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+		IGNORED_PTR_ARG,
+		IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
+		HTTPAPI_REQUEST_POST,                               /*HTTPAPI_REQUEST_TYPE requestType,                            */
+		"/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP_ETAG TEST_ETAG_VALUE_UNQUOTED "/abandon" API_VERSION,    /*const char* relativePath,                                    */
+		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
+		NULL,                                               /*BUFFER_HANDLE requestContent,                                */
+		IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
+		NULL,                                               /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
+		NULL                                                /*BUFFER_HANDLE responseContent))                              */
+		))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2)
+		.IgnoreArgument(5)
+		.IgnoreArgument(7)
+		.CopyOutArgumentBuffer(7, &statusCode204, sizeof(statusCode204));
 
 	///act
 	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
@@ -10490,82 +9839,136 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_with_properties_succ
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_063: [ Every property name shall add to the message size the length of the property name + the length of the property value + 16 bytes. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_with_1_properties_at_maximum_message_size_succeeds)
+
+//Tests_SRS_TRANSPORTMULTITHTTP_17_090: [ All the HTTP headers of the form iothub-app-name:somecontent shall be transformed in message properties {name, somecontent}. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_092: [ If assembling the message fails in any way, then _DoWork shall "abandon" the message. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_with_2_property_when_properties_fails_it_abandons_2)
 {
-	/*this test shall use a message that has a payload of MAXIMUM_MESSAGE_SIZE - PAYLOAD_OVERHEAD - PROPERTY_OVERHEAD - 2*/
-	/*it will also have a property of "a":"b", therefore reaching the MAXIMUM_MESSAGE_SIZE*/
-	/*the next test will increase either the propertyname or value by 1 character as the message is expected to fail*/
 	///arrange
 	CIoTHubTransportHttpMocks mocks;
-	DList_InsertTailList(&(waitingToSend), &(message11.entry));
+	unsigned int statusCode200 = 200;
+	unsigned int statusCode204 = 204;
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
 	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
+	(void)IoTHubTransportHttp_Subscribe(devHandle);
+	size_t nHeaders = 3;
 	mocks.ResetAllCalls();
 
 	setupDoWorkLoopOnceForOneDevice(mocks);
 
-	setupIrrelevantMocksForProperties(&mocks, message11.messageHandle);
+	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
 
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message11.messageHandle));
-	STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_1_PROPERTY_A_B, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+
+	STRICT_EXPECTED_CALL(mocks, BUFFER_new());
+	STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+
+	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+		.IgnoreArgument(1); /*because relativePath is a STRING_HANDLE*/
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+		IGNORED_PTR_ARG,
+		IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
+		HTTPAPI_REQUEST_GET,                                /*HTTPAPI_REQUEST_TYPE requestType,                            */
+		"/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP API_VERSION,    /*const char* relativePath,                                    */
+		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
+		NULL,                                               /*BUFFER_HANDLE requestContent,                                */
+		IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
+		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
+		IGNORED_PTR_ARG                                     /*BUFFER_HANDLE responseContent))                              */
+		))
+		.IgnoreArgument(1)
 		.IgnoreArgument(2)
-		.IgnoreArgument(3)
-		.IgnoreArgument(4);
+		.IgnoreArgument(5)
+		.IgnoreArgument(7)
+		.IgnoreArgument(8)
+		.IgnoreArgument(9)
+		.CopyOutArgumentBuffer(7, &statusCode200, sizeof(statusCode200));
 
-	EXPECTED_CALL(mocks, STRING_new_with_memory(IGNORED_PTR_ARG));
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_FindHeaderValue(IGNORED_PTR_ARG, "ETag"))
+		.IgnoreArgument(1)
+		.SetReturn(TEST_ETAG_VALUE);
 
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, ",\"properties\":"))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "{"))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\"iothub-app-"))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, TEST_VALUES1_A_B[0]))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\":\""))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, TEST_KEYS1_A_B[0]))
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2)
+		.SetReturn(TEST_IOTHUB_MESSAGE_HANDLE_8);
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\""))
+	STRICT_EXPECTED_CALL(mocks, BUFFER_u_char(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "}"))
+	STRICT_EXPECTED_CALL(mocks, BUFFER_length(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
+	{
+		/*this scope is for is properties code*/
 
-	ENABLE_BATCHING();
-
-	///act
-	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+		HTTPHeaders_GetHeaderCount_writes_to_its_outputs = false;
+		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeaderCount(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+			.IgnoreArgument(1)
+			.CopyOutArgumentBuffer(2, &nHeaders, sizeof(nHeaders));
 
-	///assert
-	mocks.AssertActualAndExpectedCalls();
+		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE_8));
 
-	///cleanup
-	IoTHubTransportHttp_Destroy(handle);
-}
+		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeader(IGNORED_PTR_ARG, 0, IGNORED_PTR_ARG))
+			.IgnoreArgument(1)
+			.IgnoreArgument(3);
+		STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+			.IgnoreArgument(1);
+		STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(TEST_MAP_3_PROPERTY, "NAME1", "VALUE1"));
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_063: [ Every property name shall add to the message size the length of the property name + the length of the property value + 16 bytes. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_with_1_properties_past_maximum_message_size_fails)
-{
-	/*this test shall use a message that has a payload of MAXIMUM_MESSAGE_SIZE - PAYLOAD_OVERHEAD - PROPERTY_OVERHEAD - 2*/
-	/*it will also have a property of "aa":"b", therefore reaching 1 byte past the MAXIMUM_MESSAGE_SIZE*/
-	/*this is done in a very e2e manner*/
-	///arrange
-	CNiceCallComparer<CIoTHubTransportHttpMocks>mocks;
-	DList_InsertTailList(&(waitingToSend), &(message12.entry));
-	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
-	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeader(IGNORED_PTR_ARG, 1, IGNORED_PTR_ARG))
+			.IgnoreArgument(1)
+			.IgnoreArgument(3);
+		STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+			.IgnoreArgument(1);
 
-	ENABLE_BATCHING();
+		whenShallHTTPHeaders_GetHeader_fail = currentHTTPHeaders_GetHeader_call + 3;
+		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeader(IGNORED_PTR_ARG, 2, IGNORED_PTR_ARG))
+			.IgnoreArgument(1)
+			.IgnoreArgument(3);
+	}
 
+	/*this is "abandon"*/
+	STRICT_EXPECTED_CALL(mocks, STRING_clone(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, STRING_construct_n(TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1))
+		.ValidateArgumentBuffer(1, TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1);
+	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "/abandon" API_VERSION))
+		.IgnoreArgument(1);
 
-	mocks.ResetAllCalls();
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "If-Match", TEST_ETAG_VALUE))
+		.IgnoreArgument(1);
 
-	setupDoWorkLoopOnceForOneDevice(mocks);
 
-	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_FAILED))
-		.IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+		.IgnoreArgument(1); /*because abandon relativePath is a STRING_HANDLE*/
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+		IGNORED_PTR_ARG,
+		IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
+		HTTPAPI_REQUEST_POST,                               /*HTTPAPI_REQUEST_TYPE requestType,                            */
+		"/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP_ETAG TEST_ETAG_VALUE_UNQUOTED "/abandon" API_VERSION,    /*const char* relativePath,                                    */
+		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
+		NULL,                                               /*BUFFER_HANDLE requestContent,                                */
+		IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
+		NULL,                                               /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
+		NULL                                                /*BUFFER_HANDLE responseContent))                              */
+		))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2)
+		.IgnoreArgument(5)
+		.IgnoreArgument(7)
+		.CopyOutArgumentBuffer(7, &statusCode204, sizeof(statusCode204));
 
 	///act
 	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
@@ -10577,258 +9980,259 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_with_1_properties_pa
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_064: [ If IoTHubMessage does not have properties, then "properties":{...} shall be missing from the payload. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_fails_when_Map_GetInternals_fails)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_090: [ All the HTTP headers of the form iothub-app-name:somecontent shall be transformed in message properties {name, somecontent}. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_092: [ If assembling the message fails in any way, then _DoWork shall "abandon" the message. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_with_2_property_when_properties_fails_it_abandons_3)
 {
 	///arrange
-	CNiceCallComparer<CIoTHubTransportHttpMocks> mocks;
-	DList_InsertTailList(&(waitingToSend), &(message6.entry));
+	CIoTHubTransportHttpMocks mocks;
+	unsigned int statusCode200 = 200;
+	unsigned int statusCode204 = 204;
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
 	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
+	(void)IoTHubTransportHttp_Subscribe(devHandle);
+	size_t nHeaders = 3;
 	mocks.ResetAllCalls();
 
 	setupDoWorkLoopOnceForOneDevice(mocks);
 
-	STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_1_PROPERTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreArgument(2)
-		.IgnoreArgument(3)
-		.IgnoreArgument(4)
-		.SetReturn(MAP_ERROR);
-
-	ENABLE_BATCHING();
-
-	///act
-	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
 
-	///assert
-	ASSERT_IS_NULL(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest);
-	mocks.AssertActualAndExpectedCalls();
+	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
 
+	STRICT_EXPECTED_CALL(mocks, BUFFER_new());
+	STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
 
-	///cleanup
-	IoTHubTransportHttp_Destroy(handle);
-}
+	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+		.IgnoreArgument(1); /*because relativePath is a STRING_HANDLE*/
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+		IGNORED_PTR_ARG,
+		IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
+		HTTPAPI_REQUEST_GET,                                /*HTTPAPI_REQUEST_TYPE requestType,                            */
+		"/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP API_VERSION,    /*const char* relativePath,                                    */
+		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
+		NULL,                                               /*BUFFER_HANDLE requestContent,                                */
+		IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
+		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
+		IGNORED_PTR_ARG                                     /*BUFFER_HANDLE responseContent))                              */
+		))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2)
+		.IgnoreArgument(5)
+		.IgnoreArgument(7)
+		.IgnoreArgument(8)
+		.IgnoreArgument(9)
+		.CopyOutArgumentBuffer(7, &statusCode200, sizeof(statusCode200));
 
-void setupIrrelevantMocksForProperties2(CIoTHubTransportHttpMocks *mocks, IOTHUB_MESSAGE_HANDLE h1, IOTHUB_MESSAGE_HANDLE h2) /*these are copy pasted from TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items))*/
-{
-	(void)(*mocks);
-	STRICT_EXPECTED_CALL((*mocks), DList_IsListEmpty(&waitingToSend));
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_FindHeaderValue(IGNORED_PTR_ARG, "ETag"))
+		.IgnoreArgument(1)
+		.SetReturn(TEST_ETAG_VALUE);
 
-	STRICT_EXPECTED_CALL((*mocks), HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2)
+		.SetReturn(TEST_IOTHUB_MESSAGE_HANDLE_8);
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
-
-	/*starting to prepare the "big" payload*/
-	STRICT_EXPECTED_CALL((*mocks), STRING_construct("["));
-	STRICT_EXPECTED_CALL((*mocks), STRING_delete(IGNORED_PTR_ARG))
+	STRICT_EXPECTED_CALL(mocks, BUFFER_u_char(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, BUFFER_length(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
-
-	/*this is first batched payload*/
 	{
-		STRICT_EXPECTED_CALL((*mocks), IoTHubMessage_GetContentType(h1));
-		STRICT_EXPECTED_CALL((*mocks), STRING_construct("{\"body\":\""));
-		STRICT_EXPECTED_CALL((*mocks), STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL((*mocks), IoTHubMessage_GetByteArray(message6.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3);
-
-		STRICT_EXPECTED_CALL((*mocks), Base64_Encode_Bytes(buffer6, buffer6_size));
-		STRICT_EXPECTED_CALL((*mocks), STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
+		/*this scope is for is properties code*/
 
-		STRICT_EXPECTED_CALL((*mocks), STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		HTTPHeaders_GetHeaderCount_writes_to_its_outputs = false;
+		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeaderCount(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
 			.IgnoreArgument(1)
-			.IgnoreArgument(2);
-
-		STRICT_EXPECTED_CALL((*mocks), STRING_concat(IGNORED_PTR_ARG, "\"")) /*closing the value of the body*/
-			.IgnoreArgument(1);
+			.CopyOutArgumentBuffer(2, &nHeaders, sizeof(nHeaders));
 
-		STRICT_EXPECTED_CALL((*mocks), STRING_concat(IGNORED_PTR_ARG, "},")) /* this extra "," is going to be harshly overwritten by a "]"*/
-			.IgnoreArgument(1);
-		/*end of the first batched payload*/
-	}
+		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE_8));
 
-	{
-		/*adding the first payload to the "big" payload*/
-		STRICT_EXPECTED_CALL((*mocks), STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeader(IGNORED_PTR_ARG, 0, IGNORED_PTR_ARG))
 			.IgnoreArgument(1)
-			.IgnoreArgument(2);
-	}
-
-	/*this is second batched payload*/
-	{
-		STRICT_EXPECTED_CALL((*mocks), IoTHubMessage_GetContentType(h2));
-		STRICT_EXPECTED_CALL((*mocks), STRING_construct("{\"body\":\""));
-		STRICT_EXPECTED_CALL((*mocks), STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL((*mocks), IoTHubMessage_GetByteArray(message7.messageHandle, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
 			.IgnoreArgument(3);
-
-		STRICT_EXPECTED_CALL((*mocks), Base64_Encode_Bytes(buffer7, buffer7_size));
-		STRICT_EXPECTED_CALL((*mocks), STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-
-		STRICT_EXPECTED_CALL((*mocks), STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
-
-		STRICT_EXPECTED_CALL((*mocks), STRING_concat(IGNORED_PTR_ARG, "\"")) /*closing the value of the body*/
-			.IgnoreArgument(1);
-
-		STRICT_EXPECTED_CALL((*mocks), STRING_concat(IGNORED_PTR_ARG, "},")) /* this extra "," is going to be harshly overwritten by a "]"*/
+		STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
 			.IgnoreArgument(1);
-		/*end of the first batched payload*/
-	}
+		STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(TEST_MAP_3_PROPERTY, "NAME1", "VALUE1"));
 
-	{
-		/*adding the second payload to the "big" payload*/
-		STRICT_EXPECTED_CALL((*mocks), STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		whenShallHTTPHeaders_GetHeader_fail = currentHTTPHeaders_GetHeader_call + 2;
+		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeader(IGNORED_PTR_ARG, 1, IGNORED_PTR_ARG))
 			.IgnoreArgument(1)
-			.IgnoreArgument(2);
-
-		/*closing the "big" payload*/
-		STRICT_EXPECTED_CALL((*mocks), STRING_c_str(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL((*mocks), STRING_length(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
+			.IgnoreArgument(3);
 	}
 
-	/*building the list of messages to be notified if HTTP is fine*/
-	STRICT_EXPECTED_CALL((*mocks), DList_RemoveHeadList(IGNORED_PTR_ARG))
+	/*this is "abandon"*/
+	STRICT_EXPECTED_CALL(mocks, STRING_clone(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL((*mocks), DList_InsertTailList(IGNORED_PTR_ARG, &(message6.entry)))
+	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL((*mocks), DList_RemoveHeadList(IGNORED_PTR_ARG))
+	STRICT_EXPECTED_CALL(mocks, STRING_construct_n(TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1))
+		.ValidateArgumentBuffer(1, TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1);
+	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL((*mocks), DList_InsertTailList(IGNORED_PTR_ARG, &(message7.entry)))
+	STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "/abandon" API_VERSION))
 		.IgnoreArgument(1);
 
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "If-Match", TEST_ETAG_VALUE))
+		.IgnoreArgument(1);
 
-	{
-		/*this is building the HTTP payload... from a STRING_HANDLE (as it comes as "big payload"), into an array of bytes*/
-		STRICT_EXPECTED_CALL((*mocks), BUFFER_new());
-		STRICT_EXPECTED_CALL((*mocks), BUFFER_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-
-		STRICT_EXPECTED_CALL((*mocks), STRING_length(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL((*mocks), STRING_c_str(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL((*mocks), BUFFER_build(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2)
-			.IgnoreArgument(3);
-	}
 
-	/*executing HTTP goodies*/
-	STRICT_EXPECTED_CALL((*mocks), STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL((*mocks), HTTPAPIEX_SAS_ExecuteRequest2(
-		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
+	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+		.IgnoreArgument(1); /*because abandon relativePath is a STRING_HANDLE*/
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
 		IGNORED_PTR_ARG,
-		HTTPAPI_REQUEST_POST,                                                           /*HTTPAPI_REQUEST_TYPE requestType,                  */
-		"/devices/" TEST_DEVICE_ID EVENT_ENDPOINT API_VERSION,                 /*const char* relativePath,                          */
-		IGNORED_PTR_ARG,                                                                /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,      */
-		IGNORED_PTR_ARG,                                                                /*BUFFER_HANDLE requestContent,                      */
-		IGNORED_PTR_ARG,                                                                /*unsigned int* statusCode,                          */
-		NULL,                                                                           /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,     */
-		NULL                                                                            /*BUFFER_HANDLE responseContent)                     */
+		IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
+		HTTPAPI_REQUEST_POST,                               /*HTTPAPI_REQUEST_TYPE requestType,                            */
+		"/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP_ETAG TEST_ETAG_VALUE_UNQUOTED "/abandon" API_VERSION,    /*const char* relativePath,                                    */
+		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
+		NULL,                                               /*BUFFER_HANDLE requestContent,                                */
+		IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
+		NULL,                                               /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
+		NULL                                                /*BUFFER_HANDLE responseContent))                              */
 		))
 		.IgnoreArgument(1)
 		.IgnoreArgument(2)
 		.IgnoreArgument(5)
-		.IgnoreArgument(6)
-		.CopyOutArgumentBuffer(7, &httpStatus200, sizeof(httpStatus200));
+		.IgnoreArgument(7)
+		.CopyOutArgumentBuffer(7, &statusCode204, sizeof(statusCode204));
 
-	/*once the event has been succesfull...*/
+	///act
+	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
-	STRICT_EXPECTED_CALL((*mocks), IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_SUCCESS))
-		.IgnoreArgument(2);
+	///assert
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_064: [ If IoTHubMessage does not have properties, then "properties":{...} shall be missing from the payload. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_2_event_items_with_properties_succeeds)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_090: [ All the HTTP headers of the form iothub-app-name:somecontent shall be transformed in message properties {name, somecontent}. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_092: [ If assembling the message fails in any way, then _DoWork shall "abandon" the message. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_with_2_property_when_properties_fails_it_abandons_4)
 {
 	///arrange
 	CIoTHubTransportHttpMocks mocks;
-	DList_InsertTailList(&(waitingToSend), &(message6.entry));
-	DList_InsertTailList(&(waitingToSend), &(message7.entry));
+	unsigned int statusCode200 = 200;
+	unsigned int statusCode204 = 204;
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
 	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
+	(void)IoTHubTransportHttp_Subscribe(devHandle);
+	size_t nHeaders = 3;
 	mocks.ResetAllCalls();
 
 	setupDoWorkLoopOnceForOneDevice(mocks);
 
-	setupIrrelevantMocksForProperties2(&mocks, message6.messageHandle, message7.messageHandle);
-
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message6.messageHandle));
-	STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_1_PROPERTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreArgument(2)
-		.IgnoreArgument(3)
-		.IgnoreArgument(4);
-
-	EXPECTED_CALL(mocks, STRING_new_with_memory(IGNORED_PTR_ARG))
-		.ExpectedAtLeastTimes(2);
+	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
 
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, ",\"properties\":"))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "{")) /*opening of the properties*/
+	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
 
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\"iothub-app-"))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, TEST_VALUES1[0]))
+	STRICT_EXPECTED_CALL(mocks, BUFFER_new());
+	STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\":\""))
+
+	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+		.IgnoreArgument(1); /*because relativePath is a STRING_HANDLE*/
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+		IGNORED_PTR_ARG,
+		IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
+		HTTPAPI_REQUEST_GET,                                /*HTTPAPI_REQUEST_TYPE requestType,                            */
+		"/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP API_VERSION,    /*const char* relativePath,                                    */
+		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
+		NULL,                                               /*BUFFER_HANDLE requestContent,                                */
+		IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
+		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
+		IGNORED_PTR_ARG                                     /*BUFFER_HANDLE responseContent))                              */
+		))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2)
+		.IgnoreArgument(5)
+		.IgnoreArgument(7)
+		.IgnoreArgument(8)
+		.IgnoreArgument(9)
+		.CopyOutArgumentBuffer(7, &statusCode200, sizeof(statusCode200));
+
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_FindHeaderValue(IGNORED_PTR_ARG, "ETag"))
+		.IgnoreArgument(1)
+		.SetReturn(TEST_ETAG_VALUE);
+
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2)
+		.SetReturn(TEST_IOTHUB_MESSAGE_HANDLE_8);
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, TEST_KEYS1[0]))
+	STRICT_EXPECTED_CALL(mocks, BUFFER_u_char(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\""))
+	STRICT_EXPECTED_CALL(mocks, BUFFER_length(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
+	{
+		/*this scope is for is properties code*/
 
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "}"))/*closing of the properties*/
-		.IgnoreArgument(1);
+		HTTPHeaders_GetHeaderCount_writes_to_its_outputs = false;
+		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeaderCount(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+			.IgnoreArgument(1)
+			.CopyOutArgumentBuffer(2, &nHeaders, sizeof(nHeaders));
 
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message7.messageHandle));
-	STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_2_PROPERTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreArgument(2)
-		.IgnoreArgument(3)
-		.IgnoreArgument(4);
+		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE_8));
 
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, ",\"properties\":"))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "{")) /*opening of the properties*/
-		.IgnoreArgument(1);
+		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeader(IGNORED_PTR_ARG, 0, IGNORED_PTR_ARG))
+			.IgnoreArgument(1)
+			.IgnoreArgument(3);
+		STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+			.IgnoreArgument(1);
+		STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(TEST_MAP_3_PROPERTY, "NAME1", "VALUE1"))
+			.SetReturn(MAP_ERROR);
+	}
 
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\"iothub-app-"))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, TEST_VALUES2[0]))
+	/*this is "abandon"*/
+	STRICT_EXPECTED_CALL(mocks, STRING_clone(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\":\""))
+	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, TEST_KEYS2[0]))
+	STRICT_EXPECTED_CALL(mocks, STRING_construct_n(TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1))
+		.ValidateArgumentBuffer(1, TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1);
+	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\""))
+	STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "/abandon" API_VERSION))
 		.IgnoreArgument(1);
 
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, ",\"iothub-app-"))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, TEST_VALUES2[1]))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\":\""))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, TEST_KEYS2[1]))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "\""))
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "If-Match", TEST_ETAG_VALUE))
 		.IgnoreArgument(1);
 
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "}"))/*closing of the properties*/
-		.IgnoreArgument(1);
 
-	ENABLE_BATCHING();
+	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+		.IgnoreArgument(1); /*because abandon relativePath is a STRING_HANDLE*/
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+		IGNORED_PTR_ARG,
+		IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
+		HTTPAPI_REQUEST_POST,                               /*HTTPAPI_REQUEST_TYPE requestType,                            */
+		"/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP_ETAG TEST_ETAG_VALUE_UNQUOTED "/abandon" API_VERSION,    /*const char* relativePath,                                    */
+		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
+		NULL,                                               /*BUFFER_HANDLE requestContent,                                */
+		IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
+		NULL,                                               /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
+		NULL                                                /*BUFFER_HANDLE responseContent))                              */
+		))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2)
+		.IgnoreArgument(5)
+		.IgnoreArgument(7)
+		.CopyOutArgumentBuffer(7, &statusCode204, sizeof(statusCode204));
 
 	///act
 	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
@@ -10840,552 +10244,834 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_2_event_items_with_properties_succ
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-
-#define TEST_2_ITEM_STRING "[{\"body\":\"MTIzNDU2\",\"properties\":{" TEST_RED_KEY_STRING_WITH_IOTHUBAPP ":" TEST_RED_VALUE_STRING "}},{\"body\":\"MTIzNDU2Nw==\",\"properties\":{" TEST_BLUE_KEY_STRING_WITH_IOTHUBAPP ":" TEST_BLUE_VALUE_STRING "," TEST_YELLOW_KEY_STRING_WITH_IOTHUBAPP ":" TEST_YELLOW_VALUE_STRING "}}]"
-#define TEST_1_ITEM_STRING "[{\"body\":\"MTIzNDU2\",\"properties\":{" TEST_RED_KEY_STRING_WITH_IOTHUBAPP ":" TEST_RED_VALUE_STRING "}}]"
-
-//Tests_SRS_TRANSPORTMULTITHTTP_17_058: [ If IoTHubMessage has properties, then they shall be serialized at the same level as "body" using the following pattern: "properties":{"iothub-app-name1":"value1","iothub-app-name2":"value2"} ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_2_event_items)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_090: [ All the HTTP headers of the form iothub-app-name:somecontent shall be transformed in message properties {name, somecontent}. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_092: [ If assembling the message fails in any way, then _DoWork shall "abandon" the message. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_with_2_property_when_properties_fails_it_abandons_5)
 {
 	///arrange
-	CNiceCallComparer<CIoTHubTransportHttpMocks> mocks; /*a very e2e test... */
-	DList_InsertTailList(&(waitingToSend), &(message6.entry));
-	DList_InsertTailList(&(waitingToSend), &(message7.entry));
+	CIoTHubTransportHttpMocks mocks;
+	unsigned int statusCode200 = 200;
+	unsigned int statusCode204 = 204;
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
 	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
+	(void)IoTHubTransportHttp_Subscribe(devHandle);
+	size_t nHeaders = 3;
 	mocks.ResetAllCalls();
 
 	setupDoWorkLoopOnceForOneDevice(mocks);
 
-	ENABLE_BATCHING();
+	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
 
-	///act
-	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
 
-	///assert
-	ASSERT_ARE_EQUAL(int, 0, memcmp(BASEIMPLEMENTATION::BUFFER_u_char(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest), TEST_2_ITEM_STRING, sizeof(TEST_2_ITEM_STRING) - 1));
-	mocks.AssertActualAndExpectedCalls();
+	STRICT_EXPECTED_CALL(mocks, BUFFER_new());
+	STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
 
-	///cleanup
-	IoTHubTransportHttp_Destroy(handle);
-}
+	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+		.IgnoreArgument(1); /*because relativePath is a STRING_HANDLE*/
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+		IGNORED_PTR_ARG,
+		IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
+		HTTPAPI_REQUEST_GET,                                /*HTTPAPI_REQUEST_TYPE requestType,                            */
+		"/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP API_VERSION,    /*const char* relativePath,                                    */
+		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
+		NULL,                                               /*BUFFER_HANDLE requestContent,                                */
+		IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
+		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
+		IGNORED_PTR_ARG                                     /*BUFFER_HANDLE responseContent))                              */
+		))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2)
+		.IgnoreArgument(5)
+		.IgnoreArgument(7)
+		.IgnoreArgument(8)
+		.IgnoreArgument(9)
+		.CopyOutArgumentBuffer(7, &statusCode200, sizeof(statusCode200));
 
-#define THRESHOLD1 32 /*between THRESHOLD1 and THRESHOLD2 of STRING_concat fails there still is produced a payload, consisting of only REDKEY, REDVALUE*/
-#define THRESHOLD2 17
-#define THRESHOLD3 7 /*below 7, STRING_concat would fail not in producing properties*/
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_FindHeaderValue(IGNORED_PTR_ARG, "ETag"))
+		.IgnoreArgument(1)
+		.SetReturn(TEST_ETAG_VALUE);
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_058: [ If IoTHubMessage has properties, then they shall be serialized at the same level as "body" using the following pattern: "properties":{"iothub-app-name1":"value1","iothub-app-name2":"value2"} ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_2_event_items_THRESHOLD1_succeeds)
-{
-	for (size_t i = THRESHOLD1 + 1; i > THRESHOLD1; i--)
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2)
+		.SetReturn(TEST_IOTHUB_MESSAGE_HANDLE_8);
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, BUFFER_u_char(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, BUFFER_length(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
 	{
-		///arrange
-		currentSTRING_concat_call = 0;
-		whenShallSTRING_concat_fail = 0;
-		BASEIMPLEMENTATION::DList_InitializeListHead(&waitingToSend);
-		CNiceCallComparer<CIoTHubTransportHttpMocks> mocks; /*a very e2e test... */
-		DList_InsertTailList(&(waitingToSend), &(message6.entry));
-		DList_InsertTailList(&(waitingToSend), &(message7.entry));
-		auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
-		auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
-
-		mocks.ResetAllCalls();
+		/*this scope is for is properties code*/
 
-		setupDoWorkLoopOnceForOneDevice(mocks);
+		HTTPHeaders_GetHeaderCount_writes_to_its_outputs = false;
+		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeaderCount(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+			.IgnoreArgument(1)
+			.CopyOutArgumentBuffer(2, &nHeaders, sizeof(nHeaders))
+			.SetReturn(HTTP_HEADERS_ERROR);
+	}
+
+	/*this is "abandon"*/
+	STRICT_EXPECTED_CALL(mocks, STRING_clone(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, STRING_construct_n(TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1))
+		.ValidateArgumentBuffer(1, TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1);
+	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "/abandon" API_VERSION))
+		.IgnoreArgument(1);
 
-		whenShallSTRING_concat_fail = i;
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "If-Match", TEST_ETAG_VALUE))
+		.IgnoreArgument(1);
 
-		ENABLE_BATCHING();
 
-		///act
-		IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+		.IgnoreArgument(1); /*because abandon relativePath is a STRING_HANDLE*/
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
+		IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
+		HTTPAPI_REQUEST_POST,                               /*HTTPAPI_REQUEST_TYPE requestType,                            */
+		"/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP_ETAG TEST_ETAG_VALUE_UNQUOTED "/abandon" API_VERSION,    /*const char* relativePath,                                    */
+		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
+		NULL,                                               /*BUFFER_HANDLE requestContent,                                */
+		IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
+		NULL,                                               /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
+		NULL                                                /*BUFFER_HANDLE responseContent))                              */
+		))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2)
+		.IgnoreArgument(5)
+		.IgnoreArgument(7)
+		.CopyOutArgumentBuffer(7, &statusCode204, sizeof(statusCode204));
+
+	///act
+	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
-		///assert
-		ASSERT_ARE_EQUAL(int, 0, memcmp(BASEIMPLEMENTATION::BUFFER_u_char(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest), TEST_2_ITEM_STRING, sizeof(TEST_2_ITEM_STRING) - 1));
-		mocks.AssertActualAndExpectedCalls();
+	///assert
+	mocks.AssertActualAndExpectedCalls();
 
-		///cleanup
-		IoTHubTransportHttp_Destroy(handle);
-		if (last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest != NULL)
-		{
-			BASEIMPLEMENTATION::BUFFER_delete(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest);
-			last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest = NULL;
-		}
-	}
+	///cleanup
+	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_058: [ If IoTHubMessage has properties, then they shall be serialized at the same level as "body" using the following pattern: "properties":{"iothub-app-name1":"value1","iothub-app-name2":"value2"} ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_2_event_items_send_only_1_when_properties_for_second_fail)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_071: [ If option SetBatching is false then _DoWork shall send individual event message as specced below. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_076: [ A clone of the event HTTP request headers shall be created. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_077: [ The cloned HTTP headers shall have the HTTP header "Content-Type" set to "application/octet-stream". ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_078: [ Every message property "property":"value" shall be added to the HTTP headers as an individual header "iothub-app-property":"value". ] /*well - this tests that no "phantom" properties are added when there are no properties to add*/
+//Tests_SRS_TRANSPORTMULTITHTTP_17_080: [ IoTHubTransportHttp_DoWork shall call HTTPAPIEX_SAS_ExecuteRequest2 passing the following parameters ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_082: [ If HTTPAPIEX_SAS_ExecuteRequest2 does not fail and http status code < 300 then IoTHubTransportHttp_DoWork shall call IoTHubClient_LL_SendComplete. Parameter PDLIST_ENTRY completed shall point to a list the item send, and parameter IOTHUB_BATCHSTATE result shall be set to IOTHUB_BATCHSTATE_SUCCESS. The item shall be removed from waitingToSend. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_117: [ If optionName is an option handled by IoTHubTransportHttp then it shall be set. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_120: [ "Batching" ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_no_properties_unbatched_happy_path_succeeds)
 {
-	for (size_t i = THRESHOLD1; i > THRESHOLD2; i--)
-	{
-		///arrange
-		currentSTRING_concat_call = 0;
-		whenShallSTRING_concat_fail = 0;
-		BASEIMPLEMENTATION::DList_InitializeListHead(&waitingToSend);
-		CNiceCallComparer<CIoTHubTransportHttpMocks> mocks; /*a very e2e test... */
-		DList_InsertTailList(&(waitingToSend), &(message6.entry));
-		DList_InsertTailList(&(waitingToSend), &(message7.entry));
-		auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
-		auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
-
-		mocks.ResetAllCalls();
+	///arrange
+	CIoTHubTransportHttpMocks mocks;
+	DList_InsertTailList(&(waitingToSend), &(message1.entry));
+	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
-		setupDoWorkLoopOnceForOneDevice(mocks);
+	mocks.ResetAllCalls();
 
-		whenShallSTRING_concat_fail = i;
+	setupDoWorkLoopOnceForOneDevice(mocks);
 
-		ENABLE_BATCHING();
+	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
 
-		///act
-		IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE_1));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE_1, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3);
 
-		///assert
-		ASSERT_ARE_EQUAL(int, 0, memcmp(BASEIMPLEMENTATION::BUFFER_u_char(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest), TEST_1_ITEM_STRING, sizeof(TEST_1_ITEM_STRING) - 1));
-		mocks.AssertActualAndExpectedCalls();
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Clone(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
 
-		///cleanup
-		IoTHubTransportHttp_Destroy(handle);
-		if (last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest != NULL)
-		{
-			BASEIMPLEMENTATION::BUFFER_delete(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest);
-			last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest = NULL;
-		}
-	}
-}
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/octet-stream"))
+		.IgnoreArgument(1);
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_058: [ If IoTHubMessage has properties, then they shall be serialized at the same level as "body" using the following pattern: "properties":{"iothub-app-name1":"value1","iothub-app-name2":"value2"} ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_2_event_items_send_nothing)
-{
-	for (size_t i = THRESHOLD2; i > THRESHOLD3; i--)
-	{
-		///arrange
-		currentSTRING_concat_call = 0;
-		whenShallSTRING_concat_fail = 0;
-		BASEIMPLEMENTATION::DList_InitializeListHead(&waitingToSend);
-		CNiceCallComparer<CIoTHubTransportHttpMocks> mocks; /*a very e2e test... */
-		DList_InsertTailList(&(waitingToSend), &(message6.entry));
-		DList_InsertTailList(&(waitingToSend), &(message7.entry));
-		auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
-		mocks.ResetAllCalls();
+	/*no properties, so no more headers*/
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE_1));
+	STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3)
+		.IgnoreArgument(4);
 
-		whenShallSTRING_concat_fail = i;
+	STRICT_EXPECTED_CALL(mocks, BUFFER_new());
+	STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, BUFFER_build(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2)
+		.IgnoreArgument(3);
 
-		ENABLE_BATCHING();
+	/*executing HTTP goodies*/
+	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
+		IGNORED_PTR_ARG,
+		HTTPAPI_REQUEST_POST,                                                           /*HTTPAPI_REQUEST_TYPE requestType,                  */
+		"/devices/" TEST_DEVICE_ID EVENT_ENDPOINT API_VERSION,                 /*const char* relativePath,                          */
+		IGNORED_PTR_ARG,                                                                /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,      */
+		IGNORED_PTR_ARG,                                                                /*BUFFER_HANDLE requestContent,                      */
+		IGNORED_PTR_ARG,                                                                /*unsigned int* statusCode,                          */
+		NULL,                                                                           /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,     */
+		NULL                                                                            /*BUFFER_HANDLE responseContent)                     */
+		))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2)
+		.IgnoreArgument(5)
+		.IgnoreArgument(6)
+		.CopyOutArgumentBuffer(7, &httpStatus200, sizeof(httpStatus200));
 
-		///act
-		IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+	/*once the event has been succesfull...*/
 
-		///assert
-		ASSERT_IS_NULL(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest);
-		mocks.AssertActualAndExpectedCalls();
+	/*building the list of messages to be notified if HTTP is fine*/
+	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message1.entry)))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_SUCCESS))
+		.IgnoreArgument(2);
 
-		///cleanup
-		IoTHubTransportHttp_Destroy(handle);
-		if (last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest != NULL)
-		{
-			BASEIMPLEMENTATION::BUFFER_delete(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest);
-			last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest = NULL;
-		}
-	}
-}
+	EXPECTED_CALL(mocks, IoTHubMessage_GetMessageId(IGNORED_PTR_ARG));
+	EXPECTED_CALL(mocks, IoTHubMessage_GetCorrelationId(IGNORED_PTR_ARG));
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_114: [ If handle parameter is NULL then IoTHubTransportHttp_SetOption shall return IOTHUB_CLIENT_INVALID_ARG. ]
-TEST_FUNCTION(IoTHubTransportHttp_SetOption_with_NULL_handle_fails)
-{
-	///arrange
+	DISABLE_BATCHING();
 
 	///act
-	auto result = IoTHubTransportHttp_SetOption(NULL, "someOption", "someValue");
+	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
 	///assert
-	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+	ASSERT_ARE_EQUAL(int, 0, memcmp(BASEIMPLEMENTATION::BUFFER_u_char(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest), buffer1, buffer1_size));
+	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
+	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_115: [ If option parameter is NULL then IoTHubTransportHttp_SetOption shall return IOTHUB_CLIENT_INVALID_ARG. ]
-TEST_FUNCTION(IoTHubTransportHttp_SetOption_with_NULL_optionName_fails)
-{
-	///arrange
-	CIoTHubTransportHttpMocks mocks;
-	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
-	mocks.ResetAllCalls();
-
-	///act
-	auto result = IoTHubTransportHttp_SetOption(handle, NULL, "someValue");
-
-	///assert
-	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
-	mocks.AssertActualAndExpectedCalls();
-
-	///cleanup
-	IoTHubTransportHttp_Destroy(handle);
-}
-
-//Tests_SRS_TRANSPORTMULTITHTTP_17_116: [ If value parameter is NULL then IoTHubTransportHttp_SetOption shall return IOTHUB_CLIENT_INVALID_ARG. ]
-TEST_FUNCTION(IoTHubTransportHttp_SetOption_with_NULL_value_fails)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_071: [ If option SetBatching is false then _DoWork shall send individual event message as specced below. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_076: [ A clone of the event HTTP request headers shall be created. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_077: [ The cloned HTTP headers shall have the HTTP header "Content-Type" set to "application/octet-stream". ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_078: [ Every message property "property":"value" shall be added to the HTTP headers as an individual header "iothub-app-property":"value". ] /*well - this tests that no "phantom" properties are added when there are no properties to add*/
+//Tests_SRS_TRANSPORTMULTITHTTP_17_080: [ IoTHubTransportHttp_DoWork shall call HTTPAPIEX_SAS_ExecuteRequest2 passing the following parameters ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_082: [ If HTTPAPIEX_SAS_ExecuteRequest2 does not fail and http status code < 300 then IoTHubTransportHttp_DoWork shall call IoTHubClient_LL_SendComplete. Parameter PDLIST_ENTRY completed shall point to a list the item send, and parameter IOTHUB_BATCHSTATE result shall be set to IOTHUB_BATCHSTATE_SUCCESS. The item shall be removed from waitingToSend. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_117: [ If optionName is an option handled by IoTHubTransportHttp then it shall be set. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_120: [ "Batching" ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_no_properties_string_type_unbatched_happy_path_succeeds)
 {
 	///arrange
 	CIoTHubTransportHttpMocks mocks;
+	DList_InsertTailList(&(waitingToSend), &(message10.entry));
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+
 	mocks.ResetAllCalls();
 
+	setupDoWorkLoopOnceForOneDevice(mocks);
+
+	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
+
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE_10));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetString(TEST_IOTHUB_MESSAGE_HANDLE_10));
+
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Clone(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/octet-stream"))
+		.IgnoreArgument(1);
+
+	/*no properties, so no more headers*/
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE_10));
+	STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3)
+		.IgnoreArgument(4);
+
+	STRICT_EXPECTED_CALL(mocks, BUFFER_new());
+	STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, BUFFER_build(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2)
+		.IgnoreArgument(3);
+
+	/*executing HTTP goodies*/
+	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
+		IGNORED_PTR_ARG,
+		HTTPAPI_REQUEST_POST,                                                           /*HTTPAPI_REQUEST_TYPE requestType,                  */
+		"/devices/" TEST_DEVICE_ID EVENT_ENDPOINT API_VERSION,                 /*const char* relativePath,                          */
+		IGNORED_PTR_ARG,                                                                /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,      */
+		IGNORED_PTR_ARG,                                                                /*BUFFER_HANDLE requestContent,                      */
+		IGNORED_PTR_ARG,                                                                /*unsigned int* statusCode,                          */
+		NULL,                                                                           /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,     */
+		NULL                                                                            /*BUFFER_HANDLE responseContent)                     */
+		))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2)
+		.IgnoreArgument(5)
+		.IgnoreArgument(6)
+		.CopyOutArgumentBuffer(7, &httpStatus200, sizeof(httpStatus200));
+
+	/*once the event has been succesfull...*/
+
+	/*building the list of messages to be notified if HTTP is fine*/
+	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message10.entry)))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_SUCCESS))
+		.IgnoreArgument(2);
+
+	EXPECTED_CALL(mocks, IoTHubMessage_GetMessageId(IGNORED_PTR_ARG));
+	EXPECTED_CALL(mocks, IoTHubMessage_GetCorrelationId(IGNORED_PTR_ARG));
+
+	DISABLE_BATCHING();
+
 	///act
-	auto result = IoTHubTransportHttp_SetOption(handle, "someOption", NULL);
+	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
 	///assert
-	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+	ASSERT_ARE_EQUAL(int, 0, memcmp(BASEIMPLEMENTATION::BUFFER_u_char(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest), string10, strlen(string10)));
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_119: [ The following table translates HTTPAPIEX return codes to IOTHUB_CLIENT_RESULT return codes: ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_118: [ Otherwise, IoTHubTransport_Http shall call HTTPAPIEX_SetOption with the same parameters and return the translated code. ]
-TEST_FUNCTION(IoTHubTransportHttp_SetOption_succeeds_when_HTTPAPIEX_succeeds)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_072: [ The message size shall be limited to 255KB -1 bytes. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_unbatched_happy_path_at_the_message_limit_succeeds)
 {
 	///arrange
 	CIoTHubTransportHttpMocks mocks;
+	DList_InsertTailList(&(waitingToSend), &(message11.entry));
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+
 	mocks.ResetAllCalls();
 
-	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SetOption(TEST_HTTPAPIEX_HANDLE, "someOption", (void*)42));
+	setupDoWorkLoopOnceForOneDevice(mocks);
+
+	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
+
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE_11));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE_11, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3);
+
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Clone(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/octet-stream"))
+		.IgnoreArgument(1);
+
+	/*1 property*/
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE_11));
+	STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_1_PROPERTY_A_B, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3)
+		.IgnoreArgument(4);
+
+	STRICT_EXPECTED_CALL(mocks, STRING_construct("iothub-app-"));
+	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+
+	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, TEST_KEYS1_A_B[0]))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "iothub-app-a", TEST_VALUES1_A_B[0]))
+		.IgnoreArgument(1);
+
+
+	STRICT_EXPECTED_CALL(mocks, BUFFER_new());
+	STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, BUFFER_build(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2)
+		.IgnoreArgument(3);
+
+	/*executing HTTP goodies*/
+	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
+		IGNORED_PTR_ARG,
+		HTTPAPI_REQUEST_POST,                                                           /*HTTPAPI_REQUEST_TYPE requestType,                  */
+		"/devices/" TEST_DEVICE_ID EVENT_ENDPOINT API_VERSION,                 /*const char* relativePath,                          */
+		IGNORED_PTR_ARG,                                                                /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,      */
+		IGNORED_PTR_ARG,                                                                /*BUFFER_HANDLE requestContent,                      */
+		IGNORED_PTR_ARG,                                                                /*unsigned int* statusCode,                          */
+		NULL,                                                                           /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,     */
+		NULL                                                                            /*BUFFER_HANDLE responseContent)                     */
+		))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2)
+		.IgnoreArgument(5)
+		.IgnoreArgument(6)
+		.CopyOutArgumentBuffer(7, &httpStatus200, sizeof(httpStatus200));
+
+	/*once the event has been succesfull...*/
+
+	/*building the list of messages to be notified if HTTP is fine*/
+	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message11.entry)))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_SUCCESS))
+		.IgnoreArgument(2);
+
+	EXPECTED_CALL(mocks, IoTHubMessage_GetMessageId(IGNORED_PTR_ARG));
+	EXPECTED_CALL(mocks, IoTHubMessage_GetCorrelationId(IGNORED_PTR_ARG));
+
+	DISABLE_BATCHING();
 
 	///act
-	auto result = IoTHubTransportHttp_SetOption(handle, "someOption", (void*)42);
+	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
 	///assert
-	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+	ASSERT_ARE_EQUAL(int, 0, memcmp(BASEIMPLEMENTATION::BUFFER_u_char(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest), buffer11, buffer11_size));
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_119: [ The following table translates HTTPAPIEX return codes to IOTHUB_CLIENT_RESULT return codes: ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_118: [ Otherwise, IoTHubTransport_Http shall call HTTPAPIEX_SetOption with the same parameters and return the translated code. ]
-TEST_FUNCTION(IoTHubTransportHttp_SetOption_fails_when_HTTPAPIEX_returns_HTTPAPIEX_INVALID_ARG)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_072: [ The message size shall be limited to 255KB -1 bytes. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_073: [ The message size is computed from the length of the payload + 384. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_074: [ Every property name shall add to the message size the length of the property name + the length of the property value + 16 bytes. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_no_properties_string_type_unbatched_happy_path_at_the_message_limit_succeeds)
 {
 	///arrange
-	CIoTHubTransportHttpMocks mocks;
+	CNiceCallComparer<CIoTHubTransportHttpMocks> mocks;
+	DList_InsertTailList(&(waitingToSend), &(message12.entry));
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+
+	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+
 	mocks.ResetAllCalls();
 
-	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SetOption(TEST_HTTPAPIEX_HANDLE, "someOption", (void*)42))
-		.SetReturn(HTTPAPIEX_INVALID_ARG);
+	setupDoWorkLoopOnceForOneDevice(mocks);
+
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_FAILED))
+		.IgnoreArgument(2);
+
+	DISABLE_BATCHING();
 
 	///act
-	auto result = IoTHubTransportHttp_SetOption(handle, "someOption", (void*)42);
+	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
 	///assert
-	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_119: [ The following table translates HTTPAPIEX return codes to IOTHUB_CLIENT_RESULT return codes: ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_118: [ Otherwise, IoTHubTransport_Http shall call HTTPAPIEX_SetOption with the same parameters and return the translated code. ]
-TEST_FUNCTION(IoTHubTransportHttp_SetOption_fails_when_HTTPAPIEX_returns_HTTPAPIEX_ERROR)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_071: [ If option SetBatching is false then _DoWork shall send individual event message as specced below. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_076: [ A clone of the event HTTP request headers shall be created. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_077: [ The cloned HTTP headers shall have the HTTP header "Content-Type" set to "application/octet-stream". ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_078: [ Every message property "property":"value" shall be added to the HTTP headers as an individual header "iothub-app-property":"value". ] /*well - this tests that no "phantom" properties are added when there are no properties to add*/
+//Tests_SRS_TRANSPORTMULTITHTTP_17_080: [ IoTHubTransportHttp_DoWork shall call HTTPAPIEX_SAS_ExecuteRequest2 passing the following parameters ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_082: [ If HTTPAPIEX_SAS_ExecuteRequest2 does not fail and http status code < 300 then IoTHubTransportHttp_DoWork shall call IoTHubClient_LL_SendComplete. Parameter PDLIST_ENTRY completed shall point to a list the item send, and parameter IOTHUB_BATCHSTATE result shall be set to IOTHUB_BATCHSTATE_SUCCESS. The item shall be removed from waitingToSend. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_117: [ If optionName is an option handled by IoTHubTransportHttp then it shall be set. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_120: [ "Batching" ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_no_properties_string_type_unbatched_fails_when_getString_fails)
 {
 	///arrange
 	CIoTHubTransportHttpMocks mocks;
+	DList_InsertTailList(&(waitingToSend), &(message10.entry));
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+
 	mocks.ResetAllCalls();
 
-	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SetOption(TEST_HTTPAPIEX_HANDLE, "someOption", (void*)42))
-		.SetReturn(HTTPAPIEX_ERROR);
+	setupDoWorkLoopOnceForOneDevice(mocks);
+
+	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
+
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE_10));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetString(TEST_IOTHUB_MESSAGE_HANDLE_10))
+		.SetReturn((const char*)NULL);
+
+	DISABLE_BATCHING();
 
 	///act
-	auto result = IoTHubTransportHttp_SetOption(handle, "someOption", (void*)42);
+	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
 	///assert
-	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_119: [ The following table translates HTTPAPIEX return codes to IOTHUB_CLIENT_RESULT return codes: ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_118: [ Otherwise, IoTHubTransport_Http shall call HTTPAPIEX_SetOption with the same parameters and return the translated code. ]
-TEST_FUNCTION(IoTHubTransportHttp_SetOption_fails_when_HTTPAPIEX_returns_any_other_error)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_071: [ If option SetBatching is false then _DoWork shall send individual event message as specced below. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_076: [ A clone of the event HTTP request headers shall be created. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_077: [ The cloned HTTP headers shall have the HTTP header "Content-Type" set to "application/octet-stream". ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_078: [ Every message property "property":"value" shall be added to the HTTP headers as an individual header "iothub-app-property":"value". ] /*well - this tests that no "phantom" properties are added when there are no properties to add*/
+//Tests_SRS_TRANSPORTMULTITHTTP_17_080: [ IoTHubTransportHttp_DoWork shall call HTTPAPIEX_SAS_ExecuteRequest2 passing the following parameters ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_082: [ If HTTPAPIEX_SAS_ExecuteRequest2 does not fail and http status code < 300 then IoTHubTransportHttp_DoWork shall call IoTHubClient_LL_SendComplete. Parameter PDLIST_ENTRY completed shall point to a list the item send, and parameter IOTHUB_BATCHSTATE result shall be set to IOTHUB_BATCHSTATE_SUCCESS. The item shall be removed from waitingToSend. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_happy_path_succeeds)
 {
 	///arrange
 	CIoTHubTransportHttpMocks mocks;
+	DList_InsertTailList(&(waitingToSend), &(message6.entry));
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+
 	mocks.ResetAllCalls();
 
-	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SetOption(TEST_HTTPAPIEX_HANDLE, "someOption", (void*)42))
-		.SetReturn(HTTPAPIEX_RECOVERYFAILED);
+	setupDoWorkLoopOnceForOneDevice(mocks);
 
-	///act
-	auto result = IoTHubTransportHttp_SetOption(handle, "someOption", (void*)42);
 
-	///assert
-	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
-	mocks.AssertActualAndExpectedCalls();
+	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
 
-	///cleanup
-	IoTHubTransportHttp_Destroy(handle);
-}
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE_6));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE_6, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3);
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_096: [ If IoTHubClient_LL_MessageCallback returns IOTHUBMESSAGE_ABANDONED then _DoWork shall "abandon" the message. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_with_abandon_succeeds)
-{
-	///arrange
-	CIoTHubTransportHttpMocks mocks;
-	unsigned int statusCode200 = 200;
-	unsigned int statusCode204 = 204;
-	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
-	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Clone(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
 
-	(void)IoTHubTransportHttp_Subscribe(devHandle);
-	mocks.ResetAllCalls();
-	setupDoWorkLoopOnceForOneDevice(mocks);
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/octet-stream"))
+		.IgnoreArgument(1);
 
-	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
+	/*no properties, so no more headers*/
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE_6));
+	STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_1_PROPERTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3)
+		.IgnoreArgument(4);
 
-	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
+	/*this is making http headers*/
+	STRICT_EXPECTED_CALL(mocks, STRING_construct("iothub-app-"));
+	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, TEST_RED_KEY))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "iothub-app-" TEST_RED_KEY, TEST_RED_VALUE))
 		.IgnoreArgument(1);
 
 	STRICT_EXPECTED_CALL(mocks, BUFFER_new());
 	STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, BUFFER_build(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2)
+		.IgnoreArgument(3);
 
-	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-		.IgnoreArgument(1); /*because relativePath is a STRING_HANDLE*/
+	/*executing HTTP goodies*/
+	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
+		.IgnoreArgument(1);
 	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
 		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
-		IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
-		HTTPAPI_REQUEST_GET,                                /*HTTPAPI_REQUEST_TYPE requestType,                            */
-		"/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP API_VERSION,    /*const char* relativePath,                                    */
-		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
-		NULL,                                               /*BUFFER_HANDLE requestContent,                                */
-		IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
-		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
-		IGNORED_PTR_ARG                                     /*BUFFER_HANDLE responseContent))                              */
+		IGNORED_PTR_ARG,
+		HTTPAPI_REQUEST_POST,                                                           /*HTTPAPI_REQUEST_TYPE requestType,                  */
+		"/devices/" TEST_DEVICE_ID EVENT_ENDPOINT API_VERSION,                 /*const char* relativePath,                          */
+		IGNORED_PTR_ARG,                                                                /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,      */
+		IGNORED_PTR_ARG,                                                                /*BUFFER_HANDLE requestContent,                      */
+		IGNORED_PTR_ARG,                                                                /*unsigned int* statusCode,                          */
+		NULL,                                                                           /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,     */
+		NULL                                                                            /*BUFFER_HANDLE responseContent)                     */
 		))
 		.IgnoreArgument(1)
 		.IgnoreArgument(2)
 		.IgnoreArgument(5)
-		.IgnoreArgument(7)
-		.IgnoreArgument(8)
-		.IgnoreArgument(9)
-		.CopyOutArgumentBuffer(7, &statusCode200, sizeof(statusCode200));
+		.IgnoreArgument(6)
+		.CopyOutArgumentBuffer(7, &httpStatus200, sizeof(httpStatus200));
 
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_FindHeaderValue(IGNORED_PTR_ARG, "ETag"))
-		.IgnoreArgument(1)
-		.SetReturn(TEST_ETAG_VALUE);
+	/*once the event has been succesfull...*/
 
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2);
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, BUFFER_u_char(IGNORED_PTR_ARG))
+	/*building the list of messages to be notified if HTTP is fine*/
+	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, BUFFER_length(IGNORED_PTR_ARG))
+	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message6.entry)))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeaderCount(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreArgument(1)
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_SUCCESS))
 		.IgnoreArgument(2);
 
-	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_MessageCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreArgument(1)
+	EXPECTED_CALL(mocks, IoTHubMessage_GetMessageId(IGNORED_PTR_ARG));
+	EXPECTED_CALL(mocks, IoTHubMessage_GetCorrelationId(IGNORED_PTR_ARG));
+
+	DISABLE_BATCHING();
+
+	///act
+	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+
+	///assert
+	ASSERT_ARE_EQUAL(int, 0, memcmp(BASEIMPLEMENTATION::BUFFER_u_char(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest), buffer6, buffer6_size));
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubTransportHttp_Destroy(handle);
+}
+
+
+//Tests_SRS_TRANSPORTMULTITHTTP_17_069: [ If HTTPAPIEX_SAS_ExecuteRequest2 fails or the http status code >=300 then IoTHubTransportHttp_DoWork shall not do any other action (it is assumed at the next _DoWork it shall be retried). ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_does_nothing_when_httpStatusCode_is_not_succeess)
+{
+	///arrange
+	CIoTHubTransportHttpMocks mocks;
+	DList_InsertTailList(&(waitingToSend), &(message6.entry));
+	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+
+	mocks.ResetAllCalls();
+
+	setupDoWorkLoopOnceForOneDevice(mocks);
+
+	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
+
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE_6));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE_6, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
 		.IgnoreArgument(2)
-		.SetReturn(IOTHUBMESSAGE_ABANDONED);
+		.IgnoreArgument(3);
 
-	/*this is "abandon"*/
-	STRICT_EXPECTED_CALL(mocks, STRING_clone(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Clone(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_construct_n(TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1))
-		.ValidateArgumentBuffer(1, TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1);
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "/abandon" API_VERSION))
+
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/octet-stream"))
 		.IgnoreArgument(1);
 
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc());
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
+	/*no properties, so no more headers*/
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE_6));
+	STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_1_PROPERTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3)
+		.IgnoreArgument(4);
+
+	/*this is making http headers*/
+	STRICT_EXPECTED_CALL(mocks, STRING_construct("iothub-app-"));
+	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "User-Agent", CLIENT_DEVICE_TYPE_PREFIX CLIENT_DEVICE_BACKSLASH IOTHUB_SDK_VERSION))
+	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, TEST_RED_KEY))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "Authorization", TEST_BLANK_SAS_TOKEN))
+	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "If-Match", TEST_ETAG_VALUE))
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "iothub-app-" TEST_RED_KEY, TEST_RED_VALUE))
 		.IgnoreArgument(1);
 
-	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-		.IgnoreArgument(1); /*because abandon relativePath is a STRING_HANDLE*/
+	STRICT_EXPECTED_CALL(mocks, BUFFER_new());
+	STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, BUFFER_build(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2)
+		.IgnoreArgument(3);
+
+	/*executing HTTP goodies*/
+	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
+		.IgnoreArgument(1);
 	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
 		IGNORED_PTR_ARG,
-		IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
-		HTTPAPI_REQUEST_POST,                               /*HTTPAPI_REQUEST_TYPE requestType,                            */
-		"/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP_ETAG TEST_ETAG_VALUE_UNQUOTED "/abandon" API_VERSION,    /*const char* relativePath,                                    */
-		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
-		NULL,                                               /*BUFFER_HANDLE requestContent,                                */
-		IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
-		NULL,                                               /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
-		NULL                                                /*BUFFER_HANDLE responseContent))                              */
+		HTTPAPI_REQUEST_POST,                                                           /*HTTPAPI_REQUEST_TYPE requestType,                  */
+		"/devices/" TEST_DEVICE_ID EVENT_ENDPOINT API_VERSION,                 /*const char* relativePath,                          */
+		IGNORED_PTR_ARG,                                                                /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,      */
+		IGNORED_PTR_ARG,                                                                /*BUFFER_HANDLE requestContent,                      */
+		IGNORED_PTR_ARG,                                                                /*unsigned int* statusCode,                          */
+		NULL,                                                                           /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,     */
+		NULL                                                                            /*BUFFER_HANDLE responseContent)                     */
 		))
 		.IgnoreArgument(1)
 		.IgnoreArgument(2)
 		.IgnoreArgument(5)
-		.IgnoreArgument(7)
-		.CopyOutArgumentBuffer(7, &statusCode204, sizeof(statusCode204));
+		.IgnoreArgument(6)
+		.CopyOutArgumentBuffer(7, &httpStatus404, sizeof(httpStatus404));
+
+	EXPECTED_CALL(mocks, IoTHubMessage_GetMessageId(IGNORED_PTR_ARG));
+	EXPECTED_CALL(mocks, IoTHubMessage_GetCorrelationId(IGNORED_PTR_ARG));
+
+	DISABLE_BATCHING();
 
 	///act
 	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
 	///assert
+	ASSERT_ARE_EQUAL(int, 0, memcmp(BASEIMPLEMENTATION::BUFFER_u_char(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest), buffer6, buffer6_size));
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_090: [ All the HTTP headers of the form iothub-app-name:somecontent shall be transformed in message properties {name, somecontent}. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_with_1_property_succeeds)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_081: [ If HTTPAPIEX_SAS_ExecuteRequest2 fails or the http status code >=300 then IoTHubTransportHttp_DoWork shall not do any other action (it is assumed at the next _DoWork it shall be retried). ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_does_nothing_when_HTTPAPIEXSAS_fails)
 {
 	///arrange
 	CIoTHubTransportHttpMocks mocks;
-	unsigned int statusCode200 = 200;
-	unsigned int statusCode204 = 204;
+	DList_InsertTailList(&(waitingToSend), &(message6.entry));
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
 	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
-	(void)IoTHubTransportHttp_Subscribe(devHandle);
-	size_t nHeaders = 1;
 	mocks.ResetAllCalls();
 
 	setupDoWorkLoopOnceForOneDevice(mocks);
 
-	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
+	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
 
-	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE_6));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE_6, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3);
+
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Clone(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
 
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/octet-stream"))
+		.IgnoreArgument(1);
+
+	/*no properties, so no more headers*/
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE_6));
+	STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_1_PROPERTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3)
+		.IgnoreArgument(4);
+
+	/*this is making http headers*/
+	STRICT_EXPECTED_CALL(mocks, STRING_construct("iothub-app-"));
+	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, TEST_RED_KEY))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "iothub-app-" TEST_RED_KEY, TEST_RED_VALUE))
+		.IgnoreArgument(1);
+
 	STRICT_EXPECTED_CALL(mocks, BUFFER_new());
 	STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, BUFFER_build(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2)
+		.IgnoreArgument(3);
 
-	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-		.IgnoreArgument(1); /*because relativePath is a STRING_HANDLE*/
+	/*executing HTTP goodies*/
+	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
+		.IgnoreArgument(1);
 	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
 		IGNORED_PTR_ARG,
-		IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
-		HTTPAPI_REQUEST_GET,                                /*HTTPAPI_REQUEST_TYPE requestType,                            */
-		"/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP API_VERSION,    /*const char* relativePath,                                    */
-		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
-		NULL,                                               /*BUFFER_HANDLE requestContent,                                */
-		IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
-		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
-		IGNORED_PTR_ARG                                     /*BUFFER_HANDLE responseContent))                              */
+		HTTPAPI_REQUEST_POST,                                                           /*HTTPAPI_REQUEST_TYPE requestType,                  */
+		"/devices/" TEST_DEVICE_ID EVENT_ENDPOINT API_VERSION,                 /*const char* relativePath,                          */
+		IGNORED_PTR_ARG,                                                                /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,      */
+		IGNORED_PTR_ARG,                                                                /*BUFFER_HANDLE requestContent,                      */
+		IGNORED_PTR_ARG,                                                                /*unsigned int* statusCode,                          */
+		NULL,                                                                           /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,     */
+		NULL                                                                            /*BUFFER_HANDLE responseContent)                     */
 		))
 		.IgnoreArgument(1)
 		.IgnoreArgument(2)
 		.IgnoreArgument(5)
-		.IgnoreArgument(7)
-		.IgnoreArgument(8)
-		.IgnoreArgument(9)
-		.CopyOutArgumentBuffer(7, &statusCode200, sizeof(statusCode200));
+		.IgnoreArgument(6)
+		.CopyOutArgumentBuffer(7, &httpStatus200, sizeof(httpStatus200))
+		.SetReturn(HTTPAPIEX_ERROR);
 
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_FindHeaderValue(IGNORED_PTR_ARG, "ETag"))
-		.IgnoreArgument(1)
-		.SetReturn(TEST_ETAG_VALUE);
+	EXPECTED_CALL(mocks, IoTHubMessage_GetMessageId(IGNORED_PTR_ARG));
+	EXPECTED_CALL(mocks, IoTHubMessage_GetCorrelationId(IGNORED_PTR_ARG));
 
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2)
-		.SetReturn(TEST_IOTHUB_MESSAGE_HANDLE_8);
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, BUFFER_u_char(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, BUFFER_length(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	{
-		/*this scope is for is properties code*/
+	DISABLE_BATCHING();
 
-		HTTPHeaders_GetHeaderCount_writes_to_its_outputs = false;
-		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeaderCount(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.CopyOutArgumentBuffer(2, &nHeaders, sizeof(nHeaders));
+	///act
+	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE_8));
+	///assert
+	ASSERT_ARE_EQUAL(int, 0, memcmp(BASEIMPLEMENTATION::BUFFER_u_char(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest), buffer6, buffer6_size));
+	mocks.AssertActualAndExpectedCalls();
 
-		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeader(IGNORED_PTR_ARG, 0, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(3);
-		STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(TEST_MAP_3_PROPERTY, "NAME1", "VALUE1"));
-	}
+	///cleanup
+	IoTHubTransportHttp_Destroy(handle);
+}
 
-	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_MessageCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2);
+//Tests_SRS_TRANSPORTMULTITHTTP_17_079: [ If any HTTP header operation fails, _DoWork shall advance to the next action. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_does_nothing_when_buffer_fails_1)
+{
+	///arrange
+	CIoTHubTransportHttpMocks mocks;
+	DList_InsertTailList(&(waitingToSend), &(message6.entry));
+	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+
+	mocks.ResetAllCalls();
+	setupDoWorkLoopOnceForOneDevice(mocks);
 
+	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
 
-	/*this returns "0" so the message needs to be "accepted"*/
-	/*this is "accepting"*/
-	STRICT_EXPECTED_CALL(mocks, STRING_clone(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE_6));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE_6, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3);
+
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Clone(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_construct_n(TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1))
-		.ValidateArgumentBuffer(1, TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1);
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, API_VERSION))
+
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/octet-stream"))
 		.IgnoreArgument(1);
 
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc());
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
+	/*no properties, so no more headers*/
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE_6));
+	STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_1_PROPERTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3)
+		.IgnoreArgument(4);
+
+	/*this is making http headers*/
+	STRICT_EXPECTED_CALL(mocks, STRING_construct("iothub-app-"));
+	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "User-Agent", CLIENT_DEVICE_TYPE_PREFIX CLIENT_DEVICE_BACKSLASH IOTHUB_SDK_VERSION))
+	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, TEST_RED_KEY))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "Authorization", TEST_BLANK_SAS_TOKEN))
+	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "If-Match", TEST_ETAG_VALUE))
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "iothub-app-" TEST_RED_KEY, TEST_RED_VALUE))
 		.IgnoreArgument(1);
 
+	STRICT_EXPECTED_CALL(mocks, BUFFER_new());
+	STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
 
-	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-		.IgnoreArgument(1); /*because abandon relativePath is a STRING_HANDLE*/
-	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
-		IGNORED_PTR_ARG,
-		IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
-		HTTPAPI_REQUEST_DELETE,                                /*HTTPAPI_REQUEST_TYPE requestType,                            */
-		"/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP_ETAG TEST_ETAG_VALUE_UNQUOTED API_VERSION,    /*const char* relativePath,                                    */
-		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
-		NULL,                                               /*BUFFER_HANDLE requestContent,                                */
-		IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
-		NULL,                                               /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
-		NULL                                                /*BUFFER_HANDLE responseContent))                              */
-		))
+	STRICT_EXPECTED_CALL(mocks, BUFFER_build(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
 		.IgnoreArgument(1)
 		.IgnoreArgument(2)
-		.IgnoreArgument(5)
-		.IgnoreArgument(7)
-		.CopyOutArgumentBuffer(7, &statusCode204, sizeof(statusCode204));
+		.IgnoreArgument(3)
+		.SetReturn(1);
+
+	EXPECTED_CALL(mocks, IoTHubMessage_GetMessageId(IGNORED_PTR_ARG));
+	EXPECTED_CALL(mocks, IoTHubMessage_GetCorrelationId(IGNORED_PTR_ARG));
+
+	DISABLE_BATCHING();
 
 	///act
 	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
@@ -11397,149 +11083,121 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_090: [ All the HTTP headers of the form iothub-app-name:somecontent shall be transformed in message properties {name, somecontent}. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_with_2_property_succeeds)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_079: [ If any HTTP header operation fails, _DoWork shall advance to the next action. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_does_nothing_when_buffer_fails_2)
 {
 	///arrange
 	CIoTHubTransportHttpMocks mocks;
-	unsigned int statusCode200 = 200;
-	unsigned int statusCode204 = 204;
+	DList_InsertTailList(&(waitingToSend), &(message6.entry));
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
 	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
-	(void)IoTHubTransportHttp_Subscribe(devHandle);
-	size_t nHeaders = 3;
 	mocks.ResetAllCalls();
 
 	setupDoWorkLoopOnceForOneDevice(mocks);
 
-	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
+	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
 
-	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE_6));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE_6, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3);
+
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Clone(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
 
-	STRICT_EXPECTED_CALL(mocks, BUFFER_new());
-	STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/octet-stream"))
 		.IgnoreArgument(1);
 
-	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-		.IgnoreArgument(1); /*because relativePath is a STRING_HANDLE*/
-	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
-		IGNORED_PTR_ARG,
-		IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
-		HTTPAPI_REQUEST_GET,                                /*HTTPAPI_REQUEST_TYPE requestType,                            */
-		"/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP API_VERSION,    /*const char* relativePath,                                    */
-		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
-		NULL,                                               /*BUFFER_HANDLE requestContent,                                */
-		IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
-		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
-		IGNORED_PTR_ARG                                     /*BUFFER_HANDLE responseContent))                              */
-		))
-		.IgnoreArgument(1)
+	/*no properties, so no more headers*/
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE_6));
+	STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_1_PROPERTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
 		.IgnoreArgument(2)
-		.IgnoreArgument(5)
-		.IgnoreArgument(7)
-		.IgnoreArgument(8)
-		.IgnoreArgument(9)
-		.CopyOutArgumentBuffer(7, &statusCode200, sizeof(statusCode200));
-
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_FindHeaderValue(IGNORED_PTR_ARG, "ETag"))
-		.IgnoreArgument(1)
-		.SetReturn(TEST_ETAG_VALUE);
+		.IgnoreArgument(3)
+		.IgnoreArgument(4);
 
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2)
-		.SetReturn(TEST_IOTHUB_MESSAGE_HANDLE_8);
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG))
+	/*this is making http headers*/
+	STRICT_EXPECTED_CALL(mocks, STRING_construct("iothub-app-"));
+	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, BUFFER_u_char(IGNORED_PTR_ARG))
+	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, TEST_RED_KEY))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, BUFFER_length(IGNORED_PTR_ARG))
+	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "iothub-app-" TEST_RED_KEY, TEST_RED_VALUE))
 		.IgnoreArgument(1);
-	{
-		/*this scope is for is properties code*/
 
-		HTTPHeaders_GetHeaderCount_writes_to_its_outputs = false;
-		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeaderCount(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.CopyOutArgumentBuffer(2, &nHeaders, sizeof(nHeaders));
+	whenShallBUFFER_new_fail = currentBUFFER_new_call + 1;
+	STRICT_EXPECTED_CALL(mocks, BUFFER_new());
 
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE_8));
+	EXPECTED_CALL(mocks, IoTHubMessage_GetMessageId(IGNORED_PTR_ARG));
+	EXPECTED_CALL(mocks, IoTHubMessage_GetCorrelationId(IGNORED_PTR_ARG));
 
-		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeader(IGNORED_PTR_ARG, 0, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(3);
-		STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(TEST_MAP_3_PROPERTY, "NAME1", "VALUE1"));
+	DISABLE_BATCHING();
 
-		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeader(IGNORED_PTR_ARG, 1, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(3);
-		STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
+	///act
+	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
-		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeader(IGNORED_PTR_ARG, 2, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(3);
-		STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(TEST_MAP_3_PROPERTY, "NAME2", "VALUE2"));
-	}
+	///assert
+	mocks.AssertActualAndExpectedCalls();
 
-	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_MessageCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2);
+	///cleanup
+	IoTHubTransportHttp_Destroy(handle);
+}
 
+//Tests_SRS_TRANSPORTMULTITHTTP_17_079: [ If any HTTP header operation fails, _DoWork shall advance to the next action. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_does_nothing_when_http_headers_fail_1)
+{
+	///arrange
+	CIoTHubTransportHttpMocks mocks;
+	DList_InsertTailList(&(waitingToSend), &(message6.entry));
+	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
-	/*this returns "0" so the message needs to be "accepted"*/
-	/*this is "accepting"*/
-	STRICT_EXPECTED_CALL(mocks, STRING_clone(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_construct_n(TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1))
-		.ValidateArgumentBuffer(1, TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1);
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+	mocks.ResetAllCalls();
+
+	setupDoWorkLoopOnceForOneDevice(mocks);
+
+	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
+
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE_6));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE_6, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3);
+
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Clone(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, API_VERSION))
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
 
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc());
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/octet-stream"))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "User-Agent", CLIENT_DEVICE_TYPE_PREFIX CLIENT_DEVICE_BACKSLASH IOTHUB_SDK_VERSION))
+
+	/*no properties, so no more headers*/
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE_6));
+	STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_1_PROPERTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3)
+		.IgnoreArgument(4);
+
+	/*this is making http headers*/
+	STRICT_EXPECTED_CALL(mocks, STRING_construct("iothub-app-"));
+	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "Authorization", TEST_BLANK_SAS_TOKEN))
+	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, TEST_RED_KEY))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "If-Match", TEST_ETAG_VALUE))
+	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "iothub-app-" TEST_RED_KEY, TEST_RED_VALUE))
+		.IgnoreArgument(1)
+		.SetReturn(HTTP_HEADERS_ERROR);
 
+	EXPECTED_CALL(mocks, IoTHubMessage_GetMessageId(IGNORED_PTR_ARG));
+	EXPECTED_CALL(mocks, IoTHubMessage_GetCorrelationId(IGNORED_PTR_ARG));
 
-	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-		.IgnoreArgument(1); /*because abandon relativePath is a STRING_HANDLE*/
-	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
-		IGNORED_PTR_ARG,
-		IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
-		HTTPAPI_REQUEST_DELETE,                                /*HTTPAPI_REQUEST_TYPE requestType,                            */
-		"/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP_ETAG TEST_ETAG_VALUE_UNQUOTED API_VERSION,    /*const char* relativePath,                                    */
-		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
-		NULL,                                               /*BUFFER_HANDLE requestContent,                                */
-		IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
-		NULL,                                               /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
-		NULL                                                /*BUFFER_HANDLE responseContent))                              */
-		))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2)
-		.IgnoreArgument(5)
-		.IgnoreArgument(7)
-		.CopyOutArgumentBuffer(7, &statusCode204, sizeof(statusCode204));
+	DISABLE_BATCHING();
 
 	///act
 	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
@@ -11551,145 +11209,107 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_090: [ All the HTTP headers of the form iothub-app-name:somecontent shall be transformed in message properties {name, somecontent}. ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_092: [ If assembling the message fails in any way, then _DoWork shall "abandon" the message. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_with_2_property_when_properties_fails_it_abandons_1)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_079: [ If any HTTP header operation fails, _DoWork shall advance to the next action. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_does_nothing_when_http_headers_fail_2)
 {
 	///arrange
 	CIoTHubTransportHttpMocks mocks;
-	unsigned int statusCode200 = 200;
-	unsigned int statusCode204 = 204;
+	DList_InsertTailList(&(waitingToSend), &(message6.entry));
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
 	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
-	(void)IoTHubTransportHttp_Subscribe(devHandle);
-	size_t nHeaders = 3;
 	mocks.ResetAllCalls();
 
 	setupDoWorkLoopOnceForOneDevice(mocks);
 
-	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
+	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
 
-	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE_6));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE_6, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3);
+
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Clone(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
 
-	STRICT_EXPECTED_CALL(mocks, BUFFER_new());
-	STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/octet-stream"))
 		.IgnoreArgument(1);
 
-	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-		.IgnoreArgument(1); /*because relativePath is a STRING_HANDLE*/
-	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
-		IGNORED_PTR_ARG,
-		IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
-		HTTPAPI_REQUEST_GET,                                /*HTTPAPI_REQUEST_TYPE requestType,                            */
-		"/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP API_VERSION,    /*const char* relativePath,                                    */
-		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
-		NULL,                                               /*BUFFER_HANDLE requestContent,                                */
-		IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
-		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
-		IGNORED_PTR_ARG                                     /*BUFFER_HANDLE responseContent))                              */
-		))
-		.IgnoreArgument(1)
+	/*no properties, so no more headers*/
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE_6));
+	STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_1_PROPERTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
 		.IgnoreArgument(2)
-		.IgnoreArgument(5)
-		.IgnoreArgument(7)
-		.IgnoreArgument(8)
-		.IgnoreArgument(9)
-		.CopyOutArgumentBuffer(7, &statusCode200, sizeof(statusCode200));
+		.IgnoreArgument(3)
+		.IgnoreArgument(4);
 
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_FindHeaderValue(IGNORED_PTR_ARG, "ETag"))
+	/*this is making http headers*/
+	STRICT_EXPECTED_CALL(mocks, STRING_construct("iothub-app-"));
+	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, TEST_RED_KEY))
 		.IgnoreArgument(1)
-		.SetReturn(TEST_ETAG_VALUE);
+		.SetReturn(1111); /*unpredictable value which is an error*/
 
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2)
-		.SetReturn(TEST_IOTHUB_MESSAGE_HANDLE_8);
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, BUFFER_u_char(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, BUFFER_length(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	{
-		/*this scope is for is properties code*/
+	EXPECTED_CALL(mocks, IoTHubMessage_GetMessageId(IGNORED_PTR_ARG));
+	EXPECTED_CALL(mocks, IoTHubMessage_GetCorrelationId(IGNORED_PTR_ARG));
 
-		HTTPHeaders_GetHeaderCount_writes_to_its_outputs = false;
-		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeaderCount(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.CopyOutArgumentBuffer(2, &nHeaders, sizeof(nHeaders));
+	DISABLE_BATCHING();
 
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE_8));
+	///act
+	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
-		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeader(IGNORED_PTR_ARG, 0, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(3);
-		STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(TEST_MAP_3_PROPERTY, "NAME1", "VALUE1"));
+	///assert
+	mocks.AssertActualAndExpectedCalls();
 
-		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeader(IGNORED_PTR_ARG, 1, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(3);
-		STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
+	///cleanup
+	IoTHubTransportHttp_Destroy(handle);
+}
 
-		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeader(IGNORED_PTR_ARG, 2, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(3);
-		STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(TEST_MAP_3_PROPERTY, "NAME2", "VALUE2"))
-			.SetReturn(MAP_ERROR);
-	}
+//Tests_SRS_TRANSPORTMULTITHTTP_17_079: [ If any HTTP header operation fails, _DoWork shall advance to the next action. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_does_nothing_when_http_headers_fail_3)
+{
+	///arrange
+	CIoTHubTransportHttpMocks mocks;
+	DList_InsertTailList(&(waitingToSend), &(message6.entry));
+	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
-	/*this is "abandon"*/
-	STRICT_EXPECTED_CALL(mocks, STRING_clone(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_construct_n(TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1))
-		.ValidateArgumentBuffer(1, TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1);
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "/abandon" API_VERSION))
-		.IgnoreArgument(1);
+	mocks.ResetAllCalls();
 
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc());
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "User-Agent", CLIENT_DEVICE_TYPE_PREFIX CLIENT_DEVICE_BACKSLASH IOTHUB_SDK_VERSION))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "Authorization", TEST_BLANK_SAS_TOKEN))
+	setupDoWorkLoopOnceForOneDevice(mocks);
+
+	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
+
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE_6));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE_6, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3);
+
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Clone(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "If-Match", TEST_ETAG_VALUE))
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
 
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/octet-stream"))
+		.IgnoreArgument(1);
 
-	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-		.IgnoreArgument(1); /*because abandon relativePath is a STRING_HANDLE*/
-	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
-		IGNORED_PTR_ARG,
-		IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
-		HTTPAPI_REQUEST_POST,                               /*HTTPAPI_REQUEST_TYPE requestType,                            */
-		"/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP_ETAG TEST_ETAG_VALUE_UNQUOTED "/abandon" API_VERSION,    /*const char* relativePath,                                    */
-		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
-		NULL,                                               /*BUFFER_HANDLE requestContent,                                */
-		IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
-		NULL,                                               /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
-		NULL                                                /*BUFFER_HANDLE responseContent))                              */
-		))
-		.IgnoreArgument(1)
+	/*no properties, so no more headers*/
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE_6));
+	STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_1_PROPERTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
 		.IgnoreArgument(2)
-		.IgnoreArgument(5)
-		.IgnoreArgument(7)
-		.CopyOutArgumentBuffer(7, &statusCode204, sizeof(statusCode204));
+		.IgnoreArgument(3)
+		.IgnoreArgument(4);
+
+	/*this is making http headers*/
+	whenShallSTRING_construct_fail = currentSTRING_construct_call + 1;
+	STRICT_EXPECTED_CALL(mocks, STRING_construct("iothub-app-"));
+
+	EXPECTED_CALL(mocks, IoTHubMessage_GetMessageId(IGNORED_PTR_ARG));
+	EXPECTED_CALL(mocks, IoTHubMessage_GetCorrelationId(IGNORED_PTR_ARG));
+
+	DISABLE_BATCHING();
 
 	///act
 	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
@@ -11701,143 +11321,43 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-
-//Tests_SRS_TRANSPORTMULTITHTTP_17_090: [ All the HTTP headers of the form iothub-app-name:somecontent shall be transformed in message properties {name, somecontent}. ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_092: [ If assembling the message fails in any way, then _DoWork shall "abandon" the message. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_with_2_property_when_properties_fails_it_abandons_2)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_079: [ If any HTTP header operation fails, _DoWork shall advance to the next action. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_does_nothing_when_map_fails)
 {
 	///arrange
 	CIoTHubTransportHttpMocks mocks;
-	unsigned int statusCode200 = 200;
-	unsigned int statusCode204 = 204;
+	DList_InsertTailList(&(waitingToSend), &(message6.entry));
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
 	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
-	(void)IoTHubTransportHttp_Subscribe(devHandle);
-	size_t nHeaders = 3;
 	mocks.ResetAllCalls();
 
 	setupDoWorkLoopOnceForOneDevice(mocks);
 
-	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
+	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
 
-	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-
-	STRICT_EXPECTED_CALL(mocks, BUFFER_new());
-	STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-
-	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-		.IgnoreArgument(1); /*because relativePath is a STRING_HANDLE*/
-	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
-		IGNORED_PTR_ARG,
-		IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
-		HTTPAPI_REQUEST_GET,                                /*HTTPAPI_REQUEST_TYPE requestType,                            */
-		"/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP API_VERSION,    /*const char* relativePath,                                    */
-		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
-		NULL,                                               /*BUFFER_HANDLE requestContent,                                */
-		IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
-		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
-		IGNORED_PTR_ARG                                     /*BUFFER_HANDLE responseContent))                              */
-		))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2)
-		.IgnoreArgument(5)
-		.IgnoreArgument(7)
-		.IgnoreArgument(8)
-		.IgnoreArgument(9)
-		.CopyOutArgumentBuffer(7, &statusCode200, sizeof(statusCode200));
-
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_FindHeaderValue(IGNORED_PTR_ARG, "ETag"))
-		.IgnoreArgument(1)
-		.SetReturn(TEST_ETAG_VALUE);
-
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-		.IgnoreArgument(1)
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE_6));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE_6, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
 		.IgnoreArgument(2)
-		.SetReturn(TEST_IOTHUB_MESSAGE_HANDLE_8);
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, BUFFER_u_char(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, BUFFER_length(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	{
-		/*this scope is for is properties code*/
-
-		HTTPHeaders_GetHeaderCount_writes_to_its_outputs = false;
-		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeaderCount(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.CopyOutArgumentBuffer(2, &nHeaders, sizeof(nHeaders));
-
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE_8));
-
-		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeader(IGNORED_PTR_ARG, 0, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(3);
-		STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(TEST_MAP_3_PROPERTY, "NAME1", "VALUE1"));
-
-		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeader(IGNORED_PTR_ARG, 1, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(3);
-		STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-
-		whenShallHTTPHeaders_GetHeader_fail = currentHTTPHeaders_GetHeader_call + 3;
-		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeader(IGNORED_PTR_ARG, 2, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(3);
-	}
+		.IgnoreArgument(3);
 
-	/*this is "abandon"*/
-	STRICT_EXPECTED_CALL(mocks, STRING_clone(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_construct_n(TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1))
-		.ValidateArgumentBuffer(1, TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1);
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "/abandon" API_VERSION))
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Clone(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
-
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc());
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "User-Agent", CLIENT_DEVICE_TYPE_PREFIX CLIENT_DEVICE_BACKSLASH IOTHUB_SDK_VERSION))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "Authorization", TEST_BLANK_SAS_TOKEN))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "If-Match", TEST_ETAG_VALUE))
-		.IgnoreArgument(1);
 
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/octet-stream"))
+		.IgnoreArgument(1);
 
-	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-		.IgnoreArgument(1); /*because abandon relativePath is a STRING_HANDLE*/
-	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
-		IGNORED_PTR_ARG,
-		IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
-		HTTPAPI_REQUEST_POST,                               /*HTTPAPI_REQUEST_TYPE requestType,                            */
-		"/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP_ETAG TEST_ETAG_VALUE_UNQUOTED "/abandon" API_VERSION,    /*const char* relativePath,                                    */
-		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
-		NULL,                                               /*BUFFER_HANDLE requestContent,                                */
-		IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
-		NULL,                                               /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
-		NULL                                                /*BUFFER_HANDLE responseContent))                              */
-		))
-		.IgnoreArgument(1)
+	/*no properties, so no more headers*/
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE_6));
+	STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_1_PROPERTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
 		.IgnoreArgument(2)
-		.IgnoreArgument(5)
-		.IgnoreArgument(7)
-		.CopyOutArgumentBuffer(7, &statusCode204, sizeof(statusCode204));
+		.IgnoreArgument(3)
+		.IgnoreArgument(4)
+		.SetReturn(MAP_ERROR);
+
+	DISABLE_BATCHING();
 
 	///act
 	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
@@ -11849,136 +11369,36 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_090: [ All the HTTP headers of the form iothub-app-name:somecontent shall be transformed in message properties {name, somecontent}. ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_092: [ If assembling the message fails in any way, then _DoWork shall "abandon" the message. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_with_2_property_when_properties_fails_it_abandons_3)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_079: [ If any HTTP header operation fails, _DoWork shall advance to the next action. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_does_nothing_when_http_fails_4)
 {
 	///arrange
 	CIoTHubTransportHttpMocks mocks;
-	unsigned int statusCode200 = 200;
-	unsigned int statusCode204 = 204;
+	DList_InsertTailList(&(waitingToSend), &(message6.entry));
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
 	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
-	(void)IoTHubTransportHttp_Subscribe(devHandle);
-	size_t nHeaders = 3;
 	mocks.ResetAllCalls();
 
 	setupDoWorkLoopOnceForOneDevice(mocks);
 
-	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
-
-	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-
-	STRICT_EXPECTED_CALL(mocks, BUFFER_new());
-	STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-
-	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-		.IgnoreArgument(1); /*because relativePath is a STRING_HANDLE*/
-	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
-		IGNORED_PTR_ARG,
-		IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
-		HTTPAPI_REQUEST_GET,                                /*HTTPAPI_REQUEST_TYPE requestType,                            */
-		"/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP API_VERSION,    /*const char* relativePath,                                    */
-		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
-		NULL,                                               /*BUFFER_HANDLE requestContent,                                */
-		IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
-		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
-		IGNORED_PTR_ARG                                     /*BUFFER_HANDLE responseContent))                              */
-		))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2)
-		.IgnoreArgument(5)
-		.IgnoreArgument(7)
-		.IgnoreArgument(8)
-		.IgnoreArgument(9)
-		.CopyOutArgumentBuffer(7, &statusCode200, sizeof(statusCode200));
-
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_FindHeaderValue(IGNORED_PTR_ARG, "ETag"))
-		.IgnoreArgument(1)
-		.SetReturn(TEST_ETAG_VALUE);
+	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
 
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-		.IgnoreArgument(1)
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE_6));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE_6, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
 		.IgnoreArgument(2)
-		.SetReturn(TEST_IOTHUB_MESSAGE_HANDLE_8);
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, BUFFER_u_char(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, BUFFER_length(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	{
-		/*this scope is for is properties code*/
-
-		HTTPHeaders_GetHeaderCount_writes_to_its_outputs = false;
-		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeaderCount(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.CopyOutArgumentBuffer(2, &nHeaders, sizeof(nHeaders));
-
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE_8));
-
-		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeader(IGNORED_PTR_ARG, 0, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(3);
-		STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(TEST_MAP_3_PROPERTY, "NAME1", "VALUE1"));
-
-		whenShallHTTPHeaders_GetHeader_fail = currentHTTPHeaders_GetHeader_call + 2;
-		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeader(IGNORED_PTR_ARG, 1, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(3);
-	}
+		.IgnoreArgument(3);
 
-	/*this is "abandon"*/
-	STRICT_EXPECTED_CALL(mocks, STRING_clone(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_construct_n(TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1))
-		.ValidateArgumentBuffer(1, TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1);
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "/abandon" API_VERSION))
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Clone(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
-
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc());
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "User-Agent", CLIENT_DEVICE_TYPE_PREFIX CLIENT_DEVICE_BACKSLASH IOTHUB_SDK_VERSION))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "Authorization", TEST_BLANK_SAS_TOKEN))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "If-Match", TEST_ETAG_VALUE))
-		.IgnoreArgument(1);
 
-
-	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-		.IgnoreArgument(1); /*because abandon relativePath is a STRING_HANDLE*/
-	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
-		IGNORED_PTR_ARG,
-		IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
-		HTTPAPI_REQUEST_POST,                               /*HTTPAPI_REQUEST_TYPE requestType,                            */
-		"/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP_ETAG TEST_ETAG_VALUE_UNQUOTED "/abandon" API_VERSION,    /*const char* relativePath,                                    */
-		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
-		NULL,                                               /*BUFFER_HANDLE requestContent,                                */
-		IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
-		NULL,                                               /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
-		NULL                                                /*BUFFER_HANDLE responseContent))                              */
-		))
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/octet-stream"))
 		.IgnoreArgument(1)
-		.IgnoreArgument(2)
-		.IgnoreArgument(5)
-		.IgnoreArgument(7)
-		.CopyOutArgumentBuffer(7, &statusCode204, sizeof(statusCode204));
+		.SetReturn(HTTP_HEADERS_ERROR);
+
+	DISABLE_BATCHING();
 
 	///act
 	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
@@ -11990,132 +11410,64 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_090: [ All the HTTP headers of the form iothub-app-name:somecontent shall be transformed in message properties {name, somecontent}. ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_092: [ If assembling the message fails in any way, then _DoWork shall "abandon" the message. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_with_2_property_when_properties_fails_it_abandons_4)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_079: [ If any HTTP header operation fails, _DoWork shall advance to the next action. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_does_nothing_when_http_fails_5)
 {
 	///arrange
 	CIoTHubTransportHttpMocks mocks;
-	unsigned int statusCode200 = 200;
-	unsigned int statusCode204 = 204;
+	DList_InsertTailList(&(waitingToSend), &(message6.entry));
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
 	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
-	(void)IoTHubTransportHttp_Subscribe(devHandle);
-	size_t nHeaders = 3;
 	mocks.ResetAllCalls();
 
 	setupDoWorkLoopOnceForOneDevice(mocks);
 
-	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
+	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
 
-	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE_6));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE_6, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.IgnoreArgument(3);
 
-	STRICT_EXPECTED_CALL(mocks, BUFFER_new());
-	STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
+	whenShallHTTPHeaders_Clone_fail = currentHTTPHeaders_Clone_call + 1;
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Clone(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
 
-	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-		.IgnoreArgument(1); /*because relativePath is a STRING_HANDLE*/
-	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
-		IGNORED_PTR_ARG,
-		IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
-		HTTPAPI_REQUEST_GET,                                /*HTTPAPI_REQUEST_TYPE requestType,                            */
-		"/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP API_VERSION,    /*const char* relativePath,                                    */
-		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
-		NULL,                                               /*BUFFER_HANDLE requestContent,                                */
-		IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
-		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
-		IGNORED_PTR_ARG                                     /*BUFFER_HANDLE responseContent))                              */
-		))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2)
-		.IgnoreArgument(5)
-		.IgnoreArgument(7)
-		.IgnoreArgument(8)
-		.IgnoreArgument(9)
-		.CopyOutArgumentBuffer(7, &statusCode200, sizeof(statusCode200));
-
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_FindHeaderValue(IGNORED_PTR_ARG, "ETag"))
-		.IgnoreArgument(1)
-		.SetReturn(TEST_ETAG_VALUE);
+	DISABLE_BATCHING();
 
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2)
-		.SetReturn(TEST_IOTHUB_MESSAGE_HANDLE_8);
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, BUFFER_u_char(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, BUFFER_length(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	{
-		/*this scope is for is properties code*/
+	///act
+	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
-		HTTPHeaders_GetHeaderCount_writes_to_its_outputs = false;
-		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeaderCount(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.CopyOutArgumentBuffer(2, &nHeaders, sizeof(nHeaders));
+	///assert
+	mocks.AssertActualAndExpectedCalls();
 
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE_8));
+	///cleanup
+	IoTHubTransportHttp_Destroy(handle);
+}
 
-		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeader(IGNORED_PTR_ARG, 0, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(3);
-		STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(TEST_MAP_3_PROPERTY, "NAME1", "VALUE1"))
-			.SetReturn(MAP_ERROR);
-	}
+//Tests_SRS_TRANSPORTMULTITHTTP_17_079: [ If any HTTP header operation fails, _DoWork shall advance to the next action. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_does_nothing_when_IoTHubMessage_GetByteArray_fails)
+{
+	///arrange
+	CIoTHubTransportHttpMocks mocks;
+	DList_InsertTailList(&(waitingToSend), &(message6.entry));
+	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
-	/*this is "abandon"*/
-	STRICT_EXPECTED_CALL(mocks, STRING_clone(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_construct_n(TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1))
-		.ValidateArgumentBuffer(1, TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1);
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "/abandon" API_VERSION))
-		.IgnoreArgument(1);
+	mocks.ResetAllCalls();
 
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc());
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "User-Agent", CLIENT_DEVICE_TYPE_PREFIX CLIENT_DEVICE_BACKSLASH IOTHUB_SDK_VERSION))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "Authorization", TEST_BLANK_SAS_TOKEN))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "If-Match", TEST_ETAG_VALUE))
-		.IgnoreArgument(1);
+	setupDoWorkLoopOnceForOneDevice(mocks);
 
+	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
 
-	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-		.IgnoreArgument(1); /*because abandon relativePath is a STRING_HANDLE*/
-	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
-		IGNORED_PTR_ARG,
-		IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
-		HTTPAPI_REQUEST_POST,                               /*HTTPAPI_REQUEST_TYPE requestType,                            */
-		"/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP_ETAG TEST_ETAG_VALUE_UNQUOTED "/abandon" API_VERSION,    /*const char* relativePath,                                    */
-		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
-		NULL,                                               /*BUFFER_HANDLE requestContent,                                */
-		IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
-		NULL,                                               /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
-		NULL                                                /*BUFFER_HANDLE responseContent))                              */
-		))
-		.IgnoreArgument(1)
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE_6));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE_6, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
 		.IgnoreArgument(2)
-		.IgnoreArgument(5)
-		.IgnoreArgument(7)
-		.CopyOutArgumentBuffer(7, &statusCode204, sizeof(statusCode204));
+		.IgnoreArgument(3)
+		.SetReturn(IOTHUB_MESSAGE_ERROR);
+
+	DISABLE_BATCHING();
 
 	///act
 	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
@@ -12127,123 +11479,38 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_090: [ All the HTTP headers of the form iothub-app-name:somecontent shall be transformed in message properties {name, somecontent}. ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_092: [ If assembling the message fails in any way, then _DoWork shall "abandon" the message. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and_1_service_message_with_2_property_when_properties_fails_it_abandons_5)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_075: [ If the oldest message in waitingToSend causes the message to exceed the message size limit then it shall be removed from waitingToSend, and IoTHubClient_LL_SendComplete shall be called. Parameter PDLIST_ENTRY completed shall point to a list containing only the oldest item, and parameter IOTHUB_BATCHSTATE result shall be set to IOTHUB_BATCHSTATE_FAILED. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_overlimit_calls_SendComplete_with_BATCHSTATE_FAILED)
 {
 	///arrange
 	CIoTHubTransportHttpMocks mocks;
-	unsigned int statusCode200 = 200;
-	unsigned int statusCode204 = 204;
+	DList_InsertTailList(&(waitingToSend), &(message9.entry));
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
 	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
-	(void)IoTHubTransportHttp_Subscribe(devHandle);
-	size_t nHeaders = 3;
 	mocks.ResetAllCalls();
 
 	setupDoWorkLoopOnceForOneDevice(mocks);
 
-	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
-
-	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-
-	STRICT_EXPECTED_CALL(mocks, BUFFER_new());
-	STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-
-	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-		.IgnoreArgument(1); /*because relativePath is a STRING_HANDLE*/
-	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
-		IGNORED_PTR_ARG,
-		IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
-		HTTPAPI_REQUEST_GET,                                /*HTTPAPI_REQUEST_TYPE requestType,                            */
-		"/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP API_VERSION,    /*const char* relativePath,                                    */
-		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
-		NULL,                                               /*BUFFER_HANDLE requestContent,                                */
-		IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
-		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
-		IGNORED_PTR_ARG                                     /*BUFFER_HANDLE responseContent))                              */
-		))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2)
-		.IgnoreArgument(5)
-		.IgnoreArgument(7)
-		.IgnoreArgument(8)
-		.IgnoreArgument(9)
-		.CopyOutArgumentBuffer(7, &statusCode200, sizeof(statusCode200));
 
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_FindHeaderValue(IGNORED_PTR_ARG, "ETag"))
-		.IgnoreArgument(1)
-		.SetReturn(TEST_ETAG_VALUE);
+	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
 
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-		.IgnoreArgument(1)
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE_9));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE_9, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
 		.IgnoreArgument(2)
-		.SetReturn(TEST_IOTHUB_MESSAGE_HANDLE_8);
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, BUFFER_u_char(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, BUFFER_length(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	{
-		/*this scope is for is properties code*/
+		.IgnoreArgument(3);
 
-		HTTPHeaders_GetHeaderCount_writes_to_its_outputs = false;
-		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeaderCount(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.CopyOutArgumentBuffer(2, &nHeaders, sizeof(nHeaders))
-			.SetReturn(HTTP_HEADERS_ERROR);
-	}
+	/*ooops - over 256K*/
 
-	/*this is "abandon"*/
-	STRICT_EXPECTED_CALL(mocks, STRING_clone(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+	/*building the list of messages to be notified if HTTP is fine*/
+	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_construct_n(TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1))
-		.ValidateArgumentBuffer(1, TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1);
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message9.entry)))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreArgument(1)
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_FAILED))
 		.IgnoreArgument(2);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "/abandon" API_VERSION))
-		.IgnoreArgument(1);
-
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc());
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "User-Agent", CLIENT_DEVICE_TYPE_PREFIX CLIENT_DEVICE_BACKSLASH IOTHUB_SDK_VERSION))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "Authorization", TEST_BLANK_SAS_TOKEN))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "If-Match", TEST_ETAG_VALUE))
-		.IgnoreArgument(1);
-
 
-	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-		.IgnoreArgument(1); /*because abandon relativePath is a STRING_HANDLE*/
-	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
-		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
-		IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
-		HTTPAPI_REQUEST_POST,                               /*HTTPAPI_REQUEST_TYPE requestType,                            */
-		"/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP_ETAG TEST_ETAG_VALUE_UNQUOTED "/abandon" API_VERSION,    /*const char* relativePath,                                    */
-		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
-		NULL,                                               /*BUFFER_HANDLE requestContent,                                */
-		IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
-		NULL,                                               /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
-		NULL                                                /*BUFFER_HANDLE responseContent))                              */
-		))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2)
-		.IgnoreArgument(5)
-		.IgnoreArgument(7)
-		.CopyOutArgumentBuffer(7, &statusCode204, sizeof(statusCode204));
+	DISABLE_BATCHING();
 
 	///act
 	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
@@ -12255,19 +11522,12 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_071: [ If option SetBatching is false then _DoWork shall send individual event message as specced below. ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_076: [ A clone of the event HTTP request headers shall be created. ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_077: [ The cloned HTTP headers shall have the HTTP header "Content-Type" set to "application/octet-stream". ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_078: [ Every message property "property":"value" shall be added to the HTTP headers as an individual header "iothub-app-property":"value". ] /*well - this tests that no "phantom" properties are added when there are no properties to add*/
-//Tests_SRS_TRANSPORTMULTITHTTP_17_080: [ IoTHubTransportHttp_DoWork shall call HTTPAPIEX_SAS_ExecuteRequest2 passing the following parameters ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_082: [ If HTTPAPIEX_SAS_ExecuteRequest2 does not fail and http status code < 300 then IoTHubTransportHttp_DoWork shall call IoTHubClient_LL_SendComplete. Parameter PDLIST_ENTRY completed shall point to a list the item send, and parameter IOTHUB_BATCHSTATE result shall be set to IOTHUB_BATCHSTATE_SUCCESS. The item shall be removed from waitingToSend. ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_117: [ If optionName is an option handled by IoTHubTransportHttp then it shall be set. ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_120: [ "Batching" ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_no_properties_unbatched_happy_path_succeeds)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_057: [ If a messages to be send has type IOTHUBMESSAGE_STRING, then its serialization shall be {"body":"JSON encoding of the string", "base64Encoded":false} ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_as_string_happy_path_succeeds)
 {
 	///arrange
 	CIoTHubTransportHttpMocks mocks;
-	DList_InsertTailList(&(waitingToSend), &(message1.entry));
+	DList_InsertTailList(&(waitingToSend), &(message10.entry));
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
 	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
@@ -12277,33 +11537,21 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_no_properties_unbatch
 
 	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
 
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE_1));
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE_1, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreArgument(2)
-		.IgnoreArgument(3);
-
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Clone(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
 		.IgnoreArgument(1);
 
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/octet-stream"))
-		.IgnoreArgument(1);
+	/*measuring the items, the ones that fit make the batch*/
+	setupBatchedItem(mocks, message10.messageHandle, TEST_MAP_EMPTY);
 
-	/*no properties, so no more headers*/
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE_1));
-	STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreArgument(2)
-		.IgnoreArgument(3)
-		.IgnoreArgument(4);
+	/*the payload is allocated once and the batched items are written directly in it*/
+	setupBatchedPayload(mocks);
+	setupBatchedItem(mocks, message10.messageHandle, TEST_MAP_EMPTY);
 
-	STRICT_EXPECTED_CALL(mocks, BUFFER_new());
-	STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
+	/*building the list of messages to be notified if HTTP is fine*/
+	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message10.entry)))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, BUFFER_build(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2)
-		.IgnoreArgument(3);
 
 	/*executing HTTP goodies*/
 	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
@@ -12327,39 +11575,23 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_no_properties_unbatch
 
 	/*once the event has been succesfull...*/
 
-	/*building the list of messages to be notified if HTTP is fine*/
-	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message1.entry)))
-		.IgnoreArgument(1);
 	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_SUCCESS))
 		.IgnoreArgument(2);
 
-	EXPECTED_CALL(mocks, IoTHubMessage_GetMessageId(IGNORED_PTR_ARG));
-	EXPECTED_CALL(mocks, IoTHubMessage_GetCorrelationId(IGNORED_PTR_ARG));
-
-	DISABLE_BATCHING();
+	ENABLE_BATCHING();
 
 	///act
 	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
 	///assert
-	ASSERT_ARE_EQUAL(int, 0, memcmp(BASEIMPLEMENTATION::BUFFER_u_char(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest), buffer1, buffer1_size));
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_071: [ If option SetBatching is false then _DoWork shall send individual event message as specced below. ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_076: [ A clone of the event HTTP request headers shall be created. ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_077: [ The cloned HTTP headers shall have the HTTP header "Content-Type" set to "application/octet-stream". ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_078: [ Every message property "property":"value" shall be added to the HTTP headers as an individual header "iothub-app-property":"value". ] /*well - this tests that no "phantom" properties are added when there are no properties to add*/
-//Tests_SRS_TRANSPORTMULTITHTTP_17_080: [ IoTHubTransportHttp_DoWork shall call HTTPAPIEX_SAS_ExecuteRequest2 passing the following parameters ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_082: [ If HTTPAPIEX_SAS_ExecuteRequest2 does not fail and http status code < 300 then IoTHubTransportHttp_DoWork shall call IoTHubClient_LL_SendComplete. Parameter PDLIST_ENTRY completed shall point to a list the item send, and parameter IOTHUB_BATCHSTATE result shall be set to IOTHUB_BATCHSTATE_SUCCESS. The item shall be removed from waitingToSend. ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_117: [ If optionName is an option handled by IoTHubTransportHttp then it shall be set. ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_120: [ "Batching" ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_no_properties_string_type_unbatched_happy_path_succeeds)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_067: [ If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_as_string_when_Map_GetInternals_fails_it_fails)
 {
 	///arrange
 	CIoTHubTransportHttpMocks mocks;
@@ -12373,84 +11605,37 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_no_properties_string_
 
 	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
 
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE_10));
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetString(TEST_IOTHUB_MESSAGE_HANDLE_10));
-
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Clone(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/octet-stream"))
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
 		.IgnoreArgument(1);
 
-	/*no properties, so no more headers*/
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE_10));
+	/*measuring the first item fails*/
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message10.messageHandle));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetString(message10.messageHandle));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message10.messageHandle));
 	STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
 		.IgnoreArgument(2)
 		.IgnoreArgument(3)
-		.IgnoreArgument(4);
-
-	STRICT_EXPECTED_CALL(mocks, BUFFER_new());
-	STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, BUFFER_build(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2)
-		.IgnoreArgument(3);
-
-	/*executing HTTP goodies*/
-	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
-		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
-		IGNORED_PTR_ARG,
-		HTTPAPI_REQUEST_POST,                                                           /*HTTPAPI_REQUEST_TYPE requestType,                  */
-		"/devices/" TEST_DEVICE_ID EVENT_ENDPOINT API_VERSION,                 /*const char* relativePath,                          */
-		IGNORED_PTR_ARG,                                                                /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,      */
-		IGNORED_PTR_ARG,                                                                /*BUFFER_HANDLE requestContent,                      */
-		IGNORED_PTR_ARG,                                                                /*unsigned int* statusCode,                          */
-		NULL,                                                                           /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,     */
-		NULL                                                                            /*BUFFER_HANDLE responseContent)                     */
-		))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2)
-		.IgnoreArgument(5)
-		.IgnoreArgument(6)
-		.CopyOutArgumentBuffer(7, &httpStatus200, sizeof(httpStatus200));
-
-	/*once the event has been succesfull...*/
-
-	/*building the list of messages to be notified if HTTP is fine*/
-	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message10.entry)))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_SUCCESS))
-		.IgnoreArgument(2);
-
-	EXPECTED_CALL(mocks, IoTHubMessage_GetMessageId(IGNORED_PTR_ARG));
-	EXPECTED_CALL(mocks, IoTHubMessage_GetCorrelationId(IGNORED_PTR_ARG));
+		.IgnoreArgument(4)
+		.SetReturn(MAP_ERROR);
 
-	DISABLE_BATCHING();
+	ENABLE_BATCHING();
 
 	///act
 	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
 	///assert
-	ASSERT_ARE_EQUAL(int, 0, memcmp(BASEIMPLEMENTATION::BUFFER_u_char(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest), string10, strlen(string10)));
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_072: [ The message size shall be limited to 255KB -1 bytes. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_unbatched_happy_path_at_the_message_limit_succeeds)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_067: [ If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_as_string_when_IoTHubMessage_GetString_it_fails)
 {
 	///arrange
 	CIoTHubTransportHttpMocks mocks;
-	DList_InsertTailList(&(waitingToSend), &(message11.entry));
+	DList_InsertTailList(&(waitingToSend), &(message10.entry));
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
 	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
@@ -12460,135 +11645,69 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_unbatched_happy_path_at_th
 
 	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
 
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE_11));
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE_11, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreArgument(2)
-		.IgnoreArgument(3);
-
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Clone(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/octet-stream"))
-		.IgnoreArgument(1);
-
-	/*1 property*/
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE_11));
-	STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_1_PROPERTY_A_B, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreArgument(2)
-		.IgnoreArgument(3)
-		.IgnoreArgument(4);
-
-	STRICT_EXPECTED_CALL(mocks, STRING_construct("iothub-app-"));
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, TEST_KEYS1_A_B[0]))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "iothub-app-a", TEST_VALUES1_A_B[0]))
-		.IgnoreArgument(1);
-
-
-	STRICT_EXPECTED_CALL(mocks, BUFFER_new());
-	STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, BUFFER_build(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2)
-		.IgnoreArgument(3);
-
-	/*executing HTTP goodies*/
-	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
-		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
-		IGNORED_PTR_ARG,
-		HTTPAPI_REQUEST_POST,                                                           /*HTTPAPI_REQUEST_TYPE requestType,                  */
-		"/devices/" TEST_DEVICE_ID EVENT_ENDPOINT API_VERSION,                 /*const char* relativePath,                          */
-		IGNORED_PTR_ARG,                                                                /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,      */
-		IGNORED_PTR_ARG,                                                                /*BUFFER_HANDLE requestContent,                      */
-		IGNORED_PTR_ARG,                                                                /*unsigned int* statusCode,                          */
-		NULL,                                                                           /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,     */
-		NULL                                                                            /*BUFFER_HANDLE responseContent)                     */
-		))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2)
-		.IgnoreArgument(5)
-		.IgnoreArgument(6)
-		.CopyOutArgumentBuffer(7, &httpStatus200, sizeof(httpStatus200));
-
-	/*once the event has been succesfull...*/
-
-	/*building the list of messages to be notified if HTTP is fine*/
-	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message11.entry)))
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_SUCCESS))
-		.IgnoreArgument(2);
 
-	EXPECTED_CALL(mocks, IoTHubMessage_GetMessageId(IGNORED_PTR_ARG));
-	EXPECTED_CALL(mocks, IoTHubMessage_GetCorrelationId(IGNORED_PTR_ARG));
+	/*measuring the first item fails*/
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message10.messageHandle));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetString(message10.messageHandle))
+		.SetReturn((const char*)NULL);
 
-	DISABLE_BATCHING();
+	ENABLE_BATCHING();
 
 	///act
 	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
 	///assert
-	ASSERT_ARE_EQUAL(int, 0, memcmp(BASEIMPLEMENTATION::BUFFER_u_char(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest), buffer11, buffer11_size));
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_072: [ The message size shall be limited to 255KB -1 bytes. ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_073: [ The message size is computed from the length of the payload + 384. ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_074: [ Every property name shall add to the message size the length of the property name + the length of the property value + 16 bytes. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_no_properties_string_type_unbatched_happy_path_at_the_message_limit_succeeds)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_067: [ If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_as_string_with_non_ASCII_characters_it_fails)
 {
 	///arrange
-	CNiceCallComparer<CIoTHubTransportHttpMocks> mocks;
-	DList_InsertTailList(&(waitingToSend), &(message12.entry));
+	CIoTHubTransportHttpMocks mocks;
+	DList_InsertTailList(&(waitingToSend), &(message10.entry));
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
-
 	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
 	mocks.ResetAllCalls();
 
 	setupDoWorkLoopOnceForOneDevice(mocks);
 
-	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_FAILED))
-		.IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
 
-	DISABLE_BATCHING();
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
+		.IgnoreArgument(1);
+
+	/*the string cannot be represented in JSON, measuring the first item fails*/
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message10.messageHandle));
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetString(message10.messageHandle))
+		.SetReturn("caf\xC3\xA9");
+
+	ENABLE_BATCHING();
 
 	///act
 	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
 	///assert
 	mocks.AssertActualAndExpectedCalls();
+	ASSERT_IS_NULL(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest);
 
 	///cleanup
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_071: [ If option SetBatching is false then _DoWork shall send individual event message as specced below. ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_076: [ A clone of the event HTTP request headers shall be created. ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_077: [ The cloned HTTP headers shall have the HTTP header "Content-Type" set to "application/octet-stream". ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_078: [ Every message property "property":"value" shall be added to the HTTP headers as an individual header "iothub-app-property":"value". ] /*well - this tests that no "phantom" properties are added when there are no properties to add*/
-//Tests_SRS_TRANSPORTMULTITHTTP_17_080: [ IoTHubTransportHttp_DoWork shall call HTTPAPIEX_SAS_ExecuteRequest2 passing the following parameters ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_082: [ If HTTPAPIEX_SAS_ExecuteRequest2 does not fail and http status code < 300 then IoTHubTransportHttp_DoWork shall call IoTHubClient_LL_SendComplete. Parameter PDLIST_ENTRY completed shall point to a list the item send, and parameter IOTHUB_BATCHSTATE result shall be set to IOTHUB_BATCHSTATE_SUCCESS. The item shall be removed from waitingToSend. ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_117: [ If optionName is an option handled by IoTHubTransportHttp then it shall be set. ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_120: [ "Batching" ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_no_properties_string_type_unbatched_fails_when_getString_fails)
+#define TEST_ESCAPED_STRING_ITEM "[{\"body\":\"a\\\"b\\\\c\\/d\\u0001\\u001F\",\"base64Encoded\":false}]"
+
+//Tests_SRS_TRANSPORTMULTITHTTP_17_057: [ If a messages to be send has type IOTHUBMESSAGE_STRING, then its serialization shall be {"body":"JSON encoding of the string", "base64Encoded":false} ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_as_string_escapes_the_string)
 {
 	///arrange
-	CIoTHubTransportHttpMocks mocks;
+	CNiceCallComparer<CIoTHubTransportHttpMocks> mocks; /*a very e2e test... */
 	DList_InsertTailList(&(waitingToSend), &(message10.entry));
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
 	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
@@ -12597,371 +11716,313 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_no_properties_string_
 
 	setupDoWorkLoopOnceForOneDevice(mocks);
 
-	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
-
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE_10));
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetString(TEST_IOTHUB_MESSAGE_HANDLE_10))
-		.SetReturn((const char*)NULL);
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetString(message10.messageHandle))
+		.SetReturn("a\"b\\c/d\x01\x1F")
+		.ExpectedTimesExactly(2);
 
-	DISABLE_BATCHING();
+	ENABLE_BATCHING();
 
 	///act
 	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
 	///assert
+	ASSERT_ARE_EQUAL(size_t, sizeof(TEST_ESCAPED_STRING_ITEM) - 1, BASEIMPLEMENTATION::BUFFER_length(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest));
+	ASSERT_ARE_EQUAL(int, 0, memcmp(BASEIMPLEMENTATION::BUFFER_u_char(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest), TEST_ESCAPED_STRING_ITEM, sizeof(TEST_ESCAPED_STRING_ITEM) - 1));
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_071: [ If option SetBatching is false then _DoWork shall send individual event message as specced below. ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_076: [ A clone of the event HTTP request headers shall be created. ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_077: [ The cloned HTTP headers shall have the HTTP header "Content-Type" set to "application/octet-stream". ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_078: [ Every message property "property":"value" shall be added to the HTTP headers as an individual header "iothub-app-property":"value". ] /*well - this tests that no "phantom" properties are added when there are no properties to add*/
-//Tests_SRS_TRANSPORTMULTITHTTP_17_080: [ IoTHubTransportHttp_DoWork shall call HTTPAPIEX_SAS_ExecuteRequest2 passing the following parameters ]
-//Tests_SRS_TRANSPORTMULTITHTTP_17_082: [ If HTTPAPIEX_SAS_ExecuteRequest2 does not fail and http status code < 300 then IoTHubTransportHttp_DoWork shall call IoTHubClient_LL_SendComplete. Parameter PDLIST_ENTRY completed shall point to a list the item send, and parameter IOTHUB_BATCHSTATE result shall be set to IOTHUB_BATCHSTATE_SUCCESS. The item shall be removed from waitingToSend. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_happy_path_succeeds)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_091: [ The HTTP header value of iothub-messageid shall be set in the IoTHub_SetMessageId. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_SetMessageId_SUCCEED)
 {
 	///arrange
 	CIoTHubTransportHttpMocks mocks;
-	DList_InsertTailList(&(waitingToSend), &(message6.entry));
+	size_t nHeaders = 4;
+	unsigned int statusCode200 = 200;
+	unsigned int statusCode204 = 204;
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
 	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
+	(void)IoTHubTransportHttp_Subscribe(devHandle);
 	mocks.ResetAllCalls();
-
 	setupDoWorkLoopOnceForOneDevice(mocks);
 
+	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
 
-	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
-
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE_6));
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE_6, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreArgument(2)
-		.IgnoreArgument(3);
-
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Clone(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
 
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/octet-stream"))
+	STRICT_EXPECTED_CALL(mocks, BUFFER_new());
+	STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
 
-	/*no properties, so no more headers*/
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE_6));
-	STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_1_PROPERTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreArgument(2)
-		.IgnoreArgument(3)
-		.IgnoreArgument(4);
-
-	/*this is making http headers*/
-	STRICT_EXPECTED_CALL(mocks, STRING_construct("iothub-app-"));
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, TEST_RED_KEY))
-		.IgnoreArgument(1);
 	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "iothub-app-" TEST_RED_KEY, TEST_RED_VALUE))
-		.IgnoreArgument(1);
-
-	STRICT_EXPECTED_CALL(mocks, BUFFER_new());
-	STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, BUFFER_build(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2)
-		.IgnoreArgument(3);
-
-	/*executing HTTP goodies*/
-	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
-		.IgnoreArgument(1);
+		.IgnoreArgument(1); /*because relativePath is a STRING_HANDLE*/
 	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
 		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
-		IGNORED_PTR_ARG,
-		HTTPAPI_REQUEST_POST,                                                           /*HTTPAPI_REQUEST_TYPE requestType,                  */
-		"/devices/" TEST_DEVICE_ID EVENT_ENDPOINT API_VERSION,                 /*const char* relativePath,                          */
-		IGNORED_PTR_ARG,                                                                /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,      */
-		IGNORED_PTR_ARG,                                                                /*BUFFER_HANDLE requestContent,                      */
-		IGNORED_PTR_ARG,                                                                /*unsigned int* statusCode,                          */
-		NULL,                                                                           /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,     */
-		NULL                                                                            /*BUFFER_HANDLE responseContent)                     */
+		IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
+		HTTPAPI_REQUEST_GET,                                /*HTTPAPI_REQUEST_TYPE requestType,                            */
+		"/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP API_VERSION,    /*const char* relativePath,                                    */
+		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
+		NULL,                                               /*BUFFER_HANDLE requestContent,                                */
+		IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
+		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
+		IGNORED_PTR_ARG                                     /*BUFFER_HANDLE responseContent))                              */
 		))
 		.IgnoreArgument(1)
 		.IgnoreArgument(2)
 		.IgnoreArgument(5)
-		.IgnoreArgument(6)
-		.CopyOutArgumentBuffer(7, &httpStatus200, sizeof(httpStatus200));
+		.IgnoreArgument(7)
+		.IgnoreArgument(8)
+		.IgnoreArgument(9)
+		.CopyOutArgumentBuffer(7, &statusCode200, sizeof(statusCode200));
 
-	/*once the event has been succesfull...*/
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_FindHeaderValue(IGNORED_PTR_ARG, "ETag"))
+		.IgnoreArgument(1)
+		.SetReturn(TEST_ETAG_VALUE);
 
-	/*building the list of messages to be notified if HTTP is fine*/
-	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2)
+		.SetReturn(TEST_IOTHUB_MESSAGE_HANDLE_8);
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message6.entry)))
+	STRICT_EXPECTED_CALL(mocks, BUFFER_u_char(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_SUCCESS))
-		.IgnoreArgument(2);
-
-	EXPECTED_CALL(mocks, IoTHubMessage_GetMessageId(IGNORED_PTR_ARG));
-	EXPECTED_CALL(mocks, IoTHubMessage_GetCorrelationId(IGNORED_PTR_ARG));
-
-	DISABLE_BATCHING();
-
-	///act
-	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
-
-	///assert
-	ASSERT_ARE_EQUAL(int, 0, memcmp(BASEIMPLEMENTATION::BUFFER_u_char(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest), buffer6, buffer6_size));
-	mocks.AssertActualAndExpectedCalls();
-
-	///cleanup
-	IoTHubTransportHttp_Destroy(handle);
-}
+	STRICT_EXPECTED_CALL(mocks, BUFFER_length(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	{
+		/*this scope is for is properties code*/
 
+		HTTPHeaders_GetHeaderCount_writes_to_its_outputs = false;
+		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeaderCount(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+			.IgnoreArgument(1)
+			.CopyOutArgumentBuffer(2, &nHeaders, sizeof(nHeaders));
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_069: [ If HTTPAPIEX_SAS_ExecuteRequest2 fails or the http status code >=300 then IoTHubTransportHttp_DoWork shall not do any other action (it is assumed at the next _DoWork it shall be retried). ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_does_nothing_when_httpStatusCode_is_not_succeess)
-{
-	///arrange
-	CIoTHubTransportHttpMocks mocks;
-	DList_InsertTailList(&(waitingToSend), &(message6.entry));
-	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
-	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE_8));
 
-	mocks.ResetAllCalls();
+		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeader(IGNORED_PTR_ARG, 0, IGNORED_PTR_ARG))
+			.IgnoreArgument(1)
+			.IgnoreArgument(3);
+		STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+			.IgnoreArgument(1);
+		STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(TEST_MAP_3_PROPERTY, "NAME1", "VALUE1"));
 
-	setupDoWorkLoopOnceForOneDevice(mocks);
+		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeader(IGNORED_PTR_ARG, 1, IGNORED_PTR_ARG))
+			.IgnoreArgument(1)
+			.IgnoreArgument(3);
+		STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+			.IgnoreArgument(1);
 
-	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
+		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeader(IGNORED_PTR_ARG, 2, IGNORED_PTR_ARG))
+			.IgnoreArgument(1)
+			.IgnoreArgument(3);
+		STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+			.IgnoreArgument(1);
+		STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(TEST_MAP_3_PROPERTY, "NAME2", "VALUE2"));
 
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE_6));
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE_6, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreArgument(2)
-		.IgnoreArgument(3);
+		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeader(IGNORED_PTR_ARG, 3, IGNORED_PTR_ARG))
+			.IgnoreArgument(1)
+			.IgnoreArgument(3);
+		STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+			.IgnoreArgument(1);
+		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_SetMessageId(IGNORED_PTR_ARG, "VALUE3"))
+			.IgnoreArgument(1);
+	}
 
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Clone(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_MessageCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2);
 
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/octet-stream"))
+	/*this returns "0" so the message needs to be "accepted"*/
+	/*this is "accepting"*/
+	STRICT_EXPECTED_CALL(mocks, STRING_clone(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
-
-	/*no properties, so no more headers*/
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE_6));
-	STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_1_PROPERTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreArgument(2)
-		.IgnoreArgument(3)
-		.IgnoreArgument(4);
-
-	/*this is making http headers*/
-	STRICT_EXPECTED_CALL(mocks, STRING_construct("iothub-app-"));
 	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, TEST_RED_KEY))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+	STRICT_EXPECTED_CALL(mocks, STRING_construct_n(TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1))
+		.ValidateArgumentBuffer(1, TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1);
+	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "iothub-app-" TEST_RED_KEY, TEST_RED_VALUE))
+	STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, API_VERSION))
 		.IgnoreArgument(1);
 
-	STRICT_EXPECTED_CALL(mocks, BUFFER_new());
-	STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "If-Match", TEST_ETAG_VALUE))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, BUFFER_build(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2)
-		.IgnoreArgument(3);
 
-	/*executing HTTP goodies*/
-	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
-		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+		.IgnoreArgument(1); /*because abandon relativePath is a STRING_HANDLE*/
 	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
 		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
-		IGNORED_PTR_ARG,
-		HTTPAPI_REQUEST_POST,                                                           /*HTTPAPI_REQUEST_TYPE requestType,                  */
-		"/devices/" TEST_DEVICE_ID EVENT_ENDPOINT API_VERSION,                 /*const char* relativePath,                          */
-		IGNORED_PTR_ARG,                                                                /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,      */
-		IGNORED_PTR_ARG,                                                                /*BUFFER_HANDLE requestContent,                      */
-		IGNORED_PTR_ARG,                                                                /*unsigned int* statusCode,                          */
-		NULL,                                                                           /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,     */
-		NULL                                                                            /*BUFFER_HANDLE responseContent)                     */
+		IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
+		HTTPAPI_REQUEST_DELETE,                                /*HTTPAPI_REQUEST_TYPE requestType,                            */
+		"/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP_ETAG TEST_ETAG_VALUE_UNQUOTED API_VERSION,    /*const char* relativePath,                                    */
+		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
+		NULL,                                               /*BUFFER_HANDLE requestContent,                                */
+		IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
+		NULL,                                               /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
+		NULL                                                /*BUFFER_HANDLE responseContent))                              */
 		))
 		.IgnoreArgument(1)
 		.IgnoreArgument(2)
 		.IgnoreArgument(5)
-		.IgnoreArgument(6)
-		.CopyOutArgumentBuffer(7, &httpStatus404, sizeof(httpStatus404));
-
-	EXPECTED_CALL(mocks, IoTHubMessage_GetMessageId(IGNORED_PTR_ARG));
-	EXPECTED_CALL(mocks, IoTHubMessage_GetCorrelationId(IGNORED_PTR_ARG));
-
-	DISABLE_BATCHING();
+		.IgnoreArgument(7)
+		.CopyOutArgumentBuffer(7, &statusCode204, sizeof(statusCode204));
 
 	///act
 	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
 	///assert
-	ASSERT_ARE_EQUAL(int, 0, memcmp(BASEIMPLEMENTATION::BUFFER_u_char(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest), buffer6, buffer6_size));
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_081: [ If HTTPAPIEX_SAS_ExecuteRequest2 fails or the http status code >=300 then IoTHubTransportHttp_DoWork shall not do any other action (it is assumed at the next _DoWork it shall be retried). ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_does_nothing_when_HTTPAPIEXSAS_fails)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_091: [ The HTTP header value of iothub-messageid shall be set in the IoTHub_SetMessageId. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_SetMessageId_FAILED)
 {
 	///arrange
 	CIoTHubTransportHttpMocks mocks;
-	DList_InsertTailList(&(waitingToSend), &(message6.entry));
+	size_t nHeaders = 4;
+	unsigned int statusCode200 = 200;
+	unsigned int statusCode204 = 204;
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
 	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
 
+	(void)IoTHubTransportHttp_Subscribe(devHandle);
 	mocks.ResetAllCalls();
-
 	setupDoWorkLoopOnceForOneDevice(mocks);
 
-	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
-
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE_6));
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE_6, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreArgument(2)
-		.IgnoreArgument(3);
+	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
 
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Clone(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
 
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/octet-stream"))
-		.IgnoreArgument(1);
-
-	/*no properties, so no more headers*/
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE_6));
-	STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_1_PROPERTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreArgument(2)
-		.IgnoreArgument(3)
-		.IgnoreArgument(4);
-
-	/*this is making http headers*/
-	STRICT_EXPECTED_CALL(mocks, STRING_construct("iothub-app-"));
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, TEST_RED_KEY))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "iothub-app-" TEST_RED_KEY, TEST_RED_VALUE))
-		.IgnoreArgument(1);
-
 	STRICT_EXPECTED_CALL(mocks, BUFFER_new());
 	STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, BUFFER_build(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2)
-		.IgnoreArgument(3);
 
-	/*executing HTTP goodies*/
-	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
-		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+		.IgnoreArgument(1); /*because relativePath is a STRING_HANDLE*/
 	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
 		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
-		IGNORED_PTR_ARG,
-		HTTPAPI_REQUEST_POST,                                                           /*HTTPAPI_REQUEST_TYPE requestType,                  */
-		"/devices/" TEST_DEVICE_ID EVENT_ENDPOINT API_VERSION,                 /*const char* relativePath,                          */
-		IGNORED_PTR_ARG,                                                                /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,      */
-		IGNORED_PTR_ARG,                                                                /*BUFFER_HANDLE requestContent,                      */
-		IGNORED_PTR_ARG,                                                                /*unsigned int* statusCode,                          */
-		NULL,                                                                           /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,     */
-		NULL                                                                            /*BUFFER_HANDLE responseContent)                     */
-		))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2)
-		.IgnoreArgument(5)
-		.IgnoreArgument(6)
-		.CopyOutArgumentBuffer(7, &httpStatus200, sizeof(httpStatus200))
-		.SetReturn(HTTPAPIEX_ERROR);
-
-	EXPECTED_CALL(mocks, IoTHubMessage_GetMessageId(IGNORED_PTR_ARG));
-	EXPECTED_CALL(mocks, IoTHubMessage_GetCorrelationId(IGNORED_PTR_ARG));
-
-	DISABLE_BATCHING();
+		IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
+		HTTPAPI_REQUEST_GET,                                /*HTTPAPI_REQUEST_TYPE requestType,                            */
+		"/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP API_VERSION,    /*const char* relativePath,                                    */
+		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
+		NULL,                                               /*BUFFER_HANDLE requestContent,                                */
+		IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
+		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
+		IGNORED_PTR_ARG                                     /*BUFFER_HANDLE responseContent))                              */
+		))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2)
+		.IgnoreArgument(5)
+		.IgnoreArgument(7)
+		.IgnoreArgument(8)
+		.IgnoreArgument(9)
+		.CopyOutArgumentBuffer(7, &statusCode200, sizeof(statusCode200));
 
-	///act
-	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_FindHeaderValue(IGNORED_PTR_ARG, "ETag"))
+		.IgnoreArgument(1)
+		.SetReturn(TEST_ETAG_VALUE);
 
-	///assert
-	ASSERT_ARE_EQUAL(int, 0, memcmp(BASEIMPLEMENTATION::BUFFER_u_char(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest), buffer6, buffer6_size));
-	mocks.AssertActualAndExpectedCalls();
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2)
+		.SetReturn(TEST_IOTHUB_MESSAGE_HANDLE_8);
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, BUFFER_u_char(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, BUFFER_length(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	{
+		/*this scope is for is properties code*/
 
-	///cleanup
-	IoTHubTransportHttp_Destroy(handle);
-}
+		HTTPHeaders_GetHeaderCount_writes_to_its_outputs = false;
+		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeaderCount(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+			.IgnoreArgument(1)
+			.CopyOutArgumentBuffer(2, &nHeaders, sizeof(nHeaders));
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_079: [ If any HTTP header operation fails, _DoWork shall advance to the next action. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_does_nothing_when_buffer_fails_1)
-{
-	///arrange
-	CIoTHubTransportHttpMocks mocks;
-	DList_InsertTailList(&(waitingToSend), &(message6.entry));
-	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
-	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE_8));
 
-	mocks.ResetAllCalls();
-	setupDoWorkLoopOnceForOneDevice(mocks);
+		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeader(IGNORED_PTR_ARG, 0, IGNORED_PTR_ARG))
+			.IgnoreArgument(1)
+			.IgnoreArgument(3);
+		STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+			.IgnoreArgument(1);
+		STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(TEST_MAP_3_PROPERTY, "NAME1", "VALUE1"));
 
-	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
+		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeader(IGNORED_PTR_ARG, 1, IGNORED_PTR_ARG))
+			.IgnoreArgument(1)
+			.IgnoreArgument(3);
+		STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+			.IgnoreArgument(1);
 
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE_6));
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE_6, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreArgument(2)
-		.IgnoreArgument(3);
+		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeader(IGNORED_PTR_ARG, 2, IGNORED_PTR_ARG))
+			.IgnoreArgument(1)
+			.IgnoreArgument(3);
+		STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+			.IgnoreArgument(1);
+		STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(TEST_MAP_3_PROPERTY, "NAME2", "VALUE2"));
 
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Clone(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
+		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeader(IGNORED_PTR_ARG, 3, IGNORED_PTR_ARG))
+			.IgnoreArgument(1)
+			.IgnoreArgument(3);
+		STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+			.IgnoreArgument(1);
+		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_SetMessageId(IGNORED_PTR_ARG, "VALUE3"))
+			.IgnoreArgument(1)
+			.SetReturn(IOTHUB_MESSAGE_ERROR);
+	}
 
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/octet-stream"))
+	/*this is "abandon"*/
+	STRICT_EXPECTED_CALL(mocks, STRING_clone(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
-
-	/*no properties, so no more headers*/
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE_6));
-	STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_1_PROPERTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreArgument(2)
-		.IgnoreArgument(3)
-		.IgnoreArgument(4);
-
-	/*this is making http headers*/
-	STRICT_EXPECTED_CALL(mocks, STRING_construct("iothub-app-"));
 	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, TEST_RED_KEY))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+	STRICT_EXPECTED_CALL(mocks, STRING_construct_n(TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1))
+		.ValidateArgumentBuffer(1, TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1);
+	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "iothub-app-" TEST_RED_KEY, TEST_RED_VALUE))
+	STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "/abandon" API_VERSION))
 		.IgnoreArgument(1);
 
-	STRICT_EXPECTED_CALL(mocks, BUFFER_new());
-	STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "If-Match", TEST_ETAG_VALUE))
 		.IgnoreArgument(1);
 
-	STRICT_EXPECTED_CALL(mocks, BUFFER_build(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+		.IgnoreArgument(1); /*because abandon relativePath is a STRING_HANDLE*/
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+		IGNORED_PTR_ARG,
+		IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
+		HTTPAPI_REQUEST_POST,                               /*HTTPAPI_REQUEST_TYPE requestType,                            */
+		"/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP_ETAG TEST_ETAG_VALUE_UNQUOTED "/abandon" API_VERSION,    /*const char* relativePath,                                    */
+		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
+		NULL,                                               /*BUFFER_HANDLE requestContent,                                */
+		IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
+		NULL,                                               /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
+		NULL                                                /*BUFFER_HANDLE responseContent))                              */
+		))
 		.IgnoreArgument(1)
 		.IgnoreArgument(2)
-		.IgnoreArgument(3)
-		.SetReturn(1);
-
-	EXPECTED_CALL(mocks, IoTHubMessage_GetMessageId(IGNORED_PTR_ARG));
-	EXPECTED_CALL(mocks, IoTHubMessage_GetCorrelationId(IGNORED_PTR_ARG));
-
-	DISABLE_BATCHING();
+		.IgnoreArgument(5)
+		.IgnoreArgument(7)
+		.CopyOutArgumentBuffer(7, &statusCode204, sizeof(statusCode204));
 
 	///act
 	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
@@ -12973,8 +12034,8 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_079: [ If any HTTP header operation fails, _DoWork shall advance to the next action. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_does_nothing_when_buffer_fails_2)
+//Tests_SRS_TRANSPORTMULTITHTTP_17_091: [ The HTTP header value of iothub-messageid shall be set in the IoTHub_SetMessageId. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_GetMessageId_succeeds)
 {
 	///arrange
 	CIoTHubTransportHttpMocks mocks;
@@ -13019,26 +12080,64 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "iothub-app-" TEST_RED_KEY, TEST_RED_VALUE))
 		.IgnoreArgument(1);
 
-	whenShallBUFFER_new_fail = currentBUFFER_new_call + 1;
 	STRICT_EXPECTED_CALL(mocks, BUFFER_new());
+	STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, BUFFER_build(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2)
+		.IgnoreArgument(3);
 
-	EXPECTED_CALL(mocks, IoTHubMessage_GetMessageId(IGNORED_PTR_ARG));
+	/*executing HTTP goodies*/
+	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
+		IGNORED_PTR_ARG,
+		HTTPAPI_REQUEST_POST,                                                           /*HTTPAPI_REQUEST_TYPE requestType,                  */
+		"/devices/" TEST_DEVICE_ID EVENT_ENDPOINT API_VERSION,                 /*const char* relativePath,                          */
+		IGNORED_PTR_ARG,                                                                /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,      */
+		IGNORED_PTR_ARG,                                                                /*BUFFER_HANDLE requestContent,                      */
+		IGNORED_PTR_ARG,                                                                /*unsigned int* statusCode,                          */
+		NULL,                                                                           /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,     */
+		NULL                                                                            /*BUFFER_HANDLE responseContent)                     */
+		))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2)
+		.IgnoreArgument(5)
+		.IgnoreArgument(6)
+		.CopyOutArgumentBuffer(7, &httpStatus200, sizeof(httpStatus200));
+
+	/*once the event has been succesfull...*/
+
+	/*building the list of messages to be notified if HTTP is fine*/
+	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message6.entry)))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_SUCCESS))
+		.IgnoreArgument(2);
+
+	EXPECTED_CALL(mocks, IoTHubMessage_GetMessageId(IGNORED_PTR_ARG)).SetReturn(TEST_MESSAGE_ID);
 	EXPECTED_CALL(mocks, IoTHubMessage_GetCorrelationId(IGNORED_PTR_ARG));
 
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "iothub-messageid", TEST_MESSAGE_ID))
+		.IgnoreArgument(1);
+
 	DISABLE_BATCHING();
 
 	///act
 	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
 	///assert
+	ASSERT_ARE_EQUAL(int, 0, memcmp(BASEIMPLEMENTATION::BUFFER_u_char(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest), buffer6, buffer6_size));
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_079: [ If any HTTP header operation fails, _DoWork shall advance to the next action. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_does_nothing_when_http_headers_fail_1)
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_GetCorrelationId_succeeds)
 {
 	///arrange
 	CIoTHubTransportHttpMocks mocks;
@@ -13081,11 +12180,51 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_
 	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "iothub-app-" TEST_RED_KEY, TEST_RED_VALUE))
+		.IgnoreArgument(1);
+
+	STRICT_EXPECTED_CALL(mocks, BUFFER_new());
+	STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, BUFFER_build(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
 		.IgnoreArgument(1)
-		.SetReturn(HTTP_HEADERS_ERROR);
+		.IgnoreArgument(2)
+		.IgnoreArgument(3);
+
+	/*executing HTTP goodies*/
+	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
+		IGNORED_PTR_ARG,
+		HTTPAPI_REQUEST_POST,                                                           /*HTTPAPI_REQUEST_TYPE requestType,                  */
+		"/devices/" TEST_DEVICE_ID EVENT_ENDPOINT API_VERSION,                 /*const char* relativePath,                          */
+		IGNORED_PTR_ARG,                                                                /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,      */
+		IGNORED_PTR_ARG,                                                                /*BUFFER_HANDLE requestContent,                      */
+		IGNORED_PTR_ARG,                                                                /*unsigned int* statusCode,                          */
+		NULL,                                                                           /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,     */
+		NULL                                                                            /*BUFFER_HANDLE responseContent)                     */
+		))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2)
+		.IgnoreArgument(5)
+		.IgnoreArgument(6)
+		.CopyOutArgumentBuffer(7, &httpStatus200, sizeof(httpStatus200));
+
+	/*once the event has been succesfull...*/
+
+	/*building the list of messages to be notified if HTTP is fine*/
+	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message6.entry)))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_SUCCESS))
+		.IgnoreArgument(2);
 
 	EXPECTED_CALL(mocks, IoTHubMessage_GetMessageId(IGNORED_PTR_ARG));
-	EXPECTED_CALL(mocks, IoTHubMessage_GetCorrelationId(IGNORED_PTR_ARG));
+	EXPECTED_CALL(mocks, IoTHubMessage_GetCorrelationId(IGNORED_PTR_ARG)).SetReturn(TEST_MESSAGE_ID);
+
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "iothub-correlationid", TEST_MESSAGE_ID))
+		.IgnoreArgument(1);
 
 	DISABLE_BATCHING();
 
@@ -13093,501 +12232,303 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_
 	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
 	///assert
+	ASSERT_ARE_EQUAL(int, 0, memcmp(BASEIMPLEMENTATION::BUFFER_u_char(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest), buffer6, buffer6_size));
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_079: [ If any HTTP header operation fails, _DoWork shall advance to the next action. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_does_nothing_when_http_headers_fail_2)
+/*Tests_SRS_TRANSPORTMULTITHTTP_02_001: [ If handle is NULL then IoTHubTransportHttp_GetHostname shall fail and return NULL. ]*/
+TEST_FUNCTION(IoTHubTransportHttp_GetHostname_with_NULL_handle_fails)
 {
-	///arrange
-	CIoTHubTransportHttpMocks mocks;
-	DList_InsertTailList(&(waitingToSend), &(message6.entry));
-	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
-	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+    ///arrange
+    CIoTHubTransportHttpMocks mocks;
 
-	mocks.ResetAllCalls();
+    ///act
+    STRING_HANDLE hostname = IoTHubTransportHttp_GetHostname(NULL);
 
-	setupDoWorkLoopOnceForOneDevice(mocks);
-
-	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
-
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE_6));
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE_6, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreArgument(2)
-		.IgnoreArgument(3);
+    ///assert
+    ASSERT_IS_NULL(hostname);
+    mocks.AssertActualAndExpectedCalls();
 
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Clone(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
+    ///cleanup
+}
 
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/octet-stream"))
-		.IgnoreArgument(1);
+/*Tests_SRS_TRANSPORTMULTITHTTP_02_001: [ If handle is NULL then IoTHubTransportHttp_GetHostname shall fail and return NULL. ]*/
+TEST_FUNCTION(IoTHubTransportHttp_GetHostname_with_non_NULL_handle_succeeds)
+{
+    ///arrange
+    CIoTHubTransportHttpMocks mocks;
+    TRANSPORT_LL_HANDLE handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    mocks.ResetAllCalls();
 
-	/*no properties, so no more headers*/
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE_6));
-	STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_1_PROPERTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreArgument(2)
-		.IgnoreArgument(3)
-		.IgnoreArgument(4);
+    ///act
+    STRING_HANDLE hostname = IoTHubTransportHttp_GetHostname(handle);
 
-	/*this is making http headers*/
-	STRICT_EXPECTED_CALL(mocks, STRING_construct("iothub-app-"));
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, TEST_RED_KEY))
-		.IgnoreArgument(1)
-		.SetReturn(1111); /*unpredictable value which is an error*/
+    ///assert
+    ASSERT_IS_NOT_NULL(hostname);
+    mocks.AssertActualAndExpectedCalls();
+    ASSERT_ARE_EQUAL(char_ptr, TEST_IOTHUB_NAME "." TEST_IOTHUB_SUFFIX, STRING_c_str(hostname));
 
-	EXPECTED_CALL(mocks, IoTHubMessage_GetMessageId(IGNORED_PTR_ARG));
-	EXPECTED_CALL(mocks, IoTHubMessage_GetCorrelationId(IGNORED_PTR_ARG));
+    ///cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
 
-	DISABLE_BATCHING();
+/*Tests_SRS_TRANSPORTMULTITHTTP_02_004: [ If "ConnectionPoolSize" is 0 then IoTHubTransportHttp_SetOption shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_ConnectionPoolSize_0_fails)
+{
+	///arrange
+	CIoTHubTransportHttpMocks mocks;
+	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	unsigned int connectionPoolSize = 0;
+	mocks.ResetAllCalls();
 
 	///act
-	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+	auto result = IoTHubTransportHttp_SetOption(handle, "ConnectionPoolSize", &connectionPoolSize);
 
 	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_079: [ If any HTTP header operation fails, _DoWork shall advance to the next action. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_does_nothing_when_http_headers_fail_3)
+/*Tests_SRS_TRANSPORTMULTITHTTP_02_003: [ "ConnectionPoolSize" ]*/
+/*Tests_SRS_TRANSPORTMULTITHTTP_02_038: [ Setting "ConnectionPoolSize" to a value greater than 1 shall start one pool thread for every pooled connection but the first one. The pool threads shall stay alive until "ConnectionPoolSize" changes again or the transport is destroyed. ]*/
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_ConnectionPoolSize_3_creates_2_more_connections_succeeds)
 {
 	///arrange
 	CIoTHubTransportHttpMocks mocks;
-	DList_InsertTailList(&(waitingToSend), &(message6.entry));
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
-	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
-
+	unsigned int connectionPoolSize = 3;
 	mocks.ResetAllCalls();
 
-	setupDoWorkLoopOnceForOneDevice(mocks);
-
-	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
-
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE_6));
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE_6, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreArgument(2)
-		.IgnoreArgument(3);
-
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Clone(IGNORED_PTR_ARG))
+	STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
+	STRICT_EXPECTED_CALL(mocks, Lock_Init());
+	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
-
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/octet-stream"))
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_Create(TEST_IOTHUB_NAME "." TEST_IOTHUB_SUFFIX))
+		.SetReturn(TEST_HTTPAPIEX_HANDLE2);
+	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
-
-	/*no properties, so no more headers*/
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE_6));
-	STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_1_PROPERTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreArgument(2)
-		.IgnoreArgument(3)
-		.IgnoreArgument(4);
-
-	/*this is making http headers*/
-	whenShallSTRING_construct_fail = currentSTRING_construct_call + 1;
-	STRICT_EXPECTED_CALL(mocks, STRING_construct("iothub-app-"));
-
-	EXPECTED_CALL(mocks, IoTHubMessage_GetMessageId(IGNORED_PTR_ARG));
-	EXPECTED_CALL(mocks, IoTHubMessage_GetCorrelationId(IGNORED_PTR_ARG));
-
-	DISABLE_BATCHING();
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_Create(TEST_IOTHUB_NAME "." TEST_IOTHUB_SUFFIX))
+		.SetReturn(TEST_HTTPAPIEX_HANDLE3);
+	STRICT_EXPECTED_CALL(mocks, gballoc_free(NULL));
+	STRICT_EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments();
+	STRICT_EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments();
 
 	///act
-	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+	auto result = IoTHubTransportHttp_SetOption(handle, "ConnectionPoolSize", &connectionPoolSize);
 
 	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_079: [ If any HTTP header operation fails, _DoWork shall advance to the next action. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_does_nothing_when_map_fails)
+/*Tests_SRS_TRANSPORTMULTITHTTP_02_038: [ Setting "ConnectionPoolSize" to a value greater than 1 shall start one pool thread for every pooled connection but the first one. The pool threads shall stay alive until "ConnectionPoolSize" changes again or the transport is destroyed. ]*/
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_ConnectionPoolSize_2_then_3_restarts_the_pool_threads)
 {
 	///arrange
 	CIoTHubTransportHttpMocks mocks;
-	DList_InsertTailList(&(waitingToSend), &(message6.entry));
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
-	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
-
+	unsigned int connectionPoolSize = 2;
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_Create(TEST_IOTHUB_NAME "." TEST_IOTHUB_SUFFIX))
+		.SetReturn(TEST_HTTPAPIEX_HANDLE2);
+	(void)IoTHubTransportHttp_SetOption(handle, "ConnectionPoolSize", &connectionPoolSize);
+	connectionPoolSize = 3;
 	mocks.ResetAllCalls();
 
-	setupDoWorkLoopOnceForOneDevice(mocks);
-
-	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
-
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE_6));
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE_6, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreArgument(2)
-		.IgnoreArgument(3);
-
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Clone(IGNORED_PTR_ARG))
+	STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
+	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
-
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/octet-stream"))
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_Create(TEST_IOTHUB_NAME "." TEST_IOTHUB_SUFFIX))
+		.SetReturn(TEST_HTTPAPIEX_HANDLE3);
+	STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, ThreadAPI_Join(TEST_THREAD_HANDLE, IGNORED_PTR_ARG))
+		.IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
-
-	/*no properties, so no more headers*/
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE_6));
-	STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_1_PROPERTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreArgument(2)
-		.IgnoreArgument(3)
-		.IgnoreArgument(4)
-		.SetReturn(MAP_ERROR);
-
-	DISABLE_BATCHING();
+	STRICT_EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments();
+	STRICT_EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments();
 
 	///act
-	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+	auto result = IoTHubTransportHttp_SetOption(handle, "ConnectionPoolSize", &connectionPoolSize);
 
 	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_079: [ If any HTTP header operation fails, _DoWork shall advance to the next action. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_does_nothing_when_http_fails_4)
+/*Tests_SRS_TRANSPORTMULTITHTTP_02_005: [ If any resource needed by "ConnectionPoolSize" cannot be created then IoTHubTransportHttp_SetOption shall fail, return IOTHUB_CLIENT_ERROR and leave the existing connections untouched. ]*/
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_ConnectionPoolSize_fails_when_HTTPAPIEX_Create_fails)
 {
 	///arrange
 	CIoTHubTransportHttpMocks mocks;
-	DList_InsertTailList(&(waitingToSend), &(message6.entry));
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
-	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
-
+	unsigned int connectionPoolSize = 3;
 	mocks.ResetAllCalls();
 
-	setupDoWorkLoopOnceForOneDevice(mocks);
-
-	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
-
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE_6));
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE_6, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreArgument(2)
-		.IgnoreArgument(3);
-
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Clone(IGNORED_PTR_ARG))
+	STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
+	STRICT_EXPECTED_CALL(mocks, Lock_Init());
+	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_Create(TEST_IOTHUB_NAME "." TEST_IOTHUB_SUFFIX))
+		.SetReturn(TEST_HTTPAPIEX_HANDLE2);
+	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_Create(TEST_IOTHUB_NAME "." TEST_IOTHUB_SUFFIX))
+		.SetReturn((HTTPAPIEX_HANDLE)NULL);
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_Destroy(TEST_HTTPAPIEX_HANDLE2));
+	STRICT_EXPECTED_CALL(mocks, Lock_Deinit(TEST_LOCK_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
-
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/octet-stream"))
-		.IgnoreArgument(1)
-		.SetReturn(HTTP_HEADERS_ERROR);
-
-	DISABLE_BATCHING();
 
 	///act
-	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+	auto result = IoTHubTransportHttp_SetOption(handle, "ConnectionPoolSize", &connectionPoolSize);
 
 	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_079: [ If any HTTP header operation fails, _DoWork shall advance to the next action. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_does_nothing_when_http_fails_5)
+/*Tests_SRS_TRANSPORTMULTITHTTP_02_010: [ Options passed down to HTTPAPIEX_SetOption shall also be passed to every pooled connection, stopping at the first failure. ]*/
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_is_passed_to_every_pooled_connection)
 {
 	///arrange
 	CIoTHubTransportHttpMocks mocks;
-	DList_InsertTailList(&(waitingToSend), &(message6.entry));
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
-	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
-
+	unsigned int connectionPoolSize = 2;
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_Create(TEST_IOTHUB_NAME "." TEST_IOTHUB_SUFFIX))
+		.SetReturn(TEST_HTTPAPIEX_HANDLE2);
+	(void)IoTHubTransportHttp_SetOption(handle, "ConnectionPoolSize", &connectionPoolSize);
 	mocks.ResetAllCalls();
 
-	setupDoWorkLoopOnceForOneDevice(mocks);
-
-	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
-
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE_6));
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE_6, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreArgument(2)
-		.IgnoreArgument(3);
-
-	whenShallHTTPHeaders_Clone_fail = currentHTTPHeaders_Clone_call + 1;
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Clone(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-
-	DISABLE_BATCHING();
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SetOption(TEST_HTTPAPIEX_HANDLE, "someOption", (void*)42));
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SetOption(TEST_HTTPAPIEX_HANDLE2, "someOption", (void*)42));
 
 	///act
-	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+	auto result = IoTHubTransportHttp_SetOption(handle, "someOption", (void*)42);
 
 	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_079: [ If any HTTP header operation fails, _DoWork shall advance to the next action. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_does_nothing_when_IoTHubMessage_GetByteArray_fails)
+/*Tests_SRS_TRANSPORTMULTITHTTP_17_013: [ Otherwise, IoTHubTransportHttp_Destroy shall free all the resources currently in use. ]*/
+/*Tests_SRS_TRANSPORTMULTITHTTP_02_038: [ Setting "ConnectionPoolSize" to a value greater than 1 shall start one pool thread for every pooled connection but the first one. The pool threads shall stay alive until "ConnectionPoolSize" changes again or the transport is destroyed. ]*/
+TEST_FUNCTION(IoTHubTransportHttp_Destroy_stops_the_pool_threads_and_frees_the_connection_pool)
 {
 	///arrange
-	CIoTHubTransportHttpMocks mocks;
-	DList_InsertTailList(&(waitingToSend), &(message6.entry));
+	CNiceCallComparer<CIoTHubTransportHttpMocks> mocks;
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
-	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
-
+	unsigned int connectionPoolSize = 2;
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_Create(TEST_IOTHUB_NAME "." TEST_IOTHUB_SUFFIX))
+		.SetReturn(TEST_HTTPAPIEX_HANDLE2);
+	(void)IoTHubTransportHttp_SetOption(handle, "ConnectionPoolSize", &connectionPoolSize);
 	mocks.ResetAllCalls();
 
-	setupDoWorkLoopOnceForOneDevice(mocks);
-
-	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
-
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE_6));
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE_6, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreArgument(2)
-		.IgnoreArgument(3)
-		.SetReturn(IOTHUB_MESSAGE_ERROR);
-
-	DISABLE_BATCHING();
+	STRICT_EXPECTED_CALL(mocks, ThreadAPI_Join(TEST_THREAD_HANDLE, IGNORED_PTR_ARG))
+		.IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_Destroy(TEST_HTTPAPIEX_HANDLE2));
+	STRICT_EXPECTED_CALL(mocks, Lock_Deinit(TEST_LOCK_HANDLE));
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_Destroy(TEST_HTTPAPIEX_HANDLE));
 
 	///act
-	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+	IoTHubTransportHttp_Destroy(handle);
 
 	///assert
 	mocks.AssertActualAndExpectedCalls();
-
-	///cleanup
-	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_075: [ If the oldest message in waitingToSend causes the message to exceed the message size limit then it shall be removed from waitingToSend, and IoTHubClient_LL_SendComplete shall be called. Parameter PDLIST_ENTRY completed shall point to a list containing only the oldest item, and parameter IOTHUB_BATCHSTATE result shall be set to IOTHUB_BATCHSTATE_FAILED. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_1_property_unbatched_overlimit_calls_SendComplete_with_BATCHSTATE_FAILED)
+/*Tests_SRS_TRANSPORTMULTITHTTP_02_039: [ An idle pool thread shall sleep between its checks for a DoWork waiting for workers, doubling the sleep (starting at 1 ms) every time it finds none, up to 64 ms. A pool thread that finds such a DoWork shall join it as one of its min(busy devices, "ConnectionPoolSize") workers and shall restart its sleep at 1 ms afterwards. ]*/
+TEST_FUNCTION(IoTHubTransportHttp_idle_pool_thread_backs_off_up_to_64_ms)
 {
 	///arrange
-	CIoTHubTransportHttpMocks mocks;
-	DList_InsertTailList(&(waitingToSend), &(message9.entry));
+	CNiceCallComparer<CIoTHubTransportHttpMocks> mocks;
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
-	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
-
+	unsigned int connectionPoolSize = 2;
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_Create(TEST_IOTHUB_NAME "." TEST_IOTHUB_SUFFIX))
+		.SetReturn(TEST_HTTPAPIEX_HANDLE2);
+	(void)IoTHubTransportHttp_SetOption(handle, "ConnectionPoolSize", &connectionPoolSize);
+	ASSERT_IS_NOT_NULL((void*)lastPoolThreadFunc);
 	mocks.ResetAllCalls();
+	currentLock_call = 0;
+	whenShallLock_fail = 10; /*1 Lock when the thread starts + 1 after each of the 9 sleeps, the 10th ends the thread*/
 
-	setupDoWorkLoopOnceForOneDevice(mocks);
-
-
-	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
-
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE_9));
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE_9, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreArgument(2)
-		.IgnoreArgument(3);
-
-	/*ooops - over 256K*/
-
-	/*building the list of messages to be notified if HTTP is fine*/
-	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message9.entry)))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_FAILED))
-		.IgnoreArgument(2);
-
-	DISABLE_BATCHING();
+	STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(1));
+	STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(2));
+	STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(4));
+	STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(8));
+	STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(16));
+	STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(32));
+	STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(64))
+		.ExpectedTimesExactly(3);
 
 	///act
-	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+	(void)lastPoolThreadFunc(lastPoolThreadArg); /*no DoWork is waiting for workers*/
 
 	///assert
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
+	whenShallLock_fail = 0;
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_057: [ If a messages to be send has type IOTHUBMESSAGE_STRING, then its serialization shall be {"body":"JSON encoding of the string", "base64Encoded":false} ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_as_string_happy_path_succeeds)
+/*Tests_SRS_TRANSPORTMULTITHTTP_02_006: [ If "ConnectionPoolSize" is greater than 1 and more than 1 device has an event to send or is allowed to poll for messages, then IoTHubTransportHttp_DoWork shall service the devices from min(busy devices, "ConnectionPoolSize") workers, each one using its own pooled connection, and shall wait for all the workers to finish before returning. The thread calling IoTHubTransportHttp_DoWork is one of the workers, the others are pool threads. ]*/
+/*Tests_SRS_TRANSPORTMULTITHTTP_02_007: [ Every worker shall hold the transport's upper layer lock at all times except while executing an HTTP request, so that calls into the upper layer (including the completion and message callbacks) are serialized. ]*/
+/*Tests_SRS_TRANSPORTMULTITHTTP_02_008: [ Each worker shall take the next device not yet serviced in this DoWork and perform both the "SendEvent" and "ExecuteMessage" actions for it, so that the order of the actions for a device is preserved. ]*/
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_ConnectionPoolSize_2_and_2_busy_devices_does_not_create_threads)
 {
 	///arrange
-	CIoTHubTransportHttpMocks mocks;
+	CNiceCallComparer<CIoTHubTransportHttpMocks> mocks;
 	DList_InsertTailList(&(waitingToSend), &(message10.entry));
+	DList_InsertTailList(&(waitingToSend2), &(message6.entry));
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
-	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
-
-	mocks.ResetAllCalls();
-
-	setupDoWorkLoopOnceForOneDevice(mocks);
-
-	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
-
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
-		.IgnoreArgument(1);
-
-	/*starting to prepare the "big" payload*/
-	STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-
-	/*this is first batched payload*/
-	{
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message10.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":"));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetString(message10.messageHandle));
-
-		STRICT_EXPECTED_CALL(mocks, STRING_new_JSON(string10));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
-
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, ",\"base64Encoded\":false")) /*closing the value of the body*/
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message10.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3)
-			.IgnoreArgument(4);
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "},")) /* this extra "," is going to be harshly overwritten by a "]"*/
-			.IgnoreArgument(1);
-		/*end of the first batched payload*/
-	}
-
-	{
-		/*adding the first payload to the "big" payload*/
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
-
-		/*closing the "big" payload*/
-		STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, STRING_length(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-	}
-
-	/*building the list of messages to be notified if HTTP is fine*/
-	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message10.entry)))
-		.IgnoreArgument(1);
-
-	{
-		/*this is building the HTTP payload... from a STRING_HANDLE (as it comes as "big payload"), into an array of bytes*/
-		STRICT_EXPECTED_CALL(mocks, BUFFER_new());
-		STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-
-		STRICT_EXPECTED_CALL(mocks, STRING_length(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, BUFFER_build(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2)
-			.IgnoreArgument(3);
-	}
-
-	/*executing HTTP goodies*/
-	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
-		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
-		IGNORED_PTR_ARG,
-		HTTPAPI_REQUEST_POST,                                                           /*HTTPAPI_REQUEST_TYPE requestType,                  */
-		"/devices/" TEST_DEVICE_ID EVENT_ENDPOINT API_VERSION,                 /*const char* relativePath,                          */
-		IGNORED_PTR_ARG,                                                                /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,      */
-		IGNORED_PTR_ARG,                                                                /*BUFFER_HANDLE requestContent,                      */
-		IGNORED_PTR_ARG,                                                                /*unsigned int* statusCode,                          */
-		NULL,                                                                           /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,     */
-		NULL                                                                            /*BUFFER_HANDLE responseContent)                     */
-		))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2)
-		.IgnoreArgument(5)
-		.IgnoreArgument(6)
-		.CopyOutArgumentBuffer(7, &httpStatus200, sizeof(httpStatus200));
-
-	/*once the event has been succesfull...*/
+	auto devHandle1 = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+	auto devHandle2 = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_2, TEST_IOTHUB_CLIENT_LL_HANDLE2, TEST_CONFIG2.waitingToSend);
+	unsigned int connectionPoolSize = 2;
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_Create(TEST_IOTHUB_NAME "." TEST_IOTHUB_SUFFIX))
+		.SetReturn(TEST_HTTPAPIEX_HANDLE2);
+	(void)IoTHubTransportHttp_SetOption(handle, "ConnectionPoolSize", &connectionPoolSize);
+	mocks.ResetAllCalls();
 
+	STRICT_EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments()
+		.NeverInvoked();
+	STRICT_EXPECTED_CALL(mocks, ThreadAPI_Join(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments()
+		.NeverInvoked();
+	STRICT_EXPECTED_CALL(mocks, Lock(TEST_LOCK_HANDLE))
+		.ExpectedTimesExactly(3); /*1 for the DoWork + 1 after each HTTP request. The pool threads never run in these tests, so the calling thread services both devices*/
+	STRICT_EXPECTED_CALL(mocks, Unlock(TEST_LOCK_HANDLE))
+		.ExpectedTimesExactly(3);
 	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_SUCCESS))
 		.IgnoreArgument(2);
-
-	ENABLE_BATCHING();
-
-	///act
-	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
-
-	///assert
-	mocks.AssertActualAndExpectedCalls();
-
-	///cleanup
-	IoTHubTransportHttp_Destroy(handle);
-}
-
-//Tests_SRS_TRANSPORTMULTITHTTP_17_057: [ If a messages to be send has type IOTHUBMESSAGE_STRING, then its serialization shall be {"body":"JSON encoding of the string", "base64Encoded":false} ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_as_string_when_string_concat_fails_it_fails)
-{
-	///arrange
-	CIoTHubTransportHttpMocks mocks;
-	DList_InsertTailList(&(waitingToSend), &(message10.entry));
-	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
-	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
-
-	mocks.ResetAllCalls();
-
-	setupDoWorkLoopOnceForOneDevice(mocks);
-
-	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
-
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
-		.IgnoreArgument(1);
-
-	/*starting to prepare the "big" payload*/
-	STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-
-	/*this is first batched payload*/
-	{
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message10.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":"));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetString(message10.messageHandle));
-
-		STRICT_EXPECTED_CALL(mocks, STRING_new_JSON(string10));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
-
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, ",\"base64Encoded\":false")) /*closing the value of the body*/
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message10.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3)
-			.IgnoreArgument(4);
-		whenShallSTRING_concat_fail = currentSTRING_concat_call + 2;
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "},")) /* this extra "," is going to be harshly overwritten by a "]"*/
-			.IgnoreArgument(1);
-		/*end of the first batched payload*/
-	}
-
-	ENABLE_BATCHING();
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE2, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_SUCCESS))
+		.IgnoreArgument(2);
 
 	///act
 	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
@@ -13596,60 +12537,34 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_as_string_when_string
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
+	IoTHubTransportHttp_Unregister(devHandle1);
+	IoTHubTransportHttp_Unregister(devHandle2);
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_057: [ If a messages to be send has type IOTHUBMESSAGE_STRING, then its serialization shall be {"body":"JSON encoding of the string", "base64Encoded":false} ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_as_string_when_Map_GetInternals_fails_it_fails)
+/*Tests_SRS_TRANSPORTMULTITHTTP_02_006: [ If "ConnectionPoolSize" is greater than 1 and more than 1 device has an event to send or is allowed to poll for messages, then IoTHubTransportHttp_DoWork shall service the devices from min(busy devices, "ConnectionPoolSize") workers, each one using its own pooled connection, and shall wait for all the workers to finish before returning. The thread calling IoTHubTransportHttp_DoWork is one of the workers, the others are pool threads. ]*/
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_ConnectionPoolSize_2_and_1_busy_device_does_not_start_workers)
 {
 	///arrange
-	CIoTHubTransportHttpMocks mocks;
-	DList_InsertTailList(&(waitingToSend), &(message10.entry));
+	CNiceCallComparer<CIoTHubTransportHttpMocks> mocks;
+	DList_InsertTailList(&(waitingToSend2), &(message6.entry));
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
-	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
-
+	auto devHandle1 = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+	auto devHandle2 = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_2, TEST_IOTHUB_CLIENT_LL_HANDLE2, TEST_CONFIG2.waitingToSend);
+	unsigned int connectionPoolSize = 2;
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_Create(TEST_IOTHUB_NAME "." TEST_IOTHUB_SUFFIX))
+		.SetReturn(TEST_HTTPAPIEX_HANDLE2);
+	(void)IoTHubTransportHttp_SetOption(handle, "ConnectionPoolSize", &connectionPoolSize);
 	mocks.ResetAllCalls();
 
-	setupDoWorkLoopOnceForOneDevice(mocks);
-
-	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
-
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
-		.IgnoreArgument(1);
-
-	/*starting to prepare the "big" payload*/
-	STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-
-	/*this is first batched payload*/
-	{
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message10.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":"));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetString(message10.messageHandle));
-
-		STRICT_EXPECTED_CALL(mocks, STRING_new_JSON(string10));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
-
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, ",\"base64Encoded\":false")) /*closing the value of the body*/
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(message10.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(2)
-			.IgnoreArgument(3)
-			.IgnoreArgument(4)
-			.SetReturn(MAP_ERROR);
-		/*end of the first batched payload*/
-	}
-
-	ENABLE_BATCHING();
+	STRICT_EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments()
+		.NeverInvoked();
+	STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.NeverInvoked();
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE2, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_SUCCESS))
+		.IgnoreArgument(2);
 
 	///act
 	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
@@ -13658,288 +12573,64 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_as_string_when_Map_Ge
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
+	IoTHubTransportHttp_Unregister(devHandle1);
+	IoTHubTransportHttp_Unregister(devHandle2);
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_057: [ If a messages to be send has type IOTHUBMESSAGE_STRING, then its serialization shall be {"body":"JSON encoding of the string", "base64Encoded":false} ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_as_string_when_STRING_concat_fails_it_fails_2)
+/*Tests_SRS_TRANSPORTMULTITHTTP_02_014: [ "MaximumMessagesPerDoWork" ]*/
+/*Tests_SRS_TRANSPORTMULTITHTTP_02_015: [ If "MaximumMessagesPerDoWork" is 0 then IoTHubTransportHttp_SetOption shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_MaximumMessagesPerDoWork_0_fails)
 {
 	///arrange
 	CIoTHubTransportHttpMocks mocks;
-	DList_InsertTailList(&(waitingToSend), &(message10.entry));
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
-	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
-
+	unsigned int maximumMessagesPerDoWork = 0;
 	mocks.ResetAllCalls();
 
-	setupDoWorkLoopOnceForOneDevice(mocks);
-
-	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
-
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
-		.IgnoreArgument(1);
-
-	/*starting to prepare the "big" payload*/
-	STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-
-	/*this is first batched payload*/
-	{
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message10.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":"));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetString(message10.messageHandle));
-
-		STRICT_EXPECTED_CALL(mocks, STRING_new_JSON(string10));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
-
-		whenShallSTRING_concat_fail = currentSTRING_concat_call + 1;
-		STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, ",\"base64Encoded\":false")) /*closing the value of the body*/
-			.IgnoreArgument(1);
-		/*end of the first batched payload*/
-	}
-
-	ENABLE_BATCHING();
-
 	///act
-	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+	auto result = IoTHubTransportHttp_SetOption(handle, "MaximumMessagesPerDoWork", &maximumMessagesPerDoWork);
 
 	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_057: [ If a messages to be send has type IOTHUBMESSAGE_STRING, then its serialization shall be {"body":"JSON encoding of the string", "base64Encoded":false} ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_as_string_when_STRING_concat_with_STRING_fails_it_fails)
+/*Tests_SRS_TRANSPORTMULTITHTTP_02_014: [ "MaximumMessagesPerDoWork" ]*/
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_MaximumMessagesPerDoWork_succeeds)
 {
 	///arrange
 	CIoTHubTransportHttpMocks mocks;
-	DList_InsertTailList(&(waitingToSend), &(message10.entry));
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
-	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
-
+	unsigned int maximumMessagesPerDoWork = 10;
 	mocks.ResetAllCalls();
 
-	setupDoWorkLoopOnceForOneDevice(mocks);
-
-	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
-
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
-		.IgnoreArgument(1);
-
-	/*starting to prepare the "big" payload*/
-	STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-
-	/*this is first batched payload*/
-	{
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message10.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":"));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetString(message10.messageHandle));
-
-		STRICT_EXPECTED_CALL(mocks, STRING_new_JSON(string10));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-
-		whenShallSTRING_concat_with_STRING_fail = currentSTRING_concat_with_STRING_call + 1;
-		STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(2);
-		/*end of the first batched payload*/
-	}
-
-	ENABLE_BATCHING();
-
 	///act
-	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+	auto result = IoTHubTransportHttp_SetOption(handle, "MaximumMessagesPerDoWork", &maximumMessagesPerDoWork);
 
 	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_057: [ If a messages to be send has type IOTHUBMESSAGE_STRING, then its serialization shall be {"body":"JSON encoding of the string", "base64Encoded":false} ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_as_string_when_STRING_new_JSON_fails_it_fails)
+/*Tests_SRS_TRANSPORTMULTITHTTP_02_016: [ By default "MaximumMessagesPerDoWork" shall be 1. ]*/
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_by_default_gets_only_1_message)
 {
 	///arrange
-	CIoTHubTransportHttpMocks mocks;
-	DList_InsertTailList(&(waitingToSend), &(message10.entry));
+	CNiceCallComparer<CIoTHubTransportHttpMocks> mocks;
+	unsigned int statusCode200 = 200;
+	unsigned int statusCode204 = 204;
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
 	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
-
+	(void)IoTHubTransportHttp_Subscribe(devHandle);
 	mocks.ResetAllCalls();
 
-	setupDoWorkLoopOnceForOneDevice(mocks);
-
-	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
-
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
-		.IgnoreArgument(1);
-
-	/*starting to prepare the "big" payload*/
-	STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-
-	/*this is first batched payload*/
-	{
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message10.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":"));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetString(message10.messageHandle));
-
-		whenShallSTRING_new_JSON_fail = currentSTRING_new_JSON_call + 1;
-		STRICT_EXPECTED_CALL(mocks, STRING_new_JSON(string10));
-
-		/*end of the first batched payload*/
-	}
-
-	ENABLE_BATCHING();
-
-	///act
-	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
-
-	///assert
-	mocks.AssertActualAndExpectedCalls();
-
-	///cleanup
-	IoTHubTransportHttp_Destroy(handle);
-}
-
-//Tests_SRS_TRANSPORTMULTITHTTP_17_057: [ If a messages to be send has type IOTHUBMESSAGE_STRING, then its serialization shall be {"body":"JSON encoding of the string", "base64Encoded":false} ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_as_string_when_IoTHubMessage_GetString_it_fails)
-{
-	///arrange
-	CIoTHubTransportHttpMocks mocks;
-	DList_InsertTailList(&(waitingToSend), &(message10.entry));
-	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
-	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
-
-	mocks.ResetAllCalls();
-
-	setupDoWorkLoopOnceForOneDevice(mocks);
-
-	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
-
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
-		.IgnoreArgument(1);
-
-	/*starting to prepare the "big" payload*/
-	STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-
-	/*this is first batched payload*/
-	{
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message10.messageHandle));
-		STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":"));
-		STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetString(message10.messageHandle))
-			.SetReturn((const char*)NULL);
-
-		/*end of the first batched payload*/
-	}
-
-	ENABLE_BATCHING();
-
-	///act
-	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
-
-	///assert
-	mocks.AssertActualAndExpectedCalls();
-
-	///cleanup
-	IoTHubTransportHttp_Destroy(handle);
-}
-
-//Tests_SRS_TRANSPORTMULTITHTTP_17_057: [ If a messages to be send has type IOTHUBMESSAGE_STRING, then its serialization shall be {"body":"JSON encoding of the string", "base64Encoded":false} ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_as_string_when_STRING_construct_it_fails)
-{
-	///arrange
-	CIoTHubTransportHttpMocks mocks;
-	DList_InsertTailList(&(waitingToSend), &(message10.entry));
-	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
-	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
-
-	mocks.ResetAllCalls();
-
-	setupDoWorkLoopOnceForOneDevice(mocks);
-
-	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
-
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"))
-		.IgnoreArgument(1);
-
-	/*starting to prepare the "big" payload*/
-	STRICT_EXPECTED_CALL(mocks, STRING_construct("["));
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-
-	/*this is first batched payload*/
-	{
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(message10.messageHandle));
-		whenShallSTRING_construct_fail = currentSTRING_construct_call + 2;
-		STRICT_EXPECTED_CALL(mocks, STRING_construct("{\"body\":"));
-
-		/*end of the first batched payload*/
-	}
-
-	ENABLE_BATCHING();
-
-	///act
-	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
-
-	///assert
-	mocks.AssertActualAndExpectedCalls();
-
-	///cleanup
-	IoTHubTransportHttp_Destroy(handle);
-}
-
-//Tests_SRS_TRANSPORTMULTITHTTP_17_091: [ The HTTP header value of iothub-messageid shall be set in the IoTHub_SetMessageId. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_SetMessageId_SUCCEED)
-{
-	///arrange
-	CIoTHubTransportHttpMocks mocks;
-	size_t nHeaders = 4;
-	unsigned int statusCode200 = 200;
-	unsigned int statusCode204 = 204;
-	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
-	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
-
-	(void)IoTHubTransportHttp_Subscribe(devHandle);
-	mocks.ResetAllCalls();
-	setupDoWorkLoopOnceForOneDevice(mocks);
-
-	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
-
-	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-
-	STRICT_EXPECTED_CALL(mocks, BUFFER_new());
-	STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-
-	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-		.IgnoreArgument(1); /*because relativePath is a STRING_HANDLE*/
 	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
 		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
 		IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
@@ -13958,96 +12649,15 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_SetMessageId_SUCCEED)
 		.IgnoreArgument(8)
 		.IgnoreArgument(9)
 		.CopyOutArgumentBuffer(7, &statusCode200, sizeof(statusCode200));
-
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_FindHeaderValue(IGNORED_PTR_ARG, "ETag"))
 		.IgnoreArgument(1)
 		.SetReturn(TEST_ETAG_VALUE);
-
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2)
-		.SetReturn(TEST_IOTHUB_MESSAGE_HANDLE_8);
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, BUFFER_u_char(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, BUFFER_length(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	{
-		/*this scope is for is properties code*/
-
-		HTTPHeaders_GetHeaderCount_writes_to_its_outputs = false;
-		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeaderCount(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.CopyOutArgumentBuffer(2, &nHeaders, sizeof(nHeaders));
-
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE_8));
-
-		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeader(IGNORED_PTR_ARG, 0, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(3);
-		STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(TEST_MAP_3_PROPERTY, "NAME1", "VALUE1"));
-
-		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeader(IGNORED_PTR_ARG, 1, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(3);
-		STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-
-		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeader(IGNORED_PTR_ARG, 2, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(3);
-		STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(TEST_MAP_3_PROPERTY, "NAME2", "VALUE2"));
-
-		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeader(IGNORED_PTR_ARG, 3, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(3);
-		STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_SetMessageId(IGNORED_PTR_ARG, "VALUE3"))
-			.IgnoreArgument(1);
-	}
-
-	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_MessageCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2);
-
-	/*this returns "0" so the message needs to be "accepted"*/
-	/*this is "accepting"*/
-	STRICT_EXPECTED_CALL(mocks, STRING_clone(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_construct_n(TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1))
-		.ValidateArgumentBuffer(1, TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1);
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreArgument(1)
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_MessageCallback(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG))
 		.IgnoreArgument(2);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, API_VERSION))
-		.IgnoreArgument(1);
-
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc());
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "User-Agent", CLIENT_DEVICE_TYPE_PREFIX CLIENT_DEVICE_BACKSLASH IOTHUB_SDK_VERSION))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "Authorization", TEST_BLANK_SAS_TOKEN))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "If-Match", TEST_ETAG_VALUE))
-		.IgnoreArgument(1);
-
-	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-		.IgnoreArgument(1); /*because abandon relativePath is a STRING_HANDLE*/
 	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
 		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
 		IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
-		HTTPAPI_REQUEST_DELETE,                                /*HTTPAPI_REQUEST_TYPE requestType,                            */
+		HTTPAPI_REQUEST_DELETE,                             /*HTTPAPI_REQUEST_TYPE requestType,                            */
 		"/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP_ETAG TEST_ETAG_VALUE_UNQUOTED API_VERSION,    /*const char* relativePath,                                    */
 		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
 		NULL,                                               /*BUFFER_HANDLE requestContent,                                */
@@ -14060,6 +12670,24 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_SetMessageId_SUCCEED)
 		.IgnoreArgument(5)
 		.IgnoreArgument(7)
 		.CopyOutArgumentBuffer(7, &statusCode204, sizeof(statusCode204));
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
+		IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
+		HTTPAPI_REQUEST_GET,                                /*HTTPAPI_REQUEST_TYPE requestType,                            */
+		"/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP API_VERSION,    /*const char* relativePath,                                    */
+		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
+		NULL,                                               /*BUFFER_HANDLE requestContent,                                */
+		IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
+		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
+		IGNORED_PTR_ARG                                     /*BUFFER_HANDLE responseContent))                              */
+		))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2)
+		.IgnoreArgument(5)
+		.IgnoreArgument(7)
+		.IgnoreArgument(8)
+		.IgnoreArgument(9)
+		.NeverInvoked();
 
 	///act
 	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
@@ -14071,34 +12699,21 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_SetMessageId_SUCCEED)
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_091: [ The HTTP header value of iothub-messageid shall be set in the IoTHub_SetMessageId. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_SetMessageId_FAILED)
+/*Tests_SRS_TRANSPORTMULTITHTTP_02_017: [ After a message has been received and accepted or rejected, _DoWork shall immediately issue another GET for the same device (regardless of GetMinimumPollingTime) until "MaximumMessagesPerDoWork" messages have been received in this call. ]*/
+/*Tests_SRS_TRANSPORTMULTITHTTP_02_018: [ _DoWork shall stop issuing GETs for the device as soon as a GET does not produce a message (status code 204, any other status code, or any failure). ]*/
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_MaximumMessagesPerDoWork_3_drains_until_204)
 {
 	///arrange
-	CIoTHubTransportHttpMocks mocks;
-	size_t nHeaders = 4;
+	CNiceCallComparer<CIoTHubTransportHttpMocks> mocks;
 	unsigned int statusCode200 = 200;
 	unsigned int statusCode204 = 204;
+	unsigned int maximumMessagesPerDoWork = 3;
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
 	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
-
 	(void)IoTHubTransportHttp_Subscribe(devHandle);
+	(void)IoTHubTransportHttp_SetOption(handle, "MaximumMessagesPerDoWork", &maximumMessagesPerDoWork);
 	mocks.ResetAllCalls();
-	setupDoWorkLoopOnceForOneDevice(mocks);
-
-	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
-
-	STRICT_EXPECTED_CALL(mocks, get_time(NULL));
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc()); /*because responseHeadearsHandle: a new instance of HTTP headers*/
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-
-	STRICT_EXPECTED_CALL(mocks, BUFFER_new());
-	STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
 
-	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-		.IgnoreArgument(1); /*because relativePath is a STRING_HANDLE*/
 	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
 		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
 		IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
@@ -14117,104 +12732,830 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_SetMessageId_FAILED)
 		.IgnoreArgument(8)
 		.IgnoreArgument(9)
 		.CopyOutArgumentBuffer(7, &statusCode200, sizeof(statusCode200));
-
 	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_FindHeaderValue(IGNORED_PTR_ARG, "ETag"))
 		.IgnoreArgument(1)
 		.SetReturn(TEST_ETAG_VALUE);
-
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
+		IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
+		HTTPAPI_REQUEST_DELETE,                             /*HTTPAPI_REQUEST_TYPE requestType,                            */
+		"/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP_ETAG TEST_ETAG_VALUE_UNQUOTED API_VERSION,    /*const char* relativePath,                                    */
+		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
+		NULL,                                               /*BUFFER_HANDLE requestContent,                                */
+		IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
+		NULL,                                               /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
+		NULL                                                /*BUFFER_HANDLE responseContent))                              */
+		))
 		.IgnoreArgument(1)
 		.IgnoreArgument(2)
-		.SetReturn(TEST_IOTHUB_MESSAGE_HANDLE_8);
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Destroy(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, BUFFER_u_char(IGNORED_PTR_ARG))
+		.IgnoreArgument(5)
+		.IgnoreArgument(7)
+		.CopyOutArgumentBuffer(7, &statusCode204, sizeof(statusCode204));
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
+		IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
+		HTTPAPI_REQUEST_GET,                                /*HTTPAPI_REQUEST_TYPE requestType,                            */
+		"/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP API_VERSION,    /*const char* relativePath,                                    */
+		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
+		NULL,                                               /*BUFFER_HANDLE requestContent,                                */
+		IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
+		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
+		IGNORED_PTR_ARG                                     /*BUFFER_HANDLE responseContent))                              */
+		))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2)
+		.IgnoreArgument(5)
+		.IgnoreArgument(7)
+		.IgnoreArgument(8)
+		.IgnoreArgument(9)
+		.CopyOutArgumentBuffer(7, &statusCode200, sizeof(statusCode200));
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_FindHeaderValue(IGNORED_PTR_ARG, "ETag"))
+		.IgnoreArgument(1)
+		.SetReturn(TEST_ETAG_VALUE);
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
+		IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
+		HTTPAPI_REQUEST_DELETE,                             /*HTTPAPI_REQUEST_TYPE requestType,                            */
+		"/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP_ETAG TEST_ETAG_VALUE_UNQUOTED API_VERSION,    /*const char* relativePath,                                    */
+		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
+		NULL,                                               /*BUFFER_HANDLE requestContent,                                */
+		IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
+		NULL,                                               /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
+		NULL                                                /*BUFFER_HANDLE responseContent))                              */
+		))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2)
+		.IgnoreArgument(5)
+		.IgnoreArgument(7)
+		.CopyOutArgumentBuffer(7, &statusCode204, sizeof(statusCode204));
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
+		IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
+		HTTPAPI_REQUEST_GET,                                /*HTTPAPI_REQUEST_TYPE requestType,                            */
+		"/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP API_VERSION,    /*const char* relativePath,                                    */
+		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
+		NULL,                                               /*BUFFER_HANDLE requestContent,                                */
+		IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
+		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
+		IGNORED_PTR_ARG                                     /*BUFFER_HANDLE responseContent))                              */
+		))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2)
+		.IgnoreArgument(5)
+		.IgnoreArgument(7)
+		.IgnoreArgument(8)
+		.IgnoreArgument(9)
+		.CopyOutArgumentBuffer(7, &statusCode204, sizeof(statusCode204));
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_MessageCallback(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.ExpectedTimesExactly(2);
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
+		IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
+		HTTPAPI_REQUEST_GET,                                /*HTTPAPI_REQUEST_TYPE requestType,                            */
+		"/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP API_VERSION,    /*const char* relativePath,                                    */
+		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
+		NULL,                                               /*BUFFER_HANDLE requestContent,                                */
+		IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
+		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
+		IGNORED_PTR_ARG                                     /*BUFFER_HANDLE responseContent))                              */
+		))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2)
+		.IgnoreArgument(5)
+		.IgnoreArgument(7)
+		.IgnoreArgument(8)
+		.IgnoreArgument(9)
+		.NeverInvoked();
+
+	///act
+	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+
+	///assert
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubTransportHttp_Destroy(handle);
+}
+
+/*Tests_SRS_TRANSPORTMULTITHTTP_02_017: [ After a message has been received and accepted or rejected, _DoWork shall immediately issue another GET for the same device (regardless of GetMinimumPollingTime) until "MaximumMessagesPerDoWork" messages have been received in this call. ]*/
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_MaximumMessagesPerDoWork_2_stops_after_2_messages)
+{
+	///arrange
+	CNiceCallComparer<CIoTHubTransportHttpMocks> mocks;
+	unsigned int statusCode200 = 200;
+	unsigned int statusCode204 = 204;
+	unsigned int maximumMessagesPerDoWork = 2;
+	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+	(void)IoTHubTransportHttp_Subscribe(devHandle);
+	(void)IoTHubTransportHttp_SetOption(handle, "MaximumMessagesPerDoWork", &maximumMessagesPerDoWork);
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
+		IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
+		HTTPAPI_REQUEST_GET,                                /*HTTPAPI_REQUEST_TYPE requestType,                            */
+		"/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP API_VERSION,    /*const char* relativePath,                                    */
+		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
+		NULL,                                               /*BUFFER_HANDLE requestContent,                                */
+		IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
+		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
+		IGNORED_PTR_ARG                                     /*BUFFER_HANDLE responseContent))                              */
+		))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2)
+		.IgnoreArgument(5)
+		.IgnoreArgument(7)
+		.IgnoreArgument(8)
+		.IgnoreArgument(9)
+		.CopyOutArgumentBuffer(7, &statusCode200, sizeof(statusCode200));
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_FindHeaderValue(IGNORED_PTR_ARG, "ETag"))
+		.IgnoreArgument(1)
+		.SetReturn(TEST_ETAG_VALUE);
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
+		IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
+		HTTPAPI_REQUEST_DELETE,                             /*HTTPAPI_REQUEST_TYPE requestType,                            */
+		"/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP_ETAG TEST_ETAG_VALUE_UNQUOTED API_VERSION,    /*const char* relativePath,                                    */
+		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
+		NULL,                                               /*BUFFER_HANDLE requestContent,                                */
+		IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
+		NULL,                                               /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
+		NULL                                                /*BUFFER_HANDLE responseContent))                              */
+		))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2)
+		.IgnoreArgument(5)
+		.IgnoreArgument(7)
+		.CopyOutArgumentBuffer(7, &statusCode204, sizeof(statusCode204));
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
+		IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
+		HTTPAPI_REQUEST_GET,                                /*HTTPAPI_REQUEST_TYPE requestType,                            */
+		"/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP API_VERSION,    /*const char* relativePath,                                    */
+		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
+		NULL,                                               /*BUFFER_HANDLE requestContent,                                */
+		IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
+		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
+		IGNORED_PTR_ARG                                     /*BUFFER_HANDLE responseContent))                              */
+		))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2)
+		.IgnoreArgument(5)
+		.IgnoreArgument(7)
+		.IgnoreArgument(8)
+		.IgnoreArgument(9)
+		.CopyOutArgumentBuffer(7, &statusCode200, sizeof(statusCode200));
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_FindHeaderValue(IGNORED_PTR_ARG, "ETag"))
+		.IgnoreArgument(1)
+		.SetReturn(TEST_ETAG_VALUE);
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
+		IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
+		HTTPAPI_REQUEST_DELETE,                             /*HTTPAPI_REQUEST_TYPE requestType,                            */
+		"/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP_ETAG TEST_ETAG_VALUE_UNQUOTED API_VERSION,    /*const char* relativePath,                                    */
+		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
+		NULL,                                               /*BUFFER_HANDLE requestContent,                                */
+		IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
+		NULL,                                               /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
+		NULL                                                /*BUFFER_HANDLE responseContent))                              */
+		))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2)
+		.IgnoreArgument(5)
+		.IgnoreArgument(7)
+		.CopyOutArgumentBuffer(7, &statusCode204, sizeof(statusCode204));
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_MessageCallback(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.ExpectedTimesExactly(2);
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
+		IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
+		HTTPAPI_REQUEST_GET,                                /*HTTPAPI_REQUEST_TYPE requestType,                            */
+		"/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP API_VERSION,    /*const char* relativePath,                                    */
+		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
+		NULL,                                               /*BUFFER_HANDLE requestContent,                                */
+		IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
+		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
+		IGNORED_PTR_ARG                                     /*BUFFER_HANDLE responseContent))                              */
+		))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2)
+		.IgnoreArgument(5)
+		.IgnoreArgument(7)
+		.IgnoreArgument(8)
+		.IgnoreArgument(9)
+		.NeverInvoked();
+
+	///act
+	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+
+	///assert
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubTransportHttp_Destroy(handle);
+}
+
+/*Tests_SRS_TRANSPORTMULTITHTTP_02_018: [ _DoWork shall stop issuing GETs for the device as soon as a GET does not produce a message (status code 204, any other status code, or any failure). ]*/
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_MaximumMessagesPerDoWork_3_stops_when_ETag_is_missing)
+{
+	///arrange
+	CNiceCallComparer<CIoTHubTransportHttpMocks> mocks;
+	unsigned int statusCode200 = 200;
+	unsigned int maximumMessagesPerDoWork = 3;
+	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+	(void)IoTHubTransportHttp_Subscribe(devHandle);
+	(void)IoTHubTransportHttp_SetOption(handle, "MaximumMessagesPerDoWork", &maximumMessagesPerDoWork);
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
+		IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
+		HTTPAPI_REQUEST_GET,                                /*HTTPAPI_REQUEST_TYPE requestType,                            */
+		"/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP API_VERSION,    /*const char* relativePath,                                    */
+		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
+		NULL,                                               /*BUFFER_HANDLE requestContent,                                */
+		IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
+		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
+		IGNORED_PTR_ARG                                     /*BUFFER_HANDLE responseContent))                              */
+		))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2)
+		.IgnoreArgument(5)
+		.IgnoreArgument(7)
+		.IgnoreArgument(8)
+		.IgnoreArgument(9)
+		.CopyOutArgumentBuffer(7, &statusCode200, sizeof(statusCode200));
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_FindHeaderValue(IGNORED_PTR_ARG, "ETag"))
+		.IgnoreArgument(1)
+		.SetReturn((const char*)NULL);
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_MessageCallback(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.NeverInvoked();
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
+		IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
+		HTTPAPI_REQUEST_GET,                                /*HTTPAPI_REQUEST_TYPE requestType,                            */
+		"/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP API_VERSION,    /*const char* relativePath,                                    */
+		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
+		NULL,                                               /*BUFFER_HANDLE requestContent,                                */
+		IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
+		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
+		IGNORED_PTR_ARG                                     /*BUFFER_HANDLE responseContent))                              */
+		))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2)
+		.IgnoreArgument(5)
+		.IgnoreArgument(7)
+		.IgnoreArgument(8)
+		.IgnoreArgument(9)
+		.NeverInvoked();
+
+	///act
+	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+
+	///assert
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubTransportHttp_Destroy(handle);
+}
+
+/*Tests_SRS_TRANSPORTMULTITHTTP_02_040: [ An abandoned message goes back to the device's queue, so after abandoning a message _DoWork shall not issue another GET for the device in this call. ]*/
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_MaximumMessagesPerDoWork_3_stops_after_an_abandoned_message)
+{
+	///arrange
+	CNiceCallComparer<CIoTHubTransportHttpMocks> mocks;
+	unsigned int statusCode200 = 200;
+	unsigned int statusCode204 = 204;
+	unsigned int maximumMessagesPerDoWork = 3;
+	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+	(void)IoTHubTransportHttp_Subscribe(devHandle);
+	(void)IoTHubTransportHttp_SetOption(handle, "MaximumMessagesPerDoWork", &maximumMessagesPerDoWork);
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
+		IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
+		HTTPAPI_REQUEST_GET,                                /*HTTPAPI_REQUEST_TYPE requestType,                            */
+		"/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP API_VERSION,    /*const char* relativePath,                                    */
+		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
+		NULL,                                               /*BUFFER_HANDLE requestContent,                                */
+		IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
+		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
+		IGNORED_PTR_ARG                                     /*BUFFER_HANDLE responseContent))                              */
+		))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2)
+		.IgnoreArgument(5)
+		.IgnoreArgument(7)
+		.IgnoreArgument(8)
+		.IgnoreArgument(9)
+		.CopyOutArgumentBuffer(7, &statusCode200, sizeof(statusCode200));
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_FindHeaderValue(IGNORED_PTR_ARG, "ETag"))
+		.IgnoreArgument(1)
+		.SetReturn(TEST_ETAG_VALUE);
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_MessageCallback(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.SetReturn(IOTHUBMESSAGE_ABANDONED);
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
+		IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
+		HTTPAPI_REQUEST_POST,                               /*HTTPAPI_REQUEST_TYPE requestType,                            */
+		"/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP_ETAG TEST_ETAG_VALUE_UNQUOTED "/abandon" API_VERSION,    /*const char* relativePath,                                    */
+		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
+		NULL,                                               /*BUFFER_HANDLE requestContent,                                */
+		IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
+		NULL,                                               /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
+		NULL                                                /*BUFFER_HANDLE responseContent))                              */
+		))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2)
+		.IgnoreArgument(5)
+		.IgnoreArgument(7)
+		.CopyOutArgumentBuffer(7, &statusCode204, sizeof(statusCode204));
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
+		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
+		IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
+		HTTPAPI_REQUEST_GET,                                /*HTTPAPI_REQUEST_TYPE requestType,                            */
+		"/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP API_VERSION,    /*const char* relativePath,                                    */
+		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
+		NULL,                                               /*BUFFER_HANDLE requestContent,                                */
+		IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
+		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
+		IGNORED_PTR_ARG                                     /*BUFFER_HANDLE responseContent))                              */
+		))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2)
+		.IgnoreArgument(5)
+		.IgnoreArgument(7)
+		.IgnoreArgument(8)
+		.IgnoreArgument(9)
+		.NeverInvoked();
+
+	///act
+	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+
+	///assert
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubTransportHttp_Destroy(handle);
+}
+
+/*Tests_SRS_TRANSPORTMULTITHTTP_02_019: [ "sas_token_lifetime" ]*/
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_sas_token_lifetime_succeeds)
+{
+	///arrange
+	CIoTHubTransportHttpMocks mocks;
+	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	size_t sasTokenLifetime = 3600000;
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, BUFFER_length(IGNORED_PTR_ARG))
+
+	///act
+	auto result = IoTHubTransportHttp_SetOption(handle, "sas_token_lifetime", &sasTokenLifetime);
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubTransportHttp_Destroy(handle);
+}
+
+/*Tests_SRS_TRANSPORTMULTITHTTP_02_043: [ If "sas_token_lifetime" is not 0 and less than 1000 then IoTHubTransportHttp_SetOption shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_sas_token_lifetime_999_fails)
+{
+	///arrange
+	CIoTHubTransportHttpMocks mocks;
+	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	size_t sasTokenLifetime = 999;
+	mocks.ResetAllCalls();
+
+	///act
+	auto result = IoTHubTransportHttp_SetOption(handle, "sas_token_lifetime", &sasTokenLifetime);
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubTransportHttp_Destroy(handle);
+}
+
+/*Tests_SRS_TRANSPORTMULTITHTTP_02_043: [ If "sas_token_lifetime" is not 0 and less than 1000 then IoTHubTransportHttp_SetOption shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_sas_token_lifetime_1000_succeeds)
+{
+	///arrange
+	CIoTHubTransportHttpMocks mocks;
+	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	size_t sasTokenLifetime = 1000;
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
 		.IgnoreArgument(1);
-	{
-		/*this scope is for is properties code*/
 
-		HTTPHeaders_GetHeaderCount_writes_to_its_outputs = false;
-		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeaderCount(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.CopyOutArgumentBuffer(2, &nHeaders, sizeof(nHeaders));
+	///act
+	auto result = IoTHubTransportHttp_SetOption(handle, "sas_token_lifetime", &sasTokenLifetime);
 
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE_8));
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubTransportHttp_Destroy(handle);
+}
+
+/*Tests_SRS_TRANSPORTMULTITHTTP_02_021: [ By default "sas_token_lifetime" shall be 0. ]*/
+/*Tests_SRS_TRANSPORTMULTITHTTP_02_025: [ If "sas_token_lifetime" is 0 or time is not available, then the request shall be executed by HTTPAPIEX_SAS_ExecuteRequest. ]*/
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_by_default_does_not_cache_SAS_tokens)
+{
+	///arrange
+	CNiceCallComparer<CIoTHubTransportHttpMocks> mocks;
+	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+	(void)IoTHubTransportHttp_Subscribe(devHandle);
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, SASToken_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+		.IgnoreAllArguments()
+		.NeverInvoked();
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(IGNORED_PTR_ARG, IGNORED_PTR_ARG, HTTPAPI_REQUEST_GET, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2)
+		.IgnoreArgument(4)
+		.IgnoreArgument(5)
+		.IgnoreArgument(6)
+		.IgnoreArgument(7)
+		.IgnoreArgument(8)
+		.IgnoreArgument(9);
+
+	///act
+	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+
+	///assert
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubTransportHttp_Destroy(handle);
+}
+
+/*Tests_SRS_TRANSPORTMULTITHTTP_02_022: [ If "sas_token_lifetime" is not 0, then before every request of a device that has a deviceKey _DoWork shall create a SAS token by calling SASToken_Create with the device key, hostname + "/devices/" + URL_ENCODED(deviceId), an empty key name and an expiry of now + "sas_token_lifetime", unless a cached one can be reused. ]*/
+/*Tests_SRS_TRANSPORTMULTITHTTP_02_023: [ The cached SAS token shall be reused until half of "sas_token_lifetime" has elapsed since it was created. ]*/
+/*Tests_SRS_TRANSPORTMULTITHTTP_02_026: [ Otherwise, the "Authorization" header of the request shall be set to the cached SAS token and the request shall be executed by HTTPAPIEX_ExecuteRequest. ]*/
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_sas_token_lifetime_creates_the_SAS_token_once)
+{
+	///arrange
+	CNiceCallComparer<CIoTHubTransportHttpMocks> mocks;
+	unsigned int statusCode200 = 200;
+	unsigned int statusCode204 = 204;
+	size_t sasTokenLifetime = 3600000;
+	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+	(void)IoTHubTransportHttp_Subscribe(devHandle);
+	(void)IoTHubTransportHttp_SetOption(handle, "sas_token_lifetime", &sasTokenLifetime);
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, SASToken_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, TEST_GET_TIME_VALUE + 3600))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2)
+		.IgnoreArgument(3)
+		.ExpectedTimesExactly(1);
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Authorization", TEST_SAS_TOKEN))
+		.IgnoreArgument(1)
+		.ExpectedTimesExactly(2);
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_ExecuteRequest2(
+		IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
+		HTTPAPI_REQUEST_GET,                                /*HTTPAPI_REQUEST_TYPE requestType,                            */
+		"/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP API_VERSION,    /*const char* relativePath,                                    */
+		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
+		NULL,                                               /*BUFFER_HANDLE requestContent,                                */
+		IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
+		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
+		IGNORED_PTR_ARG                                     /*BUFFER_HANDLE responseContent))                              */
+		))
+		.IgnoreArgument(1)
+		.IgnoreArgument(4)
+		.IgnoreArgument(6)
+		.IgnoreArgument(7)
+		.IgnoreArgument(8)
+		.CopyOutArgumentBuffer(6, &statusCode200, sizeof(statusCode200));
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_FindHeaderValue(IGNORED_PTR_ARG, "ETag"))
+		.IgnoreArgument(1)
+		.SetReturn(TEST_ETAG_VALUE);
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_MessageCallback(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG))
+		.IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_ExecuteRequest2(
+		IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
+		HTTPAPI_REQUEST_DELETE,                             /*HTTPAPI_REQUEST_TYPE requestType,                            */
+		"/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP_ETAG TEST_ETAG_VALUE_UNQUOTED API_VERSION,    /*const char* relativePath,                                    */
+		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
+		NULL,                                               /*BUFFER_HANDLE requestContent,                                */
+		IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
+		NULL,                                               /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
+		NULL                                                /*BUFFER_HANDLE responseContent))                              */
+		))
+		.IgnoreArgument(1)
+		.IgnoreArgument(4)
+		.IgnoreArgument(6)
+		.CopyOutArgumentBuffer(6, &statusCode204, sizeof(statusCode204));
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(IGNORED_PTR_ARG, IGNORED_PTR_ARG, HTTPAPI_REQUEST_GET, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments()
+		.NeverInvoked();
 
-		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeader(IGNORED_PTR_ARG, 0, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(3);
-		STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(TEST_MAP_3_PROPERTY, "NAME1", "VALUE1"));
+	///act
+	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
-		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeader(IGNORED_PTR_ARG, 1, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(3);
-		STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
+	///assert
+	mocks.AssertActualAndExpectedCalls();
 
-		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeader(IGNORED_PTR_ARG, 2, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(3);
-		STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, Map_AddOrUpdate(TEST_MAP_3_PROPERTY, "NAME2", "VALUE2"));
+	///cleanup
+	IoTHubTransportHttp_Destroy(handle);
+}
 
-		STRICT_EXPECTED_CALL(mocks, HTTPHeaders_GetHeader(IGNORED_PTR_ARG, 3, IGNORED_PTR_ARG))
-			.IgnoreArgument(1)
-			.IgnoreArgument(3);
-		STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
-			.IgnoreArgument(1);
-		STRICT_EXPECTED_CALL(mocks, IoTHubMessage_SetMessageId(IGNORED_PTR_ARG, "VALUE3"))
-			.IgnoreArgument(1)
-			.SetReturn(IOTHUB_MESSAGE_ERROR);
-	}
+/*Tests_SRS_TRANSPORTMULTITHTTP_02_023: [ The cached SAS token shall be reused until half of "sas_token_lifetime" has elapsed since it was created. ]*/
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_sas_token_lifetime_recreates_the_SAS_token_after_half_of_its_lifetime)
+{
+	///arrange
+	CNiceCallComparer<CIoTHubTransportHttpMocks> mocks;
+	unsigned int statusCode200 = 200;
+	unsigned int statusCode204 = 204;
+	size_t sasTokenLifetime = 3600000;
+	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+	(void)IoTHubTransportHttp_Subscribe(devHandle);
+	(void)IoTHubTransportHttp_SetOption(handle, "sas_token_lifetime", &sasTokenLifetime);
+	mocks.ResetAllCalls();
 
-	/*this is "abandon"*/
-	STRICT_EXPECTED_CALL(mocks, STRING_clone(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_construct_n(TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1))
-		.ValidateArgumentBuffer(1, TEST_ETAG_VALUE_UNQUOTED, sizeof(TEST_ETAG_VALUE_UNQUOTED) - 1);
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+	STRICT_EXPECTED_CALL(mocks, get_difftime(TEST_GET_TIME_VALUE, TEST_GET_TIME_VALUE))
+		.SetReturn((double)1800);
+	STRICT_EXPECTED_CALL(mocks, SASToken_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, TEST_GET_TIME_VALUE + 3600))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2)
+		.IgnoreArgument(3)
+		.ExpectedTimesExactly(2);
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_ExecuteRequest2(
+		IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
+		HTTPAPI_REQUEST_GET,                                /*HTTPAPI_REQUEST_TYPE requestType,                            */
+		"/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP API_VERSION,    /*const char* relativePath,                                    */
+		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
+		NULL,                                               /*BUFFER_HANDLE requestContent,                                */
+		IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
+		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
+		IGNORED_PTR_ARG                                     /*BUFFER_HANDLE responseContent))                              */
+		))
+		.IgnoreArgument(1)
+		.IgnoreArgument(4)
+		.IgnoreArgument(6)
+		.IgnoreArgument(7)
+		.IgnoreArgument(8)
+		.CopyOutArgumentBuffer(6, &statusCode200, sizeof(statusCode200));
+	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_FindHeaderValue(IGNORED_PTR_ARG, "ETag"))
 		.IgnoreArgument(1)
+		.SetReturn(TEST_ETAG_VALUE);
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_MessageCallback(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG))
 		.IgnoreArgument(2);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, "/abandon" API_VERSION))
-		.IgnoreArgument(1);
-
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Alloc());
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "User-Agent", CLIENT_DEVICE_TYPE_PREFIX CLIENT_DEVICE_BACKSLASH IOTHUB_SDK_VERSION))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "Authorization", TEST_BLANK_SAS_TOKEN))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "If-Match", TEST_ETAG_VALUE))
-		.IgnoreArgument(1);
-
-	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-		.IgnoreArgument(1); /*because abandon relativePath is a STRING_HANDLE*/
-	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
-		IGNORED_PTR_ARG,
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_ExecuteRequest2(
 		IGNORED_PTR_ARG,                                    /*HTTPAPIEX_HANDLE handle,                                     */
-		HTTPAPI_REQUEST_POST,                               /*HTTPAPI_REQUEST_TYPE requestType,                            */
-		"/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP_ETAG TEST_ETAG_VALUE_UNQUOTED "/abandon" API_VERSION,    /*const char* relativePath,                                    */
+		HTTPAPI_REQUEST_DELETE,                             /*HTTPAPI_REQUEST_TYPE requestType,                            */
+		"/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP_ETAG TEST_ETAG_VALUE_UNQUOTED API_VERSION,    /*const char* relativePath,                                    */
 		IGNORED_PTR_ARG,                                    /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,                */
 		NULL,                                               /*BUFFER_HANDLE requestContent,                                */
 		IGNORED_PTR_ARG,                                    /*unsigned int* statusCode,                                    */
 		NULL,                                               /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,               */
 		NULL                                                /*BUFFER_HANDLE responseContent))                              */
 		))
+		.IgnoreArgument(1)
+		.IgnoreArgument(4)
+		.IgnoreArgument(6)
+		.CopyOutArgumentBuffer(6, &statusCode204, sizeof(statusCode204));
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(IGNORED_PTR_ARG, IGNORED_PTR_ARG, HTTPAPI_REQUEST_GET, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments()
+		.NeverInvoked();
+
+	///act
+	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+
+	///assert
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubTransportHttp_Destroy(handle);
+}
+
+/*Tests_SRS_TRANSPORTMULTITHTTP_02_020: [ Changing "sas_token_lifetime" shall discard all the cached SAS tokens. ]*/
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_sas_token_lifetime_discards_the_cached_SAS_tokens)
+{
+	///arrange
+	CNiceCallComparer<CIoTHubTransportHttpMocks> mocks;
+	size_t sasTokenLifetime = 3600000;
+	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+	(void)IoTHubTransportHttp_Subscribe(devHandle);
+	(void)IoTHubTransportHttp_SetOption(handle, "sas_token_lifetime", &sasTokenLifetime);
+	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+
+	///act
+	auto result = IoTHubTransportHttp_SetOption(handle, "sas_token_lifetime", &sasTokenLifetime);
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubTransportHttp_Destroy(handle);
+}
+
+/*Tests_SRS_TRANSPORTMULTITHTTP_02_024: [ If creating the SAS token fails, then the request shall fail the same way a failed HTTPAPIEX_SAS_ExecuteRequest does. ]*/
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_sas_token_lifetime_when_SASToken_Create_fails_no_request_is_made)
+{
+	///arrange
+	CNiceCallComparer<CIoTHubTransportHttpMocks> mocks;
+	size_t sasTokenLifetime = 3600000;
+	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+	(void)IoTHubTransportHttp_Subscribe(devHandle);
+	(void)IoTHubTransportHttp_SetOption(handle, "sas_token_lifetime", &sasTokenLifetime);
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, SASToken_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+		.IgnoreAllArguments()
+		.SetReturn((STRING_HANDLE)NULL);
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_ExecuteRequest2(IGNORED_PTR_ARG, HTTPAPI_REQUEST_GET, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments()
+		.NeverInvoked();
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(IGNORED_PTR_ARG, IGNORED_PTR_ARG, HTTPAPI_REQUEST_GET, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments()
+		.NeverInvoked();
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_MessageCallback(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG))
+		.IgnoreArgument(2)
+		.NeverInvoked();
+
+	///act
+	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+
+	///assert
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubTransportHttp_Destroy(handle);
+}
+
+/*Tests_SRS_TRANSPORTMULTITHTTP_02_032: [ "BatchLingerMs" ]*/
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_BatchLingerMs_succeeds)
+{
+	///arrange
+	CIoTHubTransportHttpMocks mocks;
+	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	unsigned int batchLingerMs = 100;
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, tickcounter_create());
+
+	///act
+	auto result = IoTHubTransportHttp_SetOption(handle, "BatchLingerMs", &batchLingerMs);
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubTransportHttp_Destroy(handle);
+}
+
+/*Tests_SRS_TRANSPORTMULTITHTTP_02_036: [ If the tick counter needed by "BatchLingerMs" or "BatchLingerAdaptive" cannot be created then IoTHubTransportHttp_SetOption shall return IOTHUB_CLIENT_ERROR. ]*/
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_BatchLingerMs_fails_when_tickcounter_create_fails)
+{
+	///arrange
+	CIoTHubTransportHttpMocks mocks;
+	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	unsigned int batchLingerMs = 100;
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, tickcounter_create())
+		.SetReturn((TICK_COUNTER_HANDLE)NULL);
+
+	///act
+	auto result = IoTHubTransportHttp_SetOption(handle, "BatchLingerMs", &batchLingerMs);
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubTransportHttp_Destroy(handle);
+}
+
+/*Tests_SRS_TRANSPORTMULTITHTTP_02_033: [ "BatchMinBytes" ]*/
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_BatchMinBytes_succeeds)
+{
+	///arrange
+	CIoTHubTransportHttpMocks mocks;
+	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	size_t batchMinBytes = 4096;
+	mocks.ResetAllCalls();
+
+	///act
+	auto result = IoTHubTransportHttp_SetOption(handle, "BatchMinBytes", &batchMinBytes);
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubTransportHttp_Destroy(handle);
+}
+
+/*Tests_SRS_TRANSPORTMULTITHTTP_02_037: [ "BatchLingerAdaptive" ]*/
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_BatchLingerAdaptive_succeeds)
+{
+	///arrange
+	CIoTHubTransportHttpMocks mocks;
+	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, tickcounter_create());
+
+	///act
+	auto result = IoTHubTransportHttp_SetOption(handle, "BatchLingerAdaptive", &thisIsTrue);
+
+	///assert
+	ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubTransportHttp_Destroy(handle);
+}
+
+/*Tests_SRS_TRANSPORTMULTITHTTP_02_027: [ If "Batching" is true and the linger is not 0, then _DoWork shall hold back the events of a device until the oldest one has waited for the linger. ]*/
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_BatchLingerMs_holds_the_batch)
+{
+	///arrange
+	CNiceCallComparer<CIoTHubTransportHttpMocks> mocks;
+	unsigned int batchLingerMs = 100;
+	DList_InsertTailList(&(waitingToSend), &(message1.entry));
+	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	(void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+	ENABLE_BATCHING();
+	(void)IoTHubTransportHttp_SetOption(handle, "BatchLingerMs", &batchLingerMs);
+	currentTickCounterMs = 1000;
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(IGNORED_PTR_ARG, IGNORED_PTR_ARG, HTTPAPI_REQUEST_POST, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments()
+		.NeverInvoked();
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_SUCCESS))
+		.IgnoreArgument(2)
+		.NeverInvoked();
+
+	///act
+	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+	currentTickCounterMs += batchLingerMs - 1;
+	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+
+	///assert
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubTransportHttp_Destroy(handle);
+}
+
+/*Tests_SRS_TRANSPORTMULTITHTTP_02_027: [ If "Batching" is true and the linger is not 0, then _DoWork shall hold back the events of a device until the oldest one has waited for the linger. ]*/
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_BatchLingerMs_sends_the_batch_after_the_linger)
+{
+	///arrange
+	CNiceCallComparer<CIoTHubTransportHttpMocks> mocks;
+	unsigned int batchLingerMs = 100;
+	DList_InsertTailList(&(waitingToSend), &(message1.entry));
+	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	(void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+	ENABLE_BATCHING();
+	(void)IoTHubTransportHttp_SetOption(handle, "BatchLingerMs", &batchLingerMs);
+	currentTickCounterMs = 1000;
+	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE); /*starts the linger*/
+	currentTickCounterMs += batchLingerMs;
+	mocks.ResetAllCalls();
+
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(IGNORED_PTR_ARG, IGNORED_PTR_ARG, HTTPAPI_REQUEST_POST, "/devices/" TEST_DEVICE_ID EVENT_ENDPOINT API_VERSION, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, NULL, NULL))
 		.IgnoreArgument(1)
 		.IgnoreArgument(2)
 		.IgnoreArgument(5)
+		.IgnoreArgument(6)
 		.IgnoreArgument(7)
-		.CopyOutArgumentBuffer(7, &statusCode204, sizeof(statusCode204));
+		.CopyOutArgumentBuffer(7, &httpStatus200, sizeof(httpStatus200));
+	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_SUCCESS))
+		.IgnoreArgument(2);
 
 	///act
 	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
@@ -14226,246 +13567,180 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_SetMessageId_FAILED)
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-//Tests_SRS_TRANSPORTMULTITHTTP_17_091: [ The HTTP header value of iothub-messageid shall be set in the IoTHub_SetMessageId. ]
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_GetMessageId_succeeds)
+/*Tests_SRS_TRANSPORTMULTITHTTP_02_029: [ The batch shall be sent without lingering once the events in waitingToSend amount to "BatchMinBytes" or to the maximum batch size. ]*/
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_BatchLingerMs_and_BatchMinBytes_reached_sends_the_batch_right_away)
 {
 	///arrange
-	CIoTHubTransportHttpMocks mocks;
-	DList_InsertTailList(&(waitingToSend), &(message6.entry));
+	CNiceCallComparer<CIoTHubTransportHttpMocks> mocks;
+	unsigned int batchLingerMs = 100;
+	size_t batchMinBytes = 1;
+	DList_InsertTailList(&(waitingToSend), &(message1.entry));
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
-	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
-
+	(void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+	ENABLE_BATCHING();
+	(void)IoTHubTransportHttp_SetOption(handle, "BatchLingerMs", &batchLingerMs);
+	(void)IoTHubTransportHttp_SetOption(handle, "BatchMinBytes", &batchMinBytes);
 	mocks.ResetAllCalls();
 
-	setupDoWorkLoopOnceForOneDevice(mocks);
-
-	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
-
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE_6));
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE_6, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreArgument(2)
-		.IgnoreArgument(3);
-
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Clone(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/octet-stream"))
-		.IgnoreArgument(1);
-
-	/*no properties, so no more headers*/
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE_6));
-	STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_1_PROPERTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreArgument(2)
-		.IgnoreArgument(3)
-		.IgnoreArgument(4);
-
-	/*this is making http headers*/
-	STRICT_EXPECTED_CALL(mocks, STRING_construct("iothub-app-"));
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, TEST_RED_KEY))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "iothub-app-" TEST_RED_KEY, TEST_RED_VALUE))
-		.IgnoreArgument(1);
-
-	STRICT_EXPECTED_CALL(mocks, BUFFER_new());
-	STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, BUFFER_build(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2)
-		.IgnoreArgument(3);
-
-	/*executing HTTP goodies*/
-	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
-		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
-		IGNORED_PTR_ARG,
-		HTTPAPI_REQUEST_POST,                                                           /*HTTPAPI_REQUEST_TYPE requestType,                  */
-		"/devices/" TEST_DEVICE_ID EVENT_ENDPOINT API_VERSION,                 /*const char* relativePath,                          */
-		IGNORED_PTR_ARG,                                                                /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,      */
-		IGNORED_PTR_ARG,                                                                /*BUFFER_HANDLE requestContent,                      */
-		IGNORED_PTR_ARG,                                                                /*unsigned int* statusCode,                          */
-		NULL,                                                                           /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,     */
-		NULL                                                                            /*BUFFER_HANDLE responseContent)                     */
-		))
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(IGNORED_PTR_ARG, IGNORED_PTR_ARG, HTTPAPI_REQUEST_POST, "/devices/" TEST_DEVICE_ID EVENT_ENDPOINT API_VERSION, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, NULL, NULL))
 		.IgnoreArgument(1)
 		.IgnoreArgument(2)
 		.IgnoreArgument(5)
 		.IgnoreArgument(6)
+		.IgnoreArgument(7)
 		.CopyOutArgumentBuffer(7, &httpStatus200, sizeof(httpStatus200));
 
-	/*once the event has been succesfull...*/
-
-	/*building the list of messages to be notified if HTTP is fine*/
-	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message6.entry)))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_SUCCESS))
-		.IgnoreArgument(2);
-
-	EXPECTED_CALL(mocks, IoTHubMessage_GetMessageId(IGNORED_PTR_ARG)).SetReturn(TEST_MESSAGE_ID);
-	EXPECTED_CALL(mocks, IoTHubMessage_GetCorrelationId(IGNORED_PTR_ARG));
-
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "iothub-messageid", TEST_MESSAGE_ID))
-		.IgnoreArgument(1);
-
-	DISABLE_BATCHING();
-
 	///act
 	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
 	///assert
-	ASSERT_ARE_EQUAL(int, 0, memcmp(BASEIMPLEMENTATION::BUFFER_u_char(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest), buffer6, buffer6_size));
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-TEST_FUNCTION(IoTHubTransportHttp_DoWork_GetCorrelationId_succeeds)
+/*Tests_SRS_TRANSPORTMULTITHTTP_02_030: [ The batch shall be sent without lingering if any of its events has a message timeout. ]*/
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_BatchLingerMs_and_a_message_timeout_sends_the_batch_right_away)
 {
 	///arrange
-	CIoTHubTransportHttpMocks mocks;
-	DList_InsertTailList(&(waitingToSend), &(message6.entry));
+	CNiceCallComparer<CIoTHubTransportHttpMocks> mocks;
+	unsigned int batchLingerMs = 100;
+	message1.ms_timesOutAfter = 1;
+	DList_InsertTailList(&(waitingToSend), &(message1.entry));
 	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
-	auto devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
-
+	(void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+	ENABLE_BATCHING();
+	(void)IoTHubTransportHttp_SetOption(handle, "BatchLingerMs", &batchLingerMs);
 	mocks.ResetAllCalls();
 
-	setupDoWorkLoopOnceForOneDevice(mocks);
-
-	STRICT_EXPECTED_CALL(mocks, DList_IsListEmpty(&waitingToSend));
-
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE_6));
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE_6, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreArgument(2)
-		.IgnoreArgument(3);
-
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Clone(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_Free(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/octet-stream"))
-		.IgnoreArgument(1);
-
-	/*no properties, so no more headers*/
-	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE_6));
-	STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MAP_1_PROPERTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreArgument(2)
-		.IgnoreArgument(3)
-		.IgnoreArgument(4);
-
-	/*this is making http headers*/
-	STRICT_EXPECTED_CALL(mocks, STRING_construct("iothub-app-"));
-	STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, TEST_RED_KEY))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "iothub-app-" TEST_RED_KEY, TEST_RED_VALUE))
-		.IgnoreArgument(1);
-
-	STRICT_EXPECTED_CALL(mocks, BUFFER_new());
-	STRICT_EXPECTED_CALL(mocks, BUFFER_delete(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, BUFFER_build(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-		.IgnoreArgument(1)
-		.IgnoreArgument(2)
-		.IgnoreArgument(3);
-
-	/*executing HTTP goodies*/
-	STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG)) /*because relativePath*/
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(
-		IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
-		IGNORED_PTR_ARG,
-		HTTPAPI_REQUEST_POST,                                                           /*HTTPAPI_REQUEST_TYPE requestType,                  */
-		"/devices/" TEST_DEVICE_ID EVENT_ENDPOINT API_VERSION,                 /*const char* relativePath,                          */
-		IGNORED_PTR_ARG,                                                                /*HTTP_HEADERS_HANDLE requestHttpHeadersHandle,      */
-		IGNORED_PTR_ARG,                                                                /*BUFFER_HANDLE requestContent,                      */
-		IGNORED_PTR_ARG,                                                                /*unsigned int* statusCode,                          */
-		NULL,                                                                           /*HTTP_HEADERS_HANDLE responseHttpHeadersHandle,     */
-		NULL                                                                            /*BUFFER_HANDLE responseContent)                     */
-		))
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(IGNORED_PTR_ARG, IGNORED_PTR_ARG, HTTPAPI_REQUEST_POST, "/devices/" TEST_DEVICE_ID EVENT_ENDPOINT API_VERSION, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, NULL, NULL))
 		.IgnoreArgument(1)
 		.IgnoreArgument(2)
 		.IgnoreArgument(5)
 		.IgnoreArgument(6)
+		.IgnoreArgument(7)
 		.CopyOutArgumentBuffer(7, &httpStatus200, sizeof(httpStatus200));
 
-	/*once the event has been succesfull...*/
+	///act
+	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
-	/*building the list of messages to be notified if HTTP is fine*/
-	STRICT_EXPECTED_CALL(mocks, DList_RemoveHeadList(IGNORED_PTR_ARG))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, &(message6.entry)))
-		.IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_SUCCESS))
-		.IgnoreArgument(2);
+	///assert
+	mocks.AssertActualAndExpectedCalls();
 
-	EXPECTED_CALL(mocks, IoTHubMessage_GetMessageId(IGNORED_PTR_ARG));
-	EXPECTED_CALL(mocks, IoTHubMessage_GetCorrelationId(IGNORED_PTR_ARG)).SetReturn(TEST_MESSAGE_ID);
+	///cleanup
+	IoTHubTransportHttp_Destroy(handle);
+	message1.ms_timesOutAfter = 0;
+}
 
-	STRICT_EXPECTED_CALL(mocks, HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "iothub-correlationid", TEST_MESSAGE_ID))
-		.IgnoreArgument(1);
+/*Tests_SRS_TRANSPORTMULTITHTTP_02_041: [ While a batch lingers, _DoWork shall keep a running total of the size of its events and shall only measure the events added to waitingToSend since the previous _DoWork. ]*/
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_while_the_batch_lingers_measures_only_the_new_events)
+{
+	///arrange
+	CNiceCallComparer<CIoTHubTransportHttpMocks> mocks;
+	unsigned int batchLingerMs = 100;
+	DList_InsertTailList(&(waitingToSend), &(message1.entry));
+	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	(void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+	ENABLE_BATCHING();
+	(void)IoTHubTransportHttp_SetOption(handle, "BatchLingerMs", &batchLingerMs);
+	currentTickCounterMs = 1000;
+	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE); /*starts the linger, message1 is counted*/
+	DList_InsertTailList(&(waitingToSend), &(message2.entry));
+	currentTickCounterMs += 1;
+	mocks.ResetAllCalls();
 
-	DISABLE_BATCHING();
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE_1))
+		.NeverInvoked();
+	STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE_2));
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(IGNORED_PTR_ARG, IGNORED_PTR_ARG, HTTPAPI_REQUEST_POST, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments()
+		.NeverInvoked();
 
 	///act
 	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
 	///assert
-	ASSERT_ARE_EQUAL(int, 0, memcmp(BASEIMPLEMENTATION::BUFFER_u_char(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest), buffer6, buffer6_size));
 	mocks.AssertActualAndExpectedCalls();
 
 	///cleanup
 	IoTHubTransportHttp_Destroy(handle);
 }
 
-/*Tests_SRS_TRANSPORTMULTITHTTP_02_001: [ If handle is NULL then IoTHubTransportHttp_GetHostname shall fail and return NULL. ]*/
-TEST_FUNCTION(IoTHubTransportHttp_GetHostname_with_NULL_handle_fails)
+/*Tests_SRS_TRANSPORTMULTITHTTP_02_042: [ A device whose batch lingers and whose linger has not run out yet shall not count as having events to send. ]*/
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_ConnectionPoolSize_2_does_not_count_lingering_devices_as_busy)
 {
-    ///arrange
-    CIoTHubTransportHttpMocks mocks;
+	///arrange
+	CNiceCallComparer<CIoTHubTransportHttpMocks> mocks;
+	unsigned int batchLingerMs = 100;
+	unsigned int connectionPoolSize = 2;
+	DList_InsertTailList(&(waitingToSend), &(message1.entry));
+	DList_InsertTailList(&(waitingToSend2), &(message6.entry));
+	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	auto devHandle1 = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+	auto devHandle2 = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_2, TEST_IOTHUB_CLIENT_LL_HANDLE2, TEST_CONFIG2.waitingToSend);
+	ENABLE_BATCHING();
+	(void)IoTHubTransportHttp_SetOption(handle, "BatchLingerMs", &batchLingerMs);
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_Create(TEST_IOTHUB_NAME "." TEST_IOTHUB_SUFFIX))
+		.SetReturn(TEST_HTTPAPIEX_HANDLE2);
+	(void)IoTHubTransportHttp_SetOption(handle, "ConnectionPoolSize", &connectionPoolSize);
+	currentTickCounterMs = 1000;
+	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE); /*both devices start lingering*/
+	currentTickCounterMs += 1;
+	mocks.ResetAllCalls();
 
-    ///act
-    STRING_HANDLE hostname = IoTHubTransportHttp_GetHostname(NULL);
+	STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+		.IgnoreArgument(1)
+		.NeverInvoked();
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(IGNORED_PTR_ARG, IGNORED_PTR_ARG, HTTPAPI_REQUEST_POST, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments()
+		.NeverInvoked();
 
-    ///assert
-    ASSERT_IS_NULL(hostname);
-    mocks.AssertActualAndExpectedCalls();
+	///act
+	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
 
-    ///cleanup
+	///assert
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubTransportHttp_Unregister(devHandle1);
+	IoTHubTransportHttp_Unregister(devHandle2);
+	IoTHubTransportHttp_Destroy(handle);
 }
 
-/*Tests_SRS_TRANSPORTMULTITHTTP_02_001: [ If handle is NULL then IoTHubTransportHttp_GetHostname shall fail and return NULL. ]*/
-TEST_FUNCTION(IoTHubTransportHttp_GetHostname_with_non_NULL_handle_succeeds)
+/*Tests_SRS_TRANSPORTMULTITHTTP_02_034: [ If "BatchLingerAdaptive" is true and a batched POST has completed, then the linger shall be the smoothed round trip time of the batched POSTs, capped by "BatchLingerMs" when "BatchLingerMs" is not 0. ]*/
+/*Tests_SRS_TRANSPORTMULTITHTTP_02_035: [ The first batched POST that completes shall set the smoothed round trip time to its duration, every following one shall set it to (7 * smoothed + duration) / 8. ]*/
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_BatchLingerAdaptive_lingers_after_the_first_round_trip)
 {
-    ///arrange
-    CIoTHubTransportHttpMocks mocks;
-    TRANSPORT_LL_HANDLE handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
-    mocks.ResetAllCalls();
+	///arrange
+	CNiceCallComparer<CIoTHubTransportHttpMocks> mocks;
+	DList_InsertTailList(&(waitingToSend), &(message1.entry));
+	auto handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+	(void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_LL_HANDLE, TEST_CONFIG.waitingToSend);
+	ENABLE_BATCHING();
+	(void)IoTHubTransportHttp_SetOption(handle, "BatchLingerAdaptive", &thisIsTrue);
+	mocks.ResetAllCalls();
 
-    ///act
-    STRING_HANDLE hostname = IoTHubTransportHttp_GetHostname(handle);
+	/*no round trip is known yet, so the first batch is not held back*/
+	STRICT_EXPECTED_CALL(mocks, HTTPAPIEX_SAS_ExecuteRequest2(IGNORED_PTR_ARG, IGNORED_PTR_ARG, HTTPAPI_REQUEST_POST, "/devices/" TEST_DEVICE_ID EVENT_ENDPOINT API_VERSION, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, NULL, NULL))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2)
+		.IgnoreArgument(5)
+		.IgnoreArgument(6)
+		.IgnoreArgument(7)
+		.CopyOutArgumentBuffer(7, &httpStatus200, sizeof(httpStatus200))
+		.ExpectedTimesExactly(1);
 
-    ///assert
-    ASSERT_IS_NOT_NULL(hostname);
-    mocks.AssertActualAndExpectedCalls();
-    ASSERT_ARE_EQUAL(char_ptr, TEST_IOTHUB_NAME "." TEST_IOTHUB_SUFFIX, STRING_c_str(hostname));
+	///act
+	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+	DList_InsertTailList(&(waitingToSend), &(message2.entry));
+	IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE); /*the batch of message2 waits for the 1ms round trip*/
 
-    ///cleanup
-    IoTHubTransportHttp_Destroy(handle);
+	///assert
+	mocks.AssertActualAndExpectedCalls();
+
+	///cleanup
+	IoTHubTransportHttp_Destroy(handle);
 }
 
 END_TEST_SUITE(iothubtransporthttp)
-
@@ -57,6 +57,8 @@ static const char* TEST_EMPTY_STRING = "";
 static const char* TEST_SAS_TOKEN = "Test_SAS_Token_value";
 static const char* LOG_TRACE_OPTION = "logtrace";
 static const char* KEEP_ALIVE_OPTION = "keepalive";
+static const char* MAX_INFLIGHT_OPTION = "mqttMaxInflight";
+static const char* EVENT_QOS_OPTION = "mqttEventQos";
 const char* PROPERTY_SEPARATOR = "&";
 
 static const IOTHUB_DEVICE_CONFIG TEST_DEVICE_1 = { TEST_DEVICE_ID, TEST_DEVICE_KEY, NULL };
@@ -153,6 +155,7 @@ static ON_MQTT_MESSAGE_RECV_CALLBACK g_fnMqttMsgRecv;
 static ON_MQTT_OPERATION_CALLBACK g_fnMqttOperationCallback;
 static void* g_callbackCtx;
 static bool g_nullMapVariable;
+static const PUBLISH_ACK* g_pubackOnDoWork; /*when not NULL mqtt_client_dowork delivers this PUBACK*/
 
 TYPED_MOCK_CLASS(CIoTHubTransportMqttMocks, CGlobalMock)
 {
@@ -362,7 +365,11 @@ public:
         MOCK_METHOD_END(int, 0);
 
     MOCK_STATIC_METHOD_1(, void, mqtt_client_dowork, MQTT_CLIENT_HANDLE, handle)
-        MOCK_VOID_METHOD_END()
+        if (g_pubackOnDoWork != NULL)
+        {
+            g_fnMqttOperationCallback(handle, MQTT_CLIENT_ON_PUBLISH_ACK, g_pubackOnDoWork, g_callbackCtx);
+        }
+    MOCK_VOID_METHOD_END()
 
         MOCK_STATIC_METHOD_3(, void, mqtt_client_set_trace, MQTT_CLIENT_HANDLE, handle, bool, traceVal, bool, rawTraceLog)
         MOCK_VOID_METHOD_END()
@@ -604,6 +611,7 @@ TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
     g_fnMqttMsgRecv = NULL;
     g_fnMqttOperationCallback = NULL;
     g_callbackCtx = NULL;
+    g_pubackOnDoWork = NULL;
 
     g_current_ms = 0;
     g_tokenizerIndex = 0;
@@ -1235,6 +1243,8 @@ TEST_FUNCTION(IoTHubTransportMqtt_Destroy_One_Message_Ack_succeeds)
     STRICT_EXPECTED_CALL(mocks, mqtt_client_deinit(TEST_MQTT_CLIENT_HANDLE));
     EXPECTED_CALL(mocks, gballoc_free(NULL));
     EXPECTED_CALL(mocks, gballoc_free(NULL));
+    EXPECTED_CALL(mocks, gballoc_free(NULL));
+    EXPECTED_CALL(mocks, gballoc_free(NULL));
     STRICT_EXPECTED_CALL(mocks, xio_destroy(TEST_XIO_HANDLE));
     STRICT_EXPECTED_CALL(mocks, tickcounter_destroy(TEST_COUNTER_HANDLE));
 
@@ -1757,6 +1767,131 @@ TEST_FUNCTION(IoTHubTransportMqtt_Setoption_keepAlive_same_value_succeed)
     IoTHubTransportMqtt_Destroy(handle);
 }
 
+/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_02_007: [If the option parameter is set to "mqttMaxInflight" then the value shall be an unsigned int_ptr and the value will determine the maximum number of messages waiting for acknowledgement.] */
+TEST_FUNCTION(IoTHubTransportMqtt_Setoption_mqttMaxInflight_succeed)
+{
+    // arrange
+    CIoTHubTransportMqttMocks mocks;
+    IOTHUBTRANSPORT_CONFIG config = { 0 };
+    SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
+
+    auto handle = IoTHubTransportMqtt_Create(&config);
+    mocks.ResetAllCalls();
+
+    unsigned int maxInflight = 10;
+
+    // act
+    auto result = IoTHubTransportMqtt_SetOption(handle, MAX_INFLIGHT_OPTION, &maxInflight);
+
+    // assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+
+    mocks.AssertActualAndExpectedCalls();
+
+    //cleanup
+    IoTHubTransportMqtt_Destroy(handle);
+}
+
+/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_02_010: [If "mqttMaxInflight" is 0 or greater than 65534 then IoTHubTransportMqtt_SetOption shall return IOTHUB_CLIENT_INVALID_ARG.] */
+TEST_FUNCTION(IoTHubTransportMqtt_Setoption_mqttMaxInflight_0_fails)
+{
+    // arrange
+    CIoTHubTransportMqttMocks mocks;
+    IOTHUBTRANSPORT_CONFIG config = { 0 };
+    SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
+
+    auto handle = IoTHubTransportMqtt_Create(&config);
+    mocks.ResetAllCalls();
+
+    unsigned int maxInflight = 0;
+
+    // act
+    auto result = IoTHubTransportMqtt_SetOption(handle, MAX_INFLIGHT_OPTION, &maxInflight);
+
+    // assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+
+    mocks.AssertActualAndExpectedCalls();
+
+    //cleanup
+    IoTHubTransportMqtt_Destroy(handle);
+}
+
+/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_02_010: [If "mqttMaxInflight" is 0 or greater than 65534 then IoTHubTransportMqtt_SetOption shall return IOTHUB_CLIENT_INVALID_ARG.] */
+TEST_FUNCTION(IoTHubTransportMqtt_Setoption_mqttMaxInflight_too_big_fails)
+{
+    // arrange
+    CIoTHubTransportMqttMocks mocks;
+    IOTHUBTRANSPORT_CONFIG config = { 0 };
+    SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
+
+    auto handle = IoTHubTransportMqtt_Create(&config);
+    mocks.ResetAllCalls();
+
+    unsigned int maxInflight = 65535;
+
+    // act
+    auto result = IoTHubTransportMqtt_SetOption(handle, MAX_INFLIGHT_OPTION, &maxInflight);
+
+    // assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+
+    mocks.AssertActualAndExpectedCalls();
+
+    //cleanup
+    IoTHubTransportMqtt_Destroy(handle);
+}
+
+/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_02_013: [If the option parameter is set to "mqttEventQos" then the value shall be an unsigned int_ptr, 0 for DELIVER_AT_MOST_ONCE or 1 for DELIVER_AT_LEAST_ONCE, and the value will determine the QoS of the events published after it is set.] */
+TEST_FUNCTION(IoTHubTransportMqtt_Setoption_mqttEventQos_succeed)
+{
+    // arrange
+    CIoTHubTransportMqttMocks mocks;
+    IOTHUBTRANSPORT_CONFIG config = { 0 };
+    SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
+
+    auto handle = IoTHubTransportMqtt_Create(&config);
+    mocks.ResetAllCalls();
+
+    unsigned int eventQos = 0;
+
+    // act
+    auto result = IoTHubTransportMqtt_SetOption(handle, EVENT_QOS_OPTION, &eventQos);
+
+    // assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+
+    mocks.AssertActualAndExpectedCalls();
+
+    //cleanup
+    IoTHubTransportMqtt_Destroy(handle);
+}
+
+/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_02_016: [If "mqttEventQos" is neither 0 nor 1 then IoTHubTransportMqtt_SetOption shall return IOTHUB_CLIENT_INVALID_ARG.] */
+TEST_FUNCTION(IoTHubTransportMqtt_Setoption_mqttEventQos_2_fails)
+{
+    // arrange
+    CIoTHubTransportMqttMocks mocks;
+    IOTHUBTRANSPORT_CONFIG config = { 0 };
+    SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
+
+    auto handle = IoTHubTransportMqtt_Create(&config);
+    mocks.ResetAllCalls();
+
+    unsigned int eventQos = 2;
+
+    // act
+    auto result = IoTHubTransportMqtt_SetOption(handle, EVENT_QOS_OPTION, &eventQos);
+
+    // assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+
+    mocks.AssertActualAndExpectedCalls();
+
+    //cleanup
+    IoTHubTransportMqtt_Destroy(handle);
+}
+
 /* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_026: [IoTHubTransportMqtt_DoWork shall do nothing if parameter handle and/or iotHubClientHandle is NULL.] */
 TEST_FUNCTION(IoTHubTransportMqtt_DoWork_parameter_handle_NULL_fail)
 {
@@ -1875,7 +2010,8 @@ TEST_FUNCTION(IoTHubTransportMqtt_DoWork_with_1_event_item_succeeds)
     IoTHubTransportMqtt_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
     mocks.ResetAllCalls();
 
-    EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
+    EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+        .ExpectedTimesExactly(3);
     STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MSG_BYTEARRAY));
     STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MSG_BYTEARRAY, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreArgument(2)
@@ -1895,9 +2031,6 @@ TEST_FUNCTION(IoTHubTransportMqtt_DoWork_with_1_event_item_succeeds)
         .IgnoreArgument(2);
     STRICT_EXPECTED_CALL(mocks, mqttmessage_destroy(TEST_MQTT_MESSAGE_HANDLE));
     STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MSG_BYTEARRAY));
-    STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_MQTT_EVENT_TOPIC));
-    EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG));
     EXPECTED_CALL(mocks, Map_GetInternals(TEST_MESSAGE_PROP_MAP, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG))
         .IgnoreArgument(2);
@@ -1929,7 +2062,6 @@ TEST_FUNCTION(IoTHubTransportMqtt_DoWork_with_1_event_item_with_properties_succe
 
     const size_t propCount = 1;
     const char* TOPIC_PROPERTY_VALUE = "devices/thisIsDeviceID/messages/events/propKey1=propValue1";
-    const char* PROPERTY_VALUE = "propKey1=propValue1";
     const char* keys[propCount] = { "propKey1" };
     const char* values[propCount] = { "propValue1" };
 
@@ -1944,7 +2076,6 @@ TEST_FUNCTION(IoTHubTransportMqtt_DoWork_with_1_event_item_with_properties_succe
 
     EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
         .ExpectedTimesExactly(2);
-    EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MSG_BYTEARRAY));
     STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MSG_BYTEARRAY, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreArgument(2)
@@ -1963,15 +2094,10 @@ TEST_FUNCTION(IoTHubTransportMqtt_DoWork_with_1_event_item_with_properties_succe
         .IgnoreArgument(2);
     STRICT_EXPECTED_CALL(mocks, mqttmessage_destroy(TEST_MQTT_MESSAGE_HANDLE));
     STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MSG_BYTEARRAY));
-    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, PROPERTY_VALUE))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_MQTT_EVENT_TOPIC));
     STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MESSAGE_PROP_MAP, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
 		.CopyOutArgumentBuffer(2, &ppKeys, sizeof(ppKeys) )
 		.CopyOutArgumentBuffer(3, &ppValues, sizeof(ppValues) )
 		.CopyOutArgumentBuffer(4, &propCount, sizeof(propCount) );
-    EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG))
         .IgnoreArgument(2);
 
@@ -2003,7 +2129,6 @@ TEST_FUNCTION(IoTHubTransportMqtt_DoWork_with_1_event_item_with_2_properties_suc
     const size_t propCount = 2;
 
     const char* TOPIC_PROPERTY_VALUE = "devices/thisIsDeviceID/messages/events/propKey1=propValue1&propKey2=propValue2";
-    const char* PROPERTY_VALUE = "propKey1=propValue1&propKey2=propValue2";
 
     const char* keys[propCount] = { "propKey1", "propKey2" };
     const char* values[propCount] = { "propValue1", "propValue2" };
@@ -2018,8 +2143,6 @@ TEST_FUNCTION(IoTHubTransportMqtt_DoWork_with_1_event_item_with_2_properties_suc
 
     EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
         .ExpectedTimesExactly(3);
-    EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
-        .ExpectedTimesExactly(2);
     STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MSG_BYTEARRAY));
     STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MSG_BYTEARRAY, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreArgument(2)
@@ -2038,14 +2161,10 @@ TEST_FUNCTION(IoTHubTransportMqtt_DoWork_with_1_event_item_with_2_properties_suc
         .IgnoreArgument(2);
     STRICT_EXPECTED_CALL(mocks, mqttmessage_destroy(TEST_MQTT_MESSAGE_HANDLE));
     STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MSG_BYTEARRAY)).SetReturn(TEST_MESSAGE_PROP_MAP);
-    STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_MQTT_EVENT_TOPIC));
     STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MESSAGE_PROP_MAP, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .CopyOutArgumentBuffer(2, &ppKeys, sizeof(ppKeys))
         .CopyOutArgumentBuffer(3, &ppValues, sizeof(ppValues))
         .CopyOutArgumentBuffer(4, &propCount, sizeof(propCount));
-    EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, IGNORED_PTR_ARG)).ExpectedTimesExactly(2);
     STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG))
         .IgnoreArgument(2);
 
@@ -2059,7 +2178,7 @@ TEST_FUNCTION(IoTHubTransportMqtt_DoWork_with_1_event_item_with_2_properties_suc
     IoTHubTransportMqtt_Destroy(handle);
 }
 
-TEST_FUNCTION(IoTHubTransportMqtt_DoWork_with_1_event_item_with_properties_STRING_concat_fail)
+TEST_FUNCTION(IoTHubTransportMqtt_DoWork_with_1_event_item_with_properties_topic_malloc_fails)
 {
     // arrange
     CIoTHubTransportMqttMocks mocks;
@@ -2075,8 +2194,6 @@ TEST_FUNCTION(IoTHubTransportMqtt_DoWork_with_1_event_item_with_properties_STRIN
     g_nullMapVariable = false;
 
     const size_t propCount = 1;
-    const char* TOPIC_PROPERTY_VALUE = "devices/thisIsDeviceID/messages/events/propKey1=propValue1";
-    const char* PROPERTY_VALUE = "propKey1=propValue1";
     const char* keys[propCount] = { "propKey1" };
     const char* values[propCount] = { "propValue1" };
 
@@ -2089,8 +2206,12 @@ TEST_FUNCTION(IoTHubTransportMqtt_DoWork_with_1_event_item_with_properties_STRIN
     IoTHubTransportMqtt_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
     mocks.ResetAllCalls();
 
-    EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)).ExpectedTimesExactly(2);
-    EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG)).ExpectedTimesExactly(2);
+    /*the 3rd allocation is the topic, after the in flight entry and the in flight table*/
+    currentmalloc_call = 0;
+    whenShallmalloc_fail = 3;
+
+    EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)).ExpectedTimesExactly(3);
+    EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MSG_BYTEARRAY));
     STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetByteArray(TEST_IOTHUB_MSG_BYTEARRAY, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreArgument(2)
@@ -2101,18 +2222,14 @@ TEST_FUNCTION(IoTHubTransportMqtt_DoWork_with_1_event_item_with_properties_STRIN
 
     EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG));
     EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_SUCCESS));
+    STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_FAILED))
+        .IgnoreArgument(2);
 
     STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MSG_BYTEARRAY));
-    STRICT_EXPECTED_CALL(mocks, STRING_concat(IGNORED_PTR_ARG, PROPERTY_VALUE))
-        .IgnoreArgument(1)
-        .SetReturn(__LINE__);
-    STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_MQTT_EVENT_TOPIC));
     STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MESSAGE_PROP_MAP, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .CopyOutArgumentBuffer(2, &ppKeys, sizeof(ppKeys))
         .CopyOutArgumentBuffer(3, &ppValues, sizeof(ppValues))
         .CopyOutArgumentBuffer(4, &propCount, sizeof(propCount));
-    EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG))
         .IgnoreArgument(2);
 
@@ -2126,6 +2243,53 @@ TEST_FUNCTION(IoTHubTransportMqtt_DoWork_with_1_event_item_with_properties_STRIN
     IoTHubTransportMqtt_Destroy(handle);
 }
 
+/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_02_017: [IoTHubTransportMqtt_DoWork shall build the topic of a message, with its properties percent-encoded, only when the message is first published and shall reuse it when the message is resent.] */
+TEST_FUNCTION(IoTHubTransportMqtt_DoWork_with_1_event_item_percent_encodes_the_properties)
+{
+    // arrange
+    CNiceCallComparer<CIoTHubTransportMqttMocks> mocks;
+    IOTHUBTRANSPORT_CONFIG config = { 0 };
+    SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
+
+    QOS_VALUE QosValue[] = { DELIVER_AT_LEAST_ONCE };
+    SUBSCRIBE_ACK suback;
+    suback.packetId = 1234;
+    suback.qosCount = 1;
+    suback.qosReturn = QosValue;
+
+    g_nullMapVariable = false;
+
+    const size_t propCount = 2;
+    const char* TOPIC_PROPERTY_VALUE = "devices/thisIsDeviceID/messages/events/a%20b=c%26d%3De&path=%2Fx%2Fy-z_1.2~";
+    const char* keys[propCount] = { "a b", "path" };
+    const char* values[propCount] = { "c&d=e", "/x/y-z_1.2~" };
+
+    const char* const** ppKeys = (const char* const**)&keys;
+    const char* const** ppValues = (const char* const**)&values;
+
+    DList_InsertTailList(config.waitingToSend, &(message1.entry));
+    auto handle = IoTHubTransportMqtt_Create(&config);
+    g_fnMqttOperationCallback(TEST_MQTT_CLIENT_HANDLE, MQTT_CLIENT_ON_SUBSCRIBE_ACK, &suback, g_callbackCtx);
+    IoTHubTransportMqtt_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, Map_GetInternals(TEST_MESSAGE_PROP_MAP, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .CopyOutArgumentBuffer(2, &ppKeys, sizeof(ppKeys))
+        .CopyOutArgumentBuffer(3, &ppValues, sizeof(ppValues))
+        .CopyOutArgumentBuffer(4, &propCount, sizeof(propCount));
+    STRICT_EXPECTED_CALL(mocks, mqttmessage_create(IGNORED_NUM_ARG, TOPIC_PROPERTY_VALUE, DELIVER_AT_LEAST_ONCE, appMessage, appMsgSize))
+        .IgnoreArgument(1);
+
+    // act
+    IoTHubTransportMqtt_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+
+    //assert
+    mocks.AssertActualAndExpectedCalls();
+
+    //cleanup
+    IoTHubTransportMqtt_Destroy(handle);
+}
+
 TEST_FUNCTION(IoTHubTransportMqtt_DoWork_no_subscribe_succeeds)
 {
     // arrange
@@ -2182,7 +2346,8 @@ TEST_FUNCTION(IoTHubTransportMqtt_DoWork_with_1_event_item_STRING_type_succeeds)
     IoTHubTransportMqtt_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
     mocks.ResetAllCalls();
 
-    EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
+    EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+        .ExpectedTimesExactly(3);
     STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MSG_STRING));
     STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetString(TEST_IOTHUB_MSG_STRING));
 	STRICT_EXPECTED_CALL(mocks, mqttmessage_create(IGNORED_NUM_ARG, IGNORED_PTR_ARG, DELIVER_AT_LEAST_ONCE, (const uint8_t*)appMessageString, strlen(appMessageString) ))
@@ -2200,9 +2365,6 @@ TEST_FUNCTION(IoTHubTransportMqtt_DoWork_with_1_event_item_STRING_type_succeeds)
         .IgnoreArgument(2);
     STRICT_EXPECTED_CALL(mocks, mqttmessage_destroy(TEST_MQTT_MESSAGE_HANDLE));
     STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MSG_STRING));
-    STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_MQTT_EVENT_TOPIC));
-    EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG));
     EXPECTED_CALL(mocks, Map_GetInternals(TEST_MESSAGE_PROP_MAP, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG))
         .IgnoreArgument(2);
@@ -2254,6 +2416,8 @@ TEST_FUNCTION(IoTHubTransportMqtt_DoWork_no_resend_message_succeeds)
 }
 
 /* Test_SRS_IOTHUB_MQTT_TRANSPORT_07_033: [IoTHubTransportMqtt_DoWork shall iterate through the Waiting Acknowledge messages looking for any message that has been waiting longer than 2 min.]*/
+/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_02_003: [IoTHubTransportMqtt_DoWork shall resend a message with the packet id that the message was first published with.] */
+/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_02_017: [IoTHubTransportMqtt_DoWork shall build the topic of a message, with its properties percent-encoded, only when the message is first published and shall reuse it when the message is resent.] */
 TEST_FUNCTION(IoTHubTransportMqtt_DoWork_resend_message_succeeds)
 {
     // arrange
@@ -2278,23 +2442,16 @@ TEST_FUNCTION(IoTHubTransportMqtt_DoWork_resend_message_succeeds)
 
     STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetContentType(TEST_IOTHUB_MSG_STRING));
     STRICT_EXPECTED_CALL(mocks, IoTHubMessage_GetString(TEST_IOTHUB_MSG_STRING));
-    STRICT_EXPECTED_CALL(mocks, mqttmessage_create(IGNORED_NUM_ARG, IGNORED_PTR_ARG, DELIVER_AT_LEAST_ONCE, (const uint8_t*)appMessageString, strlen(appMessageString)))
-        .IgnoreArgument(1)
+    STRICT_EXPECTED_CALL(mocks, mqttmessage_create(1, IGNORED_PTR_ARG, DELIVER_AT_LEAST_ONCE, (const uint8_t*)appMessageString, strlen(appMessageString)))
         .IgnoreArgument(2);
     STRICT_EXPECTED_CALL(mocks, mqtt_client_publish(TEST_MQTT_CLIENT_HANDLE, IGNORED_PTR_ARG))
         .IgnoreArgument(2);
     STRICT_EXPECTED_CALL(mocks, mqtt_client_dowork(TEST_MQTT_CLIENT_HANDLE));
-    EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG))
         .IgnoreArgument(2);
     STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG))
         .IgnoreArgument(2);
     STRICT_EXPECTED_CALL(mocks, mqttmessage_destroy(TEST_MQTT_MESSAGE_HANDLE));
-    STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MSG_STRING));
-    STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_MQTT_EVENT_TOPIC));
-    EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, Map_GetInternals(TEST_MESSAGE_PROP_MAP, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG))
         .IgnoreArgument(2);
 
@@ -2343,7 +2500,8 @@ TEST_FUNCTION(IoTHubTransportMqtt_DoWork_resend_max_recount_reached_message_succ
     STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG))
         .IgnoreArgument(2)
         .ExpectedAtLeastTimes(2);
-    EXPECTED_CALL(mocks, gballoc_free(NULL));
+    EXPECTED_CALL(mocks, gballoc_free(NULL))
+        .ExpectedTimesExactly(2);
 
     // act
     IoTHubTransportMqtt_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
@@ -2467,13 +2625,12 @@ TEST_FUNCTION(IoTHubTransportMqtt_DoWork_mqtt_client_publish_fails)
     EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_FAILED))
         .IgnoreArgument(2);
-    EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
-    EXPECTED_CALL(mocks, gballoc_free(NULL));
+    EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+        .ExpectedTimesExactly(3);
+    EXPECTED_CALL(mocks, gballoc_free(NULL))
+        .ExpectedTimesExactly(2);
     STRICT_EXPECTED_CALL(mocks, mqttmessage_destroy(TEST_MQTT_MESSAGE_HANDLE));
     STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MSG_BYTEARRAY));
-    STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_MQTT_EVENT_TOPIC));
-    EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG));
     EXPECTED_CALL(mocks, Map_GetInternals(TEST_MESSAGE_PROP_MAP, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
 
@@ -2523,13 +2680,12 @@ TEST_FUNCTION(IoTHubTransportMqtt_DoWork_mqttmessage_create_fails)
     EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_FAILED))
         .IgnoreArgument(2);
-    EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
-    EXPECTED_CALL(mocks, gballoc_free(NULL));
+    EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+        .ExpectedTimesExactly(3);
+    EXPECTED_CALL(mocks, gballoc_free(NULL))
+        .ExpectedTimesExactly(2);
     EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(mocks, IoTHubMessage_Properties(TEST_IOTHUB_MSG_BYTEARRAY));
-    STRICT_EXPECTED_CALL(mocks, STRING_construct(TEST_MQTT_EVENT_TOPIC));
-    EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG));
     EXPECTED_CALL(mocks, Map_GetInternals(TEST_MESSAGE_PROP_MAP, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(TEST_COUNTER_HANDLE, IGNORED_PTR_ARG)).IgnoreArgument(2);
 
@@ -2585,6 +2741,176 @@ TEST_FUNCTION(IoTHubTransportMqtt_DoWork_connectFailCount_exceed_succeed)
     IoTHubTransportMqtt_Destroy(handle);
 }
 
+/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_02_008: [IoTHubTransportMqtt_DoWork shall not publish a new message while the number of messages waiting for acknowledgement is "mqttMaxInflight" or more.] */
+TEST_FUNCTION(IoTHubTransportMqtt_DoWork_inflight_window_full_keeps_messages_waiting)
+{
+    // arrange
+    CNiceCallComparer<CIoTHubTransportMqttMocks> mocks;
+    IOTHUBTRANSPORT_CONFIG config = { 0 };
+    SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
+
+    QOS_VALUE QosValue[] = { DELIVER_AT_LEAST_ONCE };
+    SUBSCRIBE_ACK suback;
+    suback.packetId = 1234;
+    suback.qosCount = 1;
+    suback.qosReturn = QosValue;
+
+    unsigned int maxInflight = 1;
+
+    DList_InsertTailList(config.waitingToSend, &(message1.entry));
+    DList_InsertTailList(config.waitingToSend, &(message2.entry));
+    auto handle = IoTHubTransportMqtt_Create(&config);
+    (void)IoTHubTransportMqtt_SetOption(handle, MAX_INFLIGHT_OPTION, &maxInflight);
+    g_fnMqttOperationCallback(TEST_MQTT_CLIENT_HANDLE, MQTT_CLIENT_ON_SUBSCRIBE_ACK, &suback, g_callbackCtx);
+    IoTHubTransportMqtt_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, mqttmessage_create(1, IGNORED_PTR_ARG, DELIVER_AT_LEAST_ONCE, appMessage, appMsgSize))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, mqtt_client_publish(TEST_MQTT_CLIENT_HANDLE, IGNORED_PTR_ARG))
+        .IgnoreArgument(2);
+
+    // act
+    IoTHubTransportMqtt_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+
+    //assert
+    mocks.AssertActualAndExpectedCalls();
+    ASSERT_ARE_EQUAL(void_ptr, (void*)&(message2.entry), (void*)g_waitingToSend.Flink);
+
+    //cleanup
+    IoTHubTransportMqtt_Destroy(handle);
+}
+
+/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_02_009: [If the in flight window was full and PUBACKs received by mqtt_client_dowork have freed slots in it then IoTHubTransportMqtt_DoWork shall publish waiting messages into the freed slots before returning.] */
+TEST_FUNCTION(IoTHubTransportMqtt_DoWork_PUBLISH_ACK_refills_the_inflight_window)
+{
+    // arrange
+    CNiceCallComparer<CIoTHubTransportMqttMocks> mocks;
+    IOTHUBTRANSPORT_CONFIG config = { 0 };
+    SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
+
+    QOS_VALUE QosValue[] = { DELIVER_AT_LEAST_ONCE };
+    SUBSCRIBE_ACK suback;
+    suback.packetId = 1234;
+    suback.qosCount = 1;
+    suback.qosReturn = QosValue;
+
+    PUBLISH_ACK puback;
+    puback.packetId = 1;
+
+    unsigned int maxInflight = 1;
+
+    DList_InsertTailList(config.waitingToSend, &(message1.entry));
+    DList_InsertTailList(config.waitingToSend, &(message2.entry));
+    auto handle = IoTHubTransportMqtt_Create(&config);
+    (void)IoTHubTransportMqtt_SetOption(handle, MAX_INFLIGHT_OPTION, &maxInflight);
+    g_fnMqttOperationCallback(TEST_MQTT_CLIENT_HANDLE, MQTT_CLIENT_ON_SUBSCRIBE_ACK, &suback, g_callbackCtx);
+    IoTHubTransportMqtt_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+    IoTHubTransportMqtt_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+    g_pubackOnDoWork = &puback;
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_SUCCESS))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, mqttmessage_create(2, IGNORED_PTR_ARG, DELIVER_AT_LEAST_ONCE, (const uint8_t*)appMessageString, strlen(appMessageString)))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, mqtt_client_publish(TEST_MQTT_CLIENT_HANDLE, IGNORED_PTR_ARG))
+        .IgnoreArgument(2);
+
+    // act
+    IoTHubTransportMqtt_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+
+    //assert
+    mocks.AssertActualAndExpectedCalls();
+    ASSERT_IS_TRUE(g_waitingToSend.Flink == &g_waitingToSend);
+
+    //cleanup
+    g_pubackOnDoWork = NULL;
+    IoTHubTransportMqtt_Destroy(handle);
+}
+
+/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_02_014: [If "mqttEventQos" is 0 then IoTHubTransportMqtt_DoWork shall publish the message with DELIVER_AT_MOST_ONCE and packet id 0 and shall not add it to the messages waiting for acknowledgement.] */
+/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_02_015: [The message shall be completed as soon as mqtt_client_publish returns, with IOTHUB_BATCHSTATE_SUCCESS if it succeeded and IOTHUB_BATCHSTATE_FAILED otherwise.] */
+TEST_FUNCTION(IoTHubTransportMqtt_DoWork_mqttEventQos_0_publishes_and_completes_the_message)
+{
+    // arrange
+    CNiceCallComparer<CIoTHubTransportMqttMocks> mocks;
+    IOTHUBTRANSPORT_CONFIG config = { 0 };
+    SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
+
+    QOS_VALUE QosValue[] = { DELIVER_AT_LEAST_ONCE };
+    SUBSCRIBE_ACK suback;
+    suback.packetId = 1234;
+    suback.qosCount = 1;
+    suback.qosReturn = QosValue;
+
+    unsigned int eventQos = 0;
+
+    DList_InsertTailList(config.waitingToSend, &(message1.entry));
+    auto handle = IoTHubTransportMqtt_Create(&config);
+    (void)IoTHubTransportMqtt_SetOption(handle, EVENT_QOS_OPTION, &eventQos);
+    g_fnMqttOperationCallback(TEST_MQTT_CLIENT_HANDLE, MQTT_CLIENT_ON_SUBSCRIBE_ACK, &suback, g_callbackCtx);
+    IoTHubTransportMqtt_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, mqttmessage_create(0, IGNORED_PTR_ARG, DELIVER_AT_MOST_ONCE, appMessage, appMsgSize))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, mqtt_client_publish(TEST_MQTT_CLIENT_HANDLE, IGNORED_PTR_ARG))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_SUCCESS))
+        .IgnoreArgument(2);
+
+    // act
+    IoTHubTransportMqtt_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+
+    //assert
+    mocks.AssertActualAndExpectedCalls();
+    ASSERT_IS_TRUE(g_waitingToSend.Flink == &g_waitingToSend);
+
+    //cleanup
+    IoTHubTransportMqtt_Destroy(handle);
+}
+
+/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_02_015: [The message shall be completed as soon as mqtt_client_publish returns, with IOTHUB_BATCHSTATE_SUCCESS if it succeeded and IOTHUB_BATCHSTATE_FAILED otherwise.] */
+TEST_FUNCTION(IoTHubTransportMqtt_DoWork_mqttEventQos_0_publish_fails_completes_the_message_as_failed)
+{
+    // arrange
+    CNiceCallComparer<CIoTHubTransportMqttMocks> mocks;
+    IOTHUBTRANSPORT_CONFIG config = { 0 };
+    SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
+
+    QOS_VALUE QosValue[] = { DELIVER_AT_LEAST_ONCE };
+    SUBSCRIBE_ACK suback;
+    suback.packetId = 1234;
+    suback.qosCount = 1;
+    suback.qosReturn = QosValue;
+
+    unsigned int eventQos = 0;
+
+    DList_InsertTailList(config.waitingToSend, &(message1.entry));
+    auto handle = IoTHubTransportMqtt_Create(&config);
+    (void)IoTHubTransportMqtt_SetOption(handle, EVENT_QOS_OPTION, &eventQos);
+    g_fnMqttOperationCallback(TEST_MQTT_CLIENT_HANDLE, MQTT_CLIENT_ON_SUBSCRIBE_ACK, &suback, g_callbackCtx);
+    IoTHubTransportMqtt_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, mqtt_client_publish(TEST_MQTT_CLIENT_HANDLE, IGNORED_PTR_ARG))
+        .IgnoreArgument(2)
+        .SetReturn(__LINE__);
+    STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_FAILED))
+        .IgnoreArgument(2);
+
+    // act
+    IoTHubTransportMqtt_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+
+    //assert
+    mocks.AssertActualAndExpectedCalls();
+    ASSERT_IS_TRUE(g_waitingToSend.Flink == &g_waitingToSend);
+
+    //cleanup
+    IoTHubTransportMqtt_Destroy(handle);
+}
+
 /* Test_SRS_IOTHUB_MQTT_TRANSPORT_07_023: [IoTHubTransportMqtt_GetSendStatus shall return IOTHUB_CLIENT_INVALID_ARG if called with NULL parameter.] */
 TEST_FUNCTION(IoTHubTransportMqtt_GetSendStatus_InvalidHandleArgument_fail)
 {
@@ -2872,7 +3198,42 @@ TEST_FUNCTION(IoTHubTransportMqtt_MqttOpCompleteCallback_PUBLISH_ACK_succeed)
     STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_SUCCESS))
         .IgnoreArgument(2);
     STRICT_EXPECTED_CALL(mocks, gballoc_free(NULL))
-        .IgnoreArgument(1);
+        .IgnoreArgument(1)
+        .ExpectedTimesExactly(2);
+
+    // act
+    g_fnMqttOperationCallback(TEST_MQTT_CLIENT_HANDLE, MQTT_CLIENT_ON_PUBLISH_ACK, &puback, g_callbackCtx);
+
+    //assert
+    mocks.AssertActualAndExpectedCalls();
+
+    //cleanup
+    IoTHubTransportMqtt_Destroy(handle);
+}
+
+/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_02_006: [If no message waiting for acknowledgement has the packet id of the PUBACK then the PUBACK shall be ignored.] */
+TEST_FUNCTION(IoTHubTransportMqtt_MqttOpCompleteCallback_PUBLISH_ACK_unknown_packetId_does_nothing)
+{
+    // arrange
+    CIoTHubTransportMqttMocks mocks;
+    IOTHUBTRANSPORT_CONFIG config = { 0 };
+    SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
+
+    PUBLISH_ACK puback;
+    puback.packetId = 2;
+
+    QOS_VALUE QosValue[] = { DELIVER_AT_LEAST_ONCE };
+    SUBSCRIBE_ACK suback;
+    suback.packetId = 1234;
+    suback.qosCount = 1;
+    suback.qosReturn = QosValue;
+
+    DList_InsertTailList(config.waitingToSend, &(message1.entry));
+    auto handle = IoTHubTransportMqtt_Create(&config);
+    g_fnMqttOperationCallback(TEST_MQTT_CLIENT_HANDLE, MQTT_CLIENT_ON_SUBSCRIBE_ACK, &suback, g_callbackCtx);
+    IoTHubTransportMqtt_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+    IoTHubTransportMqtt_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+    mocks.ResetAllCalls();
 
     // act
     g_fnMqttOperationCallback(TEST_MQTT_CLIENT_HANDLE, MQTT_CLIENT_ON_PUBLISH_ACK, &puback, g_callbackCtx);
@@ -2884,6 +3245,54 @@ TEST_FUNCTION(IoTHubTransportMqtt_MqttOpCompleteCallback_PUBLISH_ACK_succeed)
     IoTHubTransportMqtt_Destroy(handle);
 }
 
+/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_02_005: [When a PUBACK is received the message waiting for acknowledgement that has the packet id of the PUBACK shall be found without walking the list of messages waiting for acknowledgement and shall be completed with IOTHUB_BATCHSTATE_SUCCESS.] */
+TEST_FUNCTION(IoTHubTransportMqtt_MqttOpCompleteCallback_PUBLISH_ACK_out_of_order_completes_only_the_acknowledged_message)
+{
+    // arrange
+    CIoTHubTransportMqttMocks mocks;
+    IOTHUBTRANSPORT_CONFIG config = { 0 };
+    SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
+
+    PUBLISH_ACK puback;
+    puback.packetId = 2;
+
+    QOS_VALUE QosValue[] = { DELIVER_AT_LEAST_ONCE };
+    SUBSCRIBE_ACK suback;
+    suback.packetId = 1234;
+    suback.qosCount = 1;
+    suback.qosReturn = QosValue;
+
+    DList_InsertTailList(config.waitingToSend, &(message1.entry));
+    DList_InsertTailList(config.waitingToSend, &(message2.entry));
+    auto handle = IoTHubTransportMqtt_Create(&config);
+    g_fnMqttOperationCallback(TEST_MQTT_CLIENT_HANDLE, MQTT_CLIENT_ON_SUBSCRIBE_ACK, &suback, g_callbackCtx);
+    IoTHubTransportMqtt_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+    IoTHubTransportMqtt_DoWork(handle, TEST_IOTHUB_CLIENT_LL_HANDLE);
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, DList_RemoveEntryList(IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, DList_InitializeListHead(IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, IoTHubClient_LL_SendComplete(TEST_IOTHUB_CLIENT_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_BATCHSTATE_SUCCESS))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, gballoc_free(NULL))
+        .IgnoreArgument(1)
+        .ExpectedTimesExactly(2);
+
+    // act
+    g_fnMqttOperationCallback(TEST_MQTT_CLIENT_HANDLE, MQTT_CLIENT_ON_PUBLISH_ACK, &puback, g_callbackCtx);
+    g_fnMqttOperationCallback(TEST_MQTT_CLIENT_HANDLE, MQTT_CLIENT_ON_PUBLISH_ACK, &puback, g_callbackCtx);
+
+    //assert
+    mocks.AssertActualAndExpectedCalls();
+
+    //cleanup
+    IoTHubTransportMqtt_Destroy(handle);
+}
+
 TEST_FUNCTION(IoTHubTransportMqtt_MessageRecv_message_NULL_fail)
 {
     // arrange
@@ -491,39 +491,41 @@ static int ValidateDecimal(const char* v, size_t vlen)
     return result;
 }
 
+/*maps a character to its base64char value, characters that are not base64char map to BASE64_INVALID_CHAR*/
+#define BASE64_INVALID_CHAR 0xFF
+static const unsigned char base64charToValue[256] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x3E, 0xFF, 0xFF,
+    0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x3B, 0x3C, 0x3D, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E,
+    0x0F, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0xFF, 0xFF, 0xFF, 0xFF, 0x3F,
+    0xFF, 0x1A, 0x1B, 0x1C, 0x1D, 0x1E, 0x1F, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2A, 0x2B, 0x2C, 0x2D, 0x2E, 0x2F, 0x30, 0x31, 0x32, 0x33, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF
+};
+
 /*return 0 if everything went ok*/
 /*takes 1 base64char and returns its value*/
 static int base64toValue(char base64charSource, unsigned char* value)
 {
     int result;
-    if (('A' <= base64charSource) && (base64charSource <= 'Z'))
-    {
-        *value = base64charSource - 'A';
-        result = 0;
-    }
-    else if (('a' <= base64charSource) && (base64charSource <= 'z'))
+    unsigned char temp = base64charToValue[(unsigned char)base64charSource];
+    if (temp == BASE64_INVALID_CHAR)
     {
-        *value = ('Z' - 'A') +1+ (base64charSource - 'a');
-        result = 0;
-    }
-    else if (('0' <= base64charSource) && (base64charSource <= '9'))
-    {
-        *value = ('Z' - 'A') +1+('z'-'a')+1 +(base64charSource - '0');
-        result = 0;
-    }
-    else if ('-' == base64charSource)
-    {
-        *value = 62;
-        result = 0;
-    }
-    else if ('_' == base64charSource)
-    {
-        *value = 63;
-        result = 0;
+        result = 1;
     }
     else
     {
-        result = 1;
+        *value = temp;
+        result = 0;
     }
     return result;
 }
@@ -539,13 +541,12 @@ static int scan4base64char(const char* source, size_t sourceSize, unsigned char
     }
     else
     {
-        unsigned char b0, b1, b2, b3;
-        if (
-            (base64toValue(source[0], &b0) == 0) &&
-            (base64toValue(source[1], &b1) == 0) &&
-            (base64toValue(source[2], &b2) == 0) &&
-            (base64toValue(source[3], &b3) == 0)
-            )
+        unsigned char b0 = base64charToValue[(unsigned char)source[0]];
+        unsigned char b1 = base64charToValue[(unsigned char)source[1]];
+        unsigned char b2 = base64charToValue[(unsigned char)source[2]];
+        unsigned char b3 = base64charToValue[(unsigned char)source[3]];
+        /*valid values are 0...63, so any invalid character sets the high bit of the OR*/
+        if (((b0 | b1 | b2 | b3) & 0xC0) == 0)
         {
             *destination0 = (b0 << 2) | ((b1 & 0x30) >> 4);
             *destination1 = ((b1 & 0x0F)<<4) | ((b2 & 0x3C) >>2 );
@@ -561,33 +562,39 @@ static int scan4base64char(const char* source, size_t sourceSize, unsigned char
 }
 
 /*return 0 if the character is one of ( 'A' / 'E' / 'I' / 'M' / 'Q' / 'U' / 'Y' / 'c' / 'g' / 'k' / 'o' / 's' / 'w' / '0' / '4' / '8' )*/
+/*those are exactly the base64char that have the 2 low bits 0*/
 static int base64b16toValue(unsigned char source, unsigned char* destination)
 {
-    unsigned char i;
-    for (i = 0; i <= 15; i++)
+    int result;
+    unsigned char value = base64charToValue[source];
+    if ((value == BASE64_INVALID_CHAR) || ((value & 0x03) != 0))
     {
-        if (base64b16[i] == source)
-        {
-            *destination = i;
-            return 0;
-        }
+        result = 1;
     }
-    return 1;
+    else
+    {
+        *destination = value >> 2;
+        result = 0;
+    }
+    return result;
 }
 
 /*return 0 if the character is one of ( 'A' / 'Q' / 'g' / 'w' )*/
+/*those are exactly the base64char that have the 4 low bits 0*/
 static int base64b8toValue(unsigned char source, unsigned char* destination)
 {
-    unsigned char i;
-    for (i = 0; i <= 3; i++)
+    int result;
+    unsigned char value = base64charToValue[source];
+    if ((value == BASE64_INVALID_CHAR) || ((value & 0x0F) != 0))
     {
-        if (base64b8[i] == source)
-        {
-            *destination = i;
-            return 0;
-        }
+        result = 1;
     }
-    return 1;
+    else
+    {
+        *destination = value >> 4;
+        result = 0;
+    }
+    return result;
 }
 
 
@@ -68,6 +68,7 @@ public class TestJavaWrapper
         assertEquals(IOTHUB_CLIENT_RESULT.IOTHUB_CLIENT_ERROR, 2);
         assertEquals(IOTHUB_CLIENT_RESULT.IOTHUB_CLIENT_INVALID_SIZE, 3);
         assertEquals(IOTHUB_CLIENT_RESULT.IOTHUB_CLIENT_INDEFINITE_TIME, 4);
+        assertEquals(IOTHUB_CLIENT_RESULT.IOTHUB_CLIENT_BUSY, 5);
     }
     
     @Test
@@ -723,6 +723,7 @@ public:
         case IOTHUB_CLIENT_ERROR: s << "ERROR"; break;
         case IOTHUB_CLIENT_INVALID_SIZE: s << "INVALID_SIZE"; break;
         case IOTHUB_CLIENT_INDEFINITE_TIME: s << "INDEFINITE_TIME"; break;
+        case IOTHUB_CLIENT_BUSY: s << "BUSY"; break;
         }
         return s.str();
     }
@@ -1185,6 +1186,7 @@ BOOST_PYTHON_MODULE(IMPORT_NAME)
         .value("ERROR", IOTHUB_CLIENT_ERROR)
         .value("INVALID_SIZE", IOTHUB_CLIENT_INVALID_SIZE)
         .value("INDEFINITE_TIME", IOTHUB_CLIENT_INDEFINITE_TIME)
+        .value("BUSY", IOTHUB_CLIENT_BUSY)
         ;
 
     enum_<IOTHUB_CLIENT_STATUS>("IoTHubClientStatus")
@@ -1197,6 +1199,7 @@ BOOST_PYTHON_MODULE(IMPORT_NAME)
         .value("BECAUSE_DESTROY", IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY)
         .value("MESSAGE_TIMEOUT", IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT)
         .value("ERROR", IOTHUB_CLIENT_CONFIRMATION_ERROR)
+        .value("BECAUSE_QUEUE_FULL", IOTHUB_CLIENT_CONFIRMATION_BECAUSE_QUEUE_FULL)
         ;
 
     enum_<IOTHUBMESSAGE_DISPOSITION_RESULT>("IoTHubMessageDispositionResult")
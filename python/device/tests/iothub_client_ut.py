@@ -164,7 +164,8 @@ class TestEnumDefinitions(unittest.TestCase):
         self.assertEqual(IoTHubClientResult.ERROR, 2)
         self.assertEqual(IoTHubClientResult.INVALID_SIZE, 3)
         self.assertEqual(IoTHubClientResult.INDEFINITE_TIME, 4)
-        lastEnum = IoTHubClientResult.INDEFINITE_TIME + 1
+        self.assertEqual(IoTHubClientResult.BUSY, 5)
+        lastEnum = IoTHubClientResult.BUSY + 1
         with self.assertRaises(AttributeError):
             self.assertEqual(IoTHubClientResult.ANY, 0)
         clientResult = IoTHubClientResult()
@@ -188,7 +189,8 @@ class TestEnumDefinitions(unittest.TestCase):
         self.assertEqual(IoTHubClientConfirmationResult.BECAUSE_DESTROY, 1)
         self.assertEqual(IoTHubClientConfirmationResult.MESSAGE_TIMEOUT, 2)
         self.assertEqual(IoTHubClientConfirmationResult.ERROR, 3)
-        lastEnum = IoTHubClientConfirmationResult.ERROR + 1
+        self.assertEqual(IoTHubClientConfirmationResult.BECAUSE_QUEUE_FULL, 4)
+        lastEnum = IoTHubClientConfirmationResult.BECAUSE_QUEUE_FULL + 1
         with self.assertRaises(AttributeError):
             self.assertEqual(IoTHubClientConfirmationResult.ANY, 0)
         confirmationResult = IoTHubClientConfirmationResult()